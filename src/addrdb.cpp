@@ -170,13 +170,15 @@ bool CAddrDB::Read(CAddrMan& addr)
     // Don't try to resize to a negative number if file is small
     if (fileSize >= sizeof(uint256))
         dataSize = fileSize - sizeof(uint256);
-    std::vector<unsigned char> vchData;
-    vchData.resize(dataSize);
+    // Read straight into the stream, a large table isn't copied once more
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    ssPeers.resize(dataSize);
     uint256 hashIn;
 
     // read data and checksum from file
     try {
-        filein.read((char *)&vchData[0], dataSize);
+        if (dataSize)
+            filein.read((char *)&ssPeers[0], dataSize);
         filein >> hashIn;
     }
     catch (const std::exception& e) {
@@ -184,8 +186,6 @@ bool CAddrDB::Read(CAddrMan& addr)
     }
     filein.fclose();
 
-    CDataStream ssPeers(vchData, SER_DISK, CLIENT_VERSION);
-
     // verify stored checksum matches input data
     uint256 hashTmp = HashKeccak(ssPeers.begin(), ssPeers.end());
     if (hashIn != hashTmp)
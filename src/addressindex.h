@@ -79,4 +79,50 @@ struct CMempoolAddressDeltaKeyCompare
     }
 };
 
+/** Orders the mempool deltas of an address by the time their transaction entered the mempool. */
+struct CMempoolAddressDeltaTimeKey
+{
+    int type;
+    uint160 addressBytes;
+    int64_t time;
+    uint256 txhash;
+    unsigned int index;
+    int spending;
+
+    CMempoolAddressDeltaTimeKey(const CMempoolAddressDeltaKey &key, int64_t t) {
+        type = key.type;
+        addressBytes = key.addressBytes;
+        time = t;
+        txhash = key.txhash;
+        index = key.index;
+        spending = key.spending;
+    }
+
+    CMempoolAddressDeltaTimeKey(int addressType, uint160 addressHash, int64_t t) {
+        type = addressType;
+        addressBytes = addressHash;
+        time = t;
+        txhash.SetNull();
+        index = 0;
+        spending = 0;
+    }
+};
+
+struct CMempoolAddressDeltaTimeKeyCompare
+{
+    bool operator()(const CMempoolAddressDeltaTimeKey& a, const CMempoolAddressDeltaTimeKey& b) const {
+        if (a.type != b.type)
+            return a.type < b.type;
+        if (a.addressBytes != b.addressBytes)
+            return a.addressBytes < b.addressBytes;
+        if (a.time != b.time)
+            return a.time < b.time;
+        if (a.txhash != b.txhash)
+            return a.txhash < b.txhash;
+        if (a.index != b.index)
+            return a.index < b.index;
+        return a.spending < b.spending;
+    }
+};
+
 #endif // BITCOIN_ADDRESSINDEX_H
@@ -7,6 +7,7 @@
 #include "hash.h"
 #include "uint256.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <stdint.h>
 #include <string.h>
@@ -20,6 +21,36 @@ static const char* pszBase58 = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnop
 
 bool fUseNewAddressFormat = DEFAULT_USE_NEW_ADDRESS_FORMAT;
 
+/** Digit of each character, -1 for the ones which aren't base58 */
+static const int8_t mapBase58[256] = {
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1, 0, 1, 2, 3, 4, 5, 6, 7, 8,-1,-1,-1,-1,-1,-1,
+    -1, 9,10,11,12,13,14,15,16,-1,17,18,19,20,21,-1,
+    22,23,24,25,26,27,28,29,30,31,32,-1,-1,-1,-1,-1,
+    -1,33,34,35,36,37,38,39,40,41,42,43,-1,44,45,46,
+    47,48,49,50,51,52,53,54,55,56,57,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+};
+
+/**
+ * The conversions calculate with limbs of several digits instead of single
+ * ones: base 58^5 limbs when encoding and base 2^32 limbs when decoding, which
+ * takes a twentieth of the steps of a byte by byte conversion. Addresses and
+ * keys fit the limbs on the stack.
+ */
+static const uint32_t BASE58_LIMB = 656356768; // 58^5
+static const int BASE58_LIMB_DIGITS = 5;
+static const size_t BASE58_STACK_LIMBS = 16;
+
 bool DecodeBase58(const char* psz, std::vector<unsigned char>& vch)
 {
     // Skip leading spaces.
@@ -31,38 +62,58 @@ bool DecodeBase58(const char* psz, std::vector<unsigned char>& vch)
         zeroes++;
         psz++;
     }
-    // Allocate enough space in big-endian base256 representation.
-    std::vector<unsigned char> b256(strlen(psz) * 733 / 1000 + 1); // log(58) / log(256), rounded up.
-    // Process the characters.
+    // Allocate enough little-endian base 2^32 limbs.
+    size_t nMaxLimbs = (strlen(psz) * 733 / 1000 + 1 + 3) / 4; // log(58) / log(256), rounded up.
+    uint32_t limbsStack[BASE58_STACK_LIMBS];
+    std::vector<uint32_t> vLimbs;
+    uint32_t* limbs = limbsStack;
+    if (nMaxLimbs > BASE58_STACK_LIMBS) {
+        vLimbs.resize(nMaxLimbs);
+        limbs = &vLimbs[0];
+    }
+    size_t nLimbs = 0;
+    // Process the characters, up to a limb of them at a time.
     while (*psz && !isspace(*psz)) {
-        // Decode base58 character
-        const char* ch = strchr(pszBase58, *psz);
-        if (ch == NULL)
-            return false;
-        // Apply "b256 = b256 * 58 + ch".
-        int carry = ch - pszBase58;
-        for (std::vector<unsigned char>::reverse_iterator it = b256.rbegin(); it != b256.rend(); it++) {
-            carry += 58 * (*it);
-            *it = carry % 256;
-            carry /= 256;
+        // Decode base58 characters
+        uint64_t carry = 0;
+        uint32_t nMultiplier = 1;
+        for (int i = 0; i < BASE58_LIMB_DIGITS && *psz && !isspace(*psz); i++, psz++) {
+            int digit = mapBase58[(uint8_t)*psz];
+            if (digit == -1)
+                return false;
+            carry = carry * 58 + digit;
+            nMultiplier *= 58;
+        }
+        // Apply "limbs = limbs * 58^n + digits".
+        for (size_t i = 0; i < nLimbs; i++) {
+            carry += (uint64_t)limbs[i] * nMultiplier;
+            limbs[i] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        while (carry != 0) {
+            assert(nLimbs < nMaxLimbs);
+            limbs[nLimbs++] = (uint32_t)carry;
+            carry >>= 32;
         }
-        assert(carry == 0);
-        psz++;
     }
     // Skip trailing spaces.
     while (isspace(*psz))
         psz++;
     if (*psz != 0)
         return false;
-    // Skip leading zeroes in b256.
-    std::vector<unsigned char>::iterator it = b256.begin();
-    while (it != b256.end() && *it == 0)
-        it++;
-    // Copy result into output vector.
-    vch.reserve(zeroes + (b256.end() - it));
+    // Copy result into output vector, without the leading zeroes of the top limb.
+    vch.reserve(zeroes + nLimbs * 4);
     vch.assign(zeroes, 0x00);
-    while (it != b256.end())
-        vch.push_back(*(it++));
+    bool fLeading = true;
+    for (size_t i = nLimbs; i-- > 0;) {
+        for (int nShift = 24; nShift >= 0; nShift -= 8) {
+            unsigned char c = limbs[i] >> nShift;
+            if (fLeading && c == 0)
+                continue;
+            fLeading = false;
+            vch.push_back(c);
+        }
+    }
     return true;
 }
 
@@ -70,39 +121,53 @@ std::string EncodeBase58(const unsigned char* pbegin, const unsigned char* pend)
 {
     // Skip & count leading zeroes.
     int zeroes = 0;
-    int length = 0;
     while (pbegin != pend && *pbegin == 0) {
         pbegin++;
         zeroes++;
     }
-    // Allocate enough space in big-endian base58 representation.
-    int size = (pend - pbegin) * 138 / 100 + 1; // log(256) / log(58), rounded up.
-    std::vector<unsigned char> b58(size);
-    // Process the bytes.
+    // Allocate enough little-endian base 58^5 limbs.
+    size_t nBytes = pend - pbegin;
+    size_t nMaxLimbs = (nBytes * 138 / 100 + 1 + BASE58_LIMB_DIGITS - 1) / BASE58_LIMB_DIGITS; // log(256) / log(58), rounded up.
+    uint32_t limbsStack[BASE58_STACK_LIMBS];
+    std::vector<uint32_t> vLimbs;
+    uint32_t* limbs = limbsStack;
+    if (nMaxLimbs > BASE58_STACK_LIMBS) {
+        vLimbs.resize(nMaxLimbs);
+        limbs = &vLimbs[0];
+    }
+    size_t nLimbs = 0;
+    // Process the bytes, four at a time after the odd ones.
+    size_t nChunk = nBytes % 4 ? nBytes % 4 : 4;
     while (pbegin != pend) {
-        int carry = *pbegin;
-        int i = 0;
-        // Apply "b58 = b58 * 256 + ch".
-        for (std::vector<unsigned char>::reverse_iterator it = b58.rbegin(); (carry != 0 || i < length) && (it != b58.rend()); it++, i++) {
-            carry += 256 * (*it);
-            *it = carry % 58;
-            carry /= 58;
+        uint64_t carry = 0;
+        for (size_t i = 0; i < nChunk; i++)
+            carry = (carry << 8) | *(pbegin++);
+        // Apply "limbs = limbs * 256^n + bytes".
+        for (size_t i = 0; i < nLimbs; i++) {
+            carry += (uint64_t)limbs[i] << (8 * nChunk);
+            limbs[i] = carry % BASE58_LIMB;
+            carry /= BASE58_LIMB;
         }
-
-        assert(carry == 0);
-        length = i;
-        pbegin++;
+        while (carry != 0) {
+            assert(nLimbs < nMaxLimbs);
+            limbs[nLimbs++] = carry % BASE58_LIMB;
+            carry /= BASE58_LIMB;
+        }
+        nChunk = 4;
     }
-    // Skip leading zeroes in base58 result.
-    std::vector<unsigned char>::iterator it = b58.begin() + (size - length);
-    while (it != b58.end() && *it == 0)
-        it++;
-    // Translate the result into a string.
+    // Translate the result into a string, from the least significant digit
+    // on. The top limb has no leading zeroes.
     std::string str;
-    str.reserve(zeroes + (b58.end() - it));
-    str.assign(zeroes, '1');
-    while (it != b58.end())
-        str += pszBase58[*(it++)];
+    str.reserve(zeroes + nLimbs * BASE58_LIMB_DIGITS);
+    for (size_t i = 0; i < nLimbs; i++) {
+        uint32_t limb = limbs[i];
+        for (int j = 0; j < BASE58_LIMB_DIGITS && (limb != 0 || i + 1 < nLimbs); j++) {
+            str += pszBase58[limb % 58];
+            limb /= 58;
+        }
+    }
+    str.append(zeroes, '1');
+    std::reverse(str.begin(), str.end());
     return str;
 }
 
@@ -6,6 +6,8 @@
 
 #include "validation.h"
 #include "base58.h"
+#include "chainparams.h"
+#include "smarthive/hive.h"
 
 #include <vector>
 #include <string>
@@ -51,6 +53,48 @@ static void Base58Decode(benchmark::State& state)
 }
 
 
+// Version byte, key hash and checksum, the size of every address the rewards and SAPI print
+static void Base58EncodeAddress(benchmark::State& state)
+{
+    unsigned char buff[25] = {
+        63, 79, 8, 99, 150, 189, 208, 162, 22, 23, 203, 163, 36, 58, 147,
+        227, 139, 2, 215, 100, 91, 38, 11, 141, 253
+    };
+    unsigned char* b = buff;
+    while (state.KeepRunning()) {
+        EncodeBase58(b, b + 25);
+    }
+}
+
+
+static void Base58CheckEncodeAddress(benchmark::State& state)
+{
+    unsigned char buff[21] = {
+        63, 79, 8, 99, 150, 189, 208, 162, 22, 23, 203, 163, 36, 58, 147,
+        227, 139, 2, 215, 100, 91
+    };
+    std::vector<unsigned char> vch(buff, buff + 21);
+    while (state.KeepRunning()) {
+        EncodeBase58Check(vch);
+    }
+}
+
+
+static void SmartAddressToString(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    uint160 hash;
+    hash.SetHex("4f086396bdd0a21617cba3243a93e38b02d7645b");
+    CSmartAddress address((CKeyID(hash)));
+    while (state.KeepRunning()) {
+        address.ToString();
+    }
+}
+
+
 BENCHMARK(Base58Encode);
 BENCHMARK(Base58CheckEncode);
 BENCHMARK(Base58Decode);
+BENCHMARK(Base58EncodeAddress);
+BENCHMARK(Base58CheckEncodeAddress);
+BENCHMARK(SmartAddressToString);
@@ -4,10 +4,17 @@
 
 #include "bench.h"
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <regex>
+#include <sstream>
 #include <sys/time.h>
 
+#include <univalue.h>
+
 using namespace benchmark;
 
 std::map<std::string, BenchFunction> BenchRunner::benchmarks;
@@ -23,22 +30,254 @@ BenchRunner::BenchRunner(std::string name, BenchFunction func)
     benchmarks.insert(std::make_pair(name, func));
 }
 
-void
-BenchRunner::RunAll(double elapsedTimeForOne)
+// Nearest rank percentile of the sorted samples
+static double Percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t rank = (size_t)std::ceil(p * sorted.size());
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+static UniValue ResultToJSON(const Result& result)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("name", result.name);
+    obj.pushKV("iterations", result.iterations);
+    obj.pushKV("samples", result.samples);
+    obj.pushKV("min", result.min);
+    obj.pushKV("max", result.max);
+    obj.pushKV("mean", result.mean);
+    obj.pushKV("stddev", result.stddev);
+    obj.pushKV("p50", result.p50);
+    obj.pushKV("p90", result.p90);
+    obj.pushKV("p99", result.p99);
+    if (result.mbPerSecond)
+        obj.pushKV("MB/s", result.mbPerSecond);
+    return obj;
+}
+
+static bool ResultFromJSON(const UniValue& obj, Result& result)
+{
+    if (!obj.isObject() || !obj["name"].isStr() || !obj["mean"].isNum())
+        return false;
+
+    result.name = obj["name"].get_str();
+    result.iterations = obj["iterations"].isNum() ? obj["iterations"].get_int64() : 0;
+    result.samples = obj["samples"].isNum() ? obj["samples"].get_int64() : 0;
+    result.mean = obj["mean"].get_real();
+    result.stddev = obj["stddev"].isNum() ? obj["stddev"].get_real() : 0;
+    return true;
+}
+
+static void WriteResults(std::ostream& out, OutputFormat format, const std::vector<Result>& results)
+{
+    if (format == FORMAT_JSON) {
+        UniValue benchmarks(UniValue::VARR);
+        for (const Result& result : results)
+            benchmarks.push_back(ResultToJSON(result));
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("benchmarks", benchmarks);
+        out << obj.write(2) << "\n";
+    } else if (format == FORMAT_CSV) {
+        out << "name,iterations,samples,min,max,mean,stddev,p50,p90,p99,MB/s\n";
+        for (const Result& result : results) {
+            out << std::fixed << std::setprecision(15) << result.name << "," << result.iterations << "," << result.samples << ","
+                << result.min << "," << result.max << "," << result.mean << "," << result.stddev << ","
+                << result.p50 << "," << result.p90 << "," << result.p99 << ",";
+            if (result.mbPerSecond)
+                out << std::setprecision(2) << result.mbPerSecond;
+            out << "\n";
+        }
+    }
+}
+
+// Two-sided 95% critical values of Student's t distribution for 1 to 30 degrees of freedom
+static const double T_CRITICAL_95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+/**
+ * Welch's t-test of the means of the two runs, true if the difference is
+ * significant at the 95% level. Runs with less than two samples have no
+ * variance to test with, any difference counts then.
+ */
+static bool SignificantDifference(const Result& base, const Result& result, double& tRet)
+{
+    tRet = 0;
+    if (base.samples < 2 || result.samples < 2)
+        return true;
+
+    double varBase = base.stddev * base.stddev / base.samples;
+    double varResult = result.stddev * result.stddev / result.samples;
+    if (varBase + varResult <= 0)
+        return base.mean != result.mean;
+
+    tRet = (result.mean - base.mean) / std::sqrt(varBase + varResult);
+    double df = (varBase + varResult) * (varBase + varResult) /
+                (varBase * varBase / (base.samples - 1) + varResult * varResult / (result.samples - 1));
+    int nDf = std::max(1, (int)df);
+    double tCritical = nDf <= 30 ? T_CRITICAL_95[nDf - 1] : 1.96;
+
+    return std::fabs(tRet) > tCritical;
+}
+
+// Prints the comparison to stderr, false if a benchmark got significantly slower than the threshold
+static bool CompareResults(const std::string& strFile, double threshold, const std::vector<Result>& results)
+{
+    std::ifstream file(strFile);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    UniValue obj;
+    if (!file.is_open() || !obj.read(ss.str()) || !obj["benchmarks"].isArray()) {
+        std::cerr << "Error: cannot read the benchmark results of " << strFile << "\n";
+        return false;
+    }
+
+    std::map<std::string, Result> mapBase;
+    for (const UniValue& entry : obj["benchmarks"].getValues()) {
+        Result result;
+        if (ResultFromJSON(entry, result))
+            mapBase[result.name] = result;
+    }
+
+    bool fRegression = false;
+    std::cerr << "#Benchmark,base mean,mean,change %,t,verdict\n";
+    for (const Result& result : results) {
+        std::map<std::string, Result>::const_iterator it = mapBase.find(result.name);
+        if (it == mapBase.end() || it->second.mean <= 0) {
+            std::cerr << result.name << ",,," << std::fixed << std::setprecision(15) << result.mean << ",,,new\n";
+            continue;
+        }
+
+        const Result& base = it->second;
+        double change = (result.mean / base.mean - 1) * 100;
+        double t;
+        bool fSignificant = SignificantDifference(base, result, t);
+        std::string strVerdict = "same";
+        if (fSignificant && change > threshold) {
+            strVerdict = "REGRESSION";
+            fRegression = true;
+        } else if (fSignificant && change < -threshold) {
+            strVerdict = "improvement";
+        }
+
+        std::cerr << std::fixed << std::setprecision(15) << result.name << "," << base.mean << "," << result.mean << ","
+                  << std::setprecision(2) << change << "," << t << "," << strVerdict << "\n";
+    }
+
+    return !fRegression;
+}
+
+bool
+BenchRunner::RunAll(const Options& options)
 {
-    std::cout << "#Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "\n";
+    std::regex filter;
+    try {
+        filter = std::regex(options.filter.empty() ? ".*" : options.filter);
+    } catch (const std::regex_error& e) {
+        std::cerr << "Error: invalid filter " << options.filter << ": " << e.what() << "\n";
+        return false;
+    }
 
+    std::ofstream fileOutput;
+    if (!options.output.empty()) {
+        fileOutput.open(options.output);
+        if (!fileOutput.is_open()) {
+            std::cerr << "Error: cannot write " << options.output << "\n";
+            return false;
+        }
+    }
+    std::ostream& out = fileOutput.is_open() ? fileOutput : std::cout;
+
+    if (options.format == FORMAT_TEXT)
+        out << "#Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << "," << "MB/s" << "\n";
+
+    std::vector<Result> results;
     for (std::map<std::string,BenchFunction>::iterator it = benchmarks.begin();
          it != benchmarks.end(); ++it) {
 
-        State state(it->first, elapsedTimeForOne);
+        if (!std::regex_search(it->first, filter))
+            continue;
+
+        State state(it->first, options.elapsedTimeForOne, options.iterations);
         BenchFunction& func = it->second;
+
+        // What the benchmarks print themselves goes to stderr, so stdout stays machine readable
+        std::streambuf* coutbuf = NULL;
+        if (options.format != FORMAT_TEXT && !fileOutput.is_open())
+            coutbuf = std::cout.rdbuf(std::cerr.rdbuf());
         func(state);
+        if (coutbuf)
+            std::cout.rdbuf(coutbuf);
+
+        const Result& result = state.GetResult();
+        if (options.format == FORMAT_TEXT) {
+            out << std::fixed << std::setprecision(15) << result.name << "," << result.iterations << "," << result.min << "," << result.max << "," << result.mean << ",";
+            if (result.mbPerSecond)
+                out << std::setprecision(2) << result.mbPerSecond;
+            out << "\n";
+        }
+        results.push_back(result);
+    }
+
+    WriteResults(out, options.format, results);
+
+    if (!options.compare.empty())
+        return CompareResults(options.compare, options.compareThreshold, results);
+
+    return true;
+}
+
+void State::Finish(double now)
+{
+    std::vector<double> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+
+    result.name = name;
+    result.iterations = count;
+    result.samples = sorted.size();
+    result.mean = count ? (now-beginTime)/count : 0;
+    if (!sorted.empty()) {
+        result.min = sorted.front();
+        result.max = sorted.back();
     }
+    if (sorted.size() > 1) {
+        double sampleMean = 0;
+        for (double sample : sorted)
+            sampleMean += sample;
+        sampleMean /= sorted.size();
+        double sum = 0;
+        for (double sample : sorted)
+            sum += (sample - sampleMean) * (sample - sampleMean);
+        result.stddev = std::sqrt(sum / (sorted.size() - 1));
+    }
+    result.p50 = Percentile(sorted, 0.50);
+    result.p90 = Percentile(sorted, 0.90);
+    result.p99 = Percentile(sorted, 0.99);
+    if (bytesPerIteration && result.mean > 0)
+        result.mbPerSecond = bytesPerIteration / result.mean * 0.000001;
 }
 
 bool State::KeepRunning()
 {
+    if (fixedIterations) {
+        double now = gettimedouble();
+        if (count == 0)
+            beginTime = now;
+        else
+            samples.push_back(now - lastTime);
+        lastTime = now;
+        if (count < fixedIterations) {
+            ++count;
+            return true;
+        }
+        Finish(now);
+        return false;
+    }
+
     if (count & countMask) {
       ++count;
       return true;
@@ -51,16 +290,14 @@ bool State::KeepRunning()
         now = gettimedouble();
         double elapsed = now - lastTime;
         double elapsedOne = elapsed * countMaskInv;
-        if (elapsedOne < minTime) minTime = elapsedOne;
-        if (elapsedOne > maxTime) maxTime = elapsedOne;
+        samples.push_back(elapsedOne);
         if (elapsed*128 < maxElapsed) {
           // If the execution was much too fast (1/128th of maxElapsed), increase the count mask by 8x and restart timing.
           // The restart avoids including the overhead of this code in the measurement.
           countMask = ((countMask<<3)|7) & ((1LL<<60)-1);
           countMaskInv = 1./(countMask+1);
           count = 0;
-          minTime = std::numeric_limits<double>::max();
-          maxTime = std::numeric_limits<double>::min();
+          samples.clear();
           return true;
         }
         if (elapsed*16 < maxElapsed) {
@@ -78,9 +315,6 @@ bool State::KeepRunning()
 
     --count;
 
-    // Output results
-    double average = (now-beginTime)/count;
-    std::cout << std::fixed << std::setprecision(15) << name << "," << count << "," << minTime << "," << maxTime << "," << average << "\n";
-
+    Finish(now);
     return false;
 }
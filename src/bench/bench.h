@@ -5,8 +5,11 @@
 #ifndef BITCOIN_BENCH_BENCH_H
 #define BITCOIN_BENCH_BENCH_H
 
+#include <limits>
 #include <map>
+#include <stdint.h>
 #include <string>
+#include <vector>
 
 #include <boost/function.hpp>
 #include <boost/preprocessor/cat.hpp>
@@ -36,25 +39,72 @@ BENCHMARK(CODE_TO_TIME);
  
 namespace benchmark {
 
+    // Timings of a benchmark run, the times are seconds per iteration
+    struct Result {
+        std::string name;
+        int64_t iterations;
+        // Number of timed batches of iterations the statistics are made of
+        int64_t samples;
+        double min, max, mean, stddev;
+        double p50, p90, p99;
+        double mbPerSecond;
+
+        Result() : iterations(0), samples(0), min(0), max(0), mean(0), stddev(0), p50(0), p90(0), p99(0), mbPerSecond(0) {}
+    };
+
     class State {
         std::string name;
         double maxElapsed;
+        int64_t fixedIterations;
         double beginTime;
-        double lastTime, minTime, maxTime, countMaskInv;
+        double lastTime, countMaskInv;
         int64_t count;
         int64_t countMask;
+        uint64_t bytesPerIteration;
+        // Time per iteration of each timed batch
+        std::vector<double> samples;
+        Result result;
+
+        void Finish(double now);
     public:
-        State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0) {
-            minTime = std::numeric_limits<double>::max();
-            maxTime = std::numeric_limits<double>::min();
-            countMask = 1;
+        // With fixedIterationsIn the benchmark runs exactly so many iterations, each timed on its own
+        State(std::string _name, double _maxElapsed, int64_t fixedIterationsIn = 0) : name(_name), maxElapsed(_maxElapsed), fixedIterations(fixedIterationsIn), count(0), bytesPerIteration(0) {
+            countMask = fixedIterations ? 0 : 1;
             countMaskInv = 1./(countMask + 1);
+            result.name = name;
         }
         bool KeepRunning();
+        // Bytes one iteration processes, the throughput gets reported along with the times then
+        void SetBytesPerIteration(uint64_t bytes) { bytesPerIteration = bytes; }
+        // Filled in once KeepRunning returned false
+        const Result& GetResult() const { return result; }
     };
 
     typedef boost::function<void(State&)> BenchFunction;
 
+    enum OutputFormat {
+        FORMAT_TEXT,
+        FORMAT_CSV,
+        FORMAT_JSON,
+    };
+
+    struct Options {
+        double elapsedTimeForOne;
+        // Run each benchmark this many iterations instead of for elapsedTimeForOne
+        int64_t iterations;
+        // Only the benchmarks whose names match this regular expression
+        std::string filter;
+        OutputFormat format;
+        // File the results get written to instead of stdout
+        std::string output;
+        // JSON results of an earlier run to compare against
+        std::string compare;
+        // Slowdown of the mean in percent which counts as regression if it is significant
+        double compareThreshold;
+
+        Options() : elapsedTimeForOne(1.0), iterations(0), format(FORMAT_TEXT), compareThreshold(5.0) {}
+    };
+
     class BenchRunner
     {
         static std::map<std::string, BenchFunction> benchmarks;
@@ -62,7 +112,8 @@ namespace benchmark {
     public:
         BenchRunner(std::string name, BenchFunction func);
 
-        static void RunAll(double elapsedTimeForOne=1.0);
+        // False if a benchmark regressed compared to options.compare or a file couldn't be used
+        static bool RunAll(const Options& options = Options());
     };
 }
 
@@ -4,18 +4,67 @@
 
 #include "bench.h"
 
+#include "crypto/keccak256.h"
+#include "crypto/sha256.h"
+#include "crypto/sha512.h"
 #include "key.h"
+#include "script/sigcache.h"
 #include "validation.h"
 #include "util.h"
 
+#include <iostream>
+
+static void PrintUsage()
+{
+    std::cout << "Usage: bench_bitcoin [options]\n\n"
+              << "  -filter=<regex>          Only run the benchmarks whose names match <regex>\n"
+              << "  -time=<seconds>          Run each benchmark for about <seconds> (default: 1)\n"
+              << "  -iterations=<n>          Run each benchmark exactly <n> iterations, timing each of them\n"
+              << "  -format=<text|csv|json>  Format of the results (default: text)\n"
+              << "  -output=<file>           Write the results to <file> instead of stdout\n"
+              << "  -compare=<file>          Compare the results with the JSON results in <file>, exits with 1 on a regression\n"
+              << "  -comparethreshold=<pct>  Significant slowdown of the mean which counts as regression (default: 5)\n";
+}
+
 int
 main(int argc, char** argv)
 {
+    ParseParameters(argc, argv);
+
+    if (mapArgs.count("-?") || mapArgs.count("-h") || mapArgs.count("-help")) {
+        PrintUsage();
+        return 0;
+    }
+
+    benchmark::Options options;
+    options.elapsedTimeForOne = std::max(0.001, atof(GetArg("-time", "1").c_str()));
+    options.iterations = std::max<int64_t>(0, GetArg("-iterations", 0));
+    options.filter = GetArg("-filter", "");
+    options.output = GetArg("-output", "");
+    options.compare = GetArg("-compare", "");
+    options.compareThreshold = atof(GetArg("-comparethreshold", "5").c_str());
+
+    std::string strFormat = GetArg("-format", "text");
+    if (strFormat == "csv") {
+        options.format = benchmark::FORMAT_CSV;
+    } else if (strFormat == "json") {
+        options.format = benchmark::FORMAT_JSON;
+    } else if (strFormat != "text") {
+        std::cerr << "Error: unknown format " << strFormat << "\n";
+        return 1;
+    }
+
+    SHA256AutoDetect();
+    Keccak256AutoDetect();
+    SHA512AutoDetect();
     ECC_Start();
     SetupEnvironment();
+    InitSignatureCache();
     fPrintToDebugLog = false; // don't want to write to debug.log file
 
-    benchmark::BenchRunner::RunAll();
+    bool fSuccess = benchmark::BenchRunner::RunAll(options);
 
     ECC_Stop();
+
+    return fSuccess ? 0 : 1;
 }
@@ -0,0 +1,148 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain_setup.h"
+
+#include "chainparams.h"
+#include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "miner.h"
+#include "pow.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "smartrewards/rewards.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "util.h"
+#include "validation.h"
+
+#include <memory>
+
+// Most outputs one of the transactions of CreateOutputs gets.
+static const size_t FANOUT_OUTPUTS = 1000;
+
+static const char* const OPTIONAL_INDEXES[] = {"-timestampindex", "-spentindex", "-depositindex", "-balanceindex"};
+
+BenchChainSetup::BenchChainSetup(const std::string& strName, bool fOptionalIndexes)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    ClearDatadirCache();
+    pathTemp = boost::filesystem::temp_directory_path() / strprintf("bench_%s_%lu_%i", strName, (unsigned long)GetTime(), (int)GetRand(100000));
+    boost::filesystem::create_directories(pathTemp);
+    mapArgs["-datadir"] = pathTemp.string();
+
+    for (const char* pszIndex : OPTIONAL_INDEXES) {
+        mapArgs[pszIndex] = fOptionalIndexes ? "1" : "0";
+    }
+
+    pblocktree = new CBlockTreeDB(1 << 20, true);
+    pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+    pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+    prewards = new CSmartRewards(new CSmartRewardsDB(1 << 20, true, false));
+
+    const CChainParams& chainparams = Params();
+    CValidationState state;
+    if (!InitBlockIndex(chainparams) || !InitBalanceIndex(true) || !ActivateBestChain(state, chainparams)) {
+        throw std::runtime_error("BenchChainSetup: failed to set up the chain");
+    }
+
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+}
+
+BenchChainSetup::~BenchChainSetup()
+{
+    UnloadBlockIndex();
+    mempool.clear();
+    delete pcoinsTip;
+    delete pcoinsdbview;
+    delete pblocktree;
+    delete prewards;
+    pcoinsTip = NULL;
+    pcoinsdbview = NULL;
+    pblocktree = NULL;
+    prewards = NULL;
+
+    for (const char* pszIndex : OPTIONAL_INDEXES) {
+        mapArgs.erase(pszIndex);
+    }
+
+    ClearDatadirCache();
+    boost::filesystem::remove_all(pathTemp);
+}
+
+CBlock BenchChainSetup::CreateAndProcessBlock(const std::vector<CMutableTransaction>& vtx)
+{
+    const CChainParams& chainparams = Params();
+    std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(chainparams).CreateNewBlock(scriptPubKey, CSmartAddress()));
+    CBlock& block = pblocktemplate->block;
+
+    // Only the given transactions, whatever the mempool has stays there
+    block.vtx.resize(1);
+    for (const CMutableTransaction& tx : vtx) {
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+
+    unsigned int nExtraNonce = 0;
+    int nHeight;
+    {
+        LOCK(cs_main);
+        IncrementExtraNonce(&block, chainActive.Tip(), nExtraNonce);
+        nHeight = chainActive.Height() + 1;
+    }
+
+    while (!CheckProofOfWork(nHeight, block.GetHash(), block.nBits, chainparams.GetConsensus())) {
+        ++block.nNonce;
+    }
+
+    bool fNewBlock = false;
+    if (!ProcessNewBlock(chainparams, &block, true, NULL, &fNewBlock) || chainActive.Tip()->GetBlockHash() != block.GetHash()) {
+        throw std::runtime_error("BenchChainSetup: block not connected");
+    }
+
+    return block;
+}
+
+void BenchChainSetup::Sign(CMutableTransaction& tx) const
+{
+    for (unsigned int i = 0; i < tx.vin.size(); ++i) {
+        if (!SignSignature(keystore, scriptPubKey, tx, i)) {
+            throw std::runtime_error("BenchChainSetup: failed to sign");
+        }
+    }
+}
+
+std::vector<COutPoint> BenchChainSetup::CreateOutputs(size_t nOutputs, CAmount& nValueRet)
+{
+    // One coinbase for each fan-out transaction, mature when they get spent
+    size_t nFanouts = (nOutputs + FANOUT_OUTPUTS - 1) / FANOUT_OUTPUTS;
+    std::vector<CTransaction> vCoinbases;
+    for (size_t i = 0; i < COINBASE_MATURITY + nFanouts; ++i) {
+        vCoinbases.push_back(*CreateAndProcessBlock(std::vector<CMutableTransaction>()).vtx[0]);
+    }
+
+    std::vector<CMutableTransaction> vtx;
+    std::vector<COutPoint> vOutputs;
+    nValueRet = MAX_MONEY;
+    for (size_t i = 0; i < nFanouts; ++i) {
+        CMutableTransaction tx;
+        tx.vin.push_back(CTxIn(COutPoint(vCoinbases[i].GetHash(), 0)));
+        size_t nCount = std::min(FANOUT_OUTPUTS, nOutputs - vOutputs.size());
+        CAmount nValue = vCoinbases[i].vout[0].nValue / nCount;
+        for (size_t j = 0; j < nCount; ++j) {
+            tx.vout.push_back(CTxOut(nValue, scriptPubKey));
+        }
+        Sign(tx);
+        for (size_t j = 0; j < nCount; ++j) {
+            vOutputs.push_back(COutPoint(tx.GetHash(), j));
+        }
+        nValueRet = std::min(nValueRet, nValue);
+        vtx.push_back(tx);
+    }
+    CreateAndProcessBlock(vtx);
+
+    return vOutputs;
+}
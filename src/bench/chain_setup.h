@@ -0,0 +1,49 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_BENCH_CHAIN_SETUP_H
+#define SMARTCASH_BENCH_CHAIN_SETUP_H
+
+#include "amount.h"
+#include "key.h"
+#include "keystore.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+/**
+ * Regtest chain in a temporary data directory, the databases are kept in memory. The coinbases
+ * come from the block assembler, so they carry the mining, hive, smartnode and rewards payouts
+ * the consensus rules expect at the height, and pay to a key of the setup. The optional indexes
+ * get set up before the genesis block, the transaction and address index are always on like on
+ * every node.
+ */
+class BenchChainSetup
+{
+    boost::filesystem::path pathTemp;
+    CBasicKeyStore keystore;
+
+public:
+    CKey key;
+    CScript scriptPubKey;
+
+    BenchChainSetup(const std::string& strName, bool fOptionalIndexes);
+    ~BenchChainSetup();
+
+    //! Mine a block with the transactions on top of the tip, throws if it doesn't become the new tip
+    CBlock CreateAndProcessBlock(const std::vector<CMutableTransaction>& vtx);
+
+    //! Sign all inputs, they have to spend outputs to scriptPubKey
+    void Sign(CMutableTransaction& tx) const;
+
+    //! Mine coinbases until they are mature and split them into nOutputs confirmed outputs to scriptPubKey
+    std::vector<COutPoint> CreateOutputs(size_t nOutputs, CAmount& nValueRet);
+};
+
+#endif // SMARTCASH_BENCH_CHAIN_SETUP_H
@@ -0,0 +1,159 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "checkqueue.h"
+#include "crypto/sha256.h"
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+// Checks of a full block and of one with a few transactions only
+static const int BENCH_BLOCK_CHECKS = 4000;
+static const int BENCH_SMALL_BLOCK_CHECKS = 40;
+// Checks added at once, the inputs of a transaction
+static const int BENCH_TX_INPUTS = 2;
+// Batch size of the script check queue of validation.cpp
+static const unsigned int BENCH_BATCH_SIZE = 128;
+
+/** A few microseconds of hashing, about what a signature check leaves for the queue to hide */
+struct CBenchCheck
+{
+    unsigned char data[64];
+
+    CBenchCheck() { memset(data, 0, sizeof(data)); }
+
+    bool operator()()
+    {
+        for (int i = 0; i < 10; i++)
+            CSHA256().Write(data, sizeof(data)).Finalize(data);
+        return true;
+    }
+
+    void swap(CBenchCheck& check) { std::swap(data, check.data); }
+};
+
+/**
+ * The check queue before the work stealing one, all threads sharing one
+ * mutex and vector, kept here as the baseline of the comparison.
+ */
+template <typename T>
+class CLockedCheckQueue
+{
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condMaster;
+    std::vector<T> queue;
+    int nIdle;
+    int nTotal;
+    bool fAllOk;
+    unsigned int nTodo;
+    unsigned int nBatchSize;
+
+    bool Loop(bool fMaster = false)
+    {
+        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        std::vector<T> vChecks;
+        vChecks.reserve(nBatchSize);
+        unsigned int nNow = 0;
+        bool fOk = true;
+        do {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                if (nNow) {
+                    fAllOk &= fOk;
+                    nTodo -= nNow;
+                    if (nTodo == 0 && !fMaster)
+                        condMaster.notify_one();
+                } else {
+                    nTotal++;
+                }
+                while (queue.empty()) {
+                    if (fMaster && nTodo == 0) {
+                        nTotal--;
+                        bool fRet = fAllOk;
+                        fAllOk = true;
+                        return fRet;
+                    }
+                    nIdle++;
+                    cond.wait(lock);
+                    nIdle--;
+                }
+                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
+                vChecks.resize(nNow);
+                for (unsigned int i = 0; i < nNow; i++) {
+                    vChecks[i].swap(queue.back());
+                    queue.pop_back();
+                }
+                fOk = fAllOk;
+            }
+            for (T& check : vChecks)
+                if (fOk)
+                    fOk = check();
+            vChecks.clear();
+        } while (true);
+    }
+
+public:
+    CLockedCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+
+    void Thread() { Loop(); }
+    bool Wait() { return Loop(true); }
+
+    void Add(std::vector<T>& vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (T& check : vChecks) {
+            queue.push_back(T());
+            check.swap(queue.back());
+        }
+        nTodo += vChecks.size();
+        if (vChecks.size() == 1)
+            condWorker.notify_one();
+        else if (vChecks.size() > 1)
+            condWorker.notify_all();
+    }
+};
+
+/** Rounds of nChecks added a transaction at a time, with nThreads workers besides the master */
+template <typename Queue>
+static void CheckQueueRounds(benchmark::State& state, int nThreads, int nChecks)
+{
+    Queue queue(BENCH_BATCH_SIZE);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&Queue::Thread, boost::ref(queue)));
+
+    while (state.KeepRunning()) {
+        for (int i = 0; i < nChecks; i += BENCH_TX_INPUTS) {
+            std::vector<CBenchCheck> vChecks(BENCH_TX_INPUTS);
+            queue.Add(vChecks);
+        }
+        bool fOk = queue.Wait();
+        assert(fOk);
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+#define BENCH_CHECKQUEUE(threads) \
+    static void CheckQueue_Block_##threads##Threads(benchmark::State& state) { CheckQueueRounds<CCheckQueue<CBenchCheck> >(state, threads, BENCH_BLOCK_CHECKS); } \
+    static void CheckQueueLocked_Block_##threads##Threads(benchmark::State& state) { CheckQueueRounds<CLockedCheckQueue<CBenchCheck> >(state, threads, BENCH_BLOCK_CHECKS); } \
+    static void CheckQueue_SmallBlock_##threads##Threads(benchmark::State& state) { CheckQueueRounds<CCheckQueue<CBenchCheck> >(state, threads, BENCH_SMALL_BLOCK_CHECKS); } \
+    static void CheckQueueLocked_SmallBlock_##threads##Threads(benchmark::State& state) { CheckQueueRounds<CLockedCheckQueue<CBenchCheck> >(state, threads, BENCH_SMALL_BLOCK_CHECKS); } \
+    BENCHMARK(CheckQueue_Block_##threads##Threads); \
+    BENCHMARK(CheckQueueLocked_Block_##threads##Threads); \
+    BENCHMARK(CheckQueue_SmallBlock_##threads##Threads); \
+    BENCHMARK(CheckQueueLocked_SmallBlock_##threads##Threads);
+
+BENCH_CHECKQUEUE(1)
+BENCH_CHECKQUEUE(3)
+BENCH_CHECKQUEUE(7)
+BENCH_CHECKQUEUE(15)
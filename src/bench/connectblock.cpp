@@ -0,0 +1,125 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain_setup.h"
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "util.h"
+#include "validation.h"
+
+#include <iostream>
+#include <vector>
+
+// Blocks which get disconnected and connected again in every iteration.
+static const int BENCH_BLOCKS = 5;
+
+/** Benchmark chain which ends with BENCH_BLOCKS blocks of nTx transactions, each spending nInputs P2PKH outputs of the previous block into as many new ones. */
+class ConnectBlockBenchSetup : public BenchChainSetup
+{
+public:
+    ConnectBlockBenchSetup(size_t nTx, size_t nInputs, bool fOptionalIndexes) : BenchChainSetup("connectblock", fOptionalIndexes)
+    {
+        CAmount nValue;
+        std::vector<COutPoint> vPool = CreateOutputs(nTx * nInputs, nValue);
+
+        for (int n = 0; n < BENCH_BLOCKS; ++n) {
+            std::vector<CMutableTransaction> vtx;
+            std::vector<COutPoint> vNext;
+            for (size_t i = 0; i < nTx; ++i) {
+                CMutableTransaction tx;
+                for (size_t j = 0; j < nInputs; ++j) {
+                    tx.vin.push_back(CTxIn(vPool[i * nInputs + j]));
+                    tx.vout.push_back(CTxOut(COIN / 1000, scriptPubKey));
+                }
+                Sign(tx);
+                for (size_t j = 0; j < nInputs; ++j) {
+                    vNext.push_back(COutPoint(tx.GetHash(), j));
+                }
+                vtx.push_back(tx);
+            }
+            CreateAndProcessBlock(vtx);
+            vPool.swap(vNext);
+        }
+    }
+};
+
+static void PrintTiming(const std::string& strName, int64_t nTime, int64_t nCount)
+{
+    double dAverage = nCount ? nTime * 0.000001 / nCount : 0;
+    std::cout << strprintf("%s,%d,%.9f,%.9f,%.9f,\n", strName, nCount, dAverage, dAverage, dAverage);
+}
+
+/**
+ * Every iteration disconnects the benchmark blocks like a reorg does and connects them again,
+ * the overall time covers both. The counters of the -debug=bench log get printed afterwards as
+ * per block averages of the phases, and a flush of the whole chain state at the end.
+ */
+static void ConnectBlocks(benchmark::State& state, const std::string& strName, size_t nTx, size_t nInputs, bool fOptionalIndexes)
+{
+    ConnectBlockBenchSetup setup(nTx, nInputs, fOptionalIndexes);
+    const CChainParams& chainparams = Params();
+
+    CBlockConnectTimings start;
+    GetBlockConnectTimings(start);
+
+    while (state.KeepRunning()) {
+        CValidationState stateConnect;
+        if (!DisconnectBlocks(BENCH_BLOCKS) || !ActivateBestChain(stateConnect, chainparams)) {
+            throw std::runtime_error("ConnectBlocks: failed to reconnect the blocks");
+        }
+    }
+
+    CBlockConnectTimings end;
+    GetBlockConnectTimings(end);
+
+    int64_t nConnected = end.nBlocksConnected - start.nBlocksConnected;
+    int64_t nDisconnected = end.nBlocksDisconnected - start.nBlocksDisconnected;
+
+    PrintTiming(strName + "-check", end.nTimeCheck - start.nTimeCheck, nConnected);
+    PrintTiming(strName + "-forks", end.nTimeForks - start.nTimeForks, nConnected);
+    PrintTiming(strName + "-connect-txs", end.nTimeConnect - start.nTimeConnect, nConnected);
+    PrintTiming(strName + "-verify", end.nTimeVerify - start.nTimeVerify, nConnected);
+    PrintTiming(strName + "-payments", end.nTimePayments - start.nTimePayments, nConnected);
+    PrintTiming(strName + "-index", end.nTimeIndex - start.nTimeIndex, nConnected);
+    PrintTiming(strName + "-callbacks", end.nTimeCallbacks - start.nTimeCallbacks, nConnected);
+    PrintTiming(strName + "-read", end.nTimeReadFromDisk - start.nTimeReadFromDisk, nConnected);
+    PrintTiming(strName + "-prefetch", end.nTimePrefetch - start.nTimePrefetch, nConnected);
+    PrintTiming(strName + "-connectblock", end.nTimeConnectTotal - start.nTimeConnectTotal, nConnected);
+    PrintTiming(strName + "-flush-view", end.nTimeFlush - start.nTimeFlush, nConnected);
+    PrintTiming(strName + "-chainstate", end.nTimeChainState - start.nTimeChainState, nConnected);
+    PrintTiming(strName + "-postconnect", end.nTimePostConnect - start.nTimePostConnect, nConnected);
+    PrintTiming(strName + "-connecttip", end.nTimeTotal - start.nTimeTotal, nConnected);
+    PrintTiming(strName + "-disconnect", end.nTimeDisconnect - start.nTimeDisconnect, nDisconnected);
+
+    int64_t nStart = GetTimeMicros();
+    FlushStateToDisk();
+    PrintTiming(strName + "-flush-all", GetTimeMicros() - nStart, 1);
+}
+
+static void ConnectBlock100Tx2In(benchmark::State& state)
+{
+    ConnectBlocks(state, "ConnectBlock100Tx2In", 100, 2, false);
+}
+
+static void ConnectBlock1000Tx2In(benchmark::State& state)
+{
+    ConnectBlocks(state, "ConnectBlock1000Tx2In", 1000, 2, false);
+}
+
+static void ConnectBlock250Tx8In(benchmark::State& state)
+{
+    ConnectBlocks(state, "ConnectBlock250Tx8In", 250, 8, false);
+}
+
+static void ConnectBlock1000Tx2InIndexes(benchmark::State& state)
+{
+    ConnectBlocks(state, "ConnectBlock1000Tx2InIndexes", 1000, 2, true);
+}
+
+BENCHMARK(ConnectBlock100Tx2In);
+BENCHMARK(ConnectBlock1000Tx2In);
+BENCHMARK(ConnectBlock250Tx8In);
+BENCHMARK(ConnectBlock1000Tx2InIndexes);
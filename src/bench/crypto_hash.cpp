@@ -9,34 +9,44 @@
 #include "hash.h"
 #include "uint256.h"
 #include "utiltime.h"
+#include "crypto/pbkdf2_hmac_sha512.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 
+#include <string.h>
+
 /* Number of bytes to hash per iteration */
 static const uint64_t BUFFER_SIZE = 1000*1000;
+/* Size of a block header, the input of the proof of work hash */
+static const size_t HEADER_SIZE = 80;
+/* Number of headers or 64 byte blobs hashed at once by the batch benchmarks */
+static const size_t BATCH_SIZE = 64;
 
-static void RIPEMD160(benchmark::State& state)
+static void RIPEMD160_1MB(benchmark::State& state)
 {
     uint8_t hash[CRIPEMD160::OUTPUT_SIZE];
     std::vector<uint8_t> in(BUFFER_SIZE,0);
+    state.SetBytesPerIteration(in.size());
     while (state.KeepRunning())
         CRIPEMD160().Write(begin_ptr(in), in.size()).Finalize(hash);
 }
 
-static void SHA1(benchmark::State& state)
+static void SHA1_1MB(benchmark::State& state)
 {
     uint8_t hash[CSHA1::OUTPUT_SIZE];
     std::vector<uint8_t> in(BUFFER_SIZE,0);
+    state.SetBytesPerIteration(in.size());
     while (state.KeepRunning())
         CSHA1().Write(begin_ptr(in), in.size()).Finalize(hash);
 }
 
-static void SHA256(benchmark::State& state)
+static void SHA256_1MB(benchmark::State& state)
 {
     uint8_t hash[CSHA256::OUTPUT_SIZE];
     std::vector<uint8_t> in(BUFFER_SIZE,0);
+    state.SetBytesPerIteration(in.size());
     while (state.KeepRunning())
         CSHA256().Write(begin_ptr(in), in.size()).Finalize(hash);
 }
@@ -44,17 +54,25 @@ static void SHA256(benchmark::State& state)
 static void SHA256_32b(benchmark::State& state)
 {
     std::vector<uint8_t> in(32,0);
-    while (state.KeepRunning()) {
-        for (int i = 0; i < 1000000; i++) {
-            CSHA256().Write(begin_ptr(in), in.size()).Finalize(&in[0]);
-        }
-    }
+    state.SetBytesPerIteration(in.size());
+    while (state.KeepRunning())
+        CSHA256().Write(begin_ptr(in), in.size()).Finalize(&in[0]);
 }
 
-static void SHA512(benchmark::State& state)
+static void SHA256D64_64(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * BATCH_SIZE,0);
+    std::vector<uint8_t> out(32 * BATCH_SIZE);
+    state.SetBytesPerIteration(in.size());
+    while (state.KeepRunning())
+        SHA256D64(&out[0], &in[0], BATCH_SIZE);
+}
+
+static void SHA512_1MB(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
     std::vector<uint8_t> in(BUFFER_SIZE,0);
+    state.SetBytesPerIteration(in.size());
     while (state.KeepRunning())
         CSHA512().Write(begin_ptr(in), in.size()).Finalize(hash);
 }
@@ -62,17 +80,125 @@ static void SHA512(benchmark::State& state)
 static void SipHash_32b(benchmark::State& state)
 {
     uint256 x;
+    uint64_t i = 0;
+    state.SetBytesPerIteration(x.size());
+    while (state.KeepRunning())
+        *((uint64_t*)x.begin()) = SipHashUint256(0, ++i, x);
+}
+
+static void HashWriter_32b(benchmark::State& state)
+{
+    uint256 hash;
+    state.SetBytesPerIteration(hash.size());
     while (state.KeepRunning()) {
-        for (int i = 0; i < 1000000; i++) {
-            *((uint64_t*)x.begin()) = SipHashUint256(0, i, x);
-        }
+        CHashWriter ss(SER_GETHASH, 0);
+        ss.write((const char*)hash.begin(), hash.size());
+        hash = ss.GetHash();
     }
 }
 
-//BENCHMARK(RIPEMD160);
-//BENCHMARK(SHA1);
-//BENCHMARK(SHA256);
-//BENCHMARK(SHA512);
+static void HashWriter_1MB(benchmark::State& state)
+{
+    std::vector<uint8_t> in(BUFFER_SIZE,0);
+    state.SetBytesPerIteration(in.size());
+    while (state.KeepRunning()) {
+        CHashWriter ss(SER_GETHASH, 0);
+        ss.write((const char*)begin_ptr(in), in.size());
+        ss.GetHash();
+    }
+}
+
+static void Keccak_80b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(HEADER_SIZE,0);
+    state.SetBytesPerIteration(in.size());
+    while (state.KeepRunning()) {
+        uint256 hash = HashKeccak(in.begin(), in.end());
+        memcpy(&in[0], hash.begin(), hash.size());
+    }
+}
+
+static void Keccak_80b_batch(benchmark::State& state)
+{
+    std::vector<uint8_t> in(HEADER_SIZE * BATCH_SIZE,0);
+    std::vector<uint256> out(BATCH_SIZE);
+    for (size_t i = 0; i < BATCH_SIZE; i++)
+        in[i * HEADER_SIZE] = i;
+    state.SetBytesPerIteration(in.size());
+    while (state.KeepRunning())
+        HashKeccakMany(&out[0], &in[0], BATCH_SIZE);
+}
+
+static void Keccak_1MB(benchmark::State& state)
+{
+    std::vector<uint8_t> in(BUFFER_SIZE,0);
+    state.SetBytesPerIteration(in.size());
+    while (state.KeepRunning())
+        HashKeccak(in.begin(), in.end());
+}
+
+/* Runs bench with SHA256 restricted to one implementation, prints nothing if the CPU or the build lacks it */
+// The mnemonic and the rounds of a BIP39 seed
+static const unsigned char PBKDF2_PASS[] = "abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon about";
+static const unsigned char PBKDF2_SALT[] = "mnemonic";
+
+static void PBKDF2_SHA512_2048(benchmark::State& state)
+{
+    unsigned char out[64];
+    while (state.KeepRunning())
+        PBKDF2_HMAC_SHA512(PBKDF2_PASS, sizeof(PBKDF2_PASS) - 1, PBKDF2_SALT, sizeof(PBKDF2_SALT) - 1, 2048, out, sizeof(out));
+}
+
+static void PBKDF2_SHA512_2048_4way(benchmark::State& state)
+{
+    unsigned char out[4][64];
+    const unsigned char* pass[4] = {PBKDF2_PASS, PBKDF2_PASS, PBKDF2_PASS, PBKDF2_PASS};
+    const size_t passlen[4] = {sizeof(PBKDF2_PASS) - 1, sizeof(PBKDF2_PASS) - 1, sizeof(PBKDF2_PASS) - 1, sizeof(PBKDF2_PASS) - 1};
+    unsigned char* const pout[4] = {out[0], out[1], out[2], out[3]};
+    while (state.KeepRunning())
+        PBKDF2_HMAC_SHA512_4way(pass, passlen, PBKDF2_SALT, sizeof(PBKDF2_SALT) - 1, 2048, pout, sizeof(out[0]));
+}
+
+static void SHA256With(benchmark::State& state, sha256_implementation::UseImplementation use, const char* name, void (*bench)(benchmark::State&))
+{
+    if (SHA256AutoDetect(use).find(name) != std::string::npos)
+        bench(state);
+    SHA256AutoDetect();
+}
+
+static void SHA256_1MB_standard(benchmark::State& state) { SHA256With(state, sha256_implementation::STANDARD, "standard", SHA256_1MB); }
+static void SHA256_1MB_sse4(benchmark::State& state) { SHA256With(state, sha256_implementation::USE_SSE4, "sse4(", SHA256_1MB); }
+static void SHA256_1MB_shani(benchmark::State& state) { SHA256With(state, sha256_implementation::USE_SHANI, "shani(", SHA256_1MB); }
+
+static void SHA256D64_64_standard(benchmark::State& state) { SHA256With(state, sha256_implementation::STANDARD, "standard", SHA256D64_64); }
+static void SHA256D64_64_sse4(benchmark::State& state) { SHA256With(state, sha256_implementation::USE_SSE4, "sse4(", SHA256D64_64); }
+static void SHA256D64_64_sse41(benchmark::State& state) { SHA256With(state, sha256_implementation::USE_SSE41, "sse41(", SHA256D64_64); }
+static void SHA256D64_64_avx2(benchmark::State& state) { SHA256With(state, sha256_implementation::USE_AVX2, "avx2(", SHA256D64_64); }
+static void SHA256D64_64_shani(benchmark::State& state) { SHA256With(state, sha256_implementation::USE_SHANI, "shani(", SHA256D64_64); }
+
+BENCHMARK(RIPEMD160_1MB);
+BENCHMARK(SHA1_1MB);
+BENCHMARK(SHA256_1MB);
+BENCHMARK(SHA512_1MB);
+
+BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_64);
+BENCHMARK(SipHash_32b);
+BENCHMARK(HashWriter_32b);
+BENCHMARK(HashWriter_1MB);
+
+BENCHMARK(Keccak_80b);
+BENCHMARK(Keccak_80b_batch);
+BENCHMARK(Keccak_1MB);
+
+BENCHMARK(PBKDF2_SHA512_2048);
+BENCHMARK(PBKDF2_SHA512_2048_4way);
 
-//BENCHMARK(SHA256_32b);
-//BENCHMARK(SipHash_32b);
+BENCHMARK(SHA256_1MB_standard);
+BENCHMARK(SHA256_1MB_sse4);
+BENCHMARK(SHA256_1MB_shani);
+BENCHMARK(SHA256D64_64_standard);
+BENCHMARK(SHA256D64_64_sse4);
+BENCHMARK(SHA256D64_64_sse41);
+BENCHMARK(SHA256D64_64_avx2);
+BENCHMARK(SHA256D64_64_shani);
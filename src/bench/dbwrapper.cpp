@@ -0,0 +1,262 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "coins.h"
+#include "dbwrapper.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/standard.h"
+#include "spentindex.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+// Entries written into each database, enough for a few table files
+static const int BENCH_DB_ENTRIES = 200000;
+// Address index entries per address, one range read gets all of them
+static const int BENCH_ADDRESS_ENTRIES = 100;
+// Small cache, the reads have to go to the table files mostly
+static const size_t BENCH_DB_CACHE = 1 << 20;
+
+static uint256 BenchHash(FastRandomContext& ctx)
+{
+    std::vector<unsigned char> vchHash(32);
+    for (unsigned char& c : vchHash) {
+        c = ctx.rand32();
+    }
+
+    return uint256(vchHash);
+}
+
+static uint160 BenchAddressHash(FastRandomContext& ctx)
+{
+    std::vector<unsigned char> vchHash(20);
+    for (unsigned char& c : vchHash) {
+        c = ctx.rand32();
+    }
+
+    return uint160(vchHash);
+}
+
+static uint64_t DirectorySize(const boost::filesystem::path& path)
+{
+    uint64_t nSize = 0;
+    for (boost::filesystem::directory_iterator it(path); it != boost::filesystem::directory_iterator(); ++it) {
+        if (boost::filesystem::is_regular_file(it->status())) {
+            nSize += boost::filesystem::file_size(it->path());
+        }
+    }
+    return nSize;
+}
+
+/** A database in a temporary directory with the entries of fill written. It gets reopened
+ *  before the reads, so everything is in table files and its size on disk is printed. */
+class DBBenchSetup
+{
+    boost::filesystem::path pathTemp;
+
+public:
+    std::unique_ptr<CDBWrapper> db;
+
+    template <typename Fill>
+    DBBenchSetup(const std::string& strName, bool fObfuscate, const CDBOptions& dbOptions, Fill fill)
+    {
+        pathTemp = boost::filesystem::temp_directory_path() / strprintf("bench_dbwrapper_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+
+        db.reset(new CDBWrapper(pathTemp, BENCH_DB_CACHE, false, true, fObfuscate, dbOptions));
+        fill(*db);
+        db.reset();
+
+        db.reset(new CDBWrapper(pathTemp, BENCH_DB_CACHE, false, false, fObfuscate, dbOptions));
+
+        double dSize = DirectorySize(pathTemp) / 1048576.0;
+        std::cout << strprintf("%s-disk-MiB,1,%.3f,%.3f,%.3f\n", strName, dSize, dSize, dSize);
+    }
+
+    ~DBBenchSetup()
+    {
+        db.reset();
+        boost::filesystem::remove_all(pathTemp);
+    }
+};
+
+/** Unspent P2PKH outputs, obfuscated like the chainstate. */
+static void FillCoins(CDBWrapper& db, std::vector<COutPoint>& vecOutpoints)
+{
+    FastRandomContext ctx(true);
+    CDBBatch batch(db);
+
+    for (int i = 0; i < BENCH_DB_ENTRIES; i++) {
+        vecOutpoints.push_back(COutPoint(BenchHash(ctx), ctx.rand32() % 4));
+        CScript script = GetScriptForDestination(CKeyID(BenchAddressHash(ctx)));
+        Coin coin(CTxOut(ctx.rand32() % (1000 * COIN), script), 1000000 + i / 10, false);
+        batch.Write(std::make_pair('C', vecOutpoints.back()), coin);
+    }
+
+    db.WriteBatch(batch);
+}
+
+/** Block headers keyed by their hash, like the block index. */
+static void FillHeaders(CDBWrapper& db, std::vector<uint256>& vecHashes)
+{
+    FastRandomContext ctx(true);
+    CDBBatch batch(db);
+    CBlockHeader header;
+
+    for (int i = 0; i < BENCH_DB_ENTRIES; i++) {
+        header.nVersion = 4;
+        header.hashPrevBlock = header.GetHash();
+        header.hashMerkleRoot = BenchHash(ctx);
+        header.nTime = 1500000000 + i * 55;
+        header.nBits = 0x1b0404cb;
+        header.nNonce = ctx.rand32();
+        vecHashes.push_back(header.GetHash());
+        batch.Write(std::make_pair('b', vecHashes.back()), std::make_pair(i, header));
+    }
+
+    db.WriteBatch(batch);
+}
+
+/** Address index entries, every address with BENCH_ADDRESS_ENTRIES of them at ascending heights. */
+static void FillAddressIndex(CDBWrapper& db, std::vector<uint160>& vecAddresses)
+{
+    FastRandomContext ctx(true);
+    CDBBatch batch(db);
+
+    for (int i = 0; i < BENCH_DB_ENTRIES / BENCH_ADDRESS_ENTRIES; i++) {
+        vecAddresses.push_back(BenchAddressHash(ctx));
+        for (int j = 0; j < BENCH_ADDRESS_ENTRIES; j++) {
+            CAddressIndexKey key(1, vecAddresses.back(), 1000000 + j * 50 + ctx.rand32() % 50, ctx.rand32() % 20, BenchHash(ctx), ctx.rand32() % 4, j % 2);
+            batch.Write(std::make_pair('a', key), CAmount(ctx.rand32() % (1000 * COIN)) * (j % 2 ? -1 : 1));
+        }
+    }
+
+    db.WriteBatch(batch);
+}
+
+/** Reward entries of addresses, mostly small amounts and unset fields. */
+static void FillRewards(CDBWrapper& db, std::vector<uint160>& vecAddresses)
+{
+    FastRandomContext ctx(true);
+    CDBBatch batch(db);
+
+    for (int i = 0; i < BENCH_DB_ENTRIES; i++) {
+        vecAddresses.push_back(BenchAddressHash(ctx));
+        CAmount nBalance = CAmount(ctx.rand32() % 100000) * COIN;
+        batch.Write(std::make_pair('E', vecAddresses.back()),
+                    std::make_pair(std::make_pair(nBalance, nBalance), std::make_pair(uint256(), (int)(ctx.rand32() % 2))));
+    }
+
+    db.WriteBatch(batch);
+}
+
+template <typename K, typename V>
+static void ReadRandom(benchmark::State& state, CDBWrapper& db, const std::vector<K>& vecKeys, char chPrefix)
+{
+    FastRandomContext ctx(true);
+    V value;
+
+    while (state.KeepRunning()) {
+        assert(db.Read(std::make_pair(chPrefix, vecKeys[ctx.rand32() % vecKeys.size()]), value));
+    }
+}
+
+static void ChainstateRead(benchmark::State& state, const std::string& strName, const CDBOptions& dbOptions)
+{
+    std::vector<COutPoint> vecOutpoints;
+    DBBenchSetup setup(strName, true, dbOptions, [&vecOutpoints](CDBWrapper& db) { FillCoins(db, vecOutpoints); });
+    ReadRandom<COutPoint, Coin>(state, *setup.db, vecOutpoints, 'C');
+}
+
+static void BlockIndexRead(benchmark::State& state, const std::string& strName, const CDBOptions& dbOptions)
+{
+    std::vector<uint256> vecHashes;
+    DBBenchSetup setup(strName, false, dbOptions, [&vecHashes](CDBWrapper& db) { FillHeaders(db, vecHashes); });
+    ReadRandom<uint256, std::pair<int, CBlockHeader> >(state, *setup.db, vecHashes, 'b');
+}
+
+static void AddressIndexRead(benchmark::State& state, const std::string& strName, const CDBOptions& dbOptions)
+{
+    std::vector<uint160> vecAddresses;
+    DBBenchSetup setup(strName, false, dbOptions, [&vecAddresses](CDBWrapper& db) { FillAddressIndex(db, vecAddresses); });
+    FastRandomContext ctx(true);
+
+    // All entries of an address, like ReadAddressIndex
+    while (state.KeepRunning()) {
+        const uint160& hashBytes = vecAddresses[ctx.rand32() % vecAddresses.size()];
+        std::unique_ptr<CDBIterator> pcursor(setup.db->NewIterator());
+        int nEntries = 0;
+
+        pcursor->Seek(std::make_pair('a', CAddressIndexIteratorKey(1, hashBytes)));
+        while (pcursor->Valid()) {
+            std::pair<char, CAddressIndexKey> key;
+            CAmount nValue;
+            if (!pcursor->GetKey(key) || key.first != 'a' || key.second.hashBytes != hashBytes || !pcursor->GetValue(nValue))
+                break;
+            ++nEntries;
+            pcursor->Next();
+        }
+        assert(nEntries == BENCH_ADDRESS_ENTRIES);
+    }
+}
+
+static void RewardsRead(benchmark::State& state, const std::string& strName, const CDBOptions& dbOptions)
+{
+    std::vector<uint160> vecAddresses;
+    DBBenchSetup setup(strName, false, dbOptions, [&vecAddresses](CDBWrapper& db) { FillRewards(db, vecAddresses); });
+    ReadRandom<uint160, std::pair<std::pair<CAmount, CAmount>, std::pair<uint256, int> > >(state, *setup.db, vecAddresses, 'E');
+}
+
+// Each database with the uncompressed defaults and with the options it gets opened with. The
+// chainstate stays uncompressed, its obfuscated values leave nothing to compress.
+
+static void DBChainstateRead(benchmark::State& state)
+{
+    ChainstateRead(state, "DBChainstateRead", CDBOptions());
+}
+
+static void DBBlockIndexReadUncompressed(benchmark::State& state)
+{
+    BlockIndexRead(state, "DBBlockIndexReadUncompressed", CDBOptions());
+}
+
+static void DBBlockIndexRead(benchmark::State& state)
+{
+    BlockIndexRead(state, "DBBlockIndexRead", CDBOptions(true));
+}
+
+static void DBAddressIndexReadUncompressed(benchmark::State& state)
+{
+    AddressIndexRead(state, "DBAddressIndexReadUncompressed", CDBOptions());
+}
+
+static void DBAddressIndexRead(benchmark::State& state)
+{
+    AddressIndexRead(state, "DBAddressIndexRead", CDBOptions(true, INDEX_DB_BLOCK_SIZE));
+}
+
+static void DBRewardsReadUncompressed(benchmark::State& state)
+{
+    RewardsRead(state, "DBRewardsReadUncompressed", CDBOptions());
+}
+
+static void DBRewardsRead(benchmark::State& state)
+{
+    RewardsRead(state, "DBRewardsRead", CDBOptions(true));
+}
+
+BENCHMARK(DBChainstateRead);
+BENCHMARK(DBBlockIndexReadUncompressed);
+BENCHMARK(DBBlockIndexRead);
+BENCHMARK(DBAddressIndexReadUncompressed);
+BENCHMARK(DBAddressIndexRead);
+BENCHMARK(DBRewardsReadUncompressed);
+BENCHMARK(DBRewardsRead);
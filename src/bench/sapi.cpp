@@ -0,0 +1,456 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chain_setup.h"
+
+#include "base58.h"
+#include "core_io.h"
+#include "net.h"
+#include "netbase.h"
+#include "random.h"
+#include "rpc/server.h"
+#include "sapi/sapi.h"
+#include "smartnode/smartnodesync.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/thread.hpp>
+
+#include <event2/buffer.h>
+#include <event2/event.h>
+#include <event2/http.h>
+#include <event2/keyvalq_struct.h>
+
+/** Default for -sapibenchclients, the connections which send requests at the same time */
+static const int DEFAULT_SAPI_BENCH_CLIENTS = 8;
+/** Default for -sapibenchmix, the weights of the endpoints in the mixed benchmark */
+static const char* const DEFAULT_SAPI_BENCH_MIX = "balance:40,transactions:20,block:20,send:10,check:10";
+/** Default for -sapibenchport, away from the ports of a node which might run on the same machine */
+static const int DEFAULT_SAPI_BENCH_PORT = 28580;
+/** Default for -sapibenchlimiter, whether the requests go through the limiter instead of a whitelisted address */
+static const bool DEFAULT_SAPI_BENCH_LIMITER = false;
+
+// Blocks with transactions to the benchmark address, the history address/transactions pages through.
+static const int BENCH_HISTORY_BLOCKS = 20;
+static const size_t BENCH_HISTORY_TXS = 10;
+// Signed transactions transaction/send submits, every one after the first round is in the mempool already.
+static const size_t BENCH_SEND_TXS = 2000;
+
+enum SAPIBenchEndpoint {
+    SAPI_BENCH_BALANCE,
+    SAPI_BENCH_TRANSACTIONS,
+    SAPI_BENCH_BLOCK,
+    SAPI_BENCH_SEND,
+    SAPI_BENCH_CHECK,
+    SAPI_BENCH_ENDPOINTS
+};
+
+static const char* const SAPI_BENCH_ENDPOINT_NAMES[SAPI_BENCH_ENDPOINTS] = {
+    "balance", "transactions", "block", "send", "check"
+};
+
+struct SAPIBenchRequest {
+    bool fPost;
+    std::string strPath;
+    std::string strBody;
+};
+
+struct SAPIBenchSample {
+    int nEndpoint;
+    int64_t nLatency;
+    bool fSuccess;
+};
+
+struct SAPIBenchReply {
+    struct event_base* base;
+    int nStatus;
+};
+
+static void sapi_bench_request_done(struct evhttp_request* req, void* ctx)
+{
+    SAPIBenchReply* reply = static_cast<SAPIBenchReply*>(ctx);
+
+    // NULL if the connection failed
+    reply->nStatus = req ? evhttp_request_get_response_code(req) : 0;
+
+    // The idle keep-alive connection keeps the loop busy, it has to be left explicitly.
+    event_base_loopbreak(reply->base);
+}
+
+/** One keep-alive connection to the local SAPI server, libevent connects again after the server closed it. */
+class SAPIBenchClient
+{
+    struct event_base* base;
+    struct evhttp_connection* evcon;
+
+public:
+    explicit SAPIBenchClient(uint16_t nPort)
+    {
+        base = event_base_new();
+        if (!base)
+            throw std::runtime_error("SAPIBenchClient: cannot create event_base");
+
+        evcon = evhttp_connection_base_new(base, NULL, "127.0.0.1", nPort);
+        if (!evcon) {
+            event_base_free(base);
+            throw std::runtime_error("SAPIBenchClient: create connection failed");
+        }
+
+        evhttp_connection_set_timeout(evcon, 30);
+    }
+
+    ~SAPIBenchClient()
+    {
+        evhttp_connection_free(evcon);
+        event_base_free(base);
+    }
+
+    //! The HTTP status of the reply, 0 if there is none
+    int Send(const SAPIBenchRequest& request)
+    {
+        SAPIBenchReply reply = {base, 0};
+
+        struct evhttp_request* req = evhttp_request_new(sapi_bench_request_done, &reply);
+        if (!req)
+            return 0;
+
+        struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
+        evhttp_add_header(headers, "Host", "127.0.0.1");
+
+        if (request.fPost) {
+            evhttp_add_header(headers, "Content-Type", "application/json");
+            evbuffer_add(evhttp_request_get_output_buffer(req), request.strBody.data(), request.strBody.size());
+        }
+
+        if (evhttp_make_request(evcon, req, request.fPost ? EVHTTP_REQ_POST : EVHTTP_REQ_GET, request.strPath.c_str()) != 0)
+            return 0;
+
+        event_base_dispatch(base);
+
+        return reply.nStatus;
+    }
+};
+
+/**
+ * Regtest chain with the optional indexes, a history of transactions to the benchmark address
+ * and signed transactions which didn't get mined yet, served by the SAPI server of the process.
+ * The loopback address gets whitelisted unless -sapibenchlimiter is set, the whitelist stays for
+ * the rest of the process then.
+ */
+class SAPIBenchSetup : public BenchChainSetup
+{
+    std::unique_ptr<CConnman> connmanPrev;
+
+public:
+    uint16_t nPort;
+    std::vector<SAPIBenchRequest> vRequests[SAPI_BENCH_ENDPOINTS];
+
+    SAPIBenchSetup() : BenchChainSetup("sapi", true)
+    {
+        std::string strAddress = CBitcoinAddress(key.GetPubKey().GetID()).ToString();
+        FastRandomContext ctx(true);
+
+        CAmount nValue;
+        std::vector<COutPoint> vOutputs = CreateOutputs(BENCH_HISTORY_BLOCKS * BENCH_HISTORY_TXS + BENCH_SEND_TXS, nValue);
+        std::vector<COutPoint>::const_iterator itOutput = vOutputs.begin();
+
+        for (int n = 0; n < BENCH_HISTORY_BLOCKS; ++n) {
+            std::vector<CMutableTransaction> vtx;
+            for (size_t i = 0; i < BENCH_HISTORY_TXS; ++i) {
+                CMutableTransaction tx;
+                tx.vin.push_back(CTxIn(*itOutput++));
+                tx.vout.push_back(CTxOut(nValue / 2, scriptPubKey));
+                tx.vout.push_back(CTxOut(nValue / 2 - COIN / 1000, scriptPubKey));
+                Sign(tx);
+                vtx.push_back(tx);
+            }
+            CreateAndProcessBlock(vtx);
+        }
+
+        for (; itOutput != vOutputs.end(); ++itOutput) {
+            CMutableTransaction tx;
+            tx.vin.push_back(CTxIn(*itOutput));
+            tx.vout.push_back(CTxOut(nValue - COIN / 1000, scriptPubKey));
+            Sign(tx);
+            vRequests[SAPI_BENCH_SEND].push_back({true, "/v1/transaction/send", strprintf("{\"rawtx\":\"%s\"}", EncodeHexTx(tx))});
+        }
+
+        // The address with the history and some without any
+        std::vector<std::string> vAddresses(1, strAddress);
+        for (int i = 0; i < 15; ++i) {
+            CKey keyOther;
+            keyOther.MakeNewKey(true);
+            vAddresses.push_back(CBitcoinAddress(keyOther.GetPubKey().GetID()).ToString());
+        }
+
+        for (const std::string& strAddr : vAddresses) {
+            vRequests[SAPI_BENCH_BALANCE].push_back({false, "/v1/address/balance/" + strAddr, ""});
+            vRequests[SAPI_BENCH_CHECK].push_back({false, "/v1/smartrewards/check/" + strAddr, ""});
+        }
+
+        for (int nPageSize : {1, 10, 100}) {
+            vRequests[SAPI_BENCH_TRANSACTIONS].push_back({true, "/v1/address/transactions", strprintf("{\"address\":\"%s\",\"pageSize\":%d}", strAddress, nPageSize)});
+            vRequests[SAPI_BENCH_TRANSACTIONS].push_back({true, "/v1/address/transactions", strprintf("{\"address\":\"%s\",\"pageSize\":%d,\"ascending\":false}", strAddress, nPageSize)});
+        }
+
+        int nHeight = chainActive.Height();
+        for (int i = 0; i < 32; ++i) {
+            vRequests[SAPI_BENCH_BLOCK].push_back({false, strprintf("/v1/blockchain/block/%d", ctx.rand32() % (nHeight + 1)), ""});
+        }
+
+        // SAPI answers once the node is out of the warmup and synced
+        connmanPrev = std::move(g_connman);
+        g_connman = std::unique_ptr<CConnman>(new CConnman(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max())));
+        SetRPCWarmupFinished();
+        smartnodeSync.Reset();
+        smartnodeSync.SwitchToNextAsset(*g_connman);
+
+        nPort = (uint16_t)GetArg("-sapibenchport", DEFAULT_SAPI_BENCH_PORT);
+        mapArgs["-sapiport"] = itostr(nPort);
+        if (!GetBoolArg("-sapibenchlimiter", DEFAULT_SAPI_BENCH_LIMITER)) {
+            CNetAddr loopback;
+            LookupHost("127.0.0.1", loopback, false);
+            SAPI::AddWhitelistedRange(CSubNet(loopback));
+        }
+
+        if (!InitSAPIServer() || !StartSAPIServer() || !StartSAPI())
+            throw std::runtime_error("SAPIBenchSetup: failed to start the SAPI server");
+    }
+
+    ~SAPIBenchSetup()
+    {
+        InterruptSAPI();
+        InterruptSAPIServer();
+        StopSAPI();
+        StopSAPIServer();
+
+        mapArgs.erase("-sapiport");
+        smartnodeSync.Reset();
+        g_connman = std::move(connmanPrev);
+    }
+};
+
+/**
+ * Clients which send requests of the mix to the server, each one waits for the reply before it
+ * sends the next request. They don't stop until they are told to, KeepRunning consumes one
+ * completed request per iteration, so the average of the benchmark is the time per request at
+ * the concurrency of the clients.
+ */
+class SAPILoad
+{
+    const SAPIBenchSetup& setup;
+    std::vector<int> vSchedule;
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    int64_t nCompleted;
+    int64_t nConsumed;
+    bool fStop;
+
+    std::vector<std::vector<SAPIBenchSample>> vSamples;
+    boost::thread_group threads;
+    int64_t nTimeStart;
+    int64_t nTimeStop;
+
+    void Run(int nClient)
+    {
+        RenameThread("bench-sapi");
+        SAPIBenchClient client(setup.nPort);
+        FastRandomContext ctx;
+        std::vector<SAPIBenchSample>& vClientSamples = vSamples[nClient];
+        // Every client submits its own share of the transactions first
+        size_t nSend = nClient;
+
+        while (true) {
+            {
+                boost::lock_guard<boost::mutex> lock(cs);
+                if (fStop)
+                    break;
+            }
+
+            int nEndpoint = vSchedule[ctx.rand32() % vSchedule.size()];
+            const std::vector<SAPIBenchRequest>& vRequests = setup.vRequests[nEndpoint];
+            size_t nRequest = ctx.rand32() % vRequests.size();
+            if (nEndpoint == SAPI_BENCH_SEND) {
+                nRequest = nSend % vRequests.size();
+                nSend += vSamples.size();
+            }
+
+            int64_t nStart = GetTimeMicros();
+            int nStatus = client.Send(vRequests[nRequest]);
+            vClientSamples.push_back({nEndpoint, GetTimeMicros() - nStart, nStatus == 200});
+
+            {
+                boost::lock_guard<boost::mutex> lock(cs);
+                nCompleted++;
+            }
+            cond.notify_one();
+        }
+    }
+
+public:
+    SAPILoad(const SAPIBenchSetup& setupIn, const std::vector<int>& vWeights, int nClients) :
+        setup(setupIn), nCompleted(0), nConsumed(0), fStop(false), vSamples(nClients), nTimeStop(0)
+    {
+        for (int nEndpoint = 0; nEndpoint < SAPI_BENCH_ENDPOINTS; ++nEndpoint) {
+            vSchedule.insert(vSchedule.end(), vWeights[nEndpoint], nEndpoint);
+        }
+        if (vSchedule.empty())
+            throw std::runtime_error("SAPILoad: no endpoint in the mix");
+
+        nTimeStart = GetTimeMicros();
+        for (int i = 0; i < nClients; ++i) {
+            threads.create_thread(boost::bind(&SAPILoad::Run, this, i));
+        }
+    }
+
+    ~SAPILoad()
+    {
+        Stop();
+    }
+
+    //! Wait for the next completed request
+    void WaitForRequest()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (nCompleted == nConsumed) {
+            cond.wait(lock);
+        }
+        nConsumed++;
+    }
+
+    void Stop()
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            if (fStop)
+                return;
+            fStop = true;
+        }
+        threads.join_all();
+        nTimeStop = GetTimeMicros();
+    }
+
+    //! Print one line for every endpoint of the mix and one for all of them
+    void Report(const std::string& strName) const
+    {
+        std::vector<int64_t> vLatencies[SAPI_BENCH_ENDPOINTS + 1];
+        int64_t nErrors[SAPI_BENCH_ENDPOINTS + 1] = {};
+
+        for (const std::vector<SAPIBenchSample>& vClientSamples : vSamples) {
+            for (const SAPIBenchSample& sample : vClientSamples) {
+                for (int nIndex : {sample.nEndpoint, (int)SAPI_BENCH_ENDPOINTS}) {
+                    vLatencies[nIndex].push_back(sample.nLatency);
+                    nErrors[nIndex] += !sample.fSuccess;
+                }
+            }
+        }
+
+        double dElapsed = std::max<int64_t>(nTimeStop - nTimeStart, 1) * 0.000001;
+
+        for (int nIndex = 0; nIndex <= SAPI_BENCH_ENDPOINTS; ++nIndex) {
+            std::vector<int64_t>& vLatency = vLatencies[nIndex];
+            if (vLatency.empty())
+                continue;
+
+            std::sort(vLatency.begin(), vLatency.end());
+            auto percentile = [&vLatency](double dPercent) {
+                return vLatency[std::min<size_t>(vLatency.size() * dPercent, vLatency.size() - 1)] * 0.001;
+            };
+
+            std::cout << strprintf("%s-%s,%d,%d,%.1f,%.3f,%.3f,%.3f,%.3f\n", strName,
+                                   nIndex == SAPI_BENCH_ENDPOINTS ? "all" : SAPI_BENCH_ENDPOINT_NAMES[nIndex],
+                                   vSamples.size(), nErrors[nIndex], vLatency.size() / dElapsed,
+                                   percentile(0.5), percentile(0.9), percentile(0.99), vLatency.back() * 0.001);
+        }
+    }
+};
+
+/** Weights of the endpoints from a list like balance:40,send:10, the ones it doesn't name get 0 */
+static std::vector<int> ParseSAPIBenchMix(const std::string& strMix)
+{
+    std::vector<int> vWeights(SAPI_BENCH_ENDPOINTS, 0);
+    std::vector<std::string> vEntries;
+    boost::split(vEntries, strMix, boost::is_any_of(","));
+
+    for (const std::string& strEntry : vEntries) {
+        size_t nPos = strEntry.find(':');
+        const char* const* pName = std::find(SAPI_BENCH_ENDPOINT_NAMES, SAPI_BENCH_ENDPOINT_NAMES + SAPI_BENCH_ENDPOINTS, strEntry.substr(0, nPos));
+        int32_t nWeight = 1;
+        if (pName == SAPI_BENCH_ENDPOINT_NAMES + SAPI_BENCH_ENDPOINTS || (nPos != std::string::npos && !ParseInt32(strEntry.substr(nPos + 1), &nWeight)) || nWeight < 0)
+            throw std::runtime_error(strprintf("Invalid -sapibenchmix entry: '%s'", strEntry));
+        vWeights[pName - SAPI_BENCH_ENDPOINT_NAMES] = nWeight;
+    }
+
+    return vWeights;
+}
+
+static void RunSAPILoad(benchmark::State& state, const std::string& strName, const std::vector<int>& vWeights)
+{
+    SAPIBenchSetup setup;
+    int nClients = std::max<int>(GetArg("-sapibenchclients", DEFAULT_SAPI_BENCH_CLIENTS), 1);
+    SAPILoad load(setup, vWeights, nClients);
+
+    while (state.KeepRunning()) {
+        load.WaitForRequest();
+    }
+
+    load.Stop();
+
+    std::cout << "#SAPI load,clients,errors,req/s,p50 ms,p90 ms,p99 ms,max ms\n";
+    load.Report(strName);
+}
+
+static std::vector<int> SingleEndpoint(SAPIBenchEndpoint endpoint)
+{
+    std::vector<int> vWeights(SAPI_BENCH_ENDPOINTS, 0);
+    vWeights[endpoint] = 1;
+    return vWeights;
+}
+
+static void SAPIMixed(benchmark::State& state)
+{
+    RunSAPILoad(state, "SAPIMixed", ParseSAPIBenchMix(GetArg("-sapibenchmix", DEFAULT_SAPI_BENCH_MIX)));
+}
+
+static void SAPIAddressBalance(benchmark::State& state)
+{
+    RunSAPILoad(state, "SAPIAddressBalance", SingleEndpoint(SAPI_BENCH_BALANCE));
+}
+
+static void SAPIAddressTransactions(benchmark::State& state)
+{
+    RunSAPILoad(state, "SAPIAddressTransactions", SingleEndpoint(SAPI_BENCH_TRANSACTIONS));
+}
+
+static void SAPIBlockchainBlock(benchmark::State& state)
+{
+    RunSAPILoad(state, "SAPIBlockchainBlock", SingleEndpoint(SAPI_BENCH_BLOCK));
+}
+
+static void SAPITransactionSend(benchmark::State& state)
+{
+    RunSAPILoad(state, "SAPITransactionSend", SingleEndpoint(SAPI_BENCH_SEND));
+}
+
+static void SAPISmartRewardsCheck(benchmark::State& state)
+{
+    RunSAPILoad(state, "SAPISmartRewardsCheck", SingleEndpoint(SAPI_BENCH_CHECK));
+}
+
+BENCHMARK(SAPIMixed);
+BENCHMARK(SAPIAddressBalance);
+BENCHMARK(SAPIAddressTransactions);
+BENCHMARK(SAPIBlockchainBlock);
+BENCHMARK(SAPITransactionSend);
+BENCHMARK(SAPISmartRewardsCheck);
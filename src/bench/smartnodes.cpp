@@ -0,0 +1,348 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "compat.h"
+#include "key.h"
+#include "net.h"
+#include "random.h"
+#include "script/standard.h"
+#include "smartnode/flat-database.h"
+#include "smartnode/smartnodepayments.h"
+#include "smartnode/smartnodeman.h"
+#include "smartnode/smartnodesync.h"
+#include "util.h"
+#include "validation.h"
+
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+// The testnet rules apply from low heights on. The payment queue wants twice as many
+// confirmations of the collaterals as there are smartnodes, the chain covers 20k of them.
+static const int BENCH_CHAIN_HEIGHT = 50000;
+// More than the smartnode signature cache holds, every check of the pool verifies for real.
+static const size_t BENCH_SIGNED_MESSAGES = 25000;
+
+static uint256 BenchHash(FastRandomContext& ctx)
+{
+    std::vector<unsigned char> vchHash(32);
+    for (unsigned char& c : vchHash) {
+        c = ctx.rand32();
+    }
+
+    return uint256(vchHash);
+}
+
+/** Testnet parameters, a fabricated chain and collaterals, the smartnode sync finished and a
+ *  temporary data directory for the cache files. */
+class SmartnodeBenchSetup
+{
+    boost::filesystem::path pathTemp;
+    ECCVerifyHandle verifyHandle;
+    std::vector<uint256> vecHashes;
+    std::vector<CBlockIndex> vecBlocks;
+    CCoinsView viewDummy;
+    CCoinsViewCache* pcoinsPrevious;
+
+public:
+    CConnman connman;
+    CCoinsViewCache coins;
+
+    SmartnodeBenchSetup() : pcoinsPrevious(pcoinsTip), connman(0, 0), coins(&viewDummy)
+    {
+        SelectParams(CBaseChainParams::TESTNET);
+        ClearDatadirCache();
+        pathTemp = boost::filesystem::temp_directory_path() / strprintf("bench_smartnodes_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+
+        // Same hashes for every setup, the signed messages refer to them
+        FastRandomContext ctx(true);
+        vecHashes.resize(BENCH_CHAIN_HEIGHT + 1);
+        vecBlocks.resize(BENCH_CHAIN_HEIGHT + 1);
+
+        LOCK(cs_main);
+
+        for (int i = 0; i <= BENCH_CHAIN_HEIGHT; ++i) {
+            vecHashes[i] = BenchHash(ctx);
+
+            CBlockIndex& block = vecBlocks[i];
+            block.phashBlock = &vecHashes[i];
+            block.pprev = i ? &vecBlocks[i - 1] : NULL;
+            block.nHeight = i;
+            mapBlockIndex[vecHashes[i]] = &block;
+        }
+
+        chainActive.SetTip(&vecBlocks.back());
+        pcoinsTip = &coins;
+
+        smartnodeSync.Reset();
+        while (!smartnodeSync.IsSynced()) {
+            smartnodeSync.SwitchToNextAsset(connman);
+        }
+    }
+
+    ~SmartnodeBenchSetup()
+    {
+        LOCK(cs_main);
+
+        smartnodeSync.Reset();
+        pcoinsTip = pcoinsPrevious;
+        chainActive.SetTip(NULL);
+
+        for (const uint256& hash : vecHashes) {
+            mapBlockIndex.erase(hash);
+        }
+
+        ClearDatadirCache();
+        boost::filesystem::remove_all(pathTemp);
+    }
+};
+
+/** Smartnode with the collateral in the coins of the setup, enabled for a while already. */
+static CSmartnode BenchSmartnode(SmartnodeBenchSetup& setup, FastRandomContext& ctx, uint32_t nIndex, const CPubKey& pubKeyCollateral, const CPubKey& pubKeySmartnode)
+{
+    struct in_addr ip;
+    ip.s_addr = htonl(0x0a000000 + nIndex);
+
+    COutPoint outpoint(BenchHash(ctx), 0);
+    CSmartnode mn(CService(CNetAddr(ip), Params().GetDefaultPort()), outpoint, pubKeyCollateral, pubKeySmartnode, PROTOCOL_VERSION);
+
+    int64_t nNow = GetAdjustedTime();
+
+    mn.nActiveState = CSmartnode::SMARTNODE_ENABLED;
+    // Long enough ago the payment queue doesn't take the smartnodes as new
+    mn.sigTime = nNow - 60 * 24 * 60 * 60;
+    mn.nBlockLastPaid = ctx.rand32() % BENCH_CHAIN_HEIGHT;
+    mn.vchSig.resize(65);
+    mn.lastPing.outpoint = outpoint;
+    mn.lastPing.blockHash = chainActive[BENCH_CHAIN_HEIGHT - 33]->GetBlockHash();
+    mn.lastPing.sigTime = nNow - 60;
+    mn.lastPing.vchSig.resize(65);
+
+    setup.coins.AddCoin(outpoint, Coin(CTxOut(SMARTNODE_COIN_REQUIRED * COIN, GetScriptForDestination(pubKeyCollateral.GetID())), 1, false), false);
+
+    return mn;
+}
+
+/** Unsigned smartnodes with made up keys, only the hashes of the keys matter for the list. */
+static void FillSmartnodes(SmartnodeBenchSetup& setup, CSmartnodeMan& man, size_t nSmartnodes)
+{
+    FastRandomContext ctx(true);
+    LOCK(cs_main);
+
+    for (size_t i = 0; i < nSmartnodes; ++i) {
+        std::vector<unsigned char> vchKey(33);
+        for (unsigned char& c : vchKey) {
+            c = ctx.rand32();
+        }
+        vchKey[0] = 0x02;
+
+        CPubKey pubKey(vchKey);
+        CSmartnode mn = BenchSmartnode(setup, ctx, i, pubKey, pubKey);
+        man.Add(mn);
+    }
+}
+
+/** Signed broadcasts with their signed pings, the signing takes a few seconds. */
+static const std::vector<CSmartnodeBroadcast>& SignedBroadcasts(SmartnodeBenchSetup& setup)
+{
+    static std::vector<CSmartnodeBroadcast> vecBroadcasts;
+
+    if (!vecBroadcasts.empty()) {
+        return vecBroadcasts;
+    }
+
+    FastRandomContext ctx(true);
+    LOCK(cs_main);
+
+    for (size_t i = 0; i < BENCH_SIGNED_MESSAGES; ++i) {
+        CKey key;
+        key.MakeNewKey(true);
+
+        CSmartnodeBroadcast mnb(BenchSmartnode(setup, ctx, i, key.GetPubKey(), key.GetPubKey()));
+
+        if (!mnb.lastPing.Sign(key, key.GetPubKey()) || !mnb.Sign(key)) {
+            throw std::runtime_error("SignedBroadcasts: failed to sign");
+        }
+
+        vecBroadcasts.push_back(mnb);
+    }
+
+    return vecBroadcasts;
+}
+
+static void Ranks(benchmark::State& state, size_t nSmartnodes)
+{
+    SmartnodeBenchSetup setup;
+    CSmartnodeMan man;
+    FillSmartnodes(setup, man, nSmartnodes);
+
+    CSmartnodeMan::rank_pair_vec_t vecRanks;
+    int nOffset = 0;
+
+    // Every call sees a changed list, the ranks get calculated again instead of coming from the cache.
+    while (state.KeepRunning()) {
+        man.NotifyStateChanged();
+        man.GetSmartnodeRanks(vecRanks, BENCH_CHAIN_HEIGHT - nOffset);
+        nOffset = (nOffset + 1) % 100;
+    }
+}
+
+static void Queue(benchmark::State& state, size_t nSmartnodes)
+{
+    SmartnodeBenchSetup setup;
+    CSmartnodeMan man;
+    FillSmartnodes(setup, man, nSmartnodes);
+
+    while (state.KeepRunning()) {
+        int nCount;
+        CSmartNodeWinners winners;
+        man.GetNextSmartnodesInQueueForPayment(BENCH_CHAIN_HEIGHT, true, nCount, winners);
+    }
+}
+
+static void CheckAndRemove(benchmark::State& state, size_t nSmartnodes)
+{
+    SmartnodeBenchSetup setup;
+    CSmartnodeMan man;
+    FillSmartnodes(setup, man, nSmartnodes);
+
+    // Nothing expires, the list stays the same across the iterations.
+    while (state.KeepRunning()) {
+        man.CheckAndRemove(setup.connman);
+    }
+}
+
+static void DumpLoad(benchmark::State& state, size_t nSmartnodes)
+{
+    SmartnodeBenchSetup setup;
+    CSmartnodeMan man;
+    FillSmartnodes(setup, man, nSmartnodes);
+
+    CFlatDB<CSmartnodeMan> flatdb("sncache.dat", "magicSmartnodeCache");
+
+    while (state.KeepRunning()) {
+        CSmartnodeMan manLoaded;
+        flatdb.Dump(man);
+        flatdb.Load(manLoaded);
+    }
+}
+
+static void SmartnodeRanks1k(benchmark::State& state)
+{
+    Ranks(state, 1000);
+}
+
+static void SmartnodeRanks5k(benchmark::State& state)
+{
+    Ranks(state, 5000);
+}
+
+static void SmartnodeRanks20k(benchmark::State& state)
+{
+    Ranks(state, 20000);
+}
+
+static void SmartnodeQueue1k(benchmark::State& state)
+{
+    Queue(state, 1000);
+}
+
+static void SmartnodeQueue5k(benchmark::State& state)
+{
+    Queue(state, 5000);
+}
+
+static void SmartnodeQueue20k(benchmark::State& state)
+{
+    Queue(state, 20000);
+}
+
+static void SmartnodeCheckAndRemove1k(benchmark::State& state)
+{
+    CheckAndRemove(state, 1000);
+}
+
+static void SmartnodeCheckAndRemove5k(benchmark::State& state)
+{
+    CheckAndRemove(state, 5000);
+}
+
+static void SmartnodeCheckAndRemove20k(benchmark::State& state)
+{
+    CheckAndRemove(state, 20000);
+}
+
+static void SmartnodeCacheDumpLoad1k(benchmark::State& state)
+{
+    DumpLoad(state, 1000);
+}
+
+static void SmartnodeCacheDumpLoad5k(benchmark::State& state)
+{
+    DumpLoad(state, 5000);
+}
+
+static void SmartnodeCacheDumpLoad20k(benchmark::State& state)
+{
+    DumpLoad(state, 20000);
+}
+
+// The checks a broadcast passes before it gets to the list. Past them the update of the list
+// connects to the smartnode on testnet, that isn't benched.
+static void SmartnodeBroadcastCheck(benchmark::State& state)
+{
+    SmartnodeBenchSetup setup;
+    const std::vector<CSmartnodeBroadcast>& vecBroadcasts = SignedBroadcasts(setup);
+    size_t nNext = 0;
+
+    while (state.KeepRunning()) {
+        LOCK(cs_main);
+        CSmartnodeBroadcast mnb = vecBroadcasts[nNext];
+        int nDos;
+        if (!mnb.SimpleCheck(nDos) || !mnb.CheckSignature(nDos)) {
+            throw std::runtime_error("SmartnodeBroadcastCheck: broadcast rejected");
+        }
+        nNext = (nNext + 1) % vecBroadcasts.size();
+    }
+}
+
+// Same for the pings, checking a ping against the list connects to the SAPI port of the smartnode.
+static void SmartnodePingCheck(benchmark::State& state)
+{
+    SmartnodeBenchSetup setup;
+    const std::vector<CSmartnodeBroadcast>& vecBroadcasts = SignedBroadcasts(setup);
+    size_t nNext = 0;
+
+    while (state.KeepRunning()) {
+        LOCK(cs_main);
+        CSmartnodeBroadcast mnb = vecBroadcasts[nNext];
+        int nDos;
+        if (!mnb.lastPing.SimpleCheck(nDos) || !mnb.lastPing.CheckSignature(mnb.pubKeySmartnode, nDos)) {
+            throw std::runtime_error("SmartnodePingCheck: ping rejected");
+        }
+        nNext = (nNext + 1) % vecBroadcasts.size();
+    }
+}
+
+BENCHMARK(SmartnodeRanks1k);
+BENCHMARK(SmartnodeRanks5k);
+BENCHMARK(SmartnodeRanks20k);
+BENCHMARK(SmartnodeQueue1k);
+BENCHMARK(SmartnodeQueue5k);
+BENCHMARK(SmartnodeQueue20k);
+BENCHMARK(SmartnodeCheckAndRemove1k);
+BENCHMARK(SmartnodeCheckAndRemove5k);
+BENCHMARK(SmartnodeCheckAndRemove20k);
+BENCHMARK(SmartnodeCacheDumpLoad1k);
+BENCHMARK(SmartnodeCacheDumpLoad5k);
+BENCHMARK(SmartnodeCacheDumpLoad20k);
+BENCHMARK(SmartnodeBroadcastCheck);
+BENCHMARK(SmartnodePingCheck);
@@ -0,0 +1,256 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blockscripts.h"
+#include "chainparams.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "script/standard.h"
+#include "smartrewards/rewards.h"
+#include "smartrewards/rewardspayments.h"
+#include "util.h"
+#include "utilstrencodings.h"
+
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+// Mainnet round the synthetic populations get evaluated in, past the 2.0 rules.
+static const uint16_t BENCH_ROUND = 70;
+// Entries which take part in the round, the lookback over the previous results is quadratic in it.
+static const size_t BENCH_ELIGIBLE_ENTRIES = 1000;
+
+/** Mainnet parameters and a temporary data directory, the rewards database is kept in memory. */
+class RewardsBenchSetup
+{
+    boost::filesystem::path pathTemp;
+
+public:
+    RewardsBenchSetup()
+    {
+        SelectParams(CBaseChainParams::MAIN);
+        ClearDatadirCache();
+        pathTemp = boost::filesystem::temp_directory_path() / strprintf("bench_smartrewards_%lu_%i", (unsigned long)GetTime(), (int)GetRand(100000));
+        boost::filesystem::create_directories(pathTemp);
+        mapArgs["-datadir"] = pathTemp.string();
+    }
+
+    ~RewardsBenchSetup()
+    {
+        ClearDatadirCache();
+        boost::filesystem::remove_all(pathTemp);
+    }
+};
+
+static CSmartAddress BenchAddress(FastRandomContext& ctx)
+{
+    std::vector<unsigned char> vchKey(20);
+    for (unsigned char& c : vchKey) {
+        c = ctx.rand32();
+    }
+
+    return CSmartAddress(CTxDestination(CKeyID(uint160(vchKey))));
+}
+
+static uint256 BenchHash(FastRandomContext& ctx)
+{
+    std::vector<unsigned char> vchHash(32);
+    for (unsigned char& c : vchHash) {
+        c = ctx.rand32();
+    }
+
+    return uint256(vchHash);
+}
+
+static CSmartRewardRound BenchRound(uint16_t nNumber, int64_t nEligible)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    CSmartRewardRound round;
+
+    round.number = nNumber;
+    round.startBlockHeight = HF_V2_5_HEIGHT + (nNumber - BENCH_ROUND) * consensus.nRewardsBlocksPerRound_1_3;
+    round.endBlockHeight = round.startBlockHeight + consensus.nRewardsBlocksPerRound_1_3 - 1;
+    round.startBlockTime = 1600000000 + (int64_t)(nNumber - BENCH_ROUND) * consensus.nRewardsBlocksPerRound_1_3 * 55;
+    round.endBlockTime = round.startBlockTime + consensus.nRewardsBlocksPerRound_1_3 * 55;
+    round.eligibleEntries = nEligible;
+    round.eligibleSmart = nEligible * 5000 * COIN;
+    round.percent = 0.01;
+
+    return round;
+}
+
+/** Fill the cache with nEntries entries, the first nEligible ones qualify for the round. */
+static void FillEntries(CSmartRewardsCache& cache, FastRandomContext& ctx, size_t nEntries, size_t nEligible, std::vector<CSmartAddress>* pIds = nullptr)
+{
+    for (size_t i = 0; i < nEntries; ++i) {
+        CSmartRewardEntry* entry = cache.CreateEntry(BenchAddress(ctx));
+
+        if (i < nEligible) {
+            entry->balance = 5000 * COIN;
+            entry->balanceEligible = entry->balance;
+            entry->activationTx = BenchHash(ctx);
+            entry->fActivated = true;
+            entry->bonusLevel = CSmartRewardEntry::NoBonus;
+        } else {
+            entry->balance = (1 + ctx.rand32() % 10000) * COIN;
+        }
+
+        entry->balanceAtStart = entry->balance;
+        cache.AddEntry(entry);
+
+        if (pIds) {
+            pIds->push_back(entry->id);
+        }
+    }
+}
+
+/** In-memory rewards database with nEntries entries and the benchmark round as current round. */
+static CSmartRewardsDB* CreateBenchDB(size_t nEntries, size_t nEligible, std::vector<CSmartAddress>* pIds = nullptr)
+{
+    FastRandomContext ctx(true);
+    CSmartRewardsDB* pdb = new CSmartRewardsDB(1 << 26, true, false);
+    CSmartRewardsCache cache;
+
+    FillEntries(cache, ctx, nEntries, nEligible, pIds);
+
+    {
+        LOCK(cs_rewardscache);
+        cache.SetCurrentRound(BenchRound(BENCH_ROUND, nEligible));
+    }
+
+    if (!pdb->SyncCached(cache)) {
+        throw std::runtime_error("CreateBenchDB: failed to write the entries");
+    }
+
+    return pdb;
+}
+
+static void EvaluateRounds(benchmark::State& state, size_t nEntries)
+{
+    RewardsBenchSetup setup;
+    CSmartRewards rewards(CreateBenchDB(nEntries, std::min(nEntries, BENCH_ELIGIBLE_ENTRIES)));
+
+    // Every call finishes the current round and starts the next one. The entries stay in the
+    // cache after the first call, the database still gets walked every time.
+    while (state.KeepRunning()) {
+        const CSmartRewardRound* current = rewards.GetCurrentRound();
+        CSmartRewardRound next = BenchRound(current->number + 1, 0);
+
+        rewards.EvaluateRound(next);
+    }
+}
+
+static void SmartRewardsEvaluateRound10k(benchmark::State& state)
+{
+    EvaluateRounds(state, 10000);
+}
+
+static void SmartRewardsEvaluateRound100k(benchmark::State& state)
+{
+    EvaluateRounds(state, 100000);
+}
+
+static void SmartRewardsEvaluateRound1M(benchmark::State& state)
+{
+    EvaluateRounds(state, 1000000);
+}
+
+// One block of 1000 transactions with two outputs each to a population of 10k addresses, the
+// outputs get spent again right away so the balances stay the same across the iterations.
+static void SmartRewardsProcessBlock(benchmark::State& state)
+{
+    RewardsBenchSetup setup;
+    FastRandomContext ctx(true);
+    std::vector<CSmartAddress> ids;
+    CSmartRewards rewards(CreateBenchDB(10000, BENCH_ELIGIBLE_ENTRIES, &ids));
+
+    std::vector<CTransaction> vtx;
+
+    for (int i = 0; i < 1000; ++i) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(BenchHash(ctx), 0);
+
+        for (int j = 0; j < 2; ++j) {
+            CSmartAddress id = ids[ctx.rand32() % ids.size()];
+            mtx.vout.push_back(CTxOut((1 + ctx.rand32() % 100) * COIN, GetScriptForDestination(id.Get())));
+        }
+
+        vtx.push_back(CTransaction(mtx));
+    }
+
+    const CSmartRewardRound round = BenchRound(BENCH_ROUND, BENCH_ELIGIBLE_ENTRIES);
+    int nHeight = round.startBlockHeight;
+
+    while (state.KeepRunning()) {
+        CSmartRewardsUpdateResult result;
+
+        for (const CTransaction& tx : vtx) {
+            for (const CTxOut& out : tx.vout) {
+                rewards.ProcessOutput(tx, out, CDecodedScript(out.scriptPubKey), round.number, nHeight, round.startBlockTime, result);
+            }
+        }
+
+        for (const CTransaction& tx : vtx) {
+            for (const CTxOut& out : tx.vout) {
+                rewards.ProcessInput(tx, out, CDecodedScript(out.scriptPubKey), nHeight, round.number, result);
+            }
+        }
+    }
+}
+
+static void SmartRewardsGetPaymentsForBlock(benchmark::State& state)
+{
+    RewardsBenchSetup setup;
+    CSmartRewards rewards(CreateBenchDB(100000, BENCH_ELIGIBLE_ENTRIES));
+
+    // Finish the round to get a result to pay out.
+    CSmartRewardRound next = BenchRound(BENCH_ROUND + 1, 0);
+    rewards.EvaluateRound(next);
+
+    const CSmartRewardsRoundResult* pResult = rewards.GetLastRoundResult();
+    int64_t nFirst = pResult->round.endBlockHeight + Params().GetConsensus().nRewardsPayoutStartDelay;
+    int64_t nBlocks = pResult->round.nBlockInterval * 100;
+    int64_t nOffset = 0;
+
+    CSmartRewards* pPrevious = prewards;
+    prewards = &rewards;
+
+    while (state.KeepRunning()) {
+        SmartRewardPayments::Result result;
+        SmartRewardPayments::GetPaymentsForBlock(nFirst + nOffset, 0, result);
+        nOffset = (nOffset + 1) % std::max<int64_t>(nBlocks, 1);
+    }
+
+    prewards = pPrevious;
+}
+
+static void SmartRewardsSyncCached(benchmark::State& state)
+{
+    RewardsBenchSetup setup;
+    FastRandomContext ctx(true);
+    CSmartRewardsDB db(1 << 26, true, false);
+    CSmartRewardsCache cache;
+
+    FillEntries(cache, ctx, 10000, BENCH_ELIGIBLE_ENTRIES);
+
+    {
+        LOCK(cs_rewardscache);
+        cache.SetCurrentRound(BenchRound(BENCH_ROUND, BENCH_ELIGIBLE_ENTRIES));
+    }
+
+    // Writes the same 10k entries over and over again.
+    while (state.KeepRunning()) {
+        db.SyncCached(cache);
+    }
+}
+
+BENCHMARK(SmartRewardsEvaluateRound10k);
+BENCHMARK(SmartRewardsEvaluateRound100k);
+BENCHMARK(SmartRewardsEvaluateRound1M);
+BENCHMARK(SmartRewardsProcessBlock);
+BENCHMARK(SmartRewardsGetPaymentsForBlock);
+BENCHMARK(SmartRewardsSyncCached);
@@ -0,0 +1,59 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "random.h"
+#include "utilstrencodings.h"
+
+#include <string>
+#include <vector>
+
+// About the size of a full block in getblock verbosity 0 or a large raw transaction
+static const size_t HEX_BENCH_BYTES = 1000000;
+
+static std::vector<unsigned char> HexBenchData()
+{
+    std::vector<unsigned char> vch(HEX_BENCH_BYTES);
+    GetRandBytes(vch.data(), vch.size());
+    return vch;
+}
+
+static void HexStrBlock(benchmark::State& state)
+{
+    std::vector<unsigned char> vch = HexBenchData();
+    while (state.KeepRunning()) {
+        HexStr(vch.data(), vch.data() + vch.size());
+    }
+}
+
+static void HexStrScript(benchmark::State& state)
+{
+    std::vector<unsigned char> vch = HexBenchData();
+    vch.resize(25);
+    while (state.KeepRunning()) {
+        HexStr(vch);
+    }
+}
+
+static void ParseHexBlock(benchmark::State& state)
+{
+    std::string strHex = HexStr(HexBenchData());
+    while (state.KeepRunning()) {
+        ParseHex(strHex);
+    }
+}
+
+static void IsHexBlock(benchmark::State& state)
+{
+    std::string strHex = HexStr(HexBenchData());
+    while (state.KeepRunning()) {
+        IsHex(strHex);
+    }
+}
+
+BENCHMARK(HexStrBlock);
+BENCHMARK(HexStrScript);
+BENCHMARK(ParseHexBlock);
+BENCHMARK(IsHexBlock);
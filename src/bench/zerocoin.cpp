@@ -0,0 +1,152 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "libzerocoin/Zerocoin.h"
+#include "streams.h"
+#include "taskpool.h"
+#include "util.h"
+#include "version.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+using namespace libzerocoin;
+
+// Coins accumulated in one iteration, the pre HF_ZEROCOIN_DISABLE history ran into thousands
+static const int BENCH_ZEROCOIN_COINS = 16;
+
+/**
+ * Parameters from a fresh RSA modulus nobody keeps the factors of, and a set
+ * of minted coins. Generated once on first use, that takes a few seconds.
+ */
+class ZerocoinBenchSetup
+{
+public:
+    std::unique_ptr<Params> params;
+    std::vector<PrivateCoin> vecPrivate;
+    std::vector<PublicCoin> vecPublic;
+
+    ZerocoinBenchSetup()
+    {
+        Bignum p = Bignum::generatePrime(1024, false);
+        Bignum q = Bignum::generatePrime(1024, false);
+        Bignum modulus = p * q;
+        params.reset(new Params(modulus, modulus));
+
+        for (int i = 0; i < BENCH_ZEROCOIN_COINS; i++) {
+            vecPrivate.push_back(PrivateCoin(params.get()));
+            vecPublic.push_back(vecPrivate.back().getPublicCoin());
+        }
+    }
+};
+
+static const ZerocoinBenchSetup& ZerocoinSetup()
+{
+    static ZerocoinBenchSetup setup;
+    return setup;
+}
+
+/** Workers for the batched accumulation, bench_bitcoin doesn't start the task pool otherwise */
+class TaskPoolBenchSetup
+{
+public:
+    TaskPoolBenchSetup() { taskPool.Start(std::max(GetNumCores(), 2)); }
+    ~TaskPoolBenchSetup() { taskPool.Stop(); }
+};
+
+static void Zerocoin_Mint(benchmark::State& state)
+{
+    const ZerocoinBenchSetup& setup = ZerocoinSetup();
+    while (state.KeepRunning()) {
+        PrivateCoin coin(setup.params.get());
+        assert(coin.getPublicCoin().validate());
+    }
+}
+
+static void Zerocoin_Accumulate(benchmark::State& state)
+{
+    const ZerocoinBenchSetup& setup = ZerocoinSetup();
+    while (state.KeepRunning()) {
+        Accumulator acc(setup.params.get());
+        for (const PublicCoin& coin : setup.vecPublic)
+            acc += coin;
+    }
+}
+
+static void Zerocoin_AccumulateBatch(benchmark::State& state)
+{
+    const ZerocoinBenchSetup& setup = ZerocoinSetup();
+    TaskPoolBenchSetup pool;
+    while (state.KeepRunning()) {
+        Accumulator acc(setup.params.get());
+        acc.accumulate(setup.vecPublic);
+    }
+}
+
+static void Zerocoin_Witness(benchmark::State& state)
+{
+    const ZerocoinBenchSetup& setup = ZerocoinSetup();
+    Accumulator checkpoint(setup.params.get());
+    while (state.KeepRunning()) {
+        AccumulatorWitness witness(setup.params.get(), checkpoint, setup.vecPublic[0]);
+        for (const PublicCoin& coin : setup.vecPublic)
+            witness += coin;
+    }
+}
+
+static void Zerocoin_WitnessBatch(benchmark::State& state)
+{
+    const ZerocoinBenchSetup& setup = ZerocoinSetup();
+    TaskPoolBenchSetup pool;
+    Accumulator checkpoint(setup.params.get());
+    while (state.KeepRunning()) {
+        AccumulatorWitness witness(setup.params.get(), checkpoint, setup.vecPublic[0]);
+        witness.AddElements(setup.vecPublic);
+    }
+}
+
+static void Zerocoin_Spend(benchmark::State& state)
+{
+    const ZerocoinBenchSetup& setup = ZerocoinSetup();
+    Accumulator acc(setup.params.get());
+    acc.accumulate(setup.vecPublic);
+    AccumulatorWitness witness(setup.params.get(), Accumulator(setup.params.get()), setup.vecPublic[0]);
+    witness.AddElements(setup.vecPublic);
+    SpendMetaData metaData(1, 1);
+
+    while (state.KeepRunning()) {
+        CoinSpend spend(setup.params.get(), setup.vecPrivate[0], acc, witness, metaData);
+    }
+}
+
+static void Zerocoin_SpendVerify(benchmark::State& state)
+{
+    const ZerocoinBenchSetup& setup = ZerocoinSetup();
+    Accumulator acc(setup.params.get());
+    acc.accumulate(setup.vecPublic);
+    AccumulatorWitness witness(setup.params.get(), Accumulator(setup.params.get()), setup.vecPublic[0]);
+    witness.AddElements(setup.vecPublic);
+    SpendMetaData metaData(1, 1);
+
+    // Verified the way it arrives, out of its serialization
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CoinSpend(setup.params.get(), setup.vecPrivate[0], acc, witness, metaData);
+    CoinSpend spend(setup.params.get(), ss);
+
+    while (state.KeepRunning()) {
+        bool fValid = spend.Verify(acc, metaData);
+        assert(fValid);
+    }
+}
+
+BENCHMARK(Zerocoin_Mint);
+BENCHMARK(Zerocoin_Accumulate);
+BENCHMARK(Zerocoin_AccumulateBatch);
+BENCHMARK(Zerocoin_Witness);
+BENCHMARK(Zerocoin_WitnessBatch);
+BENCHMARK(Zerocoin_Spend);
+BENCHMARK(Zerocoin_SpendVerify);
@@ -26,10 +26,26 @@
 
 #include "bip39.h"
 #include "bip39_english.h"
+#include "crypto/pbkdf2_hmac_sha512.h"
 #include "crypto/sha256.h"
 #include "random.h"
 
-#include <openssl/evp.h>
+#include <algorithm>
+#include <string.h>
+
+static const int BIP39_WORDS = 2048;
+static const unsigned int BIP39_PBKDF2_ROUNDS = 2048;
+
+/** Index of word in the sorted wordlist, -1 if it isn't one */
+static int FindWord(const SecureString& word)
+{
+    const char* const* pend = wordlist + BIP39_WORDS;
+    const char* const* it = std::lower_bound(wordlist, pend, word.c_str(), [](const char* a, const char* b) { return strcmp(a, b) < 0; });
+    if (it == pend || word != *it) {
+        return -1;
+    }
+    return it - wordlist;
+}
 
 SecureString CMnemonic::Generate(int strength)
 {
@@ -99,7 +115,7 @@ bool CMnemonic::Check(SecureString mnemonic)
     SecureString ssCurrentWord;
     SecureVector bits(32 + 1);
 
-    uint32_t nWordIndex, ki, nBitsCount{};
+    uint32_t ki, nBitsCount{};
 
     for (size_t i = 0; i < mnemonic.size(); ++i)
     {
@@ -111,21 +127,15 @@ bool CMnemonic::Check(SecureString mnemonic)
             ssCurrentWord += mnemonic[i + ssCurrentWord.size()];
         }
         i += ssCurrentWord.size();
-        nWordIndex = 0;
-        for (;;) {
-            if (!wordlist[nWordIndex]) { // word not found
-                return false;
-            }
-            if (ssCurrentWord == wordlist[nWordIndex]) { // word found on index nWordIndex
-                for (ki = 0; ki < 11; ki++) {
-                    if (nWordIndex & (1 << (10 - ki))) {
-                        bits[nBitsCount / 8] |= 1 << (7 - (nBitsCount % 8));
-                    }
-                    nBitsCount++;
-                }
-                break;
+        int nWordIndex = FindWord(ssCurrentWord);
+        if (nWordIndex < 0) { // word not found
+            return false;
+        }
+        for (ki = 0; ki < 11; ki++) {
+            if (nWordIndex & (1 << (10 - ki))) {
+                bits[nBitsCount / 8] |= 1 << (7 - (nBitsCount % 8));
             }
-            nWordIndex++;
+            nBitsCount++;
         }
     }
     if (nBitsCount != nWordCount * 11) {
@@ -152,11 +162,27 @@ bool CMnemonic::Check(SecureString mnemonic)
 void CMnemonic::ToSeed(SecureString mnemonic, SecureString passphrase, SecureVector& seedRet)
 {
     SecureString ssSalt = SecureString("mnemonic") + passphrase;
-    SecureVector vchSalt(ssSalt.begin(), ssSalt.end());
     seedRet.resize(64);
-    // int PKCS5_PBKDF2_HMAC(const char *pass, int passlen,
-    //                    const unsigned char *salt, int saltlen, int iter,
-    //                    const EVP_MD *digest,
-    //                    int keylen, unsigned char *out);
-    PKCS5_PBKDF2_HMAC(mnemonic.c_str(), mnemonic.size(), &vchSalt[0], vchSalt.size(), 2048, EVP_sha512(), 64, &seedRet[0]);
+    PBKDF2_HMAC_SHA512((const unsigned char*)mnemonic.data(), mnemonic.size(), (const unsigned char*)ssSalt.data(), ssSalt.size(), BIP39_PBKDF2_ROUNDS, &seedRet[0], 64);
+}
+
+void CMnemonic::ToSeeds(const std::vector<SecureString>& vMnemonics, SecureString passphrase, std::vector<SecureVector>& vSeedsRet)
+{
+    SecureString ssSalt = SecureString("mnemonic") + passphrase;
+    vSeedsRet.assign(vMnemonics.size(), SecureVector(64));
+    size_t i = 0;
+    for (; i + 4 <= vMnemonics.size(); i += 4) {
+        const unsigned char* pass[4];
+        size_t passlen[4];
+        unsigned char* out[4];
+        for (int n = 0; n < 4; ++n) {
+            pass[n] = (const unsigned char*)vMnemonics[i + n].data();
+            passlen[n] = vMnemonics[i + n].size();
+            out[n] = &vSeedsRet[i + n][0];
+        }
+        PBKDF2_HMAC_SHA512_4way(pass, passlen, (const unsigned char*)ssSalt.data(), ssSalt.size(), BIP39_PBKDF2_ROUNDS, out, 64);
+    }
+    for (; i < vMnemonics.size(); ++i) {
+        PBKDF2_HMAC_SHA512((const unsigned char*)vMnemonics[i].data(), vMnemonics[i].size(), (const unsigned char*)ssSalt.data(), ssSalt.size(), BIP39_PBKDF2_ROUNDS, &vSeedsRet[i][0], 64);
+    }
 }
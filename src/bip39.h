@@ -26,6 +26,8 @@
 
 #include "support/allocators/secure.h"
 
+#include <vector>
+
 class CMnemonic
 {
 public:
@@ -34,6 +36,8 @@ public:
     static bool Check(SecureString mnemonic);
     // passphrase must be at most 256 characters or code may crash
     static void ToSeed(SecureString mnemonic, SecureString passphrase, SecureVector& seedRet);
+    // the seeds of many mnemonics with the same passphrase, four at a time where SHA-512 has a multi-way implementation
+    static void ToSeeds(const std::vector<SecureString>& vMnemonics, SecureString passphrase, std::vector<SecureVector>& vSeedsRet);
 };
 
 #endif
@@ -0,0 +1,303 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "coins.h"
+#include "crypto/common.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "version.h"
+
+#include <algorithm>
+#include <ios>
+#include <limits>
+#include <stdexcept>
+
+/** Map x uniformly to [0, n), the upper half of the 128 bit product */
+static inline uint64_t FastRange64(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)(((unsigned __int128)x * (unsigned __int128)n) >> 64);
+#else
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+
+    uint64_t ac = x_hi * n_hi;
+    uint64_t ad = x_hi * n_lo;
+    uint64_t bc = x_lo * n_hi;
+    uint64_t bd = x_lo * n_lo;
+
+    uint64_t mid34 = (bd >> 32) + (bc & 0xFFFFFFFF) + (ad & 0xFFFFFFFF);
+    return ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+#endif
+}
+
+/** Appends bits to a byte vector, most significant bit first */
+class CBitWriter
+{
+    std::vector<unsigned char>& vch;
+    uint8_t nBuffer;
+    int nOffset;
+
+public:
+    explicit CBitWriter(std::vector<unsigned char>& vchIn) : vch(vchIn), nBuffer(0), nOffset(0) {}
+
+    //! The lowest nBits of data, up to 64
+    void Write(uint64_t data, int nBits)
+    {
+        while (nBits > 0) {
+            int nChunk = std::min(8 - nOffset, nBits);
+            nBuffer |= (uint8_t)(((data >> (nBits - nChunk)) & ((1U << nChunk) - 1)) << (8 - nOffset - nChunk));
+            nOffset += nChunk;
+            nBits -= nChunk;
+            if (nOffset == 8)
+                Flush();
+        }
+    }
+
+    //! Write the last byte, padded with zeros
+    void Flush()
+    {
+        if (nOffset == 0)
+            return;
+        vch.push_back(nBuffer);
+        nBuffer = 0;
+        nOffset = 0;
+    }
+};
+
+/** Reads the bits CBitWriter wrote */
+class CBitReader
+{
+    const unsigned char* pnext;
+    const unsigned char* pend;
+    uint8_t nBuffer;
+    int nOffset;
+
+public:
+    CBitReader(const unsigned char* pbegin, const unsigned char* pendIn) : pnext(pbegin), pend(pendIn), nBuffer(0), nOffset(8) {}
+
+    uint64_t Read(int nBits)
+    {
+        uint64_t data = 0;
+        while (nBits > 0) {
+            if (nOffset == 8) {
+                if (pnext == pend)
+                    throw std::ios_base::failure("CBitReader::Read(): end of data");
+                nBuffer = *pnext++;
+                nOffset = 0;
+            }
+            int nChunk = std::min(8 - nOffset, nBits);
+            data <<= nChunk;
+            data |= (nBuffer >> (8 - nOffset - nChunk)) & ((1U << nChunk) - 1);
+            nOffset += nChunk;
+            nBits -= nChunk;
+        }
+        return data;
+    }
+};
+
+static void GolombRiceEncode(CBitWriter& writer, uint8_t nP, uint64_t x)
+{
+    // The quotient in unary, ones ended by a zero
+    uint64_t q = x >> nP;
+    while (q > 0) {
+        int nBits = q <= 64 ? (int)q : 64;
+        writer.Write(~0ULL, nBits);
+        q -= nBits;
+    }
+    writer.Write(0, 1);
+    writer.Write(x, nP);
+}
+
+static uint64_t GolombRiceDecode(CBitReader& reader, uint8_t nP)
+{
+    uint64_t q = 0;
+    while (reader.Read(1) == 1)
+        ++q;
+    uint64_t r = reader.Read(nP);
+    return (q << nP) + r;
+}
+
+CGCSFilter::CGCSFilter(uint64_t nK0, uint64_t nK1, uint8_t nPIn, uint32_t nMIn)
+    : nSipHashK0(nK0), nSipHashK1(nK1), nP(nPIn), nM(nMIn), nN(0), nF(0), vchEncoded(1, 0)
+{
+}
+
+CGCSFilter::CGCSFilter(uint64_t nK0, uint64_t nK1, uint8_t nPIn, uint32_t nMIn, const std::vector<unsigned char>& vchEncodedIn)
+    : nSipHashK0(nK0), nSipHashK1(nK1), nP(nPIn), nM(nMIn), vchEncoded(vchEncodedIn)
+{
+    CDataStream ss(vchEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t nElements = ReadCompactSize(ss);
+    if (nElements > std::numeric_limits<uint32_t>::max())
+        throw std::ios_base::failure("CGCSFilter(): N must be below 2^32");
+    nN = nElements;
+    nF = (uint64_t)nN * nM;
+
+    // Decoded once, a filter which ends early is rejected right here
+    const unsigned char* pbegin = vchEncoded.data() + (vchEncoded.size() - ss.size());
+    CBitReader reader(pbegin, vchEncoded.data() + vchEncoded.size());
+    for (uint32_t i = 0; i < nN; ++i)
+        GolombRiceDecode(reader, nP);
+}
+
+CGCSFilter::CGCSFilter(uint64_t nK0, uint64_t nK1, uint8_t nPIn, uint32_t nMIn, const ElementSet& elements)
+    : nSipHashK0(nK0), nSipHashK1(nK1), nP(nPIn), nM(nMIn)
+{
+    if (elements.size() > std::numeric_limits<uint32_t>::max())
+        throw std::invalid_argument("CGCSFilter(): N must be below 2^32");
+    nN = elements.size();
+    nF = (uint64_t)nN * nM;
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ss, nN);
+    vchEncoded.assign(ss.begin(), ss.end());
+
+    std::vector<uint64_t> vecHashes;
+    vecHashes.reserve(elements.size());
+    for (const Element& element : elements)
+        vecHashes.push_back(HashToRange(element));
+    std::sort(vecHashes.begin(), vecHashes.end());
+
+    CBitWriter writer(vchEncoded);
+    uint64_t nLast = 0;
+    for (uint64_t nHash : vecHashes) {
+        GolombRiceEncode(writer, nP, nHash - nLast);
+        nLast = nHash;
+    }
+    writer.Flush();
+}
+
+uint64_t CGCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t nHash = CSipHasher(nSipHashK0, nSipHashK1).Write(element.data(), element.size()).Finalize();
+    return FastRange64(nHash, nF);
+}
+
+bool CGCSFilter::MatchInternal(const std::vector<uint64_t>& vecHashes) const
+{
+    CDataStream ss(vchEncoded, SER_NETWORK, PROTOCOL_VERSION);
+    ReadCompactSize(ss);
+    const unsigned char* pbegin = vchEncoded.data() + (vchEncoded.size() - ss.size());
+    CBitReader reader(pbegin, vchEncoded.data() + vchEncoded.size());
+
+    uint64_t nValue = 0;
+    size_t j = 0;
+    for (uint32_t i = 0; i < nN; ++i) {
+        nValue += GolombRiceDecode(reader, nP);
+
+        // Both sorted, skip the queried hashes below the element
+        while (true) {
+            if (j == vecHashes.size())
+                return false;
+            if (vecHashes[j] == nValue)
+                return true;
+            if (vecHashes[j] > nValue)
+                break;
+            ++j;
+        }
+    }
+    return false;
+}
+
+bool CGCSFilter::Match(const Element& element) const
+{
+    return MatchInternal(std::vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool CGCSFilter::MatchAny(const ElementSet& elements) const
+{
+    std::vector<uint64_t> vecHashes;
+    vecHashes.reserve(elements.size());
+    for (const Element& element : elements)
+        vecHashes.push_back(HashToRange(element));
+    std::sort(vecHashes.begin(), vecHashes.end());
+    return MatchInternal(vecHashes);
+}
+
+static void AddBasicFilterElement(const CScript& script, CGCSFilter::ElementSet& elements)
+{
+    if (script.empty() || script[0] == OP_RETURN)
+        return;
+    elements.insert(CGCSFilter::Element(script.begin(), script.end()));
+}
+
+void CBlockFilter::GetKey(uint64_t& nK0, uint64_t& nK1) const
+{
+    nK0 = ReadLE64(blockHash.begin());
+    nK1 = ReadLE64(blockHash.begin() + 8);
+}
+
+CBlockFilter::CBlockFilter(BlockFilterType filterTypeIn, const uint256& blockHashIn, const std::vector<unsigned char>& vchEncoded)
+    : filterType(filterTypeIn), blockHash(blockHashIn)
+{
+    if (filterType != BLOCK_FILTER_BASIC)
+        throw std::ios_base::failure("CBlockFilter(): unknown filter type");
+
+    uint64_t nK0, nK1;
+    GetKey(nK0, nK1);
+    filter = CGCSFilter(nK0, nK1, BASIC_FILTER_P, BASIC_FILTER_M, vchEncoded);
+}
+
+CBlockFilter::CBlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockUndo)
+    : filterType(filterTypeIn), blockHash(block.GetHash())
+{
+    if (filterType != BLOCK_FILTER_BASIC)
+        throw std::invalid_argument("CBlockFilter(): unknown filter type");
+
+    CGCSFilter::ElementSet elements;
+
+    for (const CTransactionRef& tx : block.vtx) {
+        for (const CTxOut& out : tx->vout)
+            AddBasicFilterElement(out.scriptPubKey, elements);
+    }
+
+    // The coinbase and zerocoin spends have no undo entries, they spend no scripts
+    for (const CTxUndo& txundo : blockUndo.vtxundo) {
+        for (const Coin& coin : txundo.vprevout)
+            AddBasicFilterElement(coin.out.scriptPubKey, elements);
+    }
+
+    uint64_t nK0, nK1;
+    GetKey(nK0, nK1);
+    filter = CGCSFilter(nK0, nK1, BASIC_FILTER_P, BASIC_FILTER_M, elements);
+}
+
+uint256 CBlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& vchEncoded = filter.GetEncoded();
+    return Hash(vchEncoded.begin(), vchEncoded.end());
+}
+
+uint256 CBlockFilter::ComputeHeader(const uint256& prevHeader) const
+{
+    return ComputeBlockFilterHeader(GetHash(), prevHeader);
+}
+
+uint256 ComputeBlockFilterHeader(const uint256& hashFilter, const uint256& prevHeader)
+{
+    return Hash(hashFilter.begin(), hashFilter.end(), prevHeader.begin(), prevHeader.end());
+}
+
+std::string BlockFilterTypeName(BlockFilterType filterType)
+{
+    switch (filterType) {
+    case BLOCK_FILTER_BASIC:
+        return "basic";
+    }
+    return "";
+}
+
+bool BlockFilterTypeByName(const std::string& strName, BlockFilterType& filterType)
+{
+    if (strName == "basic") {
+        filterType = BLOCK_FILTER_BASIC;
+        return true;
+    }
+    return false;
+}
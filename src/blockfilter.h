@@ -0,0 +1,131 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_BLOCKFILTER_H
+#define SMARTCASH_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+//! Filter types of BIP 158, only the basic one so far
+enum BlockFilterType : uint8_t {
+    BLOCK_FILTER_BASIC = 0,
+};
+
+//! Golomb-Rice parameter and inverse false positive rate of the basic filter
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+//! Most filters a getcfilters request gets, and filter hashes a getcfheaders one
+static const int MAX_GETCFILTERS_SIZE = 1000;
+static const int MAX_GETCFHEADERS_SIZE = 2000;
+//! Heights between the filter headers of a cfcheckpt message
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/** Default for -blockfilterindex */
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+/** Default for -peerblockfilters */
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+
+/**
+ * Golomb-coded set of BIP 158. The elements get hashed to [0, N * M) with
+ * SipHash keyed by the block, sorted, and the differences between them get
+ * Golomb-Rice coded with parameter P. A match decodes the set front to back,
+ * other elements match with a probability of 1/M.
+ */
+class CGCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+private:
+    uint64_t nSipHashK0;
+    uint64_t nSipHashK1;
+    uint8_t nP;
+    uint32_t nM;
+    uint32_t nN;
+    //! The range of the hashed elements, N * M
+    uint64_t nF;
+    //! N as compact size followed by the coded set
+    std::vector<unsigned char> vchEncoded;
+
+    uint64_t HashToRange(const Element& element) const;
+    //! vecHashes has to be sorted
+    bool MatchInternal(const std::vector<uint64_t>& vecHashes) const;
+
+public:
+    //! The empty filter
+    CGCSFilter(uint64_t nK0 = 0, uint64_t nK1 = 0, uint8_t nPIn = BASIC_FILTER_P, uint32_t nMIn = BASIC_FILTER_M);
+    //! Decode a received or stored filter, throws std::ios_base::failure if it is malformed
+    CGCSFilter(uint64_t nK0, uint64_t nK1, uint8_t nPIn, uint32_t nMIn, const std::vector<unsigned char>& vchEncodedIn);
+    CGCSFilter(uint64_t nK0, uint64_t nK1, uint8_t nPIn, uint32_t nMIn, const ElementSet& elements);
+
+    uint32_t GetN() const { return nN; }
+    const std::vector<unsigned char>& GetEncoded() const { return vchEncoded; }
+
+    bool Match(const Element& element) const;
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+/** The filter of a block, what a cfilter message carries. */
+class CBlockFilter
+{
+    BlockFilterType filterType;
+    uint256 blockHash;
+    CGCSFilter filter;
+
+    //! SipHash key of the filter, the first half of the block hash
+    void GetKey(uint64_t& nK0, uint64_t& nK1) const;
+
+public:
+    CBlockFilter() : filterType(BLOCK_FILTER_BASIC) {}
+    //! Throws std::ios_base::failure for a malformed filter
+    CBlockFilter(BlockFilterType filterTypeIn, const uint256& blockHashIn, const std::vector<unsigned char>& vchEncoded);
+    //! The outputs of the block and the ones it spends, except empty and OP_RETURN scripts
+    CBlockFilter(BlockFilterType filterTypeIn, const CBlock& block, const CBlockUndo& blockUndo);
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    const uint256& GetBlockHash() const { return blockHash; }
+    const CGCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    //! Hash of the encoded filter
+    uint256 GetHash() const;
+    //! Header of the filter in the chain of the filter headers, prevHeader is zero for the genesis block
+    uint256 ComputeHeader(const uint256& prevHeader) const;
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        uint8_t nFilterType = filterType;
+        READWRITE(nFilterType);
+        READWRITE(blockHash);
+        std::vector<unsigned char> vchEncoded;
+        if (!ser_action.ForRead())
+            vchEncoded = filter.GetEncoded();
+        READWRITE(vchEncoded);
+        if (ser_action.ForRead())
+            *this = CBlockFilter(static_cast<BlockFilterType>(nFilterType), blockHash, vchEncoded);
+    }
+};
+
+//! Header of the filter with the hash in the chain of the filter headers
+uint256 ComputeBlockFilterHeader(const uint256& hashFilter, const uint256& prevHeader);
+
+//! Name of a filter type for the RPC and the SAPI
+std::string BlockFilterTypeName(BlockFilterType filterType);
+//! False if strName isn't a known type
+bool BlockFilterTypeByName(const std::string& strName, BlockFilterType& filterType);
+
+#endif // SMARTCASH_BLOCKFILTER_H
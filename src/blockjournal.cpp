@@ -0,0 +1,146 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockjournal.h"
+
+#include "tinyformat.h"
+#include "util.h"
+
+#include <boost/filesystem.hpp>
+
+CBlockJournal blockJournal;
+
+void CBlockJournalRecord::SetNull()
+{
+    nHeight = -1;
+    hash.SetNull();
+    nTime = 0;
+    nSize = 0;
+    nTx = 0;
+    nInputs = 0;
+    nTimeRead = 0;
+    nTimeCheck = 0;
+    nTimeForks = 0;
+    nTimeInputs = 0;
+    nTimeVerify = 0;
+    nTimePayments = 0;
+    nTimeRewards = 0;
+    nTimeIndex = 0;
+    nTimeFlush = 0;
+    nTimeChainState = 0;
+    nTimeTotal = 0;
+    nCoinsHits = 0;
+    nCoinsMisses = 0;
+    nSigCacheHits = 0;
+    nSigCacheMisses = 0;
+}
+
+std::string CBlockJournalRecord::CSVHeader()
+{
+    return "height,hash,time,size,tx,inputs,read_us,check_us,forks_us,inputs_us,verify_us,payments_us,rewards_us,index_us,flush_us,chainstate_us,total_us,"
+           "coins_hits,coins_misses,sigcache_hits,sigcache_misses\n";
+}
+
+std::string CBlockJournalRecord::ToCSV() const
+{
+    return strprintf("%d,%s,%d,%u,%u,%u,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%u,%u,%u,%u\n",
+                     nHeight, hash.ToString(), nTime, nSize, nTx, nInputs,
+                     nTimeRead, nTimeCheck, nTimeForks, nTimeInputs, nTimeVerify, nTimePayments, nTimeRewards, nTimeIndex, nTimeFlush, nTimeChainState, nTimeTotal,
+                     nCoinsHits, nCoinsMisses, nSigCacheHits, nSigCacheMisses);
+}
+
+bool CBlockJournal::OpenFile()
+{
+    file = fopen(pathFile.string().c_str(), "a");
+    if (!file)
+        return false;
+
+    boost::system::error_code ec;
+    nFileSize = boost::filesystem::file_size(pathFile, ec);
+    if (ec)
+        nFileSize = 0;
+
+    if (!nFileSize) {
+        std::string strHeader = CBlockJournalRecord::CSVHeader();
+        fwrite(strHeader.data(), 1, strHeader.size(), file);
+        nFileSize = strHeader.size();
+    }
+
+    return true;
+}
+
+void CBlockJournal::RotateFile()
+{
+    fclose(file);
+    file = NULL;
+
+    // blockjournal.csv.1 is the newest of the rotated files
+    boost::system::error_code ec;
+    boost::filesystem::remove(pathFile.string() + strprintf(".%d", BLOCK_JOURNAL_ROTATED_FILES), ec);
+    for (int i = BLOCK_JOURNAL_ROTATED_FILES - 1; i > 0; --i) {
+        boost::filesystem::rename(pathFile.string() + strprintf(".%d", i), pathFile.string() + strprintf(".%d", i + 1), ec);
+    }
+    RenameOver(pathFile, pathFile.string() + ".1");
+
+    if (!OpenFile())
+        LogPrintf("CBlockJournal::%s -- Failed to reopen %s, the journal file stops here\n", __func__, pathFile.string());
+}
+
+bool CBlockJournal::Open(const boost::filesystem::path& path, uint64_t nMaxFileSizeIn)
+{
+    LOCK(cs);
+
+    if (file)
+        fclose(file);
+
+    pathFile = path;
+    nMaxFileSize = nMaxFileSizeIn;
+
+    return OpenFile();
+}
+
+void CBlockJournal::Close()
+{
+    LOCK(cs);
+
+    if (file) {
+        fclose(file);
+        file = NULL;
+    }
+}
+
+void CBlockJournal::Add(const CBlockJournalRecord& record)
+{
+    LOCK(cs);
+
+    dequeRecords.push_back(record);
+    if (dequeRecords.size() > BLOCK_JOURNAL_RECORDS)
+        dequeRecords.pop_front();
+
+    if (!file)
+        return;
+
+    std::string strLine = record.ToCSV();
+    if (nMaxFileSize && nFileSize + strLine.size() > nMaxFileSize) {
+        RotateFile();
+        if (!file)
+            return;
+    }
+
+    fwrite(strLine.data(), 1, strLine.size(), file);
+    fflush(file);
+    nFileSize += strLine.size();
+}
+
+std::vector<CBlockJournalRecord> CBlockJournal::GetRecent(size_t nCount) const
+{
+    LOCK(cs);
+
+    std::vector<CBlockJournalRecord> vRecords;
+    for (std::deque<CBlockJournalRecord>::const_reverse_iterator it = dequeRecords.rbegin(); it != dequeRecords.rend() && vRecords.size() < nCount; ++it) {
+        vRecords.push_back(*it);
+    }
+
+    return vRecords;
+}
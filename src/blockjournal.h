@@ -0,0 +1,108 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_BLOCKJOURNAL_H
+#define SMARTCASH_BLOCKJOURNAL_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <deque>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+//! Write the connected blocks to the journal file, see -blockjournal
+static const bool DEFAULT_BLOCK_JOURNAL = false;
+//! Size in MiB the journal file gets rotated at
+static const unsigned int DEFAULT_BLOCK_JOURNAL_SIZE = 16;
+//! Rotated journal files kept besides the one being written
+static const int BLOCK_JOURNAL_ROTATED_FILES = 4;
+//! Most recent records kept in memory for getblockjournal
+static const size_t BLOCK_JOURNAL_RECORDS = 1000;
+
+/** Figures of a block connected to the tip, the times are in microseconds. */
+struct CBlockJournalRecord
+{
+    int nHeight;
+    uint256 hash;
+    //! Time the block got connected
+    int64_t nTime;
+    unsigned int nSize;
+    unsigned int nTx;
+    unsigned int nInputs;
+
+    //! Read from disk or taken from the read ahead, and the prefetch of its inputs
+    int64_t nTimeRead;
+    //! Sanity checks of ConnectBlock
+    int64_t nTimeCheck;
+    int64_t nTimeForks;
+    //! Connecting the transactions with the lookups of their inputs
+    int64_t nTimeInputs;
+    //! Until the script checks are done, includes nTimeInputs and nTimePayments
+    int64_t nTimeVerify;
+    //! Validation of the mining, smartnode, hive and reward payments of the coinbase
+    int64_t nTimePayments;
+    //! SmartRewards processing of the transactions and the commit of the block
+    int64_t nTimeRewards;
+    //! Undo data and index writing
+    int64_t nTimeIndex;
+    //! Flush of the block's view into the coins cache
+    int64_t nTimeFlush;
+    //! FlushStateToDisk after the block
+    int64_t nTimeChainState;
+    int64_t nTimeTotal;
+
+    //! Coins cache lookups while the block was prefetched and connected, the misses went to the database
+    uint64_t nCoinsHits;
+    uint64_t nCoinsMisses;
+    uint64_t nSigCacheHits;
+    uint64_t nSigCacheMisses;
+
+    CBlockJournalRecord() { SetNull(); }
+
+    void SetNull();
+
+    static std::string CSVHeader();
+    std::string ToCSV() const;
+};
+
+/**
+ * Journal of the blocks connected to the tip, one record per block.
+ *
+ * The recent records are kept in memory for getblockjournal. With -blockjournal
+ * they also get appended to a CSV file in the data directory, which is rotated
+ * once it reaches -blockjournalsize.
+ */
+class CBlockJournal
+{
+    mutable CCriticalSection cs;
+    std::deque<CBlockJournalRecord> dequeRecords;
+
+    FILE* file;
+    boost::filesystem::path pathFile;
+    uint64_t nMaxFileSize;
+    uint64_t nFileSize;
+
+    bool OpenFile();
+    void RotateFile();
+
+public:
+    CBlockJournal() : file(NULL), nMaxFileSize(0), nFileSize(0) {}
+    ~CBlockJournal() { Close(); }
+
+    /** Append the records to the file at path from now on */
+    bool Open(const boost::filesystem::path& path, uint64_t nMaxFileSizeIn);
+    void Close();
+
+    void Add(const CBlockJournalRecord& record);
+    /** Up to nCount of the most recent records, the newest first. */
+    std::vector<CBlockJournalRecord> GetRecent(size_t nCount) const;
+};
+
+extern CBlockJournal blockJournal;
+
+#endif // SMARTCASH_BLOCKJOURNAL_H
@@ -0,0 +1,117 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockscripts.h"
+
+#include "coins.h"
+#include "primitives/block.h"
+#include "pubkey.h"
+#include "script/standard.h"
+
+#include <map>
+
+bool ExtractDestination(const CScript& scriptPubKey, CSmartAddress& idRet)
+{
+    std::vector<std::vector<unsigned char> > vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return false;
+
+    if (whichType == TX_PUBKEY) {
+        CPubKey pubKey(vSolutions[0]);
+        if (!pubKey.IsValid())
+            return false;
+
+        idRet = CSmartAddress(pubKey.GetID());
+        return true;
+    } else if (whichType == TX_PUBKEYHASH) {
+        idRet = CSmartAddress(CKeyID(uint160(vSolutions[0])));
+        return true;
+    } else if (whichType == TX_SCRIPTHASH) {
+        idRet = CSmartAddress(CScriptID(uint160(vSolutions[0])));
+        return true;
+    } else if (whichType == TX_PUBKEYHASHLOCKED) {
+        idRet = CSmartAddress(CKeyID(uint160(vSolutions[0])));
+        return true;
+    } else if (whichType == TX_SCRIPTHASHLOCKED) {
+        idRet = CSmartAddress(CScriptID(uint160(vSolutions[0])));
+        return true;
+    }
+    // Multisig txns have more than one address...
+    return false;
+}
+
+int GetIndexAddress(const CScript& script, uint160& hashBytes)
+{
+    if (script.IsPayToScriptHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 2, script.begin() + 22));
+        return 2;
+    } else if (script.IsPayToPublicKeyHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 3, script.begin() + 23));
+        return 1;
+    } else if (script.IsPayToPublicKey()) {
+        CPubKey pubKey(std::vector<unsigned char>(script.begin() + 1, script.begin() + 34));
+        hashBytes = pubKey.GetID();
+        return 1;
+    } else if (script.IsPayToScriptHashLocked()) {
+        int nOffset = script[0] + 5;
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + nOffset, script.begin() + nOffset + 20));
+        return 2;
+    } else if (script.IsPayToPublicKeyHashLocked()) {
+        int nOffset = script[0] + 6;
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + nOffset, script.begin() + nOffset + 20));
+        return 1;
+    }
+
+    hashBytes.SetNull();
+    return 0;
+}
+
+void CDecodedScript::Decode(const CScript& script)
+{
+    addressType = GetIndexAddress(script, hashBytes);
+    fDestination = ExtractDestination(script, id);
+}
+
+void CDecodedBlockScripts::Decode(const CBlock& block, const CCoinsViewCache& view)
+{
+    vOutputs.assign(block.vtx.size(), std::vector<CDecodedScript>());
+    vInputs.assign(block.vtx.size(), std::vector<CDecodedScript>());
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        vOutputs[i].resize(tx.vout.size());
+        for (size_t k = 0; k < tx.vout.size(); k++) {
+            vOutputs[i][k].Decode(tx.vout[k].scriptPubKey);
+        }
+    }
+
+    // Only filled in when an input spends an output of the block
+    std::map<uint256, size_t> mapBlockTx;
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (tx.IsCoinBase() || tx.IsZerocoinSpend())
+            continue;
+
+        vInputs[i].resize(tx.vin.size());
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            const COutPoint& prevout = tx.vin[j].prevout;
+            const Coin& coin = view.AccessCoin(prevout);
+            if (!coin.IsSpent()) {
+                vInputs[i][j].Decode(coin.out.scriptPubKey);
+                continue;
+            }
+
+            if (mapBlockTx.empty()) {
+                for (size_t n = 0; n < block.vtx.size(); n++)
+                    mapBlockTx.insert(std::make_pair(block.vtx[n]->GetHash(), n));
+            }
+            // Missing inputs are left without an address, ConnectBlock rejects the block for them
+            auto it = mapBlockTx.find(prevout.hash);
+            if (it != mapBlockTx.end() && it->second < i && prevout.n < vOutputs[it->second].size())
+                vInputs[i][j] = vOutputs[it->second][prevout.n];
+        }
+    }
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_BLOCKSCRIPTS_H
+#define SMARTCASH_BLOCKSCRIPTS_H
+
+#include "smarthive/hive.h"
+#include "uint256.h"
+
+#include <vector>
+
+class CBlock;
+class CCoinsViewCache;
+class CScript;
+
+/** The address the rewards count the script for, false for scripts without a single one */
+bool ExtractDestination(const CScript& scriptPubKey, CSmartAddress& idRet);
+
+/** Address type and hash the address, spent and deposit indexes use for the script,
+ *  1 for key hashes, 2 for script hashes and 0 for scripts without an address. */
+int GetIndexAddress(const CScript& script, uint160& hashBytes);
+
+/** An output script decoded for everyone who needs its address while a block gets connected */
+struct CDecodedScript
+{
+    //! See GetIndexAddress
+    int addressType;
+    uint160 hashBytes;
+    //! Set if ExtractDestination found the address id
+    bool fDestination;
+    CSmartAddress id;
+
+    CDecodedScript() : addressType(0), fDestination(false) {}
+    explicit CDecodedScript(const CScript& script) { Decode(script); }
+
+    void Decode(const CScript& script);
+};
+
+/**
+ * The scripts of the outputs a block creates and of the ones it spends,
+ * each decoded once for the rewards, the indexes and the checks of
+ * ConnectBlock instead of by every one of them.
+ */
+class CDecodedBlockScripts
+{
+    //! By transaction and output
+    std::vector<std::vector<CDecodedScript> > vOutputs;
+    //! By transaction and input, empty for the coinbase and zerocoin spends
+    std::vector<std::vector<CDecodedScript> > vInputs;
+
+public:
+    /** Decode the scripts of block. The outputs spent are looked up in view,
+     *  or in the block itself if they are created earlier in it. */
+    void Decode(const CBlock& block, const CCoinsViewCache& view);
+
+    const CDecodedScript& Output(size_t nTx, size_t nOut) const { return vOutputs[nTx][nOut]; }
+    const CDecodedScript& Input(size_t nTx, size_t nIn) const { return vInputs[nTx][nIn]; }
+    //! False for the coinbase and zerocoin spends, their inputs don't get decoded
+    bool HaveInputs(size_t nTx) const { return !vInputs[nTx].empty(); }
+};
+
+#endif // SMARTCASH_BLOCKSCRIPTS_H
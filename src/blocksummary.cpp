@@ -0,0 +1,60 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blocksummary.h"
+
+#include "primitives/block.h"
+#include "serialize.h"
+#include "version.h"
+
+CBlockSummaryCache blockSummaries;
+
+CBlockSummary::CBlockSummary(const CBlock& block, int nHeightIn)
+{
+    SetNull();
+    hash = block.GetHash();
+    nHeight = nHeightIn;
+    nTime = block.GetBlockTime();
+    nSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+    nTx = block.vtx.size();
+}
+
+void CBlockSummary::SetNull()
+{
+    hash.SetNull();
+    nHeight = -1;
+    nTime = 0;
+    nSize = 0;
+    nTx = 0;
+    nFees = 0;
+    nMiningReward = 0;
+    nHiveReward = 0;
+    nSmartnodeReward = 0;
+    nSmartRewardsReward = 0;
+    fHavePayouts = false;
+}
+
+void CBlockSummaryCache::Add(const CBlockSummary& summary)
+{
+    if (summary.IsNull() || vecSummaries.empty())
+        return;
+
+    LOCK(cs);
+    vecSummaries[summary.nHeight % vecSummaries.size()] = summary;
+}
+
+bool CBlockSummaryCache::Get(int nHeight, const uint256& hash, CBlockSummary& summary) const
+{
+    if (nHeight < 0 || vecSummaries.empty())
+        return false;
+
+    LOCK(cs);
+    const CBlockSummary& entry = vecSummaries[nHeight % vecSummaries.size()];
+
+    if (entry.nHeight != nHeight || entry.hash != hash)
+        return false;
+
+    summary = entry;
+    return true;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_BLOCKSUMMARY_H
+#define SMARTCASH_BLOCKSUMMARY_H
+
+#include "amount.h"
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <vector>
+
+class CBlock;
+
+//! Most recent blocks of the chain the summary cache keeps
+static const int BLOCK_SUMMARY_CACHE_BLOCKS = 10000;
+
+/** Per block figures of the explorer endpoints which would need the full block otherwise.
+ *  In prune mode they also get stored with the indexes, see -prune. */
+struct CBlockSummary
+{
+    uint256 hash;
+    int nHeight;
+    int64_t nTime;
+    unsigned int nSize;
+    unsigned int nTx;
+    //! Only known for blocks connected since the start, see fHavePayouts
+    CAmount nFees;
+    CAmount nMiningReward;
+    CAmount nHiveReward;
+    CAmount nSmartnodeReward;
+    CAmount nSmartRewardsReward;
+    bool fHavePayouts;
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hash);
+        READWRITE(nHeight);
+        READWRITE(nTime);
+        READWRITE(nSize);
+        READWRITE(nTx);
+        READWRITE(fHavePayouts);
+        if (fHavePayouts) {
+            READWRITE(nFees);
+            READWRITE(nMiningReward);
+            READWRITE(nHiveReward);
+            READWRITE(nSmartnodeReward);
+            READWRITE(nSmartRewardsReward);
+        }
+    }
+
+    CBlockSummary() { SetNull(); }
+    CBlockSummary(const CBlock& block, int nHeightIn);
+
+    void SetNull();
+    bool IsNull() const { return nHeight < 0; }
+};
+
+/** Ring buffer of the summaries of the recently connected blocks, indexed by height.
+ *
+ * Filled by ConnectBlock, an entry only matches as long as the block at its height
+ * has the same hash, so disconnected blocks don't need to be removed.
+ */
+class CBlockSummaryCache
+{
+    mutable CCriticalSection cs;
+    std::vector<CBlockSummary> vecSummaries;
+
+public:
+    CBlockSummaryCache(size_t nBlocks = BLOCK_SUMMARY_CACHE_BLOCKS) : vecSummaries(nBlocks) {}
+
+    void Add(const CBlockSummary& summary);
+    /** Summary of the block with the hash at the height, false if it isn't cached. */
+    bool Get(int nHeight, const uint256& hash, CBlockSummary& summary) const;
+};
+
+extern CBlockSummaryCache blockSummaries;
+
+#endif // SMARTCASH_BLOCKSUMMARY_H
@@ -5,10 +5,15 @@
 #ifndef CACHEMAP_H_
 #define CACHEMAP_H_
 
-#include <map>
-#include <list>
 #include <cstddef>
-
+#include <iterator>
+#include <limits>
+#include <new>
+#include <stdint.h>
+#include <vector>
+
+#include "flathashmap.h"
+#include "memusage.h"
 #include "serialize.h"
 
 /**
@@ -38,11 +43,212 @@ struct CacheItem
     }
 };
 
+/**
+ * Doubly linked list of cache items which keeps all items in one vector and
+ * links them by their position. Erased positions get reused by the next
+ * insert, so an item costs no allocation of its own. The iterators hold a
+ * position and stay valid across inserts, erasing an item only invalidates
+ * the iterators to it.
+ *
+ * Serialized like the std::list it replaced, front to back.
+ */
+template<typename K, typename V>
+class CacheItemList
+{
+public:
+    typedef CacheItem<K,V> item_t;
+
+    static const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+private:
+    struct Slot {
+        item_t item;
+        uint32_t nPrev;
+        uint32_t nNext;
+    };
+
+    std::vector<Slot> vecSlots;
+    uint32_t nHead;
+    uint32_t nTail;
+    // first free slot, the free slots are chained by nNext
+    uint32_t nFree;
+    size_t nSize;
+
+    uint32_t Allocate(const item_t& item)
+    {
+        if(nFree == NONE) {
+            vecSlots.push_back(Slot{item, NONE, NONE});
+            return vecSlots.size() - 1;
+        }
+        uint32_t nPos = nFree;
+        nFree = vecSlots[nPos].nNext;
+        Replace(nPos, item);
+        return nPos;
+    }
+
+    // Some values are not assignable (CProposalVote), construct them anew instead
+    void Replace(uint32_t nPos, const item_t& item)
+    {
+        item_t* pItem = &vecSlots[nPos].item;
+        pItem->~item_t();
+        new (pItem) item_t(item);
+    }
+
+    void Unlink(uint32_t nPos)
+    {
+        Slot& slot = vecSlots[nPos];
+        if(slot.nPrev != NONE) vecSlots[slot.nPrev].nNext = slot.nNext; else nHead = slot.nNext;
+        if(slot.nNext != NONE) vecSlots[slot.nNext].nPrev = slot.nPrev; else nTail = slot.nPrev;
+    }
+
+    void LinkFront(uint32_t nPos)
+    {
+        vecSlots[nPos].nPrev = NONE;
+        vecSlots[nPos].nNext = nHead;
+        if(nHead != NONE) vecSlots[nHead].nPrev = nPos; else nTail = nPos;
+        nHead = nPos;
+    }
+
+    void LinkBack(uint32_t nPos)
+    {
+        vecSlots[nPos].nPrev = nTail;
+        vecSlots[nPos].nNext = NONE;
+        if(nTail != NONE) vecSlots[nTail].nNext = nPos; else nHead = nPos;
+        nTail = nPos;
+    }
+
+public:
+    class const_iterator : public std::iterator<std::forward_iterator_tag, const item_t>
+    {
+        const CacheItemList* pList;
+        uint32_t nPos;
+
+    public:
+        const_iterator() : pList(NULL), nPos(NONE) {}
+        const_iterator(const CacheItemList* pListIn, uint32_t nPosIn) : pList(pListIn), nPos(nPosIn) {}
+
+        const item_t& operator*() const { return pList->vecSlots[nPos].item; }
+        const item_t* operator->() const { return &pList->vecSlots[nPos].item; }
+
+        const_iterator& operator++() { nPos = pList->vecSlots[nPos].nNext; return *this; }
+        const_iterator operator++(int) { const_iterator it = *this; ++(*this); return it; }
+
+        bool operator==(const const_iterator& other) const { return nPos == other.nPos && pList == other.pList; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+        uint32_t GetPos() const { return nPos; }
+    };
+
+    CacheItemList() : nHead(NONE), nTail(NONE), nFree(NONE), nSize(0) {}
+
+    CacheItemList(const CacheItemList& other) : nHead(NONE), nTail(NONE), nFree(NONE), nSize(0)
+    {
+        *this = other;
+    }
+
+    CacheItemList& operator=(const CacheItemList& other)
+    {
+        if(this == &other) return *this;
+        clear();
+        vecSlots.reserve(other.nSize);
+        for(const item_t& item : other) {
+            push_back(item);
+        }
+        return *this;
+    }
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    //! Storage of the slots, heap memory owned by the items themselves excluded
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vecSlots); }
+
+    const_iterator begin() const { return const_iterator(this, nHead); }
+    const_iterator end() const { return const_iterator(this, NONE); }
+
+    const item_t& operator[](uint32_t nPos) const { return vecSlots[nPos].item; }
+
+    /// Position of the last item, NONE if empty
+    uint32_t back() const { return nTail; }
+
+    uint32_t push_front(const item_t& item)
+    {
+        uint32_t nPos = Allocate(item);
+        LinkFront(nPos);
+        ++nSize;
+        return nPos;
+    }
+
+    uint32_t push_back(const item_t& item)
+    {
+        uint32_t nPos = Allocate(item);
+        LinkBack(nPos);
+        ++nSize;
+        return nPos;
+    }
+
+    void move_to_front(uint32_t nPos)
+    {
+        if(nPos == nHead) return;
+        Unlink(nPos);
+        LinkFront(nPos);
+    }
+
+    void erase(uint32_t nPos)
+    {
+        Unlink(nPos);
+        // drop what the item owns, the slot itself stays for reuse
+        Replace(nPos, item_t());
+        vecSlots[nPos].nNext = nFree;
+        nFree = nPos;
+        --nSize;
+    }
+
+    void clear()
+    {
+        vecSlots.clear();
+        nHead = nTail = nFree = NONE;
+        nSize = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        unsigned int nSerializeSize = GetSizeOfCompactSize(nSize);
+        for(const item_t& item : *this) {
+            nSerializeSize += ::GetSerializeSize(item, nType, nVersion);
+        }
+        return nSerializeSize;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteCompactSize(s, nSize);
+        for(const item_t& item : *this) {
+            ::Serialize(s, item, nType, nVersion);
+        }
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        clear();
+        uint64_t nCount = ReadCompactSize(s);
+        for(uint64_t i = 0; i < nCount; ++i) {
+            item_t item;
+            ::Unserialize(s, item, nType, nVersion);
+            push_back(item);
+        }
+    }
+};
 
 /**
  * Map like container that keeps the N most recently added items
+ *
+ * The items sit in a CacheItemList, most recent first, and a CFlatHashMap
+ * finds their position by key.
  */
-template<typename K, typename V, typename Size = uint32_t>
+template<typename K, typename V, typename Hasher, typename Size = uint32_t>
 class CacheMap
 {
 public:
@@ -50,13 +256,13 @@ public:
 
     typedef CacheItem<K,V> item_t;
 
-    typedef std::list<item_t> list_t;
+    typedef CacheItemList<K,V> list_t;
 
-    typedef typename list_t::iterator list_it;
+    typedef typename list_t::const_iterator list_it;
 
     typedef typename list_t::const_iterator list_cit;
 
-    typedef std::map<K, list_it> map_t;
+    typedef CFlatHashMap<K, uint32_t, Hasher> map_t;
 
     typedef typename map_t::iterator map_it;
 
@@ -76,7 +282,7 @@ public:
           mapIndex()
     {}
 
-    CacheMap(const CacheMap<K,V>& other)
+    CacheMap(const CacheMap& other)
         : nMaxSize(other.nMaxSize),
           listItems(other.listItems),
           mapIndex()
@@ -103,6 +309,10 @@ public:
         return listItems.size();
     }
 
+    size_t DynamicMemoryUsage() const {
+        return listItems.DynamicMemoryUsage() + mapIndex.DynamicMemoryUsage();
+    }
+
     bool Insert(const K& key, const V& value)
     {
         if(mapIndex.find(key) != mapIndex.end()) {
@@ -111,8 +321,7 @@ public:
         if(listItems.size() == nMaxSize) {
             PruneLast();
         }
-        listItems.push_front(item_t(key, value));
-        mapIndex.emplace(key, listItems.begin());
+        mapIndex.insert(std::make_pair(key, listItems.push_front(item_t(key, value))));
         return true;
     }
 
@@ -127,8 +336,18 @@ public:
         if(it == mapIndex.end()) {
             return false;
         }
-        item_t& item = *(it->second);
-        value = item.value;
+        value = listItems[it->second].value;
+        return true;
+    }
+
+    /** Move the item of key to the front so it gets pruned last. */
+    bool Touch(const K& key)
+    {
+        map_it it = mapIndex.find(key);
+        if(it == mapIndex.end()) {
+            return false;
+        }
+        listItems.move_to_front(it->second);
         return true;
     }
 
@@ -139,14 +358,14 @@ public:
             return;
         }
         listItems.erase(it->second);
-        mapIndex.erase(it);
+        mapIndex.erase(key);
     }
 
     const list_t& GetItemList() const {
         return listItems;
     }
 
-    CacheMap<K,V>& operator=(const CacheMap<K,V>& other)
+    CacheMap& operator=(const CacheMap& other)
     {
         nMaxSize = other.nMaxSize;
         listItems = other.listItems;
@@ -172,16 +391,23 @@ private:
         if(listItems.empty()) {
             return;
         }
-        item_t& item = listItems.back();
-        mapIndex.erase(item.key);
-        listItems.pop_back();
+        uint32_t nPos = listItems.back();
+        mapIndex.erase(listItems[nPos].key);
+        listItems.erase(nPos);
     }
 
     void RebuildIndex()
     {
         mapIndex.clear();
-        for(list_it it = listItems.begin(); it != listItems.end(); ++it) {
-            mapIndex.emplace(it->key, it);
+        mapIndex.reserve(listItems.size());
+        list_cit it = listItems.begin();
+        while(it != listItems.end()) {
+            uint32_t nPos = it.GetPos();
+            ++it;
+            // keep the most recent of duplicate keys
+            if(!mapIndex.insert(std::make_pair(listItems[nPos].key, nPos)).second) {
+                listItems.erase(nPos);
+            }
         }
     }
 };
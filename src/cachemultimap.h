@@ -5,10 +5,9 @@
 #ifndef CACHEMULTIMAP_H_
 #define CACHEMULTIMAP_H_
 
+#include <algorithm>
 #include <cstddef>
-#include <map>
-#include <list>
-#include <set>
+#include <vector>
 
 #include "serialize.h"
 
@@ -16,8 +15,11 @@
 
 /**
  * Map like container that keeps the N most recently added items
+ *
+ * Like CacheMap the items sit in a CacheItemList. The index holds the
+ * positions of the items of a key, ordered by their value.
  */
-template<typename K, typename V, typename Size = uint32_t>
+template<typename K, typename V, typename Hasher, typename Size = uint32_t>
 class CacheMultiMap
 {
 public:
@@ -25,19 +27,15 @@ public:
 
     typedef CacheItem<K,V> item_t;
 
-    typedef std::list<item_t> list_t;
+    typedef CacheItemList<K,V> list_t;
 
-    typedef typename list_t::iterator list_it;
+    typedef typename list_t::const_iterator list_it;
 
     typedef typename list_t::const_iterator list_cit;
 
-    typedef std::map<V,list_it> it_map_t;
+    typedef std::vector<uint32_t> pos_v_t;
 
-    typedef typename it_map_t::iterator it_map_it;
-
-    typedef typename it_map_t::const_iterator it_map_cit;
-
-    typedef std::map<K, it_map_t> map_t;
+    typedef CFlatHashMap<K, pos_v_t, Hasher> map_t;
 
     typedef typename map_t::iterator map_it;
 
@@ -50,6 +48,30 @@ private:
 
     map_t mapIndex;
 
+    /// Orders positions by the values of their items
+    struct ValueLess {
+        const list_t& listItems;
+        explicit ValueLess(const list_t& listItemsIn) : listItems(listItemsIn) {}
+        bool operator()(uint32_t nPos, const V& value) const { return listItems[nPos].value < value; }
+    };
+
+    /// Position of value in vecPos, or vecPos.end()
+    pos_v_t::iterator FindValue(pos_v_t& vecPos, const V& value) const
+    {
+        pos_v_t::iterator it = std::lower_bound(vecPos.begin(), vecPos.end(), value, ValueLess(listItems));
+        if(it != vecPos.end() && !(value < listItems[*it].value)) {
+            return it;
+        }
+        return vecPos.end();
+    }
+
+    void AddToIndex(uint32_t nPos)
+    {
+        const item_t& item = listItems[nPos];
+        pos_v_t& vecPos = mapIndex[item.key];
+        vecPos.insert(std::lower_bound(vecPos.begin(), vecPos.end(), item.value, ValueLess(listItems)), nPos);
+    }
+
 public:
     CacheMultiMap(size_type nMaxSizeIn = 0)
         : nMaxSize(nMaxSizeIn),
@@ -57,7 +79,7 @@ public:
           mapIndex()
     {}
 
-    CacheMultiMap(const CacheMap<K,V>& other)
+    CacheMultiMap(const CacheMultiMap& other)
         : nMaxSize(other.nMaxSize),
           listItems(other.listItems),
           mapIndex()
@@ -84,24 +106,27 @@ public:
         return listItems.size();
     }
 
+    size_t DynamicMemoryUsage() const {
+        size_t nUsage = listItems.DynamicMemoryUsage() + mapIndex.DynamicMemoryUsage();
+        for(map_cit it = mapIndex.begin(); it != mapIndex.end(); ++it) {
+            nUsage += memusage::DynamicUsage(it->second);
+        }
+        return nUsage;
+    }
+
     bool Insert(const K& key, const V& value)
     {
         map_it mit = mapIndex.find(key);
-        if(mit == mapIndex.end()) {
-            mit = mapIndex.emplace(key, it_map_t()).first;
-        }
-        it_map_t& mapIt = mit->second;
-
-        if(mapIt.count(value) > 0) {
+        if(mit != mapIndex.end() && FindValue(mit->second, value) != mit->second.end()) {
             // Don't insert duplicates
             return false;
         }
 
+        // Pruning may drop index entries, which moves the others
         if(listItems.size() == nMaxSize) {
             PruneLast();
         }
-        listItems.push_front(item_t(key, value));
-        mapIt.emplace(value, listItems.begin());
+        AddToIndex(listItems.push_front(item_t(key, value)));
         return true;
     }
 
@@ -116,9 +141,7 @@ public:
         if(it == mapIndex.end()) {
             return false;
         }
-        const it_map_t& mapIt = it->second;
-        const item_t& item = *(mapIt.begin()->second);
-        value = item.value;
+        value = listItems[it->second.front()].value;
         return true;
     }
 
@@ -128,11 +151,8 @@ public:
         if(mit == mapIndex.end()) {
             return false;
         }
-        const it_map_t& mapIt = mit->second;
-
-        for(it_map_cit it = mapIt.begin(); it != mapIt.end(); ++it) {
-            const item_t& item = *(it->second);
-            vecValues.push_back(item.value);
+        for(uint32_t nPos : mit->second) {
+            vecValues.push_back(listItems[nPos].value);
         }
         return true;
     }
@@ -150,13 +170,10 @@ public:
         if(mit == mapIndex.end()) {
             return;
         }
-        it_map_t& mapIt = mit->second;
-
-        for(it_map_it it = mapIt.begin(); it != mapIt.end(); ++it) {
-            listItems.erase(it->second);
+        for(uint32_t nPos : mit->second) {
+            listItems.erase(nPos);
         }
-
-        mapIndex.erase(mit);
+        mapIndex.erase(key);
     }
 
     void Erase(const K& key, const V& value)
@@ -165,18 +182,18 @@ public:
         if(mit == mapIndex.end()) {
             return;
         }
-        it_map_t& mapIt = mit->second;
+        pos_v_t& vecPos = mit->second;
 
-        it_map_it it = mapIt.find(value);
-        if(it == mapIt.end()) {
+        pos_v_t::iterator it = FindValue(vecPos, value);
+        if(it == vecPos.end()) {
             return;
         }
 
-        listItems.erase(it->second);
-        mapIt.erase(it);
+        listItems.erase(*it);
+        vecPos.erase(it);
 
-        if(mapIt.empty()) {
-            mapIndex.erase(mit);
+        if(vecPos.empty()) {
+            mapIndex.erase(key);
         }
     }
 
@@ -184,7 +201,7 @@ public:
         return listItems;
     }
 
-    CacheMap<K,V>& operator=(const CacheMap<K,V>& other)
+    CacheMultiMap& operator=(const CacheMultiMap& other)
     {
         nMaxSize = other.nMaxSize;
         listItems = other.listItems;
@@ -211,36 +228,42 @@ private:
             return;
         }
 
-        list_it lit = listItems.end();
-        --lit;
-        item_t& item = *lit;
+        uint32_t nPos = listItems.back();
+        const item_t& item = listItems[nPos];
 
         map_it mit = mapIndex.find(item.key);
 
         if(mit != mapIndex.end()) {
-            it_map_t& mapIt = mit->second;
+            pos_v_t& vecPos = mit->second;
 
-            mapIt.erase(item.value);
+            pos_v_t::iterator it = std::find(vecPos.begin(), vecPos.end(), nPos);
+            if(it != vecPos.end()) {
+                vecPos.erase(it);
+            }
 
-            if(mapIt.empty()) {
+            if(vecPos.empty()) {
                 mapIndex.erase(item.key);
             }
         }
 
-        listItems.pop_back();
+        listItems.erase(nPos);
     }
 
     void RebuildIndex()
     {
         mapIndex.clear();
-        for(list_it lit = listItems.begin(); lit != listItems.end(); ++lit) {
-            item_t& item = *lit;
+        list_cit lit = listItems.begin();
+        while(lit != listItems.end()) {
+            uint32_t nPos = lit.GetPos();
+            ++lit;
+            const item_t& item = listItems[nPos];
             map_it mit = mapIndex.find(item.key);
-            if(mit == mapIndex.end()) {
-                mit = mapIndex.emplace(item.key, it_map_t()).first;
+            // keep the most recent of duplicate items
+            if(mit != mapIndex.end() && FindValue(mit->second, item.value) != mit->second.end()) {
+                listItems.erase(nPos);
+                continue;
             }
-            it_map_t& mapIt = mit->second;
-            mapIt.emplace(item.value, lit);
+            AddToIndex(nPos);
         }
     }
 };
@@ -7,6 +7,51 @@
 
 using namespace std;
 
+CBlockIndex* CBlockIndexArena::New(int nHeight)
+{
+    ++nEntries;
+
+    if (nHeight >= 0) {
+        size_t nChunk = nHeight / BLOCK_INDEX_ARENA_CHUNK;
+        size_t nSlot = nHeight % BLOCK_INDEX_ARENA_CHUNK;
+
+        if (nChunk >= vHeightChunks.size())
+            vHeightChunks.resize(nChunk + 1);
+
+        if (!vHeightChunks[nChunk]) {
+            vHeightChunks[nChunk].reset(new HeightChunk());
+            vHeightChunks[nChunk]->entries.reset(new CBlockIndex[BLOCK_INDEX_ARENA_CHUNK]);
+        }
+
+        HeightChunk& chunk = *vHeightChunks[nChunk];
+        if (!chunk.used[nSlot]) {
+            chunk.used[nSlot] = true;
+            return &chunk.entries[nSlot];
+        }
+    }
+
+    if (nOverflowUsed == BLOCK_INDEX_ARENA_CHUNK) {
+        vOverflowChunks.emplace_back(new CBlockIndex[BLOCK_INDEX_ARENA_CHUNK]);
+        nOverflowUsed = 0;
+    }
+    return &vOverflowChunks.back()[nOverflowUsed++];
+}
+
+void CBlockIndexArena::Clear()
+{
+    vHeightChunks.clear();
+    vOverflowChunks.clear();
+    nOverflowUsed = BLOCK_INDEX_ARENA_CHUNK;
+    nEntries = 0;
+}
+
+size_t CBlockIndexArena::OverflowSize() const
+{
+    if (vOverflowChunks.empty())
+        return 0;
+    return (vOverflowChunks.size() - 1) * BLOCK_INDEX_ARENA_CHUNK + nOverflowUsed;
+}
+
 /**
  * CChain implementation
  */
@@ -61,6 +106,13 @@ const CBlockIndex *CChain::FindFork(const CBlockIndex *pindex) const {
     return pindex;
 }
 
+CBlockIndex* CChain::FindEarliestAtLeast(int64_t nTime) const
+{
+    std::vector<CBlockIndex*>::const_iterator lower = std::lower_bound(vChain.begin(), vChain.end(), nTime,
+        [](CBlockIndex* pBlock, const int64_t& time) -> bool { return pBlock->nTimeMax < time; });
+    return (lower == vChain.end() ? NULL : *lower);
+}
+
 /** Turn the lowest '1' bit in the binary representation of a number into a '0'. */
 int static inline InvertLowestOne(int n) { return n & (n - 1); }
 
@@ -12,6 +12,8 @@
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <bitset>
+#include <memory>
 #include <vector>
 
 static const int64_t MAX_FUTURE_BLOCK_TIME = 15 * 60;
@@ -158,8 +160,8 @@ enum BlockStatus: uint32_t {
 class CBlockIndex
 {
 public:
-    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
-    const uint256* phashBlock;
+    // The fields the chain walks and the best chain selection read come first,
+    // within the first 64 bytes of the entry.
 
     //! pointer to the index of the predecessor of this block
     CBlockIndex* pprev;
@@ -170,29 +172,38 @@ public:
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
-    //! Which # file this block is stored in (blk?????.dat)
-    int nFile;
-
-    //! Byte offset within blk?????.dat where this block's data is stored
-    unsigned int nDataPos;
-
-    //! Byte offset within rev?????.dat where this block's undo data is stored
-    unsigned int nUndoPos;
+    //! Verification status of this block. See enum BlockStatus
+    unsigned int nStatus;
 
     //! (memory only) Total amount of work (expected number of hashes) in the chain up to and including this block
     arith_uint256 nChainWork;
 
-    //! Number of transactions in this block.
-    //! Note: in a potential headers-first mode, this number cannot be relied upon
-    unsigned int nTx;
-
     //! (memory only) Number of transactions in the chain up to and including this block.
     //! This value will be non-zero only if and only if transactions for this block and all its parents are available.
     //! Change to 64-bit type when necessary; won't happen before 2030
     unsigned int nChainTx;
 
-    //! Verification status of this block. See enum BlockStatus
-    unsigned int nStatus;
+    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
+    uint32_t nSequenceId;
+
+    //! pointer to the hash of the block, if any. Memory is owned by this CBlockIndex
+    const uint256* phashBlock;
+
+    //! Number of transactions in this block.
+    //! Note: in a potential headers-first mode, this number cannot be relied upon
+    unsigned int nTx;
+
+    //! (memory only) Maximum nTime in the chain upto and including this block.
+    unsigned int nTimeMax;
+
+    //! Which # file this block is stored in (blk?????.dat)
+    int nFile;
+
+    //! Byte offset within blk?????.dat where this block's data is stored
+    unsigned int nDataPos;
+
+    //! Byte offset within rev?????.dat where this block's undo data is stored
+    unsigned int nUndoPos;
 
     //! block header
     int nVersion;
@@ -201,9 +212,6 @@ public:
     unsigned int nBits;
     unsigned int nNonce;
 
-    //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
-    uint32_t nSequenceId;
-
     void SetNull()
     {
         phashBlock = NULL;
@@ -218,6 +226,7 @@ public:
         nChainTx = 0;
         nStatus = 0;
         nSequenceId = 0;
+        nTimeMax = 0;
 
         nVersion       = 0;
         hashMerkleRoot = uint256();
@@ -382,7 +391,7 @@ public:
         READWRITE(nNonce);
     }
 
-    uint256 GetBlockHash() const
+    CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
         block.nVersion        = nVersion;
@@ -391,7 +400,12 @@ public:
         block.nTime           = nTime;
         block.nBits           = nBits;
         block.nNonce          = nNonce;
-        return block.GetHash();
+        return block;
+    }
+
+    uint256 GetBlockHash() const
+    {
+        return GetBlockHeader().GetHash();
     }
 
 
@@ -406,6 +420,46 @@ public:
     }
 };
 
+/**
+ * The entries of mapBlockIndex, allocated in chunks of BLOCK_INDEX_ARENA_CHUNK
+ * heights instead of one by one. The first entry at a height gets the slot of
+ * the height, the entries of a chain lie in memory in the order the walks
+ * along pprev and pskip go through them. Further entries at a height, of
+ * stale forks, come from the overflow chunks.
+ *
+ * The entries never get freed on their own, only all of them at once.
+ */
+class CBlockIndexArena
+{
+public:
+    static const size_t BLOCK_INDEX_ARENA_CHUNK = 4096;
+
+private:
+    struct HeightChunk {
+        std::unique_ptr<CBlockIndex[]> entries;
+        std::bitset<BLOCK_INDEX_ARENA_CHUNK> used;
+    };
+
+    //! By height / BLOCK_INDEX_ARENA_CHUNK, null until an entry of its heights got allocated
+    std::vector<std::unique_ptr<HeightChunk> > vHeightChunks;
+    std::vector<std::unique_ptr<CBlockIndex[]> > vOverflowChunks;
+    //! Entries handed out of the last overflow chunk
+    size_t nOverflowUsed;
+    size_t nEntries;
+
+public:
+    CBlockIndexArena() : nOverflowUsed(BLOCK_INDEX_ARENA_CHUNK), nEntries(0) {}
+
+    /** A new entry for a block at nHeight, negative if the height isn't known.
+     *  Setting the height of the entry is up to the caller. */
+    CBlockIndex* New(int nHeight);
+    void Clear();
+
+    size_t size() const { return nEntries; }
+    //! Entries which didn't get the slot of their height
+    size_t OverflowSize() const;
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
@@ -461,6 +515,9 @@ public:
 
     /** Find the last common block between this chain and a block index entry. */
     const CBlockIndex *FindFork(const CBlockIndex *pindex) const;
+
+    /** Find the earliest block with timestamp equal or greater than the given. */
+    CBlockIndex* FindEarliestAtLeast(int64_t nTime) const;
 };
 
 #endif // BITCOIN_CHAIN_H
@@ -0,0 +1,31 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "changefeed.h"
+
+CChangeFeed::CChangeFeed() : nVersion(1)
+{
+}
+
+void CChangeFeed::Notify()
+{
+    {
+        std::unique_lock<std::mutex> lock(mut);
+        ++nVersion;
+    }
+    cond.notify_all();
+}
+
+uint64_t CChangeFeed::GetVersion() const
+{
+    std::unique_lock<std::mutex> lock(mut);
+    return nVersion;
+}
+
+uint64_t CChangeFeed::WaitForChange(uint64_t nKnown, std::chrono::milliseconds rel_time)
+{
+    std::unique_lock<std::mutex> lock(mut);
+    cond.wait_for(lock, rel_time, [this, nKnown]() { return nVersion != nKnown; });
+    return nVersion;
+}
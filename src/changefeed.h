@@ -0,0 +1,35 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_CHANGEFEED_H
+#define SMARTCASH_CHANGEFEED_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+
+/*
+    Version counter of some state which clients can wait on instead of polling it,
+    e.g. the long-polling RPCs. The owner of the state calls Notify() on every
+    change, the versions start at 1 so a client without one gets the current
+    state right away.
+*/
+class CChangeFeed
+{
+public:
+    CChangeFeed();
+
+    void Notify();
+    uint64_t GetVersion() const;
+    /** Wait until the version is another one than nKnown or rel_time passed, returns the version then */
+    uint64_t WaitForChange(uint64_t nKnown, std::chrono::milliseconds rel_time);
+
+private:
+    std::condition_variable cond;
+    mutable std::mutex mut;
+    uint64_t nVersion;
+};
+
+#endif // SMARTCASH_CHANGEFEED_H
@@ -6,17 +6,28 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
 #include <vector>
 
-#include <boost/foreach.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/** Workers with a queue of their own, further ones only take from the others */
+static const int MAX_CHECKQUEUE_WORKERS = 64;
+/** Checks a queue holds at first and at most, it grows between two rounds if the master ran out of space */
+static const unsigned int CHECKQUEUE_INITIAL_CAPACITY = 1024;
+static const unsigned int CHECKQUEUE_MAX_CAPACITY = 1 << 16;
+/** Times a thread looks through the queues for work before it parks */
+static const int CHECKQUEUE_SPIN_ROUNDS = 256;
 
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
   * operator(), returning a bool.
@@ -25,110 +36,244 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has a queue of its own the master fills in turns. The
+  * positions in a queue only ever grow, the master publishes new checks by
+  * moving the tail and the threads claim them by moving the head with a
+  * compare and swap, so adding and taking work needs no lock. A worker
+  * takes from its own queue first and from the others when it runs dry,
+  * always half of what it finds up to nBatchSize. Threads without work
+  * look around a few times and then park on a condition variable, which
+  * is only touched when someone is parked.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
+    /** Checks of one worker, the master is the only one adding to it */
+    struct WorkQueue
+    {
+        //! Next position to take, moved by everyone taking from the queue
+        std::atomic<uint64_t> nHead;
+        char padHead[64 - sizeof(std::atomic<uint64_t>)];
+        //! Position after the last check, only moved by the master
+        std::atomic<uint64_t> nTail;
+        char padTail[64 - sizeof(std::atomic<uint64_t>)];
 
-    //! Worker threads block on this when out of work
-    boost::condition_variable condWorker;
+        //! Only changed by the master between two rounds, when nobody looks at the slots
+        std::unique_ptr<T[]> slots;
+        uint64_t nCapacity;
+        //! Tail when the round started, the slots after it must not wrap around
+        uint64_t nRoundStart;
+        //! The master found the queue full in the last round
+        bool fOverflow;
 
-    //! Master thread blocks on this when out of work
-    boost::condition_variable condMaster;
+        WorkQueue() : nHead(0), nTail(0), nCapacity(0), nRoundStart(0), fOverflow(false) {}
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+        T& Slot(uint64_t nPos) { return slots[nPos & (nCapacity - 1)]; }
+    };
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! Queue 0 belongs to the master, the workers get the others in the order they started
+    WorkQueue queues[MAX_CHECKQUEUE_WORKERS + 1];
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Worker threads which started, including those beyond MAX_CHECKQUEUE_WORKERS
+    std::atomic<int> nWorkers;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
-
-    //! Whether we're shutting down.
-    bool fQuit;
+    std::atomic<unsigned int> nTodo;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Only for parking, a thread holds it while it checks once more whether to sleep
+    boost::mutex mutexPark;
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
+    std::atomic<int> nParked;
+    std::atomic<bool> fMasterParked;
+
+    //! Only touched by the master
+    bool fRoundStarted;
+    int nNextQueue;
+
+    int QueueCount() const
+    {
+        return std::min(nWorkers.load(), MAX_CHECKQUEUE_WORKERS) + 1;
+    }
+
+    bool HaveWork() const
+    {
+        int nQueues = QueueCount();
+        for (int i = 0; i < nQueues; i++) {
+            if (queues[i].nHead.load() < queues[i].nTail.load())
+                return true;
+        }
+        return false;
+    }
+
+    /** Claim up to nBatchSize checks of q into vChecks, the number of them */
+    unsigned int Take(WorkQueue& q, std::vector<T>& vChecks)
+    {
+        uint64_t nHead = q.nHead.load();
+        while (true) {
+            uint64_t nTail = q.nTail.load();
+            if (nHead >= nTail)
+                return 0;
+            // Half of the queue leaves the rest to whoever comes next, the
+            // batches get smaller towards the end so everyone finishes together.
+            uint64_t nAvailable = nTail - nHead;
+            unsigned int nNow = std::max<uint64_t>(1, std::min<uint64_t>(nBatchSize, (nAvailable + 1) / 2));
+            if (q.nHead.compare_exchange_weak(nHead, nHead + nNow)) {
+                vChecks.resize(nNow);
+                for (unsigned int i = 0; i < nNow; i++)
+                    vChecks[i].swap(q.Slot(nHead + i));
+                return nNow;
+            }
+        }
+    }
+
+    /** Own queue first, then the others starting with the next one */
+    unsigned int Find(int nOwn, std::vector<T>& vChecks)
+    {
+        int nQueues = QueueCount();
+        if (nOwn >= 0 && nOwn < nQueues) {
+            unsigned int nNow = Take(queues[nOwn], vChecks);
+            if (nNow)
+                return nNow;
+        }
+        for (int i = 1; i <= nQueues; i++) {
+            int nQueue = (std::max(nOwn, 0) + i) % nQueues;
+            if (nQueue == nOwn)
+                continue;
+            unsigned int nNow = Take(queues[nQueue], vChecks);
+            if (nNow)
+                return nNow;
+        }
+        return 0;
+    }
+
+    void Park(bool fMaster)
+    {
+        boost::unique_lock<boost::mutex> lock(mutexPark);
+        // Announced before the last look, whoever adds work or finishes the last check afterwards sees it
+        if (fMaster) {
+            fMasterParked = true;
+            while (nTodo.load() != 0 && !HaveWork())
+                condMaster.wait(lock);
+            fMasterParked = false;
+        } else {
+            nParked++;
+            try {
+                while (!HaveWork())
+                    condWorker.wait(lock);
+            } catch (...) {
+                nParked--;
+                throw;
+            }
+            nParked--;
+        }
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        int nOwn = fMaster ? 0 : nWorkers.fetch_add(1) + 1;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        int nSpins = 0;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+            unsigned int nNow = Find(nOwn, vChecks);
+            if (nNow) {
+                // Check whether we need to do work at all
+                bool fOk = fAllOk.load();
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                vChecks.clear();
+                if (!fOk)
+                    fAllOk = false;
+                // We processed the last element; inform the master it can exit and return the result
+                if (nTodo.fetch_sub(nNow) == nNow && !fMaster && fMasterParked.load()) {
+                    boost::unique_lock<boost::mutex> lock(mutexPark);
+                    condMaster.notify_one();
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                nSpins = 0;
+                continue;
+            }
+
+            if (fMaster && nTodo.load() == 0) {
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                EndRound();
+                // return the current status
+                return fRet;
+            }
+
+            if (++nSpins < CHECKQUEUE_SPIN_ROUNDS) {
+                if (nSpins % 16 == 0) {
+                    boost::this_thread::interruption_point();
+                    boost::this_thread::yield();
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            Park(fMaster);
+            nSpins = 0;
         } while (true);
     }
 
+    /** Make room for the checks of the new round, nobody takes from the queues before it adds some */
+    void StartRound()
+    {
+        int nQueues = QueueCount();
+        for (int i = 0; i < nQueues; i++) {
+            WorkQueue& q = queues[i];
+            if (q.nCapacity == 0 || (q.fOverflow && q.nCapacity < CHECKQUEUE_MAX_CAPACITY)) {
+                q.nCapacity = q.nCapacity ? q.nCapacity * 2 : CHECKQUEUE_INITIAL_CAPACITY;
+                q.slots.reset(new T[q.nCapacity]);
+            }
+            q.fOverflow = false;
+            q.nRoundStart = q.nTail.load();
+        }
+        fRoundStarted = true;
+    }
+
+    void EndRound()
+    {
+        fRoundStarted = false;
+    }
+
+    /** Append the checks of vChecks from nStart on to q, the number of them which fit */
+    size_t Push(WorkQueue& q, std::vector<T>& vChecks, size_t nStart, size_t nCount)
+    {
+        uint64_t nTail = q.nTail.load();
+        uint64_t nFree = q.nCapacity - (nTail - q.nRoundStart);
+        size_t nPush = std::min<uint64_t>(nCount, nFree);
+        if (nPush < nCount)
+            q.fOverflow = true;
+        if (nPush == 0)
+            return 0;
+
+        for (size_t i = 0; i < nPush; i++)
+            q.Slot(nTail + i).swap(vChecks[nStart + i]);
+        // Counted before they can be taken, nTodo never drops below the checks in flight
+        nTodo += nPush;
+        q.nTail = nTail + nPush;
+        return nPush;
+    }
+
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn) : nWorkers(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn), nParked(0), fMasterParked(false), fRoundStarted(false), nNextQueue(0) {}
 
     //! Worker thread
     void Thread()
@@ -145,16 +290,37 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty())
+            return;
+        if (!fRoundStarted)
+            StartRound();
+
+        // Spread over the queues of the workers in pieces of nBatchSize, the
+        // master's own one only holds work while no worker is around.
+        int nQueues = QueueCount();
+        size_t nDone = 0;
+        int nTried = 0;
+        while (nDone < vChecks.size() && nTried < nQueues) {
+            int nQueue = nQueues > 1 ? 1 + (nNextQueue++ % (nQueues - 1)) : 0;
+            size_t nPushed = Push(queues[nQueue], vChecks, nDone, std::min<size_t>(nBatchSize, vChecks.size() - nDone));
+            nDone += nPushed;
+            nTried = nPushed ? 0 : nTried + 1;
+        }
+
+        // No room left anywhere, the rest gets checked right here
+        for (; nDone < vChecks.size(); nDone++) {
+            if (fAllOk.load() && !vChecks[nDone]())
+                fAllOk = false;
+            T().swap(vChecks[nDone]);
+        }
+
+        if (nParked.load() > 0) {
+            boost::unique_lock<boost::mutex> lock(mutexPark);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
         }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
     }
 
     ~CCheckQueue()
@@ -163,13 +329,12 @@ public:
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return nTodo.load() == 0 && fAllOk.load();
     }
 
 };
 
-/** 
+/**
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
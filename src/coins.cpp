@@ -15,6 +15,15 @@ uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return 0; }
 
+void CCoinsView::GetCoins(const std::vector<COutPoint> &vOutpoints, std::vector<Coin> &vCoins) const
+{
+    vCoins.resize(vOutpoints.size());
+    for (size_t i = 0; i < vOutpoints.size(); i++) {
+        if (!GetCoin(vOutpoints[i], vCoins[i]))
+            vCoins[i].Clear();
+    }
+}
+
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
 {
     Coin coin;
@@ -32,16 +41,25 @@ size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn),
+    cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), CCoinsMapAllocator(&cacheCoinsPool)), cachedCoinsUsage(0), nCacheHits(0), nCacheMisses(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
-    return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
+    size_t nUsage = cacheCoinsPool.DynamicMemoryUsage() + cachedCoinsUsage;
+    // A bucket array which fits a block of the pool is in the pool's usage already
+    size_t nBucketsSize = sizeof(void*) * cacheCoins.bucket_count();
+    if (nBucketsSize > sizeof(CCoinsMapAllocator::Block))
+        nUsage += memusage::MallocUsage(nBucketsSize);
+    return nUsage;
 }
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        ++nCacheHits;
         return it;
+    }
+    ++nCacheMisses;
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
@@ -55,6 +73,30 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
     return ret;
 }
 
+void CCoinsViewCache::Prefetch(const std::vector<COutPoint> &vOutpoints) const {
+    std::vector<COutPoint> vMissing;
+    vMissing.reserve(vOutpoints.size());
+    for (const COutPoint &outpoint : vOutpoints) {
+        if (!cacheCoins.count(outpoint))
+            vMissing.push_back(outpoint);
+    }
+    nCacheHits += vOutpoints.size() - vMissing.size();
+    nCacheMisses += vMissing.size();
+    if (vMissing.empty())
+        return;
+
+    std::vector<Coin> vCoins;
+    base->GetCoins(vMissing, vCoins);
+    for (size_t i = 0; i < vMissing.size(); i++) {
+        // Like FetchCoin nothing gets cached for an outpoint the base has no coin of
+        if (vCoins[i].IsSpent())
+            continue;
+        std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(vMissing[i]), std::forward_as_tuple(std::move(vCoins[i])));
+        if (ret.second)
+            cachedCoinsUsage += ret.first->second.coin.DynamicMemoryUsage();
+    }
+}
+
 bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it != cacheCoins.end()) {
@@ -202,9 +244,19 @@ bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    ReleaseCache();
     return fOk;
 }
 
+void CCoinsViewCache::ReleaseCache()
+{
+    assert(cacheCoins.empty());
+    // The salted hasher can't be swapped or assigned, the map gets built anew
+    cacheCoins.~CCoinsMap();
+    cacheCoinsPool.Reset();
+    ::new (&cacheCoins) CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), CCoinsMapAllocator(&cacheCoinsPool));
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -10,6 +10,7 @@
 #include "core_memusage.h"
 #include "hash.h"
 #include "memusage.h"
+#include "objectpool.h"
 #include "serialize.h"
 #include "uint256.h"
 
@@ -119,7 +120,14 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The nodes of a CCoinsMap come from the pool of its cache, without a heap
+ * allocation and its overhead for each coin. The block size leaves room for
+ * the node overhead of the standard library.
+ */
+typedef CObjectPoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                             sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4> CCoinsMapAllocator;
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>, CCoinsMapAllocator> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -152,6 +160,11 @@ public:
      */
     virtual bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
 
+    /** Retrieve the coins of several outpoints at once, vCoins gets one entry for each
+     *  of them. The entries of the outpoints without an unspent coin are spent.
+     */
+    virtual void GetCoins(const std::vector<COutPoint> &vOutpoints, std::vector<Coin> &vCoins) const;
+
     //! Just check whether a given outpoint is unspent.
     virtual bool HaveCoin(const COutPoint &outpoint) const;
 
@@ -200,11 +213,17 @@ protected:
      * declared as "const".  
      */
     mutable uint256 hashBlock;
+    //! Memory of the cacheCoins nodes, declared first as it has to outlive them
+    mutable CCoinsMapAllocator::Pool cacheCoinsPool;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Lookups answered from cacheCoins and the ones which went to the base. */
+    mutable uint64_t nCacheHits;
+    mutable uint64_t nCacheMisses;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -225,6 +244,13 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Load the coins of the outpoints not in this cache yet with one GetCoins
+     * call to the backing CCoinsView, so the lookups of a block's inputs don't
+     * go to it one at a time.
+     */
+    void Prefetch(const std::vector<COutPoint> &vOutpoints) const;
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
@@ -269,6 +295,9 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! Number of lookups since the creation of the cache which found the outpoint in it and which didn't
+    void GetCacheStats(uint64_t& nHitsRet, uint64_t& nMissesRet) const { nHitsRet = nCacheHits; nMissesRet = nCacheMisses; }
+
     /** 
      * Amount of smartcash coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -292,6 +321,9 @@ public:
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
 
+    //! Release the pool of the emptied cache, the memory of a flushed cache goes back
+    void ReleaseCache();
+
     /**
      * By making the copy constructor private, we prevent accidentally using it when one intends to create a cache on top of a base cache.
      */
@@ -94,8 +94,21 @@ typedef u_int SOCKET;
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
+// The sockets are polled with epoll on Linux and kqueue on the BSDs and macOS,
+// select() is the fallback. Single sockets get waited for with poll() then,
+// so there is no FD_SETSIZE limit.
+#if defined(HAVE_SYS_EPOLL_H)
+#define USE_EPOLL
+#elif defined(HAVE_SYS_EVENT_H) && defined(HAVE_KQUEUE)
+#define USE_KQUEUE
+#endif
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+#define USE_POLL
+#include <poll.h>
+#endif
+
 bool static inline IsSelectableSocket(SOCKET s) {
-#ifdef WIN32
+#if defined(WIN32) || defined(USE_POLL)
     return true;
 #else
     return (s < FD_SETSIZE);
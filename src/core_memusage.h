@@ -67,9 +67,13 @@ static inline size_t RecursiveDynamicUsage(const CMutableTransaction& tx) {
     return mem;
 }
 
+static inline size_t RecursiveDynamicUsage(const CTransactionRef& tx) {
+    return tx ? memusage::DynamicUsage(tx) + RecursiveDynamicUsage(*tx) : 0;
+}
+
 static inline size_t RecursiveDynamicUsage(const CBlock& block) {
     size_t mem = memusage::DynamicUsage(block.vtx);
-    for (std::vector<CTransaction>::const_iterator it = block.vtx.begin(); it != block.vtx.end(); it++) {
+    for (std::vector<CTransactionRef>::const_iterator it = block.vtx.begin(); it != block.vtx.end(); it++) {
         mem += RecursiveDynamicUsage(*it);
     }
     return mem;
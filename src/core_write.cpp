@@ -120,7 +120,7 @@ string EncodeHexTx(const CTransaction& tx, const int serialFlags)
 {
     CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION | serialFlags);
     ssTx << tx;
-    return HexStr(ssTx.begin(), ssTx.end());
+    return HexStr(ssTx.data(), ssTx.data() + ssTx.size());
 }
 
 void ScriptPubKeyToUniv(const CScript& scriptPubKey,
@@ -8,10 +8,43 @@
 #include <assert.h>
 #include <string.h>
 
+#include "compat/cpuid.h"
+
 extern "C" {
 #include "crypto/ctaes/ctaes.c"
 }
 
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+namespace aes256_aesni
+{
+void ExpandEncryptKey(unsigned char out[240], const unsigned char key[32]);
+void ExpandDecryptKey(unsigned char out[240], const unsigned char key[32]);
+void Encrypt(const unsigned char rk[240], unsigned char* out, const unsigned char* in);
+void Decrypt(const unsigned char rk[240], unsigned char* out, const unsigned char* in);
+}
+
+namespace
+{
+bool DetectAESNI()
+{
+#if defined(HAVE_GETCPUID)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    return (ecx >> 25) & 1;
+#else
+    return false;
+#endif
+}
+
+//! Whether AES-256 goes through AES-NI, the constant-time ctaes is the fallback
+bool UseAESNI()
+{
+    static const bool fUseAESNI = DetectAESNI();
+    return fUseAESNI;
+}
+}
+#endif
+
 AES128Encrypt::AES128Encrypt(const unsigned char key[16])
 {
     AES128_init(&ctx, key);
@@ -44,31 +77,57 @@ void AES128Decrypt::Decrypt(unsigned char plaintext[16], const unsigned char cip
 
 AES256Encrypt::AES256Encrypt(const unsigned char key[32])
 {
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (UseAESNI()) {
+        aes256_aesni::ExpandEncryptKey(rk, key);
+        return;
+    }
+#endif
     AES256_init(&ctx, key);
 }
 
 AES256Encrypt::~AES256Encrypt()
 {
     memset(&ctx, 0, sizeof(ctx));
+    memset(rk, 0, sizeof(rk));
 }
 
 void AES256Encrypt::Encrypt(unsigned char ciphertext[16], const unsigned char plaintext[16]) const
 {
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (UseAESNI()) {
+        aes256_aesni::Encrypt(rk, ciphertext, plaintext);
+        return;
+    }
+#endif
     AES256_encrypt(&ctx, 1, ciphertext, plaintext);
 }
 
 AES256Decrypt::AES256Decrypt(const unsigned char key[32])
 {
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (UseAESNI()) {
+        aes256_aesni::ExpandDecryptKey(rk, key);
+        return;
+    }
+#endif
     AES256_init(&ctx, key);
 }
 
 AES256Decrypt::~AES256Decrypt()
 {
     memset(&ctx, 0, sizeof(ctx));
+    memset(rk, 0, sizeof(rk));
 }
 
 void AES256Decrypt::Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const
 {
+#if defined(ENABLE_AESNI) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (UseAESNI()) {
+        aes256_aesni::Decrypt(rk, plaintext, ciphertext);
+        return;
+    }
+#endif
     AES256_decrypt(&ctx, 1, plaintext, ciphertext);
 }
 
@@ -39,11 +39,15 @@ public:
     void Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const;
 };
 
-/** An encryption class for AES-256. */
+//! Size of the AES-256 round keys of the AES-NI implementation
+static const int AES256_ROUNDKEYS_SIZE = 240;
+
+/** An encryption class for AES-256, which uses AES-NI if the CPU supports it. */
 class AES256Encrypt
 {
 private:
     AES256_ctx ctx;
+    unsigned char rk[AES256_ROUNDKEYS_SIZE];
 
 public:
     AES256Encrypt(const unsigned char key[32]);
@@ -51,11 +55,12 @@ public:
     void Encrypt(unsigned char ciphertext[16], const unsigned char plaintext[16]) const;
 };
 
-/** A decryption class for AES-256. */
+/** A decryption class for AES-256, which uses AES-NI if the CPU supports it. */
 class AES256Decrypt
 {
 private:
     AES256_ctx ctx;
+    unsigned char rk[AES256_ROUNDKEYS_SIZE];
 
 public:
     AES256Decrypt(const unsigned char key[32]);
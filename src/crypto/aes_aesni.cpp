@@ -0,0 +1,101 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// AES-256 using the AES-NI instructions, the key expansion follows the
+// Intel AES-NI white paper.
+
+#ifdef ENABLE_AESNI
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace {
+
+__m128i inline __attribute__((always_inline)) ShiftXor(__m128i key)
+{
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, _mm_slli_si128(key, 4));
+}
+
+/** The even round keys, assist is the aeskeygenassist of the previous odd one with the round constant. */
+__m128i inline __attribute__((always_inline)) ExpandEven(__m128i key, __m128i assist)
+{
+    return _mm_xor_si128(ShiftXor(key), _mm_shuffle_epi32(assist, 0xff));
+}
+
+/** The odd round keys, which don't rotate and use no round constant. */
+__m128i inline __attribute__((always_inline)) ExpandOdd(__m128i key, __m128i even)
+{
+    return _mm_xor_si128(ShiftXor(key), _mm_shuffle_epi32(_mm_aeskeygenassist_si128(even, 0x00), 0xaa));
+}
+
+void Expand(__m128i rk[15], const unsigned char key[32])
+{
+    rk[0] = _mm_loadu_si128((const __m128i*)key);
+    rk[1] = _mm_loadu_si128((const __m128i*)(key + 16));
+    // The round constant has to be an immediate
+    rk[2] = ExpandEven(rk[0], _mm_aeskeygenassist_si128(rk[1], 0x01));
+    rk[3] = ExpandOdd(rk[1], rk[2]);
+    rk[4] = ExpandEven(rk[2], _mm_aeskeygenassist_si128(rk[3], 0x02));
+    rk[5] = ExpandOdd(rk[3], rk[4]);
+    rk[6] = ExpandEven(rk[4], _mm_aeskeygenassist_si128(rk[5], 0x04));
+    rk[7] = ExpandOdd(rk[5], rk[6]);
+    rk[8] = ExpandEven(rk[6], _mm_aeskeygenassist_si128(rk[7], 0x08));
+    rk[9] = ExpandOdd(rk[7], rk[8]);
+    rk[10] = ExpandEven(rk[8], _mm_aeskeygenassist_si128(rk[9], 0x10));
+    rk[11] = ExpandOdd(rk[9], rk[10]);
+    rk[12] = ExpandEven(rk[10], _mm_aeskeygenassist_si128(rk[11], 0x20));
+    rk[13] = ExpandOdd(rk[11], rk[12]);
+    rk[14] = ExpandEven(rk[12], _mm_aeskeygenassist_si128(rk[13], 0x40));
+}
+
+}
+
+namespace aes256_aesni {
+
+void ExpandEncryptKey(unsigned char out[240], const unsigned char key[32])
+{
+    __m128i rk[15];
+    Expand(rk, key);
+    for (int i = 0; i < 15; i++) {
+        _mm_storeu_si128((__m128i*)(out + 16 * i), rk[i]);
+    }
+}
+
+void ExpandDecryptKey(unsigned char out[240], const unsigned char key[32])
+{
+    // The equivalent inverse cipher, the round keys in reverse order through InvMixColumns
+    __m128i rk[15];
+    Expand(rk, key);
+    _mm_storeu_si128((__m128i*)out, rk[14]);
+    for (int i = 1; i < 14; i++) {
+        _mm_storeu_si128((__m128i*)(out + 16 * i), _mm_aesimc_si128(rk[14 - i]));
+    }
+    _mm_storeu_si128((__m128i*)(out + 16 * 14), rk[0]);
+}
+
+void Encrypt(const unsigned char rk[240], unsigned char* out, const unsigned char* in)
+{
+    __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), _mm_loadu_si128((const __m128i*)rk));
+    for (int i = 1; i < 14; i++) {
+        block = _mm_aesenc_si128(block, _mm_loadu_si128((const __m128i*)(rk + 16 * i)));
+    }
+    block = _mm_aesenclast_si128(block, _mm_loadu_si128((const __m128i*)(rk + 16 * 14)));
+    _mm_storeu_si128((__m128i*)out, block);
+}
+
+void Decrypt(const unsigned char rk[240], unsigned char* out, const unsigned char* in)
+{
+    __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), _mm_loadu_si128((const __m128i*)rk));
+    for (int i = 1; i < 14; i++) {
+        block = _mm_aesdec_si128(block, _mm_loadu_si128((const __m128i*)(rk + 16 * i)));
+    }
+    block = _mm_aesdeclast_si128(block, _mm_loadu_si128((const __m128i*)(rk + 16 * 14)));
+    _mm_storeu_si128((__m128i*)out, block);
+}
+
+}
+
+#endif
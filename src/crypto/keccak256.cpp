@@ -0,0 +1,111 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/keccak256.h>
+#include <crypto/common.h>
+#include <crypto/sph_keccak.h>
+
+#include <assert.h>
+#include <string.h>
+
+#include <compat/cpuid.h>
+
+namespace keccak256_avx2
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+
+namespace
+{
+
+void Keccak256(unsigned char* out, const unsigned char* in)
+{
+    sph_keccak256_context ctx;
+    sph_keccak256_init(&ctx);
+    sph_keccak256(&ctx, in, 80);
+    sph_keccak256_close(&ctx, out);
+}
+
+typedef void (*Transform4Type)(unsigned char*, const unsigned char*);
+
+Transform4Type Transform_4way = nullptr;
+
+bool SelfTest()
+{
+    // Four different inputs, a mixup of the lanes doesn't go unnoticed
+    unsigned char data[320];
+    for (int i = 0; i < 320; ++i) {
+        data[i] = i * 7 + 1;
+    }
+
+    unsigned char out[4][32];
+    unsigned char expected[4][32];
+
+    // The multi-way transforms have to match the reference one for every input.
+    for (int i = 0; i < 4; ++i) {
+        Keccak256(expected[i], data + 80 * i);
+    }
+
+    if (Transform_4way) {
+        Transform_4way(out[0], data);
+        if (memcmp(out, expected, sizeof(out))) return false;
+    }
+
+    return true;
+}
+
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+} // namespace
+
+
+std::string Keccak256AutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    // The AVX2 transform is the only one, nothing to look for without it
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    bool have_xsave = (ecx >> 27) & 1;
+    bool have_avx = (ecx >> 28) & 1;
+    bool have_avx2 = false;
+    if (have_xsave && have_avx && AVXEnabled()) {
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = (ebx >> 5) & 1;
+    }
+
+    if (have_avx2) {
+        Transform_4way = keccak256_avx2::Transform_4way;
+        ret += ",avx2(4way)";
+    }
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
+void Keccak256_80(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (Transform_4way) {
+        while (blocks >= 4) {
+            Transform_4way(out, in);
+            out += 128;
+            in += 320;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        Keccak256(out, in);
+        out += 32;
+        in += 80;
+        blocks -= 1;
+    }
+}
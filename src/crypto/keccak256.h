@@ -0,0 +1,24 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_CRYPTO_KECCAK256_H
+#define SMARTCASH_CRYPTO_KECCAK256_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** Autodetect the best available implementation for Keccak256_80.
+ *  Returns the name of the implementation.
+ */
+std::string Keccak256AutoDetect();
+
+/** Compute multiple Keccak-256's of 80-byte blobs, the size of a block header.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*80 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ */
+void Keccak256_80(unsigned char* output, const unsigned char* input, size_t blocks);
+
+#endif // SMARTCASH_CRYPTO_KECCAK256_H
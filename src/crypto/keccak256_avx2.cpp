@@ -0,0 +1,149 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <crypto/common.h>
+
+namespace keccak256_avx2 {
+namespace {
+
+const uint64_t RC[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808AULL, 0x8000000080008000ULL,
+    0x000000000000808BULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008AULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000AULL,
+    0x000000008000808BULL, 0x800000000000008BULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800AULL, 0x800000008000000AULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z, __m256i w, __m256i v) { return Xor(Xor(Xor(x, y), Xor(z, w)), v); }
+__m256i inline AndNot(__m256i x, __m256i y) { return _mm256_andnot_si256(x, y); }
+template <int n> __m256i inline Rot(__m256i x) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+
+void inline __attribute__((always_inline)) Theta(__m256i* a, __m256i d0, __m256i d1, __m256i d2, __m256i d3, __m256i d4)
+{
+    for (int y = 0; y < 25; y += 5) {
+        a[y] = Xor(a[y], d0);
+        a[y + 1] = Xor(a[y + 1], d1);
+        a[y + 2] = Xor(a[y + 2], d2);
+        a[y + 3] = Xor(a[y + 3], d3);
+        a[y + 4] = Xor(a[y + 4], d4);
+    }
+}
+
+/** Chi on the row starting at lane y. */
+void inline __attribute__((always_inline)) Chi(__m256i* a, const __m256i* b, int y)
+{
+    a[y] = Xor(b[y], AndNot(b[y + 1], b[y + 2]));
+    a[y + 1] = Xor(b[y + 1], AndNot(b[y + 2], b[y + 3]));
+    a[y + 2] = Xor(b[y + 2], AndNot(b[y + 3], b[y + 4]));
+    a[y + 3] = Xor(b[y + 3], AndNot(b[y + 4], b[y]));
+    a[y + 4] = Xor(b[y + 4], AndNot(b[y], b[y + 1]));
+}
+
+/** Keccak-f[1600] on four states, a[x + 5 * y] holds lane (x, y) of each of them. */
+void inline __attribute__((always_inline)) Permute(__m256i* a)
+{
+    __m256i b[25], c0, c1, c2, c3, c4, d0, d1, d2, d3, d4;
+
+    for (int round = 0; round < 24; ++round) {
+        // Theta
+        c0 = Xor(a[0], a[5], a[10], a[15], a[20]);
+        c1 = Xor(a[1], a[6], a[11], a[16], a[21]);
+        c2 = Xor(a[2], a[7], a[12], a[17], a[22]);
+        c3 = Xor(a[3], a[8], a[13], a[18], a[23]);
+        c4 = Xor(a[4], a[9], a[14], a[19], a[24]);
+        d0 = Xor(c4, Rot<1>(c1));
+        d1 = Xor(c0, Rot<1>(c2));
+        d2 = Xor(c1, Rot<1>(c3));
+        d3 = Xor(c2, Rot<1>(c4));
+        d4 = Xor(c3, Rot<1>(c0));
+        Theta(a, d0, d1, d2, d3, d4);
+
+        // Rho and pi, lane (x, y) moves to (y, 2x + 3y)
+        b[0] = a[0];
+        b[10] = Rot<1>(a[1]);
+        b[20] = Rot<62>(a[2]);
+        b[5] = Rot<28>(a[3]);
+        b[15] = Rot<27>(a[4]);
+        b[16] = Rot<36>(a[5]);
+        b[1] = Rot<44>(a[6]);
+        b[11] = Rot<6>(a[7]);
+        b[21] = Rot<55>(a[8]);
+        b[6] = Rot<20>(a[9]);
+        b[7] = Rot<3>(a[10]);
+        b[17] = Rot<10>(a[11]);
+        b[2] = Rot<43>(a[12]);
+        b[12] = Rot<25>(a[13]);
+        b[22] = Rot<39>(a[14]);
+        b[23] = Rot<41>(a[15]);
+        b[8] = Rot<45>(a[16]);
+        b[18] = Rot<15>(a[17]);
+        b[3] = Rot<21>(a[18]);
+        b[13] = Rot<8>(a[19]);
+        b[14] = Rot<18>(a[20]);
+        b[24] = Rot<2>(a[21]);
+        b[9] = Rot<61>(a[22]);
+        b[19] = Rot<56>(a[23]);
+        b[4] = Rot<14>(a[24]);
+
+        // Chi
+        Chi(a, b, 0);
+        Chi(a, b, 5);
+        Chi(a, b, 10);
+        Chi(a, b, 15);
+        Chi(a, b, 20);
+
+        // Iota
+        a[0] = Xor(a[0], _mm256_set1_epi64x(RC[round]));
+    }
+}
+
+__m256i inline Read4(const unsigned char* in, int offset)
+{
+    return _mm256_set_epi64x(ReadLE64(in + 240 + offset), ReadLE64(in + 160 + offset), ReadLE64(in + 80 + offset), ReadLE64(in + offset));
+}
+
+void inline Write4(unsigned char* out, int offset, __m256i v)
+{
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, v);
+    WriteLE64(out + offset, lanes[0]);
+    WriteLE64(out + 32 + offset, lanes[1]);
+    WriteLE64(out + 64 + offset, lanes[2]);
+    WriteLE64(out + 96 + offset, lanes[3]);
+}
+
+}
+
+/** Keccak-256 of four 80 byte inputs at once. They fit into the 136 byte rate, each takes a single
+ *  permutation with the original Keccak padding: 0x01 after the data and 0x80 in the last byte. */
+void Transform_4way(unsigned char* out, const unsigned char* in)
+{
+    __m256i a[25];
+
+    for (int i = 0; i < 10; ++i) {
+        a[i] = Read4(in, 8 * i);
+    }
+    for (int i = 10; i < 25; ++i) {
+        a[i] = _mm256_setzero_si256();
+    }
+    a[10] = _mm256_set1_epi64x(0x01);
+    a[16] = _mm256_set1_epi64x(0x8000000000000000ULL);
+
+    Permute(a);
+
+    for (int i = 0; i < 4; ++i) {
+        Write4(out, 8 * i, a[i]);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,125 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/pbkdf2_hmac_sha512.h"
+
+#include "crypto/common.h"
+#include "crypto/hmac_sha512.h"
+#include "crypto/sha512.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+const uint64_t SHA512_INIT[8] = {
+    0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull, 0xa54ff53a5f1d36f1ull,
+    0x510e527fade682d1ull, 0x9b05688c2b3e6c1full, 0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull,
+};
+
+/** The first HMAC of a block of the key, U_1 = PRF(P, S || INT(i)). */
+void FirstBlock(const CHMAC_SHA512& prf, const unsigned char* salt, size_t saltlen, uint32_t nBlock, unsigned char* out)
+{
+    unsigned char count[4];
+    WriteBE32(count, nBlock);
+    CHMAC_SHA512(prf).Write(salt, saltlen).Write(count, 4).Finalize(out);
+}
+} // namespace
+
+void PBKDF2_HMAC_SHA512(const unsigned char* pass, size_t passlen, const unsigned char* salt, size_t saltlen, unsigned int iterations, unsigned char* out, size_t outlen)
+{
+    // The copies of prf start from the hashed key pads instead of hashing them again every time
+    const CHMAC_SHA512 prf(pass, passlen);
+    unsigned char u[CHMAC_SHA512::OUTPUT_SIZE];
+    unsigned char t[CHMAC_SHA512::OUTPUT_SIZE];
+
+    for (uint32_t nBlock = 1; outlen > 0; ++nBlock) {
+        FirstBlock(prf, salt, saltlen, nBlock, u);
+        memcpy(t, u, sizeof(t));
+        for (unsigned int i = 1; i < iterations; ++i) {
+            CHMAC_SHA512(prf).Write(u, sizeof(u)).Finalize(u);
+            for (size_t j = 0; j < sizeof(t); ++j) {
+                t[j] ^= u[j];
+            }
+        }
+        size_t nCopy = std::min(outlen, sizeof(t));
+        memcpy(out, t, nCopy);
+        out += nCopy;
+        outlen -= nCopy;
+    }
+}
+
+void PBKDF2_HMAC_SHA512_4way(const unsigned char* const pass[4], const size_t passlen[4], const unsigned char* salt, size_t saltlen, unsigned int iterations, unsigned char* const out[4], size_t outlen)
+{
+    // The states of the hashes after the inner and the outer key pad of every HMAC
+    uint64_t inner[32];
+    uint64_t outer[32];
+    unsigned char chunk[512];
+    for (int n = 0; n < 4; ++n) {
+        unsigned char* rkey = chunk + 128 * n;
+        if (passlen[n] <= 128) {
+            memcpy(rkey, pass[n], passlen[n]);
+            memset(rkey + passlen[n], 0, 128 - passlen[n]);
+        } else {
+            CSHA512().Write(pass[n], passlen[n]).Finalize(rkey);
+            memset(rkey + 64, 0, 64);
+        }
+        for (int i = 0; i < 128; ++i) {
+            rkey[i] ^= 0x5c;
+        }
+        memcpy(outer + 8 * n, SHA512_INIT, sizeof(SHA512_INIT));
+        memcpy(inner + 8 * n, SHA512_INIT, sizeof(SHA512_INIT));
+    }
+    SHA512Transform_4way(outer, chunk);
+    for (int i = 0; i < 512; ++i) {
+        chunk[i] ^= 0x5c ^ 0x36;
+    }
+    SHA512Transform_4way(inner, chunk);
+
+    // Every further HMAC hashes a 64 byte message, padded to a single chunk both in the
+    // inner and the outer hash which follow a key pad of 128 bytes
+    memset(chunk, 0, sizeof(chunk));
+    for (int n = 0; n < 4; ++n) {
+        chunk[128 * n + 64] = 0x80;
+        WriteBE64(chunk + 128 * n + 120, (128 + 64) * 8);
+    }
+
+    uint64_t s[32];
+    uint64_t t[32];
+    size_t nOffset = 0;
+    for (uint32_t nBlock = 1; nOffset < outlen; ++nBlock) {
+        for (int n = 0; n < 4; ++n) {
+            FirstBlock(CHMAC_SHA512(pass[n], passlen[n]), salt, saltlen, nBlock, chunk + 128 * n);
+            for (int i = 0; i < 8; ++i) {
+                t[8 * n + i] = ReadBE64(chunk + 128 * n + 8 * i);
+            }
+        }
+        for (unsigned int nIteration = 1; nIteration < iterations; ++nIteration) {
+            memcpy(s, inner, sizeof(s));
+            SHA512Transform_4way(s, chunk);
+            for (int n = 0; n < 4; ++n) {
+                for (int i = 0; i < 8; ++i) {
+                    WriteBE64(chunk + 128 * n + 8 * i, s[8 * n + i]);
+                }
+            }
+            memcpy(s, outer, sizeof(s));
+            SHA512Transform_4way(s, chunk);
+            for (int n = 0; n < 4; ++n) {
+                for (int i = 0; i < 8; ++i) {
+                    WriteBE64(chunk + 128 * n + 8 * i, s[8 * n + i]);
+                    t[8 * n + i] ^= s[8 * n + i];
+                }
+            }
+        }
+        size_t nCopy = std::min(outlen - nOffset, (size_t)CHMAC_SHA512::OUTPUT_SIZE);
+        for (int n = 0; n < 4; ++n) {
+            unsigned char block[CHMAC_SHA512::OUTPUT_SIZE];
+            for (int i = 0; i < 8; ++i) {
+                WriteBE64(block + 8 * i, t[8 * n + i]);
+            }
+            memcpy(out[n] + nOffset, block, nCopy);
+        }
+        nOffset += nCopy;
+    }
+}
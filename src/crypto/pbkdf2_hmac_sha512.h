@@ -0,0 +1,19 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_CRYPTO_PBKDF2_HMAC_SHA512_H
+#define SMARTCASH_CRYPTO_PBKDF2_HMAC_SHA512_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** PBKDF2 (RFC 2898) with HMAC-SHA-512 as the pseudorandom function, outlen bytes of key into out. */
+void PBKDF2_HMAC_SHA512(const unsigned char* pass, size_t passlen, const unsigned char* salt, size_t saltlen, unsigned int iterations, unsigned char* out, size_t outlen);
+
+/** Four PBKDF2_HMAC_SHA512 of different passwords at once on SHA512Transform_4way.
+ *  The salt, the number of iterations and the length of the keys are the same for all of them.
+ */
+void PBKDF2_HMAC_SHA512_4way(const unsigned char* const pass[4], const size_t passlen[4], const unsigned char* salt, size_t saltlen, unsigned int iterations, unsigned char* const out[4], size_t outlen);
+
+#endif // SMARTCASH_CRYPTO_PBKDF2_HMAC_SHA512_H
@@ -559,9 +559,14 @@ bool AVXEnabled()
 } // namespace
 
 
-std::string SHA256AutoDetect()
+std::string SHA256AutoDetect(sha256_implementation::UseImplementation use_implementation)
 {
     std::string ret = "standard";
+    Transform = sha256::Transform;
+    TransformD64 = sha256::TransformD64;
+    TransformD64_2way = nullptr;
+    TransformD64_4way = nullptr;
+    TransformD64_8way = nullptr;
 #if defined(USE_ASM) && defined(HAVE_GETCPUID)
     bool have_sse4 = false;
     bool have_xsave = false;
@@ -591,6 +596,11 @@ std::string SHA256AutoDetect()
         have_avx2 = (ebx >> 5) & 1;
         have_shani = (ebx >> 29) & 1;
     }
+    bool have_sse41 = have_sse4 && (use_implementation & sha256_implementation::USE_SSE41);
+    (void)have_sse41;
+    have_sse4 &= (use_implementation & sha256_implementation::USE_SSE4) != 0;
+    have_avx2 &= (use_implementation & sha256_implementation::USE_AVX2) != 0;
+    have_shani &= (use_implementation & sha256_implementation::USE_SHANI) != 0;
 
 #if defined(ENABLE_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
     if (have_shani) {
@@ -599,6 +609,7 @@ std::string SHA256AutoDetect()
         TransformD64_2way = sha256d64_shani::Transform_2way;
         ret = "shani(1way,2way)";
         have_sse4 = false; // Disable SSE4/AVX2;
+        have_sse41 = false;
         have_avx2 = false;
     }
 #endif
@@ -609,11 +620,13 @@ std::string SHA256AutoDetect()
         TransformD64 = TransformD64Wrapper<sha256_sse4::Transform>;
         ret = "sse4(1way)";
 #endif
+    }
 #if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_sse41) {
         TransformD64_4way = sha256d64_sse41::Transform_4way;
         ret += ",sse41(4way)";
-#endif
     }
+#endif
 
 #if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
     if (have_avx2 && have_avx && enabled_avx) {
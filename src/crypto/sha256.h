@@ -26,10 +26,23 @@ public:
     CSHA256& Reset();
 };
 
-/** Autodetect the best available SHA256 implementation.
+namespace sha256_implementation {
+/** The SHA256 implementations SHA256AutoDetect may pick from, besides the standard one. */
+enum UseImplementation : uint8_t {
+    STANDARD = 0,
+    USE_SSE4 = 1 << 0,  //!< SSE4 assembly, one block at a time
+    USE_SSE41 = 1 << 1, //!< SSE4.1, four 64 byte double-SHA256 at once
+    USE_AVX2 = 1 << 2,  //!< AVX2, eight 64 byte double-SHA256 at once
+    USE_SHANI = 1 << 3, //!< SHA-NI, one block at a time and two 64 byte double-SHA256 at once
+    USE_ALL = USE_SSE4 | USE_SSE41 | USE_AVX2 | USE_SHANI,
+};
+}
+
+/** Autodetect the best available SHA256 implementation, out of the ones use_implementation allows.
+ *  Can be called again to switch, the benchmarks do that to measure every implementation.
  *  Returns the name of the implementation.
  */
-std::string SHA256AutoDetect();
+std::string SHA256AutoDetect(sha256_implementation::UseImplementation use_implementation = sha256_implementation::USE_ALL);
 
 /** Compute multiple double-SHA256's of 64-byte blobs.
  *  output:  pointer to a blocks*32 byte output buffer
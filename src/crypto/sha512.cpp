@@ -6,8 +6,16 @@
 
 #include "crypto/common.h"
 
+#include <assert.h>
 #include <string.h>
 
+#include <compat/cpuid.h>
+
+namespace sha512_avx2
+{
+void Transform_4way(uint64_t* s, const unsigned char* chunk);
+}
+
 // Internal implementation code.
 namespace
 {
@@ -144,10 +152,90 @@ void Transform(uint64_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+/** Four independent transformations, one after the other. */
+void Transform_4way(uint64_t* s, const unsigned char* chunk)
+{
+    for (int i = 0; i < 4; ++i) {
+        Transform(s + 8 * i, chunk + 128 * i);
+    }
+}
+
 } // namespace sha512
 
+typedef void (*Transform4Type)(uint64_t*, const unsigned char*);
+
+Transform4Type Transform_4way = sha512::Transform_4way;
+
+bool SelfTest()
+{
+    // Four different states and chunks, a mixup of the lanes doesn't go unnoticed
+    unsigned char data[512];
+    for (int i = 0; i < 512; ++i) {
+        data[i] = i * 7 + 1;
+    }
+    uint64_t s[32];
+    uint64_t expected[32];
+    for (int i = 0; i < 32; ++i) {
+        s[i] = expected[i] = 0x0123456789abcdefull * (i + 1);
+    }
+
+    sha512::Transform_4way(expected, data);
+    Transform_4way(s, data);
+    return memcmp(s, expected, sizeof(s)) == 0;
+}
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
 } // namespace
 
+std::string SHA512AutoDetect()
+{
+    std::string ret = "standard";
+    Transform_4way = sha512::Transform_4way;
+#if defined(USE_ASM) && defined(HAVE_GETCPUID)
+    bool have_xsave = false;
+    bool have_avx = false;
+    bool have_avx2 = false;
+    bool enabled_avx = false;
+
+    (void)AVXEnabled;
+    (void)have_avx2;
+
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    have_xsave = (ecx >> 27) & 1;
+    have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx) {
+        enabled_avx = AVXEnabled();
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = (ebx >> 5) & 1;
+    }
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2 && enabled_avx) {
+        Transform_4way = sha512_avx2::Transform_4way;
+        ret += ",avx2(4way)";
+    }
+#endif
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
+void SHA512Transform_4way(uint64_t* s, const unsigned char* chunk)
+{
+    Transform_4way(s, chunk);
+}
+
 
 ////// SHA-512
 
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-512. */
 class CSHA512
@@ -25,4 +26,15 @@ public:
     CSHA512& Reset();
 };
 
+/** Autodetect the best available implementation for SHA512Transform_4way.
+ *  Returns the name of the implementation.
+ */
+std::string SHA512AutoDetect();
+
+/** Process one 128-byte chunk for each of four independent SHA-512 states, e.g. the HMACs of PBKDF2.
+ *  s:     pointer to the 4*8 state words, the states one after the other
+ *  chunk: pointer to the 4*128 byte input, the chunks one after the other
+ */
+void SHA512Transform_4way(uint64_t* s, const unsigned char* chunk);
+
 #endif // BITCOIN_CRYPTO_SHA512_H
@@ -0,0 +1,209 @@
+// Copyright (c) 2016 Jeremy Rubin
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_CUCKOOCACHE_H
+#define SMARTCASH_CUCKOOCACHE_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/** Fixed size cache of elements with 8 hash locations each, for sets which
+ *  get looked up by many threads at once like the signature cache. */
+namespace CuckooCache
+{
+
+/**
+ * One atomic bit per cache slot. A set bit means the slot may be overwritten,
+ * readers which found their element set it to erase it without a write lock.
+ */
+class bit_packed_atomic_flags
+{
+    std::unique_ptr<std::atomic<uint8_t>[]> mem;
+
+public:
+    bit_packed_atomic_flags() = delete;
+
+    //! All bits set, an empty cache has all slots free
+    explicit bit_packed_atomic_flags(uint32_t size)
+    {
+        size = (size + 7) / 8;
+        mem.reset(new std::atomic<uint8_t>[size]);
+        for (uint32_t i = 0; i < size; ++i)
+            mem[i].store(0xFF);
+    }
+
+    //! Start over with size bits, all set. Not thread-safe.
+    void setup(uint32_t size)
+    {
+        bit_packed_atomic_flags d(size);
+        std::swap(mem, d.mem);
+    }
+
+    void bit_set(uint32_t s) { mem[s >> 3].fetch_or(1 << (s & 7), std::memory_order_relaxed); }
+    void bit_unset(uint32_t s) { mem[s >> 3].fetch_and(~(1 << (s & 7)), std::memory_order_relaxed); }
+    bool bit_is_set(uint32_t s) const { return (1 << (s & 7)) & mem[s >> 3].load(std::memory_order_relaxed); }
+};
+
+/**
+ * Cuckoo cache of Elements, Hash has to provide 8 independent 32 bit hashes
+ * through operator()<0> ... operator()<7>.
+ *
+ * An element lives at one of its 8 locations. Inserting moves the elements in
+ * the way on to another of their locations, up to a depth of log2(size)
+ * moves, the last one moved out gets dropped.
+ *
+ * Eviction goes by generations: the epoch flag of a slot tells whether it
+ * got written in the current one. Once the current generation holds 45% of
+ * the slots, the previous one is marked as free and the current one becomes
+ * the previous one, so the newest entries stay while the old ones make room.
+ *
+ * contains() may be called concurrently, also with erase set, insert() and
+ * setup() need exclusive access.
+ */
+template <typename Element, typename Hash>
+class cache
+{
+    std::vector<Element> table;
+    uint32_t size;
+    mutable bit_packed_atomic_flags collection_flags;
+    //! Set for the slots written in the current generation
+    mutable std::vector<bool> epoch_flags;
+    //! Inserts until the generation gets checked again
+    uint32_t epoch_heuristic_counter;
+    //! Slots of a full generation
+    uint32_t epoch_size;
+    uint8_t depth_limit;
+    const Hash hash_function;
+
+    //! The hashes scaled to [0, size) without a division
+    std::array<uint32_t, 8> compute_hashes(const Element& e) const
+    {
+        return {{(uint32_t)((hash_function.template operator()<0>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)((hash_function.template operator()<1>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)((hash_function.template operator()<2>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)((hash_function.template operator()<3>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)((hash_function.template operator()<4>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)((hash_function.template operator()<5>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)((hash_function.template operator()<6>(e) * (uint64_t)size) >> 32),
+                 (uint32_t)((hash_function.template operator()<7>(e) * (uint64_t)size) >> 32)}};
+    }
+
+    static uint32_t invalid() { return ~(uint32_t)0; }
+
+    void allow_erase(uint32_t n) const { collection_flags.bit_set(n); }
+    void please_keep(uint32_t n) const { collection_flags.bit_unset(n); }
+
+    /** Start a new generation once the current one is full. Counting the
+     *  slots in use is a full scan, it only happens every so many inserts. */
+    void epoch_check()
+    {
+        if (epoch_heuristic_counter != 0) {
+            --epoch_heuristic_counter;
+            return;
+        }
+
+        uint32_t epoch_unused_count = 0;
+        for (uint32_t i = 0; i < size; ++i)
+            epoch_unused_count += epoch_flags[i] && !collection_flags.bit_is_set(i);
+
+        if (epoch_unused_count >= epoch_size) {
+            // The current generation becomes the old one, the old one is free
+            for (uint32_t i = 0; i < size; ++i) {
+                if (epoch_flags[i])
+                    epoch_flags[i] = false;
+                else
+                    allow_erase(i);
+            }
+            epoch_heuristic_counter = epoch_size;
+        } else {
+            epoch_heuristic_counter = std::max(1u, std::max(epoch_size / 16, epoch_size - std::min(epoch_size, epoch_unused_count)));
+        }
+    }
+
+public:
+    cache() : size(0), collection_flags(0), epoch_heuristic_counter(0), epoch_size(0), depth_limit(0), hash_function() {}
+
+    //! Make room for new_size elements, dropping all. Returns the size used.
+    uint32_t setup(uint32_t new_size)
+    {
+        size = std::max<uint32_t>(2, new_size);
+        depth_limit = static_cast<uint8_t>(std::log2(static_cast<float>(size)));
+        table.assign(size, Element());
+        collection_flags.setup(size);
+        epoch_flags.assign(size, false);
+        epoch_size = std::max<uint32_t>(1, (45 * size) / 100);
+        epoch_heuristic_counter = epoch_size;
+        return size;
+    }
+
+    //! setup() for as many elements as fit in bytes
+    uint32_t setup_bytes(size_t bytes)
+    {
+        return setup(std::min<size_t>(bytes / sizeof(Element), ~(uint32_t)0));
+    }
+
+    void insert(Element e)
+    {
+        epoch_check();
+
+        uint32_t last_loc = invalid();
+        bool last_epoch = true;
+        std::array<uint32_t, 8> locs = compute_hashes(e);
+
+        // Already in, it just counts as new again
+        for (uint32_t loc : locs) {
+            if (table[loc] == e) {
+                please_keep(loc);
+                epoch_flags[loc] = last_epoch;
+                return;
+            }
+        }
+
+        for (uint8_t depth = 0; depth < depth_limit; ++depth) {
+            for (uint32_t loc : locs) {
+                if (!collection_flags.bit_is_set(loc))
+                    continue;
+                table[loc] = std::move(e);
+                please_keep(loc);
+                epoch_flags[loc] = last_epoch;
+                return;
+            }
+
+            // Move the element at the location after the one it came from,
+            // so an element doesn't go back and forth between two slots
+            last_loc = locs[(1 + (std::find(locs.begin(), locs.end(), last_loc) - locs.begin())) & 7];
+            std::swap(table[last_loc], e);
+            bool epoch = last_epoch;
+            last_epoch = epoch_flags[last_loc];
+            epoch_flags[last_loc] = epoch;
+
+            locs = compute_hashes(e);
+        }
+        // The element still in e gets dropped, it's the one moved most
+    }
+
+    //! Whether e is in the cache, with erase it gets marked to be overwritten
+    bool contains(const Element& e, const bool erase) const
+    {
+        std::array<uint32_t, 8> locs = compute_hashes(e);
+        for (uint32_t loc : locs) {
+            if (table[loc] == e) {
+                if (erase)
+                    allow_erase(loc);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+} // namespace CuckooCache
+
+#endif // SMARTCASH_CUCKOOCACHE_H
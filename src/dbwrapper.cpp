@@ -15,6 +15,17 @@
 #include <memenv.h>
 #include <stdint.h>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 class CBitcoinLevelDBLogger : public leveldb::Logger {
 public:
@@ -73,14 +84,152 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+/** Env of a database on disk. LevelDB's default env runs the compactions of all
+ *  databases one after the other in a single thread, with the indexes enabled one
+ *  of them falling behind stalls the writes of the others too. This one gives the
+ *  database a compaction thread of its own, at a lower CPU and IO priority if set.
+ *  It also keeps the time the writes spent stalled, to log it. */
+class CDBCompactionEnv : public leveldb::EnvWrapper
+{
+    std::string strName;
+    bool fThread;
+    int nNice;
+
+    std::mutex cs;
+    std::condition_variable cond;
+    std::deque<std::pair<void (*)(void*), void*> > queue;
+    std::thread thread;
+    bool fStop;
+
+    //! Time spent in the 1ms sleeps of the L0 slowdown trigger, not taken by a write yet
+    std::atomic<int64_t> nSlowdownMicros;
+
+    int64_t nStallMicros;
+    int nStallWrites;
+    int64_t nLastStallLog;
+
+    void ThreadCompaction()
+    {
+        RenameThread("smartcash-dbcompact");
+        SetPriority();
+
+        std::unique_lock<std::mutex> lock(cs);
+        while (true) {
+            cond.wait(lock, [this] { return fStop || !queue.empty(); });
+            // LevelDB waits for its scheduled work when the database gets closed, so it is done then.
+            if (queue.empty())
+                break;
+
+            std::pair<void (*)(void*), void*> work = queue.front();
+            queue.pop_front();
+
+            lock.unlock();
+            work.first(work.second);
+            lock.lock();
+        }
+    }
+
+    void SetPriority()
+    {
+        if (nNice <= 0)
+            return;
+#ifdef __linux__
+        // Linux keeps a nice value and IO priority for each thread.
+        pid_t tid = syscall(SYS_gettid);
+        if (setpriority(PRIO_PROCESS, tid, nNice) != 0)
+            LogPrintf("%s: failed to set the nice value of the compaction thread of %s\n", __func__, strName);
+#ifdef SYS_ioprio_set
+        // Best effort class, at the level the kernel derives from the nice value without one.
+        static const int IOPRIO_CLASS_BE = 2;
+        static const int IOPRIO_CLASS_SHIFT = 13;
+        static const int IOPRIO_WHO_PROCESS = 1;
+        int nLevel = std::min(7, (nNice + 20) / 5);
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | nLevel) != 0)
+            LogPrintf("%s: failed to set the IO priority of the compaction thread of %s\n", __func__, strName);
+#endif
+#else
+        LogPrintf("%s: -dbcompactionnice is only supported on Linux\n", __func__);
+#endif
+    }
+
+public:
+    CDBCompactionEnv(const std::string& strNameIn, bool fThreadIn, int nNiceIn) :
+        leveldb::EnvWrapper(leveldb::Env::Default()), strName(strNameIn), fThread(fThreadIn), nNice(nNiceIn),
+        fStop(false), nSlowdownMicros(0), nStallMicros(0), nStallWrites(0), nLastStallLog(0) {}
+
+    ~CDBCompactionEnv()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fStop = true;
+        }
+        cond.notify_one();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    void Schedule(void (*function)(void*), void* arg) override
+    {
+        if (!fThread) {
+            target()->Schedule(function, arg);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            if (!thread.joinable())
+                thread = std::thread(&CDBCompactionEnv::ThreadCompaction, this);
+            queue.push_back(std::make_pair(function, arg));
+        }
+        cond.notify_one();
+    }
+
+    void SleepForMicroseconds(int micros) override
+    {
+        nSlowdownMicros += micros;
+        target()->SleepForMicroseconds(micros);
+    }
+
+    /** Count a write of nMicros as stalled if it slept in the L0 slowdown or got blocked
+     *  for long. Synced writes wait for the disk anyway, only their slowdown counts. */
+    void WriteDone(int64_t nMicros, bool fSync)
+    {
+        int64_t nStalled = nSlowdownMicros.exchange(0);
+        if (!fSync && nMicros >= DB_WRITE_STALL_MICROS)
+            nStalled = std::max(nStalled, nMicros);
+
+        if (!nStalled)
+            return;
+
+        std::lock_guard<std::mutex> lock(cs);
+        nStallMicros += nStalled;
+        ++nStallWrites;
+
+        int64_t nNow = GetTime();
+        if (nNow - nLastStallLog >= DB_STALL_LOG_INTERVAL) {
+            LogPrintf("LevelDB writes to %s stalled for %dms in %d writes, the compaction is behind\n",
+                      strName, nStallMicros / 1000, nStallWrites);
+            nStallMicros = 0;
+            nStallWrites = 0;
+            nLastStallLog = nNow;
+        }
+    }
+};
+
+int nDBMaxOpenFiles = DEFAULT_DB_MAX_OPEN_FILES;
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBOptions& dbOptions)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
     options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    // Without Snappy in the leveldb build the blocks are stored uncompressed anyway.
+    // Both kinds of blocks can be read, switching doesn't need a rebuild.
+    bool fCompression = dbOptions.fCompression && GetBoolArg("-dbcompression", DEFAULT_DB_COMPRESSION);
+    options.compression = fCompression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.block_size = dbOptions.nBlockSize;
+    options.max_open_files = nDBMaxOpenFiles;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -90,14 +239,16 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate,
+                       const CDBOptions& dbOptions)
 {
     penv = NULL;
+    pcompactionenv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, dbOptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -110,6 +261,11 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
         }
         TryCreateDirectory(path);
         LogPrintf("Opening LevelDB in %s\n", path.string());
+
+        int nNice = std::max(0, std::min(19, (int)GetArg("-dbcompactionnice", DEFAULT_DB_COMPACTION_NICE)));
+        pcompactionenv = new CDBCompactionEnv(path.filename().string(), GetBoolArg("-dbparallelcompaction", DEFAULT_DB_PARALLEL_COMPACTION), nNice);
+        penv = pcompactionenv;
+        options.env = penv;
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -151,14 +307,20 @@ CDBWrapper::~CDBWrapper()
     options.info_log = NULL;
     delete options.block_cache;
     options.block_cache = NULL;
+    // After the database, it waits for the scheduled compaction on close
     delete penv;
+    penv = NULL;
+    pcompactionenv = NULL;
     options.env = NULL;
 }
 
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
+    int64_t nStart = GetTimeMicros();
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     dbwrapper_private::HandleError(status);
+    if (pcompactionenv)
+        pcompactionenv->WriteDone(GetTimeMicros() - nStart, fSync);
     return true;
 }
 
@@ -192,9 +354,25 @@ bool CDBWrapper::IsEmpty()
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
+void CDBIterator::SeekToLast() { piter->SeekToLast(); }
 void CDBIterator::Next() { piter->Next(); }
 void CDBIterator::Prev() { piter->Prev(); }
 
+void CDBIterator::GetRaw(std::vector<unsigned char>& vchKey, std::vector<unsigned char>& vchValue)
+{
+    leveldb::Slice slKey = piter->key();
+    leveldb::Slice slValue = piter->value();
+    vchKey.assign(slKey.data(), slKey.data() + slKey.size());
+    vchValue.assign(slValue.data(), slValue.data() + slValue.size());
+
+    const std::vector<unsigned char>& vchObfuscateKey = dbwrapper_private::GetObfuscateKey(parent);
+    if (!vchObfuscateKey.empty()) {
+        for (size_t i = 0; i < vchValue.size(); i++) {
+            vchValue[i] ^= vchObfuscateKey[i % vchObfuscateKey.size()];
+        }
+    }
+}
+
 namespace dbwrapper_private {
 
 void HandleError(const leveldb::Status& status)
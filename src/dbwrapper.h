@@ -20,6 +20,41 @@
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
+//! -dbcompression default, lets the databases which ask for it store their blocks Snappy compressed
+static const bool DEFAULT_DB_COMPRESSION = true;
+//! LevelDB's own block size
+static const size_t DEFAULT_DB_BLOCK_SIZE = 4 << 10;
+//! Open table files per database, unless init found more file descriptors to spare
+static const int DEFAULT_DB_MAX_OPEN_FILES = 64;
+//! LevelDB's own default, more open files don't help
+static const int MAX_DB_MAX_OPEN_FILES = 1000;
+//! Databases open at the same time: chainstate, blocks/index, indexes, rewards, votes and votingpower
+static const int MAX_DB_COUNT = 6;
+
+//! -dbparallelcompaction default, a compaction thread of its own for each database
+static const bool DEFAULT_DB_PARALLEL_COMPACTION = true;
+//! -dbcompactionnice default, the compaction threads run at normal priority
+static const int DEFAULT_DB_COMPACTION_NICE = 0;
+//! A write blocked this long waited for the compaction, the L0 stop trigger or a full memtable
+static const int64_t DB_WRITE_STALL_MICROS = 100000;
+//! Stalled writes of a database get logged at most once in this many seconds
+static const int64_t DB_STALL_LOG_INTERVAL = 60;
+
+/** Open table files of each database, set by init from the file descriptor limit. */
+extern int nDBMaxOpenFiles;
+
+/** LevelDB settings which depend on what a database stores. Compression
+ *  pays off for keys with long common prefixes and small values, larger
+ *  blocks for databases mostly read in ranges. */
+struct CDBOptions
+{
+    bool fCompression;
+    size_t nBlockSize;
+
+    CDBOptions(bool fCompressionIn = false, size_t nBlockSizeIn = DEFAULT_DB_BLOCK_SIZE) :
+        fCompression(fCompressionIn), nBlockSize(nBlockSizeIn) {}
+};
+
 class dbwrapper_error : public std::runtime_error
 {
 public:
@@ -131,6 +166,7 @@ public:
     bool Valid();
 
     void SeekToFirst();
+    void SeekToLast();
 
     template<typename K> void Seek(const K& key) {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
@@ -140,6 +176,15 @@ public:
         piter->Seek(slKey);
     }
 
+    /** Position at the last key which is not greater than key, for newest first walks with Prev(). */
+    template<typename K> void SeekForPrev(const K& key) {
+        Seek(key);
+        if (!Valid())
+            SeekToLast();
+        else if (CompareKey(key) > 0)
+            Prev();
+    }
+
     void Next();
     void Prev();
 
@@ -158,6 +203,15 @@ public:
         return piter->key().size();
     }
 
+    /** Compare the current key with key in the database's order, < 0 if the current key comes first. */
+    template<typename K> int CompareKey(const K& key) {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey << key;
+        leveldb::Slice slKey(ssKey.data(), ssKey.size());
+        return piter->key().compare(slKey);
+    }
+
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
@@ -174,8 +228,14 @@ public:
         return piter->value().size();
     }
 
+    /** The current key as stored and the deobfuscated value, for copying entries
+     *  without knowing their types. */
+    void GetRaw(std::vector<unsigned char>& vchKey, std::vector<unsigned char>& vchValue);
+
 };
 
+class CDBCompactionEnv;
+
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
@@ -183,6 +243,9 @@ private:
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
 
+    //! environment of a database on disk, runs its compactions and keeps its write stalls (NULL in memory)
+    CDBCompactionEnv* pcompactionenv;
+
     //! database options used
     leveldb::Options options;
 
@@ -220,8 +283,10 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] dbOptions   Compression and block size of the database.
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false,
+               const CDBOptions& dbOptions = CDBOptions());
     ~CDBWrapper();
 
     template <typename K, typename V>
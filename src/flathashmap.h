@@ -0,0 +1,296 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATHASHMAP_H
+#define BITCOIN_FLATHASHMAP_H
+
+#include "memusage.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash map which keeps its elements in one contiguous vector.
+ *
+ * Lookups go through an open addressing index (linear probing) which only
+ * stores the position of the element in the vector and a 32 bit fingerprint
+ * of its hash, so most probes never touch the keys. Iterating the map walks
+ * the dense element vector in insertion order (until the first erase).
+ *
+ * Differs from std::unordered_map in that any insert may invalidate all
+ * iterators, pointers and references to elements, and that erase moves the
+ * last element into the erased position.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K> >
+class CFlatHashMap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K, V> value_type;
+    typedef typename std::vector<value_type>::iterator iterator;
+    typedef typename std::vector<value_type>::const_iterator const_iterator;
+    typedef typename std::vector<value_type>::size_type size_type;
+
+private:
+    struct Bucket {
+        //! Position of the element in values plus one, 0 marks an empty bucket.
+        uint32_t nIndex;
+        uint32_t nHash;
+    };
+
+    static const size_t MIN_BUCKETS = 8;
+
+    std::vector<value_type> values;
+    std::vector<Bucket> buckets;
+    Hash hasher;
+    KeyEqual equal;
+
+    static uint32_t Fingerprint(size_t nHash)
+    {
+        uint64_t n = nHash;
+        return (uint32_t)(n ^ (n >> 32));
+    }
+
+    size_t Mask() const { return buckets.size() - 1; }
+
+    size_t HomeBucket(uint32_t nHash) const
+    {
+        // Spread the fingerprint since the low bits of the hashers used here are not
+        // necessarily well distributed.
+        return ((uint64_t)nHash * 0x9E3779B97F4A7C15ULL >> 32) & Mask();
+    }
+
+    /** Return the bucket holding key or, if there is none, the empty bucket where it belongs. */
+    size_t FindBucket(const K& key, uint32_t nHash) const
+    {
+        size_t nPos = HomeBucket(nHash);
+
+        while (true) {
+            const Bucket& bucket = buckets[nPos];
+            if (bucket.nIndex == 0 || (bucket.nHash == nHash && equal(values[bucket.nIndex - 1].first, key))) {
+                return nPos;
+            }
+            nPos = (nPos + 1) & Mask();
+        }
+    }
+
+    size_t FindBucketOfIndex(uint32_t nIndex, uint32_t nHash) const
+    {
+        size_t nPos = HomeBucket(nHash);
+
+        while (buckets[nPos].nIndex != nIndex) {
+            assert(buckets[nPos].nIndex != 0);
+            nPos = (nPos + 1) & Mask();
+        }
+
+        return nPos;
+    }
+
+    /** Smallest power of two bucket count which keeps the load factor of nElements below 3/4. */
+    static size_t BucketsFor(size_t nElements)
+    {
+        size_t nBuckets = MIN_BUCKETS;
+        while (nBuckets * 3 < nElements * 4 + 4) {
+            nBuckets <<= 1;
+        }
+        return nBuckets;
+    }
+
+    void Rehash(size_t nBuckets)
+    {
+        std::vector<Bucket> old(nBuckets, Bucket{0, 0});
+        old.swap(buckets);
+
+        for (const Bucket& bucket : old) {
+            if (bucket.nIndex != 0) {
+                size_t nPos = HomeBucket(bucket.nHash);
+                while (buckets[nPos].nIndex != 0) {
+                    nPos = (nPos + 1) & Mask();
+                }
+                buckets[nPos] = bucket;
+            }
+        }
+    }
+
+    /** Empty the bucket at nPos and shift the following buckets of the probe sequence back. */
+    void RemoveBucket(size_t nPos)
+    {
+        size_t nHole = nPos;
+        size_t nNext = (nPos + 1) & Mask();
+
+        while (buckets[nNext].nIndex != 0) {
+            size_t nHome = HomeBucket(buckets[nNext].nHash);
+            if (((nNext - nHome) & Mask()) >= ((nNext - nHole) & Mask())) {
+                buckets[nHole] = buckets[nNext];
+                nHole = nNext;
+            }
+            nNext = (nNext + 1) & Mask();
+        }
+
+        buckets[nHole] = Bucket{0, 0};
+    }
+
+    iterator Insert(size_t nPos, uint32_t nHash, value_type&& value)
+    {
+        values.push_back(std::move(value));
+        buckets[nPos] = Bucket{(uint32_t)values.size(), nHash};
+
+        if (BucketsFor(values.size()) > buckets.size()) {
+            Rehash(buckets.size() * 2);
+        }
+
+        return values.end() - 1;
+    }
+
+public:
+    CFlatHashMap() : buckets(MIN_BUCKETS, Bucket{0, 0}) {}
+
+    std::pair<iterator, bool> insert(const value_type& value)
+    {
+        uint32_t nHash = Fingerprint(hasher(value.first));
+        size_t nPos = FindBucket(value.first, nHash);
+
+        if (buckets[nPos].nIndex != 0) {
+            return std::make_pair(values.begin() + (buckets[nPos].nIndex - 1), false);
+        }
+
+        return std::make_pair(Insert(nPos, nHash, value_type(value)), true);
+    }
+
+    V& operator[](const K& key)
+    {
+        uint32_t nHash = Fingerprint(hasher(key));
+        size_t nPos = FindBucket(key, nHash);
+
+        if (buckets[nPos].nIndex != 0) {
+            return values[buckets[nPos].nIndex - 1].second;
+        }
+
+        return Insert(nPos, nHash, value_type(key, V()))->second;
+    }
+
+    iterator find(const K& key)
+    {
+        size_t nPos = FindBucket(key, Fingerprint(hasher(key)));
+        return buckets[nPos].nIndex != 0 ? values.begin() + (buckets[nPos].nIndex - 1) : values.end();
+    }
+
+    const_iterator find(const K& key) const
+    {
+        size_t nPos = FindBucket(key, Fingerprint(hasher(key)));
+        return buckets[nPos].nIndex != 0 ? values.cbegin() + (buckets[nPos].nIndex - 1) : values.cend();
+    }
+
+    V& at(const K& key)
+    {
+        iterator it = find(key);
+        if (it == values.end()) {
+            throw std::out_of_range("CFlatHashMap::at");
+        }
+        return it->second;
+    }
+
+    const V& at(const K& key) const
+    {
+        const_iterator it = find(key);
+        if (it == values.cend()) {
+            throw std::out_of_range("CFlatHashMap::at");
+        }
+        return it->second;
+    }
+
+    size_type count(const K& key) const
+    {
+        return buckets[FindBucket(key, Fingerprint(hasher(key)))].nIndex != 0 ? 1 : 0;
+    }
+
+    size_type erase(const K& key)
+    {
+        size_t nPos = FindBucket(key, Fingerprint(hasher(key)));
+
+        if (buckets[nPos].nIndex == 0) {
+            return 0;
+        }
+
+        uint32_t nIndex = buckets[nPos].nIndex;
+        RemoveBucket(nPos);
+
+        uint32_t nLast = values.size();
+        if (nIndex != nLast) {
+            size_t nMoved = FindBucketOfIndex(nLast, Fingerprint(hasher(values.back().first)));
+            buckets[nMoved].nIndex = nIndex;
+            values[nIndex - 1] = std::move(values.back());
+        }
+
+        values.pop_back();
+        return 1;
+    }
+
+    /** Make room for nElements without further rehashing. */
+    void reserve(size_t nElements)
+    {
+        values.reserve(nElements);
+        size_t nBuckets = BucketsFor(nElements);
+        if (nBuckets > buckets.size()) {
+            Rehash(nBuckets);
+        }
+    }
+
+    /** Remove all elements but keep the allocated storage. */
+    void clear()
+    {
+        values.clear();
+        std::fill(buckets.begin(), buckets.end(), Bucket{0, 0});
+    }
+
+    /** Release storage which is not required to hold max(size(), nKeep) elements. */
+    void shrink(size_t nKeep = 0)
+    {
+        size_t nElements = std::max(values.size(), nKeep);
+
+        if (values.capacity() > nElements) {
+            std::vector<value_type> tmp;
+            tmp.reserve(nElements);
+            std::move(values.begin(), values.end(), std::back_inserter(tmp));
+            values.swap(tmp);
+        }
+
+        size_t nBuckets = BucketsFor(nElements);
+        if (nBuckets < buckets.size()) {
+            Rehash(nBuckets);
+        }
+    }
+
+    void swap(CFlatHashMap& other)
+    {
+        values.swap(other.values);
+        buckets.swap(other.buckets);
+        std::swap(hasher, other.hasher);
+        std::swap(equal, other.equal);
+    }
+
+    bool empty() const { return values.empty(); }
+    size_type size() const { return values.size(); }
+    iterator begin() { return values.begin(); }
+    iterator end() { return values.end(); }
+    const_iterator begin() const { return values.begin(); }
+    const_iterator end() const { return values.end(); }
+    const_iterator cbegin() const { return values.cbegin(); }
+    const_iterator cend() const { return values.cend(); }
+
+    /** Heap usage of the map itself, memory owned by the elements is not included. */
+    size_t DynamicMemoryUsage() const
+    {
+        return memusage::MallocUsage(values.capacity() * sizeof(value_type)) + memusage::DynamicUsage(buckets);
+    }
+};
+
+#endif // BITCOIN_FLATHASHMAP_H
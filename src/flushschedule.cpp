@@ -0,0 +1,39 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flushschedule.h"
+
+#include <algorithm>
+
+CFlushSchedule::CFlushSchedule(int nBudgetPercent) : nLastEnd(0), nLastDuration(0)
+{
+    SetBudget(nBudgetPercent);
+}
+
+void CFlushSchedule::SetBudget(int nBudgetPercent)
+{
+    nBudget = std::min(std::max(nBudgetPercent, 1), 100);
+}
+
+double CFlushSchedule::Pressure(size_t nCoinsUsage, size_t nCoinsLimit, double nRewardsPressure)
+{
+    double nCoinsPressure = nCoinsLimit ? (double)nCoinsUsage / nCoinsLimit : 0;
+    return std::max(nCoinsPressure, nRewardsPressure);
+}
+
+int64_t CFlushSchedule::GetNextEarlyFlush() const
+{
+    return nLastEnd + nLastDuration * (100 - nBudget) / nBudget;
+}
+
+bool CFlushSchedule::IsEarlyFlushDue(double nPressure, int64_t nNow) const
+{
+    return nPressure >= FLUSH_EARLY_PRESSURE && nNow >= GetNextEarlyFlush();
+}
+
+void CFlushSchedule::Flushed(int64_t nStart, int64_t nEnd)
+{
+    nLastEnd = nEnd;
+    nLastDuration = std::max<int64_t>(nEnd - nStart, 0);
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_FLUSHSCHEDULE_H
+#define SMARTCASH_FLUSHSCHEDULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** -dbflushbudget default (percent of the time the early flushes may keep the databases busy) */
+static const int DEFAULT_DB_FLUSH_BUDGET = 10;
+/** Share of its limit from which a cache gets written out between the blocks instead of waiting for it to fill up */
+static const double FLUSH_EARLY_PRESSURE = 0.9;
+
+/**
+ * Decides when FlushStateToDisk writes the coins and the rewards cache. Both
+ * get written together so the chainstate and the rewards database on disk
+ * describe the same block, and either one reaching its limit forced a full
+ * flush of both in the middle of connecting a block.
+ *
+ * The fuller of the two sets the pressure. Once it gets close to its limit
+ * the next call between the blocks flushes early, as long as the budget
+ * allows it: after a flush which took d the databases have to be idle for
+ * d * (100 - budget) / budget before the next early one. Flushes which are
+ * due anyway don't wait for the budget, they are the reason for it.
+ */
+class CFlushSchedule
+{
+    int nBudget;
+    //! Microseconds, 0 before the first flush
+    int64_t nLastEnd;
+    int64_t nLastDuration;
+
+public:
+    explicit CFlushSchedule(int nBudgetPercent = DEFAULT_DB_FLUSH_BUDGET);
+
+    /** Clamped to 1 to 100 percent */
+    void SetBudget(int nBudgetPercent);
+    int GetBudget() const { return nBudget; }
+
+    /** The share of its limit the fuller cache uses, 0 for the coins if there is no limit */
+    static double Pressure(size_t nCoinsUsage, size_t nCoinsLimit, double nRewardsPressure);
+
+    /** Time in microseconds from which an early flush fits the budget */
+    int64_t GetNextEarlyFlush() const;
+    /** Whether a call at nNow between the blocks should flush at nPressure */
+    bool IsEarlyFlushDue(double nPressure, int64_t nNow) const;
+
+    /** Record a flush of the caches which ran from nStart to nEnd */
+    void Flushed(int64_t nStart, int64_t nEnd);
+};
+
+#endif // SMARTCASH_FLUSHSCHEDULE_H
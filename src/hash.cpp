@@ -5,6 +5,7 @@
 #include "hash.h"
 #include "crypto/common.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/keccak256.h"
 #include "pubkey.h"
 
 
@@ -102,6 +103,7 @@ CSipHasher::CSipHasher(uint64_t k0, uint64_t k1)
     v[2] = 0x6c7967656e657261ULL ^ k0;
     v[3] = 0x7465646279746573ULL ^ k1;
     count = 0;
+    tmp = 0;
 }
 
 CSipHasher& CSipHasher::Write(uint64_t data)
@@ -246,3 +248,9 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+void HashKeccakMany(uint256* output, const unsigned char* input, size_t count)
+{
+    static_assert(sizeof(uint256) == 32, "uint256 has to be the bare hash");
+    Keccak256_80(reinterpret_cast<unsigned char*>(output), input, count);
+}
@@ -141,6 +141,10 @@ inline uint256 HashKeccak(const T1 pbegin, const T1 pend)
     return hash;
 }        }
 
+/** Keccak-256 of count 80 byte inputs laid out one after another, the block headers the way
+ *  HashKeccak gets them. Several get hashed at once where the CPU supports it. */
+void HashKeccakMany(uint256* output, const unsigned char* input, size_t count);
+
 template<typename T1, typename T2>
 inline uint256 Hash4(const T1 p1begin, const T1 p1end,
                     const T2 p2begin, const T2 p2end)
@@ -112,6 +112,8 @@ public:
 
     uint256 GetSeedHash();
     void DeriveChildExtKey(uint32_t nAccountIndex, bool fInternal, uint32_t nChildIndex, CExtKey& extKeyRet);
+    //! The key at m/purpose'/coin_type'/account'/change, the parent of the keys of DeriveChildExtKey
+    void DeriveChangeExtKey(uint32_t nAccountIndex, bool fInternal, CExtKey& extKeyRet);
 
     void AddAccount();
     bool GetAccount(uint32_t nAccountIndex, CHDAccount& hdAccountRet);
@@ -61,6 +61,46 @@ private:
 };
 
 
+/** Streams the result of a single request with chunked transfer encoding,
+ * see CRPCResultStream. Set for the thread while it exists.
+ */
+class HTTPRPCStreamSink : public RPCStreamSink
+{
+public:
+    HTTPRPCStreamSink(HTTPRequest* req) : req(req), fStarted(false)
+    {
+        SetRPCStreamSink(this);
+    }
+    ~HTTPRPCStreamSink()
+    {
+        SetRPCStreamSink(NULL);
+    }
+    void Write(const std::string& strJSON)
+    {
+        if (!fStarted) {
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReplyStart(HTTPStatus::OK);
+            req->WriteReplyChunk("{\"result\":" + strJSON);
+            fStarted = true;
+            return;
+        }
+        req->WriteReplyChunk(strJSON);
+    }
+    bool IsStarted() const
+    {
+        return fStarted;
+    }
+    /** The rest of the reply after the result, like JSONRPCReply */
+    void Finish(const UniValue& id)
+    {
+        req->WriteReplyChunk(",\"error\":null,\"id\":" + id.write() + "}\n");
+        req->WriteReplyEnd();
+    }
+private:
+    HTTPRequest* req;
+    bool fStarted;
+};
+
 /* Pre-base64-encoded authentication token */
 static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
@@ -184,14 +224,20 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            HTTPRPCStreamSink sink(req);
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
+            if (sink.IsStarted()) {
+                sink.Finish(jreq.id);
+                return true;
+            }
+
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            strReply = JSONRPCExecBatch(valRequest.get_array(), HTTPWorkerCount() - 1, &HTTPEnqueue);
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
@@ -9,6 +9,7 @@
 #include "util.h"
 #include "netbase.h"
 #include "rpc/protocol.h" // For HTTP status codes
+#include "taskpool.h"
 #include "ui_interface.h"
 
 #include <stdio.h>
@@ -17,6 +18,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <signal.h>
 
 #include <event2/event.h>
@@ -47,8 +49,8 @@ static struct event_base* eventBase = 0;
 struct evhttp* eventHTTP = 0;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure>* workQueue = 0;
+//! Work queue for handling longer requests off the event loop thread, on the shared task pool
+static CTaskQueue* workQueue = 0;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
@@ -158,11 +160,9 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
-        std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler));
+        std::shared_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler));
         assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
-            item.release(); /* if true, queue took ownership */
-        else {
+        if (!workQueue->Enqueue([item]() { (*item)(); })) {
             LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
             item->req->WriteReply(HTTPStatus::INTERNAL_SERVER_ERROR, "Work queue depth exceeded");
         }
@@ -227,13 +227,6 @@ static bool HTTPBindAddresses(struct evhttp* http)
     return !boundSockets.empty();
 }
 
-/** Simple wrapper to set thread name and run work queue */
-static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
-{
-    RenameThread("smartcash-httpworker");
-    queue->Run();
-}
-
 /** libevent event log callback */
 static void libevent_log_cb(int severity, const char *msg)
 {
@@ -306,28 +299,33 @@ bool InitHTTPServer()
 
     LogPrint("http", "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
+    LogPrintf("HTTP: creating work queue of depth %d running up to %d requests at a time\n", workQueueDepth, rpcThreads);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    workQueue = new CTaskQueue(taskPool, CTaskPool::PRIORITY_HIGH, workQueueDepth, rpcThreads);
     eventBase = base;
     eventHTTP = http;
     return true;
 }
 
 boost::thread threadHTTP;
-static std::vector<boost::thread> threadHTTPWorkers;
+
+bool HTTPEnqueue(const boost::function<void ()>& func)
+{
+    if (!workQueue)
+        return false;
+    return workQueue->Enqueue(func);
+}
+
+int HTTPWorkerCount()
+{
+    return workQueue ? workQueue->MaxRunning() : 0;
+}
 
 bool StartHTTPServer()
 {
     LogPrint("http", "Starting HTTP server\n");
-    int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
     threadHTTP = boost::thread(boost::bind(&ThreadHTTP, eventBase, eventHTTP));
-
-    for (int i = 0; i < rpcThreads; i++) {
-        threadHTTPWorkers.emplace_back(boost::bind(&HTTPWorkQueueRun, workQueue));
-    }
-
     return true;
 }
 
@@ -350,11 +348,7 @@ void StopHTTPServer()
 {
     LogPrint("http", "Stopping HTTP server\n");
     if (workQueue) {
-        LogPrint("http", "Waiting for HTTP worker threads to exit\n");
-        for (auto &thread : threadHTTPWorkers) {
-            thread.join();
-        }
-        threadHTTPWorkers.clear();
+        LogPrint("http", "Waiting for HTTP requests to finish\n");
         workQueue->WaitExit();
         delete workQueue;
         workQueue = nullptr;
@@ -420,12 +414,17 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       replyStarted(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (replyStarted && !replySent) {
+        // The status is out already, just finish the body
+        LogPrintf("%s: Unfinished reply\n", __func__);
+        WriteReplyEnd();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTPStatus::INTERNAL_SERVER_ERROR, "Unhandled request");
@@ -464,6 +463,34 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+const char* HTTPRequest::PeekBody(size_t& nSize)
+{
+    nSize = 0;
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return NULL;
+    size_t size = evbuffer_get_length(buf);
+    const char* data = (const char*)evbuffer_pullup(buf, size);
+    if (data)
+        nSize = size;
+    return data;
+}
+
+size_t HTTPRequest::GetBodySize()
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    return buf ? evbuffer_get_length(buf) : 0;
+}
+
+size_t HTTPRequest::ReadBody(char* pch, size_t nSize)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf || !nSize)
+        return 0;
+    int nRead = evbuffer_remove(buf, pch, nSize);
+    return nRead > 0 ? nRead : 0;
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -476,8 +503,26 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  * Replies must be sent in the main loop in the main http thread,
  * this cannot be done from worker threads.
  */
+void HTTPRequest::SetConnectionTimeout(int nSeconds)
+{
+    assert(!replySent && req);
+    struct evhttp_connection* con = evhttp_request_get_connection(req);
+    if (!con)
+        return;
+    // Like the reply, applied by the main http thread
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(evhttp_connection_set_timeout, con, nSeconds));
+    ev->trigger(0);
+}
+
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
+    if (replyStarted && !replySent) {
+        // Too late for another status, e.g. an error in the middle of a chunked reply
+        LogPrintf("%s: Reply already started, dropping status %d\n", __func__, nStatus);
+        WriteReplyEnd();
+        return;
+    }
     assert(!replySent && req);
     // Send event to main http thread to send reply message
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
@@ -490,6 +535,66 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+bool HTTPRequest::AddReplyFile(const std::string& strPath, int64_t nOffset, int64_t nLength)
+{
+    assert(!replySent && !replyStarted && req);
+    int nFlags = O_RDONLY;
+#ifdef WIN32
+    nFlags |= O_BINARY;
+#endif
+    int fd = open(strPath.c_str(), nFlags);
+    if (fd < 0) {
+        LogPrintf("%s: Can't open %s\n", __func__, strPath);
+        return false;
+    }
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    // On success the buffer owns the file descriptor and closes it once sent
+    if (evbuffer_add_file(evb, fd, nOffset, nLength) != 0) {
+        LogPrintf("%s: Can't add %s to the reply\n", __func__, strPath);
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+static void http_send_reply_chunk(struct evhttp_request* req, struct evbuffer* evb)
+{
+    evhttp_send_reply_chunk(req, evb);
+    evbuffer_free(evb);
+}
+
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && !replyStarted && req);
+    // The events get handled in the order they were triggered
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(evhttp_send_reply_start, req, nStatus, (const char*)NULL));
+    ev->trigger(0);
+    replyStarted = true;
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && replyStarted && req);
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, strChunk.data(), strChunk.size());
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(http_send_reply_chunk, req, evb));
+    ev->trigger(0);
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(!replySent && replyStarted && req);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(evhttp_send_reply_end, req));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
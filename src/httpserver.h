@@ -45,6 +45,13 @@ void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPR
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Run func as an HTTP work item on the task pool.
+ * Returns false if the work queue is full.
+ */
+bool HTTPEnqueue(const boost::function<void ()>& func);
+/** Number of HTTP work items running at the same time, -rpcthreads */
+int HTTPWorkerCount();
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -58,6 +65,7 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool replyStarted;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -98,6 +106,27 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Contiguous view of the body which wasn't read yet, nSize gets its length.
+     *
+     * @note Doesn't consume the buffer, the view stays valid until the body gets read
+     * or the request replied to. Only copies if the body arrived in several chunks.
+     * @return NULL for an empty body.
+     */
+    const char* PeekBody(size_t& nSize);
+
+    /** Get the number of body bytes which weren't read yet.
+     */
+    size_t GetBodySize();
+
+    /**
+     * Read up to nSize bytes of the body into pch without an intermediate copy.
+     *
+     * @note Consumes the read part of the underlying buffer.
+     * @return the number of bytes read.
+     */
+    size_t ReadBody(char* pch, size_t nSize);
+
     /**
      * Write output header.
      *
@@ -105,6 +134,12 @@ public:
      */
     void WriteHeader(const std::string& hdr, const std::string& value);
 
+    /**
+     * Set the read and write timeout of the connection of the request in seconds,
+     * e.g. for a request which waits longer than the server timeout for its reply.
+     */
+    void SetConnectionTimeout(int nSeconds);
+
     /**
      * Write HTTP reply.
      * nStatus is the HTTP status code to send.
@@ -114,6 +149,25 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Add nLength bytes of the file at strPath from nOffset to the body of the reply, in
+     * front of the one passed to WriteReply. libevent sends them with sendfile or mmap,
+     * they don't get copied into memory.
+     * Returns false if the file can't be opened, nothing was added then.
+     */
+    bool AddReplyFile(const std::string& strPath, int64_t nOffset, int64_t nLength);
+
+    /**
+     * Write a HTTP reply in chunks with chunked transfer encoding.
+     * WriteReplyStart sends the status and the headers, every WriteReplyChunk a part
+     * of the body and WriteReplyEnd finishes the reply.
+     *
+     * @note As WriteReply, WriteReplyEnd gives the request back to the main thread.
+     */
+    void WriteReplyStart(int nStatus);
+    void WriteReplyChunk(const std::string& strChunk);
+    void WriteReplyEnd();
 };
 
 /** Event handler closure.
@@ -145,104 +199,6 @@ private:
     HTTPRequestHandler func;
 };
 
-
-/** Simple work queue for distributing work over multiple threads.
- * Work items are simply callable objects.
- */
-template <typename WorkItem>
-class WorkQueue
-{
-private:
-    /** Mutex protects entire object */
-    CWaitableCriticalSection cs;
-    CConditionVariable cond;
-    std::deque<std::unique_ptr<WorkItem>> queue;
-    bool running;
-    size_t maxDepth;
-    int numThreads;
-
-    /** RAII object to keep track of number of running worker threads */
-    class ThreadCounter
-    {
-    public:
-        WorkQueue &wq;
-        ThreadCounter(WorkQueue &w): wq(w)
-        {
-            boost::lock_guard<boost::mutex> lock(wq.cs);
-            wq.numThreads += 1;
-        }
-        ~ThreadCounter()
-        {
-            boost::lock_guard<boost::mutex> lock(wq.cs);
-            wq.numThreads -= 1;
-            wq.cond.notify_all();
-        }
-    };
-
-public:
-    WorkQueue(size_t maxDepth) : running(true),
-                                 maxDepth(maxDepth),
-                                 numThreads(0)
-    {
-    }
-    /** Precondition: worker threads have all stopped
-     * (call WaitExit)
-     */
-    ~WorkQueue()
-    {
-    }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
-    {
-        boost::unique_lock<boost::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
-            return false;
-        }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
-        cond.notify_one();
-        return true;
-    }
-    /** Thread function */
-    void Run()
-    {
-        ThreadCounter count(*this);
-        while (running) {
-            std::unique_ptr<WorkItem> i;
-            {
-                boost::unique_lock<boost::mutex> lock(cs);
-                while (running && queue.empty())
-                    cond.wait(lock);
-                if (!running)
-                    break;
-                i = std::move(queue.front());
-                queue.pop_front();
-            }
-            (*i)();
-        }
-    }
-    /** Interrupt and exit loops */
-    void Interrupt()
-    {
-        boost::unique_lock<boost::mutex> lock(cs);
-        running = false;
-        cond.notify_all();
-    }
-    /** Wait for worker threads to exit */
-    void WaitExit()
-    {
-        boost::unique_lock<boost::mutex> lock(cs);
-        while (numThreads > 0)
-            cond.wait(lock);
-    }
-
-    /** Return current depth of queue */
-    size_t Depth()
-    {
-        boost::unique_lock<boost::mutex> lock(cs);
-        return queue.size();
-    }
-};
-
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
@@ -0,0 +1,354 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "indexbuilder.h"
+
+#include "blockfilter.h"
+#include "blockscripts.h"
+#include "chainparams.h"
+#include "spentindex.h"
+#include "tinyformat.h"
+#include "txdb.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+CIndexBuilder indexBuilder;
+
+static const std::pair<IndexBuilderIndex, const char*> vecIndexFlags[] = {
+    std::make_pair(INDEX_BUILD_TIMESTAMP, "timestampindex"),
+    std::make_pair(INDEX_BUILD_SPENT, "spentindex"),
+    std::make_pair(INDEX_BUILD_DEPOSIT, "depositindex"),
+    std::make_pair(INDEX_BUILD_PAYOUT, "payoutindex"),
+    std::make_pair(INDEX_BUILD_BLOCKFILTER, "blockfilterindex"),
+};
+
+struct CIndexBuilderBlock
+{
+    const CBlockIndex* pindex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vecSpent;
+    std::vector<std::pair<CDepositIndexKey, CDepositValue> > vecDeposits;
+    std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > vecPayouts;
+    CBlockFilter filter;
+};
+
+static bool ReadIndexEntries(const CBlockIndex* pindex, const CDiskBlockPos& undoPos, int nIndexes, CIndexBuilderBlock& entries)
+{
+    CBlock block;
+    CBlockUndo blockUndo;
+
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+        return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+
+    // The genesis block has no undo data, its coinbase is the only transaction
+    if (pindex->pprev) {
+        if (undoPos.IsNull() || !UndoReadFromDisk(blockUndo, undoPos, pindex->pprev->GetBlockHash()))
+            return error("%s: failed to read the undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+        if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+            return error("%s: undo data of block %s doesn't match", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    entries.pindex = pindex;
+
+    if (nIndexes & INDEX_BUILD_PAYOUT)
+        GetPayoutIndexEntries(*block.vtx[0], pindex->nHeight, entries.vecPayouts);
+
+    if (nIndexes & INDEX_BUILD_BLOCKFILTER)
+        entries.filter = CBlockFilter(BLOCK_FILTER_BASIC, block, blockUndo);
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *block.vtx[i];
+        const uint256 txhash = tx.GetHash();
+        std::map<std::pair<uint160, int>, CAmount> mapInputs;
+        std::map<std::pair<uint160, int>, CAmount> mapOutputs;
+        uint160 hashBytes;
+
+        // Zerocoin spends don't spend coins, they have no undo entries either
+        if (!tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
+            const CTxUndo &txundo = blockUndo.vtxundo[i - 1];
+
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s: undo data of transaction %s doesn't match", __func__, txhash.ToString());
+
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CTxOut &prevout = txundo.vprevout[j].out;
+                int nType = GetIndexAddress(prevout.scriptPubKey, hashBytes);
+
+                if ((nIndexes & INDEX_BUILD_DEPOSIT) && nType)
+                    mapInputs[std::make_pair(hashBytes, nType)] += prevout.nValue;
+
+                if (nIndexes & INDEX_BUILD_SPENT)
+                    entries.vecSpent.push_back(std::make_pair(CSpentIndexKey(tx.vin[j].prevout.hash, tx.vin[j].prevout.n),
+                                                              CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, nType, hashBytes)));
+            }
+        }
+
+        if (!(nIndexes & INDEX_BUILD_DEPOSIT))
+            continue;
+
+        for (const CTxOut &out : tx.vout) {
+            int nType = GetIndexAddress(out.scriptPubKey, hashBytes);
+            if (nType)
+                mapOutputs[std::make_pair(hashBytes, nType)] += out.nValue;
+        }
+
+        // What an address received beyond what it spent in the transaction
+        for (const auto &output : mapOutputs) {
+            auto input = mapInputs.find(output.first);
+            CAmount nDeposit = input == mapInputs.end() ? output.second : output.second - input->second;
+
+            if (nDeposit > 0)
+                entries.vecDeposits.push_back(std::make_pair(CDepositIndexKey(output.first.second, output.first.first, block.nTime, txhash),
+                                                             CDepositValue(nDeposit, pindex->nHeight)));
+        }
+    }
+
+    return true;
+}
+
+bool CIndexBuilder::Init(int nIndexesIn, int nTipHeight)
+{
+    AssertLockHeld(cs_main);
+
+    int nStoredIndexes = 0;
+    int nStoredHeight = 0;
+    bool fStored = pblocktree->ReadIndexBuildProgress(nStoredIndexes, nStoredHeight);
+
+    boost::lock_guard<boost::mutex> lock(cs);
+
+    nIndexes = nIndexesIn;
+    nTargetHeight = nTipHeight;
+    nNextHeight = 0;
+    mapDone.clear();
+
+    if (!nIndexes) {
+        nNextUnit = 0;
+        return !fStored || pblocktree->EraseIndexBuildProgress();
+    }
+
+    // An index added since needs all blocks again
+    if (fStored && nStoredIndexes == nIndexes)
+        nNextHeight = nStoredHeight;
+
+    nNextUnit = nNextHeight;
+
+    CDBBatch batch(pblocktree->IndexDB());
+    pblocktree->WriteIndexBuildProgress(batch, nIndexes, nNextHeight);
+    if (!pblocktree->IndexDB().WriteBatch(batch))
+        return error("%s: failed to write the progress", __func__);
+
+    LogPrintf("%s: building the indexes 0x%x from height %d to %d in the background\n", __func__, nIndexes, nNextHeight, nTargetHeight);
+    return true;
+}
+
+void CIndexBuilder::Start(boost::thread_group& threadGroup)
+{
+    boost::lock_guard<boost::mutex> lock(cs);
+
+    if (fStarted || !nIndexes)
+        return;
+
+    fStarted = true;
+    nThreads = std::max(1, std::min(GetNumCores(), MAX_INDEX_BUILDER_THREADS));
+
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&CIndexBuilder::Thread, this));
+}
+
+bool CIndexBuilder::NextUnit(int &nStart, int &nEnd)
+{
+    LOCK(cs_main);
+    boost::lock_guard<boost::mutex> lock(cs);
+
+    if (fFailed || nNextUnit > nTargetHeight)
+        return false;
+
+    nStart = nEnd = nNextUnit;
+
+    // Keep to one blk file so the thread reads it front to back
+    const CBlockIndex* pindexStart = chainActive[nStart];
+
+    while (pindexStart && nEnd < nTargetHeight && nEnd - nStart + 1 < INDEX_BUILDER_UNIT_BLOCKS) {
+        const CBlockIndex* pindexNext = chainActive[nEnd + 1];
+        if (!pindexNext || pindexNext->nFile != pindexStart->nFile)
+            break;
+        ++nEnd;
+    }
+
+    nNextUnit = nEnd + 1;
+    return true;
+}
+
+bool CIndexBuilder::BuildUnit(int nStart, int nEnd)
+{
+    int nBuildIndexes;
+    {
+        boost::lock_guard<boost::mutex> lock(cs);
+        nBuildIndexes = nIndexes;
+    }
+
+    std::vector<CIndexBuilderBlock> vecBlocks;
+    vecBlocks.reserve(nEnd - nStart + 1);
+
+    for (int nHeight = nStart; nHeight <= nEnd; nHeight++) {
+        boost::this_thread::interruption_point();
+
+        const CBlockIndex* pindex;
+        CDiskBlockPos undoPos;
+        {
+            LOCK(cs_main);
+            // The chain got shorter, ConnectBlock indexes what comes at the height
+            pindex = chainActive[nHeight];
+            if (!pindex)
+                continue;
+            undoPos = pindex->GetUndoPos();
+        }
+
+        vecBlocks.push_back(CIndexBuilderBlock());
+        if (!ReadIndexEntries(pindex, undoPos, nBuildIndexes, vecBlocks.back()))
+            return false;
+    }
+
+    int nIndexesBuilt = 0;
+    {
+        LOCK(cs_main);
+
+        CDBBatch batch(pblocktree->IndexDB());
+        // Written at once, the deposit counts of the batch are summed up in one call
+        std::vector<std::pair<CDepositIndexKey, CDepositValue> > vecDeposits;
+
+        for (const CIndexBuilderBlock &entries : vecBlocks) {
+            // Disconnected meanwhile, DisconnectBlock didn't find entries to remove then and
+            // the block connected at the height since got indexed by ConnectBlock.
+            if (!chainActive.Contains(entries.pindex))
+                continue;
+
+            if (nBuildIndexes & INDEX_BUILD_TIMESTAMP)
+                pblocktree->WriteTimestampIndex(batch, CTimestampIndexKey(entries.pindex->nTime, entries.pindex->GetBlockHash()));
+            if (nBuildIndexes & INDEX_BUILD_SPENT)
+                pblocktree->UpdateSpentIndex(batch, entries.vecSpent);
+            if (nBuildIndexes & INDEX_BUILD_DEPOSIT)
+                vecDeposits.insert(vecDeposits.end(), entries.vecDeposits.begin(), entries.vecDeposits.end());
+            if (nBuildIndexes & INDEX_BUILD_PAYOUT)
+                pblocktree->WritePayoutIndex(batch, entries.vecPayouts);
+            if (nBuildIndexes & INDEX_BUILD_BLOCKFILTER)
+                pblocktree->WriteBlockFilter(batch, entries.filter);
+        }
+
+        if (!vecDeposits.empty())
+            pblocktree->WriteDepositIndex(batch, vecDeposits);
+
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+
+            mapDone[nStart] = nEnd;
+            while (!mapDone.empty() && mapDone.begin()->first == nNextHeight) {
+                nNextHeight = mapDone.begin()->second + 1;
+                mapDone.erase(mapDone.begin());
+            }
+
+            pblocktree->WriteIndexBuildProgress(batch, nIndexes, nNextHeight);
+
+            if (nNextHeight > nTargetHeight)
+                nIndexesBuilt = nIndexes;
+        }
+
+        if (!pblocktree->IndexDB().WriteBatch(batch))
+            return error("%s: failed to write the entries of the heights %d to %d", __func__, nStart, nEnd);
+
+        if (nIndexesBuilt) {
+            if ((nIndexesBuilt & INDEX_BUILD_BLOCKFILTER) && !BuildBlockFilterHeaders())
+                return false;
+
+            // The flags live in the block database, set them before the progress goes.
+            for (const auto &flag : vecIndexFlags) {
+                if ((nIndexesBuilt & flag.first) && !pblocktree->WriteFlag(flag.second, true))
+                    return error("%s: failed to write the %s flag", __func__, flag.second);
+            }
+
+            if (!pblocktree->EraseIndexBuildProgress())
+                return error("%s: failed to erase the progress", __func__);
+
+            boost::lock_guard<boost::mutex> lock(cs);
+            nIndexes = 0;
+        }
+    }
+
+    if (nIndexesBuilt)
+        LogPrintf("CIndexBuilder::BuildUnit -- Indexes 0x%x built up to height %d\n", nIndexesBuilt, nEnd);
+
+    return true;
+}
+
+bool CIndexBuilder::BuildBlockFilterHeaders()
+{
+    AssertLockHeld(cs_main);
+
+    int64_t nStart = GetTimeMillis();
+    uint256 prevHeader;
+    CDBBatch batch(pblocktree->IndexDB());
+
+    // Also the blocks connected since the build started, ConnectBlock had
+    // no header of the previous block to chain theirs to.
+    for (const CBlockIndex* pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex)) {
+        uint256 hashFilter;
+        if (!pblocktree->ReadBlockFilterHash(pindex->GetBlockHash(), hashFilter))
+            return error("%s: no filter for block %s at height %d", __func__, pindex->GetBlockHash().ToString(), pindex->nHeight);
+
+        prevHeader = ComputeBlockFilterHeader(hashFilter, prevHeader);
+        pblocktree->WriteBlockFilterHeader(batch, pindex->GetBlockHash(), prevHeader);
+
+        if ((pindex->nHeight + 1) % INDEX_BUILDER_HEADER_BATCH == 0) {
+            if (!pblocktree->IndexDB().WriteBatch(batch))
+                return error("%s: failed to write the filter headers up to height %d", __func__, pindex->nHeight);
+            batch.Clear();
+        }
+    }
+
+    if (!pblocktree->IndexDB().WriteBatch(batch))
+        return error("%s: failed to write the filter headers", __func__);
+
+    LogPrintf("CIndexBuilder::BuildBlockFilterHeaders -- Chained the filter headers up to height %d in %dms\n", chainActive.Height(), GetTimeMillis() - nStart);
+    return true;
+}
+
+void CIndexBuilder::Thread()
+{
+    RenameThread("smartcash-idxbuild");
+
+    int nStart, nEnd;
+
+    while (NextUnit(nStart, nEnd)) {
+        if (!BuildUnit(nStart, nEnd)) {
+            LogPrintf("CIndexBuilder::Thread -- Failed to build the indexes for the heights %d to %d, restart to try again\n", nStart, nEnd);
+            boost::lock_guard<boost::mutex> lock(cs);
+            fFailed = true;
+            return;
+        }
+    }
+}
+
+bool CIndexBuilder::IsReady(IndexBuilderIndex index) const
+{
+    boost::lock_guard<boost::mutex> lock(cs);
+    return !(nIndexes & index);
+}
+
+std::string CIndexBuilder::GetStatus() const
+{
+    boost::lock_guard<boost::mutex> lock(cs);
+
+    if (!nIndexes)
+        return "Indexes ready";
+
+    if (fFailed)
+        return "Index build failed, restart the node to continue";
+
+    return strprintf("Index syncing, height %d of %d", nNextHeight, nTargetHeight);
+}
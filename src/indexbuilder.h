@@ -0,0 +1,91 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_INDEXBUILDER_H
+#define SMARTCASH_INDEXBUILDER_H
+
+#include <map>
+#include <string>
+
+#include <boost/thread/mutex.hpp>
+
+namespace boost {
+    class thread_group;
+}
+
+//! Indexes the builder can create from the blocks on disk
+enum IndexBuilderIndex {
+    INDEX_BUILD_TIMESTAMP = 1,
+    INDEX_BUILD_SPENT = 2,
+    INDEX_BUILD_DEPOSIT = 4,
+    INDEX_BUILD_PAYOUT = 8,
+    INDEX_BUILD_BLOCKFILTER = 16,
+};
+
+//! Upper limit of the builder threads
+static const int MAX_INDEX_BUILDER_THREADS = 4;
+//! Most blocks a builder thread reads before writing their entries
+static const int INDEX_BUILDER_UNIT_BLOCKS = 500;
+//! Block filter headers written in one batch once the filters are built
+static const int INDEX_BUILDER_HEADER_BATCH = 10000;
+
+/**
+ * Builds the timestamp, spent, deposit, payout and block filter indexes of
+ * the blocks which got connected before the index was enabled, in place of a
+ * -reindex.
+ *
+ * The blocks up to the tip at startup get split into runs of consecutive
+ * heights stored in the same blk file. The threads read them with their undo
+ * data, so the spent prevouts don't need the chainstate, and write the
+ * entries of a run in one batch. The blocks connected meanwhile get indexed
+ * by ConnectBlock as usual.
+ *
+ * All heights below the resume height are done, it is stored along with the
+ * entries, the build continues there after a restart. Once it reaches the tip
+ * the flags of the indexes get set, they count as ready then.
+ *
+ * The header of a block filter commits to the one of the previous block, so
+ * the filter headers can't be built out of order. They get chained in one
+ * pass from the genesis block up to the tip when the filters are done.
+ */
+class CIndexBuilder
+{
+    mutable boost::mutex cs;
+
+    //! IndexBuilderIndex flags of the indexes being built
+    int nIndexes;
+    //! Heights below are done
+    int nNextHeight;
+    //! First height no thread took yet
+    int nNextUnit;
+    int nTargetHeight;
+    //! Written runs above nNextHeight, start to end
+    std::map<int, int> mapDone;
+    bool fStarted;
+    bool fFailed;
+    int nThreads;
+
+    bool NextUnit(int &nStart, int &nEnd);
+    bool BuildUnit(int nStart, int nEnd);
+    bool BuildBlockFilterHeaders();
+    void Finish();
+    void Thread();
+
+public:
+    CIndexBuilder() : nIndexes(0), nNextHeight(0), nNextUnit(0), nTargetHeight(-1),
+                      fStarted(false), fFailed(false), nThreads(0) {}
+
+    /** Set up the build of the indexes for the blocks up to nTipHeight, or drop
+     *  a previous one if nIndexesIn is 0. Requires cs_main. */
+    bool Init(int nIndexesIn, int nTipHeight);
+    void Start(boost::thread_group& threadGroup);
+
+    //! False while the index is enabled but not built up to the tip yet
+    bool IsReady(IndexBuilderIndex index) const;
+    std::string GetStatus() const;
+};
+
+extern CIndexBuilder indexBuilder;
+
+#endif // SMARTCASH_INDEXBUILDER_H
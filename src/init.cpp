@@ -12,13 +12,18 @@
 #include "addrman.h"
 #include "amount.h"
 #include "base58.h"
+#include "blockfilter.h"
+#include "blockjournal.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/keccak256.h"
+#include "crypto/sha512.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "indexbuilder.h"
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
@@ -34,6 +39,8 @@
 #include "script/standard.h"
 #include "script/sigcache.h"
 #include "scheduler.h"
+#include "taskpool.h"
+#include "maintenance.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "torcontrol.h"
@@ -76,6 +83,8 @@
 
 #include "sapi/sapi.h"
 
+#include <atomic>
+#include <functional>
 #include <stdint.h>
 #include <stdio.h>
 #include <memory>
@@ -97,7 +106,9 @@
 #include <openssl/crypto.h>
 
 #if ENABLE_ZMQ
+#include "zmq/zmqabstractnotifier.h"
 #include "zmq/zmqnotificationinterface.h"
+#include "zmq/zmqrpc.h"
 #endif
 
 using namespace std;
@@ -113,6 +124,10 @@ CWallet* pwalletMain = NULL;
 #endif
 bool fFeeEstimatesInitialized = false;
 bool fRestartRequested = false;  // true: restart false: shutdown
+// Set once mempool.dat got loaded, a mempool only partly loaded doesn't get dumped
+static std::atomic<bool> fDumpMempoolLater(false);
+// Set once the smartnode caches got loaded, the InstantSend votes of mempool.dat need the smartnode list
+static std::atomic<bool> fSmartnodeCachesLoaded(false);
 static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
 static const bool DEFAULT_DISABLE_SAFEMODE = false;
@@ -121,10 +136,6 @@ static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 std::unique_ptr<CConnman> g_connman;
 std::unique_ptr<PeerLogicValidation> peerLogic;
 
-#if ENABLE_ZMQ
-static CZMQNotificationInterface* pzmqNotificationInterface = NULL;
-#endif
-
 static CDSNotificationInterface* pdsNotificationInterface = NULL;
 
 #ifdef WIN32
@@ -210,6 +221,15 @@ public:
             abort();
         }
     }
+    void GetCoins(const std::vector<COutPoint> &vOutpoints, std::vector<Coin> &vCoins) const override {
+        try {
+            base->GetCoins(vOutpoints, vCoins);
+        } catch(const std::runtime_error& e) {
+            uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
+            LogPrintf("Error reading from database: %s\n", e.what());
+            abort();
+        }
+    }
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
@@ -225,44 +245,110 @@ void Interrupt(boost::thread_group& threadGroup)
     InterruptSAPIServer();
     InterruptSAPI();
     InterruptTorControl();
+    maintenanceTasks.Stop();
     if (g_connman)
         g_connman->Interrupt();
     threadGroup.interrupt_all();
 }
 
-void PrepareShutdown()
+/**
+ * A step of the startup which runs on a thread of its own while AppInit2 goes on with the
+ * ones that don't need it, the step which needs its result waits for it with Wait(). Both
+ * times get logged, so the log shows which step the startup had to wait for.
+ */
+class CStartupStep
 {
-    fRequestShutdown = true; // Needed when we shutdown the wallet
-    fRestartRequested = true; // Needed when we restart the wallet
-    LogPrintf("%s: In progress...\n", __func__);
-    static CCriticalSection cs_Shutdown;
-    TRY_LOCK(cs_Shutdown, lockShutdown);
-    if (!lockShutdown)
-        return;
+public:
+    CStartupStep(const std::string& strNameIn, const std::function<bool()>& func)
+        : strName(strNameIn), fJoined(false), fResult(false), fWaited(false), nDuration(0)
+    {
+        thread = boost::thread([this, func]() {
+            RenameThread(("smartcash-init-" + strName).c_str());
+            int64_t nTimeStart = GetTimeMillis();
+            try {
+                fResult = func();
+            } catch (const std::exception& e) {
+                PrintExceptionContinue(&e, strName.c_str());
+            } catch (...) {
+                PrintExceptionContinue(NULL, strName.c_str());
+            }
+            nDuration = GetTimeMillis() - nTimeStart;
+        });
+    }
 
-    /// Note: Shutdown() must be able to handle cases in which AppInit2() failed part of the way,
-    /// for example if the data directory was found to be locked.
-    /// Be sure that anything that writes files or flushes caches only does this if the respective
-    /// module was initialized.
-    RenameThread("smartcash-shutoff");
-    mempool.AddTransactionsUpdated(1);
-    StopHTTPRPC();
-    StopREST();
-    StopRPC();
-    StopHTTPServer();
-    StopSAPIServer();
-    StopSAPI();
-#ifdef ENABLE_WALLET
-    if (pwalletMain)
-        pwalletMain->Flush(false);
-#endif
-    //GenerateBitcoins(false, 0, Params(), *g_connman);
-    MapPort(false);
-    UnregisterValidationInterface(peerLogic.get());
-    peerLogic.reset();
-    g_connman.reset();
+    ~CStartupStep() { Join(); }
 
-    // STORE DATA CACHES INTO SERIALIZED DAT FILES
+    CStartupStep(const CStartupStep&) = delete;
+    CStartupStep& operator=(const CStartupStep&) = delete;
+
+    /** Wait for the step to finish, true if it succeeded */
+    bool Wait()
+    {
+        int64_t nTimeStart = GetTimeMillis();
+        Join();
+        if (!fWaited) {
+            fWaited = true;
+            LogPrintf("Startup step %s took %dms, waited %dms for it\n", strName, nDuration, GetTimeMillis() - nTimeStart);
+        }
+        return fResult;
+    }
+
+private:
+    const std::string strName;
+    boost::thread thread;
+    bool fJoined;
+    bool fResult;
+    bool fWaited;
+    int64_t nDuration;
+
+    void Join()
+    {
+        if (!fJoined) {
+            thread.join();
+            fJoined = true;
+        }
+    }
+};
+
+/** Read one of the smartnode caches, the errors get reported once AppInit2 waits for it */
+template <typename T>
+static std::unique_ptr<CStartupStep> StartLoadingCache(const std::string& strDBName, const std::string& strMagic, T& objToLoad)
+{
+    return std::unique_ptr<CStartupStep>(new CStartupStep(strDBName, [strDBName, strMagic, &objToLoad]() {
+        CFlatDB<T> flatdb(strDBName, strMagic);
+        return flatdb.Load(objToLoad);
+    }));
+}
+
+/** Open the SmartRewards database, from scratch if fWipe, and check it is usable */
+static bool LoadSmartRewards(int64_t nRewardsCache, bool fWipe, std::string& strLoadError)
+{
+    try {
+        delete prewards;
+        prewards = new CSmartRewards(new CSmartRewardsDB(nRewardsCache, false, fWipe));
+
+        if( !prewards->Verify() ) throw std::runtime_error(_("Failed to verify SmartRewards database."));
+    } catch (const std::runtime_error &e) {
+        if (fDebug) LogPrintf("%s\n", e.what());
+        strLoadError = e.what();
+        return false;
+    } catch (const std::exception &e) {
+        if (fDebug) LogPrintf("%s\n", e.what());
+        strLoadError = _("Error opening rewards database");
+        return false;
+    } catch ( ... ){
+        if (fDebug) LogPrintf("Unexpected exception\n");
+        strLoadError = _("Unexpected error with the rewards database");
+        return false;
+    }
+    return true;
+}
+
+/** Store the smartnode caches into their dat files, at shutdown and every -cachedumpinterval seconds. */
+static void DumpSmartnodeCaches()
+{
+    static CCriticalSection cs_DumpCaches;
+    LOCK(cs_DumpCaches);
 
     bool fCache;
 
@@ -293,10 +379,118 @@ void PrepareShutdown()
 
     fCache = GetBoolArg("-sapi", false);
     if( fCache ){
-        CFlatDB<CSAPIStatistics> flatdb(".sapi_stats", "magicSAPIStatistics");
+        CFlatDB<CSAPIStatistics> flatdb(".sapi_stats", "magicSAPIStatistics3");
         flatdb.Dump(sapiStatistics);
     }
     */
+}
+
+void GetSubsystemMemoryUsage(std::vector<std::pair<std::string, memusage::ComponentUsage> >& vecUsageRet)
+{
+    vecUsageRet.clear();
+
+    vecUsageRet.emplace_back("smartnodes", memusage::ComponentUsage());
+    mnodeman.GetMemoryUsage(vecUsageRet.back().second);
+
+    vecUsageRet.emplace_back("payments", memusage::ComponentUsage());
+    mnpayments.GetMemoryUsage(vecUsageRet.back().second);
+
+    vecUsageRet.emplace_back("instantsend", memusage::ComponentUsage());
+    instantsend.GetMemoryUsage(vecUsageRet.back().second);
+
+    vecUsageRet.emplace_back("voting", memusage::ComponentUsage());
+    smartVoting.GetMemoryUsage(vecUsageRet.back().second);
+
+    vecUsageRet.emplace_back("fulfilled", memusage::ComponentUsage());
+    netfulfilledman.GetMemoryUsage(vecUsageRet.back().second);
+
+    if (prewards) {
+        vecUsageRet.emplace_back("rewards", memusage::ComponentUsage());
+        prewards->GetMemoryUsage(vecUsageRet.back().second);
+    }
+
+    size_t nClients;
+    vecUsageRet.emplace_back("sapi", memusage::ComponentUsage());
+    vecUsageRet.back().second.emplace_back("clients", SAPI::Limits::DynamicMemoryUsage(nClients));
+    vecUsageRet.back().second.emplace_back("statistics", sapiStatistics.DynamicMemoryUsage());
+}
+
+/** Log the memory usage of the subsystems every -memoryloginterval seconds. */
+static void LogSubsystemMemoryUsage()
+{
+    std::vector<std::pair<std::string, memusage::ComponentUsage> > vecUsage;
+    GetSubsystemMemoryUsage(vecUsage);
+
+    size_t nTotal = 0;
+    for (const auto& subsystem : vecUsage) {
+        size_t nSubsystem = 0;
+        std::string strParts;
+        for (const auto& part : subsystem.second) {
+            nSubsystem += part.second;
+            strParts += strprintf(" %s=%.1fkB", part.first, part.second / 1000.0);
+        }
+        nTotal += nSubsystem;
+        LogPrintf("Memory usage %s: %.2fMB,%s\n", subsystem.first, nSubsystem / 1000000.0, strParts);
+    }
+    LogPrintf("Memory usage of the subsystems: %.2fMB\n", nTotal / 1000000.0);
+}
+
+/** Mark the caches just written as a consistent snapshot of the tip, see CSmartnodeSyncSnapshot. */
+static void DumpSmartnodeSyncSnapshot()
+{
+    if( fLiteMode || !GetBoolArg("-syncwarmstart", DEFAULT_SYNC_WARM_START) ||
+        !GetBoolArg("-cachenodelist", DEFAULT_CACHE_NODES) || !GetBoolArg("-cachewinners", DEFAULT_CACHE_WINNERS) )
+        return;
+
+    CSmartnodeSyncSnapshot snapshot = smartnodeSync.GetSnapshot();
+    if( snapshot.IsNull() )
+        return;
+
+    CFlatDB<CSmartnodeSyncSnapshot> flatdb("snsync.dat", "magicSmartnodeSyncSnapshot");
+    flatdb.Dump(snapshot);
+}
+
+void PrepareShutdown()
+{
+    fRequestShutdown = true; // Needed when we shutdown the wallet
+    fRestartRequested = true; // Needed when we restart the wallet
+    LogPrintf("%s: In progress...\n", __func__);
+    static CCriticalSection cs_Shutdown;
+    TRY_LOCK(cs_Shutdown, lockShutdown);
+    if (!lockShutdown)
+        return;
+
+    /// Note: Shutdown() must be able to handle cases in which AppInit2() failed part of the way,
+    /// for example if the data directory was found to be locked.
+    /// Be sure that anything that writes files or flushes caches only does this if the respective
+    /// module was initialized.
+    RenameThread("smartcash-shutoff");
+    mempool.AddTransactionsUpdated(1);
+    StopHTTPRPC();
+    StopREST();
+    StopRPC();
+    StopHTTPServer();
+    StopSAPIServer();
+    // The servers are done with the pool, the background tasks left run before the modules go away
+    maintenanceTasks.Stop();
+    taskPool.Stop();
+    StopSAPI();
+#ifdef ENABLE_WALLET
+    if (pwalletMain)
+        pwalletMain->Flush(false);
+#endif
+    //GenerateBitcoins(false, 0, Params(), *g_connman);
+    MapPort(false);
+    UnregisterValidationInterface(peerLogic.get());
+    peerLogic.reset();
+    g_connman.reset();
+
+    // STORE DATA CACHES INTO SERIALIZED DAT FILES
+    DumpSmartnodeCaches();
+    DumpSmartnodeSyncSnapshot();
+
+    if (fDumpMempoolLater && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        DumpMempool();
 
     UnregisterNodeSignals(GetNodeSignals());
 
@@ -322,11 +516,18 @@ void PrepareShutdown()
         pcoinscatcher = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
+        if (pblocktree != NULL)
+            instantsend.FlushIndex();
         delete pblocktree;
         pblocktree = NULL;
         delete prewards;
         prewards = NULL;
+        delete pvotedb;
+        pvotedb = NULL;
+        delete pvotingpowerdb;
+        pvotingpowerdb = NULL;
     }
+    blockJournal.Close();
 #ifdef ENABLE_WALLET
     if (pwalletMain)
         pwalletMain->Flush(true);
@@ -436,8 +637,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
+    strUsage += HelpMessageOpt("-blockreadahead=<n>", strprintf(_("Read up to <n> MiB of the blocks to connect next ahead during the initial block download, 0 to disable (default: %u)"), DEFAULT_BLOCK_READAHEAD));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
+    strUsage += HelpMessageOpt("-undocache=<n>", strprintf(_("Keep the last <n> connected blocks with their undo data in memory, so short reorgs don't read them from disk (0 to %u, default: %u)"), MAX_UNDO_CACHE_BLOCKS, DEFAULT_UNDO_CACHE_BLOCKS));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), BITCOIN_CONF_FILENAME));
@@ -449,20 +652,31 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbcompression", strprintf(_("Store the blocks of the index, rewards and voting databases Snappy compressed, if leveldb was built with it (default: %u)"), DEFAULT_DB_COMPRESSION));
+    strUsage += HelpMessageOpt("-dbparallelcompaction", strprintf(_("Compact each database in a background thread of its own instead of one shared by all (default: %u)"), DEFAULT_DB_PARALLEL_COMPACTION));
+    strUsage += HelpMessageOpt("-dbcompactionnice=<n>", strprintf(_("Lower the CPU and disk priority of those compaction threads, 0 to 19, Linux only (default: %d)"), DEFAULT_DB_COMPACTION_NICE));
+    strUsage += HelpMessageOpt("-dbflushbudget=<n>", strprintf(_("Percent of the time the coins and rewards caches may spend being written out before they are full, 1 to 100 (default: %d)"), DEFAULT_DB_FLUSH_BUDGET));
+    strUsage += HelpMessageOpt("-indexdbcache=<n>", strprintf(_("Keep the optional indexes in their own database (indexes/) with this part of -dbcache in megabytes, 0 keeps them in the block database. Changing it rebuilds the indexes (default: %d)"), nDefaultIndexDBCache));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool and the InstantSend lock requests on shutdown and load them on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-taskthreads=<n>", strprintf(_("Set the number of threads shared by the RPC and SAPI requests and background tasks (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+        MIN_TASK_THREADS, MAX_TASK_THREADS, DEFAULT_TASK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
-    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. This mode is incompatible with -txindex and -rescan. "
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. The indexes, the SmartRewards and the block summaries of the SAPI are kept, "
+            "-rescan, -rebuildrewards and enabling further indexes need the pruned blocks. "
+            "Transactions of pruned blocks are not available anymore, except for the proposal fees, so getrawtransaction, REST and SAPI report them as pruned. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+    strUsage += HelpMessageOpt("-prunekeepblocks=<n>", strprintf(_("Recent blocks to keep in prune mode, at least %u (default: %u)"), MIN_BLOCKS_TO_KEEP, DEFAULT_PRUNE_KEEP_BLOCKS));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
 #ifndef WIN32
@@ -471,7 +685,15 @@ std::string HelpMessage(HelpMessageMode mode)
     // ### SMARTCASH ###
     // txindex option is currently disabled, defaults to true.
     //strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-balanceindex", strprintf(_("Maintain the balance, received and sent totals of every address, requires -addressindex (default: %u)"), DEFAULT_BALANCEINDEX));
+    strUsage += HelpMessageOpt("-payoutindex", strprintf(_("Maintain an index of the coinbase payouts by address and category, used by the SAPI and the getaddresspayouts rpc call (default: %u)"), DEFAULT_PAYOUTINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain an index of the BIP 158 basic block filters, used by the SAPI, the getblockfilter rpc call and -peerblockfilters (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
     strUsage += HelpMessageOpt("-depositindex", strprintf(_("Maintain a address deposit index, used by the SAPI and the getdeposits rpc call (not yet implemented) (default: %u)"), DEFAULT_DEPOSITINDEX));
+    strUsage += HelpMessageOpt("-rewardsincremental", strprintf(_("Only evaluate SmartRewards entries which got touched during the round or are able to become eligible at the round's end (default: %u)"), DEFAULT_REWARDS_INCREMENTAL));
+    strUsage += HelpMessageOpt("-rewardsreadcache=<n>", strprintf(_("Number of SmartRewards entries looked up by the RPC, SAPI and UI to keep in memory, 0 to disable (default: %u)"), REWARDS_READ_CACHE_ENTRIES_DEFAULT));
+    strUsage += HelpMessageOpt("-rebuildrewards", strprintf(_("Rebuild the SmartRewards database from the blocks on disk, reads ahead with -par threads (default: %u)"), DEFAULT_REWARDS_REBUILD));
+    strUsage += HelpMessageOpt("-cachedumpinterval=<n>", strprintf(_("Write the smartnode, payment and fulfilled request caches to disk every <n> seconds, 0 to only write them at shutdown (default: %u)"), DEFAULT_CACHE_DUMP_INTERVAL));
+    strUsage += HelpMessageOpt("-syncwarmstart", strprintf(_("Resume the smartnode sync from the cached list and winners if they were written at a clean shutdown on the current tip, requires -cachenodelist and -cachewinners (default: %u)"), DEFAULT_SYNC_WARM_START));
 
     strUsage += HelpMessageGroup(_("Options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -494,6 +716,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf(_("Serve the compact block filters of BIP 157 to peers, requires -blockfilterindex (default: %u)"), DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), Params(CBaseChainParams::MAIN).GetDefaultPort(), Params(CBaseChainParams::TESTNET).GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
@@ -503,6 +726,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
+    strUsage += HelpMessageOpt("-txreconciliation", strprintf(_("Reconcile the transaction inventory with peers which support it instead of announcing all of it (default: %u)"), DEFAULT_TXRECONCILIATION));
 #ifdef USE_UPNP
 #if USE_UPNP
     strUsage += HelpMessageOpt("-upnp", _("Use UPnP to map the listening port (default: 1 when listening and no -proxy)"));
@@ -527,6 +751,15 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashtxlock=<address>", _("Enable publish hash transaction (locked via InstantSend) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrawtxlock=<address>", _("Enable publish raw transaction (locked via InstantSend) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrewardblock=<address>", _("Enable publish hash and SmartRewards payout of blocks which pay out SmartRewards in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubsmartnodelist=<address>", _("Enable publish smartnode list changes in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashproposalvote=<address>", _("Enable publish hash proposal vote in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubrawproposalvote=<address>", _("Enable publish raw proposal vote in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhwm=<n>", strprintf(_("Outbound message high water mark of the ZMQ sockets, 0 = no limit (default: %d)"), DEFAULT_ZMQ_SNDHWM));
+    strUsage += HelpMessageOpt("-zmqqueuesize=<n>", strprintf(_("Drop the transaction, smartnode and vote notifications while more than <n> wait to be published, 0 = no limit (default: %u)"), DEFAULT_ZMQ_QUEUE_SIZE));
+    strUsage += HelpMessageOpt("-zmqtxbatch=<n>", strprintf(_("Publish up to <n> transactions in one hashtx or rawtx message (default: %u, maximum: %u)"), DEFAULT_ZMQ_TX_BATCH, MAX_ZMQ_TX_BATCH));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -555,7 +788,11 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
         strUsage += HelpMessageOpt("-nodebug", "Turn off debugging messages, same as -debug=0");
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
+    strUsage += HelpMessageOpt("-blockjournal", strprintf(_("Write the phase timings and cache hit counts of every connected block to blockjournal.csv in the data directory, see getblockjournal (default: %u)"), DEFAULT_BLOCK_JOURNAL));
+    strUsage += HelpMessageOpt("-blockjournalsize=<n>", strprintf(_("Rotate blockjournal.csv when it reaches <n> MiB, keeping %d older files (default: %u)"), BLOCK_JOURNAL_ROTATED_FILES, DEFAULT_BLOCK_JOURNAL_SIZE));
+    strUsage += HelpMessageOpt("-lockstats", strprintf(_("Keep contention statistics of the busiest locks, see getlockstats (default: %u)"), DEFAULT_LOCKSTATS));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), DEFAULT_LOGIPS));
+    strUsage += HelpMessageOpt("-memoryloginterval=<n>", strprintf(_("Log the memory usage of the smartnode, instantsend, voting, rewards and SAPI subsystems every <n> seconds, 0 to disable, see getmemoryinfo (default: %u)"), DEFAULT_MEMORY_LOG_INTERVAL));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
     if (showDebug)
     {
@@ -605,7 +842,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcauth=<userpw>", _("Username and hashed password for JSON-RPC connections. The field <userpw> comes in the format: <USERNAME>:<SALT>$<HASH>. A canonical python script is included in share/rpcuser. This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), BaseParams(CBaseChainParams::MAIN).RPCPort(), BaseParams(CBaseChainParams::TESTNET).RPCPort()));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
-    strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of RPC calls served at the same time (default: %d)"), DEFAULT_HTTP_THREADS));
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
@@ -613,9 +850,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("SAPI server options:"));
     strUsage += HelpMessageOpt("-sapi", _("Enable SmartCash API server and databases.  Also enables -addressindex, -spentindex, -depositindex, -instantpayindex."));
     strUsage += HelpMessageOpt("-sapiport=<port>",_("Listen for SAPI requests on <port> (default: 8080)"));
-    strUsage += HelpMessageOpt("-sapithreads=<n>",_("Set the number of threads for SAPI requests (default: 4)"));
-    strUsage += HelpMessageOpt("-sapiworkqueue=<n>",_("Set the queue for SAPI requests (default: 16)"));
-    strUsage += HelpMessageOpt("-sapiservertimeout=<n>",_("Set the seconds before SAPI timeout (default: 30)"));
+    strUsage += HelpMessageOpt("-sapithreads=<n>",_("Set the number of SAPI requests served at the same time (default: 4)"));
+    strUsage += HelpMessageOpt("-sapieventthreads=<n>",strprintf(_("Set the number of threads accepting and routing SAPI requests, each one listens with SO_REUSEPORT if more than one (default: %u)"), DEFAULT_SAPI_EVENT_THREADS));
+    strUsage += HelpMessageOpt("-sapiworkqueue=<n>",_("Set the queue depth of each SAPI request cost class (default: 16)"));
+    strUsage += HelpMessageOpt("-sapicachesize=<n>",strprintf(_("Set the size of the cache for SAPI replies which only change with the chain tip in MiB, 0 to disable (default: %u)"), DEFAULT_SAPI_CACHE_SIZE));
+    strUsage += HelpMessageOpt("-sapimaxpolls=<n>",strprintf(_("Set the number of address long-poll requests which can wait for activity at the same time (default: %u)"), DEFAULT_SAPI_MAX_POLLS));
+    strUsage += HelpMessageOpt("-sapiservertimeout=<n>",strprintf(_("Set the seconds before SAPI timeout, also the idle timeout of kept-alive connections (default: %u)"), DEFAULT_SAPI_SERVER_TIMEOUT));
+    strUsage += HelpMessageOpt("-sapikeepalive=<n>",strprintf(_("Close SAPI connections after they served <n> requests, 0 for no limit (default: %u)"), DEFAULT_SAPI_KEEPALIVE_REQUESTS));
+    strUsage += HelpMessageOpt("-sapislowrequest=<n>",strprintf(_("Log SAPI requests which take longer than <n> milliseconds with their queue, lock, handler and serialization time, 0 to disable (default: %u)"), DEFAULT_SAPI_SLOW_REQUEST));
     strUsage += HelpMessageOpt("-sapiwhitelist=<ip>",_("Whitelist ip for SAPI"));
     return strUsage;
 }
@@ -761,6 +1003,11 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         }
     }
 
+    // -rebuildrewards, the database got wiped during the init
+    if (GetBoolArg("-rebuildrewards", DEFAULT_REWARDS_REBUILD)) {
+        ThreadSmartRewards(true);
+    }
+
     // scan for better chains in the block chain database, that are not yet connected in the active best chain
     CValidationState state;
     if (!ActivateBestChain(state, chainparams)) {
@@ -772,6 +1019,15 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        while (!fSmartnodeCachesLoaded && !ShutdownRequested())
+            MilliSleep(10);
+        if (!ShutdownRequested()) {
+            LoadMempool(*g_connman);
+            fDumpMempoolLater = !ShutdownRequested();
+        }
+    }
 }
 
 /** Sanity checks
@@ -783,6 +1039,10 @@ bool InitSanityCheck(void)
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string keccak256_algo = Keccak256AutoDetect();
+    LogPrintf("Using the '%s' Keccak-256 implementation for block headers\n", keccak256_algo);
+    std::string sha512_algo = SHA512AutoDetect();
+    LogPrintf("Using the '%s' SHA512 implementation for multi-way HMACs\n", sha512_algo);
 
     if(!ECC_InitSanityCheck()) {
         InitError("Elliptic curve cryptography sanity check failure. Aborting.");
@@ -952,7 +1212,8 @@ void InitParameterInteraction()
         GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) ||
         GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) ||
         GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX) ||
-        GetBoolArg("-depositindex", DEFAULT_DEPOSITINDEX);
+        GetBoolArg("-depositindex", DEFAULT_DEPOSITINDEX) ||
+        GetBoolArg("-payoutindex", DEFAULT_PAYOUTINDEX);
 
     if (fAdditionalIndexes && GetArg("-checklevel", DEFAULT_CHECKLEVEL) < 4) {
         mapArgs["-checklevel"] = "4";
@@ -1099,12 +1360,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // also see: InitParameterInteraction()
 
-    // if using block pruning, then disable txindex
+    // ### SMARTCASH ###
+    // The txindex and the addressindex are always on, they get written as the blocks
+    // connect and don't need them afterwards. Only rebuilding from the blocks doesn't work.
     if (GetArg("-prune", 0)) {
-        // ### SMARTCASH ###
-        // txindex option is currently disabled, defaults to true.
-        if ( 1 || GetBoolArg("-txindex", DEFAULT_TXINDEX))
-            return InitError(_("Prune mode is incompatible with -txindex."));
+        if (GetBoolArg("-rebuildrewards", DEFAULT_REWARDS_REBUILD))
+            return InitError(_("Rebuilding the SmartRewards is not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
 #ifdef ENABLE_WALLET
         if (GetBoolArg("-rescan", false)) {
             return InitError(_("Rescans are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
@@ -1129,6 +1390,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     if (nMaxConnections < nUserMaxConnections)
         InitWarning(strprintf(_("Reducing -maxconnections from %d to %d, because of system limitations."), nUserMaxConnections, nMaxConnections));
+
+    // The databases share the file descriptors left over, fewer table files to reopen on reads
+    nDBMaxOpenFiles = std::max(DEFAULT_DB_MAX_OPEN_FILES, std::min(MAX_DB_MAX_OPEN_FILES, (nFD - nMaxConnections - MIN_CORE_FILEDESCRIPTORS) / MAX_DB_COUNT));
     // ********************************************************* Step 3: parameter-to-internal-flags
 
     fDebug = !mapMultiArgs["-debug"].empty();
@@ -1137,6 +1401,16 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (GetBoolArg("-nodebug", false) || find(categories.begin(), categories.end(), string("0")) != categories.end())
         fDebug = false;
 
+    if (GetBoolArg("-lockstats", DEFAULT_LOCKSTATS)) {
+        // Before any thread takes them, see getlockstats
+        RegisterLockStats(cs_main, "cs_main");
+        RegisterLockStats(mempool.cs, "mempool.cs");
+        RegisterLockStats(cs_rewardscache, "cs_rewardscache");
+        RegisterLockStats(instantsend.cs_instantsend, "instantsend.cs_instantsend");
+        RegisterLockStats(smartVoting.cs, "smartVoting.cs");
+        mnodeman.RegisterLockStats();
+    }
+
     // Check for -debugnet
     if (GetBoolArg("-debugnet", false))
         InitWarning(_("Unsupported argument -debugnet ignored, use -debug=net."));
@@ -1182,6 +1456,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // -taskthreads=0 means autodetect like -par, a few workers are always there
+    int nTaskThreads = GetArg("-taskthreads", DEFAULT_TASK_THREADS);
+    if (nTaskThreads <= 0)
+        nTaskThreads += GetNumCores();
+    nTaskThreads = std::min(std::max(nTaskThreads, MIN_TASK_THREADS), MAX_TASK_THREADS);
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
@@ -1194,7 +1474,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES) {
             return InitError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
         }
-        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        nPruneKeepBlocks = std::max<int64_t>(GetArg("-prunekeepblocks", DEFAULT_PRUNE_KEEP_BLOCKS), MIN_BLOCKS_TO_KEEP);
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files, keeping the last %u blocks.\n", nPruneTarget / 1024 / 1024, nPruneKeepBlocks);
         fPruneMode = true;
     }
 
@@ -1289,12 +1570,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Option to startup with mocktime set (used for regression testing):
     SetMockTime(GetArg("-mocktime", 0)); // SetMockTime(0) is a no-op
 
-    ServiceFlags nLocalServices = NODE_NETWORK;
+    ServiceFlags nLocalServices = ServiceFlags(NODE_NETWORK | NODE_SMARTNODE_LIST_DELTA);
     ServiceFlags nRelevantServices = NODE_NETWORK;
 
     if (GetBoolArg("-peerbloomfilters", true))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    if (GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (!GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Cannot set -peerblockfilters without -blockfilterindex."));
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     fEnableReplacement = GetBoolArg("-mempoolreplacement", DEFAULT_ENABLE_REPLACEMENT);
     if ((!fEnableReplacement) && mapArgs.count("-mempoolreplacement")) {
         // Minimal effort at forwards compatibility
@@ -1314,6 +1601,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (!InitSanityCheck())
         return InitError(_("Initialization sanity check failed. SmartCash Core is shutting down."));
 
+    InitSignatureCache();
+
     std::string strDataDir = GetDataDir().string();
 #ifdef ENABLE_WALLET
     // Wallet file must be a plain filename without a directory
@@ -1359,10 +1648,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        for (int i=0; i<nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadBlockCheck);
+        }
     }
 
+    nUndoCacheBlocks = std::max(0, std::min((int)MAX_UNDO_CACHE_BLOCKS, (int)GetArg("-undocache", DEFAULT_UNDO_CACHE_BLOCKS)));
+
+    int64_t nBlockReadAhead = GetArg("-blockreadahead", DEFAULT_BLOCK_READAHEAD);
+    if (nBlockReadAhead > 0)
+        threadGroup.create_thread(boost::bind(&ThreadBlockReadAhead, (size_t)nBlockReadAhead << 20));
+
     if (!sporkManager.SetSporkAddress(GetArg("-sporkaddr", Params().SporkAddress())))
         return InitError(_("Invalid spork address specified with -sporkaddr"));
 
@@ -1379,6 +1676,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             return InitError(_("Given mining address is invalid!"));
     }
 
+    LogPrintf("Using %d threads for the task pool\n", nTaskThreads);
+    taskPool.Start(nTaskThreads);
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
@@ -1391,6 +1691,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (fServer)
     {
         uiInterface.InitMessage.connect(SetRPCWarmupStatus);
+#if ENABLE_ZMQ
+        RegisterZMQRPCCommands(tableRPC);
+#endif
         if (!AppInitServers(threadGroup))
             return InitError(_("Unable to start HTTP server. Use rpcport=9679 or a port other than 8080 in the smartcash.conf.  See debug log for details."));
     }
@@ -1399,7 +1702,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     if( fSAPI ){
 
-        CFlatDB<CSAPIStatistics> flatdb(".sapi_stats", "magicSAPIStatistics");
+        CFlatDB<CSAPIStatistics> flatdb(".sapi_stats", "magicSAPIStatistics3");
         if(!flatdb.Load(sapiStatistics)) {
             LogPrintf("SAPI statistics reading error. Create a new one.");
             flatdb.Dump(sapiStatistics);
@@ -1609,6 +1912,28 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // ********************************************************* Step 7: load block chain
 
+    // The startup steps which don't need each other run alongside:
+    //  - the block index loads on this thread
+    //  - the SmartRewards database opens on its own thread, InitBlockIndex and everything
+    //    after it connect blocks with it and wait for it
+    //  - the smartnode, payment and fulfilled request caches load on threads of their own,
+    //    step 11b waits for them
+    std::unique_ptr<CStartupStep> pstepSmartnodes, pstepPayments, pstepFulfilled;
+    if (!fLiteMode) {
+        if (GetBoolArg("-cachenodelist", DEFAULT_CACHE_NODES))
+            pstepSmartnodes = StartLoadingCache("sncache.dat", "magicSmartnodeCache", mnodeman);
+        if (GetBoolArg("-cachewinners", DEFAULT_CACHE_WINNERS))
+            pstepPayments = StartLoadingCache("snpayments.dat", "magicSmartnodePaymentsCache", mnpayments);
+        if (GetBoolArg("-cachefulfilled", DEFAULT_CACHE_NETFULLFILLED))
+            pstepFulfilled = StartLoadingCache("netfulfilled.dat", "magicFulfilledCache", netfulfilledman);
+    }
+
+    if (GetBoolArg("-blockjournal", DEFAULT_BLOCK_JOURNAL)) {
+        boost::filesystem::path pathJournal = GetDataDir() / "blockjournal.csv";
+        if (!blockJournal.Open(pathJournal, std::max<int64_t>(0, GetArg("-blockjournalsize", DEFAULT_BLOCK_JOURNAL_SIZE)) << 20))
+            return InitError(strprintf(_("Unable to open the block journal %s"), pathJournal.string()));
+    }
+
     fReindex = GetBoolArg("-reindex", false);
     bool fReindexChainState = GetBoolArg("-reindex-chainstate", false);
 
@@ -1647,6 +1972,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greated than nMaxDbcache
+    int64_t nIndexDBCache = std::max<int64_t>(0, std::min(GetArg("-indexdbcache", nDefaultIndexDBCache) << 20, nTotalCache / 2));
+    nTotalCache -= nIndexDBCache;
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     // #####   SMARTCASH  ######
     // txindex option is currently disabled, defaults to true.
@@ -1656,10 +1983,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
+    nDBFlushBudget = std::min(std::max((int)GetArg("-dbflushbudget", DEFAULT_DB_FLUSH_BUDGET), 1), 100);
     nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
+    if (nIndexDBCache > 0)
+        LogPrintf("* Using %.1fMiB for index database\n", nIndexDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
 
@@ -1667,63 +1997,19 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("* Using %.1fMiB for smart rewards database\n", nRewardsCache * (1.0 / 1024 / 1024));
 
     nCacheRewardEntries = GetArg("-rewardsentrycache", REWARDS_CACHE_ENTRIES_DEFAULT);
+    nReadCacheRewardEntries = std::max<int64_t>(0, GetArg("-rewardsreadcache", REWARDS_READ_CACHE_ENTRIES_DEFAULT));
+    fRewardsIncremental = GetBoolArg("-rewardsincremental", DEFAULT_REWARDS_INCREMENTAL);
 
-    delete prewards;
-
-    CSmartRewardsDB *prewardsdb = new CSmartRewardsDB(nRewardsCache, false, false);
-
-    prewards = new CSmartRewards(prewardsdb);
-
-    uiInterface.InitMessage(_("Loading SmartRewards..."));
+    bool fWipeRewards = fReindex || GetBoolArg("-rebuildrewards", DEFAULT_REWARDS_REBUILD);
+    std::string strRewardsError;
+    CStartupStep stepRewards("rewards", [nRewardsCache, fWipeRewards, &strRewardsError]() {
+        return LoadSmartRewards(nRewardsCache, fWipeRewards, strRewardsError);
+    });
+    bool fRewardsLoaded = false;
+    bool fRewardsReindex = false;
 
     bool fLoaded = false;
 
-    while (!fLoaded) {
-
-        std::string strLoadError;
-
-        nStart = GetTimeMillis();
-        do {
-            try {
-
-                if( fReindex ){
-                    delete prewards;
-
-                    prewardsdb = new CSmartRewardsDB(nRewardsCache, false, true);
-                    prewards = new CSmartRewards(prewardsdb);
-                }
-
-                if( !(fLoaded = prewards->Verify()) ) throw std::runtime_error(_("Failed to verify SmartRewards database."));
-
-                if (fRequestShutdown) break;
-
-            } catch (const std::runtime_error &e) {
-                if (fDebug) LogPrintf("%s\n", e.what());
-                strLoadError = e.what();
-                break;
-            } catch (const std::exception &e) {
-                if (fDebug) LogPrintf("%s\n", e.what());
-                strLoadError = _("Error opening rewards database");
-                break;
-            } catch ( ... ){
-                if (fDebug) LogPrintf("Unexpected exception\n");
-                strLoadError = _("Unexpected error with the rewards database");
-                break;
-            }
-
-            fLoaded = true;
-
-        } while(false);
-
-        if( !fLoaded ){
-            InitWarning(strLoadError + _("\n\nReindexing blockchain data now..."));
-            fReindex = true;
-        }
-
-    }
-
-    fLoaded = false;
-
     while (!fLoaded && !fRequestShutdown) {
         bool fReset = fReindex;
         std::string strLoadError;
@@ -1739,7 +2025,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinscatcher;
                 delete pblocktree;
 
-                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
+                pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, nIndexDBCache);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
@@ -1768,12 +2054,55 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(chainparams.GetConsensus().hashGenesisBlock) == 0)
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
 
+                // Blocks get connected from here on, they need the rewards. A broken rewards
+                // database gets rebuilt together with the blocks, without asking first.
+                if (!fRewardsLoaded) {
+                    uiInterface.InitMessage(_("Loading SmartRewards..."));
+                    if (!(fRewardsLoaded = stepRewards.Wait())) {
+                        do {
+                            InitWarning(strRewardsError + _("\n\nReindexing blockchain data now..."));
+                            fRewardsLoaded = LoadSmartRewards(nRewardsCache, true, strRewardsError);
+                        } while (!fRewardsLoaded);
+                        if (!fReindex) {
+                            fRewardsReindex = true;
+                            fReindex = true;
+                            break;
+                        }
+                    }
+                    uiInterface.InitMessage(_("Loading block index..."));
+                }
+
                 // Initialize the block index (no-op if non-empty database was already loaded)
                 if (!InitBlockIndex(chainparams)) {
                     strLoadError = _("Error initializing block database");
                     break;
                 }
 
+                if (!InitCompactAddressIndex()) {
+                    strLoadError = _("Error upgrading the address index");
+                    break;
+                }
+
+                if (!InitBalanceIndex(fReindex || fReindexChainState)) {
+                    strLoadError = _("Error initializing the balance index");
+                    break;
+                }
+
+                if (!InitUnspentAmountIndex()) {
+                    strLoadError = _("Error initializing the unspent amount index");
+                    break;
+                }
+
+                if (!InitDepositBuckets()) {
+                    strLoadError = _("Error initializing the deposit counts");
+                    break;
+                }
+
+                if (!pblocktree->LoadVoteKeys()) {
+                    strLoadError = _("Error loading the vote keys");
+                    break;
+                }
+
                 // #####   SMARTCASH  ######
                 // txindex option is currently disabled, defaults to true.
 //                // Check for changed -txindex state
@@ -1820,6 +2149,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             fLoaded = true;
         } while(false);
 
+        if (fRewardsReindex) {
+            fRewardsReindex = false;
+            continue;
+        }
+
         if (!fLoaded && !fRequestShutdown) {
             // first suggest a reindex
             if (!fReset) {
@@ -1850,16 +2184,6 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
-    // As LoadBlockIndex can take several minutes, it's possible the user
-    // requested to kill the GUI during the last operation. If so, exit.
-    // As the program has not fully started yet, Shutdown() is possibly overkill.
-    if (fRequestShutdown)
-    {
-        LogPrintf("Shutdown requested. Exiting.\n");
-        return false;
-    }
-    LogPrintf(" rewards %15dms\n", GetTimeMillis() - nStart);
-
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1978,6 +2302,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         LogPrintf("%s", strErrors.str());
         LogPrintf(" wallet      %15dms\n", GetTimeMillis() - nStart);
 
+        pwalletMain->watchAddresses.SetMaxBlocks(GetArg("-watchdeltablocks", DEFAULT_WATCH_DELTA_BLOCKS));
         RegisterValidationInterface(pwalletMain);
 
         CBlockIndex *pindexRescan = chainActive.Tip();
@@ -2167,12 +2492,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
         bool fCache;
 
-        fCache = GetBoolArg("-cachenodelist", DEFAULT_CACHE_NODES);
-        if( fCache ){
+        // Loaded since step 7
+        if( pstepSmartnodes ){
             strDBName = "sncache.dat";
             uiInterface.InitMessage(_("Loading smartnode cache..."));
-            CFlatDB<CSmartnodeMan> flatdb(strDBName, "magicSmartnodeCache");
-            if(!flatdb.Load(mnodeman)) {
+            if(!pstepSmartnodes->Wait()) {
                 InitError(_("Failed to load smartnode cache from") + "\n" + (pathDB / strDBName).string());
                 try {
                     boost::filesystem::remove((pathDB / strDBName).string());
@@ -2182,12 +2506,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             }
         }
 
-        fCache = GetBoolArg("-cachewinners", DEFAULT_CACHE_WINNERS);
-        if( fCache ){
+        if( pstepPayments ){
             strDBName = "snpayments.dat";
             uiInterface.InitMessage(_("Loading smartnode payment cache..."));
-            CFlatDB<CSmartnodePayments> flatdb(strDBName, "magicSmartnodePaymentsCache");
-            if(!flatdb.Load(mnpayments)) {
+            if(!pstepPayments->Wait()) {
                 InitWarning(_("Failed to load smartnode payments cache from") + "\n" + (pathDB / strDBName).string());
                 try {
                     boost::filesystem::remove((pathDB / strDBName).string());
@@ -2197,12 +2519,26 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             }
         }
 
-        fCache = GetBoolArg("-cachefulfilled", DEFAULT_CACHE_NETFULLFILLED);
+        fCache = GetBoolArg("-syncwarmstart", DEFAULT_SYNC_WARM_START);
         if( fCache ){
+            strDBName = "snsync.dat";
+            CSmartnodeSyncSnapshot snapshot;
+            CFlatDB<CSmartnodeSyncSnapshot> flatdb(strDBName, "magicSmartnodeSyncSnapshot");
+            if( GetBoolArg("-cachenodelist", DEFAULT_CACHE_NODES) && GetBoolArg("-cachewinners", DEFAULT_CACHE_WINNERS) && flatdb.Load(snapshot) )
+                smartnodeSync.WarmStart(snapshot);
+            // The snapshot only holds for the start right after the shutdown which wrote it,
+            // the caches get dumped again while running.
+            try {
+                boost::filesystem::remove((pathDB / strDBName).string());
+            } catch (const boost::filesystem::filesystem_error& e) {
+                LogPrintf("Unable to remove snsync.dat: %s\n", e.what());
+            }
+        }
+
+        if( pstepFulfilled ){
             strDBName = "netfulfilled.dat";
             uiInterface.InitMessage(_("Loading fulfilled requests cache..."));
-            CFlatDB<CNetFulfilledRequestManager> flatdb(strDBName, "magicFulfilledCache");
-            if(!flatdb.Load(netfulfilledman)) {
+            if(!pstepFulfilled->Wait()) {
                 InitError(_("Failed to load fulfilled requests cache from") + "\n" + (pathDB / strDBName).string());
                 try {
                     boost::filesystem::remove((pathDB / strDBName).string());
@@ -2213,6 +2549,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
 
         /* WIP-VOTING uncomment
+        // Needs to be open before smartvoting.dat gets loaded, the votes move over then
+        if( GetBoolArg("-votedb", DEFAULT_VOTE_DB) ){
+            pvotedb = new CProposalVoteDB(VOTE_DB_CACHE);
+        }
+
         fCache = GetBoolArg("-cachevoting", DEFAULT_CACHE_VOTING);
         if( fCache ){
             strDBName = "smartvoting.dat";
@@ -2241,10 +2582,44 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // ********************************************************* Step 11d: start smartcash threads
 
-    threadGroup.create_thread(boost::bind(&ThreadSmartnode, boost::ref(*g_connman)));
+    StartSmartnodeMaintenance(*g_connman);
+
+    // The smartnode layer messages get processed off the message handler thread
+    StartSmartnodeMessageQueues(threadGroup, *g_connman);
+
+    // Indexes enabled on the existing chain, see InitBlockIndex
+    indexBuilder.Start(threadGroup);
+
+    if (!fLiteMode) {
+        instantsend.StartVoteVerification(threadGroup, *g_connman);
+        if (fInstantPayIndex)
+            instantsend.StartIndexWriter(threadGroup);
+    }
+
+    // The vote verification threads are running, ThreadImport can load mempool.dat
+    fSmartnodeCachesLoaded = true;
+
+    // Keep the caches on disk up to date in case the node doesn't get shut down cleanly
+    int64_t nCacheDumpInterval = GetArg("-cachedumpinterval", DEFAULT_CACHE_DUMP_INTERVAL);
+    if (nCacheDumpInterval > 0)
+        maintenanceTasks.Add("cachedump", nCacheDumpInterval * 1000, &DumpSmartnodeCaches);
+
+    int64_t nMemoryLogInterval = GetArg("-memoryloginterval", DEFAULT_MEMORY_LOG_INTERVAL);
+    if (nMemoryLogInterval > 0)
+        maintenanceTasks.Add("memorylog", nMemoryLogInterval * 1000, &LogSubsystemMemoryUsage);
+
+    if (fSAPI)
+        maintenanceTasks.Add("sapilimits", SAPI_LIMITS_CLEANUP_INTERVAL, &SAPI::Limits::CheckAndRemove);
+
+    // See getmaintenanceinfo for how long the runs take
+    maintenanceTasks.Start(scheduler);
 
 //  WIP-VOTING uncomment
+//    if( GetBoolArg("-votingpowersnapshots", DEFAULT_VOTING_POWER_SNAPSHOTS) )
+//        pvotingpowerdb = new CVotingPowerDB(VOTING_POWER_DB_CACHE);
+//    RegisterValidationInterface(&votingPowerValidation);
 //    threadGroup.create_thread(&ThreadSmartVoting);
+//    smartVoting.StartVoteVerification(threadGroup, *g_connman);
 
     // ********************************************************* Step 12: start node
 
@@ -7,6 +7,7 @@
 #define BITCOIN_INIT_H
 
 #include <string>
+#include "memusage.h"
 #include "serialize.h"
 #include "tinyformat.h"
 
@@ -20,6 +21,9 @@ class thread_group;
 
 extern CWallet* pwalletMain;
 
+/** Seconds between the memory usage reports in the log, see GetSubsystemMemoryUsage */
+static const int64_t DEFAULT_MEMORY_LOG_INTERVAL = 60 * 60;
+
 void StartShutdown();
 bool ShutdownRequested();
 /** Interrupt threads */
@@ -43,6 +47,9 @@ std::string HelpMessage(HelpMessageMode mode);
 /** Returns licensing information (for -version) */
 std::string LicenseInfo();
 
+/** Heap usage of the smartnode, instantsend, voting, rewards and SAPI subsystems by their parts */
+void GetSubsystemMemoryUsage(std::vector<std::pair<std::string, memusage::ComponentUsage> >& vecUsageRet);
+
 
 // Used to keep track of the client and protocol version.
 // If one changes the caches will become cleared on startup.
@@ -12,9 +12,31 @@
 
 #include <sstream>
 #include "Zerocoin.h"
+#include "../taskpool.h"
+
+// Coins one helper of the task pool validates at least in a batch
+#define ACCUMULATOR_VALIDATIONS_PER_HELPER  4
+// Multiplications of one level of the product tree a helper does at least
+#define ACCUMULATOR_PRODUCTS_PER_HELPER     16
 
 namespace libzerocoin {
 
+/** Product of all values, multiplied pairwise level by level so the factors
+ *  of a multiplication are about the same size and a level runs in parallel. */
+static Bignum ProductTree(std::vector<Bignum> level) {
+	while (level.size() > 1) {
+		std::vector<Bignum> next((level.size() + 1) / 2);
+		taskPool.ForEach(CTaskPool::PRIORITY_LOW, next.size(), ACCUMULATOR_PRODUCTS_PER_HELPER, [&level, &next](size_t i) {
+			if (2 * i + 1 < level.size())
+				next[i] = level[2 * i] * level[2 * i + 1];
+			else
+				next[i] = level[2 * i];
+		});
+		level.swap(next);
+	}
+	return level[0];
+}
+
 //Accumulator class
 Accumulator::Accumulator(const AccumulatorAndProofParams* p, const CoinDenomination d): params(p), denomination(d) {
 	if (!(params->initialized)) {
@@ -35,12 +57,7 @@ Accumulator::Accumulator(const Params* p, const CoinDenomination d) {
 	this->value = this->params->accumulatorBase;
 }
 
-void Accumulator::accumulate(const PublicCoin& coin) {
-	// Make sure we're initialized
-	if(!(this->value)) {
-		throw ZerocoinException("Accumulator is not initialized");
-	}
-
+void Accumulator::checkDenomination(const PublicCoin& coin) const {
 	if(this->denomination != coin.getDenomination()) {
 		//std::stringstream msg;
 		std::string msg;
@@ -50,6 +67,15 @@ void Accumulator::accumulate(const PublicCoin& coin) {
 		msg += coin.getDenomination();
 		throw ZerocoinException(msg);
 	}
+}
+
+void Accumulator::accumulate(const PublicCoin& coin) {
+	// Make sure we're initialized
+	if(!(this->value)) {
+		throw ZerocoinException("Accumulator is not initialized");
+	}
+
+	checkDenomination(coin);
 
 	if(coin.validate()) {
 		// Compute new accumulator = "old accumulator"^{element} mod N
@@ -59,6 +85,40 @@ void Accumulator::accumulate(const PublicCoin& coin) {
 	}
 }
 
+void Accumulator::accumulate(const std::vector<PublicCoin>& coins) {
+	// Make sure we're initialized
+	if(!(this->value)) {
+		throw ZerocoinException("Accumulator is not initialized");
+	}
+
+	if(coins.empty()) {
+		return;
+	}
+
+	for (const PublicCoin& coin : coins) {
+		checkDenomination(coin);
+	}
+
+	// The primality tests are independent of each other, no std::vector<bool>
+	// as the threads write next to each other
+	std::vector<char> valid(coins.size(), 0);
+	std::vector<Bignum> values(coins.size());
+	taskPool.ForEach(CTaskPool::PRIORITY_LOW, coins.size(), ACCUMULATOR_VALIDATIONS_PER_HELPER, [&coins, &valid, &values](size_t i) {
+		valid[i] = coins[i].validate();
+		values[i] = coins[i].getValue();
+	});
+
+	// All or nothing, the valid coins before an invalid one don't get accumulated either
+	for (char fValid : valid) {
+		if (!fValid) {
+			throw ZerocoinException("Coin is not valid");
+		}
+	}
+
+	// "old accumulator"^{e_1}^{e_2}... = "old accumulator"^{e_1 * e_2 * ...} mod N
+	this->value = this->value.pow_mod(ProductTree(values), this->params->accumulatorModulus);
+}
+
 CoinDenomination Accumulator::getDenomination() const {
 	return static_cast<CoinDenomination> (this->denomination);
 }
@@ -87,6 +147,17 @@ void AccumulatorWitness::AddElement(const PublicCoin& c) {
 	}
 }
 
+void AccumulatorWitness::AddElements(const std::vector<PublicCoin>& coins) {
+	std::vector<PublicCoin> others;
+	others.reserve(coins.size());
+	for (const PublicCoin& c : coins) {
+		if(element != c) {
+			others.push_back(c);
+		}
+	}
+	witness.accumulate(others);
+}
+
 const Bignum& AccumulatorWitness::getValue() const {
 	return this->witness.getValue();
 }
@@ -58,6 +58,25 @@ public:
 	 **/
     void accumulate(const PublicCoin &coin);
 
+	/**
+	 * Accumulate a batch of coins, with the same result as accumulating
+	 * them one after the other. The coins get validated in parallel and
+	 * their values multiplied in a product tree, the levels of which run
+	 * in parallel too, so the accumulator only gets raised once to the
+	 * product of all of them.
+	 *
+	 * The batch is all-or-nothing: unlike accumulating the coins one after
+	 * the other, none of them is accumulated if one is not valid, not even
+	 * the valid ones before it.
+	 *
+	 * @param coins	The PublicCoins to accumulate.
+	 *
+	 * @throw		Zerocoin exception if one of the coins is not valid, the
+	 *				accumulator is left unchanged then.
+	 *
+	 **/
+    void accumulate(const std::vector<PublicCoin> &coins);
+
 	CoinDenomination getDenomination() const;
 	/** Get the accumulator result
 	 *
@@ -90,6 +109,8 @@ public:
 		READWRITE(denomination);
 	}
 private:
+	void checkDenomination(const PublicCoin &coin) const;
+
 	const AccumulatorAndProofParams* params;
 	Bignum value;
 	// Denomination is stored as an INT because storing
@@ -120,6 +141,12 @@ public:
 	 */
     void AddElement(const PublicCoin& c);
 
+	/** Adds a batch of elements at once, see Accumulator::accumulate
+	 *
+	 * @param coins the coins to add, the one of the witness gets skipped
+	 */
+    void AddElements(const std::vector<PublicCoin>& coins);
+
 	/**
 	 *
 	 * @return the value of the witness
@@ -0,0 +1,152 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "maintenance.h"
+
+#include "random.h"
+#include "scheduler.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+CMaintenanceTasks maintenanceTasks;
+
+struct CMaintenanceTasks::Entry
+{
+    CTaskPool::Task task;
+    CCriticalSection* pcsBusy;
+    CTaskPool::Priority priority;
+    //! Times the current run got put off, only touched by the run itself
+    int nBackoffs;
+    //! Protected by CMaintenanceTasks::cs
+    Stats stats;
+};
+
+CMaintenanceTasks::CMaintenanceTasks() : pscheduler(NULL), fStopped(false)
+{
+}
+
+void CMaintenanceTasks::Start(CScheduler& scheduler)
+{
+    std::vector<std::shared_ptr<Entry>> vStart;
+    {
+        LOCK(cs);
+        assert(!pscheduler);
+        pscheduler = &scheduler;
+        vStart = vEntries;
+    }
+    for (const auto& entry : vStart)
+        Schedule(entry, GetRand(entry->stats.nPeriod) + 1);
+}
+
+void CMaintenanceTasks::Stop()
+{
+    fStopped = true;
+}
+
+void CMaintenanceTasks::Add(const std::string& strName, int64_t nPeriodMillis, const CTaskPool::Task& task,
+                            CCriticalSection* pcsBusy, CTaskPool::Priority priority)
+{
+    assert(nPeriodMillis > 0);
+
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->task = task;
+    entry->pcsBusy = pcsBusy;
+    entry->priority = priority;
+    entry->nBackoffs = 0;
+    entry->stats.strName = strName;
+    entry->stats.nPeriod = nPeriodMillis;
+    entry->stats.nRuns = 0;
+    entry->stats.nLastRun = 0;
+    entry->stats.nLastDuration = 0;
+    entry->stats.nMaxDuration = 0;
+    entry->stats.nOverruns = 0;
+    entry->stats.nBackoffs = 0;
+
+    bool fStarted;
+    {
+        LOCK(cs);
+        vEntries.push_back(entry);
+        fStarted = pscheduler != NULL;
+    }
+    if (fStarted)
+        Schedule(entry, GetRand(nPeriodMillis) + 1);
+}
+
+std::vector<CMaintenanceTasks::Stats> CMaintenanceTasks::GetStats() const
+{
+    LOCK(cs);
+    std::vector<Stats> vStats;
+    vStats.reserve(vEntries.size());
+    for (const auto& entry : vEntries)
+        vStats.push_back(entry->stats);
+    return vStats;
+}
+
+void CMaintenanceTasks::Schedule(const std::shared_ptr<Entry>& entry, int64_t nDelayMillis)
+{
+    if (fStopped)
+        return;
+
+    // The scheduler thread only hands the run over, it stays free for the network tasks
+    pscheduler->schedule([this, entry]() {
+        if (!fStopped)
+            taskPool.Submit(entry->priority, [this, entry]() { Run(entry); });
+    }, boost::chrono::system_clock::now() + boost::chrono::milliseconds(nDelayMillis));
+}
+
+void CMaintenanceTasks::Run(const std::shared_ptr<Entry>& entry)
+{
+    if (fStopped)
+        return;
+
+    // Only probed, the task takes the lock itself in the order it always did
+    if (entry->pcsBusy && entry->nBackoffs < MAINTENANCE_MAX_BACKOFFS) {
+        bool fBusy;
+        {
+            TRY_LOCK(*entry->pcsBusy, lockBusy);
+            fBusy = !lockBusy;
+        }
+        if (fBusy) {
+            int64_t nDelay = MAINTENANCE_BACKOFF_MILLIS << entry->nBackoffs++;
+            {
+                LOCK(cs);
+                entry->stats.nBackoffs++;
+            }
+            Schedule(entry, nDelay + GetRand(nDelay));
+            return;
+        }
+    }
+    entry->nBackoffs = 0;
+
+    int64_t nTimeStart = GetTimeMicros();
+    {
+        LOCK(cs);
+        entry->stats.nLastRun = GetTime();
+    }
+
+    try {
+        entry->task();
+    } catch (const std::exception& e) {
+        PrintExceptionContinue(&e, entry->stats.strName.c_str());
+    } catch (...) {
+        PrintExceptionContinue(NULL, entry->stats.strName.c_str());
+    }
+
+    int64_t nDuration = GetTimeMicros() - nTimeStart;
+    int64_t nPeriod = entry->stats.nPeriod;
+    {
+        LOCK(cs);
+        entry->stats.nRuns++;
+        entry->stats.nLastDuration = nDuration;
+        entry->stats.nMaxDuration = std::max(entry->stats.nMaxDuration, nDuration);
+        if (nDuration > nPeriod * 1000)
+            entry->stats.nOverruns++;
+    }
+    if (nDuration > nPeriod * 1000)
+        LogPrint("bench", "CMaintenanceTasks::Run -- %s took %.2fms, longer than its period of %dms\n", entry->stats.strName, nDuration * 0.001, nPeriod);
+
+    Schedule(entry, nPeriod + GetRand(nPeriod / 10 + 1));
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_MAINTENANCE_H
+#define SMARTCASH_MAINTENANCE_H
+
+#include "sync.h"
+#include "taskpool.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class CScheduler;
+
+/** A run of a task which finds its lock busy is put off this long, doubled for each further try */
+static const int64_t MAINTENANCE_BACKOFF_MILLIS = 50;
+/** Tries put off before the task runs anyway and waits for the lock like everyone else */
+static const int MAINTENANCE_MAX_BACKOFFS = 4;
+
+/**
+ * The periodic maintenance of the smartnode, instantsend, payment and SAPI
+ * subsystems, which used to have sleep loops of their own waking at the same
+ * second. The scheduler only keeps the times, the runs happen on the task
+ * pool.
+ *
+ * A task runs again a period after its last run finished, plus a random
+ * jitter of up to a tenth of the period so tasks with the same period drift
+ * apart. Tasks registered with a lock probe it before they start and put the
+ * run off a little while someone else holds it, instead of queueing up
+ * behind it with the other tasks.
+ */
+class CMaintenanceTasks
+{
+public:
+    struct Stats
+    {
+        std::string strName;
+        int64_t nPeriod;        //!< Milliseconds between the runs
+        uint64_t nRuns;
+        int64_t nLastRun;       //!< Time the last run started, 0 before the first one
+        int64_t nLastDuration;  //!< Microseconds
+        int64_t nMaxDuration;   //!< Microseconds
+        uint64_t nOverruns;     //!< Runs which took longer than the period
+        uint64_t nBackoffs;     //!< Runs put off because the lock was busy
+    };
+
+    CMaintenanceTasks();
+
+    CMaintenanceTasks(const CMaintenanceTasks&) = delete;
+    CMaintenanceTasks& operator=(const CMaintenanceTasks&) = delete;
+
+    /** Tasks added before get scheduled here, the ones added later right away */
+    void Start(CScheduler& scheduler);
+    /** Don't start any further runs, the ones on the pool finish */
+    void Stop();
+
+    /**
+     * Run task about every nPeriodMillis milliseconds, starting after a random part of the first
+     * period. pcsBusy is the lock the task spends most of its time waiting for, NULL for none.
+     */
+    void Add(const std::string& strName, int64_t nPeriodMillis, const CTaskPool::Task& task,
+             CCriticalSection* pcsBusy = NULL, CTaskPool::Priority priority = CTaskPool::PRIORITY_LOW);
+
+    std::vector<Stats> GetStats() const;
+
+private:
+    struct Entry;
+
+    mutable CCriticalSection cs;
+    CScheduler* pscheduler;
+    std::vector<std::shared_ptr<Entry>> vEntries;
+    std::atomic<bool> fStopped;
+
+    void Schedule(const std::shared_ptr<Entry>& entry, int64_t nDelayMillis);
+    void Run(const std::shared_ptr<Entry>& entry);
+};
+
+extern CMaintenanceTasks maintenanceTasks;
+
+#endif // SMARTCASH_MAINTENANCE_H
@@ -3,12 +3,78 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "cuckoocache.h"
 #include "hash.h"
+#include "random.h"
 #include "validation.h" // For strMessageMagic
 #include "messagesigner.h"
 #include "tinyformat.h"
 #include "utilstrencodings.h"
 
+#include <cstring>
+
+#include <boost/thread.hpp>
+
+namespace {
+
+/** The entries are salted hashes already, their 8 words are the 8 hashes of the cuckoo cache */
+class CMessageSignatureCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select < 8, "CMessageSignatureCacheHasher only has 8 hashes available");
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+/**
+ * Signatures of smartnode broadcasts, pings, payment votes, sporks and
+ * proposal votes found valid, so the ones relayed, requested again or
+ * checked again after a list reset don't need another public key recovery.
+ * Built like the script signature cache in script/sigcache.cpp.
+ */
+class CMessageSignatureCache
+{
+private:
+    //! Entries are SHA256(nonce || hash || key id || signature)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, CMessageSignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_msgsigcache;
+
+public:
+    CMessageSignatureCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+        setValid.setup_bytes(MESSAGE_SIG_CACHE_BYTES);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(keyID.begin(), keyID.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_msgsigcache);
+        setValid.insert(entry);
+    }
+};
+
+static CMessageSignatureCache messageSignatureCache;
+
+}
+
 bool CMessageSigner::GetKeysFromSecret(const std::string strSecret, CKey& keyRet, CPubKey& pubkeyRet)
 {
     CBitcoinSecret vchSecret;
@@ -56,6 +122,11 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CPubKey& pubkey, const s
 
 bool CHashSigner::VerifyHash(const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig, std::string& strErrorRet)
 {
+    uint256 entry;
+    messageSignatureCache.ComputeEntry(entry, hash, keyID, vchSig);
+    if (messageSignatureCache.Get(entry))
+        return true;
+
     CPubKey pubkeyFromSig;
     if(!pubkeyFromSig.RecoverCompact(hash, vchSig)) {
         strErrorRet = "Error recovering public key.";
@@ -69,5 +140,6 @@ bool CHashSigner::VerifyHash(const uint256& hash, const CKeyID& keyID, const std
         return false;
     }
 
+    messageSignatureCache.Set(entry);
     return true;
 }
@@ -7,6 +7,9 @@
 
 #include "key.h"
 
+//! Size of the cache of verified smartnode, spork and vote signatures, 2 MiB or 65536 entries
+static const size_t MESSAGE_SIG_CACHE_BYTES = 2 << 20;
+
 /** Helper class for signing messages and checking their signatures
  */
 class CMessageSigner
@@ -31,7 +34,7 @@ public:
     static bool SignHash(const uint256& hash, const CKey key, std::vector<unsigned char>& vchSigRet);
     /// Verify the hash signature, returns true if succcessful
     static bool VerifyHash(const uint256& hash, const CPubKey& pubkey, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
-    /// Verify the hash signature, returns true if succcessful
+    /// Verify the hash signature, returns true if succcessful. Signatures found valid before are looked up instead of recovered again.
     static bool VerifyHash(const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
 };
 
@@ -34,7 +34,6 @@
 #include <algorithm>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
-#include <queue>
 
 using namespace std;
 
@@ -53,17 +52,49 @@ uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 uint64_t nLastBlockWeight = 0;
 
-class ScoreCompare
+namespace {
+
+//! The in-mempool ancestors of an entry summed up, including the entry itself
+struct CAncestorState
 {
-public:
-    ScoreCompare() {}
+    uint64_t nCount;
+    uint64_t nSize;
+    CAmount nModFees;
+    int64_t nSigOpCount;
+};
 
-    bool operator()(const CTxMemPool::txiter a, const CTxMemPool::txiter b)
+/**
+ * The ancestor state of the mempool entries from the last template. As long
+ * as the tip and the prioritisations stay the same, the in-mempool ancestors
+ * of an entry don't change: only the entries which came in since the last
+ * template have to be walked, which keeps getblocktemplate fast for pools
+ * asking every few seconds.
+ */
+struct CAncestorStateCache
+{
+    uint256 hashTip;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::map<uint256, CAncestorState> mapState;
+};
+
+CAncestorStateCache ancestorStateCache; // protected by cs_main
+
+// A comparator that sorts transactions based on number of ancestors.
+// This is sufficient to sort an ancestor package in an order that is valid
+// to appear in a block.
+struct CompareTxIterByAncestorCount {
+    bool operator()(const CTxMemPool::txiter &a, const CTxMemPool::txiter &b) const
     {
-        return CompareTxMemPoolEntryByScore()(*b,*a); // Convert to less than
+        uint64_t nCountA = ancestorStateCache.mapState.at(a->GetTx().GetHash()).nCount;
+        uint64_t nCountB = ancestorStateCache.mapState.at(b->GetTx().GetHash()).nCount;
+        if (nCountA != nCountB)
+            return nCountA < nCountB;
+        return CTxMemPool::CompareIteratorByHash()(a, b);
     }
 };
 
+}
+
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
     int64_t nOldTime = pblock->nTime;
@@ -138,7 +169,7 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, co
 
     if(!pblocktemplate.get())
         return NULL;
-    CBlock *pblock = &pblocktemplate->block; // pointer for convenience
+    pblock = &pblocktemplate->block; // pointer for convenience
     LOCK(cs_main);
     CBlockIndex* pindexPrev = chainActive.Tip();
     nHeight = pindexPrev->nHeight + 1;
@@ -165,44 +196,10 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, co
     SmartRewardPayments::FillPayments(coinbaseTx, nHeight, pindexPrev->GetBlockTime(), pblock->voutSmartRewards);
 
     // Add coinbase tx as first transaction here. Will
-    pblock->vtx.push_back(coinbaseTx);
+    pblock->vtx.push_back(MakeTransactionRef(coinbaseTx));
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
 
-    // Largest block you're willing to create:
-    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
-    // Limit to between 1K and MAX_BLOCK_SIZE-1K for sanity:
-    nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MAX_BLOCK_SERIALIZED_SIZE - 1000), nBlockMaxSize));
-
-    // How much of the block should be dedicated to high-priority transactions,
-    // included regardless of the fees they pay
-    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
-    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
-    // Minimum block size you want to create; block will be filled with free transactions
-    // until there are no more or the block reaches this size:
-    unsigned int nBlockMinSize = GetArg("-blockminsize", 0);
-    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
-
-    // Collect memory pool transactions into the block
-    CTxMemPool::setEntries inBlock;
-    CTxMemPool::setEntries waitSet;
-
-    // This vector will be sorted into a priority queue:
-    vector<TxCoinAgePriority> vecPriority;
-    TxCoinAgePriorityCompare pricomparer;
-    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
-    typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
-    double actualPriority = -1;
-
-    std::priority_queue<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, ScoreCompare> clearedTxs;
-    bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
-    uint64_t nBlockSize = 1000;
-    uint64_t nBlockTx = 0;
-    unsigned int nBlockSigOps = 100;
-    int lastFewTxs = 0;
-    CAmount nFees = 0;
-
     {
         LOCK(mempool.cs);
         pblock->nTime = GetAdjustedTime();
@@ -214,574 +211,397 @@ CBlockTemplate* BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, co
         if (chainparams.MineBlocksOnDemand())
             pblock->nVersion = GetArg("-blockversion", pblock->nVersion);
 
-        int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
-                                  ? nMedianTimePast
-                                  : pblock->GetBlockTime();
+        nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                          ? nMedianTimePast
+                          : pblock->GetBlockTime();
 
-        bool fPriorityBlock = nBlockPrioritySize > 0;
-        if (fPriorityBlock) {
-            vecPriority.reserve(mempool.mapTx.size());
-            for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-                 mi != mempool.mapTx.end(); ++mi)
-            {
-                double dPriority = mi->GetPriority(nHeight);
-                CAmount dummy;
-                mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-                vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
-            }
-            std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+        addPriorityTxs();
+        addPackageTxs();
+
+        nLastBlockTx = nBlockTx;
+        nLastBlockSize = nBlockSize;
+        nLastBlockWeight = nBlockWeight;
+        LogPrintf("CreateNewBlock(): total size %u txs: %u fees: %ld sigops %d\n", nBlockSize, nBlockTx, nFees, nBlockSigOpsCost);
+
+        // Finally now that we know the fees add them to the mining reward!
+        coinbaseTx.vout[0].nValue += nFees;
+        pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+
+        // Fill in header
+        pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
+        UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
+        pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
+        pblock->nNonce         = 0;
+        pblocktemplate->vTxSigOpsCost[0] = GetLegacySigOpCount(*pblock->vtx[0]);
+        pblocktemplate->vTxFees[0] = -nFees;
+
+        CValidationState state;
+        if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+            throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
         }
+    }
+    return pblocktemplate.release();
+}
 
-        CTxMemPool::indexed_transaction_set::nth_index<3>::type::iterator mi = mempool.mapTx.get<3>().begin();
-        CTxMemPool::txiter iter;
-
-        while (mi != mempool.mapTx.get<3>().end() || !clearedTxs.empty())
-        {
-            bool priorityTx = false;
-            if (fPriorityBlock && !vecPriority.empty()) { // add a tx from priority queue to fill the blockprioritysize
-                priorityTx = true;
-                iter = vecPriority.front().second;
-                actualPriority = vecPriority.front().first;
-                std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                vecPriority.pop_back();
-            }
-            else if (clearedTxs.empty()) { // add tx with next highest score
-                iter = mempool.mapTx.project<0>(mi);
-                mi++;
-            }
-            else {  // try to add a previously postponed child tx
-                iter = clearedTxs.top();
-                clearedTxs.pop();
-            }
+bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
+{
+    BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
+    {
+        if (!inBlock.count(parent)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-            if (inBlock.count(iter)) {
-                LogPrintf("skip, due to exist!\n");
-                continue; // could have been added to the priorityBlock
-            }
+void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
+{
+    for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
+        // Only test txs not already in the block
+        if (inBlock.count(*iit)) {
+            testSet.erase(iit++);
+        }
+        else {
+            iit++;
+        }
+    }
+}
 
-            const CTransaction& tx = iter->GetTx();
-            LogPrintf("Trying to add tx=%s\n", tx.GetHash().ToString());
+bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost, uint64_t packageCount)
+{
+    // There is no witness data, the weight of a transaction is its size scaled
+    if (nBlockWeight + WITNESS_SCALE_FACTOR * packageSize >= nBlockMaxWeight)
+        return false;
+    if (nBlockSize + packageSize >= nBlockMaxSize)
+        return false;
+    if (nBlockSigOpsCost + packageSigOpsCost >= MAX_BLOCK_SIGOPS_COST)
+        return false;
+    if (nTxMaxCount > 0 && nBlockTx + packageCount > nTxMaxCount)
+        return false;
+    return true;
+}
 
-            bool fOrphan = false;
-            BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
-            {
-                if (!inBlock.count(parent)) {
-                    fOrphan = true;
-                    break;
-                }
-            }
-            if (fOrphan) {
-                if (priorityTx)
-                    waitPriMap.insert(std::make_pair(iter,actualPriority));
-                else waitSet.insert(iter);
-                LogPrintf("skip tx=%s, due to fOrphan=%s\n", tx.GetHash().ToString(), fOrphan);
-                continue;
-            }
+// Perform transaction-level checks before adding to block:
+// - transaction finality (locktime)
+bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& package)
+{
+    BOOST_FOREACH (const CTxMemPool::txiter it, package) {
+        if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
+            return false;
+    }
+    return true;
+}
 
-            unsigned int nTxSize = iter->GetTxSize();
-            if (fPriorityBlock &&
-                (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(actualPriority))) {
-                fPriorityBlock = false;
-                waitPriMap.clear();
-            }
+bool BlockAssembler::TestForBlock(CTxMemPool::txiter iter)
+{
+    if (nBlockWeight + WITNESS_SCALE_FACTOR * iter->GetTxSize() >= nBlockMaxWeight ||
+        nBlockSize + iter->GetTxSize() >= nBlockMaxSize) {
+        // If the block is so close to full that no more txs will fit
+        // or if we've tried more than 50 times to fill remaining space
+        // then flag that the block is finished
+        if (nBlockSize > nBlockMaxSize - 100 || nBlockWeight > nBlockMaxWeight - 400 || lastFewTxs > 50) {
+            blockFinished = true;
+            return false;
+        }
+        // Once we're within 1000 bytes of a full block, only look at 50 more txs
+        // to try to fill the remaining space.
+        if (nBlockSize > nBlockMaxSize - 1000 || nBlockWeight > nBlockMaxWeight - 4000) {
+            lastFewTxs++;
+        }
+        return false;
+    }
 
-            if (nBlockSize + nTxSize >= nBlockMaxSize) {
-                if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
-                    LogPrintf("tx=%s, stop due to size overweight", tx.GetHash().ToString());
-                    LogPrintf("nBlockSize=%s\n", nBlockSize);
-                    LogPrintf("nBlockMaxSize=%s\n", nBlockMaxSize);
-                    break;
-                }
-                // Once we're within 1000 bytes of a full block, only look at 50 more txs
-                // to try to fill the remaining space.
-                if (nBlockSize > nBlockMaxSize - 1000) {
-                    lastFewTxs++;
-                }
-                LogPrintf("skip tx=%s\n", tx.GetHash().ToString());
-                LogPrintf("nBlockSize=%s\n", nBlockSize);
-                LogPrintf("nBlockMaxSize=%s\n", nBlockMaxSize);
-                continue;
-            }
-            if (tx.IsCoinBase()) {
-                LogPrintf("skip tx=%s, coinbase tx\n", tx.GetHash().ToString());
-                continue;
-            }
+    if (nBlockSigOpsCost + iter->GetSigOpCount() >= MAX_BLOCK_SIGOPS_COST) {
+        // If the block has room for no more sig ops then
+        // flag that the block is finished
+        if (nBlockSigOpsCost > MAX_BLOCK_SIGOPS_COST - 2) {
+            blockFinished = true;
+            return false;
+        }
+        // Otherwise attempt to find another tx with fewer sigops
+        // to put in the block.
+        return false;
+    }
 
-            if (!IsFinalTx(tx, nHeight, nLockTimeCutoff)) {
-                LogPrintf("skip tx=%s, not IsFinalTx\n", tx.GetHash().ToString());
-                continue;
+    if (nTxMaxCount > 0 && nBlockTx >= nTxMaxCount) {
+        blockFinished = true;
+        return false;
+    }
+
+    // Must check that lock times are still valid
+    // This can be removed once MTP is always enforced
+    // as long as reorgs keep the mempool consistent.
+    if (!IsFinalTx(iter->GetTx(), nHeight, nLockTimeCutoff))
+        return false;
+
+    return true;
+}
+
+void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
+{
+    pblock->vtx.push_back(iter->GetSharedTx());
+    pblocktemplate->vTxFees.push_back(iter->GetFee());
+    pblocktemplate->vTxSigOpsCost.push_back(iter->GetSigOpCount());
+    nBlockSize += iter->GetTxSize();
+    nBlockWeight += WITNESS_SCALE_FACTOR * iter->GetTxSize();
+    ++nBlockTx;
+    nBlockSigOpsCost += iter->GetSigOpCount();
+    nFees += iter->GetFee();
+    inBlock.insert(iter);
+
+    bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
+    if (fPrintPriority) {
+        double dPriority = iter->GetPriority(nHeight);
+        CAmount dummy;
+        mempool.ApplyDeltas(iter->GetTx().GetHash(), dPriority, dummy);
+        LogPrintf("priority %.1f fee %s txid %s\n",
+                  dPriority,
+                  CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(),
+                  iter->GetTx().GetHash().ToString());
+    }
+}
+
+void BlockAssembler::InitPackages(indexed_modified_transaction_set &mapModifiedTx)
+{
+    const uint256& hashTip = chainActive.Tip()->GetBlockHash();
+    if (ancestorStateCache.hashTip != hashTip || ancestorStateCache.mapDeltas != mempool.mapDeltas) {
+        ancestorStateCache.hashTip = hashTip;
+        ancestorStateCache.mapDeltas = mempool.mapDeltas;
+        ancestorStateCache.mapState.clear();
+    }
+
+    // Entries which left the mempool get dropped from the cache on the way
+    std::map<uint256, CAncestorState> mapState;
+    size_t nReused = 0;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
+        const uint256& hash = it->GetTx().GetHash();
+        std::map<uint256, CAncestorState>::const_iterator cached = ancestorStateCache.mapState.find(hash);
+        CAncestorState state;
+        if (cached != ancestorStateCache.mapState.end()) {
+            state = cached->second;
+            nReused++;
+        } else {
+            CTxMemPool::setEntries ancestors;
+            mempool.CalculateMemPoolAncestors(*it, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+            state.nCount = ancestors.size() + 1;
+            state.nSize = it->GetTxSize();
+            state.nModFees = it->GetModifiedFee();
+            state.nSigOpCount = it->GetSigOpCount();
+            BOOST_FOREACH(CTxMemPool::txiter ancestor, ancestors) {
+                state.nSize += ancestor->GetTxSize();
+                state.nModFees += ancestor->GetModifiedFee();
+                state.nSigOpCount += ancestor->GetSigOpCount();
             }
+        }
+        // mapTx is sorted by txid as well
+        mapState.insert(mapState.end(), std::make_pair(hash, state));
+
+        if (inBlock.count(it))
+            continue;
+        CTxMemPoolModifiedEntry modEntry(it);
+        modEntry.nCountWithAncestors = state.nCount;
+        modEntry.nSizeWithAncestors = state.nSize;
+        modEntry.nModFeesWithAncestors = state.nModFees;
+        modEntry.nSigOpCountWithAncestors = state.nSigOpCount;
+        mapModifiedTx.insert(modEntry);
+    }
+    ancestorStateCache.mapState.swap(mapState);
 
-            unsigned int nTxSigOps = iter->GetSigOpCount();
-            LogPrintf("nTxSigOps=%s\n", nTxSigOps);
-            LogPrintf("nBlockSigOps=%s\n", nBlockSigOps);
-            LogPrintf("MAX_BLOCK_SIGOPS_COST=%s\n", MAX_BLOCK_SIGOPS_COST);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS_COST) {
-                if (nBlockSigOps > MAX_BLOCK_SIGOPS_COST - 2) {
-                    LogPrintf("tx=%s, stop due to cross fee\n", tx.GetHash().ToString());
-                    break;
-                }
-                LogPrintf("skip tx=%s, nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS_COST\n", tx.GetHash().ToString());
+    LogPrint("bench", "%s: ancestor state of %u of %u mempool entries reused\n", __func__, nReused, ancestorStateCache.mapState.size());
+}
+
+void BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
+        indexed_modified_transaction_set &mapModifiedTx)
+{
+    BOOST_FOREACH(const CTxMemPool::txiter it, alreadyAdded) {
+        CTxMemPool::setEntries descendants;
+        mempool.CalculateDescendants(it, descendants);
+        // Update the descendants which are still candidates for their
+        // ancestor going into the block, the ones which failed are gone
+        BOOST_FOREACH(CTxMemPool::txiter desc, descendants) {
+            if (alreadyAdded.count(desc))
                 continue;
-            }
-            CAmount nTxFees = iter->GetFee();
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOpsCost.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-            LogPrintf("added to block=%s\n", tx.GetHash().ToString());
-            if (fPrintPriority)
-            {
-                double dPriority = iter->GetPriority(nHeight);
-                CAmount dummy;
-                mempool.ApplyDeltas(tx.GetHash(), dPriority, dummy);
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                          dPriority , CFeeRate(iter->GetModifiedFee(), nTxSize).ToString(), tx.GetHash().ToString());
-            }
+            modtxiter mit = mapModifiedTx.find(desc);
+            if (mit != mapModifiedTx.end())
+                mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
+        }
+    }
+}
 
-            inBlock.insert(iter);
+void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries)
+{
+    // Sort package by ancestor count
+    // If a transaction A depends on transaction B, then A's ancestor count
+    // must be greater than B's.  So this is sufficient to validly order the
+    // transactions for block inclusion.
+    sortedEntries.clear();
+    sortedEntries.insert(sortedEntries.begin(), package.begin(), package.end());
+    std::sort(sortedEntries.begin(), sortedEntries.end(), CompareTxIterByAncestorCount());
+}
 
-            // Add transactions that depend on this one to the priority queue
-            BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
-            {
-                if (fPriorityBlock) {
-                    waitPriIter wpiter = waitPriMap.find(child);
-                    if (wpiter != waitPriMap.end()) {
-                        vecPriority.push_back(TxCoinAgePriority(wpiter->second,child));
-                        std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                        waitPriMap.erase(wpiter);
-                    }
-                }
-                else {
-                    if (waitSet.count(child)) {
-                        clearedTxs.push(child);
-                        waitSet.erase(child);
-                    }
-                }
-            }
+// This transaction selection algorithm orders the mempool based
+// on feerate of a transaction including all unconfirmed ancestors.
+// Since we don't remove transactions from the mempool as we select them
+// for block inclusion, we need an alternate method of updating the feerate
+// of a transaction with its not-yet-selected ancestors as we go.
+// All the candidates are kept in mapModifiedTx with their ancestor state,
+// which gets updated for the ancestors going into the block, so the best
+// package is always the first one of mapModifiedTx.
+void BlockAssembler::addPackageTxs()
+{
+    indexed_modified_transaction_set mapModifiedTx;
+    InitPackages(mapModifiedTx);
+
+    // Start by modifying the descendants of the priority transactions
+    // for their already included ancestors
+    UpdatePackagesForAdded(inBlock, mapModifiedTx);
+
+    // Limits the number of packages to look at once the block is nearly full
+    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+    int64_t nConsecutiveFailed = 0;
+
+    while (!mapModifiedTx.empty())
+    {
+        modtxscoreiter modit = mapModifiedTx.get<1>().begin();
+        CTxMemPool::txiter iter = modit->iter;
+
+        // mapModifiedTx shouldn't contain anything that is inBlock.
+        assert(!inBlock.count(iter));
 
-            if(nBlockTx >= nTxMaxCount && nTxMaxCount > 0){
-                LogPrintf("skip tx=%s, over the max tx count set\n", tx.GetHash().ToString());
+        uint64_t packageSize = modit->nSizeWithAncestors;
+        CAmount packageFees = modit->nModFeesWithAncestors;
+        int64_t packageSigOpsCost = modit->nSigOpCountWithAncestors;
+        uint64_t packageCount = modit->nCountWithAncestors;
+
+        if (packageFees < ::minRelayTxFee.GetFee(packageSize)) {
+            // Everything else we might consider has a lower fee rate
+            return;
+        }
+
+        if (!TestPackage(packageSize, packageSigOpsCost, packageCount)) {
+            // Since we always look at the best entry in mapModifiedTx,
+            // we must erase failed entries so that we can consider the
+            // next best entry on the next loop iteration
+            mapModifiedTx.get<1>().erase(modit);
+
+            ++nConsecutiveFailed;
+            if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockSize > nBlockMaxSize - 1000) {
+                // Give up if we're close to full and haven't succeeded in a while
                 break;
             }
+            continue;
         }
 
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
-        LogPrintf("CreateNewBlock(): total size %u txs: %u fees: %ld sigops %d\n", nBlockSize, nBlockTx, nFees, nBlockSigOps);
+        CTxMemPool::setEntries ancestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
 
-        // Finally now that we know the fees add them to the mining reward!
-        pblock->vtx[0].vout[0].nValue += nFees;
+        onlyUnconfirmed(ancestors);
+        ancestors.insert(iter);
 
-        // Fill in header
-        pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
-        UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
-        pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
-        pblock->nNonce         = 0;
-        pblocktemplate->vTxSigOpsCost[0] = GetLegacySigOpCount(pblock->vtx[0]);
-        pblocktemplate->vTxFees[0] = -nFees;
+        // Test if all tx's are Final
+        if (!TestPackageTransactions(ancestors)) {
+            mapModifiedTx.get<1>().erase(modit);
+            continue;
+        }
 
-        CValidationState state;
-        if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
-            throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+        // This transaction will make it in; reset the failed counter.
+        nConsecutiveFailed = 0;
+
+        // Package can be added. Sort the entries in a valid order.
+        vector<CTxMemPool::txiter> sortedEntries;
+        SortForBlock(ancestors, sortedEntries);
+
+        for (size_t i=0; i<sortedEntries.size(); ++i) {
+            AddToBlock(sortedEntries[i]);
+            // Erase from the modified set, if present
+            mapModifiedTx.erase(sortedEntries[i]);
         }
+
+        // Update transactions that depend on each of these
+        UpdatePackagesForAdded(ancestors, mapModifiedTx);
+
+        if (nTxMaxCount > 0 && nBlockTx >= nTxMaxCount)
+            break;
     }
-    return pblocktemplate.release();
 }
 
-// bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
-// {
-//     BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
-//     {
-//         if (!inBlock.count(parent)) {
-//             return true;
-//         }
-//     }
-//     return false;
-// }
-
-// void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
-// {
-//     for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
-//         // Only test txs not already in the block
-//         if (inBlock.count(*iit)) {
-//             testSet.erase(iit++);
-//         }
-//         else {
-//             iit++;
-//         }
-//     }
-// }
-
-// bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost)
-// {
-//     // TODO: switch to weight-based accounting for packages instead of vsize-based accounting.
-//     if (nBlockWeight + WITNESS_SCALE_FACTOR * packageSize >= nBlockMaxWeight)
-//         return false;
-//     if (nBlockSigOpsCost + packageSigOpsCost >= MAX_BLOCK_SIGOPS_COST)
-//         return false;
-//     return true;
-// }
-
-// // Perform transaction-level checks before adding to block:
-// // - transaction finality (locktime)
-// // - premature witness (in case segwit transactions are added to mempool before
-// //   segwit activation)
-// // - serialized size (in case -blockmaxsize is in use)
-// bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& package)
-// {
-//     uint64_t nPotentialBlockSize = nBlockSize; // only used with fNeedSizeAccounting
-//     BOOST_FOREACH (const CTxMemPool::txiter it, package) {
-//         if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
-//             return false;
-//         if (!fIncludeWitness && !it->GetTx().wit.IsNull())
-//             return false;
-//         if (fNeedSizeAccounting) {
-//             uint64_t nTxSize = ::GetSerializeSize(it->GetTx(), SER_NETWORK, PROTOCOL_VERSION);
-//             if (nPotentialBlockSize + nTxSize >= nBlockMaxSize) {
-//                 return false;
-//             }
-//             nPotentialBlockSize += nTxSize;
-//         }
-//     }
-//     return true;
-// }
-
-// bool BlockAssembler::TestForBlock(CTxMemPool::txiter iter)
-// {
-//     if (nBlockWeight + iter->GetTxWeight() >= nBlockMaxWeight) {
-//         // If the block is so close to full that no more txs will fit
-//         // or if we've tried more than 50 times to fill remaining space
-//         // then flag that the block is finished
-//         if (nBlockWeight >  nBlockMaxWeight - 400 || lastFewTxs > 50) {
-//              blockFinished = true;
-//              return false;
-//         }
-//         // Once we're within 4000 weight of a full block, only look at 50 more txs
-//         // to try to fill the remaining space.
-//         if (nBlockWeight > nBlockMaxWeight - 4000) {
-//             lastFewTxs++;
-//         }
-//         return false;
-//     }
-
-//     if (fNeedSizeAccounting) {
-//         if (nBlockSize + ::GetSerializeSize(iter->GetTx(), SER_NETWORK, PROTOCOL_VERSION) >= nBlockMaxSize) {
-//             if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
-//                  blockFinished = true;
-//                  return false;
-//             }
-//             if (nBlockSize > nBlockMaxSize - 1000) {
-//                 lastFewTxs++;
-//             }
-//             return false;
-//         }
-//     }
-
-//     if (nBlockSigOpsCost + iter->GetSigOpCost() >= MAX_BLOCK_SIGOPS_COST) {
-//         // If the block has room for no more sig ops then
-//         // flag that the block is finished
-//         if (nBlockSigOpsCost > MAX_BLOCK_SIGOPS_COST - 8) {
-//             blockFinished = true;
-//             return false;
-//         }
-//         // Otherwise attempt to find another tx with fewer sigops
-//         // to put in the block.
-//         return false;
-//     }
-
-//     // Must check that lock times are still valid
-//     // This can be removed once MTP is always enforced
-//     // as long as reorgs keep the mempool consistent.
-//     if (!IsFinalTx(iter->GetTx(), nHeight, nLockTimeCutoff))
-//         return false;
-
-//     return true;
-// }
-
-// void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
-// {
-//     pblock->vtx.push_back(iter->GetTx());
-//     pblocktemplate->vTxFees.push_back(iter->GetFee());
-//     pblocktemplate->vTxSigOpsCost.push_back(iter->GetSigOpCost());
-//     if (fNeedSizeAccounting) {
-//         nBlockSize += ::GetSerializeSize(iter->GetTx(), SER_NETWORK, PROTOCOL_VERSION);
-//     }
-//     nBlockWeight += iter->GetTxWeight();
-//     ++nBlockTx;
-//     nBlockSigOpsCost += iter->GetSigOpCost();
-//     nFees += iter->GetFee();
-//     inBlock.insert(iter);
-
-//     bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
-//     if (fPrintPriority) {
-//         double dPriority = iter->GetPriority(nHeight);
-//         CAmount dummy;
-//         mempool.ApplyDeltas(iter->GetTx().GetHash(), dPriority, dummy);
-//         LogPrintf("priority %.1f fee %s txid %s\n",
-//                   dPriority,
-//                   CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(),
-//                   iter->GetTx().GetHash().ToString());
-//     }
-// }
-
-// void BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
-//         indexed_modified_transaction_set &mapModifiedTx)
-// {
-//     BOOST_FOREACH(const CTxMemPool::txiter it, alreadyAdded) {
-//         CTxMemPool::setEntries descendants;
-//         mempool.CalculateDescendants(it, descendants);
-//         // Insert all descendants (not yet in block) into the modified set
-//         BOOST_FOREACH(CTxMemPool::txiter desc, descendants) {
-//             if (alreadyAdded.count(desc))
-//                 continue;
-//             modtxiter mit = mapModifiedTx.find(desc);
-//             if (mit == mapModifiedTx.end()) {
-//                 CTxMemPoolModifiedEntry modEntry(desc);
-//                 modEntry.nSizeWithAncestors -= it->GetTxSize();
-//                 modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
-//                 modEntry.nSigOpCostWithAncestors -= it->GetSigOpCost();
-//                 mapModifiedTx.insert(modEntry);
-//             } else {
-//                 mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
-//             }
-//         }
-//     }
-// }
-
-// // Skip entries in mapTx that are already in a block or are present
-// // in mapModifiedTx (which implies that the mapTx ancestor state is
-// // stale due to ancestor inclusion in the block)
-// // Also skip transactions that we've already failed to add. This can happen if
-// // we consider a transaction in mapModifiedTx and it fails: we can then
-// // potentially consider it again while walking mapTx.  It's currently
-// // guaranteed to fail again, but as a belt-and-suspenders check we put it in
-// // failedTx and avoid re-evaluation, since the re-evaluation would be using
-// // cached size/sigops/fee values that are not actually correct.
-// bool BlockAssembler::SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx)
-// {
-//     assert (it != mempool.mapTx.end());
-//     if (mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it))
-//         return true;
-//     return false;
-// }
-
-// void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemPool::txiter entry, std::vector<CTxMemPool::txiter>& sortedEntries)
-// {
-//     // Sort package by ancestor count
-//     // If a transaction A depends on transaction B, then A's ancestor count
-//     // must be greater than B's.  So this is sufficient to validly order the
-//     // transactions for block inclusion.
-//     sortedEntries.clear();
-//     sortedEntries.insert(sortedEntries.begin(), package.begin(), package.end());
-//     std::sort(sortedEntries.begin(), sortedEntries.end(), CompareTxIterByAncestorCount());
-// }
-
-// // This transaction selection algorithm orders the mempool based
-// // on feerate of a transaction including all unconfirmed ancestors.
-// // Since we don't remove transactions from the mempool as we select them
-// // for block inclusion, we need an alternate method of updating the feerate
-// // of a transaction with its not-yet-selected ancestors as we go.
-// // This is accomplished by walking the in-mempool descendants of selected
-// // transactions and storing a temporary modified state in mapModifiedTxs.
-// // Each time through the loop, we compare the best transaction in
-// // mapModifiedTxs with the next transaction in the mempool to decide what
-// // transaction package to work on next.
-// void BlockAssembler::addPackageTxs()
-// {
-//     // mapModifiedTx will store sorted packages after they are modified
-//     // because some of their txs are already in the block
-//     indexed_modified_transaction_set mapModifiedTx;
-//     // Keep track of entries that failed inclusion, to avoid duplicate work
-//     CTxMemPool::setEntries failedTx;
-
-//     // Start by adding all descendants of previously added txs to mapModifiedTx
-//     // and modifying them for their already included ancestors
-//     UpdatePackagesForAdded(inBlock, mapModifiedTx);
-
-//     CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
-//     CTxMemPool::txiter iter;
-//     while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
-//     {
-//         // First try to find a new transaction in mapTx to evaluate.
-//         if (mi != mempool.mapTx.get<ancestor_score>().end() &&
-//                 SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
-//             ++mi;
-//             continue;
-//         }
-
-//         // Now that mi is not stale, determine which transaction to evaluate:
-//         // the next entry from mapTx, or the best from mapModifiedTx?
-//         bool fUsingModified = false;
-
-//         modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
-//         if (mi == mempool.mapTx.get<ancestor_score>().end()) {
-//             // We're out of entries in mapTx; use the entry from mapModifiedTx
-//             iter = modit->iter;
-//             fUsingModified = true;
-//         } else {
-//             // Try to compare the mapTx entry to the mapModifiedTx entry
-//             iter = mempool.mapTx.project<0>(mi);
-//             if (modit != mapModifiedTx.get<ancestor_score>().end() &&
-//                     CompareModifiedEntry()(*modit, CTxMemPoolModifiedEntry(iter))) {
-//                 // The best entry in mapModifiedTx has higher score
-//                 // than the one from mapTx.
-//                 // Switch which transaction (package) to consider
-//                 iter = modit->iter;
-//                 fUsingModified = true;
-//             } else {
-//                 // Either no entry in mapModifiedTx, or it's worse than mapTx.
-//                 // Increment mi for the next loop iteration.
-//                 ++mi;
-//             }
-//         }
-
-//         // We skip mapTx entries that are inBlock, and mapModifiedTx shouldn't
-//         // contain anything that is inBlock.
-//         assert(!inBlock.count(iter));
-
-//         uint64_t packageSize = iter->GetSizeWithAncestors();
-//         CAmount packageFees = iter->GetModFeesWithAncestors();
-//         int64_t packageSigOpsCost = iter->GetSigOpCostWithAncestors();
-//         if (fUsingModified) {
-//             packageSize = modit->nSizeWithAncestors;
-//             packageFees = modit->nModFeesWithAncestors;
-//             packageSigOpsCost = modit->nSigOpCostWithAncestors;
-//         }
-
-//         if (packageFees < ::minRelayTxFee.GetFee(packageSize)) {
-//             // Everything else we might consider has a lower fee rate
-//             return;
-//         }
-
-//         if (!TestPackage(packageSize, packageSigOpsCost)) {
-//             if (fUsingModified) {
-//                 // Since we always look at the best entry in mapModifiedTx,
-//                 // we must erase failed entries so that we can consider the
-//                 // next best entry on the next loop iteration
-//                 mapModifiedTx.get<ancestor_score>().erase(modit);
-//                 failedTx.insert(iter);
-//             }
-//             continue;
-//         }
-
-//         CTxMemPool::setEntries ancestors;
-//         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-//         std::string dummy;
-//         mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-
-//         onlyUnconfirmed(ancestors);
-//         ancestors.insert(iter);
-
-//         // Test if all tx's are Final
-//         if (!TestPackageTransactions(ancestors)) {
-//             if (fUsingModified) {
-//                 mapModifiedTx.get<ancestor_score>().erase(modit);
-//                 failedTx.insert(iter);
-//             }
-//             continue;
-//         }
-
-//         // Package can be added. Sort the entries in a valid order.
-//         vector<CTxMemPool::txiter> sortedEntries;
-//         SortForBlock(ancestors, iter, sortedEntries);
-
-//         for (size_t i=0; i<sortedEntries.size(); ++i) {
-//             AddToBlock(sortedEntries[i]);
-//             // Erase from the modified set, if present
-//             mapModifiedTx.erase(sortedEntries[i]);
-//         }
-
-//         // Update transactions that depend on each of these
-//         UpdatePackagesForAdded(ancestors, mapModifiedTx);
-//     }
-// }
-
-// void BlockAssembler::addPriorityTxs()
-// {
-//     // How much of the block should be dedicated to high-priority transactions,
-//     // included regardless of the fees they pay
-//     unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
-//     nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
-//     if (nBlockPrioritySize == 0) {
-//         return;
-//     }
-
-//     bool fSizeAccounting = fNeedSizeAccounting;
-//     fNeedSizeAccounting = true;
-
-//     // This vector will be sorted into a priority queue:
-//     vector<TxCoinAgePriority> vecPriority;
-//     TxCoinAgePriorityCompare pricomparer;
-//     std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
-//     typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
-//     double actualPriority = -1;
-
-//     vecPriority.reserve(mempool.mapTx.size());
-//     for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-//          mi != mempool.mapTx.end(); ++mi)
-//     {
-//         double dPriority = mi->GetPriority(nHeight);
-//         CAmount dummy;
-//         mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-//         vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
-//     }
-//     std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-
-//     CTxMemPool::txiter iter;
-//     while (!vecPriority.empty() && !blockFinished) { // add a tx from priority queue to fill the blockprioritysize
-//         iter = vecPriority.front().second;
-//         actualPriority = vecPriority.front().first;
-//         std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-//         vecPriority.pop_back();
-
-//         // If tx already in block, skip
-//         if (inBlock.count(iter)) {
-//             assert(false); // shouldn't happen for priority txs
-//             continue;
-//         }
-
-//         // cannot accept witness transactions into a non-witness block
-//         if (!fIncludeWitness && !iter->GetTx().wit.IsNull())
-//             continue;
-
-//         // If tx is dependent on other mempool txs which haven't yet been included
-//         // then put it in the waitSet
-//         if (isStillDependent(iter)) {
-//             waitPriMap.insert(std::make_pair(iter, actualPriority));
-//             continue;
-//         }
-
-//         // If this tx fits in the block add it, otherwise keep looping
-//         if (TestForBlock(iter)) {
-//             AddToBlock(iter);
-
-//             // If now that this txs is added we've surpassed our desired priority size
-//             // or have dropped below the AllowFreeThreshold, then we're done adding priority txs
-//             if (nBlockSize >= nBlockPrioritySize || !AllowFree(actualPriority)) {
-//                 break;
-//             }
-
-//             // This tx was successfully added, so
-//             // add transactions that depend on this one to the priority queue to try again
-//             BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
-//             {
-//                 waitPriIter wpiter = waitPriMap.find(child);
-//                 if (wpiter != waitPriMap.end()) {
-//                     vecPriority.push_back(TxCoinAgePriority(wpiter->second,child));
-//                     std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-//                     waitPriMap.erase(wpiter);
-//                 }
-//             }
-//         }
-//     }
-//     fNeedSizeAccounting = fSizeAccounting;
-// }
+void BlockAssembler::addPriorityTxs()
+{
+    // How much of the block should be dedicated to high-priority transactions,
+    // included regardless of the fees they pay
+    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
+    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
+
+    if (nBlockPrioritySize == 0) {
+        return;
+    }
+
+    // This vector will be sorted into a priority queue:
+    vector<TxCoinAgePriority> vecPriority;
+    TxCoinAgePriorityCompare pricomparer;
+    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
+    typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
+    double actualPriority = -1;
+
+    vecPriority.reserve(mempool.mapTx.size());
+    for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
+         mi != mempool.mapTx.end(); ++mi)
+    {
+        double dPriority = mi->GetPriority(nHeight);
+        CAmount dummy;
+        mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
+        vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
+    }
+    std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+
+    CTxMemPool::txiter iter;
+    while (!vecPriority.empty() && !blockFinished) { // add a tx from priority queue to fill the blockprioritysize
+        iter = vecPriority.front().second;
+        actualPriority = vecPriority.front().first;
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+        vecPriority.pop_back();
+
+        // If tx already in block, skip
+        if (inBlock.count(iter)) {
+            assert(false); // shouldn't happen for priority txs
+            continue;
+        }
+
+        // If tx is dependent on other mempool txs which haven't yet been included
+        // then put it in the waitSet
+        if (isStillDependent(iter)) {
+            waitPriMap.insert(std::make_pair(iter, actualPriority));
+            continue;
+        }
+
+        // If this tx fits in the block add it, otherwise keep looping
+        if (TestForBlock(iter)) {
+            AddToBlock(iter);
+
+            // If now that this txs is added we've surpassed our desired priority size
+            // or have dropped below the AllowFreeThreshold, then we're done adding priority txs
+            if (nBlockSize >= nBlockPrioritySize || !AllowFree(actualPriority)) {
+                break;
+            }
+
+            // This tx was successfully added, so
+            // add transactions that depend on this one to the priority queue to try again
+            BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
+            {
+                waitPriIter wpiter = waitPriMap.find(child);
+                if (wpiter != waitPriMap.end()) {
+                    vecPriority.push_back(TxCoinAgePriority(wpiter->second,child));
+                    std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+                    waitPriMap.erase(wpiter);
+                }
+            }
+        }
+    }
+}
 
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
@@ -794,18 +614,53 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     }
     ++nExtraNonce;
     unsigned int nHeight = pindexPrev->nHeight+1; // Height first in coinbase required for block.version=2
-    CMutableTransaction txCoinbase(pblock->vtx[0]);
+    CMutableTransaction txCoinbase(*pblock->vtx[0]);
     txCoinbase.vin[0].scriptSig = (CScript() << nHeight << CScriptNum(nExtraNonce)) + COINBASE_FLAGS;
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
-    pblock->vtx[0] = txCoinbase;
+    pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);}
 
+bool ScanHash(CBlockHeader& header, uint32_t nNonceEnd, const arith_uint256& hashTarget, uint64_t& nHashesDone)
+{
+    // The fields GetHash hashes, nVersion up to nNonce. The header fits in
+    // one Keccak block, so there is no midstate to keep: the header gets laid
+    // out once per batch and only the nonces are written for each round.
+    static const size_t HEADER_HASH_SIZE = 80;
+    static const size_t NONCE_OFFSET = HEADER_HASH_SIZE - sizeof(header.nNonce);
+    assert(END(header.nNonce) - BEGIN(header.nVersion) == (ptrdiff_t)HEADER_HASH_SIZE);
+
+    unsigned char vData[SCAN_HASH_BATCH * HEADER_HASH_SIZE];
+    uint256 vHashes[SCAN_HASH_BATCH];
+    for (size_t i = 0; i < SCAN_HASH_BATCH; i++)
+        memcpy(&vData[i * HEADER_HASH_SIZE], BEGIN(header.nVersion), HEADER_HASH_SIZE);
+
+    while (header.nNonce < nNonceEnd) {
+        size_t nCount = std::min<uint32_t>(SCAN_HASH_BATCH, nNonceEnd - header.nNonce);
+        for (size_t i = 0; i < nCount; i++) {
+            uint32_t nNonce = header.nNonce + i;
+            memcpy(&vData[i * HEADER_HASH_SIZE + NONCE_OFFSET], &nNonce, sizeof(nNonce));
+        }
+        HashKeccakMany(vHashes, vData, nCount);
+
+        for (size_t i = 0; i < nCount; i++) {
+            if (UintToArith256(vHashes[i]) <= hashTarget) {
+                header.nNonce += i;
+                nHashesDone += i + 1;
+                return true;
+            }
+        }
+        header.nNonce += nCount;
+        nHashesDone += nCount;
+    }
+    return false;
+}
+
 
 static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainparams)
 {
     LogPrintf("%s\n", pblock->ToString());
-    LogPrintf("generated %s\n", FormatMoney(pblock->vtx[0].vout[0].nValue));
+    LogPrintf("generated %s\n", FormatMoney(pblock->vtx[0]->vout[0].nValue));
 
     // Found a solution
     {
@@ -824,8 +679,7 @@ static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainpar
     return true;
 }
 
-// ***TODO*** that part changed in bitcoin, we are using a mix with old one here for now
-void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
+void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman, int nThread, int nThreads)
 {
     LogPrintf("SmartCashMiner -- started\n");
     SetThreadPriority(THREAD_PRIORITY_LOWEST);
@@ -833,6 +687,11 @@ void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
 
     unsigned int nExtraNonce = 0;
 
+    // The threads work on the same coinbase, each one searches a range of
+    // the nonces of its own
+    const uint32_t nNonceBegin = (uint64_t)MINER_NONCE_END * nThread / nThreads;
+    const uint32_t nNonceEnd = (uint64_t)MINER_NONCE_END * (nThread + 1) / nThreads;
+
     boost::shared_ptr<CReserveScript> coinbaseScript;
     GetMainSignals().ScriptForMining(coinbaseScript);
 
@@ -863,8 +722,8 @@ void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
             CBlockIndex* pindexPrev = chainActive.Tip();
             if(!pindexPrev) break;
 
-            static CBlockTemplate* pblocktemplate = BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript, nullptr);
-            if (!pblocktemplate)
+            std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript, CSmartAddress()));
+            if (!pblocktemplate.get())
             {
                 LogPrintf("SmartCashMiner -- Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
                 return;
@@ -880,34 +739,29 @@ void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
             //
             int64_t nStart = GetTime();
             arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
+            pblock->nNonce = nNonceBegin;
             while (true)
             {
-                unsigned int nHashesDone = 0;
+                uint64_t nHashesDone = 0;
 
-                uint256 hash;
-                while (true)
+                // Hash a round of nonces in batches before looking around
+                uint32_t nRoundEnd = std::min<uint64_t>(nNonceEnd, (uint64_t)pblock->nNonce + MINER_ROUND_NONCES);
+                if (ScanHash(*pblock, nRoundEnd, hashTarget, nHashesDone))
                 {
-                    hash = pblock->GetHash();
-                    if (UintToArith256(hash) <= hashTarget)
-                    {
-                        // Found a solution
-                        SetThreadPriority(THREAD_PRIORITY_NORMAL);
-                        LogPrintf("SmartCashMiner:\n  proof-of-work found\n  hash: %s\n  target: %s\n", hash.GetHex(), hashTarget.GetHex());
-                        ProcessBlockFound(pblock, chainparams);
-                        SetThreadPriority(THREAD_PRIORITY_LOWEST);
-                        coinbaseScript->KeepScript();
-
-                        // In regression test mode, stop mining after a block is found. This
-                        // allows developers to controllably generate a block on demand.
-                        if (chainparams.MineBlocksOnDemand())
-                            throw boost::thread_interrupted();
+                    // Found a solution
+                    uint256 hash = pblock->GetHash();
+                    SetThreadPriority(THREAD_PRIORITY_NORMAL);
+                    LogPrintf("SmartCashMiner:\n  proof-of-work found\n  hash: %s\n  target: %s\n", hash.GetHex(), hashTarget.GetHex());
+                    ProcessBlockFound(pblock, chainparams);
+                    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+                    coinbaseScript->KeepScript();
+
+                    // In regression test mode, stop mining after a block is found. This
+                    // allows developers to controllably generate a block on demand.
+                    if (chainparams.MineBlocksOnDemand())
+                        throw boost::thread_interrupted();
 
-                        break;
-                    }
-                    pblock->nNonce += 1;
-                    nHashesDone += 1;
-                    if ((pblock->nNonce & 0xFF) == 0)
-                        break;
+                    break;
                 }
 
                 // Check for stop or if block needs to be rebuilt
@@ -915,7 +769,7 @@ void static BitcoinMiner(const CChainParams& chainparams, CConnman& connman)
                 // Regtest mode doesn't require peers
                 if (connman.GetNodeCount(CConnman::CONNECTIONS_ALL) == 0 && chainparams.MiningRequiresPeers())
                     break;
-                if (pblock->nNonce >= 0xffff0000)
+                if (pblock->nNonce >= nNonceEnd)
                     break;
                 if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60)
                     break;
@@ -965,5 +819,5 @@ void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainpar
 
     minerThreads = new boost::thread_group();
     for (int i = 0; i < nThreads; i++)
-        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams), boost::ref(connman)));
+        minerThreads->create_thread(boost::bind(&BitcoinMiner, boost::cref(chainparams), boost::ref(connman), i, nThreads));
 }
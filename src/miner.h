@@ -15,6 +15,7 @@
 #include "boost/multi_index/ordered_index.hpp"
 #include "smarthive/hive.h"
 
+class arith_uint256;
 class CBlockIndex;
 class CChainParams;
 class CConnman;
@@ -29,6 +30,13 @@ static const int DEFAULT_GENERATE_THREADS = 1;
 
 static const bool DEFAULT_PRINTPRIORITY = false;
 
+/** The number of headers ScanHash hashes at once */
+static const size_t SCAN_HASH_BATCH = 64;
+/** Nonces a miner thread hashes before it checks for a new tip or template */
+static const uint32_t MINER_ROUND_NONCES = 0x1000;
+/** The miner threads split the nonces below this one, the extra nonce changes past it */
+static const uint32_t MINER_NONCE_END = 0xffff0000;
+
 struct CBlockTemplate
 {
     CBlock block;
@@ -41,102 +49,92 @@ struct CBlockTemplate
 void GenerateBitcoins(bool fGenerate, int nThreads, const CChainParams& chainparams, CConnman& connman);
 
 // Container for tracking updates to ancestor feerate as we include (parent)
-// transactions in a block
-// struct CTxMemPoolModifiedEntry {
-//     CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
-//     {
-//         iter = entry;
-//         nSizeWithAncestors = entry->GetSizeWithAncestors();
-//         nModFeesWithAncestors = entry->GetModFeesWithAncestors();
-//         nSigOpCostWithAncestors = entry->GetSigOpCostWithAncestors();
-//     }
-
-//     CTxMemPool::txiter iter;
-//     uint64_t nSizeWithAncestors;
-//     CAmount nModFeesWithAncestors;
-//     int64_t nSigOpCostWithAncestors;
-// };
+// transactions in a block. The mempool doesn't keep the ancestor state of its
+// entries, it gets summed up from CalculateMemPoolAncestors() while
+// assembling.
+struct CTxMemPoolModifiedEntry {
+    CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
+    {
+        iter = entry;
+        nCountWithAncestors = 1;
+        nSizeWithAncestors = entry->GetTxSize();
+        nModFeesWithAncestors = entry->GetModifiedFee();
+        nSigOpCountWithAncestors = entry->GetSigOpCount();
+    }
+
+    CTxMemPool::txiter iter;
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    int64_t nSigOpCountWithAncestors;
+};
 
 /** Comparator for CTxMemPool::txiter objects.
  *  It simply compares the internal memory address of the CTxMemPoolEntry object
  *  pointed to. This means it has no meaning, and is only useful for using them
  *  as key in other indexes.
  */
-// struct CompareCTxMemPoolIter {
-//     bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
-//     {
-//         return &(*a) < &(*b);
-//     }
-// };
-
-// struct modifiedentry_iter {
-//     typedef CTxMemPool::txiter result_type;
-//     result_type operator() (const CTxMemPoolModifiedEntry &entry) const
-//     {
-//         return entry.iter;
-//     }
-// };
-
-// This matches the calculation in CompareTxMemPoolEntryByAncestorFee,
-// except operating on CTxMemPoolModifiedEntry.
-// TODO: refactor to avoid duplication of this logic.
-// struct CompareModifiedEntry {
-//     bool operator()(const CTxMemPoolModifiedEntry &a, const CTxMemPoolModifiedEntry &b)
-//     {
-//         double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
-//         double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
-//         if (f1 == f2) {
-//             return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
-//         }
-//         return f1 > f2;
-//     }
-// };
-
-// A comparator that sorts transactions based on number of ancestors.
-// This is sufficient to sort an ancestor package in an order that is valid
-// to appear in a block.
-// struct CompareTxIterByAncestorCount {
-//     bool operator()(const CTxMemPool::txiter &a, const CTxMemPool::txiter &b)
-//     {
-//         if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
-//             return a->GetCountWithAncestors() < b->GetCountWithAncestors();
-//         return CTxMemPool::CompareIteratorByHash()(a, b);
-//     }
-// };
-
-// typedef boost::multi_index_container<
-//     CTxMemPoolModifiedEntry,
-//     boost::multi_index::indexed_by<
-//         boost::multi_index::ordered_unique<
-//             modifiedentry_iter,
-//             CompareCTxMemPoolIter
-//         >,
-//         // sorted by modified ancestor fee rate
-//         boost::multi_index::ordered_non_unique<
-//             // Reuse same tag from CTxMemPool's similar index
-//             boost::multi_index::tag<ancestor_score>,
-//             boost::multi_index::identity<CTxMemPoolModifiedEntry>,
-//             CompareModifiedEntry
-//         >
-//     >
-// > indexed_modified_transaction_set;
-
-// typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
-// typedef indexed_modified_transaction_set::index<ancestor_score>::type::iterator modtxscoreiter;
-
-// struct update_for_parent_inclusion
-// {
-//     update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
-
-//     void operator() (CTxMemPoolModifiedEntry &e)
-//     {
-//         e.nModFeesWithAncestors -= iter->GetFee();
-//         e.nSizeWithAncestors -= iter->GetTxSize();
-//         e.nSigOpCostWithAncestors -= iter->GetSigOpCost();
-//     }
-
-//     CTxMemPool::txiter iter;
-// };
+struct CompareCTxMemPoolIter {
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        return &(*a) < &(*b);
+    }
+};
+
+struct modifiedentry_iter {
+    typedef CTxMemPool::txiter result_type;
+    result_type operator() (const CTxMemPoolModifiedEntry &entry) const
+    {
+        return entry.iter;
+    }
+};
+
+// Sort by the feerate of a transaction including its ancestors which are
+// not in the block yet, in descending order.
+struct CompareModifiedEntry {
+    bool operator()(const CTxMemPoolModifiedEntry &a, const CTxMemPoolModifiedEntry &b) const
+    {
+        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
+        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
+        if (f1 == f2) {
+            return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
+        }
+        return f1 > f2;
+    }
+};
+
+typedef boost::multi_index_container<
+    CTxMemPoolModifiedEntry,
+    boost::multi_index::indexed_by<
+        boost::multi_index::ordered_unique<
+            modifiedentry_iter,
+            CompareCTxMemPoolIter
+        >,
+        // sorted by modified ancestor fee rate
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
+            CompareModifiedEntry
+        >
+    >
+> indexed_modified_transaction_set;
+
+typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
+typedef indexed_modified_transaction_set::nth_index<1>::type::iterator modtxscoreiter;
+
+struct update_for_parent_inclusion
+{
+    update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
+
+    void operator() (CTxMemPoolModifiedEntry &e)
+    {
+        e.nModFeesWithAncestors -= iter->GetModifiedFee();
+        e.nSizeWithAncestors -= iter->GetTxSize();
+        e.nSigOpCountWithAncestors -= iter->GetSigOpCount();
+        e.nCountWithAncestors--;
+    }
+
+    CTxMemPool::txiter iter;
+};
 
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler
@@ -197,24 +195,29 @@ private:
     /** Remove confirmed (inBlock) entries from given set */
     void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
     /** Test if a new package would "fit" in the block */
-    bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost);
-    /** Perform checks on each transaction in a package:
-      * locktime, premature-witness, serialized size (if necessary)
+    bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost, uint64_t packageCount);
+    /** Perform checks on each transaction in a package: locktime.
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries& package);
-    /** Return true if given transaction from mapTx has already been evaluated,
-      * or if the transaction's cached data in mapTx is incorrect. */
-    //bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx);
+    /** Fill mapModifiedTx with all mempool entries and the state of their
+      * in-mempool ancestors, reusing what got summed up for the last
+      * template on the same tip. */
+    void InitPackages(indexed_modified_transaction_set &mapModifiedTx);
     /** Sort the package in an order that is valid to appear in a block */
-    void SortForBlock(const CTxMemPool::setEntries& package, CTxMemPool::txiter entry, std::vector<CTxMemPool::txiter>& sortedEntries);
-    /** Add descendants of given transactions to mapModifiedTx with ancestor
-      * state updated assuming given transactions are inBlock. */
-    //void UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
+    void SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries);
+    /** Update the entries of mapModifiedTx which descend from the given
+      * transactions for their ancestor state assuming these are inBlock. */
+    void UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
+/** Search the nonces of header from its nNonce up to nNonceEnd for a hash at
+ *  or below hashTarget, SCAN_HASH_BATCH at a time with HashKeccakMany.
+ *  Returns true with nNonce being the one found, false with it at nNonceEnd.
+ *  nHashesDone gets the number of hashes added. */
+bool ScanHash(CBlockHeader& header, uint32_t nNonceEnd, const arith_uint256& hashTarget, uint64_t& nHashesDone);
 
 #endif // BITCOIN_MINER_H
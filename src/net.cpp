@@ -19,6 +19,8 @@
 #include "hash.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
+#include "taskpool.h"
+#include "trace.h"
 #include "ui_interface.h"
 #include "utilstrencodings.h"
 
@@ -32,6 +34,12 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#elif defined(USE_KQUEUE)
+#include <sys/event.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -72,6 +80,11 @@ constexpr const CConnman::CAllNodes CConnman::AllNodes;
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL; // SHA256("localhostnonce")[0:8]
+
+/** Milliseconds the socket handler waits for socket events at most, it checks on the nodes as often */
+static const int SOCKET_EVENTS_TIMEOUT = 50;
+/** Number of socket events taken at once */
+static const int MAX_SOCKET_EVENTS = 256;
 //
 // Global state variables
 //
@@ -416,6 +429,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
 
 void CConnman::DumpBanlist()
 {
+    LOCK(cs_dumpData);
     SweepBanned(); // clean unused entries (if bantime has expired)
 
     if (!BannedSetIsDirty())
@@ -632,6 +646,102 @@ void CNode::SetAddrLocal(const CService& addrLocalIn) {
     }
 }
 
+const int64_t CNetMsgCmdStats::TIME_BUCKET_BOUNDS[CNetMsgCmdStats::NUM_TIME_BUCKETS - 1] = {10, 100, 1000, 10000, 100000, 1000000};
+
+void CNetMsgCmdStats::Add(int64_t nTimeIn, bool fRejected, int nBanScoreIn)
+{
+    nMessages++;
+    nTime += nTimeIn;
+    nMaxTime = std::max(nMaxTime, nTimeIn);
+    int nBucket = 0;
+    while (nBucket < NUM_TIME_BUCKETS - 1 && nTimeIn >= TIME_BUCKET_BOUNDS[nBucket])
+        nBucket++;
+    vTimeBuckets[nBucket]++;
+    if (fRejected || nBanScoreIn > 0)
+        nRejected++;
+    nBanScore += nBanScoreIn;
+}
+
+void CNetMsgCmdStats::Add(const CNetMsgCmdStats& other)
+{
+    nMessages += other.nMessages;
+    nTime += other.nTime;
+    nMaxTime = std::max(nMaxTime, other.nMaxTime);
+    for (int i = 0; i < NUM_TIME_BUCKETS; i++)
+        vTimeBuckets[i] += other.vTimeBuckets[i];
+    nRejected += other.nRejected;
+    nBanScore += other.nBanScore;
+}
+
+static void NoCleanup(CProcessedNetMsg*) {}
+static boost::thread_specific_ptr<CProcessedNetMsg> processedNetMsg(NoCleanup);
+
+CProcessedNetMsg::CProcessedNetMsg(CNode* pnodeIn, const std::string& strCommandIn) :
+    pnode(pnodeIn), strCommand(strCommandIn), nStart(GetTimeMicros()), pprev(processedNetMsg.get()),
+    fQueued(false), fRejected(false), nBanScore(0)
+{
+    processedNetMsg.reset(this);
+}
+
+CProcessedNetMsg::~CProcessedNetMsg()
+{
+    processedNetMsg.reset(pprev);
+    if (!fQueued)
+        pnode->RecordProcessedMsg(strCommand, GetTimeMicros() - nStart, fRejected, nBanScore);
+}
+
+CProcessedNetMsg* CProcessedNetMsg::Current()
+{
+    return processedNetMsg.get();
+}
+
+NodeId CProcessedNetMsg::GetNodeId() const
+{
+    return pnode->GetId();
+}
+
+// Statistics of the peers which disconnected
+static CCriticalSection cs_closedMsgStats;
+static mapMsgCmdStats mapClosedProcessStats;
+static mapMsgCmdSize mapClosedSendBytes;
+static mapMsgCmdSize mapClosedRecvBytes;
+
+static void AddMsgCmdStats(const CNodeStats& stats, mapMsgCmdStats& mapStats, mapMsgCmdSize& mapSendBytes, mapMsgCmdSize& mapRecvBytes)
+{
+    for (const mapMsgCmdStats::value_type& i : stats.mapProcessStatsPerMsgCmd)
+        mapStats[i.first].Add(i.second);
+    for (const mapMsgCmdSize::value_type& i : stats.mapSendBytesPerMsgCmd)
+        mapSendBytes[i.first] += i.second;
+    for (const mapMsgCmdSize::value_type& i : stats.mapRecvBytesPerMsgCmd)
+        if (i.second)
+            mapRecvBytes[i.first] += i.second;
+}
+
+void GetNetMsgStats(CConnman& connman, mapMsgCmdStats& mapStats, mapMsgCmdSize& mapSendBytes, mapMsgCmdSize& mapRecvBytes)
+{
+    {
+        LOCK(cs_closedMsgStats);
+        mapStats = mapClosedProcessStats;
+        mapSendBytes = mapClosedSendBytes;
+        mapRecvBytes = mapClosedRecvBytes;
+    }
+
+    std::vector<CNodeStats> vstats;
+    connman.GetNodeStats(vstats);
+    for (const CNodeStats& stats : vstats)
+        AddMsgCmdStats(stats, mapStats, mapSendBytes, mapRecvBytes);
+}
+
+void CNode::RecordProcessedMsg(const std::string& strCommand, int64_t nTime, bool fRejected, int nBanScore)
+{
+    // Only the valid commands get their own entry, like for the received bytes
+    static const std::set<std::string> setMsgTypes(getAllNetMessageTypes().begin(), getAllNetMessageTypes().end());
+    const std::string& strKey = setMsgTypes.count(strCommand) ? strCommand : NET_MESSAGE_COMMAND_OTHER;
+
+    LOCK(cs_msgStats);
+    mapProcessStatsPerMsgCmd[strKey].Add(nTime, fRejected, nBanScore);
+}
+
 #undef X
 #define X(name) stats.name = name
 void CNode::copyStats(CNodeStats &stats)
@@ -666,7 +776,15 @@ void CNode::copyStats(CNodeStats &stats)
         X(mapRecvBytesPerMsgCmd);
         X(nRecvBytes);
     }
+    {
+        LOCK(cs_msgStats);
+        X(mapProcessStatsPerMsgCmd);
+    }
     X(fWhitelisted);
+    {
+        LOCK(cs_inventory);
+        stats.fTxReconciliation = reconState != nullptr;
+    }
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -845,6 +963,7 @@ size_t CConnman::SocketSendData(CNode *pnode) const
                 it++;
             } else {
                 // could not send full message; stop sending more
+                pnode->fSendReady = false;
                 break;
             }
         } else {
@@ -858,6 +977,7 @@ size_t CConnman::SocketSendData(CNode *pnode) const
                 }
             }
             // couldn't send anything at all
+            pnode->fSendReady = false;
             break;
         }
     }
@@ -1105,9 +1225,203 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         vNodes.push_back(pnode);
     }
 }
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+bool CConnman::InitSocketEvents()
+{
+#ifdef USE_EPOLL
+    nEventsFd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    nEventsFd = kqueue();
+#endif
+    if (nEventsFd < 0) {
+        LogPrintf("Unable to create the socket events instance: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+
+    // The listening sockets are level-triggered, one connection gets accepted at a time
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+#ifdef USE_EPOLL
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = hListenSocket.socket;
+        int nRet = epoll_ctl(nEventsFd, EPOLL_CTL_ADD, hListenSocket.socket, &event);
+#else
+        struct kevent event;
+        EV_SET(&event, hListenSocket.socket, EVFILT_READ, EV_ADD, 0, 0, NULL);
+        int nRet = kevent(nEventsFd, &event, 1, NULL, 0, NULL);
+#endif
+        if (nRet < 0) {
+            LogPrintf("Unable to register a listening socket for events: %s\n", NetworkErrorString(WSAGetLastError()));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CConnman::AddSocketEvents(SOCKET hSocket)
+{
+    // Edge-triggered for reading and writing alike, a socket is registered once.
+    // Closing it removes it again.
+#ifdef USE_EPOLL
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = hSocket;
+    return epoll_ctl(nEventsFd, EPOLL_CTL_ADD, hSocket, &event) == 0;
+#else
+    struct kevent events[2];
+    EV_SET(&events[0], hSocket, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, NULL);
+    EV_SET(&events[1], hSocket, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, NULL);
+    return kevent(nEventsFd, events, 2, NULL, 0, NULL) == 0;
+#endif
+}
+
+void CConnman::SocketEvents(const std::vector<CNode*>& vNodesCopy, int nTimeout,
+                            std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    BOOST_FOREACH(CNode* pnode, vNodesCopy) {
+        if (pnode->fSocketEvents)
+            continue;
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (!AddSocketEvents(pnode->hSocket)) {
+            LogPrintf("Unable to register the socket of peer=%d for events: %s\n", pnode->id, NetworkErrorString(WSAGetLastError()));
+            pnode->fDisconnect = true;
+            continue;
+        }
+        pnode->fSocketEvents = true;
+    }
+
+#ifdef USE_EPOLL
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+    int nEvents = epoll_wait(nEventsFd, events, MAX_SOCKET_EVENTS, nTimeout);
+#else
+    struct kevent events[MAX_SOCKET_EVENTS];
+    struct timespec timeout;
+    timeout.tv_sec = nTimeout / 1000;
+    timeout.tv_nsec = (nTimeout % 1000) * 1000000;
+    int nEvents = kevent(nEventsFd, NULL, 0, events, MAX_SOCKET_EVENTS, &timeout);
+#endif
+    if (nEvents < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket events error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(nTimeout));
+        }
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+#ifdef USE_EPOLL
+        SOCKET hSocket = events[i].data.fd;
+        if (events[i].events & EPOLLIN)
+            recv_set.insert(hSocket);
+        if (events[i].events & EPOLLOUT)
+            send_set.insert(hSocket);
+        if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+            error_set.insert(hSocket);
+#else
+        SOCKET hSocket = events[i].ident;
+        if (events[i].filter == EVFILT_READ)
+            recv_set.insert(hSocket);
+        if (events[i].filter == EVFILT_WRITE)
+            send_set.insert(hSocket);
+        if (events[i].flags & (EV_EOF | EV_ERROR))
+            error_set.insert(hSocket);
+#endif
+    }
+}
+#else
+bool CConnman::InitSocketEvents()
+{
+    return true;
+}
+
+void CConnman::SocketEvents(const std::vector<CNode*>& vNodesCopy, int nTimeout,
+                            std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set)
+{
+    struct timeval timeout;
+    timeout.tv_sec  = nTimeout / 1000;
+    timeout.tv_usec = (nTimeout % 1000) * 1000;
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    BOOST_FOREACH(CNode* pnode, vNodesCopy)
+    {
+        // select() for sending only while there is data to send, for
+        // receiving only while there's nothing to send and space left in
+        // the receive buffer.
+        bool select_recv = !pnode->fPauseRecv;
+        bool select_send;
+        {
+            LOCK(pnode->cs_vSend);
+            select_send = !pnode->vSendMsg.empty();
+        }
+
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+
+        FD_SET(pnode->hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, pnode->hSocket);
+        have_fds = true;
+
+        if (select_send) {
+            FD_SET(pnode->hSocket, &fdsetSend);
+            continue;
+        }
+        if (select_recv) {
+            FD_SET(pnode->hSocket, &fdsetRecv);
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                recv_set.insert(i);
+        }
+        interruptNet.sleep_for(std::chrono::milliseconds(nTimeout));
+        return;
+    }
+
+    for (SOCKET hSocket = 0; have_fds && hSocket <= hSocketMax; hSocket++) {
+        if (FD_ISSET(hSocket, &fdsetRecv))
+            recv_set.insert(hSocket);
+        if (FD_ISSET(hSocket, &fdsetSend))
+            send_set.insert(hSocket);
+        if (FD_ISSET(hSocket, &fdsetError))
+            error_set.insert(hSocket);
+    }
+}
+#endif
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    // Set when a socket may have more to read than one recv took
+    bool fMoreRecv = false;
     while (!interruptNet)
     {
         //
@@ -1178,93 +1492,23 @@ void CConnman::ThreadSocketHandler()
         }
 
         //
-        // Find which sockets have data to receive
+        // Find which sockets are ready
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        if (interruptNet)
+        std::vector<CNode*> vNodesCopy = CopyNodeVector();
+        std::set<SOCKET> recv_set, send_set, error_set;
+        SocketEvents(vNodesCopy, fMoreRecv ? 0 : SOCKET_EVENTS_TIMEOUT, recv_set, send_set, error_set);
+        if (interruptNet) {
+            ReleaseNodeVector(vNodesCopy);
             return;
-
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
         }
+        fMoreRecv = false;
 
         //
         // Accept new connections
         //
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && recv_set.count(hListenSocket.socket))
             {
                 AcceptConnection(hListenSocket);
             }
@@ -1273,27 +1517,53 @@ void CConnman::ThreadSocketHandler()
         //
         // Service each socket
         //
-        std::vector<CNode*> vNodesCopy = CopyNodeVector();
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
             if (interruptNet)
-                return;
+                break;
 
-            //
-            // Receive
-            //
-            bool recvSet = false;
+            // A socket stays ready until a recv or send on it would block, the
+            // events only tell about the ones which became ready.
             bool sendSet = false;
             bool errorSet = false;
             {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                if (recv_set.count(pnode->hSocket))
+                    pnode->fRecvReady = true;
+                sendSet = send_set.count(pnode->hSocket) > 0;
+                errorSet = error_set.count(pnode->hSocket) > 0;
             }
-            if (recvSet || errorSet)
+
+            //
+            // Send
+            //
+            // If there is data to send, drain the write buffer before receiving
+            // more. This avoids needlessly queueing received data, if the remote
+            // peer is not themselves receiving data. This means properly
+            // utilizing TCP flow control signalling.
+            bool fSendPending;
+            {
+                LOCK(pnode->cs_vSend);
+                if (sendSet)
+                    pnode->fSendReady = true;
+                if (pnode->fSendReady && !pnode->vSendMsg.empty()) {
+                    size_t nBytes = SocketSendData(pnode);
+                    if (nBytes) {
+                        RecordBytesSent(nBytes);
+                    }
+                }
+                fSendPending = !pnode->vSendMsg.empty();
+            }
+
+            //
+            // Receive
+            //
+            // As long as there is space left in the receive buffer. All complete
+            // messages are handed off to the processor, to be handled without
+            // blocking here. An error always gets read, to find out about it.
+            if (errorSet || (pnode->fRecvReady && !pnode->fPauseRecv && !fSendPending))
             {
                 {
                     {
@@ -1306,6 +1576,12 @@ void CConnman::ThreadSocketHandler()
                                 continue;
                             nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
                         }
+                        // A full buffer may have left more to read, anything else
+                        // means the socket got drained
+                        if (nBytes == (int)sizeof(pchBuf))
+                            fMoreRecv = true;
+                        else
+                            pnode->fRecvReady = false;
                         if (nBytes > 0)
                         {
                             bool notify = false;
@@ -1351,18 +1627,6 @@ void CConnman::ThreadSocketHandler()
                 }
             }
 
-            //
-            // Send
-            //
-            if (sendSet)
-            {
-                LOCK(pnode->cs_vSend);
-                size_t nBytes = SocketSendData(pnode);
-                if (nBytes) {
-                    RecordBytesSent(nBytes);
-                }
-            }
-
             //
             // Inactivity checking
             //
@@ -1642,6 +1906,7 @@ void CConnman::ThreadDNSAddressSeed()
 
 void CConnman::DumpAddresses()
 {
+    LOCK(cs_dumpData);
     int64_t nStart = GetTimeMillis();
 
     CAddrDB adb;
@@ -1657,6 +1922,20 @@ void CConnman::DumpData()
     DumpBanlist();
 }
 
+void CConnman::DumpDataAsync()
+{
+    // The last run is still busy with the files, it would write about the same again
+    if (fDumpQueued.exchange(true))
+        return;
+
+    // Addrman is only locked while it gets serialized to memory, the hashing and the
+    // file writes of a large table don't hold up the scheduler and the network tasks on it
+    taskPool.Submit(CTaskPool::PRIORITY_LOW, [this]() {
+        DumpData();
+        fDumpQueued = false;
+    });
+}
+
 void CConnman::ProcessOneShot()
 {
     std::string strDest;
@@ -2242,6 +2521,7 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     fNetworkActive = true;
     setBannedIsDirty = false;
     fAddressesInitialized = false;
+    fDumpQueued = false;
     nLastNodeId = 0;
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
@@ -2254,6 +2534,9 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nBestHeight = 0;
     clientInterface = NULL;
     flagInterruptMsgProc = false;
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    nEventsFd = -1;
+#endif
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -2348,6 +2631,11 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         fMsgProcWake = false;
     }
 
+    if (!InitSocketEvents()) {
+        strNodeError = _("Unable to set up the socket events.");
+        return false;
+    }
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2370,7 +2658,7 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
 
     // Dump network addresses
-    scheduler.scheduleEvery(boost::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL);
+    scheduler.scheduleEvery(boost::bind(&CConnman::DumpDataAsync, this), DUMP_ADDRESSES_INTERVAL);
 
     return true;
 }
@@ -2443,6 +2731,12 @@ void CConnman::Stop()
         threadDNSAddressSeed.join();
     if (threadSocketHandler.joinable())
         threadSocketHandler.join();
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    if (nEventsFd >= 0) {
+        close(nEventsFd);
+        nEventsFd = -1;
+    }
+#endif
 
     if (fAddressesInitialized)
     {
@@ -2796,6 +3090,8 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nStartingHeight = -1;
     filterInventoryKnown.reset();
     fSendMempool = false;
+    nReconSalt = 0;
+    nRemoteReconSalt = 0;
     fGetAddr = false;
     nNextLocalAddrSend = 0;
     nNextAddrSend = 0;
@@ -2812,6 +3108,9 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     fSmartnode = false;
     nMinPingUsecTime = std::numeric_limits<int64_t>::max();
     fPauseRecv = false;
+    fRecvReady = false;
+    fSendReady = true;
+    fSocketEvents = false;
     fPauseSend = false;
     nProcessQueueSize = 0;
     nPaymentMessagesInSync = 0;
@@ -2830,12 +3129,31 @@ CNode::~CNode()
 {
     CloseSocket(hSocket);
 
+    {
+        CNodeStats stats;
+        {
+            LOCK(cs_vSend);
+            stats.mapSendBytesPerMsgCmd.swap(mapSendBytesPerMsgCmd);
+        }
+        {
+            LOCK(cs_vRecv);
+            stats.mapRecvBytesPerMsgCmd.swap(mapRecvBytesPerMsgCmd);
+        }
+        {
+            LOCK(cs_msgStats);
+            stats.mapProcessStatsPerMsgCmd.swap(mapProcessStatsPerMsgCmd);
+        }
+        LOCK(cs_closedMsgStats);
+        AddMsgCmdStats(stats, mapClosedProcessStats, mapClosedSendBytes, mapClosedRecvBytes);
+    }
+
     if (pfilter)
         delete pfilter;
 }
 
 void CNode::AskFor(const CInv& inv)
 {
+    LOCK(cs_askFor);
     if (mapAskFor.size() > MAPASKFOR_MAX_SZ || setAskFor.size() > SETASKFOR_MAX_SZ) {
         int64_t nNow = GetTime();
         if(nNow - nLastWarningTime > WARNING_INTERVAL) {
@@ -2880,6 +3198,18 @@ void CNode::AskFor(const CInv& inv)
     mapAskFor.insert(std::make_pair(nRequestTime, inv));
 }
 
+void CNode::RemoveAskFor(const uint256& hash)
+{
+    LOCK(cs_askFor);
+    setAskFor.erase(hash);
+}
+
+size_t CNode::GetAskForSize() const
+{
+    LOCK(cs_askFor);
+    return setAskFor.size();
+}
+
 bool CConnman::NodeFullyConnected(const CNode* pnode)
 {
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
@@ -2909,6 +3239,8 @@ void CConnman::PushMessage(CNode* pnode, CDataStream& strm, const std::string& s
 
     unsigned int nSize = strm.size() - CMessageHeader::HEADER_SIZE;
     LogPrint("net", "sending %s (%d bytes) peer=%d\n",  SanitizeString(sCommand.c_str()), nSize, pnode->id);
+    // peer id, command, payload bytes
+    TRACE3(net, outbound_message, pnode->id, sCommand.c_str(), nSize);
 
     size_t nBytesSent = 0;
     {
@@ -20,11 +20,13 @@
 #include "uint256.h"
 #include "util.h"
 #include "threadinterrupt.h"
+#include "txreconciliation.h"
 
 #include <atomic>
 #include <condition_variable>
 #include <deque>
 #include <memory>
+#include <set>
 #include <stdint.h>
 #include <thread>
 
@@ -447,6 +449,15 @@ private:
     NodeId GetNewNodeId();
 
     size_t SocketSendData(CNode *pnode) const;
+
+    /** Set up the polling of the sockets, epoll or kqueue where available */
+    bool InitSocketEvents();
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    bool AddSocketEvents(SOCKET hSocket);
+#endif
+    /** Wait up to nTimeout milliseconds for sockets to become ready */
+    void SocketEvents(const std::vector<CNode*>& vNodesCopy, int nTimeout,
+                      std::set<SOCKET>& recv_set, std::set<SOCKET>& send_set, std::set<SOCKET>& error_set);
     //!check is the banlist has unwritten changes
     bool BannedSetIsDirty();
     //!set the "dirty" flag for the banlist
@@ -456,6 +467,8 @@ private:
     void DumpAddresses();
     void DumpData();
     void DumpBanlist();
+    //! DumpData on the task pool, the scheduler thread only queues it
+    void DumpDataAsync();
 
     CDataStream BeginMessage(CNode* node, int nVersion, int flags, const std::string& sCommand);
 
@@ -495,6 +508,10 @@ private:
     CCriticalSection cs_setBanned;
     bool setBannedIsDirty;
     bool fAddressesInitialized;
+    //! Held while peers.dat or banlist.dat get written, so a dump never replaces a newer one
+    CCriticalSection cs_dumpData;
+    //! Set while a DumpDataAsync run is queued or running
+    std::atomic<bool> fDumpQueued;
     CAddrMan addrman;
     std::deque<std::string> vOneShots;
     CCriticalSection cs_vOneShots;
@@ -535,6 +552,11 @@ private:
 
     CThreadInterrupt interruptNet;
 
+#if defined(USE_EPOLL) || defined(USE_KQUEUE)
+    /** The epoll/kqueue instance the sockets are registered with */
+    int nEventsFd;
+#endif
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
@@ -623,6 +645,57 @@ extern CCriticalSection cs_mapLocalHost;
 extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 typedef std::map<std::string, uint64_t> mapMsgCmdSize; //command, total bytes
 
+/** Processing statistics of the messages of one command, all times in microseconds */
+struct CNetMsgCmdStats
+{
+    //! Upper bounds of the processing time buckets, the last bucket is open ended
+    static const int NUM_TIME_BUCKETS = 7;
+    static const int64_t TIME_BUCKET_BOUNDS[NUM_TIME_BUCKETS - 1];
+
+    uint64_t nMessages;
+    int64_t nTime;
+    int64_t nMaxTime;
+    uint64_t vTimeBuckets[NUM_TIME_BUCKETS];
+    //! Messages which failed to process or raised the ban score of the peer
+    uint64_t nRejected;
+    int64_t nBanScore;
+
+    CNetMsgCmdStats() : nMessages(0), nTime(0), nMaxTime(0), vTimeBuckets(), nRejected(0), nBanScore(0) {}
+
+    void Add(int64_t nTimeIn, bool fRejected, int nBanScoreIn);
+    void Add(const CNetMsgCmdStats& other);
+};
+typedef std::map<std::string, CNetMsgCmdStats> mapMsgCmdStats;
+
+/**
+ * The message the thread processes. Misbehaving adds the ban score it causes, the
+ * statistics of the peer get it when it goes out of scope unless a subsystem queue
+ * took the message, the queue records its processing then.
+ */
+class CProcessedNetMsg
+{
+    CNode* pnode;
+    const std::string& strCommand;
+    int64_t nStart;
+    CProcessedNetMsg* pprev;
+
+public:
+    bool fQueued;
+    bool fRejected;
+    int nBanScore;
+
+    CProcessedNetMsg(CNode* pnodeIn, const std::string& strCommandIn);
+    ~CProcessedNetMsg();
+
+    //! Message processed by the current thread, NULL outside of the message processing
+    static CProcessedNetMsg* Current();
+
+    NodeId GetNodeId() const;
+};
+
+/** Message statistics of all peers, both the connected ones and the ones which are gone */
+void GetNetMsgStats(CConnman& connman, mapMsgCmdStats& mapStats, mapMsgCmdSize& mapSendBytes, mapMsgCmdSize& mapRecvBytes);
+
 class CNodeStats
 {
 public:
@@ -643,7 +716,9 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdStats mapProcessStatsPerMsgCmd;
     bool fWhitelisted;
+    bool fTxReconciliation;
     double dPingTime;
     double dPingWait;
     double dMinPing;
@@ -760,17 +835,26 @@ public:
     CSemaphoreGrant grantSmartnodeOutbound;
     CCriticalSection cs_filter;
     CBloomFilter* pfilter;
-    int nRefCount;
+    std::atomic<int> nRefCount;
     NodeId id;
 
     const uint64_t nKeyedNetGroup;
 
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+
+    // The socket is ready for a recv/send until one would block. The socket
+    // events only report the sockets which became ready. fSendReady is guarded
+    // by cs_vSend, the others belong to the socket handler thread.
+    bool fRecvReady;
+    bool fSendReady;
+    bool fSocketEvents; // registered with the socket events instance
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdStats mapProcessStatsPerMsgCmd; // guarded by cs_msgStats
+    CCriticalSection cs_msgStats;
 
 public:
     uint256 hashContinue;
@@ -788,6 +872,9 @@ public:
     CRollingBloomFilter filterInventoryKnown;
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
+    // setAskFor and mapAskFor are guarded by cs_askFor, the smartnode message
+    // queues remove what they received from other threads
+    mutable CCriticalSection cs_askFor;
     std::set<uint256> setAskFor;
     std::multimap<int64_t, CInv> mapAskFor;
     int64_t nNextInvSend;
@@ -801,6 +888,12 @@ public:
     std::vector<uint256> vBlockHashesFromINV;
     // Used for BIP35 mempool sending, also protected by cs_inventory
     bool fSendMempool;
+    // Salt of the short ids we sent in sendrecon, 0 if we didn't, also protected by cs_inventory
+    uint64_t nReconSalt;
+    // Salt the peer sent in sendrecon, 0 if it didn't, also protected by cs_inventory
+    uint64_t nRemoteReconSalt;
+    // Set once both sides sent sendrecon, also protected by cs_inventory
+    std::unique_ptr<CTxReconciliationState> reconState;
 
     // Block and TXN accept times
     std::atomic<int64_t> nLastBlockTime;
@@ -908,6 +1001,8 @@ public:
         {
             LOCK(cs_inventory);
             filterInventoryKnown.insert(inv.hash);
+            if (reconState)
+                reconState->Remove(inv.hash);
         }
     }
 
@@ -919,6 +1014,11 @@ public:
                 LogPrint("net", "PushInventory --  filtered inv: %s peer=%d\n", inv.ToString(), id);
                 return;
             }
+            if (reconState && !fWhitelisted && CTxReconciliationState::IsReconciled(inv.type) &&
+                !reconState->ShouldFlood(inv.hash) && reconState->Add(inv)) {
+                LogPrint("net", "PushInventory --  reconciled inv: %s peer=%d\n", inv.ToString(), id);
+                return;
+            }
             LogPrint("net", "PushInventory --  inv: %s peer=%d\n", inv.ToString(), id);
             vInventoryToSend.push_back(inv);
         }
@@ -937,11 +1037,17 @@ public:
     }
 
     void AskFor(const CInv& inv);
+    //! The inv got received, it doesn't have to be asked for anymore
+    void RemoveAskFor(const uint256& hash);
+    size_t GetAskForSize() const;
 
     void CloseSocketDisconnect();
 
     void copyStats(CNodeStats &stats);
 
+    //! Add a processed message to the statistics of its command
+    void RecordProcessedMsg(const std::string& strCommand, int64_t nTime, bool fRejected, int nBanScore);
+
     ServiceFlags GetLocalServices() const
     {
         return nLocalServices;
@@ -8,9 +8,12 @@
 #include "alert.h"
 #include "addrman.h"
 #include "arith_uint256.h"
+#include "blockencodings.h"
+#include "blockfilter.h"
 #include "chainparams.h"
 #include "consensus/validation.h"
 #include "hash.h"
+#include "indexbuilder.h"
 #include "init.h"
 #include "validation.h"
 #include "merkleblock.h"
@@ -22,6 +25,7 @@
 #include "primitives/transaction.h"
 #include "random.h"
 #include "tinyformat.h"
+#include "trace.h"
 #include "txmempool.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -41,6 +45,8 @@
 //#endif // ENABLE_WALLET
 //#include "privatesend-server.h"
 
+#include <limits>
+
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -52,7 +58,7 @@ using namespace std;
 int64_t nTimeBestReceived = 0; // Used only to inform the wallet of when we last received a block
 
 struct COrphanTx {
-    CTransaction tx;
+    CTransactionRef tx;
     NodeId fromPeer;
 };
 map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);
@@ -98,6 +104,18 @@ namespace {
 
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
+    /** Blocks holding up the download window which got requested from a second,
+     *  faster peer as well, and that peer. Protected by cs_main. */
+    map<uint256, NodeId> mapBlocksRedundant;
+
+    /** The peers we asked to announce new blocks with cmpctblocks, the one which
+     *  delivered a new block most recently last. Protected by cs_main. */
+    list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+    /** The compact block of the tip, built once for all the peers which get
+     *  it announced with a cmpctblock. Protected by cs_main. */
+    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblockTip;
+
     /** Number of preferable block download peers. */
     int nPreferredDownload = 0;
 
@@ -179,6 +197,13 @@ void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
     BOOST_FOREACH(const QueuedBlock& entry, state->vBlocksInFlight) {
         mapBlocksInFlight.erase(entry.hash);
     }
+    for (map<uint256, NodeId>::iterator it = mapBlocksRedundant.begin(); it != mapBlocksRedundant.end();) {
+        if (it->second == nodeid)
+            mapBlocksRedundant.erase(it++);
+        else
+            ++it;
+    }
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
@@ -189,17 +214,34 @@ void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime) {
     if (mapNodeState.empty()) {
         // Do a consistency check after the last peer is removed.
         assert(mapBlocksInFlight.empty());
+        assert(mapBlocksRedundant.empty());
         assert(nPreferredDownload == 0);
         assert(nPeersWithValidatedDownloads == 0);
     }
 }
 
 // Requires cs_main.
-// Returns a bool indicating whether we requested this block.
-bool MarkBlockAsReceived(const uint256& hash) {
+// Returns a bool indicating whether we requested this block. fDelivered is false
+// when the block only moves to another peer, it doesn't count for the download rate then.
+bool MarkBlockAsReceived(const uint256& hash, bool fDelivered = true) {
+    bool fRequested = false;
+    map<uint256, NodeId>::iterator itRedundant = mapBlocksRedundant.find(hash);
+    if (itRedundant != mapBlocksRedundant.end()) {
+        State(itRedundant->second)->nBlocksInFlightRedundant--;
+        mapBlocksRedundant.erase(itRedundant);
+        fRequested = true;
+    }
+
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
         CNodeState *state = State(itInFlight->second.first);
+        int64_t nNow = GetTimeMicros();
+        if (fDelivered) {
+            // Time the peer took for this block, not counting the time it was busy with the ones before
+            int64_t nDeliveryTime = std::max<int64_t>(nNow - std::max(state->nLastBlockDelivery, itInFlight->second.second->nTime), 1);
+            state->nAvgBlockDeliveryTime = state->nAvgBlockDeliveryTime ? (state->nAvgBlockDeliveryTime * 7 + nDeliveryTime) / 8 : nDeliveryTime;
+            state->nLastBlockDelivery = nNow;
+        }
         state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
         if (state->nBlocksInFlightValidHeaders == 0 && itInFlight->second.second->fValidatedHeaders) {
             // Last validated block on the queue was received.
@@ -207,29 +249,51 @@ bool MarkBlockAsReceived(const uint256& hash) {
         }
         if (state->vBlocksInFlight.begin() == itInFlight->second.second) {
             // First block on the queue was received, update the start download time for the next one
-            state->nDownloadingSince = std::max(state->nDownloadingSince, GetTimeMicros());
+            state->nDownloadingSince = std::max(state->nDownloadingSince, nNow);
         }
         state->vBlocksInFlight.erase(itInFlight->second.second);
         state->nBlocksInFlight--;
         state->nStallingSince = 0;
         mapBlocksInFlight.erase(itInFlight);
-        return true;
+        fRequested = true;
     }
-    return false;
+    return fRequested;
+}
+
+// Requires cs_main.
+// Number of blocks the block download keeps in flight from the peer, enough for
+// BLOCK_DOWNLOAD_TARGET_LATENCY seconds at the rate it delivered them so far.
+int GetBlocksInFlightLimit(const CNodeState* state) {
+    if (state->nAvgBlockDeliveryTime == 0) {
+        // Nothing known about the peer yet, it has to prove itself first
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER / 4;
+    }
+    int64_t nLimit = BLOCK_DOWNLOAD_TARGET_LATENCY * 1000000LL / state->nAvgBlockDeliveryTime;
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(nLimit, MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER));
 }
 
 // Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL) {
+// Returns false if the block is in flight from this peer already. With pit set, the
+// block gets a PartiallyDownloadedBlock and *pit points to its entry in either case.
+bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Params& consensusParams, CBlockIndex *pindex = NULL, list<QueuedBlock>::iterator **pit = NULL) {
     CNodeState *state = State(nodeid);
     assert(state != NULL);
 
+    // Short-circuit most stuff in case it is from the same node
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == nodeid) {
+        if (pit)
+            *pit = &itInFlight->second.second;
+        return false;
+    }
+
     // Make sure it's not listed somewhere already.
-    MarkBlockAsReceived(hash);
+    MarkBlockAsReceived(hash, false);
 
-    QueuedBlock newentry = {hash, pindex, pindex != NULL};
-    list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
+    list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
+            {hash, pindex, pindex != NULL, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : NULL), GetTimeMicros()});
     state->nBlocksInFlight++;
-    state->nBlocksInFlightValidHeaders += newentry.fValidatedHeaders;
+    state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
         // We're starting a block download (batch) from this peer.
         state->nDownloadingSince = GetTimeMicros();
@@ -237,7 +301,46 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const Consensus::Pa
     if (state->nBlocksInFlightValidHeaders == 1 && pindex != NULL) {
         nPeersWithValidatedDownloads++;
     }
-    mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
+    itInFlight = mapBlocksInFlight.insert(std::make_pair(hash, std::make_pair(nodeid, it))).first;
+    if (pit)
+        *pit = &itInFlight->second.second;
+    return true;
+}
+
+/**
+ * Ask nodeid to announce new blocks to us with cmpctblocks, the peers which
+ * delivered new blocks most recently get to do that. Requires cs_main.
+ */
+void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid, CConnman& connman) {
+    CNodeState* nodestate = State(nodeid);
+    if (!nodestate || !nodestate->fProvidesHeaderAndIDs) {
+        // Never ask from peers who can't provide compact blocks.
+        return;
+    }
+    for (list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin(); it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
+        if (*it == nodeid) {
+            lNodesAnnouncingHeaderAndIDs.erase(it);
+            lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
+            return;
+        }
+    }
+    bool fAnnounceUsingCMPCTBLOCK = false;
+    uint64_t nCMPCTBLOCKVersion = 1;
+    if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_CMPCTBLOCK_ANNOUNCING_PEERS) {
+        // As per BIP152, we only get 3 of our peers to announce
+        // blocks using compact encodings.
+        connman.ForNode(lNodesAnnouncingHeaderAndIDs.front(), [&connman, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion](CNode* pnodeStop){
+            connman.PushMessage(pnodeStop, NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+            return true;
+        });
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+    }
+    fAnnounceUsingCMPCTBLOCK = true;
+    connman.ForNode(nodeid, [&connman, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion](CNode* pfrom){
+        connman.PushMessage(pfrom, NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+        return true;
+    });
+    lNodesAnnouncingHeaderAndIDs.push_back(nodeid);
 }
 
 /** Check whether the last unknown block a peer advertised is not yet known. */
@@ -309,8 +412,9 @@ CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb) {
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
-void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) {
+ *  at most count entries. If the download window holds up the peer, nodeStaller and pindexStalling
+ *  are set to the peer and the block in flight from it at the start of the window. */
+void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller, CBlockIndex*& pindexStalling, const Consensus::Params& consensusParams) {
     if (count == 0)
         return;
 
@@ -346,6 +450,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    CBlockIndex* pindexWaitingFor = NULL;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -377,6 +482,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
                     if (vBlocks.size() == 0 && waitingfor != nodeid) {
                         // We aren't able to fetch anything, but we would be if the download window was one larger.
                         nodeStaller = waitingfor;
+                        pindexStalling = pindexWaitingFor;
                     }
                     return;
                 }
@@ -387,6 +493,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                pindexWaitingFor = pindex;
             }
         }
     }
@@ -405,6 +512,9 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.dBlockRate = state->nAvgBlockDeliveryTime ? 1e6 / state->nAvgBlockDeliveryTime : 0;
+    stats.nBlocksInFlightLimit = GetBlocksInFlightLimit(state);
+    stats.nRedundantRequests = state->nRedundantRequests;
     return true;
 }
 
@@ -429,8 +539,9 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals)
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+bool AddOrphanTx(const CTransactionRef& ptx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
+    const CTransaction& tx = *ptx;
     uint256 hash = tx.GetHash();
     if (mapOrphanTransactions.count(hash))
         return false;
@@ -449,7 +560,7 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
         return false;
     }
 
-    mapOrphanTransactions[hash].tx = tx;
+    mapOrphanTransactions[hash].tx = ptx;
     mapOrphanTransactions[hash].fromPeer = peer;
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
         mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
@@ -464,7 +575,7 @@ void static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return;
-    BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
+    BOOST_FOREACH(const CTxIn& txin, it->second.tx->vin)
     {
         map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
         if (itPrev == mapOrphanTransactionsByPrev.end())
@@ -485,7 +596,7 @@ void EraseOrphansFor(NodeId peer)
         map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
         if (maybeErase->second.fromPeer == peer)
         {
-            EraseOrphanTx(maybeErase->second.tx.GetHash());
+            EraseOrphanTx(maybeErase->second.tx->GetHash());
             ++nErased;
         }
     }
@@ -520,6 +631,9 @@ void Misbehaving(NodeId pnode, int howmuch)
         return;
 
     state->nMisbehavior += howmuch;
+    CProcessedNetMsg* pmsg = CProcessedNetMsg::Current();
+    if (pmsg && pmsg->GetNodeId() == pnode)
+        pmsg->nBanScore += howmuch;
     int banscore = GetArg("-banscore", DEFAULT_BANSCORE_THRESHOLD);
     if (state->nMisbehavior >= banscore && state->nMisbehavior - howmuch < banscore)
     {
@@ -591,6 +705,11 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const CValidationSta
             if (nDoS > 0)
                 Misbehaving(it->second, nDoS);
         }
+    } else if (state.IsValid() && it != mapBlockSource.end() && !IsInitialBlockDownload() &&
+               mapBlocksInFlight.count(hash) == mapBlocksInFlight.size()) {
+        // The peer which delivered the one block we were waiting for is fast
+        // enough to announce the next ones with cmpctblocks
+        MaybeSetPeerAsAnnouncingHeaderAndIDs(it->second, *connman);
     }
     if (it != mapBlockSource.end())
         mapBlockSource.erase(it);
@@ -639,10 +758,8 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         We want to only update the time on new hits, so that we can time out appropriately if needed.
     */
     case MSG_TXLOCK_REQUEST:
-        return instantsend.AlreadyHave(inv.hash);
-
     case MSG_TXLOCK_VOTE:
-        return instantsend.AlreadyHave(inv.hash);
+        return instantsend.AlreadyHave(inv.hash, inv.type);
 
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
@@ -660,14 +777,14 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         return mnodeman.mapSeenSmartnodeBroadcast.count(inv.hash) && !mnodeman.IsMnbRecoveryRequested(inv.hash);
 
     case MSG_SMARTNODE_PING:
-        return mnodeman.mapSeenSmartnodePing.count(inv.hash);
+        return mnodeman.mapSeenSmartnodePing.Has(inv.hash);
 
     case MSG_VOTING_PROPOSAL:
     case MSG_VOTING_PROPOSAL_VOTE:
         return true; // WIP-VOTING replace with => return !smartVoting.ConfirmInventoryRequest(inv);
 
     case MSG_SMARTNODE_VERIFY:
-        return mnodeman.mapSeenSmartnodeVerification.count(inv.hash);
+        return mnodeman.mapSeenSmartnodeVerification.Has(inv.hash);
     }
 
     // Don't know what it is, just say we already got one
@@ -707,6 +824,34 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman& connma
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+//! Both sides sent sendrecon, requires cs_inventory of the node
+static void SetupTxReconciliation(CNode* pnode)
+{
+    if (pnode->reconState || pnode->nReconSalt == 0 || pnode->nRemoteReconSalt == 0)
+        return;
+    pnode->reconState.reset(new CTxReconciliationState(!pnode->fInbound, pnode->nReconSalt, pnode->nRemoteReconSalt));
+    LogPrint("net", "reconciling the transaction inventory with peer=%d%s\n", pnode->id, pnode->fInbound ? "" : " as initiator");
+}
+
+//! Announce the items a reconciliation found the peer missing, without another trickle delay
+static void PushReconciledInventory(CNode* pto, const std::vector<CInv>& vInvIn, CConnman& connman)
+{
+    vector<CInv> vInv;
+    LOCK(pto->cs_inventory);
+    BOOST_FOREACH(const CInv& inv, vInvIn) {
+        if (pto->filterInventoryKnown.contains(inv.hash))
+            continue;
+        pto->filterInventoryKnown.insert(inv.hash);
+        vInv.push_back(inv);
+        if (vInv.size() >= MAX_INV_SZ) {
+            connman.PushMessage(pto, NetMsgType::INV, vInv);
+            vInv.clear();
+        }
+    }
+    if (!vInv.empty())
+        connman.PushMessage(pto, NetMsgType::INV, vInv);
+}
+
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams, CConnman& connman, std::atomic<bool>& interruptMsgProc)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -727,7 +872,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -768,6 +913,16 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                         assert(!"cannot load block from disk");
                     if (inv.type == MSG_BLOCK)
                         connman.PushMessage(pfrom, NetMsgType::BLOCK, block);
+                    else if (inv.type == MSG_CMPCT_BLOCK)
+                    {
+                        // A peer asking for an old block most likely doesn't have the
+                        // transactions of it in its mempool, it gets the full block.
+                        if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                            CBlockHeaderAndShortTxIDs cmpctblock(block);
+                            connman.PushMessage(pfrom, NetMsgType::CMPCTBLOCK, cmpctblock);
+                        } else
+                            connman.PushMessage(pfrom, NetMsgType::BLOCK, block);
+                    }
                     else // MSG_FILTERED_BLOCK)
                     {
                         LOCK(pfrom->cs_filter);
@@ -821,11 +976,11 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 }
 
                 if (!pushed && inv.type == MSG_TX) {
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
+                    CTransactionRef ptx = mempool.get(inv.hash);
+                    if (ptx) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << tx;
+                        ss << *ptx;
                         connman.PushMessage(pfrom, NetMsgType::TX, ss);
                         pushed = true;
                     }
@@ -903,10 +1058,11 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 }
 
                 if (!pushed && inv.type == MSG_SMARTNODE_PING) {
-                    if(mnodeman.mapSeenSmartnodePing.count(inv.hash)) {
+                    CSmartnodePing mnp;
+                    if(mnodeman.mapSeenSmartnodePing.Get(inv.hash, mnp)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mnodeman.mapSeenSmartnodePing[inv.hash];
+                        ss << mnp;
                         connman.PushMessage(pfrom, NetMsgType::MNPING, ss);
                         pushed = true;
                     }
@@ -952,10 +1108,11 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 */
 
                 if (!pushed && inv.type == MSG_SMARTNODE_VERIFY) {
-                    if(mnodeman.mapSeenSmartnodeVerification.count(inv.hash)) {
+                    CSmartnodeVerification mnv;
+                    if(mnodeman.mapSeenSmartnodeVerification.Get(inv.hash, mnv)) {
                         CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
-                        ss << mnodeman.mapSeenSmartnodeVerification[inv.hash];
+                        ss << mnv;
                         connman.PushMessage(pfrom, NetMsgType::MNVERIFY, ss);
                         pushed = true;
                     }
@@ -968,7 +1125,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             // Track requests for our stuff.
             GetMainSignals().Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
                 break;
         }
     }
@@ -987,6 +1144,264 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
     }
 }
 
+namespace {
+
+/**
+ * The smartnode layer messages of one subsystem. They get processed in the
+ * order they came in on a thread of the subsystem's own, so a slow mnb or vote
+ * check holds up the messages of its subsystem only, never the blocks and
+ * transactions of the message handler thread.
+ */
+class CSubsystemMessageQueue
+{
+public:
+    typedef void (*ProcessFunc)(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
+
+private:
+    struct QueuedMessage {
+        CNode* pnode; // referenced while queued
+        std::string strCommand;
+        CDataStream vRecv;
+    };
+
+    const char* pszName;
+    ProcessFunc process;
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<QueuedMessage> queueMessages;
+    bool fStarted;
+    CConnman* pconnman;
+
+    void Process(QueuedMessage& msg)
+    {
+        CProcessedNetMsg processed(msg.pnode, msg.strCommand);
+        try {
+            process(msg.pnode, msg.strCommand, msg.vRecv, *pconnman);
+        } catch (const std::ios_base::failure& e) {
+            processed.fRejected = true;
+            pconnman->PushMessageWithVersion(msg.pnode, INIT_PROTO_VERSION, NetMsgType::REJECT, msg.strCommand, REJECT_MALFORMED, string("error parsing message"));
+            LogPrintf("CSubsystemMessageQueue::Process -- %s(%s, %u bytes): Exception '%s' caught\n", pszName,
+                      SanitizeString(msg.strCommand), msg.vRecv.size(), e.what());
+        } catch (const std::exception& e) {
+            processed.fRejected = true;
+            PrintExceptionContinue(&e, "CSubsystemMessageQueue::Process()");
+        }
+    }
+
+public:
+    CSubsystemMessageQueue(const char* pszNameIn, ProcessFunc processIn) :
+        pszName(pszNameIn), process(processIn), fStarted(false), pconnman(NULL) {}
+
+    void Start(boost::thread_group& threadGroup, CConnman& connman)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            if (fStarted) return;
+            pconnman = &connman;
+            fStarted = true;
+        }
+
+        threadGroup.create_thread(boost::bind(&CSubsystemMessageQueue::Thread, this));
+    }
+
+    bool IsFull()
+    {
+        boost::lock_guard<boost::mutex> lock(cs);
+        return fStarted && queueMessages.size() >= MAX_SUBSYSTEM_QUEUED_MESSAGES;
+    }
+
+    /// False if the message has to be processed right away
+    bool Queue(CNode* pnode, const std::string& strCommand, const CDataStream& vRecv)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            if (!fStarted) return false;
+            pnode->AddRef();
+            queueMessages.push_back(QueuedMessage{pnode, strCommand, vRecv});
+        }
+
+        cond.notify_one();
+        return true;
+    }
+
+    void Thread()
+    {
+        RenameThread(strprintf("smartcash-%s", pszName).c_str());
+
+        while (true) {
+            std::deque<QueuedMessage> queueTaken;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (queueMessages.empty())
+                    cond.wait(lock);
+                queueTaken.swap(queueMessages);
+            }
+
+            while (!queueTaken.empty()) {
+                QueuedMessage& msg = queueTaken.front();
+                if (!msg.pnode->fDisconnect)
+                    Process(msg);
+                msg.pnode->Release();
+                queueTaken.pop_front();
+                boost::this_thread::interruption_point();
+            }
+        }
+    }
+};
+
+CSubsystemMessageQueue smartnodeListQueue("snlist", [](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+    mnodeman.ProcessMessage(pfrom, strCommand, vRecv, connman);
+});
+CSubsystemMessageQueue smartnodePaymentsQueue("snpay", [](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+    mnpayments.ProcessMessage(pfrom, strCommand, vRecv, connman);
+});
+CSubsystemMessageQueue instantSendQueue("isend", [](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+    instantsend.ProcessMessage(pfrom, strCommand, vRecv, connman);
+});
+CSubsystemMessageQueue sporkQueue("spork", [](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+    sporkManager.ProcessSpork(pfrom, strCommand, vRecv, connman);
+});
+CSubsystemMessageQueue smartnodeSyncQueue("snsync", [](CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman) {
+    smartnodeSync.ProcessMessage(pfrom, strCommand, vRecv, connman);
+});
+
+/** The queue of the subsystem which handles strCommand, NULL for the other messages */
+CSubsystemMessageQueue* GetSubsystemMessageQueue(const std::string& strCommand)
+{
+    static const std::map<std::string, CSubsystemMessageQueue*> mapQueues = {
+        {NetMsgType::MNANNOUNCE, &smartnodeListQueue},
+        {NetMsgType::MNPING, &smartnodeListQueue},
+        {NetMsgType::DSEG, &smartnodeListQueue},
+        {NetMsgType::DSEGDELTA, &smartnodeListQueue},
+        {NetMsgType::MNVERIFY, &smartnodeListQueue},
+        {NetMsgType::SMARTNODEPAYMENTSYNC, &smartnodePaymentsQueue},
+        {NetMsgType::SMARTNODEPAYMENTVOTE, &smartnodePaymentsQueue},
+        {NetMsgType::TXLOCKVOTE, &instantSendQueue},
+        {NetMsgType::SPORK, &sporkQueue},
+        {NetMsgType::GETSPORKS, &sporkQueue},
+        {NetMsgType::SYNCSTATUSCOUNT, &smartnodeSyncQueue},
+    };
+    std::map<std::string, CSubsystemMessageQueue*>::const_iterator it = mapQueues.find(strCommand);
+    return it != mapQueues.end() ? it->second : NULL;
+}
+
+} // anon namespace
+
+void StartSmartnodeMessageQueues(boost::thread_group& threadGroup, CConnman& connman)
+{
+    smartnodeListQueue.Start(threadGroup, connman);
+    smartnodePaymentsQueue.Start(threadGroup, connman);
+    instantSendQueue.Start(threadGroup, connman);
+    sporkQueue.Start(threadGroup, connman);
+    smartnodeSyncQueue.Start(threadGroup, connman);
+}
+
+/**
+ * Fill the compact block in flight from pfrom with the transactions of resp
+ * and process it. If the block doesn't come out right, the full one gets
+ * requested.
+ */
+static bool ProcessBlockTransactions(CNode* pfrom, const BlockTransactions& resp, const CChainParams& chainparams, CConnman& connman)
+{
+    CBlock block;
+    bool fBlockRead = false;
+    {
+        LOCK(cs_main);
+
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator it = mapBlocksInFlight.find(resp.blockhash);
+        if (it == mapBlocksInFlight.end() || !it->second.second->partialBlock ||
+                it->second.first != pfrom->GetId()) {
+            LogPrint("net", "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->id);
+            return true;
+        }
+
+        PartiallyDownloadedBlock& partialBlock = *it->second.second->partialBlock;
+        ReadStatus status = partialBlock.FillBlock(block, resp.txn);
+        if (status == READ_STATUS_INVALID) {
+            MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+            Misbehaving(pfrom->GetId(), 100);
+            LogPrintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->id);
+            return true;
+        } else if (status == READ_STATUS_FAILED) {
+            // Might have collided, fall back to getdata now :(
+            it->second.second->partialBlock.reset();
+            std::vector<CInv> invs;
+            invs.push_back(CInv(MSG_BLOCK, resp.blockhash));
+            connman.PushMessage(pfrom, NetMsgType::GETDATA, invs);
+        } else {
+            MarkBlockAsReceived(resp.blockhash); // it is now an empty pointer
+            fBlockRead = true;
+            // mapBlockSource is only used for sending reject messages and DoS scores,
+            // so the race between here and cs_main in ProcessNewBlock is fine.
+            mapBlockSource.emplace(resp.blockhash, pfrom->GetId());
+        }
+    } // Don't hold cs_main when we call into ProcessNewBlock
+
+    if (fBlockRead) {
+        bool fNewBlock = false;
+        // Since we requested this block (it was in mapBlocksInFlight), force it to be processed,
+        // even if it would not be a candidate for new tip (missing previous block, chain not long enough, etc)
+        ProcessNewBlock(chainparams, &block, true, NULL, &fNewBlock);
+        if (fNewBlock)
+            pfrom->nLastBlockTime = GetTime();
+    }
+    return true;
+}
+
+/**
+ * Check a getcfilters, getcfheaders or getcfcheckpt request of pfrom. Peers
+ * asking for filters we don't serve, for blocks we never connected or for too
+ * many at once get disconnected. Block index entries stay around once they
+ * exist, pindexStop gets used after cs_main is released.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, uint8_t nFilterType, uint32_t nStartHeight, const uint256& hashStop,
+                                      uint32_t nMaxRange, const CBlockIndex*& pindexStop)
+{
+    if (!(pfrom->GetLocalServices() & NODE_COMPACT_FILTERS) || nFilterType != BLOCK_FILTER_BASIC) {
+        LogPrint("net", "peer %d requested unsupported block filter type %d\n", pfrom->id, nFilterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+
+        BlockMap::iterator it = mapBlockIndex.find(hashStop);
+        if (it == mapBlockIndex.end() || !it->second->IsValid(BLOCK_VALID_SCRIPTS)) {
+            LogPrint("net", "peer %d requested block filters up to unknown block %s\n", pfrom->id, hashStop.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+
+        pindexStop = it->second;
+        uint32_t nStopHeight = pindexStop->nHeight;
+        if (nStartHeight > nStopHeight || nStopHeight - nStartHeight >= nMaxRange) {
+            LogPrint("net", "peer %d requested block filters of invalid range %d to %d\n", pfrom->id, nStartHeight, nStopHeight);
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    // Still being built, the request goes unanswered like one for a block we don't have yet
+    if (!indexBuilder.IsReady(INDEX_BUILD_BLOCKFILTER)) {
+        LogPrint("net", "peer %d requested block filters while the index is being built\n", pfrom->id);
+        return false;
+    }
+
+    return true;
+}
+
+/** Hashes of the blocks from nStartHeight up to pindexStop, only these get collected under cs_main */
+static std::vector<uint256> GetBlockFilterRequestHashes(const CBlockIndex* pindexStop, uint32_t nStartHeight)
+{
+    LOCK(cs_main);
+    std::vector<uint256> vecHashes(pindexStop->nHeight - nStartHeight + 1);
+    for (const CBlockIndex* pindex = pindexStop; pindex && pindex->nHeight >= (int)nStartHeight; pindex = pindex->pprev)
+        vecHashes[pindex->nHeight - nStartHeight] = pindex->GetBlockHash();
+    return vecHashes;
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman& connman, std::atomic<bool>& interruptMsgProc)
 {
     const CChainParams& chainparams = Params();
@@ -1211,6 +1626,29 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             connman.PushMessage(pfrom, NetMsgType::SENDHEADERS);
         }
 
+        if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
+            // Tell our peer we are willing to provide version-1 cmpctblocks
+            // However, we do not request new block announcements using
+            // cmpctblock messages.
+            // We send this to non-NODE NETWORK peers as well, because
+            // they may wish to request compact blocks from us
+            bool fAnnounceUsingCMPCTBLOCK = false;
+            uint64_t nCMPCTBLOCKVersion = 1;
+            connman.PushMessage(pfrom, NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion);
+        }
+
+        if (fRelayTxes && GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION)) {
+            // Offer to reconcile the transaction inventory instead of flooding
+            // it, once the peer sent its sendrecon as well
+            uint64_t nSalt = GetRand(std::numeric_limits<uint64_t>::max() - 1) + 1;
+            {
+                LOCK(pfrom->cs_inventory);
+                pfrom->nReconSalt = nSalt;
+                SetupTxReconciliation(pfrom);
+            }
+            connman.PushMessage(pfrom, NetMsgType::SENDRECON, TXRECONCILIATION_VERSION, nSalt);
+        }
+
         pfrom->fSuccessfullyConnected = true;
     }
 
@@ -1274,6 +1712,137 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         State(pfrom->GetId())->fPreferHeaders = true;
     }
 
+    else if (strCommand == NetMsgType::SENDCMPCT)
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 1;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        if (nCMPCTBLOCKVersion == 1) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fProvidesHeaderAndIDs = true;
+            State(pfrom->GetId())->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
+        }
+    }
+
+    else if (strCommand == NetMsgType::SENDRECON)
+    {
+        uint32_t nReconVersion = 0;
+        uint64_t nSalt = 0;
+        vRecv >> nReconVersion >> nSalt;
+        if (nReconVersion >= TXRECONCILIATION_VERSION && nSalt != 0) {
+            LOCK(pfrom->cs_inventory);
+            if (pfrom->nRemoteReconSalt == 0) {
+                pfrom->nRemoteReconSalt = nSalt;
+                SetupTxReconciliation(pfrom);
+            }
+        }
+    }
+
+    else if (strCommand == NetMsgType::REQRECON)
+    {
+        uint16_t nRemoteSetSize = 0;
+        vRecv >> nRemoteSetSize;
+
+        vector<CInv> vInvFlood;
+        CTxSketch sketch;
+        {
+            LOCK(pfrom->cs_inventory);
+            CTxReconciliationState* recon = pfrom->reconState.get();
+            if (!recon || recon->fInitiator) {
+                LogPrint("net", "unexpected reqrecon from peer=%d\n", pfrom->id);
+                return true;
+            }
+            // The peer never finished the last round, the items of it get flooded
+            for (const auto& pair : recon->setSnapshot)
+                vInvFlood.push_back(pair.second);
+            recon->setSnapshot.clear();
+            recon->setSnapshot.swap(recon->setInventory);
+            sketch = CTxReconciliationState::GetSketch(recon->setSnapshot, EstimateSketchCapacity(recon->setSnapshot.size(), nRemoteSetSize));
+        }
+        PushReconciledInventory(pfrom, vInvFlood, connman);
+        connman.PushMessage(pfrom, NetMsgType::SKETCH, sketch);
+    }
+
+    else if (strCommand == NetMsgType::SKETCH)
+    {
+        CTxSketch sketch;
+        vRecv >> sketch;
+
+        vector<CInv> vInvAnnounce;
+        vector<uint32_t> vMissing;
+        bool fDecoded = false;
+        {
+            LOCK(pfrom->cs_inventory);
+            CTxReconciliationState* recon = pfrom->reconState.get();
+            if (!recon || !recon->fInitiator || recon->nRequestTime == 0) {
+                LogPrint("net", "unexpected sketch from peer=%d\n", pfrom->id);
+                return true;
+            }
+            recon->nRequestTime = 0;
+
+            CTxReconciliationState::ReconSet setLocal;
+            setLocal.swap(recon->setInventory);
+            CTxSketch diff = CTxReconciliationState::GetSketch(setLocal, sketch.GetCapacity());
+            diff.Merge(sketch);
+
+            vector<uint32_t> vDiff;
+            fDecoded = diff.Decode(vDiff);
+            if (fDecoded) {
+                // Ours get announced, the peer announces the rest
+                for (uint32_t nShortID : vDiff) {
+                    CTxReconciliationState::ReconSet::const_iterator it = setLocal.find(nShortID);
+                    if (it != setLocal.end())
+                        vInvAnnounce.push_back(it->second);
+                    else
+                        vMissing.push_back(nShortID);
+                }
+            } else {
+                // Too many differences for the sketch, both sides flood their sets
+                for (const auto& pair : setLocal)
+                    vInvAnnounce.push_back(pair.second);
+            }
+        }
+        LogPrint("net", "reconciliation with peer=%d %s, capacity=%u announced=%u missing=%u\n", pfrom->id,
+            fDecoded ? "decoded" : "failed", sketch.GetCapacity(), vInvAnnounce.size(), vMissing.size());
+        connman.PushMessage(pfrom, NetMsgType::RECONCILDIFF, fDecoded, vMissing);
+        PushReconciledInventory(pfrom, vInvAnnounce, connman);
+    }
+
+    else if (strCommand == NetMsgType::RECONCILDIFF)
+    {
+        bool fDecoded = false;
+        vector<uint32_t> vMissing;
+        vRecv >> fDecoded >> vMissing;
+        if (vMissing.size() > MAX_SKETCH_CAPACITY)
+        {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            return error("message reconcildiff size() = %u", vMissing.size());
+        }
+
+        vector<CInv> vInvAnnounce;
+        {
+            LOCK(pfrom->cs_inventory);
+            CTxReconciliationState* recon = pfrom->reconState.get();
+            if (!recon || recon->fInitiator) {
+                LogPrint("net", "unexpected reconcildiff from peer=%d\n", pfrom->id);
+                return true;
+            }
+            if (fDecoded) {
+                for (uint32_t nShortID : vMissing) {
+                    CTxReconciliationState::ReconSet::const_iterator it = recon->setSnapshot.find(nShortID);
+                    if (it != recon->setSnapshot.end())
+                        vInvAnnounce.push_back(it->second);
+                }
+            } else {
+                for (const auto& pair : recon->setSnapshot)
+                    vInvAnnounce.push_back(pair.second);
+            }
+            recon->setSnapshot.clear();
+        }
+        PushReconciledInventory(pfrom, vInvAnnounce, connman);
+    }
+
 
     else if (strCommand == NetMsgType::INV)
     {
@@ -1338,7 +1907,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                         CNodeState *nodestate = State(pfrom->GetId());
                         if (CanDirectFetch(chainparams.GetConsensus()) &&
                             nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-                            vToFetch.push_back(inv);
+                            // Close to the tip our mempool most likely has the transactions of the block
+                            if (nodestate->fProvidesHeaderAndIDs)
+                                vToFetch.push_back(CInv(MSG_CMPCT_BLOCK, inv.hash));
+                            else
+                                vToFetch.push_back(inv);
                             // Mark block as in flight already, even though the actual "getdata" message only goes out
                             // later (within the same cs_main lock, though).
                             MarkBlockAsInFlight(pfrom->GetId(), inv.hash, chainparams.GetConsensus());
@@ -1439,6 +2012,132 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     }
 
 
+    else if (strCommand == NetMsgType::GETBLOCKTXN)
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+        if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrintf("Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
+            assert(!"cannot load block from disk");
+
+        if (it->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            // Older blocks are sent in full, so a peer can't have us read one
+            // block from disk after the other for a few bytes of traffic.
+            LogPrint("net", "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+            connman.PushMessage(pfrom, NetMsgType::BLOCK, block);
+            return true;
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices\n", pfrom->id);
+                return true;
+            }
+            resp.txn[i] = *block.vtx[req.indexes[i]];
+        }
+        connman.PushMessage(pfrom, NetMsgType::BLOCKTXN, resp);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFILTERS)
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFILTERS_SIZE, pindexStop))
+            return true;
+
+        std::vector<uint256> vecHashes = GetBlockFilterRequestHashes(pindexStop, nStartHeight);
+        for (const uint256& hash : vecHashes) {
+            CBlockFilter filter;
+            if (!GetBlockFilter(hash, filter)) {
+                LogPrintf("Failed to find the block filter of %s requested by peer %d\n", hash.ToString(), pfrom->id);
+                return true;
+            }
+            connman.PushMessage(pfrom, NetMsgType::CFILTER, filter);
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFHEADERS)
+    {
+        uint8_t nFilterType;
+        uint32_t nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFHEADERS_SIZE, pindexStop))
+            return true;
+
+        // One more hash in front, the header before the range
+        std::vector<uint256> vecHashes = GetBlockFilterRequestHashes(pindexStop, nStartHeight > 0 ? nStartHeight - 1 : 0);
+        uint256 prevHeader;
+        if (nStartHeight > 0) {
+            uint256 hashPrev = vecHashes.front();
+            vecHashes.erase(vecHashes.begin());
+            if (!GetBlockFilterHeader(hashPrev, prevHeader)) {
+                LogPrintf("Failed to find the block filter header of %s requested by peer %d\n", hashPrev.ToString(), pfrom->id);
+                return true;
+            }
+        }
+
+        std::vector<uint256> vecFilterHashes(vecHashes.size());
+        for (size_t i = 0; i < vecHashes.size(); i++) {
+            if (!GetBlockFilterHash(vecHashes[i], vecFilterHashes[i])) {
+                LogPrintf("Failed to find the block filter of %s requested by peer %d\n", vecHashes[i].ToString(), pfrom->id);
+                return true;
+            }
+        }
+
+        connman.PushMessage(pfrom, NetMsgType::CFHEADERS, nFilterType, hashStop, prevHeader, vecFilterHashes);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT)
+    {
+        uint8_t nFilterType;
+        uint256 hashStop;
+        vRecv >> nFilterType >> hashStop;
+
+        const CBlockIndex* pindexStop = NULL;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, 0, hashStop, std::numeric_limits<uint32_t>::max(), pindexStop))
+            return true;
+
+        // Every CFCHECKPT_INTERVAL block up to the stop block
+        std::vector<uint256> vecHashes;
+        {
+            LOCK(cs_main);
+            for (int nHeight = CFCHECKPT_INTERVAL; nHeight <= pindexStop->nHeight; nHeight += CFCHECKPT_INTERVAL)
+                vecHashes.push_back(pindexStop->GetAncestor(nHeight)->GetBlockHash());
+        }
+
+        std::vector<uint256> vecHeaders(vecHashes.size());
+        for (size_t i = 0; i < vecHashes.size(); i++) {
+            if (!GetBlockFilterHeader(vecHashes[i], vecHeaders[i])) {
+                LogPrintf("Failed to find the block filter header of %s requested by peer %d\n", vecHashes[i].ToString(), pfrom->id);
+                return true;
+            }
+        }
+
+        connman.PushMessage(pfrom, NetMsgType::CFCHECKPT, nFilterType, hashStop, vecHeaders);
+    }
+
+
     else if (strCommand == NetMsgType::GETHEADERS)
     {
         CBlockLocator locator;
@@ -1500,17 +2199,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         vector<uint256> vWorkQueue;
         vector<uint256> vEraseQueue;
-        CTransaction tx;
+        // Allocated once here, the mempool and the orphans share it
+        CTransactionRef ptx = MakeTransactionRef();
         CTxLockRequest txLockRequest;
         //CDarksendBroadcastTx dstx;
         int nInvType = MSG_TX;
 
         // Read data and assign inv type
         if(strCommand == NetMsgType::TX) {
-            vRecv >> tx;
+            vRecv >> ptx;
         } else if(strCommand == NetMsgType::TXLOCKREQUEST) {
             vRecv >> txLockRequest;
-            tx = txLockRequest;
+            ptx = MakeTransactionRef(txLockRequest);
             nInvType = MSG_TXLOCK_REQUEST;
         }
         // else if (strCommand == NetMsgType::DSTX) {
@@ -1518,10 +2218,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         //     tx = dstx.tx;
         //     nInvType = MSG_DSTX;
         // }
+        const CTransaction& tx = *ptx;
 
         CInv inv(nInvType, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
-        pfrom->setAskFor.erase(inv.hash);
+        pfrom->RemoveAskFor(inv.hash);
 
         // Process custom logic, no matter if tx will be accepted to mempool later or not
         if (strCommand == NetMsgType::TXLOCKREQUEST) {
@@ -1568,7 +2269,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         mapAlreadyAskedFor.erase(inv.hash);
 
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs))
+        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs))
         {
             // Process custom txes, this changes AlreadyHave to "true"
             // if (strCommand == NetMsgType::DSTX) {
@@ -1606,7 +2307,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                      ++mi)
                 {
                     const uint256& orphanHash = *mi;
-                    const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
+                    CTransactionRef porphanTx = mapOrphanTransactions[orphanHash].tx;
+                    const CTransaction& orphanTx = *porphanTx;
                     NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
                     bool fMissingInputs2 = false;
                     // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
@@ -1617,7 +2319,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
                     if (setMisbehaving.count(fromPeer))
                         continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2))
+                    if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, true, &fMissingInputs2))
                     {
                         LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
                         connman.RelayTransaction(orphanTx);
@@ -1650,7 +2352,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         else if (fMissingInputs)
         {
-            AddOrphanTx(tx, pfrom->GetId());
+            AddOrphanTx(ptx, pfrom->GetId());
 
             // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
             unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -1819,6 +2521,11 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                             pindexLast->GetBlockHash().ToString(), pindexLast->nHeight);
                 }
                 if (vGetData.size() > 0) {
+                    if (nodestate->fProvidesHeaderAndIDs && vGetData.size() == 1 && mapBlocksInFlight.size() == 1 && pindexLast->pprev->IsValid(BLOCK_VALID_CHAIN)) {
+                        // We seem to be rather well-synced, download the block
+                        // using a compact block, not a regular one
+                        vGetData[0] = CInv(MSG_CMPCT_BLOCK, vGetData[0].hash);
+                    }
                     connman.PushMessage(pfrom, NetMsgType::GETDATA, vGetData);
                 }
             }
@@ -1826,6 +2533,141 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
     }
 
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+
+        {
+        LOCK(cs_main);
+        if (mapBlockIndex.find(cmpctblock.header.hashPrevBlock) == mapBlockIndex.end()) {
+            // Doesn't connect (or is genesis), instead of DoSing in AcceptBlockHeader, request deeper headers
+            if (!IsInitialBlockDownload())
+                connman.PushMessage(pfrom, NetMsgType::GETHEADERS, chainActive.GetLocator(pindexBestHeader), uint256());
+            return true;
+        }
+        }
+
+        CBlockIndex *pindex = NULL;
+        CValidationState state;
+        if (!ProcessNewBlockHeaders({cmpctblock.header}, state, chainparams, &pindex)) {
+            int nDoS;
+            if (state.IsInvalid(nDoS)) {
+                if (nDoS > 0) {
+                    LOCK(cs_main);
+                    Misbehaving(pfrom->GetId(), nDoS);
+                }
+                LogPrintf("Peer %d sent us invalid header via cmpctblock\n", pfrom->id);
+                return true;
+            }
+        }
+
+        // Set when all the transactions were found, the block gets filled right away then
+        BlockTransactions txnNone;
+        bool fComplete = false;
+        {
+        LOCK(cs_main);
+        // If AcceptBlockHeader returned true, it set pindex
+        assert(pindex);
+        UpdateBlockAvailability(pfrom->GetId(), pindex->GetBlockHash());
+
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator blockInFlightIt = mapBlocksInFlight.find(pindex->GetBlockHash());
+        bool fAlreadyInFlight = blockInFlightIt != mapBlocksInFlight.end();
+
+        if (pindex->nStatus & BLOCK_HAVE_DATA) // Nothing to do here
+            return true;
+
+        if (pindex->nChainWork <= chainActive.Tip()->nChainWork || // We know something better
+                pindex->nTx != 0) { // We had this block at some point, but pruned it
+            if (fAlreadyInFlight) {
+                // We requested this block for some reason, but our mempool will probably be useless
+                // so we just grab the block via normal getdata
+                std::vector<CInv> vInv(1);
+                vInv[0] = CInv(MSG_BLOCK, cmpctblock.header.GetHash());
+                connman.PushMessage(pfrom, NetMsgType::GETDATA, vInv);
+            }
+            return true;
+        }
+
+        // If we're not close to tip yet, give up and let parallel block fetch work its magic
+        if (!fAlreadyInFlight && !CanDirectFetch(chainparams.GetConsensus()))
+            return true;
+
+        CNodeState *nodestate = State(pfrom->GetId());
+
+        // We want to be a bit conservative just to be extra careful about DoS
+        // possibilities in compact block processing...
+        if (pindex->nHeight <= chainActive.Height() + 2) {
+            if ((!fAlreadyInFlight && nodestate->nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) ||
+                 (fAlreadyInFlight && blockInFlightIt->second.first == pfrom->GetId())) {
+                list<QueuedBlock>::iterator *queuedBlockIt = NULL;
+                if (!MarkBlockAsInFlight(pfrom->GetId(), pindex->GetBlockHash(), chainparams.GetConsensus(), pindex, &queuedBlockIt)) {
+                    if (!(*queuedBlockIt)->partialBlock)
+                        (*queuedBlockIt)->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+                    else {
+                        // The block was already in flight using compact blocks from the same peer
+                        LogPrint("net", "Peer sent us compact block we were already syncing!\n");
+                        return true;
+                    }
+                }
+
+                // The transactions of the InstantSend lock requests are looked at besides the
+                // mempool, a locked transaction the mempool didn't take is still in the block
+                std::vector<CTransaction> vExtraTxn;
+                instantsend.GetTxLockRequestTxes(vExtraTxn);
+
+                PartiallyDownloadedBlock& partialBlock = *(*queuedBlockIt)->partialBlock;
+                ReadStatus status = partialBlock.InitData(cmpctblock, vExtraTxn);
+                if (status == READ_STATUS_INVALID) {
+                    MarkBlockAsReceived(pindex->GetBlockHash()); // Reset in-flight state in case of whitelist
+                    Misbehaving(pfrom->GetId(), 100);
+                    LogPrintf("Peer %d sent us invalid compact block\n", pfrom->id);
+                    return true;
+                } else if (status == READ_STATUS_FAILED) {
+                    // Duplicate txindexes, the block is now in-flight, so just request it
+                    (*queuedBlockIt)->partialBlock.reset();
+                    std::vector<CInv> vInv(1);
+                    vInv[0] = CInv(MSG_BLOCK, cmpctblock.header.GetHash());
+                    connman.PushMessage(pfrom, NetMsgType::GETDATA, vInv);
+                    return true;
+                }
+
+                BlockTransactionsRequest req;
+                for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                    if (!partialBlock.IsTxAvailable(i))
+                        req.indexes.push_back(i);
+                }
+                if (req.indexes.empty()) {
+                    txnNone.blockhash = pindex->GetBlockHash();
+                    fComplete = true;
+                } else {
+                    req.blockhash = pindex->GetBlockHash();
+                    connman.PushMessage(pfrom, NetMsgType::GETBLOCKTXN, req);
+                }
+            }
+        } else if (fAlreadyInFlight) {
+            // We requested this block, but its far into the future, so our
+            // mempool will probably be useless - request the block normally
+            std::vector<CInv> vInv(1);
+            vInv[0] = CInv(MSG_BLOCK, cmpctblock.header.GetHash());
+            connman.PushMessage(pfrom, NetMsgType::GETDATA, vInv);
+            return true;
+        }
+        // Otherwise it was an announcement, the header got processed and the
+        // block gets downloaded like the ones announced with headers
+        }
+
+        if (fComplete)
+            return ProcessBlockTransactions(pfrom, txnNone, chainparams, connman);
+    }
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+        return ProcessBlockTransactions(pfrom, resp, chainparams, connman);
+    }
+
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         CBlock block;
@@ -1903,10 +2745,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         BOOST_FOREACH(uint256& hash, vtxid) {
             CInv inv(MSG_TX, hash);
             if (pfrom->pfilter) {
-                CTransaction tx;
-                bool fInMemPool = mempool.lookup(hash, tx);
-                if (!fInMemPool) continue; // another thread removed since queryHashes, maybe...
-                if (!pfrom->pfilter->IsRelevantAndUpdate(tx)) continue;
+                CTransactionRef ptx = mempool.get(hash);
+                if (!ptx) continue; // another thread removed since queryHashes, maybe...
+                if (!pfrom->pfilter->IsRelevantAndUpdate(*ptx)) continue;
             }
             vInv.push_back(inv);
             if (vInv.size() == MAX_INV_SZ) {
@@ -2118,7 +2959,14 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
         }
 
-        if (found)
+        CSubsystemMessageQueue* pqueue = found ? GetSubsystemMessageQueue(strCommand) : NULL;
+        if (pqueue && pqueue->Queue(pfrom, strCommand, vRecv))
+        {
+            // Processed on the thread of the subsystem, which also records it
+            if (CProcessedNetMsg* pmsg = CProcessedNetMsg::Current())
+                pmsg->fQueued = true;
+        }
+        else if (found)
         {
             mnodeman.ProcessMessage(pfrom, strCommand, vRecv, connman);
             mnpayments.ProcessMessage(pfrom, strCommand, vRecv, connman);
@@ -2170,6 +3018,12 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
             LOCK(pfrom->cs_vProcessMsg);
             if (pfrom->vProcessMsg.empty())
                 return false;
+            // A smartnode layer message waits while the queue of its subsystem is
+            // full and so do the messages after it. Once the peer's process queue
+            // fills up too, fPauseRecv stops reading from it.
+            CSubsystemMessageQueue* pqueue = GetSubsystemMessageQueue(pfrom->vProcessMsg.front().hdr.GetCommand());
+            if (pqueue && pqueue->IsFull())
+                return false;
             // Just take one message
             msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
             pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
@@ -2211,6 +3065,7 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
         }
 
         // Process message
+        CProcessedNetMsg processed(pfrom, strCommand);
         bool fRet = false;
         try
         {
@@ -2244,8 +3099,13 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
 
-        if (!fRet)
+        if (!fRet) {
+            processed.fRejected = true;
             LogPrint("net", "%s(%s, %u bytes) FAILED peer=%d\n", __func__, SanitizeString(strCommand), nMessageSize, pfrom->id);
+        }
+
+        // peer id, command, payload bytes, processed successfully
+        TRACE4(net, inbound_message, pfrom->id, strCommand.c_str(), nMessageSize, fRet);
 
     return fMoreWork;
 }
@@ -2409,10 +3269,13 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
             // not yet known to our peer but would connect, and send.
             // If no header would connect, or if we have too many
             // blocks, or if the peer doesn't want headers, just
-            // add all to the inv queue.
+            // add all to the inv queue. A single new block goes out as a
+            // cmpctblock to the peers which asked for those.
             LOCK(pto->cs_inventory);
             vector<CBlock> vHeaders;
-            bool fRevertToInv = (!state.fPreferHeaders || pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
+            bool fRevertToInv = ((!state.fPreferHeaders &&
+                                 (!state.fPreferHeaderAndIDs || pto->vBlockHashesToAnnounce.size() > 1)) ||
+                                pto->vBlockHashesToAnnounce.size() > MAX_BLOCKS_TO_ANNOUNCE);
             CBlockIndex *pBestIndex = NULL; // last header queued for delivery
             ProcessBlockAvailability(pto->id); // ensure pindexBestKnownBlock is up-to-date
 
@@ -2491,7 +3354,20 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
                             pto->id, hashToAnnounce.ToString());
                     }
                 }
-            } else if (!vHeaders.empty()) {
+            } else if (state.fPreferHeaderAndIDs && vHeaders.size() == 1) {
+                // The compact block of the tip is built once for all the
+                // peers it gets announced to
+                if (!pcmpctblockTip || pcmpctblockTip->header.GetHash() != pBestIndex->GetBlockHash()) {
+                    CBlock block;
+                    if (!ReadBlockFromDisk(block, pBestIndex, consensusParams))
+                        assert(!"cannot load block from disk");
+                    pcmpctblockTip = std::make_shared<const CBlockHeaderAndShortTxIDs>(block);
+                }
+                LogPrint("net", "%s: sending cmpctblock %s to peer=%d\n", __func__,
+                        pBestIndex->GetBlockHash().ToString(), pto->id);
+                connman.PushMessage(pto, NetMsgType::CMPCTBLOCK, *pcmpctblockTip);
+                state.pindexBestHeaderSent = pBestIndex;
+            } else if (state.fPreferHeaders) {
                 if (vHeaders.size() > 1) {
                     LogPrint("net", "%s: %u headers, range (%s, %s), to peer=%d\n", __func__,
                             vHeaders.size(),
@@ -2563,6 +3439,25 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
             connman.PushMessage(pto, NetMsgType::INV, vInv);
         }
 
+        //
+        // Message: reqrecon
+        //
+        {
+            LOCK(pto->cs_inventory);
+            CTxReconciliationState* recon = pto->reconState.get();
+            if (recon && recon->fInitiator) {
+                // A sketch which never arrived doesn't hold up the next rounds
+                if (recon->nRequestTime != 0 && recon->nRequestTime < nNow - 1000000 * RECON_RESPONSE_TIMEOUT)
+                    recon->nRequestTime = 0;
+                if (recon->nRequestTime == 0 && recon->nNextRequest < nNow) {
+                    recon->nRequestTime = nNow;
+                    recon->nNextRequest = PoissonNextSend(nNow, RECON_REQUEST_INTERVAL);
+                    uint16_t nSetSize = std::min<size_t>(recon->setInventory.size(), std::numeric_limits<uint16_t>::max());
+                    connman.PushMessage(pto, NetMsgType::REQRECON, nSetSize);
+                }
+            }
+        }
+
         // Detect whether we're stalling
         nNow = GetTimeMicros();
         if (!pto->fDisconnect && state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
@@ -2623,10 +3518,13 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
         // Message: getdata (blocks)
         //
         vector<CInv> vGetData;
-        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        int nBlocksInFlightLimit = GetBlocksInFlightLimit(&state);
+        int nBlocksRequested = state.nBlocksInFlight + state.nBlocksInFlightRedundant;
+        if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && nBlocksRequested < nBlocksInFlightLimit) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            CBlockIndex* pindexStalling = NULL;
+            FindNextBlocksToDownload(pto->GetId(), nBlocksInFlightLimit - nBlocksRequested, vToDownload, staller, pindexStalling, consensusParams);
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
                 vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
@@ -2639,14 +3537,37 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
                     LogPrint("net", "Stall started peer=%d\n", staller);
                 }
             }
+            if (staller != -1 && pindexStalling != NULL && state.nAvgBlockDeliveryTime != 0 &&
+                    !mapBlocksRedundant.count(pindexStalling->GetBlockHash())) {
+                // The block holding up the window, which this peer would have delivered twice
+                // over by now, gets requested from it as well. Whichever peer sends it first
+                // moves the window on, and saves the slow one from the stalling disconnect.
+                const QueuedBlock& queued = *mapBlocksInFlight[pindexStalling->GetBlockHash()].second;
+                if (nNow - queued.nTime > 2 * state.nAvgBlockDeliveryTime) {
+                    vGetData.push_back(CInv(MSG_BLOCK, pindexStalling->GetBlockHash()));
+                    mapBlocksRedundant[pindexStalling->GetBlockHash()] = pto->GetId();
+                    state.nBlocksInFlightRedundant++;
+                    state.nRedundantRequests++;
+                    LogPrint("net", "Requesting block %s (%d) peer=%d as well, it holds up the download at peer=%d\n",
+                        pindexStalling->GetBlockHash().ToString(), pindexStalling->nHeight, pto->id, staller);
+                }
+            }
         }
 
         //
         // Message: getdata (non-blocks)
         //
-        while (!pto->fDisconnect && !pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
+        std::vector<CInv> vAskFor;
+        {
+            LOCK(pto->cs_askFor);
+            while (!pto->fDisconnect && !pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
+            {
+                vAskFor.push_back((*pto->mapAskFor.begin()).second);
+                pto->mapAskFor.erase(pto->mapAskFor.begin());
+            }
+        }
+        BOOST_FOREACH(const CInv& inv, vAskFor)
         {
-            const CInv& inv = (*pto->mapAskFor.begin()).second;
             if (!AlreadyHave(inv))
             {
                 LogPrint("net", "SendMessages -- GETDATA -- requesting inv = %s peer=%d\n", inv.ToString(), pto->id);
@@ -2660,9 +3581,8 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
             } else {
                 //If we're not going to ask, don't expect a response.
                 LogPrint("net", "SendMessages -- GETDATA -- already have inv = %s peer=%d\n", inv.ToString(), pto->id);
-                pto->setAskFor.erase(inv.hash);
+                pto->RemoveAskFor(inv.hash);
             }
-            pto->mapAskFor.erase(pto->mapAskFor.begin());
         }
         if (!vGetData.empty()) {
             connman.PushMessage(pto, NetMsgType::GETDATA, vGetData);
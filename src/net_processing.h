@@ -6,9 +6,11 @@
 #ifndef BITCOIN_NET_PROCESSING_H
 #define BITCOIN_NET_PROCESSING_H
 
+#include "blockencodings.h"
 #include "net.h"
 #include "validationinterface.h"
 
+#include <memory>
 
 struct CBlockReject {
     unsigned char chRejectCode;
@@ -21,6 +23,8 @@ struct QueuedBlock {
     uint256 hash;
     CBlockIndex* pindex;     //!< Optional.
     bool fValidatedHeaders;  //!< Whether this block has validated headers at the time of request.
+    std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+    int64_t nTime;           //!< When the block was requested (in microseconds).
 };
 
 
@@ -62,10 +66,22 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Average time the peer took per block we requested, while it had some in flight (in microseconds), or 0.
+    int64_t nAvgBlockDeliveryTime;
+    //! When the peer delivered the last block we requested from it (in microseconds).
+    int64_t nLastBlockDelivery;
+    //! Blocks in flight from another peer which holds up the download window, requested from this one as well.
+    int nBlocksInFlightRedundant;
+    //! Number of such redundant block requests this peer got.
+    int nRedundantRequests;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
     bool fPreferHeaders;
+    //! Whether this peer wants cmpctblocks (when possible) for block announcements.
+    bool fPreferHeaderAndIDs;
+    //! Whether this peer sent us a sendcmpct, it sends cmpctblocks if we request them.
+    bool fProvidesHeaderAndIDs;
 
     CNodeState(CAddress addrIn, std::string addrNameIn) : address(addrIn), name(addrNameIn) {
         fCurrentlyConnected = false;
@@ -81,8 +97,14 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nAvgBlockDeliveryTime = 0;
+        nLastBlockDelivery = 0;
+        nBlocksInFlightRedundant = 0;
+        nRedundantRequests = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
+        fPreferHeaderAndIDs = false;
+        fProvidesHeaderAndIDs = false;
     }
 };
 
@@ -115,6 +137,9 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    double dBlockRate;
+    int nBlocksInFlightLimit;
+    int nRedundantRequests;
 };
 
 /** Get statistics from node state */
@@ -122,6 +147,17 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 
+/** Number of messages one smartnode layer subsystem queues at most, the peer's
+ *  messages wait in its process queue while the subsystem catches up */
+static const size_t MAX_SUBSYSTEM_QUEUED_MESSAGES = 1000;
+
+/**
+ * Start the threads which process the smartnode layer messages, one for each
+ * subsystem (list, payments, InstantSend, sporks, sync). Without them these
+ * messages get processed on the message handler thread.
+ */
+void StartSmartnodeMessageQueues(boost::thread_group& threadGroup, CConnman& connman);
+
 /** Process protocol messages received from a given node */
 bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interrupt);
 /**
@@ -0,0 +1,208 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_OBJECTPOOL_H
+#define BITCOIN_OBJECTPOOL_H
+
+#include "memusage.h"
+
+#include <assert.h>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Slab allocator for objects of type T.
+ *
+ * Memory is requested in slabs of nSlabSize objects and released slots are
+ * kept in a free list for reuse, so creating and destroying lots of small
+ * objects neither hits malloc for every object nor fragments the heap.
+ * Objects still alive when the pool gets destroyed are not destructed.
+ *
+ * The pool is not thread safe, the owner has to take care of the locking.
+ */
+template <typename T>
+class CObjectPool
+{
+    union Slot {
+        Slot* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+    };
+
+    std::vector<std::unique_ptr<Slot[]> > slabs;
+    Slot* pFree;
+    size_t nSlabSize;
+    size_t nSlab;
+    size_t nSlabUsed;
+    size_t nObjects;
+
+    Slot* AllocateSlot()
+    {
+        if (pFree) {
+            Slot* slot = pFree;
+            pFree = slot->next;
+            return slot;
+        }
+
+        if (nSlabUsed == nSlabSize) {
+            ++nSlab;
+            nSlabUsed = 0;
+        }
+
+        if (nSlab == slabs.size()) {
+            slabs.emplace_back(new Slot[nSlabSize]);
+        }
+
+        return &slabs[nSlab][nSlabUsed++];
+    }
+
+    void FreeSlot(Slot* slot)
+    {
+        slot->next = pFree;
+        pFree = slot;
+    }
+
+public:
+    explicit CObjectPool(size_t nSlabSizeIn = 1024) : pFree(nullptr), nSlabSize(nSlabSizeIn), nSlab(0), nSlabUsed(0), nObjects(0)
+    {
+        assert(nSlabSize > 0);
+    }
+
+    CObjectPool(const CObjectPool&) = delete;
+    CObjectPool& operator=(const CObjectPool&) = delete;
+
+    template <typename... Args>
+    T* Construct(Args&&... args)
+    {
+        Slot* slot = AllocateSlot();
+        T* pObject;
+
+        try {
+            pObject = new (&slot->data) T(std::forward<Args>(args)...);
+        } catch (...) {
+            FreeSlot(slot);
+            throw;
+        }
+
+        ++nObjects;
+        return pObject;
+    }
+
+    void Destroy(T* pObject)
+    {
+        if (!pObject) {
+            return;
+        }
+
+        assert(nObjects > 0);
+
+        pObject->~T();
+        FreeSlot(reinterpret_cast<Slot*>(pObject));
+        --nObjects;
+    }
+
+    /** Forget about all slots and keep only as many slabs as required to hold nKeep
+     *  objects. All objects must have been destroyed before. */
+    void Reset(size_t nKeep = 0)
+    {
+        assert(nObjects == 0);
+
+        size_t nKeepSlabs = (nKeep + nSlabSize - 1) / nSlabSize;
+
+        if (slabs.size() > nKeepSlabs) {
+            slabs.resize(nKeepSlabs);
+        }
+
+        pFree = nullptr;
+        nSlab = 0;
+        nSlabUsed = 0;
+    }
+
+    /** Exchange all slabs and objects with other. */
+    void Swap(CObjectPool& other)
+    {
+        slabs.swap(other.slabs);
+        std::swap(pFree, other.pFree);
+        std::swap(nSlabSize, other.nSlabSize);
+        std::swap(nSlab, other.nSlab);
+        std::swap(nSlabUsed, other.nSlabUsed);
+        std::swap(nObjects, other.nObjects);
+    }
+
+    size_t Size() const { return nObjects; }
+    size_t Capacity() const { return slabs.size() * nSlabSize; }
+
+    size_t DynamicMemoryUsage() const
+    {
+        return slabs.size() * memusage::MallocUsage(nSlabSize * sizeof(Slot)) + memusage::DynamicUsage(slabs);
+    }
+};
+
+/**
+ * Allocator for node based containers like std::unordered_map, taking memory
+ * blocks of BlockSize bytes out of a CObjectPool, which has to outlive the
+ * container. Requests not fitting a block, like larger bucket arrays, go to
+ * operator new.
+ */
+template <typename T, size_t BlockSize, size_t BlockAlign = alignof(void*)>
+class CObjectPoolAllocator
+{
+public:
+    typedef typename std::aligned_storage<BlockSize, BlockAlign>::type Block;
+    typedef CObjectPool<Block> Pool;
+    typedef T value_type;
+
+    template <typename U>
+    struct rebind {
+        typedef CObjectPoolAllocator<U, BlockSize, BlockAlign> other;
+    };
+
+    explicit CObjectPoolAllocator(Pool* poolIn) noexcept : pool(poolIn) {}
+
+    template <typename U>
+    CObjectPoolAllocator(const CObjectPoolAllocator<U, BlockSize, BlockAlign>& other) noexcept : pool(other.GetPool()) {}
+
+    T* allocate(size_t n)
+    {
+        if (Fits(n)) {
+            return reinterpret_cast<T*>(pool->Construct());
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        if (Fits(n)) {
+            pool->Destroy(reinterpret_cast<Block*>(p));
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    Pool* GetPool() const noexcept { return pool; }
+
+private:
+    Pool* pool;
+
+    static bool Fits(size_t n)
+    {
+        return n * sizeof(T) <= sizeof(Block) && alignof(T) <= alignof(Block);
+    }
+};
+
+template <typename T, typename U, size_t BlockSize, size_t BlockAlign>
+bool operator==(const CObjectPoolAllocator<T, BlockSize, BlockAlign>& a, const CObjectPoolAllocator<U, BlockSize, BlockAlign>& b) noexcept
+{
+    return a.GetPool() == b.GetPool();
+}
+
+template <typename T, typename U, size_t BlockSize, size_t BlockAlign>
+bool operator!=(const CObjectPoolAllocator<T, BlockSize, BlockAlign>& a, const CObjectPoolAllocator<U, BlockSize, BlockAlign>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_OBJECTPOOL_H
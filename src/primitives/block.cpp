@@ -15,6 +15,23 @@
 //     return SerializeHash(*this);
 // }
 
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashes)
+{
+    // The fields GetHash hashes, nVersion up to nNonce
+    static const size_t HEADER_HASH_SIZE = 80;
+    std::vector<unsigned char> vData(vHeaders.size() * HEADER_HASH_SIZE);
+
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        const CBlockHeader& header = vHeaders[i];
+        assert(END(header.nNonce) - BEGIN(header.nVersion) == (ptrdiff_t)HEADER_HASH_SIZE);
+        memcpy(&vData[i * HEADER_HASH_SIZE], BEGIN(header.nVersion), HEADER_HASH_SIZE);
+    }
+
+    vHashes.resize(vHeaders.size());
+    if (!vHeaders.empty())
+        HashKeccakMany(&vHashes[0], &vData[0], vHeaders.size());
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
@@ -27,7 +44,7 @@ std::string CBlock::ToString() const
         vtx.size());
     for (unsigned int i = 0; i < vtx.size(); i++)
     {
-        s << "  " << vtx[i].ToString() << "\n";
+        s << "  " << vtx[i]->ToString() << "\n";
     }
     return s.str();
 }
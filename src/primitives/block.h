@@ -79,8 +79,8 @@ public:
 class CBlock : public CBlockHeader
 {
 public:
-    // network and disk
-    std::vector<CTransaction> vtx;
+    // network and disk, shared with the mempool and everyone else holding the transactions
+    std::vector<CTransactionRef> vtx;
 
     // memory only
     mutable bool fChecked;
@@ -90,6 +90,12 @@ public:
     mutable std::vector<CTxOut> voutSmartRewards;
     mutable std::vector<uint256> vMerkleTree;
 
+private:
+    // memory only, the hash set by SetHash and the header it belongs to
+    uint256 hashCached;
+    CBlockHeader headerCached;
+
+public:
     CBlock()
     {
         SetNull();
@@ -117,6 +123,25 @@ public:
         voutSmartNodes.clear();
         voutSmartRewards.clear();
         fChecked = false;
+        hashCached.SetNull();
+    }
+
+    /** Remember the hash of the header, ReadBlockFromDisk sets the one of the block
+     *  index. A changed header gets hashed again, GetHash never writes the cache so
+     *  blocks shared between threads stay read only. */
+    void SetHash(const uint256& hash)
+    {
+        hashCached = hash;
+        headerCached = GetBlockHeader();
+    }
+
+    uint256 GetHash() const
+    {
+        if (!hashCached.IsNull() && nNonce == headerCached.nNonce && nTime == headerCached.nTime &&
+            hashMerkleRoot == headerCached.hashMerkleRoot && hashPrevBlock == headerCached.hashPrevBlock &&
+            nBits == headerCached.nBits && nVersion == headerCached.nVersion)
+            return hashCached;
+        return CBlockHeader::GetHash();
     }
 
     CBlockHeader GetBlockHeader() const
@@ -148,7 +173,7 @@ public:
     {
         vMerkleTree.clear();
         for (unsigned int i = 0; i < vtx.size(); ++i){
-            vMerkleTree.push_back(vtx[i].GetHash());
+            vMerkleTree.push_back(vtx[i]->GetHash());
         }
         int j = 0;
         for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
@@ -166,6 +191,9 @@ public:
     }
 };
 
+/** Hashes of the headers, several get computed at once, see HashKeccakMany. */
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashes);
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
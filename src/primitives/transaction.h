@@ -222,7 +222,8 @@ public:
 
     bool IsVoteKeyRegistrationData() const
     {
-        return scriptPubKey.IsVoteKeyData() && nValue == VOTEKEY_REGISTER_FEE;
+        // The fee is the cheap check, almost no output pays exactly it
+        return nValue == VOTEKEY_REGISTER_FEE && scriptPubKey.IsVoteKeyData();
     }
 
     uint32_t GetLockTime() const;
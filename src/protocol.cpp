@@ -40,6 +40,16 @@ const char *SENDCMPCT="sendcmpct";
 const char *CMPCTBLOCK="cmpctblock"; 
 const char *GETBLOCKTXN="getblocktxn"; 
 const char *BLOCKTXN="blocktxn";
+const char *SENDRECON="sendrecon";
+const char *REQRECON="reqrecon";
+const char *SKETCH="sketch";
+const char *RECONCILDIFF="reconcildiff";
+const char *GETCFILTERS="getcfilters";
+const char *CFILTER="cfilter";
+const char *GETCFHEADERS="getcfheaders";
+const char *CFHEADERS="cfheaders";
+const char *GETCFCHECKPT="getcfcheckpt";
+const char *CFCHECKPT="cfcheckpt";
 // SmartCash message types
 const char *TXLOCKREQUEST="ix";
 const char *TXLOCKVOTE="txlvote";
@@ -65,6 +75,7 @@ const char *DSSTATUSUPDATE="dssu";
 const char *DSTX="dstx";
 const char *DSQUEUE="dsq";
 const char *DSEG="dseg";
+const char *DSEGDELTA="dsegd";
 const char *SYNCSTATUSCOUNT="ssc";
 const char *VOTINGSYNC="votesync";
 const char *VOTINGPROPOSAL="proposal";
@@ -130,6 +141,16 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::CMPCTBLOCK, 
     NetMsgType::GETBLOCKTXN, 
     NetMsgType::BLOCKTXN,
+    NetMsgType::SENDRECON,
+    NetMsgType::REQRECON,
+    NetMsgType::SKETCH,
+    NetMsgType::RECONCILDIFF,
+    NetMsgType::GETCFILTERS,
+    NetMsgType::CFILTER,
+    NetMsgType::GETCFHEADERS,
+    NetMsgType::CFHEADERS,
+    NetMsgType::GETCFCHECKPT,
+    NetMsgType::CFCHECKPT,
     // SmartCash message types
     // NOTE: do NOT include non-implmented here, we want them to be "Unknown command" in ProcessMessage()
     NetMsgType::TXLOCKREQUEST,
@@ -150,6 +171,7 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::DSTX,
     NetMsgType::DSQUEUE,
     NetMsgType::DSEG,
+    NetMsgType::DSEGDELTA,
     NetMsgType::SYNCSTATUSCOUNT,
     NetMsgType::VOTINGSYNC,
     NetMsgType::VOTINGPROPOSAL,
@@ -250,6 +250,59 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152 
  */ 
 extern const char *BLOCKTXN; 
+/**
+ * Contains a 4-byte version number and an 8-byte salt.
+ * Indicates that a node reconciles its transaction inventory with the peer,
+ * once both sides sent it, see txreconciliation.h.
+ */
+extern const char *SENDRECON;
+/**
+ * Contains the 2-byte size of the sender's reconciliation set.
+ * Asks the peer for the "sketch" of its set, sent by the side which made the connection.
+ */
+extern const char *REQRECON;
+/**
+ * Contains a CTxSketch of the sender's reconciliation set.
+ * Sent in response to a "reqrecon" message.
+ */
+extern const char *SKETCH;
+/**
+ * Contains a 1-byte bool whether the difference decoded and the 4-byte short
+ * ids of the items the sender is missing. The peer announces those, or all of
+ * its set if the difference didn't decode.
+ */
+extern const char *RECONCILDIFF;
+/**
+ * Contains a 1-byte filter type, the 4-byte start height and the hash of the
+ * last block. Asks for the filters of the blocks from the start height up to
+ * the last one, one "cfilter" message each.
+ * Only available with service bit NODE_COMPACT_FILTERS, see BIP 157.
+ */
+extern const char *GETCFILTERS;
+/**
+ * Contains a CBlockFilter, sent in response to "getcfilters".
+ */
+extern const char *CFILTER;
+/**
+ * Contains the same as "getcfilters". Asks for the filter hashes of the
+ * blocks and the filter header of the block before the start height.
+ */
+extern const char *GETCFHEADERS;
+/**
+ * Contains the filter type, the hash of the last block, the previous filter
+ * header and the filter hashes, sent in response to "getcfheaders".
+ */
+extern const char *CFHEADERS;
+/**
+ * Contains a 1-byte filter type and the hash of the last block. Asks for
+ * the filter headers at every CFCHECKPT_INTERVAL heights up to the block.
+ */
+extern const char *GETCFCHECKPT;
+/**
+ * Contains the filter type, the hash of the last block and the filter
+ * headers, sent in response to "getcfcheckpt".
+ */
+extern const char *CFCHECKPT;
     
 extern const char *TXLOCKVOTE;
 
@@ -273,6 +326,7 @@ extern const char *DSSTATUSUPDATE;
 extern const char *DSTX;
 extern const char *DSQUEUE;
 extern const char *DSEG;
+extern const char *DSEGDELTA;
 extern const char *SYNCSTATUSCOUNT;
 extern const char *VOTINGSYNC;
 extern const char *VOTINGPROPOSAL;
@@ -300,6 +354,13 @@ enum ServiceFlags : uint64_t {
     // but no longer do as of protocol version 70201 (= NO_BLOOM_VERSION)
     NODE_BLOOM = (1 << 2),
 
+    // NODE_SMARTNODE_LIST_DELTA means the node answers dsegd requests with the
+    // entries of its smartnode list the requester doesn't have yet.
+    NODE_SMARTNODE_LIST_DELTA = (1 << 5),
+    // NODE_COMPACT_FILTERS means the node serves the basic block filters of
+    // BIP 157 and 158, see -peerblockfilters.
+    NODE_COMPACT_FILTERS = (1 << 6),
+
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
     // bitcoin-development mailing list. Remember that service bits are just
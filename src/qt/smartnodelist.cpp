@@ -13,9 +13,11 @@
 #include "wallet/wallet.h"
 #include "walletmodel.h"
 #include "nodecontroldialog.h"
+#include "smartnodetablemodel.h"
 
 #include <QTimer>
 #include <QMessageBox>
+#include <QSortFilterProxyModel>
 
 
 bool SmartnodeWidgetItem::operator<(const QTableWidgetItem &other) const {
@@ -45,7 +47,9 @@ SmartnodeList::SmartnodeList(const PlatformStyle *platformStyle, QWidget *parent
     ui(new Ui::SmartnodeList),
     clientModel(0),
     walletModel(0),
-    platformStyle(platformStyle)
+    platformStyle(platformStyle),
+    smartnodeModel(0),
+    smartnodeProxyModel(0)
 {
     ui->setupUi(this);
 
@@ -65,11 +69,25 @@ SmartnodeList::SmartnodeList(const PlatformStyle *platformStyle, QWidget *parent
     ui->tableWidgetMySmartnodes->setColumnWidth(4, columnActiveWidth);
     ui->tableWidgetMySmartnodes->setColumnWidth(5, columnLastSeenWidth);
 
-    ui->tableWidgetSmartnodes->setColumnWidth(0, columnAddressWidth);
-    ui->tableWidgetSmartnodes->setColumnWidth(1, columnProtocolWidth);
-    ui->tableWidgetSmartnodes->setColumnWidth(2, columnStatusWidth);
-    ui->tableWidgetSmartnodes->setColumnWidth(3, columnActiveWidth);
-    ui->tableWidgetSmartnodes->setColumnWidth(4, columnLastSeenWidth);
+    smartnodeModel = new SmartnodeTableModel(this);
+    smartnodeProxyModel = new QSortFilterProxyModel(this);
+    smartnodeProxyModel->setSourceModel(smartnodeModel);
+    smartnodeProxyModel->setSortRole(SmartnodeTableModel::SortRole);
+    smartnodeProxyModel->setFilterKeyColumn(-1);
+    smartnodeProxyModel->setDynamicSortFilter(true);
+    ui->tableViewSmartnodes->setModel(smartnodeProxyModel);
+    ui->tableViewSmartnodes->sortByColumn(SmartnodeTableModel::Address, Qt::AscendingOrder);
+
+    ui->tableViewSmartnodes->setColumnWidth(SmartnodeTableModel::Address, columnAddressWidth);
+    ui->tableViewSmartnodes->setColumnWidth(SmartnodeTableModel::Protocol, columnProtocolWidth);
+    ui->tableViewSmartnodes->setColumnWidth(SmartnodeTableModel::Status, columnStatusWidth);
+    ui->tableViewSmartnodes->setColumnWidth(SmartnodeTableModel::Active, columnActiveWidth);
+    ui->tableViewSmartnodes->setColumnWidth(SmartnodeTableModel::LastSeen, columnLastSeenWidth);
+
+    connect(smartnodeProxyModel, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(updateNodeCount()));
+    connect(smartnodeProxyModel, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(updateNodeCount()));
+    connect(smartnodeProxyModel, SIGNAL(modelReset()), this, SLOT(updateNodeCount()));
+    connect(smartnodeProxyModel, SIGNAL(layoutChanged()), this, SLOT(updateNodeCount()));
 
     ui->tableWidgetMySmartnodes->setContextMenuPolicy(Qt::CustomContextMenu);
 
@@ -84,9 +102,7 @@ SmartnodeList::SmartnodeList(const PlatformStyle *platformStyle, QWidget *parent
     connect(timer, SIGNAL(timeout()), this, SLOT(updateMyNodeList()));
     timer->start(1000);
 
-    fFilterUpdated = false;
-    nTimeFilterUpdated = GetTime();
-    updateNodeList();
+    updateNodeCount();
 }
 
 SmartnodeList::~SmartnodeList()
@@ -287,87 +303,23 @@ void SmartnodeList::updateMyNodeList(bool fForce)
 
 void SmartnodeList::updateNodeList()
 {
-    TRY_LOCK(cs_mnlist, fLockAcquired);
-    if(!fLockAcquired) {
+    if (ShutdownRequested()) {
+        timer->stop();
         return;
     }
 
-    if( ShutdownRequested() ) delete timer;
-
-    static int64_t nTimeListUpdated = GetTime();
-
-    // to prevent high cpu usage update only once in SMARTNODELIST_UPDATE_SECONDS seconds
-    // or SMARTNODELIST_FILTER_COOLDOWN_SECONDS seconds after filter was last changed
-    int64_t nSecondsToWait = fFilterUpdated
-                            ? nTimeFilterUpdated - GetTime() + SMARTNODELIST_FILTER_COOLDOWN_SECONDS
-                            : nTimeListUpdated - GetTime() + SMARTNODELIST_UPDATE_SECONDS;
-
-    if(fFilterUpdated) ui->countLabel->setText(QString::fromStdString(strprintf("Please wait... %d", nSecondsToWait)));
-    if(nSecondsToWait > 0) return;
-
-    nTimeListUpdated = GetTime();
-    fFilterUpdated = false;
-
-    QString strToFilter;
-    ui->countLabel->setText("Updating...");
-    ui->tableWidgetSmartnodes->setSortingEnabled(false);
-    ui->tableWidgetSmartnodes->clearContents();
-    ui->tableWidgetSmartnodes->setRowCount(0);
-    std::map<COutPoint, CSmartnode> mapSmartnodes = mnodeman.GetFullSmartnodeMap();
-
-    int offsetFromUtc = GetOffsetFromUtc();
-
-    for(auto& mnpair : mapSmartnodes)
-    {
-        CSmartnode mn = mnpair.second;
-        // populate list
-        // Address, Protocol, Status, Active Seconds, Last Seen, Pub Key
-        SmartnodeWidgetItem *addressItem = new SmartnodeWidgetItem(QString::fromStdString(mn.addr.ToString()));
-        SmartnodeWidgetItem *protocolItem = new SmartnodeWidgetItem(QString::number(mn.nProtocolVersion));
-        SmartnodeWidgetItem *statusItem = new SmartnodeWidgetItem(QString::fromStdString(mn.GetStatus()));
-
-        int activeSeconds = mn.lastPing.sigTime - mn.sigTime;
-        activeSeconds = activeSeconds < 0 ? 0: activeSeconds;
-
-        QString activeSecondsTitle = QString::fromStdString(DurationToDHMS(activeSeconds));
-        SmartnodeWidgetItem *activeSecondsItem = new SmartnodeWidgetItem(activeSecondsTitle, activeSeconds);
-
-        int lastSeen = mn.lastPing.sigTime + offsetFromUtc;
-        QString lastSeenTitle = QString::fromStdString(DateTimeStrFormat("%Y-%m-%d %H:%M",lastSeen));
-        SmartnodeWidgetItem *lastSeenItem = new SmartnodeWidgetItem(lastSeenTitle, lastSeen);
-
-        SmartnodeWidgetItem *pubkeyItem = new SmartnodeWidgetItem(QString::fromStdString(CBitcoinAddress(mn.pubKeyCollateralAddress.GetID()).ToString()));
-
-        if (strCurrentFilter != "")
-        {
-            strToFilter =   addressItem->text() + " " +
-                            protocolItem->text() + " " +
-                            statusItem->text() + " " +
-                            activeSecondsItem->text() + " " +
-                            lastSeenItem->text() + " " +
-                            pubkeyItem->text();
-            if (!strToFilter.contains(strCurrentFilter)) continue;
-        }
-
-        ui->tableWidgetSmartnodes->insertRow(0);
-        ui->tableWidgetSmartnodes->setItem(0, 0, addressItem);
-        ui->tableWidgetSmartnodes->setItem(0, 1, protocolItem);
-        ui->tableWidgetSmartnodes->setItem(0, 2, statusItem);
-        ui->tableWidgetSmartnodes->setItem(0, 3, activeSecondsItem);
-        ui->tableWidgetSmartnodes->setItem(0, 4, lastSeenItem);
-        ui->tableWidgetSmartnodes->setItem(0, 5, pubkeyItem);
-    }
+    // Only the added, removed or changed rows get updated, nothing if the list didn't change
+    smartnodeModel->refresh();
+}
 
-    ui->countLabel->setText(QString::number(ui->tableWidgetSmartnodes->rowCount()));
-    ui->tableWidgetSmartnodes->setSortingEnabled(true);
+void SmartnodeList::updateNodeCount()
+{
+    ui->countLabel->setText(QString::number(smartnodeProxyModel->rowCount()));
 }
 
 void SmartnodeList::on_filterLineEdit_textChanged(const QString &strFilterIn)
 {
-    strCurrentFilter = strFilterIn;
-    nTimeFilterUpdated = GetTime();
-    fFilterUpdated = true;
-    ui->countLabel->setText(QString::fromStdString(strprintf("Please wait... %d", SMARTNODELIST_FILTER_COOLDOWN_SECONDS)));
+    smartnodeProxyModel->setFilterFixedString(strFilterIn);
 }
 
 void SmartnodeList::on_startButton_clicked()
@@ -12,8 +12,6 @@
 #include <QWidget>
 
 #define MY_SMARTNODELIST_UPDATE_SECONDS                 60
-#define SMARTNODELIST_UPDATE_SECONDS                    60
-#define SMARTNODELIST_FILTER_COOLDOWN_SECONDS            3
 
 namespace Ui {
     class SmartnodeList;
@@ -33,10 +31,12 @@ public:
 };
 
 class ClientModel;
+class SmartnodeTableModel;
 class WalletModel;
 
 QT_BEGIN_NAMESPACE
 class QModelIndex;
+class QSortFilterProxyModel;
 QT_END_NAMESPACE
 
 /** Smartnode Manager page widget */
@@ -66,8 +66,6 @@ public:
 
 private:
     QMenu *contextMenu;
-    int64_t nTimeFilterUpdated;
-    bool fFilterUpdated;
 
 public Q_SLOTS:
     void updateMySmartnodeInfo(QString strAlias, QString strAddr, const COutPoint& outpoint);
@@ -84,16 +82,16 @@ private:
 
     const PlatformStyle *platformStyle;
 
-    // Protects tableWidgetSmartnodes
-    CCriticalSection cs_mnlist;
+    SmartnodeTableModel *smartnodeModel;
+    // Sorts and filters tableViewSmartnodes
+    QSortFilterProxyModel *smartnodeProxyModel;
 
     // Protects tableWidgetMySmartnodes
     CCriticalSection cs_mymnlist;
 
-    QString strCurrentFilter;
-
 private Q_SLOTS:
     void showContextMenu(const QPoint &);
+    void updateNodeCount();
     void on_filterLineEdit_textChanged(const QString &strFilterIn);
     void on_startButton_clicked();
 //    void on_startAllButton_clicked();
@@ -0,0 +1,193 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "smartnodetablemodel.h"
+
+#include "base58.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#include <QDateTime>
+
+SmartnodeTableEntry::SmartnodeTableEntry(const CSmartnode& mn) :
+    outpoint(mn.vin.prevout),
+    addr(mn.addr),
+    nProtocolVersion(mn.nProtocolVersion),
+    nActiveState(mn.nActiveState),
+    sigTime(mn.sigTime),
+    nLastPing(mn.lastPing.sigTime),
+    collateralID(mn.pubKeyCollateralAddress.GetID()),
+    strAddress(QString::fromStdString(mn.addr.ToString())),
+    strPayee(QString::fromStdString(CBitcoinAddress(collateralID).ToString()))
+{
+}
+
+bool SmartnodeTableEntry::matches(const CSmartnode& mn) const
+{
+    return addr == mn.addr && nProtocolVersion == mn.nProtocolVersion && nActiveState == mn.nActiveState &&
+           sigTime == mn.sigTime && nLastPing == mn.lastPing.sigTime && collateralID == mn.pubKeyCollateralAddress.GetID();
+}
+
+// private implementation
+class SmartnodeTablePriv
+{
+public:
+    /** The snapshot the rows are of, unchanged snapshots need no refresh */
+    CSmartnodeMan::snapshot_t snapshot;
+    /** The rows in outpoint order, the same as the one of the snapshot */
+    std::vector<SmartnodeTableEntry> rows;
+
+    int size() const
+    {
+        return rows.size();
+    }
+
+    const SmartnodeTableEntry *index(int idx) const
+    {
+        if (idx >= 0 && idx < (int)rows.size())
+            return &rows[idx];
+
+        return 0;
+    }
+};
+
+SmartnodeTableModel::SmartnodeTableModel(QObject *parent) :
+    QAbstractTableModel(parent)
+{
+    columns << tr("Address") << tr("Protocol") << tr("Status") << tr("Active") << tr("Last Seen") << tr("Payee");
+    priv.reset(new SmartnodeTablePriv());
+
+    // load initial data
+    refresh();
+}
+
+SmartnodeTableModel::~SmartnodeTableModel()
+{
+    // Intentionally left empty
+}
+
+int SmartnodeTableModel::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return priv->size();
+}
+
+int SmartnodeTableModel::columnCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return columns.length();
+}
+
+QVariant SmartnodeTableModel::data(const QModelIndex &index, int role) const
+{
+    const SmartnodeTableEntry *rec = priv->index(index.row());
+    if (!index.isValid() || !rec)
+        return QVariant();
+
+    int64_t nActiveSeconds = std::max<int64_t>(0, rec->nLastPing - rec->sigTime);
+
+    if (role == SortRole) {
+        switch (index.column())
+        {
+        case Protocol:
+            return rec->nProtocolVersion;
+        case Active:
+            return (qlonglong)nActiveSeconds;
+        case LastSeen:
+            return (qlonglong)rec->nLastPing;
+        }
+        return data(index, Qt::DisplayRole);
+    }
+
+    if (role == Qt::DisplayRole) {
+        switch (index.column())
+        {
+        case Address:
+            return rec->strAddress;
+        case Protocol:
+            return QString::number(rec->nProtocolVersion);
+        case Status:
+            return QString::fromStdString(CSmartnode::StateToString(rec->nActiveState));
+        case Active:
+            return QString::fromStdString(DurationToDHMS(nActiveSeconds));
+        case LastSeen:
+            return QDateTime::fromTime_t((qint32)rec->nLastPing).toString("yyyy-MM-dd hh:mm");
+        case Payee:
+            return rec->strPayee;
+        }
+    }
+
+    return QVariant();
+}
+
+QVariant SmartnodeTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if(orientation == Qt::Horizontal)
+    {
+        if(role == Qt::DisplayRole && section < columns.size())
+        {
+            return columns[section];
+        }
+    }
+    return QVariant();
+}
+
+Qt::ItemFlags SmartnodeTableModel::flags(const QModelIndex &index) const
+{
+    if(!index.isValid())
+        return 0;
+
+    Qt::ItemFlags retval = Qt::ItemIsSelectable | Qt::ItemIsEnabled;
+    return retval;
+}
+
+void SmartnodeTableModel::refresh()
+{
+    CSmartnodeMan::snapshot_t snapshot = mnodeman.GetSmartnodeSnapshot();
+    if (snapshot == priv->snapshot)
+        return;
+    priv->snapshot = snapshot;
+
+    std::vector<SmartnodeTableEntry>& rows = priv->rows;
+
+    if (rows.empty() || snapshot->empty()) {
+        beginResetModel();
+        rows.clear();
+        rows.reserve(snapshot->size());
+        for (const CSmartnode& mn : *snapshot)
+            rows.push_back(SmartnodeTableEntry(mn));
+        endResetModel();
+        return;
+    }
+
+    // Merge the snapshot into the rows, consecutive added or removed ones go in one step
+    size_t nRow = 0, nNew = 0;
+    while (nRow < rows.size() || nNew < snapshot->size())
+    {
+        if (nNew == snapshot->size() || (nRow < rows.size() && rows[nRow].outpoint < (*snapshot)[nNew].vin.prevout)) {
+            size_t nEnd = nRow + 1;
+            while (nEnd < rows.size() && (nNew == snapshot->size() || rows[nEnd].outpoint < (*snapshot)[nNew].vin.prevout))
+                nEnd++;
+            beginRemoveRows(QModelIndex(), nRow, nEnd - 1);
+            rows.erase(rows.begin() + nRow, rows.begin() + nEnd);
+            endRemoveRows();
+        } else if (nRow == rows.size() || (*snapshot)[nNew].vin.prevout < rows[nRow].outpoint) {
+            std::vector<SmartnodeTableEntry> vecAdded;
+            while (nNew < snapshot->size() && (nRow == rows.size() || (*snapshot)[nNew].vin.prevout < rows[nRow].outpoint))
+                vecAdded.push_back(SmartnodeTableEntry((*snapshot)[nNew++]));
+            beginInsertRows(QModelIndex(), nRow, nRow + vecAdded.size() - 1);
+            rows.insert(rows.begin() + nRow, vecAdded.begin(), vecAdded.end());
+            endInsertRows();
+            nRow += vecAdded.size();
+        } else {
+            const CSmartnode& mn = (*snapshot)[nNew++];
+            if (!rows[nRow].matches(mn)) {
+                rows[nRow] = SmartnodeTableEntry(mn);
+                Q_EMIT dataChanged(index(nRow, 0), index(nRow, columns.length() - 1));
+            }
+            nRow++;
+        }
+    }
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_QT_SMARTNODETABLEMODEL_H
+#define SMARTCASH_QT_SMARTNODETABLEMODEL_H
+
+#include "smartnode/smartnodeman.h"
+
+#include <QAbstractTableModel>
+#include <QStringList>
+
+class SmartnodeTablePriv;
+
+/** One row of the smartnode list, the fields shown and the ones they are formatted from */
+struct SmartnodeTableEntry {
+    COutPoint outpoint;
+    CService addr;
+    int nProtocolVersion;
+    int nActiveState;
+    int64_t sigTime;
+    int64_t nLastPing;
+    CKeyID collateralID;
+    QString strAddress;
+    QString strPayee;
+
+    explicit SmartnodeTableEntry(const CSmartnode& mn);
+    /** Whether the shown fields of mn are the same, compared without formatting anything */
+    bool matches(const CSmartnode& mn) const;
+};
+
+/**
+   Qt model of the smartnode list. The rows follow the shared snapshot of
+   CSmartnodeMan, which only gets rebuilt on changes of the list or of a state
+   and every few seconds for the pings, so a refresh with the same snapshot is
+   free. Otherwise the new snapshot gets compared against the rows, both are in
+   outpoint order, and only the rows which got added, removed or changed are
+   signalled.
+   Sorting and filtering are up to a proxy model, see SortRole.
+ */
+class SmartnodeTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit SmartnodeTableModel(QObject *parent = 0);
+    ~SmartnodeTableModel();
+
+    enum ColumnIndex {
+        Address = 0,
+        Protocol = 1,
+        Status = 2,
+        Active = 3,
+        LastSeen = 4,
+        Payee = 5
+    };
+
+    enum RoleIndex {
+        /** Numbers for the numeric columns, the shown text for the others */
+        SortRole = Qt::UserRole
+    };
+
+    /** @name Methods overridden from QAbstractTableModel
+        @{*/
+    int rowCount(const QModelIndex &parent) const;
+    int columnCount(const QModelIndex &parent) const;
+    QVariant data(const QModelIndex &index, int role) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const;
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+    /*@}*/
+
+public Q_SLOTS:
+    void refresh();
+
+private:
+    QStringList columns;
+    std::unique_ptr<SmartnodeTablePriv> priv;
+};
+
+#endif // SMARTCASH_QT_SMARTNODETABLEMODEL_H
@@ -36,26 +36,78 @@
 #include <QHBoxLayout>
 #include <QSpacerItem>
 
-struct QSmartRewardField
+QSmartRewardField::QSmartRewardField() : label(QString()), address(QString()),
+                                         balance(0), balanceAtStart(0), eligible(0), reward(0),
+                                         disqualifyingTx(),
+                                         fIsSmartNode(false), fActivated(false),
+                                         bonusLevel(CSmartRewardEntry::NoBonus) {}
+
+/* Object for looking up the reward entries of the wallet's addresses in a separate thread.
+*/
+class SmartRewardsListWorker : public QObject
 {
-    QString label;
-    QString address;
-    CAmount balance;
-    CAmount balanceAtStart;
-    CAmount eligible;
-    CAmount reward;
-    uint256 disqualifyingTx;
-    bool fIsSmartNode;
-    bool fActivated;
-    uint8_t bonusLevel;
-
-    QSmartRewardField() : label(QString()), address(QString()),
-                          balance(0), eligible(0),reward(0),
-                          disqualifyingTx(),
-                          fIsSmartNode(false), fActivated(false),
-                          bonusLevel(CSmartRewardEntry::NoBonus) {}
+    Q_OBJECT
+
+public Q_SLOTS:
+    void fetch(const QSmartRewardFieldList &fields);
+
+Q_SIGNALS:
+    void fetched(const QSmartRewardsListUpdate &update);
 };
 
+#include "smartrewardslist.moc"
+
+void SmartRewardsListWorker::fetch(const QSmartRewardFieldList &fields)
+{
+    QSmartRewardsListUpdate update;
+
+    update.rounds = prewards->GetRoundsSnapshot();
+    const CSmartRewardRound &currentRound = update.rounds->current;
+
+    std::vector<CSmartAddress> ids;
+    ids.reserve(fields.size());
+
+    for (const QSmartRewardField &field : fields)
+        ids.push_back(CSmartAddress::Legacy(field.address.toStdString()));
+
+    // All of them with one lock of cs_rewardscache
+    CSmartRewardEntryList entries;
+    std::vector<bool> vFound;
+    prewards->GetRewardEntries(ids, entries, vFound);
+
+    for (size_t i = 0; i < fields.size(); ++i) {
+
+        QSmartRewardField field = fields[i];
+
+        if( vFound[i] ){
+            const CSmartRewardEntry &reward = entries[i];
+
+            field.balance = reward.balance;
+            field.fIsSmartNode = !reward.smartnodePaymentTx.IsNull();
+            field.balanceAtStart = reward.balanceAtStart;
+            field.disqualifyingTx = reward.disqualifyingTx;
+            field.fActivated = reward.fActivated;
+            field.bonusLevel = reward.bonusLevel;
+
+            if( !currentRound.Is_1_3() ){
+                field.eligible = reward.balanceEligible && reward.disqualifyingTx.IsNull() ? reward.balanceEligible : 0;
+            }else{
+                field.eligible = reward.IsEligible() ? reward.balanceEligible : 0;
+            }
+
+            field.reward = currentRound.percent * field.eligible;
+
+            if( currentRound.Is_1_3() && !field.fActivated ){
+                ++update.nAvailableForProof;
+            }
+        }
+
+        if( field.balance || field.eligible ) update.fields.push_back(field);
+    }
+
+    Q_EMIT fetched(update);
+}
+
 struct SortSmartRewardWidgets
 {
     bool operator()(QSmartRewardEntry* w1,
@@ -82,7 +134,9 @@ SmartrewardsList::SmartrewardsList(const PlatformStyle *platformStyle, QWidget *
     model(nullptr),
     clientModel(nullptr),
     platformStyle(platformStyle),
-    state(STATE_INIT)
+    state(STATE_INIT),
+    fUpdating(false),
+    fUpdatePending(false)
 {
     ui->setupUi(this);
 
@@ -104,16 +158,38 @@ SmartrewardsList::SmartrewardsList(const PlatformStyle *platformStyle, QWidget *
 
 
     ui->stackedWidget->setCurrentIndex(0);
+
+    qRegisterMetaType<QSmartRewardFieldList>("QSmartRewardFieldList");
+    qRegisterMetaType<QSmartRewardsListUpdate>("QSmartRewardsListUpdate");
+
+    SmartRewardsListWorker *worker = new SmartRewardsListWorker();
+    worker->moveToThread(&thread);
+
+    connect(this, SIGNAL(fetchRequest(QSmartRewardFieldList)), worker, SLOT(fetch(QSmartRewardFieldList)));
+    connect(worker, SIGNAL(fetched(QSmartRewardsListUpdate)), this, SLOT(updateOverviewUI(QSmartRewardsListUpdate)));
+    connect(&thread, SIGNAL(finished()), worker, SLOT(deleteLater()), Qt::DirectConnection);
+
+    thread.start();
 }
 
 SmartrewardsList::~SmartrewardsList()
 {
+    stopWorker();
     delete ui;
 }
 
+void SmartrewardsList::stopWorker()
+{
+    if( thread.isRunning() ){
+        thread.quit();
+        thread.wait();
+    }
+}
+
 void SmartrewardsList::setModel(WalletModel *model)
 {
     this->model = model;
+    hashShown.SetNull();
     updateUI();
 }
 
@@ -121,13 +197,75 @@ void SmartrewardsList::setClientModel(ClientModel *model)
 {
     this->clientModel = model;
 
-    if( clientModel )
+    if( clientModel ){
         connect(clientModel, SIGNAL(SmartRewardsUpdated()), this, SLOT(updateUI()));
+        // The client model goes away before the shutdown, the worker must not look up anything after it.
+        connect(clientModel, SIGNAL(destroyed()), this, SLOT(stopWorker()));
+    }
 
 }
 
-void SmartrewardsList::updateOverviewUI(const CSmartRewardRound &currentRound, const CBlockIndex *tip)
+void SmartrewardsList::requestUpdate()
 {
+    if( fUpdating ){
+        fUpdatePending = true;
+        return;
+    }
+
+    std::map<QString, std::vector<COutput> > mapCoins;
+    model->listCoins(mapCoins);
+
+    QSmartRewardFieldList fields;
+
+    BOOST_FOREACH(const PAIRTYPE(QString, std::vector<COutput>)& coins, mapCoins) {
+
+        QString sWalletAddress = coins.first;
+        QString sWalletLabel = model->getAddressTableModel()->labelForAddress(sWalletAddress);
+
+        if (sWalletLabel.isEmpty())
+            sWalletLabel = tr("(no label)");
+
+        QSmartRewardField rewardField;
+
+        rewardField.address = sWalletAddress;
+        rewardField.label = sWalletLabel;
+
+        BOOST_FOREACH(const COutput& out, coins.second) {
+
+            CTxDestination outputAddress;
+
+            if(ExtractDestination(out.tx->vout[out.i].scriptPubKey, outputAddress)){
+
+                QString sAddress = QString::fromStdString(CBitcoinAddress(outputAddress).ToString());
+
+                if (!(sAddress == sWalletAddress)){ // change address
+
+                    QSmartRewardField change;
+
+                    change.address = sAddress;
+                    change.label = tr("(change)");
+                    change.balance = out.tx->vout[out.i].nValue;
+
+                    fields.push_back(change);
+                }
+            }
+        }
+
+        if( !rewardField.address.isEmpty() ) fields.push_back(rewardField);
+    }
+
+    fUpdating = true;
+    Q_EMIT fetchRequest(fields);
+}
+
+void SmartrewardsList::updateOverviewUI(const QSmartRewardsListUpdate &update)
+{
+    fUpdating = false;
+    hashShown = update.rounds->block.nHash;
+
+    const CSmartRewardRound &currentRound = update.rounds->current;
+    int nHeight = update.rounds->block.nHeight;
+
 
     if( !currentRound.Is_1_3() ){
         ui->btnSendProofs->hide();
@@ -172,9 +310,9 @@ void SmartrewardsList::updateOverviewUI(const CSmartRewardRound &currentRound, c
     roundEnd.setTime_t(currentRound.endBlockTime);
     QString roundEndText;
 
-    if( ( ( MainNet() && currentRound.number >= nRewardsFirstAutomatedRound ) || TestNet() ) && tip ){
+    if( ( ( MainNet() && currentRound.number >= nRewardsFirstAutomatedRound ) || TestNet() ) && nHeight ){
 
-        int64_t remainingBlocks = currentRound.endBlockHeight - tip->nHeight;
+        int64_t remainingBlocks = currentRound.endBlockHeight - nHeight;
 
         roundEndText = QString("%1 blocks ( ").arg(remainingBlocks);
 
@@ -243,107 +381,7 @@ void SmartrewardsList::updateOverviewUI(const CSmartRewardRound &currentRound, c
 
     ui->nextRoundLabel->setText(roundEndText);
 
-    int nAvailableForProof = 0;
-    std::map<QString, std::vector<COutput> > mapCoins;
-    model->listCoins(mapCoins);
-
-    std::vector<QSmartRewardField> rewardList;
-
-    BOOST_FOREACH(const PAIRTYPE(QString, std::vector<COutput>)& coins, mapCoins) {
-
-        QString sWalletAddress = coins.first;
-        QString sWalletLabel = model->getAddressTableModel()->labelForAddress(sWalletAddress);
-
-        if (sWalletLabel.isEmpty())
-            sWalletLabel = tr("(no label)");
-
-        QSmartRewardField rewardField;
-
-        rewardField.address = sWalletAddress;
-        rewardField.label = sWalletLabel;
-
-        BOOST_FOREACH(const COutput& out, coins.second) {
-
-            CTxDestination outputAddress;
-            QString sAddress;
-
-            if(ExtractDestination(out.tx->vout[out.i].scriptPubKey, outputAddress)){
-
-                sAddress = QString::fromStdString(CBitcoinAddress(outputAddress).ToString());
-
-                if (!(sAddress == sWalletAddress)){ // change address
-
-                    QSmartRewardField change;
-                    CSmartRewardEntry *reward = nullptr;
-
-                    change.address = sAddress;
-                    change.label = tr("(change)");
-                    change.balance = out.tx->vout[out.i].nValue;
-
-                    if( prewards->GetRewardEntry(CSmartAddress::Legacy(sAddress.toStdString()), reward, false) ){
-                        change.balance = reward->balance;
-                        change.fIsSmartNode = !reward->smartnodePaymentTx.IsNull();
-                        change.balanceAtStart = reward->balanceAtStart;
-                        change.disqualifyingTx = reward->disqualifyingTx;
-                        change.fActivated = reward->fActivated;
-
-                        if( !currentRound.Is_1_3() ){
-                            change.eligible = reward->balanceEligible && reward->disqualifyingTx.IsNull() ? reward->balanceEligible : 0;
-                        }else{
-                            change.eligible = reward->IsEligible() ? reward->balanceEligible : 0;
-                        }
-
-                        change.reward = currentRound.percent * change.eligible;
-
-                        if( currentRound.Is_1_3() && !change.fActivated ){
-                            ++nAvailableForProof;
-                        }
-                    }
-
-                    if( change.balance || change.eligible ) rewardList.push_back(change);
-
-                    continue;
-
-                }else{
-
-                    rewardField.label = model->getAddressTableModel()->labelForAddress(rewardField.address);
-
-                    if (rewardField.label.isEmpty())
-                        rewardField.label = tr("(no label)");
-                }
-
-            }
-
-        }
-
-        if( !rewardField.address.isEmpty() ){
-
-            CSmartRewardEntry *reward = nullptr;
-
-            if( prewards->GetRewardEntry(CSmartAddress::Legacy(rewardField.address.toStdString()), reward, false) ){
-                rewardField.balance = reward->balance;
-                rewardField.fIsSmartNode = !reward->smartnodePaymentTx.IsNull();
-                rewardField.balanceAtStart = reward->balanceAtStart;
-                rewardField.disqualifyingTx = reward->disqualifyingTx;
-                rewardField.fActivated = reward->fActivated;
-                rewardField.bonusLevel = reward->bonusLevel;
-
-                if( !currentRound.Is_1_3() ){
-                    rewardField.eligible = reward->balanceEligible && reward->disqualifyingTx.IsNull() ? reward->balanceEligible : 0;
-                }else{
-                    rewardField.eligible = reward->IsEligible() ? reward->balanceEligible : 0;
-                }
-
-                rewardField.reward = currentRound.percent * rewardField.eligible;
-
-                if( currentRound.Is_1_3() && !rewardField.fActivated ){
-                    ++nAvailableForProof;
-                }
-            }
-
-            if( rewardField.balance || rewardField.eligible ) rewardList.push_back(rewardField);
-        }
-    }
+    const QSmartRewardFieldList& rewardList = update.fields;
 
     int nEligibleAddresses = 0;
     CAmount rewardSum = 0;
@@ -354,7 +392,7 @@ void SmartrewardsList::updateOverviewUI(const CSmartRewardRound &currentRound, c
 
         auto it = std::find_if(rewardList.begin(),
                                rewardList.end(),
-                               [entry](QSmartRewardField& field) -> bool {
+                               [entry](const QSmartRewardField& field) -> bool {
             return (*entry)->Address() == field.address;
         });
 
@@ -366,7 +404,7 @@ void SmartrewardsList::updateOverviewUI(const CSmartRewardRound &currentRound, c
         }
     }
 
-    BOOST_FOREACH(const QSmartRewardField& field, rewardList) {
+    for (const QSmartRewardField& field : rewardList) {
 
         QSmartRewardEntry* entry;
 
@@ -470,8 +508,8 @@ void SmartrewardsList::updateOverviewUI(const CSmartRewardRound &currentRound, c
         }
     }
 
-    if( nAvailableForProof ){
-        ui->btnSendProofs->setText( QString(tr("Send ActivateRewards [%1]")).arg(nAvailableForProof) );
+    if( update.nAvailableForProof ){
+        ui->btnSendProofs->setText( QString(tr("Send ActivateRewards [%1]")).arg(update.nAvailableForProof) );
         ui->btnSendProofs->setEnabled(true);
     }else{
         ui->btnSendProofs->setText( tr("No addresses need to ActivateRewards") );
@@ -483,6 +521,12 @@ void SmartrewardsList::updateOverviewUI(const CSmartRewardRound &currentRound, c
     QString strEstimated = QString::fromStdString(strprintf("%d", (rewardSum + 50000000)/COIN));
     AddThousandsSpaces(strEstimated);
     ui->lblTotalRewards->setText(strEstimated + " SMART");
+
+    // Tip changes while the lookup ran
+    if( fUpdatePending ){
+        fUpdatePending = false;
+        requestUpdate();
+    }
 }
 
 void SmartrewardsList::updateUI()
@@ -492,14 +536,6 @@ void SmartrewardsList::updateUI()
         return;
     }
 
-    CSmartRewardRound currentRound;
-    CBlockIndex* tip = nullptr;
-    {
-        LOCK(cs_rewardscache);
-        currentRound = *prewards->GetCurrentRound();
-        tip = chainActive.Tip();
-    }
-
     switch(state){
     case STATE_INIT:
 
@@ -512,7 +548,9 @@ void SmartrewardsList::updateUI()
 
         break;
     case STATE_OVERVIEW:
-        updateOverviewUI(currentRound, tip);
+        // Only look up the entries again once another block got processed
+        if( hashShown.IsNull() || prewards->GetRoundsSnapshot()->block.nHash != hashShown )
+            requestUpdate();
         break;
     default:
         break;
@@ -548,5 +586,6 @@ void SmartrewardsList::on_btnSendProofs_clicked()
     SpecialTransactionDialog dlg(ACTIVATION_TRANSACTIONS, platformStyle);
     dlg.setModel(model);
     dlg.exec();
+    hashShown.SetNull();
     updateUI();
 }
@@ -10,14 +10,16 @@
 #include "sync.h"
 #include "util.h"
 
+#include <memory>
+
 #include <QDialog>
 #include <QMenu>
+#include <QThread>
 #include <QTimer>
 #include <QWidget>
 #include <QTableWidgetItem>
 
-class CSmartRewardRound;
-class CBlockIndex;
+struct CSmartRewardsRoundsSnapshot;
 
 namespace Ui {
     class SmartrewardsList;
@@ -44,6 +46,38 @@ class PlatformStyle;
 class QModelIndex;
 class QSmartRewardEntry;
 
+/** One address of the list, the wallet part is filled in by the GUI thread and the rewards part by SmartRewardsListWorker */
+struct QSmartRewardField
+{
+    QString label;
+    QString address;
+    CAmount balance;
+    CAmount balanceAtStart;
+    CAmount eligible;
+    CAmount reward;
+    uint256 disqualifyingTx;
+    bool fIsSmartNode;
+    bool fActivated;
+    uint8_t bonusLevel;
+
+    QSmartRewardField();
+};
+
+typedef std::vector<QSmartRewardField> QSmartRewardFieldList;
+
+/** The reward state of the wallet's addresses as of one processed block */
+struct QSmartRewardsListUpdate
+{
+    std::shared_ptr<const CSmartRewardsRoundsSnapshot> rounds;
+    QSmartRewardFieldList fields;
+    int nAvailableForProof;
+
+    QSmartRewardsListUpdate() : nAvailableForProof(0) {}
+};
+
+Q_DECLARE_METATYPE(QSmartRewardFieldList)
+Q_DECLARE_METATYPE(QSmartRewardsListUpdate)
+
 QT_BEGIN_NAMESPACE
 class QItemSelection;
 class QMenu;
@@ -70,7 +104,17 @@ class SmartrewardsList : public QWidget
     std::vector<QWidget*> vecLines;
     SmartRewardsListState state;
 
+    // The reward entries are looked up by a worker in this thread, cs_rewardscache
+    // can be held for a while by the block processing. At most one lookup runs at
+    // a time, the block tip changes during one lead to a single further lookup.
+    QThread thread;
+    bool fUpdating;
+    bool fUpdatePending;
+    /** Block of the rewards state shown, there is nothing new to look up until it changes */
+    uint256 hashShown;
+
     void setState(SmartrewardsList::SmartRewardsListState state);
+    void requestUpdate();
 
 public:
     explicit SmartrewardsList(const PlatformStyle *platformStyle, QWidget *parent = 0);
@@ -89,11 +133,17 @@ public:
     };
 
 public Q_SLOTS:
-    void updateOverviewUI(const CSmartRewardRound &currentRound, const CBlockIndex *tip);
+    void updateOverviewUI(const QSmartRewardsListUpdate &update);
     void updateUI();
 
     void on_btnSendProofs_clicked();
 
     void scrollChanged(int value);
+
+private Q_SLOTS:
+    void stopWorker();
+
+Q_SIGNALS:
+    void fetchRequest(const QSmartRewardFieldList &fields);
 };
 #endif // SMARTREWARDSLIST_H
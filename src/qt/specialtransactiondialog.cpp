@@ -390,12 +390,7 @@ void SpecialTransactionDialog::SendTransactions(std::vector<QString> &vecErrors)
             break;
         case ACTIVATION_TRANSACTIONS:{
 
-            int nCurrentRound;
-
-            {
-                LOCK(cs_rewardscache);
-                nCurrentRound = prewards->GetCurrentRound()->number;
-            }
+            int nCurrentRound = prewards->GetRoundsSnapshot()->current.number;
 
             fSuccess = SendActivationTransaction(it.first, it.second, nCurrentRound, strError);
         }break;
@@ -848,23 +843,24 @@ void SpecialTransactionDialog::updateView()
             CKeyID keyId;
             CSmartAddress address(CSmartAddress::Legacy(sWalletAddress.toStdString()));
             int nCurrentRound = 0;
-            CSmartRewardEntry *reward = nullptr;
+            CSmartRewardEntry reward;
+            bool fReward = false;
 
             {
                 LOCK(cs_rewardscache);
                 nCurrentRound = prewards->GetCurrentRound()->number;
-                prewards->GetRewardEntry(address, reward, false);
+                fReward = prewards->GetRewardEntry(address, reward);
             }
 
             if( !address.GetKeyID(keyId) ){
                 continue;
             }
 
-            if (reward) {
-                if (reward->fActivated) {
+            if (fReward) {
+                if (reward.fActivated) {
                     // Address is already activated
                     lineBrush.setColor(COLOR_GREEN);
-                } else if (!reward->smartnodePaymentTx.IsNull()) {
+                } else if (!reward.smartnodePaymentTx.IsNull()) {
                     // Address is linked to a SmartNode
                     lineBrush.setColor(COLOR_YELLOW);
                 }
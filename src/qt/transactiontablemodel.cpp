@@ -25,6 +25,7 @@
 #include <QDebug>
 #include <QIcon>
 #include <QList>
+#include <QTimer>
 
 #include <boost/foreach.hpp>
 
@@ -38,6 +39,9 @@ static int column_alignments[] = {
         Qt::AlignRight|Qt::AlignVCenter /* amount */
     };
 
+// Number of wallet transactions decomposed at once while loading the wallet
+static const int TRANSACTION_LOAD_BATCH_SIZE = 1000;
+
 // Comparison operator for sort/binary search of model tx list
 struct TxLessThan
 {
@@ -61,7 +65,8 @@ class TransactionTablePriv
 public:
     TransactionTablePriv(CWallet *wallet, TransactionTableModel *parent) :
         wallet(wallet),
-        parent(parent)
+        parent(parent),
+        fLoading(false)
     {
     }
 
@@ -74,20 +79,49 @@ public:
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* The wallet is loaded in batches in hash order, so that the GUI doesn't wait
+     * for all transactions to be decomposed and the wallet isn't locked all the time.
+     * Everything before hashLoadNext is in cachedWallet while fLoading is set.
+     */
+    bool fLoading;
+    uint256 hashLoadNext;
+
+    /* Query entire wallet anew from core, returns whether there is more to load.
      */
-    void refreshWallet()
+    bool refreshWallet()
     {
         qDebug() << "TransactionTablePriv::refreshWallet";
         cachedWallet.clear();
+        fLoading = true;
+        hashLoadNext.SetNull();
+        return loadWallet();
+    }
+
+    /* Decompose the next batch of wallet transactions, returns whether there is more to load.
+     */
+    bool loadWallet()
+    {
+        QList<TransactionRecord> toInsert;
         {
             LOCK2(cs_main, wallet->cs_wallet);
-            for(std::map<uint256, CWalletTx>::iterator it = wallet->mapWallet.begin(); it != wallet->mapWallet.end(); ++it)
+            std::map<uint256, CWalletTx>::iterator it = wallet->mapWallet.lower_bound(hashLoadNext);
+            for(int n = 0; it != wallet->mapWallet.end() && n < TRANSACTION_LOAD_BATCH_SIZE; ++it, ++n)
             {
                 if(TransactionRecord::showTransaction(it->second))
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wallet, it->second));
+                    toInsert.append(TransactionRecord::decomposeTransaction(wallet, it->second));
             }
+            fLoading = it != wallet->mapWallet.end();
+            if(fLoading)
+                hashLoadNext = it->first;
         }
+        if(!toInsert.isEmpty())
+        {
+            // All transactions in the model sort before the ones of this batch
+            parent->beginInsertRows(QModelIndex(), cachedWallet.size(), cachedWallet.size()+toInsert.size()-1);
+            cachedWallet.append(toInsert);
+            parent->endInsertRows();
+        }
+        return fLoading;
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -99,6 +133,12 @@ public:
     {
         qDebug() << "TransactionTablePriv::updateWallet: " + QString::fromStdString(hash.ToString()) + " " + QString::number(status);
 
+        if(fLoading && !(hash < hashLoadNext))
+        {
+            // Not loaded yet, it is decomposed with its batch
+            return;
+        }
+
         // Find bounds of this transaction in model
         QList<TransactionRecord>::iterator lower = qLowerBound(
             cachedWallet.begin(), cachedWallet.end(), hash, TxLessThan());
@@ -166,8 +206,13 @@ public:
             parent->endRemoveRows();
             break;
         case CT_UPDATED:
-            // Miscellaneous updates -- nothing to do, status update will take care of this, and is only computed for
-            // visible transactions.
+            // Miscellaneous updates -- the status is computed again when the transaction is shown
+            if(inModel)
+            {
+                for(QList<TransactionRecord>::iterator it = lower; it != upper; ++it)
+                    it->status.cur_num_blocks = -1;
+                Q_EMIT parent->dataChanged(parent->index(lowerIndex, 0), parent->index(upperIndex-1, parent->columns.length()-1));
+            }
             break;
         }
     }
@@ -181,32 +226,46 @@ public:
     {
         if(idx >= 0 && idx < cachedWallet.size())
         {
-            TransactionRecord *rec = &cachedWallet[idx];
-
-            // Get required locks upfront. This avoids the GUI from getting
-            // stuck if the core is holding the locks for a longer time - for
-            // example, during a wallet rescan.
-            //
-            // If a status update is needed (blocks came in since last check),
-            //  update the status of this transaction from the wallet. Otherwise,
-            // simply re-use the cached status.
-            TRY_LOCK(cs_main, lockMain);
-            if(lockMain)
+            return &cachedWallet[idx];
+        }
+        return 0;
+    }
+
+    /* Only done for the data which depends on the status, the sorting and
+     * filtering of all rows doesn't need it.
+     */
+    void updateStatus(TransactionRecord *rec)
+    {
+        // Get required locks upfront. This avoids the GUI from getting
+        // stuck if the core is holding the locks for a longer time - for
+        // example, during a wallet rescan.
+        //
+        // If a status update is needed (blocks came in since last check),
+        //  update the status of this transaction from the wallet. Otherwise,
+        // simply re-use the cached status.
+        TRY_LOCK(cs_main, lockMain);
+        if(lockMain)
+        {
+            TRY_LOCK(wallet->cs_wallet, lockWallet);
+            if(lockWallet && rec->statusUpdateNeeded())
             {
-                TRY_LOCK(wallet->cs_wallet, lockWallet);
-                if(lockWallet && rec->statusUpdateNeeded())
-                {
-                    std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
+                std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
 
-                    if(mi != wallet->mapWallet.end())
-                    {
-                        rec->updateStatus(mi->second);
-                    }
+                if(mi != wallet->mapWallet.end())
+                {
+                    rec->updateStatus(mi->second);
                 }
             }
-            return rec;
         }
-        return 0;
+    }
+
+    /* Whether the shown status can still change with the number of confirmations.
+     * Rows of which the status was never computed weren't shown yet.
+     */
+    bool statusChanging(int idx) const
+    {
+        const TransactionStatus &status = cachedWallet[idx].status;
+        return status.cur_num_blocks != -1 && status.status != TransactionStatus::Confirmed;
     }
 
     QString describe(TransactionRecord *rec, int unit)
@@ -244,7 +303,8 @@ TransactionTableModel::TransactionTableModel(const PlatformStyle *platformStyle,
         platformStyle(platformStyle)
 {
     columns << QString() << QString() << tr("Date") << tr("Type") << tr("Label") << BitcoinUnits::getAmountColumnTitle(walletModel->getOptionsModel()->getDisplayUnit());
-    priv->refreshWallet();
+    if(priv->refreshWallet())
+        QTimer::singleShot(0, this, SLOT(loadTransactions()));
 
     connect(walletModel->getOptionsModel(), SIGNAL(displayUnitChanged(int)), this, SLOT(updateDisplayUnit()));
 
@@ -272,14 +332,33 @@ void TransactionTableModel::updateTransaction(const QString &hash, int status, b
     priv->updateWallet(updated, status, showTransaction);
 }
 
+void TransactionTableModel::loadTransactions()
+{
+    if(priv->loadWallet())
+        QTimer::singleShot(0, this, SLOT(loadTransactions()));
+}
+
 void TransactionTableModel::updateConfirmations()
 {
     // Blocks came in since last poll.
     // Invalidate status (number of confirmations) and (possibly) description
-    //  for all rows. Qt is smart enough to only actually request the data for the
-    //  visible rows.
-    Q_EMIT dataChanged(index(0, Status), index(priv->size()-1, Status));
-    Q_EMIT dataChanged(index(0, ToAddress), index(priv->size()-1, ToAddress));
+    //  for the rows which are not confirmed yet. The others don't change but
+    //  in their tooltip, which is computed when it is shown.
+    int nFirst = -1;
+    for(int idx = 0; idx <= priv->size(); ++idx)
+    {
+        if(idx < priv->size() && priv->statusChanging(idx))
+        {
+            if(nFirst < 0)
+                nFirst = idx;
+        }
+        else if(nFirst >= 0)
+        {
+            Q_EMIT dataChanged(index(nFirst, Status), index(idx-1, Status));
+            Q_EMIT dataChanged(index(nFirst, ToAddress), index(idx-1, ToAddress));
+            nFirst = -1;
+        }
+    }
 }
 
 int TransactionTableModel::rowCount(const QModelIndex &parent) const
@@ -523,12 +602,35 @@ QString TransactionTableModel::formatTooltip(const TransactionRecord *rec) const
     return tooltip;
 }
 
+// Whether the data of the role depends on the status of the transaction
+static bool roleNeedsStatus(int role, int column)
+{
+    switch(role)
+    {
+    case TransactionTableModel::RawDecorationRole:
+    case Qt::EditRole:
+        return column == TransactionTableModel::Status;
+    case Qt::DisplayRole:
+        return column == TransactionTableModel::Amount;
+    case Qt::ToolTipRole:
+    case Qt::ForegroundRole:
+    case TransactionTableModel::TxPlainTextRole:
+    case TransactionTableModel::ConfirmedRole:
+    case TransactionTableModel::StatusRole:
+        return true;
+    }
+    return false;
+}
+
 QVariant TransactionTableModel::data(const QModelIndex &index, int role) const
 {
     if(!index.isValid())
         return QVariant();
     TransactionRecord *rec = static_cast<TransactionRecord*>(index.internalPointer());
 
+    if(roleNeedsStatus(role, index.column()))
+        priv->updateStatus(rec);
+
     switch(role)
     {
     case RawDecorationRole:
@@ -702,7 +804,7 @@ QModelIndex TransactionTableModel::index(int row, int column, const QModelIndex
     TransactionRecord *data = priv->index(row);
     if(data)
     {
-        return createIndex(row, column, priv->index(row));
+        return createIndex(row, column, data);
     }
     return QModelIndex();
 }
@@ -206,6 +206,20 @@ static bool rest_headers(HTTPRequest* req,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/** Send the binary block straight from its blk file, the bytes on disk are its network serialization. Requires cs_main. */
+static bool rest_block_file(HTTPRequest* req, const CBlockIndex* pblockindex)
+{
+    CDiskBlockPos pos;
+    unsigned int nSize;
+    if (!GetBlockDiskRange(pblockindex, pos, nSize, Params().MessageStart()))
+        return false;
+    if (!req->AddReplyFile(GetBlockPosFilename(pos, "blk").string(), pos.nPos, nSize))
+        return false;
+    req->WriteHeader("Content-Type", "application/octet-stream");
+    req->WriteReply(HTTPStatus::OK);
+    return true;
+}
+
 static bool rest_block(HTTPRequest* req,
                        const std::string& strURIPart,
                        bool showTxDetails)
@@ -230,6 +244,10 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTPStatus::NOT_FOUND, hashStr + " not available (pruned data)");
 
+        // Without the witnesses the block needs to get serialized again
+        if (rf == RF_BINARY && RPCSerializationFlags() == 0 && rest_block_file(req, pblockindex))
+            return true;
+
         if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
             return RESTERR(req, HTTPStatus::NOT_FOUND, hashStr + " not found");
     }
@@ -247,7 +265,7 @@ static bool rest_block(HTTPRequest* req,
     case RF_HEX: {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
         ssBlock << block;
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        string strHex = HexStr(ssBlock.data(), ssBlock.data() + ssBlock.size()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTPStatus::OK, strHex);
         return true;
@@ -371,8 +389,11 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
 
     CTransaction tx;
     uint256 hashBlock = uint256();
-    if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true))
+    if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true)) {
+        if (IsTransactionPruned(hash))
+            return RESTERR(req, HTTPStatus::NOT_FOUND, hashStr + " not available (pruned data)");
         return RESTERR(req, HTTPStatus::NOT_FOUND, hashStr + " not found");
+    }
 
     switch (rf) {
     case RF_BINARY: {
@@ -387,7 +408,7 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     case RF_HEX: {
         CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
         ssTx << tx;
-        string strHex = HexStr(ssTx.begin(), ssTx.end()) + "\n";
+        string strHex = HexStr(ssTx.data(), ssTx.data() + ssTx.size()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTPStatus::OK, strHex);
         return true;
@@ -4,17 +4,22 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "amount.h"
+#include "blockfilter.h"
+#include "blockjournal.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "coins.h"
 #include "consensus/validation.h"
+#include "indexbuilder.h"
 #include "validation.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
+#include "snapshot.h"
 #include "streams.h"
 #include "sync.h"
+#include "taskpool.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
@@ -32,6 +37,9 @@ using namespace std;
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
+/** Transactions one helper of the task pool renders at least when getblock includes their data */
+static const size_t BLOCK_JSON_TXS_PER_HELPER = 8;
+
 double GetDifficulty(const CBlockIndex* blockindex)
 {
     // Floating point number that is a multiple of the minimum difficulty,
@@ -91,9 +99,11 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/** The fields of blockToJSON before and after the transactions, requires cs_main */
+static void blockFieldsToJSON(const CBlock& block, const CBlockIndex* blockindex, UniValue& result, UniValue& tail)
 {
-    UniValue result(UniValue::VOBJ);
+    result = UniValue(UniValue::VOBJ);
+    tail = UniValue(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
@@ -107,31 +117,49 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("version", block.nVersion));
     result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
-    UniValue txs(UniValue::VARR);
-    BOOST_FOREACH(const CTransaction&tx, block.vtx)
-    {
-        if(txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToJSON(tx, uint256(), objTx);
-            txs.push_back(objTx);
-        }
-        else
-            txs.push_back(tx.GetHash().GetHex());
-    }
-    result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    tail.push_back(Pair("time", block.GetBlockTime()));
+    tail.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
+    tail.push_back(Pair("nonce", (uint64_t)block.nNonce));
+    tail.push_back(Pair("bits", strprintf("%08x", block.nBits)));
+    tail.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    tail.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
 
     if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+        tail.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
     CBlockIndex *pnext = chainActive.Next(blockindex);
     if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+        tail.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+}
+
+/**
+ * The transactions of block, their data rendered on the task pool into a
+ * slot each and appended in order. Only looks at the block, no lock needed.
+ */
+static UniValue blockTxsToJSON(const CBlock& block, bool txDetails)
+{
+    UniValue txs(UniValue::VARR);
+    txs.reserve(block.vtx.size());
+    if (!txDetails) {
+        for (const CTransactionRef& tx : block.vtx)
+            txs.push_back(tx->GetHash().GetHex());
+        return txs;
+    }
+
+    std::vector<UniValue> vTxs(block.vtx.size(), UniValue(UniValue::VOBJ));
+    taskPool.ForEach(CTaskPool::PRIORITY_HIGH, block.vtx.size(), BLOCK_JSON_TXS_PER_HELPER, [&block, &vTxs](size_t i) {
+        TxToJSON(*block.vtx[i], uint256(), vTxs[i]);
+    });
+    for (UniValue& objTx : vTxs)
+        txs.push_back(std::move(objTx));
+    return txs;
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    UniValue result, tail;
+    blockFieldsToJSON(block, blockindex, result, tail);
+    result.pushKV("tx", blockTxsToJSON(block, txDetails));
+    result.pushKVs(tail);
     return result;
 }
 
@@ -400,7 +428,7 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << pblockindex->GetBlockHeader();
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        std::string strHex = HexStr(ssBlock.data(), ssBlock.data() + ssBlock.size());
         return strHex;
     }
 
@@ -478,7 +506,7 @@ UniValue getblockheaders(const UniValue& params, bool fHelp)
         {
             CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
             ssBlock << pblockindex->GetBlockHeader();
-            std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+            std::string strHex = HexStr(ssBlock.data(), ssBlock.data() + ssBlock.size());
             arrHeaders.push_back(strHex);
             if (--nCount <= 0)
                 break;
@@ -496,17 +524,71 @@ UniValue getblockheaders(const UniValue& params, bool fHelp)
     return arrHeaders;
 }
 
+UniValue getblockfilter(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block.\n"
+            "The node has to run with -blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=\"basic\") The type name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",  (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hash\"  (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 hash(ParseHashV(params[0], "blockhash"));
+
+    BlockFilterType filterType = BLOCK_FILTER_BASIC;
+    if (params.size() > 1 && !BlockFilterTypeByName(params[1].get_str(), filterType))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+
+    if (!fBlockFilterIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + BlockFilterTypeName(filterType));
+
+    if (!indexBuilder.IsReady(INDEX_BUILD_BLOCKFILTER))
+        throw JSONRPCError(RPC_MISC_ERROR, indexBuilder.GetStatus());
+
+    {
+        LOCK(cs_main);
+        BlockMap::iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        if (!it->second->IsValid(BLOCK_VALID_SCRIPTS))
+            throw JSONRPCError(RPC_MISC_ERROR, "Block was never connected, it has no filter");
+    }
+
+    CBlockFilter filter;
+    uint256 header;
+    if (!GetBlockFilter(hash, filter) || !GetBlockFilterHeader(hash, header))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Filter not found");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", header.GetHex()));
+    return ret;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
         throw runtime_error(
-            "getblock \"hash\" ( verbose )\n"
-            "\nIf verbose is false, returns a string that is serialized, hex-encoded data for block 'hash'.\n"
-            "If verbose is true, returns an Object with information about block <hash>.\n"
+            "getblock \"hash\" ( verbosity )\n"
+            "\nIf verbosity is 0, returns a string that is serialized, hex-encoded data for block 'hash'.\n"
+            "If verbosity is 1, returns an Object with information about block <hash>.\n"
+            "If verbosity is 2, returns an Object with information about block <hash> and information about each transaction.\n"
             "\nArguments:\n"
             "1. \"hash\"          (string, required) The block hash\n"
-            "2. verbose           (boolean, optional, default=true) true for a json object, false for the hex encoded data\n"
-            "\nResult (for verbose = true):\n"
+            "2. verbosity         (numeric, optional, default=1) 0 for hex encoded data, 1 for a json object, and 2 for json object with transaction data\n"
+            "                     true and false are taken as 1 and 0\n"
+            "\nResult (for verbosity = 1):\n"
             "{\n"
             "  \"hash\" : \"hash\",     (string) the block hash (same as provided)\n"
             "  \"confirmations\" : n,   (numeric) The number of confirmations, or -1 if the block is not on the main chain\n"
@@ -530,43 +612,63 @@ UniValue getblock(const UniValue& params, bool fHelp)
             "  \"previousblockhash\" : \"hash\",  (string) The hash of the previous block\n"
             "  \"nextblockhash\" : \"hash\"       (string) The hash of the next block\n"
             "}\n"
-            "\nResult (for verbose=false):\n"
+            "\nResult (for verbosity = 2):\n"
+            "{\n"
+            "  ...,                     Same output as verbosity = 1.\n"
+            "  \"tx\" : [               (array of Objects) The transactions in the format of the getrawtransaction RPC. Different from verbosity = 1 \"tx\" result.\n"
+            "         ,...\n"
+            "  ],\n"
+            "  ,...                     Same output as verbosity = 1.\n"
+            "}\n"
+            "\nResult (for verbosity = 0):\n"
             "\"data\"             (string) A string that is serialized, hex-encoded data for block 'hash'.\n"
             "\nExamples:\n"
             + HelpExampleCli("getblock", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
             + HelpExampleRpc("getblock", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     uint256 hash(uint256S(strHash));
 
-    bool fVerbose = true;
-    if (params.size() > 1)
-        fVerbose = params[1].get_bool();
-
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    int nVerbosity = 1;
+    if (params.size() > 1) {
+        if (params[1].isNum())
+            nVerbosity = params[1].get_int();
+        else
+            nVerbosity = params[1].get_bool() ? 1 : 0;
+    }
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    UniValue result, tail;
+    {
+        LOCK(cs_main);
+
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+        CBlockIndex* pblockindex = mapBlockIndex[hash];
 
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if (!fVerbose)
-    {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+        if (nVerbosity <= 0)
+        {
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssBlock << block;
+            std::string strHex = HexStr(ssBlock.data(), ssBlock.data() + ssBlock.size());
+            return strHex;
+        }
+
+        blockFieldsToJSON(block, pblockindex, result, tail);
     }
 
-    return blockToJSON(block, pblockindex);
+    // The transactions only need the block read above, rendered without cs_main
+    result.pushKV("tx", blockTxsToJSON(block, nVerbosity >= 2));
+    result.pushKVs(tail);
+    return result;
 }
 
 struct CCoinsStats
@@ -674,6 +776,111 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+static UniValue SnapshotToJSON(const boost::filesystem::path& path, const CSnapshotInfo& info)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("base_hash", info.header.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", info.header.nHeight));
+    ret.push_back(Pair("total_amount", ValueFromAmount(info.nTotalAmount)));
+
+    UniValue sections(UniValue::VARR);
+    for (const CSnapshotSectionInfo& section : info.vSections) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("name", section.GetName()));
+        obj.push_back(Pair("height", section.nHeight));
+        obj.push_back(Pair("entries", (uint64_t)section.nEntries));
+        obj.push_back(Pair("chunks", (uint64_t)section.nChunks));
+        obj.push_back(Pair("hash", section.hash.GetHex()));
+        sections.push_back(obj);
+    }
+    ret.push_back(Pair("sections", sections));
+    ret.push_back(Pair("hash", info.hash.GetHex()));
+    return ret;
+}
+
+static const std::string strSnapshotResultHelp =
+    "{\n"
+    "  \"path\": \"path\",          (string) the snapshot file\n"
+    "  \"base_hash\": \"hash\",     (string) the block the coins are at\n"
+    "  \"base_height\": n,        (numeric) its height\n"
+    "  \"total_amount\": x.xxx,   (numeric) the sum of the coins\n"
+    "  \"sections\": [            (array) coins, rewards and votekeys as included\n"
+    "    {\n"
+    "      \"name\": \"name\",      (string) section name\n"
+    "      \"height\": n,         (numeric) height its database was at\n"
+    "      \"entries\": n,        (numeric) number of entries\n"
+    "      \"chunks\": n,         (numeric) number of hashed chunks\n"
+    "      \"hash\": \"hash\"       (string) hash of the chunk hashes\n"
+    "    }, ...\n"
+    "  ],\n"
+    "  \"hash\": \"hash\"           (string) hash identifying the snapshot\n"
+    "}\n";
+
+static boost::filesystem::path GetSnapshotPath(const UniValue& param)
+{
+    boost::filesystem::path path(param.get_str());
+    if (!path.is_complete())
+        path = GetDataDir() / path;
+    return path;
+}
+
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "dumptxoutset \"path\" ( rewards votekeys )\n"
+            "\nWrite the unspent transaction output set at the current tip to a snapshot file.\n"
+            "The entries are written in hashed chunks, verifytxoutset checks a snapshot.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"      (string, required) the file to write, relative to the data directory if not absolute\n"
+            "2. rewards     (boolean, optional, default=false) include the SmartRewards database\n"
+            "3. votekeys    (boolean, optional, default=false) include the vote key index\n"
+            "\nResult:\n"
+            + strSnapshotResultHelp +
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\" true true")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\", true, true")
+        );
+
+    boost::filesystem::path path = GetSnapshotPath(params[0]);
+    bool fRewards = params.size() > 1 && params[1].get_bool();
+    bool fVoteKeys = params.size() > 2 && params[2].get_bool();
+
+    CSnapshotInfo info;
+    std::string strError;
+    if (!DumpSnapshot(path, fRewards, fVoteKeys, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    return SnapshotToJSON(path, info);
+}
+
+UniValue verifytxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "verifytxoutset \"path\"\n"
+            "\nCheck the hashes of all chunks and sections of a snapshot written by dumptxoutset.\n"
+            "\nArguments:\n"
+            "1. \"path\"      (string, required) the snapshot file, relative to the data directory if not absolute\n"
+            "\nResult:\n"
+            + strSnapshotResultHelp +
+            "\nExamples:\n"
+            + HelpExampleCli("verifytxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("verifytxoutset", "\"utxo.dat\"")
+        );
+
+    boost::filesystem::path path = GetSnapshotPath(params[0]);
+
+    CSnapshotInfo info;
+    std::string strError;
+    if (!VerifySnapshot(path, info, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+
+    return SnapshotToJSON(path, info);
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -1225,3 +1432,86 @@ UniValue getchaintxstats(const UniValue& params, bool fHelp)
 
     return ret;
 }
+
+static double HitRate(uint64_t nHits, uint64_t nMisses)
+{
+    return nHits + nMisses ? (double)nHits / (nHits + nMisses) : 0.0;
+}
+
+UniValue getblockjournal(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw std::runtime_error(
+            "getblockjournal ( count )\n"
+            "\nReturns the journal records of the most recently connected blocks, the newest first.\n"
+            "The times are in microseconds, with -blockjournal the records also get written to blockjournal.csv.\n"
+            "\nArguments:\n"
+            "1. count            (numeric, optional, default=10) Number of records, at most " + std::to_string(BLOCK_JOURNAL_RECORDS) + " are kept\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"height\": n,              (numeric) The height of the block\n"
+            "    \"hash\": \"hash\",           (string) The block hash\n"
+            "    \"time\": n,                (numeric) When the block got connected (seconds since epoch)\n"
+            "    \"size\": n,                (numeric) The block size in bytes\n"
+            "    \"tx\": n,                  (numeric) The number of transactions\n"
+            "    \"inputs\": n,              (numeric) The number of transaction inputs without the one of the coinbase\n"
+            "    \"read_us\": n,             (numeric) Reading the block and prefetching its inputs\n"
+            "    \"check_us\": n,            (numeric) The sanity checks\n"
+            "    \"forks_us\": n,            (numeric) The fork checks\n"
+            "    \"inputs_us\": n,           (numeric) Connecting the transactions\n"
+            "    \"verify_us\": n,           (numeric) Until the scripts were verified, includes inputs_us and payments_us\n"
+            "    \"payments_us\": n,         (numeric) The validation of the coinbase payments\n"
+            "    \"rewards_us\": n,          (numeric) The SmartRewards processing\n"
+            "    \"index_us\": n,            (numeric) Writing the undo data and the indexes\n"
+            "    \"flush_us\": n,            (numeric) Flushing the block into the coins cache\n"
+            "    \"chainstate_us\": n,       (numeric) Writing the chain state\n"
+            "    \"total_us\": n,            (numeric) Connecting the block altogether\n"
+            "    \"coins_hits\": n,          (numeric) Coins cache lookups which found the coin\n"
+            "    \"coins_misses\": n,        (numeric) Coins cache lookups which went to the database\n"
+            "    \"coins_hitrate\": x.xxx,   (numeric) The share of the coins cache hits\n"
+            "    \"sigcache_hits\": n,       (numeric) Signature cache lookups which found the signature\n"
+            "    \"sigcache_misses\": n,     (numeric) Signatures which had to be verified\n"
+            "    \"sigcache_hitrate\": x.xxx (numeric) The share of the signature cache hits\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockjournal", "")
+            + HelpExampleRpc("getblockjournal", "100")
+        );
+
+    int nCount = params.size() > 0 ? params[0].get_int() : 10;
+    if (nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+
+    UniValue ret(UniValue::VARR);
+    for (const CBlockJournalRecord& record : blockJournal.GetRecent(nCount)) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("height", record.nHeight);
+        obj.pushKV("hash", record.hash.GetHex());
+        obj.pushKV("time", record.nTime);
+        obj.pushKV("size", (int64_t)record.nSize);
+        obj.pushKV("tx", (int64_t)record.nTx);
+        obj.pushKV("inputs", (int64_t)record.nInputs);
+        obj.pushKV("read_us", record.nTimeRead);
+        obj.pushKV("check_us", record.nTimeCheck);
+        obj.pushKV("forks_us", record.nTimeForks);
+        obj.pushKV("inputs_us", record.nTimeInputs);
+        obj.pushKV("verify_us", record.nTimeVerify);
+        obj.pushKV("payments_us", record.nTimePayments);
+        obj.pushKV("rewards_us", record.nTimeRewards);
+        obj.pushKV("index_us", record.nTimeIndex);
+        obj.pushKV("flush_us", record.nTimeFlush);
+        obj.pushKV("chainstate_us", record.nTimeChainState);
+        obj.pushKV("total_us", record.nTimeTotal);
+        obj.pushKV("coins_hits", (int64_t)record.nCoinsHits);
+        obj.pushKV("coins_misses", (int64_t)record.nCoinsMisses);
+        obj.pushKV("coins_hitrate", HitRate(record.nCoinsHits, record.nCoinsMisses));
+        obj.pushKV("sigcache_hits", (int64_t)record.nSigCacheHits);
+        obj.pushKV("sigcache_misses", (int64_t)record.nSigCacheMisses);
+        obj.pushKV("sigcache_hitrate", HitRate(record.nSigCacheHits, record.nSigCacheMisses));
+        ret.push_back(obj);
+    }
+
+    return ret;
+}
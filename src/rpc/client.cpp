@@ -33,6 +33,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "generate", 1},
     { "generatetoaddress", 1},
     { "generatetoaddress", 2},
+    { "getblocktemplate", 1 },
+    { "getlockstats", 0 },
     { "getnetworkhashps", 0 },
     { "getnetworkhashps", 1 },
     { "sendtoaddress", 1 },
@@ -96,6 +98,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblockheaders", 1 },
     { "getblockheaders", 2 },
     { "getchaintxstats", 0 },
+    { "getblockjournal", 0 },
+    { "dumptxoutset", 1 },
+    { "dumptxoutset", 2 },
     { "gettransaction", 1 },
     { "getrawtransaction", 1 },
     { "createrawtransaction", 0 },
@@ -118,6 +123,10 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "importelectrumwallet", 1 },
     { "importaddress", 2 },
     { "importaddress", 3 },
+    { "importwatchaddresses", 0 },
+    { "removewatchaddresses", 0 },
+    { "listwatchdeltas", 0 },
+    { "listwatchdeltas", 1 },
     { "importpubkey", 2 },
     { "verifychain", 0 },
     { "verifychain", 1 },
@@ -140,6 +149,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getspentinfo", 0},
     { "getaddresstxids", 0},
     { "getaddressbalance", 0},
+    { "getaddresspayouts", 0},
     { "getaddressdeltas", 0},
     { "getaddressutxos", 0},
     { "getaddressmempool", 0},
@@ -150,7 +160,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "dumpprivkey", 1},
     { "dumpwallet", 1},
     { "smartmining", 1},
-    { "smartmining", 2}
+    { "smartmining", 2},
+    { "getrewardsstats", 0},
+    { "getinstantpaystats", 0}
 };
 
 class CRPCConvertTable
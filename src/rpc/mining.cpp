@@ -22,6 +22,7 @@
 #include "util.h"
 #ifdef ENABLE_WALLET
 #endif
+#include "utilmoneystr.h"
 #include "utilstrencodings.h"
 #include "validationinterface.h"
 #include "warnings.h"
@@ -128,14 +129,22 @@ UniValue generateBlocks(boost::shared_ptr<CReserveScript> coinbaseScript, int nG
             LOCK(cs_main);
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
-        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(nHeight, pblock->GetHash(), pblock->nBits, Params().GetConsensus())) {
-            ++pblock->nNonce;
-            --nMaxTries;
+        // Before the height the hash gets checked at any nonce goes, after it
+        // the nonces get hashed in batches for one below the target
+        bool fFound = CheckProofOfWork(nHeight, pblock->GetHash(), pblock->nBits, Params().GetConsensus());
+        arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
+        while (!fFound && nMaxTries > 0 && pblock->nNonce < nInnerLoopCount) {
+            uint64_t nHashesDone = 0;
+            uint32_t nNonceEnd = std::min<uint64_t>(nInnerLoopCount, pblock->nNonce + nMaxTries);
+            if (ScanHash(*pblock, nNonceEnd, hashTarget, nHashesDone))
+                fFound = CheckProofOfWork(nHeight, pblock->GetHash(), pblock->nBits, Params().GetConsensus());
+            nMaxTries -= std::min(nMaxTries, nHashesDone);
+            if (!fFound && pblock->nNonce < nNonceEnd)
+                ++pblock->nNonce;
         }
-        if (nMaxTries == 0) {
-            break;
-        }
-        if (pblock->nNonce == nInnerLoopCount) {
+        if (!fFound) {
+            if (nMaxTries == 0)
+                break;
             continue;
         }
         CValidationState state;
@@ -404,14 +413,26 @@ std::string gbt_vb_name(const Consensus::DeploymentPos pos) {
     return s;
 }
 
+/** How much more fees a template has to pay before a long poll returns it */
+static const CAmount DEFAULT_LONGPOLL_FEE_DELTA = COIN / 100;
+
 UniValue getblocktemplate(const UniValue& params, bool fHelp)
 {
 
-    if (fHelp || params.size() > 1)
+    if (fHelp || params.size() > 2)
         throw std::runtime_error(
-            "getblocktemplate ( SigningAddress )\n"
+            "getblocktemplate ( SigningAddress TemplateRequest )\n"
             "\nReturns a block template miners must comply with to create blocks that will become accepted by"
             " the SmartCash network.\n"
+            "\nArguments:\n"
+            "1. SigningAddress     (string, optional) The address to sign the block with, can be \"\"\n"
+            "2. TemplateRequest    (json object, optional) A json object in the following spec\n"
+            "     {\n"
+            "       \"longpollid\":\"id\",   (string, optional) The longpollid of the template the miner works on. The call waits\n"
+            "                                  until the tip changes or the fees of the template improve by feedelta\n"
+            "       \"feedelta\":n,         (numeric, optional, default=" + FormatMoney(DEFAULT_LONGPOLL_FEE_DELTA) + ") The improvement\n"
+            "                                  of the fees in " + CURRENCY_UNIT + " a long poll waits for\n"
+            "     }\n"
             "\nResult:\n"
             "{\n"
             "  \"version\" : n,                     (numeric) The preferred block version\n"
@@ -478,6 +499,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getblocktemplate", "\"signingaddress\"")
+            + HelpExampleCli("getblocktemplate", "\"signingaddress\" '{\"longpollid\":\"id\"}'")
             + HelpExampleRpc("getblocktemplate", "\"signingaddress\"")
          );
 
@@ -497,7 +519,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
 
     CSmartAddress signingAddress;
 
-    if (params.size() == 1) {
+    if (params.size() > 0 && !params[0].get_str().empty()) {
         signingAddress = CSmartAddress(params[0].get_str());
     }
 
@@ -507,9 +529,9 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static CBlockTemplate* pblocktemplate;
-    if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
-    {
+    // The live template follows the mempool, a long poll keeps it up to date
+    // while it waits
+    auto UpdateTemplate = [&signingAddress]() {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = NULL;
 
@@ -530,7 +552,67 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
 
         // Need to update only after we know CreateNewBlock succeeded
         pindexPrev = pindexPrevNew;
+    };
 
+    if (params.size() > 1) {
+        const UniValue& request = params[1].get_obj();
+        const UniValue& lpval = find_value(request, "longpollid");
+        if (!lpval.isNull()) {
+            // Wait to respond until either the best block changes, OR the
+            // fees of the template improve by at least feedelta
+            if (!lpval.isStr())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid longpollid");
+            std::string lpstr = lpval.get_str();
+            if (lpstr.size() < 64)
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid longpollid");
+            uint256 hashWatchedChain = uint256S(lpstr.substr(0, 64));
+            unsigned int nTransactionsUpdatedLastLP = atoi64(lpstr.substr(64));
+
+            CAmount nFeeDelta = DEFAULT_LONGPOLL_FEE_DELTA;
+            const UniValue& feeval = find_value(request, "feedelta");
+            if (!feeval.isNull())
+                nFeeDelta = AmountFromValue(feeval);
+
+            // A longpollid of an older template than the live one gets the
+            // live template right away
+            if (pblocktemplate && pindexPrev && pindexPrev == chainActive.Tip() &&
+                hashWatchedChain == pindexPrev->GetBlockHash() && nTransactionsUpdatedLastLP == nTransactionsUpdatedLast)
+            {
+                CAmount nFeesWatched = -pblocktemplate->vTxFees[0];
+                unsigned int nTransactionsChecked = nTransactionsUpdatedLast;
+                while (true) {
+                    LEAVE_CRITICAL_SECTION(cs_main);
+                    {
+                        WaitableLock lock(csBestBlock);
+                        while (chainActive.Tip()->GetBlockHash() == hashWatchedChain && IsRPCRunning()) {
+                            boost::system_time checktxtime = boost::get_system_time() + boost::posix_time::seconds(1);
+                            if (!cvBlockChange.timed_wait(lock, checktxtime) &&
+                                mempool.GetTransactionsUpdated() != nTransactionsChecked)
+                                break;
+                        }
+                    }
+                    ENTER_CRITICAL_SECTION(cs_main);
+
+                    if (!IsRPCRunning())
+                        throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+                    if (chainActive.Tip()->GetBlockHash() != hashWatchedChain)
+                        break;
+
+                    // The mempool changed, the live template gets rebuilt
+                    // and is handed out once it pays enough more
+                    nTransactionsChecked = mempool.GetTransactionsUpdated();
+                    UpdateTemplate();
+                    if (-pblocktemplate->vTxFees[0] >= nFeesWatched + nFeeDelta)
+                        break;
+                }
+            }
+        }
+    }
+
+    if (pindexPrev != chainActive.Tip() ||
+        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
+    {
+        UpdateTemplate();
     }
 
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
@@ -547,7 +629,8 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     UniValue transactions(UniValue::VARR);
     map<uint256, int64_t> setTxIndex;
     int i = 0;
-    BOOST_FOREACH (CTransaction& tx, pblock->vtx) {
+    for (const CTransactionRef& ptx : pblock->vtx) {
+        const CTransaction& tx = *ptx;
         uint256 txHash = tx.GetHash();
         setTxIndex[txHash] = i++;
 
@@ -582,7 +665,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     }
 
     UniValue coinbase(UniValue::VOBJ);
-    coinbase.pushKV("mining", (int64_t)pblock->vtx[0].vout[0].nValue);
+    coinbase.pushKV("mining", (int64_t)pblock->vtx[0]->vout[0].nValue);
 
     std::string signature = "";
 
@@ -5,11 +5,14 @@
 
 #include "base58.h"
 #include "clientversion.h"
+#include "indexbuilder.h"
 #include "init.h"
+#include "maintenance.h"
 #include "validation.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpc/server.h"
+#include "smartmining/miningpayments.h"
 #include "timedata.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -24,6 +27,7 @@
 #include "smartnode/spork.h"
 #include "smarthive/hive.h"
 
+#include <limits>
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
@@ -368,18 +372,160 @@ UniValue debug(const UniValue& params, bool fHelp)
     return "Debug mode: " + (fDebug ? strMode : "off");
 }
 
+UniValue getlockstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getlockstats ( reset )\n"
+            "Returns the contention statistics of the locks registered with -lockstats.\n"
+            "Only the outermost acquisition of a recursive lock counts, all times are in microseconds.\n"
+            "\nArguments:\n"
+            "1. reset       (boolean, optional, default=false) Reset the counters after reading them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {               (object) The lock\n"
+            "    \"acquisitions\": n,    (numeric) Number of times the lock was taken\n"
+            "    \"contended\": n,       (numeric) Number of times a thread had to wait for it\n"
+            "    \"wait_us\": n,         (numeric) Total time threads waited for it\n"
+            "    \"maxwait_us\": n,      (numeric) Longest wait\n"
+            "    \"hold_us\": n,         (numeric) Total time it was held\n"
+            "    \"maxhold_us\": n       (numeric) Longest hold\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleCli("getlockstats", "true")
+            + HelpExampleRpc("getlockstats", "")
+        );
+
+    bool fReset = params.size() > 0 && params[0].get_bool();
+
+    UniValue result(UniValue::VOBJ);
+    for (CLockStats* pstats : GetLockStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("acquisitions", pstats->nAcquisitions.load()));
+        obj.push_back(Pair("contended", pstats->nContended.load()));
+        obj.push_back(Pair("wait_us", pstats->nWaitTime.load()));
+        obj.push_back(Pair("maxwait_us", pstats->nMaxWaitTime.load()));
+        obj.push_back(Pair("hold_us", pstats->nHoldTime.load()));
+        obj.push_back(Pair("maxhold_us", pstats->nMaxHoldTime.load()));
+        result.push_back(Pair(pstats->pszName, obj));
+        if (fReset)
+            pstats->Reset();
+    }
+
+    return result;
+}
+
+UniValue getmemoryinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmemoryinfo\n"
+            "Returns the heap memory used by the smartnode, instantsend, voting, rewards and SAPI subsystems.\n"
+            "The sizes are estimates of the allocations of their containers in bytes, -memoryloginterval\n"
+            "writes the same to the log.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"subsystem\": {          (object) smartnodes, payments, instantsend, voting, fulfilled, rewards or sapi\n"
+            "    \"total\": n,           (numeric) Bytes used by the subsystem\n"
+            "    \"part\": n, ...        (numeric) Bytes used by each of its parts\n"
+            "  }, ...\n"
+            "  \"total\": n             (numeric) Bytes used by all of the subsystems\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmemoryinfo", "")
+            + HelpExampleRpc("getmemoryinfo", "")
+        );
+
+    std::vector<std::pair<std::string, memusage::ComponentUsage> > vecUsage;
+    GetSubsystemMemoryUsage(vecUsage);
+
+    UniValue result(UniValue::VOBJ);
+    uint64_t nTotal = 0;
+    for (const auto& subsystem : vecUsage) {
+        UniValue obj(UniValue::VOBJ);
+        uint64_t nSubsystem = 0;
+        for (const auto& part : subsystem.second) {
+            nSubsystem += part.second;
+        }
+        obj.push_back(Pair("total", nSubsystem));
+        for (const auto& part : subsystem.second) {
+            obj.push_back(Pair(part.first, (uint64_t)part.second));
+        }
+        result.push_back(Pair(subsystem.first, obj));
+        nTotal += nSubsystem;
+    }
+    result.push_back(Pair("total", nTotal));
+
+    return result;
+}
+
+UniValue getmaintenanceinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmaintenanceinfo\n"
+            "Returns the statistics of the periodic maintenance tasks of the smartnode layer, the caches and SAPI.\n"
+            "All durations are in microseconds.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {              (object) The task\n"
+            "    \"period_ms\": n,       (numeric) Milliseconds between the runs, without the jitter\n"
+            "    \"runs\": n,            (numeric) Number of runs since the start\n"
+            "    \"lastrun\": n,         (numeric) Time the last run started, 0 before the first one\n"
+            "    \"last_us\": n,         (numeric) Duration of the last run\n"
+            "    \"max_us\": n,          (numeric) Longest run\n"
+            "    \"overruns\": n,        (numeric) Runs which took longer than the period\n"
+            "    \"backoffs\": n         (numeric) Runs put off because the lock they need was busy\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmaintenanceinfo", "")
+            + HelpExampleRpc("getmaintenanceinfo", "")
+        );
+
+    UniValue result(UniValue::VOBJ);
+    for (const CMaintenanceTasks::Stats& stats : maintenanceTasks.GetStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("period_ms", stats.nPeriod));
+        obj.push_back(Pair("runs", stats.nRuns));
+        obj.push_back(Pair("lastrun", stats.nLastRun));
+        obj.push_back(Pair("last_us", stats.nLastDuration));
+        obj.push_back(Pair("max_us", stats.nMaxDuration));
+        obj.push_back(Pair("overruns", stats.nOverruns));
+        obj.push_back(Pair("backoffs", stats.nBackoffs));
+        result.push_back(Pair(stats.strName, obj));
+    }
+
+    return result;
+}
+
 UniValue snsync(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 1)
+    if (fHelp || params.size() < 1 || params.size() > 3 || (params.size() > 1 && params[0].get_str() != "waitforchange"))
         throw runtime_error(
-                "snsync [status|next|reset]\n"
+                "snsync [status|next|reset|waitforchange ( version timeout )]\n"
                         "Returns the sync status, updates to the next step or resets it entirely.\n"
+                        "waitforchange waits up to timeout milliseconds (default: 0 = no limit) until the \"Version\"\n"
+                        "of the status is another one than version, then returns the status. The version changes\n"
+                        "with the asset being synced, a reset or a failure.\n"
         );
 
     std::string strMode = params[0].get_str();
 
+    uint64_t nVersion = smartnodeSync.GetStatusFeed().GetVersion();
+    if(strMode == "waitforchange") {
+        uint64_t nKnown;
+        int64_t nTimeout;
+        RPCParseWaitForChange(params, 1, nKnown, nTimeout);
+        nVersion = RPCWaitForChange(smartnodeSync.GetStatusFeed(), nKnown, nTimeout);
+        strMode = "status";
+    }
+
     if(strMode == "status") {
         UniValue objStatus(UniValue::VOBJ);
+        objStatus.push_back(Pair("Version", nVersion));
         objStatus.push_back(Pair("AssetID", smartnodeSync.GetAssetID()));
         objStatus.push_back(Pair("AssetName", smartnodeSync.GetAssetName()));
         objStatus.push_back(Pair("Attempt", smartnodeSync.GetAttempt()));
@@ -390,6 +536,8 @@ UniValue snsync(const UniValue& params, bool fHelp)
 // WIP-VOTING uncomment ->  objStatus.push_back(Pair("IsProposalDataSynced", smartnodeSync.IsProposalDataSynced()));
         objStatus.push_back(Pair("IsSynced", smartnodeSync.IsSynced()));
         objStatus.push_back(Pair("IsFailed", smartnodeSync.IsFailed()));
+        objStatus.push_back(Pair("IsWarmStart", smartnodeSync.IsWarmStart()));
+        objStatus.push_back(Pair("Assets", smartnodeSync.GetAssetStats()));
         return objStatus;
     }
 
@@ -990,6 +1138,100 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
 
 }
 
+UniValue getaddresspayouts(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getaddresspayouts\n"
+            "\nReturns the coinbase payouts to an address in block height order (requires payoutindex to be enabled).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"address\"  (string) The base58check encoded address\n"
+            "  \"start\"    (number, optional) The start block height\n"
+            "  \"end\"      (number, optional) The end block height\n"
+            "  \"category\" (string, optional, default=all) Comma separated list of mining, hive, smartnode and smartrewards\n"
+            "  \"limit\"    (number, optional) Stop after the height this many payouts are reached at\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"payouts\": [\n"
+            "    {\n"
+            "      \"height\"  (number) The block height\n"
+            "      \"index\"  (number) The output of the coinbase\n"
+            "      \"category\"  (string) What the output pays\n"
+            "      \"satoshis\"  (number) The amount in satoshis\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"totals\"  (object) The satoshis of the payouts by category\n"
+            "  \"next\"  (number) The start height of the next page, missing when there are no more\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresspayouts", "'{\"address\": \"SwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\", \"category\": \"smartnode\"}'")
+            + HelpExampleRpc("getaddresspayouts", "{\"address\": \"SwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwg\", \"category\": \"smartnode\"}")
+        );
+
+    const UniValue& request = params[0].get_obj();
+
+    CBitcoinAddress address(find_value(request, "address").isStr() ? find_value(request, "address").get_str() : std::string());
+    uint160 hashBytes;
+    int type = 0;
+    if (!address.GetIndexKey(hashBytes, type)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    UniValue startValue = find_value(request, "start");
+    UniValue endValue = find_value(request, "end");
+    UniValue categoryValue = find_value(request, "category");
+    UniValue limitValue = find_value(request, "limit");
+
+    int start = startValue.isNum() ? startValue.get_int() : 0;
+    int end = endValue.isNum() ? endValue.get_int() : std::numeric_limits<int>::max();
+    int limit = limitValue.isNum() ? limitValue.get_int() : 0;
+    int categories = PAYOUT_ALL;
+
+    if (!categoryValue.isNull() && (!categoryValue.isStr() || !SmartMining::ParsePayoutCategories(categoryValue.get_str(), categories))) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid category, expected mining, hive, smartnode, smartrewards or all");
+    }
+
+    if (!indexBuilder.IsReady(INDEX_BUILD_PAYOUT)) {
+        throw JSONRPCError(RPC_MISC_ERROR, indexBuilder.GetStatus());
+    }
+
+    std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > payoutIndex;
+
+    if (!GetPayoutIndex(hashBytes, type, start, end, categories, limit, payoutIndex)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+
+    UniValue payouts(UniValue::VARR);
+    std::map<int, CAmount> totals;
+
+    for (const auto &payout : payoutIndex) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("height", payout.first.blockHeight));
+        entry.push_back(Pair("index", (int)payout.first.nOut));
+        entry.push_back(Pair("category", SmartMining::PayoutCategoryName(payout.second.category)));
+        entry.push_back(Pair("satoshis", payout.second.satoshis));
+        payouts.push_back(entry);
+
+        totals[payout.second.category] += payout.second.satoshis;
+    }
+
+    UniValue totalsObj(UniValue::VOBJ);
+    for (const auto &total : totals)
+        totalsObj.push_back(Pair(SmartMining::PayoutCategoryName(total.first), total.second));
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("payouts", payouts));
+    result.push_back(Pair("totals", totalsObj));
+
+    if (limit > 0 && payoutIndex.size() >= (size_t)limit && payoutIndex.back().first.blockHeight < end)
+        result.push_back(Pair("next", payoutIndex.back().first.blockHeight + 1));
+
+    return result;
+}
+
 UniValue getspentinfo(const UniValue& params, bool fHelp)
 {
 
@@ -1041,20 +1283,27 @@ UniValue getspentinfo(const UniValue& params, bool fHelp)
 
 UniValue getaddresses(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() > 2)
+    if (fHelp || params.size() > 3)
         throw runtime_error(
-            "getaddresses \"excludeZeroBalances\" \n"
+            "getaddresses \"excludeZeroBalances\" ( blockHeight \"format\" )\n"
             "\nPrint a list of all addresses in the SmartCash blockchain.\n"
             "\nArguments:\n"
             "1. \"excludeZeroBalances\"  (bool, optional, default: true) If true, addresses with zero balance aren't included in the list. If false, they are.\n"
-            "1. \"blockHeight\"          (number, optional, default: current block height) The block height to generate the address list. 0 - blockHeight\n"
+            "2. \"blockHeight\"          (number, optional, default: current block height) The block height to generate the address list. 0 - blockHeight\n"
+            "3. \"format\"               (string, optional, default: json) \"json\" for a list of objects, \"csv\" for one string with a line\n"
+            "                            \"address,received,balance\" per address, which is several times smaller.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresses", "true 100000")
+            + HelpExampleCli("getaddresses", "true -1 csv")
             + HelpExampleRpc("getaddresses", "true")
         );
 
     bool fExcludeZeroBalances = params.size() ? params[0].get_bool() : true;
     int64_t nEndBlockHeight = params.size() > 1 ? params[1].get_int64() : -1;
+    std::string strFormat = params.size() > 2 ? params[2].get_str() : "json";
+    if (strFormat != "json" && strFormat != "csv")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid format, json or csv expected");
+
     std::vector<CAddressListEntry> addressList;
 
     if (!GetAddresses(addressList, nEndBlockHeight, fExcludeZeroBalances)) {
@@ -1067,7 +1316,15 @@ UniValue getaddresses(const UniValue& params, bool fHelp)
         return a.balance > b.balance;
     });
 
-    UniValue result(UniValue::VARR);
+    // Written out while the list is walked, the entries of mainnet don't fit into memory as UniValue
+    CRPCResultStream result;
+
+    if (strFormat == "csv") {
+        result.BeginString();
+        result.Append("address,received,balance\n");
+    } else {
+        result.BeginArray();
+    }
 
     for (std::vector<CAddressListEntry>::const_iterator it=addressList.begin(); it!=addressList.end(); it++) {
 
@@ -1076,16 +1333,21 @@ UniValue getaddresses(const UniValue& params, bool fHelp)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
         }
 
+        if (strFormat == "csv") {
+            result.Append(strprintf("%s,%d,%d\n", address, it->received, it->balance));
+            continue;
+        }
+
         UniValue entry(UniValue::VOBJ);
 
         entry.push_back(Pair("address", address));
         entry.push_back(Pair("received", it->received));
         entry.push_back(Pair("balance", it->balance));
 
-        result.push_back(entry);
+        result.Push(entry);
     }
 
-    return result;
+    return result.Finish();
 }
 
 UniValue getmoneysupply(const UniValue& params, bool fHelp)
@@ -1101,7 +1363,7 @@ UniValue getmoneysupply(const UniValue& params, bool fHelp)
 
     std::vector<CAddressListEntry> addressList;
 
-    if (!GetAddresses(addressList, true)) {
+    if (!GetAddresses(addressList, -1, true)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Failed to load the address list.");
     }
 
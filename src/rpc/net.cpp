@@ -97,10 +97,14 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "    \"banscore\": n,             (numeric) The ban score\n"
             "    \"synced_headers\": n,       (numeric) The last header we have in common with this peer\n"
             "    \"synced_blocks\": n,        (numeric) The last block we have in common with this peer\n"
+            "    \"txreconciliation\": true|false, (boolean) Whether the transaction inventory gets reconciled with the peer\n"
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ]\n"
+            "    \"blockrate\": n,            (numeric) The blocks per second the peer delivered while we were downloading from it\n"
+            "    \"inflightlimit\": n,        (numeric) The number of blocks we keep in flight from this peer at most\n"
+            "    \"redundantrequests\": n,    (numeric) The number of blocks held up at other peers which we requested from this one as well\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,             (numeric) The total bytes sent aggregated by message type\n"
             "       ...\n"
@@ -109,6 +113,15 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
             "       \"addr\": n,             (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
             "    }\n"
+            "    \"processed_per_msg\": {\n"
+            "       \"addr\": {             (object) The processing of the messages received from the peer by type\n"
+            "         \"count\": n,          (numeric) The number of messages\n"
+            "         \"time_us\": n,        (numeric) The total processing time in microseconds\n"
+            "         \"maxtime_us\": n,     (numeric) The longest processing time in microseconds\n"
+            "         \"rejected\": n,       (numeric) The number of messages which failed to process or raised the ban score\n"
+            "         \"banscore\": n        (numeric) The ban score the messages caused\n"
+            "       }, ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -163,8 +176,12 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("blockrate", statestats.dBlockRate));
+            obj.push_back(Pair("inflightlimit", statestats.nBlocksInFlightLimit));
+            obj.push_back(Pair("redundantrequests", statestats.nRedundantRequests));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        obj.push_back(Pair("txreconciliation", stats.fTxReconciliation));
 
         UniValue sendPerMsgCmd(UniValue::VOBJ);
         BOOST_FOREACH(const mapMsgCmdSize::value_type &i, stats.mapSendBytesPerMsgCmd) {
@@ -180,6 +197,18 @@ UniValue getpeerinfo(const UniValue& params, bool fHelp)
         }
         obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
 
+        UniValue processedPerMsgCmd(UniValue::VOBJ);
+        BOOST_FOREACH(const mapMsgCmdStats::value_type &i, stats.mapProcessStatsPerMsgCmd) {
+            UniValue msgStats(UniValue::VOBJ);
+            msgStats.push_back(Pair("count", i.second.nMessages));
+            msgStats.push_back(Pair("time_us", i.second.nTime));
+            msgStats.push_back(Pair("maxtime_us", i.second.nMaxTime));
+            msgStats.push_back(Pair("rejected", i.second.nRejected));
+            msgStats.push_back(Pair("banscore", i.second.nBanScore));
+            processedPerMsgCmd.push_back(Pair(i.first, msgStats));
+        }
+        obj.push_back(Pair("processed_per_msg", processedPerMsgCmd));
+
         ret.push_back(obj);
     }
 
@@ -363,6 +392,86 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getnetmsgstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getnetmsgstats\n"
+            "\nReturns the traffic and processing time of the p2p messages by type, summed up over\n"
+            "all peers since the start including the disconnected ones. The types which took the\n"
+            "most processing time come first.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"type\": {                (object) The message type, *other* for the unknown ones\n"
+            "    \"count\": n,            (numeric) The number of messages processed\n"
+            "    \"bytessent\": n,        (numeric) The bytes sent\n"
+            "    \"bytesrecv\": n,        (numeric) The bytes received\n"
+            "    \"time_us\": n,          (numeric) The total processing time in microseconds\n"
+            "    \"avgtime_us\": n,       (numeric) The average processing time in microseconds\n"
+            "    \"maxtime_us\": n,       (numeric) The longest processing time in microseconds\n"
+            "    \"time_histogram\": {    (object) The number of messages by processing time\n"
+            "      \"<10us\": n,\n"
+            "      ...\n"
+            "      \">=1s\": n\n"
+            "    },\n"
+            "    \"rejected\": n,         (numeric) The number of messages which failed to process or raised the ban score\n"
+            "    \"banscore\": n          (numeric) The ban score the messages caused\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnetmsgstats", "")
+            + HelpExampleRpc("getnetmsgstats", "")
+        );
+
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    mapMsgCmdStats mapStats;
+    mapMsgCmdSize mapSendBytes, mapRecvBytes;
+    GetNetMsgStats(*g_connman, mapStats, mapSendBytes, mapRecvBytes);
+
+    std::vector<std::string> vHistogramLabels;
+    for (int64_t nBound : CNetMsgCmdStats::TIME_BUCKET_BOUNDS) {
+        vHistogramLabels.push_back(nBound < 1000 ? strprintf("<%dus", nBound) : nBound < 1000000 ? strprintf("<%dms", nBound / 1000) : strprintf("<%ds", nBound / 1000000));
+    }
+    vHistogramLabels.push_back(">=" + vHistogramLabels.back().substr(1));
+
+    // The types which were sent only have no processing statistics
+    std::set<std::string> setTypes;
+    BOOST_FOREACH(const mapMsgCmdStats::value_type &i, mapStats)
+        setTypes.insert(i.first);
+    BOOST_FOREACH(const mapMsgCmdSize::value_type &i, mapSendBytes)
+        setTypes.insert(i.first);
+    BOOST_FOREACH(const mapMsgCmdSize::value_type &i, mapRecvBytes)
+        setTypes.insert(i.first);
+
+    std::vector<std::pair<int64_t, std::string> > vTypes;
+    BOOST_FOREACH(const std::string& strType, setTypes)
+        vTypes.push_back(std::make_pair(mapStats[strType].nTime, strType));
+    std::sort(vTypes.rbegin(), vTypes.rend());
+
+    UniValue ret(UniValue::VOBJ);
+    BOOST_FOREACH(const PAIRTYPE(int64_t, std::string)& type, vTypes) {
+        const CNetMsgCmdStats& stats = mapStats[type.second];
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("count", stats.nMessages));
+        obj.push_back(Pair("bytessent", mapSendBytes[type.second]));
+        obj.push_back(Pair("bytesrecv", mapRecvBytes[type.second]));
+        obj.push_back(Pair("time_us", stats.nTime));
+        obj.push_back(Pair("avgtime_us", stats.nMessages ? stats.nTime / (int64_t)stats.nMessages : 0));
+        obj.push_back(Pair("maxtime_us", stats.nMaxTime));
+        UniValue histogram(UniValue::VOBJ);
+        for (int i = 0; i < CNetMsgCmdStats::NUM_TIME_BUCKETS; i++)
+            histogram.push_back(Pair(vHistogramLabels[i], stats.vTimeBuckets[i]));
+        obj.push_back(Pair("time_histogram", histogram));
+        obj.push_back(Pair("rejected", stats.nRejected));
+        obj.push_back(Pair("banscore", stats.nBanScore));
+        ret.push_back(Pair(type.second, obj));
+    }
+
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -19,6 +19,7 @@ namespace HTTPStatus{
     enum Codes
     {
         OK                    = 200,
+        NOT_MODIFIED          = 304,
         BAD_REQUEST           = 400,
         UNAUTHORIZED          = 401,
         FORBIDDEN             = 403,
@@ -28,7 +28,9 @@
 #include "wallet/wallet.h"
 #endif
 
+#include <atomic>
 #include <stdint.h>
+#include <thread>
 
 #include <boost/assign/list_of.hpp>
 
@@ -68,7 +70,20 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
     entry.push_back(Pair("version", tx.nVersion));
     entry.push_back(Pair("locktime", (int64_t)tx.nLockTime));
     entry.push_back(Pair("activation", tx.IsActivationTx()));
+
+    // Spent info of the inputs and outputs if spentindex enabled, looked up at once
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vecSpentInfo;
+    if (!tx.IsCoinBase()) {
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            vecSpentInfo.push_back(std::make_pair(CSpentIndexKey(txin.prevout.hash, txin.prevout.n), CSpentIndexValue()));
+    }
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+        vecSpentInfo.push_back(std::make_pair(CSpentIndexKey(txid, i), CSpentIndexValue()));
+    bool fSpentInfo = GetSpentIndex(vecSpentInfo);
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator itSpentInfo = vecSpentInfo.begin();
+
     UniValue vin(UniValue::VARR);
+    vin.reserve(tx.vin.size());
     BOOST_FOREACH(const CTxIn& txin, tx.vin) {
         UniValue in(UniValue::VOBJ);
         if (tx.IsCoinBase())
@@ -79,12 +94,11 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
             UniValue o(UniValue::VOBJ);
             o.push_back(Pair("asm", ScriptToAsmStr(txin.scriptSig, true)));
             o.push_back(Pair("hex", HexStr(txin.scriptSig.begin(), txin.scriptSig.end())));
-            in.push_back(Pair("scriptSig", o));
+            in.pushKV("scriptSig", std::move(o));
 
             // Add address and value info if spentindex enabled
-            CSpentIndexValue spentInfo;
-            CSpentIndexKey spentKey(txin.prevout.hash, txin.prevout.n);
-            if (GetSpentIndex(spentKey, spentInfo)) {
+            const CSpentIndexValue &spentInfo = (itSpentInfo++)->second;
+            if (fSpentInfo && !spentInfo.IsNull()) {
                 in.push_back(Pair("value", ValueFromAmount(spentInfo.satoshis)));
                 in.push_back(Pair("valueSat", spentInfo.satoshis));
                 if (spentInfo.addressType == 1) {
@@ -96,10 +110,11 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
 
         }
         in.push_back(Pair("sequence", (int64_t)txin.nSequence));
-        vin.push_back(in);
+        vin.push_back(std::move(in));
     }
-    entry.push_back(Pair("vin", vin));
+    entry.pushKV("vin", std::move(vin));
     UniValue vout(UniValue::VARR);
+    vout.reserve(tx.vout.size());
     for (unsigned int i = 0; i < tx.vout.size(); i++) {
         const CTxOut& txout = tx.vout[i];
         UniValue out(UniValue::VOBJ);
@@ -108,20 +123,19 @@ void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry)
         out.push_back(Pair("n", (int64_t)i));
         UniValue o(UniValue::VOBJ);
         ScriptPubKeyToJSON(txout.scriptPubKey, o, true);
-        out.push_back(Pair("scriptPubKey", o));
+        out.pushKV("scriptPubKey", std::move(o));
 
         // Add spent information if spentindex is enabled
-        CSpentIndexValue spentInfo;
-        CSpentIndexKey spentKey(txid, i);
-        if (GetSpentIndex(spentKey, spentInfo)) {
+        const CSpentIndexValue &spentInfo = (itSpentInfo++)->second;
+        if (fSpentInfo && !spentInfo.IsNull()) {
             out.push_back(Pair("spentTxId", spentInfo.txid.GetHex()));
             out.push_back(Pair("spentIndex", (int)spentInfo.inputIndex));
             out.push_back(Pair("spentHeight", spentInfo.blockHeight));
         }
 
-        vout.push_back(out);
+        vout.push_back(std::move(out));
     }
-    entry.push_back(Pair("vout", vout));
+    entry.pushKV("vout", std::move(vout));
 
     if (!hashBlock.IsNull()) {
         entry.push_back(Pair("blockhash", hashBlock.GetHex()));
@@ -149,6 +163,7 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
             "\nNOTE: By default this function only works sometimes. This is when the tx is in the mempool\n"
             "or there is an unspent output in the utxo for this transaction. To make it always work,\n"
             "you need to maintain a transaction index, using the -txindex command line option.\n"
+            "In prune mode the transactions of pruned blocks are not available.\n"
             "\nReturn the raw transaction data.\n"
             "\nIf verbose=0, returns a string that is serialized, hex-encoded data for 'txid'.\n"
             "If verbose is non-zero, returns an Object with information about 'txid'.\n"
@@ -222,8 +237,11 @@ UniValue getrawtransaction(const UniValue& params, bool fHelp)
 
     CTransaction tx;
     uint256 hashBlock;
-    if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true))
+    if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true)) {
+        if (IsTransactionPruned(hash))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Transaction not available (pruned data)");
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available about transaction");
+    }
 
     string strHex = EncodeHexTx(tx, RPCSerializationFlags());
 
@@ -305,8 +323,8 @@ UniValue gettxoutproof(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     unsigned int ntxFound = 0;
-    BOOST_FOREACH(const CTransaction&tx, block.vtx)
-        if (setTxids.count(tx.GetHash()))
+    for (const CTransactionRef& tx : block.vtx)
+        if (setTxids.count(tx->GetHash()))
             ntxFound++;
     if (ntxFound != setTxids.size())
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "(Not all) transactions not found in specified block");
@@ -314,7 +332,7 @@ UniValue gettxoutproof(const UniValue& params, bool fHelp)
     CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION);
     CMerkleBlock mb(block, setTxids);
     ssMB << mb;
-    std::string strHex = HexStr(ssMB.begin(), ssMB.end());
+    std::string strHex = HexStr(ssMB.data(), ssMB.data() + ssMB.size());
     return strHex;
 }
 
@@ -927,29 +945,59 @@ UniValue signrawtransaction(const UniValue& params, bool fHelp)
     // Script verification errors
     UniValue vErrors(UniValue::VARR);
 
-    // Sign what we can:
+    // The coins of the view can't be read concurrently
+    std::vector<CScript> vPrevPubKeys(mergedTx.vin.size());
+    std::vector<CScript> vScriptPubKeys(mergedTx.vin.size());
+    std::vector<std::string> vInputErrors(mergedTx.vin.size());
     for (unsigned int i = 0; i < mergedTx.vin.size(); i++) {
-        CTxIn& txin = mergedTx.vin[i];
-        const Coin& coin = view.AccessCoin(txin.prevout);
+        const Coin& coin = view.AccessCoin(mergedTx.vin[i].prevout);
         if (coin.IsSpent()) {
-            TxInErrorToJSON(txin, vErrors, "Input not found or already spent");
+            vInputErrors[i] = "Input not found or already spent";
             continue;
         }
-        const CScript& prevPubKey = coin.out.scriptPubKey;
+        vPrevPubKeys[i] = coin.out.scriptPubKey;
 
-        txin.scriptSig.clear();
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mergedTx.vout.size()))
-            SignSignature(keystore, prevPubKey, mergedTx, i, nHashType);
+            vScriptPubKeys[i] = coin.out.scriptPubKey;
+    }
 
-        // ... and merge in other signatures:
-        BOOST_FOREACH(const CMutableTransaction& txv, txVariants) {
-            txin.scriptSig = CombineSignatures(prevPubKey, mergedTx, i, txin.scriptSig, txv.vin[i].scriptSig);
-        }
-        ScriptError serror = SCRIPT_ERR_OK;
-        if (!VerifyScript(txin.scriptSig, prevPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, MutableTransactionSignatureChecker(&mergedTx, i), &serror)) {
-            TxInErrorToJSON(txin, vErrors, ScriptErrorString(serror));
+    // Sign what we can, the signature hashes don't depend on the script signatures of the inputs:
+    CTransaction txConst(mergedTx);
+    std::vector<CScript> vScriptSigs;
+    ProduceSignatures(keystore, txConst, vScriptPubKeys, nHashType, vScriptSigs);
+
+    // ... and merge in other signatures:
+    PrecomputedTransactionData txdata(txConst);
+    std::atomic<size_t> nNext(0);
+    auto mergeInputs = [&]() {
+        for (size_t i = nNext++; i < mergedTx.vin.size(); i = nNext++) {
+            if (!vInputErrors[i].empty())
+                continue;
+            const CScript& prevPubKey = vPrevPubKeys[i];
+            TransactionSignatureChecker checker(&txConst, i, &txdata);
+            CScript& scriptSig = mergedTx.vin[i].scriptSig;
+            scriptSig = vScriptSigs[i];
+            BOOST_FOREACH(const CMutableTransaction& txv, txVariants) {
+                scriptSig = CombineSignatures(prevPubKey, checker, scriptSig, txv.vin[i].scriptSig);
+            }
+            ScriptError serror = SCRIPT_ERR_OK;
+            if (!VerifyScript(scriptSig, prevPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, checker, &serror)) {
+                vInputErrors[i] = ScriptErrorString(serror);
+            }
         }
+    };
+    int nThreads = std::min<int>(std::min<int>(std::max<int>(std::thread::hardware_concurrency(), 1), MAX_SIGNATURE_THREADS), mergedTx.vin.size());
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; ++i)
+        vThreads.emplace_back(mergeInputs);
+    mergeInputs();
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    for (unsigned int i = 0; i < mergedTx.vin.size(); i++) {
+        if (!vInputErrors[i].empty())
+            TxInErrorToJSON(mergedTx.vin[i], vErrors, vInputErrors[i]);
     }
     bool fComplete = vErrors.empty();
 
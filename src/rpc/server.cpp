@@ -6,6 +6,7 @@
 #include "rpc/server.h"
 
 #include "base58.h"
+#include "changefeed.h"
 #include "init.h"
 #include "random.h"
 #include "sync.h"
@@ -13,6 +14,9 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
+#include <memory>
+
 #include <univalue.h>
 
 #include <boost/bind.hpp>
@@ -266,163 +270,174 @@ UniValue stop(const UniValue& params, bool fHelp)
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode  readOnly
+  //  --------------------- ------------------------  -----------------------  ----------  --------
     /* Overall control/query calls */
-    { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
-    { "control",            "debug",                  &debug,                  true  },
-    { "control",            "help",                   &help,                   true  },
-    { "control",            "stop",                   &stop,                   true  },
+    { "control",            "getinfo",                &getinfo,                true,       true  }, /* uses wallet if enabled */
+    { "control",            "debug",                  &debug,                  true,       false },
+    { "control",            "getlockstats",           &getlockstats,           true,       true  },
+    { "control",            "getmemoryinfo",          &getmemoryinfo,          true,       true  },
+    { "control",            "getmaintenanceinfo",     &getmaintenanceinfo,     true,       true  },
+    { "control",            "help",                   &help,                   true,       true  },
+    { "control",            "stop",                   &stop,                   true,       false },
 
     /* P2P networking */
-    { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
-    { "network",            "addnode",                &addnode,                true  },
-    { "network",            "disconnectnode",         &disconnectnode,         true  },
-    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
-    { "network",            "getconnectioncount",     &getconnectioncount,     true  },
-    { "network",            "getnettotals",           &getnettotals,           true  },
-    { "network",            "getpeerinfo",            &getpeerinfo,            true  },
-    { "network",            "ping",                   &ping,                   true  },
-    { "network",            "setban",                 &setban,                 true  },
-    { "network",            "listbanned",             &listbanned,             true  },
-    { "network",            "clearbanned",            &clearbanned,            true  },
-    { "network",            "setnetworkactive",       &setnetworkactive,       true  },
+    { "network",            "getnetworkinfo",         &getnetworkinfo,         true,       true  },
+    { "network",            "addnode",                &addnode,                true,       false },
+    { "network",            "disconnectnode",         &disconnectnode,         true,       false },
+    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,       true  },
+    { "network",            "getconnectioncount",     &getconnectioncount,     true,       true  },
+    { "network",            "getnettotals",           &getnettotals,           true,       true  },
+    { "network",            "getnetmsgstats",         &getnetmsgstats,         true,       true  },
+    { "network",            "getpeerinfo",            &getpeerinfo,            true,       true  },
+    { "network",            "ping",                   &ping,                   true,       false },
+    { "network",            "setban",                 &setban,                 true,       false },
+    { "network",            "listbanned",             &listbanned,             true,       true  },
+    { "network",            "clearbanned",            &clearbanned,            true,       false },
+    { "network",            "setnetworkactive",       &setnetworkactive,       true,       false },
 
     /* Block chain and UTXO */
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
-    { "blockchain",         "getblockheaders",        &getblockheaders,        true  },
-    { "blockchain",         "getchaintips",           &getchaintips,           true  },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
-    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true  },
-    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
-    { "blockchain",         "verifychain",            &verifychain,            true  },
-    { "blockchain",         "getspentinfo",           &getspentinfo,           false },
-    { "blockchain",         "getchaintxstats",        &getchaintxstats,        false },
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,       true  },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,       true  },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,       true  },
+    { "blockchain",         "getblock",               &getblock,               true,       true  },
+    { "blockchain",         "getblockhashes",         &getblockhashes,         true,       true  },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,       true  },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,       true  },
+    { "blockchain",         "getblockheaders",        &getblockheaders,        true,       true  },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true,       true  },
+    { "blockchain",         "getchaintips",           &getchaintips,           true,       true  },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,       true  },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,       true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,       true  },
+    { "blockchain",         "gettxout",               &gettxout,               true,       true  },
+    { "blockchain",         "gettxoutproof",          &gettxoutproof,          true,       true  },
+    { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true,       true  },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,       false },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true,       false },
+    { "blockchain",         "verifytxoutset",         &verifytxoutset,         true,       false },
+    { "blockchain",         "verifychain",            &verifychain,            true,       false },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           false,      true  },
+    { "blockchain",         "getchaintxstats",        &getchaintxstats,        false,      true  },
+    { "blockchain",         "getblockjournal",        &getblockjournal,        true,       true  },
 
     /* Mining */
-    { "mining",             "getblocktemplate",       &getblocktemplate,       true  },
-    { "mining",             "getmininginfo",          &getmininginfo,          true  },
-    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true  },
-    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true  },
-    { "mining",             "submitblock",            &submitblock,            true  },
+    { "mining",             "getblocktemplate",       &getblocktemplate,       true,       false },
+    { "mining",             "getmininginfo",          &getmininginfo,          true,       true  },
+    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true,       true  },
+    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true,       false },
+    { "mining",             "submitblock",            &submitblock,            true,       false },
 
     /* Coin generation */
-    { "generating",         "getgenerate",            &getgenerate,            true  },
-    { "generating",         "setgenerate",            &setgenerate,            true  },
-    { "generating",         "generate",               &generate,               true  },
+    { "generating",         "getgenerate",            &getgenerate,            true,       false },
+    { "generating",         "setgenerate",            &setgenerate,            true,       false },
+    { "generating",         "generate",               &generate,               true,       false },
 
     /* Raw transactions */
-    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true  },
-    { "rawtransactions",    "splitinputs",            &splitinputs,            true  },
-    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true  },
-    { "rawtransactions",    "decodescript",           &decodescript,           true  },
-    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true  },
-    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false },
-    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false }, /* uses wallet if enabled */
+    { "rawtransactions",    "createrawtransaction",   &createrawtransaction,   true,       false },
+    { "rawtransactions",    "splitinputs",            &splitinputs,            true,       false },
+    { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   true,       true  },
+    { "rawtransactions",    "decodescript",           &decodescript,           true,       true  },
+    { "rawtransactions",    "getrawtransaction",      &getrawtransaction,      true,       true  },
+    { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     false,      false },
+    { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     false,      false }, /* uses wallet if enabled */
 #ifdef ENABLE_WALLET
-    { "rawtransactions",    "fundrawtransaction",     &fundrawtransaction,     false },
+    { "rawtransactions",    "fundrawtransaction",     &fundrawtransaction,     false,      false },
 #endif
 
     /* Address index */
-    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true  },
-    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false },
-    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false },
-    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false },
-    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false },
-    { "addressindex",       "getaddresses",           &getaddresses,           false },
-    { "addressindex",       "getmoneysupply",         &getmoneysupply,         false },
+    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true,       true  },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false,      true  },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false,      true  },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false,      true  },
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false,      true  },
+    { "addressindex",       "getaddresspayouts",      &getaddresspayouts,      false,      true  },
+    { "addressindex",       "getaddresses",           &getaddresses,           false,      true  },
+    { "addressindex",       "getmoneysupply",         &getmoneysupply,         false,      true  },
 
     /* Utility functions */
-    { "util",               "createmultisig",         &createmultisig,         true  },
-    { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "verifymessage",          &verifymessage,          true  },
-    { "util",               "estimatefee",            &estimatefee,            true  },
-    { "util",               "estimatepriority",       &estimatepriority,       true  },
-    { "util",               "estimatesmartfee",       &estimatesmartfee,       true  },
-    { "util",               "estimatesmartpriority",  &estimatesmartpriority,  true  },
-    { "util",               "getrandomkeypair",       &getrandomkeypair,       true  },
+    { "util",               "createmultisig",         &createmultisig,         true,       true  },
+    { "util",               "validateaddress",        &validateaddress,        true,       true  }, /* uses wallet if enabled */
+    { "util",               "verifymessage",          &verifymessage,          true,       true  },
+    { "util",               "estimatefee",            &estimatefee,            true,       true  },
+    { "util",               "estimatepriority",       &estimatepriority,       true,       true  },
+    { "util",               "estimatesmartfee",       &estimatesmartfee,       true,       true  },
+    { "util",               "estimatesmartpriority",  &estimatesmartpriority,  true,       true  },
+    { "util",               "getrandomkeypair",       &getrandomkeypair,       true,       false },
 
     /* Not shown in help */
-    { "hidden",             "invalidateblock",        &invalidateblock,        true  },
-    { "hidden",             "reconsiderblock",        &reconsiderblock,        true  },
-    { "hidden",             "setmocktime",            &setmocktime,            true  },
+    { "hidden",             "invalidateblock",        &invalidateblock,        true,       false },
+    { "hidden",             "reconsiderblock",        &reconsiderblock,        true,       false },
+    { "hidden",             "setmocktime",            &setmocktime,            true,       false },
 #ifdef ENABLE_WALLET
-    { "hidden",             "resendwallettransactions", &resendwallettransactions, true},
+    { "hidden",             "resendwallettransactions", &resendwallettransactions, true,       false },
 #endif
 
     /* SmartCash features */
-    { "smartcash",               "smartnode",             &smartnode,             true  },
-    { "smartcash",               "smartnodelist",         &smartnodelist,         true  },
-    { "smartcash",               "smartnodebroadcast",    &smartnodebroadcast,    true  },
+    { "smartcash",               "smartnode",             &smartnode,             true,       false },
+    { "smartcash",               "smartnodelist",         &smartnodelist,         true,       true  },
+    { "smartcash",               "smartnodebroadcast",    &smartnodebroadcast,    true,       false },
+    { "smartcash",               "getinstantpaystats",    &getinstantpaystats,    true,       true  },
   /* WIP-VOTING uncomment
-    { "smartcash",               "smartvoting",           &smartvoting,           true  },
-    { "smartcash",               "votekeys",              &votekeys,              true  },
+    { "smartcash",               "smartvoting",           &smartvoting,           true,       false },
+    { "smartcash",               "votekeys",              &votekeys,              true,       false },
   */
-    { "smartcash",               "snsync",                 &snsync,                 true  },
-    { "smartcash",               "spork",                  &spork,                  true  },
-    { "smartcash",               "smartrewards",           &smartrewards,           true  },
-    { "smartcash",               "termrewards",            &termrewards,            true  },
-    { "smartcash",               "smartmining",            &smartmining,            true  },
+    { "smartcash",               "snsync",                 &snsync,                 true,       false },
+    { "smartcash",               "spork",                  &spork,                  true,       false },
+    { "smartcash",               "smartrewards",           &smartrewards,           true,       true  },
+    { "smartcash",               "termrewards",            &termrewards,            true,       true  },
+    { "smartcash",               "getrewardsstats",        &getrewardsstats,        true,       true  },
+    { "smartcash",               "smartmining",            &smartmining,            true,       false },
 #ifdef ENABLE_WALLET
 
     /* Wallet */
-    //{ "wallet",             "keepass",                &keepass,                true },
-    { "wallet",             "instantsendtoaddress",   &instantsendtoaddress,   false },
-    { "wallet",             "addmultisigaddress",     &addmultisigaddress,     true  },
-    { "wallet",             "backupwallet",           &backupwallet,           true  },
-    { "wallet",             "dumpprivkey",            &dumpprivkey,            true  },
-    { "wallet",             "dumphdinfo",             &dumphdinfo,             true  },
-    { "wallet",             "dumpwallet",             &dumpwallet,             true  },
-    { "wallet",             "encryptwallet",          &encryptwallet,          true  },
-    { "wallet",             "getaccountaddress",      &getaccountaddress,      true  },
-    { "wallet",             "getaccount",             &getaccount,             true  },
-    { "wallet",             "getaddress",             &getaddress,             true  },
-    { "wallet",             "getaddressesbyaccount",  &getaddressesbyaccount,  true  },
-    { "wallet",             "getbalance",             &getbalance,             false },
-    { "wallet",             "getnewaddress",          &getnewaddress,          true  },
-    { "wallet",             "getrawchangeaddress",    &getrawchangeaddress,    true  },
-    { "wallet",             "getreceivedbyaccount",   &getreceivedbyaccount,   false },
-    { "wallet",             "getreceivedbyaddress",   &getreceivedbyaddress,   false },
-    { "wallet",             "gettransaction",         &gettransaction,         false },
-    { "wallet",             "abandontransaction",     &abandontransaction,     false },
-    { "wallet",             "getunconfirmedbalance",  &getunconfirmedbalance,  false },
-    { "wallet",             "getwalletinfo",          &getwalletinfo,          false },
-    { "wallet",             "importprivkey",          &importprivkey,          true  },
-    { "wallet",             "importwallet",           &importwallet,           true  },
-    { "wallet",             "importelectrumwallet",   &importelectrumwallet,   true  },
-    { "wallet",             "importaddress",          &importaddress,          true  },
-    { "wallet",             "importpubkey",           &importpubkey,           true  },
-    { "wallet",             "keypoolrefill",          &keypoolrefill,          true  },
-    { "wallet",             "listaccounts",           &listaccounts,           false },
-    { "wallet",             "listaddressgroupings",   &listaddressgroupings,   false },
-    { "wallet",             "listlockunspent",        &listlockunspent,        false },
-    { "wallet",             "listreceivedbyaccount",  &listreceivedbyaccount,  false },
-    { "wallet",             "listreceivedbyaddress",  &listreceivedbyaddress,  false },
-    { "wallet",             "listsinceblock",         &listsinceblock,         false },
-    { "wallet",             "listtransactions",       &listtransactions,       false },
-    { "wallet",             "listunspent",            &listunspent,            false },
-    { "wallet",             "lockunspent",            &lockunspent,            true  },
-    { "wallet",             "move",                   &movecmd,                false },
-    { "wallet",             "sendfrom",               &sendfrom,               false },
-    { "wallet",             "sendmany",               &sendmany,               false },
-    { "wallet",             "sendtoaddress",          &sendtoaddress,          false },
-    { "wallet",             "sendtoaddresslocked",    &sendtoaddresslocked,    false },
-    { "wallet",             "setaccount",             &setaccount,             true  },
-    { "wallet",             "settxfee",               &settxfee,               true  },
-    { "wallet",             "signmessage",            &signmessage,            true  },
-    { "wallet",             "walletlock",             &walletlock,             true  },
-    { "wallet",             "walletpassphrasechange", &walletpassphrasechange, true  },
-    { "wallet",             "walletpassphrase",       &walletpassphrase,       true  },
+    //{ "wallet",             "keepass",                &keepass,                true,       false },
+    { "wallet",             "instantsendtoaddress",   &instantsendtoaddress,   false,      false },
+    { "wallet",             "addmultisigaddress",     &addmultisigaddress,     true,       false },
+    { "wallet",             "backupwallet",           &backupwallet,           true,       false },
+    { "wallet",             "dumpprivkey",            &dumpprivkey,            true,       false },
+    { "wallet",             "dumphdinfo",             &dumphdinfo,             true,       false },
+    { "wallet",             "dumpwallet",             &dumpwallet,             true,       false },
+    { "wallet",             "encryptwallet",          &encryptwallet,          true,       false },
+    { "wallet",             "getaccountaddress",      &getaccountaddress,      true,       false },
+    { "wallet",             "getaccount",             &getaccount,             true,       true  },
+    { "wallet",             "getaddress",             &getaddress,             true,       false },
+    { "wallet",             "getaddressesbyaccount",  &getaddressesbyaccount,  true,       true  },
+    { "wallet",             "getbalance",             &getbalance,             false,      true  },
+    { "wallet",             "getnewaddress",          &getnewaddress,          true,       false },
+    { "wallet",             "getrawchangeaddress",    &getrawchangeaddress,    true,       false },
+    { "wallet",             "getreceivedbyaccount",   &getreceivedbyaccount,   false,      true  },
+    { "wallet",             "getreceivedbyaddress",   &getreceivedbyaddress,   false,      true  },
+    { "wallet",             "gettransaction",         &gettransaction,         false,      true  },
+    { "wallet",             "abandontransaction",     &abandontransaction,     false,      false },
+    { "wallet",             "getunconfirmedbalance",  &getunconfirmedbalance,  false,      true  },
+    { "wallet",             "getwalletinfo",          &getwalletinfo,          false,      true  },
+    { "wallet",             "importprivkey",          &importprivkey,          true,       false },
+    { "wallet",             "importwallet",           &importwallet,           true,       false },
+    { "wallet",             "importelectrumwallet",   &importelectrumwallet,   true,       false },
+    { "wallet",             "importaddress",          &importaddress,          true,       false },
+    { "wallet",             "importpubkey",           &importpubkey,           true,       false },
+    { "wallet",             "keypoolrefill",          &keypoolrefill,          true,       false },
+    { "wallet",             "listaccounts",           &listaccounts,           false,      true  },
+    { "wallet",             "listaddressgroupings",   &listaddressgroupings,   false,      true  },
+    { "wallet",             "listlockunspent",        &listlockunspent,        false,      true  },
+    { "wallet",             "listreceivedbyaccount",  &listreceivedbyaccount,  false,      true  },
+    { "wallet",             "listreceivedbyaddress",  &listreceivedbyaddress,  false,      true  },
+    { "wallet",             "listsinceblock",         &listsinceblock,         false,      true  },
+    { "wallet",             "listtransactions",       &listtransactions,       false,      true  },
+    { "wallet",             "listunspent",            &listunspent,            false,      true  },
+    { "wallet",             "lockunspent",            &lockunspent,            true,       false },
+    { "wallet",             "move",                   &movecmd,                false,      false },
+    { "wallet",             "sendfrom",               &sendfrom,               false,      false },
+    { "wallet",             "sendmany",               &sendmany,               false,      false },
+    { "wallet",             "sendtoaddress",          &sendtoaddress,          false,      false },
+    { "wallet",             "sendtoaddresslocked",    &sendtoaddresslocked,    false,      false },
+    { "wallet",             "setaccount",             &setaccount,             true,       false },
+    { "wallet",             "settxfee",               &settxfee,               true,       false },
+    { "wallet",             "signmessage",            &signmessage,            true,       false },
+    { "wallet",             "walletlock",             &walletlock,             true,       false },
+    { "wallet",             "walletpassphrasechange", &walletpassphrasechange, true,       false },
+    { "wallet",             "walletpassphrase",       &walletpassphrase,       true,       false },
 
 #endif // ENABLE_WALLET
 };
@@ -488,6 +503,45 @@ bool IsRPCRunning()
     return fRPCRunning;
 }
 
+uint64_t RPCWaitForChange(CChangeFeed& feed, uint64_t nKnown, int64_t nTimeoutMillis)
+{
+    int64_t nDeadline = GetTimeMillis() + nTimeoutMillis;
+    uint64_t nVersion = feed.GetVersion();
+
+    // Waits in slices to notice the shutdown
+    while (nVersion == nKnown && IsRPCRunning()) {
+        int64_t nWait = 1000;
+        if (nTimeoutMillis > 0) {
+            nWait = std::min(nWait, nDeadline - GetTimeMillis());
+            if (nWait <= 0)
+                break;
+        }
+        nVersion = feed.WaitForChange(nKnown, std::chrono::milliseconds(nWait));
+    }
+
+    return nVersion;
+}
+
+static int64_t ParseWaitArgument(const UniValue& value, const std::string& strName)
+{
+    int64_t n;
+    if (value.isNum())
+        n = value.get_int64();
+    else if (!value.isStr() || !ParseInt64(value.get_str(), &n))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid " + strName);
+    if (n < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative " + strName);
+    return n;
+}
+
+void RPCParseWaitForChange(const UniValue& params, size_t nFirst, uint64_t& nKnown, int64_t& nTimeoutMillis)
+{
+    if (params.size() > nFirst + 2)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Too many parameters");
+    nKnown = params.size() > nFirst ? ParseWaitArgument(params[nFirst], "version") : 0;
+    nTimeoutMillis = params.size() > nFirst + 1 ? ParseWaitArgument(params[nFirst + 1], "timeout") : 0;
+}
+
 void SetRPCWarmupStatus(const std::string& newStatus)
 {
     LOCK(cs_rpcWarmup);
@@ -563,11 +617,82 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+static bool IsReadOnlyRequest(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req, "method");
+    if (!valMethod.isStr())
+        return false;
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->fReadOnly;
+}
+
+/** A run of read-only calls of a batch, shared with the helpers which may only start after it is done */
+struct CRPCBatchRun
+{
+    const UniValue& vReq;
+    size_t nBegin;
+    size_t nEnd;
+    std::atomic<size_t> nNext;
+    std::vector<UniValue> vReplies;
+
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    size_t nDone;
+
+    CRPCBatchRun(const UniValue& vReqIn, size_t nBeginIn, size_t nEndIn) :
+        vReq(vReqIn), nBegin(nBeginIn), nEnd(nEndIn), nNext(nBeginIn), vReplies(nEndIn - nBeginIn), nDone(0) {}
+};
+
+static void JSONRPCExecRun(std::shared_ptr<CRPCBatchRun> run)
+{
+    // vReq is only valid as long as there are calls left to take
+    size_t reqIdx;
+    while ((reqIdx = run->nNext++) < run->nEnd) {
+        UniValue reply = JSONRPCExecOne(run->vReq[reqIdx]);
+
+        boost::unique_lock<boost::mutex> lock(run->cs);
+        run->vReplies[reqIdx - run->nBegin] = reply;
+        if (++run->nDone == run->nEnd - run->nBegin)
+            run->cond.notify_all();
+    }
+}
+
+std::string JSONRPCExecBatch(const UniValue& vReq, int nHelpers, const RPCBatchEnqueue& enqueue)
 {
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        size_t nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsReadOnlyRequest(vReq[nEnd]))
+            nEnd++;
+
+        if (nEnd - reqIdx < 2 || nHelpers <= 0 || enqueue.empty()) {
+            // A call which changes something, or nothing to run next to each other
+            nEnd = std::max(nEnd, reqIdx + 1);
+            for (; reqIdx < nEnd; reqIdx++)
+                ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+            continue;
+        }
+
+        std::shared_ptr<CRPCBatchRun> run = std::make_shared<CRPCBatchRun>(vReq, reqIdx, nEnd);
+        // The helpers only speed it up, this thread runs whatever they don't take
+        for (size_t i = 0; i < std::min((size_t)nHelpers, nEnd - reqIdx - 1); i++) {
+            if (!enqueue(boost::bind(&JSONRPCExecRun, run)))
+                break;
+        }
+        JSONRPCExecRun(run);
+
+        {
+            boost::unique_lock<boost::mutex> lock(run->cs);
+            while (run->nDone < nEnd - reqIdx)
+                run->cond.wait(lock);
+        }
+        for (const UniValue& reply : run->vReplies)
+            ret.push_back(reply);
+        reqIdx = nEnd;
+    }
 
     return ret.write() + "\n";
 }
@@ -601,6 +726,120 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     g_rpcSignals.PostCommand(*pcmd);
 }
 
+static void NoCleanup(RPCStreamSink*) {}
+static boost::thread_specific_ptr<RPCStreamSink> streamSink(NoCleanup);
+
+void SetRPCStreamSink(RPCStreamSink* sink)
+{
+    streamSink.reset(sink);
+}
+
+CRPCResultStream::CRPCResultStream() : sink(streamSink.get()), fStarted(false)
+{
+    // Calls made by this one build their results again
+    streamSink.reset();
+}
+
+void CRPCResultStream::Separator()
+{
+    if (vecOpen.empty())
+        return;
+
+    assert(vecOpen.back().first != '"');
+    if (vecOpen.back().second)
+        strBuffer += ',';
+
+    vecOpen.back().second = true;
+}
+
+void CRPCResultStream::Key(const std::string& key)
+{
+    Separator();
+    strBuffer += UniValue(key).write();
+    strBuffer += ':';
+}
+
+void CRPCResultStream::Flush()
+{
+    if (!sink || strBuffer.size() < nChunkSize)
+        return;
+
+    sink->Write(strBuffer);
+    strBuffer.clear();
+    fStarted = true;
+}
+
+void CRPCResultStream::BeginArray()
+{
+    Separator();
+    strBuffer += '[';
+    vecOpen.push_back(std::make_pair(']', false));
+}
+
+void CRPCResultStream::BeginObject()
+{
+    Separator();
+    strBuffer += '{';
+    vecOpen.push_back(std::make_pair('}', false));
+}
+
+void CRPCResultStream::BeginString()
+{
+    Separator();
+    strBuffer += '"';
+    vecOpen.push_back(std::make_pair('"', false));
+}
+
+void CRPCResultStream::End()
+{
+    assert(!vecOpen.empty());
+    strBuffer += vecOpen.back().first;
+    vecOpen.pop_back();
+    Flush();
+}
+
+void CRPCResultStream::Push(const UniValue& value)
+{
+    Separator();
+    strBuffer += value.write();
+    Flush();
+}
+
+void CRPCResultStream::Push(const std::string& key, const UniValue& value)
+{
+    Key(key);
+    strBuffer += value.write();
+    Flush();
+}
+
+void CRPCResultStream::Append(const std::string& str)
+{
+    assert(!vecOpen.empty() && vecOpen.back().first == '"');
+    // Escaped like a whole string, without its quotes
+    std::string strEscaped = UniValue(str).write();
+    strBuffer.append(strEscaped, 1, strEscaped.size() - 2);
+    Flush();
+}
+
+UniValue CRPCResultStream::Finish()
+{
+    while (!vecOpen.empty())
+        End();
+
+    if (fStarted) {
+        if (!strBuffer.empty())
+            sink->Write(strBuffer);
+        strBuffer.clear();
+        return NullUniValue;
+    }
+
+    // The reader only takes arrays and objects at the top
+    UniValue result;
+    if (!result.read("[" + strBuffer + "]") || result.size() != 1)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Invalid streamed result");
+    return result[0];
+}
+
 std::vector<std::string> CRPCTable::listCommands() const
 {
     std::vector<std::string> commandList;
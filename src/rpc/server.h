@@ -57,6 +57,19 @@ public:
 /** Query whether RPC is running */
 bool IsRPCRunning();
 
+class CChangeFeed;
+
+/**
+ * Long poll of a change feed for the waitforchange commands. Returns the version of the feed
+ * once it is another one than nKnown, after nTimeoutMillis (0 = no limit) or when RPC stops.
+ */
+uint64_t RPCWaitForChange(CChangeFeed& feed, uint64_t nKnown, int64_t nTimeoutMillis);
+/**
+ * The ( version timeout ) arguments of a waitforchange command from params[nFirst] on, as numbers
+ * or as the strings bitcoin-cli passes for subcommands. Both default to 0.
+ */
+void RPCParseWaitForChange(const UniValue& params, size_t nFirst, uint64_t& nKnown, int64_t& nTimeoutMillis);
+
 /**
  * Set the RPC warmup status.  When this is done, all RPC calls will error out
  * immediately with RPC_IN_WARMUP.
@@ -131,6 +144,8 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    /** Doesn't change any state, it can run next to the other read-only calls of a batch */
+    bool fReadOnly;
 };
 
 /**
@@ -171,6 +186,63 @@ public:
 
 extern CRPCTable tableRPC;
 
+/**
+ * Receives the JSON of a result while the call produces it. The HTTP server sets one
+ * for the thread around a single request.
+ */
+class RPCStreamSink
+{
+public:
+    virtual ~RPCStreamSink() {}
+    virtual void Write(const std::string& strJSON) = 0;
+};
+
+/** Set the sink for the results streamed by this thread, NULL to remove it */
+void SetRPCStreamSink(RPCStreamSink* sink);
+
+/**
+ * Result of a call which gets written in parts, for the ones too large to be built
+ * as one UniValue. With a stream sink for the thread the JSON goes to the sink once
+ * nChunkSize is buffered and Finish returns NullUniValue, the sink completes the
+ * reply. Otherwise, e.g. in a batch or the console, and for results smaller than
+ * nChunkSize Finish returns the result as UniValue. Only the first stream of a call
+ * gets the sink. Once the first part went out an error can only end the reply.
+ */
+class CRPCResultStream
+{
+private:
+    RPCStreamSink* sink;
+    std::string strBuffer;
+    //! Closing character of every open array, object or string and whether it got a value already
+    std::vector<std::pair<char, bool> > vecOpen;
+    bool fStarted;
+
+    void Separator();
+    void Key(const std::string& key);
+    void Flush();
+
+public:
+    static const size_t nChunkSize = 64 * 1024;
+
+    CRPCResultStream();
+
+    void BeginArray();
+    void BeginObject();
+    /** A string which is appended in parts, e.g. lines of CSV */
+    void BeginString();
+    /** Close the innermost open array, object or string */
+    void End();
+
+    void Push(const UniValue& value);
+    void Push(const std::string& key, const UniValue& value);
+    void Append(const std::string& str);
+
+    bool IsStarted() const { return fStarted; }
+
+    /** Close all open arrays, objects and strings and pass on the rest */
+    UniValue Finish();
+};
+
 /**
  * Utilities: convert hex-encoded Values
  * (throws error if not hex).
@@ -195,6 +267,7 @@ extern UniValue getaddressutxos(const UniValue& params, bool fHelp);
 extern UniValue getaddressdeltas(const UniValue& params, bool fHelp);
 extern UniValue getaddresstxids(const UniValue& params, bool fHelp);
 extern UniValue getaddressbalance(const UniValue& params, bool fHelp);
+extern UniValue getaddresspayouts(const UniValue& params, bool fHelp);
 
 extern UniValue getpeerinfo(const UniValue& params, bool fHelp);
 extern UniValue ping(const UniValue& params, bool fHelp);
@@ -202,6 +275,7 @@ extern UniValue addnode(const UniValue& params, bool fHelp);
 extern UniValue disconnectnode(const UniValue& params, bool fHelp);
 extern UniValue getaddednodeinfo(const UniValue& params, bool fHelp);
 extern UniValue getnettotals(const UniValue& params, bool fHelp);
+extern UniValue getnetmsgstats(const UniValue& params, bool fHelp);
 extern UniValue setban(const UniValue& params, bool fHelp);
 extern UniValue listbanned(const UniValue& params, bool fHelp);
 extern UniValue clearbanned(const UniValue& params, bool fHelp);
@@ -268,6 +342,9 @@ extern UniValue walletlock(const UniValue& params, bool fHelp);
 extern UniValue validateaddress(const UniValue& params, bool fHelp);
 extern UniValue getinfo(const UniValue& params, bool fHelp);
 extern UniValue debug(const UniValue& params, bool fHelp);
+extern UniValue getlockstats(const UniValue& params, bool fHelp);
+extern UniValue getmemoryinfo(const UniValue& params, bool fHelp);
+extern UniValue getmaintenanceinfo(const UniValue& params, bool fHelp);
 extern UniValue getwalletinfo(const UniValue& params, bool fHelp);
 extern UniValue getblockchaininfo(const UniValue& params, bool fHelp);
 extern UniValue getnetworkinfo(const UniValue& params, bool fHelp);
@@ -296,8 +373,10 @@ extern UniValue smartnodebroadcast(const UniValue& params, bool fHelp);
 extern UniValue smartvoting(const UniValue& params, bool fHelp);
 extern UniValue votekeys(const UniValue& params, bool fHelp);
 extern UniValue snsync(const UniValue& params, bool fHelp);
+extern UniValue getinstantpaystats(const UniValue& params, bool fHelp);
 extern UniValue smartrewards(const UniValue& params, bool fHelp);
 extern UniValue termrewards(const UniValue& params, bool fHelp);
+extern UniValue getrewardsstats(const UniValue& params, bool fHelp);
 extern UniValue smartmining(const UniValue& params, bool fHelp);
 
 extern UniValue getblockcount(const UniValue& params, bool fHelp); // in rpc/blockchain.cpp
@@ -310,14 +389,18 @@ extern UniValue getblockhashes(const UniValue& params, bool fHelp);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
 extern UniValue getblockheaders(const UniValue& params, bool fHelp);
+extern UniValue getblockfilter(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
+extern UniValue dumptxoutset(const UniValue& params, bool fHelp);
+extern UniValue verifytxoutset(const UniValue& params, bool fHelp);
 extern UniValue gettxout(const UniValue& params, bool fHelp);
 extern UniValue verifychain(const UniValue& params, bool fHelp);
 extern UniValue getchaintips(const UniValue& params, bool fHelp);
 extern UniValue invalidateblock(const UniValue& params, bool fHelp);
 extern UniValue reconsiderblock(const UniValue& params, bool fHelp);
 extern UniValue getchaintxstats(const UniValue& params, bool fHelp);
+extern UniValue getblockjournal(const UniValue& params, bool fHelp);
 extern UniValue getspentinfo(const UniValue& params, bool fHelp);
 extern UniValue getaddresses(const UniValue& params, bool fHelp);
 extern UniValue getmoneysupply(const UniValue& params, bool fHelp);
@@ -330,7 +413,14 @@ extern void EnsureVotingIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+/** Queues a function to be run on another thread, returns false if it can't be queued */
+typedef boost::function<bool (const boost::function<void ()>&)> RPCBatchEnqueue;
+/**
+ * Execute a batch of requests, the replies are in request order. Consecutive
+ * read-only calls run concurrently on up to nHelpers more threads through
+ * enqueue, the others one after the other with nothing else running.
+ */
+std::string JSONRPCExecBatch(const UniValue& vReq, int nHelpers = 0, const RPCBatchEnqueue& enqueue = RPCBatchEnqueue());
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
@@ -23,10 +23,10 @@ int64_t GetKeyForBlock(const CBlockIndex * pIndex){
 
         if( block.vtx.size() >= 1 ){
 
-            if( block.vtx[0].vout.size() >= 2){
+            if( block.vtx[0]->vout.size() >= 2){
 
                 // Second output of the coinbase needs to be the signature.
-                const CScript &sigScript = block.vtx[0].vout[1].scriptPubKey;
+                const CScript &sigScript = block.vtx[0]->vout[1].scriptPubKey;
 
                 // Check if it is an OP_RETURN and if the startvalue is OP_DATA_MINING_FLAG
                 if( sigScript.size() > nMiningSignatureMinScriptLength &&
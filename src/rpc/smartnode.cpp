@@ -9,6 +9,7 @@
 #include "netbase.h"
 #include "rpc/server.h"
 #include "smartnode/activesmartnode.h"
+#include "smartnode/instantx.h"
 #include "smartnode/smartnodeconfig.h"
 #include "smartnode/smartnodeman.h"
 #include "smartnode/smartnodepayments.h"
@@ -122,7 +123,7 @@ UniValue smartnode(const UniValue& params, bool fHelp)
 #endif // ENABLE_WALLET
          strCommand != "list" && strCommand != "list-conf" && strCommand != "count" && strCommand != "roi" &&
          strCommand != "debug" && strCommand != "current" && strCommand != "winner" && strCommand != "winners" && strCommand != "genkey" &&
-         strCommand != "connect" && strCommand != "status" && strCommand != "protocol"))
+         strCommand != "connect" && strCommand != "status" && strCommand != "protocol" && strCommand != "waitforchange"))
             throw std::runtime_error(
                 "smartnode \"command\"...\n"
                 "Set of commands to execute smartnode related actions\n"
@@ -143,6 +144,10 @@ UniValue smartnode(const UniValue& params, bool fHelp)
                 "  list-conf    - Print smartnode.conf in JSON format\n"
                 "  winner       - Print info on next smartnode winner to vote for\n"
                 "  winners      - Print list of smartnode winners\n"
+                "  waitforchange ( version timeout )\n"
+                "               - Wait up to timeout milliseconds (default: 0 = no limit) until the list or a smartnode\n"
+                "                 state changed since version, then print the new version with the total and enabled\n"
+                "                 count. Without a version it prints them right away. Pings don't count as changes.\n"
                 );
 
     if (strCommand == "list")
@@ -174,6 +179,19 @@ UniValue smartnode(const UniValue& params, bool fHelp)
         return "successfully connected";
     }
 
+    if (strCommand == "waitforchange")
+    {
+        uint64_t nKnown;
+        int64_t nTimeout;
+        RPCParseWaitForChange(params, 1, nKnown, nTimeout);
+
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("version", RPCWaitForChange(mnodeman.GetListFeed(), nKnown, nTimeout));
+        obj.pushKV("total", mnodeman.size());
+        obj.pushKV("enabled", mnodeman.CountEnabled());
+        return obj;
+    }
+
     if (strCommand == "count")
     {
         if (params.size() > 2)
@@ -611,28 +629,29 @@ UniValue smartnodelist(const UniValue& params, bool fHelp)
         mnodeman.UpdateLastPaid(pindex);
     }
 
-    UniValue obj(UniValue::VOBJ);
+    // Written out while the list is walked instead of as one large UniValue
+    CRPCResultStream obj;
+    obj.BeginObject();
     if (strMode == "rank") {
         CSmartnodeMan::rank_pair_vec_t vSmartnodeRanks;
         mnodeman.GetSmartnodeRanks(vSmartnodeRanks);
         BOOST_FOREACH(PAIRTYPE(int, CSmartnode)& s, vSmartnodeRanks) {
             std::string strOutpoint = s.second.vin.prevout.ToStringShort();
             if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
-            obj.push_back(Pair(strOutpoint, s.first));
+            obj.Push(strOutpoint, s.first);
         }
     } else {
-        std::map<COutPoint, CSmartnode> mapSmartnodes = mnodeman.GetFullSmartnodeMap();
-        for (auto& mnpair : mapSmartnodes) {
-            CSmartnode mn = mnpair.second;
-            std::string strOutpoint = mnpair.first.ToStringShort();
+        CSmartnodeMan::snapshot_t snapshot = mnodeman.GetSmartnodeSnapshot();
+        for (const CSmartnode& mn : *snapshot) {
+            std::string strOutpoint = mn.vin.prevout.ToStringShort();
             if (strMode == "activeseconds") {
                 if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, (int64_t)(mn.lastPing.sigTime - mn.sigTime)));
+                obj.Push(strOutpoint, (int64_t)(mn.lastPing.sigTime - mn.sigTime));
             } else if (strMode == "addr") {
                 std::string strAddress = mn.addr.ToString();
                 if (strFilter !="" && strAddress.find(strFilter) == std::string::npos &&
                     strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, strAddress));
+                obj.Push(strOutpoint, strAddress);
             } else if (strMode == "full") {
                 std::ostringstream streamFull;
                 streamFull << std::setw(18) <<
@@ -647,7 +666,7 @@ UniValue smartnodelist(const UniValue& params, bool fHelp)
                 std::string strFull = streamFull.str();
                 if (strFilter !="" && strFull.find(strFilter) == std::string::npos &&
                     strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, strFull));
+                obj.Push(strOutpoint, strFull);
             } else if (strMode == "info") {
                 std::ostringstream streamInfo;
                 streamInfo << std::setw(18) <<
@@ -662,38 +681,38 @@ UniValue smartnodelist(const UniValue& params, bool fHelp)
                 std::string strInfo = streamInfo.str();
                 if (strFilter !="" && strInfo.find(strFilter) == std::string::npos &&
                     strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, strInfo));
+                obj.Push(strOutpoint, strInfo);
             } else if (strMode == "lastpaidblock") {
                 if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, mn.GetLastPaidBlock()));
+                obj.Push(strOutpoint, mn.GetLastPaidBlock());
             } else if (strMode == "lastpaidtime") {
                 if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, mn.GetLastPaidTime()));
+                obj.Push(strOutpoint, mn.GetLastPaidTime());
             } else if (strMode == "lastseen") {
                 if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, (int64_t)mn.lastPing.sigTime));
+                obj.Push(strOutpoint, (int64_t)mn.lastPing.sigTime);
             } else if (strMode == "payee") {
                 CBitcoinAddress address(mn.pubKeyCollateralAddress.GetID());
                 std::string strPayee = address.ToString();
                 if (strFilter !="" && strPayee.find(strFilter) == std::string::npos &&
                     strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, strPayee));
+                obj.Push(strOutpoint, strPayee);
             } else if (strMode == "protocol") {
                 if (strFilter !="" && strFilter != strprintf("%d", mn.nProtocolVersion) &&
                     strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, (int64_t)mn.nProtocolVersion));
+                obj.Push(strOutpoint, (int64_t)mn.nProtocolVersion);
             } else if (strMode == "pubkey") {
                 if (strFilter !="" && strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, HexStr(mn.pubKeySmartnode)));
+                obj.Push(strOutpoint, HexStr(mn.pubKeySmartnode));
             } else if (strMode == "status") {
                 std::string strStatus = mn.GetStatus();
                 if (strFilter !="" && strStatus.find(strFilter) == std::string::npos &&
                     strOutpoint.find(strFilter) == std::string::npos) continue;
-                obj.push_back(Pair(strOutpoint, strStatus));
+                obj.Push(strOutpoint, strStatus);
             }
         }
     }
-    return obj;
+    return obj.Finish();
 }
 
 bool DecodeHexVecMnb(std::vector<CSmartnodeBroadcast>& vecMnb, std::string strHexMnb) {
@@ -942,6 +961,50 @@ UniValue smartnodebroadcast(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+UniValue getinstantpaystats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1) {
+        throw std::runtime_error(
+            "getinstantpaystats ( reset )\n"
+            "Display the latency of the InstantPay locks seen since the start\n"
+
+            "\nArguments:\n"
+            "1. reset    (boolean, optional, default=false) Clear the statistics after they got returned\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"requests\" : n,                 (numeric) Lock requests received\n"
+            "  \"locked\" : n,                   (numeric) Requests which got locked\n"
+            "  \"failed\" : n,                   (numeric) Requests which timed out without a lock\n"
+            "  \"time_to_first_vote\" : {        (object) Time from the request to its first vote\n"
+            "    \"count\" : n,                  (numeric) Number of samples\n"
+            "    \"avg_ms\" : n.nnn,             (numeric) Average of the samples in milliseconds\n"
+            "    \"max_ms\" : n,                 (numeric) Slowest sample in milliseconds\n"
+            "    \"p50_ms\" : n,                 (numeric) Upper bound of the bucket with the median, -1 if open ended\n"
+            "    \"p90_ms\" : n,                 (numeric) Same for the 90th percentile\n"
+            "    \"p99_ms\" : n,                 (numeric) Same for the 99th percentile\n"
+            "    \"histogram\" : [               (array) Non-empty power of two buckets\n"
+            "      { \"below_ms\" : n, \"count\" : n }\n"
+            "    ]\n"
+            "  },\n"
+            "  \"time_to_lock\" : { ... },       (object) Time from the request to the completed lock\n"
+            "  \"vote_arrival\" : { ... }        (object) Time from the request to each of its votes\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getinstantpaystats", "")
+            + HelpExampleRpc("getinstantpaystats", "true")
+            );
+    }
+
+    UniValue result = instantsend.GetStats().ToJSON();
+
+    if (params.size() > 0 && params[0].get_bool()) {
+        instantsend.GetStats().Clear();
+    }
+
+    return result;
+}
+
 UniValue sentinelping(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1) {
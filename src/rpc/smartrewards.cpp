@@ -10,20 +10,50 @@
 #include "rpc/server.h"
 #include "smartrewards/rewards.h"
 #include "smartrewards/rewardspayments.h"
+#include "smartrewards/rewardsroundfile.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "utilstrencodings.h"
 #include "wallet/wallet.h"
 
 #include <fstream>
 #include <iomanip>
+#include <limits>
 #include <univalue.h>
 
 
+static double FormatSmart(CAmount a)
+{
+    return a / COIN + ( double(a % COIN) / COIN );
+}
+
+static UniValue CurrentRoundToJSON(const CSmartRewardsRoundsSnapshotRef& rounds, uint64_t nVersion)
+{
+    UniValue obj(UniValue::VOBJ);
+
+    const CSmartRewardRound *current = &rounds->current;
+
+    if( !current->number ) throw JSONRPCError(RPC_DATABASE_ERROR, "No active reward round available yet.");
+
+    obj.pushKV("rewards_cycle",current->number);
+    obj.pushKV("start_blockheight",current->startBlockHeight);
+    obj.pushKV("start_blocktime",current->startBlockTime);
+    obj.pushKV("end_blockheight",current->endBlockHeight);
+    obj.pushKV("end_blocktime",current->endBlockTime);
+    obj.pushKV("eligible_addresses",current->GetEligibleEntries());
+    obj.pushKV("eligible_smart",FormatSmart(current->GetEligibleSmart()));
+    obj.pushKV("disqualified_addresses",current->disqualifiedEntries);
+    obj.pushKV("disqualified_smart",FormatSmart(current->disqualifiedSmart));
+    obj.pushKV("estimated_rewards",FormatSmart(current->rewards));
+    obj.pushKV("estimated_percent",current->percent * 100.0);
+    obj.pushKV("version",nVersion);
+
+    return obj;
+}
+
 UniValue smartrewards(const UniValue& params, bool fHelp)
 {
-    std::function<double (CAmount)> format = [](CAmount a) {
-        return a / COIN + ( double(a % COIN) / COIN );
-    };
+    std::function<double (CAmount)> format = FormatSmart;
 
     std::string strCommand;
     if (params.size() >= 1) {
@@ -32,7 +62,7 @@ UniValue smartrewards(const UniValue& params, bool fHelp)
 
     if (fHelp  ||
         (
-         strCommand != "current" && strCommand != "snapshot" && strCommand != "history" && strCommand != "check" && strCommand != "payouts"))
+         strCommand != "current" && strCommand != "snapshot" && strCommand != "history" && strCommand != "check" && strCommand != "payouts" && strCommand != "waitforchange"))
             throw std::runtime_error(
                 "smartrewards \"command\"...\n"
                 "Set of commands to execute smartrewards related actions\n"
@@ -41,56 +71,44 @@ UniValue smartrewards(const UniValue& params, bool fHelp)
                 "\nAvailable commands:\n"
                 "  current           - Print information about the current SmartReward cycle.\n"
                 "  history           - Print the results of all past SmartReward cycles.\n"
-                "  payouts  :round   - Print a list of all paid rewards in the past cycle :round\n"
+                "  payouts  :round ( :offset :limit ( :format ) )\n"
+                "                    - Print a list of the paid rewards in the past cycle :round, optionally only\n"
+                "                      :limit payouts starting at payout :offset. :format \"csv\" prints one string\n"
+                "                      with a line \"address,reward\" per payout instead of a list of objects.\n"
                 "  snapshot :round   - Print a list of all addresses with their balances from the end of the past cycle :round.\n"
                 "  check :address    - Check the given :address for eligibility in the current rewards cycle.\n"
+                "  waitforchange ( :version :timeout )\n"
+                "                    - Wait up to :timeout milliseconds (default: 0 = no limit) until the \"version\" of\n"
+                "                      \"current\" is another one than :version, then print \"current\". Without a\n"
+                "                      :version it prints \"current\" right away.\n"
                 );
 
     if( !fDebug && !prewards->IsSynced() )
         throw JSONRPCError(RPC_DATABASE_ERROR, "Rewards database is not up to date.");
 
-    TRY_LOCK(cs_rewardsdb, lockRewardsDb);
-
-    if (!lockRewardsDb) {
-        throw JSONRPCError(RPC_DATABASE_ERROR, "Rewards database is busy..Try it again!");
-    }
-
-    if (strCommand == "current")
+    if (strCommand == "waitforchange")
     {
-        UniValue obj(UniValue::VOBJ);
-
-        TRY_LOCK(cs_rewardscache, cacheLocked);
+        uint64_t nKnown;
+        int64_t nTimeout;
+        RPCParseWaitForChange(params, 1, nKnown, nTimeout);
 
-        if(!cacheLocked) throw JSONRPCError(RPC_DATABASE_ERROR, "Rewards database is busy..Try it again!");
-
-        const CSmartRewardRound *current = prewards->GetCurrentRound();
-
-        if( !current->number ) throw JSONRPCError(RPC_DATABASE_ERROR, "No active reward round available yet.");
+        uint64_t nVersion = RPCWaitForChange(prewards->GetRoundsFeed(), nKnown, nTimeout);
+        return CurrentRoundToJSON(prewards->GetRoundsSnapshot(), nVersion);
+    }
 
-        obj.pushKV("rewards_cycle",current->number);
-        obj.pushKV("start_blockheight",current->startBlockHeight);
-        obj.pushKV("start_blocktime",current->startBlockTime);
-        obj.pushKV("end_blockheight",current->endBlockHeight);
-        obj.pushKV("end_blocktime",current->endBlockTime);
-        obj.pushKV("eligible_addresses",current->eligibleEntries - current->disqualifiedEntries);
-        obj.pushKV("eligible_smart",format(current->eligibleSmart - current->disqualifiedSmart));
-        obj.pushKV("disqualified_addresses",current->disqualifiedEntries);
-        obj.pushKV("disqualified_smart",format(current->disqualifiedSmart));
-        obj.pushKV("estimated_rewards",format(current->rewards));
-        obj.pushKV("estimated_percent",current->percent * 100.0);
+    // The rounds are read from the published snapshot, that doesn't need any of the rewards locks.
+    // The version gets read first, a change in between shows up with the next waitforchange again.
+    uint64_t nVersion = prewards->GetRoundsFeed().GetVersion();
+    CSmartRewardsRoundsSnapshotRef rounds = prewards->GetRoundsSnapshot();
 
-        return obj;
-    }
+    if (strCommand == "current")
+        return CurrentRoundToJSON(rounds, nVersion);
 
     if (strCommand == "history")
     {
         UniValue obj(UniValue::VARR);
 
-        TRY_LOCK(cs_rewardscache, cacheLocked);
-
-        if(!cacheLocked) throw JSONRPCError(RPC_DATABASE_ERROR, "Rewards database is busy..Try it again!");
-
-        const CSmartRewardRoundMap* history = prewards->GetRewardRounds();
+        const CSmartRewardRoundMap* history = rounds->history.get();
 
         int64_t nPayoutDelay = Params().GetConsensus().nRewardsPayoutStartDelay;
 
@@ -107,8 +125,8 @@ UniValue smartrewards(const UniValue& params, bool fHelp)
             roundObj.pushKV("start_blocktime",round->second.startBlockTime);
             roundObj.pushKV("end_blockheight",round->second.endBlockHeight);
             roundObj.pushKV("end_blocktime",round->second.endBlockTime);
-            roundObj.pushKV("eligible_addresses",((round->second.eligibleEntries - round->second.disqualifiedEntries)>0) ? (round->second.eligibleEntries - round->second.disqualifiedEntries) : 0);
-            roundObj.pushKV("eligible_smart",format(((round->second.eligibleSmart - round->second.disqualifiedSmart) > 0) ? (round->second.eligibleSmart - round->second.disqualifiedSmart) : 0));
+            roundObj.pushKV("eligible_addresses",round->second.GetEligibleEntries());
+            roundObj.pushKV("eligible_smart",format(round->second.GetEligibleSmart()));
             roundObj.pushKV("disqualified_addresses",round->second.disqualifiedEntries);
             roundObj.pushKV("disqualified_smart",format(round->second.disqualifiedSmart));
             roundObj.pushKV("rewards",format(round->second.rewards));
@@ -141,18 +159,14 @@ UniValue smartrewards(const UniValue& params, bool fHelp)
 
     if(strCommand == "payouts")
     {
-        TRY_LOCK(cs_rewardscache, cacheLocked);
-
-        if(!cacheLocked) throw JSONRPCError(RPC_DATABASE_ERROR, "Rewards database is busy..Try it again!");
-
-        const CSmartRewardRound *current = prewards->GetCurrentRound();
+        const CSmartRewardRound *current = &rounds->current;
 
         if( !current->number ) throw JSONRPCError(RPC_DATABASE_ERROR, "No active reward round available yet.");
 
         int round = 0;
         std::string err = strprintf("Past SmartReward round required: 1 - %d ",current->number - 1 );
 
-        if (params.size() != 2) throw JSONRPCError(RPC_INVALID_PARAMETER, err);
+        if (params.size() != 2 && params.size() != 4 && params.size() != 5) throw JSONRPCError(RPC_INVALID_PARAMETER, err);
 
         try {
              int n = std::stoi(params[1].get_str());
@@ -168,32 +182,60 @@ UniValue smartrewards(const UniValue& params, bool fHelp)
 
         if(round < 1 || round >= current->number) throw JSONRPCError(RPC_INVALID_PARAMETER, err);
 
-        CSmartRewardResultEntryList payouts;
+        auto it = rounds->history->find(round);
+        if (it == rounds->history->end()) throw JSONRPCError(RPC_INVALID_PARAMETER, err);
 
-        if( !prewards->GetRewardPayouts(round,payouts) )
-            throw JSONRPCError(RPC_DATABASE_ERROR, "Couldn't fetch the list from the database.");
+        size_t nOffset = 0;
+        size_t nLimit = std::numeric_limits<size_t>::max();
 
-        UniValue obj(UniValue::VARR);
+        if (params.size() >= 4) {
+            int64_t n;
+            if (!ParseInt64(params[2].get_str(), &n) || n < 0) throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid offset");
+            nOffset = n;
+            if (!ParseInt64(params[3].get_str(), &n) || n < 1) throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid limit");
+            nLimit = n;
+        }
 
-        BOOST_FOREACH(CSmartRewardResultEntry payout, payouts) {
+        bool fCSV = false;
 
-            UniValue addrObj(UniValue::VOBJ);
-            addrObj.pushKV("address", payout.entry.id.ToString());
-            addrObj.pushKV("reward", format(payout.reward));
+        if (params.size() == 5) {
+            if (params[4].get_str() != "json" && params[4].get_str() != "csv") throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid format, json or csv expected");
+            fCSV = params[4].get_str() == "csv";
+        }
 
-            obj.push_back(addrObj);
+        // Written out while the payouts are read, all of a round don't fit into memory as UniValue
+        CRPCResultStream obj;
+        size_t nPayouts;
+
+        if (fCSV) {
+            obj.BeginString();
+            obj.Append("address,reward\n");
+        } else {
+            obj.BeginArray();
         }
 
-        return obj;
+        bool fRead = prewards->ForEachRewardPayout(it->second, nOffset, nLimit, [&](const CSmartAddress& address, CAmount nReward) {
+            if (fCSV) {
+                obj.Append(address.ToString() + "," + UniValue(format(nReward)).write() + "\n");
+                return;
+            }
+
+            UniValue addrObj(UniValue::VOBJ);
+            addrObj.pushKV("address", address.ToString());
+            addrObj.pushKV("reward", format(nReward));
+
+            obj.Push(addrObj);
+        }, nPayouts);
+
+        if( !fRead )
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Rewards database is busy..Try it again!");
+
+        return obj.Finish();
     }
 
     if(strCommand == "snapshot")
     {
-        TRY_LOCK(cs_rewardscache, cacheLocked);
-
-        if(!cacheLocked) throw JSONRPCError(RPC_DATABASE_ERROR, "Rewards database is busy..Try it again!");
-
-        const CSmartRewardRound *current = prewards->GetCurrentRound();
+        const CSmartRewardRound *current = &rounds->current;
 
         if( !current->number ) throw JSONRPCError(RPC_DATABASE_ERROR, "No active reward round available yet.");
 
@@ -216,18 +258,21 @@ UniValue smartrewards(const UniValue& params, bool fHelp)
 
         if(round < 1 || round >= current->number) throw JSONRPCError(RPC_INVALID_PARAMETER, err);
 
-        CSmartRewardResultEntryList results;
+        auto it = rounds->history->find(round);
+        if (it == rounds->history->end()) throw JSONRPCError(RPC_INVALID_PARAMETER, err);
+
+        CSmartRewardsRoundFile file;
 
-        if( !prewards->GetRewardRoundResults(round, results) )
-            throw JSONRPCError(RPC_DATABASE_ERROR, "Couldn't fetch the list from the database.");
+        if( !prewards->GetRoundFile(it->second, file) )
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Rewards database is busy..Try it again!");
 
         UniValue obj(UniValue::VARR);
 
-        BOOST_FOREACH(CSmartRewardResultEntry s, results) {
+        for (size_t i = 0; i < file.size(); ++i) {
 
             UniValue addrObj(UniValue::VOBJ);
-            addrObj.pushKV("address", s.entry.id.ToString());
-            addrObj.pushKV("balance", format(s.entry.balance));
+            addrObj.pushKV("address", file.GetAddress(i).ToString());
+            addrObj.pushKV("balance", format(file.GetBalance(i)));
 
             obj.push_back(addrObj);
         }
@@ -239,11 +284,16 @@ UniValue smartrewards(const UniValue& params, bool fHelp)
     {
         if (params.size() != 2) throw JSONRPCError(RPC_INVALID_PARAMETER, "SmartCash address required.");
 
+        // The entries are read through the cache.
+        TRY_LOCK(cs_rewardsdb, lockRewardsDb);
+
+        if(!lockRewardsDb) throw JSONRPCError(RPC_DATABASE_ERROR, "Rewards database is busy..Try it again!");
+
         TRY_LOCK(cs_rewardscache, cacheLocked);
 
         if(!cacheLocked) throw JSONRPCError(RPC_DATABASE_ERROR, "Rewards database is busy..Try it again!");
 
-        const CSmartRewardRound *current = prewards->GetCurrentRound();
+        const CSmartRewardRound *current = &rounds->current;
 
         int nFirst_1_3_Round = Params().GetConsensus().nRewardsFirst_1_3_Round;
 
@@ -252,18 +302,18 @@ UniValue smartrewards(const UniValue& params, bool fHelp)
 
         if( !id.IsValid() ) throw JSONRPCError(RPC_DATABASE_ERROR, strprintf("Invalid SmartCash address provided: %s",addressString));
 
-        CSmartRewardEntry *entry = nullptr;
+        CSmartRewardEntry entry;
 
-        if( !prewards->GetRewardEntry(id, entry, false) ) throw JSONRPCError(RPC_DATABASE_ERROR, "Couldn't find this SmartCash address in the database.");
+        if( !prewards->GetRewardEntry(id, entry) ) throw JSONRPCError(RPC_DATABASE_ERROR, "Couldn't find this SmartCash address in the database.");
 
         UniValue obj(UniValue::VOBJ);
 
         obj.pushKV("address", id.ToString());
-        obj.pushKV("balance", format(entry->balance));
-        obj.pushKV("balance_eligible", format(entry->balanceEligible));
-        obj.pushKV("is_smartnode", !entry->smartnodePaymentTx.IsNull());
-        obj.pushKV("activated", entry->fActivated);
-        obj.pushKV("eligible", current->number < nFirst_1_3_Round ? entry->balanceEligible > 0 : entry->IsEligible());
+        obj.pushKV("balance", format(entry.balance));
+        obj.pushKV("balance_eligible", format(entry.balanceEligible));
+        obj.pushKV("is_smartnode", !entry.smartnodePaymentTx.IsNull());
+        obj.pushKV("activated", entry.fActivated);
+        obj.pushKV("eligible", current->number < nFirst_1_3_Round ? entry.balanceEligible > 0 : entry.IsEligible());
 
         return obj;
     }
@@ -277,11 +327,14 @@ UniValue termrewards(const UniValue& params, bool fHelp)
         return a / COIN + ( double(a % COIN) / COIN );
     };
 
-    if (fHelp) {
+    if (fHelp || params.size() > 1) {
         throw std::runtime_error(
-            "termrewardds\n"
+            "termrewardds ( \"address\" )\n"
             "Display addresses currently eligible to TermRewards\n"
 
+            "\nArguments:\n"
+            "1. \"address\"    (string, optional) Only display the TermRewards of this address\n"
+
             "\nResult (if verbose > 0):\n"
             "[\n"
             " {\n"
@@ -314,6 +367,28 @@ UniValue termrewards(const UniValue& params, bool fHelp)
 
     if(!cacheLocked) throw JSONRPCError(RPC_DATABASE_ERROR, "Rewards database is busy..Try it again!");
 
+    if (params.size() == 1) {
+        CSmartAddress id = CSmartAddress::Legacy(params[0].get_str());
+
+        if (!id.IsValid()) throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Invalid SmartCash address provided: %s", params[0].get_str()));
+
+        CTermRewardEntryList entries;
+        if (!prewards->GetTermRewardEntries(id, entries)) throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to get TermRewards entries");
+
+        for (const auto &entry : entries) {
+            UniValue obj(UniValue::VOBJ);
+            obj.pushKV("address", entry.GetAddress());
+            obj.pushKV("tx_hash", entry.txHash.GetHex());
+            obj.pushKV("balance", format(entry.balance));
+            obj.pushKV("level", entry.GetLevel());
+            obj.pushKV("percent", entry.percent);
+            obj.pushKV("expires", entry.expires);
+            arr.push_back(obj);
+        }
+
+        return arr;
+    }
+
     CTermRewardEntryMap entries;
     if (!prewards->GetTermRewardsEntries(entries)) throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to get TermRewards entries");
 
@@ -330,3 +405,46 @@ UniValue termrewards(const UniValue& params, bool fHelp)
 
     return arr;
 }
+
+UniValue getrewardsstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1) {
+        throw std::runtime_error(
+            "getrewardsstats ( reset )\n"
+            "Display the time the SmartRewards processing spent in the blocks connected since the start\n"
+
+            "\nArguments:\n"
+            "1. reset    (boolean, optional, default=false) Clear the statistics after they got returned\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\" : { ... },           (object) Time of the whole rewards processing per block\n"
+            "  \"phases\" : {                  (object) Time per call of prefetch, process_transaction,\n"
+            "                                  process_input, process_output, commit_block and sync_cached\n"
+            "    \"phase\" : {\n"
+            "      \"count\" : n,             (numeric) Number of samples\n"
+            "      \"total_us\" : n,          (numeric) Sum of all samples in microseconds\n"
+            "      \"avg_us\" : n.nnn,        (numeric) Average of the samples in microseconds\n"
+            "      \"max_us\" : n,            (numeric) Slowest sample in microseconds\n"
+            "      \"histogram\" : [          (array) Non-empty power of two buckets\n"
+            "        { \"below_us\" : n, \"count\" : n }\n"
+            "      ]\n"
+            "    }\n"
+            "  },\n"
+            "  \"slowest_blocks\" : [ ... ],   (array) Blocks with the slowest processing and their phases\n"
+            "  \"rounds\" : [ ... ]            (array) Processing time of the most recent rounds\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrewardsstats", "")
+            + HelpExampleRpc("getrewardsstats", "true")
+            );
+    }
+
+    UniValue result = prewards->GetStats().ToJSON();
+
+    if (params.size() > 0 && params[0].get_bool()) {
+        prewards->GetStats().Clear();
+    }
+
+    return result;
+}
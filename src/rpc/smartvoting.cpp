@@ -398,34 +398,29 @@ UniValue smartvoting(const UniValue& params, bool fHelp)
 
         // GET MATCHING GOVERNANCE OBJECTS
 
-        LOCK2(cs_main, smartVoting.cs);
-
-        std::vector<const CProposal*> objs = smartVoting.GetAllNewerThan(0);
+        proposal_summaries_t pSummaries = smartVoting.GetProposalSummaries();
 
         // CREATE RESULTS FOR USER
 
-        for (const auto& pProposal : objs)
+        for (const CProposalSummary& summary : *pSummaries)
         {
-            //if(strType == "active" && !pProposal->IsOpenToVote()) continue;
-
             UniValue bObj(UniValue::VOBJ);
-            bObj.pushKV("Hash",  pProposal->GetHash().ToString());
-            bObj.pushKV("FeeHash",  pProposal->GetFeeHash().ToString());
-            bObj.pushKV("Title",  pProposal->GetTitle());
-            bObj.pushKV("Url",  pProposal->GetUrl());
-            bObj.pushKV("CreationTime", pProposal->GetCreationTime());
-            bObj.pushKV("CreationHeight", pProposal->GetVotingStartHeight());
-            const CSmartAddress& proposalAddress = pProposal->GetAddress();
-            if(proposalAddress.IsValid()) {
-                bObj.pushKV("ProposalAddress", proposalAddress.ToString());
+            bObj.pushKV("Hash",  summary.nHash.ToString());
+            bObj.pushKV("FeeHash",  summary.nFeeHash.ToString());
+            bObj.pushKV("Title",  summary.strTitle);
+            bObj.pushKV("Url",  summary.strUrl);
+            bObj.pushKV("CreationTime", summary.nCreationTime);
+            bObj.pushKV("CreationHeight", summary.nCreationHeight);
+            if(summary.address.IsValid()) {
+                bObj.pushKV("ProposalAddress", summary.address.ToString());
             }else{
                 bObj.pushKV("ProposalAddress", "Invalid");
             }
-            bObj.pushKV("ValidityEndHeight", pProposal->GetValidVoteEndHeight());
-            bObj.pushKV("FundingEndHeight", pProposal->GetFundingVoteEndHeight());
+            bObj.pushKV("ValidityEndHeight", summary.nValidityEndHeight);
+            bObj.pushKV("FundingEndHeight", summary.nFundingEndHeight);
 
             // REPORT STATUS FOR FUNDING VOTES SPECIFICALLY
-            CVoteResult fundingResult = pProposal->GetVotingResult(VOTE_SIGNAL_FUNDING);
+            const CVoteResult& fundingResult = summary.fundingResult;
             bObj.pushKV("YesPower", fundingResult.nYesPower);
             bObj.pushKV("NoPower", fundingResult.nNoPower);
             bObj.pushKV("AbstainPower", fundingResult.nAbstainPower);
@@ -434,13 +429,12 @@ UniValue smartvoting(const UniValue& params, bool fHelp)
             bObj.pushKV("AbstainPercent", fundingResult.percentAbstain);
 
             // REPORT VALIDITY AND CACHING FLAGS FOR VARIOUS SETTINGS
-            std::string strError = "";
-            bObj.pushKV("fBlockchainValidity",  pProposal->IsValidLocally(strError, false));
-            bObj.pushKV("IsValidReason",  strError.c_str());
-            bObj.pushKV("fCachedValid",  pProposal->IsSetCachedValid());
-            bObj.pushKV("fCachedFunding",  pProposal->IsSetCachedFunding());
+            bObj.pushKV("fBlockchainValidity",  summary.fBlockchainValidity);
+            bObj.pushKV("IsValidReason",  summary.strValidityError);
+            bObj.pushKV("fCachedValid",  summary.fCachedValid);
+            bObj.pushKV("fCachedFunding",  summary.fCachedFunding);
 
-            objResult.pushKV(pProposal->GetHash().ToString(), bObj);
+            objResult.pushKV(summary.nHash.ToString(), bObj);
         }
 
         return objResult;
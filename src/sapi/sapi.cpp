@@ -14,6 +14,7 @@
 #include "sapi/sapi_validation.h"
 #include "streams.h"
 #include "sync.h"
+#include "trace.h"
 #include "rpc/client.h"
 #include "txmempool.h"
 #include "utilstrencodings.h"
@@ -27,6 +28,7 @@
 #include "sapi/sapi_address.h"
 #include "sapi/sapi_blockchain.h"
 #include "sapi/sapi_common.h"
+#include "sapi/sapi_metrics.h"
 #include "sapi/sapi_transaction.h"
 #include "sapi/sapi_smartnodes.h"
 #include "sapi/sapi_smartrewards.h"
@@ -39,6 +41,7 @@
 #include "sync.h"
 #include "ui_interface.h"
 
+#include <cmath>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -53,6 +56,7 @@
 #include <event2/buffer.h>
 #include <event2/util.h>
 #include <event2/keyvalq_struct.h>
+#include <event2/listener.h>
 
 #ifdef EVENT__HAVE_NETINET_IN_H
 #include <netinet/in.h>
@@ -78,16 +82,16 @@ static int64_t nStartTime;
 /** Maximum size of http request (request line + headers) */
 static const size_t MAX_HEADERS_SIZE = 8192;
 
-//! libevent event loop
-static struct event_base* eventBaseSAPI = 0;
-//! SAPI server
-struct evhttp* eventSAPI = 0;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure>* workQueue = 0;
+//! libevent event loops, one per -sapieventthreads
+static std::vector<struct event_base*> eventBasesSAPI;
+//! SAPI servers, one for each event loop
+static std::vector<struct evhttp*> eventsSAPI;
+//! Work queue for handling longer requests off the event loop threads on the task pool, one lane per endpoint cost class
+static CSAPIWorkQueue* workQueue = 0;
 //! Handlers for (sub)paths
 static std::vector<HTTPPathHandler> pathHandlersSAPI;
-//! Bound listening sockets
-static std::vector<evhttp_bound_socket *> boundSocketsSAPI;
+//! Bound listening sockets and the server they belong to
+static std::vector<std::pair<struct evhttp*, evhttp_bound_socket *>> boundSocketsSAPI;
 
 // Endpoint groups available for the SAPI
 static std::vector<SAPI::EndpointGroup*> endpointGroups;
@@ -98,7 +102,39 @@ CSAPIStatistics sapiStatistics;
 
 using namespace std;
 
-static bool SAPIExecuteEndpoint(HTTPRequest *req, const std::map<std::string, std::string> &mapPathParams, const SAPI::Endpoint *endpoint);
+static bool SAPIExecuteEndpoint(HTTPRequest *req, const std::map<std::string, std::string> &mapPathParams, const SAPI::Endpoint *endpoint, int64_t nTimeQueued);
+static bool SAPIValidateBodyParameter(HTTPRequest *req, const SAPI::Endpoint *endpoint, const UniValue &bodyParameter);
+static bool sapi_batch(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+
+static SAPI::EndpointGroup batchEndpoints = {
+    "batch",
+    {
+        {
+            "", HTTPRequest::POST, UniValue::VARR, sapi_batch,
+            {
+                // Validated by sapi_batch
+            },
+            SAPI::CostExpensive
+        }
+    }
+};
+
+/** Reply of a sub-request of /batch, the SAPI writers fill it instead of sending the reply. */
+struct CSAPIReplyCapture{
+    int nStatus;
+    std::string strJSON;
+    CSAPIReplyCapture() : nStatus(0) {}
+};
+
+static CCriticalSection cs_captures;
+static std::map<const HTTPRequest*, CSAPIReplyCapture*> mapCaptures;
+
+static CSAPIReplyCapture *GetReplyCapture(const HTTPRequest *req)
+{
+    LOCK(cs_captures);
+    auto it = mapCaptures.find(req);
+    return it != mapCaptures.end() ? it->second : nullptr;
+}
 
 static void SplitPath(const std::string& str, std::vector<std::string>& parts,
               const std::string& delim = "/")
@@ -106,6 +142,132 @@ static void SplitPath(const std::string& str, std::vector<std::string>& parts,
     boost::split(parts, str, boost::is_any_of(delim));
 }
 
+typedef std::pair<const SAPI::Endpoint*, std::map<std::string, std::string>> SAPIEndpointMatch;
+
+/** Trie of the path components of all endpoints, built once in StartSAPI.
+ *
+ * The first level holds the group prefixes. Literal components are children of a node,
+ * all {param} components at the same position share one wildcard child. An endpoint is
+ * stored at the node of its last component together with its parameter names, so a
+ * request walks its path once and only needs to build the parameter map of a match.
+ */
+class CSAPIRouter
+{
+    struct Route {
+        const SAPI::Endpoint *endpoint;
+        std::vector<std::string> vecParamKeys;
+    };
+
+    struct Node {
+        std::map<std::string, std::unique_ptr<Node>> children;
+        std::unique_ptr<Node> param;
+        std::vector<Route> routes;
+    };
+
+    Node root;
+
+    void Walk(const Node *node, const std::vector<std::string> &parts, size_t nPos,
+              std::vector<size_t> &vecParamPos, std::vector<SAPIEndpointMatch> &matches) const
+    {
+        // Match /v1/<group>/<endpoint> and /v1/<group>/<endpoint>/
+        if( nPos == parts.size() || ( nPos + 1 == parts.size() && parts.back() == "" ) ){
+
+            for( const Route &route : node->routes ){
+
+                std::map<std::string, std::string> mapPathParams;
+
+                for( size_t i = 0; i < route.vecParamKeys.size(); i++ )
+                    mapPathParams.insert(std::make_pair(route.vecParamKeys[i], parts[vecParamPos[i]]));
+
+                matches.push_back(std::make_pair(route.endpoint, std::move(mapPathParams)));
+            }
+        }
+
+        if( nPos == parts.size() )
+            return;
+
+        auto child = node->children.find(parts[nPos]);
+
+        if( child != node->children.end() )
+            Walk(child->second.get(), parts, nPos + 1, vecParamPos, matches);
+
+        if( node->param ){
+            vecParamPos.push_back(nPos);
+            Walk(node->param.get(), parts, nPos + 1, vecParamPos, matches);
+            vecParamPos.pop_back();
+        }
+    }
+
+public:
+    void Clear()
+    {
+        root.children.clear();
+        root.param.reset();
+        root.routes.clear();
+    }
+
+    void Add(const std::string &prefix, const SAPI::Endpoint &endpoint)
+    {
+        std::unique_ptr<Node> &group = root.children[prefix];
+
+        if( !group )
+            group.reset(new Node());
+
+        Node *node = group.get();
+        Route route{&endpoint, {}};
+        std::vector<std::string> partsEndpoint;
+
+        SplitPath(endpoint.path, partsEndpoint);
+
+        // The root endpoint of a group /v1/<group> lives at the group node itself.
+        if( partsEndpoint.size() == 1 && partsEndpoint.back() == "" )
+            partsEndpoint.clear();
+
+        for( const std::string &part : partsEndpoint ){
+
+            // Check if a parameter is expected for this path component
+            bool fParam = part.size() > 1 && part.front() == '{' && part.back() == '}';
+            std::unique_ptr<Node> &next = fParam ? node->param : node->children[part];
+
+            // Filter the param key of the path part
+            if( fParam )
+                route.vecParamKeys.push_back(std::string(part.begin() + 1, part.end() - 1));
+
+            if( !next )
+                next.reset(new Node());
+
+            node = next.get();
+        }
+
+        node->routes.push_back(route);
+    }
+
+    /** Collect all endpoints matching the path components, the group prefix being the first one. */
+    void Match(const std::vector<std::string> &parts, std::vector<SAPIEndpointMatch> &matches) const
+    {
+        matches.clear();
+
+        if( parts.empty() )
+            return;
+
+        auto group = root.children.find(parts.front());
+
+        if( group == root.children.end() )
+            return;
+
+        std::vector<size_t> vecParamPos;
+        Walk(group->second.get(), parts, 1, vecParamPos, matches);
+
+        // The endpoints of a group are stored contiguously, sorting by address
+        // keeps the first declared endpoint first if several of them match.
+        std::sort(matches.begin(), matches.end(), [](const SAPIEndpointMatch &a, const SAPIEndpointMatch &b) -> bool {
+            return a.first < b.first;
+        });
+    }
+};
+
+static CSAPIRouter sapiRouter;
+
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
 {
@@ -125,9 +287,47 @@ UniValue UniValueFromAmount(int64_t nAmount)
             strprintf("%s%d.%08d", sign ? "-" : "", quotient, remainder));
 }
 
+/** Requests served by the open SAPI connections, the close callback of a connection removes it. */
+static CCriticalSection cs_connections;
+static std::map<const struct evhttp_connection*, int64_t> mapConnectionRequests;
+//! Requests a connection may serve before it gets closed, 0 for no limit
+static int64_t nMaxConnectionRequests = DEFAULT_SAPI_KEEPALIVE_REQUESTS;
+
+static void sapi_connection_close_cb(struct evhttp_connection* evcon, void*)
+{
+    LOCK(cs_connections);
+    auto it = mapConnectionRequests.find(evcon);
+    if (it != mapConnectionRequests.end()) {
+        LogPrint("sapi", "Connection closed after %d requests\n", it->second);
+        mapConnectionRequests.erase(it);
+    }
+}
+
+/** Count a request on its connection, returns the number of requests served by it so far. */
+static int64_t SAPIConnectionRequest(struct evhttp_request* req)
+{
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+
+    if (!evcon)
+        return 1;
+
+    LOCK(cs_connections);
+
+    auto it = mapConnectionRequests.find(evcon);
+
+    if (it == mapConnectionRequests.end()) {
+        evhttp_connection_set_closecb(evcon, sapi_connection_close_cb, NULL);
+        mapConnectionRequests.emplace(evcon, 1);
+        return 1;
+    }
+
+    return ++it->second;
+}
+
 /** SAPI request callback */
 static void sapi_request_cb(struct evhttp_request* req, void* arg)
 {
+    int64_t nConnectionRequests = SAPIConnectionRequest(req);
     std::unique_ptr<HTTPRequest> hreq(new HTTPRequest(req));
     HTTPRequest::RequestMethod method = hreq->GetRequestMethod();
     LogPrint("sapi", "Received a %s request for %s from %s\n",
@@ -138,6 +338,17 @@ static void sapi_request_cb(struct evhttp_request* req, void* arg)
 
     CService peer = hreq->GetPeer();
 
+    sapiStatistics.connection(peer, nConnectionRequests > 1);
+
+    // evhttp keeps HTTP/1.1 connections (and HTTP/1.0 ones which ask for it) open after the
+    // reply. It reads the next request of a connection only after the reply to the previous
+    // one was sent, so pipelined requests get answered in order even though they run in the
+    // worker threads. Idle connections get closed after -sapiservertimeout seconds.
+    if (nMaxConnectionRequests > 0 && nConnectionRequests >= nMaxConnectionRequests)
+        hreq->WriteHeader("Connection", "close");
+    else
+        hreq->WriteHeader("Keep-Alive", strprintf("timeout=%d", GetArg("-sapiservertimeout", DEFAULT_SAPI_SERVER_TIMEOUT)));
+
     // Early address-based allow check
     if (!ClientAllowed(peer)) {
         sapiStatistics.request(peer, CSAPIStatistics::Blocked);
@@ -149,7 +360,7 @@ static void sapi_request_cb(struct evhttp_request* req, void* arg)
 
     if( !fWhitelisted ){
 
-        SAPI::Limits::Client * client = SAPI::Limits::GetClient(peer);
+        std::shared_ptr<SAPI::Limits::Client> client = SAPI::Limits::GetClient(peer);
 
         client->Request();
 
@@ -182,6 +393,10 @@ static void sapi_request_cb(struct evhttp_request* req, void* arg)
     // Get the requested path
     std::string strURI = hreq->GetURI();
 
+    // Prometheus scrapes /metrics by default, it is the same as /v1/metrics
+    if( strURI == "/metrics" )
+        strURI = SAPI::versionSubPath + strURI;
+
     // For now we only have v1, so just check if its provided..
     if( strURI.substr(0,SAPI::versionSubPath.size()) != SAPI::versionSubPath ){
         sapiStatistics.request(peer, CSAPIStatistics::Invalid);
@@ -199,77 +414,19 @@ static void sapi_request_cb(struct evhttp_request* req, void* arg)
     }
 
     std::vector<std::string> partsURI;
-    std::map<SAPI::Endpoint*, std::map<std::string, std::string>> mapPathMatch;
+    std::vector<SAPIEndpointMatch> vecPathMatch;
 
     SplitPath(strURI.substr(1), partsURI);
 
-    std::string pathGroup = partsURI.front();
-
-    // Get a subvector without the path group
-    partsURI = std::vector<std::string>( partsURI.begin() + 1, partsURI.end() );
-
-    for( auto group : endpointGroups ){
-
-        if( group->prefix != pathGroup )
-            continue;
-
-        for( SAPI::Endpoint &endpoint : group->endpoints ){
-
-            std::vector<std::string> partsEndpoint;
-            SplitPath(endpoint.path, partsEndpoint);
-
-            if( partsEndpoint.size() == 1 && partsEndpoint.back() == "" ){
-                // If the endpoint is the root one for the group /v1/<group>
-
-                // Match /v1/<group>/<endpoint> and /v1/<group>/<endpoint>/
-                if( !partsURI.size() || ( partsURI.size() == 1 && partsURI.back() == "" ) )
-                    mapPathMatch.insert(std::make_pair(&endpoint, std::map<std::string, std::string>()));
-
-            // Match /v1/<group>/<endpoint> and /v1/<group>/<endpoint>/
-            // For any other possible matching endpoints /v1/<group>/../..
-            }else if( ( partsURI.size() == partsEndpoint.size() + 1 && partsURI.back() == "" ) ||
-                        partsURI.size() == partsEndpoint.size() ){
-
-                bool fMatch = true;
-                std::map<std::string, std::string> mapPathParams;
-
-                for( size_t i = 0; i < partsURI.size(); i++ ){
-
-                    bool fParam = false;
-                    std::string partStr = i < partsEndpoint.size() ? partsEndpoint.at(i) : "";
-                    std::string &uriPartStr = partsURI.at(i);
-
-                    // Check if a parameter is expected for this path component
-                    if( partStr.front() == '{' && partStr.back() == '}' )
-                        fParam = true;
-
-                    if( uriPartStr != partStr && !fParam ){
-                        fMatch = false;
-                        break;
-                    }else if( fParam ){
-
-                        // Filter the param key of the path part
-                        partStr = std::string(partStr.begin() + 1, partStr.end() - 1 );
+    sapiRouter.Match(partsURI, vecPathMatch);
 
-                        // Add the potential path parameter
-                        mapPathParams.insert(std::make_pair(partStr, uriPartStr));
-                    }
-                }
-
-                if( fMatch )
-                    mapPathMatch.insert(std::make_pair(&endpoint, mapPathParams));
-
-            }
-        }
-    }
-
-    if( mapPathMatch.size() && hreq->GetRequestMethod() == HTTPRequest::OPTIONS){
+    if( vecPathMatch.size() && hreq->GetRequestMethod() == HTTPRequest::OPTIONS){
 
         sapiStatistics.request(peer, CSAPIStatistics::Valid);
 
         std::string strMethods = RequestMethodString(HTTPRequest::OPTIONS);
 
-        for( auto match : mapPathMatch ){
+        for( const SAPIEndpointMatch &match : vecPathMatch ){
             strMethods += ", " + RequestMethodString(match.first->method);
         }
 
@@ -281,14 +438,13 @@ static void sapi_request_cb(struct evhttp_request* req, void* arg)
         return;
     }
 
-    auto fullMatch = std::find_if(mapPathMatch.begin(), mapPathMatch.end(),
-                                  [method](const std::pair<const SAPI::Endpoint *,
-                                  std::map<std::string, std::string>> &entry) -> bool{
+    auto fullMatch = std::find_if(vecPathMatch.begin(), vecPathMatch.end(),
+                                  [method](const SAPIEndpointMatch &entry) -> bool{
         return method == entry.first->method;
     });
 
     // Dispatch to worker thread
-    if (fullMatch != mapPathMatch.end()) {
+    if (fullMatch != vecPathMatch.end()) {
 
         sapiStatistics.request(peer, CSAPIStatistics::Valid);
 
@@ -297,16 +453,13 @@ static void sapi_request_cb(struct evhttp_request* req, void* arg)
         if (workQueue->Enqueue(item.get()))
             item.release(); /* if true, queue took ownership */
         else {
-            LogPrintf("WARNING: request rejected because sapi work queue depth exceeded, it can be increased with the -sapiworkqueue= setting\n");
+            LogPrintf("WARNING: request rejected because sapi work queue depth of lane %d exceeded, it can be increased with the -sapiworkqueue= setting\n", fullMatch->first->cost);
             item->req->WriteReply(HTTPStatus::INTERNAL_SERVER_ERROR, "Work queue depth exceeded");
         }
     } else {
         sapiStatistics.request(peer, CSAPIStatistics::Invalid);
         SAPI::Error(hreq.get(), HTTPStatus::NOT_FOUND, "Invalid endpoint: " + strURI + " with method: " + RequestMethodString(hreq->GetRequestMethod()) + " See: IP:8080/v1/client/help");
     }
-
-    // Clean up rate limits
-    SAPI::Limits::CheckAndRemove();
 }
 
 /** Callback to reject SAPI requests after shutdown. */
@@ -326,11 +479,45 @@ static void ThreadSAPI(struct event_base* base, struct evhttp* http)
     LogPrint("sapi", "Exited sapi event loop\n");
 }
 
+#ifdef LEV_OPT_REUSEABLE_PORT
+/** Bind a listener with SO_REUSEPORT, the kernel spreads the connections over all servers bound this way */
+static evhttp_bound_socket *SAPIBindReusePort(struct event_base* base, struct evhttp* http, const std::string &address, uint16_t port)
+{
+    struct sockaddr_storage sockaddr;
+    int len = sizeof(sockaddr);
+    std::string strAddress = address.find(':') != std::string::npos ? strprintf("[%s]:%d", address, port) : strprintf("%s:%d", address, port);
+
+    if (evutil_parse_sockaddr_port(strAddress.c_str(), (struct sockaddr*)&sockaddr, &len) != 0)
+        return NULL;
+
+    unsigned int flags = LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC | LEV_OPT_REUSEABLE | LEV_OPT_REUSEABLE_PORT;
+
+#ifdef LEV_OPT_BIND_IPV6ONLY
+    // Keep the IPv4 wildcard listeners of the other servers apart from the IPv6 ones.
+    if (sockaddr.ss_family == AF_INET6)
+        flags |= LEV_OPT_BIND_IPV6ONLY;
+#endif
+
+    struct evconnlistener *listener = evconnlistener_new_bind(base, NULL, NULL, flags, -1, (struct sockaddr*)&sockaddr, len);
+
+    if (!listener)
+        return NULL;
+
+    evhttp_bound_socket *bind_handle = evhttp_bind_listener(http, listener);
+
+    if (!bind_handle)
+        evconnlistener_free(listener);
+
+    return bind_handle;
+}
+#endif
+
 /** Bind SAPI server to specified addresses */
-static bool SAPIBindAddresses(struct evhttp* http)
+static bool SAPIBindAddresses(struct event_base* base, struct evhttp* http, bool fReusePort)
 {
     uint16_t defaultPort = GetArg("-sapiport", DEFAULT_SAPI_SERVER_PORT);
     std::vector<std::pair<std::string, uint16_t> > endpoints;
+    size_t nBound = boundSocketsSAPI.size();
 
     endpoints.push_back(std::make_pair("0.0.0.0", defaultPort));
     endpoints.push_back(std::make_pair("::", defaultPort));
@@ -338,22 +525,21 @@ static bool SAPIBindAddresses(struct evhttp* http)
     // Bind addresses
     for (std::vector<std::pair<std::string, uint16_t> >::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
         LogPrint("sapi", "Binding SAPI on address %s port %i\n", i->first, i->second);
-        evhttp_bound_socket *bind_handle = evhttp_bind_socket_with_handle(http, i->first.empty() ? NULL : i->first.c_str(), i->second);
+        evhttp_bound_socket *bind_handle = NULL;
+#ifdef LEV_OPT_REUSEABLE_PORT
+        if (fReusePort)
+            bind_handle = SAPIBindReusePort(base, http, i->first, i->second);
+        else
+#endif
+            bind_handle = evhttp_bind_socket_with_handle(http, i->first.empty() ? NULL : i->first.c_str(), i->second);
         if (bind_handle) {
-            boundSocketsSAPI.push_back(bind_handle);
+            boundSocketsSAPI.push_back(std::make_pair(http, bind_handle));
         } else {
             LogPrintf("Binding SAPI on address %s port %i failed.\n", i->first, i->second);
         }
     }
 
-    return !boundSocketsSAPI.empty();
-}
-
-/** Simple wrapper to set thread name and run work queue */
-static void SAPIWorkQueueRun(WorkQueue<HTTPClosure>* queue)
-{
-    RenameThread("smartcash-sapiworker");
-    queue->Run();
+    return boundSocketsSAPI.size() > nBound;
 }
 
 /** libevent event log callback */
@@ -405,69 +591,97 @@ bool InitSAPIServer()
     evthread_use_pthreads();
 #endif
 
-    base = event_base_new(); // XXX RAII
-    if (!base) {
-        LogPrintf("Couldn't create an event_base: exiting\n");
-        return false;
-    }
+    nMaxConnectionRequests = std::max<int64_t>(GetArg("-sapikeepalive", DEFAULT_SAPI_KEEPALIVE_REQUESTS), 0);
 
-    /* Create a new evhttp object to handle requests. */
-    sapi = evhttp_new(base); // XXX RAII
-    if (!sapi) {
-        LogPrintf("couldn't create evhttp for SAPI. Exiting.\n");
-        event_base_free(base);
-        return false;
+    int nEventThreads = std::max((long)GetArg("-sapieventthreads", DEFAULT_SAPI_EVENT_THREADS), 1L);
+#ifndef LEV_OPT_REUSEABLE_PORT
+    if (nEventThreads > 1) {
+        LogPrintf("SAPI: SO_REUSEPORT listeners require libevent 2.1, using one event thread\n");
+        nEventThreads = 1;
     }
+#endif
 
-    evhttp_set_timeout(sapi, GetArg("-sapiservertimeout", DEFAULT_SAPI_SERVER_TIMEOUT));
-    evhttp_set_max_headers_size(sapi, MAX_HEADERS_SIZE);
-    evhttp_set_max_body_size(sapi, MAX_SIZE);
-    evhttp_set_gencb(sapi, sapi_request_cb, NULL);
-    evhttp_set_allowed_methods(sapi, EVHTTP_REQ_GET |
-                                       EVHTTP_REQ_POST |
-                                       EVHTTP_REQ_OPTIONS);
+    for (int i = 0; i < nEventThreads; i++) {
 
-    if (!SAPIBindAddresses(sapi)) {
-        LogPrintf("Unable to bind any endpoint for SAPI server\n");
-        evhttp_free(sapi);
-        event_base_free(base);
+        base = event_base_new(); // XXX RAII
+        if (!base) {
+            LogPrintf("Couldn't create an event_base: exiting\n");
+            break;
+        }
+
+        /* Create a new evhttp object to handle requests. */
+        sapi = evhttp_new(base); // XXX RAII
+        if (!sapi) {
+            LogPrintf("couldn't create evhttp for SAPI. Exiting.\n");
+            event_base_free(base);
+            break;
+        }
+
+        // Applies to reading a request as well as to idle keep-alive connections.
+        evhttp_set_timeout(sapi, GetArg("-sapiservertimeout", DEFAULT_SAPI_SERVER_TIMEOUT));
+        evhttp_set_max_headers_size(sapi, MAX_HEADERS_SIZE);
+        evhttp_set_max_body_size(sapi, MAX_SIZE);
+        evhttp_set_gencb(sapi, sapi_request_cb, NULL);
+        evhttp_set_allowed_methods(sapi, EVHTTP_REQ_GET |
+                                           EVHTTP_REQ_POST |
+                                           EVHTTP_REQ_OPTIONS);
+
+        if (!SAPIBindAddresses(base, sapi, nEventThreads > 1)) {
+            LogPrintf("Unable to bind any endpoint for SAPI server\n");
+            evhttp_free(sapi);
+            event_base_free(base);
+            break;
+        }
+
+        eventBasesSAPI.push_back(base);
+        eventsSAPI.push_back(sapi);
+    }
+
+    // All event loops are required, otherwise a part of the connections would never be accepted.
+    if ((int)eventsSAPI.size() != nEventThreads) {
+        for (size_t i = 0; i < eventsSAPI.size(); i++) {
+            evhttp_free(eventsSAPI[i]);
+            event_base_free(eventBasesSAPI[i]);
+        }
+        eventsSAPI.clear();
+        eventBasesSAPI.clear();
+        boundSocketsSAPI.clear();
         return false;
     }
 
-    LogPrint("sapi", "Initialized SAPI server\n");
+    LogPrint("sapi", "Initialized SAPI server with %d event threads\n", nEventThreads);
     int workQueueDepth = std::max((long)GetArg("-sapiworkqueue", DEFAULT_SAPI_WORKQUEUE), 1L);
-    LogPrintf("SAPI: creating work queue of depth %d\n", workQueueDepth);
+    int rpcThreads = std::max((long)GetArg("-sapithreads", DEFAULT_SAPI_THREADS), 1L);
+    LogPrintf("SAPI: creating work queue with %d lanes of depth %d running up to %d requests at a time\n", SAPI::CostClassCount, workQueueDepth, rpcThreads);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
-    eventBaseSAPI = base;
-    eventSAPI = sapi;
+    workQueue = new CSAPIWorkQueue(workQueueDepth, taskPool, rpcThreads);
     return true;
 }
 
-boost::thread threadSAPI;
+static std::vector<boost::thread> threadsSAPI;
 
 bool StartSAPIServer()
 {
     LogPrint("sapi", "Starting SAPI server\n");
-    int rpcThreads = std::max((long)GetArg("-sapithreads", DEFAULT_SAPI_THREADS), 1L);
-    LogPrintf("SAPI: starting %d worker threads\n", rpcThreads);
-    threadSAPI = boost::thread(boost::bind(&ThreadSAPI, eventBaseSAPI, eventSAPI));
+    LogPrintf("SAPI: starting %d event threads\n", eventBasesSAPI.size());
+
+    for (size_t i = 0; i < eventBasesSAPI.size(); i++)
+        threadsSAPI.push_back(boost::thread(boost::bind(&ThreadSAPI, eventBasesSAPI[i], eventsSAPI[i])));
 
-    for (int i = 0; i < rpcThreads; i++)
-        boost::thread(boost::bind(&SAPIWorkQueueRun, workQueue));
     return true;
 }
 
 void InterruptSAPIServer()
 {
     LogPrint("sapi", "Interrupting SAPI server\n");
-    if (eventSAPI) {
-        // Unlisten sockets
-        BOOST_FOREACH (evhttp_bound_socket *socket, boundSocketsSAPI) {
-            evhttp_del_accept_socket(eventSAPI, socket);
-        }
-        // Reject requests on current connections
-        evhttp_set_gencb(eventSAPI, sapi_reject_request_cb, NULL);
+    // Unlisten sockets
+    for (const std::pair<struct evhttp*, evhttp_bound_socket *> &socket : boundSocketsSAPI) {
+        evhttp_del_accept_socket(socket.first, socket.second);
+    }
+    boundSocketsSAPI.clear();
+    // Reject requests on current connections
+    for (struct evhttp* sapi : eventsSAPI) {
+        evhttp_set_gencb(sapi, sapi_reject_request_cb, NULL);
     }
     if (workQueue)
         workQueue->Interrupt();
@@ -477,11 +691,11 @@ void StopSAPIServer()
 {
     LogPrint("sapi", "Stopping HTTP server\n");
     if (workQueue) {
-        LogPrint("sapi", "Waiting for SAPI worker threads to exit\n");
+        LogPrint("sapi", "Waiting for SAPI requests to finish\n");
         workQueue->WaitExit();
         delete workQueue;
     }
-    if (eventBaseSAPI) {
+    for (size_t i = 0; i < threadsSAPI.size(); i++) {
         LogPrint("sapi", "Waiting for SAPI event thread to exit\n");
         // Give event loop a few seconds to exit (to send back last SAPI responses), then break it
         // Before this was solved with event_base_loopexit, but that didn't work as expected in
@@ -490,75 +704,86 @@ void StopSAPIServer()
         // could be used again (if desirable).
         // (see discussion in https://github.com/bitcoin/bitcoin/pull/6990)
 #if BOOST_VERSION >= 105000
-        if (!threadSAPI.try_join_for(boost::chrono::milliseconds(2000))) {
+        if (!threadsSAPI[i].try_join_for(boost::chrono::milliseconds(2000))) {
 #else
-        if (!threadSAPI.timed_join(boost::posix_time::milliseconds(2000))) {
+        if (!threadsSAPI[i].timed_join(boost::posix_time::milliseconds(2000))) {
 #endif
             LogPrintf("SAPI event loop did not exit within allotted time, sending loopbreak\n");
-            event_base_loopbreak(eventBaseSAPI);
-            threadSAPI.join();
+            event_base_loopbreak(eventBasesSAPI[i]);
+            threadsSAPI[i].join();
         }
     }
-    if (eventSAPI) {
-        evhttp_free(eventSAPI);
-        eventSAPI = 0;
+    threadsSAPI.clear();
+    for (struct evhttp* sapi : eventsSAPI) {
+        evhttp_free(sapi);
     }
-    if (eventBaseSAPI) {
-        event_base_free(eventBaseSAPI);
-        eventBaseSAPI = 0;
+    eventsSAPI.clear();
+    for (struct event_base* base : eventBasesSAPI) {
+        event_base_free(base);
     }
+    eventBasesSAPI.clear();
     LogPrint("sapi", "Stopped SAPI server\n");
 }
 
 
-static SAPI::Result ParameterBaseCheck(HTTPRequest* req, const UniValue &obj, const SAPI::BodyParameter &param)
-{
-    std::string key = param.key;
-    SAPI::Codes code = SAPI::Valid;
-    std::string err = std::string();
-
-    if( !obj.exists(param.key) && !param.optional ){
-        err = "Parameter missing: " + key;
-        code = SAPI::ParameterMissing;
-    }else if( obj.exists(param.key) ){
-
-        if( obj[key].type() != param.validator->GetType() ){
-
-            code = SAPI::InvalidType;
-            err = "Invalid type for key: " + key;
-
-            switch( param.validator->GetType() ){
-                case UniValue::VARR:
-                     err += " -- expected JSON-Array";
-                    break;
-                case UniValue::VBOOL:
-                    err += " -- expected Bool";
-                    break;
-                case UniValue::VNULL:
-                     err += " -- expected Null";
-                    break;
-                case UniValue::VNUM:
-                     err += " -- expected Number";
-                    break;
-                case UniValue::VOBJ:
-                    err += " -- expected Object";
-                    break;
-                case UniValue::VSTR:
-                    err += " -- expected String";
-                    break;
-                default:
-                    err = "ParameterBaseCheck: invalid type value.";
-                    break;
-                }
-        }
+/** A body parameter of an endpoint with everything its checks need which doesn't depend on the request */
+struct CSAPIBodyParameterCheck{
+    const std::string *key;
+    const SAPI::Validation::Base *validator;
+    UniValue::VType type;
+    bool optional;
+    std::string strMissing;
+    std::string strInvalidType;
+};
 
-    }
+typedef std::vector<CSAPIBodyParameterCheck> CSAPIBodySchema;
+
+// Built by StartSAPI for all endpoints, only read afterwards
+static std::map<const SAPI::Endpoint*, CSAPIBodySchema> mapBodySchemas;
+
+static CSAPIBodySchema CompileBodySchema(const SAPI::Endpoint &endpoint)
+{
+    CSAPIBodySchema schema;
+    schema.reserve(endpoint.vecBodyParameter.size());
+
+    for( const SAPI::BodyParameter &param : endpoint.vecBodyParameter ){
+
+        CSAPIBodyParameterCheck check;
+        check.key = &param.key;
+        check.validator = param.validator;
+        check.type = param.validator->GetType();
+        check.optional = param.optional;
+        check.strMissing = "Parameter missing: " + param.key;
+        check.strInvalidType = "Invalid type for key: " + param.key;
+
+        switch( check.type ){
+            case UniValue::VARR:
+                check.strInvalidType += " -- expected JSON-Array";
+                break;
+            case UniValue::VBOOL:
+                check.strInvalidType += " -- expected Bool";
+                break;
+            case UniValue::VNULL:
+                check.strInvalidType += " -- expected Null";
+                break;
+            case UniValue::VNUM:
+                check.strInvalidType += " -- expected Number";
+                break;
+            case UniValue::VOBJ:
+                check.strInvalidType += " -- expected Object";
+                break;
+            case UniValue::VSTR:
+                check.strInvalidType += " -- expected String";
+                break;
+            default:
+                check.strInvalidType = "ParameterBaseCheck: invalid type value.";
+                break;
+        }
 
-    if( code != SAPI::Valid ){
-        return SAPI::Result(code, err);
+        schema.push_back(std::move(check));
     }
 
-    return SAPI::Result();
+    return schema;
 }
 
 bool ParseHashStr(const string& strHash, uint256& v)
@@ -580,6 +805,13 @@ bool SAPI::CheckWarmup(HTTPRequest* req)
     return true;
 }
 
+bool SAPI::CheckIndexReady(HTTPRequest* req, IndexBuilderIndex index)
+{
+    if (!indexBuilder.IsReady(index))
+        return SAPI::Error(req, HTTPStatus::SERVICE_UNAVAILABLE, "Service temporarily unavailable: " + indexBuilder.GetStatus());
+    return true;
+}
+
 bool StartSAPI()
 {
     SAPI::versionSubPath = strprintf("/v%d", SAPI_VERSION_MAJOR);
@@ -593,20 +825,37 @@ bool StartSAPI()
         &transactionEndpoints,
         &smartnodeEndpoints,
         &smartrewardsEndpoints,
-        &termrewardsEndpoints
+        &termrewardsEndpoints,
+        &metricsEndpoints,
+        &batchEndpoints
     };
 
+    sapiRouter.Clear();
+    mapBodySchemas.clear();
+
+    for( const SAPI::EndpointGroup *group : endpointGroups ){
+        for( const SAPI::Endpoint &endpoint : group->endpoints ){
+            sapiRouter.Add(group->prefix, endpoint);
+            mapBodySchemas[&endpoint] = CompileBodySchema(endpoint);
+        }
+    }
+
+    SAPI::Cache::Start();
+    SAPI::Timing::Start(endpointGroups);
+    SAPI::Poll::Start();
+
     return true;
 }
 
 void InterruptSAPI()
 {
-    // Nothing to do here yet.
+    SAPI::Poll::Interrupt();
 }
 
 void StopSAPI()
 {
-    // Nothing to do here yet.
+    SAPI::Poll::Stop();
+    SAPI::Cache::Stop();
 }
 
 static bool SAPIValidateBody(HTTPRequest *req, const SAPI::Endpoint *endpoint, UniValue &bodyParameter)
@@ -615,18 +864,19 @@ static bool SAPIValidateBody(HTTPRequest *req, const SAPI::Endpoint *endpoint, U
     if( endpoint->bodyRoot != UniValue::VARR && endpoint->bodyRoot != UniValue::VOBJ )
         return true;
 
-    std::string bodyStr = req->ReadBody();
+    if( endpoint->fBinaryBody && SAPI::IsBinaryBody(req) )
+        return true;
+
+    size_t nBodySize;
+    const char *pBody = req->PeekBody(nBodySize);
 
-    if ( bodyStr.empty() )
+    if ( !nBodySize )
         return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "No body parameter object defined in the body: {...TBD...}");
 
     try{
-        // Try to parse body string to json
-        UniValue jVal;
-        if (!jVal.read(std::string("[")+bodyStr+std::string("]")) ||
-            !jVal.isArray() || jVal.size()!=1)
-            throw runtime_error(string("Error parsing JSON:")+bodyStr);
-        bodyParameter = jVal[0];
+        // Parse the body right from the request buffer, the root is an object or an array
+        if (!bodyParameter.read(pBody, nBodySize))
+            throw runtime_error(string("Error parsing JSON:")+std::string(pBody, nBodySize));
     }
     catch (UniValue& objError)
     {
@@ -646,24 +896,38 @@ static bool SAPIValidateBody(HTTPRequest *req, const SAPI::Endpoint *endpoint, U
         return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "Error: " + std::string(e.what()));
     }
 
+    return SAPIValidateBodyParameter(req, endpoint, bodyParameter);
+}
+
+static bool SAPIValidateBodyParameter(HTTPRequest *req, const SAPI::Endpoint *endpoint, const UniValue &bodyParameter)
+{
     if( endpoint->bodyRoot == UniValue::VOBJ && !bodyParameter.isObject() )
         return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "Parameter json is expedted to be a JSON object: {...TBD... }");
     else if( endpoint->bodyRoot == UniValue::VARR && !bodyParameter.isArray() )
         return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "Parameter json is expedted to be a JSON array: {...TBD... }");
 
+    auto it = mapBodySchemas.find(endpoint);
+    assert(it != mapBodySchemas.end());
+
     std::vector<SAPI::Result> results;
 
-    for( auto param : endpoint->vecBodyParameter ){
+    for( const CSAPIBodyParameterCheck &param : it->second ){
+
+        // One lookup per parameter, NullUniValue itself is only returned for missing keys
+        const UniValue &value = find_value(bodyParameter, *param.key);
+
+        if( &value == &NullUniValue ){
 
-        SAPI::Result &&result = ParameterBaseCheck(req, bodyParameter, param);
+            if( !param.optional )
+                results.push_back(SAPI::Result(SAPI::ParameterMissing, param.strMissing));
 
-        if( result != SAPI::Codes::Valid ){
+        }else if( value.type() != param.type ){
 
-            results.push_back(result);
+            results.push_back(SAPI::Result(SAPI::InvalidType, param.strInvalidType));
 
-        }else if( bodyParameter.exists(param.key) ){
+        }else{
 
-            SAPI::Result result = param.validator->Validate(param.key, bodyParameter[param.key]);
+            SAPI::Result result = param.validator->Validate(*param.key, value);
 
             if( result != SAPI::Valid ){
                 results.push_back(result);
@@ -677,14 +941,155 @@ static bool SAPIValidateBody(HTTPRequest *req, const SAPI::Endpoint *endpoint, U
     return true;
 }
 
-static bool SAPIExecuteEndpoint(HTTPRequest *req, const std::map<std::string, std::string> &mapPathParams, const SAPI::Endpoint *endpoint)
+static bool SAPIExecuteEndpoint(HTTPRequest *req, const std::map<std::string, std::string> &mapPathParams, const SAPI::Endpoint *endpoint, int64_t nTimeQueued)
 {
     UniValue bodyParameter;
 
-    if(!SAPIValidateBody(req, endpoint, bodyParameter) )
-        return false;
+    // endpoint path, microseconds spent in the work queue
+    TRACE2(sapi, request_start, endpoint->path.c_str(), GetTimeMicros() - nTimeQueued);
+
+    bool fResult;
+
+    {
+        SAPI::Timing::Scope timing(req, endpoint, nTimeQueued);
+        SAPI::Cache::Scope cache(req);
+
+        fResult = SAPI::Cache::Reply(req, endpoint, mapPathParams) ||
+                  ( SAPIValidateBody(req, endpoint, bodyParameter) &&
+                    endpoint->handler(req, mapPathParams, bodyParameter ) );
+    }
 
-    return endpoint->handler(req, mapPathParams, bodyParameter );
+    // endpoint path, succeeded, microseconds since the request was queued
+    TRACE3(sapi, request_done, endpoint->path.c_str(), fResult, GetTimeMicros() - nTimeQueued);
+
+    return fResult;
+}
+
+/** Execute the sub-requests of a /batch request, the replies of the endpoints get captured and
+ *  returned as array of {"status", "result"} objects in the order of the request. */
+static bool sapi_batch(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    if( !bodyParameter.size() )
+        return SAPI::Error(req, SAPI::BatchRequestInvalid, "Empty batch request");
+
+    if( bodyParameter.size() > SAPI_BATCH_MAX_REQUESTS )
+        return SAPI::Error(req, SAPI::BatchRequestInvalid, strprintf("Too many requests in the batch, maximum is %d", SAPI_BATCH_MAX_REQUESTS));
+
+    std::vector<SAPIEndpointMatch> vecRequests;
+    std::vector<UniValue> vecBodies;
+
+    for( size_t i = 0; i < bodyParameter.size(); i++ ){
+
+        const UniValue &request = bodyParameter[i];
+
+        if( !request.isObject() || !request[SAPI::Keys::path].isStr() )
+            return SAPI::Error(req, SAPI::BatchRequestInvalid, strprintf("Request %d: object with a \"%s\" string expected", i, SAPI::Keys::path));
+
+        HTTPRequest::RequestMethod method = HTTPRequest::GET;
+        const UniValue &methodValue = request[SAPI::Keys::method];
+
+        if( !methodValue.isNull() ){
+            if( methodValue.isStr() && methodValue.get_str() == "POST" )
+                method = HTTPRequest::POST;
+            else if( !methodValue.isStr() || methodValue.get_str() != "GET" )
+                return SAPI::Error(req, SAPI::BatchRequestInvalid, strprintf("Request %d: method GET or POST expected", i));
+        }
+
+        std::string strPath = request[SAPI::Keys::path].get_str();
+
+        if( strPath.substr(0, SAPI::versionSubPath.size()) == SAPI::versionSubPath )
+            strPath = strPath.substr(SAPI::versionSubPath.size());
+
+        if( !strPath.size() || strPath.front() != '/' )
+            return SAPI::Error(req, SAPI::BatchRequestInvalid, strprintf("Request %d: endpoint missing", i));
+
+        std::vector<std::string> partsPath;
+        std::vector<SAPIEndpointMatch> vecPathMatch;
+
+        SplitPath(strPath.substr(1), partsPath);
+
+        sapiRouter.Match(partsPath, vecPathMatch);
+
+        auto fullMatch = std::find_if(vecPathMatch.begin(), vecPathMatch.end(),
+                                      [method](const SAPIEndpointMatch &entry) -> bool{
+            return method == entry.first->method;
+        });
+
+        if( fullMatch == vecPathMatch.end() )
+            return SAPI::Error(req, SAPI::BatchRequestInvalid, strprintf("Request %d: invalid endpoint %s with method %s", i, strPath, RequestMethodString(method)));
+
+        if( fullMatch->first->handler == sapi_batch )
+            return SAPI::Error(req, SAPI::BatchRequestInvalid, strprintf("Request %d: nested batch requests are not allowed", i));
+
+        vecRequests.push_back(*fullMatch);
+        vecBodies.push_back(request[SAPI::Keys::body]);
+    }
+
+    // The batch was counted as one request when it came in, count the others now.
+    CService peer = req->GetPeer();
+
+    if( !SAPI::IsWhitelistedRange(peer) ){
+
+        std::shared_ptr<SAPI::Limits::Client> client = SAPI::Limits::GetClient(peer);
+
+        for( size_t i = 1; i < vecRequests.size(); i++ ){
+
+            client->Request();
+
+            if( client->IsRequestLimited() ){
+                sapiStatistics.request(peer, CSAPIStatistics::Blocked);
+                SAPI::Result error(SAPI::RequestRateLimitExceeded,
+                                   strprintf("Too many Requests. Requests locked for %d seconds.", 10 + client->GetRequestLockSeconds()));
+                return SAPI::Error(req, HTTPStatus::FORBIDDEN, error);
+            }
+        }
+    }
+
+    CSAPIReplyCapture capture;
+
+    {
+        LOCK(cs_captures);
+        mapCaptures[req] = &capture;
+    }
+
+    std::string strJSON = "[";
+
+    // The endpoints take cs_main themselves where they need it. Holding it for
+    // the whole batch would stall the block processing for up to
+    // SAPI_BATCH_MAX_REQUESTS requests.
+    for( size_t i = 0; i < vecRequests.size(); i++ ){
+
+        const SAPI::Endpoint *endpoint = vecRequests[i].first;
+        const UniValue &body = vecBodies[i];
+
+        capture = CSAPIReplyCapture();
+
+        bool fBody = endpoint->bodyRoot == UniValue::VARR || endpoint->bodyRoot == UniValue::VOBJ;
+
+        if( !fBody || SAPIValidateBodyParameter(req, endpoint, body) )
+            endpoint->handler(req, vecRequests[i].second, fBody ? body : NullUniValue);
+
+        if( !capture.nStatus ){
+            capture.nStatus = HTTPStatus::INTERNAL_SERVER_ERROR;
+            capture.strJSON = "null";
+        }
+
+        if( i ) strJSON += ",";
+        strJSON += strprintf("{\"status\":%d,\"result\":%s}", capture.nStatus, capture.strJSON);
+    }
+
+    {
+        LOCK(cs_captures);
+        mapCaptures.erase(req);
+    }
+
+    strJSON += "]\n";
+
+    SAPI::AddDefaultHeaders(req);
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTPStatus::OK, strJSON);
+
+    return true;
 }
 
 std::string JsonString(const UniValue &obj)
@@ -700,6 +1105,17 @@ void SAPI::AddDefaultHeaders(HTTPRequest* req)
     req->WriteHeader("Access-Control-Allow-Origin", "*");
 }
 
+bool SAPI::IsCaptured(const HTTPRequest *req)
+{
+    return GetReplyCapture(req) != nullptr;
+}
+
+bool SAPI::IsBinaryBody(HTTPRequest *req)
+{
+    std::pair<bool, std::string> contentType = req->GetHeader("Content-Type");
+    return contentType.first && boost::algorithm::istarts_with(contentType.second, "application/octet-stream");
+}
+
 bool SAPI::Error(HTTPRequest* req, HTTPStatus::Codes status, const std::vector<SAPI::Result> &errors)
 {
     UniValue arr(UniValue::VARR);
@@ -708,7 +1124,15 @@ bool SAPI::Error(HTTPRequest* req, HTTPStatus::Codes status, const std::vector<S
         arr.push_back(error.ToUniValue());
     }
 
+    if( CSAPIReplyCapture *capture = GetReplyCapture(req) ){
+        capture->nStatus = status;
+        capture->strJSON = arr.write();
+        return false;
+    }
+
+    int64_t nStart = GetTimeMicros();
     string strJSON = arr.write(1,1) + "\n";
+    SAPI::Timing::Add(SAPI::Timing::Serialize, GetTimeMicros() - nStart);
 
     AddDefaultHeaders(req);
     req->WriteHeader("Content-Type", "application/json");
@@ -733,13 +1157,35 @@ bool SAPI::Error(HTTPRequest* req, SAPI::Codes code, const std::string &message)
 
 void SAPI::WriteReply(HTTPRequest *req, HTTPStatus::Codes status, const UniValue &obj)
 {
+    int64_t nStart = GetTimeMicros();
+
+    if( CSAPIReplyCapture *capture = GetReplyCapture(req) ){
+        capture->nStatus = status;
+        capture->strJSON = obj.write();
+        SAPI::Timing::Add(SAPI::Timing::Serialize, GetTimeMicros() - nStart);
+        return;
+    }
+
+    std::string strJSON = JsonString(obj);
+    SAPI::Timing::Add(SAPI::Timing::Serialize, GetTimeMicros() - nStart);
+
     AddDefaultHeaders(req);
     req->WriteHeader("Content-Type", "application/json");
-    req->WriteReply(status, JsonString(obj));
+
+    if( status == HTTPStatus::OK )
+        SAPI::Cache::Store(req, strJSON);
+
+    req->WriteReply(status, strJSON);
 }
 
 void SAPI::WriteReply(HTTPRequest *req, HTTPStatus::Codes status, const std::string &str)
 {
+    if( CSAPIReplyCapture *capture = GetReplyCapture(req) ){
+        capture->nStatus = status;
+        capture->strJSON = UniValue(str).write();
+        return;
+    }
+
     AddDefaultHeaders(req);
     req->WriteHeader("Content-Type", "text/plain");
     req->WriteReply(status, str + "\n");
@@ -755,32 +1201,214 @@ void SAPI::WriteReply(HTTPRequest *req, const std::string &str)
     SAPI::WriteReply(req, HTTPStatus::OK, str);
 }
 
+void SAPI::JSONStream::Separator()
+{
+    if( vecOpen.empty() )
+        return;
+
+    if( vecOpen.back().second )
+        strBuffer += ',';
+
+    vecOpen.back().second = true;
+}
+
+void SAPI::JSONStream::Key(const std::string &key)
+{
+    Separator();
+    strBuffer += UniValue(key).write();
+    strBuffer += ':';
+}
+
+void SAPI::JSONStream::Flush()
+{
+    if( strBuffer.size() < nChunkSize || GetReplyCapture(req) )
+        return;
+
+    if( !fStarted ){
+        AddDefaultHeaders(req);
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReplyStart(HTTPStatus::OK);
+        fStarted = true;
+    }
+
+    req->WriteReplyChunk(strBuffer);
+    strBuffer.clear();
+}
+
+void SAPI::JSONStream::BeginArray()
+{
+    Separator();
+    strBuffer += '[';
+    vecOpen.push_back(std::make_pair(']', false));
+}
+
+void SAPI::JSONStream::BeginArray(const std::string &key)
+{
+    Key(key);
+    strBuffer += '[';
+    vecOpen.push_back(std::make_pair(']', false));
+}
+
+void SAPI::JSONStream::BeginObject()
+{
+    Separator();
+    strBuffer += '{';
+    vecOpen.push_back(std::make_pair('}', false));
+}
+
+void SAPI::JSONStream::BeginObject(const std::string &key)
+{
+    Key(key);
+    strBuffer += '{';
+    vecOpen.push_back(std::make_pair('}', false));
+}
+
+void SAPI::JSONStream::End()
+{
+    assert(!vecOpen.empty());
+    strBuffer += vecOpen.back().first;
+    vecOpen.pop_back();
+    Flush();
+}
+
+void SAPI::JSONStream::Push(const UniValue &value)
+{
+    int64_t nStart = GetTimeMicros();
+    Separator();
+    strBuffer += value.write();
+    SAPI::Timing::Add(SAPI::Timing::Serialize, GetTimeMicros() - nStart);
+    Flush();
+}
+
+void SAPI::JSONStream::Push(const std::string &key, const UniValue &value)
+{
+    int64_t nStart = GetTimeMicros();
+    Key(key);
+    strBuffer += value.write();
+    SAPI::Timing::Add(SAPI::Timing::Serialize, GetTimeMicros() - nStart);
+    Flush();
+}
+
+void SAPI::JSONStream::Finish()
+{
+    assert(!fFinished);
+
+    while( !vecOpen.empty() )
+        End();
+
+    fFinished = true;
+
+    if( CSAPIReplyCapture *capture = GetReplyCapture(req) ){
+        capture->nStatus = HTTPStatus::OK;
+        capture->strJSON = strBuffer;
+        return;
+    }
+
+    strBuffer += '\n';
+
+    if( !fStarted ){
+        AddDefaultHeaders(req);
+        req->WriteHeader("Content-Type", "application/json");
+        SAPI::Cache::Store(req, strBuffer);
+        req->WriteReply(HTTPStatus::OK, strBuffer);
+        return;
+    }
+
+    req->WriteReplyChunk(strBuffer);
+    req->WriteReplyEnd();
+}
+
+bool SAPI::JSONStream::Error(SAPI::Codes code, const std::string &message)
+{
+    assert(!fFinished);
+    fFinished = true;
+
+    if( !fStarted )
+        return SAPI::Error(req, code, message);
+
+    LogPrint("sapi", "SAPI::JSONStream::Error() - Reply aborted: %s\n", message);
+    req->WriteReplyEnd();
+    return false;
+}
+
 int64_t SAPI::GetStartTime() {
     return nStartTime;
 }
 
+void CSAPIClientEstimator::Add(uint64_t nHash)
+{
+    // The upper bits select the register, it keeps the longest run of leading zeros of the rest.
+    size_t nRegister = nHash >> (64 - nRegisterBits);
+    uint64_t nRest = (nHash << nRegisterBits) | (1ULL << (nRegisterBits - 1));
+    unsigned char nRank = 1;
+
+    while( !(nRest & (1ULL << 63)) ){
+        nRest <<= 1;
+        ++nRank;
+    }
+
+    if( nRank > vecRegisters[nRegister] )
+        vecRegisters[nRegister] = nRank;
+}
+
+void CSAPIClientEstimator::Merge(const CSAPIClientEstimator &other)
+{
+    for( size_t i = 0; i < vecRegisters.size(); i++ ){
+        if( other.vecRegisters[i] > vecRegisters[i] )
+            vecRegisters[i] = other.vecRegisters[i];
+    }
+}
+
+uint64_t CSAPIClientEstimator::Estimate() const
+{
+    double m = vecRegisters.size();
+    double dSum = 0;
+    size_t nZero = 0;
+
+    for( unsigned char nRank : vecRegisters ){
+        dSum += std::ldexp(1.0, -nRank);
+        if( !nRank ) ++nZero;
+    }
+
+    double dEstimate = 0.7213 / (1 + 1.079 / m) * m * m / dSum;
+
+    // Linear counting is more accurate as long as there are empty registers left.
+    if( dEstimate <= 2.5 * m && nZero )
+        dEstimate = m * std::log(m / nZero);
+
+    return static_cast<uint64_t>(dEstimate + 0.5);
+}
+
+void CSAPIClientEstimator::Clear()
+{
+    vecRegisters.assign(1 << nRegisterBits, 0);
+}
+
 CSAPIStatistics::CSAPIStatistics()
 {
     nTotalValidRequests = 0;
     nTotalInvalidRequests = 0;
     nTotalBlockedRequests = 0;
 
+    nTotalConnections = 0;
+    nTotalReusedRequests = 0;
+
     nMaxRequestsPerHour = 0;
     nMaxClientsPerHour = 0;
 
-    init();
+    init(GetCurrentStartTimestamp());
 }
 
-void CSAPIStatistics::init()
+void CSAPIStatistics::init(int64_t nStartTimestamp)
 {
-    setCurrentClients.clear();
+    currentClients.Clear();
 
     vecRequests.clear();
     vecRequests.resize(nCountLastHours);
 
-    nLastHour = GetCurrentHour();
+    nLastHour = (nStartTimestamp / nSecondsPerHour) % nCountLastHours;
     vecRequests[nLastHour].Reset();
-    vecRequests[nLastHour].nStartTimestamp = GetCurrentStartTimestamp();
+    vecRequests[nLastHour].nStartTimestamp = nStartTimestamp;
 
     int64_t nNextTimestamp;
     int64_t nNextHour = 0, nPrevHour = nLastHour;
@@ -794,54 +1422,145 @@ void CSAPIStatistics::init()
     }
 }
 
-void CSAPIStatistics::request(CNetAddr &address, RequestType type)
+template <typename Func>
+void CSAPIStatistics::Count(const CNetAddr &address, Func count)
 {
-    LOCK(cs_requests);
+    int64_t nStartTimestamp = GetCurrentStartTimestamp();
+    uint64_t nHash = address.GetHash();
+    Stripe &stripe = stripes[nHash % nStripes];
 
-    int nCurrentHour = GetCurrentHour();
+    while( true ){
 
-    if( (GetTime() - vecRequests[nLastHour].nStartTimestamp) > (nCountLastHours * nSecondsPerHour) ){
-        init();
-    }else{
+        {
+            LOCK(stripe.cs);
 
-        while( nLastHour != nCurrentHour ){
-            int64_t nNextTimestamp = vecRequests[nLastHour].nStartTimestamp + nSecondsPerHour;
-            nLastHour++;
-            if( nLastHour >= nCountLastHours) nLastHour = 0;
+            CSAPIRequestStripe &requests = stripe.requests;
 
-            vecRequests[nLastHour].Reset();
-            vecRequests[nLastHour].nStartTimestamp = nNextTimestamp;
-            setCurrentClients.clear();
+            if( requests.IsEmpty() || requests.nStartTimestamp == nStartTimestamp ){
+
+                requests.nStartTimestamp = nStartTimestamp;
+                requests.clients.Add(nHash);
+
+                count(requests);
+                return;
+            }
         }
+
+        // The stripe still counts a previous hour, move it into the history first.
+        Merge();
     }
+}
 
-    setCurrentClients.insert(address);
+void CSAPIStatistics::request(const CNetAddr &address, RequestType type)
+{
+    Count(address, [type](CSAPIRequestStripe &requests) {
+        switch(type){
+        case Valid:
+            requests.nValid++;
+            break;
+        case Invalid:
+            requests.nInvalid++;
+            break;
+        case Blocked:
+            requests.nBlocked++;
+            break;
+        default:
+            break;
+        }
+    });
+}
+
+void CSAPIStatistics::connection(const CNetAddr &address, bool fReused)
+{
+    Count(address, [fReused](CSAPIRequestStripe &requests) {
+        if( fReused )
+            requests.nReused++;
+        else
+            requests.nConnections++;
+    });
+}
+
+void CSAPIStatistics::Merge()
+{
+    LOCK(cs_requests);
+
+    std::vector<CSAPIRequestStripe> vecPending;
+
+    for( Stripe &stripe : stripes ){
+        LOCK(stripe.cs);
+        if( !stripe.requests.IsEmpty() ){
+            vecPending.push_back(stripe.requests);
+            stripe.requests.Reset();
+        }
+    }
+
+    std::sort(vecPending.begin(), vecPending.end(), [](const CSAPIRequestStripe &a, const CSAPIRequestStripe &b) -> bool {
+        return a.nStartTimestamp < b.nStartTimestamp;
+    });
+
+    for( const CSAPIRequestStripe &requests : vecPending ){
+        Advance(requests.nStartTimestamp);
+        Apply(requests);
+    }
+
+    Advance(GetCurrentStartTimestamp());
+}
+
+void CSAPIStatistics::Advance(int64_t nStartTimestamp)
+{
+    AssertLockHeld(cs_requests);
 
-    uint64_t nClients = setCurrentClients.size();
-    vecRequests[nCurrentHour].nClients = nClients;
+    if( nStartTimestamp <= vecRequests[nLastHour].nStartTimestamp )
+        return;
+
+    if( (nStartTimestamp - vecRequests[nLastHour].nStartTimestamp) >= (nCountLastHours * nSecondsPerHour) ){
+        init(nStartTimestamp);
+        return;
+    }
 
-    if( nClients > nMaxClientsPerHour ) nMaxClientsPerHour = nClients;
+    while( vecRequests[nLastHour].nStartTimestamp < nStartTimestamp ){
+        int64_t nNextTimestamp = vecRequests[nLastHour].nStartTimestamp + nSecondsPerHour;
+        nLastHour++;
+        if( nLastHour >= nCountLastHours) nLastHour = 0;
 
-    switch(type){
-    case Valid:
-        ++nTotalValidRequests;
-        vecRequests[nCurrentHour].nValid++;
-        break;
-    case Invalid:
-        ++nTotalInvalidRequests;
-        vecRequests[nCurrentHour].nInvalid++;
-        break;
-    case Blocked:
-        ++nTotalBlockedRequests;
-        vecRequests[nCurrentHour].nBlocked++;
-        break;
-    default:
-        break;
+        vecRequests[nLastHour].Reset();
+        vecRequests[nLastHour].nStartTimestamp = nNextTimestamp;
+        currentClients.Clear();
     }
+}
+
+void CSAPIStatistics::Apply(const CSAPIRequestStripe &requests)
+{
+    AssertLockHeld(cs_requests);
+
+    nTotalValidRequests += requests.nValid;
+    nTotalInvalidRequests += requests.nInvalid;
+    nTotalBlockedRequests += requests.nBlocked;
+    nTotalConnections += requests.nConnections;
+    nTotalReusedRequests += requests.nReused;
+
+    int nHour = (requests.nStartTimestamp / nSecondsPerHour) % nCountLastHours;
+    CSAPIRequestCount &count = vecRequests[nHour];
 
-    if( vecRequests[nCurrentHour].GetTotalRequests() > nMaxRequestsPerHour )
-        nMaxRequestsPerHour = vecRequests[nCurrentHour].GetTotalRequests();
+    // Requests of an hour which already left the history only count for the totals.
+    if( count.nStartTimestamp != requests.nStartTimestamp )
+        return;
+
+    count.nValid += requests.nValid;
+    count.nInvalid += requests.nInvalid;
+    count.nBlocked += requests.nBlocked;
+    count.nConnections += requests.nConnections;
+    count.nReused += requests.nReused;
 
+    if( nHour == nLastHour ){
+        currentClients.Merge(requests.clients);
+        count.nClients = currentClients.Estimate();
+    }
+
+    if( count.nClients > nMaxClientsPerHour ) nMaxClientsPerHour = count.nClients;
+
+    if( count.GetTotalRequests() > nMaxRequestsPerHour )
+        nMaxRequestsPerHour = count.GetTotalRequests();
 }
 
 void CSAPIStatistics::reset()
@@ -862,6 +1581,8 @@ UniValue CSAPIStatistics::ToUniValue()
 {
     LOCK(cs_requests);
 
+    Merge();
+
     UniValue obj(UniValue::VOBJ);
     UniValue last24h(UniValue::VARR);
 
@@ -870,6 +1591,8 @@ UniValue CSAPIStatistics::ToUniValue()
     obj.pushKV("totalBlocked", GetTotalBlockedRequests() );
     obj.pushKV("maxRequestsPerHour", GetMaxRequestsPerHour() );
     obj.pushKV("maxClientsPerHour", GetMaxClientsPerHour() );
+    obj.pushKV("totalConnections", GetTotalConnections() );
+    obj.pushKV("totalReused", GetTotalReusedRequests() );
 
     int nIndex = nLastHour;
 
@@ -884,6 +1607,8 @@ UniValue CSAPIStatistics::ToUniValue()
         hour.pushKV("valid", count.nValid);
         hour.pushKV("invalid", count.nInvalid);
         hour.pushKV("blocked", count.nBlocked);
+        hour.pushKV("connections", count.nConnections);
+        hour.pushKV("reused", count.nReused);
 
         last24h.push_back(hour);
 
@@ -897,6 +1622,20 @@ UniValue CSAPIStatistics::ToUniValue()
     return obj;
 }
 
+size_t CSAPIStatistics::DynamicMemoryUsage()
+{
+    LOCK(cs_requests);
+
+    size_t nUsage = memusage::DynamicUsage(vecRequests) + memusage::DynamicUsage(vecRestarts) + currentClients.DynamicMemoryUsage();
+
+    for( Stripe &stripe : stripes ){
+        LOCK(stripe.cs);
+        nUsage += stripe.requests.clients.DynamicMemoryUsage();
+    }
+
+    return nUsage;
+}
+
 string CSAPIStatistics::ToString() const
 {
     return strprintf("CSAPIStatistics( restarts=%d, totalValidRequests=%d )", vecRestarts.size(), nTotalValidRequests);
@@ -6,9 +6,15 @@
 #define SMARTCASH_SAPI_H
 
 #include "httpserver.h"
+#include "indexbuilder.h"
+#include "memusage.h"
 #include "validation.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
+#include "taskpool.h"
+#include "utiltime.h"
+#include <deque>
+#include <memory>
 #include <string>
 #include <stdint.h>
 #include <boost/thread.hpp>
@@ -21,15 +27,47 @@ class CSAPIStatistics;
 extern CSAPIStatistics sapiStatistics;
 
 extern UniValue UniValueFromAmount(int64_t nAmount);
-extern bool GetTransactionInfo(HTTPRequest* req, uint256 nHash, const CTransaction &tx, UniValue &txObj, bool showHex);
+extern bool GetTransactionInfo(HTTPRequest* req, uint256 nHash, const CTransaction &tx, UniValue &txObj, bool showHex,
+                               const std::map<COutPoint, CTxOut> *pPrevouts = nullptr);
 
 static const int DEFAULT_SAPI_THREADS=4;
+static const int DEFAULT_SAPI_EVENT_THREADS=1;
 static const int DEFAULT_SAPI_WORKQUEUE=16;
 static const int DEFAULT_SAPI_SERVER_TIMEOUT=3;
+//! Requests served by one keep-alive connection before the server closes it, 0 for no limit
+static const int DEFAULT_SAPI_KEEPALIVE_REQUESTS=100;
 static const int DEFAULT_SAPI_SERVER_PORT=8080;
+//! Size of the SAPI response cache in MiB, 0 disables it
+static const int DEFAULT_SAPI_CACHE_SIZE=32;
+//! Confirmations after which the instantpay details of a transaction don't change anymore
+static const int SAPI_CACHE_MIN_TX_DEPTH=6;
 
 static const int DEFAULT_SAPI_JSON_INDENT=2;
 
+//! Requests which take longer get logged with their latency split, in milliseconds, 0 to disable
+static const int64_t DEFAULT_SAPI_SLOW_REQUEST=0;
+
+//! Milliseconds between the removals of idle clients from the rate limits
+static const int64_t SAPI_LIMITS_CLEANUP_INTERVAL=5000;
+
+//! Maximum number of sub-requests of a /batch request, they all run under one cs_main lock
+static const size_t SAPI_BATCH_MAX_REQUESTS=50;
+//! Maximum number of transactions of a binary transaction/send/batch request, submitted under one cs_main lock
+static const size_t SAPI_SEND_BATCH_MAX_TXS=1000;
+
+//! Long-poll requests for address activity which can wait at the same time
+static const int DEFAULT_SAPI_MAX_POLLS=1000;
+//! Seconds a long-poll request waits for address activity if it doesn't ask for less
+static const int SAPI_POLL_DEFAULT_TIMEOUT=30;
+static const int SAPI_POLL_MAX_TIMEOUT=60;
+
+//! Decoded previous outputs kept for the transaction details of the SAPI
+static const size_t SAPI_PREVOUT_CACHE_SIZE=50000;
+//! Threads which read the previous transactions of one request, including the worker thread of the request
+static const int SAPI_PREVOUT_THREADS=4;
+//! Previous transactions a thread has to read at least before another one gets started
+static const int SAPI_PREVOUT_THREAD_TXS=16;
+
 namespace SAPI{
 
 extern std::string versionSubPath;
@@ -57,6 +95,8 @@ enum Codes{
     InvalidAmount,
     AmountOverflow,
     AmountOutOfRange,
+    InvalidCursor,
+    InvalidPayoutCategory,
     /* common errors */
     TimedOut = 2000,
     PageOutOfRange,
@@ -65,11 +105,14 @@ enum Codes{
     RessourceRateLimitExceeded,
     AddressNotFound,
     NoInstantPayLocksAvailble,
+    BatchRequestInvalid,
+    PollLimitExceeded,
     /* block errors */
     BlockHeightOutOfRange = 3000,
     BlockNotFound,
     BlockNotSpecified,
     BlockHashInvalid,
+    BlockFilterNotAvailable,
     /* address errors */
     NoDepositAvailble = 4000,
     NoUtxosAvailble,
@@ -107,6 +150,7 @@ namespace Keys{
     const std::string random = "random";
     const std::string maxInputs = "maxInputs";
     const std::string height = "height";
+    const std::string round = "round";
     const std::string hash = "hash";
     const std::string inputs = "inputs";
     const std::string outputs = "outputs";
@@ -114,6 +158,15 @@ namespace Keys{
     const std::string protocol = "protocol";
     const std::string status = "status";
     const std::string direction = "direction";
+    const std::string path = "path";
+    const std::string method = "method";
+    const std::string body = "body";
+    const std::string cursor = "cursor";
+    const std::string addresses = "addresses";
+    const std::string timeout = "timeout";
+    const std::string heightFrom = "heightFrom";
+    const std::string heightTo = "heightTo";
+    const std::string category = "category";
 }
 
 namespace Validation{
@@ -243,6 +296,22 @@ namespace Validation{
         SAPI::Result Validate(const std::string &parameter, const UniValue &value) const final;
     };
 
+    /** Continuation token of paged transaction lists, "<height>:<txid>" of the last transaction received. */
+    class TxCursor : public Base{
+    public:
+        TxCursor() : Base(UniValue::VSTR) {}
+        SAPI::Result Validate(const std::string &parameter, const UniValue &value) const final;
+    };
+
+    bool ParseTxCursor(const std::string &strCursor, int &nHeight, uint256 &txhash);
+
+    /** Comma separated payout categories, mining, hive, smartnode, smartrewards or all. */
+    class PayoutCategories : public Base{
+    public:
+        PayoutCategories() : Base(UniValue::VSTR) {}
+        SAPI::Result Validate(const std::string &parameter, const UniValue &value) const final;
+    };
+
     class SmartCashAddresses : public Array{
     public:
         SmartCashAddresses() : Array() {}
@@ -287,8 +356,12 @@ namespace Limits {
         bool CheckAndRemove();
     };
 
-    Client *GetClient( const CService &peer );
+    /** Get or create the limiter of a peer, it stays valid while it gets removed by CheckAndRemove. */
+    std::shared_ptr<Client> GetClient( const CService &peer );
+    /** Remove the clients which are neither limited nor active, every SAPI_LIMITS_CLEANUP_INTERVAL ms from the maintenance tasks. */
     void CheckAndRemove();
+    /** Heap usage of the client table, nClientsRet gets the number of clients in it. */
+    size_t DynamicMemoryUsage(size_t &nClientsRet);
 }
 
 struct BodyParameter{
@@ -322,12 +395,25 @@ struct Result{
     }
 };
 
+/** Cost class of an endpoint, each class gets its own lane in the SAPI work queue */
+enum CostClass{
+    /* Endpoints without explicit class */
+    CostDefault = 0,
+    /* Cheap and latency critical, like sending transactions or the chain height */
+    CostCritical,
+    /* Paged or list queries which walk indexes or many blocks */
+    CostExpensive,
+    CostClassCount
+};
+
 typedef struct {
     std::string path;
     HTTPRequest::RequestMethod method;
     UniValue::VType bodyRoot;
     bool (*handler)(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
     std::vector<SAPI::BodyParameter> vecBodyParameter;
+    CostClass cost; // Value initialized to CostDefault if omitted
+    bool fBinaryBody; // Hand application/octet-stream bodies unparsed to the handler with a null bodyParameter
 }Endpoint;
 
 typedef struct{
@@ -335,10 +421,165 @@ typedef struct{
     std::vector<Endpoint> endpoints;
 }EndpointGroup;
 
+/** Replies of GET endpoints which only change with the chain tip.
+ *
+ * Handlers mark the reply of a request as cacheable with SetCacheable before they
+ * write it. The cache gets cleared by every new tip, including disconnects.
+ */
+namespace Cache {
+
+    void Start();
+    void Stop();
+
+    /** Write the cached reply of the request if there is one, otherwise prepare to store the new one. */
+    bool Reply(HTTPRequest *req, const Endpoint *endpoint, const std::map<std::string, std::string> &mapPathParams);
+    /** Forget the request after its handler finished. */
+    void End(HTTPRequest *req);
+
+    /** Forgets the request at the end of its scope, also if the handler throws. */
+    class Scope
+    {
+        HTTPRequest *req;
+
+    public:
+        explicit Scope(HTTPRequest *reqIn) : req(reqIn) {}
+        ~Scope()
+        {
+            End(req);
+        }
+    };
+
+    void SetCacheable(HTTPRequest *req);
+    /** Store the reply of a cacheable request and add its ETag and Cache-Control headers. */
+    void Store(HTTPRequest *req, const std::string &strJSON);
+}
+
+/** Prometheus text exposition of /metrics.
+ *
+ * The samples get appended to one text buffer which is sent as it is, all metric names
+ * get the smartcash_ prefix. Labels are passed as their inner part, like key="value".
+ */
+namespace Metrics {
+
+    class Writer
+    {
+        std::string &str;
+
+    public:
+        explicit Writer(std::string &strIn) : str(strIn) {}
+
+        /** The HELP and TYPE lines which have to precede the samples of a metric. */
+        void Family(const std::string &strName, const char *pszType, const char *pszHelp);
+        void Sample(const std::string &strName, const std::string &strLabels, int64_t nValue);
+        void Sample(const std::string &strName, const std::string &strLabels, uint64_t nValue);
+        void Sample(const std::string &strName, const std::string &strLabels, double dValue);
+        /** Histogram samples from the counts below the bucket bounds, the samples above the last bound are only part of nCount. */
+        void Histogram(const std::string &strName, const std::string &strLabels, const std::vector<std::pair<double, uint64_t>> &vecBuckets, uint64_t nCount, double dSum);
+    };
+
+    /** A label with its value escaped. */
+    std::string Label(const char *pszKey, const std::string &strValue);
+}
+
+/** Per endpoint latency histograms of the SAPI requests.
+ *
+ * The time of a request gets split into the wait in the work queue, the wait for cs_main,
+ * the JSON encoding of the reply and the remaining handler time. Requests slower than
+ * -sapislowrequest milliseconds get logged with this split.
+ */
+namespace Timing {
+
+    enum Phase{
+        QueueWait = 0,
+        LockWait,
+        Handler,
+        Serialize,
+        Total,
+        PhaseCount
+    };
+
+    void Start(const std::vector<EndpointGroup*> &groups);
+
+    /** Time a request of the endpoint which runs in the calling thread until End. */
+    void Begin(HTTPRequest *req, const Endpoint *endpoint, int64_t nTimeQueued);
+    void End();
+    /** Add time of a phase to the request of the calling thread, if there is one. */
+    void Add(Phase phase, int64_t nMicros);
+
+    /** Times the request for its lifetime, End also runs if the handler throws. */
+    class Scope
+    {
+    public:
+        Scope(HTTPRequest *req, const Endpoint *endpoint, int64_t nTimeQueued)
+        {
+            Begin(req, endpoint, nTimeQueued);
+        }
+        ~Scope()
+        {
+            End();
+        }
+    };
+
+    UniValue ToUniValue();
+    /** Latency quantiles of the endpoints with requests as Prometheus summaries. */
+    void WriteMetrics(Metrics::Writer &writer);
+}
+
+/** Long-poll for the activity of a set of addresses.
+ *
+ * A request waits until a transaction which enters the mempool, gets mined or gets locked by
+ * InstantPay touches one of its addresses, or until its timeout. The events come from the
+ * validation interface. Waiting requests don't occupy a worker thread, the work item of the
+ * request hands it over with Adopt and the poll thread replies to it.
+ */
+namespace Poll {
+
+    void Start();
+    void Interrupt();
+    void Stop();
+
+    /** Let the request wait for activity of the address index keys, replies with an error if no more requests can wait. */
+    bool Wait(HTTPRequest *req, const std::vector<std::pair<uint160, int>> &vecAddresses, int64_t nTimeout);
+    /** Take over the request if its handler let it wait. */
+    bool Adopt(std::unique_ptr<HTTPRequest> &req);
+}
+
+/** Previous outputs of transaction inputs.
+ *
+ * The transactions which hold them get read from the mempool or by their txindex
+ * position in parallel and without cs_main, so the handlers can resolve them while they
+ * hold the lock. Outputs never change for their outpoint so the LRU of the decoded
+ * outputs doesn't need to care about reorgs.
+ */
+namespace Prevouts {
+
+    /** Add the previous outputs of the inputs of all transactions to mapPrevouts, false if one is missing. */
+    bool Resolve(const std::vector<const CTransaction*> &vecTx, std::map<COutPoint, CTxOut> &mapPrevouts);
+}
+
+/** cs_main lock of the SAPI handlers, the time it waits for the lock counts as LockWait. */
+class MainLock
+{
+    int64_t nStart;
+    CCriticalBlock lock;
+
+public:
+    MainLock(const char *pszFile, int nLine) :
+        nStart(GetTimeMicros()), lock(cs_main, "cs_main", pszFile, nLine)
+    {
+        Timing::Add(Timing::LockWait, GetTimeMicros() - nStart);
+    }
+};
+#define SAPI_LOCK_MAIN() SAPI::MainLock PASTE2(sapimainlock, __COUNTER__)(__FILE__, __LINE__)
+
 void AddWhitelistedRange(const CSubNet &subnet);
 bool IsWhitelistedRange(const CNetAddr &address);
 
 void AddDefaultHeaders(HTTPRequest* req);
+/** Check if the reply of the request gets captured as part of a /batch request. */
+bool IsCaptured(const HTTPRequest *req);
+/** Check if the body of the request is sent as application/octet-stream. */
+bool IsBinaryBody(HTTPRequest *req);
 
 bool Error(HTTPRequest* req, HTTPStatus::Codes status, const std::string &message);
 bool Error(HTTPRequest* req, HTTPStatus::Codes status, const SAPI::Result &error);
@@ -350,9 +591,52 @@ void WriteReply(HTTPRequest *req, HTTPStatus::Codes status, const std::string &s
 void WriteReply(HTTPRequest *req, const UniValue& obj);
 void WriteReply(HTTPRequest *req, const std::string &str);
 
-bool CheckWarmup(HTTPRequest* req);
+/** Compact JSON reply which gets written while it is built instead of as one UniValue tree.
+ *
+ * The output is buffered and only sent with chunked transfer encoding once it reaches
+ * nChunkSize, smaller replies go out as one. Until the first chunk is sent a handler can
+ * still fail with Error, afterwards Error just ends the incomplete reply. A started
+ * reply which doesn't get finished is ended by the HTTPRequest.
+ */
+class JSONStream{
+
+    HTTPRequest *req;
+    std::string strBuffer;
+    //! Closing bracket of every open array or object and whether it got a value already
+    std::vector<std::pair<char, bool>> vecOpen;
+    bool fStarted;
+    bool fFinished;
+
+    void Separator();
+    void Key(const std::string &key);
+    void Flush();
+
+public:
+
+    static const size_t nChunkSize = 64 * 1024;
+
+    explicit JSONStream(HTTPRequest *req) : req(req), fStarted(false), fFinished(false) {}
+
+    void BeginArray();
+    void BeginArray(const std::string &key);
+    void BeginObject();
+    void BeginObject(const std::string &key);
+    /** Close the innermost open array or object. */
+    void End();
+
+    void Push(const UniValue &value);
+    void Push(const std::string &key, const UniValue &value);
+
+    bool IsStarted() const { return fStarted; }
+
+    /** Close all open arrays and objects and send the rest of the reply. */
+    void Finish();
+    bool Error(SAPI::Codes code, const std::string &message);
+};
 
-SAPI::Limits::Client *GetClientLimiter(const CService &peer);
+bool CheckWarmup(HTTPRequest* req);
+/** Error reply while the background index builder didn't reach the tip with the index yet. */
+bool CheckIndexReady(HTTPRequest* req, IndexBuilderIndex index);
 
 int64_t GetStartTime();
 
@@ -384,7 +668,7 @@ void InterruptSAPI();
 void StopSAPI();
 
 /** Handler for requests to a certain HTTP path */
-typedef std::function<bool(HTTPRequest*, const std::map<std::string, std::string> &, const SAPI::Endpoint *)> SAPIRequestHandler;
+typedef std::function<bool(HTTPRequest*, const std::map<std::string, std::string> &, const SAPI::Endpoint *, int64_t)> SAPIRequestHandler;
 
 /** SAPI request work item */
 class SAPIWorkItem : public HTTPClosure
@@ -393,20 +677,163 @@ public:
     SAPIWorkItem(std::unique_ptr<HTTPRequest> req,
                  const std::map<std::string, std::string> &mapPathParams,
                  const SAPI::Endpoint *endpoint, const SAPIRequestHandler& func):
-        req(std::move(req)), mapPathParams(mapPathParams), endpoint(endpoint), func(func)
+        req(std::move(req)), mapPathParams(mapPathParams), endpoint(endpoint), func(func), nTimeQueued(GetTimeMicros())
     {
     }
     void operator()()
     {
-        func(req.get(), mapPathParams, endpoint);
+        func(req.get(), mapPathParams, endpoint, nTimeQueued);
+        // Long-poll requests outlive the work item
+        SAPI::Poll::Adopt(req);
     }
 
+    SAPI::CostClass GetCostClass() const { return endpoint->cost; }
+
     std::unique_ptr<HTTPRequest> req;
 
 private:
     const std::map<std::string, std::string> mapPathParams;
     const SAPI::Endpoint *endpoint;
     SAPIRequestHandler func;
+    int64_t nTimeQueued;
+};
+
+/** Work queue with one lane per endpoint cost class, run on the shared task pool.
+ *
+ * Each lane has its own depth so a burst of expensive queries can't get cheap requests
+ * rejected. At most numSlots items run at the same time, the slots pick the lanes by
+ * smooth weighted round robin and expensive items never occupy all slots at once, a slot
+ * is always left for the other lanes.
+ */
+class CSAPIWorkQueue
+{
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    std::deque<std::unique_ptr<SAPIWorkItem>> lanes[SAPI::CostClassCount];
+    int nCredits[SAPI::CostClassCount];
+    bool running;
+    size_t maxDepth;
+    CTaskPool &pool;
+    int numSlots;
+    int numRunning;
+    int numExpensive;
+
+    static int Weight(int nLane)
+    {
+        static const int nWeights[SAPI::CostClassCount] = {4, 8, 1};
+        return nWeights[nLane];
+    }
+
+    bool Eligible(int nLane) const
+    {
+        return !lanes[nLane].empty() &&
+               (nLane != SAPI::CostExpensive || numSlots < 2 || numExpensive < numSlots - 1);
+    }
+
+    /** Pick the next lane to serve, -1 if there is nothing to do. Requires cs. */
+    int Select()
+    {
+        int nBest = -1, nTotal = 0;
+
+        for( int i = 0; i < SAPI::CostClassCount; i++ ){
+            if( !Eligible(i) ) continue;
+            nCredits[i] += Weight(i);
+            nTotal += Weight(i);
+            if( nBest < 0 || nCredits[i] > nCredits[nBest] ) nBest = i;
+        }
+
+        if( nBest >= 0 ) nCredits[nBest] -= nTotal;
+
+        return nBest;
+    }
+
+    /** Pool task of a slot, runs one item and queues itself again for the next one */
+    void RunNext()
+    {
+        std::unique_ptr<SAPIWorkItem> i;
+        int nLane;
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            if (!running || (nLane = Select()) < 0) {
+                numRunning -= 1;
+                cond.notify_all();
+                return;
+            }
+            if (nLane == SAPI::CostExpensive)
+                numExpensive += 1;
+            i = std::move(lanes[nLane].front());
+            lanes[nLane].pop_front();
+        }
+        try {
+            (*i)();
+        } catch (...) {
+            Finished(nLane);
+            throw;
+        }
+        Finished(nLane);
+    }
+
+    /** Release the item of a slot and queue the slot for the next one */
+    void Finished(int nLane)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            // Done with the item, this can make the expensive lane eligible again.
+            if (nLane == SAPI::CostExpensive)
+                numExpensive -= 1;
+        }
+        pool.Submit(CTaskPool::PRIORITY_NORMAL, std::bind(&CSAPIWorkQueue::RunNext, this));
+    }
+
+public:
+    CSAPIWorkQueue(size_t maxDepth, CTaskPool &pool, int numSlots) : running(true),
+                                                                   maxDepth(maxDepth),
+                                                                   pool(pool),
+                                                                   numSlots(numSlots),
+                                                                   numRunning(0),
+                                                                   numExpensive(0)
+    {
+        for( int i = 0; i < SAPI::CostClassCount; i++ ) nCredits[i] = 0;
+    }
+    /** Enqueue a work item into the lane of its cost class */
+    bool Enqueue(SAPIWorkItem* item)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            std::deque<std::unique_ptr<SAPIWorkItem>> &lane = lanes[item->GetCostClass()];
+            if (!running || lane.size() >= maxDepth) {
+                return false;
+            }
+            lane.emplace_back(std::unique_ptr<SAPIWorkItem>(item));
+            // A free slot takes the item, otherwise a busy one gets to it
+            if (numRunning >= numSlots)
+                return true;
+            numRunning += 1;
+        }
+        pool.Submit(CTaskPool::PRIORITY_NORMAL, std::bind(&CSAPIWorkQueue::RunNext, this));
+        return true;
+    }
+    /** Interrupt and exit loops */
+    void Interrupt()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        running = false;
+        cond.notify_all();
+    }
+    /** Wait for the running items to finish */
+    void WaitExit()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (numRunning > 0)
+            cond.wait(lock);
+    }
+    /** Return current depth of a lane */
+    size_t Depth(SAPI::CostClass cost)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        return lanes[cost].size();
+    }
 };
 
 struct CSAPIRequestCount{
@@ -415,6 +842,8 @@ struct CSAPIRequestCount{
     uint64_t nValid;
     uint64_t nInvalid;
     uint64_t nBlocked;
+    uint64_t nConnections;
+    uint64_t nReused;
     CSAPIRequestCount(){ Reset(); }
 
 
@@ -427,6 +856,8 @@ struct CSAPIRequestCount{
         READWRITE(nValid);
         READWRITE(nInvalid);
         READWRITE(nBlocked);
+        READWRITE(nConnections);
+        READWRITE(nReused);
     }
 
     uint64_t GetTotalRequests(){
@@ -439,6 +870,65 @@ struct CSAPIRequestCount{
         nValid = 0;
         nInvalid = 0;
         nBlocked = 0;
+        nConnections = 0;
+        nReused = 0;
+    }
+};
+
+/** HyperLogLog sketch to estimate the number of distinct clients within an hour. */
+class CSAPIClientEstimator
+{
+    static const int nRegisterBits = 10;
+
+    std::vector<unsigned char> vecRegisters;
+
+public:
+
+    CSAPIClientEstimator() : vecRegisters(1 << nRegisterBits, 0) {}
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(vecRegisters);
+
+        if( ser_action.ForRead() && vecRegisters.size() != (1 << nRegisterBits) )
+            Clear();
+    }
+
+    /** Add a client by a uniformly distributed hash of its address. */
+    void Add(uint64_t nHash);
+    void Merge(const CSAPIClientEstimator &other);
+    uint64_t Estimate() const;
+    void Clear();
+
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vecRegisters); }
+};
+
+/** Requests counted by one stripe of CSAPIStatistics since they were merged last time. */
+struct CSAPIRequestStripe{
+    int64_t nStartTimestamp;
+    uint64_t nValid;
+    uint64_t nInvalid;
+    uint64_t nBlocked;
+    //! Requests which opened a new connection and requests on a kept-alive one
+    uint64_t nConnections;
+    uint64_t nReused;
+    CSAPIClientEstimator clients;
+    CSAPIRequestStripe(){ Reset(); }
+
+    bool IsEmpty() const {
+        return nStartTimestamp == 0;
+    }
+
+    void Reset(){
+        nStartTimestamp = 0;
+        nValid = 0;
+        nInvalid = 0;
+        nBlocked = 0;
+        nConnections = 0;
+        nReused = 0;
+        clients.Clear();
     }
 };
 
@@ -446,6 +936,12 @@ class CSAPIStatistics
 {
     const int nSecondsPerHour = 60*60;
     const int nCountLastHours = 24;
+    static const int nStripes = 16;
+
+    struct Stripe{
+        CCriticalSection cs;
+        CSAPIRequestStripe requests;
+    };
 
     int nLastHour;
 
@@ -453,16 +949,30 @@ class CSAPIStatistics
     uint64_t nTotalBlockedRequests;
     uint64_t nTotalInvalidRequests;
 
+    uint64_t nTotalConnections;
+    uint64_t nTotalReusedRequests;
+
     uint64_t nMaxRequestsPerHour;
     uint64_t nMaxClientsPerHour;
 
-    std::set<CNetAddr> setCurrentClients;
+    CSAPIClientEstimator currentClients;
     std::vector<CSAPIRequestCount> vecRequests;
 
     std::vector<int64_t> vecRestarts;
 
     CCriticalSection cs_requests;
 
+    // Requests get counted in the stripe of their address and only merged into
+    // the hours above by the first request of a stripe in a new hour and by readers.
+    Stripe stripes[nStripes];
+
+    void Merge();
+    void Advance(int64_t nStartTimestamp);
+    void Apply(const CSAPIRequestStripe &requests);
+
+    template <typename Func>
+    void Count(const CNetAddr &address, Func count);
+
 public:
 
     enum RequestType{
@@ -477,33 +987,48 @@ public:
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        LOCK(cs_requests);
+        if( !ser_action.ForRead() )
+            Merge();
         READWRITE(nLastHour);
         READWRITE(nTotalValidRequests);
         READWRITE(nTotalBlockedRequests);
         READWRITE(nTotalInvalidRequests);
+        READWRITE(nTotalConnections);
+        READWRITE(nTotalReusedRequests);
         READWRITE(nMaxRequestsPerHour);
         READWRITE(nMaxClientsPerHour);
-        READWRITE(setCurrentClients);
+        READWRITE(currentClients);
         READWRITE(vecRequests);
         READWRITE(vecRestarts);
     }
 
-    void init();
-    void request(CNetAddr& address, RequestType type);
+    void init(int64_t nStartTimestamp);
+    void request(const CNetAddr& address, RequestType type);
+    /** Count a request by its connection, fReused if the connection served a request before. */
+    void connection(const CNetAddr& address, bool fReused);
     void reset();
 
     int GetCurrentHour();
     int GetCurrentStartTimestamp();
 
+    /** Merge the counts of the stripes, the getters of the totals don't. */
+    void Update(){ LOCK(cs_requests); Merge(); }
+
     uint64_t GetTotalValidRequests(){ return nTotalValidRequests; }
     uint64_t GetTotalInvalidRequests(){ return nTotalInvalidRequests; }
     uint64_t GetTotalBlockedRequests(){ return nTotalBlockedRequests; }
 
+    uint64_t GetTotalConnections(){ return nTotalConnections; }
+    uint64_t GetTotalReusedRequests(){ return nTotalReusedRequests; }
+
     uint64_t GetMaxRequestsPerHour(){ return nMaxRequestsPerHour; }
     uint64_t GetMaxClientsPerHour(){ return nMaxClientsPerHour; }
 
     UniValue ToUniValue();
     std::string ToString() const;
+    /** Heap usage of the hourly counts, the restarts and the client estimators. */
+    size_t DynamicMemoryUsage();
 
     // Dummies..for the flatDB.
     void CheckAndRemove(){}
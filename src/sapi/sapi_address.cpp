@@ -11,6 +11,7 @@
 #include "sapi_validation.h"
 #include "sapi/sapi_address.h"
 #include "smarthive/hive.h"
+#include "smartmining/miningpayments.h"
 #include "smartnode/instantx.h"
 #include "txdb.h"
 #include "random.h"
@@ -30,80 +31,71 @@ struct CAddressBalance
 };
 
 
-bool amountSortLTH(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
-                std::pair<CAddressUnspentKey, CAddressUnspentValue> b)
-{
-    return a.second.satoshis < b.second.satoshis;
-}
-
-bool amountSortHTL(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
-                std::pair<CAddressUnspentKey, CAddressUnspentValue> b)
-{
-    return a.second.satoshis > b.second.satoshis;
-}
-
 bool spendingSort(std::pair<CAddressIndexKey, CAmount> a,
                 std::pair<CAddressIndexKey, CAmount> b) {
     return a.first.spending != b.first.spending;
 }
 
 
-bool IsTimeLocked(HTTPRequest* req, int blockHeight, const uint256 &txhash, const CSmartAddress &address, bool &locked) {
-    // Get block
-    CBlock block;
-    CBlockIndex* pBlockindex = chainActive[blockHeight];
-    if (!ReadBlockFromDisk(block, pBlockindex, Params().GetConsensus())) {
-        return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
-    }
+/** Lock state of time locked outputs at the current tip.
+ *
+ * The lock time is part of the output script, which the address unspent index stores
+ * along with the amount. So the state of an unspent output doesn't need its block.
+ */
+class CTimeLockState
+{
+    int nCurrentHeight;
+    int64_t nCurrentTime;
 
-    // Find TX inside the block
-    auto tx = std::find_if(block.vtx.begin(), block.vtx.end(), [&txhash] (const CTransaction &t) {
-        return txhash == t.GetHash();
-    });
+public:
 
-    if (tx == block.vtx.end()) {
-        return SAPI::Error(req, SAPI::TxNotFound, "Can't find Tx ID in block");
+    CTimeLockState()
+    {
+        SAPI_LOCK_MAIN();
+        nCurrentHeight = chainActive.Height();
+        nCurrentTime = chainActive.Tip() ? chainActive.Tip()->GetMedianTimePast() : GetTime();
     }
 
-    // Find output based on the address
-    auto vout = std::find_if(tx->vout.begin(), tx->vout.end(), [&address] (const CTxOut &output) {
-        CTxDestination addr;
-        if (!ExtractDestination(output.scriptPubKey, addr)) {
-            return false;
-        }
-        return CSmartAddress(addr) == address;
-    });
-
-    locked = false;
-
-    // If no output script matched destination address, just don't consider it locked
-    if (vout == tx->vout.end()) {
-        return true;
-    }
+    bool IsLocked(const CAddressUnspentValue &value) const
+    {
+        uint32_t nLockTime = CTxOut(value.satoshis, value.script).GetLockTime();
 
-    uint32_t nLockTime = vout->GetLockTime();
-    if (nLockTime) {
-        int nCurrentHeight = chainActive.Height();
-        int64_t nCurrentTime = chainActive.Tip() ? chainActive.Tip()->GetMedianTimePast() : GetTime();
-        if ((nLockTime < LOCKTIME_THRESHOLD && nCurrentHeight < nLockTime ) ||
-            (nLockTime >= LOCKTIME_THRESHOLD && nCurrentTime < nLockTime )) {
-            // Time locked transaction that has not expired yet
-            locked = true;
-        }
+        // Time locked outputs which have not expired yet
+        return nLockTime && ((nLockTime < LOCKTIME_THRESHOLD && nCurrentHeight < (int64_t)nLockTime) ||
+                             (nLockTime >= LOCKTIME_THRESHOLD && nCurrentTime < nLockTime));
     }
-
-    return true;
-}
+};
 
 
 static bool address_balance(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool address_balances(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool address_deposit(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool address_payouts(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool address_utxos(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool address_utxos_amount(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool address_transaction(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool address_transactions(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool address_mempool(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool address_poll(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+/** Index keys of the addresses without duplicates. */
+static bool GetAddressIndexKeys(HTTPRequest* req, const UniValue &arrAddresses, std::vector<std::pair<uint160, int> > &addresses)
+{
+    for (const UniValue &addr : arrAddresses.getValues()) {
+        uint160 hashBytes;
+        int type = 0;
+
+        if (!CBitcoinAddress(addr.get_str()).GetIndexKey(hashBytes, type)) {
+            return SAPI::Error(req, SAPI::InvalidSmartCashAddress, "Invalid address: " + addr.get_str());
+        }
+
+        if (std::find(addresses.begin(), addresses.end(), std::make_pair(hashBytes, type)) == addresses.end())
+            addresses.push_back(std::make_pair(hashBytes, type));
+    }
+
+    return true;
+}
+
+static bool address_mempool_multi(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 
 SAPI::EndpointGroup addressEndpoints = {
     "address",
@@ -112,13 +104,15 @@ SAPI::EndpointGroup addressEndpoints = {
             "balance/{address}", HTTPRequest::GET, UniValue::VNULL, address_balance,
             {
                 // No body parameter
-            }
+            },
+            SAPI::CostCritical
         },
         {
             "balances", HTTPRequest::POST, UniValue::VARR, address_balances,
             {
                 // No body parameter
-            }
+            },
+            SAPI::CostExpensive
         },
         {
             "deposit", HTTPRequest::POST, UniValue::VOBJ, address_deposit,
@@ -129,7 +123,19 @@ SAPI::EndpointGroup addressEndpoints = {
                 SAPI::BodyParameter(SAPI::Keys::pageNumber,     new SAPI::Validation::IntRange(1,INT_MAX)),
                 SAPI::BodyParameter(SAPI::Keys::pageSize,       new SAPI::Validation::IntRange(1,1000)),
                 SAPI::BodyParameter(SAPI::Keys::ascending,      new SAPI::Validation::Bool(), true),
-            }
+            },
+            SAPI::CostExpensive
+        },
+        {
+            "payouts", HTTPRequest::POST, UniValue::VOBJ, address_payouts,
+            {
+                SAPI::BodyParameter(SAPI::Keys::address,        new SAPI::Validation::SmartCashAddress()),
+                SAPI::BodyParameter(SAPI::Keys::heightFrom,     new SAPI::Validation::UInt(), true),
+                SAPI::BodyParameter(SAPI::Keys::heightTo,       new SAPI::Validation::UInt(), true),
+                SAPI::BodyParameter(SAPI::Keys::category,       new SAPI::Validation::PayoutCategories(), true),
+                SAPI::BodyParameter(SAPI::Keys::pageSize,       new SAPI::Validation::IntRange(1,1000)),
+            },
+            SAPI::CostExpensive
         },
         {
             "unspent", HTTPRequest::POST, UniValue::VOBJ, address_utxos,
@@ -137,7 +143,8 @@ SAPI::EndpointGroup addressEndpoints = {
                 SAPI::BodyParameter(SAPI::Keys::address,        new SAPI::Validation::SmartCashAddress()),
                 SAPI::BodyParameter(SAPI::Keys::pageNumber,     new SAPI::Validation::IntRange(1,INT_MAX)),
                 SAPI::BodyParameter(SAPI::Keys::pageSize,       new SAPI::Validation::IntRange(1,1000))
-            }
+            },
+            SAPI::CostExpensive
         },
         {
             "unspent/amount", HTTPRequest::POST, UniValue::VOBJ, address_utxos_amount,
@@ -146,7 +153,8 @@ SAPI::EndpointGroup addressEndpoints = {
                 SAPI::BodyParameter(SAPI::Keys::amount,     new SAPI::Validation::AmountRange(1,MAX_MONEY)),
                 SAPI::BodyParameter(SAPI::Keys::random,     new SAPI::Validation::Bool(), true),
                 SAPI::BodyParameter(SAPI::Keys::instantpay, new SAPI::Validation::Bool(), true)
-            }
+            },
+            SAPI::CostExpensive
         },
         {
             "transaction/{address}", HTTPRequest::GET, UniValue::VNULL, address_transaction,
@@ -155,17 +163,20 @@ SAPI::EndpointGroup addressEndpoints = {
 //                SAPI::BodyParameter(SAPI::Keys::pageSize,    new SAPI::Validation::IntRange(1,100)),
 //                SAPI::BodyParameter(SAPI::Keys::ascending,   new SAPI::Validation::Bool(), true),
 //                SAPI::BodyParameter(SAPI::Keys::direction,   new SAPI::Validation::TxDirection(), true)
-            }
+            },
+            SAPI::CostExpensive
         },
         {
             "transactions", HTTPRequest::POST, UniValue::VOBJ, address_transactions,
             {
                 SAPI::BodyParameter(SAPI::Keys::address,     new SAPI::Validation::SmartCashAddress()),
-                SAPI::BodyParameter(SAPI::Keys::pageNumber,  new SAPI::Validation::IntRange(1,INT_MAX)),
+                SAPI::BodyParameter(SAPI::Keys::pageNumber,  new SAPI::Validation::IntRange(1,INT_MAX), true),
                 SAPI::BodyParameter(SAPI::Keys::pageSize,    new SAPI::Validation::IntRange(1,100)),
                 SAPI::BodyParameter(SAPI::Keys::ascending,   new SAPI::Validation::Bool(), true),
-                SAPI::BodyParameter(SAPI::Keys::direction,   new SAPI::Validation::TxDirection(), true)
-            }
+                SAPI::BodyParameter(SAPI::Keys::direction,   new SAPI::Validation::TxDirection(), true),
+                SAPI::BodyParameter(SAPI::Keys::cursor,      new SAPI::Validation::TxCursor(), true)
+            },
+            SAPI::CostExpensive
         },
         {
             "mempool/{address}", HTTPRequest::GET, UniValue::VNULL, address_mempool,
@@ -176,18 +187,76 @@ SAPI::EndpointGroup addressEndpoints = {
 //                SAPI::BodyParameter(SAPI::Keys::ascending,   new SAPI::Validation::Bool(), true),
 //                SAPI::BodyParameter(SAPI::Keys::direction,   new SAPI::Validation::TxDirection(), true)
             }
+        },
+        {
+            "mempool", HTTPRequest::POST, UniValue::VOBJ, address_mempool_multi,
+            {
+                SAPI::BodyParameter(SAPI::Keys::addresses,      new SAPI::Validation::SmartCashAddresses()),
+                SAPI::BodyParameter(SAPI::Keys::timestampFrom,  new SAPI::Validation::UInt(), true)
+            }
+        },
+        {
+            "poll", HTTPRequest::POST, UniValue::VOBJ, address_poll,
+            {
+                SAPI::BodyParameter(SAPI::Keys::addresses,      new SAPI::Validation::SmartCashAddresses()),
+                SAPI::BodyParameter(SAPI::Keys::timeout,        new SAPI::Validation::IntRange(1, SAPI_POLL_MAX_TIMEOUT), true)
+            }
         }
     }
 };
 
-bool timestampSorta(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
-                   std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> b) {
-    return a.second.time < b.second.time;
+static bool AddressMempoolDeltasToJSON(HTTPRequest* req, const std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>> &indexes, UniValue &result)
+{
+    std::string address;
+
+    for (const auto &it : indexes) {
+
+        if (!getAddressFromIndex(it.first.type, it.first.addressBytes, address)) {
+            return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "Unknown address type");
+        }
+
+        UniValue delta(UniValue::VOBJ);
+        delta.push_back(Pair("address", address));
+        delta.push_back(Pair("txid", it.first.txhash.GetHex()));
+        delta.push_back(Pair("index", (int)it.first.index));
+        delta.push_back(Pair("satoshis", it.second.amount));
+        delta.push_back(Pair("timestamp", it.second.time));
+        if (it.second.amount < 0) {
+            delta.push_back(Pair("prevtxid", it.second.prevhash.GetHex()));
+            delta.push_back(Pair("prevout", (int)it.second.prevout));
+        }
+        result.push_back(delta);
+    }
+
+    return true;
+}
+
+static bool address_poll(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    // The reply of a batch gets written when all of its requests are done.
+    if (SAPI::IsCaptured(req)) {
+        return SAPI::Error(req, SAPI::BatchRequestInvalid, "Long-poll requests can't be part of a batch");
+    }
+
+    std::vector<std::pair<uint160, int> > addresses;
+
+    if (!GetAddressIndexKeys(req, bodyParameter[SAPI::Keys::addresses], addresses)) {
+        return false;
+    }
+
+    int64_t nTimeout = bodyParameter.exists(SAPI::Keys::timeout) ? bodyParameter[SAPI::Keys::timeout].get_int64() : SAPI_POLL_DEFAULT_TIMEOUT;
+
+    // The spent index gives the addresses of the inputs
+    if (!SAPI::CheckIndexReady(req, INDEX_BUILD_SPENT)) {
+        return false;
+    }
+
+    // Replied by the poll thread once one of the addresses sees activity or the timeout expires.
+    return SAPI::Poll::Wait(req, addresses, nTimeout);
 }
 
 static bool GetAddressMempool(HTTPRequest* req, const std::string &addr, UniValue &result)
 {
-    std::string address;
     uint160 hashBytes;
     int type = 0;
 
@@ -199,34 +268,13 @@ static bool GetAddressMempool(HTTPRequest* req, const std::string &addr, UniValu
         {hashBytes, type}
     };
 
+    // The mempool keeps the deltas of every address in time order already.
     std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>> indexes;
-    if (!mempool.getAddressIndex(addresses, indexes)) {
+    if (!mempool.getAddressIndexByTime(addresses, indexes)) {
         return SAPI::Error(req, SAPI::AddressNotFound, "No information available for address in the mempool");
     }
 
-    std::sort(indexes.begin(), indexes.end(), timestampSorta);
-
-    for (std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >::iterator it = indexes.begin();
-        it != indexes.end(); it++) {
-
-        if (!getAddressFromIndex(it->first.type, it->first.addressBytes, address)) {
-            return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "Unknown address type");
-        }
-
-        UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("address", address));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("satoshis", it->second.amount));
-        delta.push_back(Pair("timestamp", it->second.time));
-        if (it->second.amount < 0) {
-            delta.push_back(Pair("prevtxid", it->second.prevhash.GetHex()));
-            delta.push_back(Pair("prevout", (int)it->second.prevout));
-        }
-        result.push_back(delta);
-    }
-
-    return true;
+    return AddressMempoolDeltasToJSON(req, indexes, result);
 }
 
 static bool GetAddressMempoolFull(HTTPRequest* req, const std::string &addr, UniValue &result)
@@ -245,12 +293,10 @@ static bool GetAddressMempoolFull(HTTPRequest* req, const std::string &addr, Uni
     };
 
     std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>> indexes;
-    if (!mempool.getAddressIndex(addresses, indexes)) {
+    if (!mempool.getAddressIndexByTime(addresses, indexes)) {
         return SAPI::Error(req, SAPI::AddressNotFound, "No information available for address in the mempool");
     }
 
-    std::sort(indexes.begin(), indexes.end(), timestampSorta);
-
     for (std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >::iterator it = indexes.begin();
         it != indexes.end(); it++) {
 
@@ -280,6 +326,7 @@ static bool GetAddressesBalances(HTTPRequest* req,
 {
     SAPI::Codes code = SAPI::Valid;
     std::vector<SAPI::Result> errors;
+    CTimeLockState lockState;
 
     vecBalances.clear();
 
@@ -296,38 +343,57 @@ static bool GetAddressesBalances(HTTPRequest* req,
             continue;
         }
 
-        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-        if (!GetAddressIndex(hashBytes, type, addressIndex)) {
-            code = SAPI::AddressNotFound;
-            std::string message = "No information available for " + addrStr;
-            errors.push_back(SAPI::Result(code, message));
-            continue;
-        }
-
         CAmount balance = 0;
         CAmount locked = 0;
         CAmount received = 0;
         CAmount unconfirmed = 0;
 
-        for (const auto &addr : addressIndex) {
-            const auto &key = addr.first;
-            const auto &value = addr.second;
+        if( fBalanceIndex ){
 
-            // Figure out if utxo is spendable (i.e. not time locked)
-            bool fLocked = false;
-            if (!IsTimeLocked(req, key.blockHeight, key.txhash, address, fLocked)) {
-                return false;
+            // The maintained totals spare the walk over the whole history of the address.
+            CAddressBalanceValue value;
+
+            if (!GetAddressBalance(hashBytes, type, value)) {
+                code = SAPI::AddressNotFound;
+                std::string message = "No information available for " + addrStr;
+                errors.push_back(SAPI::Result(code, message));
+                continue;
+            }
+
+            balance = value.balance;
+            received = value.received;
+
+        }else{
+
+            std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+
+            if (!GetAddressIndex(hashBytes, type, addressIndex)) {
+                code = SAPI::AddressNotFound;
+                std::string message = "No information available for " + addrStr;
+                errors.push_back(SAPI::Result(code, message));
+                continue;
             }
 
-            if (fLocked) {
-                locked += value;
+            for (const auto &addr : addressIndex) {
+                const auto &value = addr.second;
+
+                if (value > 0) {
+                    received += value;
+                }
+                balance += value;
             }
+        }
 
-            if (value > 0) {
-                received += value;
+        // Time locked outputs can't be spent before they expire, so all of them are still in
+        // the unspent index which carries their scripts.
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+
+        if (GetAddressUnspent(hashBytes, type, unspentOutputs)) {
+            for (const auto &unspent : unspentOutputs) {
+                if (lockState.IsLocked(unspent.second)) {
+                    locked += unspent.second.satoshis;
+                }
             }
-            balance += value;
         }
 
         std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > mempoolDelta;
@@ -369,9 +435,10 @@ static bool GetAddressesBalances(HTTPRequest* req,
 
 static bool GetAddressesTransactions(HTTPRequest* req, std::string addrStr,
     std::vector<std::tuple<uint256, int, CAmount>> &addressTxs, int64_t pageNum, int64_t pageSize,
-    bool ascending, int64_t &totalNumTxs)
+    bool ascending, int64_t &totalNumTxs, const std::string &strCursor, std::string &strNextCursor)
 {
     addressTxs.clear();
+    strNextCursor.clear();
 
     CBitcoinAddress address(addrStr);
     uint160 hashBytes;
@@ -381,36 +448,29 @@ static bool GetAddressesTransactions(HTTPRequest* req, std::string addrStr,
         return SAPI::Error(req, SAPI::InvalidSmartCashAddress, "Invalid address: " + addrStr);
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
+    // With a cursor the page starts right after the transaction it points to, no matter
+    // how deep in the history that is. Otherwise the page number decides how many to skip.
+    int nCursorHeight = 0;
+    uint256 cursorTx;
+    int64_t nSkip = 0;
 
-    if (!GetAddressIndex(hashBytes, type, addressIndex)) {
-        return SAPI::Error(req, SAPI::AddressNotFound, "No information available for " + addrStr);
+    if (!strCursor.empty()) {
+        if (!SAPI::Validation::ParseTxCursor(strCursor, nCursorHeight, cursorTx)) {
+            return SAPI::Error(req, SAPI::InvalidCursor, SAPI::Validation::ResultMessage(SAPI::InvalidCursor));
+        }
+    } else {
+        nSkip = (pageNum - 1) * pageSize;
     }
 
-    if (!ascending) {
-        // Reverse index from newest to oldest transactions
-        std::reverse(addressIndex.begin(), addressIndex.end());
+    bool fMore = false;
+
+    if (!GetAddressTransactions(hashBytes, type, ascending, nCursorHeight, cursorTx, nSkip, pageSize, addressTxs, fMore) ||
+        !GetAddressTransactionCount(hashBytes, type, totalNumTxs)) {
+        return SAPI::Error(req, SAPI::AddressNotFound, "No information available for " + addrStr);
     }
 
-    totalNumTxs = 0;
-    int nIndexOffset = static_cast<int>((pageNum - 1) * pageSize);
-    auto tx = addressIndex.begin();
-    while (tx != addressIndex.end()) {
-        // If we have multiple entries for the same tx, add up all amounts
-        auto found = std::find_if(addressTxs.begin(), addressTxs.end(),
-            [&tx] (const std::tuple<uint256, int, CAmount> &t) {
-                return std::get<0>(t) == tx->first.txhash;
-        });
-
-        if (found == addressTxs.end()) {
-            if ((std::distance(addressIndex.begin(), tx) >= nIndexOffset) && static_cast<int64_t>(addressTxs.size()) < pageSize) {
-                addressTxs.emplace_back(tx->first.txhash, tx->first.blockHeight, tx->second);
-            }
-            totalNumTxs++;
-        } else {
-            std::get<2>(*found) += tx->second;
-        }
-        tx++;
+    if (fMore && !addressTxs.empty()) {
+        strNextCursor = strprintf("%d:%s", std::get<1>(addressTxs.back()), std::get<0>(addressTxs.back()).ToString());
     }
 
     return true;
@@ -434,6 +494,34 @@ static bool address_mempool(HTTPRequest* req, const std::map<std::string, std::s
     return true;
 }
 
+static bool address_mempool_multi(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    const UniValue &arrAddresses = bodyParameter[SAPI::Keys::addresses];
+    int64_t nStartTime = bodyParameter.exists(SAPI::Keys::timestampFrom) ? bodyParameter[SAPI::Keys::timestampFrom].get_int64() : 0;
+
+    std::vector<std::pair<uint160, int> > addresses;
+
+    if (!GetAddressIndexKeys(req, arrAddresses, addresses)) {
+        return false;
+    }
+
+    // One mempool lock for all addresses, each of them in time order. Pollers pass the
+    // timestamp of the last delta they have seen to only get what entered since.
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>> indexes;
+    if (!mempool.getAddressIndexByTime(addresses, indexes, nStartTime)) {
+        return SAPI::Error(req, SAPI::AddressNotFound, "No information available for the addresses in the mempool");
+    }
+
+    UniValue result(UniValue::VARR);
+    if (!AddressMempoolDeltasToJSON(req, indexes, result)) {
+        return false;
+    }
+
+    SAPI::WriteReply(req, result);
+
+    return true;
+}
+
 static bool GetUTXOCount(HTTPRequest* req, const CBitcoinAddress& address, int &count, CAddressUnspentKey &lastIndex){
 
     uint160 hashBytes;
@@ -591,6 +679,9 @@ static bool address_deposit(HTTPRequest* req, const std::map<std::string, std::s
     int64_t nPageSize = bodyParameter[SAPI::Keys::pageSize].get_int64();
     bool fAsc = bodyParameter.exists(SAPI::Keys::ascending) ? bodyParameter[SAPI::Keys::ascending].get_bool() : false;
 
+    if (!SAPI::CheckIndexReady(req, INDEX_BUILD_DEPOSIT))
+        return false;
+
     if ( end <= start)
         return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "\"" + SAPI::Keys::timestampFrom + "\" is expected to be greater than \"" + SAPI::Keys::timestampTo + "\"");
 
@@ -671,6 +762,74 @@ static bool address_deposit(HTTPRequest* req, const std::map<std::string, std::s
     return true;
 }
 
+static bool address_payouts(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    std::string addrStr = bodyParameter[SAPI::Keys::address].get_str();
+    int64_t nFrom = bodyParameter.exists(SAPI::Keys::heightFrom) ? bodyParameter[SAPI::Keys::heightFrom].get_int64() : 0;
+    int64_t nTo = bodyParameter.exists(SAPI::Keys::heightTo) ? bodyParameter[SAPI::Keys::heightTo].get_int64() : INT_MAX;
+    int64_t nPageSize = bodyParameter[SAPI::Keys::pageSize].get_int64();
+    int nCategories = PAYOUT_ALL;
+
+    if (bodyParameter.exists(SAPI::Keys::category))
+        SmartMining::ParsePayoutCategories(bodyParameter[SAPI::Keys::category].get_str(), nCategories);
+
+    if (!SAPI::CheckIndexReady(req, INDEX_BUILD_PAYOUT))
+        return false;
+
+    nTo = std::min<int64_t>(nTo, INT_MAX);
+
+    if (nTo < nFrom)
+        return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "\"" + SAPI::Keys::heightTo + "\" is expected to be greater than or equal to \"" + SAPI::Keys::heightFrom + "\"");
+
+    CBitcoinAddress address(addrStr);
+    uint160 hashBytes;
+    int type = 0;
+
+    if (!address.GetIndexKey(hashBytes, type))
+        return SAPI::Error(req, HTTPStatus::BAD_REQUEST,"Invalid address: " + addrStr);
+
+    std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > payoutIndex;
+
+    if (!GetPayoutIndex(hashBytes, type, nFrom, nTo, nCategories, nPageSize, payoutIndex))
+        return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "No information available for " + addrStr);
+
+    UniValue arrPayouts(UniValue::VARR);
+    std::map<int, CAmount> mapTotals;
+
+    for (const auto &payout : payoutIndex) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("blockHeight", payout.first.blockHeight);
+        obj.pushKV("index", int64_t(payout.first.nOut));
+        obj.pushKV("category", SmartMining::PayoutCategoryName(payout.second.category));
+        obj.pushKV("amount", UniValueFromAmount(payout.second.satoshis));
+        arrPayouts.push_back(obj);
+
+        mapTotals[payout.second.category] += payout.second.satoshis;
+    }
+
+    UniValue objTotals(UniValue::VOBJ);
+    for (const auto &total : mapTotals)
+        objTotals.pushKV(SmartMining::PayoutCategoryName(total.first), UniValueFromAmount(total.second));
+
+    UniValue obj(UniValue::VOBJ);
+
+    obj.pushKV("address", addrStr);
+    obj.pushKV("count", (int64_t)payoutIndex.size());
+    obj.pushKV("totals", objTotals);
+    obj.pushKV("payouts", arrPayouts);
+
+    // Pages hold whole heights, a full one can be followed by more
+    int nLastHeight = payoutIndex.empty() ? -1 : payoutIndex.back().first.blockHeight;
+    if (payoutIndex.size() >= (size_t)nPageSize && nLastHeight < nTo)
+        obj.pushKV("nextHeight", nLastHeight + 1);
+    else
+        obj.pushKV("nextHeight", NullUniValue);
+
+    SAPI::WriteReply(req, obj);
+
+    return true;
+}
+
 static bool address_utxos(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
 {
     int64_t nTime0, nTime1, nTime2, nTime3, nTime4;
@@ -713,6 +872,7 @@ static bool address_utxos(HTTPRequest* req, const std::map<std::string, std::str
     nTime2 = GetTimeMicros();
 
     UniValue arrUtxos(UniValue::VARR);
+    CTimeLockState lockState;
 
     for (const auto &unspentOutput : unspentOutputs) {
         const auto &key = unspentOutput.first;
@@ -726,10 +886,7 @@ static bool address_utxos(HTTPRequest* req, const std::map<std::string, std::str
         bool fInMempool = mempool.getSpentIndex(spentKey, spentInfo);
 
         // Figure out if utxo is spendable (i.e. not time locked)
-        bool fLocked = true;
-        if (!IsTimeLocked(req, key.nBlockHeight, key.txhash, address, fLocked)) {
-            return false;
-        }
+        bool fLocked = lockState.IsLocked(value);
 
         output.pushKV("txid", key.txhash.GetHex());
         output.pushKV("index", static_cast<int>(key.index));
@@ -783,114 +940,141 @@ static bool address_utxos_amount(HTTPRequest* req, const std::map<std::string, s
     bool fInstantPay = bodyParameter.exists(SAPI::Keys::instantpay) ? bodyParameter[SAPI::Keys::instantpay].get_bool() : false;
 
     CSmartAddress address(addrStr);
-    CAddressUnspentKey lastIndex;
-    int nUtxoCount = 0;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
-    if( !GetUTXOCount(req, address, nUtxoCount, lastIndex ) ){
-        return false;
-    }
-
-    if (!nUtxoCount)
-        return SAPI::Error(req, SAPI::NoUtxosAvailble, "No unspent outputs available");
-
-    nTime1 = GetTimeMicros();
+    int64_t nHeight = chainActive.Height();
 
+    CUnspentSolution currentSolution, bestSolution;
+    CTimeLockState lockState;
     bool fTimedOut = false;
-    int nPages = nUtxoCount / nUtxosSlice;
-    if( nUtxoCount % nUtxosSlice ) nPages++;
-    int nPageStart = GetRand(nPages);
-    int nPageCurrent = nPageStart;
 
-    int64_t nHeight = chainActive.Height();
+    // Ignore time locked inputs, inputs currently used for tx in the mempool and inputs
+    // that are not valid for instantpay if instantpay is requested.
+    auto isSelectable = [&](const std::pair<CAddressUnspentKey, CAddressUnspentValue> &utxo) -> bool {
 
-    CUnspentSolution currentSolution, bestSolution;
+        if( lockState.IsLocked(utxo.second) )
+            return false;
 
-    do{
+        if( fInstantPay && (nHeight - utxo.first.nBlockHeight + 1) < INSTANTSEND_CONFIRMATIONS_REQUIRED )
+            return false;
 
-        int nIndexOffset = static_cast<int>( (nPageCurrent % nPages) * nUtxosSlice);
-        int nLimit = static_cast<int>( (nUtxoCount % nUtxosSlice) &&
-                                       (nPageCurrent % nPages) == nPages - 1 ? (nUtxoCount % nUtxosSlice) :
-                                                                    nUtxosSlice);
+        CSpentIndexValue spentInfo;
+        CSpentIndexKey spentKey(utxo.first.txhash, static_cast<unsigned int>(utxo.first.index));
 
-        if( !fRandom && GetTimeMicros() - nTime0 > nMatchTimeoutMicros )
-            break;
+        return !mempool.getSpentIndex(spentKey, spentInfo);
+    };
 
-        if( !GetUTXOs(req, address, unspentOutputs, CAddressUnspentKey(), nIndexOffset , nLimit) )
-            return false;
+    nTime1 = GetTimeMicros();
 
-        // Filter out utxos that are currently time-locked
-        for (auto it = unspentOutputs.begin(); it != unspentOutputs.end();) {
-            bool locked = false;
-            if (!IsTimeLocked(req, it->first.nBlockHeight, it->first.txhash, address, locked)) {
-                return false;
-            }
+    if( !fRandom ){ // Fewest utxo's, the largest ones first from the amount ordered index.
 
-            if (locked) {
-                it = unspentOutputs.erase(it);
-            } else {
-                ++it;
-            }
-        }
+        uint160 hashBytes;
+        int type = 0;
 
-        if( fRandom ){ // Pick random utxos until the amount is reached.
-            std::random_shuffle(unspentOutputs.begin(), unspentOutputs.end());
-        }else{ // Search a solution with fewest utxo's
-            std::sort(unspentOutputs.begin(), unspentOutputs.end(), amountSortHTL);
-        }
+        if( !address.GetIndexKey(hashBytes, type) )
+            return SAPI::Error(req, SAPI::InvalidSmartCashAddress, "Invalid address");
+
+        CAddressUnspentAmountKey cursor;
+        bool fFirst = true;
 
-        for (auto it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
+        do{
 
             if( GetTimeMicros() - nTime0 > nMatchTimeoutMicros ){
                 fTimedOut = true;
                 break;
             }
 
-            CSpentIndexValue spentInfo;
-            CSpentIndexKey spentKey(it->first.txhash, static_cast<unsigned int>(it->first.index));
+            unspentOutputs.clear();
 
-            // Ignore inputs currently used for tx in the mempool
-            // Ignore inputs that are not valid for instantpay if instantpay is requested
-            if (!mempool.getSpentIndex(spentKey, spentInfo) &&
-               ( ( !fInstantPay || ( fInstantPay && (nHeight - it->first.nBlockHeight + 1) >= INSTANTSEND_CONFIRMATIONS_REQUIRED ) ) )){
+            if( !GetAddressUnspentByAmount(hashBytes, type, unspentOutputs, cursor, nUtxosSlice) )
+                return SAPI::Error(req, SAPI::AddressNotFound, "No information available for address");
 
-                currentSolution.AddUtxo(*it);
-            }
+            if( fFirst && unspentOutputs.empty() )
+                return SAPI::Error(req, SAPI::NoUtxosAvailble, "No unspent outputs available");
 
-            if( currentSolution.amount >= expectedAmount + currentSolution.fee ){
+            fFirst = false;
 
-                if( currentSolution.amount == expectedAmount + currentSolution.fee ){
-                     currentSolution.change = 0;
-                }else{
-                    currentSolution.change = currentSolution.amount - expectedAmount - currentSolution.fee;
-                }
+            // Stops with the first output which covers the amount, the rest never gets read.
+            for( const std::pair<CAddressUnspentKey, CAddressUnspentValue> &utxo : unspentOutputs ){
 
-                if( bestSolution.IsNull() ||
-                    ( !fRandom && currentSolution.vecUtxos.size() < bestSolution.vecUtxos.size() ) ){ // Looking for fewest inputs
+                if( !isSelectable(utxo) )
+                    continue;
 
+                currentSolution.AddUtxo(utxo);
+
+                if( currentSolution.amount >= expectedAmount + currentSolution.fee ){
+                    currentSolution.change = currentSolution.amount - expectedAmount - currentSolution.fee;
                     bestSolution = currentSolution;
-                    currentSolution.SetNull();
+                    break;
                 }
-
-                break;
             }
-        }
 
-        if(!bestSolution.IsNull() && fRandom )
-            break;
+        }while( bestSolution.IsNull() && !cursor.IsNull() );
+
+        nTime2 = GetTimeMicros();
+
+        if( bestSolution.IsNull() && !fTimedOut )
+            return SAPI::Error(req, SAPI::BalanceInsufficient, "Requested amount exceeds balance");
 
-        if( GetTimeMicros() - nTime0 > nMatchTimeoutMicros ){
-            fTimedOut = true;
-            break;
+    }else{ // Pick random utxos until the amount is reached.
+
+        CAddressUnspentKey lastIndex;
+        int nUtxoCount = 0;
+
+        if( !GetUTXOCount(req, address, nUtxoCount, lastIndex ) ){
+            return false;
         }
 
-    }while( (++nPageCurrent % nPages) != nPageStart);
+        if (!nUtxoCount)
+            return SAPI::Error(req, SAPI::NoUtxosAvailble, "No unspent outputs available");
 
-    nTime2 = GetTimeMicros();
+        int nPages = nUtxoCount / nUtxosSlice;
+        if( nUtxoCount % nUtxosSlice ) nPages++;
+        int nPageStart = GetRand(nPages);
+        int nPageCurrent = nPageStart;
+
+        do{
+
+            int nIndexOffset = static_cast<int>( (nPageCurrent % nPages) * nUtxosSlice);
+            int nLimit = static_cast<int>( (nUtxoCount % nUtxosSlice) &&
+                                           (nPageCurrent % nPages) == nPages - 1 ? (nUtxoCount % nUtxosSlice) :
+                                                                        nUtxosSlice);
+
+            unspentOutputs.clear();
+
+            if( !GetUTXOs(req, address, unspentOutputs, CAddressUnspentKey(), nIndexOffset , nLimit) )
+                return false;
+
+            std::random_shuffle(unspentOutputs.begin(), unspentOutputs.end());
+
+            for (auto it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++) {
+
+                if( GetTimeMicros() - nTime0 > nMatchTimeoutMicros ){
+                    fTimedOut = true;
+                    break;
+                }
+
+                if( isSelectable(*it) )
+                    currentSolution.AddUtxo(*it);
 
-    // If we iterated over all utxos and we did not find a solution.
-    if( (++nPageCurrent % nPages) == nPageStart && bestSolution.IsNull() && !fTimedOut )
-        return SAPI::Error(req, SAPI::BalanceInsufficient, "Requested amount exceeds balance");
+                if( currentSolution.amount >= expectedAmount + currentSolution.fee ){
+                    currentSolution.change = currentSolution.amount - expectedAmount - currentSolution.fee;
+                    bestSolution = currentSolution;
+                    break;
+                }
+            }
+
+            if( !bestSolution.IsNull() || fTimedOut )
+                break;
+
+        }while( (++nPageCurrent % nPages) != nPageStart);
+
+        nTime2 = GetTimeMicros();
+
+        // If we iterated over all utxos and we did not find a solution.
+        if( bestSolution.IsNull() && !fTimedOut )
+            return SAPI::Error(req, SAPI::BalanceInsufficient, "Requested amount exceeds balance");
+    }
 
     // We found no solution, but there still might be one..
     if( bestSolution.IsNull() )
@@ -952,7 +1136,8 @@ static bool address_transaction(HTTPRequest* req, const std::map<std::string, st
     std::string addrStr = mapPathParams.at("address");
     std::vector<std::tuple<uint256, int, CAmount>> vecResult;
     int64_t totalNumTxs;
-    if( !GetAddressesTransactions(req, addrStr, vecResult, nPageNumber, nPageSize, fAsc, totalNumTxs) )
+    std::string strNextCursor;
+    if( !GetAddressesTransactions(req, addrStr, vecResult, nPageNumber, nPageSize, fAsc, totalNumTxs, std::string(), strNextCursor) )
         return false;
 
     if (totalNumTxs < 1)
@@ -969,6 +1154,8 @@ static bool address_transaction(HTTPRequest* req, const std::map<std::string, st
 
       CBlock block;
       CBlockIndex* pBlockindex = chainActive[std::get<1>(txEntry)];
+      if (fHavePruned && !(pBlockindex->nStatus & BLOCK_HAVE_DATA) && pBlockindex->nTx > 0)
+          return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data).");
       if(!ReadBlockFromDisk(block, pBlockindex, Params().GetConsensus()))
           return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
 
@@ -978,16 +1165,16 @@ static bool address_transaction(HTTPRequest* req, const std::map<std::string, st
       txValue.pushKV("direction", txDirection);
 
       // Find TX inside the block
-      auto tx = std::find_if(block.vtx.begin(), block.vtx.end(), [&txEntry] (const CTransaction &t) {
-          return std::get<0>(txEntry) == t.GetHash();
+      auto tx = std::find_if(block.vtx.begin(), block.vtx.end(), [&txEntry] (const CTransactionRef &t) {
+          return std::get<0>(txEntry) == t->GetHash();
       });
 
       if (tx != block.vtx.end()) {
-        if (!GetTransactionInfo(req, block.GetHash(), *tx, txValue, false))
+        if (!GetTransactionInfo(req, block.GetHash(), **tx, txValue, false))
             return false;
       }
 
-      transactions.push_back(txValue);
+      transactions.push_back(std::move(txValue));
     }
 
     // Add mempool entries corresponding to the address if any
@@ -1023,11 +1210,12 @@ static bool address_transaction(HTTPRequest* req, const std::map<std::string, st
 static bool address_transactions(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
 {
     std::string addrStr = bodyParameter[SAPI::Keys::address].get_str();
-    int64_t nPageNumber = bodyParameter[SAPI::Keys::pageNumber].get_int64();
+    int64_t nPageNumber = bodyParameter.exists(SAPI::Keys::pageNumber) ? bodyParameter[SAPI::Keys::pageNumber].get_int64() : 1;
     int64_t nPageSize = bodyParameter[SAPI::Keys::pageSize].get_int64();
     bool fAsc = bodyParameter.exists(SAPI::Keys::ascending) ? bodyParameter[SAPI::Keys::ascending].get_bool() : false;
     std::string direction = bodyParameter.exists(SAPI::Keys::direction)
         ? bodyParameter[SAPI::Keys::direction].get_str() : "Any";
+    std::string strCursor = bodyParameter.exists(SAPI::Keys::cursor) ? bodyParameter[SAPI::Keys::cursor].get_str() : std::string();
 
 //    if ( !mapPathParams.count("address") )
  //       return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "No SmartCash address specified. Use /address/transactions/<smartcash_address>");
@@ -1035,7 +1223,8 @@ static bool address_transactions(HTTPRequest* req, const std::map<std::string, s
 //    std::string addrStr = mapPathParams.at("address");
     std::vector<std::tuple<uint256, int, CAmount>> vecResult;
     int64_t totalNumTxs;
-    if( !GetAddressesTransactions(req, addrStr, vecResult, nPageNumber, nPageSize, fAsc, totalNumTxs) )
+    std::string strNextCursor;
+    if( !GetAddressesTransactions(req, addrStr, vecResult, nPageNumber, nPageSize, fAsc, totalNumTxs, strCursor, strNextCursor) )
         return false;
     if (totalNumTxs < 1)
         return SAPI::Error(req, SAPI::PageOutOfRange, "No transactions available for this address.");
@@ -1051,6 +1240,8 @@ static bool address_transactions(HTTPRequest* req, const std::map<std::string, s
 
       CBlock block;
       CBlockIndex* pBlockindex = chainActive[std::get<1>(txEntry)];
+      if (fHavePruned && !(pBlockindex->nStatus & BLOCK_HAVE_DATA) && pBlockindex->nTx > 0)
+          return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data).");
       if(!ReadBlockFromDisk(block, pBlockindex, Params().GetConsensus()))
           return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
 
@@ -1060,21 +1251,21 @@ static bool address_transactions(HTTPRequest* req, const std::map<std::string, s
       txValue.pushKV("direction", txDirection);
 
       // Find TX inside the block
-      auto tx = std::find_if(block.vtx.begin(), block.vtx.end(), [&txEntry] (const CTransaction &t) {
-          return std::get<0>(txEntry) == t.GetHash();
+      auto tx = std::find_if(block.vtx.begin(), block.vtx.end(), [&txEntry] (const CTransactionRef &t) {
+          return std::get<0>(txEntry) == t->GetHash();
       });
 
       if (tx != block.vtx.end()) {
-        if (!GetTransactionInfo(req, block.GetHash(), *tx, txValue, false))
+        if (!GetTransactionInfo(req, block.GetHash(), **tx, txValue, false))
             return false;
       }
 
-      transactions.push_back(txValue);
+      transactions.push_back(std::move(txValue));
     }
 
-    // Add mempool entries corresponding to the address if any
+    // Add mempool entries corresponding to the address if any, pages continued by a cursor had them already
     UniValue result(UniValue::VARR);
-    if (!GetAddressMempoolFull(req, addrStr, result)) {
+    if (strCursor.empty() && !GetAddressMempoolFull(req, addrStr, result)) {
         return false;
     }
 
@@ -1090,7 +1281,7 @@ static bool address_transactions(HTTPRequest* req, const std::map<std::string, s
     int nPages = totalNumTxs / nPageSize;
     if (totalNumTxs % nPageSize || (totalNumTxs < nPageSize) ) nPages++;
 
-    if (nPageNumber > nPages)
+    if (strCursor.empty() && nPageNumber > nPages)
         return SAPI::Error(req, SAPI::PageOutOfRange, strprintf("Page number out of range: 1 - %d.", nPages));
 
 
@@ -1099,6 +1290,10 @@ static bool address_transactions(HTTPRequest* req, const std::map<std::string, s
     response.pushKV("pages", nPages);
     response.pushKV("page", nPageNumber);
 
+    // Pass it as cursor to get the next page, without skipping over all previous pages again
+    if (!strNextCursor.empty())
+        response.pushKV("cursor", strNextCursor);
+
     response.pushKV("data", transactions);
 
     SAPI::WriteReply(req, response);
@@ -2,15 +2,24 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockfilter.h"
+#include "blocksummary.h"
 #include "core_io.h"
+#include "indexbuilder.h"
 #include "sapi.h"
 #include "consensus/validation.h"
 #include "smartnode/instantx.h"
+#include "taskpool.h"
+#include "txdb.h"
 #include "validation.h"
 #include "checkpoints.h"
 
 #define BLOCKS_API_MAX_COUNT        10
 #define TRANSACTIONS_API_MAX_COUNT  10
+#define BLOCK_SUMMARIES_API_MAX_COUNT   100
+
+//! Transactions one helper of the task pool renders at least for block/transactions
+static const size_t BLOCK_TRANSACTIONS_PER_HELPER = 8;
 
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
@@ -18,29 +27,36 @@ static bool blockchain_info(HTTPRequest* req, const std::map<std::string, std::s
 static bool blockchain_height(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool blockchain_supply(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool blockchain_block(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool blockchain_block_filter(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool blockchain_block_transactions(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool blockchain_blocks_latest(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool blockchain_blocks_range(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool blockchain_blocks_summary_latest(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool blockchain_blocks_summary_range(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool blockchain_transactions_latest(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 
 SAPI::EndpointGroup blockchainEndpoints = {
     "blockchain",
     {
         {"", HTTPRequest::GET, UniValue::VNULL, blockchain_info, {}},
-        {"height", HTTPRequest::GET, UniValue::VNULL, blockchain_height, {}},
+        {"height", HTTPRequest::GET, UniValue::VNULL, blockchain_height, {}, SAPI::CostCritical},
         {"supply", HTTPRequest::GET, UniValue::VNULL, blockchain_supply, {}},
         {"block/{blockinfo}", HTTPRequest::GET, UniValue::VNULL, blockchain_block, {}},
+        {"block/filter/{blockinfo}", HTTPRequest::GET, UniValue::VNULL, blockchain_block_filter, {}},
         {"block/transactions", HTTPRequest::POST, UniValue::VOBJ, blockchain_block_transactions,
          {
              SAPI::BodyParameter(SAPI::Keys::hash,           new SAPI::Validation::HexString(), true),
              SAPI::BodyParameter(SAPI::Keys::height,         new SAPI::Validation::UInt(), true),
              SAPI::BodyParameter(SAPI::Keys::pageNumber,     new SAPI::Validation::IntRange(1,INT_MAX)),
              SAPI::BodyParameter(SAPI::Keys::pageSize,       new SAPI::Validation::IntRange(1,100))
-         }
+         },
+         SAPI::CostExpensive
         },
-        {"blocks/latest/{count}", HTTPRequest::GET, UniValue::VNULL, blockchain_blocks_latest, {}},
-        {"blocks/{from}/{to}", HTTPRequest::GET, UniValue::VNULL, blockchain_blocks_range, {}},
-        {"transactions/latest/{count}", HTTPRequest::GET, UniValue::VNULL, blockchain_transactions_latest, {}}
+        {"blocks/latest/{count}", HTTPRequest::GET, UniValue::VNULL, blockchain_blocks_latest, {}, SAPI::CostExpensive},
+        {"blocks/{from}/{to}", HTTPRequest::GET, UniValue::VNULL, blockchain_blocks_range, {}, SAPI::CostExpensive},
+        {"blocks/summary/latest/{count}", HTTPRequest::GET, UniValue::VNULL, blockchain_blocks_summary_latest, {}},
+        {"blocks/summary/{from}/{to}", HTTPRequest::GET, UniValue::VNULL, blockchain_blocks_summary_range, {}},
+        {"transactions/latest/{count}", HTTPRequest::GET, UniValue::VNULL, blockchain_transactions_latest, {}, SAPI::CostExpensive}
     }
 };
 
@@ -61,16 +77,17 @@ static bool GetBlockInfo(HTTPRequest* req, CBlockIndex *blockindex, const CBlock
     blockObj.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
 
     UniValue txs(UniValue::VARR);
-    BOOST_FOREACH(const CTransaction&tx, block.vtx)
+    txs.reserve(block.vtx.size());
+    for (const CTransactionRef& tx : block.vtx)
     {
         UniValue txObj(UniValue::VOBJ);
-        if (!GetTransactionInfo(req, tx.GetHash(), tx, txObj, false))
+        if (!GetTransactionInfo(req, tx->GetHash(), *tx, txObj, false))
             return false;
 
-        txs.push_back(txObj);
+        txs.push_back(std::move(txObj));
     }
 
-    blockObj.push_back(Pair("tx", txs));
+    blockObj.pushKV("tx", std::move(txs));
     blockObj.push_back(Pair("time", block.GetBlockTime()));
     blockObj.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
     blockObj.push_back(Pair("nonce", (uint64_t)block.nNonce));
@@ -87,7 +104,43 @@ static bool GetBlockInfo(HTTPRequest* req, CBlockIndex *blockindex, const CBlock
     return true;
 }
 
-bool GetTransactionInfo(HTTPRequest* req, uint256 nHash, const CTransaction &tx, UniValue &txObj, bool showHex)
+/** Where a block is in the chain, for the fields of its transactions which depend on it */
+struct CBlockPosition
+{
+    bool fInChain;
+    int nHeight;
+    int nConfirmations;
+    int64_t nTime;
+};
+
+/** Requires cs_main */
+static CBlockPosition GetBlockPosition(const CBlockIndex *pindex)
+{
+    CBlockPosition pos;
+    pos.fInChain = chainActive.Contains(pindex);
+    pos.nHeight = pindex->nHeight;
+    pos.nConfirmations = 1 + chainActive.Height() - pindex->nHeight;
+    pos.nTime = pindex->GetBlockTime();
+    return pos;
+}
+
+static void PushBlockPosition(const uint256 &nHash, const CBlockPosition &pos, UniValue &txObj)
+{
+    txObj.pushKV("blockhash", nHash.GetHex());
+    if (pos.fInChain) {
+        txObj.pushKV("height", pos.nHeight);
+        txObj.pushKV("confirmations", pos.nConfirmations);
+        txObj.pushKV("time", pos.nTime);
+    } else {
+        txObj.pushKV("height", -1);
+        txObj.pushKV("confirmations", 0);
+    }
+}
+
+/** The fields of GetTransactionInfo which only depend on the transaction itself, strError
+ *  tells about a missing input. Only takes cs_main for inputs which aren't in pPrevouts. */
+static bool GetTransactionFields(const CTransaction &tx, UniValue &txObj, bool showHex,
+                                 const std::map<COutPoint, CTxOut> *pPrevouts, std::string &strError)
 {
     if (showHex) {
       string strHex = EncodeHexTx(tx, SERIALIZE_TRANSACTION_NO_WITNESS);
@@ -100,6 +153,7 @@ bool GetTransactionInfo(HTTPRequest* req, uint256 nHash, const CTransaction &tx,
     txObj.pushKV("version", tx.nVersion);
     txObj.pushKV("locktime", (int64_t)tx.nLockTime);
     UniValue vin(UniValue::VARR);
+    vin.reserve(tx.vin.size());
     BOOST_FOREACH(const CTxIn& txin, tx.vin) {
 
         UniValue in(UniValue::VOBJ);
@@ -108,26 +162,40 @@ bool GetTransactionInfo(HTTPRequest* req, uint256 nHash, const CTransaction &tx,
 	} else if (tx.IsZerocoinSpend()) {
             in.pushKV("zerocoin", HexStr(txin.scriptSig.begin(), txin.scriptSig.end()));
 	} else {
-            CTransaction txInput;
-            uint256 hashBlockIn;
-            if (!GetTransaction(txin.prevout.hash, txInput, Params().GetConsensus(), hashBlockIn, false))
-                return SAPI::Error(req, SAPI::TxNotFound, "No information available about one of the inputs.");
+            CTxOut txout;
+            std::map<COutPoint, CTxOut>::const_iterator itPrevout;
 
-            const CTxOut& txout = txInput.vout[txin.prevout.n];
+            if (pPrevouts && (itPrevout = pPrevouts->find(txin.prevout)) != pPrevouts->end()) {
+                txout = itPrevout->second;
+            } else {
+                CTransaction txInput;
+                uint256 hashBlockIn;
+                if (!GetTransaction(txin.prevout.hash, txInput, Params().GetConsensus(), hashBlockIn, false) ||
+                    txin.prevout.n >= txInput.vout.size()) {
+                    if (IsTransactionPruned(txin.prevout.hash))
+                        strError = "One of the inputs is not available (pruned data).";
+                    else
+                        strError = "No information available about one of the inputs.";
+                    return false;
+                }
+
+                txout = txInput.vout[txin.prevout.n];
+            }
 
             in.pushKV("txid", txin.prevout.hash.GetHex());
             in.pushKV("value", ValueFromAmount(txout.nValue));
             in.pushKV("n", (int64_t)txin.prevout.n);
             UniValue o(UniValue::VOBJ);
             ScriptPubKeyToJSON(txout.scriptPubKey, o, true);
-            in.pushKV("scriptPubKey", o);
+            in.pushKV("scriptPubKey", std::move(o));
         }
 
         in.pushKV("sequence", (int64_t)txin.nSequence);
-        vin.push_back(in);
+        vin.push_back(std::move(in));
     }
-    txObj.pushKV("vin", vin);
+    txObj.pushKV("vin", std::move(vin));
     UniValue vout(UniValue::VARR);
+    vout.reserve(tx.vout.size());
     for (unsigned int i = 0; i < tx.vout.size(); i++) {
         const CTxOut& txout = tx.vout[i];
         UniValue out(UniValue::VOBJ);
@@ -135,25 +203,27 @@ bool GetTransactionInfo(HTTPRequest* req, uint256 nHash, const CTransaction &tx,
         out.pushKV("n", (int64_t)i);
         UniValue o(UniValue::VOBJ);
         ScriptPubKeyToJSON(txout.scriptPubKey, o, true);
-        out.pushKV("scriptPubKey", o);
-        vout.push_back(out);
+        out.pushKV("scriptPubKey", std::move(o));
+        vout.push_back(std::move(out));
     }
-    txObj.pushKV("vout", vout);
+    txObj.pushKV("vout", std::move(vout));
+
+    return true;
+}
+
+bool GetTransactionInfo(HTTPRequest* req, uint256 nHash, const CTransaction &tx, UniValue &txObj, bool showHex,
+                        const std::map<COutPoint, CTxOut> *pPrevouts)
+{
+    std::string strError;
+    if (!GetTransactionFields(tx, txObj, showHex, pPrevouts, strError))
+        return SAPI::Error(req, SAPI::TxNotFound, strError);
 
     if (!nHash.IsNull()) {
-        txObj.pushKV("blockhash", nHash.GetHex());
         BlockMap::iterator mi = mapBlockIndex.find(nHash);
-        if (mi != mapBlockIndex.end() && (*mi).second) {
-            CBlockIndex* pindex = (*mi).second;
-            if (chainActive.Contains(pindex)) {
-                txObj.pushKV("height", pindex->nHeight);
-                txObj.pushKV("confirmations", 1 + chainActive.Height() - pindex->nHeight);
-                txObj.pushKV("time", pindex->GetBlockTime());
-            } else {
-                txObj.pushKV("height", -1);
-                txObj.pushKV("confirmations", 0);
-            }
-        }
+        if (mi != mapBlockIndex.end() && (*mi).second)
+            PushBlockPosition(nHash, GetBlockPosition((*mi).second), txObj);
+        else
+            txObj.pushKV("blockhash", nHash.GetHex());
     } else {
         txObj.pushKV("height", -1);
         txObj.pushKV("confirmations", 0);
@@ -167,7 +237,7 @@ static bool blockchain_info(HTTPRequest* req, const std::map<std::string, std::s
     UniValue obj(UniValue::VOBJ);
 
     {
-        LOCK(cs_main);
+        SAPI_LOCK_MAIN();
         obj.push_back(Pair("chain",                 Params().NetworkIDString()));
         obj.push_back(Pair("blocks",                (int)chainActive.Height()));
         obj.push_back(Pair("headers",               pindexBestHeader ? pindexBestHeader->nHeight : -1));
@@ -185,7 +255,7 @@ static bool blockchain_info(HTTPRequest* req, const std::map<std::string, std::s
 
 static bool blockchain_supply(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
 {
-    LOCK(cs_main);
+    SAPI_LOCK_MAIN();
 
     UniValue result(UniValue::VOBJ);
     result.pushKV("CurrentSupply",  (int64_t)(143750 * 5000 * (1 + log(chainActive.Height()) - log(143750))) );
@@ -196,7 +266,7 @@ static bool blockchain_supply(HTTPRequest* req, const std::map<std::string, std:
 
 static bool blockchain_height(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
 {
-    LOCK(cs_main);
+    SAPI_LOCK_MAIN();
 
     UniValue result(UniValue::VOBJ);
     result.pushKV("height", chainActive.Height());
@@ -213,7 +283,7 @@ static bool blockchain_block(HTTPRequest* req, const std::map<std::string, std::
     std::string blockInfoStr = mapPathParams.at("blockinfo");
     uint256 hash;
 
-    LOCK(cs_main);
+    SAPI_LOCK_MAIN();
 
     if( IsInteger(blockInfoStr) ){
 
@@ -247,6 +317,67 @@ static bool blockchain_block(HTTPRequest* req, const std::map<std::string, std::
     if (!GetBlockInfo(req, blockindex, block, result))
         return false;
 
+    SAPI::Cache::SetCacheable(req);
+    SAPI::WriteReply(req, result);
+
+    return true;
+}
+
+static bool blockchain_block_filter(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    if ( !mapPathParams.count("blockinfo") )
+        return SAPI::Error(req, SAPI::BlockNotSpecified, "No height or hash specified. Use /blockchain/block/filter/<height or hash>");
+
+    if (!fBlockFilterIndex)
+        return SAPI::Error(req, SAPI::BlockFilterNotAvailable, "Block filters are disabled. Start the node with -blockfilterindex");
+
+    if (!SAPI::CheckIndexReady(req, INDEX_BUILD_BLOCKFILTER))
+        return false;
+
+    std::string blockInfoStr = mapPathParams.at("blockinfo");
+    uint256 hash;
+    int nHeight;
+
+    {
+        SAPI_LOCK_MAIN();
+
+        if( IsInteger(blockInfoStr) ){
+
+            int64_t nHeightParam;
+
+            if( !ParseInt64(blockInfoStr, &nHeightParam) )
+                return SAPI::Error(req, SAPI::UIntOverflow, "Integer overflow.");
+
+            if ( nHeightParam < 0 ||  nHeightParam > chainActive.Height() )
+                return SAPI::Error(req, SAPI::BlockHeightOutOfRange, "Block height out of range");
+
+            hash = chainActive[nHeightParam]->GetBlockHash();
+        }else if( !ParseHashStr(blockInfoStr, hash) ){
+            return SAPI::Error(req, SAPI::BlockNotSpecified, "No valid height or hash specified. Use /blockchain/block/filter/<height or hash>");
+        }
+
+        BlockMap::iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            return SAPI::Error(req, SAPI::BlockNotFound, "Block not found");
+
+        nHeight = it->second->nHeight;
+    }
+
+    // Read from the index without cs_main, filters outlive the block data when pruned
+    CBlockFilter filter;
+    uint256 header;
+    if (!GetBlockFilter(hash, filter) || !GetBlockFilterHeader(hash, header))
+        return SAPI::Error(req, SAPI::BlockFilterNotAvailable, "No block filter available for " + hash.GetHex());
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("hash", hash.GetHex()));
+    result.push_back(Pair("height", nHeight));
+    result.push_back(Pair("filterType", BlockFilterTypeName(filter.GetFilterType())));
+    result.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    result.push_back(Pair("filterHash", filter.GetHash().GetHex()));
+    result.push_back(Pair("header", header.GetHex()));
+
+    SAPI::Cache::SetCacheable(req);
     SAPI::WriteReply(req, result);
 
     return true;
@@ -263,70 +394,108 @@ static bool blockchain_block_transactions(HTTPRequest* req, const std::map<std::
         return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "Both, hash and height are given but only one is allowed. Use either 'hash' or 'height' as parameter in the body.");
     }else if( !fByHash && !fByHeight ){
         return SAPI::Error(req, SAPI::BlockNotSpecified, "No valid height or hash specified: Use either 'hash' or 'height' as parameter in the body.");
-    }else if( fByHeight ){
-
-        int64_t nHeight = bodyParameter[SAPI::Keys::height].get_int64();
-
-        if ( nHeight < 0 ||  nHeight > chainActive.Height() )
-            return SAPI::Error(req, SAPI::BlockHeightOutOfRange, "Block height out of range.");
-
-        CBlockIndex* pblockindex = chainActive[nHeight];
-        nHash = pblockindex->GetBlockHash();
-
-    }else if( !ParseHashStr(bodyParameter[SAPI::Keys::hash].get_str(), nHash) ){
+    }else if( fByHash && !ParseHashStr(bodyParameter[SAPI::Keys::hash].get_str(), nHash) ){
         return SAPI::Error(req, SAPI::BlockHashInvalid, "Invalid block hash provided.");
     }
 
     int64_t nPageNumber = bodyParameter[SAPI::Keys::pageNumber].get_int64();
     int64_t nPageSize = bodyParameter[SAPI::Keys::pageSize].get_int64();
 
-    LOCK(cs_main);
-
     CBlock block;
-    CBlockIndex* blockindex = mapBlockIndex[nHash];
+    CBlockPosition pos;
+    int nPages;
+    UniValue result(UniValue::VOBJ);
+    UniValue tail(UniValue::VOBJ);
 
-    if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0)
-        return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data).");
+    {
+        SAPI_LOCK_MAIN();
 
-    if(!ReadBlockFromDisk(block, blockindex, Params().GetConsensus()))
-        return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
+        if( fByHeight ){
 
-    int nTxCount = block.vtx.size();
-    int nPages = nTxCount / nPageSize;
-    if( nTxCount % nPageSize ) nPages++;
+            int64_t nHeight = bodyParameter[SAPI::Keys::height].get_int64();
 
-    if (nPageNumber > nPages)
-        return SAPI::Error(req, SAPI::PageOutOfRange, strprintf("Page number out of range: 1 - %d.", nPages));
+            if ( nHeight < 0 ||  nHeight > chainActive.Height() )
+                return SAPI::Error(req, SAPI::BlockHeightOutOfRange, "Block height out of range.");
 
+            nHash = chainActive[nHeight]->GetBlockHash();
+        }
 
-    UniValue result(UniValue::VOBJ);
-    result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
-    int confirmations = -1;
-    // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    result.push_back(Pair("confirmations", confirmations));
-    result.push_back(Pair("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
-    result.push_back(Pair("weight", (int)::GetBlockWeight(block)));
-    result.push_back(Pair("height", blockindex->nHeight));
-    result.push_back(Pair("version", block.nVersion));
-    result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
-    result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
+        BlockMap::iterator mi = mapBlockIndex.find(nHash);
+        if (mi == mapBlockIndex.end())
+            return SAPI::Error(req, SAPI::BlockNotFound, "Block not found.");
 
-    UniValue txs(UniValue::VARR);
+        CBlockIndex* blockindex = mi->second;
+
+        if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0)
+            return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data).");
+
+        if(!ReadBlockFromDisk(block, blockindex, Params().GetConsensus()))
+            return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
+
+        int nTxCount = block.vtx.size();
+        nPages = nTxCount / nPageSize;
+        if( nTxCount % nPageSize ) nPages++;
+
+        if (nPageNumber > nPages)
+            return SAPI::Error(req, SAPI::PageOutOfRange, strprintf("Page number out of range: 1 - %d.", nPages));
+
+        result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
+        int confirmations = -1;
+        // Only report confirmations if the block is on the main chain
+        if (chainActive.Contains(blockindex))
+            confirmations = chainActive.Height() - blockindex->nHeight + 1;
+        result.push_back(Pair("confirmations", confirmations));
+        result.push_back(Pair("strippedsize", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS)));
+        result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
+        result.push_back(Pair("weight", (int)::GetBlockWeight(block)));
+        result.push_back(Pair("height", blockindex->nHeight));
+        result.push_back(Pair("version", block.nVersion));
+        result.push_back(Pair("versionHex", strprintf("%08x", block.nVersion)));
+        result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
+
+        tail.push_back(Pair("time", block.GetBlockTime()));
+        tail.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
+        tail.push_back(Pair("nonce", (uint64_t)block.nNonce));
+        tail.push_back(Pair("bits", strprintf("%08x", block.nBits)));
+        tail.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+        tail.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+
+        if (blockindex->pprev)
+            tail.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+        CBlockIndex *pnext = chainActive.Next(blockindex);
+        if (pnext)
+            tail.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+
+        // The transactions of the page get rendered without cs_main, all they need of the chain
+        pos = GetBlockPosition(blockindex);
+    }
 
     int nIndexOffset = static_cast<int>(( nPageNumber - 1 ) * nPageSize);
-    auto tx = block.vtx.begin() + nIndexOffset;
 
-    while(tx != block.vtx.end() && static_cast<int64_t>(txs.size()) < nPageSize )
-    {
-        UniValue txObj(UniValue::VOBJ);
-        if (!GetTransactionInfo(req, nHash, *tx, txObj, false)) {
-            return false;
-        }
-        txs.push_back(txObj);
-        ++tx;
+    std::vector<const CTransaction*> vecPage;
+    for (auto it = block.vtx.begin() + nIndexOffset; it != block.vtx.end() && static_cast<int64_t>(vecPage.size()) < nPageSize; ++it)
+        vecPage.push_back(it->get());
+
+    // Missing ones fall back to GetTransaction which reports the error
+    std::map<COutPoint, CTxOut> mapPrevouts;
+    SAPI::Prevouts::Resolve(vecPage, mapPrevouts);
+
+    // A slot each, the pool fills them in any order and the page keeps the one of the block
+    std::vector<UniValue> vecTxObjs(vecPage.size(), UniValue(UniValue::VOBJ));
+    std::vector<std::string> vecErrors(vecPage.size());
+    taskPool.ForEach(CTaskPool::PRIORITY_NORMAL, vecPage.size(), BLOCK_TRANSACTIONS_PER_HELPER, [&](size_t i) {
+        if (GetTransactionFields(*vecPage[i], vecTxObjs[i], false, &mapPrevouts, vecErrors[i]))
+            PushBlockPosition(nHash, pos, vecTxObjs[i]);
+    });
+
+    UniValue txs(UniValue::VARR);
+    txs.reserve(vecPage.size());
+
+    for (size_t i = 0; i < vecPage.size(); i++) {
+        // Replied from the thread of the request, the first one in the order of the block
+        if (!vecErrors[i].empty())
+            return SAPI::Error(req, SAPI::TxNotFound, vecErrors[i]);
+        txs.push_back(std::move(vecTxObjs[i]));
     }
 
     UniValue transactions(UniValue::VOBJ);
@@ -334,21 +503,10 @@ static bool blockchain_block_transactions(HTTPRequest* req, const std::map<std::
     transactions.pushKV("count",static_cast<int64_t>(block.vtx.size()));
     transactions.pushKV("pages", nPages);
     transactions.pushKV("page", nPageNumber);
-    transactions.pushKV("data", txs);
-
-    result.push_back(Pair("transactions", transactions));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("nonce", (uint64_t)block.nNonce));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
+    transactions.pushKV("data", std::move(txs));
 
-    if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pnext = chainActive.Next(blockindex);
-    if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+    result.pushKV("transactions", std::move(transactions));
+    result.pushKVs(tail);
 
     SAPI::WriteReply(req, result);
 
@@ -368,42 +526,44 @@ bool blockchain_blocks_latest(HTTPRequest* req, const std::map<std::string, std:
         }
     }
 
-    UniValue response(UniValue::VARR);
+    SAPI::JSONStream response(req);
 
-    LOCK(cs_main);
+    SAPI_LOCK_MAIN();
 
     int64_t currentHeight = chainActive.Height();
     if (currentHeight < count) {
         count = currentHeight;
     }
 
+    response.BeginArray();
+
     for (int i = 0; i < count; i++) {
         CBlock block;
         CBlockIndex* blockindex = chainActive[currentHeight - i];
 
         if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0)
-            return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data).");
+            return response.Error(SAPI::BlockNotFound, "Block not available (pruned data).");
 
         if(!ReadBlockFromDisk(block, blockindex, Params().GetConsensus()))
-            return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
+            return response.Error(SAPI::BlockNotFound, "Can't read block from disk.");
 
         UniValue blockInfo(UniValue::VOBJ);
         if (!GetBlockInfo(req, blockindex, block, blockInfo))
             return false;
 
-        response.push_back(blockInfo);
+        response.Push(blockInfo);
     }
 
-    SAPI::WriteReply(req, response);
+    response.Finish();
 
     return true;
 }
 
 bool blockchain_blocks_range(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
 {
-    UniValue response(UniValue::VARR);
+    SAPI::JSONStream response(req);
 
-    LOCK(cs_main);
+    SAPI_LOCK_MAIN();
 
     int64_t to = chainActive.Height();
     int64_t from = to - BLOCKS_API_MAX_COUNT + 1;
@@ -440,28 +600,168 @@ bool blockchain_blocks_range(HTTPRequest* req, const std::map<std::string, std::
     from = from < 0 ? 0 : from;
     to = to > chainActive.Height() ? chainActive.Height() : to;
 
+    response.BeginArray();
+
     for (int i = to; i >= from; i--) {
         CBlock block;
         CBlockIndex* blockindex = chainActive[i];
 
         if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0)
-            return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data).");
+            return response.Error(SAPI::BlockNotFound, "Block not available (pruned data).");
 
         if(!ReadBlockFromDisk(block, blockindex, Params().GetConsensus()))
-            return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
+            return response.Error(SAPI::BlockNotFound, "Can't read block from disk.");
 
         UniValue blockInfo(UniValue::VOBJ);
         if (!GetBlockInfo(req, blockindex, block, blockInfo))
             return false;
 
-        response.push_back(blockInfo);
+        response.Push(blockInfo);
     }
 
-    SAPI::WriteReply(req, response);
+    response.Finish();
+
+    return true;
+}
+
+/** Write the summaries of the blocks, the ones out of the summary cache get read from disk,
+ *  or from the stored summaries for pruned blocks. Doesn't need cs_main. */
+static bool WriteBlockSummaries(HTTPRequest* req, const std::vector<const CBlockIndex*> &vecBlocks, int nTipHeight)
+{
+    SAPI::JSONStream response(req);
+
+    response.BeginArray();
+
+    for (const CBlockIndex* blockindex : vecBlocks) {
+
+        CBlockSummary summary;
+
+        if (!blockSummaries.Get(blockindex->nHeight, blockindex->GetBlockHash(), summary)) {
+
+            CBlock block;
+
+            if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0) {
+                // Pruned before the summaries got stored, or replaced by another block at the height
+                if (!pblocktree->ReadBlockSummary(blockindex->nHeight, summary) || summary.hash != blockindex->GetBlockHash())
+                    return response.Error(SAPI::BlockNotFound, "Block not available (pruned data).");
+            } else {
+                if(!ReadBlockFromDisk(block, blockindex, Params().GetConsensus()))
+                    return response.Error(SAPI::BlockNotFound, "Can't read block from disk.");
+
+                summary = CBlockSummary(block, blockindex->nHeight);
+            }
+        }
+
+        UniValue blockObj(UniValue::VOBJ);
+        blockObj.pushKV("hash", summary.hash.GetHex());
+        blockObj.pushKV("height", summary.nHeight);
+        blockObj.pushKV("confirmations", nTipHeight - summary.nHeight + 1);
+        blockObj.pushKV("time", summary.nTime);
+        blockObj.pushKV("size", (int)summary.nSize);
+        blockObj.pushKV("txCount", (int)summary.nTx);
+
+        // Only known for the blocks connected since the node started
+        if (summary.fHavePayouts) {
+            UniValue payouts(UniValue::VOBJ);
+            payouts.pushKV("mining", UniValueFromAmount(summary.nMiningReward));
+            payouts.pushKV("hive", UniValueFromAmount(summary.nHiveReward));
+            payouts.pushKV("smartnode", UniValueFromAmount(summary.nSmartnodeReward));
+            payouts.pushKV("smartrewards", UniValueFromAmount(summary.nSmartRewardsReward));
+
+            blockObj.pushKV("fees", UniValueFromAmount(summary.nFees));
+            blockObj.pushKV("payouts", std::move(payouts));
+        }
+
+        response.Push(blockObj);
+    }
+
+    response.Finish();
 
     return true;
 }
 
+bool blockchain_blocks_summary_latest(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    int64_t count = BLOCK_SUMMARIES_API_MAX_COUNT;
+
+    if (mapPathParams.count("count")) {
+        std::string countStr = mapPathParams.at("count");
+        if (IsInteger(countStr)) {
+            if (ParseInt64(countStr, &count)) {
+                count = count > BLOCK_SUMMARIES_API_MAX_COUNT ? BLOCK_SUMMARIES_API_MAX_COUNT : count;
+            }
+        }
+    }
+
+    std::vector<const CBlockIndex*> vecBlocks;
+    int nTipHeight;
+
+    {
+        SAPI_LOCK_MAIN();
+
+        nTipHeight = chainActive.Height();
+
+        if (nTipHeight < count) {
+            count = nTipHeight;
+        }
+
+        for (int i = 0; i < count; i++)
+            vecBlocks.push_back(chainActive[nTipHeight - i]);
+    }
+
+    return WriteBlockSummaries(req, vecBlocks, nTipHeight);
+}
+
+bool blockchain_blocks_summary_range(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    std::vector<const CBlockIndex*> vecBlocks;
+    int nTipHeight;
+
+    {
+        SAPI_LOCK_MAIN();
+
+        nTipHeight = chainActive.Height();
+
+        int64_t to = nTipHeight;
+        int64_t from = to - BLOCK_SUMMARIES_API_MAX_COUNT + 1;
+
+        if (mapPathParams.count("from")) {
+            std::string fromStr = mapPathParams.at("from");
+            if (IsInteger(fromStr)) {
+                if (ParseInt64(fromStr, &from)) {
+                    from = from < 0 ? 0 : from;
+                }
+            }
+        }
+
+        if (mapPathParams.count("to")) {
+            std::string toStr = mapPathParams.at("to");
+            if (IsInteger(toStr)) {
+                if (ParseInt64(toStr, &to)) {
+                    to = to > nTipHeight ? nTipHeight : to;
+                }
+            }
+        }
+
+        // Check that 'from' and 'to' were given in the right order
+        if (from >= to) {
+            return SAPI::Error(req, SAPI::BlockHeightOutOfRange, "Range should be in ascending order");
+        }
+
+        // If number of requested blocks is bigger than max, reduce the range
+        if ((to - from + 1) > BLOCK_SUMMARIES_API_MAX_COUNT) {
+            to = from + BLOCK_SUMMARIES_API_MAX_COUNT - 1;
+        }
+
+        from = from < 0 ? 0 : from;
+
+        for (int64_t i = to; i >= from; i--)
+            vecBlocks.push_back(chainActive[i]);
+    }
+
+    return WriteBlockSummaries(req, vecBlocks, nTipHeight);
+}
+
 bool blockchain_transactions_latest(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
 {
     int64_t count = TRANSACTIONS_API_MAX_COUNT;
@@ -477,34 +777,48 @@ bool blockchain_transactions_latest(HTTPRequest* req, const std::map<std::string
 
     UniValue response(UniValue::VARR);
 
-    LOCK(cs_main);
+    SAPI_LOCK_MAIN();
 
     int64_t nHeight = chainActive.Height();
     int64_t numTxs = count;
 
-    while (numTxs) {
-        CBlock block;
+    std::deque<CBlock> vecBlocks;
+    std::vector<const CBlockIndex*> vecIndexes;
+    std::vector<const CTransaction*> vecTxs;
+
+    while (numTxs && nHeight >= 0) {
         CBlockIndex* blockindex = chainActive[nHeight];
 
         if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0)
             return SAPI::Error(req, SAPI::BlockNotFound, "Block not available (pruned data).");
 
-        if (!ReadBlockFromDisk(block, blockindex, Params().GetConsensus()))
+        vecBlocks.emplace_back();
+
+        if (!ReadBlockFromDisk(vecBlocks.back(), blockindex, Params().GetConsensus()))
             return SAPI::Error(req, SAPI::BlockNotFound, "Can't read block from disk.");
 
-        auto tx = block.vtx.begin();
-        while (tx != block.vtx.end() && numTxs) {
-            UniValue txObj(UniValue::VOBJ);
-            if (!GetTransactionInfo(req, blockindex->GetBlockHash(), *tx, txObj, false)) {
-                return false;
-            }
-            response.push_back(txObj);
+        auto tx = vecBlocks.back().vtx.begin();
+        while (tx != vecBlocks.back().vtx.end() && numTxs) {
+            vecIndexes.push_back(blockindex);
+            vecTxs.push_back(tx->get());
+            ++tx;
             numTxs--;
         }
 
         nHeight--;
     }
 
+    std::map<COutPoint, CTxOut> mapPrevouts;
+    SAPI::Prevouts::Resolve(vecTxs, mapPrevouts);
+
+    for (size_t i = 0; i < vecTxs.size(); i++) {
+        UniValue txObj(UniValue::VOBJ);
+        if (!GetTransactionInfo(req, vecIndexes[i]->GetBlockHash(), *vecTxs[i], txObj, false, &mapPrevouts)) {
+            return false;
+        }
+        response.push_back(std::move(txObj));
+    }
+
     SAPI::WriteReply(req, response);
 
     return true;
@@ -0,0 +1,227 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sapi/sapi.h"
+#include "hash.h"
+#include "sync.h"
+#include "util.h"
+#include "validationinterface.h"
+
+#include <list>
+
+typedef std::pair<const SAPI::Endpoint*, std::string> CSAPICacheKey;
+
+struct CSAPICacheEntry{
+    std::string strJSON;
+    std::string strETag;
+    std::list<CSAPICacheKey>::iterator itUsage;
+};
+
+struct CSAPICacheRequest{
+    CSAPICacheKey key;
+    uint64_t nGeneration;
+    bool fCacheable;
+};
+
+class CSAPIResponseCache : public CValidationInterface
+{
+    CCriticalSection cs;
+
+    std::map<CSAPICacheKey, CSAPICacheEntry> mapEntries;
+    //! Most recently used entries first
+    std::list<CSAPICacheKey> listUsage;
+    std::map<const HTTPRequest*, CSAPICacheRequest> mapRequests;
+
+    size_t nBytes;
+    size_t nMaxBytes;
+    //! Bumped with every clear, replies built before must not be stored anymore
+    uint64_t nGeneration;
+
+    static size_t EntrySize(const CSAPICacheKey &key, const CSAPICacheEntry &entry)
+    {
+        return key.second.size() + entry.strJSON.size() + entry.strETag.size() + 128;
+    }
+
+    void WriteHeaders(HTTPRequest *req, const std::string &strETag)
+    {
+        req->WriteHeader("ETag", strETag);
+        req->WriteHeader("Cache-Control", "no-cache");
+    }
+
+public:
+
+    CSAPIResponseCache() : nBytes(0), nMaxBytes(0), nGeneration(0) {}
+
+    void SetMaxBytes(size_t nMaxBytesIn)
+    {
+        LOCK(cs);
+        nMaxBytes = nMaxBytesIn;
+    }
+
+    void Clear()
+    {
+        LOCK(cs);
+        mapEntries.clear();
+        listUsage.clear();
+        nBytes = 0;
+        ++nGeneration;
+    }
+
+    bool Reply(HTTPRequest *req, const SAPI::Endpoint *endpoint, const std::map<std::string, std::string> &mapPathParams)
+    {
+        if( endpoint->method != HTTPRequest::GET || endpoint->bodyRoot != UniValue::VNULL )
+            return false;
+
+        std::string strParams;
+
+        for( const std::pair<std::string, std::string> &param : mapPathParams )
+            strParams += param.first + "=" + param.second + "/";
+
+        CSAPICacheKey key(endpoint, strParams);
+        std::string strJSON, strETag;
+
+        {
+            LOCK(cs);
+
+            if( !nMaxBytes )
+                return false;
+
+            auto it = mapEntries.find(key);
+
+            if( it == mapEntries.end() ){
+                mapRequests[req] = CSAPICacheRequest{key, nGeneration, false};
+                return false;
+            }
+
+            listUsage.splice(listUsage.begin(), listUsage, it->second.itUsage);
+            strJSON = it->second.strJSON;
+            strETag = it->second.strETag;
+        }
+
+        SAPI::AddDefaultHeaders(req);
+        WriteHeaders(req, strETag);
+
+        std::pair<bool, std::string> ifNoneMatch = req->GetHeader("If-None-Match");
+
+        if( ifNoneMatch.first && ifNoneMatch.second == strETag ){
+            req->WriteReply(HTTPStatus::NOT_MODIFIED);
+        }else{
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTPStatus::OK, strJSON);
+        }
+
+        return true;
+    }
+
+    void End(HTTPRequest *req)
+    {
+        LOCK(cs);
+        mapRequests.erase(req);
+    }
+
+    void SetCacheable(HTTPRequest *req)
+    {
+        LOCK(cs);
+
+        auto it = mapRequests.find(req);
+
+        if( it != mapRequests.end() )
+            it->second.fCacheable = true;
+    }
+
+    void Store(HTTPRequest *req, const std::string &strJSON)
+    {
+        CSAPICacheKey key;
+
+        {
+            LOCK(cs);
+
+            auto it = mapRequests.find(req);
+
+            if( it == mapRequests.end() || !it->second.fCacheable )
+                return;
+
+            bool fCurrent = it->second.nGeneration == nGeneration;
+            key = it->second.key;
+            mapRequests.erase(it);
+
+            // The tip changed while the reply was built.
+            if( !fCurrent )
+                return;
+        }
+
+        uint256 hash = Hash(strJSON.begin(), strJSON.end());
+        CSAPICacheEntry entry{strJSON, "\"" + hash.GetHex().substr(0, 32) + "\"", {}};
+
+        WriteHeaders(req, entry.strETag);
+
+        LOCK(cs);
+
+        size_t nSize = EntrySize(key, entry);
+
+        if( nSize > nMaxBytes / 4 || mapEntries.count(key) )
+            return;
+
+        while( nBytes + nSize > nMaxBytes && !listUsage.empty() ){
+            auto oldest = mapEntries.find(listUsage.back());
+            nBytes -= EntrySize(oldest->first, oldest->second);
+            mapEntries.erase(oldest);
+            listUsage.pop_back();
+        }
+
+        listUsage.push_front(key);
+        entry.itUsage = listUsage.begin();
+        mapEntries.insert(std::make_pair(key, std::move(entry)));
+        nBytes += nSize;
+    }
+
+protected:
+
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override
+    {
+        // Replies contain confirmations and next block hashes, they don't survive a new tip.
+        Clear();
+    }
+};
+
+static CSAPIResponseCache responseCache;
+
+void SAPI::Cache::Start()
+{
+    int64_t nSize = std::max<int64_t>(GetArg("-sapicachesize", DEFAULT_SAPI_CACHE_SIZE), 0);
+
+    LogPrintf("SAPI: response cache of %d MiB\n", nSize);
+
+    responseCache.SetMaxBytes(nSize << 20);
+    responseCache.Clear();
+
+    RegisterValidationInterface(&responseCache);
+}
+
+void SAPI::Cache::Stop()
+{
+    UnregisterValidationInterface(&responseCache);
+    responseCache.SetMaxBytes(0);
+    responseCache.Clear();
+}
+
+bool SAPI::Cache::Reply(HTTPRequest *req, const Endpoint *endpoint, const std::map<std::string, std::string> &mapPathParams)
+{
+    return responseCache.Reply(req, endpoint, mapPathParams);
+}
+
+void SAPI::Cache::End(HTTPRequest *req)
+{
+    responseCache.End(req);
+}
+
+void SAPI::Cache::SetCacheable(HTTPRequest *req)
+{
+    responseCache.SetCacheable(req);
+}
+
+void SAPI::Cache::Store(HTTPRequest *req, const std::string &strJSON)
+{
+    responseCache.Store(req, strJSON);
+}
@@ -10,6 +10,7 @@
 #include "sapi_validation.h"
 #include "sapi/sapi_common.h"
 #include "smartnode/instantx.h"
+#include "smartrewards/rewards.h"
 #include "validation.h"
 #include "clientversion.h"
 
@@ -24,6 +25,7 @@ SAPI::EndpointGroup clientEndpoints = {
             {
                 // No body parameter
             },
+            SAPI::CostCritical
         },
         {
 
@@ -38,6 +40,9 @@ SAPI::EndpointGroup clientEndpoints = {
 static bool statistics_requests(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool statistics_instantpay(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool statistics_instantpay_list(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool statistics_instantpay_latency(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool statistics_rewards(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool statistics_latency(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 
 SAPI::EndpointGroup statisticsEndpoints = {
     "statistics",
@@ -62,7 +67,26 @@ SAPI::EndpointGroup statisticsEndpoints = {
                 SAPI::BodyParameter(SAPI::Keys::pageNumber,     new SAPI::Validation::IntRange(1,INT_MAX)),
                 SAPI::BodyParameter(SAPI::Keys::pageSize,       new SAPI::Validation::IntRange(1,1000)),
                 SAPI::BodyParameter(SAPI::Keys::ascending,      new SAPI::Validation::Bool(), true),
-            }
+            },
+            SAPI::CostExpensive
+        },
+        {
+            "instantpay/latency", HTTPRequest::GET, UniValue::VNULL, statistics_instantpay_latency,
+            {
+                // No body parameter
+            },
+        },
+        {
+            "rewards", HTTPRequest::GET, UniValue::VNULL, statistics_rewards,
+            {
+                // No body parameter
+            },
+        },
+        {
+            "latency", HTTPRequest::GET, UniValue::VNULL, statistics_latency,
+            {
+                // No body parameter
+            },
         }
     }
 };
@@ -77,9 +101,10 @@ static bool client_help(HTTPRequest* req, const std::map<std::string, std::strin
     response.pushKV("IP:8080/v1/blockchain/", "info height block/{blockinfo} block/transactions blocks/latest/{count} blocks/{from?/{to}");
     response.pushKV("IP:8080/v1/client/", "status help");
     response.pushKV("IP:8080/v1/smartnode/", "count roi list check check/{address}");
-    response.pushKV("IP:8080/v1/smartrewards/","current roi history check/{address}");
-    response.pushKV("IP:8080/v1/statistics/", "requests instantpay");
-    response.pushKV("IP:8080/v1/termrewards/","list payments roi");
+    response.pushKV("IP:8080/v1/smartrewards/","current roi history payouts check/{address}");
+    response.pushKV("IP:8080/v1/statistics/", "requests instantpay instantpay/latency rewards latency");
+    response.pushKV("IP:8080/v1/termrewards/","list list/{address} expires/{from}/{to} payments roi");
+    response.pushKV("IP:8080/v1/metrics", "Prometheus metrics for whitelisted clients, also at IP:8080/metrics");
     response.pushKV("IP:8080/v1/transaction/", "send check create");
 
     SAPI::WriteReply(req, response);
@@ -241,3 +266,21 @@ static bool statistics_instantpay_list(HTTPRequest* req, const std::map<std::str
 
     return true;
 }
+
+static bool statistics_instantpay_latency(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    SAPI::WriteReply(req, instantsend.GetStats().ToJSON());
+    return true;
+}
+
+static bool statistics_rewards(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    SAPI::WriteReply(req, prewards->GetStats().ToJSON());
+    return true;
+}
+
+static bool statistics_latency(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    SAPI::WriteReply(req, SAPI::Timing::ToUniValue());
+    return true;
+}
@@ -6,51 +6,78 @@
 #include "netbase.h"
 #include "util.h"
 
-CCriticalSection cs_clients;
-static std::map<std::string, SAPI::Limits::Client*> mapClients;
+#include <atomic>
+#include <memory>
+
+/** One part of the client table, the clients are spread by a hash of their address. */
+struct CSAPIClientShard
+{
+    CCriticalSection cs;
+    std::map<CNetAddr, std::shared_ptr<SAPI::Limits::Client>> mapClients;
+};
+
+static const size_t nClientShards = 16;
+static CSAPIClientShard clientShards[nClientShards];
 
 //static std::vector<int> vecThrottling = {
 //    1,1,1,1,5,5,5,5,50,120,6000
 //};
 
-SAPI::Limits::Client *SAPI::Limits::GetClient(const CService &peer)
+static CSAPIClientShard &GetClientShard(const CNetAddr &addr)
 {
-    SAPI::Limits::Client *client;
-    std::string strIp = peer.ToStringIP(false);
+    return clientShards[addr.GetHash() % nClientShards];
+}
 
-    LOCK(cs_clients);
+std::shared_ptr<SAPI::Limits::Client> SAPI::Limits::GetClient(const CService &peer)
+{
+    const CNetAddr &addr = peer;
+    CSAPIClientShard &shard = GetClientShard(addr);
 
-    auto it = mapClients.find(strIp);
+    LOCK(shard.cs);
 
-    if( it == mapClients.end() ){
-        client = new SAPI::Limits::Client();
-        mapClients.insert(std::make_pair(strIp, client));
-    }else{
-        client = it->second;
-    }
+    std::shared_ptr<SAPI::Limits::Client> &client = shard.mapClients[addr];
+
+    if( !client )
+        client = std::make_shared<SAPI::Limits::Client>();
 
     return client;
 }
 
 void SAPI::Limits::CheckAndRemove()
 {
-    LOCK(cs_clients);
+    // One shard locked at a time, the requests of the others go on meanwhile.
+    for( CSAPIClientShard &shard : clientShards ){
 
-    LogPrintf("SAPI::Limits::CheckAndRemove() - Clients %d\n", mapClients.size());
+        LOCK(shard.cs);
 
-    auto it = mapClients.begin();
+        auto it = shard.mapClients.begin();
 
-    while( it != mapClients.end() ){
-        if( it->second->CheckAndRemove() ){
-            LogPrintf("SAPI::Limits::CheckAndRemove() - Remove %s\n", it->first);
-            delete it->second;
-            it = mapClients.erase(it);
-        }else{
-            ++it;
+        while( it != shard.mapClients.end() ){
+            if( it->second->CheckAndRemove() ){
+                LogPrint("sapi", "SAPI::Limits::CheckAndRemove() - Remove %s\n", it->first.ToStringIP());
+                it = shard.mapClients.erase(it);
+            }else{
+                ++it;
+            }
         }
     }
 }
 
+size_t SAPI::Limits::DynamicMemoryUsage(size_t &nClientsRet)
+{
+    size_t nUsage = 0;
+    nClientsRet = 0;
+
+    for( CSAPIClientShard &shard : clientShards ){
+        LOCK(shard.cs);
+        nClientsRet += shard.mapClients.size();
+        // The clients are shared pointers, each one is allocated together with its control block
+        nUsage += memusage::DynamicUsage(shard.mapClients) + shard.mapClients.size() * memusage::MallocUsage(sizeof(SAPI::Limits::Client) + 2 * sizeof(long));
+    }
+
+    return nUsage;
+}
+
 void SAPI::Limits::Client::Request()
 {
     LOCK(cs);
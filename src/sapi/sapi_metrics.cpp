@@ -0,0 +1,262 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sapi/sapi_metrics.h"
+
+#include "coins.h"
+#include "net.h"
+#include "smartnode/smartnodeman.h"
+#include "smartnode/smartnodesync.h"
+#include "smartrewards/rewards.h"
+#include "sync.h"
+#include "txmempool.h"
+#include "validation.h"
+
+static bool metrics(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+
+SAPI::EndpointGroup metricsEndpoints = {
+    "metrics",
+    {
+        {
+            "", HTTPRequest::GET, UniValue::VNULL, metrics,
+            {
+                // No body parameter
+            },
+            SAPI::CostCritical
+        }
+    }
+};
+
+//! Most scrapes fit without growing the buffer
+static const size_t METRICS_BUFFER_SIZE = 64 * 1024;
+
+std::string SAPI::Metrics::Label(const char *pszKey, const std::string &strValue)
+{
+    std::string str = pszKey;
+
+    str += "=\"";
+
+    for( char c : strValue ){
+        if( c == '\\' || c == '"' )
+            str += '\\';
+
+        if( c == '\n' )
+            str += "\\n";
+        else
+            str += c;
+    }
+
+    str += '"';
+
+    return str;
+}
+
+void SAPI::Metrics::Writer::Family(const std::string &strName, const char *pszType, const char *pszHelp)
+{
+    str += strprintf("# HELP smartcash_%s %s\n# TYPE smartcash_%s %s\n", strName, pszHelp, strName, pszType);
+}
+
+void SAPI::Metrics::Writer::Sample(const std::string &strName, const std::string &strLabels, int64_t nValue)
+{
+    str += strprintf(strLabels.empty() ? "smartcash_%s%s %d\n" : "smartcash_%s{%s} %d\n", strName, strLabels, nValue);
+}
+
+void SAPI::Metrics::Writer::Sample(const std::string &strName, const std::string &strLabels, uint64_t nValue)
+{
+    str += strprintf(strLabels.empty() ? "smartcash_%s%s %u\n" : "smartcash_%s{%s} %u\n", strName, strLabels, nValue);
+}
+
+void SAPI::Metrics::Writer::Sample(const std::string &strName, const std::string &strLabels, double dValue)
+{
+    str += strprintf(strLabels.empty() ? "smartcash_%s%s %.9g\n" : "smartcash_%s{%s} %.9g\n", strName, strLabels, dValue);
+}
+
+void SAPI::Metrics::Writer::Histogram(const std::string &strName, const std::string &strLabels, const std::vector<std::pair<double, uint64_t>> &vecBuckets, uint64_t nCount, double dSum)
+{
+    std::string strPrefix = strLabels.empty() ? "" : strLabels + ",";
+    uint64_t nCumulative = 0;
+
+    for( const std::pair<double, uint64_t> &bucket : vecBuckets ){
+        nCumulative += bucket.second;
+        Sample(strName + "_bucket", strPrefix + Label("le", strprintf("%g", bucket.first)), nCumulative);
+    }
+
+    Sample(strName + "_bucket", strPrefix + Label("le", "+Inf"), nCount);
+    Sample(strName + "_sum", strLabels, dSum);
+    Sample(strName + "_count", strLabels, nCount);
+}
+
+static void WriteRewardsHistogram(SAPI::Metrics::Writer &writer, const std::string &strName, const std::string &strLabels, const CSmartRewardsTimingHistogram &histogram)
+{
+    // Bucket i counts the samples below 2^i microseconds, the last one is open ended
+    std::vector<std::pair<double, uint64_t>> vecBuckets;
+
+    for( int i = 0; i < CSmartRewardsTimingHistogram::NUM_BUCKETS - 1; i++ )
+        vecBuckets.emplace_back(((int64_t)1 << i) * 0.000001, histogram.vBuckets[i]);
+
+    writer.Histogram(strName, strLabels, vecBuckets, histogram.nCount, histogram.nTotal * 0.000000001);
+}
+
+static void WriteChainMetrics(SAPI::Metrics::Writer &writer)
+{
+    int nHeight, nHeaders;
+    size_t nCoinsUsage;
+
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height();
+        nHeaders = pindexBestHeader ? pindexBestHeader->nHeight : -1;
+        nCoinsUsage = pcoinsTip ? pcoinsTip->DynamicMemoryUsage() : 0;
+    }
+
+    writer.Family("chain_height", "gauge", "Height of the active chain");
+    writer.Sample("chain_height", "", (int64_t)nHeight);
+    writer.Family("chain_headers", "gauge", "Height of the best known header");
+    writer.Sample("chain_headers", "", (int64_t)nHeaders);
+    writer.Family("dbcache_usage_bytes", "gauge", "Memory usage of the coins cache");
+    writer.Sample("dbcache_usage_bytes", "", (uint64_t)nCoinsUsage);
+
+    writer.Family("mempool_transactions", "gauge", "Transactions in the mempool");
+    writer.Sample("mempool_transactions", "", (uint64_t)mempool.size());
+    writer.Family("mempool_size_bytes", "gauge", "Serialized size of the mempool transactions");
+    writer.Sample("mempool_size_bytes", "", mempool.GetTotalTxSize());
+    writer.Family("mempool_usage_bytes", "gauge", "Memory usage of the mempool");
+    writer.Sample("mempool_usage_bytes", "", (uint64_t)mempool.DynamicMemoryUsage());
+}
+
+static void WriteNetworkMetrics(SAPI::Metrics::Writer &writer)
+{
+    if( !g_connman )
+        return;
+
+    writer.Family("peers", "gauge", "Connected peers by direction");
+    writer.Sample("peers", SAPI::Metrics::Label("direction", "in"), (uint64_t)g_connman->GetNodeCount(CConnman::CONNECTIONS_IN));
+    writer.Sample("peers", SAPI::Metrics::Label("direction", "out"), (uint64_t)g_connman->GetNodeCount(CConnman::CONNECTIONS_OUT));
+
+    writer.Family("network_bytes_total", "counter", "Traffic of all peers by direction");
+    writer.Sample("network_bytes_total", SAPI::Metrics::Label("direction", "recv"), g_connman->GetTotalBytesRecv());
+    writer.Sample("network_bytes_total", SAPI::Metrics::Label("direction", "sent"), g_connman->GetTotalBytesSent());
+
+    mapMsgCmdStats mapStats;
+    mapMsgCmdSize mapSendBytes, mapRecvBytes;
+    GetNetMsgStats(*g_connman, mapStats, mapSendBytes, mapRecvBytes);
+
+    writer.Family("p2p_message_bytes_total", "counter", "Traffic of the p2p messages by type and direction");
+    for( const mapMsgCmdSize::value_type &entry : mapRecvBytes )
+        writer.Sample("p2p_message_bytes_total", SAPI::Metrics::Label("type", entry.first) + "," + SAPI::Metrics::Label("direction", "recv"), entry.second);
+    for( const mapMsgCmdSize::value_type &entry : mapSendBytes )
+        writer.Sample("p2p_message_bytes_total", SAPI::Metrics::Label("type", entry.first) + "," + SAPI::Metrics::Label("direction", "sent"), entry.second);
+
+    writer.Family("p2p_message_processing_seconds", "histogram", "Processing time of the received p2p messages by type");
+    for( const mapMsgCmdStats::value_type &entry : mapStats ){
+        std::vector<std::pair<double, uint64_t>> vecBuckets;
+        for( int i = 0; i < CNetMsgCmdStats::NUM_TIME_BUCKETS - 1; i++ )
+            vecBuckets.emplace_back(CNetMsgCmdStats::TIME_BUCKET_BOUNDS[i] * 0.000001, entry.second.vTimeBuckets[i]);
+        writer.Histogram("p2p_message_processing_seconds", SAPI::Metrics::Label("type", entry.first), vecBuckets, entry.second.nMessages, entry.second.nTime * 0.000001);
+    }
+
+    writer.Family("p2p_message_rejected_total", "counter", "Received p2p messages which failed to process or raised the ban score, by type");
+    for( const mapMsgCmdStats::value_type &entry : mapStats )
+        writer.Sample("p2p_message_rejected_total", SAPI::Metrics::Label("type", entry.first), entry.second.nRejected);
+    writer.Family("p2p_message_banscore_total", "counter", "Ban score the received p2p messages caused, by type");
+    for( const mapMsgCmdStats::value_type &entry : mapStats )
+        writer.Sample("p2p_message_banscore_total", SAPI::Metrics::Label("type", entry.first), entry.second.nBanScore);
+}
+
+static void WriteSmartnodeMetrics(SAPI::Metrics::Writer &writer)
+{
+    writer.Family("smartnodes", "gauge", "Smartnodes in the list by state");
+    writer.Sample("smartnodes", SAPI::Metrics::Label("state", "all"), (int64_t)mnodeman.CountSmartnodes());
+    writer.Sample("smartnodes", SAPI::Metrics::Label("state", "enabled"), (int64_t)mnodeman.CountEnabled());
+
+    writer.Family("smartnode_sync_asset", "gauge", "Current asset of the smartnode sync, 999 when finished");
+    writer.Sample("smartnode_sync_asset", SAPI::Metrics::Label("name", smartnodeSync.GetAssetName()), (int64_t)smartnodeSync.GetAssetID());
+    writer.Family("smartnode_synced", "gauge", "1 if the smartnode sync finished");
+    writer.Sample("smartnode_synced", "", (int64_t)smartnodeSync.IsSynced());
+    writer.Family("blockchain_synced", "gauge", "1 if the smartnode sync considers the blockchain synced");
+    writer.Sample("blockchain_synced", "", (int64_t)smartnodeSync.IsBlockchainSynced());
+}
+
+static void WriteRewardsMetrics(SAPI::Metrics::Writer &writer)
+{
+    if( !prewards )
+        return;
+
+    writer.Family("rewards_cache_bytes", "gauge", "Estimated memory usage of the SmartRewards cache");
+    writer.Sample("rewards_cache_bytes", "", (uint64_t)prewards->GetCacheSize());
+
+    CSmartRewardsTimingHistogram blocks;
+    std::vector<std::pair<std::string, CSmartRewardsTimingHistogram>> vecPhases;
+    prewards->GetStats().GetHistograms(blocks, vecPhases);
+
+    writer.Family("rewards_block_seconds", "histogram", "SmartRewards processing time of the connected blocks");
+    WriteRewardsHistogram(writer, "rewards_block_seconds", "", blocks);
+    writer.Family("rewards_phase_seconds", "histogram", "SmartRewards processing time by phase");
+    for( const std::pair<std::string, CSmartRewardsTimingHistogram> &phase : vecPhases )
+        WriteRewardsHistogram(writer, "rewards_phase_seconds", SAPI::Metrics::Label("phase", phase.first), phase.second);
+}
+
+static void WriteLockMetrics(SAPI::Metrics::Writer &writer)
+{
+    std::vector<CLockStats*> vecStats = GetLockStats();
+
+    if( vecStats.empty() )
+        return;
+
+    writer.Family("lock_acquisitions_total", "counter", "Outermost acquisitions of the locks registered with -lockstats");
+    for( const CLockStats *pstats : vecStats )
+        writer.Sample("lock_acquisitions_total", SAPI::Metrics::Label("lock", pstats->pszName), (int64_t)pstats->nAcquisitions.load());
+    writer.Family("lock_contended_total", "counter", "Acquisitions which had to wait for the lock");
+    for( const CLockStats *pstats : vecStats )
+        writer.Sample("lock_contended_total", SAPI::Metrics::Label("lock", pstats->pszName), (int64_t)pstats->nContended.load());
+    writer.Family("lock_wait_seconds_total", "counter", "Time threads waited for the lock");
+    for( const CLockStats *pstats : vecStats )
+        writer.Sample("lock_wait_seconds_total", SAPI::Metrics::Label("lock", pstats->pszName), pstats->nWaitTime.load() * 0.000001);
+    writer.Family("lock_hold_seconds_total", "counter", "Time the lock was held");
+    for( const CLockStats *pstats : vecStats )
+        writer.Sample("lock_hold_seconds_total", SAPI::Metrics::Label("lock", pstats->pszName), pstats->nHoldTime.load() * 0.000001);
+}
+
+static void WriteSAPIMetrics(SAPI::Metrics::Writer &writer)
+{
+    sapiStatistics.Update();
+
+    writer.Family("sapi_requests_total", "counter", "SAPI requests by result");
+    writer.Sample("sapi_requests_total", SAPI::Metrics::Label("result", "valid"), sapiStatistics.GetTotalValidRequests());
+    writer.Sample("sapi_requests_total", SAPI::Metrics::Label("result", "invalid"), sapiStatistics.GetTotalInvalidRequests());
+    writer.Sample("sapi_requests_total", SAPI::Metrics::Label("result", "blocked"), sapiStatistics.GetTotalBlockedRequests());
+    writer.Family("sapi_connections_total", "counter", "SAPI requests by whether they opened a connection or reused one");
+    writer.Sample("sapi_connections_total", SAPI::Metrics::Label("type", "new"), sapiStatistics.GetTotalConnections());
+    writer.Sample("sapi_connections_total", SAPI::Metrics::Label("type", "reused"), sapiStatistics.GetTotalReusedRequests());
+
+    SAPI::Timing::WriteMetrics(writer);
+}
+
+static bool metrics(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    if( !SAPI::IsWhitelistedRange(req->GetPeer()) )
+        return SAPI::Error(req, HTTPStatus::FORBIDDEN, "The metrics are only available to whitelisted clients, see -sapiwhitelist");
+
+    // The text format doesn't fit into the JSON of a /batch reply
+    if( SAPI::IsCaptured(req) )
+        return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "The metrics can't be part of a batch request");
+
+    std::string strMetrics;
+    strMetrics.reserve(METRICS_BUFFER_SIZE);
+
+    SAPI::Metrics::Writer writer(strMetrics);
+
+    WriteChainMetrics(writer);
+    WriteNetworkMetrics(writer);
+    WriteSmartnodeMetrics(writer);
+    WriteRewardsMetrics(writer);
+    WriteLockMetrics(writer);
+    WriteSAPIMetrics(writer);
+
+    SAPI::AddDefaultHeaders(req);
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4; charset=utf-8");
+    req->WriteReply(HTTPStatus::OK, strMetrics);
+
+    return true;
+}
@@ -0,0 +1,12 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_SAPI_METRICS_H
+#define SMARTCASH_SAPI_METRICS_H
+
+#include "sapi/sapi.h"
+
+extern SAPI::EndpointGroup metricsEndpoints;
+
+#endif // SMARTCASH_SAPI_METRICS_H
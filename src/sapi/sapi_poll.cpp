@@ -0,0 +1,308 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sapi/sapi.h"
+#include "base58.h"
+#include "primitives/block.h"
+#include "script/standard.h"
+#include "spentindex.h"
+#include "util.h"
+#include "validationinterface.h"
+
+typedef std::pair<uint160, int> CSAPIPollAddress;
+
+/** Long-poll request which waits for activity of its addresses. */
+struct CSAPIPollRequest{
+    HTTPRequest *req;
+    //! Null until the work item of the request handed it over
+    std::unique_ptr<HTTPRequest> owned;
+    std::vector<CSAPIPollAddress> vecAddresses;
+    int64_t nDeadline;
+    UniValue events;
+    CSAPIPollRequest() : req(nullptr), nDeadline(0), events(UniValue::VARR) {}
+};
+
+/** Net amount of every address the inputs and outputs of the transaction touch.
+ *  The inputs are only known with the spent index. */
+static void GetTouchedAddresses(const CTransaction &tx, std::map<CSAPIPollAddress, CAmount> &mapTouched)
+{
+    for( const CTxOut &out : tx.vout ){
+
+        CTxDestination dest;
+        uint160 hashBytes;
+        int type = 0;
+
+        if( ExtractDestination(out.scriptPubKey, dest) && CBitcoinAddress(dest).GetIndexKey(hashBytes, type) )
+            mapTouched[std::make_pair(hashBytes, type)] += out.nValue;
+    }
+
+    if( tx.IsCoinBase() )
+        return;
+
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vecSpent;
+
+    for( const CTxIn &in : tx.vin )
+        vecSpent.push_back(std::make_pair(CSpentIndexKey(in.prevout.hash, in.prevout.n), CSpentIndexValue()));
+
+    if( !GetSpentIndex(vecSpent) )
+        return;
+
+    for( const auto &spent : vecSpent ){
+
+        const CSpentIndexValue &value = spent.second;
+
+        if( !value.IsNull() && value.addressType )
+            mapTouched[std::make_pair(value.addressHash, value.addressType)] -= value.satoshis;
+    }
+}
+
+class CSAPIAddressPoll : public CValidationInterface
+{
+    boost::mutex cs;
+    boost::condition_variable cond;
+
+    std::map<const HTTPRequest*, std::unique_ptr<CSAPIPollRequest>> mapRequests;
+    std::multimap<CSAPIPollAddress, CSAPIPollRequest*> mapAddresses;
+
+    size_t nMaxRequests;
+    bool fRunning;
+    boost::thread thread;
+
+    /** Requires cs. */
+    std::unique_ptr<CSAPIPollRequest> Remove(std::map<const HTTPRequest*, std::unique_ptr<CSAPIPollRequest>>::iterator it)
+    {
+        std::unique_ptr<CSAPIPollRequest> request = std::move(it->second);
+
+        for( const CSAPIPollAddress &address : request->vecAddresses ){
+            auto range = mapAddresses.equal_range(address);
+            for( auto itAddress = range.first; itAddress != range.second; ++itAddress ){
+                if( itAddress->second == request.get() ){
+                    mapAddresses.erase(itAddress);
+                    break;
+                }
+            }
+        }
+
+        mapRequests.erase(it);
+
+        return request;
+    }
+
+    static void Reply(std::unique_ptr<CSAPIPollRequest> request)
+    {
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("events", request->events);
+        result.pushKV("timestamp", GetTime());
+
+        // Back to the idle timeout of kept-alive connections
+        request->req->SetConnectionTimeout(GetArg("-sapiservertimeout", DEFAULT_SAPI_SERVER_TIMEOUT));
+        SAPI::WriteReply(request->req, result);
+    }
+
+    void Notify(const std::string &strType, const CTransaction &tx, const CBlock *pblock)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            if( mapAddresses.empty() )
+                return;
+        }
+
+        std::map<CSAPIPollAddress, CAmount> mapTouched;
+        GetTouchedAddresses(tx, mapTouched);
+
+        bool fWake = false;
+        boost::lock_guard<boost::mutex> lock(cs);
+
+        for( const std::pair<CSAPIPollAddress, CAmount> &touched : mapTouched ){
+
+            auto range = mapAddresses.equal_range(touched.first);
+            std::string strAddress;
+
+            if( range.first == range.second || !getAddressFromIndex(touched.first.second, touched.first.first, strAddress) )
+                continue;
+
+            UniValue event(UniValue::VOBJ);
+            event.pushKV("type", strType);
+            event.pushKV("address", strAddress);
+            event.pushKV("txid", tx.GetHash().GetHex());
+            event.pushKV("satoshis", touched.second);
+            if( pblock )
+                event.pushKV("blockhash", pblock->GetHash().GetHex());
+
+            for( auto it = range.first; it != range.second; ++it )
+                it->second->events.push_back(event);
+
+            fWake = true;
+        }
+
+        if( fWake )
+            cond.notify_one();
+    }
+
+    /** Reply to requests which saw activity or timed out. */
+    void Run()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+
+        while( fRunning ){
+
+            int64_t nNow = GetTimeMicros();
+            int64_t nNext = nNow + SAPI_POLL_MAX_TIMEOUT * 1000000LL;
+            std::vector<std::unique_ptr<CSAPIPollRequest>> vecReply;
+
+            for( auto it = mapRequests.begin(); it != mapRequests.end(); ){
+
+                const CSAPIPollRequest &request = *it->second;
+
+                if( !request.owned ){
+                    ++it;
+                }else if( request.events.size() || request.nDeadline <= nNow ){
+                    vecReply.push_back(Remove(it++));
+                }else{
+                    nNext = std::min(nNext, request.nDeadline);
+                    ++it;
+                }
+            }
+
+            if( vecReply.size() ){
+                lock.unlock();
+                for( std::unique_ptr<CSAPIPollRequest> &request : vecReply )
+                    Reply(std::move(request));
+                lock.lock();
+                continue;
+            }
+
+            cond.timed_wait(lock, boost::posix_time::microseconds(nNext - nNow));
+        }
+    }
+
+public:
+
+    CSAPIAddressPoll() : nMaxRequests(0), fRunning(false) {}
+
+    void Start()
+    {
+        boost::lock_guard<boost::mutex> lock(cs);
+        nMaxRequests = std::max<int64_t>(GetArg("-sapimaxpolls", DEFAULT_SAPI_MAX_POLLS), 0);
+        fRunning = true;
+        thread = boost::thread(boost::bind(&CSAPIAddressPoll::Run, this));
+    }
+
+    /** Stop the poll thread and reply to all requests which wait. */
+    void Interrupt()
+    {
+        std::vector<std::unique_ptr<CSAPIPollRequest>> vecReply;
+
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            fRunning = false;
+            cond.notify_all();
+
+            for( auto it = mapRequests.begin(); it != mapRequests.end(); ){
+                if( it->second->owned )
+                    vecReply.push_back(Remove(it++));
+                else
+                    ++it;
+            }
+        }
+
+        if( thread.joinable() )
+            thread.join();
+
+        for( std::unique_ptr<CSAPIPollRequest> &request : vecReply )
+            Reply(std::move(request));
+    }
+
+    bool Wait(HTTPRequest *req, const std::vector<CSAPIPollAddress> &vecAddresses, int64_t nTimeout)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+
+            if( fRunning && mapRequests.size() < nMaxRequests ){
+
+                std::unique_ptr<CSAPIPollRequest> request(new CSAPIPollRequest());
+                request->req = req;
+                request->vecAddresses = vecAddresses;
+                request->nDeadline = GetTimeMicros() + nTimeout * 1000000;
+
+                for( const CSAPIPollAddress &address : vecAddresses )
+                    mapAddresses.insert(std::make_pair(address, request.get()));
+
+                mapRequests[req] = std::move(request);
+
+                // Not replied before Adopt, the timeout can still be raised here.
+                req->SetConnectionTimeout(nTimeout + GetArg("-sapiservertimeout", DEFAULT_SAPI_SERVER_TIMEOUT));
+                return true;
+            }
+        }
+
+        return SAPI::Error(req, HTTPStatus::SERVICE_UNAVAILABLE, SAPI::Result(SAPI::PollLimitExceeded, SAPI::Validation::ResultMessage(SAPI::PollLimitExceeded)));
+    }
+
+    bool Adopt(std::unique_ptr<HTTPRequest> &req)
+    {
+        std::unique_ptr<CSAPIPollRequest> request;
+
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+
+            auto it = mapRequests.find(req.get());
+
+            if( it == mapRequests.end() )
+                return false;
+
+            it->second->owned = std::move(req);
+
+            if( fRunning ){
+                cond.notify_one();
+                return true;
+            }
+
+            // Interrupted while the handler ran
+            request = Remove(it);
+        }
+
+        Reply(std::move(request));
+        return true;
+    }
+
+    // CValidationInterface
+    void SyncTransaction(const CTransaction &tx, const CBlock *pblock) override
+    {
+        Notify(pblock ? "block" : "transaction", tx, pblock);
+    }
+
+    void NotifyTransactionLock(const CTransaction &tx) override
+    {
+        Notify("instantpay", tx, nullptr);
+    }
+};
+
+static CSAPIAddressPoll addressPoll;
+
+void SAPI::Poll::Start()
+{
+    addressPoll.Start();
+    RegisterValidationInterface(&addressPoll);
+}
+
+void SAPI::Poll::Interrupt()
+{
+    addressPoll.Interrupt();
+}
+
+void SAPI::Poll::Stop()
+{
+    UnregisterValidationInterface(&addressPoll);
+}
+
+bool SAPI::Poll::Wait(HTTPRequest *req, const std::vector<std::pair<uint160, int>> &vecAddresses, int64_t nTimeout)
+{
+    return addressPoll.Wait(req, vecAddresses, nTimeout);
+}
+
+bool SAPI::Poll::Adopt(std::unique_ptr<HTTPRequest> &req)
+{
+    return addressPoll.Adopt(req);
+}
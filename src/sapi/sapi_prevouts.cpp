@@ -0,0 +1,171 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sapi/sapi.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "util.h"
+
+#include <atomic>
+#include <list>
+
+/** LRU of decoded previous outputs by their outpoint. */
+class CSAPIPrevoutCache
+{
+    typedef std::list<std::pair<COutPoint, CTxOut>> EntryList;
+
+    boost::mutex cs;
+    EntryList listEntries;
+    std::map<COutPoint, EntryList::iterator> mapEntries;
+    size_t nMaxEntries;
+
+public:
+
+    explicit CSAPIPrevoutCache(size_t nMaxEntries) : nMaxEntries(nMaxEntries) {}
+
+    bool Get(const COutPoint &outpoint, CTxOut &txout)
+    {
+        boost::lock_guard<boost::mutex> lock(cs);
+
+        auto it = mapEntries.find(outpoint);
+
+        if( it == mapEntries.end() )
+            return false;
+
+        listEntries.splice(listEntries.begin(), listEntries, it->second);
+        txout = it->second->second;
+
+        return true;
+    }
+
+    void Add(const COutPoint &outpoint, const CTxOut &txout)
+    {
+        boost::lock_guard<boost::mutex> lock(cs);
+
+        auto it = mapEntries.find(outpoint);
+
+        if( it != mapEntries.end() ){
+            listEntries.splice(listEntries.begin(), listEntries, it->second);
+            return;
+        }
+
+        listEntries.push_front(std::make_pair(outpoint, txout));
+        mapEntries[outpoint] = listEntries.begin();
+
+        while( listEntries.size() > nMaxEntries ){
+            mapEntries.erase(listEntries.back().first);
+            listEntries.pop_back();
+        }
+    }
+};
+
+static CSAPIPrevoutCache prevoutCache(SAPI_PREVOUT_CACHE_SIZE);
+
+/** Same as the txindex path of GetTransaction but without cs_main. */
+static bool ReadIndexedTransaction(const uint256 &hash, CTransaction &tx)
+{
+    CDiskTxPos postx;
+
+    if( !pblocktree->ReadTxIndex(hash, postx) )
+        return false;
+
+    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+
+    if( file.IsNull() )
+        return error("%s: OpenBlockFile failed", __func__);
+
+    CBlockHeader header;
+
+    try{
+        file >> header;
+        fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+        file >> tx;
+    }catch(const std::exception &e){
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    if( tx.GetHash() != hash )
+        return error("%s: txid mismatch", __func__);
+
+    return true;
+}
+
+bool SAPI::Prevouts::Resolve(const std::vector<const CTransaction*> &vecTx, std::map<COutPoint, CTxOut> &mapPrevouts)
+{
+    // Output indexes not in the cache by the transaction which holds them
+    std::map<uint256, std::vector<uint32_t>> mapMissing;
+
+    for( const CTransaction *tx : vecTx ){
+
+        if( tx->IsCoinBase() || tx->IsZerocoinSpend() )
+            continue;
+
+        for( const CTxIn &in : tx->vin ){
+
+            CTxOut txout;
+
+            if( mapPrevouts.count(in.prevout) )
+                continue;
+
+            if( prevoutCache.Get(in.prevout, txout) )
+                mapPrevouts[in.prevout] = txout;
+            else
+                mapMissing[in.prevout.hash].push_back(in.prevout.n);
+        }
+    }
+
+    if( mapMissing.empty() )
+        return true;
+
+    std::vector<const uint256*> vecHashes;
+    vecHashes.reserve(mapMissing.size());
+
+    for( const std::pair<const uint256, std::vector<uint32_t>> &missing : mapMissing )
+        vecHashes.push_back(&missing.first);
+
+    std::vector<CTransaction> vecPrevTx(vecHashes.size());
+    // No std::vector<bool>, the threads write next to each other
+    std::vector<char> vecFound(vecHashes.size(), 0);
+    std::atomic<size_t> nNext(0);
+
+    auto read = [&](){
+        for( size_t i; (i = nNext.fetch_add(1)) < vecHashes.size(); )
+            vecFound[i] = mempool.lookup(*vecHashes[i], vecPrevTx[i]) || (fTxIndex && ReadIndexedTransaction(*vecHashes[i], vecPrevTx[i]));
+    };
+
+    // The worker thread of the request reads too, the helpers only speed it up
+    int nHelpers = std::min<int>(SAPI_PREVOUT_THREADS, vecHashes.size() / SAPI_PREVOUT_THREAD_TXS) - 1;
+    boost::thread_group helpers;
+
+    for( int i = 0; i < nHelpers; i++ )
+        helpers.create_thread(read);
+
+    read();
+    helpers.join_all();
+
+    bool fComplete = true;
+
+    for( size_t i = 0; i < vecHashes.size(); i++ ){
+
+        if( !vecFound[i] ){
+            fComplete = false;
+            continue;
+        }
+
+        for( uint32_t n : mapMissing[*vecHashes[i]] ){
+
+            if( n >= vecPrevTx[i].vout.size() ){
+                fComplete = false;
+                continue;
+            }
+
+            COutPoint outpoint(*vecHashes[i], n);
+
+            mapPrevouts[outpoint] = vecPrevTx[i].vout[n];
+            prevoutCache.Add(outpoint, vecPrevTx[i].vout[n]);
+        }
+    }
+
+    return fComplete;
+}
@@ -33,13 +33,15 @@ SAPI::EndpointGroup smartnodeEndpoints = {
             "list", HTTPRequest::GET, UniValue::VNULL, smartnodes_list,
             {
                 // No body parameter
-            }
+            },
+            SAPI::CostExpensive
         },
         {
             "check", HTTPRequest::POST, UniValue::VARR, smartnodes_check_list,
             {
                // No body parameter
-            }
+            },
+            SAPI::CostExpensive
         },
         {
             "check/{info}", HTTPRequest::GET, UniValue::VNULL, smartnodes_check_one,
@@ -52,7 +54,8 @@ SAPI::EndpointGroup smartnodeEndpoints = {
             {
                 SAPI::BodyParameter(SAPI::Keys::status, new SAPI::Validation::String(), true),
                 SAPI::BodyParameter(SAPI::Keys::protocol, new SAPI::Validation::Int(), true)
-            }
+            },
+            SAPI::CostExpensive
         },
         {
             "roi", HTTPRequest::GET, UniValue::VNULL, smartnodes_roi,
@@ -66,11 +69,10 @@ SAPI::EndpointGroup smartnodeEndpoints = {
 static bool CheckSmartnodes(HTTPRequest* req, std::vector<std::string> vecInfos, std::vector<UniValue> &vecResults)
 {
 
-    std::map<COutPoint, CSmartnode> mapSmartnodes = mnodeman.GetFullSmartnodeMap();
+    CSmartnodeMan::snapshot_t snapshot = mnodeman.GetSmartnodeSnapshot();
 
-    for (auto& mnpair : mapSmartnodes) {
-        CSmartnode mn = mnpair.second;
-        std::string strOutpoint = strprintf("%s:%d", mnpair.first.hash.ToString(), mnpair.first.n);
+    for (const CSmartnode& mn : *snapshot) {
+        std::string strOutpoint = strprintf("%s:%d", mn.vin.prevout.hash.ToString(), mn.vin.prevout.n);
 
         std::ostringstream streamFull;
         streamFull << std::setw(18) <<
@@ -132,7 +134,7 @@ static bool smartnodes_count(HTTPRequest* req, const std::map<std::string, std::
 
 static bool smartnodes_roi(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
 {
-    LOCK(cs_main);
+    SAPI_LOCK_MAIN();
     UniValue response(UniValue::VOBJ);
 
     {
@@ -150,10 +152,9 @@ static bool smartnodes_list(HTTPRequest* req, const std::map<std::string, std::s
 {
     UniValue obj(UniValue::VOBJ);
 
-    std::map<COutPoint, CSmartnode> mapSmartnodes = mnodeman.GetFullSmartnodeMap();
+    CSmartnodeMan::snapshot_t snapshot = mnodeman.GetSmartnodeSnapshot();
 
-    for (auto& mnpair : mapSmartnodes) {
-        CSmartnode mn = mnpair.second;
+    for (const CSmartnode& mn : *snapshot) {
 
         UniValue node(UniValue::VOBJ);
 
@@ -166,7 +167,7 @@ static bool smartnodes_list(HTTPRequest* req, const std::map<std::string, std::s
         node.pushKV("lastPaidBlock", mn.GetLastPaidBlock());
         node.pushKV("ip", mn.addr.ToString());
 
-        obj.pushKV(strprintf("%s:%d", mnpair.first.hash.ToString(), mnpair.first.n), node);
+        obj.pushKV(strprintf("%s:%d", mn.vin.prevout.hash.ToString(), mn.vin.prevout.n), node);
     }
 
     SAPI::WriteReply(req, obj);
@@ -228,10 +229,9 @@ static bool smartnodes_filter_list(HTTPRequest* req, const std::map<std::string,
 
     UniValue result(UniValue::VARR);
 
-    std::map<COutPoint, CSmartnode> mapSmartnodes = mnodeman.GetFullSmartnodeMap();
+    CSmartnodeMan::snapshot_t snapshot = mnodeman.GetSmartnodeSnapshot();
 
-    for (auto& mnpair : mapSmartnodes) {
-        CSmartnode mn = mnpair.second;
+    for (const CSmartnode& mn : *snapshot) {
         if (((filterStatus == "*") || (mn.GetStatus() == filterStatus)) &&
             ((filterProtocol < 0) || (mn.nProtocolVersion == filterProtocol))) {
             UniValue obj(UniValue::VOBJ);
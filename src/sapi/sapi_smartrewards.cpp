@@ -6,6 +6,7 @@
 #include "sapi.h"
 
 #include <algorithm>
+#include <unordered_set>
 #include "base58.h"
 #include "rpc/client.h"
 #include "sapi_validation.h"
@@ -29,6 +30,7 @@ static std::unordered_map<uint8_t, std::string> bonusLevelStr = {
 static bool smartrewards_current(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool smartrewards_roi(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool smartrewards_history(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool smartrewards_payouts(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool smartrewards_check_one(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool smartrewards_check_list(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 
@@ -53,11 +55,21 @@ SAPI::EndpointGroup smartrewardsEndpoints = {
                 // No body parameter
             }
         },
+        {
+            "payouts", HTTPRequest::POST, UniValue::VOBJ, smartrewards_payouts,
+            {
+                SAPI::BodyParameter(SAPI::Keys::round,          new SAPI::Validation::IntRange(1,INT16_MAX)),
+                SAPI::BodyParameter(SAPI::Keys::pageNumber,     new SAPI::Validation::IntRange(1,INT_MAX)),
+                SAPI::BodyParameter(SAPI::Keys::pageSize,       new SAPI::Validation::IntRange(1,1000))
+            },
+            SAPI::CostExpensive
+        },
         {
             "check", HTTPRequest::POST, UniValue::VARR, smartrewards_check_list,
             {
                // No body parameter
-            }
+            },
+            SAPI::CostExpensive
         },
         {
             "check/{address}", HTTPRequest::GET, UniValue::VNULL, smartrewards_check_one,
@@ -76,28 +88,43 @@ static bool CheckAddresses(HTTPRequest* req, std::vector<std::string> vecAddr, s
 
     vecResults.clear();
 
+    CSmartRewardsRoundsSnapshotRef rounds = prewards->GetRoundsSnapshot();
+    const CSmartRewardRound *current = &rounds->current;
+
+    // The entries are read through the cache.
     TRY_LOCK(cs_rewardscache,cacheLocked);
 
     if(!cacheLocked) return SAPI::Error(req, SAPI::RewardsDatabaseBusy, "Rewards database is busy..Try it again!");
 
-    const CSmartRewardRound *current = prewards->GetCurrentRound();
-
     int nFirst_1_3_Round = Params().GetConsensus().nRewardsFirst_1_3_Round;
 
+    std::vector<CSmartAddress> vecIds;
+
     for( auto addrStr : vecAddr ){
+        vecIds.push_back(CSmartAddress::Legacy(addrStr));
+    }
+
+    // Resolve all addresses at once, the database lookups share one cursor.
+    CSmartRewardEntryList vecEntries;
+    std::vector<bool> vecFound;
+
+    if( !prewards->GetRewardEntries(vecIds, vecEntries, vecFound) ){
+        return SAPI::Error(req, HTTPStatus::INTERNAL_SERVER_ERROR, "Failed to read the rewards database.");
+    }
 
-        CSmartAddress id = CSmartAddress::Legacy(addrStr);
+    for( size_t i = 0; i < vecAddr.size(); ++i ){
+
+        const CSmartAddress &id = vecIds[i];
+        CSmartRewardEntry &entry = vecEntries[i];
 
         if( !id.IsValid() ){
             code = SAPI::InvalidSmartCashAddress;
-            std::string message = "Invalid address: " + addrStr;
+            std::string message = "Invalid address: " + vecAddr[i];
             errors.push_back(SAPI::Result(code, message));
             continue;
         }
 
-        CSmartRewardEntry *entry = nullptr;
-
-        if( !prewards->GetRewardEntry(id, entry, false) ){
+        if( !vecFound[i] ){
             code = SAPI::AddressNotFound;
             std::string message = "Couldn't find this SmartCash address in the database.";
             errors.push_back(SAPI::Result(code, message));
@@ -107,12 +134,12 @@ static bool CheckAddresses(HTTPRequest* req, std::vector<std::string> vecAddr, s
         UniValue obj(UniValue::VOBJ);
 
         obj.pushKV("address",id.ToString());
-        obj.pushKV("balance",UniValueFromAmount(entry->balance));
-        obj.pushKV("balance_eligible", UniValueFromAmount(entry->balanceEligible));
-        obj.pushKV("is_smartnode", !entry->smartnodePaymentTx.IsNull());
-        obj.pushKV("activated", entry->fActivated);
-        obj.pushKV("eligible", current->number < nFirst_1_3_Round ? entry->balanceEligible > 0 : entry->IsEligible());
-        obj.pushKV("bonus_level", bonusLevelStr.count(entry->bonusLevel) ? bonusLevelStr[entry->bonusLevel] : "unknown");
+        obj.pushKV("balance",UniValueFromAmount(entry.balance));
+        obj.pushKV("balance_eligible", UniValueFromAmount(entry.balanceEligible));
+        obj.pushKV("is_smartnode", !entry.smartnodePaymentTx.IsNull());
+        obj.pushKV("activated", entry.fActivated);
+        obj.pushKV("eligible", current->number < nFirst_1_3_Round ? entry.balanceEligible > 0 : entry.IsEligible());
+        obj.pushKV("bonus_level", bonusLevelStr.count(entry.bonusLevel) ? bonusLevelStr[entry.bonusLevel] : "unknown");
 
         vecResults.push_back(obj);
     }
@@ -132,11 +159,8 @@ static bool smartrewards_current(HTTPRequest* req, const std::map<std::string, s
 {
     UniValue obj(UniValue::VOBJ);
 
-    TRY_LOCK(cs_rewardscache, cacheLocked);
-
-    if(!cacheLocked) return SAPI::Error(req, SAPI::RewardsDatabaseBusy, "Rewards database is busy..Try it again!");
-
-    const CSmartRewardRound *current = prewards->GetCurrentRound();
+    CSmartRewardsRoundsSnapshotRef rounds = prewards->GetRoundsSnapshot();
+    const CSmartRewardRound *current = &rounds->current;
 
     if( !current->number ) return SAPI::Error(req, SAPI::NoActiveRewardRound, "No active reward round available yet.");
 
@@ -145,8 +169,8 @@ static bool smartrewards_current(HTTPRequest* req, const std::map<std::string, s
     obj.pushKV("start_blocktime",current->startBlockTime);
     obj.pushKV("end_blockheight",current->endBlockHeight);
     obj.pushKV("end_blocktime",current->endBlockTime);
-    obj.pushKV("eligible_addresses",((current->eligibleEntries - current->disqualifiedEntries) > 0) ? (current->eligibleEntries - current->disqualifiedEntries) : 0);
-    obj.pushKV("eligible_smart",UniValueFromAmount(((current->eligibleSmart - current->disqualifiedSmart) > 0) ? (current->eligibleSmart - current->disqualifiedSmart) : 0));
+    obj.pushKV("eligible_addresses",current->GetEligibleEntries());
+    obj.pushKV("eligible_smart",UniValueFromAmount(current->GetEligibleSmart()));
     obj.pushKV("disqualified_addresses",current->disqualifiedEntries);
     obj.pushKV("disqualified_smart",UniValueFromAmount(current->disqualifiedSmart));
     obj.pushKV("estimated_rewards",UniValueFromAmount(current->rewards));
@@ -161,11 +185,8 @@ static bool smartrewards_roi(HTTPRequest* req, const std::map<std::string, std::
 {
     UniValue obj(UniValue::VOBJ);
 
-    TRY_LOCK(cs_rewardscache, cacheLocked);
-
-    if(!cacheLocked) return SAPI::Error(req, SAPI::RewardsDatabaseBusy, "Rewards database is busy..Try it again!");
-
-    const CSmartRewardRound *current = prewards->GetCurrentRound();
+    CSmartRewardsRoundsSnapshotRef rounds = prewards->GetRoundsSnapshot();
+    const CSmartRewardRound *current = &rounds->current;
 
     if( !current->number ) return SAPI::Error(req, SAPI::NoActiveRewardRound, "No active reward round available yet.");
 
@@ -191,11 +212,8 @@ static bool smartrewards_history(HTTPRequest* req, const std::map<std::string, s
 {
     UniValue obj(UniValue::VARR);
 
-    TRY_LOCK(cs_rewardscache, cacheLocked);
-
-    if(!cacheLocked) return SAPI::Error(req, SAPI::RewardsDatabaseBusy, "Rewards database is busy..Try it again!");
-
-    const CSmartRewardRoundMap* history = prewards->GetRewardRounds();
+    CSmartRewardsRoundsSnapshotRef rounds = prewards->GetRoundsSnapshot();
+    const CSmartRewardRoundMap* history = rounds->history.get();
 
     int64_t nPayoutDelay = Params().GetConsensus().nRewardsPayoutStartDelay;
 
@@ -203,17 +221,20 @@ static bool smartrewards_history(HTTPRequest* req, const std::map<std::string, s
 
     auto round = history->begin();
 
+    obj.reserve(history->size());
+
     while( round != history->end() ){
 
         UniValue roundObj(UniValue::VOBJ);
+        roundObj.reserve(12);
 
         roundObj.pushKV("rewards_cycle",round->second.number);
         roundObj.pushKV("start_blockheight",round->second.startBlockHeight);
         roundObj.pushKV("start_blocktime",round->second.startBlockTime);
         roundObj.pushKV("end_blockheight",round->second.endBlockHeight);
         roundObj.pushKV("end_blocktime",round->second.endBlockTime);
-        roundObj.pushKV("eligible_addresses",((round->second.eligibleEntries - round->second.disqualifiedEntries) > 0) ? (round->second.eligibleEntries - round->second.disqualifiedEntries) : 0);
-        roundObj.pushKV("eligible_smart",UniValueFromAmount(((round->second.eligibleSmart - round->second.disqualifiedSmart) > 0) ? (round->second.eligibleSmart - round->second.disqualifiedSmart) : 0));
+        roundObj.pushKV("eligible_addresses",round->second.GetEligibleEntries());
+        roundObj.pushKV("eligible_smart",UniValueFromAmount(round->second.GetEligibleSmart()));
         roundObj.pushKV("disqualified_addresses",round->second.disqualifiedEntries);
         roundObj.pushKV("disqualified_smart",UniValueFromAmount(round->second.disqualifiedSmart));
         roundObj.pushKV("rewards",UniValueFromAmount(round->second.rewards));
@@ -221,8 +242,8 @@ static bool smartrewards_history(HTTPRequest* req, const std::map<std::string, s
 
         UniValue payObj(UniValue::VOBJ);
 
-        if ( (round->second.eligibleEntries - round->second.disqualifiedEntries) > 0) {
-            int nPayeeCount = round->second.eligibleEntries - round->second.disqualifiedEntries;
+        if (round->second.GetEligibleEntries() > 0) {
+            int nPayeeCount = round->second.GetEligibleEntries();
             int nBlockPayees = round->second.nBlockPayees;
             int nPayoutInterval = round->second.nBlockInterval;
             int nRewardBlocks = nPayeeCount / nBlockPayees;
@@ -240,13 +261,59 @@ static bool smartrewards_history(HTTPRequest* req, const std::map<std::string, s
             payObj.pushKV("None","No payees were eligible for this round");
         }
 
-        roundObj.pushKV("payouts", payObj);
+        roundObj.pushKV("payouts", std::move(payObj));
 
-        obj.push_back(roundObj);
+        obj.push_back(std::move(roundObj));
 
         ++round;
     }
 
+    SAPI::Cache::SetCacheable(req);
+    SAPI::WriteReply(req, obj);
+
+    return true;
+}
+
+static bool smartrewards_payouts(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    int64_t nRound = bodyParameter[SAPI::Keys::round].get_int64();
+    int64_t nPageNumber = bodyParameter[SAPI::Keys::pageNumber].get_int64();
+    int64_t nPageSize = bodyParameter[SAPI::Keys::pageSize].get_int64();
+
+    CSmartRewardsRoundsSnapshotRef rounds = prewards->GetRoundsSnapshot();
+
+    auto round = rounds->history->find(nRound);
+
+    if( round == rounds->history->end() )
+        return SAPI::Error(req, SAPI::NoFinishedRewardRound, strprintf("Past SmartReward round required: 1 - %d", rounds->current.number - 1));
+
+    // Only the requested page gets built, the payouts are read from the round's file.
+    UniValue arrPayouts(UniValue::VARR);
+    size_t nPayouts;
+
+    bool fRead = prewards->ForEachRewardPayout(round->second, (nPageNumber - 1) * nPageSize, nPageSize, [&](const CSmartAddress& address, CAmount nReward) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("address", address.ToString());
+        obj.pushKV("reward", UniValueFromAmount(nReward));
+        arrPayouts.push_back(std::move(obj));
+    }, nPayouts);
+
+    if( !fRead ) return SAPI::Error(req, SAPI::RewardsDatabaseBusy, "Rewards database is busy..Try it again!");
+
+    int64_t nPages = nPayouts / nPageSize;
+    if( nPayouts % nPageSize ) nPages++;
+
+    if( nPages && nPageNumber > nPages )
+        return SAPI::Error(req, SAPI::PageOutOfRange, strprintf("Page number out of range: 1 - %d", nPages));
+
+    UniValue obj(UniValue::VOBJ);
+
+    obj.pushKV("rewards_cycle", nRound);
+    obj.pushKV("count", (int64_t)nPayouts);
+    obj.pushKV("pages", nPages);
+    obj.pushKV("page", nPageNumber);
+    obj.pushKV("payouts", arrPayouts);
+
     SAPI::WriteReply(req, obj);
 
     return true;
@@ -276,12 +343,13 @@ static bool smartrewards_check_list(HTTPRequest* req, const std::map<std::string
 
     std::vector<UniValue> vecResults;
     std::vector<std::string> vecAddresses;
+    std::unordered_set<std::string> setAddresses;
 
     for( auto addr : bodyParameter.getValues() ){
 
         std::string addrStr = addr.get_str();
 
-        if( std::find(vecAddresses.begin(), vecAddresses.end(), addrStr) == vecAddresses.end() )
+        if( setAddresses.insert(addrStr).second )
             vecAddresses.push_back(addrStr);
     }
 
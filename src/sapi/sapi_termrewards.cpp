@@ -27,6 +27,8 @@ static std::unordered_map<uint8_t, std::string> bonusLevelStr = {
 };
 */
 static bool termrewards_list(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool termrewards_list_address(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool termrewards_expires(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool termrewards_payments(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool termrewards_roi(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 /*static bool smartrewards_history(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
@@ -38,15 +40,30 @@ SAPI::EndpointGroup termrewardsEndpoints = {
     {
         {
             "list", HTTPRequest::GET, UniValue::VNULL, termrewards_list,
+            {
+                // No body parameter
+            },
+            SAPI::CostExpensive
+        },
+        {
+            "list/{address}", HTTPRequest::GET, UniValue::VNULL, termrewards_list_address,
             {
                 // No body parameter
             }
         },
+        {
+            "expires/{from}/{to}", HTTPRequest::GET, UniValue::VNULL, termrewards_expires,
+            {
+                // No body parameter
+            },
+            SAPI::CostExpensive
+        },
         {
             "payments", HTTPRequest::GET, UniValue::VNULL, termrewards_payments,
             {
                 // No body parameter
-            }
+            },
+            SAPI::CostExpensive
         },
         {
             "roi", HTTPRequest::GET, UniValue::VNULL, termrewards_roi,
@@ -89,12 +106,14 @@ static bool CheckAddresses(HTTPRequest* req, std::vector<std::string> vecAddr, s
 
     vecResults.clear();
 
+    CSmartRewardsRoundsSnapshotRef rounds = prewards->GetRoundsSnapshot();
+    const CSmartRewardRound *current = &rounds->current;
+
+    // The entries are read through the cache.
     TRY_LOCK(cs_rewardscache,cacheLocked);
 
     if(!cacheLocked) return SAPI::Error(req, SAPI::RewardsDatabaseBusy, "Rewards database is busy..Try it again!");
 
-    const CSmartRewardRound *current = prewards->GetCurrentRound();
-
     int nFirst_1_3_Round = Params().GetConsensus().nRewardsFirst_1_3_Round;
 
     for( auto addrStr : vecAddr ){
@@ -108,9 +127,9 @@ static bool CheckAddresses(HTTPRequest* req, std::vector<std::string> vecAddr, s
             continue;
         }
 
-        CSmartRewardEntry *entry = nullptr;
+        CSmartRewardEntry entry;
 
-        if( !prewards->GetRewardEntry(id, entry, false) ){
+        if( !prewards->GetRewardEntry(id, entry) ){
             code = SAPI::AddressNotFound;
             std::string message = "Couldn't find this SmartCash address in the database.";
             errors.push_back(SAPI::Result(code, message));
@@ -120,12 +139,12 @@ static bool CheckAddresses(HTTPRequest* req, std::vector<std::string> vecAddr, s
         UniValue obj(UniValue::VOBJ);
 
         obj.pushKV("address",id.ToString());
-        obj.pushKV("balance",UniValueFromAmount(entry->balance));
-        obj.pushKV("balance_eligible", UniValueFromAmount(entry->balanceEligible));
-        obj.pushKV("is_smartnode", !entry->smartnodePaymentTx.IsNull());
-        obj.pushKV("activated", entry->fActivated);
-        obj.pushKV("eligible", current->number < nFirst_1_3_Round ? entry->balanceEligible > 0 : entry->IsEligible());
-        obj.pushKV("bonus_level", bonusLevelStr.count(entry->bonusLevel) ? bonusLevelStr[entry->bonusLevel] : "unknown");
+        obj.pushKV("balance",UniValueFromAmount(entry.balance));
+        obj.pushKV("balance_eligible", UniValueFromAmount(entry.balanceEligible));
+        obj.pushKV("is_smartnode", !entry.smartnodePaymentTx.IsNull());
+        obj.pushKV("activated", entry.fActivated);
+        obj.pushKV("eligible", current->number < nFirst_1_3_Round ? entry.balanceEligible > 0 : entry.IsEligible());
+        obj.pushKV("bonus_level", bonusLevelStr.count(entry.bonusLevel) ? bonusLevelStr[entry.bonusLevel] : "unknown");
 
         vecResults.push_back(obj);
     }
@@ -180,6 +199,72 @@ static bool termrewards_list(HTTPRequest* req, const std::map<std::string, std::
     return true;
 }
 
+static UniValue TermRewardEntryToJSON(const CTermRewardEntry &entry)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("address", entry.GetAddress());
+    obj.pushKV("tx_hash", entry.txHash.GetHex());
+    obj.pushKV("balance", UniValueFromAmount(entry.balance));
+    obj.pushKV("level", entry.GetLevel());
+    obj.pushKV("percent", entry.percent);
+    obj.pushKV("expires", entry.expires);
+    return obj;
+}
+
+static bool termrewards_list_address(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    if ( !mapPathParams.count("address") )
+        return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "No SmartCash address specified. Use /termrewards/list/<smartcash_address>");
+
+    std::string addrStr = mapPathParams.at("address");
+    CSmartAddress id = CSmartAddress::Legacy(addrStr);
+
+    if( !id.IsValid() ) return SAPI::Error(req, SAPI::InvalidSmartCashAddress, "Invalid address: " + addrStr);
+
+    TRY_LOCK(cs_rewardscache, cacheLocked);
+
+    if( !cacheLocked ) return SAPI::Error(req, SAPI::RewardsDatabaseBusy, "Rewards database is busy..Try it again.");
+
+    CTermRewardEntryList entries;
+
+    if( !prewards->GetTermRewardEntries(id, entries) ) return SAPI::Error(req, HTTPStatus::INTERNAL_SERVER_ERROR, "Failed to get TermRewards entries");
+
+    UniValue arr(UniValue::VARR);
+
+    for( const auto &entry : entries ) arr.push_back(TermRewardEntryToJSON(entry));
+
+    SAPI::WriteReply(req, arr);
+
+    return true;
+}
+
+static bool termrewards_expires(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    uint32_t nFrom = 0, nTo = 0;
+
+    if( !mapPathParams.count("from") || !ParseUInt32(mapPathParams.at("from"), &nFrom) ||
+        !mapPathParams.count("to") || !ParseUInt32(mapPathParams.at("to"), &nTo) )
+        return SAPI::Error(req, SAPI::NumberParserFailed, "Expected the expiry range as timestamps: /termrewards/expires/<from>/<to>");
+
+    if( nFrom > nTo ) return SAPI::Error(req, SAPI::IntOutOfRange, "Range should be in ascending order");
+
+    TRY_LOCK(cs_rewardscache, cacheLocked);
+
+    if( !cacheLocked ) return SAPI::Error(req, SAPI::RewardsDatabaseBusy, "Rewards database is busy..Try it again.");
+
+    CTermRewardEntryList entries;
+
+    if( !prewards->GetTermRewardEntries(nFrom, nTo, entries) ) return SAPI::Error(req, HTTPStatus::INTERNAL_SERVER_ERROR, "Failed to get TermRewards entries");
+
+    UniValue arr(UniValue::VARR);
+
+    for( const auto &entry : entries ) arr.push_back(TermRewardEntryToJSON(entry));
+
+    SAPI::WriteReply(req, arr);
+
+    return true;
+}
+
 static bool termrewards_payments(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
 {
     UniValue obj(UniValue::VOBJ);
@@ -263,8 +348,8 @@ static bool smartrewards_history(HTTPRequest* req, const std::map<std::string, s
         roundObj.pushKV("start_blocktime",round->second.startBlockTime);
         roundObj.pushKV("end_blockheight",round->second.endBlockHeight);
         roundObj.pushKV("end_blocktime",round->second.endBlockTime);
-        roundObj.pushKV("eligible_addresses",((round->second.eligibleEntries - round->second.disqualifiedEntries) > 0) ? (round->second.eligibleEntries - round->second.disqualifiedEntries) : 0);
-        roundObj.pushKV("eligible_smart",UniValueFromAmount(((round->second.eligibleSmart - round->second.disqualifiedSmart) > 0) ? (round->second.eligibleSmart - round->second.disqualifiedSmart) : 0));
+        roundObj.pushKV("eligible_addresses",round->second.GetEligibleEntries());
+        roundObj.pushKV("eligible_smart",UniValueFromAmount(round->second.GetEligibleSmart()));
         roundObj.pushKV("disqualified_addresses",round->second.disqualifiedEntries);
         roundObj.pushKV("disqualified_smart",UniValueFromAmount(round->second.disqualifiedSmart));
         roundObj.pushKV("rewards",UniValueFromAmount(round->second.rewards));
@@ -272,8 +357,8 @@ static bool smartrewards_history(HTTPRequest* req, const std::map<std::string, s
 
         UniValue payObj(UniValue::VOBJ);
 
-        if ( (round->second.eligibleEntries - round->second.disqualifiedEntries) > 0) {
-            int nPayeeCount = round->second.eligibleEntries - round->second.disqualifiedEntries;
+        if (round->second.GetEligibleEntries() > 0) {
+            int nPayeeCount = round->second.GetEligibleEntries();
             int nBlockPayees = round->second.nBlockPayees;
             int nPayoutInterval = round->second.nBlockInterval;
             int nRewardBlocks = nPayeeCount / nBlockPayees;
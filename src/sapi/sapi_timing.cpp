@@ -0,0 +1,265 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sapi/sapi.h"
+#include "util.h"
+
+#include <atomic>
+#include <cmath>
+
+#include <boost/thread/tss.hpp>
+
+/** Lock free latency histogram with four buckets per power of two microseconds. */
+class CSAPILatencyHistogram
+{
+    static const int nSubBits = 2;
+    static const int nSubBuckets = 1 << nSubBits;
+    static const int nBuckets = 36 * nSubBuckets;
+
+    std::atomic<uint64_t> buckets[nBuckets];
+    std::atomic<int64_t> nSum;
+
+    static int Bucket(int64_t nMicros)
+    {
+        if( nMicros < nSubBuckets )
+            return std::max<int64_t>(nMicros, 0);
+
+        int nBit = 63 - __builtin_clzll(nMicros);
+        int nBucket = (nBit - nSubBits + 1) * nSubBuckets + ((nMicros >> (nBit - nSubBits)) & (nSubBuckets - 1));
+
+        return std::min(nBucket, nBuckets - 1);
+    }
+
+    static int64_t UpperBound(int nBucket)
+    {
+        if( nBucket < nSubBuckets )
+            return nBucket;
+
+        int nShift = nBucket / nSubBuckets - 1;
+
+        return ((int64_t)(nSubBuckets + nBucket % nSubBuckets + 1) << nShift) - 1;
+    }
+
+public:
+
+    CSAPILatencyHistogram()
+    {
+        for( std::atomic<uint64_t> &bucket : buckets )
+            bucket.store(0, std::memory_order_relaxed);
+        nSum.store(0, std::memory_order_relaxed);
+    }
+
+    void Add(int64_t nMicros)
+    {
+        buckets[Bucket(nMicros)].fetch_add(1, std::memory_order_relaxed);
+        nSum.fetch_add(nMicros, std::memory_order_relaxed);
+    }
+
+    int64_t Sum() const
+    {
+        return nSum.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Count() const
+    {
+        uint64_t nCount = 0;
+        for( const std::atomic<uint64_t> &bucket : buckets )
+            nCount += bucket.load(std::memory_order_relaxed);
+        return nCount;
+    }
+
+    /** Upper bound in microseconds of the bucket which holds the quantile. */
+    int64_t Percentile(double dQuantile) const
+    {
+        uint64_t nCount = Count();
+
+        if( !nCount )
+            return 0;
+
+        uint64_t nRank = std::max<uint64_t>(std::ceil(dQuantile * nCount), 1), nSeen = 0;
+
+        for( int i = 0; i < nBuckets; i++ ){
+            nSeen += buckets[i].load(std::memory_order_relaxed);
+            if( nSeen >= nRank )
+                return UpperBound(i);
+        }
+
+        return UpperBound(nBuckets - 1);
+    }
+
+    UniValue ToUniValue() const
+    {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("p50", Percentile(0.5));
+        obj.pushKV("p99", Percentile(0.99));
+        obj.pushKV("p999", Percentile(0.999));
+        return obj;
+    }
+};
+
+struct CSAPIEndpointLatency{
+    std::string strEndpoint;
+    const SAPI::Endpoint *endpoint;
+    CSAPILatencyHistogram phases[SAPI::Timing::PhaseCount];
+};
+
+/** Timing of the request processed by a worker thread. */
+struct CSAPIRequestTiming{
+    HTTPRequest *req;
+    CSAPIEndpointLatency *latency;
+    int64_t nStart;
+    int64_t vecPhases[SAPI::Timing::PhaseCount];
+};
+
+static void NoCleanup(CSAPIRequestTiming*) {}
+
+//! Only filled by Start, before the SAPI accepts requests. In the order of the endpoint groups.
+static std::vector<std::unique_ptr<CSAPIEndpointLatency>> vecLatency;
+static std::map<const SAPI::Endpoint*, CSAPIEndpointLatency*> mapLatency;
+//! Timing of the request the worker thread executes, deleted by End
+static boost::thread_specific_ptr<CSAPIRequestTiming> currentTiming(NoCleanup);
+static int64_t nSlowRequestMicros = 0;
+
+static const char *PhaseName(SAPI::Timing::Phase phase)
+{
+    switch(phase){
+    case SAPI::Timing::QueueWait:
+        return "queue";
+    case SAPI::Timing::LockWait:
+        return "lock";
+    case SAPI::Timing::Handler:
+        return "handler";
+    case SAPI::Timing::Serialize:
+        return "serialize";
+    case SAPI::Timing::Total:
+        return "total";
+    default:
+        return "unknown";
+    }
+}
+
+void SAPI::Timing::Start(const std::vector<EndpointGroup*> &groups)
+{
+    mapLatency.clear();
+    vecLatency.clear();
+
+    for( const SAPI::EndpointGroup *group : groups ){
+        for( const SAPI::Endpoint &endpoint : group->endpoints ){
+            std::unique_ptr<CSAPIEndpointLatency> latency(new CSAPIEndpointLatency());
+            latency->strEndpoint = strprintf("%s %s/%s%s", RequestMethodString(endpoint.method), SAPI::versionSubPath, group->prefix,
+                                             endpoint.path.empty() ? "" : "/" + endpoint.path);
+            latency->endpoint = &endpoint;
+            mapLatency[&endpoint] = latency.get();
+            vecLatency.push_back(std::move(latency));
+        }
+    }
+
+    nSlowRequestMicros = std::max<int64_t>(GetArg("-sapislowrequest", DEFAULT_SAPI_SLOW_REQUEST), 0) * 1000;
+}
+
+void SAPI::Timing::Begin(HTTPRequest *req, const SAPI::Endpoint *endpoint, int64_t nTimeQueued)
+{
+    auto it = mapLatency.find(endpoint);
+
+    if( it == mapLatency.end() )
+        return;
+
+    CSAPIRequestTiming *timing = new CSAPIRequestTiming();
+    timing->req = req;
+    timing->latency = it->second;
+    timing->nStart = GetTimeMicros();
+
+    for( int64_t &nPhase : timing->vecPhases )
+        nPhase = 0;
+
+    timing->vecPhases[QueueWait] = timing->nStart - nTimeQueued;
+
+    currentTiming.reset(timing);
+}
+
+void SAPI::Timing::End()
+{
+    std::unique_ptr<CSAPIRequestTiming> timing(currentTiming.get());
+
+    if( !timing )
+        return;
+
+    currentTiming.reset();
+
+    int64_t *vecPhases = timing->vecPhases;
+    int64_t nExecution = GetTimeMicros() - timing->nStart;
+
+    vecPhases[Handler] = std::max<int64_t>(nExecution - vecPhases[LockWait] - vecPhases[Serialize], 0);
+    vecPhases[Total] = vecPhases[QueueWait] + nExecution;
+
+    for( int i = 0; i < PhaseCount; i++ )
+        timing->latency->phases[i].Add(vecPhases[i]);
+
+    if( nSlowRequestMicros && vecPhases[Total] >= nSlowRequestMicros ){
+        LogPrintf("SAPI: slow request %s from %s took %.3fms (queue %.3fms, lock %.3fms, handler %.3fms, serialize %.3fms)\n",
+                  timing->req->GetURI(), timing->req->GetPeer().ToString(), vecPhases[Total] * 0.001,
+                  vecPhases[QueueWait] * 0.001, vecPhases[LockWait] * 0.001, vecPhases[Handler] * 0.001, vecPhases[Serialize] * 0.001);
+    }
+}
+
+void SAPI::Timing::Add(Phase phase, int64_t nMicros)
+{
+    CSAPIRequestTiming *timing = currentTiming.get();
+
+    if( timing )
+        timing->vecPhases[phase] += nMicros;
+}
+
+UniValue SAPI::Timing::ToUniValue()
+{
+    UniValue arr(UniValue::VARR);
+
+    for( const std::unique_ptr<CSAPIEndpointLatency> &entry : vecLatency ){
+
+        const CSAPIEndpointLatency &latency = *entry;
+        uint64_t nCount = latency.phases[Total].Count();
+
+        if( !nCount )
+            continue;
+
+        UniValue obj(UniValue::VOBJ);
+
+        obj.pushKV("endpoint", latency.strEndpoint);
+        obj.pushKV("requests", nCount);
+
+        for( int i = 0; i < PhaseCount; i++ )
+            obj.pushKV(PhaseName(static_cast<Phase>(i)), latency.phases[i].ToUniValue());
+
+        arr.push_back(obj);
+    }
+
+    return arr;
+}
+
+void SAPI::Timing::WriteMetrics(Metrics::Writer &writer)
+{
+    static const double vecQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    writer.Family("sapi_request_duration_seconds", "summary", "Time of the SAPI requests by endpoint and phase, quantiles as the upper bound of their histogram bucket");
+
+    for( const std::unique_ptr<CSAPIEndpointLatency> &entry : vecLatency ){
+
+        const CSAPIEndpointLatency &latency = *entry;
+
+        if( !latency.phases[Total].Count() )
+            continue;
+
+        for( int i = 0; i < PhaseCount; i++ ){
+
+            const CSAPILatencyHistogram &histogram = latency.phases[i];
+            std::string strLabels = Metrics::Label("endpoint", latency.strEndpoint) + "," + Metrics::Label("phase", PhaseName(static_cast<Phase>(i)));
+
+            for( double dQuantile : vecQuantiles )
+                writer.Sample("sapi_request_duration_seconds", strLabels + "," + Metrics::Label("quantile", strprintf("%g", dQuantile)), histogram.Percentile(dQuantile) * 0.000001);
+
+            writer.Sample("sapi_request_duration_seconds_sum", strLabels, histogram.Sum() * 0.000001);
+            writer.Sample("sapi_request_duration_seconds_count", strLabels, histogram.Count());
+        }
+    }
+}
@@ -13,6 +13,7 @@
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
 static bool transaction_send(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
+static bool transaction_send_batch(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool transaction_check(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 static bool transaction_create(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter);
 
@@ -23,7 +24,8 @@ SAPI::EndpointGroup transactionEndpoints = {
             "check/{txhash}", HTTPRequest::GET, UniValue::VNULL, transaction_check,
             {
 
-            }
+            },
+            SAPI::CostCritical
         },
         {
             "send", HTTPRequest::POST, UniValue::VOBJ, transaction_send,
@@ -31,7 +33,15 @@ SAPI::EndpointGroup transactionEndpoints = {
                 SAPI::BodyParameter(SAPI::Keys::rawtx, new SAPI::Validation::HexString()),
                 SAPI::BodyParameter(SAPI::Keys::instantpay, new SAPI::Validation::Bool(), true),
                 SAPI::BodyParameter(SAPI::Keys::overridefees, new SAPI::Validation::Bool(), true)
-            }
+            },
+            SAPI::CostCritical, true
+        },
+        {
+            "send/batch", HTTPRequest::POST, UniValue::VNULL, transaction_send_batch,
+            {
+
+            },
+            SAPI::CostCritical
         },
         {
             "create", HTTPRequest::POST, UniValue::VOBJ, transaction_create,
@@ -57,8 +67,11 @@ static bool transaction_check(HTTPRequest* req, const std::map<std::string, std:
 
     CTransaction tx;
     uint256 hashBlock;
-    if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, false))
+    if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, false)) {
+        if (IsTransactionPruned(hash))
+            return SAPI::Error(req, SAPI::TxNotFound, "Transaction not available (pruned data).");
         return SAPI::Error(req, SAPI::TxNotFound, "No information available about the transaction");
+    }
 
     string strHex = EncodeHexTx(tx, SERIALIZE_TRANSACTION_NO_WITNESS);
 
@@ -79,8 +92,11 @@ static bool transaction_check(HTTPRequest* req, const std::map<std::string, std:
 
             CTransaction txInput;
             uint256 hashBlockIn;
-            if (!GetTransaction(txin.prevout.hash, txInput, Params().GetConsensus(), hashBlockIn, false))
+            if (!GetTransaction(txin.prevout.hash, txInput, Params().GetConsensus(), hashBlockIn, false)) {
+                if (IsTransactionPruned(txin.prevout.hash))
+                    return SAPI::Error(req, SAPI::TxNotFound, "One of the inputs is not available (pruned data).");
                 return SAPI::Error(req, SAPI::TxNotFound, "No information available about one of the inputs.");
+            }
 
             const CTxOut& txout = txInput.vout[txin.prevout.n];
 
@@ -110,7 +126,7 @@ static bool transaction_check(HTTPRequest* req, const std::map<std::string, std:
     result.pushKV("vout", vout);
 
     if (!hashBlock.IsNull()){
-        LOCK(cs_main);
+        SAPI_LOCK_MAIN();
         result.pushKV("blockhash", hashBlock.GetHex());
         BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end() && (*mi).second) {
@@ -119,6 +135,10 @@ static bool transaction_check(HTTPRequest* req, const std::map<std::string, std:
                 result.pushKV("height", pindex->nHeight);
                 result.pushKV("confirmations", 1 + chainActive.Height() - pindex->nHeight);
                 result.pushKV("blockTime", pindex->GetBlockTime());
+
+                // Mempool and instantpay details of recent transactions can change without a new tip.
+                if( 1 + chainActive.Height() - pindex->nHeight >= SAPI_CACHE_MIN_TX_DEPTH )
+                    SAPI::Cache::SetCacheable(req);
             } else {
                 result.pushKV("height", -1);
                 result.pushKV("confirmations", 0);
@@ -148,59 +168,257 @@ static bool transaction_check(HTTPRequest* req, const std::map<std::string, std:
     return true;
 }
 
-static bool transaction_send(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+/** Deserializes straight out of the body buffer of the request. */
+class CSAPIBodyStream
 {
+    HTTPRequest *req;
+    const int nType;
+    const int nVersion;
 
-    LOCK(cs_main);
+public:
 
-    std::string rawTx = bodyParameter[SAPI::Keys::rawtx].get_str();
-    bool fInstantSend = bodyParameter.exists(SAPI::Keys::instantpay) ? bodyParameter[SAPI::Keys::instantpay].get_bool() : false;
-    bool fOverrideFees = bodyParameter.exists(SAPI::Keys::overridefees) ? bodyParameter[SAPI::Keys::overridefees].get_bool() : false;
+    CSAPIBodyStream(HTTPRequest *req, int nType, int nVersion) : req(req), nType(nType), nVersion(nVersion) {}
 
-    // parse hex string from parameter
-    CTransaction tx;
+    int GetType() const { return nType; }
+    int GetVersion() const { return nVersion; }
 
-    if (!DecodeHexTx(tx, rawTx))
-        return SAPI::Error(req, SAPI::TxDecodeFailed, "TX decode failed");
+    size_t size() { return req->GetBodySize(); }
+    bool empty() { return !size(); }
 
-    uint256 hashTx = tx.GetHash();
+    void read(char *pch, size_t nSize)
+    {
+        if( req->ReadBody(pch, nSize) != nSize )
+            throw std::ios_base::failure("CSAPIBodyStream::read(): end of data");
+    }
+
+    void ignore(size_t nSize)
+    {
+        char buf[4096];
 
+        while( nSize ){
+            size_t nChunk = std::min(nSize, sizeof(buf));
+            read(buf, nChunk);
+            nSize -= nChunk;
+        }
+    }
+
+    template<typename T>
+    CSAPIBodyStream& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj, nType, nVersion);
+        return *this;
+    }
+};
+
+/** Whether outputs of the transaction are in the chainstate already, requires cs_main. */
+static bool HaveChainTransaction(const CTransaction &tx)
+{
+    AssertLockHeld(cs_main);
+
+    uint256 hashTx = tx.GetHash();
     CCoinsViewCache &view = *pcoinsTip;
-    bool fHaveChain = false;
-    for (size_t o = 0; !fHaveChain && o < tx.vout.size(); o++) {
+    for (size_t o = 0; o < tx.vout.size(); o++) {
         const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
-        fHaveChain = !existingCoin.IsSpent();
+        if (!existingCoin.IsSpent())
+            return true;
     }
-    bool fHaveMempool = mempool.exists(hashTx);
+    return false;
+}
+
+/** The error of a transaction AcceptToMemoryPool didn't accept. */
+static SAPI::Result RejectedTransaction(const CValidationState &state, bool fMissingInputs)
+{
+    if (state.IsInvalid())
+        return SAPI::Result(SAPI::TxRejected, strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason()));
+    if (fMissingInputs)
+        return SAPI::Result(SAPI::TxMissingInputs, "Missing inputs");
+    return SAPI::Result(SAPI::TxRejected, state.GetRejectReason());
+}
+
+/** Relay a transaction of the mempool. */
+static SAPI::Result RelayMempoolTransaction(const CTransaction &tx)
+{
+    if(!g_connman)
+        return SAPI::Result(SAPI::TxCantRelay, "Error: Peer-to-peer functionality missing or disabled");
+
+    g_connman->RelayTransaction(tx);
+
+    return SAPI::Result();
+}
+
+/** Submit the transaction to the mempool and relay it, requires cs_main. */
+static SAPI::Result SendTransaction(const CTransaction &tx, bool fInstantSend, bool fOverrideFees)
+{
+    AssertLockHeld(cs_main);
+
+    bool fHaveChain = HaveChainTransaction(tx);
+    bool fHaveMempool = mempool.exists(tx.GetHash());
     if (!fHaveMempool && !fHaveChain) {
         // push to local node and sync with wallets
         if (fInstantSend && !instantsend.ProcessTxLockRequest(tx, *g_connman)) {
-            return SAPI::Error(req, SAPI::TxNoValidInstantPay, "Not a valid InstantSend transaction");
+            return SAPI::Result(SAPI::TxNoValidInstantPay, "Not a valid InstantSend transaction");
         }
         CValidationState state;
         bool fMissingInputs;
-        if (!AcceptToMemoryPool(mempool, state, tx, false, &fMissingInputs, false, !fOverrideFees)) {
-            if (state.IsInvalid()) {
-                return SAPI::Error(req, SAPI::TxRejected, strprintf("%i: %s", state.GetRejectCode(), state.GetRejectReason()));
+        if (!AcceptToMemoryPool(mempool, state, tx, false, &fMissingInputs, false, !fOverrideFees))
+            return RejectedTransaction(state, fMissingInputs);
+    } else if (fHaveChain) {
+        return SAPI::Result(SAPI::TxAlreadyInBlockchain, "Transaction already in block chain");
+    }
+
+    return RelayMempoolTransaction(tx);
+}
+
+static bool transaction_send(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    CTransaction tx;
+    bool fInstantSend = false;
+    bool fOverrideFees = false;
+
+    if (bodyParameter.isNull()) {
+        // Binary body with one serialized transaction, sent without the options.
+        CSAPIBodyStream stream(req, SER_NETWORK, PROTOCOL_VERSION);
+
+        try {
+            stream >> tx;
+        } catch (const std::exception&) {
+            return SAPI::Error(req, SAPI::TxDecodeFailed, "TX decode failed");
+        }
+
+        if (!stream.empty())
+            return SAPI::Error(req, SAPI::TxDecodeFailed, "TX decode failed");
+
+    } else {
+
+        std::string rawTx = bodyParameter[SAPI::Keys::rawtx].get_str();
+        fInstantSend = bodyParameter.exists(SAPI::Keys::instantpay) ? bodyParameter[SAPI::Keys::instantpay].get_bool() : false;
+        fOverrideFees = bodyParameter.exists(SAPI::Keys::overridefees) ? bodyParameter[SAPI::Keys::overridefees].get_bool() : false;
+
+        // parse hex string from parameter
+        if (!DecodeHexTx(tx, rawTx))
+            return SAPI::Error(req, SAPI::TxDecodeFailed, "TX decode failed");
+    }
+
+    SAPI_LOCK_MAIN();
+
+    SAPI::Result result = SendTransaction(tx, fInstantSend, fOverrideFees);
+
+    if (result != SAPI::Valid)
+        return SAPI::Error(req, result.code, result.message);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("txid", tx.GetHash().GetHex());
+    SAPI::WriteReply(req, obj);
+
+    return true;
+}
+
+/** Binary body of serialized transactions, each one prefixed by its CompactSize length.
+ *  Replies with a result object per transaction in the order of the body. */
+static bool transaction_send_batch(HTTPRequest* req, const std::map<std::string, std::string> &mapPathParams, const UniValue &bodyParameter)
+{
+    if (SAPI::IsCaptured(req) || !SAPI::IsBinaryBody(req))
+        return SAPI::Error(req, HTTPStatus::BAD_REQUEST, "Expected an application/octet-stream body of length prefixed transactions");
+
+    CSAPIBodyStream stream(req, SER_NETWORK, PROTOCOL_VERSION);
+
+    // Null entries failed to decode
+    std::vector<CTransactionRef> vecTx;
+
+    while (!stream.empty()) {
+
+        if (vecTx.size() == SAPI_SEND_BATCH_MAX_TXS)
+            return SAPI::Error(req, SAPI::TxInvalidParameter, strprintf("Too many transactions in the batch, maximum is %d", SAPI_SEND_BATCH_MAX_TXS));
+
+        uint64_t nLength;
+        size_t nStart;
+        CTransactionRef tx;
+
+        try {
+            nLength = ReadCompactSize(stream);
+        } catch (const std::exception&) {
+            return SAPI::Error(req, SAPI::TxDecodeFailed, strprintf("Transaction %d: invalid length prefix", vecTx.size()));
+        }
+
+        if (nLength > stream.size())
+            return SAPI::Error(req, SAPI::TxDecodeFailed, strprintf("Transaction %d: length exceeds the body", vecTx.size()));
+
+        nStart = stream.size();
+
+        try {
+            stream >> tx;
+        } catch (const std::exception&) {
+            tx.reset();
+        }
+
+        size_t nRead = nStart - stream.size();
+
+        if (nRead > nLength)
+            return SAPI::Error(req, SAPI::TxDecodeFailed, strprintf("Transaction %d: longer than its length prefix", vecTx.size()));
+
+        if (nRead < nLength) {
+            tx.reset();
+            stream.ignore(nLength - nRead);
+        }
+
+        vecTx.push_back(std::move(tx));
+    }
+
+    if (vecTx.empty())
+        return SAPI::Error(req, SAPI::TxDecodeFailed, "No transactions in the body");
+
+    std::vector<SAPI::Result> vecResults(vecTx.size(), SAPI::Result(SAPI::TxDecodeFailed, "TX decode failed"));
+
+    {
+        SAPI_LOCK_MAIN();
+
+        // The new ones go to the mempool in one batch, the known ones only get relayed again
+        std::vector<CTransactionRef> vecAccept;
+        std::vector<size_t> vecAcceptIndex;
+        std::vector<CMempoolAcceptResult> vecAcceptResults;
+
+        for (size_t i = 0; i < vecTx.size(); i++) {
+            if (!vecTx[i])
+                continue;
+            if (HaveChainTransaction(*vecTx[i])) {
+                vecResults[i] = SAPI::Result(SAPI::TxAlreadyInBlockchain, "Transaction already in block chain");
+            } else if (mempool.exists(vecTx[i]->GetHash())) {
+                vecResults[i] = SAPI::Result();
             } else {
-                if (fMissingInputs) {
-                    return SAPI::Error(req, SAPI::TxMissingInputs, "Missing inputs");
-                }
-                return SAPI::Error(req, SAPI::TxRejected, state.GetRejectReason());
+                vecAccept.push_back(vecTx[i]);
+                vecAcceptIndex.push_back(i);
             }
         }
-    } else if (fHaveChain) {
-        return SAPI::Error(req, SAPI::TxAlreadyInBlockchain, "Transaction already in block chain");
+
+        AcceptToMemoryPoolBatch(mempool, vecAccept, vecAcceptResults, false, true);
+
+        for (size_t j = 0; j < vecAccept.size(); j++) {
+            const CMempoolAcceptResult &accept = vecAcceptResults[j];
+            vecResults[vecAcceptIndex[j]] = accept.fAccepted ? SAPI::Result() : RejectedTransaction(accept.state, accept.fMissingInputs);
+        }
+
+        for (size_t i = 0; i < vecTx.size(); i++) {
+            if (vecResults[i] == SAPI::Valid)
+                vecResults[i] = RelayMempoolTransaction(*vecTx[i]);
+        }
     }
 
-    if(!g_connman)
-        return SAPI::Error(req, SAPI::TxCantRelay, "Error: Peer-to-peer functionality missing or disabled");
+    UniValue results(UniValue::VARR);
 
-    g_connman->RelayTransaction(tx);
+    for (size_t i = 0; i < vecTx.size(); i++) {
 
-    UniValue result(UniValue::VOBJ);
-    result.pushKV("txid", hashTx.GetHex());
-    SAPI::WriteReply(req, result);
+        UniValue obj(UniValue::VOBJ);
+
+        if (vecTx[i])
+            obj.pushKV("txid", vecTx[i]->GetHash().GetHex());
+
+        if (vecResults[i] != SAPI::Valid)
+            obj.pushKV("error", vecResults[i].ToUniValue());
+
+        results.push_back(obj);
+    }
+
+    SAPI::WriteReply(req, results);
 
     return true;
 }
@@ -10,6 +10,7 @@
 #include "validation.h"
 #include "sapi.h"
 #include "sapi_validation.h"
+#include "smartmining/miningpayments.h"
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -299,6 +300,47 @@ SAPI::Result SAPI::Validation::Transactions::Validate(const std::string &paramet
     return SAPI::Result(code, ResultMessage(code));
 }
 
+bool SAPI::Validation::ParseTxCursor(const std::string &strCursor, int &nHeight, uint256 &txhash)
+{
+    size_t nSeparator = strCursor.find(':');
+
+    if( nSeparator == std::string::npos )
+        return false;
+
+    std::string strHash = strCursor.substr(nSeparator + 1);
+
+    if( !ParseInt32(strCursor.substr(0, nSeparator), &nHeight) || nHeight < 0 ||
+        strHash.size() != 64 || !IsHex(strHash) )
+        return false;
+
+    txhash.SetHex(strHash);
+
+    return true;
+}
+
+SAPI::Result SAPI::Validation::TxCursor::Validate(const std::string &parameter, const UniValue &value) const
+{
+    SAPI::Codes code = SAPI::Valid;
+    int nHeight;
+    uint256 txhash;
+
+    if( !ParseTxCursor(value.get_str(), nHeight, txhash) )
+        code = SAPI::InvalidCursor;
+
+    return SAPI::Result(code, ResultMessage(code));
+}
+
+SAPI::Result SAPI::Validation::PayoutCategories::Validate(const std::string &parameter, const UniValue &value) const
+{
+    SAPI::Codes code = SAPI::Valid;
+    int nMask;
+
+    if( !SmartMining::ParsePayoutCategories(value.get_str(), nMask) )
+        code = SAPI::InvalidPayoutCategory;
+
+    return SAPI::Result(code, ResultMessage(code));
+}
+
 SAPI::Result SAPI::Validation::TxDirection::Validate(const std::string &parameter, const UniValue &value) const
 {
     SAPI::Codes code = SAPI::Valid;
@@ -363,6 +405,10 @@ std::string SAPI::Validation::ResultMessage(SAPI::Codes value)
         return "Amount out of max money range";
     case AmountOutOfRange:
         return "Amount value out of the valid range: %s - %s";
+    case InvalidCursor:
+        return "Invalid cursor, expected <height>:<txid>";
+    case InvalidPayoutCategory:
+        return "Invalid category, expected a comma separated list of mining|hive|smartnode|smartrewards or all";
     case TimedOut:
         return "Operation timed out";
     case PageOutOfRange:
@@ -375,6 +421,10 @@ std::string SAPI::Validation::ResultMessage(SAPI::Codes value)
         return "Ressource rate limit exceeded";
     case AddressNotFound:
         return "Address not found";
+    case BatchRequestInvalid:
+        return "Invalid batch request";
+    case PollLimitExceeded:
+        return "Too many waiting long-poll requests";
     case BlockHeightOutOfRange:
         return "Block height out of range";
     case BlockNotFound:
@@ -383,6 +433,8 @@ std::string SAPI::Validation::ResultMessage(SAPI::Codes value)
         return "Block information not specified";
     case BlockHashInvalid:
         return "Block hash invalid";
+    case BlockFilterNotAvailable:
+        return "Block filter not available";
     case NoDepositAvailble:
         return "No deposits available";
     case NoUtxosAvailble:
@@ -1104,9 +1104,56 @@ public:
     }
 };
 
+/** Stream which hashes what gets serialized into it */
+class CSHA256Writer
+{
+private:
+    CSHA256& hasher;
+
+public:
+    CSHA256Writer(CSHA256& hasherIn) : hasher(hasherIn) {}
+    void write(const char* pch, size_t nSize) { hasher.Write((const unsigned char*)pch, nSize); }
+};
+
+/** Stream which appends what gets serialized into it to a byte vector */
+class CByteVectorWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+
+public:
+    CByteVectorWriter(std::vector<unsigned char>& vchIn) : vch(vchIn) {}
+    void write(const char* pch, size_t nSize) { vch.insert(vch.end(), (const unsigned char*)pch, (const unsigned char*)pch + nSize); }
+};
+
 } // anon namespace
 
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo) : nInputSize(0)
+{
+    CSHA256 hasher;
+    CSHA256Writer hashWriter(hasher);
+    ::Serialize(hashWriter, txTo.nVersion, SER_GETHASH, 0);
+    ::WriteCompactSize(hashWriter, txTo.vin.size());
+
+    CByteVectorWriter dataWriter(vchData);
+    vMidstates.reserve(txTo.vin.size());
+    for (const CTxIn& txin : txTo.vin) {
+        vMidstates.push_back(hasher);
+        size_t nPos = vchData.size();
+        ::Serialize(dataWriter, txin.prevout, SER_GETHASH, 0);
+        ::Serialize(dataWriter, CScriptBase(), SER_GETHASH, 0);
+        ::Serialize(dataWriter, txin.nSequence, SER_GETHASH, 0);
+        nInputSize = vchData.size() - nPos;
+        hasher.Write(vchData.data() + nPos, nInputSize);
+    }
+
+    ::WriteCompactSize(dataWriter, txTo.vout.size());
+    for (const CTxOut& txout : txTo.vout)
+        ::Serialize(dataWriter, txout, SER_GETHASH, 0);
+    ::Serialize(dataWriter, txTo.nLockTime, SER_GETHASH, 0);
+}
+
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* txdata)
 {
     static const uint256 one(uint256S("0000000000000000000000000000000000000000000000000000000000000001"));
     if (nIn >= txTo.vin.size()) {
@@ -1125,6 +1172,22 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // Everything but the input being signed is the same for all inputs of SIGHASH_ALL
+    if (txdata && !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        assert(txdata->vMidstates.size() == txTo.vin.size());
+        CSHA256 hasher(txdata->vMidstates[nIn]);
+        CSHA256Writer hashWriter(hasher);
+        txTmp.SerializeInput(hashWriter, nIn, SER_GETHASH, 0);
+        size_t nPos = txdata->nInputSize * (nIn + 1);
+        hasher.Write(txdata->vchData.data() + nPos, txdata->vchData.size() - nPos);
+        ::Serialize(hashWriter, nHashType, SER_GETHASH, 0);
+
+        // A single SHA-256 like CHashWriter
+        uint256 hash;
+        hasher.Finalize(hash.begin());
+        return hash;
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1149,7 +1212,7 @@ bool TransactionSignatureChecker::CheckSig(const vector<unsigned char>& vchSigIn
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
 
     if (!VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -7,6 +7,7 @@
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
 #include "script_error.h"
+#include "crypto/sha256.h"
 #include "primitives/transaction.h"
 
 #include <vector>
@@ -90,7 +91,24 @@ enum
 
 bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror);
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+/**
+ * The parts of the signature hashes of a transaction which are the same for all of its inputs. Without
+ * it every input hashes all the inputs again, so signing or verifying all of them takes quadratic time.
+ * Only hash types which commit to all inputs and outputs (SIGHASH_ALL) use it.
+ */
+struct PrecomputedTransactionData
+{
+    //! SHA-256 state after nVersion and the inputs before input n with blank scripts, for every input
+    std::vector<CSHA256> vMidstates;
+    //! The inputs with blank scripts, the outputs and nLockTime serialized
+    std::vector<unsigned char> vchData;
+    //! Size of an input with a blank script in vchData
+    size_t nInputSize;
+
+    explicit PrecomputedTransactionData(const CTransaction& txTo);
+};
+
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType, const PrecomputedTransactionData* txdata = NULL);
 
 class BaseSignatureChecker
 {
@@ -118,12 +136,13 @@ class TransactionSignatureChecker : public BaseSignatureChecker
 private:
     const CTransaction* txTo;
     unsigned int nIn;
+    const PrecomputedTransactionData* txdata;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn) : txTo(txToIn), nIn(nInIn) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const PrecomputedTransactionData* txdataIn = NULL) : txTo(txToIn), nIn(nInIn), txdata(txdataIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode) const;
     bool CheckLockTime(const CScriptNum& nLockTime) const;
     bool CheckSequence(const CScriptNum& nSequence) const;
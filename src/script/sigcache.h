@@ -10,9 +10,11 @@
 
 #include <vector>
 
-// DoS prevention: limit cache size to less than 40MB (over 500000
-// entries on 64-bit systems).
+// DoS prevention: limit cache size to 40MB (over 1.3 million entries, the
+// cuckoo cache takes 32 bytes per entry on all systems).
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 40;
+// Maximum sig cache size allowed
+static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
 class CPubKey;
 
@@ -26,4 +28,9 @@ public:
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
+
+//! Set up the signature cache with the size of -maxsigcachesize, before any script checks
+void InitSignatureCache();
+//! Lookups of the signature cache since the start which found the signature and which didn't
+void GetSignatureCacheStats(uint64_t& nHitsRet, uint64_t& nMissesRet);
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -12,13 +12,17 @@
 #include "script/standard.h"
 #include "uint256.h"
 
+#include <atomic>
+#include <set>
+#include <thread>
+
 #include <boost/foreach.hpp>
 
 using namespace std;
 
 typedef std::vector<unsigned char> valtype;
 
-TransactionSignatureCreator::TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, int nHashTypeIn) : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), checker(txTo, nIn) {}
+TransactionSignatureCreator::TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, int nHashTypeIn, const PrecomputedTransactionData* txdataIn) : BaseSignatureCreator(keystoreIn), txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), txdata(txdataIn), checker(txTo, nIn, txdata) {}
 
 bool TransactionSignatureCreator::CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& address, const CScript& scriptCode) const
 {
@@ -26,7 +30,7 @@ bool TransactionSignatureCreator::CreateSig(std::vector<unsigned char>& vchSig,
     if (!keystore->GetKey(address, key))
         return false;
 
-    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType);
+    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType, txdata);
     if (!key.Sign(hash, vchSig))
         return false;
     vchSig.push_back((unsigned char)nHashType);
@@ -128,6 +132,88 @@ bool ProduceSignature(const BaseSignatureCreator& creator, const CScript& fromPu
     return VerifyScript(scriptSig, fromPubKey, STANDARD_SCRIPT_VERIFY_FLAGS, creator.Checker());
 }
 
+static void CopySigningKey(const CKeyStore& keystore, const CKeyID& keyID, CBasicKeyStore& keystoreOut)
+{
+    CKey key;
+    CPubKey pubkey;
+    if (!keystoreOut.HaveKey(keyID) && keystore.GetKey(keyID, key) && keystore.GetPubKey(keyID, pubkey))
+        keystoreOut.AddKeyPubKey(key, pubkey);
+}
+
+void CopySigningKeys(const CKeyStore& keystore, const CScript& scriptPubKey, CBasicKeyStore& keystoreOut)
+{
+    // The same cases as SignStep
+    txnouttype whichType;
+    vector<valtype> vSolutions;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return;
+
+    switch (whichType)
+    {
+    case TX_PUBKEY:
+        CopySigningKey(keystore, CPubKey(vSolutions[0]).GetID(), keystoreOut);
+        break;
+    case TX_PUBKEYHASH:
+    case TX_PUBKEYHASHLOCKED:
+        CopySigningKey(keystore, CKeyID(uint160(vSolutions[0])), keystoreOut);
+        break;
+    case TX_SCRIPTHASH:
+    case TX_SCRIPTHASHLOCKED:
+    {
+        CScript subscript;
+        if (keystore.GetCScript(uint160(vSolutions[0]), subscript)) {
+            keystoreOut.AddCScript(subscript);
+            // ProduceSignature doesn't nest them either
+            if (!subscript.IsPayToScriptHash())
+                CopySigningKeys(keystore, subscript, keystoreOut);
+        }
+        break;
+    }
+    case TX_MULTISIG:
+        for (unsigned int i = 1; i < vSolutions.size() - 1; i++)
+            CopySigningKey(keystore, CPubKey(vSolutions[i]).GetID(), keystoreOut);
+        break;
+    default:
+        break;
+    }
+}
+
+bool ProduceSignatures(const CKeyStore& keystore, const CTransaction& txTo, const std::vector<CScript>& vScriptPubKeys, int nHashType, std::vector<CScript>& vScriptSigs)
+{
+    assert(vScriptPubKeys.size() == txTo.vin.size());
+
+    // Consolidations spend the outputs of a few scripts many times
+    CBasicKeyStore keystoreCopy;
+    std::set<CScript> setCopied;
+    for (const CScript& scriptPubKey : vScriptPubKeys) {
+        if (!scriptPubKey.empty() && setCopied.insert(scriptPubKey).second)
+            CopySigningKeys(keystore, scriptPubKey, keystoreCopy);
+    }
+
+    PrecomputedTransactionData txdata(txTo);
+    vScriptSigs.assign(txTo.vin.size(), CScript());
+    std::atomic<bool> fAllSigned(true);
+    std::atomic<size_t> nNext(0);
+    auto signInputs = [&]() {
+        for (size_t i = nNext++; i < vScriptPubKeys.size(); i = nNext++) {
+            if (vScriptPubKeys[i].empty())
+                continue;
+            if (!ProduceSignature(TransactionSignatureCreator(&keystoreCopy, &txTo, i, nHashType, &txdata), vScriptPubKeys[i], vScriptSigs[i]))
+                fAllSigned = false;
+        }
+    };
+
+    int nThreads = std::min<int>(std::min<int>(std::max<int>(std::thread::hardware_concurrency(), 1), MAX_SIGNATURE_THREADS), vScriptPubKeys.size());
+    std::vector<std::thread> vThreads;
+    for (int i = 1; i < nThreads; ++i)
+        vThreads.emplace_back(signInputs);
+    signInputs();
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    return fAllSigned;
+}
+
 bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CMutableTransaction& txTo, unsigned int nIn, int nHashType)
 {
     assert(nIn < txTo.vin.size());
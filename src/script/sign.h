@@ -8,6 +8,7 @@
 
 #include "script/interpreter.h"
 
+class CBasicKeyStore;
 class CKeyID;
 class CKeyStore;
 class CScript;
@@ -15,6 +16,9 @@ class CTransaction;
 
 struct CMutableTransaction;
 
+/** Most threads ProduceSignatures signs the inputs of a transaction on */
+static const int MAX_SIGNATURE_THREADS = 16;
+
 /** Virtual base class for signature creators. */
 class BaseSignatureCreator {
 protected:
@@ -35,10 +39,11 @@ class TransactionSignatureCreator : public BaseSignatureCreator {
     const CTransaction* txTo;
     unsigned int nIn;
     int nHashType;
+    const PrecomputedTransactionData* txdata;
     const TransactionSignatureChecker checker;
 
 public:
-    TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, int nHashTypeIn=SIGHASH_ALL);
+    TransactionSignatureCreator(const CKeyStore* keystoreIn, const CTransaction* txToIn, unsigned int nInIn, int nHashTypeIn=SIGHASH_ALL, const PrecomputedTransactionData* txdataIn=NULL);
     const BaseSignatureChecker& Checker() const { return checker; }
     bool CreateSig(std::vector<unsigned char>& vchSig, const CKeyID& keyid, const CScript& scriptCode) const;
 };
@@ -54,6 +59,17 @@ public:
 /** Produce a script signature using a generic signature creator. */
 bool ProduceSignature(const BaseSignatureCreator& creator, const CScript& scriptPubKey, CScript& scriptSig);
 
+/** Copy the keys and redeem scripts of keystore a script signature of scriptPubKey needs to keystoreOut. */
+void CopySigningKeys(const CKeyStore& keystore, const CScript& scriptPubKey, CBasicKeyStore& keystoreOut);
+
+/**
+ * Produce the script signatures of all inputs of txTo at once, vScriptPubKeys holds the outputs they spend and
+ * inputs with an empty one are left out. The inputs get signed concurrently, from copies of the keys taken on
+ * the calling thread, so keystore may be a wallet whose lock the caller holds. vScriptSigs gets the script
+ * signatures, also the incomplete ones. Returns false if one of the inputs couldn't be signed completely.
+ */
+bool ProduceSignatures(const CKeyStore& keystore, const CTransaction& txTo, const std::vector<CScript>& vScriptPubKeys, int nHashType, std::vector<CScript>& vScriptSigs);
+
 /** Produce a script signature for a transaction. */
 bool SignSignature(const CKeyStore& keystore, const CScript& fromPubKey, CMutableTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
 bool SignSignature(const CKeyStore& keystore, const CTransaction& txFrom, CMutableTransaction& txTo, unsigned int nIn, int nHashType=SIGHASH_ALL);
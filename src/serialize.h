@@ -114,6 +114,11 @@ template<typename Stream> inline void ser_writedata64(Stream &s, uint64_t obj)
     obj = htole64(obj);
     s.write((char*)&obj, 8);
 }
+template<typename Stream> inline void ser_writedata64be(Stream &s, uint64_t obj)
+{
+    obj = htobe64(obj);
+    s.write((char*)&obj, 8);
+}
 template<typename Stream> inline uint8_t ser_readdata8(Stream &s)
 {
     uint8_t obj;
@@ -144,6 +149,12 @@ template<typename Stream> inline uint64_t ser_readdata64(Stream &s)
     s.read((char*)&obj, 8);
     return le64toh(obj);
 }
+template<typename Stream> inline uint64_t ser_readdata64be(Stream &s)
+{
+    uint64_t obj;
+    s.read((char*)&obj, 8);
+    return be64toh(obj);
+}
 inline uint64_t ser_double_to_uint64(double x)
 {
     union { double x; uint64_t y; } tmp;
@@ -616,6 +627,13 @@ void Serialize(Stream &s, const std::shared_ptr <T> &item, int nType, int nVersi
 template<typename Stream, typename T>
 void Unserialize(Stream &s, std::shared_ptr <T> &item, int nType, int nVersion);
 
+/**
+ * shared_ptr to an immutable object, e.g. CTransactionRef, serialized as the object itself
+ */
+template<typename T> unsigned int GetSerializeSize(const std::shared_ptr<const T>& p, int nType, int nVersion);
+template<typename Stream, typename T> void Serialize(Stream& os, const std::shared_ptr<const T>& p, int nType, int nVersion);
+template<typename Stream, typename T> void Unserialize(Stream& is, std::shared_ptr<const T>& p, int nType, int nVersion);
+
 
 /**
  * If none of the specialized versions above matched, default to calling member function.
@@ -1060,6 +1078,30 @@ void Unserialize(Stream &os, std::shared_ptr <T> &item, int nType, int nVersion)
     }
 }
 
+/**
+ * shared_ptr to an immutable object
+ */
+template<typename T>
+unsigned int GetSerializeSize(const std::shared_ptr<const T>& p, int nType, int nVersion)
+{
+    return ::GetSerializeSize(*p, nType, nVersion);
+}
+
+template<typename Stream, typename T>
+void Serialize(Stream& os, const std::shared_ptr<const T>& p, int nType, int nVersion)
+{
+    ::Serialize(os, *p, nType, nVersion);
+}
+
+template<typename Stream, typename T>
+void Unserialize(Stream& is, std::shared_ptr<const T>& p, int nType, int nVersion)
+{
+    // Read into a fresh object, others may still share the old one
+    std::shared_ptr<T> pNew = std::make_shared<T>();
+    ::Unserialize(is, *pNew, nType, nVersion);
+    p = pNew;
+}
+
 /**
  * Support for ADD_SERIALIZE_METHODS and READWRITE macro
  */
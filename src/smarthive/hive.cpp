@@ -4,6 +4,7 @@
 
 #include <boost/functional/hash.hpp>
 
+#include "memusage.h"
 #include "smarthive/hive.h"
 #include "validation.h"
 
@@ -163,3 +164,24 @@ size_t CSmartAddress::GetHashSeed() const {
     boost::hash_combine(seed, vchData);
     return seed;
 }
+
+std::string CSmartAddress::ToString(bool fNewFormat) const
+{
+    std::shared_ptr<const CCachedString> pCached = std::atomic_load(&pCachedString);
+    if (pCached && pCached->fNewFormat == fNewFormat)
+        return pCached->str;
+
+    std::shared_ptr<CCachedString> pString = std::make_shared<CCachedString>();
+    pString->fNewFormat = fNewFormat;
+    pString->str = CBitcoinAddress::ToString(fNewFormat);
+    std::atomic_store(&pCachedString, std::shared_ptr<const CCachedString>(pString));
+    return pString->str;
+}
+
+size_t CSmartAddress::DynamicMemoryUsage() const {
+    size_t nUsage = memusage::DynamicUsage(vchVersion) + memusage::MallocUsage(vchData.capacity());
+    std::shared_ptr<const CCachedString> pCached = std::atomic_load(&pCachedString);
+    if (pCached)
+        nUsage += memusage::DynamicUsage(pCached) + memusage::MallocUsage(pCached->str.capacity());
+    return nUsage;
+}
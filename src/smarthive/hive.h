@@ -10,20 +10,56 @@
 #include "coins.h"
 #include "base58.h"
 
+#include <memory>
+
 struct CSmartAddress : public CBitcoinAddress
 {
+private:
+    struct CCachedString
+    {
+        bool fNewFormat;
+        std::string str;
+    };
+
+    //! The string ToString() returned last. The addresses of shared snapshots are printed by
+    //! several threads at once, it's only accessed with the atomic shared_ptr functions.
+    mutable std::shared_ptr<const CCachedString> pCachedString;
+
+public:
     ADD_SERIALIZE_METHODS
 
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         READWRITE(vchVersion);
         READWRITE(vchData);
+        if (ser_action.ForRead())
+            pCachedString.reset();
     }
 
     CSmartAddress() : CBitcoinAddress() {}
     CSmartAddress(const std::string &address) : CBitcoinAddress(address) {}
     CSmartAddress(const CTxDestination &destination) : CBitcoinAddress(destination) {}
     CSmartAddress(const char* pszAddress) : CBitcoinAddress(pszAddress) {}
+    CSmartAddress(const CSmartAddress& other) : CBitcoinAddress(other), pCachedString(std::atomic_load(&other.pCachedString)) {}
+    CSmartAddress(CSmartAddress&& other) = default;
+
+    CSmartAddress& operator=(const CSmartAddress& other)
+    {
+        CBitcoinAddress::operator=(other);
+        pCachedString = std::atomic_load(&other.pCachedString);
+        return *this;
+    }
+    CSmartAddress& operator=(CSmartAddress&& other) = default;
+
+    bool Set(const CKeyID &id) { pCachedString.reset(); return CBitcoinAddress::Set(id); }
+    bool Set(const CScriptID &id) { pCachedString.reset(); return CBitcoinAddress::Set(id); }
+    bool Set(const CTxDestination &dest) { pCachedString.reset(); return CBitcoinAddress::Set(dest); }
+    bool SetString(const char* psz, unsigned int nVersionBytes = 1) { pCachedString.reset(); return CBitcoinAddress::SetString(psz, nVersionBytes); }
+    bool SetString(const std::string& str) { pCachedString.reset(); return CBitcoinAddress::SetString(str); }
+
+    //! Encoded once and kept, for the reward listings and the explorer which print the same addresses over and over
+    std::string ToString() const { return ToString(fUseNewAddressFormat); }
+    std::string ToString(bool fNewFormat) const;
 
     int Compare(const CSmartAddress& other) const
     {
@@ -38,6 +74,8 @@ struct CSmartAddress : public CBitcoinAddress
 
     CScript GetScript() const { return GetScriptForDestination(Get()); }
     size_t GetHashSeed() const;
+    //! Heap memory used by the address data and its string.
+    size_t DynamicMemoryUsage() const;
 
     static CSmartAddress Legacy(const CSmartAddress &address);
     static CSmartAddress Legacy(const std::string &strAddress);
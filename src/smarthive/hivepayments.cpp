@@ -134,7 +134,7 @@ const CSmartHiveSplit * GetHiveSplit(int nHeight, int64_t blockTime)
     return nullptr;
 }
 
-SmartHivePayments::Result SmartHivePayments::Validate(const CTransaction& txCoinbase, int nHeight, int64_t blockTime, CAmount& hiveReward)
+SmartHivePayments::Result SmartHivePayments::Validate(const CCoinbaseOutputs& outputs, int nHeight, int64_t blockTime, CAmount& hiveReward)
 {
 
     CAmount blockReward = GetBlockValue(nHeight, 0, blockTime);
@@ -148,7 +148,7 @@ SmartHivePayments::Result SmartHivePayments::Validate(const CTransaction& txCoin
     // If we got an invalid height. Should not happen.
     if( ptrHiveSplit == nullptr ) return SmartHivePayments::InvalidBlockHeight;
     // If there is no hive payment in the coinbase.
-    if( !ptrHiveSplit->Valididate(txCoinbase.vout,nHeight,blockReward, hiveReward)) return SmartHivePayments::HiveAddressMissing;
+    if( !ptrHiveSplit->Valididate(outputs,nHeight,blockReward, hiveReward)) return SmartHivePayments::HiveAddressMissing;
 
     // There we go! Correct hive payments found..
     return SmartHivePayments::Valid;
@@ -164,24 +164,27 @@ void SmartHivePayments::FillPayments(CMutableTransaction& txNew, int nHeight, in
 
 }
 
-bool CSmartHiveClassicSplit::Valididate(const std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const
+bool CSmartHiveClassicSplit::Valididate(const CCoinbaseOutputs &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const
 {
     size_t found = 0;
+    // An output only counts for the first hive it matches.
+    std::vector<bool> vUsed(outputs.size());
 
     hiveReward = 0;
 
-    BOOST_FOREACH(const CTxOut& output, outputs){
     BOOST_FOREACH(CSmartHiveRewardBase *hive, hives){
+        outputs.ForEach(hive->GetScript(), [&](size_t nIndex, const CTxOut& output) {
 
-            if( hive->GetScript() != output.scriptPubKey ) continue;
-            if( abs( output.nValue - ( blockReward * hive->GetRatio() ) ) >= 2) continue;
+            if( vUsed[nIndex] ) return;
+            if( abs( output.nValue - ( blockReward * hive->GetRatio() ) ) >= 2) return;
 
             hiveReward += output.nValue;
+            vUsed[nIndex] = true;
 
             // We found a valid hive payment here!
             ++found;
-            break; // Break the inner loop.
-    }}
+        });
+    }
 
     return hives.size() == found;
 }
@@ -222,7 +225,7 @@ void CSmartHiveRotationSplit::FillPayment(std::vector<CTxOut> &outputs, int nHei
     }
 }
 
-bool CSmartHiveRotationSplit::Valididate(const std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const
+bool CSmartHiveRotationSplit::Valididate(const CCoinbaseOutputs &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const
 {
     // We have no more hive payouts in fee only mode.
     if( !hives.size() ) return true;
@@ -233,32 +236,28 @@ bool CSmartHiveRotationSplit::Valididate(const std::vector<CTxOut> &outputs, int
     CSmartHiveRotation * ptrHive;
 
     BOOST_FOREACH(CSmartHiveRewardBase *hive, hives){
-    BOOST_FOREACH(const CTxOut& output, outputs){
 
         ptrHive = static_cast<CSmartHiveRotation*> (hive);
 
         if( rotation < ptrHive->start || rotation > ptrHive->end) continue;
-        if( ptrHive->GetScript() != output.scriptPubKey ) continue;
-        if( abs( output.nValue - expected ) >= 2) continue;
 
-        hiveReward = output.nValue;
+        int nIndex = outputs.Find(ptrHive->GetScript(), [expected](const CTxOut& output) {
+            return abs( output.nValue - expected ) < 2;
+        });
+        if( nIndex < 0 ) continue;
+
+        hiveReward = outputs[nIndex].nValue;
 
         // We found a valid hive payment here!
         return true;
-    }}
+    }
 
     return false;
 }
 
 CAmount CSmartHiveBatchSplit::GetBatchReward(int nHeight) const
 {
-    CAmount reward = 0;
-    int block = nHeight - trigger - 1;
-    while (++block < nHeight) {
-        reward += GetBlockValue(block, 0, INT_MAX);
-    }
-
-    return reward;
+    return GetBlockValueSum(nHeight - trigger, nHeight - 1);
 }
 
 void CSmartHiveBatchSplit::FillPayment(std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, std::vector<CTxOut> &voutSmartHives) const
@@ -278,7 +277,7 @@ void CSmartHiveBatchSplit::FillPayment(std::vector<CTxOut> &outputs, int nHeight
 
 }
 
-bool CSmartHiveBatchSplit::Valididate(const std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const
+bool CSmartHiveBatchSplit::Valididate(const CCoinbaseOutputs &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const
 {
     hiveReward = 0;
 
@@ -289,17 +288,17 @@ bool CSmartHiveBatchSplit::Valididate(const std::vector<CTxOut> &outputs, int nH
     CAmount batchReward = GetBatchReward(nHeight);
 
     BOOST_FOREACH(CSmartHiveRewardBase *hive, hives){
-    BOOST_FOREACH(const CTxOut& output, outputs){
 
-            if( hive->GetScript() != output.scriptPubKey ) continue;
-            if( abs( output.nValue - ( batchReward * hive->GetRatio() ) ) >= 2) continue;
+            int nIndex = outputs.Find(hive->GetScript(), [batchReward, hive](const CTxOut& output) {
+                return abs( output.nValue - ( batchReward * hive->GetRatio() ) ) < 2;
+            });
+            if( nIndex < 0 ) continue;
 
-            hiveReward += output.nValue;
+            hiveReward += outputs[nIndex].nValue;
 
             // We found a valid hive payment here!
             ++found;
-            break; // Break the inner loop.
-    }}
+    }
 
     return hives.size() == found;
 }
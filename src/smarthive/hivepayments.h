@@ -6,6 +6,7 @@
 #define HIVEPAYMENTS_H
 
 #include "smarthive/hive.h"
+#include "smartmining/coinbaseoutputs.h"
 #include "chain.h"
 
 namespace SmartHivePayments{
@@ -24,7 +25,7 @@ typedef enum{
 
 void Init();
 
-SmartHivePayments::Result Validate(const CTransaction& txCoinbase, int nHeight, int64_t blockTime, CAmount& hiveReward);
+SmartHivePayments::Result Validate(const CCoinbaseOutputs& outputs, int nHeight, int64_t blockTime, CAmount& hiveReward);
 void FillPayments(CMutableTransaction& txNew, int nHeight, int64_t blockTime, CAmount blockReward, std::vector<CTxOut>& voutSmartHives);
 
 int RejectionCode(SmartHivePayments::Result result);
@@ -73,7 +74,7 @@ struct CSmartHiveSplit
     int allocation;
     double percent;
 
-    virtual bool Valididate(const std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const = 0;
+    virtual bool Valididate(const CCoinbaseOutputs &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const = 0;
     virtual void FillPayment(std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, std::vector<CTxOut>& voutSmartHives) const {voutSmartHives.clear();}
     CSmartHiveSplit() : hives(), allocation(0) {}
     CSmartHiveSplit(int allocation, std::vector<CSmartHiveRewardBase*> hives) : hives(hives), allocation(allocation) {
@@ -92,7 +93,7 @@ struct CSmartHiveSplit
 
 struct CSmartHiveClassicSplit : public CSmartHiveSplit
 {
-    bool Valididate(const std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const final;
+    bool Valididate(const CCoinbaseOutputs &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const final;
     void FillPayment(std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, std::vector<CTxOut>& voutSmartHives) const final;
     CSmartHiveClassicSplit() : CSmartHiveSplit() {}
     CSmartHiveClassicSplit(int allocation, std::vector<CSmartHiveRewardBase*> hives) : CSmartHiveSplit(allocation, hives) {}
@@ -101,7 +102,7 @@ struct CSmartHiveClassicSplit : public CSmartHiveSplit
 
 struct CSmartHiveRotationSplit : public CSmartHiveSplit
 {
-    bool Valididate(const std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const final;
+    bool Valididate(const CCoinbaseOutputs &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const final;
     void FillPayment(std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, std::vector<CTxOut>& voutSmartHives) const final;
     CSmartHiveRotationSplit() : CSmartHiveSplit() {}
     CSmartHiveRotationSplit(int allocation, std::vector<CSmartHiveRewardBase*> hives) : CSmartHiveSplit(allocation, hives) {}
@@ -111,7 +112,7 @@ struct CSmartHiveRotationSplit : public CSmartHiveSplit
 struct CSmartHiveBatchSplit : public CSmartHiveSplit
 {
     int trigger;
-    bool Valididate(const std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const final;
+    bool Valididate(const CCoinbaseOutputs &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const final;
     void FillPayment(std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, std::vector<CTxOut>& voutSmartHives) const final;
     CAmount GetBatchReward(int nHeight) const;
     CSmartHiveBatchSplit() : CSmartHiveSplit() {}
@@ -121,7 +122,7 @@ struct CSmartHiveBatchSplit : public CSmartHiveSplit
 
 struct CSmartHiveSplitDisabled : public CSmartHiveSplit
 {
-    bool Valididate(const std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const final {hiveReward = 0; return true;}
+    bool Valididate(const CCoinbaseOutputs &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const final {hiveReward = 0; return true;}
     void FillPayment(std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, std::vector<CTxOut>& voutSmartHives) const final {voutSmartHives.clear();}
     CSmartHiveSplitDisabled() : CSmartHiveSplit() {}
     ~CSmartHiveSplitDisabled(){}
@@ -129,7 +130,7 @@ struct CSmartHiveSplitDisabled : public CSmartHiveSplit
 
 struct CSmartHiveSplitInvalid : public CSmartHiveSplit
 {
-    bool Valididate(const std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const final {hiveReward = (blockReward * percent) + 1000; return true;}
+    bool Valididate(const CCoinbaseOutputs &outputs, int nHeight, CAmount blockReward, CAmount& hiveReward) const final {hiveReward = (blockReward * percent) + 1000; return true;}
     void FillPayment(std::vector<CTxOut> &outputs, int nHeight, CAmount blockReward, std::vector<CTxOut>& voutSmartHives) const final {voutSmartHives.clear();}
     CSmartHiveSplitInvalid(double percent) : CSmartHiveSplit() {this->percent = percent;}
     ~CSmartHiveSplitInvalid() {}
@@ -0,0 +1,57 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COINBASEOUTPUTS_H
+#define COINBASEOUTPUTS_H
+
+#include "primitives/transaction.h"
+#include "script/script.h"
+
+#include <map>
+
+/**
+ * The outputs of a coinbase by their script. SmartMining::Validate builds it once per block,
+ * the hive and smartnode payment checks look up their payees in it instead of walking
+ * through vout for each of them.
+ */
+class CCoinbaseOutputs
+{
+    const CTransaction& tx;
+    //! Index into vout, the outputs of a script in vout order
+    std::multimap<CScript, size_t> mapByScript;
+
+public:
+    explicit CCoinbaseOutputs(const CTransaction& txIn) : tx(txIn)
+    {
+        for (size_t i = 0; i < tx.vout.size(); i++)
+            mapByScript.insert(std::make_pair(tx.vout[i].scriptPubKey, i));
+    }
+
+    const CTransaction& GetTransaction() const { return tx; }
+    size_t size() const { return tx.vout.size(); }
+    const CTxOut& operator[](size_t nIndex) const { return tx.vout[nIndex]; }
+
+    //! Call visit(nIndex, output) for all outputs paying script, in vout order
+    template <typename Visit>
+    void ForEach(const CScript& script, Visit visit) const
+    {
+        auto range = mapByScript.equal_range(script);
+        for (auto it = range.first; it != range.second; ++it)
+            visit(it->second, tx.vout[it->second]);
+    }
+
+    //! Index of the first output paying script which matches, -1 if there is none
+    template <typename Match>
+    int Find(const CScript& script, Match match) const
+    {
+        auto range = mapByScript.equal_range(script);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (match(tx.vout[it->second]))
+                return it->second;
+        }
+        return -1;
+    }
+};
+
+#endif // COINBASEOUTPUTS_H
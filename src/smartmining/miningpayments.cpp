@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "smartmining/miningpayments.h"
+#include "smartmining/coinbaseoutputs.h"
+#include "spentindex.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
 #include "messagesigner.h"
@@ -14,6 +16,8 @@
 #include "smarthive/hive.h"
 #include "smarthive/hivepayments.h"
 
+#include <boost/algorithm/string.hpp>
+
 // Here is the place to later research with the possible mining adjustments.
 
 CCriticalSection cs_miningkeys;
@@ -153,12 +157,12 @@ static bool CheckSignature(const CBlock &block, const CBlockIndex *pindex)
     }
 
     // If we dont have at least 2 outputs in the coinbase we very likely won't have a signature.
-    if( !block.vtx.size() || block.vtx[0].vout.size() < 2 ){
+    if( !block.vtx.size() || block.vtx[0]->vout.size() < 2 ){
         return false;
     }
 
     // Second output of the coinbase needs to be the signature.
-    const CScript &sigScript = block.vtx[0].vout[1].scriptPubKey;
+    const CScript &sigScript = block.vtx[0]->vout[1].scriptPubKey;
 
     // Check if it is an OP_RETURN and if the startvalue is OP_DATA_MINING_FLAG
     if( sigScript.size() > nMiningSignatureMinScriptLength &&
@@ -186,16 +190,10 @@ static bool CheckSignature(const CBlock &block, const CBlockIndex *pindex)
                 ss << strMessageMagic;
                 ss << pindex->nHeight;
 
-                CPubKey pubkey;
-                if (!pubkey.RecoverCompact(Hash(ss.begin(), ss.end()), vchSig)){
+                std::string strError;
+                if (!CHashSigner::VerifyHash(Hash(ss.begin(), ss.end()), keyId, vchSig, strError)){
 
-                    LogPrintf("SmartMining::CheckSignature -- The signature did not match the message digest.\n");
-                    return false;
-                }
-
-                if (!(CSmartAddress(pubkey.GetID()) == signAddress)){
-
-                    LogPrintf("SmartMining::CheckSignature -- VerifyMessage() failed\n");
+                    LogPrintf("SmartMining::CheckSignature -- VerifyHash() failed, error: %s\n", strError);
                     return false;
                 }
 
@@ -212,7 +210,7 @@ static bool CheckSignature(const CBlock &block, const CBlockIndex *pindex)
         }
 
     }else{
-        LogPrintf("SmartMining::CheckSignature -- Signing output missing. %s\n", block.vtx[0].ToString());
+        LogPrintf("SmartMining::CheckSignature -- Signing output missing. %s\n", block.vtx[0]->ToString());
     }
 
     return false;
@@ -304,10 +302,79 @@ void SmartMining::FillPayment(CMutableTransaction& coinbaseTx, int nHeight, CBlo
 
 }
 
-bool SmartMining::Validate(const CBlock &block, CBlockIndex *pindex, CValidationState& state, CAmount nFees)
+void SmartMining::GetPayoutCategories(const CTransaction& coinbase, int nHeight, std::vector<int>& vCategories)
+{
+    vCategories.assign(coinbase.vout.size(), 0);
+
+    // The smartnodes get equal shares of the payment, the checks accept
+    // outputs within a satoshi of a share
+    CAmount nodeReward = SmartNodePayments::Payment(nHeight);
+    int nNodes = nodeReward > 0 ? std::max(SmartNodePayments::PayoutsPerBlock(nHeight), 1) : 0;
+    CAmount perNode = nNodes ? nodeReward / nNodes : 0;
+
+    // Mining reward first, then the hives and the smartnodes, whatever else
+    // the coinbase pays are the smartrewards
+    for (size_t i = 0; i < coinbase.vout.size(); i++) {
+        const CTxOut& out = coinbase.vout[i];
+
+        // The mining signature
+        if (out.nValue <= 0)
+            continue;
+
+        if (i == 0) {
+            vCategories[i] = PAYOUT_MINING;
+        } else if (SmartHive::IsHive(out.scriptPubKey)) {
+            vCategories[i] = PAYOUT_HIVE;
+        } else if (nNodes > 0 && abs(out.nValue - perNode) < 2) {
+            vCategories[i] = PAYOUT_SMARTNODE;
+            --nNodes;
+        } else {
+            vCategories[i] = PAYOUT_SMARTREWARDS;
+        }
+    }
+}
+
+std::string SmartMining::PayoutCategoryName(int nCategory)
+{
+    switch (nCategory) {
+    case PAYOUT_MINING: return "mining";
+    case PAYOUT_HIVE: return "hive";
+    case PAYOUT_SMARTNODE: return "smartnode";
+    case PAYOUT_SMARTREWARDS: return "smartrewards";
+    }
+    return "unknown";
+}
+
+bool SmartMining::ParsePayoutCategories(const std::string& strCategories, int& nMask)
+{
+    std::vector<std::string> vNames;
+    boost::split(vNames, strCategories, boost::is_any_of(","));
+
+    nMask = 0;
+
+    for (const std::string& strName : vNames) {
+        if (strName == "all") {
+            nMask |= PAYOUT_ALL;
+            continue;
+        }
+
+        int nCategory = PAYOUT_MINING;
+        while (nCategory <= PAYOUT_SMARTREWARDS && PayoutCategoryName(nCategory) != strName)
+            nCategory <<= 1;
+
+        if (nCategory > PAYOUT_SMARTREWARDS)
+            return false;
+
+        nMask |= nCategory;
+    }
+
+    return nMask != 0;
+}
+
+bool SmartMining::Validate(const CBlock &block, CBlockIndex *pindex, CValidationState& state, CAmount nFees, Payouts *pPayouts)
 {
     const CChainParams& chainparams = Params();
-    CAmount coinbase = block.vtx[0].GetValueOut();
+    CAmount coinbase = block.vtx[0]->GetValueOut();
     CAmount blockReward = GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus());
     CAmount miningReward = GetMiningReward(pindex, blockReward);
     CAmount hiveReward = 0, nodeReward = 0, smartReward = 0;
@@ -317,21 +384,24 @@ bool SmartMining::Validate(const CBlock &block, CBlockIndex *pindex, CValidation
                                 REJECT_INVALID, "invalid-mining-signature");
     }
 
-    SmartHivePayments::Result result = SmartHivePayments::Validate(block.vtx[0],pindex->nHeight, pindex->GetBlockTime(), hiveReward);
+    // The hive and smartnode checks look up their payees in here
+    CCoinbaseOutputs outputs(*block.vtx[0]);
+
+    SmartHivePayments::Result result = SmartHivePayments::Validate(outputs,pindex->nHeight, pindex->GetBlockTime(), hiveReward);
     if( result != SmartHivePayments::Valid ){
-        LogPrintf("SmartMining::Validate - Invalid hive payment %s\n", block.vtx[0].ToString());
+        LogPrintf("SmartMining::Validate - Invalid hive payment %s\n", block.vtx[0]->ToString());
         return state.DoS(100, false, SmartHivePayments::RejectionCode(result),
                                      SmartHivePayments::RejectionMessage(result));
     }
 
-    if (!SmartNodePayments::IsPaymentValid(block.vtx[0], pindex->nHeight, blockReward, nodeReward)) {
-        LogPrintf("SmartMining::Validate - Invalid node payment %s\n", block.vtx[0].ToString());
+    if (!SmartNodePayments::IsPaymentValid(outputs, pindex->nHeight, blockReward, nodeReward)) {
+        LogPrintf("SmartMining::Validate - Invalid node payment %s\n", block.vtx[0]->ToString());
         return state.DoS(0, error("ConnectBlock(SMARTCASH): couldn't find smartnode payments"),
                                 REJECT_INVALID, "bad-cb-payee");
     }
 //if (pindex->nHeight != 2025799 && pindex->nHeight != 2025804 && pindex->nHeight != 2025809 && pindex->nHeight != 2025814){
     if( SmartRewardPayments::Validate(block,pindex->nHeight, smartReward) != SmartRewardPayments::Valid ){
-        LogPrintf("SmartMining::Validate - Invalid smartreward payment %s\n", block.vtx[0].ToString());
+        LogPrintf("SmartMining::Validate - Invalid smartreward payment %s\n", block.vtx[0]->ToString());
         return state.DoS(100, false, REJECT_INVALID_SMARTREWARD_PAYMENTS,
                      "CTransaction::CheckTransaction() : SmartReward payment list is invalid");
     }
@@ -340,11 +410,18 @@ bool SmartMining::Validate(const CBlock &block, CBlockIndex *pindex, CValidation
 
     if( pindex->nHeight > 1 && coinbase > expectedCoinbase && pindex->nHeight != 2025799 && pindex->nHeight != 2025804 && 
             pindex->nHeight != 2025809 && pindex->nHeight != 2025814 ){
-        LogPrintf("SmartMining::Validate - Coinbase %d.%08d is higher than Expected %d.%08d! %s\n", coinbase / COIN, coinbase % COIN, expectedCoinbase / COIN, expectedCoinbase % COIN, block.vtx[0].ToString());
+        LogPrintf("SmartMining::Validate - Coinbase %d.%08d is higher than Expected %d.%08d! %s\n", coinbase / COIN, coinbase % COIN, expectedCoinbase / COIN, expectedCoinbase % COIN, block.vtx[0]->ToString());
         return state.DoS(100, false, REJECT_INVALID,
                      "CTransaction::CheckTransaction() : Coinbase value too high");
     }
 
+    if( pPayouts ){
+        pPayouts->mining = miningReward;
+        pPayouts->hive = hiveReward;
+        pPayouts->smartnode = nodeReward;
+        pPayouts->smartrewards = smartReward;
+    }
+
     return true;
 }
 
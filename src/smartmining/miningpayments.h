@@ -23,11 +23,28 @@ extern std::map<uint8_t, CSmartAddress> mapMiningKeysTestnet;
 
 namespace SmartMining{
 
+/** Rewards paid by the coinbase of a block. */
+struct Payouts{
+    CAmount mining;
+    CAmount hive;
+    CAmount smartnode;
+    CAmount smartrewards;
+    Payouts() : mining(0), hive(0), smartnode(0), smartrewards(0) {}
+};
+
 bool SetMiningKey(std::string &address);
-bool Validate(const CBlock& block, CBlockIndex *pindex, CValidationState& state, CAmount nFees);
+bool Validate(const CBlock& block, CBlockIndex *pindex, CValidationState& state, CAmount nFees, Payouts *pPayouts = nullptr);
 void FillPayment(CMutableTransaction& txNew, int nHeight, CBlockIndex * pindexPrev, CAmount blockReward, CTxOut &outSignature, const CSmartAddress &signingAddress);
 bool IsSignatureRequired(const CBlockIndex *pindex);
 bool IsSignatureRequired(const int nHeight);
+/** The PayoutCategory of each output of the coinbase of the block at nHeight, 0 for the ones
+ *  paying nothing. They are told apart by the order the miner adds them in and their amounts,
+ *  the way the payment checks find them, without the payee lists of the smartnodes. */
+void GetPayoutCategories(const CTransaction& coinbase, int nHeight, std::vector<int>& vCategories);
+//! Name of a PayoutCategory in the replies of the SAPI and the RPC
+std::string PayoutCategoryName(int nCategory);
+//! Mask of the comma separated category names, "all" for all of them
+bool ParsePayoutCategories(const std::string& strCategories, int& nMask);
 
 }
 
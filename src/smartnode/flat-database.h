@@ -13,9 +13,113 @@
 
 #include <boost/filesystem.hpp>
 
+/** First bytes of the chunked format, legacy files start with the length of their magic message */
+static const unsigned char FLATDB_SIGNATURE[4] = {0x00, 'F', 'D', 'B'};
+static const uint32_t FLATDB_FORMAT_VERSION = 1;
+/** Size of the checksummed chunks the serialized object gets split into */
+static const uint32_t FLATDB_CHUNK_SIZE = 1 << 20;
+static const uint32_t FLATDB_MAX_CHUNK_SIZE = 32 << 20;
+
+/**
+ * Stream over the chunks of a file in the chunked format. Every chunk is
+ * verified when it gets read so the object can be deserialized straight from
+ * the file. The last chunk is empty and holds the hash over all chunk hashes.
+ * The size of all data is known up front, some objects read optional fields
+ * only while there is data left.
+ */
+class CFlatDBChunkReader
+{
+    CAutoFile& filein;
+    std::vector<char> vchChunk;
+    size_t nChunkPos;
+    uint64_t nDataLeft;
+    uint256 hashChain;
+    bool fEnd;
+
+    void ReadChunk()
+    {
+        if (fEnd)
+            throw std::ios_base::failure("CFlatDBChunkReader::ReadChunk(): end of data");
+
+        uint32_t nSize;
+        uint256 hashIn;
+        filein >> nSize;
+
+        if (nSize > FLATDB_MAX_CHUNK_SIZE)
+            throw std::ios_base::failure("CFlatDBChunkReader::ReadChunk(): chunk too large");
+
+        vchChunk.resize(nSize);
+        nChunkPos = 0;
+
+        if (nSize)
+            filein.read(&vchChunk[0], nSize);
+        filein >> hashIn;
+
+        if (!nSize) {
+            fEnd = true;
+            fCorrupted = hashIn != hashChain;
+        } else {
+            uint256 hashChunk = Hash(vchChunk.begin(), vchChunk.end());
+            fCorrupted = hashIn != hashChunk;
+            hashChain = Hash(hashChain.begin(), hashChain.end(), hashChunk.begin(), hashChunk.end());
+        }
+
+        if (fCorrupted)
+            throw std::ios_base::failure("CFlatDBChunkReader::ReadChunk(): checksum mismatch");
+    }
+
+public:
+    //! Set when a chunk failed its checksum
+    bool fCorrupted;
+
+    CFlatDBChunkReader(CAutoFile& fileinIn, uint64_t nDataSize) : filein(fileinIn), nChunkPos(0), nDataLeft(nDataSize), fEnd(false), fCorrupted(false) {}
+
+    int GetType() const { return filein.GetType(); }
+    int GetVersion() const { return filein.GetVersion(); }
+    uint64_t size() const { return nDataLeft; }
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > nDataLeft)
+            throw std::ios_base::failure("CFlatDBChunkReader::read(): end of data");
+        nDataLeft -= nSize;
+
+        while (nSize) {
+            if (nChunkPos == vchChunk.size())
+                ReadChunk();
+            size_t nRead = std::min(nSize, vchChunk.size() - nChunkPos);
+            memcpy(pch, &vchChunk[nChunkPos], nRead);
+            nChunkPos += nRead;
+            pch += nRead;
+            nSize -= nRead;
+        }
+    }
+
+    /** Verify the end of the data follows, false if there is data left. */
+    bool Finish()
+    {
+        if (nDataLeft || nChunkPos != vchChunk.size())
+            return false;
+        if (!fEnd)
+            ReadChunk();
+        return fEnd && vchChunk.empty();
+    }
+
+    template<typename T>
+    CFlatDBChunkReader& operator>>(T& obj)
+    {
+        ::Unserialize(*this, obj, GetType(), GetVersion());
+        return *this;
+    }
+};
+
 /** 
 *   Generic Dumping and Loading
 *   ---------------------------
+*
+*   Files are written in the chunked format, to a temporary file first, from
+*   a copy of the object serialized under its lock. Files of the previous
+*   format with one hash at the end still get loaded.
 */
 
 template<typename T>
@@ -39,53 +143,113 @@ private:
 
     bool Write(const T& objToSave)
     {
-        // LOCK(objToSave.cs);
-
         int64_t nStart = GetTimeMillis();
 
-        // serialize, checksum data up to that point, then append checksum
+        // serialize first, the object stays locked only for this
         CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-        ssObj << strMagicMessage; // specific magic message for this type of object
-        ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
         ssObj << objToSave;
-        uint256 hash = Hash(ssObj.begin(), ssObj.end());
-        ssObj << hash;
+
+        boost::filesystem::path pathTmp = pathDB;
+        pathTmp += ".new";
 
         // open output file, and associate with CAutoFile
-        FILE *file = fopen(pathDB.string().c_str(), "wb");
+        FILE *file = fopen(pathTmp.string().c_str(), "wb");
         CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
         if (fileout.IsNull())
-            return error("%s: Failed to open file %s", __func__, pathDB.string());
+            return error("%s: Failed to open file %s", __func__, pathTmp.string());
 
-        // Write and commit header, data
         try {
-            fileout << ssObj;
+            fileout << FLATDATA(FLATDB_SIGNATURE) << FLATDB_FORMAT_VERSION;
+            fileout << strMagicMessage; // specific magic message for this type of object
+            fileout << FLATDATA(Params().MessageStart()); // network specific magic number
+            fileout << uint64_t(ssObj.size());
+
+            // chunks of the data with their checksums, then the checksum over all of them
+            uint256 hashChain;
+
+            for (size_t nPos = 0; nPos < ssObj.size(); nPos += FLATDB_CHUNK_SIZE) {
+                uint32_t nSize = std::min<size_t>(FLATDB_CHUNK_SIZE, ssObj.size() - nPos);
+                uint256 hashChunk = Hash(ssObj.begin() + nPos, ssObj.begin() + nPos + nSize);
+                fileout << nSize;
+                fileout.write(&ssObj[nPos], nSize);
+                fileout << hashChunk;
+                hashChain = Hash(hashChain.begin(), hashChain.end(), hashChunk.begin(), hashChunk.end());
+            }
+
+            fileout << uint32_t(0) << hashChain;
         }
         catch (std::exception &e) {
             return error("%s: Serialize or I/O error - %s", __func__, e.what());
         }
+
+        FileCommit(fileout.Get());
         fileout.fclose();
 
+        if (!RenameOver(pathTmp, pathDB))
+            return error("%s: Rename-into-place failed for %s", __func__, pathDB.string());
+
         LogPrintf("Written info to %s  %dms\n", strFilename, GetTimeMillis() - nStart);
         LogPrintf("     %s\n", objToSave.ToString());
 
         return true;
     }
 
-    ReadResult Read(T& objToLoad, bool fDryRun = false)
+    /** Verify the magic message and network of the file, the data follows. */
+    ReadResult ReadHeader(CAutoFile& filein, bool& fChunkedRet)
     {
-        //LOCK(objToLoad.cs);
+        unsigned char pchSignature[4];
+        unsigned char pchMsgTmp[4];
+        std::string strMagicMessageTmp;
 
-        int64_t nStart = GetTimeMillis();
-        // open input file, and associate with CAutoFile
-        FILE *file = fopen(pathDB.string().c_str(), "rb");
-        CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-        if (filein.IsNull())
-        {
-            error("%s: Failed to open file %s", __func__, pathDB.string());
-            return FileError;
+        try {
+            filein >> FLATDATA(pchSignature);
+            fChunkedRet = !memcmp(pchSignature, FLATDB_SIGNATURE, sizeof(pchSignature));
+
+            if (fChunkedRet) {
+                uint32_t nFormatVersion;
+                filein >> nFormatVersion;
+                if (nFormatVersion > FLATDB_FORMAT_VERSION) {
+                    error("%s: Unknown format version %d", __func__, nFormatVersion);
+                    return IncorrectFormat;
+                }
+            } else if (fseek(filein.Get(), 0, SEEK_SET)) {
+                return FileError;
+            }
+
+            // de-serialize file header (file specific magic message) and ..
+            filein >> strMagicMessageTmp;
+
+            // ... verify the message matches predefined one
+            if (strMagicMessage != strMagicMessageTmp)
+            {
+                error("%s: Invalid magic message", __func__);
+                return IncorrectMagicMessage;
+            }
+
+            // de-serialize file header (network specific magic number) and ..
+            filein >> FLATDATA(pchMsgTmp);
+
+            // ... verify the network matches ours
+            if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+            {
+                error("%s: Invalid network magic number", __func__);
+                return IncorrectMagicNumber;
+            }
+        }
+        catch (std::exception &e) {
+            error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            return IncorrectMagicMessage;
         }
 
+        return Ok;
+    }
+
+    /** Previous format, the hash at the end covers the header and the data. */
+    ReadResult ReadLegacy(CAutoFile& filein, T& objToLoad)
+    {
+        if (fseek(filein.Get(), 0, SEEK_SET))
+            return FileError;
+
         // use file size to size memory buffer
         int fileSize = boost::filesystem::file_size(pathDB);
         int dataSize = fileSize - sizeof(uint256);
@@ -105,7 +269,6 @@ private:
             error("%s: Deserialize or I/O error - %s", __func__, e.what());
             return HashReadError;
         }
-        filein.fclose();
 
         CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
 
@@ -117,31 +280,13 @@ private:
             return IncorrectHash;
         }
 
-
         unsigned char pchMsgTmp[4];
         std::string strMagicMessageTmp;
         try {
-            // de-serialize file header (file specific magic message) and ..
+            // the header was verified already
             ssObj >> strMagicMessageTmp;
-
-            // ... verify the message matches predefined one
-            if (strMagicMessage != strMagicMessageTmp)
-            {
-                error("%s: Invalid magic message", __func__);
-                return IncorrectMagicMessage;
-            }
-
-
-            // de-serialize file header (network specific magic number) and ..
             ssObj >> FLATDATA(pchMsgTmp);
 
-            // ... verify the network matches ours
-            if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
-            {
-                error("%s: Invalid network magic number", __func__);
-                return IncorrectMagicNumber;
-            }
-
             // de-serialize data into T object
             ssObj >> objToLoad;
         }
@@ -151,13 +296,61 @@ private:
             return IncorrectFormat;
         }
 
+        return Ok;
+    }
+
+    ReadResult Read(T& objToLoad)
+    {
+        int64_t nStart = GetTimeMillis();
+        // open input file, and associate with CAutoFile
+        FILE *file = fopen(pathDB.string().c_str(), "rb");
+        CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+        {
+            error("%s: Failed to open file %s", __func__, pathDB.string());
+            return FileError;
+        }
+
+        bool fChunked;
+        ReadResult result = ReadHeader(filein, fChunked);
+
+        if (result != Ok)
+            return result;
+
+        if (!fChunked) {
+            result = ReadLegacy(filein, objToLoad);
+        } else {
+            // de-serialize data into T object while the chunks get verified
+            uint64_t nDataSize = 0;
+            try {
+                filein >> nDataSize;
+            }
+            catch (std::exception &e) {
+                error("%s: Deserialize or I/O error - %s", __func__, e.what());
+                return HashReadError;
+            }
+
+            CFlatDBChunkReader reader(filein, nDataSize);
+            try {
+                reader >> objToLoad;
+                if (!reader.Finish())
+                    throw std::ios_base::failure("data left after the object");
+            }
+            catch (std::exception &e) {
+                objToLoad.Clear();
+                error("%s: Deserialize or I/O error - %s", __func__, e.what());
+                result = reader.fCorrupted ? IncorrectHash : IncorrectFormat;
+            }
+        }
+
+        if (result != Ok)
+            return result;
+
         LogPrintf("Loaded info from %s  %dms\n", strFilename, GetTimeMillis() - nStart);
         LogPrintf("     %s\n", objToLoad.ToString());
-        if(!fDryRun) {
-            LogPrintf("%s: Cleaning....\n", __func__);
-            objToLoad.CheckAndRemove();
-            LogPrintf("     %s\n", objToLoad.ToString());
-        }
+        LogPrintf("%s: Cleaning....\n", __func__);
+        objToLoad.CheckAndRemove();
+        LogPrintf("     %s\n", objToLoad.ToString());
 
         return Ok;
     }
@@ -199,8 +392,13 @@ public:
         int64_t nStart = GetTimeMillis();
 
         LogPrintf("Verifying %s format...\n", strFilename);
-        T tmpObjToLoad;
-        ReadResult readResult = Read(tmpObjToLoad, true);
+        ReadResult readResult = FileError;
+        {
+            CAutoFile filein(fopen(pathDB.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+            bool fChunked;
+            if (!filein.IsNull())
+                readResult = ReadHeader(filein, fChunked);
+        }
 
         // there was an error and it was not an error on file opening => do not proceed
         if (readResult == FileError)
@@ -218,7 +416,8 @@ public:
         }
 
         LogPrintf("Writing info to %s...\n", strFilename);
-        Write(objToSave);
+        if (!Write(objToSave))
+            return false;
         LogPrintf("%s dump finished  %dms\n", strFilename, GetTimeMillis() - nStart);
 
         return true;
@@ -0,0 +1,132 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "smartnode/instantpaystats.h"
+
+#include <algorithm>
+#include <cmath>
+
+void CInstantPayTimingHistogram::Clear()
+{
+    nCount = 0;
+    nTotal = 0;
+    nMax = 0;
+    std::fill(vBuckets, vBuckets + NUM_BUCKETS, 0);
+}
+
+void CInstantPayTimingHistogram::Add(int64_t nMillis)
+{
+    nMillis = std::max<int64_t>(nMillis, 0);
+
+    int64_t nValue = nMillis;
+    int nBucket = 0;
+
+    while (nValue > 0 && nBucket < NUM_BUCKETS - 1) {
+        nValue >>= 1;
+        ++nBucket;
+    }
+
+    ++nCount;
+    nTotal += nMillis;
+    nMax = std::max(nMax, nMillis);
+    ++vBuckets[nBucket];
+}
+
+int64_t CInstantPayTimingHistogram::Percentile(double dQuantile) const
+{
+    if (!nCount) return 0;
+
+    uint64_t nRank = std::max<uint64_t>(std::ceil(dQuantile * nCount), 1);
+    uint64_t nSeen = 0;
+
+    for (int i = 0; i < NUM_BUCKETS - 1; ++i) {
+        nSeen += vBuckets[i];
+        if (nSeen >= nRank) return (int64_t)1 << i;
+    }
+
+    return -1;
+}
+
+UniValue CInstantPayTimingHistogram::ToJSON() const
+{
+    UniValue obj(UniValue::VOBJ);
+    UniValue histogram(UniValue::VARR);
+
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        if (!vBuckets[i]) continue;
+
+        UniValue bucket(UniValue::VOBJ);
+        // The last bucket is open ended.
+        if (i < NUM_BUCKETS - 1) {
+            bucket.pushKV("below_ms", (int64_t)1 << i);
+        }
+        bucket.pushKV("count", (int64_t)vBuckets[i]);
+        histogram.push_back(bucket);
+    }
+
+    obj.pushKV("count", (int64_t)nCount);
+    obj.pushKV("avg_ms", nCount ? (double)nTotal / nCount : 0.0);
+    obj.pushKV("max_ms", nMax);
+    obj.pushKV("p50_ms", Percentile(0.5));
+    obj.pushKV("p90_ms", Percentile(0.9));
+    obj.pushKV("p99_ms", Percentile(0.99));
+    obj.pushKV("histogram", histogram);
+
+    return obj;
+}
+
+void CInstantPayStats::AddRequest()
+{
+    LOCK(cs);
+    ++nRequests;
+}
+
+void CInstantPayStats::AddVote(int64_t nMillis, bool fFirst)
+{
+    LOCK(cs);
+    votes.Add(nMillis);
+    if (fFirst) {
+        firstVote.Add(nMillis);
+    }
+}
+
+void CInstantPayStats::AddLock(int64_t nMillis)
+{
+    LOCK(cs);
+    ++nLocked;
+    lock.Add(nMillis);
+}
+
+void CInstantPayStats::AddFailed()
+{
+    LOCK(cs);
+    ++nFailed;
+}
+
+void CInstantPayStats::Clear()
+{
+    LOCK(cs);
+    nRequests = 0;
+    nLocked = 0;
+    nFailed = 0;
+    firstVote.Clear();
+    lock.Clear();
+    votes.Clear();
+}
+
+UniValue CInstantPayStats::ToJSON() const
+{
+    LOCK(cs);
+
+    UniValue obj(UniValue::VOBJ);
+
+    obj.pushKV("requests", (int64_t)nRequests);
+    obj.pushKV("locked", (int64_t)nLocked);
+    obj.pushKV("failed", (int64_t)nFailed);
+    obj.pushKV("time_to_first_vote", firstVote.ToJSON());
+    obj.pushKV("time_to_lock", lock.ToJSON());
+    obj.pushKV("vote_arrival", votes.ToJSON());
+
+    return obj;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef INSTANTPAYSTATS_H
+#define INSTANTPAYSTATS_H
+
+#include "sync.h"
+
+#include <univalue.h>
+
+#include <stdint.h>
+
+/** Latency histogram, bucket i counts the samples below 2^i milliseconds. */
+struct CInstantPayTimingHistogram {
+    // The last bucket collects everything from 2^18ms (~4.4 minutes) on
+    static const int NUM_BUCKETS = 20;
+
+    uint64_t nCount;
+    int64_t nTotal;
+    int64_t nMax;
+    uint64_t vBuckets[NUM_BUCKETS];
+
+    CInstantPayTimingHistogram() { Clear(); }
+
+    void Clear();
+    void Add(int64_t nMillis);
+    //! Upper bound in milliseconds of the bucket which holds the quantile, -1 for the open ended one
+    int64_t Percentile(double dQuantile) const;
+    UniValue ToJSON() const;
+};
+
+/**
+ * Latency of the InstantPay locks seen since the start, independent of the
+ * -instantpayindex database. Everything is relative to the arrival of the
+ * lock request, votes which arrived before it count as zero.
+ */
+class CInstantPayStats
+{
+    mutable CCriticalSection cs;
+
+    uint64_t nRequests;
+    uint64_t nLocked;
+    uint64_t nFailed;
+
+    CInstantPayTimingHistogram firstVote;
+    CInstantPayTimingHistogram lock;
+    CInstantPayTimingHistogram votes;
+
+public:
+    CInstantPayStats() { Clear(); }
+
+    void AddRequest();
+    void AddVote(int64_t nMillis, bool fFirst);
+    void AddLock(int64_t nMillis);
+    void AddFailed();
+    void Clear();
+
+    UniValue ToJSON() const;
+};
+
+#endif // INSTANTPAYSTATS_H
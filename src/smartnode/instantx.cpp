@@ -4,6 +4,7 @@
 
 #include "activesmartnode.h"
 #include "instantx.h"
+#include "../core_memusage.h"
 #include "../key.h"
 #include "../validation.h"
 #include "smartnodesync.h"
@@ -13,6 +14,7 @@
 #include "../protocol.h"
 #include "spork.h"
 #include "../sync.h"
+#include "../trace.h"
 #include "../txmempool.h"
 #include "../util.h"
 #include "consensus/validation.h"
@@ -22,6 +24,10 @@
 #include "wallet/wallet.h"
 #endif // ENABLE_WALLET
 
+#include <algorithm>
+#include <deque>
+#include <memory>
+
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 
@@ -36,6 +42,248 @@ int nCompleteTXLocks;
 
 CInstantSend instantsend;
 
+static CCriticalSection cs_setVerifiedVoteSignatures;
+// Hashes of the pubkey, signature and message of the vote signatures verified already
+static std::set<uint256> setVerifiedVoteSignatures;
+static const size_t MAX_VERIFIED_VOTE_SIGNATURES = 20000;
+
+static bool VerifyTxLockVoteMessage(const CPubKey& pubKey, const std::vector<unsigned char>& vchSig, const std::string& strMessage, std::string& strErrorRet)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << pubKey << vchSig << strMessage;
+    uint256 hash = ss.GetHash();
+
+    {
+        LOCK(cs_setVerifiedVoteSignatures);
+        if(setVerifiedVoteSignatures.count(hash)) return true;
+    }
+
+    if(!CMessageSigner::VerifyMessage(pubKey, vchSig, strMessage, strErrorRet)) return false;
+
+    LOCK(cs_setVerifiedVoteSignatures);
+    if(setVerifiedVoteSignatures.size() >= MAX_VERIFIED_VOTE_SIGNATURES) setVerifiedVoteSignatures.clear();
+    setVerifiedVoteSignatures.insert(hash);
+    return true;
+}
+
+/**
+ * Queue of the lock votes received from peers. The worker threads verify the signatures
+ * without any lock and whichever of them finishes the oldest vote processes the votes
+ * which are done, in the order they came in.
+ */
+class CTxLockVoteVerifier
+{
+    struct QueuedVote {
+        CTxLockVote vote;
+        CNode* pnode; // referenced while queued, NULL for the votes of mempool.dat
+        int64_t nTimeQueued;
+        bool fVerified;
+    };
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<std::shared_ptr<QueuedVote> > queueVotes;
+    // Index in queueVotes of the first vote no thread took yet
+    size_t nNextVerify;
+    bool fProcessing;
+    bool fStarted;
+    CConnman* pconnman;
+
+    int64_t nQueueTimeTotal;
+    int64_t nVotesProcessed;
+
+    void ProcessVerified()
+    {
+        while(true) {
+            std::shared_ptr<QueuedVote> queued;
+            {
+                boost::lock_guard<boost::mutex> lock(cs);
+                if(queueVotes.empty() || !queueVotes.front()->fVerified) {
+                    fProcessing = false;
+                    return;
+                }
+                queued = queueVotes.front();
+                queueVotes.pop_front();
+                --nNextVerify;
+                nQueueTimeTotal += GetTimeMicros() - queued->nTimeQueued;
+                ++nVotesProcessed;
+            }
+
+            instantsend.ProcessTxLockVote(queued->pnode, queued->vote, *pconnman);
+            if(queued->pnode) queued->pnode->Release();
+        }
+    }
+
+public:
+    CTxLockVoteVerifier() : nNextVerify(0), fProcessing(false), fStarted(false), pconnman(NULL), nQueueTimeTotal(0), nVotesProcessed(0) {}
+
+    void Start(boost::thread_group& threadGroup, CConnman& connman)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            if(fStarted) return;
+            pconnman = &connman;
+            fStarted = true;
+        }
+
+        for(int i = 0; i < INSTANTSEND_VOTE_VERIFY_THREADS; ++i)
+            threadGroup.create_thread(boost::bind(&CTxLockVoteVerifier::Thread, this));
+    }
+
+    /// False if the vote has to be processed right away
+    bool Queue(CNode* pnode, const CTxLockVote& vote)
+    {
+        std::shared_ptr<QueuedVote> queued(new QueuedVote{vote, pnode, GetTimeMicros(), false});
+
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            if(!fStarted || queueVotes.size() >= INSTANTSEND_MAX_QUEUED_VOTES) return false;
+            if(pnode) pnode->AddRef();
+            queueVotes.push_back(queued);
+        }
+
+        cond.notify_one();
+        return true;
+    }
+
+    void Thread()
+    {
+        RenameThread("smartcash-isvote");
+
+        while(true) {
+            std::shared_ptr<QueuedVote> queued;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while(nNextVerify >= queueVotes.size())
+                    cond.wait(lock);
+                queued = queueVotes[nNextVerify++];
+            }
+
+            queued->vote.PreVerifySignature();
+
+            {
+                boost::lock_guard<boost::mutex> lock(cs);
+                queued->fVerified = true;
+                if(fProcessing) continue;
+                fProcessing = true;
+            }
+
+            ProcessVerified();
+            boost::this_thread::interruption_point();
+        }
+    }
+
+    std::string ToString()
+    {
+        boost::lock_guard<boost::mutex> lock(cs);
+        return strprintf("Votes queued: %llu, average queue time: %dus", queueVotes.size(),
+                         nVotesProcessed ? nQueueTimeTotal / nVotesProcessed : 0);
+    }
+};
+
+static CTxLockVoteVerifier voteVerifier;
+
+/**
+ * Append only queue of the finalized instantpay index entries. One thread takes
+ * everything queued so far and writes it in batches, the lock processing never
+ * waits for the database.
+ */
+class CInstantPayIndexWriter
+{
+    typedef std::vector<std::pair<CInstantPayIndexKey, CInstantPayValue> > IndexEntries;
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    IndexEntries vecQueue;
+    bool fStarted;
+
+    int64_t nWriteTimeTotal;
+    int64_t nEntriesWritten;
+
+    static bool Write(const IndexEntries& vecEntries)
+    {
+        if(vecEntries.empty()) return true;
+
+        try {
+            return pblocktree->WriteInstantPayLocks(vecEntries, INSTANTPAY_INDEX_BATCH_SIZE);
+        } catch (const std::exception& e) {
+            return error("CInstantPayIndexWriter::Write -- %s", e.what());
+        }
+    }
+
+public:
+    CInstantPayIndexWriter() : fStarted(false), nWriteTimeTotal(0), nEntriesWritten(0) {}
+
+    void Start(boost::thread_group& threadGroup)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            if(fStarted) return;
+            fStarted = true;
+        }
+
+        threadGroup.create_thread(boost::bind(&CInstantPayIndexWriter::Thread, this));
+    }
+
+    /// False if the entries have to be written right away
+    bool Queue(const IndexEntries& vecEntries)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            if(!fStarted) return false;
+            vecQueue.insert(vecQueue.end(), vecEntries.begin(), vecEntries.end());
+        }
+
+        cond.notify_one();
+        return true;
+    }
+
+    void Thread()
+    {
+        RenameThread("smartcash-ipindex");
+
+        while(true) {
+            IndexEntries vecEntries;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while(vecQueue.empty())
+                    cond.wait(lock);
+                vecEntries.swap(vecQueue);
+            }
+
+            int64_t nTimeStart = GetTimeMicros();
+
+            if(!Write(vecEntries))
+                LogPrintf("CInstantPayIndexWriter::Thread -- Failed to write %d instantpay index entries\n", vecEntries.size());
+
+            boost::lock_guard<boost::mutex> lock(cs);
+            nWriteTimeTotal += GetTimeMicros() - nTimeStart;
+            nEntriesWritten += vecEntries.size();
+        }
+    }
+
+    void Flush()
+    {
+        IndexEntries vecEntries;
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            vecEntries.swap(vecQueue);
+        }
+
+        if(!Write(vecEntries))
+            LogPrintf("CInstantPayIndexWriter::Flush -- Failed to write %d instantpay index entries\n", vecEntries.size());
+    }
+
+    std::string ToString()
+    {
+        boost::lock_guard<boost::mutex> lock(cs);
+        return strprintf("Index entries queued: %llu, average write time: %dus", vecQueue.size(),
+                         nEntriesWritten ? nWriteTimeTotal / nEntriesWritten : 0);
+    }
+};
+
+static CInstantPayIndexWriter indexWriter;
+
 // Transaction Locks
 //
 // step 1) Some node announces intention to lock transaction inputs via "txlreg" message
@@ -63,7 +311,7 @@ void CInstantSend::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataSt
 
         uint256 nVoteHash = vote.GetHash();
 
-        pfrom->setAskFor.erase(nVoteHash);
+        pfrom->RemoveAskFor(nVoteHash);
 
         // Ignore any InstantSend messages until smartnode list is synced
         if(!smartnodeSync.IsSmartnodeListSynced()) return;
@@ -73,13 +321,30 @@ void CInstantSend::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataSt
             auto ret = mapTxLockVotes.emplace(nVoteHash, vote);
             if (!ret.second) return;
         }
+        seenLockVotes.insert(nVoteHash);
 
-        ProcessTxLockVote(pfrom, vote, connman);
+        if(!voteVerifier.Queue(pfrom, vote))
+            ProcessTxLockVote(pfrom, vote, connman);
 
         return;
     }
 }
 
+void CInstantSend::StartVoteVerification(boost::thread_group& threadGroup, CConnman& connman)
+{
+    voteVerifier.Start(threadGroup, connman);
+}
+
+void CInstantSend::StartIndexWriter(boost::thread_group& threadGroup)
+{
+    indexWriter.Start(threadGroup);
+}
+
+void CInstantSend::FlushIndex()
+{
+    indexWriter.Flush();
+}
+
 bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman)
 {
     LOCK(cs_main);
@@ -92,7 +357,7 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CCo
 
     // Check to see if we conflict with existing completed lock
     BOOST_FOREACH(const CTxIn& txin, txLockRequest.vin) {
-        std::map<COutPoint, uint256>::iterator it = mapLockedOutpoints.find(txin.prevout);
+        CLockedOutpointMap::iterator it = mapLockedOutpoints.find(txin.prevout);
         if(it != mapLockedOutpoints.end() && it->second != txLockRequest.GetHash()) {
             // Conflicting with complete lock, proceed to see if we should cancel them both
             LogPrintf("CInstantSend::ProcessTxLockRequest -- WARNING: Found conflicting completed Transaction Lock, txid=%s, completed lock txid=%s\n",
@@ -103,7 +368,7 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CCo
     // Check to see if there are votes for conflicting request,
     // if so - do not fail, just warn user
     BOOST_FOREACH(const CTxIn& txin, txLockRequest.vin) {
-        std::map<COutPoint, std::set<uint256> >::iterator it = mapVotedOutpoints.find(txin.prevout);
+        CVotedOutpointMap::iterator it = mapVotedOutpoints.find(txin.prevout);
         if(it != mapVotedOutpoints.end()) {
             BOOST_FOREACH(const uint256& hash, it->second) {
                 if(hash != txLockRequest.GetHash()) {
@@ -125,8 +390,8 @@ bool CInstantSend::ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CCo
     // Masternodes will sometimes propagate votes before the transaction is known to the client.
     // If this just happened - process orphan votes, lock inputs, resolve conflicting locks,
     // update transaction status forcing external script/zmq notifications.
-    ProcessOrphanTxLockVotes();
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    ProcessOrphanTxLockVotes(txHash);
+    CTxLockCandidateMap::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     TryToFinalizeLockCandidate(itLockCandidate->second);
 
     return true;
@@ -140,7 +405,7 @@ bool CInstantSend::CreateTxLockCandidate(const CTxLockRequest& txLockRequest)
 
     uint256 txHash = txLockRequest.GetHash();
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    CTxLockCandidateMap::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate == mapTxLockCandidates.end()) {
         LogPrintf("CInstantSend::CreateTxLockCandidate -- new, txid=%s\n", txHash.ToString());
 
@@ -151,6 +416,7 @@ bool CInstantSend::CreateTxLockCandidate(const CTxLockRequest& txLockRequest)
         }
         mapTxLockCandidates.insert(std::make_pair(txHash, txLockCandidate));
         CreateIndex(txLockCandidate);
+        stats.AddRequest();
     } else if (!itLockCandidate->second.txLockRequest) {
         // i.e. empty Transaction Lock Candidate was created earlier, let's update it with actual data
         itLockCandidate->second.txLockRequest = txLockRequest;
@@ -159,6 +425,8 @@ bool CInstantSend::CreateTxLockCandidate(const CTxLockRequest& txLockRequest)
             return false;
         }
         LogPrintf("CInstantSend::CreateTxLockCandidate -- update empty, txid=%s\n", txHash.ToString());
+        itLockCandidate->second.SetRequestTimeMillis(GetTimeMillis());
+        stats.AddRequest();
 
         // all inputs should already be checked by txLockRequest.IsValid() above, just use them now
         BOOST_REVERSE_FOREACH(const CTxIn& txin, txLockRequest.vin) {
@@ -244,14 +512,14 @@ void CInstantSend::Vote(CTxLockCandidate& txLockCandidate, CConnman& connman)
 
         LogPrint("instantsend", "CInstantSend::Vote -- In the top %d (%d)\n", nSignaturesTotal, nRank);
 
-        std::map<COutPoint, std::set<uint256> >::iterator itVoted = mapVotedOutpoints.find(itOutpointLock->first);
+        CVotedOutpointMap::iterator itVoted = mapVotedOutpoints.find(itOutpointLock->first);
 
         // Check to see if we already voted for this outpoint,
         // refuse to vote twice or to include the same outpoint in another tx
         bool fAlreadyVoted = false;
         if(itVoted != mapVotedOutpoints.end()) {
             BOOST_FOREACH(const uint256& hash, itVoted->second) {
-                std::map<uint256, CTxLockCandidate>::iterator it2 = mapTxLockCandidates.find(hash);
+                CTxLockCandidateMap::iterator it2 = mapTxLockCandidates.find(hash);
                 if(it2->second.HasSmartnodeVoted(itOutpointLock->first, activeSmartnode.outpoint)) {
                     // we already voted for this outpoint to be included either in the same tx or in a competing one,
                     // skip it anyway
@@ -282,6 +550,7 @@ void CInstantSend::Vote(CTxLockCandidate& txLockCandidate, CConnman& connman)
         // vote constructed sucessfully, let's store and relay it
         uint256 nVoteHash = vote.GetHash();
         mapTxLockVotes.insert(std::make_pair(nVoteHash, vote));
+        seenLockVotes.insert(nVoteHash);
         if(itOutpointLock->second.AddVote(vote)) {
             LogPrintf("CInstantSend::Vote -- Vote created successfully, relaying: txHash=%s, outpoint=%s, vote=%s\n",
                     txHash.ToString(), itOutpointLock->first.ToStringShort(), nVoteHash.ToString());
@@ -306,8 +575,27 @@ void CInstantSend::Vote(CTxLockCandidate& txLockCandidate, CConnman& connman)
     }
 }
 
+void CInstantSend::SetCandidateConfirmedHeight(const uint256& txHash, CTxLockCandidate& txLockCandidate, int nHeight)
+{
+    AssertLockHeld(cs_instantsend);
+
+    txLockCandidate.SetConfirmedHeight(nHeight);
+    if(nHeight != -1) mapCandidatesByHeight[nHeight].push_back(txHash);
+}
+
+void CInstantSend::SetVoteConfirmedHeight(const uint256& voteHash, CTxLockVote& vote, int nHeight)
+{
+    AssertLockHeld(cs_instantsend);
+
+    vote.SetConfirmedHeight(nHeight);
+    if(nHeight != -1) mapVotesByHeight[nHeight].push_back(voteHash);
+}
+
 void CInstantSend::CreateIndex(const CTxLockCandidate &txLockCandidate)
 {
+    // Only FinalizeIndex and CheckAndRemove clean up the entries, both just with the index
+    if( !fInstantPayIndex ) return;
+
     CInstantPayIndexKey key(txLockCandidate.GetCreationTime(), txLockCandidate.GetHash());
 
     if( !mapLockIndex.count(key) ){
@@ -356,15 +644,24 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
     // Smartnodes will sometimes propagate votes before the transaction is known to the client,
     // will actually process only after the lock request itself has arrived
 
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    CTxLockCandidateMap::iterator it = mapTxLockCandidates.find(txHash);
     if(it == mapTxLockCandidates.end() || !it->second.txLockRequest) {
 
+        bool fInserted = false;
+        if(!mapTxLockVotesOrphan.count(voteHash)) {
+            if(!AddOrphanTxLockVote(voteHash, vote)) {
+                LogPrint("instantsend", "CInstantSend::%s -- Too many orphan votes, dropping: txid=%s  smartnode=%s\n",
+                        __func__, txHash.ToString(), vote.GetSmartnodeOutpoint().ToStringShort());
+                return false;
+            }
+            fInserted = true;
+        }
+
         if(it == mapTxLockCandidates.end()) {
             // start timeout countdown after the very first vote
             CreateEmptyTxLockCandidate(txHash);
         }
 
-        bool fInserted = mapTxLockVotesOrphan.emplace(voteHash, vote).second;
                 LogPrint("instantsend", "CInstantSend::%s -- Orphan vote: txid=%s  masternode=%s %s\n",
                         __func__, txHash.ToString(), vote.GetSmartnodeOutpoint().ToStringShort(), fInserted ? "new" : "seen");
 
@@ -375,6 +672,7 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
         auto itMnOV = mapSmartnodeOrphanVotes.find(vote.GetSmartnodeOutpoint());
         if(itMnOV == mapSmartnodeOrphanVotes.end()) {
             mapSmartnodeOrphanVotes.emplace(vote.GetSmartnodeOutpoint(), nSmartnodeOrphanExpireTime);
+            nSmartnodeOrphanVoteTimeTotal += nSmartnodeOrphanExpireTime;
         } else {
             if(itMnOV->second > GetTime() && itMnOV->second > GetAverageSmartnodeOrphanVoteTime()) {
                 LogPrint("instantsend", "CInstantSend::%s -- masternode is spamming orphan Transaction Lock Votes: txid=%s  masternode=%s\n",
@@ -383,6 +681,7 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
                 return false;
             }
             // not spamming, refresh
+            nSmartnodeOrphanVoteTimeTotal += nSmartnodeOrphanExpireTime - itMnOV->second;
             itMnOV->second = nSmartnodeOrphanExpireTime;
         }
 
@@ -406,6 +705,8 @@ bool CInstantSend::ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman&
         return false;
     }
 
+    UpdateVoteStats(txLockCandidate);
+
     int nSignatures = txLockCandidate.CountVotes();
     int nSignaturesMax = txLockCandidate.txLockRequest.GetMaxSignatures();
     LogPrint("instantsend", "CInstantSend::ProcessTxLockVote -- Transaction Lock signatures count: %d/%d, vote hash=%s\n",
@@ -429,7 +730,7 @@ bool CInstantSend::ProcessOrphanTxLockVote(const CTxLockVote& vote)
     uint256 txHash = vote.GetTxHash();
 
     // We shouldn't process orphan votes without a valid tx lock candidate
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    CTxLockCandidateMap::iterator it = mapTxLockCandidates.find(txHash);
     if(it == mapTxLockCandidates.end() || !it->second.txLockRequest)
         return false; // this shouldn never happen
 
@@ -449,6 +750,8 @@ bool CInstantSend::ProcessOrphanTxLockVote(const CTxLockVote& vote)
         return false;
     }
 
+    UpdateVoteStats(txLockCandidate);
+
     int nSignatures = txLockCandidate.CountVotes();
     int nSignaturesMax = txLockCandidate.txLockRequest.GetMaxSignatures();
     LogPrint("instantsend", "CInstantSend::%s -- Transaction Lock signatures count: %d/%d, vote hash=%s\n",
@@ -463,14 +766,14 @@ void CInstantSend::UpdateVotedOutpoints(const CTxLockVote& vote, CTxLockCandidat
 
     uint256 txHash = vote.GetTxHash();
 
-    std::map<COutPoint, std::set<uint256> >::iterator it1 = mapVotedOutpoints.find(vote.GetOutpoint());
+    CVotedOutpointMap::iterator it1 = mapVotedOutpoints.find(vote.GetOutpoint());
     if(it1 != mapVotedOutpoints.end()) {
         for (const auto& hash : it1->second) {
             if(hash != txHash) {
                 // same outpoint was already voted to be locked by another tx lock request,
                 // let's see if it was the same masternode who voted on this outpoint
                 // for another tx lock request
-                std::map<uint256, CTxLockCandidate>::iterator it2 = mapTxLockCandidates.find(hash);
+                CTxLockCandidateMap::iterator it2 = mapTxLockCandidates.find(hash);
                 if(it2 !=mapTxLockCandidates.end() && it2->second.HasSmartnodeVoted(vote.GetOutpoint(), vote.GetSmartnodeOutpoint())) {
                     // yes, it was the same masternode
                     LogPrintf("CInstantSend::%s -- smartnode sent conflicting votes! %s\n", __func__, vote.GetSmartnodeOutpoint().ToStringShort());
@@ -494,17 +797,67 @@ void CInstantSend::UpdateVotedOutpoints(const CTxLockVote& vote, CTxLockCandidat
     }
 }
 
-void CInstantSend::ProcessOrphanTxLockVotes()
+void CInstantSend::UpdateVoteStats(CTxLockCandidate& txLockCandidate)
+{
+    AssertLockHeld(cs_instantsend);
+
+    // Orphan votes get added once the request arrived, they count as zero
+    stats.AddVote(GetTimeMillis() - txLockCandidate.GetRequestTimeMillis(), !txLockCandidate.fFirstVoteSeen);
+    txLockCandidate.fFirstVoteSeen = true;
+}
+
+bool CInstantSend::AddOrphanTxLockVote(const uint256& voteHash, const CTxLockVote& vote)
+{
+    AssertLockHeld(cs_instantsend);
+
+    if(mapTxLockVotesOrphan.size() >= INSTANTSEND_MAX_ORPHAN_VOTES) return false;
+
+    int& nSmartnodeVotes = mapSmartnodeOrphanVoteCount[vote.GetSmartnodeOutpoint()];
+    if(nSmartnodeVotes >= INSTANTSEND_MAX_ORPHAN_VOTES_PER_SMARTNODE) return false;
+
+    if(!mapTxLockVotesOrphan.emplace(voteHash, vote).second) return false;
+
+    ++nSmartnodeVotes;
+    mapTxLockVotesOrphanByTx[vote.GetTxHash()].push_back(voteHash);
+
+    return true;
+}
+
+CTxLockVoteMap::iterator CInstantSend::EraseOrphanTxLockVote(CTxLockVoteMap::iterator it)
+{
+    AssertLockHeld(cs_instantsend);
+
+    const CTxLockVote& vote = it->second;
+
+    auto itCount = mapSmartnodeOrphanVoteCount.find(vote.GetSmartnodeOutpoint());
+    if(itCount != mapSmartnodeOrphanVoteCount.end() && --itCount->second <= 0) {
+        mapSmartnodeOrphanVoteCount.erase(itCount);
+    }
+
+    auto itByTx = mapTxLockVotesOrphanByTx.find(vote.GetTxHash());
+    if(itByTx != mapTxLockVotesOrphanByTx.end()) {
+        std::vector<uint256>& vecVotes = itByTx->second;
+        vecVotes.erase(std::remove(vecVotes.begin(), vecVotes.end(), it->first), vecVotes.end());
+        if(vecVotes.empty()) mapTxLockVotesOrphanByTx.erase(itByTx);
+    }
+
+    return mapTxLockVotesOrphan.erase(it);
+}
+
+void CInstantSend::ProcessOrphanTxLockVotes(const uint256& txHash)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(cs_instantsend);
 
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotesOrphan.begin();
-    while(it != mapTxLockVotesOrphan.end()) {
-        if(ProcessOrphanTxLockVote(it->second)) {
-            mapTxLockVotesOrphan.erase(it++);
-        } else {
-            ++it;
+    auto itByTx = mapTxLockVotesOrphanByTx.find(txHash);
+    if(itByTx == mapTxLockVotesOrphanByTx.end()) return;
+
+    // EraseOrphanTxLockVote modifies the list
+    std::vector<uint256> vecVotes = itByTx->second;
+    for(const uint256& voteHash : vecVotes) {
+        CTxLockVoteMap::iterator it = mapTxLockVotesOrphan.find(voteHash);
+        if(it != mapTxLockVotesOrphan.end() && ProcessOrphanTxLockVote(it->second)) {
+            EraseOrphanTxLockVote(it);
         }
     }
 }
@@ -519,11 +872,15 @@ void CInstantSend::TryToFinalizeLockCandidate(const CTxLockCandidate& txLockCand
     uint256 txHash = txLockCandidate.txLockRequest.GetHash();
     if(txLockCandidate.IsAllOutPointsReady() && !IsLockedInstantSendTransaction(txHash)) {
         // we have enough votes now
-        LogPrint("instantsend", "CInstantSend::TryToFinalizeLockCandidate -- Transaction Lock is ready to complete, txid=%s\n", txHash.ToString());
+        LogPrint("instantsend", "CInstantSend::TryToFinalizeLockCandidate -- Transaction Lock is ready to complete after %dms, txid=%s\n",
+                GetTimeMillis() - txLockCandidate.GetCreationTimeMillis(), txHash.ToString());
         if(ResolveConflicts(txLockCandidate)) {
+            stats.AddLock(GetTimeMillis() - txLockCandidate.GetRequestTimeMillis());
             FinalizeIndex(txLockCandidate, true);
             LockTransactionInputs(txLockCandidate);
             UpdateLockedTransaction(txLockCandidate);
+            // txid, votes, milliseconds since the candidate was created
+            TRACE3(instantsend, tx_locked, txHash.begin(), txLockCandidate.CountVotes(), GetTimeMillis() - txLockCandidate.GetCreationTimeMillis());
         }
     }
 }
@@ -582,7 +939,7 @@ void CInstantSend::LockTransactionInputs(const CTxLockCandidate& txLockCandidate
 bool CInstantSend::GetLockedOutPointTxHash(const COutPoint& outpoint, uint256& hashRet)
 {
     LOCK(cs_instantsend);
-    std::map<COutPoint, uint256>::iterator it = mapLockedOutpoints.find(outpoint);
+    CLockedOutpointMap::iterator it = mapLockedOutpoints.find(outpoint);
     if(it == mapLockedOutpoints.end()) return false;
     hashRet = it->second;
     return true;
@@ -605,8 +962,8 @@ bool CInstantSend::ResolveConflicts(const CTxLockCandidate& txLockCandidate)
         if(GetLockedOutPointTxHash(txin.prevout, hashConflicting) && txHash != hashConflicting) {
             // completed lock which conflicts with another completed one?
             // this means that majority of MNs in the quorum for this specific tx input are malicious!
-            std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
-            std::map<uint256, CTxLockCandidate>::iterator itLockCandidateConflicting = mapTxLockCandidates.find(hashConflicting);
+            CTxLockCandidateMap::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+            CTxLockCandidateMap::iterator itLockCandidateConflicting = mapTxLockCandidates.find(hashConflicting);
             if(itLockCandidate == mapTxLockCandidates.end() || itLockCandidateConflicting == mapTxLockCandidates.end()) {
                 // safety check, should never really happen
                 LogPrintf("CInstantSend::ResolveConflicts -- ERROR: Found conflicting completed Transaction Lock, but one of txLockCandidate-s is missing, txid=%s, conflicting txid=%s\n",
@@ -617,12 +974,14 @@ bool CInstantSend::ResolveConflicts(const CTxLockCandidate& txLockCandidate)
                     txHash.ToString(), hashConflicting.ToString());
             CTxLockRequest txLockRequest = itLockCandidate->second.txLockRequest;
             CTxLockRequest txLockRequestConflicting = itLockCandidateConflicting->second.txLockRequest;
-            itLockCandidate->second.SetConfirmedHeight(0); // expired
-            itLockCandidateConflicting->second.SetConfirmedHeight(0); // expired
+            SetCandidateConfirmedHeight(txHash, itLockCandidate->second, 0); // expired
+            SetCandidateConfirmedHeight(hashConflicting, itLockCandidateConflicting->second, 0); // expired
             CheckAndRemove(); // clean up
             // AlreadyHave should still return "true" for both of them
             mapLockRequestRejected.insert(make_pair(txHash, txLockRequest));
             mapLockRequestRejected.insert(make_pair(hashConflicting, txLockRequestConflicting));
+            seenLockRequests.insert(txHash);
+            seenLockRequests.insert(hashConflicting);
 
             // TODO: clean up mapLockRequestRejected later somehow
             //       (not a big issue since we already PoSe ban malicious smartnodes
@@ -650,6 +1009,11 @@ bool CInstantSend::ResolveConflicts(const CTxLockCandidate& txLockCandidate)
         LogPrint("instantsend", "CInstantSend::ResolveConflicts -- Done, %s is included in block %s\n", txHash.ToString(), hashBlock.ToString());
         return true;
     }
+    // The txindex has it in a block which got pruned already
+    if(IsTransactionPruned(txHash)) {
+        LogPrint("instantsend", "CInstantSend::ResolveConflicts -- Done, %s is included in a pruned block\n", txHash.ToString());
+        return true;
+    }
     // Not in block yet, make sure all its inputs are still unspent
     BOOST_FOREACH(const CTxIn& txin, txLockCandidate.txLockRequest.vin) {
         Coin coin;
@@ -670,15 +1034,7 @@ int64_t CInstantSend::GetAverageSmartnodeOrphanVoteTime()
     // NOTE: should never actually call this function when mapSmartnodeOrphanVotes is empty
     if(mapSmartnodeOrphanVotes.empty()) return 0;
 
-    std::map<COutPoint, int64_t>::iterator it = mapSmartnodeOrphanVotes.begin();
-    int64_t total = 0;
-
-    while(it != mapSmartnodeOrphanVotes.end()) {
-        total+= it->second;
-        ++it;
-    }
-
-    return total / mapSmartnodeOrphanVotes.size();
+    return nSmartnodeOrphanVoteTimeTotal / (int64_t)mapSmartnodeOrphanVotes.size();
 }
 
 void CInstantSend::CheckAndRemove()
@@ -687,8 +1043,31 @@ void CInstantSend::CheckAndRemove()
 
     LOCK(cs_instantsend);
 
+    // count the lock requests which timed out without a lock
+    for(auto& lockCandidate : mapTxLockCandidates) {
+        CTxLockCandidate &txLockCandidate = lockCandidate.second;
+
+        if(!txLockCandidate.txLockRequest || txLockCandidate.fStatsFinished || !txLockCandidate.IsTimedOut()) continue;
+
+        txLockCandidate.fStatsFinished = true;
+
+        // same as IsLockedInstantSendTransaction, without the spork and fork checks
+        bool fLocked = !txLockCandidate.mapOutPointLocks.empty();
+        for(const auto& outpointLock : txLockCandidate.mapOutPointLocks) {
+            auto itLocked = mapLockedOutpoints.find(outpointLock.first);
+            if(itLocked == mapLockedOutpoints.end() || itLocked->second != txLockCandidate.GetHash()) {
+                fLocked = false;
+                break;
+            }
+        }
+
+        if(!fLocked) {
+            stats.AddFailed();
+        }
+    }
+
     if( fInstantPayIndex ){
-        std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.begin();
+        CTxLockCandidateMap::iterator itLockCandidate = mapTxLockCandidates.begin();
         // update index entries
         while(itLockCandidate != mapTxLockCandidates.end()) {
             CTxLockCandidate &txLockCandidate = itLockCandidate->second;
@@ -710,18 +1089,33 @@ void CInstantSend::CheckAndRemove()
             ++itLockCandidate;
         }
 
-        if( !pblocktree->WriteInstantPayLocks(mapLockIndex) ){
+        std::vector<std::pair<CInstantPayIndexKey, CInstantPayValue> > vecWrite;
+
+        for( auto& lock : mapLockIndex ){
+            if( lock.second.fProcessed && !lock.second.fWritten ){
+                lock.second.fWritten = true;
+                vecWrite.push_back(lock);
+            }
+        }
+
+        if( !vecWrite.empty() && !indexWriter.Queue(vecWrite) &&
+            !pblocktree->WriteInstantPayLocks(vecWrite, INSTANTPAY_INDEX_BATCH_SIZE) ){
             LogPrintf("CInstantSend::CheckAndRemove() - Failed to write instantpay index\n");
         }
     }
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.begin();
+    // Candidates and votes confirmed below this height only can be expired
+    int nExpiredBelow = nCachedBlockHeight - Params().GetConsensus().nInstantSendKeepLock;
+
     // remove expired candidates
-    while(itLockCandidate != mapTxLockCandidates.end()) {
-        CTxLockCandidate &txLockCandidate = itLockCandidate->second;
-        uint256 txHash = txLockCandidate.GetHash();
+    while(!mapCandidatesByHeight.empty() && mapCandidatesByHeight.begin()->first < nExpiredBelow) {
+        for(const uint256& txHashExpired : mapCandidatesByHeight.begin()->second) {
+            CTxLockCandidateMap::iterator itLockCandidate = mapTxLockCandidates.find(txHashExpired);
+            // gone already or confirmed at another height meanwhile
+            if(itLockCandidate == mapTxLockCandidates.end() || !itLockCandidate->second.IsExpired(nCachedBlockHeight)) continue;
 
-        if(txLockCandidate.IsExpired(nCachedBlockHeight)) {
+            CTxLockCandidate &txLockCandidate = itLockCandidate->second;
+            uint256 txHash = txLockCandidate.GetHash();
 
             if( fInstantPayIndex ){
                 CInstantPayIndexKey key(txLockCandidate.GetCreationTime(), txLockCandidate.GetHash());
@@ -737,39 +1131,39 @@ void CInstantSend::CheckAndRemove()
             }
             mapLockRequestAccepted.erase(txHash);
             mapLockRequestRejected.erase(txHash);
-            mapTxLockCandidates.erase(itLockCandidate++);
-        } else {
-            ++itLockCandidate;
+            mapTxLockCandidates.erase(itLockCandidate);
         }
+        mapCandidatesByHeight.erase(mapCandidatesByHeight.begin());
     }
 
     // remove expired votes
-    std::map<uint256, CTxLockVote>::iterator itVote = mapTxLockVotes.begin();
-    while(itVote != mapTxLockVotes.end()) {
-        if(itVote->second.IsExpired(nCachedBlockHeight)) {
+    while(!mapVotesByHeight.empty() && mapVotesByHeight.begin()->first < nExpiredBelow) {
+        for(const uint256& voteHash : mapVotesByHeight.begin()->second) {
+            CTxLockVoteMap::iterator itVote = mapTxLockVotes.find(voteHash);
+            if(itVote == mapTxLockVotes.end() || !itVote->second.IsExpired(nCachedBlockHeight)) continue;
+
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing expired vote: txid=%s  smartnode=%s\n",
                     itVote->second.GetTxHash().ToString(), itVote->second.GetSmartnodeOutpoint().ToStringShort());
-            mapTxLockVotes.erase(itVote++);
-        } else {
-            ++itVote;
+            mapTxLockVotes.erase(itVote);
         }
+        mapVotesByHeight.erase(mapVotesByHeight.begin());
     }
 
     // remove timed out orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
+    CTxLockVoteMap::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
     while(itOrphanVote != mapTxLockVotesOrphan.end()) {
         if(itOrphanVote->second.IsTimedOut()) {
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing timed out orphan vote: txid=%s  smartnode=%s\n",
                     itOrphanVote->second.GetTxHash().ToString(), itOrphanVote->second.GetSmartnodeOutpoint().ToStringShort());
             mapTxLockVotes.erase(itOrphanVote->first);
-            mapTxLockVotesOrphan.erase(itOrphanVote++);
+            itOrphanVote = EraseOrphanTxLockVote(itOrphanVote);
         } else {
             ++itOrphanVote;
         }
     }
 
     // remove invalid votes and votes for failed lock attempts
-    itVote = mapTxLockVotes.begin();
+    CTxLockVoteMap::iterator itVote = mapTxLockVotes.begin();
     while(itVote != mapTxLockVotes.end()) {
         if(itVote->second.IsFailed()) {
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing vote for failed lock attempt: txid=%s  smartnode=%s\n",
@@ -786,6 +1180,7 @@ void CInstantSend::CheckAndRemove()
         if(itSmartnodeOrphan->second < GetTime()) {
             LogPrint("instantsend", "CInstantSend::CheckAndRemove -- Removing timed out orphan smartnode vote: smartnode=%s\n",
                     itSmartnodeOrphan->first.ToStringShort());
+            nSmartnodeOrphanVoteTimeTotal -= itSmartnodeOrphan->second;
             mapSmartnodeOrphanVotes.erase(itSmartnodeOrphan++);
         } else {
             ++itSmartnodeOrphan;
@@ -794,8 +1189,11 @@ void CInstantSend::CheckAndRemove()
     LogPrintf("CInstantSend::CheckAndRemove -- %s\n", ToString());
 }
 
-bool CInstantSend::AlreadyHave(const uint256& hash)
+bool CInstantSend::AlreadyHave(const uint256& hash, int nType)
 {
+    if(nType == MSG_TXLOCK_REQUEST ? seenLockRequests.contains(hash) : seenLockVotes.contains(hash))
+        return true;
+
     LOCK(cs_instantsend);
     return mapLockRequestAccepted.count(hash) ||
             mapLockRequestRejected.count(hash) ||
@@ -806,12 +1204,14 @@ void CInstantSend::AcceptLockRequest(const CTxLockRequest& txLockRequest)
 {
     LOCK(cs_instantsend);
     mapLockRequestAccepted.insert(make_pair(txLockRequest.GetHash(), txLockRequest));
+    seenLockRequests.insert(txLockRequest.GetHash());
 }
 
 void CInstantSend::RejectLockRequest(const CTxLockRequest& txLockRequest)
 {
     LOCK(cs_instantsend);
     mapLockRequestRejected.insert(make_pair(txLockRequest.GetHash(), txLockRequest));
+    seenLockRequests.insert(txLockRequest.GetHash());
 }
 
 bool CInstantSend::HasTxLockRequest(const uint256& txHash)
@@ -824,18 +1224,65 @@ bool CInstantSend::GetTxLockRequest(const uint256& txHash, CTxLockRequest& txLoc
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    CTxLockCandidateMap::iterator it = mapTxLockCandidates.find(txHash);
     if(it == mapTxLockCandidates.end()) return false;
     txLockRequestRet = it->second.txLockRequest;
 
     return true;
 }
 
+void CInstantSend::GetTxLockRequestTxes(std::vector<CTransaction>& vtxRet)
+{
+    LOCK(cs_instantsend);
+
+    vtxRet.clear();
+    vtxRet.reserve(mapTxLockCandidates.size());
+    for (const auto& pair : mapTxLockCandidates) {
+        if (pair.second.txLockRequest)
+            vtxRet.push_back(pair.second.txLockRequest);
+    }
+}
+
+void CInstantSend::GetTxLockCandidatesToStore(std::vector<uint256>& vTxHashesRet, std::vector<CTxLockVote>& vVotesRet)
+{
+    LOCK(cs_instantsend);
+
+    vTxHashesRet.clear();
+    vVotesRet.clear();
+    for (const auto& pair : mapTxLockCandidates) {
+        if (pair.second.txLockRequest)
+            vTxHashesRet.push_back(pair.first);
+    }
+    for (const auto& pair : mapTxLockVotes) {
+        CTxLockCandidateMap::const_iterator it = mapTxLockCandidates.find(pair.second.GetTxHash());
+        if (it != mapTxLockCandidates.end() && it->second.txLockRequest)
+            vVotesRet.push_back(pair.second);
+    }
+}
+
+void CInstantSend::ProcessStoredTxLockVotes(const std::vector<CTxLockVote>& vVotes, CConnman& connman)
+{
+    for (const CTxLockVote& voteIn : vVotes) {
+        CTxLockVote vote(voteIn);
+        uint256 nVoteHash = vote.GetHash();
+
+        {
+            LOCK(cs_instantsend);
+            auto ret = mapTxLockVotes.emplace(nVoteHash, vote);
+            if (!ret.second) continue;
+        }
+        seenLockVotes.insert(nVoteHash);
+
+        if(!voteVerifier.Queue(NULL, vote))
+            ProcessTxLockVote(NULL, vote, connman);
+    }
+}
+
 bool CInstantSend::GetTxLockVote(const uint256& hash, CTxLockVote& txLockVoteRet)
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockVote>::iterator it = mapTxLockVotes.find(hash);
+    CTxLockVoteMap::iterator it = mapTxLockVotes.find(hash);
     if(it == mapTxLockVotes.end()) return false;
     txLockVoteRet = it->second;
 
@@ -850,7 +1297,7 @@ bool CInstantSend::IsInstantSendReadyToLock(const uint256& txHash)
     LOCK(cs_instantsend);
     // There must be a successfully verified lock request
     // and all outputs must be locked (i.e. have enough signatures)
-    std::map<uint256, CTxLockCandidate>::iterator it = mapTxLockCandidates.find(txHash);
+    CTxLockCandidateMap::iterator it = mapTxLockCandidates.find(txHash);
     return it != mapTxLockCandidates.end() && it->second.IsAllOutPointsReady();
 }
 
@@ -862,7 +1309,7 @@ bool CInstantSend::IsLockedInstantSendTransaction(const uint256& txHash)
     LOCK(cs_instantsend);
 
     // there must be a lock candidate
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    CTxLockCandidateMap::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate == mapTxLockCandidates.end()) return false;
 
     // which should have outpoints
@@ -887,7 +1334,7 @@ int CInstantSend::GetTransactionLockSignatures(const uint256& txHash)
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    CTxLockCandidateMap::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate != mapTxLockCandidates.end()) {
         return itLockCandidate->second.CountVotes();
     }
@@ -906,7 +1353,7 @@ bool CInstantSend::IsTxLockCandidateTimedOut(const uint256& txHash)
 
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    CTxLockCandidateMap::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if (itLockCandidate != mapTxLockCandidates.end()) {
         return !itLockCandidate->second.IsAllOutPointsReady() &&
                 itLockCandidate->second.IsTimedOut();
@@ -919,7 +1366,7 @@ void CInstantSend::Relay(const uint256& txHash, CConnman& connman)
 {
     LOCK(cs_instantsend);
 
-    std::map<uint256, CTxLockCandidate>::const_iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    CTxLockCandidateMap::const_iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if (itLockCandidate != mapTxLockCandidates.end()) {
         itLockCandidate->second.Relay(connman);
     }
@@ -958,25 +1405,25 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d\n", txHash.ToString(), nHeightNew);
 
     // Check lock candidates
-    std::map<uint256, CTxLockCandidate>::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
+    CTxLockCandidateMap::iterator itLockCandidate = mapTxLockCandidates.find(txHash);
     if(itLockCandidate != mapTxLockCandidates.end()) {
         LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d lock candidate updated\n",
                 txHash.ToString(), nHeightNew);
-        itLockCandidate->second.SetConfirmedHeight(nHeightNew);
+        SetCandidateConfirmedHeight(txHash, itLockCandidate->second, nHeightNew);
         // Loop through outpoint locks
         std::map<COutPoint, COutPointLock>::iterator itOutpointLock = itLockCandidate->second.mapOutPointLocks.begin();
         while(itOutpointLock != itLockCandidate->second.mapOutPointLocks.end()) {
             // Check corresponding lock votes
             std::vector<CTxLockVote> vVotes = itOutpointLock->second.GetVotes();
             std::vector<CTxLockVote>::iterator itVote = vVotes.begin();
-            std::map<uint256, CTxLockVote>::iterator it;
+            CTxLockVoteMap::iterator it;
             while(itVote != vVotes.end()) {
                 uint256 nVoteHash = itVote->GetHash();
                 LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d vote %s updated\n",
                         txHash.ToString(), nHeightNew, nVoteHash.ToString());
                 it = mapTxLockVotes.find(nVoteHash);
                 if(it != mapTxLockVotes.end()) {
-                    it->second.SetConfirmedHeight(nHeightNew);
+                    SetVoteConfirmedHeight(nVoteHash, it->second, nHeightNew);
                 }
                 ++itVote;
             }
@@ -985,21 +1432,74 @@ void CInstantSend::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     }
 
     // check orphan votes
-    std::map<uint256, CTxLockVote>::iterator itOrphanVote = mapTxLockVotesOrphan.begin();
-    while(itOrphanVote != mapTxLockVotesOrphan.end()) {
-        if(itOrphanVote->second.GetTxHash() == txHash) {
+    auto itOrphanVotes = mapTxLockVotesOrphanByTx.find(txHash);
+    if(itOrphanVotes != mapTxLockVotesOrphanByTx.end()) {
+        for(const uint256& voteHash : itOrphanVotes->second) {
             LogPrint("instantsend", "CInstantSend::SyncTransaction -- txid=%s nHeightNew=%d vote %s updated\n",
-                    txHash.ToString(), nHeightNew, itOrphanVote->first.ToString());
-            mapTxLockVotes[itOrphanVote->first].SetConfirmedHeight(nHeightNew);
+                    txHash.ToString(), nHeightNew, voteHash.ToString());
+            SetVoteConfirmedHeight(voteHash, mapTxLockVotes[voteHash], nHeightNew);
         }
-        ++itOrphanVote;
     }
 }
 
 std::string CInstantSend::ToString()
 {
     LOCK(cs_instantsend);
-    return strprintf("Lock Candidates: %llu, Votes %llu", mapTxLockCandidates.size(), mapTxLockVotes.size());
+    return strprintf("Lock Candidates: %llu, Votes %llu, %s, %s", mapTxLockCandidates.size(), mapTxLockVotes.size(),
+                     voteVerifier.ToString(), indexWriter.ToString());
+}
+
+void CInstantSend::GetMemoryUsage(memusage::ComponentUsage& usage)
+{
+    LOCK(cs_instantsend);
+
+    size_t nLockRequests = memusage::DynamicUsage(mapLockRequestAccepted) + memusage::DynamicUsage(mapLockRequestRejected);
+    for (const auto& request : mapLockRequestAccepted) {
+        nLockRequests += RecursiveDynamicUsage(request.second);
+    }
+    for (const auto& request : mapLockRequestRejected) {
+        nLockRequests += RecursiveDynamicUsage(request.second);
+    }
+    usage.emplace_back("lock_requests", nLockRequests);
+
+    size_t nCandidates = memusage::DynamicUsage(mapTxLockCandidates);
+    for (const auto& candidate : mapTxLockCandidates) {
+        nCandidates += candidate.second.DynamicMemoryUsage();
+    }
+    usage.emplace_back("lock_candidates", nCandidates);
+
+    size_t nVotes = memusage::DynamicUsage(mapTxLockVotes);
+    for (const auto& vote : mapTxLockVotes) {
+        nVotes += vote.second.DynamicMemoryUsage();
+    }
+    usage.emplace_back("votes", nVotes);
+
+    size_t nOrphanVotes = memusage::DynamicUsage(mapTxLockVotesOrphan) + memusage::DynamicUsage(mapTxLockVotesOrphanByTx) +
+                          memusage::DynamicUsage(mapSmartnodeOrphanVoteCount) + memusage::DynamicUsage(mapSmartnodeOrphanVotes);
+    for (const auto& vote : mapTxLockVotesOrphan) {
+        nOrphanVotes += vote.second.DynamicMemoryUsage();
+    }
+    for (const auto& votes : mapTxLockVotesOrphanByTx) {
+        nOrphanVotes += memusage::DynamicUsage(votes.second);
+    }
+    usage.emplace_back("orphan_votes", nOrphanVotes);
+
+    size_t nOutpoints = memusage::DynamicUsage(mapVotedOutpoints) + memusage::DynamicUsage(mapLockedOutpoints);
+    for (const auto& voted : mapVotedOutpoints) {
+        nOutpoints += memusage::DynamicUsage(voted.second);
+    }
+    usage.emplace_back("outpoints", nOutpoints);
+
+    size_t nByHeight = memusage::DynamicUsage(mapCandidatesByHeight) + memusage::DynamicUsage(mapVotesByHeight);
+    for (const auto& height : mapCandidatesByHeight) {
+        nByHeight += memusage::DynamicUsage(height.second);
+    }
+    for (const auto& height : mapVotesByHeight) {
+        nByHeight += memusage::DynamicUsage(height.second);
+    }
+    usage.emplace_back("expiry_index", nByHeight);
+
+    usage.emplace_back("lock_index", memusage::DynamicUsage(mapLockIndex));
 }
 
 //
@@ -1134,7 +1634,7 @@ bool CTxLockVote::CheckSignature() const
         return false;
     }
 
-    if(!CMessageSigner::VerifyMessage(infoMn.pubKeySmartnode, vchSmartnodeSignature, strMessage, strError)) {
+    if(!VerifyTxLockVoteMessage(infoMn.pubKeySmartnode, vchSmartnodeSignature, strMessage, strError)) {
         LogPrintf("CTxLockVote::CheckSignature -- VerifyMessage() failed, error: %s\n", strError);
         return false;
     }
@@ -1142,6 +1642,16 @@ bool CTxLockVote::CheckSignature() const
     return true;
 }
 
+void CTxLockVote::PreVerifySignature() const
+{
+    std::string strError;
+    smartnode_info_t infoMn;
+
+    // failures get logged by CheckSignature
+    if(mnodeman.GetSmartnodeInfo(outpointSmartnode, infoMn))
+        VerifyTxLockVoteMessage(infoMn.pubKeySmartnode, vchSmartnodeSignature, txHash.ToString() + outpoint.ToStringShort(), strError);
+}
+
 bool CTxLockVote::Sign()
 {
     std::string strError;
@@ -1219,6 +1729,15 @@ void COutPointLock::Relay(CConnman& connman) const
     }
 }
 
+size_t COutPointLock::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(mapSmartnodeVotes);
+    for (const auto& vote : mapSmartnodeVotes) {
+        nUsage += vote.second.DynamicMemoryUsage();
+    }
+    return nUsage;
+}
+
 //
 // CTxLockCandidate
 //
@@ -1272,6 +1791,15 @@ int CTxLockCandidate::CountVotes() const
     return nCountVotes;
 }
 
+size_t CTxLockCandidate::DynamicMemoryUsage() const
+{
+    size_t nUsage = RecursiveDynamicUsage(txLockRequest) + memusage::DynamicUsage(mapOutPointLocks);
+    for (const auto& outpointLock : mapOutPointLocks) {
+        nUsage += outpointLock.second.DynamicMemoryUsage();
+    }
+    return nUsage;
+}
+
 bool CTxLockCandidate::IsExpired(int nHeight) const
 {
     // Locks and votes expire nInstantSendKeepLock blocks after the block corresponding tx was included into.
@@ -5,10 +5,16 @@
 #define INSTANTX_H
 
 #include "../net.h"
+#include "../bloom.h"
 #include "../chain.h"
 #include "../utiltime.h"
 #include "primitives/transaction.h"
+#include "smartnode/instantpaystats.h"
 #include "txdb.h"
+#include "txmempool.h"
+
+#include <memory>
+#include <unordered_map>
 
 class CTxLockVote;
 class COutPointLock;
@@ -16,6 +22,11 @@ class CTxLockRequest;
 class CTxLockCandidate;
 class CInstantSend;
 
+namespace boost
+{
+    class thread_group;
+} // namespace boost
+
 extern CInstantSend instantsend;
 
 /*
@@ -41,10 +52,59 @@ static const int INSTANTSEND_LOCK_TIMEOUT_SECONDS   = 15;
 // must be greater than INSTANTSEND_LOCK_TIMEOUT_SECONDS
 static const int INSTANTSEND_FAILED_TIMEOUT_SECONDS = 60;
 
+// Threads which check the signatures of lock votes off the message handler thread
+static const int INSTANTSEND_VOTE_VERIFY_THREADS    = 2;
+// Votes waiting for them at most, further votes get processed right away again
+static const size_t INSTANTSEND_MAX_QUEUED_VOTES    = 10000;
+// Bytes of instantpay index entries the background writer puts into one database batch
+static const size_t INSTANTPAY_INDEX_BATCH_SIZE     = 1 << 20;
+// Votes without a lock request kept at most, in total and per smartnode
+static const size_t INSTANTSEND_MAX_ORPHAN_VOTES    = 10000;
+static const int INSTANTSEND_MAX_ORPHAN_VOTES_PER_SMARTNODE = 100;
+// Recent lock requests and votes remembered by the AlreadyHave prefilters
+static const unsigned int INSTANTSEND_SEEN_REQUESTS_FILTER_SIZE = 10000;
+static const unsigned int INSTANTSEND_SEEN_VOTES_FILTER_SIZE    = 100000;
+
+// Looked up for every mempool accept, block transaction and vote, ordering isn't needed anywhere
+typedef std::unordered_map<uint256, CTxLockCandidate, SaltedTxidHasher> CTxLockCandidateMap; // tx hash - lock candidate
+typedef std::unordered_map<uint256, CTxLockVote, SaltedTxidHasher> CTxLockVoteMap; // vote hash - vote
+typedef std::unordered_map<COutPoint, std::set<uint256>, SaltedOutpointHasher> CVotedOutpointMap; // utxo - tx hash set
+typedef std::unordered_map<COutPoint, uint256, SaltedOutpointHasher> CLockedOutpointMap; // utxo - tx hash
+
 extern bool fEnableInstantSend;
 extern int nInstantSendDepth;
 extern int nCompleteTXLocks;
 
+/**
+ * Hashes of the lock requests or votes stored since the start, with their own
+ * lock. Everything announced again during a burst hits the filter and never
+ * waits for cs_instantsend. A miss says nothing since old generations roll
+ * out, the maps have to be checked then.
+ */
+class CInstantSendSeenFilter
+{
+    mutable CCriticalSection cs;
+    unsigned int nElements;
+    // Created on first use, CRollingBloomFilter needs the randomizer initialized
+    std::unique_ptr<CRollingBloomFilter> filter;
+
+public:
+    explicit CInstantSendSeenFilter(unsigned int nElementsIn) : nElements(nElementsIn) {}
+
+    void insert(const uint256& hash)
+    {
+        LOCK(cs);
+        if(!filter) filter.reset(new CRollingBloomFilter(nElements, 0.000001));
+        filter->insert(hash);
+    }
+
+    bool contains(const uint256& hash) const
+    {
+        LOCK(cs);
+        return filter && filter->contains(hash);
+    }
+};
+
 class CInstantSend
 {
 private:
@@ -54,23 +114,40 @@ private:
     // maps for AlreadyHave
     std::map<uint256, CTxLockRequest> mapLockRequestAccepted; // tx hash - tx
     std::map<uint256, CTxLockRequest> mapLockRequestRejected; // tx hash - tx
-    std::map<uint256, CTxLockVote> mapTxLockVotes; // vote hash - vote
-    std::map<uint256, CTxLockVote> mapTxLockVotesOrphan; // vote hash - vote
+    CTxLockVoteMap mapTxLockVotes;
+    CTxLockVoteMap mapTxLockVotesOrphan;
+    CInstantSendSeenFilter seenLockRequests{INSTANTSEND_SEEN_REQUESTS_FILTER_SIZE};
+    CInstantSendSeenFilter seenLockVotes{INSTANTSEND_SEEN_VOTES_FILTER_SIZE};
+
+    CTxLockCandidateMap mapTxLockCandidates;
 
-    std::map<uint256, CTxLockCandidate> mapTxLockCandidates; // tx hash - lock candidate
+    CVotedOutpointMap mapVotedOutpoints;
+    CLockedOutpointMap mapLockedOutpoints;
 
-    std::map<COutPoint, std::set<uint256> > mapVotedOutpoints; // utxo - tx hash set
-    std::map<COutPoint, uint256> mapLockedOutpoints; // utxo - tx hash
+    // Hashes of the candidates and votes by the height they got confirmed at, CheckAndRemove
+    // only looks at the ones which can be expired. Entries of a changed height stay listed.
+    std::map<int, std::vector<uint256> > mapCandidatesByHeight;
+    std::map<int, std::vector<uint256> > mapVotesByHeight;
+
+    // orphan vote hashes by the tx they vote for and the number of them per smartnode
+    std::unordered_map<uint256, std::vector<uint256>, SaltedTxidHasher> mapTxLockVotesOrphanByTx; // tx hash - vote hashes
+    std::unordered_map<COutPoint, int, SaltedOutpointHasher> mapSmartnodeOrphanVoteCount; // mn outpoint - orphan votes
 
     //track smartnodes who voted with no txreq (for DOS protection)
     std::map<COutPoint, int64_t> mapSmartnodeOrphanVotes; // mn outpoint - time
+    int64_t nSmartnodeOrphanVoteTimeTotal = 0; // sum of the times in mapSmartnodeOrphanVotes
 
     std::map<CInstantPayIndexKey, CInstantPayValue> mapLockIndex;
 
+    CInstantPayStats stats;
+
     bool CreateTxLockCandidate(const CTxLockRequest& txLockRequest);
     void CreateEmptyTxLockCandidate(const uint256& txHash);
     void Vote(CTxLockCandidate& txLockCandidate, CConnman& connman);
 
+    void SetCandidateConfirmedHeight(const uint256& txHash, CTxLockCandidate& txLockCandidate, int nHeight);
+    void SetVoteConfirmedHeight(const uint256& voteHash, CTxLockVote& vote, int nHeight);
+
     void CreateIndex(const CTxLockCandidate& txLockCandidate);
     void FinalizeIndex(const CTxLockCandidate& txLockCandidate, bool fValid);
 
@@ -78,7 +155,10 @@ private:
     bool ProcessTxLockVote(CNode* pfrom, CTxLockVote& vote, CConnman& connman);
     bool ProcessOrphanTxLockVote(const CTxLockVote& vote);
     void UpdateVotedOutpoints(const CTxLockVote& vote, CTxLockCandidate& txLockCandidate);
-    void ProcessOrphanTxLockVotes();
+    void UpdateVoteStats(CTxLockCandidate& txLockCandidate);
+    bool AddOrphanTxLockVote(const uint256& voteHash, const CTxLockVote& vote);
+    CTxLockVoteMap::iterator EraseOrphanTxLockVote(CTxLockVoteMap::iterator it);
+    void ProcessOrphanTxLockVotes(const uint256& txHash);
     int64_t GetAverageSmartnodeOrphanVoteTime();
 
     void TryToFinalizeLockCandidate(const CTxLockCandidate& txLockCandidate);
@@ -89,20 +169,36 @@ private:
 
     bool IsInstantSendReadyToLock(const uint256 &txHash);
 
+    friend class CTxLockVoteVerifier;
+
 public:
     CCriticalSection cs_instantsend;
 
+    /// Start the threads which check the lock vote signatures, votes get processed inline without them
+    void StartVoteVerification(boost::thread_group& threadGroup, CConnman& connman);
+    /// Start the thread which writes the instantpay index, CheckAndRemove writes it inline without it
+    void StartIndexWriter(boost::thread_group& threadGroup);
+    /// Write the index entries the writer thread didn't get to anymore, after it got stopped
+    void FlushIndex();
+
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
 
     bool ProcessTxLockRequest(const CTxLockRequest& txLockRequest, CConnman& connman);
     void Vote(const uint256& txHash, CConnman& connman);
 
-    bool AlreadyHave(const uint256& hash);
+    /// nType is MSG_TXLOCK_REQUEST or MSG_TXLOCK_VOTE
+    bool AlreadyHave(const uint256& hash, int nType);
 
     void AcceptLockRequest(const CTxLockRequest& txLockRequest);
     void RejectLockRequest(const CTxLockRequest& txLockRequest);
     bool HasTxLockRequest(const uint256& txHash);
     bool GetTxLockRequest(const uint256& txHash, CTxLockRequest& txLockRequestRet);
+    /// The transactions of all the lock requests, compact blocks get reconstructed from them besides the mempool
+    void GetTxLockRequestTxes(std::vector<CTransaction>& vtxRet);
+    /// The hashes of the lock requests and the votes for them, mempool.dat keeps them over a restart
+    void GetTxLockCandidatesToStore(std::vector<uint256>& vTxHashesRet, std::vector<CTxLockVote>& vVotesRet);
+    /// Process the votes of mempool.dat again once their lock requests got loaded, on the vote verification threads
+    void ProcessStoredTxLockVotes(const std::vector<CTxLockVote>& vVotes, CConnman& connman);
 
     bool GetTxLockVote(const uint256& hash, CTxLockVote& txLockVoteRet);
 
@@ -123,9 +219,13 @@ public:
     void Relay(const uint256& txHash, CConnman& connman);
 
     void UpdatedBlockTip(const CBlockIndex *pindex);
+
+    CInstantPayStats& GetStats() { return stats; }
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
 
     std::string ToString();
+    /// Heap usage of the lock requests, candidates, votes and their indexes
+    void GetMemoryUsage(memusage::ComponentUsage& usage);
 };
 
 class CTxLockRequest : public CTransaction
@@ -203,8 +303,12 @@ public:
 
     bool Sign();
     bool CheckSignature() const;
+    /// Verify the signature without any of the main locks, CheckSignature finds the result in the cache
+    void PreVerifySignature() const;
 
     void Relay(CConnman& connman) const;
+
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vchSmartnodeSignature); }
 };
 
 class COutPointLock
@@ -233,6 +337,8 @@ public:
     void MarkAsAttacked() { fAttacked = true; }
 
     void Relay(CConnman& connman) const;
+
+    size_t DynamicMemoryUsage() const;
 };
 
 class CTxLockCandidate
@@ -240,20 +346,32 @@ class CTxLockCandidate
 private:
     int nConfirmedHeight; // when corresponding tx is 0-confirmed or conflicted, nConfirmedHeight is -1
     int64_t nTimeCreated;
+    int64_t nTimeCreatedMillis;
+    int64_t nTimeRequestMillis; // 0 until the lock request arrived
 
 public:
     CTxLockCandidate(const CTxLockRequest& txLockRequestIn) :
         nConfirmedHeight(-1),
         nTimeCreated(GetTime()),
+        nTimeCreatedMillis(GetTimeMillis()),
+        nTimeRequestMillis(txLockRequestIn ? nTimeCreatedMillis : 0),
         txLockRequest(txLockRequestIn),
-        mapOutPointLocks()
+        mapOutPointLocks(),
+        fFirstVoteSeen(false),
+        fStatsFinished(false)
         {}
 
     CTxLockRequest txLockRequest;
     std::map<COutPoint, COutPointLock> mapOutPointLocks;
+    // Telemetry state, see CInstantPayStats
+    bool fFirstVoteSeen;
+    bool fStatsFinished;
 
     uint256 GetHash() const { return txLockRequest.GetHash(); }
     int64_t GetCreationTime() const { return nTimeCreated; }
+    int64_t GetCreationTimeMillis() const { return nTimeCreatedMillis; }
+    int64_t GetRequestTimeMillis() const { return nTimeRequestMillis; }
+    void SetRequestTimeMillis(int64_t nTimeRequestMillisIn) { nTimeRequestMillis = nTimeRequestMillisIn; }
 
     void AddOutPointLock(const COutPoint& outpoint);
     void MarkOutpointAsAttacked(const COutPoint& outpoint);
@@ -269,6 +387,8 @@ public:
     bool IsTimedOut() const;
 
     void Relay(CConnman& connman) const;
+
+    size_t DynamicMemoryUsage() const;
 };
 
 #endif
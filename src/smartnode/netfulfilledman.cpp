@@ -3,37 +3,95 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chainparams.h"
+#include "hash.h"
 #include "netfulfilledman.h"
+#include "random.h"
 #include "util.h"
 
+#include <limits>
+
 CNetFulfilledRequestManager netfulfilledman;
 
-void CNetFulfilledRequestManager::AddFulfilledRequest(const CService& addr, const std::string& strRequest)
+CNetFulfilledRequestManager::CAddrHasher::CAddrHasher() :
+    k0(GetRand(std::numeric_limits<uint64_t>::max())),
+    k1(GetRand(std::numeric_limits<uint64_t>::max()))
+{
+}
+
+size_t CNetFulfilledRequestManager::CAddrHasher::operator()(const CNetAddr& addr) const
+{
+    unsigned char vchAddr[16];
+    for (int i = 0; i < 16; ++i) {
+        vchAddr[i] = addr.GetByte(15 - i);
+    }
+    return CSipHasher(k0, k1).Write(vchAddr, sizeof(vchAddr)).Finalize();
+}
+
+std::string CNetFulfilledRequestManager::GetRequestName(NetFulfilledRequest request)
+{
+    switch (request) {
+        case FULFILLED_FULL_SYNC:                       return "full-sync";
+        case FULFILLED_SMARTNODE_LIST_SYNC:             return "smartnode-list-sync";
+        case FULFILLED_SMARTNODE_PAYMENT_SYNC:          return "smartnode-payment-sync";
+        case FULFILLED_VOTING_SYNC:                     return "voting-sync";
+        case FULFILLED_SMARTNODE_PAYMENT_SYNC_REPLY:    return NetMsgType::SMARTNODEPAYMENTSYNC;
+        case FULFILLED_VOTING_SYNC_REPLY:               return NetMsgType::VOTINGSYNC;
+        case FULFILLED_MNVERIFY_REQUEST:                return strprintf("%s-request", NetMsgType::MNVERIFY);
+        case FULFILLED_MNVERIFY_REPLY:                  return strprintf("%s-reply", NetMsgType::MNVERIFY);
+        case FULFILLED_MNVERIFY_DONE:                   return strprintf("%s-done", NetMsgType::MNVERIFY);
+        default:                                        return "unknown";
+    }
+}
+
+void CNetFulfilledRequestManager::Add(const CNetAddr& addr, NetFulfilledRequest request, int64_t nExpire)
+{
+    AssertLockHeld(cs_mapFulfilledRequests);
+
+    Requests& requests = mapFulfilledRequests[addr];
+    if (!requests.vExpires[request]) ++requests.nCount;
+    requests.vExpires[request] = nExpire;
+
+    int64_t nBucket = (nExpire / EXPIRY_BUCKET_SECONDS + 1) * EXPIRY_BUCKET_SECONDS;
+    mapExpiryBuckets[nBucket].push_back(std::make_pair(addr, request));
+}
+
+void CNetFulfilledRequestManager::Erase(fulfilledreqmap_t::iterator it, NetFulfilledRequest request)
+{
+    AssertLockHeld(cs_mapFulfilledRequests);
+
+    if (!it->second.vExpires[request]) return;
+
+    it->second.vExpires[request] = 0;
+    if (--it->second.nCount == 0) {
+        mapFulfilledRequests.erase(it);
+    }
+}
+
+void CNetFulfilledRequestManager::AddFulfilledRequest(const CService& addr, NetFulfilledRequest request)
 {
     LOCK(cs_mapFulfilledRequests);
     CService addrSquashed = Params().AllowMultiplePorts() ? addr : CService(addr, 0);
-    mapFulfilledRequests[addrSquashed][strRequest] = GetTime() + Params().FulfilledRequestExpireTime();
+    Add(addrSquashed, request, GetTime() + Params().FulfilledRequestExpireTime());
 }
 
-bool CNetFulfilledRequestManager::HasFulfilledRequest(const CService& addr, const std::string& strRequest)
+bool CNetFulfilledRequestManager::HasFulfilledRequest(const CService& addr, NetFulfilledRequest request)
 {
     LOCK(cs_mapFulfilledRequests);
     CService addrSquashed = Params().AllowMultiplePorts() ? addr : CService(addr, 0);
     fulfilledreqmap_t::iterator it = mapFulfilledRequests.find(addrSquashed);
 
     return  it != mapFulfilledRequests.end() &&
-            it->second.find(strRequest) != it->second.end() &&
-            it->second[strRequest] > GetTime();
+            it->second.vExpires[request] > GetTime();
 }
 
-void CNetFulfilledRequestManager::RemoveFulfilledRequest(const CService& addr, const std::string& strRequest)
+void CNetFulfilledRequestManager::RemoveFulfilledRequest(const CService& addr, NetFulfilledRequest request)
 {
     LOCK(cs_mapFulfilledRequests);
     CService addrSquashed = Params().AllowMultiplePorts() ? addr : CService(addr, 0);
     fulfilledreqmap_t::iterator it = mapFulfilledRequests.find(addrSquashed);
 
     if (it != mapFulfilledRequests.end()) {
-        it->second.erase(strRequest);
+        Erase(it, request);
     }
 }
 
@@ -42,22 +100,16 @@ void CNetFulfilledRequestManager::CheckAndRemove()
     LOCK(cs_mapFulfilledRequests);
 
     int64_t now = GetTime();
-    fulfilledreqmap_t::iterator it = mapFulfilledRequests.begin();
-
-    while(it != mapFulfilledRequests.end()) {
-        fulfilledreqmapentry_t::iterator it_entry = it->second.begin();
-        while(it_entry != it->second.end()) {
-            if(now > it_entry->second) {
-                it->second.erase(it_entry++);
-            } else {
-                ++it_entry;
-            }
-        }
-        if(it->second.size() == 0) {
-            mapFulfilledRequests.erase(it++);
-        } else {
-            ++it;
+
+    // all expiry times in a bucket are below its key
+    while (!mapExpiryBuckets.empty() && mapExpiryBuckets.begin()->first <= now) {
+        for (const auto& entry : mapExpiryBuckets.begin()->second) {
+            fulfilledreqmap_t::iterator it = mapFulfilledRequests.find(entry.first);
+            // removed or added again meanwhile
+            if (it == mapFulfilledRequests.end() || !it->second.vExpires[entry.second] || now <= it->second.vExpires[entry.second]) continue;
+            Erase(it, entry.second);
         }
+        mapExpiryBuckets.erase(mapExpiryBuckets.begin());
     }
 }
 
@@ -65,6 +117,19 @@ void CNetFulfilledRequestManager::Clear()
 {
     LOCK(cs_mapFulfilledRequests);
     mapFulfilledRequests.clear();
+    mapExpiryBuckets.clear();
+}
+
+void CNetFulfilledRequestManager::GetMemoryUsage(memusage::ComponentUsage& usage)
+{
+    LOCK(cs_mapFulfilledRequests);
+    usage.emplace_back("requests", memusage::DynamicUsage(mapFulfilledRequests));
+
+    size_t nExpiry = memusage::DynamicUsage(mapExpiryBuckets);
+    for (const auto& bucket : mapExpiryBuckets) {
+        nExpiry += memusage::DynamicUsage(bucket.second);
+    }
+    usage.emplace_back("expiry_buckets", nExpiry);
 }
 
 std::string CNetFulfilledRequestManager::ToString() const
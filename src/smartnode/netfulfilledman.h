@@ -5,26 +5,71 @@
 #ifndef NETFULFILLEDMAN_H
 #define NETFULFILLEDMAN_H
 
+#include "../memusage.h"
 #include "../netbase.h"
 #include "../protocol.h"
 #include "../serialize.h"
 #include "../sync.h"
 
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
 // Fulfilled requests are used to prevent nodes from asking for the same data on sync
 // and from being banned for doing so too often.
 class CNetFulfilledRequestManager;
 extern CNetFulfilledRequestManager netfulfilledman;
 
+/** Kinds of requests which get tracked per peer address. */
+enum NetFulfilledRequest {
+    FULFILLED_FULL_SYNC,
+    FULFILLED_SMARTNODE_LIST_SYNC,
+    FULFILLED_SMARTNODE_PAYMENT_SYNC,
+    FULFILLED_VOTING_SYNC,
+    FULFILLED_SMARTNODE_PAYMENT_SYNC_REPLY, // answered a NetMsgType::SMARTNODEPAYMENTSYNC
+    FULFILLED_VOTING_SYNC_REPLY,            // answered a NetMsgType::VOTINGSYNC
+    FULFILLED_MNVERIFY_REQUEST,
+    FULFILLED_MNVERIFY_REPLY,
+    FULFILLED_MNVERIFY_DONE,
+    FULFILLED_REQUEST_COUNT
+};
+
 class CNetFulfilledRequestManager
 {
 private:
-    typedef std::map<std::string, int64_t> fulfilledreqmapentry_t;
-    typedef std::map<CNetAddr, fulfilledreqmapentry_t> fulfilledreqmap_t;
+    // Expiry times get grouped in buckets of this many seconds
+    static const int64_t EXPIRY_BUCKET_SECONDS = 60;
+
+    struct Requests {
+        int64_t vExpires[FULFILLED_REQUEST_COUNT]; // 0 if not fulfilled
+        int nCount;
+        Requests() : nCount(0) { std::fill(vExpires, vExpires + FULFILLED_REQUEST_COUNT, 0); }
+    };
+
+    /** Salted hasher of the peer addresses, peers choose them. */
+    class CAddrHasher
+    {
+        uint64_t k0, k1;
+    public:
+        CAddrHasher();
+        size_t operator()(const CNetAddr& addr) const;
+    };
+
+    typedef std::unordered_map<CNetAddr, Requests, CAddrHasher> fulfilledreqmap_t;
 
     //keep track of what node has/was asked for and when
     fulfilledreqmap_t mapFulfilledRequests;
+    // Requests by the end of the bucket their expiry falls into, CheckAndRemove only
+    // looks at the buckets which are over. Requests added again stay listed here.
+    std::map<int64_t, std::vector<std::pair<CNetAddr, NetFulfilledRequest> > > mapExpiryBuckets;
     CCriticalSection cs_mapFulfilledRequests;
 
+    static std::string GetRequestName(NetFulfilledRequest request);
+
+    void Add(const CNetAddr& addr, NetFulfilledRequest request, int64_t nExpire);
+    void Erase(fulfilledreqmap_t::iterator it, NetFulfilledRequest request);
+
 public:
     CNetFulfilledRequestManager() {}
 
@@ -33,17 +78,37 @@ public:
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         LOCK(cs_mapFulfilledRequests);
-        READWRITE(mapFulfilledRequests);
+        // Serialized like the map by request name it replaced to keep the cache file compatible
+        std::map<CNetAddr, std::map<std::string, int64_t> > mapRequests;
+        if (!ser_action.ForRead()) {
+            for (const auto& entry : mapFulfilledRequests)
+                for (int i = 0; i < FULFILLED_REQUEST_COUNT; ++i)
+                    if (entry.second.vExpires[i])
+                        mapRequests[entry.first][GetRequestName((NetFulfilledRequest)i)] = entry.second.vExpires[i];
+        }
+        READWRITE(mapRequests);
+        if (ser_action.ForRead()) {
+            mapFulfilledRequests.clear();
+            mapExpiryBuckets.clear();
+            for (const auto& entry : mapRequests)
+                for (int i = 0; i < FULFILLED_REQUEST_COUNT; ++i) {
+                    auto it = entry.second.find(GetRequestName((NetFulfilledRequest)i));
+                    if (it != entry.second.end())
+                        Add(entry.first, (NetFulfilledRequest)i, it->second);
+                }
+        }
     }
 
-    void AddFulfilledRequest(const CService& addr, const std::string& strRequest); // expire after 1 hour by default
-    bool HasFulfilledRequest(const CService& addr, const std::string& strRequest);
-    void RemoveFulfilledRequest(const CService& addr, const std::string& strRequest);
+    void AddFulfilledRequest(const CService& addr, NetFulfilledRequest request); // expire after 1 hour by default
+    bool HasFulfilledRequest(const CService& addr, NetFulfilledRequest request);
+    void RemoveFulfilledRequest(const CService& addr, NetFulfilledRequest request);
 
     void CheckAndRemove();
     void Clear();
 
     std::string ToString() const;
+    /// Heap usage of the requests and of their expiry buckets
+    void GetMemoryUsage(memusage::ComponentUsage& usage);
 };
 
 #endif
@@ -7,7 +7,9 @@
 #include "consensus/consensus.h"
 #include "../init.h"
 #include "instantx.h"
+#include "../maintenance.h"
 #include "../messagesigner.h"
+#include "../taskpool.h"
 //#include "governance.h"
 #include "smartnode.h"
 #include "smartnodepayments.h"
@@ -22,6 +24,8 @@
 #include "base58.h"
 #endif // ENABLE_WALLET
 
+#include <atomic>
+
 #include <boost/lexical_cast.hpp>
 #include "sapi/sapi.h"
 
@@ -68,6 +72,8 @@ bool CSmartnode::UpdateFromNewBroadcast(CSmartnodeBroadcast& mnb, CConnman& conn
     sigTime = mnb.sigTime;
     vchSig = mnb.vchSig;
     nProtocolVersion = mnb.nProtocolVersion;
+    // the protocol version decides about the rank
+    mnodeman.NotifyStateChanged();
     addr = mnb.addr;
     nPoSeBanScore = 0;
     nPoSeBanHeight = 0;
@@ -75,7 +81,7 @@ bool CSmartnode::UpdateFromNewBroadcast(CSmartnodeBroadcast& mnb, CConnman& conn
     int nDos = 0;
     if(mnb.lastPing == CSmartnodePing() || (mnb.lastPing != CSmartnodePing() && mnb.lastPing.CheckAndUpdate(this, true, nDos, connman))) {
         lastPing = mnb.lastPing;
-        mnodeman.mapSeenSmartnodePing.insert(std::make_pair(lastPing.GetHash(), lastPing));
+        mnodeman.mapSeenSmartnodePing.Insert(lastPing.GetHash(), lastPing);
     }
     // if it matches our Smartnode privkey...
     if(fSmartNode && pubKeySmartnode == activeSmartnode.pubKeySmartnode) {
@@ -134,6 +140,20 @@ void CSmartnode::Check(bool fForce)
     AssertLockHeld(cs_main);
     LOCK(cs);
 
+    int nActiveStatePrev = nActiveState;
+
+    CheckState(fForce);
+
+    // only enabled smartnodes get a rank
+    if(nActiveState != nActiveStatePrev) {
+        mnodeman.NotifyStateChanged();
+    }
+}
+
+void CSmartnode::CheckState(bool fForce)
+{
+    AssertLockHeld(cs);
+
     if(ShutdownRequested()) return;
 
     if(!fForce && (GetTime() - nTimeLastChecked < SMARTNODE_CHECK_SECONDS)) return;
@@ -234,17 +254,18 @@ void CSmartnode::Check(bool fForce)
 
 bool CSmartnode::IsInputAssociatedWithPubkey()
 {
+    AssertLockHeld(cs_main);
+
     CScript payee;
     payee = GetScriptForDestination(pubKeyCollateralAddress.GetID());
 
-    CTransaction tx;
-    uint256 hash;
-    if(GetTransaction(vin.prevout.hash, tx, Params().GetConsensus(), hash, true)) {
-        BOOST_FOREACH(CTxOut out, tx.vout)
-            if(out.nValue == SMARTNODE_COIN_REQUIRED*COIN && out.scriptPubKey == payee) return true;
+    // The UTXO set keeps the collateral after pruning deleted the block of its transaction
+    Coin coin;
+    if(!GetUTXOCoin(vin.prevout, coin)) {
+        return false;
     }
-    return false;
 
+    return coin.out.nValue == SMARTNODE_COIN_REQUIRED*COIN && coin.out.scriptPubKey == payee;
 }
 
 bool CSmartnode::IsValidNetAddr()
@@ -319,7 +340,7 @@ void CSmartnode::UpdateLastPaid(const CBlockIndex *pindex, int nMaxBlocksToScanB
 
             CAmount nSmartnodePayment = SmartNodePayments::Payment(BlockReading->nHeight) / nExpectedPayees;
 
-            BOOST_FOREACH(CTxOut txout, block.vtx[0].vout)
+            BOOST_FOREACH(const CTxOut& txout, block.vtx[0]->vout)
                 if(mnpayee == txout.scriptPubKey && abs( nSmartnodePayment - txout.nValue ) < 2) {
                     nBlockLastPaid = BlockReading->nHeight;
                     nTimeLastPaid = BlockReading->nTime;
@@ -567,41 +588,69 @@ bool CSmartnodeBroadcast::CheckOutpoint(int& nDos)
             return false;
         }
         // remember the hash of the block where smartnode collateral had minimum required confirmations
-        nCollateralMinConfBlockHash = chainActive[nHeight + Params().GetConsensus().nSmartnodeMinimumConfirmations - 1]->GetBlockHash();
-    }
+        CBlockIndex* pConfIndex = chainActive[nHeight + Params().GetConsensus().nSmartnodeMinimumConfirmations - 1];
+        nCollateralMinConfBlockHash = pConfIndex->GetBlockHash();
 
-    LogPrint("smartnode", "CSmartnodeBroadcast::CheckOutpoint -- Smartnode UTXO verified\n");
+        LogPrint("smartnode", "CSmartnodeBroadcast::CheckOutpoint -- Smartnode UTXO verified\n");
 
-    // make sure the input that was signed in smartnode broadcast message is related to the transaction
-    // that spawned the Smartnode - this is expensive, so it's only done once per Smartnode
-    if(!IsInputAssociatedWithPubkey()) {
-        LogPrintf("CSmartnodeMan::CheckOutpoint -- Got mismatched pubKeyCollateralAddress and vin\n");
-        nDos = 33;
-        return false;
+        // make sure the input that was signed in smartnode broadcast message is related to the transaction
+        // that spawned the Smartnode, the collateral coin has to pay to pubKeyCollateralAddress
+        if(!IsInputAssociatedWithPubkey()) {
+            LogPrintf("CSmartnodeMan::CheckOutpoint -- Got mismatched pubKeyCollateralAddress and vin\n");
+            nDos = 33;
+            return false;
+        }
+
+        // verify that sig time is legit in past
+        // should be at least not earlier than block when 10000 SMART tx got nSmartnodeMinimumConfirmations
+        if(pConfIndex->GetBlockTime() > sigTime) {
+            LogPrintf("CSmartnodeBroadcast::CheckOutpoint -- Bad sigTime %d (%d conf block is at %d) for Smartnode %s %s\n",
+                      sigTime, Params().GetConsensus().nSmartnodeMinimumConfirmations, pConfIndex->GetBlockTime(), vin.prevout.ToStringShort(), addr.ToString());
+            return false;
+        }
     }
 
-    // verify that sig time is legit in past
-    // should be at least not earlier than block when 10000 SMART tx got nSmartnodeMinimumConfirmations
-    uint256 hashBlock = uint256();
-    CTransaction tx2;
-    GetTransaction(vin.prevout.hash, tx2, Params().GetConsensus(), hashBlock, true);
+    return true;
+}
+
+// Message signatures of broadcasts and pings which verified, by the hash of the key, signature and message.
+// Lets the checks under cs_main and the list lock skip the key recovery PreVerifySignatures did already.
+static const size_t MAX_VERIFIED_SIGNATURES = 20000;
+static CCriticalSection cs_setVerifiedSignatures;
+static std::set<uint256> setVerifiedSignatures;
+
+static bool VerifySmartnodeMessage(const CPubKey& pubKey, const std::vector<unsigned char>& vchSig, const std::string& strMessage, std::string& strErrorRet)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << pubKey << vchSig << strMessage;
+    uint256 hash = ss.GetHash();
+
     {
-        LOCK(cs_main);
-        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
-        if (mi != mapBlockIndex.end() && (*mi).second) {
-            CBlockIndex* pMNIndex = (*mi).second; // block for 10000 SMART tx -> 1 confirmation
-            CBlockIndex* pConfIndex = chainActive[pMNIndex->nHeight + Params().GetConsensus().nSmartnodeMinimumConfirmations - 1]; // block where tx got nSmartnodeMinimumConfirmations
-            if(pConfIndex->GetBlockTime() > sigTime) {
-                LogPrintf("CSmartnodeBroadcast::CheckOutpoint -- Bad sigTime %d (%d conf block is at %d) for Smartnode %s %s\n",
-                          sigTime, Params().GetConsensus().nSmartnodeMinimumConfirmations, pConfIndex->GetBlockTime(), vin.prevout.ToStringShort(), addr.ToString());
-                return false;
-            }
-        }
+        LOCK(cs_setVerifiedSignatures);
+        if(setVerifiedSignatures.count(hash)) return true;
     }
 
+    if(!CMessageSigner::VerifyMessage(pubKey, vchSig, strMessage, strErrorRet)) return false;
+
+    LOCK(cs_setVerifiedSignatures);
+    if(setVerifiedSignatures.size() >= MAX_VERIFIED_SIGNATURES) setVerifiedSignatures.clear();
+    setVerifiedSignatures.insert(hash);
     return true;
 }
 
+static std::string GetBroadcastMessage(const CSmartnodeBroadcast& mnb)
+{
+    return mnb.addr.ToString(false) + boost::lexical_cast<std::string>(mnb.sigTime) +
+                    mnb.pubKeyCollateralAddress.GetID().ToString() + mnb.pubKeySmartnode.GetID().ToString() +
+                    boost::lexical_cast<std::string>(mnb.nProtocolVersion);
+}
+
+static std::string GetPingMessage(const CSmartnodePing& mnp)
+{
+    // TODO: add sentinel data
+    return CTxIn(mnp.outpoint).ToString() + mnp.blockHash.ToString() + boost::lexical_cast<std::string>(mnp.sigTime);
+}
+
 bool CSmartnodeBroadcast::Sign(const CKey& keyCollateralAddress)
 {
     std::string strError;
@@ -609,9 +658,7 @@ bool CSmartnodeBroadcast::Sign(const CKey& keyCollateralAddress)
 
     sigTime = GetAdjustedTime();
 
-    strMessage = addr.ToString(false) + boost::lexical_cast<std::string>(sigTime) +
-                    pubKeyCollateralAddress.GetID().ToString() + pubKeySmartnode.GetID().ToString() +
-                    boost::lexical_cast<std::string>(nProtocolVersion);
+    strMessage = GetBroadcastMessage(*this);
 
     if(!CMessageSigner::SignMessage(strMessage, vchSig, keyCollateralAddress)) {
         LogPrintf("CSmartnodeBroadcast::Sign -- SignMessage() failed\n");
@@ -632,13 +679,13 @@ bool CSmartnodeBroadcast::CheckSignature(int& nDos)
     std::string strError = "";
     nDos = 0;
 
-    strMessage = addr.ToString(false) + boost::lexical_cast<std::string>(sigTime) +
-                    pubKeyCollateralAddress.GetID().ToString() + pubKeySmartnode.GetID().ToString() +
-                    boost::lexical_cast<std::string>(nProtocolVersion);
+    strMessage = GetBroadcastMessage(*this);
 
-    LogPrint("smartnode", "CSmartnodeBroadcast::CheckSignature -- strMessage: %s  pubKeyCollateralAddress address: %s  sig: %s\n", strMessage, CBitcoinAddress(pubKeyCollateralAddress.GetID()).ToString(), EncodeBase64(&vchSig[0], vchSig.size()));
+    if(fDebug) {
+        LogPrint("smartnode", "CSmartnodeBroadcast::CheckSignature -- strMessage: %s  pubKeyCollateralAddress address: %s  sig: %s\n", strMessage, CBitcoinAddress(pubKeyCollateralAddress.GetID()).ToString(), EncodeBase64(vchSig.data(), vchSig.size()));
+    }
 
-    if(!CMessageSigner::VerifyMessage(pubKeyCollateralAddress, vchSig, strMessage, strError)){
+    if(!VerifySmartnodeMessage(pubKeyCollateralAddress, vchSig, strMessage, strError)){
         LogPrintf("CSmartnodeBroadcast::CheckSignature -- Got bad Smartnode announce signature, error: %s\n", strError);
         nDos = 100;
         return false;
@@ -647,6 +694,18 @@ bool CSmartnodeBroadcast::CheckSignature(int& nDos)
     return true;
 }
 
+void CSmartnodeBroadcast::PreVerifySignatures() const
+{
+    std::string strError;
+
+    // failures get logged and punished by the checks themselves
+    VerifySmartnodeMessage(pubKeyCollateralAddress, vchSig, GetBroadcastMessage(*this), strError);
+
+    if(lastPing != CSmartnodePing()) {
+        lastPing.PreVerifySignature(pubKeySmartnode);
+    }
+}
+
 void CSmartnodeBroadcast::Relay(CConnman& connman)
 {
     // Do not relay until fully synced
@@ -674,9 +733,8 @@ bool CSmartnodePing::Sign(const CKey& keySmartnode, const CPubKey& pubKeySmartno
     std::string strError;
     std::string strSmartNodeSignMessage;
 
-    // TODO: add sentinel data
     sigTime = GetAdjustedTime();
-    std::string strMessage = CTxIn(outpoint).ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetPingMessage(*this);
 
     if(!CMessageSigner::SignMessage(strMessage, vchSig, keySmartnode)) {
         LogPrintf("CSmartnodePing::Sign -- SignMessage() failed\n");
@@ -693,12 +751,11 @@ bool CSmartnodePing::Sign(const CKey& keySmartnode, const CPubKey& pubKeySmartno
 
 bool CSmartnodePing::CheckSignature(CPubKey& pubKeySmartnode, int &nDos)
 {
-    // TODO: add sentinel data
-    std::string strMessage = CTxIn(outpoint).ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetPingMessage(*this);
     std::string strError = "";
     nDos = 0;
 
-    if(!CMessageSigner::VerifyMessage(pubKeySmartnode, vchSig, strMessage, strError)) {
+    if(!VerifySmartnodeMessage(pubKeySmartnode, vchSig, strMessage, strError)) {
         LogPrintf("CSmartnodePing::CheckSignature -- Got bad Smartnode ping signature, smartnode=%s, error: %s\n", outpoint.ToStringShort(), strError);
         nDos = 33;
         return false;
@@ -706,6 +763,12 @@ bool CSmartnodePing::CheckSignature(CPubKey& pubKeySmartnode, int &nDos)
     return true;
 }
 
+void CSmartnodePing::PreVerifySignature(const CPubKey& pubKeySmartnode) const
+{
+    std::string strError;
+    VerifySmartnodeMessage(pubKeySmartnode, vchSig, GetPingMessage(*this), strError);
+}
+
 bool CSmartnodePing::SimpleCheck(int& nDos)
 {
     // don't ban by default
@@ -917,62 +980,70 @@ void CSmartnode::FlagGovernanceItemsAsDirty()
     }
 }
 
-void ThreadSmartnode(CConnman& connman)
+/** Once a second, only one run at a time so nTick needs no lock */
+static void SmartnodeTick(CConnman& connman)
 {
-    static bool fOneThread;
-    if(fOneThread) return;
-    fOneThread = true;
+    static unsigned int nTick = 0;
 
-    // Make this thread recognisable as the PrivateSend thread
-    RenameThread("smartnode");
+    // Lite mode only follows the sync until it's done
+    if( fLiteMode && smartnodeSync.IsSynced() ) return;
 
-    unsigned int nTick = 0;
-
-    while (true)
-    {
-        MilliSleep(1000);
+    // try to sync from all available nodes, one step at a time
+    smartnodeSync.ProcessTick(connman);
 
-        // try to sync from all available nodes, one step at a time
-        smartnodeSync.ProcessTick(connman);
+    if( fLiteMode || !smartnodeSync.IsSmartNodeSyncStarted() || ShutdownRequested() ) return;
 
-        if( fLiteMode ){
-            if(smartnodeSync.IsSynced() ) return;
-            else continue;
-        }
+    nTick++;
 
-        if(smartnodeSync.IsSmartNodeSyncStarted() && !ShutdownRequested()) {
+    // make sure to check all smartnodes first
+    mnodeman.Check();
 
-            nTick++;
+    mnodeman.ProcessPendingMnbRequests(connman);
+    mnodeman.ProcessPendingMnvRequests(connman);
 
-            // make sure to check all smartnodes first
-            mnodeman.Check();
+    // check if we should activate or ping every few minutes,
+    // slightly postpone first run to give net thread a chance to connect to some peers
+    if(nTick % SMARTNODE_MIN_MNP_SECONDS == 15)
+        activeSmartnode.ManageState(connman);
 
-            mnodeman.ProcessPendingMnbRequests(connman);
-            mnodeman.ProcessPendingMnvRequests(connman);
+    /* WIP-VOTING uncomment
+    smartVoting.ProcessVoteSyncCursors(connman);
+    */
+}
 
-            // check if we should activate or ping every few minutes,
-            // slightly postpone first run to give net thread a chance to connect to some peers
-            if(nTick % SMARTNODE_MIN_MNP_SECONDS == 15)
-                activeSmartnode.ManageState(connman);
+/** Once a minute, the full verification every fifth time */
+static void SmartnodeCleanup(CConnman& connman)
+{
+    static unsigned int nRuns = 0;
 
-            if(nTick % 60 == 0) {
-                netfulfilledman.CheckAndRemove();
-                mnodeman.ProcessSmartnodeConnections(connman);
-                mnodeman.CheckAndRemove(connman);
-                mnpayments.CheckAndRemove();
-                instantsend.CheckAndRemove();
-            }
+    if( !smartnodeSync.IsSmartNodeSyncStarted() || ShutdownRequested() ) return;
 
-            if(fSmartNode && (nTick % (60 * 5) == 0)) {
-                mnodeman.DoFullVerificationStep(connman);
-            }
+    nRuns++;
 
-            /* WIP-VOTING uncomment
-            if(nTick % (60 * 5) == 0) {
-                smartVoting.DoMaintenance(connman);
-            }
-            */
+    netfulfilledman.CheckAndRemove();
+    mnodeman.ProcessSmartnodeConnections(connman);
+    mnodeman.CheckAndRemove(connman);
+    mnpayments.CheckAndRemove();
+    instantsend.CheckAndRemove();
+    if(fSmartNode && nRuns % 5 == 0)
+        mnodeman.DoFullVerificationStep(connman);
 
-        }
+    /* WIP-VOTING uncomment
+    if(nRuns % 5 == 0) {
+        smartVoting.DoMaintenance(connman);
     }
+    */
+}
+
+void StartSmartnodeMaintenance(CConnman& connman)
+{
+    static bool fStarted;
+    if(fStarted) return;
+    fStarted = true;
+
+    // The sync and the pings have to stay in time, they go before the other background tasks
+    maintenanceTasks.Add("smartnodetick", 1000, [&connman]() { SmartnodeTick(connman); }, NULL, CTaskPool::PRIORITY_NORMAL);
+
+    if( !fLiteMode )
+        maintenanceTasks.Add("smartnodecleanup", 60 * 1000, [&connman]() { SmartnodeCleanup(connman); }, &cs_main);
 }
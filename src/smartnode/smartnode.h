@@ -6,6 +6,7 @@
 #define SMARTNODE_H
 
 #include "../key.h"
+#include "../memusage.h"
 #include "../validation.h"
 #include "spork.h"
 
@@ -85,8 +86,12 @@ public:
 
     bool IsExpired() const { return GetAdjustedTime() - sigTime > SMARTNODE_NEW_START_REQUIRED_SECONDS; }
 
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vchSig); }
+
     bool Sign(const CKey& keySmartnode, const CPubKey& pubKeySmartnode);
     bool CheckSignature(CPubKey& pubKeySmartnode, int &nDos);
+    /// Verify the signature without any lock held, CheckSignature reuses the result later
+    void PreVerifySignature(const CPubKey& pubKeySmartnode) const;
     bool SimpleCheck(int& nDos);
     bool CheckAndUpdate(CSmartnode* pmn, bool fFromNewBroadcast, int& nDos, CConnman& connman);
     void Relay(CConnman& connman);
@@ -147,6 +152,8 @@ private:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
 
+    void CheckState(bool fForce);
+
 public:
     enum state {
         SMARTNODE_PRE_ENABLED,
@@ -211,6 +218,12 @@ public:
         READWRITE(mapGovernanceObjectsVotedOn);
     }
 
+    size_t DynamicMemoryUsage() const
+    {
+        LOCK(cs);
+        return lastPing.DynamicMemoryUsage() + memusage::DynamicUsage(vchSig) + memusage::DynamicUsage(mapGovernanceObjectsVotedOn);
+    }
+
     // CALCULATE A RANK AGAINST OF GIVEN BLOCK
     arith_uint256 CalculateScore(const uint256& blockHash);
 
@@ -256,7 +269,7 @@ public:
         return nActiveState == SMARTNODE_ENABLED;
     }
 
-    /// Is the input associated with collateral public key? (and there is 100000 SMART - checking if valid smartnode)
+    /// Is the input associated with collateral public key? (and there is 100000 SMART - checking if valid smartnode), requires cs_main
     bool IsInputAssociatedWithPubkey();
 
     bool IsValidNetAddr();
@@ -272,8 +285,8 @@ public:
     std::string GetStateString() const;
     std::string GetStatus() const;
 
-    int GetLastPaidTime() { return nTimeLastPaid; }
-    int GetLastPaidBlock() { return nBlockLastPaid; }
+    int GetLastPaidTime() const { return nTimeLastPaid; }
+    int GetLastPaidBlock() const { return nBlockLastPaid; }
     void UpdateLastPaid(const CBlockIndex *pindex, int nMaxBlocksToScanBack);
 
     // KEEP TRACK OF EACH GOVERNANCE ITEM INCASE THIS NODE GOES OFFLINE, SO WE CAN RECALC THEIR STATUS
@@ -359,6 +372,8 @@ public:
 
     bool Sign(const CKey& keyCollateralAddress);
     bool CheckSignature(int& nDos);
+    /// Verify the signatures of the broadcast and its ping without any lock held, the checks reuse the results later
+    void PreVerifySignatures() const;
     void Relay(CConnman& connman);
 };
 
@@ -405,6 +420,8 @@ public:
         return ss.GetHash();
     }
 
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vchSig1) + memusage::DynamicUsage(vchSig2); }
+
     void Relay() const
     {
         CInv inv(MSG_SMARTNODE_VERIFY, GetHash());
@@ -412,6 +429,7 @@ public:
     }
 };
 
-void ThreadSmartnode(CConnman& connman);
+/** Register the sync tick and the cleanups of the smartnode layer with maintenanceTasks */
+void StartSmartnodeMaintenance(CConnman& connman);
 
 #endif
@@ -12,6 +12,7 @@
 #include "smartnodeman.h"
 #include "../util.h"
 #include "sapi/sapi.h"
+#include "validationinterface.h"
 
 /** Smartnode manager */
 CSmartnodeMan mnodeman;
@@ -36,22 +37,16 @@ struct CompareScoreMN
     }
 };
 
-struct CompareByAddr
+/// (addr, PoSe verified, outpoint) of a smartnode for CheckSameAddr
+typedef std::tuple<CService, bool, COutPoint> addr_entry_t;
 
-{
-    bool operator()(const CSmartnode* t1,
-                    const CSmartnode* t2) const
-    {
-        return t1->addr < t2->addr;
-    }
-};
+struct CompareByAddr
 
-struct CompareRankPair
 {
-    bool operator()(const CSmartnodeMan::rank_pair_t& t1,
-                    const CSmartnodeMan::rank_pair_t& t2) const
+    bool operator()(const addr_entry_t& t1,
+                    const addr_entry_t& t2) const
     {
-        return t1.first < t2.first;
+        return std::get<0>(t1) < std::get<0>(t2);
     }
 };
 
@@ -69,8 +64,17 @@ CSmartnodeMan::CSmartnodeMan()
   fSmartnodesRemoved(false),
   vecDirtyGovernanceObjectHashes(),
   nLastWatchdogVoteTime(0),
+  mapRankCache(),
+  nRankCacheChanges(0),
+  mapCountCache(),
+  nCountCacheChanges(0),
+  snapshot(),
+  nSnapshotChanges(0),
+  nSnapshotTime(0),
+  nStateChanges(0),
   mapSeenSmartnodeBroadcast(),
   mapSeenSmartnodePing(),
+  mapSeenSmartnodeVerification(),
   nDsqCount(0)
 {}
 
@@ -81,6 +85,7 @@ bool CSmartnodeMan::Add(CSmartnode &mn)
     LogPrint("smartnode", "CSmartnodeMan::Add -- Adding new Smartnode: addr=%s, %i now\n", mn.addr.ToString(), size() + 1);
     mapSmartnodes[mn.vin.prevout] = mn;
     fSmartnodesAdded = true;
+    NotifyStateChanged();
     return true;
 }
 
@@ -201,12 +206,14 @@ void CSmartnodeMan::CheckAndRemove(CConnman& connman)
                 it->second.FlagGovernanceItemsAsDirty();
                 mapSmartnodes.erase(it++);
                 fSmartnodesRemoved = true;
+                NotifyStateChanged();
             // If node is older than the min peer version, remove it.
             } else if (it->second.nProtocolVersion < MIN_PEER_PROTO_VERSION) {
                 LogPrint("smartnode", "CSmartnodeMan::CheckAndRemove -- Removing Old Version Smartnode: %s  addr=%s  %i now\n", it->second.GetStateString(), it->second.addr.ToString(), size() - 1);
                 it->second.FlagGovernanceItemsAsDirty();
                 mapSmartnodes.erase(it++);
                 fSmartnodesRemoved=true;
+                NotifyStateChanged();
             } else {
                 bool fAsk = (nAskForMnbRecovery > 0) &&
                             smartnodeSync.IsSynced() &&
@@ -327,26 +334,16 @@ void CSmartnodeMan::CheckAndRemove(CConnman& connman)
 
         // NOTE: do not expire mapSeenSmartnodeBroadcast entries here, clean them on mnb updates!
 
-        // remove expired mapSeenSmartnodePing
-        std::map<uint256, CSmartnodePing>::iterator it4 = mapSeenSmartnodePing.begin();
-        while(it4 != mapSeenSmartnodePing.end()){
-            if((*it4).second.IsExpired()) {
-                LogPrint("smartnode", "CSmartnodeMan::CheckAndRemove -- Removing expired Smartnode ping: hash=%s\n", (*it4).second.GetHash().ToString());
-                mapSeenSmartnodePing.erase(it4++);
-            } else {
-                ++it4;
-            }
+        // remove expired mapSeenSmartnodePing, whole minutes which are past the expiry
+        size_t nExpiredPings = mapSeenSmartnodePing.EraseBefore((GetAdjustedTime() - SMARTNODE_NEW_START_REQUIRED_SECONDS) / CSmartnodePingBucket::BUCKET_SECONDS);
+        if(nExpiredPings) {
+            LogPrint("smartnode", "CSmartnodeMan::CheckAndRemove -- Removed %d expired Smartnode pings\n", nExpiredPings);
         }
 
         // remove expired mapSeenSmartnodeVerification
-        std::map<uint256, CSmartnodeVerification>::iterator itv2 = mapSeenSmartnodeVerification.begin();
-        while(itv2 != mapSeenSmartnodeVerification.end()){
-            if((*itv2).second.nBlockHeight < nCachedBlockHeight - MAX_POSE_BLOCKS){
-                LogPrint("smartnode", "CSmartnodeMan::CheckAndRemove -- Removing expired Smartnode verification: hash=%s\n", (*itv2).first.ToString());
-                mapSeenSmartnodeVerification.erase(itv2++);
-            } else {
-                ++itv2;
-            }
+        size_t nExpiredVerifications = mapSeenSmartnodeVerification.EraseBefore(nCachedBlockHeight - MAX_POSE_BLOCKS);
+        if(nExpiredVerifications) {
+            LogPrint("smartnode", "CSmartnodeMan::CheckAndRemove -- Removed %d expired Smartnode verifications\n", nExpiredVerifications);
         }
 
         LogPrintf("CSmartnodeMan::CheckAndRemove -- %s\n", ToString());
@@ -361,15 +358,41 @@ void CSmartnodeMan::Clear()
 {
     LOCK(cs);
     mapSmartnodes.clear();
+    NotifyStateChanged();
     mAskedUsForSmartnodeList.clear();
     mWeAskedForSmartnodeList.clear();
     mWeAskedForSmartnodeListEntry.clear();
     mapSeenSmartnodeBroadcast.clear();
-    mapSeenSmartnodePing.clear();
+    mapSeenSmartnodePing.Clear();
     nDsqCount = 0;
     nLastWatchdogVoteTime = 0;
 }
 
+std::pair<int, int> CSmartnodeMan::GetCounts(int nProtocolVersion)
+{
+    AssertLockHeld(cs);
+
+    uint64_t nChanges = nStateChanges;
+    if (nChanges != nCountCacheChanges) {
+        mapCountCache.clear();
+        nCountCacheChanges = nChanges;
+    }
+
+    auto it = mapCountCache.find(nProtocolVersion);
+    if (it != mapCountCache.end())
+        return it->second;
+
+    std::pair<int, int> counts(0, 0);
+
+    for (auto& mnpair : mapSmartnodes) {
+        if(mnpair.second.nProtocolVersion < nProtocolVersion) continue;
+        counts.first++;
+        if(mnpair.second.IsEnabled()) counts.second++;
+    }
+
+    return mapCountCache[nProtocolVersion] = counts;
+}
+
 int CSmartnodeMan::CountSmartnodes(int nProtocolVersion)
 {
     static int nodes = 0;
@@ -377,15 +400,9 @@ int CSmartnodeMan::CountSmartnodes(int nProtocolVersion)
     TRY_LOCK(cs,locked);
     if( !locked ) return nodes;
 
-    int nCount = 0;
     nProtocolVersion = nProtocolVersion == -1 ? mnpayments.GetMinSmartnodePaymentsProto() : nProtocolVersion;
 
-    for (auto& mnpair : mapSmartnodes) {
-        if(mnpair.second.nProtocolVersion < nProtocolVersion) continue;
-        nCount++;
-    }
-
-    return (nodes = nCount);
+    return (nodes = GetCounts(nProtocolVersion).first);
 }
 
 int CSmartnodeMan::CountEnabled(int nProtocolVersion)
@@ -395,15 +412,9 @@ int CSmartnodeMan::CountEnabled(int nProtocolVersion)
     TRY_LOCK(cs,locked);
     if( !locked ) return enabled;
 
-    int nCount = 0;
     nProtocolVersion = nProtocolVersion == -1 ? mnpayments.GetMinSmartnodePaymentsProto() : nProtocolVersion;
 
-    for (auto& mnpair : mapSmartnodes) {
-        if(mnpair.second.nProtocolVersion < nProtocolVersion || !mnpair.second.IsEnabled()) continue;
-        nCount++;
-    }
-
-    return (enabled = nCount);
+    return (enabled = GetCounts(nProtocolVersion).second);
 }
 
 void CSmartnodeMan::CountStates(std::map<std::string,int64_t> &mapStates)
@@ -451,6 +462,9 @@ void CSmartnodeMan::DsegUpdate(CNode* pnode, CConnman& connman)
 
     if (pnode->GetSendVersion() == 90025) {
         connman.PushMessage(pnode, NetMsgType::DSEG, CTxIn());
+    } else if ((pnode->nServices & NODE_SMARTNODE_LIST_DELTA) && !mapSmartnodes.empty()) {
+        // We have a list already (-cachenodelist), only ask for what changed since
+        connman.PushMessage(pnode, NetMsgType::DSEGDELTA, GetListDigest());
     } else {
         connman.PushMessage(pnode, NetMsgType::DSEG, COutPoint());
     }
@@ -461,6 +475,23 @@ void CSmartnodeMan::DsegUpdate(CNode* pnode, CConnman& connman)
     LogPrint("smartnode", "CSmartnodeMan::DsegUpdate -- asked %s for the list\n", pnode->addr.ToString());
 }
 
+CSmartnodeListDigest CSmartnodeMan::GetListDigest()
+{
+    AssertLockHeld(cs);
+
+    CSmartnodeListDigest digest(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max()));
+    digest.vecShortIds.reserve(std::min(mapSmartnodes.size() * 2, CSmartnodeListDigest::MAX_SHORT_IDS));
+
+    for (const auto& mnpair : mapSmartnodes) {
+        if (digest.vecShortIds.size() + 2 > CSmartnodeListDigest::MAX_SHORT_IDS) break;
+        CSmartnodeBroadcast mnb(mnpair.second);
+        digest.vecShortIds.push_back(digest.GetShortId(mnb.GetHash()));
+        digest.vecShortIds.push_back(digest.GetShortId(mnb.lastPing.GetHash()));
+    }
+
+    return digest;
+}
+
 CSmartnode* CSmartnodeMan::Find(const COutPoint &outpoint)
 {
     LOCK(cs);
@@ -517,6 +548,27 @@ bool CSmartnodeMan::GetSmartnodeInfo(const CScript& payee, smartnode_info_t& mnI
     return false;
 }
 
+CSmartnodeMan::snapshot_t CSmartnodeMan::GetSmartnodeSnapshot()
+{
+    LOCK(cs);
+
+    uint64_t nChanges = nStateChanges;
+    int64_t nNow = GetTime();
+
+    if (!snapshot || nChanges != nSnapshotChanges || nNow - nSnapshotTime >= SNAPSHOT_MAX_AGE_SECONDS) {
+        std::shared_ptr<std::vector<CSmartnode> > vecSmartnodes = std::make_shared<std::vector<CSmartnode> >();
+        vecSmartnodes->reserve(mapSmartnodes.size());
+        for (auto& mnpair : mapSmartnodes) {
+            vecSmartnodes->push_back(mnpair.second);
+        }
+        snapshot = vecSmartnodes;
+        nSnapshotChanges = nChanges;
+        nSnapshotTime = nNow;
+    }
+
+    return snapshot;
+}
+
 bool CSmartnodeMan::Has(const COutPoint& outpoint)
 {
     LOCK(cs);
@@ -545,6 +597,8 @@ bool CSmartnodeMan::GetNextSmartnodesInQueueForPayment(int nBlockHeight, bool fF
     LOCK2(cs_main,cs);
 
     std::vector<std::pair<int, CSmartnode*> > vecSmartnodeLastPaid;
+    // only needed if too few smartnodes pass the sigTime filter
+    std::vector<CSmartnode*> vecSmartnodeTooNew;
 
     /*
         Make a vector with all of the last paid times
@@ -557,21 +611,31 @@ bool CSmartnodeMan::GetNextSmartnodesInQueueForPayment(int nBlockHeight, bool fF
     if( !nPayoutsPerBlock ) nPayoutsPerBlock = 1;
 
     int nMnCount = CountSmartnodes();
+    int nMinConfirmations = int(nMnCount / ( double( nPayoutsPerBlock ) / nPayoutInterval ) );
+    int nMinProtocol = mnpayments.GetMinSmartnodePaymentsProto();
+
+    // Collect the scheduled payees once instead of looking them up for every smartnode
+    std::set<CScript> setScheduledPayees;
+    mnpayments.GetScheduledPayees(nBlockHeight, setScheduledPayees);
 
     for (auto& mnpair : mapSmartnodes) {
         if(!mnpair.second.IsValidForPayment()) continue;
 
         //check protocol version
-        if(mnpair.second.nProtocolVersion < mnpayments.GetMinSmartnodePaymentsProto()) continue;
+        if(mnpair.second.nProtocolVersion < nMinProtocol) continue;
 
         //it's in the list (up to 8 entries ahead of current block to allow propagation) -- so let's skip it
-        if(mnpayments.IsScheduled(mnpair.second, nBlockHeight)) continue;
+        if(!setScheduledPayees.empty() &&
+           setScheduledPayees.count(GetScriptForDestination(mnpair.second.pubKeyCollateralAddress.GetID()))) continue;
 
         //it's too new, wait for a cycle
-        if(fFilterSigTime && mnpair.second.sigTime + int(nMnCount * 55 /  ( double( nPayoutsPerBlock ) / nPayoutInterval ) ) > GetAdjustedTime()) continue;
+        if(fFilterSigTime && mnpair.second.sigTime + int(nMnCount * 55 /  ( double( nPayoutsPerBlock ) / nPayoutInterval ) ) > GetAdjustedTime()) {
+            vecSmartnodeTooNew.push_back(&mnpair.second);
+            continue;
+        }
 
         //make sure it has at least as many confirmations as the smartnode cycle time
-        if(GetUTXOConfirmations(mnpair.first) < int(nMnCount / ( double( nPayoutsPerBlock ) / nPayoutInterval ) ) ) continue;
+        if(GetUTXOConfirmations(mnpair.first) < nMinConfirmations) continue;
 
         vecSmartnodeLastPaid.push_back(std::make_pair(mnpair.second.GetLastPaidBlock(), &mnpair.second));
     }
@@ -579,11 +643,13 @@ bool CSmartnodeMan::GetNextSmartnodesInQueueForPayment(int nBlockHeight, bool fF
     nCountRet = (int)vecSmartnodeLastPaid.size();
 
     //when the network is in the process of upgrading, don't penalize nodes that recently restarted
-    if(fFilterSigTime && nCountRet < nMnCount/3)
-        return GetNextSmartnodesInQueueForPayment(nBlockHeight, false, nCountRet, mnInfoRet);
-
-    // Sort them low to high
-    sort(vecSmartnodeLastPaid.begin(), vecSmartnodeLastPaid.end(), CompareLastPaidBlock());
+    if(fFilterSigTime && nCountRet < nMnCount/3) {
+        for (CSmartnode* pmn : vecSmartnodeTooNew) {
+            if(GetUTXOConfirmations(pmn->vin.prevout) < nMinConfirmations) continue;
+            vecSmartnodeLastPaid.push_back(std::make_pair(pmn->GetLastPaidBlock(), pmn));
+        }
+        nCountRet = (int)vecSmartnodeLastPaid.size();
+    }
 
     uint256 blockHash;
     if(!GetBlockHash(blockHash, nBlockHeight - 101)) {
@@ -595,15 +661,17 @@ bool CSmartnodeMan::GetNextSmartnodesInQueueForPayment(int nBlockHeight, bool fF
     //  -- 1/100 payments should be a double payment on mainnet - (1/(3000/10))*2
     //  -- (chance per block * chances before IsScheduled will fire)
     int nTenthNetwork = nMnCount/10;
-    int nCountTenth = 0;
+    size_t nTenth = std::min<size_t>(std::max(nTenthNetwork, 1), vecSmartnodeLastPaid.size());
+
+    // Only the oldest tenth gets looked at, no need to sort the others. The order is total
+    // so the head is the same as with a full sort.
+    std::partial_sort(vecSmartnodeLastPaid.begin(), vecSmartnodeLastPaid.begin() + nTenth, vecSmartnodeLastPaid.end(), CompareLastPaidBlock());
 
     std::vector<std::pair<arith_uint256, CSmartnode*>> vecTopTenthScores;
 
-    for (const auto& s : vecSmartnodeLastPaid) {
-        arith_uint256 nScore = s.second->CalculateScore(blockHash);
-        vecTopTenthScores.push_back(std::make_pair(nScore,s.second));
-        nCountTenth++;
-        if(nCountTenth >= nTenthNetwork) break;
+    for (size_t i = 0; i < nTenth; i++) {
+        arith_uint256 nScore = vecSmartnodeLastPaid[i].second->CalculateScore(blockHash);
+        vecTopTenthScores.push_back(std::make_pair(nScore, vecSmartnodeLastPaid[i].second));
     }
 
     std::sort(vecTopTenthScores.begin(), vecTopTenthScores.end(), CompareScoreMN());
@@ -646,6 +714,54 @@ bool CSmartnodeMan::GetSmartnodeScores(const uint256& nBlockHash, CSmartnodeMan:
     return !vecSmartnodeScoresRet.empty();
 }
 
+const CSmartnodeMan::CSmartnodeRanks* CSmartnodeMan::GetRanks(int nBlockHeight, int nMinProtocol)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs);
+
+    // make sure we know about this block
+    uint256 nBlockHash = uint256();
+    if (!GetBlockHash(nBlockHash, nBlockHeight)) {
+        LogPrintf("CSmartnodeMan::%s -- ERROR: GetBlockHash() failed at nBlockHeight %d\n", __func__, nBlockHeight);
+        return nullptr;
+    }
+
+    uint64_t nChanges = nStateChanges;
+    if (nChanges != nRankCacheChanges) {
+        mapRankCache.clear();
+        nRankCacheChanges = nChanges;
+    }
+
+    std::pair<uint256, int> key = std::make_pair(nBlockHash, nMinProtocol);
+    auto it = mapRankCache.find(key);
+    if (it != mapRankCache.end())
+        return &it->second;
+
+    score_pair_vec_t vecSmartnodeScores;
+    if (!GetSmartnodeScores(nBlockHash, vecSmartnodeScores, nMinProtocol))
+        return nullptr;
+
+    if (mapRankCache.size() >= RANK_CACHE_MAX_ENTRIES)
+        mapRankCache.clear();
+
+    CSmartnodeRanks& ranks = mapRankCache[key];
+    ranks.vecRanks.reserve(vecSmartnodeScores.size());
+    ranks.mapRanks.reserve(vecSmartnodeScores.size());
+
+    int nRank = 0;
+    for (auto& scorePair : vecSmartnodeScores) {
+        int nRankMN = scorePair.second->IsEnabled() ? ++nRank : MNPAYMENTS_NO_RANK;
+        ranks.vecRanks.push_back(std::make_pair(nRankMN, scorePair.second->vin.prevout));
+        ranks.mapRanks[scorePair.second->vin.prevout] = nRankMN;
+    }
+
+    // the unranked ones stay in score order behind the ranked ones
+    std::stable_sort(ranks.vecRanks.begin(), ranks.vecRanks.end(),
+                     [](const std::pair<int, COutPoint>& a, const std::pair<int, COutPoint>& b) { return a.first < b.first; });
+
+    return &ranks;
+}
+
 bool CSmartnodeMan::GetSmartnodeRank(const COutPoint& outpoint, int& nRankRet, int nBlockHeight, int nMinProtocol)
 {
     nRankRet = -1;
@@ -653,16 +769,16 @@ bool CSmartnodeMan::GetSmartnodeRank(const COutPoint& outpoint, int& nRankRet, i
     if (!smartnodeSync.IsSmartnodeListSynced())
         return false;
 
-    CSmartnodeMan::rank_pair_vec_t vecSmartnodeRanks;
-    if (!GetSmartnodeRanks(vecSmartnodeRanks, nBlockHeight, nMinProtocol))
+    LOCK2(cs_main, cs);
+
+    const CSmartnodeRanks* ranks = GetRanks(nBlockHeight, nMinProtocol);
+    if (!ranks)
         return false;
 
-    auto hasRank = std::find_if(vecSmartnodeRanks.begin(), vecSmartnodeRanks.end(), [outpoint](const CSmartnodeMan::rank_pair_t &rankPair) -> bool {
-        return outpoint == rankPair.second.vin.prevout;
-    });
+    auto hasRank = ranks->mapRanks.find(outpoint);
 
-    if( hasRank != vecSmartnodeRanks.end() ){
-        nRankRet = hasRank->first;
+    if( hasRank != ranks->mapRanks.end() ){
+        nRankRet = hasRank->second;
         return true;
     }
 
@@ -678,30 +794,18 @@ bool CSmartnodeMan::GetSmartnodeRanks(CSmartnodeMan::rank_pair_vec_t& vecSmartno
 
     LOCK2(cs_main, cs);
 
-    // make sure we know about this block
-    uint256 nBlockHash = uint256();
-    if (!GetBlockHash(nBlockHash, nBlockHeight)) {
-        LogPrintf("CSmartnodeMan::%s -- ERROR: GetBlockHash() failed at nBlockHeight %d\n", __func__, nBlockHeight);
-        return false;
-    }
-
-    score_pair_vec_t vecSmartnodeScores;
-    if (!GetSmartnodeScores(nBlockHash, vecSmartnodeScores, nMinProtocol))
+    const CSmartnodeRanks* ranks = GetRanks(nBlockHeight, nMinProtocol);
+    if (!ranks)
         return false;
 
-    int nRank = 0;
-    for (auto& scorePair : vecSmartnodeScores) {
+    vecSmartnodeRanksRet.reserve(ranks->vecRanks.size());
 
-        if( scorePair.second->IsEnabled() ){
-            nRank++;
-            vecSmartnodeRanksRet.push_back(std::make_pair(nRank, *scorePair.second));
-        }else{
-            vecSmartnodeRanksRet.push_back(std::make_pair(MNPAYMENTS_NO_RANK, *scorePair.second));
-        }
+    for (const auto& rankPair : ranks->vecRanks) {
+        auto itSmartnode = mapSmartnodes.find(rankPair.second);
+        if (itSmartnode != mapSmartnodes.end())
+            vecSmartnodeRanksRet.push_back(std::make_pair(rankPair.first, itSmartnode->second));
     }
 
-    std::sort(vecSmartnodeRanksRet.begin(), vecSmartnodeRanksRet.end(), CompareRankPair());
-
     return true;
 }
 
@@ -803,10 +907,21 @@ void CSmartnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataS
 
         if(!smartnodeSync.IsSmartNodeSyncStarted()) return;
 
-        pfrom->setAskFor.erase(mnb.GetHash());
+        pfrom->RemoveAskFor(mnb.GetHash());
 
         LogPrint("smartnode", "MNANNOUNCE -- Smartnode announce, smartnode=%s\n", mnb.vin.prevout.ToStringShort());
 
+        bool fSeen;
+        {
+            LOCK(cs);
+            fSeen = mapSeenSmartnodeBroadcast.count(mnb.GetHash()) && !mnb.fRecovery;
+        }
+
+        // Recover the signing keys before cs_main and cs get locked, the checks below only look the results up.
+        if(!fSeen) {
+            mnb.PreVerifySignatures();
+        }
+
         int nDos = 0;
 
         if (CheckMnbAndUpdateSmartnodeList(pfrom, mnb, nDos, connman)) {
@@ -827,17 +942,28 @@ void CSmartnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataS
 
         uint256 nHash = mnp.GetHash();
 
-        pfrom->setAskFor.erase(nHash);
+        pfrom->RemoveAskFor(nHash);
 
         if(!smartnodeSync.IsSmartNodeSyncStarted()) return;
 
         LogPrint("smartnode", "MNPING -- Smartnode ping, smartnode=%s\n", mnp.outpoint.ToStringShort());
 
+        // Same as for MNANNOUNCE, verify the signature of a new ping before the locks are taken.
+        smartnode_info_t infoMn;
+        bool fVerify;
+        {
+            LOCK(cs);
+            fVerify = !mapSeenSmartnodePing.Has(nHash) && GetSmartnodeInfo(mnp.outpoint, infoMn);
+        }
+
+        if(fVerify) {
+            mnp.PreVerifySignature(infoMn.pubKeySmartnode);
+        }
+
         // Need LOCK2 here to ensure consistent locking order because the CheckAndUpdate call below locks cs_main
         LOCK2(cs_main, cs);
 
-        if(mapSeenSmartnodePing.count(nHash)) return; //seen
-        mapSeenSmartnodePing.insert(std::make_pair(nHash, mnp));
+        if(!mapSeenSmartnodePing.Insert(nHash, mnp)) return; //seen
 
         LogPrint("smartnode", "MNPING -- Smartnode ping, smartnode=%s new\n", mnp.outpoint.ToStringShort());
 
@@ -886,15 +1012,34 @@ void CSmartnodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataS
             SyncSingle(pfrom, outpoint, connman);
         }
 
+    } else if (strCommand == NetMsgType::DSEGDELTA) { //Get the entries of the Smartnode list the peer doesn't have
+        // Same as DSEG, ignore until we are fully synced.
+        if (!smartnodeSync.IsSynced()) return;
+
+        CSmartnodeListDigest digest;
+        vRecv >> digest;
+
+        if(digest.vecShortIds.size() > CSmartnodeListDigest::MAX_SHORT_IDS) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            LogPrintf("DSEGDELTA -- too many short ids %d, peer=%d\n", digest.vecShortIds.size(), pfrom->id);
+            return;
+        }
+
+        LogPrint("smartnode", "DSEGDELTA -- Smartnode list delta, %d short ids, peer=%d\n", digest.vecShortIds.size(), pfrom->id);
+
+        SyncAll(pfrom, connman, &digest);
+
     } else if (strCommand == NetMsgType::MNVERIFY) { // Smartnode Verify
 
-        // Need LOCK2 here to ensure consistent locking order because the all functions below call GetBlockHash which locks cs_main
-        LOCK2(cs_main, cs);
+        // The functions below call GetBlockHash which locks cs_main, they lock cs
+        // themselves and check the signatures without it
+        LOCK(cs_main);
 
         CSmartnodeVerification mnv;
         vRecv >> mnv;
 
-        pfrom->setAskFor.erase(mnv.GetHash());
+        pfrom->RemoveAskFor(mnv.GetHash());
 
         if(!smartnodeSync.IsSmartnodeListSynced()) return;
 
@@ -929,7 +1074,7 @@ void CSmartnodeMan::SyncSingle(CNode* pnode, const COutPoint& outpoint, CConnman
     }
 }
 
-void CSmartnodeMan::SyncAll(CNode* pnode, CConnman& connman)
+void CSmartnodeMan::SyncAll(CNode* pnode, CConnman& connman, const CSmartnodeListDigest* pDigest)
 {
     // do not provide any data until our node is synced
     if (!smartnodeSync.IsSynced()) return;
@@ -951,6 +1096,7 @@ void CSmartnodeMan::SyncAll(CNode* pnode, CConnman& connman)
         mAskedUsForSmartnodeList[addrSquashed] = askAgain;
     }
 
+    int nListCount = 0;
     int nInvCount = 0;
 
     LOCK(cs);
@@ -958,16 +1104,19 @@ void CSmartnodeMan::SyncAll(CNode* pnode, CConnman& connman)
     for (const auto& mnpair : mapSmartnodes) {
         if (mnpair.second.addr.IsRFC1918() || ( MainNet() && mnpair.second.addr.IsLocal())) continue; // do not send local network masternode
         // NOTE: send masternode regardless of its current state, the other node will need it to verify old votes.
-        LogPrint("smartnode", "CSmartnodeMan::%s -- Sending Smartnode entry: smartnode=%s  addr=%s\n", __func__, mnpair.first.ToStringShort(), mnpair.second.addr.ToString());
-        PushDsegInvs(pnode, mnpair.second);
-        nInvCount++;
+        nListCount++;
+        if (PushDsegInvs(pnode, mnpair.second, pDigest)) {
+            LogPrint("smartnode", "CSmartnodeMan::%s -- Sending Smartnode entry: smartnode=%s  addr=%s\n", __func__, mnpair.first.ToStringShort(), mnpair.second.addr.ToString());
+            nInvCount++;
+        }
     }
 
-    connman.PushMessage(pnode, NetMsgType::SYNCSTATUSCOUNT, SMARTNODE_SYNC_LIST, nInvCount);
-    LogPrintf("CSmartnodeMan::%s -- Sent %d Smartnode invs to peer=%d\n", __func__, nInvCount, pnode->id);
+    // The peer compares the size of its list against the count, not the invs of a delta
+    connman.PushMessage(pnode, NetMsgType::SYNCSTATUSCOUNT, SMARTNODE_SYNC_LIST, nListCount);
+    LogPrintf("CSmartnodeMan::%s -- Sent %d of %d Smartnode entries to peer=%d\n", __func__, nInvCount, nListCount, pnode->id);
 }
 
-void CSmartnodeMan::PushDsegInvs(CNode* pnode, const CSmartnode& mn)
+int CSmartnodeMan::PushDsegInvs(CNode* pnode, const CSmartnode& mn, const CSmartnodeListDigest* pDigest)
 {
     AssertLockHeld(cs);
 
@@ -975,10 +1124,18 @@ void CSmartnodeMan::PushDsegInvs(CNode* pnode, const CSmartnode& mn)
     CSmartnodePing mnp = mnb.lastPing;
     uint256 hashMNB = mnb.GetHash();
     uint256 hashMNP = mnp.GetHash();
-    pnode->PushInventory(CInv(MSG_SMARTNODE_ANNOUNCE, hashMNB));
-    pnode->PushInventory(CInv(MSG_SMARTNODE_PING, hashMNP));
-    mapSeenSmartnodeBroadcast.insert(std::make_pair(hashMNB, std::make_pair(GetTime(), mnb)));
-    mapSeenSmartnodePing.insert(std::make_pair(hashMNP, mnp));
+    int nInvs = 0;
+    if (!pDigest || !pDigest->Contains(hashMNB)) {
+        pnode->PushInventory(CInv(MSG_SMARTNODE_ANNOUNCE, hashMNB));
+        mapSeenSmartnodeBroadcast.insert(std::make_pair(hashMNB, std::make_pair(GetTime(), mnb)));
+        nInvs++;
+    }
+    if (!pDigest || !pDigest->Contains(hashMNP)) {
+        pnode->PushInventory(CInv(MSG_SMARTNODE_PING, hashMNP));
+        mapSeenSmartnodePing.Insert(hashMNP, mnp);
+        nInvs++;
+    }
+    return nInvs;
 }
 
 // Verification of smartnodes via unique direct requests.
@@ -991,11 +1148,18 @@ void CSmartnodeMan::DoFullVerificationStep(CConnman& connman)
     rank_pair_vec_t vecSmartnodeRanks;
     GetSmartnodeRanks(vecSmartnodeRanks, nCachedBlockHeight - 1, MIN_POSE_PROTO_VERSION);
 
-    // Need LOCK2 here to ensure consistent locking order because the SendVerifyRequest call below locks cs_main
-    // through GetHeight() signal in ConnectNode
-    LOCK2(cs_main, cs);
-
+    // Requests get only queued here, don't send more while the previous ones still wait for their connection
     int nCount = 0;
+    int nInFlight;
+    {
+        LOCK(cs_mapPendingMNV);
+        nInFlight = mapPendingMNV.size();
+    }
+
+    if(nInFlight >= MAX_POSE_CONNECTIONS) {
+        LogPrint("smartnode", "CSmartnodeMan::DoFullVerificationStep -- %d verification requests still pending\n", nInFlight);
+        return;
+    }
 
     int nMyRank = MNPAYMENTS_NO_RANK;
     int nRanksTotal = (int)vecSmartnodeRanks.size();
@@ -1025,13 +1189,6 @@ void CSmartnodeMan::DoFullVerificationStep(CConnman& connman)
     int nOffset = MAX_POSE_RANK + nMyRank - 1;
     if(nOffset >= (int)vecSmartnodeRanks.size()) return;
 
-    std::vector<CSmartnode*> vSortedByAddr;
-    for (auto& mnpair : mapSmartnodes) {
-        vSortedByAddr.push_back(&mnpair.second);
-    }
-
-    sort(vSortedByAddr.begin(), vSortedByAddr.end(), CompareByAddr());
-
     it = vecSmartnodeRanks.begin() + nOffset;
     while(it != vecSmartnodeRanks.end()) {
         if(it->second.IsPoSeVerified() || it->second.IsPoSeBanned()) {
@@ -1047,9 +1204,9 @@ void CSmartnodeMan::DoFullVerificationStep(CConnman& connman)
         }
         LogPrint("smartnode", "CSmartnodeMan::DoFullVerificationStep -- Verifying smartnode %s rank %d/%d address %s\n",
                     it->second.vin.prevout.ToStringShort(), it->first, nRanksTotal, it->second.addr.ToString());
-        if(SendVerifyRequest(CAddress(it->second.addr, NODE_NETWORK), vSortedByAddr, connman)) {
+        if(SendVerifyRequest(CAddress(it->second.addr, NODE_NETWORK), connman)) {
             nCount++;
-            if(nCount >= MAX_POSE_CONNECTIONS) break;
+            if(nInFlight + nCount >= MAX_POSE_CONNECTIONS) break;
         }
         nOffset += MAX_POSE_CONNECTIONS;
         if(nOffset >= (int)vecSmartnodeRanks.size()) break;
@@ -1066,60 +1223,64 @@ void CSmartnodeMan::DoFullVerificationStep(CConnman& connman)
 
 void CSmartnodeMan::CheckSameAddr()
 {
-    if(!smartnodeSync.IsSynced() || mapSmartnodes.empty() || Params().NetworkIDString() == CBaseChainParams::TESTNET) return;
+    if(!smartnodeSync.IsSynced() || Params().NetworkIDString() == CBaseChainParams::TESTNET) return;
 
-    std::vector<CSmartnode*> vBan;
-    std::vector<CSmartnode*> vSortedByAddr;
+    // the (pre)enabled smartnodes, sorted without holding cs
+    std::vector<addr_entry_t> vecByAddr;
 
     {
         LOCK(cs);
 
-        CSmartnode* pprevSmartnode = NULL;
-        CSmartnode* pverifiedSmartnode = NULL;
-
         for (auto& mnpair : mapSmartnodes) {
-            vSortedByAddr.push_back(&mnpair.second);
+            // check only (pre)enabled smartnodes
+            if(!mnpair.second.IsEnabled() && !mnpair.second.IsPreEnabled()) continue;
+            vecByAddr.push_back(std::make_tuple(mnpair.second.addr, mnpair.second.IsPoSeVerified(), mnpair.first));
         }
+    }
 
-        sort(vSortedByAddr.begin(), vSortedByAddr.end(), CompareByAddr());
+    if(vecByAddr.empty()) return;
 
-        BOOST_FOREACH(CSmartnode* pmn, vSortedByAddr) {
-            // check only (pre)enabled smartnodes
-            if(!pmn->IsEnabled() && !pmn->IsPreEnabled()) continue;
-            // initial step
-            if(!pprevSmartnode) {
-                pprevSmartnode = pmn;
-                pverifiedSmartnode = pmn->IsPoSeVerified() ? pmn : NULL;
-                continue;
-            }
-            // second+ step
-            if(pmn->addr == pprevSmartnode->addr) {
-                if(pverifiedSmartnode) {
-                    // another smartnode with the same ip is verified, ban this one
-                    vBan.push_back(pmn);
-                } else if(pmn->IsPoSeVerified()) {
-                    // this smartnode with the same ip is verified, ban previous one
-                    vBan.push_back(pprevSmartnode);
-                    // and keep a reference to be able to ban following smartnodes with the same ip
-                    pverifiedSmartnode = pmn;
-                }
-            } else {
-                pverifiedSmartnode = pmn->IsPoSeVerified() ? pmn : NULL;
+    sort(vecByAddr.begin(), vecByAddr.end(), CompareByAddr());
+
+    std::vector<COutPoint> vBan;
+    // index of the previous smartnode, and whether one with its addr is verified
+    size_t nPrev = 0;
+    bool fVerified = std::get<1>(vecByAddr[0]);
+
+    for (size_t i = 1; i < vecByAddr.size(); i++) {
+        const addr_entry_t& mn = vecByAddr[i];
+        if(std::get<0>(mn) == std::get<0>(vecByAddr[nPrev])) {
+            if(fVerified) {
+                // another smartnode with the same ip is verified, ban this one
+                vBan.push_back(std::get<2>(mn));
+            } else if(std::get<1>(mn)) {
+                // this smartnode with the same ip is verified, ban previous one
+                vBan.push_back(std::get<2>(vecByAddr[nPrev]));
+                // and remember it to be able to ban following smartnodes with the same ip
+                fVerified = true;
             }
-            pprevSmartnode = pmn;
+        } else {
+            fVerified = std::get<1>(mn);
         }
+        nPrev = i;
     }
 
+    if(vBan.empty()) return;
+
+    LOCK(cs);
+
     // ban duplicates
-    BOOST_FOREACH(CSmartnode* pmn, vBan) {
-        LogPrintf("CSmartnodeMan::CheckSameAddr -- increasing PoSe ban score for smartnode %s\n", pmn->vin.prevout.ToStringShort());
+    for (const COutPoint& outpoint : vBan) {
+        CSmartnode* pmn = Find(outpoint);
+        if(!pmn) continue;
+        LogPrintf("CSmartnodeMan::CheckSameAddr -- increasing PoSe ban score for smartnode %s\n", outpoint.ToStringShort());
         pmn->IncreasePoSeBanScore();
     }
 }
 
-bool CSmartnodeMan::SendVerifyRequest(const CAddress& addr, const std::vector<CSmartnode*>& vSortedByAddr, CConnman& connman)
+bool CSmartnodeMan::SendVerifyRequest(const CAddress& addr, CConnman& connman)
 {
-    if(netfulfilledman.HasFulfilledRequest(addr, strprintf("%s", NetMsgType::MNVERIFY)+"-request")) {
+    if(netfulfilledman.HasFulfilledRequest(addr, FULFILLED_MNVERIFY_REQUEST)) {
         // we already asked for verification, not a good idea to do this too often, skip it
         LogPrint("smartnode", "CSmartnodeMan::SendVerifyRequest -- too many requests, skipping... addr=%s\n", addr.ToString());
         return false;
@@ -1144,7 +1305,7 @@ void CSmartnodeMan::ProcessPendingMnvRequests(CConnman& connman)
 
     while (itPendingMNV != mapPendingMNV.end()) {
         bool fDone = connman.ForNode(itPendingMNV->first, [&](CNode* pnode) {
-            netfulfilledman.AddFulfilledRequest(pnode->addr, strprintf("%s", NetMsgType::MNVERIFY)+"-request");
+            netfulfilledman.AddFulfilledRequest(pnode->addr, FULFILLED_MNVERIFY_REQUEST);
             // use random nonce, store it and require node to reply with correct one later
             mWeAskedForVerification[pnode->addr] = itPendingMNV->second.second;
             LogPrint("smartnode", "-- verifying node using nonce %d addr=%s\n", itPendingMNV->second.second.nonce, pnode->addr.ToString());
@@ -1174,7 +1335,7 @@ void CSmartnodeMan::SendVerifyReply(CNode* pnode, CSmartnodeVerification& mnv, C
         return;
     }
 
-    if(netfulfilledman.HasFulfilledRequest(pnode->addr, strprintf("%s", NetMsgType::MNVERIFY)+"-reply")) {
+    if(netfulfilledman.HasFulfilledRequest(pnode->addr, FULFILLED_MNVERIFY_REPLY)) {
         // peer should not ask us that often
         LogPrintf("SmartnodeMan::SendVerifyReply -- ERROR: peer already asked me recently, peer=%d\n", pnode->id);
         Misbehaving(pnode->id, 20);
@@ -1202,7 +1363,7 @@ void CSmartnodeMan::SendVerifyReply(CNode* pnode, CSmartnodeVerification& mnv, C
     }
 
     connman.PushMessage(pnode, NetMsgType::MNVERIFY, mnv);
-    netfulfilledman.AddFulfilledRequest(pnode->addr, strprintf("%s", NetMsgType::MNVERIFY)+"-reply");
+    netfulfilledman.AddFulfilledRequest(pnode->addr, FULFILLED_MNVERIFY_REPLY);
 }
 
 void CSmartnodeMan::ProcessVerifyReply(CNode* pnode, CSmartnodeVerification& mnv)
@@ -1212,24 +1373,30 @@ void CSmartnodeMan::ProcessVerifyReply(CNode* pnode, CSmartnodeVerification& mnv
     std::string strError;
 
     // did we even ask for it? if that's the case we should have matching fulfilled request
-    if(!netfulfilledman.HasFulfilledRequest(pnode->addr, strprintf("%s", NetMsgType::MNVERIFY)+"-request")) {
+    if(!netfulfilledman.HasFulfilledRequest(pnode->addr, FULFILLED_MNVERIFY_REQUEST)) {
         LogPrintf("CSmartnodeMan::ProcessVerifyReply -- ERROR: we didn't ask for verification of %s, peer=%d\n", pnode->addr.ToString(), pnode->id);
         Misbehaving(pnode->id, 20);
         return;
     }
 
+    CSmartnodeVerification mnvRequested;
+    {
+        LOCK(cs);
+        mnvRequested = mWeAskedForVerification[pnode->addr];
+    }
+
     // Received nonce for a known address must match the one we sent
-    if(mWeAskedForVerification[pnode->addr].nonce != mnv.nonce) {
+    if(mnvRequested.nonce != mnv.nonce) {
         LogPrintf("CSmartnodeMan::ProcessVerifyReply -- ERROR: wrong nounce: requested=%d, received=%d, peer=%d\n",
-                    mWeAskedForVerification[pnode->addr].nonce, mnv.nonce, pnode->id);
+                    mnvRequested.nonce, mnv.nonce, pnode->id);
         Misbehaving(pnode->id, 20);
         return;
     }
 
     // Received nBlockHeight for a known address must match the one we sent
-    if(mWeAskedForVerification[pnode->addr].nBlockHeight != mnv.nBlockHeight) {
+    if(mnvRequested.nBlockHeight != mnv.nBlockHeight) {
         LogPrintf("CSmartnodeMan::ProcessVerifyReply -- ERROR: wrong nBlockHeight: requested=%d, received=%d, peer=%d\n",
-                    mWeAskedForVerification[pnode->addr].nBlockHeight, mnv.nBlockHeight, pnode->id);
+                    mnvRequested.nBlockHeight, mnv.nBlockHeight, pnode->id);
         Misbehaving(pnode->id, 20);
         return;
     }
@@ -1242,78 +1409,107 @@ void CSmartnodeMan::ProcessVerifyReply(CNode* pnode, CSmartnodeVerification& mnv
     }
 
     // we already verified this address, why node is spamming?
-    if(netfulfilledman.HasFulfilledRequest(pnode->addr, strprintf("%s", NetMsgType::MNVERIFY)+"-done")) {
+    if(netfulfilledman.HasFulfilledRequest(pnode->addr, FULFILLED_MNVERIFY_DONE)) {
         LogPrintf("CSmartnodeMan::ProcessVerifyReply -- ERROR: already verified %s recently\n", pnode->addr.ToString());
         Misbehaving(pnode->id, 20);
         return;
     }
 
-    {
-        LOCK(cs);
+    std::string strMessage1 = strprintf("%s%d%s", pnode->addr.ToString(false), mnv.nonce, blockHash.ToString());
 
-        CSmartnode* prealSmartnode = NULL;
-        std::vector<CSmartnode*> vpSmartnodesToBan;
-        std::string strMessage1 = strprintf("%s%d%s", pnode->addr.ToString(false), mnv.nonce, blockHash.ToString());
+    // smartnodes with the addr of the peer, their signatures get checked without cs
+    std::vector<std::pair<COutPoint, CPubKey> > vecCandidates;
+    CService addrSmartnode;
 
+    {
+        LOCK(cs);
         for (auto& mnpair : mapSmartnodes) {
             if(CAddress(mnpair.second.addr, NODE_NETWORK) == pnode->addr) {
-                if(CMessageSigner::VerifyMessage(mnpair.second.pubKeySmartnode, mnv.vchSig1, strMessage1, strError)) {
-                    // found it!
-                    prealSmartnode = &mnpair.second;
-                    if(!mnpair.second.IsPoSeVerified()) {
-                        mnpair.second.DecreasePoSeBanScore();
-                    }
-                    netfulfilledman.AddFulfilledRequest(pnode->addr, strprintf("%s", NetMsgType::MNVERIFY)+"-done");
-
-                    // we can only broadcast it if we are an activated smartnode
-                    if(activeSmartnode.outpoint == COutPoint()) continue;
-                    // update ...
-                    mnv.addr = mnpair.second.addr;
-                    mnv.vin1 = mnpair.second.vin;
-                    mnv.vin2 = CTxIn(activeSmartnode.outpoint);
-                    std::string strMessage2 = strprintf("%s%d%s%s%s", mnv.addr.ToString(false), mnv.nonce, blockHash.ToString(),
-                                            mnv.vin1.prevout.ToStringShort(), mnv.vin2.prevout.ToStringShort());
-                    // ... and sign it
-                    if(!CMessageSigner::SignMessage(strMessage2, mnv.vchSig2, activeSmartnode.keySmartnode)) {
-                        LogPrintf("SmartnodeMan::ProcessVerifyReply -- SignMessage() failed\n");
-                        return;
-                    }
+                vecCandidates.push_back(std::make_pair(mnpair.first, mnpair.second.pubKeySmartnode));
+                addrSmartnode = mnpair.second.addr;
+            }
+        }
+    }
 
-                    std::string strError;
+    std::vector<COutPoint> vecReal;
+    std::vector<COutPoint> vecToBan;
 
-                    if(!CMessageSigner::VerifyMessage(activeSmartnode.pubKeySmartnode, mnv.vchSig2, strMessage2, strError)) {
-                        LogPrintf("SmartnodeMan::ProcessVerifyReply -- VerifyMessage() failed, error: %s\n", strError);
-                        return;
-                    }
+    for (const auto& candidate : vecCandidates) {
+        if(CMessageSigner::VerifyMessage(candidate.second, mnv.vchSig1, strMessage1, strError)) {
+            // found it!
+            vecReal.push_back(candidate.first);
+        } else {
+            vecToBan.push_back(candidate.first);
+        }
+    }
 
-                    mWeAskedForVerification[pnode->addr] = mnv;
-                    mapSeenSmartnodeVerification.insert(std::make_pair(mnv.GetHash(), mnv));
-                    mnv.Relay();
+    // no real smartnode found?...
+    if(vecReal.empty()) {
+        // this should never be the case normally,
+        // only if someone is trying to game the system in some way or smth like that
+        LogPrintf("CSmartnodeMan::ProcessVerifyReply -- ERROR: no real smartnode found for addr %s\n", pnode->addr.ToString());
+        Misbehaving(pnode->id, 20);
+        return;
+    }
 
-                } else {
-                    vpSmartnodesToBan.push_back(&mnpair.second);
-                }
+    netfulfilledman.AddFulfilledRequest(pnode->addr, FULFILLED_MNVERIFY_DONE);
+
+    // we can only broadcast it if we are an activated smartnode
+    std::vector<CSmartnodeVerification> vecBroadcasts;
+
+    if(activeSmartnode.outpoint != COutPoint()) {
+        for (const COutPoint& outpoint : vecReal) {
+            // update ...
+            CSmartnodeVerification mnvBroadcast = mnv;
+            mnvBroadcast.addr = addrSmartnode;
+            mnvBroadcast.vin1 = CTxIn(outpoint);
+            mnvBroadcast.vin2 = CTxIn(activeSmartnode.outpoint);
+            std::string strMessage2 = strprintf("%s%d%s%s%s", mnvBroadcast.addr.ToString(false), mnvBroadcast.nonce, blockHash.ToString(),
+                                    mnvBroadcast.vin1.prevout.ToStringShort(), mnvBroadcast.vin2.prevout.ToStringShort());
+            // ... and sign it
+            if(!CMessageSigner::SignMessage(strMessage2, mnvBroadcast.vchSig2, activeSmartnode.keySmartnode)) {
+                LogPrintf("SmartnodeMan::ProcessVerifyReply -- SignMessage() failed\n");
+                return;
             }
+
+            if(!CMessageSigner::VerifyMessage(activeSmartnode.pubKeySmartnode, mnvBroadcast.vchSig2, strMessage2, strError)) {
+                LogPrintf("SmartnodeMan::ProcessVerifyReply -- VerifyMessage() failed, error: %s\n", strError);
+                return;
+            }
+
+            vecBroadcasts.push_back(mnvBroadcast);
         }
-        // no real smartnode found?...
-        if(!prealSmartnode) {
-            // this should never be the case normally,
-            // only if someone is trying to game the system in some way or smth like that
-            LogPrintf("CSmartnodeMan::ProcessVerifyReply -- ERROR: no real smartnode found for addr %s\n", pnode->addr.ToString());
-            Misbehaving(pnode->id, 20);
-            return;
+    }
+
+    {
+        LOCK(cs);
+
+        for (const COutPoint& outpoint : vecReal) {
+            CSmartnode* pmn = Find(outpoint);
+            if(pmn && !pmn->IsPoSeVerified()) {
+                pmn->DecreasePoSeBanScore();
+            }
         }
+
+        for (const CSmartnodeVerification& mnvBroadcast : vecBroadcasts) {
+            mWeAskedForVerification[pnode->addr] = mnvBroadcast;
+            mapSeenSmartnodeVerification.Insert(mnvBroadcast.GetHash(), mnvBroadcast);
+            mnvBroadcast.Relay();
+        }
+
         LogPrintf("CSmartnodeMan::ProcessVerifyReply -- verified real smartnode %s for addr %s\n",
-                    prealSmartnode->vin.prevout.ToStringShort(), pnode->addr.ToString());
+                    vecReal.back().ToStringShort(), pnode->addr.ToString());
         // increase ban score for everyone else
-        BOOST_FOREACH(CSmartnode* pmn, vpSmartnodesToBan) {
+        for (const COutPoint& outpoint : vecToBan) {
+            CSmartnode* pmn = Find(outpoint);
+            if(!pmn) continue;
             pmn->IncreasePoSeBanScore();
             LogPrint("smartnode", "CSmartnodeMan::ProcessVerifyReply -- increased PoSe ban score for %s addr %s, new score %d\n",
-                        prealSmartnode->vin.prevout.ToStringShort(), pnode->addr.ToString(), pmn->nPoSeBanScore);
+                        vecReal.back().ToStringShort(), pnode->addr.ToString(), pmn->nPoSeBanScore);
         }
-        if(!vpSmartnodesToBan.empty())
+        if(!vecToBan.empty())
             LogPrintf("CSmartnodeMan::ProcessVerifyReply -- PoSe score increased for %d fake smartnodes, addr %s\n",
-                        (int)vpSmartnodesToBan.size(), pnode->addr.ToString());
+                        (int)vecToBan.size(), pnode->addr.ToString());
     }
 }
 
@@ -1323,11 +1519,10 @@ void CSmartnodeMan::ProcessVerifyBroadcast(CNode* pnode, const CSmartnodeVerific
 
     std::string strError;
 
-    if(mapSeenSmartnodeVerification.find(mnv.GetHash()) != mapSeenSmartnodeVerification.end()) {
+    if(!mapSeenSmartnodeVerification.Insert(mnv.GetHash(), mnv)) {
         // we already have one
         return;
     }
-    mapSeenSmartnodeVerification[mnv.GetHash()] = mnv;
 
     // we don't care about history
     if(mnv.nBlockHeight < nCachedBlockHeight - MAX_POSE_BLOCKS) {
@@ -1366,13 +1561,15 @@ void CSmartnodeMan::ProcessVerifyBroadcast(CNode* pnode, const CSmartnodeVerific
         return;
     }
 
+    std::string strMessage1 = strprintf("%s%d%s", mnv.addr.ToString(false), mnv.nonce, blockHash.ToString());
+    std::string strMessage2 = strprintf("%s%d%s%s%s", mnv.addr.ToString(false), mnv.nonce, blockHash.ToString(),
+                            mnv.vin1.prevout.ToStringShort(), mnv.vin2.prevout.ToStringShort());
+    CPubKey pubKeySmartnode1;
+    CPubKey pubKeySmartnode2;
+
     {
         LOCK(cs);
 
-        std::string strMessage1 = strprintf("%s%d%s", mnv.addr.ToString(false), mnv.nonce, blockHash.ToString());
-        std::string strMessage2 = strprintf("%s%d%s%s%s", mnv.addr.ToString(false), mnv.nonce, blockHash.ToString(),
-                                mnv.vin1.prevout.ToStringShort(), mnv.vin2.prevout.ToStringShort());
-
         CSmartnode* pmn1 = Find(mnv.vin1.prevout);
         if(!pmn1) {
             LogPrintf("CSmartnodeMan::ProcessVerifyBroadcast -- can't find smartnode1 %s\n", mnv.vin1.prevout.ToStringShort());
@@ -1390,15 +1587,26 @@ void CSmartnodeMan::ProcessVerifyBroadcast(CNode* pnode, const CSmartnodeVerific
             return;
         }
 
-        if(!CMessageSigner::VerifyMessage(pmn1->pubKeySmartnode, mnv.vchSig1, strMessage1, strError)) {
-            LogPrintf("CSmartnodeMan::ProcessVerifyBroadcast -- VerifyMessage() for smartnode1 failed, error: %s\n", strError);
-            return;
-        }
+        pubKeySmartnode1 = pmn1->pubKeySmartnode;
+        pubKeySmartnode2 = pmn2->pubKeySmartnode;
+    }
 
-        if(!CMessageSigner::VerifyMessage(pmn2->pubKeySmartnode, mnv.vchSig2, strMessage2, strError)) {
-            LogPrintf("CSmartnodeMan::ProcessVerifyBroadcast -- VerifyMessage() for smartnode2 failed, error: %s\n", strError);
-            return;
-        }
+    // the signatures get checked without cs
+    if(!CMessageSigner::VerifyMessage(pubKeySmartnode1, mnv.vchSig1, strMessage1, strError)) {
+        LogPrintf("CSmartnodeMan::ProcessVerifyBroadcast -- VerifyMessage() for smartnode1 failed, error: %s\n", strError);
+        return;
+    }
+
+    if(!CMessageSigner::VerifyMessage(pubKeySmartnode2, mnv.vchSig2, strMessage2, strError)) {
+        LogPrintf("CSmartnodeMan::ProcessVerifyBroadcast -- VerifyMessage() for smartnode2 failed, error: %s\n", strError);
+        return;
+    }
+
+    {
+        LOCK(cs);
+
+        CSmartnode* pmn1 = Find(mnv.vin1.prevout);
+        if(!pmn1 || pmn1->addr != mnv.addr) return;
 /*
         //Check if the SAPI port is open before decreasing SmartNode PoSe score.
         CService nodeAddr;
@@ -1472,10 +1680,84 @@ std::string CSmartnodeMan::ToString() const
     return info.str();
 }
 
+void CSmartnodeMan::GetMemoryUsage(memusage::ComponentUsage& usage)
+{
+    {
+        LOCK(cs);
+
+        size_t nSmartnodes = memusage::DynamicUsage(mapSmartnodes);
+        for (const auto& mnpair : mapSmartnodes) {
+            nSmartnodes += mnpair.second.DynamicMemoryUsage();
+        }
+        usage.emplace_back("smartnodes", nSmartnodes);
+
+        size_t nListRequests = memusage::DynamicUsage(mAskedUsForSmartnodeList) + memusage::DynamicUsage(mWeAskedForSmartnodeList) +
+                               memusage::DynamicUsage(mWeAskedForSmartnodeListEntry) + memusage::DynamicUsage(mWeAskedForVerification);
+        for (const auto& entry : mWeAskedForSmartnodeListEntry) {
+            nListRequests += memusage::DynamicUsage(entry.second);
+        }
+        for (const auto& mnv : mWeAskedForVerification) {
+            nListRequests += mnv.second.DynamicMemoryUsage();
+        }
+        usage.emplace_back("list_requests", nListRequests);
+
+        size_t nRecovery = memusage::DynamicUsage(mMnbRecoveryRequests) + memusage::DynamicUsage(mMnbRecoveryGoodReplies) +
+                           memusage::DynamicUsage(listScheduledMnbRequestConnections) + memusage::DynamicUsage(mapPendingMNB);
+        for (const auto& request : mMnbRecoveryRequests) {
+            nRecovery += memusage::DynamicUsage(request.second.second);
+        }
+        for (const auto& replies : mMnbRecoveryGoodReplies) {
+            nRecovery += memusage::DynamicUsage(replies.second);
+            for (const CSmartnodeBroadcast& mnb : replies.second) {
+                nRecovery += mnb.DynamicMemoryUsage();
+            }
+        }
+        for (const auto& pending : mapPendingMNB) {
+            nRecovery += memusage::DynamicUsage(pending.second.second);
+        }
+        usage.emplace_back("mnb_recovery", nRecovery);
+
+        size_t nRankCache = memusage::DynamicUsage(mapRankCache) + memusage::DynamicUsage(mapCountCache);
+        for (const auto& ranks : mapRankCache) {
+            nRankCache += memusage::DynamicUsage(ranks.second.vecRanks) + memusage::DynamicUsage(ranks.second.mapRanks);
+        }
+        usage.emplace_back("rank_cache", nRankCache);
+
+        // The readers of the snapshot might keep an older one alive, only the current one is counted
+        size_t nSnapshot = 0;
+        if (snapshot) {
+            nSnapshot = memusage::MallocUsage(sizeof(*snapshot)) + memusage::DynamicUsage(*snapshot);
+            for (const CSmartnode& mn : *snapshot) {
+                nSnapshot += mn.DynamicMemoryUsage();
+            }
+        }
+        usage.emplace_back("snapshot", nSnapshot);
+
+        size_t nSeenBroadcasts = memusage::DynamicUsage(mapSeenSmartnodeBroadcast);
+        for (const auto& mnb : mapSeenSmartnodeBroadcast) {
+            nSeenBroadcasts += mnb.second.second.DynamicMemoryUsage();
+        }
+        usage.emplace_back("seen_broadcasts", nSeenBroadcasts);
+    }
+
+    {
+        LOCK(cs_mapPendingMNV);
+        size_t nPendingVerifications = memusage::DynamicUsage(mapPendingMNV);
+        for (const auto& pending : mapPendingMNV) {
+            nPendingVerifications += pending.second.second.DynamicMemoryUsage();
+        }
+        usage.emplace_back("pending_verifications", nPendingVerifications);
+    }
+
+    // Sharded with their own locks
+    usage.emplace_back("seen_pings", mapSeenSmartnodePing.DynamicMemoryUsage());
+    usage.emplace_back("seen_verifications", mapSeenSmartnodeVerification.DynamicMemoryUsage());
+}
+
 void CSmartnodeMan::UpdateSmartnodeList(CSmartnodeBroadcast mnb, CConnman& connman)
 {
     LOCK2(cs_main, cs);
-    mapSeenSmartnodePing.insert(std::make_pair(mnb.lastPing.GetHash(), mnb.lastPing));
+    mapSeenSmartnodePing.Insert(mnb.lastPing.GetHash(), mnb.lastPing);
     mapSeenSmartnodeBroadcast.insert(std::make_pair(mnb.GetHash(), std::make_pair(GetTime(), mnb)));
 
     LogPrintf("CSmartnodeMan::UpdateSmartnodeList -- smartnode=%s  addr=%s\n", mnb.vin.prevout.ToStringShort(), mnb.addr.ToString());
@@ -1671,7 +1953,7 @@ void CSmartnodeMan::SetSmartnodeLastPing(const COutPoint& outpoint, const CSmart
     }
     pmn->lastPing = mnp;
 
-    mapSeenSmartnodePing.insert(std::make_pair(mnp.GetHash(), mnp));
+    mapSeenSmartnodePing.Insert(mnp.GetHash(), mnp);
 
     CSmartnodeBroadcast mnb(*pmn);
     uint256 hash = mnb.GetHash();
@@ -1685,6 +1967,8 @@ void CSmartnodeMan::UpdatedBlockTip(const CBlockIndex *pindex)
     nCachedBlockHeight = pindex->nHeight;
     LogPrint("smartnode", "CSmartnodeMan::UpdatedBlockTip -- nCachedBlockHeight=%d\n", nCachedBlockHeight);
 
+    NotifyStateChanged();
+
     CheckSameAddr();
 
     if(fSmartNode) {
@@ -1712,7 +1996,18 @@ void CSmartnodeMan::NotifySmartnodeUpdates(CConnman& connman)
     //     governance.UpdateCachesAndClean();
     // }
 
-    LOCK(cs);
-    fSmartnodesAdded = false;
-    fSmartnodesRemoved = false;
+    bool fAdded, fRemoved;
+    int nCount;
+    {
+        LOCK(cs);
+        fAdded = fSmartnodesAdded;
+        fRemoved = fSmartnodesRemoved;
+        nCount = mapSmartnodes.size();
+        fSmartnodesAdded = false;
+        fSmartnodesRemoved = false;
+    }
+
+    if(fAdded || fRemoved) {
+        GetMainSignals().NotifySmartnodeListChanged(nCount, fAdded, fRemoved);
+    }
 }
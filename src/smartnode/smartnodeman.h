@@ -6,8 +6,14 @@
 #define SMARTNODEMAN_H
 
 #include "smartnode.h"
+#include "smartnodeseen.h"
+#include "../changefeed.h"
 #include "../sync.h"
 
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+
 using namespace std;
 
 class CSmartnodeMan;
@@ -16,6 +22,51 @@ struct CSmartNodeWinners;
 
 extern CSmartnodeMan mnodeman;
 
+/// Short ids of the broadcasts and pings of the list a node already has. Sent
+/// with DSEGDELTA instead of DSEG to only get the entries which changed.
+class CSmartnodeListDigest
+{
+    std::unordered_set<uint64_t> setShortIds;
+
+public:
+    /// Two short ids per smartnode
+    static const size_t MAX_SHORT_IDS = 200000;
+
+    uint64_t nKey0;
+    uint64_t nKey1;
+    std::vector<uint64_t> vecShortIds;
+
+    CSmartnodeListDigest() : nKey0(0), nKey1(0) {}
+    CSmartnodeListDigest(uint64_t nKey0, uint64_t nKey1) : nKey0(nKey0), nKey1(nKey1) {}
+
+    uint64_t GetShortId(const uint256& hash) const { return SipHashUint256(nKey0, nKey1, hash); }
+    /// Only valid for a received digest
+    bool Contains(const uint256& hash) const { return setShortIds.count(GetShortId(hash)); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nKey0);
+        READWRITE(nKey1);
+        READWRITE(vecShortIds);
+        if(ser_action.ForRead()) {
+            setShortIds = std::unordered_set<uint64_t>(vecShortIds.begin(), vecShortIds.end());
+        }
+    }
+};
+
+/// Seen pings are bucketed by the minute they were signed
+struct CSmartnodePingBucket {
+    static const int64_t BUCKET_SECONDS = 60;
+    int64_t operator()(const CSmartnodePing& mnp) const { return mnp.sigTime / BUCKET_SECONDS; }
+};
+
+/// Seen verifications are bucketed by their block height
+struct CSmartnodeVerificationBucket {
+    int64_t operator()(const CSmartnodeVerification& mnv) const { return mnv.nBlockHeight; }
+};
+
 class CSmartnodeMan
 {
 public:
@@ -23,6 +74,7 @@ public:
     typedef std::vector<score_pair_t> score_pair_vec_t;
     typedef std::pair<int, CSmartnode> rank_pair_t;
     typedef std::vector<rank_pair_t> rank_pair_vec_t;
+    typedef std::shared_ptr<const std::vector<CSmartnode> > snapshot_t;
 
 private:
     static const std::string SERIALIZATION_VERSION_STRING;
@@ -42,6 +94,16 @@ private:
     static const int MNB_RECOVERY_WAIT_SECONDS      = 60;
     static const int MNB_RECOVERY_RETRY_SECONDS     = 3 * 60 * 60;
 
+    static const size_t RANK_CACHE_MAX_ENTRIES      = 16;
+    // pings only update the last seen times, a snapshot lives that long without list or state changes
+    static const int SNAPSHOT_MAX_AGE_SECONDS       = 10;
+
+    /// Ranks of the smartnodes for one block and minimum protocol, ordered by rank
+    struct CSmartnodeRanks {
+        std::vector<std::pair<int, COutPoint> > vecRanks;
+        std::unordered_map<COutPoint, int, SaltedOutpointHasher> mapRanks;
+    };
+
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
 
@@ -77,19 +139,42 @@ private:
 
     int64_t nLastWatchdogVoteTime;
 
+    /// Rank cache by (block hash, min protocol), requires cs_main and cs
+    std::map<std::pair<uint256, int>, CSmartnodeRanks> mapRankCache;
+    /// Value of nStateChanges the cached ranks were calculated with
+    uint64_t nRankCacheChanges;
+    /// Smartnode and enabled counts by protocol version, requires cs
+    std::map<int, std::pair<int, int> > mapCountCache;
+    uint64_t nCountCacheChanges;
+    /// Shared read only copy of the list, requires cs
+    snapshot_t snapshot;
+    uint64_t nSnapshotChanges;
+    int64_t nSnapshotTime;
+    /// Bumped by every change of the list or of a smartnode state or protocol,
+    /// lock free because smartnodes bump it under their own cs
+    std::atomic<uint64_t> nStateChanges;
+    /// The same changes for the RPC clients waiting on them
+    CChangeFeed listFeed;
+
     friend class CSmartnodeSync;
     /// Find an entry
     CSmartnode* Find(const COutPoint& outpoint);
 
     bool GetSmartnodeScores(const uint256& nBlockHash, score_pair_vec_t& vecSmartnodeScoresRet, int nMinProtocol = 0);
+    /// Get the cached ranks or calculate them, requires cs_main and cs
+    const CSmartnodeRanks* GetRanks(int nBlockHeight, int nMinProtocol);
+    /// Short ids of our list for a DSEGDELTA request, requires cs
+    CSmartnodeListDigest GetListDigest();
+    /// Get the cached (smartnodes, enabled) counts with at least the protocol or count them, requires cs
+    std::pair<int, int> GetCounts(int nProtocolVersion);
 
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, std::pair<int64_t, CSmartnodeBroadcast> > mapSeenSmartnodeBroadcast;
-    // Keep track of all pings I've seen
-    std::map<uint256, CSmartnodePing> mapSeenSmartnodePing;
-    // Keep track of all verifications I've seen
-    std::map<uint256, CSmartnodeVerification> mapSeenSmartnodeVerification;
+    // Keep track of all pings I've seen, locks on its own
+    CSeenSmartnodeMessages<CSmartnodePing, CSmartnodePingBucket> mapSeenSmartnodePing;
+    // Keep track of all verifications I've seen, locks on its own
+    CSeenSmartnodeMessages<CSmartnodeVerification, CSmartnodeVerificationBucket> mapSeenSmartnodeVerification;
     // keep track of dsq count to prevent smartnodes from gaming darksend queue
     int64_t nDsqCount;
 
@@ -122,10 +207,18 @@ public:
         if(ser_action.ForRead() && (strVersion != SERIALIZATION_VERSION_STRING)) {
             Clear();
         }
+        if(ser_action.ForRead()) {
+            NotifyStateChanged();
+        }
     }
 
     CSmartnodeMan();
 
+    /// Keep contention statistics of cs, see getlockstats
+    void RegisterLockStats() { ::RegisterLockStats(cs, "mnodeman.cs"); }
+    /// Heap usage of the list, the request tracking and the seen messages
+    void GetMemoryUsage(memusage::ComponentUsage& usage);
+
     /// Add an entry
     bool Add(CSmartnode &mn);
 
@@ -159,9 +252,11 @@ public:
 
     /// Count Smartnodes by network type - NET_IPV4, NET_IPV6, NET_TOR
     // int CountByIP(int nNetworkType);
-    void SyncAll(CNode* pnode, CConnman& connman);
+    /// Push the whole list or, with the digest of the peer, only the entries it doesn't have
+    void SyncAll(CNode* pnode, CConnman& connman, const CSmartnodeListDigest* pDigest = NULL);
     void SyncSingle(CNode* pnode, const COutPoint& outpoint, CConnman& connman);
-    void PushDsegInvs(CNode* pnode, const CSmartnode& mn);
+    /// Returns the number of invs pushed, none for the ones in the digest
+    int PushDsegInvs(CNode* pnode, const CSmartnode& mn, const CSmartnodeListDigest* pDigest = NULL);
     void DsegUpdate(CNode* pnode, CConnman& connman);
 
     /// Versions of Find that are safe to use from outside the class
@@ -177,11 +272,15 @@ public:
     /// Same as above but use current block height
     bool GetNextSmartnodesInQueueForPayment(bool fFilterSigTime, int& nCountRet, CSmartNodeWinners& mnInfoRet);
 
-    /// Find a random entry
-    std::map<COutPoint, CSmartnode> GetFullSmartnodeMap() { return mapSmartnodes; }
+    /// Read only copy of the list in outpoint order for RPC, SAPI and Qt, shared by all callers until it gets outdated
+    snapshot_t GetSmartnodeSnapshot();
 
     bool GetSmartnodeRanks(rank_pair_vec_t& vecSmartnodeRanksRet, int nBlockHeight = -1, int nMinProtocol = 0);
     bool GetSmartnodeRank(const COutPoint &outpoint, int& nRankRet, int nBlockHeight = -1, int nMinProtocol = 0);
+    /// Drop the cached ranks, counts and the snapshot, on changes of the list and of the smartnode states
+    void NotifyStateChanged() { ++nStateChanges; listFeed.Notify(); }
+    /// Bumped with NotifyStateChanged, pings don't count as changes
+    CChangeFeed& GetListFeed() { return listFeed; }
 
     void ProcessSmartnodeConnections(CConnman& connman);
     std::pair<CService, std::set<uint256> > PopScheduledMnbRequestConnection();
@@ -192,7 +291,7 @@ public:
 
     void DoFullVerificationStep(CConnman& connman);
     void CheckSameAddr();
-    bool SendVerifyRequest(const CAddress& addr, const std::vector<CSmartnode*>& vSortedByAddr, CConnman& connman);
+    bool SendVerifyRequest(const CAddress& addr, CConnman& connman);
     void SendVerifyReply(CNode* pnode, CSmartnodeVerification& mnv, CConnman& connman);
     void ProcessVerifyReply(CNode* pnode, CSmartnodeVerification& mnv);
     void ProcessVerifyBroadcast(CNode* pnode, const CSmartnodeVerification& mnv);
@@ -4,6 +4,7 @@
 
 #include "activesmartnode.h"
 #include "base58.h"
+#include "core_memusage.h"
 #include "smartnodepayments.h"
 #include "smartnodesync.h"
 #include "smartnodeman.h"
@@ -99,7 +100,7 @@ CAmount SmartNodePayments::Payment(int nHeight)
             if( nHeight % interval ){
                 blockValue = 0;
             }else{
-                while( interval-- ) blockValue += GetBlockValue(nHeight--,0,INT_MAX);
+                blockValue = GetBlockValueSum(nHeight - interval + 1, nHeight);
             }
 
         }
@@ -115,7 +116,7 @@ CAmount SmartNodePayments::Payment(int nHeight)
             if( nHeight % interval ){
                 blockValue = 0;
             }else{
-                while( interval-- ) blockValue += GetBlockValue(nHeight--,0,INT_MAX);
+                blockValue = GetBlockValueSum(nHeight - interval + 1, nHeight);
             }
 
         }
@@ -125,15 +126,17 @@ CAmount SmartNodePayments::Payment(int nHeight)
     return blockValue/10; // start at 10%
 }
 
-bool SmartNodePayments::IsPaymentValid(const CTransaction& txNew, int nHeight, CAmount blockReward, CAmount& nodeReward)
+bool SmartNodePayments::IsPaymentValid(const CCoinbaseOutputs& outputs, int nHeight, CAmount blockReward, CAmount& nodeReward)
 {
+    const CTransaction& txNew = outputs.GetTransaction();
+
     nodeReward = SmartNodePayments::Payment(nHeight);
 
     if( MainNet() ){
 
         if( nHeight >= HF_V1_1_SMARTNODE_HEIGHT + 7000 && nHeight < HF_V1_2_MULTINODE_VOTING_HEIGHT ){
 
-            BOOST_FOREACH(CTxOut txout, txNew.vout) {
+            BOOST_FOREACH(const CTxOut& txout, txNew.vout) {
                 if (abs(txout.nValue - nodeReward) < 2) {
                     nodeReward = txout.nValue;
                     LogPrint("mnpayments", "CSmartnodeBlockPayees::IsTransactionValid -- Found required payment: %s\n",txout.ToString());
@@ -168,7 +171,7 @@ bool SmartNodePayments::IsPaymentValid(const CTransaction& txNew, int nHeight, C
         return true;
     }
 
-    if(mnpayments.IsTransactionValid(txNew, nHeight, nodeReward)) {
+    if(mnpayments.IsTransactionValid(outputs, nHeight, nodeReward)) {
         LogPrint("mnpayments", "SmartNodePayments::IsPaymetValid -- Valid smartnode payment at height %d: %s", nHeight, txNew.ToString());
         return true;
     }
@@ -202,9 +205,39 @@ void CSmartnodePayments::Clear()
 {
     LOCK2(cs_mapSmartnodeBlocks, cs_mapSmartnodePaymentVotes);
     mapSmartnodeBlocks.clear();
+    mapPayeeBlocks.clear();
     mapSmartnodePaymentVotes.clear();
 }
 
+void CSmartnodePayments::RebuildPayeeIndex()
+{
+    LOCK(cs_mapSmartnodeBlocks);
+
+    mapPayeeBlocks.clear();
+
+    for (auto& block : mapSmartnodeBlocks) {
+        IndexBlockPayees(block.second, true);
+    }
+}
+
+void CSmartnodePayments::IndexBlockPayees(CSmartnodeBlockPayees& blockPayees, bool fAdd)
+{
+    CScriptVector payees;
+    if(!blockPayees.GetBestPayees(payees)) return;
+
+    for (const CScript& payee : payees) {
+        if(fAdd) {
+            mapPayeeBlocks[payee].insert(blockPayees.nBlockHeight);
+            continue;
+        }
+
+        auto it = mapPayeeBlocks.find(payee);
+        if(it == mapPayeeBlocks.end()) continue;
+        it->second.erase(blockPayees.nBlockHeight);
+        if(it->second.empty()) mapPayeeBlocks.erase(it);
+    }
+}
+
 bool CSmartnodePayments::UpdateLastVote(const CSmartnodePaymentVote& vote)
 {
     LOCK(cs_mapSmartnodePaymentVotes);
@@ -350,14 +383,14 @@ void CSmartnodePayments::ProcessMessage(CNode* pfrom, std::string& strCommand, C
         int nCountNeeded;
         vRecv >> nCountNeeded;
 
-        if(netfulfilledman.HasFulfilledRequest(pfrom->addr, NetMsgType::SMARTNODEPAYMENTSYNC)) {
+        if(netfulfilledman.HasFulfilledRequest(pfrom->addr, FULFILLED_SMARTNODE_PAYMENT_SYNC_REPLY)) {
             LOCK(cs_main);
             // Asking for the payments list multiple times in a short period of time is no good
             LogPrintf("SMARTNODEPAYMENTSYNC -- peer already asked me for the list, peer=%d\n", pfrom->id);
             Misbehaving(pfrom->GetId(), 20);
             return;
         }
-        netfulfilledman.AddFulfilledRequest(pfrom->addr, NetMsgType::SMARTNODEPAYMENTSYNC);
+        netfulfilledman.AddFulfilledRequest(pfrom->addr, FULFILLED_SMARTNODE_PAYMENT_SYNC_REPLY);
 
         Sync(pfrom, connman);
         LogPrintf("SMARTNODEPAYMENTSYNC -- Sent Smartnode payment votes to peer %d\n", pfrom->id);
@@ -376,7 +409,7 @@ void CSmartnodePayments::ProcessMessage(CNode* pfrom, std::string& strCommand, C
 
         uint256 nHash = vote.GetHash();
 
-        pfrom->setAskFor.erase(nHash);
+        pfrom->RemoveAskFor(nHash);
 
         // TODO: clear setAskFor for MSG_SMARTNODE_PAYMENT_BLOCK too
 
@@ -498,20 +531,49 @@ bool CSmartnodePayments::IsScheduled(CSmartnode& mn, int nNotBlockHeight)
     CScript mnpayee;
     mnpayee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
 
-    CScriptVector payees;
+    auto it = mapPayeeBlocks.find(mnpayee);
+    if(it == mapPayeeBlocks.end()) return false;
+
+    int nLastHeight = GetLastScheduledHeight();
+
+    for(auto itHeight = it->second.lower_bound(nCachedBlockHeight); itHeight != it->second.end() && *itHeight <= nLastHeight; ++itHeight) {
+        if(*itHeight != nNotBlockHeight) return true;
+    }
+
+    return false;
+}
+
+int CSmartnodePayments::GetLastScheduledHeight() const
+{
+    // The look ahead ends one payout interval after the future votes, with the interval of the block before
     int interval = SmartNodePayments::PayoutInterval(nCachedBlockHeight);
+    int64_t h = nCachedBlockHeight;
 
-    for(int64_t h = nCachedBlockHeight; h <= nCachedBlockHeight + MNPAYMENTS_FUTURE_VOTES + interval - 1; h++){
+    while(h <= nCachedBlockHeight + MNPAYMENTS_FUTURE_VOTES + interval - 1) {
         interval = SmartNodePayments::PayoutInterval(h);
-        if(h == nNotBlockHeight) continue;
-        if(mapSmartnodeBlocks.count(h) &&
-           mapSmartnodeBlocks[h].GetBestPayees(payees) &&
-           std::find(payees.begin(),payees.end(), mnpayee) != payees.end() ) {
-            return true;
-        }
+        h++;
     }
 
-    return false;
+    return h - 1;
+}
+
+void CSmartnodePayments::GetScheduledPayees(int nNotBlockHeight, std::set<CScript>& setPayeesRet)
+{
+    LOCK(cs_mapSmartnodeBlocks);
+
+    setPayeesRet.clear();
+
+    if(!smartnodeSync.IsSmartnodeListSynced()) return;
+
+    CScriptVector payees;
+    int nLastHeight = GetLastScheduledHeight();
+
+    for(auto it = mapSmartnodeBlocks.lower_bound(nCachedBlockHeight); it != mapSmartnodeBlocks.end() && it->first <= nLastHeight; ++it) {
+        if(it->first == nNotBlockHeight) continue;
+        if(it->second.GetBestPayees(payees)) {
+            setPayeesRet.insert(payees.begin(), payees.end());
+        }
+    }
 }
 
 bool CSmartnodePayments::AddOrUpdatePaymentVote(const CSmartnodePaymentVote& vote)
@@ -528,7 +590,9 @@ bool CSmartnodePayments::AddOrUpdatePaymentVote(const CSmartnodePaymentVote& vot
     mapSmartnodePaymentVotes[nVoteHash] = vote;
 
     auto it = mapSmartnodeBlocks.emplace(vote.nBlockHeight, CSmartnodeBlockPayees(vote.nBlockHeight)).first;
+    IndexBlockPayees(it->second, false);
     it->second.AddPayees(vote);
+    IndexBlockPayees(it->second, true);
 
     LogPrint("mnpayments", "CSmartnodePayments::AddOrUpdatePaymentVote -- added, nHeight=%d, hash=%s\n",it->second.nBlockHeight, nVoteHash.ToString());
 
@@ -567,12 +631,32 @@ void CSmartnodeBlockPayees::AddPayees(const CSmartnodePaymentVote& vote)
             vecPayees.push_back(payeeNew);
         }
     }
+
+    SortPayees();
+    fBestPayeesCached = false;
+}
+
+void CSmartnodeBlockPayees::SortPayees()
+{
+    // Stable, the payees of one vote share their first vote hash
+    std::stable_sort(vecPayees.begin(), vecPayees.end(), CompareBlockPayees());
 }
 
 bool CSmartnodeBlockPayees::GetBestPayees(CScriptVector& payeesRet)
 {
     LOCK(cs_vecPayees);
 
+    if(!fBestPayeesCached) {
+        fHasBestPayees = FindBestPayees(vecBestPayees);
+        fBestPayeesCached = true;
+    }
+
+    payeesRet = vecBestPayees;
+    return fHasBestPayees;
+}
+
+bool CSmartnodeBlockPayees::FindBestPayees(CScriptVector& payeesRet) const
+{
     payeesRet.clear();
 
     size_t expectedPayees = SmartNodePayments::PayoutsPerBlock(nBlockHeight);
@@ -587,9 +671,7 @@ bool CSmartnodeBlockPayees::GetBestPayees(CScriptVector& payeesRet)
         return false;
     }
 
-    sort(vecPayees.begin(), vecPayees.end(), CompareBlockPayees());
-
-    BOOST_FOREACH(CSmartnodePayee& payee, vecPayees) {
+    BOOST_FOREACH(const CSmartnodePayee& payee, vecPayees) {
         LogPrint("mnpayments", "CSmartnodeBlockPayees::GetBestPayee -- Loop votes %d - payeesRet %d\n",payee.GetVoteCount(),payeesRet.size());
         if (payee.GetVoteCount() > -1 ) {
             payeesRet.push_back(payee.GetPayee());
@@ -599,6 +681,7 @@ bool CSmartnodeBlockPayees::GetBestPayees(CScriptVector& payeesRet)
             return true;
     }
 
+    payeesRet.clear();
     return false;
 }
 
@@ -616,7 +699,7 @@ bool CSmartnodeBlockPayees::HasPayeeWithVotes(const CScript& payeeIn, int nVotes
     return false;
 }
 
-bool CSmartnodeBlockPayees::IsTransactionValid(const CTransaction& txNew, CAmount expectedNodeReward)
+bool CSmartnodeBlockPayees::IsTransactionValid(const CCoinbaseOutputs& outputs, CAmount expectedNodeReward)
 {
     LOCK(cs_vecPayees);
 
@@ -646,12 +729,12 @@ bool CSmartnodeBlockPayees::IsTransactionValid(const CTransaction& txNew, CAmoun
 
     BOOST_FOREACH(CSmartnodePayee& payee, vecPayees) {
         if (payee.GetVoteCount() >= MNPAYMENTS_SIGNATURES_REQUIRED) {
-            BOOST_FOREACH(CTxOut txout, txNew.vout) {
-                if (txout.scriptPubKey == payee.GetPayee() && abs(txout.nValue - expectedPerNode) < 2 ) {
-                    LogPrint("mnpayments", "CSmartnodeBlockPayees::IsTransactionValid -- Found required payment: %s\n",txout.ToString());
-                    foundPayees++;
-                    break;
-                }
+            int nIndex = outputs.Find(payee.GetPayee(), [expectedPerNode](const CTxOut& txout) {
+                return abs(txout.nValue - expectedPerNode) < 2;
+            });
+            if (nIndex >= 0) {
+                LogPrint("mnpayments", "CSmartnodeBlockPayees::IsTransactionValid -- Found required payment: %s\n",outputs[nIndex].ToString());
+                foundPayees++;
             }
 
             CTxDestination address1;
@@ -794,12 +877,12 @@ UniValue CSmartnodePayments::GetPaymentBlockObject(int nHeight)
     return obj;
 }
 
-bool CSmartnodePayments::IsTransactionValid(const CTransaction& txNew, int nBlockHeight, CAmount expectedNodeReward)
+bool CSmartnodePayments::IsTransactionValid(const CCoinbaseOutputs& outputs, int nBlockHeight, CAmount expectedNodeReward)
 {
     LOCK(cs_mapSmartnodeBlocks);
 
     if(mapSmartnodeBlocks.count(nBlockHeight)){
-        return mapSmartnodeBlocks[nBlockHeight].IsTransactionValid(txNew, expectedNodeReward);
+        return mapSmartnodeBlocks[nBlockHeight].IsTransactionValid(outputs, expectedNodeReward);
     }
 
     return true;
@@ -820,7 +903,11 @@ void CSmartnodePayments::CheckAndRemove()
         if(nCachedBlockHeight - vote.nBlockHeight > nLimit) {
             LogPrint("mnpayments", "CSmartnodePayments::CheckAndRemove -- Removing old Smartnode payment: nBlockHeight=%d\n", vote.nBlockHeight);
             mapSmartnodePaymentVotes.erase(it++);
-            mapSmartnodeBlocks.erase(vote.nBlockHeight);
+            auto itBlock = mapSmartnodeBlocks.find(vote.nBlockHeight);
+            if(itBlock != mapSmartnodeBlocks.end()) {
+                IndexBlockPayees(itBlock->second, false);
+                mapSmartnodeBlocks.erase(itBlock);
+            }
         } else {
             ++it;
         }
@@ -1182,6 +1269,58 @@ std::string CSmartnodePayments::ToString() const
     return info.str();
 }
 
+void CSmartnodePayments::GetMemoryUsage(memusage::ComponentUsage& usage)
+{
+    {
+        LOCK(cs_mapSmartnodeBlocks);
+        size_t nBlocks = memusage::DynamicUsage(mapSmartnodeBlocks);
+        for (const auto& block : mapSmartnodeBlocks) {
+            nBlocks += block.second.DynamicMemoryUsage();
+        }
+        usage.emplace_back("block_payees", nBlocks);
+
+        size_t nPayeeIndex = memusage::DynamicUsage(mapPayeeBlocks);
+        for (const auto& payee : mapPayeeBlocks) {
+            nPayeeIndex += RecursiveDynamicUsage(payee.first) + memusage::DynamicUsage(payee.second);
+        }
+        usage.emplace_back("payee_index", nPayeeIndex);
+    }
+
+    LOCK(cs_mapSmartnodePaymentVotes);
+    size_t nVotes = memusage::DynamicUsage(mapSmartnodePaymentVotes);
+    for (const auto& vote : mapSmartnodePaymentVotes) {
+        nVotes += vote.second.DynamicMemoryUsage();
+    }
+    usage.emplace_back("votes", nVotes);
+    usage.emplace_back("last_votes", memusage::DynamicUsage(mapSmartnodesLastVote) + memusage::DynamicUsage(mapSmartnodesDidNotVote));
+}
+
+size_t CSmartnodePayee::DynamicMemoryUsage() const
+{
+    return RecursiveDynamicUsage(scriptPubKey) + memusage::DynamicUsage(vecVoteHashes);
+}
+
+size_t CSmartnodeBlockPayees::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(vecPayees) + memusage::DynamicUsage(vecBestPayees);
+    for (const CSmartnodePayee& payee : vecPayees) {
+        nUsage += payee.DynamicMemoryUsage();
+    }
+    for (const CScript& script : vecBestPayees) {
+        nUsage += RecursiveDynamicUsage(script);
+    }
+    return nUsage;
+}
+
+size_t CSmartnodePaymentVote::DynamicMemoryUsage() const
+{
+    size_t nUsage = RecursiveDynamicUsage(vinSmartnode) + memusage::DynamicUsage(payees) + memusage::DynamicUsage(vchSig);
+    for (const CScript& script : payees) {
+        nUsage += RecursiveDynamicUsage(script);
+    }
+    return nUsage;
+}
+
 bool CSmartnodePayments::IsEnoughData()
 {
     int expectedPayees = SmartNodePayments::PayoutsPerBlock(nCachedBlockHeight);
@@ -10,6 +10,7 @@
 #include "../key.h"
 #include "../net_processing.h"
 #include "smartnode.h"
+#include "../smartmining/coinbaseoutputs.h"
 #include "../utilstrencodings.h"
 
 class CSmartnodePayments;
@@ -34,7 +35,7 @@ int PayoutInterval(int nHeight);
 int PayoutsPerBlock(int nHeight);
 
 bool IsBlockValueValid(const CBlock& block, int nBlockHeight, CAmount blockReward, std::string &strErrorRet);
-bool IsPaymentValid(const CTransaction& txNew, int nBlockHeight, CAmount blockReward, CAmount& nodeReward);
+bool IsPaymentValid(const CCoinbaseOutputs& outputs, int nBlockHeight, CAmount blockReward, CAmount& nodeReward);
 void FillPayments(CMutableTransaction& txNew, int nBlockHeight, CAmount blockReward, std::vector<CTxOut>& voutSmartNodes);
 std::string GetRequiredPaymentsString(int nBlockHeight);
 UniValue GetPaymentBlockObject(int nBlockHeight);
@@ -90,20 +91,37 @@ public:
     void AddVoteHash(uint256 hashIn) { vecVoteHashes.push_back(hashIn); }
     std::vector<uint256> GetVoteHashes() const { return vecVoteHashes; }
     int GetVoteCount() const { return vecVoteHashes.size(); }
+
+    size_t DynamicMemoryUsage() const;
 };
 
 // Keep track of votes for payees from smartnodes
 class CSmartnodeBlockPayees
 {
+private:
+    // Winners of the block, only computed again after a vote came in
+    bool fBestPayeesCached;
+    bool fHasBestPayees;
+    CScriptVector vecBestPayees;
+
+    bool FindBestPayees(CScriptVector& payeesRet) const;
+
 public:
     int nBlockHeight;
+    // Sorted by CompareBlockPayees
     std::vector<CSmartnodePayee> vecPayees;
 
     CSmartnodeBlockPayees() :
+        fBestPayeesCached(false),
+        fHasBestPayees(false),
+        vecBestPayees(),
         nBlockHeight(0),
         vecPayees()
         {}
     CSmartnodeBlockPayees(int nBlockHeightIn) :
+        fBestPayeesCached(false),
+        fHasBestPayees(false),
+        vecBestPayees(),
         nBlockHeight(nBlockHeightIn),
         vecPayees()
         {}
@@ -114,16 +132,24 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         READWRITE(nBlockHeight);
         READWRITE(vecPayees);
+        if(ser_action.ForRead()) {
+            fBestPayeesCached = false;
+            SortPayees();
+        }
     }
 
+    void SortPayees();
+
     void AddPayees(const CSmartnodePaymentVote& vote);
     bool GetBestPayees(CScriptVector& payeeRet);
     bool HasPayeeWithVotes(const CScript& payeeIn, int nVotesReq);
 
-    bool IsTransactionValid(const CTransaction& txNew, CAmount expectedNodeReward);
+    bool IsTransactionValid(const CCoinbaseOutputs& outputs, CAmount expectedNodeReward);
 
     std::string GetRequiredPaymentsString();
     UniValue GetPaymentBlockObject();
+
+    size_t DynamicMemoryUsage() const;
 };
 
 // vote for the winning payment
@@ -193,6 +219,8 @@ public:
     void MarkAsNotVerified() { vchSig.clear(); }
 
     std::string ToString() const;
+
+    size_t DynamicMemoryUsage() const;
 };
 
 //
@@ -211,6 +239,14 @@ private:
     // Keep track of current block height
     int nCachedBlockHeight;
 
+    // Heights of the blocks in mapSmartnodeBlocks by the payees which win them, guarded by cs_mapSmartnodeBlocks
+    std::map<CScript, std::set<int> > mapPayeeBlocks;
+
+    /// Requires cs_mapSmartnodeBlocks
+    void IndexBlockPayees(CSmartnodeBlockPayees& blockPayees, bool fAdd);
+    /// Last block IsScheduled looks at
+    int GetLastScheduledHeight() const;
+
 public:
     std::map<uint256, CSmartnodePaymentVote> mapSmartnodePaymentVotes;
     std::map<int, CSmartnodeBlockPayees> mapSmartnodeBlocks;
@@ -225,9 +261,13 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         READWRITE(mapSmartnodePaymentVotes);
         READWRITE(mapSmartnodeBlocks);
+        if(ser_action.ForRead()) {
+            RebuildPayeeIndex();
+        }
     }
 
     void Clear();
+    void RebuildPayeeIndex();
 
     bool AddOrUpdatePaymentVote(const CSmartnodePaymentVote& vote);
     bool HasVerifiedPaymentVote(uint256 hashIn);
@@ -239,8 +279,10 @@ public:
     void CheckAndRemove();
 
     bool GetBlockPayees(int nBlockHeight, CScriptVector& payees);
-    bool IsTransactionValid(const CTransaction& txNew, int nBlockHeight, CAmount expectedNodeReward);
+    bool IsTransactionValid(const CCoinbaseOutputs& outputs, int nBlockHeight, CAmount expectedNodeReward);
     bool IsScheduled(CSmartnode& mn, int nNotBlockHeight);
+    /// Payees of all blocks IsScheduled looks at, to check a whole list against them at once
+    void GetScheduledPayees(int nNotBlockHeight, std::set<CScript>& setPayeesRet);
 
     bool UpdateLastVote(const CSmartnodePaymentVote& vote);
 
@@ -250,6 +292,8 @@ public:
     UniValue GetPaymentBlockObject(int nBlockHeight);
     void FillBlockPayee(CMutableTransaction& txNew, int nBlockHeight, CAmount blockReward, std::vector<CTxOut>& voutSmartNodes);
     std::string ToString() const;
+    /// Heap usage of the votes, the block payees and the vote tracking
+    void GetMemoryUsage(memusage::ComponentUsage& usage);
 
     int GetBlockCount() { return mapSmartnodeBlocks.size(); }
     int GetVoteCount() { return mapSmartnodePaymentVotes.size(); }
@@ -0,0 +1,174 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTNODESEEN_H
+#define SMARTNODESEEN_H
+
+#include "hash.h"
+#include "memusage.h"
+#include "random.h"
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+/** Salted hasher of message hashes, the peers choose the messages they relay. */
+class CSeenMessageHasher
+{
+    uint64_t k0, k1;
+
+public:
+    CSeenMessageHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    size_t operator()(const uint256& hash) const { return SipHashUint256(k0, k1, hash); }
+};
+
+/**
+ * Smartnode messages seen by their hash. The messages are spread over shards
+ * with their own lock and grouped in buckets by the value BucketOf returns for
+ * them, a time or a height. Expired messages get dropped bucket by bucket,
+ * without a pass over the messages which are still valid.
+ */
+template<typename T, typename BucketOf>
+class CSeenSmartnodeMessages
+{
+    static const size_t SHARDS = 16;
+
+    struct Shard {
+        mutable CCriticalSection cs;
+        std::unordered_map<uint256, std::pair<int64_t, T>, CSeenMessageHasher> mapMessages;
+        /// Hashes by bucket, messages erased or moved otherwise stay listed here
+        std::map<int64_t, std::vector<uint256> > mapBuckets;
+    };
+
+    CSeenMessageHasher hasher;
+    Shard shards[SHARDS];
+
+    Shard& GetShard(const uint256& hash) { return shards[(hasher(hash) >> 32) % SHARDS]; }
+    const Shard& GetShard(const uint256& hash) const { return shards[(hasher(hash) >> 32) % SHARDS]; }
+
+    std::map<uint256, T> GetAll() const
+    {
+        std::map<uint256, T> mapAll;
+        for(const Shard& shard : shards) {
+            LOCK(shard.cs);
+            for(const auto& message : shard.mapMessages)
+                mapAll.insert(std::make_pair(message.first, message.second.second));
+        }
+        return mapAll;
+    }
+
+public:
+    bool Has(const uint256& hash) const
+    {
+        const Shard& shard = GetShard(hash);
+        LOCK(shard.cs);
+        return shard.mapMessages.count(hash);
+    }
+
+    bool Get(const uint256& hash, T& messageRet) const
+    {
+        const Shard& shard = GetShard(hash);
+        LOCK(shard.cs);
+        auto it = shard.mapMessages.find(hash);
+        if(it == shard.mapMessages.end()) return false;
+        messageRet = it->second.second;
+        return true;
+    }
+
+    /// Add the message unless it was seen already
+    bool Insert(const uint256& hash, const T& message)
+    {
+        Shard& shard = GetShard(hash);
+        int64_t nBucket = BucketOf()(message);
+        LOCK(shard.cs);
+        if(!shard.mapMessages.emplace(hash, std::make_pair(nBucket, message)).second) return false;
+        shard.mapBuckets[nBucket].push_back(hash);
+        return true;
+    }
+
+    /// Drop all messages in the buckets before nBucket, returns the number dropped
+    size_t EraseBefore(int64_t nBucket)
+    {
+        size_t nErased = 0;
+        for(Shard& shard : shards) {
+            LOCK(shard.cs);
+            auto itBucket = shard.mapBuckets.begin();
+            while(itBucket != shard.mapBuckets.end() && itBucket->first < nBucket) {
+                for(const uint256& hash : itBucket->second) {
+                    auto it = shard.mapMessages.find(hash);
+                    if(it != shard.mapMessages.end() && it->second.first == itBucket->first) {
+                        shard.mapMessages.erase(it);
+                        ++nErased;
+                    }
+                }
+                shard.mapBuckets.erase(itBucket++);
+            }
+        }
+        return nErased;
+    }
+
+    void Clear()
+    {
+        for(Shard& shard : shards) {
+            LOCK(shard.cs);
+            shard.mapMessages.clear();
+            shard.mapBuckets.clear();
+        }
+    }
+
+    size_t Size() const
+    {
+        size_t nSize = 0;
+        for(const Shard& shard : shards) {
+            LOCK(shard.cs);
+            nSize += shard.mapMessages.size();
+        }
+        return nSize;
+    }
+
+    /// Heap usage of the messages and of the bucket index, T needs a DynamicMemoryUsage()
+    size_t DynamicMemoryUsage() const
+    {
+        size_t nUsage = 0;
+        for(const Shard& shard : shards) {
+            LOCK(shard.cs);
+            nUsage += memusage::DynamicUsage(shard.mapMessages) + memusage::DynamicUsage(shard.mapBuckets);
+            for(const auto& message : shard.mapMessages)
+                nUsage += message.second.second.DynamicMemoryUsage();
+            for(const auto& bucket : shard.mapBuckets)
+                nUsage += memusage::DynamicUsage(bucket.second);
+        }
+        return nUsage;
+    }
+
+    // Serialized like the std::map it replaced to keep the cache files compatible
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return ::GetSerializeSize(GetAll(), nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        ::Serialize(s, GetAll(), nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        std::map<uint256, T> mapAll;
+        ::Unserialize(s, mapAll, nType, nVersion);
+        Clear();
+        for(const auto& message : mapAll)
+            Insert(message.first, message.second);
+    }
+};
+
+#endif // SMARTNODESEEN_H
@@ -51,10 +51,33 @@ void CSmartnodeSync::Disconnect(int nHowMany, int nMinProtocol)
     });
 }
 
+void CSmartnodeSyncSnapshot::Clear()
+{
+    hashTip.SetNull();
+    nTime = 0;
+    nSmartnodes = 0;
+    nPaymentVotes = 0;
+}
+
+std::string CSmartnodeSyncSnapshot::ToString() const
+{
+    std::ostringstream info;
+
+    info << "Tip: " << hashTip.ToString() <<
+            ", time: " << nTime <<
+            ", smartnodes: " << nSmartnodes <<
+            ", payment votes: " << nPaymentVotes;
+
+    return info.str();
+}
+
 void CSmartnodeSync::Fail(CConnman& connman)
 {
+    // Whatever the snapshot promised didn't hold, do it the long way from now on
+    fWarmStart = false;
     nTimeLastFailure = GetTime();
     nRequestedSmartnodeAssets = SMARTNODE_SYNC_FAILED;
+    statusFeed.Notify();
     // If the sync failed disconnect half of the nodes and try again..
     Disconnect(g_connman->GetNodeCount(CConnman::CONNECTIONS_OUT) / 2, mnpayments.GetMinSmartnodePaymentsProto() );
 }
@@ -66,15 +89,100 @@ void CSmartnodeSync::Reset()
     nTimeAssetSyncStarted = GetTime();
     nTimeLastBumped = GetTime();
     nTimeLastFailure = 0;
+    nFanOut = 1;
+    nItemsLastTick = 0;
+
+    statusFeed.Notify();
+
+    LOCK(cs_stats);
+    for(CSmartnodeSyncAssetStats& stats : vecAssetStats)
+        stats = CSmartnodeSyncAssetStats();
+}
+
+int CSmartnodeSync::GetAssetStatsIndex(int nAsset)
+{
+    switch(nAsset)
+    {
+        case(SMARTNODE_SYNC_LIST):         return 0;
+        case(SMARTNODE_SYNC_MNW):          return 1;
+        case(SMARTNODE_SYNC_VOTING):       return 2;
+        default:                            return -1;
+    }
 }
 
 void CSmartnodeSync::BumpAssetLastTime(std::string strFuncName)
 {
     if(IsSynced() || IsFailed()) return;
     nTimeLastBumped = GetTime();
+
+    int nIndex = GetAssetStatsIndex(nRequestedSmartnodeAssets);
+    if(nIndex >= 0) {
+        LOCK(cs_stats);
+        ++vecAssetStats[nIndex].nItems;
+    }
+
     LogPrint("mnsync", "CSmartnodeSync::BumpAssetLastTime -- %s\n", strFuncName);
 }
 
+void CSmartnodeSync::AddAssetRequest()
+{
+    int nIndex = GetAssetStatsIndex(nRequestedSmartnodeAssets);
+    if(nIndex < 0) return;
+    LOCK(cs_stats);
+    ++vecAssetStats[nIndex].nRequests;
+}
+
+void CSmartnodeSync::UpdateFanOut()
+{
+    int nIndex = GetAssetStatsIndex(nRequestedSmartnodeAssets);
+    if(nIndex < 0) return;
+
+    int nItems;
+    {
+        LOCK(cs_stats);
+        nItems = vecAssetStats[nIndex].nItems;
+    }
+
+    // Peers which deliver get the asset to themselves, otherwise ask more of them at once
+    if(nItems == nItemsLastTick)
+        nFanOut = std::min(nFanOut * 2, SMARTNODE_SYNC_MAX_FANOUT);
+    else
+        nFanOut = 1;
+
+    nItemsLastTick = nItems;
+}
+
+UniValue CSmartnodeSync::GetAssetStats() const
+{
+    static const int vecAssets[] = {SMARTNODE_SYNC_LIST, SMARTNODE_SYNC_MNW, SMARTNODE_SYNC_VOTING};
+    static const char* vecNames[] = {"SMARTNODE_SYNC_LIST", "SMARTNODE_SYNC_MNW", "SMARTNODE_SYNC_VOTING"};
+
+    UniValue arr(UniValue::VARR);
+    int64_t nNow = GetTime();
+
+    LOCK(cs_stats);
+    for(int i = 0; i < 3; ++i) {
+        const CSmartnodeSyncAssetStats& stats = vecAssetStats[i];
+        UniValue obj(UniValue::VOBJ);
+
+        std::string strStatus = "pending";
+        if(stats.nTimeFinished) strStatus = "done";
+        else if(stats.nTimeStarted) strStatus = nRequestedSmartnodeAssets == vecAssets[i] ? "syncing" : "aborted";
+
+        int64_t nSeconds = stats.nTimeStarted ? (stats.nTimeFinished ? stats.nTimeFinished : nNow) - stats.nTimeStarted : 0;
+
+        obj.push_back(Pair("AssetName", vecNames[i]));
+        obj.push_back(Pair("Status", strStatus));
+        obj.push_back(Pair("Requests", stats.nRequests));
+        obj.push_back(Pair("Items", stats.nItems));
+        obj.push_back(Pair("Seconds", nSeconds));
+        obj.push_back(Pair("ItemsPerSecond", nSeconds > 0 ? (double)stats.nItems / nSeconds : 0.0));
+        arr.push_back(obj);
+    }
+
+    return arr;
+}
+
 std::string CSmartnodeSync::GetAssetName()
 {
     switch(nRequestedSmartnodeAssets)
@@ -92,6 +200,8 @@ std::string CSmartnodeSync::GetAssetName()
 
 void CSmartnodeSync::SwitchToNextAsset(CConnman& connman)
 {
+    int nIndexPrev = GetAssetStatsIndex(nRequestedSmartnodeAssets);
+
     switch(nRequestedSmartnodeAssets)
     {
         case(SMARTNODE_SYNC_FAILED):
@@ -146,7 +256,7 @@ void CSmartnodeSync::SwitchToNextAsset(CConnman& connman)
             // if(lockRecv) { ... }
 
             connman.ForEachNode(CConnman::FullyConnectedOnly, [](CNode* pnode) {
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "full-sync");
+                netfulfilledman.AddFulfilledRequest(pnode->addr, FULFILLED_FULL_SYNC);
             });
 
             break;
@@ -171,7 +281,7 @@ void CSmartnodeSync::SwitchToNextAsset(CConnman& connman)
             // if(lockRecv) { ... }
 
             connman.ForEachNode(CConnman::FullyConnectedOnly, [](CNode* pnode) {
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "full-sync");
+                netfulfilledman.AddFulfilledRequest(pnode->addr, FULFILLED_FULL_SYNC);
             });
 
             break;
@@ -179,6 +289,72 @@ void CSmartnodeSync::SwitchToNextAsset(CConnman& connman)
     nRequestedSmartnodeAttempt = 0;
     nTimeAssetSyncStarted = GetTime();
     BumpAssetLastTime("CSmartnodeSync::SwitchToNextAsset");
+
+    nFanOut = 1;
+    nItemsLastTick = 0;
+
+    // Only the first sync after the start benefits from the snapshot
+    if(IsSynced()) fWarmStart = false;
+
+    statusFeed.Notify();
+
+    int nIndex = GetAssetStatsIndex(nRequestedSmartnodeAssets);
+
+    LOCK(cs_stats);
+    if(nIndexPrev >= 0) vecAssetStats[nIndexPrev].nTimeFinished = GetTime();
+    if(nIndex >= 0) {
+        vecAssetStats[nIndex] = CSmartnodeSyncAssetStats();
+        vecAssetStats[nIndex].nTimeStarted = GetTime();
+    }
+}
+
+CSmartnodeSyncSnapshot CSmartnodeSync::GetSnapshot()
+{
+    CSmartnodeSyncSnapshot snapshot;
+
+    if(!IsSynced()) return snapshot;
+
+    {
+        LOCK(cs_main);
+        if(!chainActive.Tip()) return snapshot;
+        snapshot.hashTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    snapshot.nTime = GetTime();
+    snapshot.nSmartnodes = mnodeman.size();
+    snapshot.nPaymentVotes = mnpayments.GetVoteCount();
+
+    return snapshot;
+}
+
+bool CSmartnodeSync::WarmStart(const CSmartnodeSyncSnapshot& snapshot)
+{
+    if(snapshot.IsNull()) return false;
+
+    if(GetTime() - snapshot.nTime > SMARTNODE_SYNC_WARM_START_MAX_AGE) {
+        LogPrintf("CSmartnodeSync::WarmStart -- snapshot is %llds old, full sync\n", GetTime() - snapshot.nTime);
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        if(!chainActive.Tip() || chainActive.Tip()->GetBlockHash() != snapshot.hashTip) {
+            LogPrintf("CSmartnodeSync::WarmStart -- snapshot is from another tip, full sync\n");
+            return false;
+        }
+    }
+
+    // Loading the caches drops the expired entries, most of them must have survived
+    if(!snapshot.nSmartnodes || mnodeman.size() < snapshot.nSmartnodes * 0.9 ||
+       mnpayments.GetVoteCount() < snapshot.nPaymentVotes * 0.9 || !mnpayments.IsEnoughData()) {
+        LogPrintf("CSmartnodeSync::WarmStart -- caches don't match the snapshot (%s), full sync\n", snapshot.ToString());
+        return false;
+    }
+
+    LogPrintf("CSmartnodeSync::WarmStart -- %s\n", snapshot.ToString());
+    fWarmStart = true;
+    statusFeed.Notify();
+    return true;
 }
 
 std::string CSmartnodeSync::GetSyncStatus()
@@ -270,6 +446,9 @@ void CSmartnodeSync::ProcessTick(CConnman& connman)
     }
 
 
+    UpdateFanOut();
+    int nRequestsThisTick = 0;
+
     std::vector<CNode*> vNodesCopy = connman.CopyNodeVector(CConnman::FullyConnectedOnly);
 
     BOOST_FOREACH(CNode* pnode, vNodesCopy)
@@ -282,7 +461,7 @@ void CSmartnodeSync::ProcessTick(CConnman& connman)
 
         // NORMAL NETWORK MODE - TESTNET/MAINNET
         {
-            if(netfulfilledman.HasFulfilledRequest(pnode->addr, "full-sync")) {
+            if(netfulfilledman.HasFulfilledRequest(pnode->addr, FULFILLED_FULL_SYNC)) {
                 // We already fully synced from this node recently,
                 // disconnect to free this connection slot for another peer.
                 pnode->fDisconnect = true;
@@ -293,7 +472,8 @@ void CSmartnodeSync::ProcessTick(CConnman& connman)
             // INITIAL TIMEOUT
 
             if(nRequestedSmartnodeAssets == SMARTNODE_SYNC_WAITING) {
-                if(GetTime() - nTimeLastBumped > SMARTNODE_SYNC_TIMEOUT_SECONDS) {
+                // With a warm start we are at the best header and have everything up to it
+                if(fWarmStart || GetTime() - nTimeLastBumped > SMARTNODE_SYNC_TIMEOUT_SECONDS) {
                     // At this point we know that:
                     // a) there are peers (because we are looping on at least one of them);
                     // b) we waited for at least SMARTNODE_SYNC_TIMEOUT_SECONDS since we reached
@@ -331,6 +511,14 @@ void CSmartnodeSync::ProcessTick(CConnman& connman)
                     return;
                 }
 
+                // warm start: the list was complete at shutdown, one answered delta request catches up
+                if(fWarmStart && nRequestedSmartnodeAttempt > 0 && GetTime() - nTimeLastBumped > SMARTNODE_SYNC_TICK_SECONDS) {
+                    LogPrintf("CSmartnodeSync::ProcessTick -- nTick %d nRequestedSmartnodeAssets %d -- warm start, list updated\n", nTick, nRequestedSmartnodeAssets);
+                    SwitchToNextAsset(connman);
+                    connman.ReleaseNodeVector(vNodesCopy);
+                    return;
+                }
+
                 // request from three peers max
                 if (nRequestedSmartnodeAttempt > 2) {
                     connman.ReleaseNodeVector(vNodesCopy);
@@ -338,14 +526,16 @@ void CSmartnodeSync::ProcessTick(CConnman& connman)
                 }
 
                 // only request once from each peer
-                if(netfulfilledman.HasFulfilledRequest(pnode->addr, "smartnode-list-sync")) continue;
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "smartnode-list-sync");
+                if(netfulfilledman.HasFulfilledRequest(pnode->addr, FULFILLED_SMARTNODE_LIST_SYNC)) continue;
+                netfulfilledman.AddFulfilledRequest(pnode->addr, FULFILLED_SMARTNODE_LIST_SYNC);
 
                 if (pnode->nVersion < mnpayments.GetMinSmartnodePaymentsProto()) continue;
                 nRequestedSmartnodeAttempt++;
+                AddAssetRequest();
 
                 mnodeman.DsegUpdate(pnode, connman);
 
+                if(++nRequestsThisTick < nFanOut) continue;
                 connman.ReleaseNodeVector(vNodesCopy);
                 return; //this will cause each peer to get one request each six seconds for the various assets we need
             }
@@ -374,7 +564,8 @@ void CSmartnodeSync::ProcessTick(CConnman& connman)
                 // check for data
                 // if mnpayments already has enough blocks and votes, switch to the next asset
                 // try to fetch data from at least two peers though
-                if(nRequestedSmartnodeAttempt > 1 && mnpayments.IsEnoughData()) {
+                // with a warm start the cached votes were complete, one peer fills the gap
+                if((nRequestedSmartnodeAttempt > 1 || (fWarmStart && nRequestedSmartnodeAttempt > 0)) && mnpayments.IsEnoughData()) {
                     LogPrintf("CSmartnodeSync::ProcessTick -- nTick %d nRequestedSmartnodeAssets %d -- found enough data\n", nTick, nRequestedSmartnodeAssets);
                     SwitchToNextAsset(connman);
                     connman.ReleaseNodeVector(vNodesCopy);
@@ -382,16 +573,18 @@ void CSmartnodeSync::ProcessTick(CConnman& connman)
                 }
 
                 // only request once from each peer
-                if(netfulfilledman.HasFulfilledRequest(pnode->addr, "smartnode-payment-sync")) continue;
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "smartnode-payment-sync");
+                if(netfulfilledman.HasFulfilledRequest(pnode->addr, FULFILLED_SMARTNODE_PAYMENT_SYNC)) continue;
+                netfulfilledman.AddFulfilledRequest(pnode->addr, FULFILLED_SMARTNODE_PAYMENT_SYNC);
 
                 nRequestedSmartnodeAttempt++;
+                AddAssetRequest();
 
                 // ask node for all payment votes it has (new nodes will only return votes for future payments)
                 connman.PushMessage(pnode, NetMsgType::SMARTNODEPAYMENTSYNC, mnpayments.GetStorageLimit());
                 // ask node for missing pieces only (old nodes will not be asked)
                 mnpayments.RequestLowDataPaymentBlocks(pnode, connman);
 
+                if(++nRequestsThisTick < nFanOut) continue;
                 connman.ReleaseNodeVector(vNodesCopy);
                 return; //this will cause each peer to get one request each six seconds for the various assets we need
             }
@@ -414,7 +607,7 @@ void CSmartnodeSync::ProcessTick(CConnman& connman)
                 }
 
                 // only request obj sync once from each peer, then request votes on per-obj basis
-                if(netfulfilledman.HasFulfilledRequest(pnode->addr, "voting-sync")) {
+                if(netfulfilledman.HasFulfilledRequest(pnode->addr, FULFILLED_VOTING_SYNC)) {
                     int nProposalsLeftToAsk = smartVoting.RequestProposalVotes(pnode, connman);
                     static int64_t nTimeNoProposalsLeft = 0;
                     // check for data
@@ -446,16 +639,18 @@ void CSmartnodeSync::ProcessTick(CConnman& connman)
                     }
                     continue;
                 }
-                netfulfilledman.AddFulfilledRequest(pnode->addr, "voting-sync");
+                netfulfilledman.AddFulfilledRequest(pnode->addr, FULFILLED_VOTING_SYNC);
 
                 if (pnode->nVersion < MIN_VOTING_PEER_PROTO_VERSION) continue;
                 nRequestedSmartnodeAttempt++;
+                AddAssetRequest();
 
                 CBloomFilter filter;
                 filter.clear();
 
                 connman.PushMessage(pnode, NetMsgType::VOTINGSYNC, uint256(), filter);
 
+                if(++nRequestsThisTick < nFanOut) continue;
                 connman.ReleaseNodeVector(vNodesCopy);
                 return; //this will cause each peer to get one request each six seconds for the various assets we need
             }
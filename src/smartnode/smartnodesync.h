@@ -5,7 +5,9 @@
 #define SMARTNODE_SYNC_H
 
 #include "../chain.h"
+#include "../changefeed.h"
 #include "../net.h"
+#include "../serialize.h"
 
 #include <univalue.h>
 
@@ -13,6 +15,10 @@ static const bool DEFAULT_CACHE_NODES = false;
 static const bool DEFAULT_CACHE_WINNERS= true;
 static const bool DEFAULT_CACHE_NETFULLFILLED = true;
 static const bool DEFAULT_CACHE_VOTING = true;
+static const int64_t DEFAULT_CACHE_DUMP_INTERVAL = 15 * 60;
+static const bool DEFAULT_SYNC_WARM_START = true;
+// Snapshots older than this are ignored, the pings in the cached list would be outdated
+static const int64_t SMARTNODE_SYNC_WARM_START_MAX_AGE = 30 * 60;
 
 class CSmartnodeSync;
 
@@ -31,11 +37,56 @@ static const int SMARTNODE_SYNC_REQUEST_VOTES_SECONDS = 10;
 static const int SMARTNODE_SYNC_TIMEOUT_SECONDS = 15; // our blocks are 2.5 minutes so 30 seconds should be fine
 
 static const int SMARTNODE_SYNC_ENOUGH_PEERS    = 3;
+// Peers asked for the current asset per tick at most, while they don't deliver anything
+static const int SMARTNODE_SYNC_MAX_FANOUT      = 4;
 
 extern CSmartnodeSync smartnodeSync;
 extern CCriticalSection cs_unknownpings;
 extern std::map<COutPoint,int> mapTryUnknownPings;
 
+/** Progress of one of the synced assets. */
+struct CSmartnodeSyncAssetStats
+{
+    int64_t nTimeStarted;
+    int64_t nTimeFinished;
+    int nRequests; // peers asked
+    int nItems; // messages which bumped the asset
+
+    CSmartnodeSyncAssetStats() : nTimeStarted(0), nTimeFinished(0), nRequests(0), nItems(0) {}
+};
+
+/**
+ * Written with the caches at a clean shutdown of a synced node. Tells the next
+ * start that the cached list and winners belong to the same chain tip, the
+ * sync then only needs to ask for what changed while the node was down.
+ */
+class CSmartnodeSyncSnapshot
+{
+public:
+    uint256 hashTip;
+    int64_t nTime;
+    int nSmartnodes;
+    int nPaymentVotes;
+
+    CSmartnodeSyncSnapshot() { Clear(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hashTip);
+        READWRITE(nTime);
+        READWRITE(nSmartnodes);
+        READWRITE(nPaymentVotes);
+    }
+
+    bool IsNull() const { return hashTip.IsNull(); }
+
+    void Clear();
+    void CheckAndRemove() {}
+    std::string ToString() const;
+};
+
 //
 // CSmartnodeSync : Sync smartnode assets in stages
 //
@@ -55,12 +106,30 @@ private:
     // ... or failed
     int64_t nTimeLastFailure;
 
+    // Caches were restored from a snapshot of the current tip, see CSmartnodeSyncSnapshot
+    bool fWarmStart;
+
+    // Bumped when the asset changes, the sync gets reset or fails
+    CChangeFeed statusFeed;
+
+    // Peers to ask per tick, raised while the asset doesn't get any data
+    int nFanOut;
+    int nItemsLastTick;
+
+    // Stats of SMARTNODE_SYNC_LIST, SMARTNODE_SYNC_MNW and SMARTNODE_SYNC_VOTING
+    mutable CCriticalSection cs_stats;
+    CSmartnodeSyncAssetStats vecAssetStats[3];
+
+    static int GetAssetStatsIndex(int nAsset);
+    void UpdateFanOut();
+    void AddAssetRequest();
+
     void Fail(CConnman& connman);
     void ClearFulfilledRequests(CConnman& connman);
 
     void Disconnect(int nHowMany, int nMinProtocol = INIT_PROTO_VERSION);
 public:
-    CSmartnodeSync() { Reset(); }
+    CSmartnodeSync() : fWarmStart(false) { Reset(); }
 
     bool IsFailed() { return nRequestedSmartnodeAssets == SMARTNODE_SYNC_FAILED; }
     bool IsBlockchainSynced() { return nRequestedSmartnodeAssets > SMARTNODE_SYNC_INITIAL; }
@@ -76,10 +145,19 @@ public:
     int64_t GetAssetStartTime() { return nTimeAssetSyncStarted; }
     std::string GetAssetName();
     std::string GetSyncStatus();
+    /// Progress and throughput of the synced assets
+    UniValue GetAssetStats() const;
 
     void Reset();
     void SwitchToNextAsset(CConnman& connman);
 
+    /// Snapshot of the current caches, null unless the sync is finished
+    CSmartnodeSyncSnapshot GetSnapshot();
+    /// Skip the full sync timeouts if the snapshot matches the loaded caches and tip
+    bool WarmStart(const CSmartnodeSyncSnapshot& snapshot);
+    bool IsWarmStart() { return fWarmStart; }
+    CChangeFeed& GetStatusFeed() { return statusFeed; }
+
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
     void ProcessTick(CConnman& connman);
 
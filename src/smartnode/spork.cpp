@@ -14,8 +14,6 @@
 class CSporkMessage;
 class CSporkManager;
 
-CSporkManager sporkManager;
-
 std::map<uint256, CSporkMessage> mapSporks;
 std::map<int, int64_t> mapSporkDefaults = {
     {SPORK_2_INSTANTSEND_ENABLED,               0},             // ON
@@ -31,6 +29,23 @@ std::map<int, int64_t> mapSporkDefaults = {
     {SPORK_21_SMARTNODE_PROTOCOL_REQUIREMENT,   0x7FFFFFFFFFFF1D1C}, // byte0 = old protocol, byte1 = new protocol, bytes 2-7 enable time
 };
 
+// After mapSporkDefaults, the constructor reads them
+CSporkManager sporkManager;
+
+CSporkManager::CSporkManager()
+{
+    for (int nSporkID = SPORK_START; nSporkID <= SPORK_END; ++nSporkID) {
+        auto it = mapSporkDefaults.find(nSporkID);
+        vSporkValues[nSporkID - SPORK_START].store(it != mapSporkDefaults.end() ? it->second : SPORK_VALUE_UNKNOWN, std::memory_order_relaxed);
+    }
+}
+
+void CSporkManager::SetSporkValue(int nSporkID, int64_t nValue)
+{
+    if (nSporkID < SPORK_START || nSporkID > SPORK_END) return;
+    vSporkValues[nSporkID - SPORK_START].store(nValue, std::memory_order_relaxed);
+}
+
 void CSporkManager::ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman)
 {
 
@@ -44,20 +59,23 @@ void CSporkManager::ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStr
         std::string strLogMsg;
         {
             LOCK(cs_main);
-            pfrom->setAskFor.erase(hash);
+            pfrom->RemoveAskFor(hash);
             if(!chainActive.Tip()) return;
             strLogMsg = strprintf("SPORK -- hash: %s id: %d value: %10d bestHeight: %d peer=%d", hash.ToString(), spork.nSporkID, spork.nValue, chainActive.Height(), pfrom->id);
         }
 
-        if(mapSporksActive.count(spork.nSporkID)) {
-            if (mapSporksActive[spork.nSporkID].nTimeSigned >= spork.nTimeSigned) {
-                LogPrint("spork", "%s seen\n", strLogMsg);
-                return;
+        {
+            LOCK(cs);
+            if(mapSporksActive.count(spork.nSporkID)) {
+                if (mapSporksActive[spork.nSporkID].nTimeSigned >= spork.nTimeSigned) {
+                    LogPrint("spork", "%s seen\n", strLogMsg);
+                    return;
+                } else {
+                    LogPrintf("%s updated\n", strLogMsg);
+                }
             } else {
-                LogPrintf("%s updated\n", strLogMsg);
+                LogPrintf("%s new\n", strLogMsg);
             }
-        } else {
-            LogPrintf("%s new\n", strLogMsg);
         }
 
         if(!spork.CheckSignature(sporkPubKeyID)) {
@@ -67,8 +85,12 @@ void CSporkManager::ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStr
             return;
         }
 
-        mapSporks[hash] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        {
+            LOCK(cs);
+            mapSporks[hash] = spork;
+            mapSporksActive[spork.nSporkID] = spork;
+            SetSporkValue(spork.nSporkID, spork.nValue);
+        }
         spork.Relay(connman);
 
         //does a task if needed
@@ -76,6 +98,7 @@ void CSporkManager::ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStr
 
     } else if (strCommand == NetMsgType::GETSPORKS) {
 
+        LOCK(cs);
         std::map<int, CSporkMessage>::iterator it = mapSporksActive.begin();
 
         while(it != mapSporksActive.end()) {
@@ -98,8 +121,10 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue, CConnman& connman)
 
     if(spork.Sign(sporkPrivKey)) {
         spork.Relay(connman);
+        LOCK(cs);
         mapSporks[spork.GetHash()] = spork;
         mapSporksActive[nSporkID] = spork;
+        SetSporkValue(nSporkID, nValue);
         return true;
     }
 
@@ -109,13 +134,13 @@ bool CSporkManager::UpdateSpork(int nSporkID, int64_t nValue, CConnman& connman)
 // grab the spork, otherwise say it's off
 bool CSporkManager::IsSporkActive(int nSporkID)
 {
-    int64_t r = -1;
+    int64_t r = SPORK_VALUE_UNKNOWN;
 
-    if(mapSporksActive.count(nSporkID)){
-        r = mapSporksActive[nSporkID].nValue;
-    } else if (mapSporkDefaults.count(nSporkID)) {
-        r = mapSporkDefaults[nSporkID];
-    } else {
+    if (nSporkID >= SPORK_START && nSporkID <= SPORK_END) {
+        r = vSporkValues[nSporkID - SPORK_START].load(std::memory_order_relaxed);
+    }
+
+    if (r == SPORK_VALUE_UNKNOWN) {
         LogPrint("spork", "CSporkManager::IsSporkActive -- Unknown Spork ID %d\n", nSporkID);
         r = 4070908800ULL; // 2099-1-1 i.e. off by default
     }
@@ -126,11 +151,9 @@ bool CSporkManager::IsSporkActive(int nSporkID)
 // grab the value of the spork on the network, or the default
 int64_t CSporkManager::GetSporkValue(int nSporkID)
 {
-    if (mapSporksActive.count(nSporkID))
-        return mapSporksActive[nSporkID].nValue;
-
-    if (mapSporkDefaults.count(nSporkID)) {
-        return mapSporkDefaults[nSporkID];
+    if (nSporkID >= SPORK_START && nSporkID <= SPORK_END) {
+        int64_t nValue = vSporkValues[nSporkID - SPORK_START].load(std::memory_order_relaxed);
+        if (nValue != SPORK_VALUE_UNKNOWN) return nValue;
     }
 
     LogPrint("spork", "CSporkManager::GetSporkValue -- Unknown Spork ID %d\n", nSporkID);
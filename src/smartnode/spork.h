@@ -10,6 +10,9 @@
 #include "../utilstrencodings.h"
 #include "key.h"
 
+#include <atomic>
+#include <limits>
+
 class CSporkMessage;
 class CSporkManager;
 
@@ -94,15 +97,26 @@ public:
 class CSporkManager
 {
 private:
+    // Value of a spork without a message and without a default
+    static const int64_t SPORK_VALUE_UNKNOWN = std::numeric_limits<int64_t>::min();
+
     std::vector<unsigned char> vchSig;
+
+    CCriticalSection cs;
     std::map<int, CSporkMessage> mapSporksActive;
 
+    // Effective value of every spork ID in [SPORK_START, SPORK_END], the one of the
+    // active message or the default. Read without a lock on every spork check.
+    std::atomic<int64_t> vSporkValues[SPORK_END - SPORK_START + 1];
+
+    void SetSporkValue(int nSporkID, int64_t nValue);
+
     CKeyID sporkPubKeyID;
     CKey sporkPrivKey;
 
 public:
 
-    CSporkManager() {}
+    CSporkManager();
 
     void ProcessSpork(CNode* pfrom, std::string& strCommand, CDataStream& vRecv, CConnman& connman);
     void ExecuteSpork(int nSporkID, int nValue);
@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "smartrewards/rewards.h"
+#include "blockscripts.h"
 #include "consensus/consensus.h"
+#include "core_memusage.h"
 #include "init.h"
 #include "rewards.h"
 #include "script/standard.h"
@@ -11,7 +13,10 @@
 #include "smartnode/smartnodepayments.h"
 #include "smartnode/spork.h"
 #include "smartrewards/rewardspayments.h"
+#include "smartrewards/rewardsroundfile.h"
+#include "trace.h"
 #include "ui_interface.h"
+#include "undo.h"
 #include "validation.h"
 
 #include <boost/date_time/gregorian/gregorian.hpp>
@@ -20,6 +25,8 @@
 
 #define REWARDS_MAX_CACHE        400000000UL     // 400MB
 #define SUPER_REWARDS_MIN_BALANCE_1_3 (999999 * COIN) // Reduce by 1 to allow for activation fee
+#define REWARDS_PARALLEL_MIN_PAYOUTS 10000 // Below that the payouts get ordered in one thread
+#define REWARDS_REBUILD_WINDOW 1000 // Blocks the rebuild workers read ahead of the sequencer
 
 CSmartRewards* prewards = NULL;
 
@@ -27,6 +34,8 @@ CCriticalSection cs_rewardsdb;
 CCriticalSection cs_rewardscache;
 
 size_t nCacheRewardEntries;
+size_t nReadCacheRewardEntries = REWARDS_READ_CACHE_ENTRIES_DEFAULT;
+bool fRewardsIncremental = DEFAULT_REWARDS_INCREMENTAL;
 
 // Used for time conversions.
 boost::posix_time::ptime epoch(boost::gregorian::date(1970, 1, 1));
@@ -47,6 +56,86 @@ struct ComparePaymentPrtList {
     }
 };
 
+// Number of threads to order the payouts of a round with, follows -par like the script verification.
+static int GetPayoutThreads(size_t nPayouts)
+{
+    if (nScriptCheckThreads <= 1 || nPayouts < REWARDS_PARALLEL_MIN_PAYOUTS) {
+        return 1;
+    }
+
+    return nScriptCheckThreads;
+}
+
+// Split [0, nItems) into nThreads consecutive chunks and run func(begin, end) for all of them in parallel.
+template <typename Func>
+static void ParallelForChunks(size_t nItems, int nThreads, const Func& func)
+{
+    size_t nChunk = (nItems + nThreads - 1) / nThreads;
+    boost::thread_group threads;
+
+    for (int i = 1; i < nThreads; ++i) {
+        size_t nBegin = std::min(nItems, i * nChunk);
+        size_t nEnd = std::min(nItems, nBegin + nChunk);
+        threads.create_thread([&func, nBegin, nEnd] { func(nBegin, nEnd); });
+    }
+
+    func(0, std::min(nItems, nChunk));
+    threads.join_all();
+}
+
+// Sort the chunks in parallel and merge them pairwise afterwards. The comparators used
+// for the payouts are total orders, so the result is the same as the one of std::sort.
+template <typename T, typename Compare>
+static void ParallelSort(std::vector<T>& vec, Compare comp)
+{
+    int nThreads = GetPayoutThreads(vec.size());
+
+    if (nThreads == 1) {
+        std::sort(vec.begin(), vec.end(), comp);
+        return;
+    }
+
+    size_t nChunk = (vec.size() + nThreads - 1) / nThreads;
+    std::vector<size_t> vBounds;
+
+    for (int i = 0; i < nThreads; ++i) {
+        vBounds.push_back(std::min(vec.size(), i * nChunk));
+    }
+    vBounds.push_back(vec.size());
+
+    ParallelForChunks(vec.size(), nThreads, [&vec, &comp](size_t nBegin, size_t nEnd) {
+        std::sort(vec.begin() + nBegin, vec.begin() + nEnd, comp);
+    });
+
+    while (vBounds.size() > 2) {
+        std::vector<size_t> vNext;
+        boost::thread_group threads;
+
+        for (size_t i = 0; i + 2 < vBounds.size(); i += 2) {
+            size_t nBegin = vBounds[i], nMiddle = vBounds[i + 1], nEnd = vBounds[i + 2];
+            threads.create_thread([&vec, &comp, nBegin, nMiddle, nEnd] {
+                std::inplace_merge(vec.begin() + nBegin, vec.begin() + nMiddle, vec.begin() + nEnd, comp);
+            });
+            vNext.push_back(nBegin);
+        }
+
+        // An odd chunk at the end gets merged in the next pass.
+        if ((vBounds.size() - 1) % 2) {
+            vNext.push_back(vBounds[vBounds.size() - 2]);
+        }
+        vNext.push_back(vBounds.back());
+
+        threads.join_all();
+        vBounds.swap(vNext);
+    }
+}
+
+// Block rewards of the heights [start, end], without fees.
+CAmount CalculateRewardsForBlockRange(int64_t start, int64_t end)
+{
+    return GetBlockValueSum(start, end);
+}
+
 // Estimate or return the current block height.
 int GetBlockHeight(const CBlockIndex* index)
 {
@@ -59,37 +148,6 @@ int GetBlockHeight(const CBlockIndex* index)
     return syncDiff > 1200 ? firstTxDiff / 55 : index->nHeight; // If we are 20 minutes near now use the current height.
 }
 
-bool ExtractDestination(const CScript& scriptPubKey, CSmartAddress& idRet)
-{
-    vector<vector<unsigned char>> vSolutions;
-    txnouttype whichType;
-    if (!Solver(scriptPubKey, whichType, vSolutions))
-        return false;
-
-    if (whichType == TX_PUBKEY) {
-        CPubKey pubKey(vSolutions[0]);
-        if (!pubKey.IsValid())
-            return false;
-
-        idRet = CSmartAddress(pubKey.GetID());
-        return true;
-    } else if (whichType == TX_PUBKEYHASH) {
-        idRet = CSmartAddress(CKeyID(uint160(vSolutions[0])));
-        return true;
-    } else if (whichType == TX_SCRIPTHASH) {
-        idRet = CSmartAddress(CScriptID(uint160(vSolutions[0])));
-        return true;
-    } else if (whichType == TX_PUBKEYHASHLOCKED) {
-        idRet = CSmartAddress(CKeyID(uint160(vSolutions[0])));
-        return true;
-    } else if (whichType == TX_SCRIPTHASHLOCKED) {
-        idRet = CSmartAddress(CScriptID(uint160(vSolutions[0])));
-        return true;
-    }
-    // Multisig txns have more than one address...
-    return false;
-}
-
 bool CSmartRewards::Verify()
 {
     LOCK(cs_rewardsdb);
@@ -110,7 +168,7 @@ void CSmartRewards::UpdateRoundPayoutParameter()
     int64_t nBlockPayees = Params().GetConsensus().nRewardsPayouts_1_3_BlockPayees;
     int64_t nBlockInterval = Params().GetConsensus().nRewardsPayouts_1_3_BlockStretch / 20;
     int nFirst_1_3_Round = Params().GetConsensus().nRewardsFirst_1_3_Round;
-    int64_t nPayeeCount = round->eligibleEntries - round->disqualifiedEntries;
+    int64_t nPayeeCount = round->GetEligibleEntries();
 
     if ( round->number < (nFirst_1_3_Round + 3) ) {
         nBlockPayees = Params().GetConsensus().nRewardsPayouts_1_2_BlockPayees;
@@ -129,8 +187,8 @@ void CSmartRewards::UpdatePercentage()
     const CSmartRewardRound *round = cache.GetCurrentRound();
 
     double nPercent = 0.0;
-    if ( (round->eligibleSmart - round->disqualifiedSmart) > 0 ) {
-        nPercent = double(round->rewards) / (round->eligibleSmart - round->disqualifiedSmart);
+    if ( round->GetEligibleSmart() > 0 ) {
+        nPercent = double(round->rewards) / round->GetEligibleSmart();
     }else{
         nPercent = 0;
     }
@@ -151,6 +209,9 @@ void CSmartRewards::EvaluateRound(CSmartRewardRound &next)
 {
     LOCK(cs_rewardscache);
 
+    // number of the next round, the duration is the time until rewards:round_evaluated on the same thread
+    TRACE1(rewards, round_evaluate_start, next.number);
+
     UpdateRoundPayoutParameter();
 
     const CSmartRewardRound *round = cache.GetCurrentRound();
@@ -164,18 +225,11 @@ void CSmartRewards::EvaluateRound(CSmartRewardRound &next)
     pResult->round.UpdatePayoutParameter();
 
     CAmount nReward;
-    CSmartRewardEntryMap tmpEntries;
-    pdb->ReadRewardEntries(tmpEntries);
 
-    for( auto itDb = tmpEntries.begin(); itDb != tmpEntries.end(); ++itDb){
-
-        auto itCache = cache.GetEntries()->find(itDb->first);
-
-        if( itCache == cache.GetEntries()->end() ){
-            cache.AddEntry(itDb->second);
-        }else{
-            delete itDb->second;
-        }
+    if (fRewardsIncremental) {
+        LoadRoundCandidates();
+    } else {
+        LoadRewardEntries();
     }
 
     if( round->number >= nFirst_1_3_Round ) {
@@ -191,7 +245,7 @@ void CSmartRewards::EvaluateRound(CSmartRewardRound &next)
         auto entry = cache.GetEntries()->begin();
         while(entry != cache.GetEntries()->end() ) {
             nReward = entry->second->IsEligible() ? CAmount(entry->second->balanceEligible * round->percent) : 0;
-            pResult->results.push_back(new CSmartRewardResultEntry(entry->second, nReward));
+            pResult->results.push_back(pResult->CreateEntry(entry->second, nReward));
             if( nReward ){
                 pResult->payouts.push_back(pResult->results.back());
             }
@@ -208,7 +262,7 @@ void CSmartRewards::EvaluateRound(CSmartRewardRound &next)
         if ( round->number >= Params().GetConsensus().nRewardsFirst_2_0_Round) {
             if( pResult->payouts.size() ){
                 // Sort it to make sure the slices are the same network wide.
-                std::sort(pResult->payouts.begin(), pResult->payouts.end(), ComparePaymentPrtList() );
+                ParallelSort(pResult->payouts, ComparePaymentPrtList());
             }
         } else {
             if( pResult->payouts.size() ){
@@ -217,18 +271,18 @@ void CSmartRewards::EvaluateRound(CSmartRewardRound &next)
                     throw std::runtime_error(strprintf("CSmartRewards::EvaluateRound -- ERROR: GetBlockHash() failed at nBlockHeight %d\n", round->startBlockHeight));
                 }
 
-                std::vector<std::pair<arith_uint256, CSmartRewardResultEntry*>> vecScores;
+                std::vector<std::pair<arith_uint256, CSmartRewardResultEntry*>> vecScores(pResult->payouts.size());
                 // Since we use payouts stretched out over a week better to have some "random" sort here
                 // based on a score calculated with the round start's blockhash.
-                CSmartRewardResultEntryPtrList::iterator it = pResult->payouts.begin();
+                const CSmartRewardResultEntryPtrList& payouts = pResult->payouts;
 
-                while( it != pResult->payouts.end() ){
-                    arith_uint256 nScore = (*it)->CalculateScore(blockHash);
-                    vecScores.push_back(std::make_pair(nScore,*it));
-                    ++it;
-                }
+                ParallelForChunks(payouts.size(), GetPayoutThreads(payouts.size()), [&](size_t nBegin, size_t nEnd) {
+                    for (size_t i = nBegin; i < nEnd; ++i) {
+                        vecScores[i] = std::make_pair(payouts[i]->CalculateScore(blockHash), payouts[i]);
+                    }
+                });
 
-                std::sort(vecScores.begin(), vecScores.end(), CompareRewardScore());
+                ParallelSort(vecScores, CompareRewardScore());
 
                 pResult->payouts.clear();
 
@@ -351,7 +405,7 @@ void CSmartRewards::EvaluateRound(CSmartRewardRound &next)
 
             nReward = entry->second->balanceEligible > 0 && !entry->second->fDisqualifyingTx ? CAmount(entry->second->balanceEligible * round->percent) : 0;
 
-            pResult->results.push_back(new CSmartRewardResultEntry(entry->second, nReward));
+            pResult->results.push_back(pResult->CreateEntry(entry->second, nReward));
 
             if( nReward ){
                 pResult->payouts.push_back(pResult->results.back());
@@ -391,7 +445,7 @@ void CSmartRewards::EvaluateRound(CSmartRewardRound &next)
 
         if( pResult->payouts.size() ){
             // Sort it to make sure the slices are the same network wide.
-            std::sort(pResult->payouts.begin(), pResult->payouts.end(), ComparePaymentPrtList() );
+            ParallelSort(pResult->payouts, ComparePaymentPrtList());
         }
 
         // Calculate the current rewards percentage
@@ -417,6 +471,62 @@ void CSmartRewards::EvaluateRound(CSmartRewardRound &next)
         cache.SetResult(pResult);
         cache.SetCurrentRound(next);
     }
+
+    if (fRewardsIncremental) {
+        UpdateRoundCandidates();
+    }
+
+    LogPrint("smartrewards-bench", "CSmartRewards::EvaluateRound - Round %d evaluated with %d entries\n", pResult->round.number, cache.GetEntries()->size());
+    // number of the evaluated round, cached entries, eligible entries
+    TRACE3(rewards, round_evaluated, pResult->round.number, cache.GetEntries()->size(), pResult->results.size());
+}
+
+void CSmartRewards::LoadRewardEntries()
+{
+    AssertLockHeld(cs_rewardscache);
+
+    // The database has to be up to date before it gets merged into the cache.
+    if (!WaitForFlush()) {
+        LogPrintf("CSmartRewards::LoadRewardEntries - Background flush failed\n");
+    }
+
+    pdb->ReadRewardEntries(cache);
+}
+
+void CSmartRewards::LoadRoundCandidates()
+{
+    AssertLockHeld(cs_rewardscache);
+
+    // Only pull the entries into the cache which can be affected by the round's
+    // evaluation. All others would end up unchanged in the database anyway.
+    for (const CSmartAddress& id : *cache.GetRoundCandidates()) {
+        if (cache.GetEntries()->count(id)) {
+            continue;
+        }
+
+        CSmartRewardEntry* entry = cache.CreateEntry(id);
+
+        if (ReadRewardEntry(id, *entry)) {
+            cache.AddEntry(entry);
+        } else {
+            cache.DestroyEntry(entry);
+        }
+    }
+}
+
+void CSmartRewards::UpdateRoundCandidates()
+{
+    AssertLockHeld(cs_rewardscache);
+
+    CSmartAddressSet candidates;
+
+    for (auto it = cache.GetEntries()->begin(); it != cache.GetEntries()->end(); ++it) {
+        if (it->second->IsRoundCandidate()) {
+            candidates.insert(it->first);
+        }
+    }
+
+    cache.SetRoundCandidates(candidates);
 }
 
 bool CSmartRewards::GetRewardRoundResults(const int16_t round, CSmartRewardResultEntryList& results)
@@ -425,10 +535,63 @@ bool CSmartRewards::GetRewardRoundResults(const int16_t round, CSmartRewardResul
     return pdb->ReadRewardRoundResults(round, results);
 }
 
-bool CSmartRewards::GetRewardRoundResults(const int16_t round, CSmartRewardResultEntryPtrList& results)
+bool CSmartRewards::GetRewardRoundResults(const int16_t round, CSmartRewardsRoundResult& result)
 {
     LOCK(cs_rewardsdb);
-    return pdb->ReadRewardRoundResults(round, results);
+    return pdb->ReadRewardRoundResults(round, result);
+}
+
+bool CSmartRewards::GetRoundFile(const CSmartRewardRound& round, CSmartRewardsRoundFile& file)
+{
+    if (file.Open(round)) {
+        return true;
+    }
+
+    // Rounds finalized before the files existed or a failed write, rebuild it from the database.
+    CSmartRewardResultEntryList results;
+
+    {
+        TRY_LOCK(cs_rewardsdb, lockRewardsDb);
+
+        if (!lockRewardsDb || !pdb->ReadRewardRoundResults(round.number, results)) {
+            return false;
+        }
+    }
+
+    // The results of a round which didn't hit the database yet are empty, the sync writes the file then.
+    if (results.empty()) {
+        return true;
+    }
+
+    return CSmartRewardsRoundFile::Write(round, results) && file.Open(round);
+}
+
+bool CSmartRewards::ForEachRewardPayout(const CSmartRewardRound& round, size_t nOffset, size_t nLimit, const std::function<void(const CSmartAddress&, CAmount)>& callback, size_t& nPayouts)
+{
+    CSmartRewardsRoundFile file;
+
+    nPayouts = 0;
+
+    if (!GetRoundFile(round, file)) {
+        return false;
+    }
+
+    // Only the rewards column gets touched for the entries outside of the page.
+    for (size_t i = 0; i < file.size(); ++i) {
+        CAmount nReward = file.GetReward(i);
+
+        if (!nReward) {
+            continue;
+        }
+
+        if (nPayouts >= nOffset && nPayouts - nOffset < nLimit) {
+            callback(file.GetAddress(i), nReward);
+        }
+
+        ++nPayouts;
+    }
+
+    return true;
 }
 
 const CSmartRewardsRoundResult* CSmartRewards::GetLastRoundResult()
@@ -457,28 +620,110 @@ bool CSmartRewards::GetRewardEntry(const CSmartAddress& id, CSmartRewardEntry*&
 
     if (it != cache.GetEntries()->end()) {
         entry = it->second;
+        if (fRewardsIncremental) {
+            cache.AddRoundCandidate(id);
+        }
         return true;
     }
 
-    entry = new CSmartRewardEntry(id);
+    entry = cache.CreateEntry(id);
 
-    // Return the entry if its already in db.
-    if (pdb->ReadRewardEntry(id, *entry)) {
-        cache.AddEntry(entry);
-        return true;
+    // The read cache also knows about the addresses not in the db, see PrefetchRewardEntries.
+    bool fFound = false;
+
+    if (!cache.GetReadEntry(id, fFound, *entry)) {
+        fFound = ReadRewardEntry(id, *entry);
     }
 
-    if (fCreate) {
+    // Return the entry if its already in db.
+    if (fFound || fCreate) {
         cache.AddEntry(entry);
+        if (fRewardsIncremental) {
+            cache.AddRoundCandidate(id);
+        }
         return true;
     }
 
-    delete entry;
+    cache.DestroyEntry(entry);
     entry = nullptr;
 
     return false;
 }
 
+bool CSmartRewards::GetRewardEntry(const CSmartAddress& id, CSmartRewardEntry& entry)
+{
+    LOCK(cs_rewardscache);
+
+    // Entries in the write cache are the most recent ones.
+    auto it = cache.GetEntries()->find(id);
+
+    if (it != cache.GetEntries()->end()) {
+        entry = *it->second;
+        return true;
+    }
+
+    bool fFound = false;
+
+    if (cache.GetReadEntry(id, fFound, entry)) {
+        return fFound;
+    }
+
+    fFound = ReadRewardEntry(id, entry);
+    cache.AddReadEntry(id, fFound, entry);
+
+    return fFound;
+}
+
+bool CSmartRewards::GetRewardEntries(const std::vector<CSmartAddress>& ids, CSmartRewardEntryList& entries, std::vector<bool>& vFound)
+{
+    LOCK(cs_rewardscache);
+
+    entries.assign(ids.size(), CSmartRewardEntry());
+    vFound.assign(ids.size(), false);
+
+    std::vector<CSmartAddress> vRead;
+    std::vector<size_t> vReadIndex;
+
+    for (size_t i = 0; i < ids.size(); ++i) {
+        auto it = cache.GetEntries()->find(ids[i]);
+
+        if (it != cache.GetEntries()->end()) {
+            entries[i] = *it->second;
+            vFound[i] = true;
+            continue;
+        }
+
+        bool fFound = false;
+
+        if (cache.GetReadEntry(ids[i], fFound, entries[i]) || ReadFlushedRewardEntry(ids[i], fFound, entries[i])) {
+            vFound[i] = fFound;
+            continue;
+        }
+
+        vRead.push_back(ids[i]);
+        vReadIndex.push_back(i);
+    }
+
+    if (vRead.empty()) {
+        return true;
+    }
+
+    CSmartRewardEntryList vReadEntries;
+    std::vector<bool> vReadFound;
+
+    if (!pdb->ReadRewardEntries(vRead, vReadEntries, vReadFound)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < vRead.size(); ++i) {
+        entries[vReadIndex[i]] = vReadEntries[i];
+        vFound[vReadIndex[i]] = vReadFound[i];
+        cache.AddReadEntry(vRead[i], vReadFound[i], vReadEntries[i]);
+    }
+
+    return true;
+}
+
 bool CSmartRewards::GetTermRewardEntry(const std::pair<CSmartAddress, uint256>& id, CTermRewardEntry*& entry,
     bool fCreate)
 {
@@ -492,10 +737,10 @@ bool CSmartRewards::GetTermRewardEntry(const std::pair<CSmartAddress, uint256>&
         return true;
     }
 
-    entry = new CTermRewardEntry(id.first, id.second);
+    entry = cache.CreateTermRewardEntry(id);
 
     // Return the entry if its already in db.
-    if (pdb->ReadTermRewardEntry(id, *entry)) {
+    if (ReadTermRewardEntry(id, *entry)) {
         cache.AddTermRewardEntry(entry);
         return true;
     }
@@ -505,111 +750,421 @@ bool CSmartRewards::GetTermRewardEntry(const std::pair<CSmartAddress, uint256>&
         return true;
     }
 
-    delete entry;
+    cache.DestroyTermRewardEntry(entry);
     entry = nullptr;
 
     return false;
 }
 
-bool CSmartRewards::GetRewardEntries(CSmartRewardEntryMap& entries)
+bool CSmartRewards::ReadFlushedRewardEntry(const CSmartAddress& id, bool& fFound, CSmartRewardEntry& entry)
 {
-    LOCK(cs_rewardsdb);
-    return pdb->ReadRewardEntries(entries);
-}
+    AssertLockHeld(cs_rewardscache);
 
-bool CSmartRewards::GetTermRewardsEntries(CTermRewardEntryMap& entries)
-{
-    LOCK(cs_rewardsdb);
-    return pdb->ReadTermRewardEntries(entries);
+    // The snapshot which is being written in the background is more recent than the database.
+    if (fFlushSnapshot) {
+        auto it = flushCache.GetEntries()->find(id);
+
+        if (it != flushCache.GetEntries()->end()) {
+            // Empty entries get erased by the flush.
+            fFound = it->second->balance > 0;
+
+            if (fFound) {
+                entry = *it->second;
+            }
+
+            return true;
+        }
+    }
+
+    return false;
 }
 
-bool CSmartRewards::SyncCached()
+bool CSmartRewards::ReadRewardEntry(const CSmartAddress& id, CSmartRewardEntry& entry)
 {
-    LOCK2(cs_rewardscache, cs_rewardsdb);
+    bool fFound = false;
 
-    int nTimeStart = GetTimeMicros();
-    int nEntriesPre = cache.GetEntries()->size();
-    int nSizePre = cache.EstimatedSize();
-
-    bool ret = pdb->SyncCached(cache);
+    if (ReadFlushedRewardEntry(id, fFound, entry)) {
+        return fFound;
+    }
 
-    cache.Clear();
+    return pdb->ReadRewardEntry(id, entry);
+}
 
-    int nTimeDone = GetTimeMicros();
+bool CSmartRewards::ReadTermRewardEntry(const CTermRewardDbKey& id, CTermRewardEntry& entry)
+{
+    AssertLockHeld(cs_rewardscache);
 
-    int nEntriesPost = cache.GetEntries()->size();
-    int nSizePost = cache.EstimatedSize();
+    if (fFlushSnapshot) {
+        auto it = flushCache.GetTermRewardsEntries()->find(id);
 
-    LogPrint("smartrewards-bench", "CSmartRewards::SyncCached size before/after %dMB/%dMB, entries before/after %d/%d, time %.2fms", nSizePre / 1000000, nSizePost / 1000000, nEntriesPre, nEntriesPost, (nTimeDone - nTimeStart) * 0.001);
+        if (it != flushCache.GetTermRewardsEntries()->end()) {
+            entry = *it->second;
+            return true;
+        }
+    }
 
-    return ret;
+    return pdb->ReadTermRewardEntry(id, entry);
 }
 
-bool CSmartRewards::IsSynced()
+bool CSmartRewards::ReadBlockUndo(const int nHeight, CSmartRewardsBlockUndo& undo)
 {
-    static bool fSynced = false;
+    AssertLockHeld(cs_rewardscache);
 
-    if (fSynced)
+    auto it = cache.GetBlockUndos()->find(nHeight);
+
+    if (it != cache.GetBlockUndos()->end()) {
+        undo = it->second;
         return true;
+    }
 
-    fSynced = (GetTime() - cache.GetCurrentBlock()->nTime) <= nRewardsSyncDistance;
+    if (fFlushSnapshot) {
+        it = flushCache.GetBlockUndos()->find(nHeight);
 
-    return fSynced;
+        if (it != flushCache.GetBlockUndos()->end()) {
+            undo = it->second;
+            return true;
+        }
+    }
+
+    return pdb->ReadBlockUndo(nHeight, undo);
 }
 
-int CSmartRewards::GetBlocksPerRound(const int nRound)
+bool CSmartRewards::GetRewardEntries(CSmartRewardEntryMap& entries)
 {
-    const CChainParams& chainparams = Params();
+    LOCK(cs_rewardsdb);
+    return pdb->ReadRewardEntries(entries);
+}
 
-    if (nRound < chainparams.GetConsensus().nRewardsFirst_1_3_Round) {
-        return chainparams.GetConsensus().nRewardsBlocksPerRound_1_2;
-    } else {
-        return chainparams.GetConsensus().nRewardsBlocksPerRound_1_3;
-    }
+bool CSmartRewards::GetTermRewardsEntries(CTermRewardEntryMap& entries)
+{
+    LOCK(cs_rewardsdb);
+    return pdb->ReadTermRewardEntries(entries);
 }
 
-CSmartRewards::CSmartRewards(CSmartRewardsDB* prewardsdb) : pdb(prewardsdb)
+void CSmartRewards::MergeTermRewardEntries(const std::function<bool(const CTermRewardEntry&)>& filter, CTermRewardEntryList& entries)
 {
-    LOCK2(cs_rewardscache, cs_rewardsdb);
+    AssertLockHeld(cs_rewardscache);
 
-    CSmartRewardBlock block;
-    CSmartRewardRound round;
-    CSmartRewardRoundMap rounds;
-    CSmartRewardResultEntryList results;
+    std::map<CTermRewardDbKey, CTermRewardEntry> mapEntries;
 
-    pdb->ReadLastBlock(block);
-    pdb->ReadCurrentRound(round);
-    pdb->ReadRounds(rounds);
+    for (const CTermRewardEntry& entry : entries) {
+        mapEntries[{entry.address, entry.txHash}] = entry;
+    }
 
-    cache.Load(block, round, rounds);
+    // Only the entries created since the last flush are cached, walking them is cheap. The
+    // more recent state replaces the database one, also if it doesn't match anymore.
+    std::vector<const CTermRewardEntryMap*> vCaches;
 
-    CSmartRewardsRoundResult* pResult = new CSmartRewardsRoundResult();
+    if (fFlushSnapshot) {
+        vCaches.push_back(flushCache.GetTermRewardsEntries());
+    }
 
-    if (round.number > 1) {
-        pResult->fSynced = true;
-        pResult->round = rounds[round.number - 1];
-        pdb->ReadRewardRoundResults(round.number - 1, pResult->results);
+    vCaches.push_back(cache.GetTermRewardsEntries());
 
-        for (auto it : pResult->results) {
-            if (it->reward) {
-                pResult->payouts.push_back(it);
+    for (const CTermRewardEntryMap* pCache : vCaches) {
+        for (auto it = pCache->begin(); it != pCache->end(); ++it) {
+            if (filter(*it->second)) {
+                mapEntries[it->first] = *it->second;
+            } else {
+                mapEntries.erase(it->first);
             }
         }
     }
 
-    cache.SetResult(pResult);
+    entries.clear();
 
-    LogPrintf("CSmartRewards::CSmartRewards\n  Last block %s\n  Current Round %s\n  Rounds: %d", block.ToString(), round.ToString(), rounds.size());
+    for (auto it = mapEntries.begin(); it != mapEntries.end(); ++it) {
+        entries.push_back(it->second);
+    }
 }
 
-bool CSmartRewards::GetLastBlock(CSmartRewardBlock& block)
+bool CSmartRewards::GetTermRewardEntries(const CSmartAddress& address, CTermRewardEntryList& entries)
 {
-    LOCK(cs_rewardsdb);
-    // Read the last block stored in the rewards database.
-    return pdb->ReadLastBlock(block);
-}
+    LOCK2(cs_rewardscache, cs_rewardsdb);
 
-bool CSmartRewards::GetTransaction(const uint256 nHash, CSmartRewardTransaction& transaction)
+    entries.clear();
+
+    if (!pdb->ReadTermRewardEntries(address, entries)) {
+        return false;
+    }
+
+    MergeTermRewardEntries([&address](const CTermRewardEntry& entry) { return entry.address == address; }, entries);
+
+    return true;
+}
+
+bool CSmartRewards::GetTermRewardEntries(unsigned int nFrom, unsigned int nTo, CTermRewardEntryList& entries)
+{
+    LOCK2(cs_rewardscache, cs_rewardsdb);
+
+    entries.clear();
+
+    if (!pdb->ReadTermRewardEntries(nFrom, nTo, entries)) {
+        return false;
+    }
+
+    MergeTermRewardEntries([nFrom, nTo](const CTermRewardEntry& entry) {
+        return (unsigned int)entry.expires >= nFrom && (unsigned int)entry.expires <= nTo;
+    }, entries);
+
+    std::stable_sort(entries.begin(), entries.end(), [](const CTermRewardEntry& a, const CTermRewardEntry& b) {
+        return (unsigned int)a.expires < (unsigned int)b.expires;
+    });
+
+    return true;
+}
+
+bool CSmartRewards::SyncCached(bool fBackground)
+{
+    CSmartRewardsPhaseTimer timer(stats, REWARDS_PHASE_SYNC_CACHED, false);
+
+    LOCK(cs_rewardscache);
+
+    int nTimeStart = GetTimeMicros();
+    int nEntriesPre = cache.GetEntries()->size();
+    int nSizePre = cache.EstimatedSize();
+
+    // Only one snapshot can be in flight, the batches need to hit the database in order.
+    if (!WaitForFlush()) {
+        return error("CSmartRewards::SyncCached - Background flush failed");
+    }
+
+    bool ret = true;
+
+    // The undo of a round writes entries which are not part of the cache, the
+    // lookups through the snapshot can't see them. Keep that one synchronous.
+    if (fBackground && (cache.GetUndoResult() == nullptr || cache.GetUndoResult()->fSynced)) {
+        cache.Freeze(flushCache);
+        fFlushSnapshot = true;
+
+        {
+            boost::unique_lock<boost::mutex> lock(csFlush);
+            fFlushPending = true;
+        }
+
+        condFlush.notify_all();
+    } else {
+        LOCK(cs_rewardsdb);
+        ret = pdb->SyncCached(cache);
+        cache.Clear();
+    }
+
+    int nTimeDone = GetTimeMicros();
+
+    int nEntriesPost = cache.GetEntries()->size();
+    int nSizePost = cache.EstimatedSize();
+
+    LogPrint("smartrewards-bench", "CSmartRewards::SyncCached size before/after %dMB/%dMB, entries before/after %d/%d, time %.2fms", nSizePre / 1000000, nSizePost / 1000000, nEntriesPre, nEntriesPost, (nTimeDone - nTimeStart) * 0.001);
+    // written in the background, entries before, entries after, cache size before in bytes, duration in microseconds
+    TRACE5(rewards, sync_cached, fFlushSnapshot, nEntriesPre, nEntriesPost, nSizePre, nTimeDone - nTimeStart);
+
+    return ret;
+}
+
+bool CSmartRewards::FinishFlush()
+{
+    LOCK(cs_rewardscache);
+    return WaitForFlush();
+}
+
+void CSmartRewards::ThreadFlush()
+{
+    RenameThread("smartcash-rewardsflush");
+
+    boost::unique_lock<boost::mutex> lock(csFlush);
+
+    while (true) {
+        while (!fFlushPending && !fFlushStop) {
+            condFlush.wait(lock);
+        }
+
+        // Write a pending snapshot before quitting.
+        if (!fFlushPending) {
+            return;
+        }
+
+        lock.unlock();
+
+        int64_t nTimeStart = GetTimeMicros();
+        bool fSuccess;
+
+        try {
+            LOCK(cs_rewardsdb);
+            fSuccess = pdb->SyncCached(flushCache);
+        } catch (const std::exception& e) {
+            fSuccess = error("CSmartRewards::ThreadFlush - %s", e.what());
+        }
+
+        int64_t nTimeFlushed = GetTimeMicros() - nTimeStart;
+        LogPrint("smartrewards-bench", "CSmartRewards::ThreadFlush - Wrote %d entries, time %.2fms\n", flushCache.GetEntries()->size(), nTimeFlushed * 0.001);
+        // entries written, success, duration in microseconds
+        TRACE3(rewards, flushed, flushCache.GetEntries()->size(), fSuccess, nTimeFlushed);
+
+        lock.lock();
+
+        fFlushFailed = fFlushFailed || !fSuccess;
+        fFlushPending = false;
+        condFlush.notify_all();
+    }
+}
+
+bool CSmartRewards::WaitForFlush()
+{
+    AssertLockHeld(cs_rewardscache);
+
+    bool fFailed;
+
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+
+        while (fFlushPending) {
+            condFlush.wait(lock);
+        }
+
+        fFailed = fFlushFailed;
+    }
+
+    ReleaseSnapshot(!fFailed);
+
+    return !fFailed;
+}
+
+void CSmartRewards::ReleaseFlushed()
+{
+    AssertLockHeld(cs_rewardscache);
+
+    if (!fFlushSnapshot) {
+        return;
+    }
+
+    bool fFailed;
+
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+
+        if (fFlushPending) {
+            return;
+        }
+
+        fFailed = fFlushFailed;
+    }
+
+    ReleaseSnapshot(!fFailed);
+}
+
+void CSmartRewards::ReleaseSnapshot(bool fWritten)
+{
+    AssertLockHeld(cs_rewardscache);
+
+    if (!fFlushSnapshot) {
+        return;
+    }
+
+    // The result only counts as synced once its copy made it to the database.
+    if (fWritten && flushCache.GetLastRoundResult() != nullptr) {
+        cache.MarkResultSynced(flushCache.GetLastRoundResult());
+    }
+
+    flushCache.ClearSnapshot();
+    fFlushSnapshot = false;
+}
+
+void CSmartRewards::GetMemoryUsage(memusage::ComponentUsage& usage)
+{
+    LOCK(cs_rewardscache);
+    cache.GetMemoryUsage(usage);
+    // The flush thread only reads the snapshot, it gets released under cs_rewardscache
+    usage.emplace_back("flush_snapshot", fFlushSnapshot ? (size_t)flushCache.EstimatedSize() : 0);
+}
+
+bool CSmartRewards::IsSynced()
+{
+    static bool fSynced = false;
+
+    if (fSynced)
+        return true;
+
+    fSynced = (GetTime() - cache.GetCurrentBlock()->nTime) <= nRewardsSyncDistance;
+
+    return fSynced;
+}
+
+int CSmartRewards::GetBlocksPerRound(const int nRound)
+{
+    const CChainParams& chainparams = Params();
+
+    if (nRound < chainparams.GetConsensus().nRewardsFirst_1_3_Round) {
+        return chainparams.GetConsensus().nRewardsBlocksPerRound_1_2;
+    } else {
+        return chainparams.GetConsensus().nRewardsBlocksPerRound_1_3;
+    }
+}
+
+CSmartRewards::CSmartRewards(CSmartRewardsDB* prewardsdb) : pdb(prewardsdb), fFlushSnapshot(false), fFlushPending(false), fFlushFailed(false), fFlushStop(false)
+{
+    LOCK2(cs_rewardscache, cs_rewardsdb);
+
+    CSmartRewardBlock block;
+    CSmartRewardRound round;
+    CSmartRewardRoundMap rounds;
+    CSmartRewardResultEntryList results;
+
+    pdb->ReadLastBlock(block);
+    pdb->ReadCurrentRound(round);
+    pdb->ReadRounds(rounds);
+
+    cache.Load(block, round, rounds);
+
+    if (fRewardsIncremental) {
+        CSmartAddressSet candidates;
+        pdb->ReadRoundCandidates(candidates);
+        cache.SetRoundCandidates(candidates);
+    }
+
+    CSmartRewardsRoundResult* pResult = new CSmartRewardsRoundResult();
+
+    if (round.number > 1) {
+        pResult->fSynced = true;
+        pResult->round = rounds[round.number - 1];
+        pdb->ReadRewardRoundResults(round.number - 1, *pResult);
+
+        for (auto it : pResult->results) {
+            if (it->reward) {
+                pResult->payouts.push_back(it);
+            }
+        }
+    }
+
+    cache.SetResult(pResult);
+
+    PublishRoundsSnapshot();
+
+    flushThread = boost::thread(boost::bind(&CSmartRewards::ThreadFlush, this));
+
+    LogPrintf("CSmartRewards::CSmartRewards\n  Last block %s\n  Current Round %s\n  Rounds: %d", block.ToString(), round.ToString(), rounds.size());
+}
+
+CSmartRewards::~CSmartRewards()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        fFlushStop = true;
+    }
+
+    condFlush.notify_all();
+    flushThread.join();
+
+    delete pdb;
+}
+
+bool CSmartRewards::GetLastBlock(CSmartRewardBlock& block)
+{
+    LOCK(cs_rewardsdb);
+    // Read the last block stored in the rewards database.
+    return pdb->ReadLastBlock(block);
+}
+
+bool CSmartRewards::GetTransaction(const uint256 nHash, CSmartRewardTransaction& transaction)
 {
     LOCK2(cs_rewardscache, cs_rewardsdb);
     // If the transaction is already in the cache use this one.
@@ -620,9 +1175,28 @@ bool CSmartRewards::GetTransaction(const uint256 nHash, CSmartRewardTransaction&
         return true;
     }
 
+    // Then check the snapshot which is being written, removals get applied after the additions.
+    if (fFlushSnapshot) {
+        if (flushCache.GetRemovedTransactions()->count(nHash)) {
+            return false;
+        }
+
+        it = flushCache.GetAddedTransactions()->find(nHash);
+
+        if (it != flushCache.GetAddedTransactions()->end()) {
+            transaction = it->second;
+            return true;
+        }
+    }
+
     return pdb->ReadTransaction(nHash, transaction);
 }
 
+const CSmartRewardBlock* CSmartRewards::GetCurrentBlock()
+{
+    return cache.GetCurrentBlock();
+}
+
 const CSmartRewardRound* CSmartRewards::GetCurrentRound()
 {
     return cache.GetCurrentRound();
@@ -633,21 +1207,56 @@ const CSmartRewardRoundMap* CSmartRewards::GetRewardRounds()
     return cache.GetRounds();
 }
 
-void CSmartRewards::ProcessInput(const CTransaction& tx, const CTxOut& in, int txHeight, uint16_t nCurrentRound, CSmartRewardsUpdateResult& result)
+CSmartRewardsRoundsSnapshotRef CSmartRewards::GetRoundsSnapshot() const
 {
+    LOCK(csRoundsSnapshot);
+    return roundsSnapshot;
+}
+
+void CSmartRewards::PublishRoundsSnapshot()
+{
+    AssertLockHeld(cs_rewardscache);
+
+    std::shared_ptr<CSmartRewardsRoundsSnapshot> pSnapshot = std::make_shared<CSmartRewardsRoundsSnapshot>();
+    CSmartRewardsRoundsSnapshotRef previous = GetRoundsSnapshot();
+
+    pSnapshot->block = *cache.GetCurrentBlock();
+    pSnapshot->current = *cache.GetCurrentRound();
+    pSnapshot->nRoundsVersion = cache.GetRoundsVersion();
+
+    // The finished rounds only change at the end of a round, share them until then.
+    if (previous && previous->nRoundsVersion == pSnapshot->nRoundsVersion) {
+        pSnapshot->history = previous->history;
+    } else {
+        pSnapshot->history = std::make_shared<CSmartRewardRoundMap>(*cache.GetRounds());
+    }
+
+    {
+        LOCK(csRoundsSnapshot);
+        roundsSnapshot = pSnapshot;
+    }
+    roundsFeed.Notify();
+}
+
+void CSmartRewards::ProcessInput(const CTransaction& tx, const CTxOut& in, const CDecodedScript& script, int txHeight, uint16_t nCurrentRound, CSmartRewardsUpdateResult& result)
+{
+    CSmartRewardsPhaseTimer timer(stats, REWARDS_PHASE_PROCESS_INPUT);
+
     uint16_t nFirst_1_3_Round = Params().GetConsensus().nRewardsFirst_1_3_Round;
     CSmartRewardEntry* rEntry = nullptr;
-    CSmartAddress id;
 
-    if (!ExtractDestination(in.scriptPubKey, id)) {
+    if (!script.fDestination) {
         LogPrint("smartrewards-tx", "CSmartRewards::ProcessInput - Could't parse CSmartAddress: %s\n", in.ToString());
         return;
     }
+    const CSmartAddress& id = script.id;
 
     if (!GetRewardEntry(id, rEntry, false)) {
         return;
     }
 
+    result.AddUndoEntry(*rEntry);
+
     if (nCurrentRound >= nFirst_1_3_Round && tx.IsActivationTx() && !rEntry->fActivated) {
         rEntry->activationTx = tx.GetHash();
         rEntry->fActivated = true;
@@ -688,18 +1297,22 @@ void CSmartRewards::ProcessInput(const CTransaction& tx, const CTxOut& in, int t
     }
 }
 
-void CSmartRewards::ProcessOutput(const CTransaction& tx, const CTxOut& out, uint16_t nCurrentRound, int nHeight,
+void CSmartRewards::ProcessOutput(const CTransaction& tx, const CTxOut& out, const CDecodedScript& script, uint16_t nCurrentRound, int nHeight,
     unsigned int nTime, CSmartRewardsUpdateResult& result)
 {
+    CSmartRewardsPhaseTimer timer(stats, REWARDS_PHASE_PROCESS_OUTPUT);
+
     CSmartRewardEntry* rEntry = nullptr;
     CTermRewardEntry* rTermEntry = nullptr;
-    CSmartAddress id;
+    const CSmartAddress& id = script.id;
 
-    if (!ExtractDestination(out.scriptPubKey, id)) {
+    if (!script.fDestination) {
         LogPrint("smartrewards-tx", "CSmartRewards::ProcessOutput - Could't parse CSmartAddress: %s\n", out.ToString());
         return;
     } else {
         if (GetRewardEntry(id, rEntry, true)) {
+            result.AddUndoEntry(*rEntry);
+
             if (tx.IsActivationTx() && Is_1_3(nCurrentRound) && !SmartHive::IsHive(rEntry->id)
                     && !rEntry->fActivated ) {
                 rEntry->activationTx = tx.GetHash();
@@ -792,8 +1405,80 @@ void CSmartRewards::ProcessOutput(const CTransaction& tx, const CTxOut& out, uin
     }
 }
 
+void CSmartRewards::PrefetchRewardEntries(const CBlockIndex* pIndex, const CBlock& block, const CDecodedBlockScripts& scripts)
+{
+    CSmartRewardsPhaseTimer timer(stats, REWARDS_PHASE_PREFETCH);
+
+    if (pIndex->nHeight == 0 || pIndex->nHeight > sporkManager.GetSporkValue(SPORK_15_SMARTREWARDS_BLOCKS_ENABLED)) {
+        return;
+    }
+
+    LOCK(cs_rewardscache);
+
+    CSmartAddressSet setSeen;
+    std::vector<CSmartAddress> vRead;
+
+    auto addScript = [&](const CDecodedScript& script) {
+        const CSmartAddress& id = script.id;
+
+        if (!script.fDestination || !setSeen.insert(id).second || cache.GetEntries()->count(id)) {
+            return;
+        }
+
+        bool fFound = false;
+        CSmartRewardEntry entry;
+
+        if (!cache.GetReadEntry(id, fFound, entry) && !ReadFlushedRewardEntry(id, fFound, entry)) {
+            vRead.push_back(id);
+        }
+    };
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (scripts.HaveInputs(i)) {
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                if (!tx.vin[j].scriptSig.IsZerocoinSpend()) {
+                    addScript(scripts.Input(i, j));
+                }
+            }
+        }
+
+        for (size_t k = 0; k < tx.vout.size(); k++) {
+            if (!tx.vout[k].scriptPubKey.IsZerocoinMint()) {
+                addScript(scripts.Output(i, k));
+            }
+        }
+    }
+
+    if (vRead.empty()) {
+        return;
+    }
+
+    CSmartRewardEntryList entries;
+    std::vector<bool> vFound;
+
+    if (!pdb->ReadRewardEntries(vRead, entries, vFound)) {
+        // Not fatal, the entries get read one by one then.
+        LogPrintf("CSmartRewards::PrefetchRewardEntries - Failed to read the entries of block %d\n", pIndex->nHeight);
+        return;
+    }
+
+    for (size_t i = 0; i < vRead.size(); ++i) {
+        if (vFound[i]) {
+            // The entry gets modified by the block anyway so it can go to the write cache right away.
+            CSmartRewardEntry* entry = cache.CreateEntry(vRead[i]);
+            *entry = entries[i];
+            cache.AddEntry(entry);
+        } else {
+            cache.AddReadEntry(vRead[i], false, entries[i]);
+        }
+    }
+}
+
 bool CSmartRewards::ProcessTransaction(CBlockIndex* pIndex, const CTransaction& tx, int nCurrentRound)
 {
+    CSmartRewardsPhaseTimer timer(stats, REWARDS_PHASE_PROCESS_TRANSACTION);
+
     LogPrint("smartrewards-tx", "CSmartRewards::ProcessTransaction - %s", tx.GetHash().ToString());
 
     int nHeight = pIndex->nHeight;
@@ -916,20 +1601,68 @@ void CSmartRewards::UndoOutput(const CTransaction& tx, const CTxOut& out, int tx
                 LogPrint("smartrewards-tx", "CSmartRewards::UndoOutput - Negative amount SmartRewards - %s", rEntry->ToString());
                 rEntry->balance = 0;
             }
-            if (result.disqualifiedEntries < 0) { result.disqualifiedEntries = 0; }
-            if (result.disqualifiedSmart < 0) { result.disqualifiedSmart = 0; }
-            if (result.qualifiedEntries < 0) { result.qualifiedEntries = 0; }
-            if (result.qualifiedSmart < 0) { result.qualifiedSmart = 0; }
+            if (result.disqualifiedEntries < 0) { result.disqualifiedEntries = 0; }
+            if (result.disqualifiedSmart < 0) { result.disqualifiedSmart = 0; }
+            if (result.qualifiedEntries < 0) { result.qualifiedEntries = 0; }
+            if (result.qualifiedSmart < 0) { result.qualifiedSmart = 0; }
+        }
+/*        GetTermRewardEntry({id, tx.GetHash()}, rTermEntry, true);
+        if (rTermEntry) {
+            rTermEntry->balance -= out.nValue;
+            if (rTermEntry->balance < 0) {
+                LogPrint("smartrewards-tx", "CSmartRewards::UndoOutput - Negative amount TermRewards - %s", rEntry->ToString());
+                rTermEntry->balance = 0;
+            }
+        }*/
+    }
+}
+
+bool CSmartRewards::UndoBlock(const CBlockIndex* pIndex, const CBlock& block, CSmartRewardsUpdateResult& result)
+{
+    if (pIndex->nHeight > sporkManager.GetSporkValue(SPORK_15_SMARTREWARDS_BLOCKS_ENABLED)) {
+        return false;
+    }
+
+    LOCK(cs_rewardscache);
+
+    CSmartRewardsBlockUndo undo;
+
+    // A journal of another block at this height is left over from a reorg.
+    if (!ReadBlockUndo(pIndex->nHeight, undo) || undo.blockHash != pIndex->GetBlockHash()) {
+        return false;
+    }
+
+    for (const CSmartRewardEntry& previous : undo.entries) {
+        CSmartRewardEntry* entry = nullptr;
+
+        GetRewardEntry(previous.id, entry, true);
+        *entry = previous;
+    }
+
+    // Blocks which finish a round have no journal, so the block was processed in the current round.
+    if (cache.GetCurrentRound()->number <= 4) {
+        CSmartRewardTransaction testTx;
+
+        for (const CTransactionRef& tx : block.vtx) {
+            if (GetTransaction(tx->GetHash(), testTx) && testTx.blockHeight == pIndex->nHeight) {
+                cache.RemoveTransaction(testTx);
+            }
         }
-/*        GetTermRewardEntry({id, tx.GetHash()}, rTermEntry, true);
-        if (rTermEntry) {
-            rTermEntry->balance -= out.nValue;
-            if (rTermEntry->balance < 0) {
-                LogPrint("smartrewards-tx", "CSmartRewards::UndoOutput - Negative amount TermRewards - %s", rEntry->ToString());
-                rTermEntry->balance = 0;
-            }
-        }*/
     }
+
+    // CommitUndoBlock applies the differences, which puts back the round's counters from before the block.
+    const CSmartRewardRound* round = cache.GetCurrentRound();
+
+    result.disqualifiedEntries = undo.disqualifiedEntries - round->disqualifiedEntries;
+    result.disqualifiedSmart = undo.disqualifiedSmart - round->disqualifiedSmart;
+    result.qualifiedEntries = undo.eligibleEntries - round->eligibleEntries;
+    result.qualifiedSmart = undo.eligibleSmart - round->eligibleSmart;
+
+    cache.RemoveBlockUndo(pIndex->nHeight);
+
+    LogPrint("smartrewards-block", "CSmartRewards::UndoBlock - Restored %d entries of block %d\n", undo.entries.size(), pIndex->nHeight);
+
+    return true;
 }
 
 void CSmartRewards::UndoTransaction(CBlockIndex* pIndex, const CTransaction& tx, CCoinsViewCache& coins, const CChainParams& chainparams, CSmartRewardsUpdateResult& result)
@@ -998,8 +1731,13 @@ bool CSmartRewards::CommitBlock(CBlockIndex* pIndex, const CSmartRewardsUpdateRe
         return true;
     }
 
+    CSmartRewardsBlockTimer blockTimer(stats, pIndex ? pIndex->nHeight : 0, cache.GetCurrentRound()->number);
+
     LOCK(cs_rewardscache);
 
+    // Drop the snapshot once the background flush is done with it.
+    ReleaseFlushed();
+
     const CSmartRewardRound* round = cache.GetCurrentRound();
 
     if (!pIndex || pIndex->nHeight != cache.GetCurrentBlock()->nHeight + 1) {
@@ -1013,8 +1751,20 @@ bool CSmartRewards::CommitBlock(CBlockIndex* pIndex, const CSmartRewardsUpdateRe
         cache.ClearResult();
     }
 
+    CSmartRewardsBlockUndo undo;
+
+    if (result.fUndoJournal) {
+        undo = result.undo;
+        undo.eligibleEntries = round->eligibleEntries;
+        undo.eligibleSmart = round->eligibleSmart;
+        undo.disqualifiedEntries = round->disqualifiedEntries;
+        undo.disqualifiedSmart = round->disqualifiedSmart;
+    }
+
     cache.ApplyRoundUpdateResult(result);
 
+    bool fEvaluated = false;
+
     // For the first round we have special parameter..
     if (!round->number) {
         if ((MainNet() && pIndex->GetBlockTime() > nFirstRoundStartTime) ||
@@ -1030,6 +1780,7 @@ bool CSmartRewards::CommitBlock(CBlockIndex* pIndex, const CSmartRewardsUpdateRe
 
             // Evaluate the round and update the next rounds parameter.
             EvaluateRound(first);
+            fEvaluated = true;
         }
     }
 
@@ -1073,6 +1824,13 @@ bool CSmartRewards::CommitBlock(CBlockIndex* pIndex, const CSmartRewardsUpdateRe
 
         // Evaluate the round and update the next rounds parameter.
         EvaluateRound(next);
+        fEvaluated = true;
+    }
+
+    // The evaluation of a round touches all entries, such blocks are undone the long way.
+    if (result.fUndoJournal && !fEvaluated) {
+        undo.blockHash = pIndex->GetBlockHash();
+        cache.AddBlockUndo(pIndex->nHeight, undo);
     }
 
     UpdatePercentage();
@@ -1086,6 +1844,11 @@ bool CSmartRewards::CommitBlock(CBlockIndex* pIndex, const CSmartRewardsUpdateRe
         LogPrint("smartrewards-bench", "  Commit block: %.2fms\n", dProcessingTime);
     }
 
+    // height, round number, round evaluated, duration in microseconds
+    TRACE4(rewards, block_committed, pIndex->nHeight, round->number, fEvaluated, GetTimeMicros() - nTime1);
+
+    PublishRoundsSnapshot();
+
     // If we are synced notify the UI on each new block.
     // If not notify the UI every nRewardsUISyncUpdateRate blocks to let it update the
     // loading screen.
@@ -1134,25 +1897,21 @@ bool CSmartRewards::CommitUndoBlock(CBlockIndex* pIndex, const CSmartRewardsUpda
 
         undoResult->round = prevRound;
 
-        if (!GetRewardRoundResults(prevRound.number, undoResult->results)) {
+        if (!GetRewardRoundResults(prevRound.number, *undoResult)) {
             LogPrintf("CSmartRewards::CommitUndoBlock - Failed to read last round's results!");
             return false;
         }
 
         cache.SetUndoResult(undoResult);
 
-        // Load all entries into the cache
-        CSmartRewardEntryMap tmpEntries;
-        pdb->ReadRewardEntries(tmpEntries);
-
-        for (auto itDb = tmpEntries.begin(); itDb != tmpEntries.end(); ++itDb) {
-            auto itCache = cache.GetEntries()->find(itDb->first);
-
-            if (itCache == cache.GetEntries()->end()) {
-                cache.AddEntry(itDb->second);
-            } else {
-                delete itDb->second;
+        if (fRewardsIncremental) {
+            // The snapshot contains all entries the round's evaluation did touch.
+            for (const CSmartRewardResultEntry* resultEntry : undoResult->results) {
+                cache.AddRoundCandidate(resultEntry->entry.id);
             }
+        } else {
+            // Load all entries into the cache
+            LoadRewardEntries();
         }
     }
 
@@ -1160,6 +1919,8 @@ bool CSmartRewards::CommitUndoBlock(CBlockIndex* pIndex, const CSmartRewardsUpda
 
     cache.UpdateHeights(GetBlockHeight(pIndex), cache.GetCurrentBlock()->nHeight);
 
+    PublishRoundsSnapshot();
+
     int nTime2 = GetTimeMicros();
 
     if (LogAcceptCategory("smartrewards-block")) {
@@ -1170,34 +1931,229 @@ bool CSmartRewards::CommitUndoBlock(CBlockIndex* pIndex, const CSmartRewardsUpda
     return true;
 }
 
+/** Block and spent outputs of one height, read by the rebuild workers. */
+struct CSmartRewardsRebuildBlock {
+    CBlockIndex* pindex;
+    CBlock block;
+    CBlockUndo undo;
+    bool fRead;
+
+    explicit CSmartRewardsRebuildBlock(CBlockIndex* pindexIn = nullptr) : pindex(pindexIn), fRead(false) {}
+};
+
+// Read the blocks and their undo data of a window, every worker takes a disjoint range of heights.
+static void ReadRebuildWindow(std::vector<CSmartRewardsRebuildBlock>& vWindow, int nThreads)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+
+    ParallelForChunks(vWindow.size(), nThreads, [&vWindow, &consensusParams](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; ++i) {
+            CSmartRewardsRebuildBlock& item = vWindow[i];
+            CDiskBlockPos pos = item.pindex->GetUndoPos();
+
+            item.fRead = ReadBlockFromDisk(item.block, item.pindex, consensusParams) &&
+                         !pos.IsNull() && UndoReadFromDisk(item.undo, pos, item.pindex->pprev->GetBlockHash());
+        }
+    });
+}
+
+// Feed one block through exactly the calls ConnectBlock does, the spent outputs come from the undo data
+// instead of the coins view.
+static bool ApplyRebuildBlock(CSmartRewards* pRewards, CSmartRewardsRebuildBlock& item)
+{
+    CBlockIndex* pindex = item.pindex;
+    const CBlock& block = item.block;
+
+    if (!item.fRead) {
+        return error("ApplyRebuildBlock - Failed to read block or undo data of %d", pindex->nHeight);
+    }
+
+    if (item.undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("ApplyRebuildBlock - Undo data mismatch in block %d", pindex->nHeight);
+    }
+
+    CSmartRewardsUpdateResult result(pindex);
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        int nCurrentRound = pRewards->GetCurrentRound()->number;
+
+        if (!pRewards->ProcessTransaction(pindex, tx, nCurrentRound)) {
+            continue;
+        }
+
+        if (!tx.IsCoinBase() && !tx.IsZerocoinSpend()) {
+            const CTxUndo& txundo = item.undo.vtxundo[i - 1];
+
+            if (txundo.vprevout.size() != tx.vin.size()) {
+                return error("ApplyRebuildBlock - Undo data mismatch in transaction %s", tx.GetHash().ToString());
+            }
+
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                const Coin& coin = txundo.vprevout[j];
+
+                if (!tx.vin[j].scriptSig.IsZerocoinSpend()) {
+                    pRewards->ProcessInput(tx, coin.out, CDecodedScript(coin.out.scriptPubKey), coin.nHeight, nCurrentRound, result);
+                }
+            }
+        }
+
+        for (const CTxOut& out : tx.vout) {
+            if (!out.scriptPubKey.IsZerocoinMint()) {
+                pRewards->ProcessOutput(tx, out, CDecodedScript(out.scriptPubKey), nCurrentRound, pindex->nHeight, pindex->nTime, result);
+            }
+        }
+    }
+
+    if (result.IsValid()) {
+        pRewards->CommitBlock(pindex, result);
+    }
+
+    if (pRewards->NeedsCacheWrite() && !pRewards->SyncCached(true)) {
+        return error("ApplyRebuildBlock - Failed to sync the cache at %d", pindex->nHeight);
+    }
+
+    return true;
+}
+
+void ThreadSmartRewards(bool fRecreate)
+{
+    // Block connections until the rewards caught up with the chain, they would be
+    // rejected by CommitBlock while the replay is behind.
+    LOCK(cs_main);
+
+    int nThreads = std::max(nScriptCheckThreads, 1);
+    int nHeight = prewards->GetCurrentBlock()->nHeight + 1;
+    int nStart = nHeight;
+    int nEnd = (int)std::min<int64_t>(chainActive.Height(), sporkManager.GetSporkValue(SPORK_15_SMARTREWARDS_BLOCKS_ENABLED));
+
+    if (fRecreate && nStart != 1) {
+        LogPrintf("ThreadSmartRewards - Rebuild requested but the database is at block %d\n", nStart - 1);
+        return;
+    }
+
+    if (nStart > nEnd) {
+        return;
+    }
+
+    LogPrintf("ThreadSmartRewards - Replay blocks %d - %d with %d threads\n", nStart, nEnd, nThreads);
+
+    int64_t nTimeStart = GetTimeMillis();
+
+    std::vector<CSmartRewardsRebuildBlock> vCurrent, vNext;
+
+    auto fillWindow = [&nHeight, nEnd](std::vector<CSmartRewardsRebuildBlock>& vWindow) {
+        vWindow.clear();
+        for (; nHeight <= nEnd && vWindow.size() < REWARDS_REBUILD_WINDOW; ++nHeight) {
+            vWindow.emplace_back(chainActive[nHeight]);
+        }
+    };
+
+    fillWindow(vCurrent);
+    ReadRebuildWindow(vCurrent, nThreads);
+
+    uiInterface.ShowProgress(_("Rebuilding SmartRewards..."), 0);
+
+    while (!vCurrent.empty()) {
+        // Read the next window while the current one gets applied in order.
+        fillWindow(vNext);
+        boost::thread reader(boost::bind(&ReadRebuildWindow, boost::ref(vNext), nThreads));
+
+        bool fSuccess = true;
+
+        for (CSmartRewardsRebuildBlock& item : vCurrent) {
+            if (ShutdownRequested() || !(fSuccess = ApplyRebuildBlock(prewards, item))) {
+                break;
+            }
+        }
+
+        reader.join();
+
+        if (!fSuccess || ShutdownRequested()) {
+            uiInterface.ShowProgress("", 100);
+            LogPrintf("ThreadSmartRewards - Replay stopped at block %d\n", prewards->GetCurrentBlock()->nHeight);
+            return;
+        }
+
+        int nDone = vCurrent.back().pindex->nHeight;
+        uiInterface.ShowProgress(_("Rebuilding SmartRewards..."), (int)((nDone - nStart + 1) * 100.0 / (nEnd - nStart + 1)));
+        LogPrint("smartrewards-bench", "ThreadSmartRewards - Replayed up to block %d\n", nDone);
+
+        vCurrent.swap(vNext);
+    }
+
+    if (!prewards->SyncCached()) {
+        LogPrintf("ThreadSmartRewards - Failed to sync the cache\n");
+    }
+
+    uiInterface.ShowProgress("", 100);
+
+    LogPrintf("ThreadSmartRewards - Replayed %d blocks in %.2fs\n", nEnd - nStart + 1, (GetTimeMillis() - nTimeStart) * 0.001);
+}
+
 CSmartRewardsCache::~CSmartRewardsCache()
 {
     LOCK(cs_rewardscache);
 
-    for (std::pair<CSmartAddress, CSmartRewardEntry*> it : entries) {
-        delete it.second;
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        entryPool.Destroy(it->second);
     }
 
-    if (result) {
-        result->Clear();
-        delete result;
+    for (auto it = termRewardEntries.begin(); it != termRewardEntries.end(); ++it) {
+        termRewardEntryPool.Destroy(it->second);
     }
 
+    delete result;
+    delete undoResults;
+
     block = CSmartRewardBlock();
     round = CSmartRewardRound();
     rounds.clear();
     addTransactions.clear();
     removeTransactions.clear();
     entries.clear();
+    termRewardEntries.clear();
 }
 
 unsigned long CSmartRewardsCache::EstimatedSize()
 {
-    unsigned long nEntriesSize = entries.size() * (sizeof(CSmartAddress) + sizeof(CSmartRewardEntry));
-    unsigned long nRoundsSize = (rounds.size() + 1) * sizeof(CSmartRewardRound);
-    unsigned long nTransactionsSize = (addTransactions.size() + removeTransactions.size()) * (sizeof(uint256) + sizeof(CSmartRewardTransaction));
+    LOCK(cs_rewardscache);
+    unsigned long nEntriesSize = entries.DynamicMemoryUsage() + nEntriesAddressUsage + entryPool.DynamicMemoryUsage();
+    unsigned long nTermEntriesSize = memusage::DynamicUsage(termRewardEntries) + termRewardEntryPool.DynamicMemoryUsage();
+    unsigned long nRoundsSize = memusage::DynamicUsage(rounds) + sizeof(CSmartRewardRound);
+    unsigned long nTransactionsSize = memusage::DynamicUsage(addTransactions) + memusage::DynamicUsage(removeTransactions);
     unsigned long nBlockSize = sizeof(CSmartRewardBlock);
-    return nEntriesSize + nRoundsSize + nTransactionsSize + nBlockSize;
+    unsigned long nBlockUndosSize = memusage::DynamicUsage(blockUndos);
+    for (const auto& undo : blockUndos) {
+        nBlockUndosSize += memusage::DynamicUsage(undo.second.entries);
+    }
+    return nEntriesSize + nTermEntriesSize + nRoundsSize + nTransactionsSize + nBlockSize + nBlockUndosSize;
+}
+
+void CSmartRewardsCache::GetMemoryUsage(memusage::ComponentUsage& usage)
+{
+    LOCK(cs_rewardscache);
+    usage.emplace_back("entries", entries.DynamicMemoryUsage() + nEntriesAddressUsage + entryPool.DynamicMemoryUsage());
+    usage.emplace_back("term_entries", memusage::DynamicUsage(termRewardEntries) + termRewardEntryPool.DynamicMemoryUsage());
+    usage.emplace_back("read_entries", readEntries.DynamicMemoryUsage());
+    usage.emplace_back("rounds", memusage::DynamicUsage(rounds));
+    usage.emplace_back("round_candidates", memusage::DynamicUsage(roundCandidates));
+    usage.emplace_back("transactions", memusage::DynamicUsage(addTransactions) + memusage::DynamicUsage(removeTransactions));
+
+    size_t nBlockUndos = memusage::DynamicUsage(blockUndos);
+    for (const auto& undo : blockUndos) {
+        nBlockUndos += memusage::DynamicUsage(undo.second.entries);
+    }
+    usage.emplace_back("block_undos", nBlockUndos);
+
+    size_t nResults = 0;
+    if (result != nullptr) {
+        nResults += memusage::MallocUsage(sizeof(CSmartRewardsRoundResult)) + result->DynamicMemoryUsage();
+    }
+    if (undoResults != nullptr) {
+        nResults += memusage::MallocUsage(sizeof(CSmartRewardsRoundResult)) + undoResults->DynamicMemoryUsage();
+    }
+    usage.emplace_back("results", nResults);
 }
 
 void CSmartRewardsCache::Load(const CSmartRewardBlock& block, const CSmartRewardRound& round, const CSmartRewardRoundMap& rounds)
@@ -1205,6 +2161,7 @@ void CSmartRewardsCache::Load(const CSmartRewardBlock& block, const CSmartReward
     this->block = block;
     this->round = round;
     this->rounds = rounds;
+    ++nRoundsVersion;
 }
 
 bool CSmartRewardsCache::NeedsSync()
@@ -1215,6 +2172,14 @@ bool CSmartRewardsCache::NeedsSync()
            EstimatedSize() > REWARDS_MAX_CACHE || entries.size() > nCacheRewardEntries;
 }
 
+double CSmartRewardsCache::Pressure()
+{
+    LOCK(cs_rewardscache);
+    double nSizePressure = (double)EstimatedSize() / REWARDS_MAX_CACHE;
+    double nEntriesPressure = nCacheRewardEntries ? (double)entries.size() / nCacheRewardEntries : 0;
+    return std::max(nSizePressure, nEntriesPressure);
+}
+
 void CSmartRewardsCache::Clear()
 {
     LOCK(cs_rewardscache);
@@ -1224,47 +2189,99 @@ void CSmartRewardsCache::Clear()
     }
 
     if (undoResults) {
+        // The undo of the round did write its entries straight to the database.
+        if (!undoResults->fSynced) {
+            readEntries.Clear();
+        }
+
         undoResults->fSynced = true;
     }
 
     for (auto it = entries.cbegin(); it != entries.cend(); it++) {
-        delete it->second;
+        entryPool.Destroy(it->second);
     }
 
     entries.clear();
+    nEntriesAddressUsage = 0;
+    // Keep the storage for the next cache cycle but don't hold on to the memory of a full
+    // database load after a round's evaluation.
+    entries.shrink(nCacheRewardEntries);
+    entryPool.Reset(nCacheRewardEntries);
     addTransactions.clear();
     removeTransactions.clear();
+    blockUndos.clear();
 }
 
-void CSmartRewardsCache::ClearResult()
+void CSmartRewardsCache::Freeze(CSmartRewardsCache& snapshot)
 {
-    if (result) {
-        auto it = result->results.begin();
+    LOCK(cs_rewardscache);
 
-        while (it != result->results.end()) {
-            delete *it;
-            ++it;
-        }
+    assert(snapshot.entries.empty() && snapshot.result == nullptr);
+    assert(undoResults == nullptr || undoResults->fSynced);
+
+    snapshot.block = block;
+    snapshot.round = round;
+    snapshot.rounds = rounds;
+
+    // The entries just change hands, the emptied pool of the snapshot becomes the
+    // storage of the new delta.
+    snapshot.entries.swap(entries);
+    snapshot.entryPool.Swap(entryPool);
+    std::swap(snapshot.nEntriesAddressUsage, nEntriesAddressUsage);
 
-        result->results.clear();
-        result->payouts.clear();
-        delete result;
-        result = nullptr;
+    snapshot.addTransactions.swap(addTransactions);
+    snapshot.removeTransactions.swap(removeTransactions);
+    snapshot.blockUndos.swap(blockUndos);
+
+    // TermRewards entries stay in the cache, the snapshot gets copies.
+    for (auto it = termRewardEntries.begin(); it != termRewardEntries.end(); ++it) {
+        snapshot.termRewardEntries[it->first] = snapshot.termRewardEntryPool.Construct(*it->second);
     }
 
-    if (undoResults) {
-        auto it = undoResults->results.begin();
+    // The last result is still required for the payments, it stays unsynced
+    // until the snapshot was written.
+    if (result != nullptr && !result->fSynced) {
+        CSmartRewardsRoundResult* pSnapshot = new CSmartRewardsRoundResult();
+        pSnapshot->round = result->round;
 
-        while (it != undoResults->results.end()) {
-            delete *it;
-            ++it;
+        for (const CSmartRewardResultEntry* entry : result->results) {
+            pSnapshot->results.push_back(pSnapshot->CreateEntry(*entry));
         }
 
-        undoResults->results.clear();
-        undoResults->payouts.clear();
-        delete undoResults;
-        undoResults = nullptr;
+        snapshot.result = pSnapshot;
+    }
+}
+
+void CSmartRewardsCache::MarkResultSynced(const CSmartRewardsRoundResult* pFlushed)
+{
+    LOCK(cs_rewardscache);
+
+    if (result != nullptr && result->round.number == pFlushed->round.number) {
+        result->fSynced = true;
+    }
+}
+
+void CSmartRewardsCache::ClearSnapshot()
+{
+    LOCK(cs_rewardscache);
+
+    Clear();
+    ClearResult();
+
+    for (auto it = termRewardEntries.begin(); it != termRewardEntries.end(); ++it) {
+        termRewardEntryPool.Destroy(it->second);
     }
+
+    termRewardEntries.clear();
+}
+
+void CSmartRewardsCache::ClearResult()
+{
+    delete result;
+    result = nullptr;
+
+    delete undoResults;
+    undoResults = nullptr;
 }
 
 void CSmartRewardsCache::SetCurrentBlock(const CSmartRewardBlock& currentBlock)
@@ -1283,11 +2300,11 @@ void CSmartRewardsCache::SetResult(CSmartRewardsRoundResult* pResult)
 {
     AssertLockHeld(cs_rewardscache);
 
-    if (result) {
-        result->Clear();
-        delete result;
+    if (pResult) {
+        pResult->PreparePayouts(Params().GetConsensus().nRewardsPayoutStartDelay);
     }
 
+    delete result;
     result = pResult;
 }
 
@@ -1295,12 +2312,11 @@ void CSmartRewardsCache::SetUndoResult(CSmartRewardsRoundResult* pResult)
 {
     AssertLockHeld(cs_rewardscache);
 
-    if (undoResults) {
-        undoResults->Clear();
-        delete undoResults;
-    }
-
+    delete undoResults;
     undoResults = pResult;
+
+    // The sync writes the entries of the result, the ones read before are outdated then.
+    readEntries.Clear();
 }
 
 void CSmartRewardsCache::ApplyRoundUpdateResult(const CSmartRewardsUpdateResult& result)
@@ -1354,6 +2370,7 @@ void CSmartRewardsCache::AddFinishedRound(const CSmartRewardRound& round)
     AssertLockHeld(cs_rewardscache);
 
     rounds[round.number] = round;
+    ++nRoundsVersion;
 }
 
 void CSmartRewardsCache::RemoveFinishedRound(const int& nNumber)
@@ -1364,6 +2381,7 @@ void CSmartRewardsCache::RemoveFinishedRound(const int& nNumber)
 
     if (it != rounds.end()) {
         rounds.erase(it);
+        ++nRoundsVersion;
     }
 }
 
@@ -1394,7 +2412,51 @@ void CSmartRewardsCache::RemoveTransaction(const CSmartRewardTransaction& transa
 void CSmartRewardsCache::AddEntry(CSmartRewardEntry* entry)
 {
     LOCK(cs_rewardscache);
+
+    size_t nSize = entries.size();
     entries[entry->id] = entry;
+
+    if (entries.size() != nSize) {
+        // The address is stored twice, as key and in the entry.
+        nEntriesAddressUsage += 2 * entry->id.DynamicMemoryUsage();
+    }
+
+    // Entries only change while they are in the write cache, drop the copy to not return
+    // a stale one once they got written and removed from the cache.
+    if (readEntries.GetSize()) {
+        readEntries.Erase(entry->id);
+    }
+}
+
+bool CSmartRewardsCache::GetReadEntry(const CSmartAddress& id, bool& fFound, CSmartRewardEntry& entry)
+{
+    LOCK(cs_rewardscache);
+
+    std::pair<bool, CSmartRewardEntry> item;
+
+    if (!readEntries.Get(id, item)) {
+        return false;
+    }
+
+    readEntries.Touch(id);
+
+    fFound = item.first;
+    if (fFound) {
+        entry = item.second;
+    }
+
+    return true;
+}
+
+void CSmartRewardsCache::AddReadEntry(const CSmartAddress& id, bool fFound, const CSmartRewardEntry& entry)
+{
+    LOCK(cs_rewardscache);
+
+    if (!readEntries.GetMaxSize()) {
+        return;
+    }
+
+    readEntries.Insert(id, std::make_pair(fFound, fFound ? entry : CSmartRewardEntry(id)));
 }
 
 void CSmartRewardsCache::AddTermRewardEntry(CTermRewardEntry *entry)
@@ -1403,12 +2465,155 @@ void CSmartRewardsCache::AddTermRewardEntry(CTermRewardEntry *entry)
     termRewardEntries[{entry->address, entry->txHash}] = entry;
 }
 
+void CSmartRewardsCache::AddBlockUndo(const int nHeight, const CSmartRewardsBlockUndo& undo)
+{
+    LOCK(cs_rewardscache);
+    blockUndos[nHeight] = undo;
+    // Don't hold on to journals which wouldn't make it into the database anyway.
+    blockUndos.erase(blockUndos.begin(), blockUndos.lower_bound(nHeight - REWARDS_UNDO_JOURNAL_BLOCKS + 1));
+}
+
+void CSmartRewardsCache::RemoveBlockUndo(const int nHeight)
+{
+    LOCK(cs_rewardscache);
+    blockUndos.erase(nHeight);
+}
+
+void CSmartRewardsCache::AddRoundCandidate(const CSmartAddress& id)
+{
+    LOCK(cs_rewardscache);
+    roundCandidates.insert(id);
+}
+
+void CSmartRewardsCache::SetRoundCandidates(const CSmartAddressSet& candidates)
+{
+    LOCK(cs_rewardscache);
+    roundCandidates = candidates;
+}
+
+size_t CSmartRewardsRoundResult::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(results) + memusage::DynamicUsage(payouts) + pool.DynamicMemoryUsage() +
+                    memusage::DynamicUsage(vPayoutSlices) + memusage::DynamicUsage(vPayoutOutputs);
+    for (const std::vector<CTxOut>& vout : vPayoutOutputs) {
+        nUsage += memusage::DynamicUsage(vout);
+        for (const CTxOut& out : vout) {
+            nUsage += RecursiveDynamicUsage(out);
+        }
+    }
+    return nUsage;
+}
+
 void CSmartRewardsRoundResult::Clear()
 {
     for (CSmartRewardResultEntry* resultEntry : results) {
-        delete resultEntry;
+        pool.Destroy(resultEntry);
     }
 
     results.clear();
     payouts.clear();
+    pool.Reset();
+
+    nRewardBlocks = 0;
+    nLastRoundBlock = 0;
+    nPayoutInterval = 0;
+    vPayoutSlices.clear();
+    vPayoutOutputs.clear();
+}
+
+void CSmartRewardsRoundResult::PreparePayouts(int64_t nPayoutDelay)
+{
+    int64_t nPayeeCount = round.GetEligibleEntries();
+    int64_t nBlockPayees = round.nBlockPayees;
+
+    nRewardBlocks = 0;
+    nLastRoundBlock = 0;
+    nPayoutInterval = round.nBlockInterval;
+    vPayoutSlices.clear();
+    vPayoutOutputs.clear();
+
+    // If we have no eligible addresses. Just to make sure...wont happen.
+    if (nPayeeCount <= 0 || nBlockPayees <= 0 || nPayoutInterval <= 0) {
+        return;
+    }
+
+    nRewardBlocks = nPayeeCount / nBlockPayees;
+    // If we dont match nRewardsPayoutsPerBlock add one more block for the remaining payments.
+    if (nPayeeCount % nBlockPayees) nRewardBlocks += 1;
+
+    nLastRoundBlock = round.endBlockHeight + nPayoutDelay + ((nRewardBlocks - 1) * nPayoutInterval);
+
+    vPayoutSlices.reserve(nRewardBlocks);
+
+    for (int64_t nRewardBlock = 1; nRewardBlock <= nRewardBlocks; ++nRewardBlock) {
+        int64_t nFinalBlockPayees = nBlockPayees;
+
+        // If the to be paid addresses are no multile of nRewardsPayoutsPerBlock
+        // the last payout block has less payees than the others.
+        if (nRewardBlock == nRewardBlocks && nPayeeCount % nBlockPayees) {
+            nFinalBlockPayees = nPayeeCount % nBlockPayees;
+        }
+
+        size_t nStartIndex = (nRewardBlock - 1) * nBlockPayees;
+        vPayoutSlices.push_back(std::make_pair(nStartIndex, nStartIndex + nFinalBlockPayees));
+    }
+
+    vPayoutOutputs.resize(nRewardBlocks);
+}
+
+int CSmartRewardsRoundResult::GetPayoutBlock(int nHeight) const
+{
+    if (!nRewardBlocks || nHeight > nLastRoundBlock || (nLastRoundBlock - nHeight) % nPayoutInterval) {
+        return -1;
+    }
+
+    int64_t nRewardBlock = nRewardBlocks - ((nLastRoundBlock - nHeight) / nPayoutInterval);
+
+    return nRewardBlock > 0 ? nRewardBlock - 1 : -1;
+}
+
+bool CSmartRewardsRoundResult::GetPayouts(int nHeight, CSmartRewardPayoutSlice& slice) const
+{
+    slice = CSmartRewardPayoutSlice();
+
+    int nPayoutBlock = GetPayoutBlock(nHeight);
+
+    if (nPayoutBlock < 0) {
+        return true;
+    }
+
+    const std::pair<size_t, size_t>& range = vPayoutSlices[nPayoutBlock];
+
+    // If for any reason the calculations end up in an overflow of the vector return an error.
+    if (range.second > payouts.size()) {
+        return false;
+    }
+
+    slice = CSmartRewardPayoutSlice(payouts.data() + range.first, payouts.data() + range.second);
+    return true;
+}
+
+const std::vector<CTxOut>& CSmartRewardsRoundResult::GetPayoutOutputs(int nHeight) const
+{
+    AssertLockHeld(cs_rewardscache);
+
+    static const std::vector<CTxOut> vEmpty;
+
+    CSmartRewardPayoutSlice slice;
+
+    if (!GetPayouts(nHeight, slice) || slice.empty()) {
+        return vEmpty;
+    }
+
+    std::vector<CTxOut>& vout = vPayoutOutputs[GetPayoutBlock(nHeight)];
+
+    if (vout.empty()) {
+        for (const CSmartRewardResultEntry* s : slice) {
+            if (s->reward > 0) {
+                vout.push_back(CTxOut(s->reward, s->entry.id.GetScript()));
+            }
+        }
+    }
+
+    return vout;
 }
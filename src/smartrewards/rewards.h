@@ -5,14 +5,29 @@
 #ifndef REWARDS_H
 #define REWARDS_H
 
+#include "cachemap.h"
+#include "changefeed.h"
+#include "objectpool.h"
 #include "sync.h"
 
 #include "consensus/consensus.h"
 #include <smartrewards/rewardsdb.h>
+#include <smartrewards/rewardsstats.h>
+
+#include <functional>
+#include <memory>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 using namespace std;
 
 #define REWARDS_CACHE_ENTRIES_DEFAULT 50000
+#define REWARDS_READ_CACHE_ENTRIES_DEFAULT 10000
+
+static const bool DEFAULT_REWARDS_INCREMENTAL = false;
+static const bool DEFAULT_REWARDS_REBUILD = false;
 
 static const CAmount SMART_REWARDS_MIN_BALANCE_1_2 = 1000 * COIN;
 static const CAmount SMART_REWARDS_MIN_BALANCE_1_3 = 999 * COIN; //Reduce by 1 to allow for activation fee
@@ -22,6 +37,9 @@ const int64_t nRewardsSyncDistance = 600;
 // Number of blocks we update the SmartRewards UI when we are in the sync process
 const int64_t nRewardsUISyncUpdateRate = 500;
 
+// Number of most recent blocks which keep an undo journal of the touched reward entries
+const int REWARDS_UNDO_JOURNAL_BLOCKS = 1440;
+
 // First automated round on mainnet
 const int64_t nRewardsFirstAutomatedRound = 13;
 
@@ -46,6 +64,12 @@ extern CCriticalSection cs_rewardsdb;
 //extern CCriticalSection cs_termrewardsdb;
 
 extern size_t nCacheRewardEntries;
+extern size_t nReadCacheRewardEntries;
+extern bool fRewardsIncremental;
+
+class CDecodedBlockScripts;
+class CSmartRewardsRoundFile;
+struct CDecodedScript;
 
 struct CSmartRewardsUpdateResult {
     int64_t disqualifiedEntries;
@@ -53,9 +77,13 @@ struct CSmartRewardsUpdateResult {
     int64_t qualifiedEntries;
     int64_t qualifiedSmart;
     CSmartRewardBlock block;
-    CSmartRewardsUpdateResult() : disqualifiedEntries(0), disqualifiedSmart(0), qualifiedEntries(0), qualifiedSmart(0), block() {}
-    CSmartRewardsUpdateResult(const int nHeight, const uint256* pBlockHash, const int64_t nBlockTime) : disqualifiedEntries(0), disqualifiedSmart(0), qualifiedEntries(0), qualifiedSmart(0), block(nHeight, pBlockHash, nBlockTime) {}
-    CSmartRewardsUpdateResult(const CBlockIndex* pIndex) : disqualifiedEntries(0), disqualifiedSmart(0), qualifiedEntries(0), qualifiedSmart(0), block()
+    //! Collect the previous state of the touched entries into undo.
+    bool fUndoJournal;
+    CSmartRewardsBlockUndo undo;
+    CSmartAddressSet undoEntries;
+    CSmartRewardsUpdateResult() : disqualifiedEntries(0), disqualifiedSmart(0), qualifiedEntries(0), qualifiedSmart(0), block(), fUndoJournal(false) {}
+    CSmartRewardsUpdateResult(const int nHeight, const uint256* pBlockHash, const int64_t nBlockTime) : disqualifiedEntries(0), disqualifiedSmart(0), qualifiedEntries(0), qualifiedSmart(0), block(nHeight, pBlockHash, nBlockTime), fUndoJournal(false) {}
+    CSmartRewardsUpdateResult(const CBlockIndex* pIndex) : disqualifiedEntries(0), disqualifiedSmart(0), qualifiedEntries(0), qualifiedSmart(0), block(), fUndoJournal(false)
     {
         if (pIndex && pIndex->phashBlock) {
             block = CSmartRewardBlock(pIndex->nHeight, pIndex->phashBlock, pIndex->nTime);
@@ -63,6 +91,27 @@ struct CSmartRewardsUpdateResult {
     }
 
     bool IsValid() const { return block.IsValid(); }
+
+    /** Remember the entry as it is before the block changes it for the first time. */
+    void AddUndoEntry(const CSmartRewardEntry& entry)
+    {
+        if (fUndoJournal && undoEntries.insert(entry.id).second) {
+            undo.entries.push_back(entry);
+        }
+    }
+};
+
+// Payees of one reward block, a view into the payouts of a round result.
+struct CSmartRewardPayoutSlice {
+    CSmartRewardResultEntry* const* pBegin;
+    CSmartRewardResultEntry* const* pEnd;
+    CSmartRewardPayoutSlice() : pBegin(nullptr), pEnd(nullptr) {}
+    CSmartRewardPayoutSlice(CSmartRewardResultEntry* const* pBeginIn, CSmartRewardResultEntry* const* pEndIn) : pBegin(pBeginIn), pEnd(pEndIn) {}
+
+    CSmartRewardResultEntry* const* begin() const { return pBegin; }
+    CSmartRewardResultEntry* const* end() const { return pEnd; }
+    size_t size() const { return pEnd - pBegin; }
+    bool empty() const { return pBegin == pEnd; }
 };
 
 struct CSmartRewardsRoundResult {
@@ -70,11 +119,51 @@ struct CSmartRewardsRoundResult {
     CSmartRewardResultEntryPtrList results;
     CSmartRewardResultEntryPtrList payouts;
     bool fSynced;
-    CSmartRewardsRoundResult() { fSynced = false; }
+    CSmartRewardsRoundResult() : fSynced(false), nRewardBlocks(0), nLastRoundBlock(0), nPayoutInterval(0) {}
+    ~CSmartRewardsRoundResult() { Clear(); }
+
+    CSmartRewardResultEntry* CreateEntry(CSmartRewardEntry* entry, CAmount nReward) { return pool.Construct(entry, nReward); }
+    CSmartRewardResultEntry* CreateEntry(const CSmartRewardResultEntry& entry) { return pool.Construct(entry); }
 
     void Clear();
+
+    /** Split the payouts into the slices of the reward blocks. Needs to be called
+     *  again whenever the payouts or the round's payout parameter change. */
+    void PreparePayouts(int64_t nPayoutDelay);
+    /** Set slice to the payees of the reward block at nHeight, empty if there is none. Returns
+     *  false if the payouts don't cover the reward block. */
+    bool GetPayouts(int nHeight, CSmartRewardPayoutSlice& slice) const;
+    /** Coinbase outputs of the reward block at nHeight, built on first use. Requires cs_rewardscache. */
+    const std::vector<CTxOut>& GetPayoutOutputs(int nHeight) const;
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    // All results of a round get created and released together.
+    CObjectPool<CSmartRewardResultEntry> pool;
+
+    // Payout schedule built by PreparePayouts().
+    int64_t nRewardBlocks;
+    int64_t nLastRoundBlock;
+    int64_t nPayoutInterval;
+    std::vector<std::pair<size_t, size_t> > vPayoutSlices;
+    mutable std::vector<std::vector<CTxOut> > vPayoutOutputs;
+
+    int GetPayoutBlock(int nHeight) const;
 };
 
+// Immutable state of the rounds published after each processed block. Readers keep
+// a reference as long as they need it and don't have to lock cs_rewardscache.
+struct CSmartRewardsRoundsSnapshot {
+    CSmartRewardBlock block;
+    CSmartRewardRound current;
+    std::shared_ptr<const CSmartRewardRoundMap> history;
+    uint32_t nRoundsVersion;
+    CSmartRewardsRoundsSnapshot() : block(), current(), history(std::make_shared<CSmartRewardRoundMap>()), nRoundsVersion(0) {}
+};
+
+typedef std::shared_ptr<const CSmartRewardsRoundsSnapshot> CSmartRewardsRoundsSnapshotRef;
+
 class CSmartRewardsCache
 {
     int chainHeight;
@@ -87,21 +176,47 @@ class CSmartRewardsCache
     CSmartRewardTransactionMap removeTransactions;
     CSmartRewardEntryMap entries;
     CTermRewardEntryMap termRewardEntries;
+    CSmartAddressSet roundCandidates;
     CSmartRewardsRoundResult* result;
     CSmartRewardsRoundResult* undoResults;
+    CSmartRewardsBlockUndoMap blockUndos;
+
+    CObjectPool<CSmartRewardEntry> entryPool;
+
+    //! Copies of entries looked up by the RPC, SAPI and UI which are not part of the write cache. Misses
+    //! are stored as well. Stays with the cache on Freeze() and is invalidated by AddEntry().
+    CacheMap<CSmartAddress, std::pair<bool, CSmartRewardEntry>, CSmartAddressHasher> readEntries;
+    CObjectPool<CTermRewardEntry> termRewardEntryPool;
+
+    //! Heap memory used by the addresses of the cached entries, the map's own storage excluded.
+    size_t nEntriesAddressUsage;
+    //! Bumped whenever the finished rounds change.
+    uint32_t nRoundsVersion;
 
 public:
-    CSmartRewardsCache() : block(), round(), rounds(), addTransactions(), removeTransactions(), entries(), result(nullptr), undoResults(nullptr) {}
+    CSmartRewardsCache() : block(), round(), rounds(), addTransactions(), removeTransactions(), entries(), result(nullptr), undoResults(nullptr), readEntries(nReadCacheRewardEntries), nEntriesAddressUsage(0), nRoundsVersion(0) {}
     ~CSmartRewardsCache();
 
     unsigned long EstimatedSize();
+    /** Heap usage by part of the cache, the round results included. */
+    void GetMemoryUsage(memusage::ComponentUsage& usage);
 
     void Load(const CSmartRewardBlock& block, const CSmartRewardRound& round, const CSmartRewardRoundMap& rounds);
 
     bool NeedsSync();
+    /** Share of the size or entry limit the cache uses, whichever is higher. */
+    double Pressure();
     void Clear();
     void ClearResult();
 
+    /** Hand everything which has to be written to the database over to the empty
+     *  snapshot cache and continue with an empty delta. */
+    void Freeze(CSmartRewardsCache& snapshot);
+    /** Release the data a previous Freeze() moved into this cache. */
+    void ClearSnapshot();
+    /** Mark the result as synced once the snapshot with its copy was written. */
+    void MarkResultSynced(const CSmartRewardsRoundResult* pFlushed);
+
     void SetCurrentBlock(const CSmartRewardBlock& currentBlock);
     void SetCurrentRound(const CSmartRewardRound& currentRound);
     void SetResult(CSmartRewardsRoundResult* pResult);
@@ -116,19 +231,34 @@ public:
     const CSmartRewardBlock* GetCurrentBlock() const { return &block; }
     const CSmartRewardRound* GetCurrentRound() const { return &round; }
     const CSmartRewardRoundMap* GetRounds() const { return &rounds; }
+    uint32_t GetRoundsVersion() const { return nRoundsVersion; }
     const CSmartRewardTransactionMap* GetAddedTransactions() const { return &addTransactions; }
     const CSmartRewardTransactionMap* GetRemovedTransactions() const { return &removeTransactions; }
     const CSmartRewardEntryMap* GetEntries() const { return &entries; }
     const CTermRewardEntryMap* GetTermRewardsEntries() const { return &termRewardEntries; }
+    const CSmartAddressSet* GetRoundCandidates() const { return &roundCandidates; }
     const CSmartRewardsRoundResult* GetLastRoundResult() const { return result; }
     const CSmartRewardsRoundResult* GetUndoResult() const { return undoResults; }
+    const CSmartRewardsBlockUndoMap* GetBlockUndos() const { return &blockUndos; }
 
     void AddFinishedRound(const CSmartRewardRound& round);
     void RemoveFinishedRound(const int& nNumber);
     void AddTransaction(const CSmartRewardTransaction& transaction);
     void RemoveTransaction(const CSmartRewardTransaction& transaction);
+    CSmartRewardEntry* CreateEntry(const CSmartAddress& id) { return entryPool.Construct(id); }
+    CSmartRewardEntry* CreateEntry(const CSmartRewardEntry& entry) { return entryPool.Construct(entry); }
+    void DestroyEntry(CSmartRewardEntry* entry) { entryPool.Destroy(entry); }
+    CTermRewardEntry* CreateTermRewardEntry(const CTermRewardDbKey& id) { return termRewardEntryPool.Construct(id.first, id.second); }
+    void DestroyTermRewardEntry(CTermRewardEntry* entry) { termRewardEntryPool.Destroy(entry); }
+
     void AddEntry(CSmartRewardEntry* entry);
+    bool GetReadEntry(const CSmartAddress& id, bool& fFound, CSmartRewardEntry& entry);
+    void AddReadEntry(const CSmartAddress& id, bool fFound, const CSmartRewardEntry& entry);
     void AddTermRewardEntry(CTermRewardEntry *entry);
+    void AddBlockUndo(const int nHeight, const CSmartRewardsBlockUndo& undo);
+    void RemoveBlockUndo(const int nHeight);
+    void AddRoundCandidate(const CSmartAddress& id);
+    void SetRoundCandidates(const CSmartAddressSet& candidates);
 };
 
 class CSmartRewards
@@ -141,24 +271,77 @@ class CSmartRewards
     void UpdateRoundPayoutParameter();
     void UpdatePercentage();
 
+    // Snapshot of the cache which gets written to the database in the background.
+    // Only modified by the block processing with cs_rewardscache held, the writer
+    // thread only reads it while fFlushPending is set.
+    CSmartRewardsCache flushCache;
+    bool fFlushSnapshot;
+
+    boost::mutex csFlush;
+    boost::condition_variable condFlush;
+    boost::thread flushThread;
+    bool fFlushPending;
+    bool fFlushFailed;
+    bool fFlushStop;
+
+    // Rounds published for the readers, csRoundsSnapshot only guards the reference.
+    mutable CCriticalSection csRoundsSnapshot;
+    CSmartRewardsRoundsSnapshotRef roundsSnapshot;
+    CChangeFeed roundsFeed;
+
+    void PublishRoundsSnapshot();
+
+    CSmartRewardsStats stats;
+
+    void ThreadFlush();
+    bool WaitForFlush();
+    void ReleaseFlushed();
+    void ReleaseSnapshot(bool fWritten);
+
+    bool ReadFlushedRewardEntry(const CSmartAddress& id, bool& fFound, CSmartRewardEntry& entry);
     bool ReadRewardEntry(const CSmartAddress& id, CSmartRewardEntry& entry);
+    bool ReadTermRewardEntry(const CTermRewardDbKey& id, CTermRewardEntry& entry);
+    bool ReadBlockUndo(const int nHeight, CSmartRewardsBlockUndo& undo);
     bool GetRewardEntries(CSmartRewardEntryMap& entries);
+    void MergeTermRewardEntries(const std::function<bool(const CTermRewardEntry&)>& filter, CTermRewardEntryList& entries);
+
+    void LoadRewardEntries();
+    void LoadRoundCandidates();
+    void UpdateRoundCandidates();
 
 public:
     CSmartRewards(CSmartRewardsDB* prewardsdb);
-    ~CSmartRewards() { delete pdb; }
+    ~CSmartRewards();
     void Lock();
     bool IsLocked();
 
     bool GetLastBlock(CSmartRewardBlock& block);
+    /** Iterator over the rewards database as of now for a snapshot of it, block
+     *  gets the last block written to it. */
+    CDBIterator* NewDatabaseIterator(CSmartRewardBlock& block) { return pdb->NewSnapshotIterator(block); }
     bool GetTransaction(const uint256 hash, CSmartRewardTransaction& transaction);
+    const CSmartRewardBlock* GetCurrentBlock();
     const CSmartRewardRound* GetCurrentRound();
     const CSmartRewardRoundMap* GetRewardRounds();
+    /** State of the rounds as of the last processed block, doesn't require cs_rewardscache. */
+    CSmartRewardsRoundsSnapshotRef GetRoundsSnapshot() const;
+    /** Bumped with every published rounds snapshot, once per processed block. */
+    CChangeFeed& GetRoundsFeed() { return roundsFeed; }
+    /** Timings of the block processing, used by getrewardsstats and the SAPI. */
+    CSmartRewardsStats& GetStats() { return stats; }
+    /** Estimated memory usage of the write cache in bytes. */
+    unsigned long GetCacheSize() { return cache.EstimatedSize(); }
+    /** Share of its limit the write cache uses, NeedsCacheWrite() from 1 on. */
+    double GetCachePressure() { return cache.Pressure(); }
+    /** Heap usage of the cache by part and of the snapshot being written in the background. */
+    void GetMemoryUsage(memusage::ComponentUsage& usage);
 
     void UpdateHeights(const int nHeight, const int nRewardHeight);
     bool Verify();
     bool NeedsCacheWrite();
-    bool SyncCached();
+    bool SyncCached(bool fBackground = false);
+    /** Wait for the snapshot SyncCached(true) handed over to hit the database, false if writing it failed. */
+    bool FinishFlush();
     bool IsSynced();
 
     int GetBlocksPerRound(const int nRound);
@@ -166,21 +349,38 @@ public:
     bool Update(CBlockIndex* pindexNew, const CChainParams& chainparams, const int nCurrentRound, CSmartRewardsUpdateResult& result);
     bool UpdateRound(const CSmartRewardRound& round);
 
-    void ProcessInput(const CTransaction& tx, const CTxOut& in, int txHeight, uint16_t nCurrentRound, CSmartRewardsUpdateResult& result);
-    void ProcessOutput(const CTransaction& tx, const CTxOut& out, uint16_t nCurrentRound, int nHeight, unsigned int nTime, CSmartRewardsUpdateResult& result);
+    //! script is the decoded scriptPubKey of in or out
+    void ProcessInput(const CTransaction& tx, const CTxOut& in, const CDecodedScript& script, int txHeight, uint16_t nCurrentRound, CSmartRewardsUpdateResult& result);
+    void ProcessOutput(const CTransaction& tx, const CTxOut& out, const CDecodedScript& script, uint16_t nCurrentRound, int nHeight, unsigned int nTime, CSmartRewardsUpdateResult& result);
 
     void UndoInput(const CTransaction& tx, const CTxOut& in, int txHeight, uint16_t nCurrentRound, CSmartRewardsUpdateResult& result);
     void UndoOutput(const CTransaction& tx, const CTxOut& out, int txHeight, uint16_t nCurrentRound, CSmartRewardsUpdateResult& result);
 
+    /** Load the entries of all addresses in the block with one pass over the database before the
+     *  transactions get processed, so ProcessInput and ProcessOutput don't hit the disk one by one. */
+    void PrefetchRewardEntries(const CBlockIndex* pIndex, const CBlock& block, const CDecodedBlockScripts& scripts);
     bool ProcessTransaction(CBlockIndex* pIndex, const CTransaction& tx, int nCurrentRound);
+    /** Restore the entries from the undo journal of the block, returns false if there is none and
+     *  UndoTransaction has to be used. */
+    bool UndoBlock(const CBlockIndex* pIndex, const CBlock& block, CSmartRewardsUpdateResult& result);
     void UndoTransaction(CBlockIndex* pIndex, const CTransaction& tx, CCoinsViewCache& coins, const CChainParams& chainparams, CSmartRewardsUpdateResult& result);
 
     bool CommitBlock(CBlockIndex* pIndex, const CSmartRewardsUpdateResult& result);
     bool CommitUndoBlock(CBlockIndex* pIndex, const CSmartRewardsUpdateResult& result);
 
     bool GetRewardEntry(const CSmartAddress& id, CSmartRewardEntry*& entry, bool fCreate);
+    /** Copy of the current state of an entry for the readers, database lookups go through a separate
+     *  read cache and don't end up in the write cache. */
+    bool GetRewardEntry(const CSmartAddress& id, CSmartRewardEntry& entry);
+    /** GetRewardEntry(id, entry) for many addresses, the database gets walked once in key order.
+     *  entries[i] and vFound[i] hold the result for ids[i]. */
+    bool GetRewardEntries(const std::vector<CSmartAddress>& ids, CSmartRewardEntryList& entries, std::vector<bool>& vFound);
     bool GetTermRewardEntry(const std::pair<CSmartAddress, uint256>& id, CTermRewardEntry*& entry, bool fCreate);
     bool GetTermRewardsEntries(CTermRewardEntryMap& entries);
+    /** Term entries of one address or with an expiry time in [nFrom, nTo], including the ones not
+     *  written to the database yet. Doesn't need to read all term entries. */
+    bool GetTermRewardEntries(const CSmartAddress& address, CTermRewardEntryList& entries);
+    bool GetTermRewardEntries(unsigned int nFrom, unsigned int nTo, CTermRewardEntryList& entries);
 
     void EvaluateRound(CSmartRewardRound& next);
     bool StartFirstRound(const CSmartRewardRound& next, const CSmartRewardEntryList& entries);
@@ -188,9 +388,16 @@ public:
     bool UndoFinalizeRound(const CSmartRewardRound& current, const CSmartRewardResultEntryList& results);
 
     bool GetRewardRoundResults(const int16_t round, CSmartRewardResultEntryList& results);
-    bool GetRewardRoundResults(const int16_t round, CSmartRewardResultEntryPtrList& results);
+    bool GetRewardRoundResults(const int16_t round, CSmartRewardsRoundResult& result);
     const CSmartRewardsRoundResult* GetLastRoundResult();
 
+    /** Open the column file of a finished round, rebuilds it from the database if required. Doesn't
+     *  block on cs_rewardsdb, fails if the database is busy. The file stays empty for a round which
+     *  is not synced yet. */
+    bool GetRoundFile(const CSmartRewardRound& round, CSmartRewardsRoundFile& file);
+    /** Call callback for the payouts nOffset to nOffset + nLimit - 1 of a finished round in the order of the
+     *  round file, without loading all of them. nPayouts returns the number of payouts in the round. */
+    bool ForEachRewardPayout(const CSmartRewardRound& round, size_t nOffset, size_t nLimit, const std::function<void(const CSmartAddress&, CAmount)>& callback, size_t& nPayouts);
     bool GetRewardPayouts(const int16_t round, CSmartRewardResultEntryList& payouts);
     bool GetRewardPayouts(const int16_t round, CSmartRewardResultEntryPtrList& payouts);
 
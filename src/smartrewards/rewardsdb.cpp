@@ -10,9 +10,11 @@
 #include "pow.h"
 #include "rewards.h"
 #include "rewardsdb.h"
+#include "rewardsroundfile.h"
 #include "ui_interface.h"
 #include "uint256.h"
 
+#include <algorithm>
 #include <stdint.h>
 
 #include "leveldb/include/leveldb/db.h"
@@ -27,12 +29,33 @@ static const char DB_ROUND_SNAPSHOT = 's';
 
 static const char DB_REWARD_ENTRY = 'E';
 static const char DB_TERMREWARD_ENTRY = 'T';
+static const char DB_TERMREWARD_EXPIRY = 'x';
+static const char DB_TERMREWARD_EXPIRY_INDEXED = 'X';
 static const char DB_BLOCK = 'B';
 static const char DB_BLOCK_LAST = 'b';
 static const char DB_TX_HASH = 't';
+static const char DB_BLOCK_UNDO = 'u';
 
 static const char DB_VERSION = 'V';
 
+//! Last version which stored the reward entries in their full encoding.
+static const uint8_t REWARDS_DB_VERSION_FULL_ENTRIES = 0x0B;
+//! Entries converted per batch by the upgrade.
+static const size_t REWARDS_DB_UPGRADE_BATCH = 10000;
+
+/** Read the value at the cursor's position into entry, the address is taken from the key. */
+static bool GetRewardEntryValue(CDBIterator* pcursor, const CSmartAddress& id, CSmartRewardEntry& entry)
+{
+    CSmartRewardEntryCompactor compactor(entry);
+
+    if (!pcursor->GetValue(compactor)) {
+        return false;
+    }
+
+    entry.id = id;
+    return true;
+}
+
 size_t CSmartAddressHasher::operator()(const CSmartAddress& a) const {
     return a.GetHashSeed();
 }
@@ -43,13 +66,83 @@ size_t CTermRewardDbKeyHasher::operator()(const CTermRewardDbKey& k) const {
     return seed;
 }
 
-CSmartRewardsDB::CSmartRewardsDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "rewards", nCacheSize, fMemory, fWipe)
+CSmartRewardsDB::CSmartRewardsDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "rewards", nCacheSize, fMemory, fWipe, false, CDBOptions(true))
 {
+    if (fWipe) {
+        CSmartRewardsRoundFile::RemoveAll();
+    }
+
+    uint8_t dbVersion;
+
     if (!Exists(DB_VERSION)) {
         Write(DB_VERSION, REWARDS_DB_VERSION);
+    } else if (Read(DB_VERSION, dbVersion) && dbVersion == REWARDS_DB_VERSION_FULL_ENTRIES) {
+        UpgradeRewardEntries();
+    }
+
+    // Databases from before the expiry index got it built once, there are only a few term entries.
+    if (!Exists(DB_TERMREWARD_EXPIRY_INDEXED)) {
+        CTermRewardEntryMap entries;
+        CDBBatch batch(*this);
+
+        if (ReadTermRewardEntries(entries)) {
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                batch.Write(make_pair(DB_TERMREWARD_EXPIRY, CTermRewardExpiryKey(it->second->expires, it->first)), '\0');
+                delete it->second;
+            }
+
+            batch.Write(DB_TERMREWARD_EXPIRY_INDEXED, true);
+            WriteBatch(batch, true);
+        }
     }
 }
 
+bool CSmartRewardsDB::UpgradeRewardEntries()
+{
+    uiInterface.InitMessage(_("Upgrading SmartRewards database..."));
+    LogPrintf("CSmartRewardsDB::UpgradeRewardEntries - Converting the reward entries to the compact encoding\n");
+
+    // Both encodings can be read, an interrupted upgrade just starts over.
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+    size_t nConverted = 0;
+
+    pcursor->Seek(DB_REWARD_ENTRY);
+
+    while (pcursor->Valid()) {
+        std::pair<char, CSmartAddress> key;
+        if (!pcursor->GetKey(key) || key.first != DB_REWARD_ENTRY) {
+            break;
+        }
+
+        CSmartRewardEntry entry;
+        if (!GetRewardEntryValue(pcursor.get(), key.second, entry)) {
+            return error("CSmartRewardsDB::UpgradeRewardEntries - Failed to read the entry of %s", key.second.ToString());
+        }
+
+        batch.Write(key, CSmartRewardEntryCompactor(entry));
+
+        if (++nConverted % REWARDS_DB_UPGRADE_BATCH == 0) {
+            if (!WriteBatch(batch)) {
+                return error("CSmartRewardsDB::UpgradeRewardEntries - Failed to write the converted entries");
+            }
+            batch.Clear();
+        }
+
+        pcursor->Next();
+    }
+
+    batch.Write(DB_VERSION, REWARDS_DB_VERSION);
+
+    if (!WriteBatch(batch, true)) {
+        return error("CSmartRewardsDB::UpgradeRewardEntries - Failed to write the converted entries");
+    }
+
+    LogPrintf("CSmartRewardsDB::UpgradeRewardEntries - Converted %d entries\n", nConverted);
+
+    return true;
+}
+
 bool CSmartRewardsDB::Verify(int& lastBlockHeight)
 {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
@@ -88,11 +181,53 @@ bool CSmartRewardsDB::ReadLastBlock(CSmartRewardBlock& block)
     return Read(DB_BLOCK_LAST, block);
 }
 
+CDBIterator* CSmartRewardsDB::NewSnapshotIterator(CSmartRewardBlock& block)
+{
+    CDBIterator* pcursor = NewIterator();
+
+    // The background flush doesn't wait for readers, the last block has to come
+    // from the iterator to match its entries
+    block = CSmartRewardBlock();
+    pcursor->Seek(DB_BLOCK_LAST);
+    if (pcursor->Valid() && pcursor->CompareKey(DB_BLOCK_LAST) == 0 && !pcursor->GetValue(block)) {
+        block = CSmartRewardBlock();
+    }
+
+    pcursor->SeekToFirst();
+    return pcursor;
+}
+
 bool CSmartRewardsDB::ReadTransaction(const uint256 hash, CSmartRewardTransaction& transaction)
 {
     return Read(make_pair(DB_TX_HASH, hash), transaction);
 }
 
+bool CSmartRewardsDB::ReadBlockUndo(const int nHeight, CSmartRewardsBlockUndo& undo)
+{
+    return Read(make_pair(DB_BLOCK_UNDO, nHeight), undo);
+}
+
+void CSmartRewardsDB::EraseBlockUndos(CDBBatch& batch, const int nHeightBelow)
+{
+    // The heights don't sort in the key encoding, all journals get visited.
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(DB_BLOCK_UNDO);
+
+    while (pcursor->Valid()) {
+        std::pair<char, int> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_UNDO) {
+            break;
+        }
+
+        if (key.second < nHeightBelow) {
+            batch.Erase(key);
+        }
+
+        pcursor->Next();
+    }
+}
+
 bool CSmartRewardsDB::ReadRound(const int16_t number, CSmartRewardRound& round)
 {
     return Read(make_pair(DB_ROUND, number), round);
@@ -130,7 +265,14 @@ bool CSmartRewardsDB::ReadCurrentRound(CSmartRewardRound& round)
 
 bool CSmartRewardsDB::ReadRewardEntry(const CSmartAddress& id, CSmartRewardEntry& entry)
 {
-    return Read(make_pair(DB_REWARD_ENTRY, id), entry);
+    CSmartRewardEntryCompactor compactor(entry);
+
+    if (!Read(make_pair(DB_REWARD_ENTRY, id), compactor)) {
+        return false;
+    }
+
+    entry.id = id;
+    return true;
 }
 
 bool CSmartRewardsDB::ReadTermRewardEntry(const std::pair<CSmartAddress, uint256> &id, CTermRewardEntry &entry)
@@ -143,6 +285,9 @@ bool CSmartRewardsDB::SyncCached(const CSmartRewardsCache& cache)
     CDBBatch batch(*this);
 
     if (cache.GetUndoResult() != nullptr && !cache.GetUndoResult()->fSynced) {
+        // Drop the file of the round before its snapshot leaves the database.
+        CSmartRewardsRoundFile::Remove(cache.GetUndoResult()->round.number);
+
         CSmartRewardResultEntryPtrList tmpResults = cache.GetUndoResult()->results;
 
         auto entry = cache.GetEntries()->begin();
@@ -157,13 +302,19 @@ bool CSmartRewardsDB::SyncCached(const CSmartRewardsCache& cache)
                 });
 
             if (it == tmpResults.end()) {
-                batch.Erase(make_pair(DB_REWARD_ENTRY, entry->first));
+                // Entries missing in the snapshot were either created after the round was finalized
+                // and are empty again after the undo, or were skipped by an incremental evaluation.
+                if (entry->second->balance <= 0) {
+                    batch.Erase(make_pair(DB_REWARD_ENTRY, entry->first));
+                } else {
+                    batch.Write(make_pair(DB_REWARD_ENTRY, entry->first), CSmartRewardEntryCompactor(*entry->second));
+                }
             } else {
                 CSmartRewardEntry rewardEntry = (*it)->entry;
 
 //                std::cout << rewardEntry.ToString() << std::endl;
 
-                batch.Write(make_pair(DB_REWARD_ENTRY, rewardEntry.id), rewardEntry);
+                batch.Write(make_pair(DB_REWARD_ENTRY, rewardEntry.id), CSmartRewardEntryCompactor(rewardEntry));
                 batch.Erase(make_pair(DB_ROUND_SNAPSHOT, make_pair(cache.GetUndoResult()->round.number, rewardEntry.id)));
                 tmpResults.erase(it);
             }
@@ -174,7 +325,7 @@ bool CSmartRewardsDB::SyncCached(const CSmartRewardsCache& cache)
         auto it = tmpResults.begin();
 
         while (it != tmpResults.end()) {
-            batch.Write(make_pair(DB_REWARD_ENTRY, (*it)->entry.id), (*it)->entry);
+            batch.Write(make_pair(DB_REWARD_ENTRY, (*it)->entry.id), CSmartRewardEntryCompactor((*it)->entry));
             batch.Erase(make_pair(DB_ROUND_SNAPSHOT, make_pair(cache.GetUndoResult()->round.number, (*it)->entry.id)));
 
             ++it;
@@ -187,7 +338,7 @@ bool CSmartRewardsDB::SyncCached(const CSmartRewardsCache& cache)
             if (entry->second->balance <= 0) {
                 batch.Erase(make_pair(DB_REWARD_ENTRY, entry->first));
             } else {
-                batch.Write(make_pair(DB_REWARD_ENTRY, entry->first), *entry->second);
+                batch.Write(make_pair(DB_REWARD_ENTRY, entry->first), CSmartRewardEntryCompactor(*entry->second));
             }
 
             ++entry;
@@ -197,7 +348,15 @@ bool CSmartRewardsDB::SyncCached(const CSmartRewardsCache& cache)
     auto entry = cache.GetTermRewardsEntries()->begin();
 
     while (entry != cache.GetTermRewardsEntries()->end()) {
+        CTermRewardEntry previous;
+
+        // Drop the index key of the previous expiry if it got changed.
+        if (ReadTermRewardEntry(entry->first, previous) && previous.expires != entry->second->expires) {
+            batch.Erase(make_pair(DB_TERMREWARD_EXPIRY, CTermRewardExpiryKey(previous.expires, entry->first)));
+        }
+
         batch.Write(make_pair(DB_TERMREWARD_ENTRY, entry->first), *entry->second);
+        batch.Write(make_pair(DB_TERMREWARD_EXPIRY, CTermRewardExpiryKey(entry->second->expires, entry->first)), '\0');
         ++entry;
     }
 
@@ -215,6 +374,19 @@ bool CSmartRewardsDB::SyncCached(const CSmartRewardsCache& cache)
         ++removeTx;
     }
 
+    if (!cache.GetBlockUndos()->empty()) {
+        // Only the most recent blocks keep their journal.
+        int nJournalStart = cache.GetBlockUndos()->rbegin()->first - REWARDS_UNDO_JOURNAL_BLOCKS + 1;
+
+        for (const auto& undo : *cache.GetBlockUndos()) {
+            if (undo.first >= nJournalStart) {
+                batch.Write(make_pair(DB_BLOCK_UNDO, undo.first), undo.second);
+            }
+        }
+
+        EraseBlockUndos(batch, nJournalStart);
+    }
+
     auto round = cache.GetRounds()->begin();
 
     while (round != cache.GetRounds()->end()) {
@@ -234,7 +406,16 @@ bool CSmartRewardsDB::SyncCached(const CSmartRewardsCache& cache)
         }
     }
 
-    return WriteBatch(batch, true);
+    if (!WriteBatch(batch, true)) {
+        return false;
+    }
+
+    // Not fatal, the readers rebuild a missing file from the database.
+    if (cache.GetLastRoundResult() != nullptr && !cache.GetLastRoundResult()->fSynced) {
+        CSmartRewardsRoundFile::Write(cache.GetLastRoundResult()->round, cache.GetLastRoundResult()->results);
+    }
+
+    return true;
 }
 
 bool CSmartRewardsDB::ReadRewardEntries(CSmartRewardEntryMap& entries)
@@ -248,7 +429,7 @@ bool CSmartRewardsDB::ReadRewardEntries(CSmartRewardEntryMap& entries)
         std::pair<char, CSmartAddress> key;
         if (pcursor->GetKey(key) && key.first == DB_REWARD_ENTRY) {
             CSmartRewardEntry entry;
-            if (pcursor->GetValue(entry)) {
+            if (GetRewardEntryValue(pcursor.get(), key.second, entry)) {
                 entries.insert(std::make_pair(entry.id, new CSmartRewardEntry(entry)));
                 pcursor->Next();
             } else {
@@ -262,6 +443,110 @@ bool CSmartRewardsDB::ReadRewardEntries(CSmartRewardEntryMap& entries)
     return true;
 }
 
+bool CSmartRewardsDB::ReadRewardEntries(const std::vector<CSmartAddress>& ids, CSmartRewardEntryList& entries, std::vector<bool>& vFound)
+{
+    entries.assign(ids.size(), CSmartRewardEntry());
+    vFound.assign(ids.size(), false);
+
+    if (ids.empty()) {
+        return true;
+    }
+
+    // Visit the keys in the database's order so the cursor never has to go back.
+    std::vector<std::pair<std::vector<unsigned char>, size_t> > vKeys;
+    vKeys.reserve(ids.size());
+
+    for (size_t i = 0; i < ids.size(); ++i) {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << make_pair(DB_REWARD_ENTRY, ids[i]);
+        vKeys.emplace_back(std::vector<unsigned char>(ssKey.begin(), ssKey.end()), i);
+    }
+
+    std::sort(vKeys.begin(), vKeys.end());
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    bool fSeeked = false;
+
+    for (const auto& key : vKeys) {
+        const CSmartAddress& id = ids[key.second];
+        std::pair<char, CSmartAddress> dbKey = make_pair(DB_REWARD_ENTRY, id);
+
+        // Only seek if the cursor is not already at or behind the key, a cursor which
+        // passed the key already means it doesn't exist.
+        if (!fSeeked || (pcursor->Valid() && pcursor->CompareKey(dbKey) < 0)) {
+            pcursor->Seek(dbKey);
+            fSeeked = true;
+        }
+
+        if (!pcursor->Valid()) {
+            break;
+        }
+
+        if (pcursor->CompareKey(dbKey) == 0) {
+            if (!GetRewardEntryValue(pcursor.get(), id, entries[key.second])) {
+                return error("failed to get reward entry");
+            }
+            vFound[key.second] = true;
+        }
+    }
+
+    return true;
+}
+
+bool CSmartRewardsDB::ReadRewardEntries(CSmartRewardsCache& cache)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(DB_REWARD_ENTRY);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CSmartAddress> key;
+        if (pcursor->GetKey(key) && key.first == DB_REWARD_ENTRY) {
+            // Entries which are already in the cache are more recent than the database ones.
+            if (!cache.GetEntries()->count(key.second)) {
+                CSmartRewardEntry* entry = cache.CreateEntry(key.second);
+                if (!GetRewardEntryValue(pcursor.get(), key.second, *entry)) {
+                    cache.DestroyEntry(entry);
+                    return error("failed to get reward entry");
+                }
+                cache.AddEntry(entry);
+            }
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool CSmartRewardsDB::ReadRoundCandidates(CSmartAddressSet& candidates)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(DB_REWARD_ENTRY);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CSmartAddress> key;
+        if (pcursor->GetKey(key) && key.first == DB_REWARD_ENTRY) {
+            CSmartRewardEntry entry;
+            if (GetRewardEntryValue(pcursor.get(), key.second, entry)) {
+                if (entry.IsRoundCandidate())
+                    candidates.insert(entry.id);
+                pcursor->Next();
+            } else {
+                return error("failed to get reward entry");
+            }
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
 bool CSmartRewardsDB::ReadTermRewardEntries(CTermRewardEntryMap& entries)
 {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
@@ -287,6 +572,55 @@ bool CSmartRewardsDB::ReadTermRewardEntries(CTermRewardEntryMap& entries)
     return true;
 }
 
+bool CSmartRewardsDB::ReadTermRewardEntries(const CSmartAddress& address, CTermRewardEntryList& entries)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    // The null hash is the first key of the address.
+    pcursor->Seek(make_pair(DB_TERMREWARD_ENTRY, CTermRewardDbKey(address, uint256())));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CTermRewardDbKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_TERMREWARD_ENTRY && key.second.first == address) {
+            CTermRewardEntry entry;
+            if (pcursor->GetValue(entry)) {
+                entries.push_back(entry);
+                pcursor->Next();
+            } else {
+                return error("failed to get term reward entry");
+            }
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool CSmartRewardsDB::ReadTermRewardEntries(unsigned int nFrom, unsigned int nTo, CTermRewardEntryList& entries)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_TERMREWARD_EXPIRY, CTermRewardExpiryKey(nFrom, CTermRewardDbKey())));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CTermRewardExpiryKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_TERMREWARD_EXPIRY && key.second.expires <= nTo) {
+            CTermRewardEntry entry;
+            if (ReadTermRewardEntry(key.second.id, entry)) {
+                entries.push_back(entry);
+            }
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
 bool CSmartRewardsDB::ReadRewardRoundResults(const int16_t round, CSmartRewardResultEntryList& results)
 {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
@@ -315,7 +649,7 @@ bool CSmartRewardsDB::ReadRewardRoundResults(const int16_t round, CSmartRewardRe
     return true;
 }
 
-bool CSmartRewardsDB::ReadRewardRoundResults(const int16_t round, CSmartRewardResultEntryPtrList& results)
+bool CSmartRewardsDB::ReadRewardRoundResults(const int16_t round, CSmartRewardsRoundResult& result)
 {
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -330,7 +664,7 @@ bool CSmartRewardsDB::ReadRewardRoundResults(const int16_t round, CSmartRewardRe
 
             CSmartRewardResultEntry nValue;
             if (pcursor->GetValue(nValue)) {
-                results.push_back(new CSmartRewardResultEntry(nValue));
+                result.results.push_back(result.CreateEntry(nValue));
                 pcursor->Next();
             } else {
                 return error("failed to get reward entry");
@@ -438,9 +772,12 @@ string CSmartRewardEntry::ToString() const
     return s.str();
 }
 
-bool CSmartRewardEntry::IsEligible()
+bool CSmartRewardEntry::IsRoundCandidate() const
 {
-    return fActivated && !fSmartnodePaymentTx && balanceEligible > 0 && !fDisqualifyingTx;
+    // Entries which fail this check are left untouched by a round evaluation
+    // and can be skipped by the incremental evaluation mode.
+    return balanceEligible > 0 || fDisqualifyingTx || fSmartnodePaymentTx ||
+           balance != balanceAtStart || balance >= SMART_REWARDS_MIN_BALANCE_1_3;
 }
 
 string CSmartRewardBlock::ToString() const
@@ -455,7 +792,7 @@ string CSmartRewardBlock::ToString() const
 
 void CSmartRewardRound::UpdatePayoutParameter()
 {
-    nPayeeCount = ((eligibleEntries - disqualifiedEntries) > 0) ? (eligibleEntries - disqualifiedEntries) : 0;
+    nPayeeCount = GetEligibleEntries();
 
     if (nPayeeCount > 0 && nBlockPayees > 0) {
         int64_t nPayoutDelay = Params().GetConsensus().nRewardsPayoutStartDelay;
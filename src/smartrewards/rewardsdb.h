@@ -5,16 +5,19 @@
 #ifndef REWARDSDB_H
 #define REWARDSDB_H
 
+#include <algorithm>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "dbwrapper.h"
 #include "amount.h"
 #include "chain.h"
 #include "coins.h"
 #include "base58.h"
+#include "flathashmap.h"
 #include "smarthive/hive.h"
 
-static constexpr uint8_t REWARDS_DB_VERSION = 0x0B;
+static constexpr uint8_t REWARDS_DB_VERSION = 0x0C;
 
 //! Compensate for extra memory peak (x1.5-x1.9) at flush time.
 static constexpr int REWARDS_DB_PEAK_USAGE_FACTOR = 2;
@@ -30,6 +33,7 @@ class CSmartRewardRound;
 class CSmartRewardResultEntry;
 class CSmartRewardTransaction;
 class CSmartRewardsCache;
+struct CSmartRewardsRoundResult;
 
 typedef std::vector<CSmartRewardBlock> CSmartRewardBlockList;
 typedef std::vector<CSmartRewardEntry> CSmartRewardEntryList;
@@ -37,6 +41,7 @@ typedef std::map<uint16_t, CSmartRewardRound> CSmartRewardRoundMap;
 typedef std::vector<CSmartRewardResultEntry> CSmartRewardResultEntryList;
 typedef std::vector<CSmartRewardResultEntry*> CSmartRewardResultEntryPtrList;
 typedef std::pair<CSmartAddress, uint256> CTermRewardDbKey;
+typedef std::vector<CTermRewardEntry> CTermRewardEntryList;
 
 struct CSmartAddressHasher {
     size_t operator()(const CSmartAddress& a) const;
@@ -47,8 +52,9 @@ struct CTermRewardDbKeyHasher {
 };
 
 typedef std::map<uint256, CSmartRewardTransaction> CSmartRewardTransactionMap;
-typedef std::unordered_map<CSmartAddress, CSmartRewardEntry*, CSmartAddressHasher> CSmartRewardEntryMap;
+typedef CFlatHashMap<CSmartAddress, CSmartRewardEntry*, CSmartAddressHasher> CSmartRewardEntryMap;
 typedef std::unordered_map<CTermRewardDbKey, CTermRewardEntry*, CTermRewardDbKeyHasher> CTermRewardEntryMap;
+typedef std::unordered_set<CSmartAddress, CSmartAddressHasher> CSmartAddressSet;
 
 class CSmartRewardTransaction
 {
@@ -193,6 +199,11 @@ public:
 
     void UpdatePayoutParameter();
 
+    // Counters of the round, kept up to date by every processed block. Disqualifications
+    // can outnumber the qualified entries of older rounds, so both are clamped at zero.
+    int64_t GetEligibleEntries() const { return std::max<int64_t>(eligibleEntries - disqualifiedEntries, 0); }
+    CAmount GetEligibleSmart() const { return std::max<CAmount>(eligibleSmart - disqualifiedSmart, 0); }
+
     int GetPayeeCount() const { return nPayeeCount; }
     int GetRewardBlocks() const { return nRewardBlocks; }
     int GetLastRoundBlock() const { return nLastRoundBlock; }
@@ -277,9 +288,167 @@ public:
     std::string GetAddress() const;
     void SetNull();
     std::string ToString() const;
-    bool IsEligible();
+    bool IsEligible() const { return fActivated && !fSmartnodePaymentTx && balanceEligible > 0 && !fDisqualifyingTx; }
+    bool IsRoundCandidate() const;
+};
+
+/**
+ * Compact encoding of the DB_REWARD_ENTRY values.
+ *
+ * The address is part of the key and not stored again. A marker byte with the high bit set,
+ * which the full encoding never starts with, is followed by a varint bitmap of the flags, the
+ * non-null hashes and the signs of the amounts, the compressed amounts as varints, the present
+ * hashes and the bonus level. Values in the full encoding of older databases are still read.
+ */
+class CSmartRewardEntryCompactor
+{
+    CSmartRewardEntry& entry;
+
+    static const uint8_t MARKER = 0x81;
+
+    enum {
+        DISQUALIFYING_TX = 1 << 0,
+        DISQUALIFIED = 1 << 1,
+        ACTIVATION_TX = 1 << 2,
+        ACTIVATED = 1 << 3,
+        SMARTNODE_PAYMENT_TX = 1 << 4,
+        SMARTNODE_PAYMENT = 1 << 5,
+        NEGATIVE_BALANCE = 1 << 6,
+        NEGATIVE_BALANCE_AT_START = 1 << 7,
+        NEGATIVE_BALANCE_ELIGIBLE = 1 << 8,
+    };
+
+    template <typename Stream>
+    static void WriteAmount(Stream& s, CAmount nAmount)
+    {
+        uint64_t nCompressed = CTxOutCompressor::CompressAmount(nAmount < 0 ? -(uint64_t)nAmount : nAmount);
+        s << VARINT(nCompressed);
+    }
+
+    template <typename Stream>
+    static CAmount ReadAmount(Stream& s, bool fNegative)
+    {
+        uint64_t nCompressed = 0;
+        s >> VARINT(nCompressed);
+        uint64_t nAmount = CTxOutCompressor::DecompressAmount(nCompressed);
+        return fNegative ? -(CAmount)nAmount : (CAmount)nAmount;
+    }
+
+public:
+    explicit CSmartRewardEntryCompactor(CSmartRewardEntry& entryIn) : entry(entryIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        uint32_t nFlags = (entry.disqualifyingTx.IsNull() ? 0 : DISQUALIFYING_TX) |
+                          (entry.fDisqualifyingTx ? DISQUALIFIED : 0) |
+                          (entry.activationTx.IsNull() ? 0 : ACTIVATION_TX) |
+                          (entry.fActivated ? ACTIVATED : 0) |
+                          (entry.smartnodePaymentTx.IsNull() ? 0 : SMARTNODE_PAYMENT_TX) |
+                          (entry.fSmartnodePaymentTx ? SMARTNODE_PAYMENT : 0) |
+                          (entry.balance < 0 ? NEGATIVE_BALANCE : 0) |
+                          (entry.balanceAtStart < 0 ? NEGATIVE_BALANCE_AT_START : 0) |
+                          (entry.balanceEligible < 0 ? NEGATIVE_BALANCE_ELIGIBLE : 0);
+
+        ser_writedata8(s, MARKER);
+        s << VARINT(nFlags);
+        WriteAmount(s, entry.balance);
+        WriteAmount(s, entry.balanceAtStart);
+        WriteAmount(s, entry.balanceEligible);
+        if (nFlags & DISQUALIFYING_TX) s << entry.disqualifyingTx;
+        if (nFlags & ACTIVATION_TX) s << entry.activationTx;
+        if (nFlags & SMARTNODE_PAYMENT_TX) s << entry.smartnodePaymentTx;
+        ser_writedata8(s, entry.bonusLevel);
+    }
+
+    /** Only for data streams, the encoding gets detected with a look at the first byte. */
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        // The full encoding starts with the length of the address version.
+        if (s.empty() || !((uint8_t)s[0] & 0x80)) {
+            s >> entry;
+            return;
+        }
+
+        if (ser_readdata8(s) != MARKER) {
+            throw std::ios_base::failure("CSmartRewardEntryCompactor: unknown encoding");
+        }
+
+        uint32_t nFlags = 0;
+        s >> VARINT(nFlags);
+        entry.balance = ReadAmount(s, nFlags & NEGATIVE_BALANCE);
+        entry.balanceAtStart = ReadAmount(s, nFlags & NEGATIVE_BALANCE_AT_START);
+        entry.balanceEligible = ReadAmount(s, nFlags & NEGATIVE_BALANCE_ELIGIBLE);
+        entry.disqualifyingTx.SetNull();
+        entry.activationTx.SetNull();
+        entry.smartnodePaymentTx.SetNull();
+        if (nFlags & DISQUALIFYING_TX) s >> entry.disqualifyingTx;
+        if (nFlags & ACTIVATION_TX) s >> entry.activationTx;
+        if (nFlags & SMARTNODE_PAYMENT_TX) s >> entry.smartnodePaymentTx;
+        entry.fDisqualifyingTx = nFlags & DISQUALIFIED;
+        entry.fActivated = nFlags & ACTIVATED;
+        entry.fSmartnodePaymentTx = nFlags & SMARTNODE_PAYMENT;
+        entry.bonusLevel = ser_readdata8(s);
+    }
 };
 
+/**
+ * Reward entries touched by a block as they were before it got connected, written for the most
+ * recent blocks. Disconnecting the block just puts them back instead of reversing each input
+ * and output. The counters are the ones of the round before the block.
+ */
+class CSmartRewardsBlockUndo
+{
+public:
+    uint256 blockHash;
+    int64_t eligibleEntries;
+    CAmount eligibleSmart;
+    int64_t disqualifiedEntries;
+    CAmount disqualifiedSmart;
+    CSmartRewardEntryList entries;
+
+    CSmartRewardsBlockUndo() : eligibleEntries(0), eligibleSmart(0), disqualifiedEntries(0), disqualifiedSmart(0) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        s << blockHash << eligibleEntries << eligibleSmart << disqualifiedEntries << disqualifiedSmart;
+        WriteCompactSize(s, entries.size());
+        for (const CSmartRewardEntry& entry : entries) {
+            s << entry.id << CSmartRewardEntryCompactor(REF(entry));
+        }
+    }
+
+    /** Only for data streams, see CSmartRewardEntryCompactor. */
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        s >> blockHash >> eligibleEntries >> eligibleSmart >> disqualifiedEntries >> disqualifiedSmart;
+        entries.resize(ReadCompactSize(s));
+        for (CSmartRewardEntry& entry : entries) {
+            CSmartRewardEntryCompactor compactor(entry);
+            s >> entry.id >> compactor;
+        }
+    }
+};
+
+typedef std::map<int, CSmartRewardsBlockUndo> CSmartRewardsBlockUndoMap;
+
 class CSmartRewardResultEntry
 {
 
@@ -374,6 +543,29 @@ public:
     std::string GetLevel() const;
 };
 
+/** Key of the term rewards expiry index, the big endian expiry time keeps the keys sorted by time. */
+struct CTermRewardExpiryKey {
+    unsigned int expires;
+    CTermRewardDbKey id;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 4 + ::GetSerializeSize(id, nType, nVersion);
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata32be(s, expires);
+        ::Serialize(s, id, nType, nVersion);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        expires = ser_readdata32be(s);
+        ::Unserialize(s, id, nType, nVersion);
+    }
+
+    CTermRewardExpiryKey() : expires(0) {}
+    CTermRewardExpiryKey(unsigned int expires, const CTermRewardDbKey& id) : expires(expires), id(id) {}
+};
+
 /** Access to the rewards database (rewards/) */
 class CSmartRewardsDB : public CDBWrapper
 {
@@ -384,10 +576,16 @@ private:
     CSmartRewardsDB(const CSmartRewardsDB&);
     void operator=(const CSmartRewardsDB&);
 
+    bool UpgradeRewardEntries();
+
 public:
 
     bool Verify(int& lastBlockHeight);
 
+    /** Iterator over the whole database as of now, block gets the last block it
+     *  was written with. */
+    CDBIterator* NewSnapshotIterator(CSmartRewardBlock &block);
+
     bool ReadBlock(const int nHeight, CSmartRewardBlock &block);
     bool ReadLastBlock(CSmartRewardBlock &block);
 
@@ -400,11 +598,24 @@ public:
 
     bool ReadRewardEntry(const CSmartAddress &id, CSmartRewardEntry &entry);
     bool ReadRewardEntries(CSmartRewardEntryMap &entries);
+    bool ReadRewardEntries(CSmartRewardsCache &cache);
+    /** Look up all ids with one cursor which only seeks forward. entries[i] and vFound[i] hold
+     *  the result for ids[i]. */
+    bool ReadRewardEntries(const std::vector<CSmartAddress> &ids, CSmartRewardEntryList &entries, std::vector<bool> &vFound);
+    bool ReadRoundCandidates(CSmartAddressSet &candidates);
     bool ReadTermRewardEntry(const std::pair<CSmartAddress, uint256 >&id, CTermRewardEntry &entry);
     bool ReadTermRewardEntries(CTermRewardEntryMap& entries);
+    /** Term entries of one address, a range of the primary keys. */
+    bool ReadTermRewardEntries(const CSmartAddress &address, CTermRewardEntryList &entries);
+    /** Term entries which expire in [nFrom, nTo], a range of the expiry index. */
+    bool ReadTermRewardEntries(unsigned int nFrom, unsigned int nTo, CTermRewardEntryList &entries);
+
+    bool ReadBlockUndo(const int nHeight, CSmartRewardsBlockUndo &undo);
+    /** Drop the journals of all blocks below nHeightBelow. */
+    void EraseBlockUndos(CDBBatch &batch, const int nHeightBelow);
 
     bool ReadRewardRoundResults(const int16_t round, CSmartRewardResultEntryList &results);
-    bool ReadRewardRoundResults(const int16_t round, CSmartRewardResultEntryPtrList &results);
+    bool ReadRewardRoundResults(const int16_t round, CSmartRewardsRoundResult &result);
     bool ReadRewardPayouts(const int16_t round, CSmartRewardResultEntryList &payouts);
     bool ReadRewardPayouts(const int16_t round, CSmartRewardResultEntryPtrList &payouts);
 
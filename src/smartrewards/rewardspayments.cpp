@@ -16,75 +16,40 @@
 
 #include <stdint.h>
 
-CSmartRewardResultEntryPtrList SmartRewardPayments::GetPayments(const CSmartRewardsRoundResult *pResult, const int64_t nPayoutDelay, const int nHeight, int64_t blockTime, SmartRewardPayments::Result &result)
+CSmartRewardPayoutSlice SmartRewardPayments::GetPayments(const CSmartRewardsRoundResult *pResult, const int nHeight, SmartRewardPayments::Result &result)
 {
-    int64_t nPayeeCount = pResult->round.eligibleEntries - pResult->round.disqualifiedEntries;
+    CSmartRewardPayoutSlice payments;
 
-    // If we have no eligible addresses. Just to make sure...wont happen.
-    if( nPayeeCount <= 0 ){
-        result = SmartRewardPayments::NoRewardBlock;
-        return CSmartRewardResultEntryPtrList();
-    }
-
-    int64_t nBlockPayees = pResult->round.nBlockPayees;
-    int64_t nPayoutInterval = pResult->round.nBlockInterval;
-
-    int64_t nRewardBlocks = nPayeeCount / nBlockPayees;
-    // If we dont match nRewardsPayoutsPerBlock add one more block for the remaining payments.
-    if( nPayeeCount % nBlockPayees ) nRewardBlocks += 1;
-
-    int64_t nLastRoundBlock = pResult->round.endBlockHeight + nPayoutDelay + ( (nRewardBlocks - 1) * nPayoutInterval );
-
-    if( nHeight <= nLastRoundBlock && !(( nLastRoundBlock - nHeight ) % nPayoutInterval) ){
-        // We have a reward block! Now try to create the payments vector.
-
-        // Index of the current payout block for this round.
-        int64_t nRewardBlock = nRewardBlocks - ( (nLastRoundBlock - nHeight) / nPayoutInterval );
-        int64_t nFinalBlockPayees = nBlockPayees;
-
-        // If the to be paid addresses are no multile of nRewardsPayoutsPerBlock
-        // the last payout block has less payees than the others.
-        if( nRewardBlock == nRewardBlocks && nPayeeCount % nBlockPayees ){
-            // Use the remainders here..
-            nFinalBlockPayees = nPayeeCount % nBlockPayees;
-        }
-
-        // As start index we want to use the current payout block index + payouts per block as offset.
-        size_t nStartIndex = (nRewardBlock - 1) * nBlockPayees;
-        // As ennd index we use the startIndex + number of payees for this round.
-        size_t nEndIndex = nStartIndex + nFinalBlockPayees;
-        // If for any reason the calculations end up in an overflow of the vector return an error.
-        if( nEndIndex > pResult->payouts.size() ){
-            // Should not happen!
-            result = SmartRewardPayments::DatabaseError;
-            return CSmartRewardResultEntryPtrList();
-        }
-
-        // Finally return the subvector with the payees of this blockHeight!
-        return CSmartRewardResultEntryPtrList(pResult->payouts.begin() + nStartIndex, pResult->payouts.begin() + nEndIndex);
+    // The slices of the reward blocks get prepared once the result is set, see CSmartRewardsCache::SetResult.
+    if( !pResult->GetPayouts(nHeight, payments) ){
+        // Should not happen!
+        result = SmartRewardPayments::DatabaseError;
+        return CSmartRewardPayoutSlice();
     }
 
     // If we arent in any rounds payout range!
-    result = SmartRewardPayments::NoRewardBlock;
+    if( payments.empty() ){
+        result = SmartRewardPayments::NoRewardBlock;
+    }
 
-    return CSmartRewardResultEntryPtrList();
+    return payments;
 }
 
-CSmartRewardResultEntryPtrList SmartRewardPayments::GetPaymentsForBlock(const int nHeight, int64_t blockTime, SmartRewardPayments::Result &result)
+CSmartRewardPayoutSlice SmartRewardPayments::GetPaymentsForBlock(const int nHeight, int64_t blockTime, SmartRewardPayments::Result &result)
 {
     result = SmartRewardPayments::Valid;
 
     if(nHeight > sporkManager.GetSporkValue(SPORK_15_SMARTREWARDS_BLOCKS_ENABLED)) {
         LogPrint("smartrewards", "SmartRewardPayments::GetPaymentsForBlock -- Disabled");
         result = SmartRewardPayments::NoRewardBlock;
-        return CSmartRewardResultEntryPtrList();
+        return CSmartRewardPayoutSlice();
     }
 
     // If we are not yet at the 1.2 payout block time.
     if( ( MainNet() && nHeight < HF_V1_2_SMARTREWARD_HEIGHT + Params().GetConsensus().nRewardsBlocksPerRound_1_2 ) ||
         ( TestNet() && nHeight < nFirstRoundEndBlock_Testnet ) ){
         result = SmartRewardPayments::NoRewardBlock;
-        return CSmartRewardResultEntryPtrList();
+        return CSmartRewardPayoutSlice();
     }
 
     const CSmartRewardsRoundResult *pResult = prewards->GetLastRoundResult();
@@ -92,7 +57,7 @@ CSmartRewardResultEntryPtrList SmartRewardPayments::GetPaymentsForBlock(const in
     // If there are no rounds yet or the database has an issue.
     if( !pResult ){
         result = SmartRewardPayments::NoRewardBlock;
-        return CSmartRewardResultEntryPtrList();
+        return CSmartRewardPayoutSlice();
     }
 
     // If the requested height is lower then the rounds end step forward to the
@@ -100,13 +65,13 @@ CSmartRewardResultEntryPtrList SmartRewardPayments::GetPaymentsForBlock(const in
     int64_t nPayoutDelay = Params().GetConsensus().nRewardsPayoutStartDelay;
 
     if( nHeight >= ( pResult->round.endBlockHeight + nPayoutDelay ) ){
-        return SmartRewardPayments::GetPayments( pResult, nPayoutDelay, nHeight, blockTime, result );
+        return SmartRewardPayments::GetPayments( pResult, nHeight, result );
     }
 
     // If we arent in any rounds payout range!
     result = SmartRewardPayments::NoRewardBlock;
 
-    return CSmartRewardResultEntryPtrList();
+    return CSmartRewardPayoutSlice();
 }
 
 void SmartRewardPayments::FillPayments(CMutableTransaction &coinbaseTx, int nHeight, int64_t prevBlockTime, std::vector<CTxOut>& voutSmartRewards)
@@ -114,20 +79,17 @@ void SmartRewardPayments::FillPayments(CMutableTransaction &coinbaseTx, int nHei
     LOCK(cs_rewardscache);
 
     SmartRewardPayments::Result result;
-    CSmartRewardResultEntryPtrList rewards =  SmartRewardPayments::GetPaymentsForBlock(nHeight, prevBlockTime, result);
+    CSmartRewardPayoutSlice rewards =  SmartRewardPayments::GetPaymentsForBlock(nHeight, prevBlockTime, result);
 
     // only create rewardblocks if a rewardblock is actually required at the current height.
     if( result == SmartRewardPayments::Valid && rewards.size() ) {
             LogPrintf("FillRewardPayments -- triggered rewardblock creation at height %d with %d payees\n", nHeight, rewards.size());
 
-            for( auto s : rewards )
-            {
-                if( s->reward > 0){
-                    CTxOut out = CTxOut(s->reward, s->entry.id.GetScript());
-                    coinbaseTx.vout.push_back(out);
-                    voutSmartRewards.push_back(out);
-                }
-            }
+            // The outputs are cached in the round result, every block template of this height reuses them.
+            const std::vector<CTxOut>& vout = prewards->GetLastRoundResult()->GetPayoutOutputs(nHeight);
+
+            coinbaseTx.vout.insert(coinbaseTx.vout.end(), vout.begin(), vout.end());
+            voutSmartRewards.insert(voutSmartRewards.end(), vout.begin(), vout.end());
     }
 }
 
@@ -194,9 +156,9 @@ SmartRewardPayments::Result SmartRewardPayments::Validate(const CBlock& block, i
 
     smartReward = 0;
 
-    const CTransaction &txCoinbase = block.vtx[0];
+    const CTransaction &txCoinbase = *block.vtx[0];
 
-    CSmartRewardResultEntryPtrList rewards =  SmartRewardPayments::GetPaymentsForBlock(nHeight, block.GetBlockTime(), result);
+    CSmartRewardPayoutSlice rewards =  SmartRewardPayments::GetPaymentsForBlock(nHeight, block.GetBlockTime(), result);
 
     if( result == SmartRewardPayments::Valid && rewards.size() ) {
 
@@ -236,7 +198,7 @@ SmartRewardPayments::Result SmartRewardPayments::Validate(const CBlock& block, i
 /*
     CSmartRewardResultEntryPtrList rewards =  SmartRewardPayments::GetPaymentsForBlock(nHeight, block.GetBlockTime(), result);
     if (result == SmartRewardPayments::Valid && rewards.size()) {
-        const CTransaction &txCoinbase = block.vtx[0];
+        const CTransaction &txCoinbase = *block.vtx[0];
         static CSmartRewardResultEntryPtrList remainingPayouts;
         int64_t nPayoutDelay = Params().GetConsensus().nRewardsPayoutStartDelay;
         const CSmartRewardsRoundResult *pResult = prewards->GetLastRoundResult();
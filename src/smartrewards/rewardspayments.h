@@ -13,6 +13,7 @@
 #include "base58.h"
 
 struct CSmartRewardsRoundResult;
+struct CSmartRewardPayoutSlice;
 
 namespace SmartRewardPayments{
 
@@ -25,8 +26,8 @@ typedef enum{
     CoreError
 } Result;
 
-CSmartRewardResultEntryPtrList GetPayments(const CSmartRewardsRoundResult *pResult, const int64_t nPayoutDelay, const int nHeight, int64_t blockTime, SmartRewardPayments::Result &result);
-CSmartRewardResultEntryPtrList GetPaymentsForBlock(const int nHeight, int64_t blockTime, SmartRewardPayments::Result &result);
+CSmartRewardPayoutSlice GetPayments(const CSmartRewardsRoundResult *pResult, const int nHeight, SmartRewardPayments::Result &result);
+CSmartRewardPayoutSlice GetPaymentsForBlock(const int nHeight, int64_t blockTime, SmartRewardPayments::Result &result);
 SmartRewardPayments::Result Validate(const CBlock& block, const int nHeight, CAmount& smartReward);
 void FillPayments(CMutableTransaction& txNew, int nHeight, int64_t prevBlockTime, std::vector<CTxOut>& voutSmartRewards);
 
@@ -0,0 +1,280 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "smartrewards/rewardsroundfile.h"
+
+#include "crypto/common.h"
+#include "random.h"
+#include "streams.h"
+#include "util.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include <boost/filesystem.hpp>
+
+// Layout of the header, all numbers are little endian.
+static const unsigned char ROUND_FILE_MAGIC[4] = {'S', 'R', 'R', 'F'};
+static const uint32_t ROUND_FILE_VERSION = 1;
+static const size_t ROUND_FILE_HEADER_SIZE = 40;
+
+static size_t PadTo8(size_t nSize)
+{
+    return (nSize + 7) & ~(size_t)7;
+}
+
+static std::vector<unsigned char> SerializeAddress(const CSmartAddress& id)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << id;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+// Same order as the address part of the DB_ROUND_SNAPSHOT keys, so the files list
+// the results just like the database does.
+static int CompareBytes(const unsigned char* a, size_t nSizeA, const unsigned char* b, size_t nSizeB)
+{
+    int cmp = memcmp(a, b, std::min(nSizeA, nSizeB));
+    if (cmp != 0) return cmp;
+    return nSizeA < nSizeB ? -1 : (nSizeA > nSizeB ? 1 : 0);
+}
+
+namespace {
+
+struct CRoundFileRow {
+    std::vector<unsigned char> vchAddress;
+    CAmount nBalance;
+    CAmount nReward;
+
+    bool operator<(const CRoundFileRow& other) const
+    {
+        return CompareBytes(vchAddress.data(), vchAddress.size(), other.vchAddress.data(), other.vchAddress.size()) < 0;
+    }
+};
+
+bool WriteRows(const CSmartRewardRound& round, std::vector<CRoundFileRow>& vRows)
+{
+    std::sort(vRows.begin(), vRows.end());
+
+    size_t nAddressSize = 0;
+    for (const CRoundFileRow& row : vRows) {
+        nAddressSize += row.vchAddress.size();
+    }
+
+    size_t nAddressStart = ROUND_FILE_HEADER_SIZE + (vRows.size() + 1) * 4;
+    size_t nBalanceStart = PadTo8(nAddressStart + nAddressSize);
+    size_t nRewardStart = nBalanceStart + vRows.size() * 8;
+    std::vector<unsigned char> vchData(nRewardStart + vRows.size() * 8, 0);
+
+    memcpy(vchData.data(), ROUND_FILE_MAGIC, sizeof(ROUND_FILE_MAGIC));
+    WriteLE32(&vchData[4], ROUND_FILE_VERSION);
+    WriteLE32(&vchData[8], round.number);
+    WriteLE32(&vchData[12], vRows.size());
+    WriteLE32(&vchData[16], nAddressSize);
+    WriteLE64(&vchData[24], round.endBlockHeight);
+    WriteLE64(&vchData[32], round.endBlockTime);
+
+    size_t nOffset = 0;
+    for (size_t i = 0; i < vRows.size(); ++i) {
+        WriteLE32(&vchData[ROUND_FILE_HEADER_SIZE + i * 4], nOffset);
+        memcpy(&vchData[nAddressStart + nOffset], vRows[i].vchAddress.data(), vRows[i].vchAddress.size());
+        nOffset += vRows[i].vchAddress.size();
+        WriteLE64(&vchData[nBalanceStart + i * 8], vRows[i].nBalance);
+        WriteLE64(&vchData[nRewardStart + i * 8], vRows[i].nReward);
+    }
+    WriteLE32(&vchData[ROUND_FILE_HEADER_SIZE + vRows.size() * 4], nOffset);
+
+    boost::filesystem::path dir = CSmartRewardsRoundFile::GetDirectory();
+    TryCreateDirectory(dir);
+
+    // The database writer and a reader rebuilding a missing file may race, give both their own temp file.
+    boost::filesystem::path pathTmp = dir / strprintf("round_%05d.%016x.tmp", round.number, GetRand(std::numeric_limits<uint64_t>::max()));
+    boost::filesystem::path path = CSmartRewardsRoundFile::GetPath(round.number);
+
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file) {
+        return error("%s: Failed to open %s", __func__, pathTmp.string());
+    }
+
+    bool fWritten = fwrite(vchData.data(), 1, vchData.size(), file) == vchData.size();
+    if (fWritten) {
+        FileCommit(file);
+    }
+    fclose(file);
+
+    if (!fWritten || !RenameOver(pathTmp, path)) {
+        boost::filesystem::remove(pathTmp);
+        return error("%s: Failed to write %s", __func__, path.string());
+    }
+
+    return true;
+}
+
+} // anon namespace
+
+boost::filesystem::path CSmartRewardsRoundFile::GetDirectory()
+{
+    return GetDataDir() / "rewards" / "rounds";
+}
+
+boost::filesystem::path CSmartRewardsRoundFile::GetPath(int nRound)
+{
+    return GetDirectory() / strprintf("round_%05d.dat", nRound);
+}
+
+bool CSmartRewardsRoundFile::Write(const CSmartRewardRound& round, const CSmartRewardResultEntryPtrList& results)
+{
+    std::vector<CRoundFileRow> vRows;
+    vRows.reserve(results.size());
+
+    for (const CSmartRewardResultEntry* s : results) {
+        vRows.push_back(CRoundFileRow{SerializeAddress(s->entry.id), s->entry.balance, s->reward});
+    }
+
+    return WriteRows(round, vRows);
+}
+
+bool CSmartRewardsRoundFile::Write(const CSmartRewardRound& round, const CSmartRewardResultEntryList& results)
+{
+    std::vector<CRoundFileRow> vRows;
+    vRows.reserve(results.size());
+
+    for (const CSmartRewardResultEntry& s : results) {
+        vRows.push_back(CRoundFileRow{SerializeAddress(s.entry.id), s.entry.balance, s.reward});
+    }
+
+    return WriteRows(round, vRows);
+}
+
+void CSmartRewardsRoundFile::Remove(int nRound)
+{
+    boost::system::error_code ec;
+    boost::filesystem::remove(GetPath(nRound), ec);
+}
+
+void CSmartRewardsRoundFile::RemoveAll()
+{
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(GetDirectory(), ec);
+}
+
+bool CSmartRewardsRoundFile::Open(const CSmartRewardRound& round)
+{
+    boost::filesystem::path path = GetPath(round.number);
+
+    try {
+        if (!boost::filesystem::exists(path)) {
+            return false;
+        }
+
+        boost::interprocess::file_mapping tmpFile(path.string().c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region tmpRegion(tmpFile, boost::interprocess::read_only);
+        file.swap(tmpFile);
+        region.swap(tmpRegion);
+    } catch (const boost::interprocess::interprocess_exception& e) {
+        return error("%s: Failed to map %s: %s", __func__, path.string(), e.what());
+    }
+
+    const unsigned char* pData = static_cast<const unsigned char*>(region.get_address());
+    size_t nSize = region.get_size();
+
+    if (nSize < ROUND_FILE_HEADER_SIZE || memcmp(pData, ROUND_FILE_MAGIC, sizeof(ROUND_FILE_MAGIC)) ||
+        ReadLE32(pData + 4) != ROUND_FILE_VERSION || ReadLE32(pData + 8) != round.number ||
+        (int64_t)ReadLE64(pData + 24) != round.endBlockHeight || (int64_t)ReadLE64(pData + 32) != round.endBlockTime) {
+        return false;
+    }
+
+    uint64_t nCountIn = ReadLE32(pData + 12);
+    uint64_t nAddressSize = ReadLE32(pData + 16);
+    uint64_t nAddressStart = ROUND_FILE_HEADER_SIZE + (nCountIn + 1) * 4;
+    uint64_t nBalanceStart = PadTo8(nAddressStart + nAddressSize);
+
+    if (nBalanceStart + nCountIn * 16 != nSize) {
+        return error("%s: Invalid size of %s", __func__, path.string());
+    }
+
+    // Make sure the offset index can't point outside of the address column.
+    uint32_t nPrevious = 0;
+    for (uint64_t i = 0; i <= nCountIn; ++i) {
+        uint32_t nOffset = ReadLE32(pData + ROUND_FILE_HEADER_SIZE + i * 4);
+        if (nOffset < nPrevious || nOffset > nAddressSize) {
+            return error("%s: Invalid index in %s", __func__, path.string());
+        }
+        nPrevious = nOffset;
+    }
+
+    if (nPrevious != nAddressSize) {
+        return error("%s: Invalid index in %s", __func__, path.string());
+    }
+
+    nCount = nCountIn;
+    pOffsets = pData + ROUND_FILE_HEADER_SIZE;
+    pAddresses = pData + nAddressStart;
+    pBalances = pData + nBalanceStart;
+    pRewards = pBalances + nCount * 8;
+
+    return true;
+}
+
+CSmartAddress CSmartRewardsRoundFile::GetAddress(size_t nIndex) const
+{
+    assert(nIndex < nCount);
+
+    uint32_t nBegin = ReadLE32(pOffsets + nIndex * 4);
+    uint32_t nEnd = ReadLE32(pOffsets + (nIndex + 1) * 4);
+
+    CSmartAddress id;
+    try {
+        CDataStream ss((const char*)pAddresses + nBegin, (const char*)pAddresses + nEnd, SER_DISK, CLIENT_VERSION);
+        ss >> id;
+    } catch (const std::exception& e) {
+        // Leave the address invalid, the caller sees that.
+    }
+
+    return id;
+}
+
+CAmount CSmartRewardsRoundFile::GetBalance(size_t nIndex) const
+{
+    assert(nIndex < nCount);
+    return ReadLE64(pBalances + nIndex * 8);
+}
+
+CAmount CSmartRewardsRoundFile::GetReward(size_t nIndex) const
+{
+    assert(nIndex < nCount);
+    return ReadLE64(pRewards + nIndex * 8);
+}
+
+int CSmartRewardsRoundFile::CompareAddress(size_t nIndex, const std::vector<unsigned char>& vchAddress) const
+{
+    uint32_t nBegin = ReadLE32(pOffsets + nIndex * 4);
+    uint32_t nEnd = ReadLE32(pOffsets + (nIndex + 1) * 4);
+
+    return CompareBytes(pAddresses + nBegin, nEnd - nBegin, vchAddress.data(), vchAddress.size());
+}
+
+bool CSmartRewardsRoundFile::Find(const CSmartAddress& id, size_t& nIndex) const
+{
+    std::vector<unsigned char> vchAddress = SerializeAddress(id);
+    size_t nLow = 0, nHigh = nCount;
+
+    while (nLow < nHigh) {
+        size_t nMiddle = nLow + (nHigh - nLow) / 2;
+        int cmp = CompareAddress(nMiddle, vchAddress);
+
+        if (cmp == 0) {
+            nIndex = nMiddle;
+            return true;
+        }
+
+        if (cmp < 0) {
+            nLow = nMiddle + 1;
+        } else {
+            nHigh = nMiddle;
+        }
+    }
+
+    return false;
+}
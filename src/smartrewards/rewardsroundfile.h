@@ -0,0 +1,69 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef REWARDSROUNDFILE_H
+#define REWARDSROUNDFILE_H
+
+#include "smartrewards/rewardsdb.h"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+/**
+ * Read only copy of the results of a finalized round, written next to the
+ * rewards database once the round got synced.
+ *
+ * The file is memory mapped and consists of an address column sorted by the
+ * serialized address plus an offset index into it, a balance column and a
+ * reward column. Single addresses can be looked up with a binary search and
+ * whole rounds get streamed directly out of the mapping.
+ *
+ * The rewards database stays the authority, the files are only a derived
+ * copy for the readers. A missing or damaged file gets rebuilt from the
+ * database.
+ */
+class CSmartRewardsRoundFile
+{
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+
+    uint32_t nCount;
+    const unsigned char* pOffsets;
+    const unsigned char* pAddresses;
+    const unsigned char* pBalances;
+    const unsigned char* pRewards;
+
+    int CompareAddress(size_t nIndex, const std::vector<unsigned char>& vchAddress) const;
+
+public:
+    CSmartRewardsRoundFile() : nCount(0), pOffsets(nullptr), pAddresses(nullptr), pBalances(nullptr), pRewards(nullptr) {}
+
+    CSmartRewardsRoundFile(const CSmartRewardsRoundFile&) = delete;
+    CSmartRewardsRoundFile& operator=(const CSmartRewardsRoundFile&) = delete;
+
+    static boost::filesystem::path GetDirectory();
+    static boost::filesystem::path GetPath(int nRound);
+
+    static bool Write(const CSmartRewardRound& round, const CSmartRewardResultEntryPtrList& results);
+    static bool Write(const CSmartRewardRound& round, const CSmartRewardResultEntryList& results);
+    static void Remove(int nRound);
+    static void RemoveAll();
+
+    /** Map the file of round, fails if there is none or it doesn't belong to this round. */
+    bool Open(const CSmartRewardRound& round);
+    bool IsOpen() const { return pOffsets != nullptr; }
+
+    size_t size() const { return nCount; }
+    bool empty() const { return nCount == 0; }
+
+    CSmartAddress GetAddress(size_t nIndex) const;
+    CAmount GetBalance(size_t nIndex) const;
+    CAmount GetReward(size_t nIndex) const;
+
+    /** Binary search for id, sets nIndex to its position if found. */
+    bool Find(const CSmartAddress& id, size_t& nIndex) const;
+};
+
+#endif // REWARDSROUNDFILE_H
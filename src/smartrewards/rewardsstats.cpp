@@ -0,0 +1,202 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "smartrewards/rewardsstats.h"
+
+#include <algorithm>
+
+static const char* strPhases[REWARDS_PHASE_COUNT] = {
+    "prefetch",
+    "process_transaction",
+    "process_input",
+    "process_output",
+    "commit_block",
+    "sync_cached",
+};
+
+void CSmartRewardsTimingHistogram::Clear()
+{
+    nCount = 0;
+    nTotal = 0;
+    nMax = 0;
+    std::fill(vBuckets, vBuckets + NUM_BUCKETS, 0);
+}
+
+void CSmartRewardsTimingHistogram::Add(int64_t nNanos)
+{
+    int64_t nMicros = nNanos / 1000;
+    int nBucket = 0;
+
+    while (nMicros > 0 && nBucket < NUM_BUCKETS - 1) {
+        nMicros >>= 1;
+        ++nBucket;
+    }
+
+    ++nCount;
+    nTotal += nNanos;
+    nMax = std::max(nMax, nNanos);
+    ++vBuckets[nBucket];
+}
+
+void CSmartRewardsTimingHistogram::Merge(const CSmartRewardsTimingHistogram& other)
+{
+    nCount += other.nCount;
+    nTotal += other.nTotal;
+    nMax = std::max(nMax, other.nMax);
+
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        vBuckets[i] += other.vBuckets[i];
+    }
+}
+
+UniValue CSmartRewardsTimingHistogram::ToJSON() const
+{
+    UniValue obj(UniValue::VOBJ);
+    UniValue histogram(UniValue::VARR);
+
+    for (int i = 0; i < NUM_BUCKETS; ++i) {
+        if (!vBuckets[i]) continue;
+
+        UniValue bucket(UniValue::VOBJ);
+        // The last bucket is open ended.
+        if (i < NUM_BUCKETS - 1) {
+            bucket.pushKV("below_us", (int64_t)1 << i);
+        }
+        bucket.pushKV("count", (int64_t)vBuckets[i]);
+        histogram.push_back(bucket);
+    }
+
+    obj.pushKV("count", (int64_t)nCount);
+    obj.pushKV("total_us", nTotal / 1000);
+    obj.pushKV("avg_us", nCount ? (double)nTotal / nCount / 1000.0 : 0.0);
+    obj.pushKV("max_us", nMax / 1000);
+    obj.pushKV("histogram", histogram);
+
+    return obj;
+}
+
+void CSmartRewardsStats::Add(SmartRewardsPhase phase, int64_t nNanos)
+{
+    LOCK(cs);
+    phases[phase].Add(nNanos);
+}
+
+void CSmartRewardsStats::FinishBlock(int nHeight, int nRound)
+{
+    CSmartRewardsBlockTiming block;
+    block.nHeight = nHeight;
+    block.nRound = nRound;
+    block.nTotal = 0;
+
+    for (int i = 0; i < REWARDS_PHASE_COUNT; ++i) {
+        block.vPhases[i] = pending[i].nTotal;
+        block.nTotal += pending[i].nTotal;
+    }
+
+    LOCK(cs);
+
+    for (int i = 0; i < REWARDS_PHASE_COUNT; ++i) {
+        phases[i].Merge(pending[i]);
+        pending[i].Clear();
+    }
+
+    blocks.Add(block.nTotal);
+    lastBlock = block;
+
+    auto compare = [](const CSmartRewardsBlockTiming& a, const CSmartRewardsBlockTiming& b) { return a.nTotal > b.nTotal; };
+    vSlowestBlocks.insert(std::upper_bound(vSlowestBlocks.begin(), vSlowestBlocks.end(), block, compare), block);
+    if (vSlowestBlocks.size() > REWARDS_STATS_SLOWEST_BLOCKS) {
+        vSlowestBlocks.pop_back();
+    }
+
+    CSmartRewardsRoundTiming& round = mapRounds[nRound];
+    ++round.nBlocks;
+    round.nTotal += block.nTotal;
+    if (block.nTotal > round.nMax) {
+        round.nMax = block.nTotal;
+        round.nMaxHeight = nHeight;
+    }
+
+    while (mapRounds.size() > REWARDS_STATS_ROUNDS) {
+        mapRounds.erase(mapRounds.begin());
+    }
+}
+
+void CSmartRewardsStats::Clear()
+{
+    LOCK(cs);
+
+    for (int i = 0; i < REWARDS_PHASE_COUNT; ++i) {
+        phases[i].Clear();
+    }
+
+    blocks.Clear();
+    vSlowestBlocks.clear();
+    mapRounds.clear();
+}
+
+UniValue CSmartRewardsStats::ToJSON() const
+{
+    LOCK(cs);
+
+    UniValue obj(UniValue::VOBJ);
+    UniValue phasesObj(UniValue::VOBJ);
+    UniValue slowestArr(UniValue::VARR);
+    UniValue roundsArr(UniValue::VARR);
+
+    for (int i = 0; i < REWARDS_PHASE_COUNT; ++i) {
+        phasesObj.pushKV(strPhases[i], phases[i].ToJSON());
+    }
+
+    for (const CSmartRewardsBlockTiming& block : vSlowestBlocks) {
+        UniValue blockObj(UniValue::VOBJ);
+        blockObj.pushKV("height", block.nHeight);
+        blockObj.pushKV("round", block.nRound);
+        blockObj.pushKV("total_us", block.nTotal / 1000);
+        for (int i = 0; i < REWARDS_PHASE_COUNT; ++i) {
+            blockObj.pushKV(std::string(strPhases[i]) + "_us", block.vPhases[i] / 1000);
+        }
+        slowestArr.push_back(blockObj);
+    }
+
+    for (const auto& it : mapRounds) {
+        UniValue roundObj(UniValue::VOBJ);
+        roundObj.pushKV("round", it.first);
+        roundObj.pushKV("blocks", it.second.nBlocks);
+        roundObj.pushKV("total_us", it.second.nTotal / 1000);
+        roundObj.pushKV("avg_us", it.second.nBlocks ? (double)it.second.nTotal / it.second.nBlocks / 1000.0 : 0.0);
+        roundObj.pushKV("max_us", it.second.nMax / 1000);
+        roundObj.pushKV("max_height", it.second.nMaxHeight);
+        roundsArr.push_back(roundObj);
+    }
+
+    obj.pushKV("blocks", blocks.ToJSON());
+    obj.pushKV("phases", phasesObj);
+    obj.pushKV("slowest_blocks", slowestArr);
+    obj.pushKV("rounds", roundsArr);
+
+    return obj;
+}
+
+void CSmartRewardsStats::GetHistograms(CSmartRewardsTimingHistogram& blocksRet, std::vector<std::pair<std::string, CSmartRewardsTimingHistogram>>& vPhasesRet) const
+{
+    LOCK(cs);
+
+    blocksRet = blocks;
+    vPhasesRet.clear();
+    for (int i = 0; i < REWARDS_PHASE_COUNT; ++i) {
+        vPhasesRet.emplace_back(strPhases[i], phases[i]);
+    }
+}
+
+bool CSmartRewardsStats::GetLastBlock(CSmartRewardsBlockTiming& blockRet) const
+{
+    LOCK(cs);
+
+    if (lastBlock.nHeight < 0)
+        return false;
+
+    blockRet = lastBlock;
+    return true;
+}
@@ -0,0 +1,143 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef REWARDSSTATS_H
+#define REWARDSSTATS_H
+
+#include "sync.h"
+
+#include <univalue.h>
+
+#include <chrono>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Number of slowest blocks and most recent rounds kept in the statistics
+#define REWARDS_STATS_SLOWEST_BLOCKS 10
+#define REWARDS_STATS_ROUNDS 10
+
+enum SmartRewardsPhase {
+    REWARDS_PHASE_PREFETCH,
+    REWARDS_PHASE_PROCESS_TRANSACTION,
+    REWARDS_PHASE_PROCESS_INPUT,
+    REWARDS_PHASE_PROCESS_OUTPUT,
+    REWARDS_PHASE_COMMIT_BLOCK,
+    REWARDS_PHASE_SYNC_CACHED,
+    REWARDS_PHASE_COUNT
+};
+
+/** Latency histogram, bucket i counts the samples below 2^i microseconds. */
+struct CSmartRewardsTimingHistogram {
+    static const int NUM_BUCKETS = 24;
+
+    uint64_t nCount;
+    int64_t nTotal;
+    int64_t nMax;
+    uint64_t vBuckets[NUM_BUCKETS];
+
+    CSmartRewardsTimingHistogram() { Clear(); }
+
+    void Clear();
+    void Add(int64_t nNanos);
+    void Merge(const CSmartRewardsTimingHistogram& other);
+    UniValue ToJSON() const;
+};
+
+struct CSmartRewardsBlockTiming {
+    int nHeight;
+    int nRound;
+    int64_t nTotal;
+    int64_t vPhases[REWARDS_PHASE_COUNT];
+};
+
+struct CSmartRewardsRoundTiming {
+    int64_t nBlocks;
+    int64_t nTotal;
+    int64_t nMax;
+    int nMaxHeight;
+
+    CSmartRewardsRoundTiming() : nBlocks(0), nTotal(0), nMax(0), nMaxHeight(0) {}
+};
+
+/**
+ * Timings of the SmartRewards block processing.
+ *
+ * The phases of the block being connected are collected without locking, the
+ * block processing runs under cs_main anyway. They get merged into the
+ * totals once the block got committed.
+ */
+class CSmartRewardsStats
+{
+    mutable CCriticalSection cs;
+
+    CSmartRewardsTimingHistogram pending[REWARDS_PHASE_COUNT];
+
+    CSmartRewardsTimingHistogram phases[REWARDS_PHASE_COUNT];
+    CSmartRewardsTimingHistogram blocks;
+    std::vector<CSmartRewardsBlockTiming> vSlowestBlocks;
+    std::map<int, CSmartRewardsRoundTiming> mapRounds;
+    CSmartRewardsBlockTiming lastBlock;
+
+public:
+    CSmartRewardsStats() { lastBlock.nHeight = -1; }
+
+    void AddPending(SmartRewardsPhase phase, int64_t nNanos) { pending[phase].Add(nNanos); }
+    void Add(SmartRewardsPhase phase, int64_t nNanos);
+    void FinishBlock(int nHeight, int nRound);
+    void Clear();
+
+    UniValue ToJSON() const;
+    /** Copies of the histograms of the whole block processing and of each phase with its name. */
+    void GetHistograms(CSmartRewardsTimingHistogram& blocksRet, std::vector<std::pair<std::string, CSmartRewardsTimingHistogram>>& vPhasesRet) const;
+    /** Timing of the block finished last, false if there was none since the start. */
+    bool GetLastBlock(CSmartRewardsBlockTiming& blockRet) const;
+};
+
+/** Adds the time until it goes out of scope to a phase of the statistics. */
+class CSmartRewardsPhaseTimer
+{
+    CSmartRewardsStats& stats;
+    SmartRewardsPhase phase;
+    bool fPending;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    //! fPendingIn adds the time to the block being connected, otherwise it directly goes to the totals.
+    CSmartRewardsPhaseTimer(CSmartRewardsStats& statsIn, SmartRewardsPhase phaseIn, bool fPendingIn = true) :
+        stats(statsIn), phase(phaseIn), fPending(fPendingIn), start(std::chrono::steady_clock::now()) {}
+
+    ~CSmartRewardsPhaseTimer()
+    {
+        int64_t nNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+        if (fPending) {
+            stats.AddPending(phase, nNanos);
+        } else {
+            stats.Add(phase, nNanos);
+        }
+    }
+};
+
+/** Times the commit of a block and finishes the block's statistics when it goes out of scope. */
+class CSmartRewardsBlockTimer
+{
+    CSmartRewardsStats& stats;
+    int nHeight;
+    int nRound;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    CSmartRewardsBlockTimer(CSmartRewardsStats& statsIn, int nHeightIn, int nRoundIn) :
+        stats(statsIn), nHeight(nHeightIn), nRound(nRoundIn), start(std::chrono::steady_clock::now()) {}
+
+    ~CSmartRewardsBlockTimer()
+    {
+        stats.AddPending(REWARDS_PHASE_COMMIT_BLOCK, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        stats.FinishBlock(nHeight, nRound);
+    }
+};
+
+#endif // REWARDSSTATS_H
@@ -8,11 +8,125 @@
 #include "random.h"
 #include "smartvoting/manager.h"
 #include "smartnode/smartnodesync.h"
+#include "smartvoting/votevalidation.h"
 #include "validation.h"
+#include "validationinterface.h"
+
+#include <deque>
+#include <memory>
+
+#include <boost/thread.hpp>
 
 CSmartVotingManager smartVoting;
 
-const std::string CSmartVotingManager::SERIALIZATION_VERSION_STRING = "CSmartVotingManager-Version-1";
+/**
+ * Queue of the proposal votes received from peers, see CTxLockVoteVerifier. The
+ * worker threads verify the signatures without any lock and whichever of them
+ * finishes the oldest vote processes the votes which are done, in the order
+ * they came in.
+ */
+class CProposalVoteVerifier
+{
+    struct QueuedVote {
+        CProposalVote vote;
+        CNode* pnode; // referenced while queued
+        bool fVerified;
+    };
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<std::shared_ptr<QueuedVote> > queueVotes;
+    // Index in queueVotes of the first vote no thread took yet
+    size_t nNextVerify;
+    bool fProcessing;
+    bool fStarted;
+    CConnman* pconnman;
+
+    void ProcessVerified()
+    {
+        while(true) {
+            std::shared_ptr<QueuedVote> queued;
+            {
+                boost::lock_guard<boost::mutex> lock(cs);
+                if(queueVotes.empty() || !queueVotes.front()->fVerified) {
+                    fProcessing = false;
+                    return;
+                }
+                queued = queueVotes.front();
+                queueVotes.pop_front();
+                --nNextVerify;
+            }
+
+            smartVoting.ProcessReceivedVote(queued->pnode, queued->vote, *pconnman);
+            queued->pnode->Release();
+        }
+    }
+
+public:
+    CProposalVoteVerifier() : nNextVerify(0), fProcessing(false), fStarted(false), pconnman(NULL) {}
+
+    void Start(boost::thread_group& threadGroup, CConnman& connman)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            if(fStarted) return;
+            pconnman = &connman;
+            fStarted = true;
+        }
+
+        int nThreads = std::min(SMARTVOTING_MAX_VOTE_VERIFY_THREADS, std::max(1, GetNumCores() - 1));
+
+        for(int i = 0; i < nThreads; ++i)
+            threadGroup.create_thread(boost::bind(&CProposalVoteVerifier::Thread, this));
+    }
+
+    /// False if the vote has to be processed right away
+    bool Queue(CNode* pnode, const CProposalVote& vote)
+    {
+        std::shared_ptr<QueuedVote> queued(new QueuedVote{vote, pnode, false});
+
+        {
+            boost::lock_guard<boost::mutex> lock(cs);
+            if(!fStarted || queueVotes.size() >= SMARTVOTING_MAX_QUEUED_VOTES) return false;
+            pnode->AddRef();
+            queueVotes.push_back(queued);
+        }
+
+        cond.notify_one();
+        return true;
+    }
+
+    void Thread()
+    {
+        RenameThread("smartcash-pvote");
+
+        while(true) {
+            std::shared_ptr<QueuedVote> queued;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while(nNextVerify >= queueVotes.size())
+                    cond.wait(lock);
+                queued = queueVotes[nNextVerify++];
+            }
+
+            queued->vote.PreVerifySignature();
+
+            {
+                boost::lock_guard<boost::mutex> lock(cs);
+                queued->fVerified = true;
+                if(fProcessing) continue;
+                fProcessing = true;
+            }
+
+            ProcessVerified();
+            boost::this_thread::interruption_point();
+        }
+    }
+};
+
+static CProposalVoteVerifier voteVerifier;
+
+const std::string CSmartVotingManager::SERIALIZATION_VERSION_STRING = "CSmartVotingManager-Version-2";
 const int CSmartVotingManager::MAX_TIME_FUTURE_DEVIATION = 60*60;
 const int CSmartVotingManager::RELIABLE_PROPAGATION_TIME = 60;
 
@@ -27,9 +141,29 @@ CSmartVotingManager::CSmartVotingManager()
       setRequestedProposals(),
       setRequestedVotes(),
       fRateChecksEnabled(true),
+      pSummaries(),
+      nSummariesPowerVersion(0),
+      fSummariesDirty(true),
       cs()
 {}
 
+CProposalSummary::CProposalSummary(const CProposal& proposal)
+    : nHash(proposal.GetHash()),
+      nFeeHash(proposal.GetFeeHash()),
+      strTitle(proposal.GetTitle()),
+      strUrl(proposal.GetUrl()),
+      nCreationTime(proposal.GetCreationTime()),
+      nCreationHeight(proposal.GetVotingStartHeight()),
+      address(proposal.GetAddress()),
+      nValidityEndHeight(proposal.GetValidVoteEndHeight()),
+      nFundingEndHeight(proposal.GetFundingVoteEndHeight()),
+      fundingResult(proposal.GetVotingResult(VOTE_SIGNAL_FUNDING)),
+      strValidityError(),
+      fBlockchainValidity(proposal.IsValidLocally(strValidityError, false)),
+      fCachedValid(proposal.IsSetCachedValid()),
+      fCachedFunding(proposal.IsSetCachedFunding())
+{}
+
 // Accessors for thread-safe access to maps
 bool CSmartVotingManager::HaveProposalForHash(const uint256& nHash) const
 {
@@ -141,7 +275,7 @@ void CSmartVotingManager::ProcessMessage(CNode* pfrom, const std::string& strCom
 
         uint256 nHash = proposal.GetHash();
 
-        pfrom->setAskFor.erase(nHash);
+        pfrom->RemoveAskFor(nHash);
 
         if(pfrom->nVersion < MIN_VOTING_PEER_PROTO_VERSION) {
             LogPrint("proposal", "VOTINGPROPOSAL -- peer=%d using obsolete version %i\n", pfrom->id, pfrom->nVersion);
@@ -202,7 +336,7 @@ void CSmartVotingManager::ProcessMessage(CNode* pfrom, const std::string& strCom
 
         uint256 nHash = vote.GetHash();
 
-        pfrom->setAskFor.erase(nHash);
+        pfrom->RemoveAskFor(nHash);
 
         if(pfrom->nVersion < MIN_VOTING_PEER_PROTO_VERSION) {
             LogPrint("proposal", "VOTINGPROPOSALVOTE -- peer=%d using obsolete version %i\n", pfrom->id, pfrom->nVersion);
@@ -226,21 +360,30 @@ void CSmartVotingManager::ProcessMessage(CNode* pfrom, const std::string& strCom
             return;
         }
 
-        CSmartVotingException exception;
-        if(ProcessVote(pfrom, vote, exception, connman)) {
-            LogPrint("proposal", "VOTINGPROPOSALVOTE -- %s new\n", strHash);
-            smartnodeSync.BumpAssetLastTime("VOTINGPROPOSALVOTE");
-            vote.Relay(connman);
-        }
-        else {
-            LogPrint("proposal", "VOTINGPROPOSALVOTE -- Rejected vote, error = %s\n", exception.what());
-            if((exception.GetNodePenalty() != 0) && smartnodeSync.IsSynced()) {
-                LOCK(cs_main);
-                Misbehaving(pfrom->GetId(), exception.GetNodePenalty());
-            }
-            return;
-        }
+        if(!voteVerifier.Queue(pfrom, vote))
+            ProcessReceivedVote(pfrom, vote, connman);
+    }
+}
+
+void CSmartVotingManager::StartVoteVerification(boost::thread_group& threadGroup, CConnman& connman)
+{
+    voteVerifier.Start(threadGroup, connman);
+}
 
+void CSmartVotingManager::ProcessReceivedVote(CNode* pfrom, const CProposalVote& vote, CConnman& connman)
+{
+    CSmartVotingException exception;
+    if(ProcessVote(pfrom, vote, exception, connman)) {
+        LogPrint("proposal", "VOTINGPROPOSALVOTE -- %s new\n", vote.GetHash().ToString());
+        smartnodeSync.BumpAssetLastTime("VOTINGPROPOSALVOTE");
+        vote.Relay(connman);
+    }
+    else {
+        LogPrint("proposal", "VOTINGPROPOSALVOTE -- Rejected vote, error = %s\n", exception.what());
+        if((exception.GetNodePenalty() != 0) && smartnodeSync.IsSynced()) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), exception.GetNodePenalty());
+        }
     }
 }
 
@@ -262,6 +405,7 @@ void CSmartVotingManager::CheckOrphanVotes(CProposal& proposal, CSmartVotingExce
             fRemove = true;
         }
         else if(proposal.ProcessVote(NULL, vote, exception, connman)) {
+            GetMainSignals().NotifyProposalVote(vote);
             vote.Relay(connman);
             fRemove = true;
         }
@@ -309,6 +453,8 @@ void CSmartVotingManager::AddProposal(CProposal& proposal, CConnman& connman, CN
         return;
     }
 
+    ProposalsChanged();
+
     // SHOULD WE ADD THIS OBJECT TO ANY OTHER MANANGERS?
 
     DBG( std::cout << "CSmartVotingManager::AddProposal Before trigger block, GetDataAsPlainString = "
@@ -337,6 +483,8 @@ void CSmartVotingManager::UpdateCachesAndClean()
 {
     LogPrint("proposal", "CSmartVotingManager::UpdateCachesAndClean\n");
 
+    ProposalsChanged();
+
     LOCK2(cs_main, cs);
 
     ScopedLockBool guard(cs, fRateChecksEnabled, false);
@@ -347,14 +495,7 @@ void CSmartVotingManager::UpdateCachesAndClean()
     while(it != mapProposals.end())
     {
         CProposal* pProposal = &((*it).second);
-
-        if(!pProposal) {
-            ++it;
-            continue;
-        }
-
-        uint256 nHash = it->first;
-        std::string strHash = nHash.ToString();
+        int64_t nPrevDeletionTime = pProposal->GetDeletionTime();
 
         // UPDATE SENTINEL SIGNALING VARIABLES
         pProposal->UpdateSentinelVariables();
@@ -365,59 +506,71 @@ void CSmartVotingManager::UpdateCachesAndClean()
             pProposal->UpdateLocalValidity();
         }
 
-        // IF DELETE=TRUE, THEN CLEAN THE MESS UP!
+        if (!pProposal->IsValid()) {
+            LogPrintf("CSmartVotingManager::UpdateCachesAndClean -- set for deletion expired obj %s\n", (*it).first.ToString());
+            pProposal->SetCachedValid(false);
+            if (!pProposal->GetDeletionTime()) {
+                pProposal->SetDeletionTime(nNow);
+            }
+        }
 
-        int64_t nTimeSinceDeletion = nNow - pProposal->GetDeletionTime();
+        if(!nPrevDeletionTime && pProposal->GetDeletionTime()) {
+            mmapDeletionQueue.insert(std::make_pair(pProposal->GetDeletionTime() + SMARTVOTING_DELETION_DELAY, it->first));
+        }
 
-        LogPrint("proposal", "CSmartVotingManager::UpdateCachesAndClean -- Checking object for deletion: %s, deletion time = %d, time since deletion = %d, valid flag = %d, expired flag = %d\n",
-                 strHash, pProposal->GetDeletionTime(), nTimeSinceDeletion, pProposal->IsSetCachedValid(), pProposal->IsSetExpired());
+        ++it;
+    }
 
-        if((!pProposal->IsSetCachedValid() || pProposal->IsSetExpired()) &&
-           (nTimeSinceDeletion >= SMARTVOTING_DELETION_DELAY)) {
-            LogPrintf("CSmartVotingManager::UpdateCachesAndClean -- erase proposal %s\n", (*it).first.ToString());
+    // IF DELETE=TRUE, THEN CLEAN THE MESS UP!
 
-            // Remove vote references
-            const object_ref_cm_t::list_t& listItems = cmapVoteToProposal.GetItemList();
-            object_ref_cm_t::list_cit lit = listItems.begin();
-            while(lit != listItems.end()) {
-                if(lit->value == pProposal) {
-                    uint256 nKey = lit->key;
-                    ++lit;
-                    cmapVoteToProposal.Erase(nKey);
-                }
-                else {
-                    ++lit;
-                }
-            }
+    std::vector<uint256> vecRequeue;
+    while(!mmapDeletionQueue.empty() && mmapDeletionQueue.begin()->first <= nNow) {
+        uint256 nHash = mmapDeletionQueue.begin()->second;
+        mmapDeletionQueue.erase(mmapDeletionQueue.begin());
 
-            int64_t nTimeExpired{0};
+        proposal_m_it pit = mapProposals.find(nHash);
+        if(pit == mapProposals.end()) {
+            continue;
+        }
 
-            // keep hashes of deleted proposals forever
-            nTimeExpired = std::numeric_limits<int64_t>::max();
+        CProposal* pProposal = &pit->second;
 
-            mapErasedProposals.insert(std::make_pair(nHash, nTimeExpired));
-            mapProposals.erase(it++);
-        } else {
+        LogPrint("proposal", "CSmartVotingManager::UpdateCachesAndClean -- Checking object for deletion: %s, deletion time = %d, valid flag = %d, expired flag = %d\n",
+                 nHash.ToString(), pProposal->GetDeletionTime(), pProposal->IsSetCachedValid(), pProposal->IsSetExpired());
 
-            if (!pProposal->IsValid()) {
-                LogPrintf("CSmartVotingManager::UpdateCachesAndClean -- set for deletion expired obj %s\n", (*it).first.ToString());
-                pProposal->SetCachedValid(false);
-                if (!pProposal->GetDeletionTime()) {
-                    pProposal->SetDeletionTime(nNow);
-                }
-            }
+        if(pProposal->IsSetCachedValid() && !pProposal->IsSetExpired()) {
+            // not to be deleted right now, check again next time
+            vecRequeue.push_back(nHash);
+            continue;
+        }
 
-            ++it;
+        LogPrintf("CSmartVotingManager::UpdateCachesAndClean -- erase proposal %s\n", nHash.ToString());
+
+        // Remove vote references
+        for(const uint256& nHashVote : pProposal->GetVoteFile().GetVoteHashes()) {
+            CProposal* pVoteProposal = NULL;
+            if(cmapVoteToProposal.Get(nHashVote, pVoteProposal) && pVoteProposal == pProposal) {
+                cmapVoteToProposal.Erase(nHashVote);
+            }
         }
+
+        // keep hashes of deleted proposals forever
+        mapErasedProposals.insert(std::make_pair(nHash, std::numeric_limits<int64_t>::max()));
+        pProposal->EraseVotes();
+        mapProposals.erase(pit);
+    }
+
+    for(const uint256& nHash : vecRequeue) {
+        mmapDeletionQueue.insert(std::make_pair(nNow, nHash));
     }
 
     // forget about expired deleted objects
-    hash_time_m_it s_it = mapErasedProposals.begin();
-    while(s_it != mapErasedProposals.end()) {
-        if(s_it->second < nNow)
-            mapErasedProposals.erase(s_it++);
-        else
-            ++s_it;
+    while(!mmapErasedExpiry.empty() && mmapErasedExpiry.begin()->first < nNow) {
+        hash_time_m_it s_it = mapErasedProposals.find(mmapErasedExpiry.begin()->second);
+        if(s_it != mapErasedProposals.end() && s_it->second < nNow) {
+            mapErasedProposals.erase(s_it);
+        }
+        mmapErasedExpiry.erase(mmapErasedExpiry.begin());
     }
 
     LogPrintf("CSmartVotingManager::UpdateCachesAndClean -- %s\n", ToString());
@@ -526,6 +679,36 @@ struct sortProposalsByVotes {
     }
 };
 
+proposal_summaries_t CSmartVotingManager::GetProposalSummaries() const
+{
+    uint64_t nPowerVersion = GetVotingPowerVersion();
+
+    {
+        LOCK(cs_summaries);
+        if(pSummaries && !fSummariesDirty && nSummariesPowerVersion == nPowerVersion) {
+            return pSummaries;
+        }
+    }
+
+    // Changes during the rebuild mark the summaries dirty again
+    fSummariesDirty = false;
+
+    std::shared_ptr<std::vector<CProposalSummary> > pNew = std::make_shared<std::vector<CProposalSummary> >();
+
+    {
+        LOCK2(cs_main, cs);
+        pNew->reserve(mapProposals.size());
+        for(proposal_m_cit it = mapProposals.begin(); it != mapProposals.end(); ++it) {
+            pNew->emplace_back(it->second);
+        }
+    }
+
+    LOCK(cs_summaries);
+    pSummaries = pNew;
+    nSummariesPowerVersion = nPowerVersion;
+    return pSummaries;
+}
+
 void CSmartVotingManager::DoMaintenance(CConnman& connman)
 {
     if(fLiteMode || !smartnodeSync.IsSynced()) return;
@@ -601,8 +784,6 @@ void CSmartVotingManager::SyncProposalWithVotes(CNode* pnode, const uint256& nPr
     // do not provide any data until our node is synced
     if(!smartnodeSync.IsSynced()) return;
 
-    int nVoteCount = 0;
-
     // SYNC GOVERNANCE OBJECTS WITH OTHER CLIENT
 
     LogPrint("proposal", "CSmartVotingManager::%s -- syncing single object to peer=%d, nProp = %s\n", __func__, pnode->id, nProp.ToString());
@@ -630,20 +811,78 @@ void CSmartVotingManager::SyncProposalWithVotes(CNode* pnode, const uint256& nPr
     LogPrint("proposal", "CSmartVotingManager::%s -- syncing proposal: %s, peer=%d\n", __func__, strHash, pnode->id);
     pnode->PushInventory(CInv(MSG_VOTING_PROPOSAL, it->first));
 
-    auto fileVotes = proposal.GetVoteFile();
-    std::string strError;
-    for (const auto& vote : fileVotes.GetVotes()) {
-        uint256 nVoteHash = vote.GetHash();
-        if(filter.contains(nVoteHash) || !vote.IsValid(true, true, strError)) {
-            continue;
+    // The votes follow in batches, a new request of the peer restarts its sync
+    mapVoteSyncCursors.erase(pnode->id);
+    CVoteSyncCursor cursor(nProp, filter);
+
+    if(!SyncVoteBatch(pnode, cursor, connman)) {
+        mapVoteSyncCursors.insert(std::make_pair(pnode->id, cursor));
+    }
+}
+
+bool CSmartVotingManager::SyncVoteBatch(CNode* pnode, CVoteSyncCursor& cursor, CConnman& connman)
+{
+    AssertLockHeld(cs);
+
+    proposal_m_it it = mapProposals.find(cursor.nProp);
+    bool fDone = true;
+
+    if(it != mapProposals.end()) {
+        std::vector<CProposalVote> vecVotes = it->second.GetVoteFile().GetVotesAfter(cursor.nLastVote, SMARTVOTING_VOTE_SYNC_BATCH);
+        std::string strError;
+
+        fDone = vecVotes.size() < SMARTVOTING_VOTE_SYNC_BATCH;
+
+        for (const auto& vote : vecVotes) {
+            uint256 nVoteHash = vote.GetHash();
+            cursor.nLastVote = nVoteHash;
+            if(cursor.filter.contains(nVoteHash) || !vote.IsValid(true, true, strError)) {
+                continue;
+            }
+            pnode->PushInventory(CInv(MSG_VOTING_PROPOSAL_VOTE, nVoteHash));
+            ++cursor.nVoteCount;
         }
-        pnode->PushInventory(CInv(MSG_VOTING_PROPOSAL_VOTE, nVoteHash));
-        ++nVoteCount;
     }
 
-    connman.PushMessage(pnode, NetMsgType::SYNCSTATUSCOUNT, SMARTNODE_SYNC_PROPOSAL, 1);
-    connman.PushMessage(pnode, NetMsgType::SYNCSTATUSCOUNT, SMARTNODE_SYNC_PROPOSAL_VOTE, nVoteCount);
-    LogPrintf("CSmartVotingManager::%s -- sent 1 object and %d votes to peer=%d\n", __func__, nVoteCount, pnode->id);
+    if(fDone) {
+        connman.PushMessage(pnode, NetMsgType::SYNCSTATUSCOUNT, SMARTNODE_SYNC_PROPOSAL, 1);
+        connman.PushMessage(pnode, NetMsgType::SYNCSTATUSCOUNT, SMARTNODE_SYNC_PROPOSAL_VOTE, cursor.nVoteCount);
+        LogPrintf("CSmartVotingManager::%s -- sent 1 object and %d votes to peer=%d\n", __func__, cursor.nVoteCount, pnode->id);
+    }
+
+    return fDone;
+}
+
+void CSmartVotingManager::ProcessVoteSyncCursors(CConnman& connman)
+{
+    {
+        LOCK(cs);
+        if(mapVoteSyncCursors.empty()) return;
+    }
+
+    std::vector<CNode*> vNodesCopy = connman.CopyNodeVector();
+
+    {
+        LOCK2(cs_main, cs);
+
+        std::map<NodeId, CNode*> mapNodes;
+        for (const auto& pnode : vNodesCopy) {
+            mapNodes[pnode->id] = pnode;
+        }
+
+        auto it = mapVoteSyncCursors.begin();
+        while(it != mapVoteSyncCursors.end()) {
+            auto itNode = mapNodes.find(it->first);
+            // the peer is gone
+            if(itNode == mapNodes.end() || itNode->second->fDisconnect || SyncVoteBatch(itNode->second, it->second, connman)) {
+                mapVoteSyncCursors.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    connman.ReleaseNodeVector(vNodesCopy);
 }
 
 void CSmartVotingManager::SyncAll(CNode* pnode, CConnman& connman) const
@@ -651,14 +890,14 @@ void CSmartVotingManager::SyncAll(CNode* pnode, CConnman& connman) const
     // do not provide any data until our node is synced
     if(!smartnodeSync.IsSynced()) return;
 
-    if(netfulfilledman.HasFulfilledRequest(pnode->addr, NetMsgType::VOTINGSYNC)) {
+    if(netfulfilledman.HasFulfilledRequest(pnode->addr, FULFILLED_VOTING_SYNC_REPLY)) {
         LOCK(cs_main);
         // Asking for the whole list multiple times in a short period of time is no good
         LogPrint("proposal", "CSmartVotingManager::%s -- peer already asked me for the list\n", __func__);
         Misbehaving(pnode->GetId(), 20);
         return;
     }
-    netfulfilledman.AddFulfilledRequest(pnode->addr, NetMsgType::VOTINGSYNC);
+    netfulfilledman.AddFulfilledRequest(pnode->addr, FULFILLED_VOTING_SYNC_REPLY);
 
     int nObjCount = 0;
     int nVoteCount = 0;
@@ -727,7 +966,7 @@ bool CSmartVotingManager::ProcessVote(CNode* pfrom, const CProposalVote& vote, C
         ostr << "Unknown proposal " << nHashProposal.ToString()
              << ", votekey = " << vote.GetVoteKey().ToString();
         exception = CSmartVotingException(ostr.str(), SMARTVOTING_EXCEPTION_WARNING);
-        if(cmmapOrphanVotes.Insert(nHashProposal, vote_time_pair_t(vote, GetAdjustedTime() + SMARTVOTING_ORPHAN_EXPIRATION_TIME))) {
+        if(AddOrphanVote(nHashProposal, vote)) {
             LEAVE_CRITICAL_SECTION(cs);
             RequestProposal(pfrom, nHashProposal, connman);
             LogPrint("proposal", "CSmartVotingManager::ProcessVote -- %s\n", ostr.str());
@@ -752,6 +991,10 @@ bool CSmartVotingManager::ProcessVote(CNode* pfrom, const CProposalVote& vote, C
     }
 
     bool fOk = proposal.ProcessVote(pfrom, vote, exception, connman) && cmapVoteToProposal.Insert(nHashVote, &proposal);
+    if(fOk) {
+        ProposalsChanged();
+        GetMainSignals().NotifyProposalVote(vote);
+    }
     LEAVE_CRITICAL_SECTION(cs);
     return fOk;
 }
@@ -888,7 +1131,8 @@ int CSmartVotingManager::RequestProposalVotes(const std::vector<CNode*>& vNodesC
     // number of votes to make sure it's robust enough, so aim at 2000 votes per masternode per request.
     // On mainnet nMaxObjRequestsPerNode is always set to 1.
     int nMaxProposalRequestsPerNode = 1;
-    size_t nProjectedVotes = 10000;
+    // The peers send the votes in batches, only a batch at a time lands in setAskFor
+    size_t nProjectedVotes = SMARTVOTING_VOTE_SYNC_BATCH;
 //    if(Params().NetworkIDString() != CBaseChainParams::MAIN) {
 //        nMaxProposalRequestsPerNode = std::max(1, int(nProjectedVotes / std::max(1, mnodeman.size())));
 //    }
@@ -938,7 +1182,7 @@ int CSmartVotingManager::RequestProposalVotes(const std::vector<CNode*>& vNodesC
             // only use up to date peers
             if(pnode->nVersion < MIN_VOTING_PEER_PROTO_VERSION) continue;
             // stop early to prevent setAskFor overflow
-            size_t nProjectedSize = pnode->setAskFor.size() + nProjectedVotes;
+            size_t nProjectedSize = pnode->GetAskForSize() + nProjectedVotes;
             if(nProjectedSize > SETASKFOR_MAX_SZ/2) continue;
             // to early to ask the same node
             if(mapAskedRecently[nHashProposal].count(pnode->addr)) continue;
@@ -999,12 +1243,38 @@ void CSmartVotingManager::RebuildIndexes()
     }
 }
 
+void CSmartVotingManager::RebuildExpiryQueues()
+{
+    LOCK(cs);
+
+    mmapDeletionQueue.clear();
+    for(const auto& proposal : mapProposals) {
+        if(proposal.second.GetDeletionTime()) {
+            mmapDeletionQueue.insert(std::make_pair(proposal.second.GetDeletionTime() + SMARTVOTING_DELETION_DELAY, proposal.first));
+        }
+    }
+
+    mmapErasedExpiry.clear();
+    for(const auto& erased : mapErasedProposals) {
+        if(erased.second != std::numeric_limits<int64_t>::max()) {
+            mmapErasedExpiry.insert(std::make_pair(erased.second, erased.first));
+        }
+    }
+
+    mmapOrphanExpiry.clear();
+    for(const auto& item : cmmapOrphanVotes.GetItemList()) {
+        mmapOrphanExpiry.insert(std::make_pair(item.value.second, item.key));
+    }
+}
+
 void CSmartVotingManager::InitOnLoad()
 {
     LOCK(cs);
     int64_t nStart = GetTimeMillis();
     LogPrintf("Preparing votingkey indexes...\n");
     RebuildIndexes();
+    RebuildExpiryQueues();
+    ProposalsChanged();
     LogPrintf("Votingkey indexes prepared  %dms\n", GetTimeMillis() - nStart);
     LogPrintf("     %s\n", ToString());
 }
@@ -1019,6 +1289,47 @@ std::string CSmartVotingManager::ToString() const
                     (int)cmapVoteToProposal.GetSize());
 }
 
+void CSmartVotingManager::GetMemoryUsage(memusage::ComponentUsage& usage) const
+{
+    {
+        LOCK(cs);
+
+        size_t nProposals = memusage::DynamicUsage(mapProposals) + memusage::DynamicUsage(mapPostponedProposals);
+        for(proposal_m_cit it = mapProposals.begin(); it != mapProposals.end(); ++it) {
+            nProposals += it->second.DynamicMemoryUsage();
+        }
+        for(proposal_m_cit it = mapPostponedProposals.begin(); it != mapPostponedProposals.end(); ++it) {
+            nProposals += it->second.DynamicMemoryUsage();
+        }
+        usage.emplace_back("proposals", nProposals);
+
+        usage.emplace_back("erased_proposals", memusage::DynamicUsage(mapErasedProposals));
+        usage.emplace_back("expiry_queues", memusage::DynamicUsage(mmapDeletionQueue) + memusage::DynamicUsage(mmapErasedExpiry) +
+                                            memusage::DynamicUsage(mmapOrphanExpiry));
+        usage.emplace_back("vote_index", cmapVoteToProposal.DynamicMemoryUsage());
+
+        size_t nInvalidVotes = cmapInvalidVotes.DynamicMemoryUsage();
+        for(const auto& item : cmapInvalidVotes.GetItemList()) {
+            nInvalidVotes += item.value.DynamicMemoryUsage();
+        }
+        usage.emplace_back("invalid_votes", nInvalidVotes);
+
+        size_t nOrphanVotes = cmmapOrphanVotes.DynamicMemoryUsage();
+        for(const auto& item : cmmapOrphanVotes.GetItemList()) {
+            nOrphanVotes += item.value.first.DynamicMemoryUsage();
+        }
+        usage.emplace_back("orphan_votes", nOrphanVotes);
+
+        usage.emplace_back("requests", memusage::DynamicUsage(setAdditionalRelayObjects) + memusage::DynamicUsage(setRequestedProposals) +
+                                       memusage::DynamicUsage(setRequestedVotes));
+        usage.emplace_back("vote_syncs", memusage::DynamicUsage(mapVoteSyncCursors));
+    }
+
+    // Readers might keep older summaries alive, only the current ones are counted
+    LOCK(cs_summaries);
+    usage.emplace_back("summaries", pSummaries ? memusage::MallocUsage(sizeof(*pSummaries)) + memusage::DynamicUsage(*pSummaries) : 0);
+}
+
 UniValue CSmartVotingManager::ToJson() const
 {
     LOCK(cs);
@@ -1044,6 +1355,9 @@ void CSmartVotingManager::UpdatedBlockTip(const CBlockIndex *pindex, CConnman& c
     nCachedBlockHeight = pindex->nHeight;
     LogPrint("proposal", "CSmartVotingManager::UpdatedBlockTip -- nCachedBlockHeight: %d\n", nCachedBlockHeight);
 
+    // The validity of the proposals depends on the height
+    ProposalsChanged();
+
     CheckPostponedProposals(connman);
 }
 
@@ -1082,17 +1396,21 @@ void CSmartVotingManager::RequestOrphanProposals(CConnman& connman)
 void CSmartVotingManager::CleanOrphanObjects()
 {
     LOCK(cs);
-    const vote_cmm_t::list_t& items = cmmapOrphanVotes.GetItemList();
 
     int64_t nNow = GetAdjustedTime();
 
-    vote_cmm_t::list_cit it = items.begin();
-    while(it != items.end()) {
-        vote_cmm_t::list_cit prevIt = it;
-        ++it;
-        const vote_time_pair_t& pairVote = prevIt->value;
-        if(pairVote.second < nNow) {
-            cmmapOrphanVotes.Erase(prevIt->key, prevIt->value);
+    while(!mmapOrphanExpiry.empty() && mmapOrphanExpiry.begin()->first < nNow) {
+        uint256 nHash = mmapOrphanExpiry.begin()->second;
+        mmapOrphanExpiry.erase(mmapOrphanExpiry.begin());
+
+        std::vector<vote_time_pair_t> vecVotePairs;
+        if(!cmmapOrphanVotes.GetAll(nHash, vecVotePairs)) {
+            continue;
+        }
+        for(const vote_time_pair_t& pairVote : vecVotePairs) {
+            if(pairVote.second < nNow) {
+                cmmapOrphanVotes.Erase(nHash, pairVote);
+            }
         }
     }
 }
@@ -12,8 +12,12 @@
 #include "univalue.h"
 #include "smartvoting/exceptions.h"
 #include "smartvoting/proposal.h"
+#include "smartnode/smartnodeseen.h"
 #include "net.h"
 
+#include <atomic>
+#include <memory>
+
 
 class CSmartVotingManager;
 
@@ -28,6 +32,50 @@ struct ExpirationInfo {
 
 typedef std::pair<CProposal, ExpirationInfo> object_info_pair_t;
 
+/** What the RPC and the UI show of a proposal, taken at once under cs_main and cs. */
+struct CProposalSummary {
+    uint256 nHash;
+    uint256 nFeeHash;
+    std::string strTitle;
+    std::string strUrl;
+    int64_t nCreationTime;
+    int64_t nCreationHeight;
+    CSmartAddress address;
+    int nValidityEndHeight;
+    int nFundingEndHeight;
+    CVoteResult fundingResult;
+    // filled by IsValidLocally, declared first for that
+    std::string strValidityError;
+    bool fBlockchainValidity;
+    bool fCachedValid;
+    bool fCachedFunding;
+
+    explicit CProposalSummary(const CProposal& proposal);
+};
+
+/** Shared, never modified once published */
+typedef std::shared_ptr<const std::vector<CProposalSummary> > proposal_summaries_t;
+
+// Threads which check the signatures of proposal votes off the message handler thread, at most
+static const int SMARTVOTING_MAX_VOTE_VERIFY_THREADS = 8;
+// Votes waiting for them at most, further votes get processed right away again
+static const size_t SMARTVOTING_MAX_QUEUED_VOTES = 50000;
+
+/** Votes pushed to a peer per batch of a proposal sync */
+static const size_t SMARTVOTING_VOTE_SYNC_BATCH = 1000;
+
+/** Where the vote sync of a proposal to a peer continues. */
+struct CVoteSyncCursor {
+    uint256 nProp;
+    CBloomFilter filter;
+    // hash of the last vote checked, the votes are sent in the order of their hash
+    uint256 nLastVote;
+    int nVoteCount;
+
+    CVoteSyncCursor(const uint256& nPropIn, const CBloomFilter& filterIn) :
+        nProp(nPropIn), filter(filterIn), nLastVote(), nVoteCount(0) {}
+};
+
 
 //
 // Governance Manager : Contains all proposals for the budget
@@ -44,7 +92,7 @@ public: // Types
 
     typedef proposal_m_t::const_iterator proposal_m_cit;
 
-    typedef CacheMap<uint256, CProposal*> object_ref_cm_t;
+    typedef CacheMap<uint256, CProposal*, CSeenMessageHasher> object_ref_cm_t;
 
     typedef std::map<uint256, CProposalVote> vote_m_t;
 
@@ -52,9 +100,9 @@ public: // Types
 
     typedef vote_m_t::const_iterator vote_m_cit;
 
-    typedef CacheMap<uint256, CProposalVote> vote_cm_t;
+    typedef CacheMap<uint256, CProposalVote, CSeenMessageHasher> vote_cm_t;
 
-    typedef CacheMultiMap<uint256, vote_time_pair_t> vote_cmm_t;
+    typedef CacheMultiMap<uint256, vote_time_pair_t, CSeenMessageHasher> vote_cmm_t;
 
     typedef proposal_m_t::size_type size_type;
 
@@ -78,6 +126,8 @@ public: // Types
 
     typedef hash_time_m_t::const_iterator hash_time_m_cit;
 
+    typedef std::multimap<int64_t, uint256> time_hash_mm_t;
+
 private:
     static const int MAX_CACHE_SIZE = 10000000;
 
@@ -99,6 +149,16 @@ private:
     //   value - expiration time for deleted objects
     hash_time_m_t mapErasedProposals;
 
+    // Expiry queues, due time -> hash, so the maintenance only looks at the
+    // entries which are due. They are rebuilt on load and may hold entries
+    // that are gone already, those get skipped when they come up.
+    //   mmapDeletionQueue - proposals set for deletion
+    //   mmapErasedExpiry  - erased proposals with a finite expiration time
+    //   mmapOrphanExpiry  - proposals with orphan votes
+    time_hash_mm_t mmapDeletionQueue;
+    time_hash_mm_t mmapErasedExpiry;
+    time_hash_mm_t mmapOrphanExpiry;
+
     proposal_m_t mapPostponedProposals;
     hash_s_t setAdditionalRelayObjects;
 
@@ -114,6 +174,18 @@ private:
 
     bool fRateChecksEnabled;
 
+    // running proposal vote syncs by peer, one per peer
+    std::map<NodeId, CVoteSyncCursor> mapVoteSyncCursors;
+
+    // last published proposal summaries, rebuilt on the next read once the
+    // proposals, their votes or the voting power changed
+    mutable CCriticalSection cs_summaries;
+    mutable proposal_summaries_t pSummaries;
+    mutable uint64_t nSummariesPowerVersion;
+    mutable std::atomic<bool> fSummariesDirty;
+
+    void ProposalsChanged() { fSummariesDirty = true; }
+
     class ScopedLockBool
     {
         bool& ref;
@@ -150,9 +222,16 @@ public:
 
     void SyncProposalWithVotes(CNode* pnode, const uint256& nProp, const CBloomFilter& filter, CConnman& connman);
     void SyncAll(CNode* pnode, CConnman& connman) const;
+    /// Push the next batch of votes to all peers with a running proposal sync
+    void ProcessVoteSyncCursors(CConnman& connman);
 
     void ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman& connman);
 
+    /// Start the threads which check the vote signatures, votes get processed inline without them
+    void StartVoteVerification(boost::thread_group& threadGroup, CConnman& connman);
+    /// Process a vote received from pfrom, its signature got checked already if it was queued
+    void ProcessReceivedVote(CNode* pfrom, const CProposalVote& vote, CConnman& connman);
+
     void DoMaintenance(CConnman& connman);
 
     CProposal* FindProposal(const uint256& nHash);
@@ -161,6 +240,8 @@ public:
     std::vector<CProposalVote> GetMatchingVotes(const uint256& nParentHash) const;
     std::vector<CProposalVote> GetCurrentVotes(const uint256& nParentHash, const COutPoint& mnCollateralOutpointFilter) const;
     std::vector<const CProposal*> GetAllNewerThan(int64_t nMoreThanTime) const;
+    /// Summaries of all proposals, consistent among each other. Don't hold cs_main or cs when calling it.
+    proposal_summaries_t GetProposalSummaries() const;
 
     void AddProposal(CProposal& proposal, CConnman& connman, CNode* pfrom = NULL);
 
@@ -175,12 +256,19 @@ public:
         LogPrint("proposal", "SmartVoting manager was cleared\n");
         mapProposals.clear();
         mapErasedProposals.clear();
+        mmapDeletionQueue.clear();
+        mmapErasedExpiry.clear();
+        mmapOrphanExpiry.clear();
         cmapVoteToProposal.Clear();
         cmapInvalidVotes.Clear();
         cmmapOrphanVotes.Clear();
+        mapVoteSyncCursors.clear();
+        ProposalsChanged();
     }
 
     std::string ToString() const;
+    /// Heap usage of the proposals, the vote caches and the sync state
+    void GetMemoryUsage(memusage::ComponentUsage& usage) const;
 
     ADD_SERIALIZE_METHODS
 
@@ -261,13 +349,23 @@ private:
         cmapInvalidVotes.Insert(vote.GetHash(), vote);
     }
 
-    void AddOrphanVote(const CProposalVote& vote)
+    bool AddOrphanVote(const uint256& nHashProposal, const CProposalVote& vote)
     {
-        cmmapOrphanVotes.Insert(vote.GetHash(), vote_time_pair_t(vote, GetAdjustedTime() + SMARTVOTING_ORPHAN_EXPIRATION_TIME));
+        int64_t nExpiration = GetAdjustedTime() + SMARTVOTING_ORPHAN_EXPIRATION_TIME;
+        if(!cmmapOrphanVotes.Insert(nHashProposal, vote_time_pair_t(vote, nExpiration))) {
+            return false;
+        }
+        mmapOrphanExpiry.insert(std::make_pair(nExpiration, nHashProposal));
+        return true;
     }
 
+    void RebuildExpiryQueues();
+
     bool ProcessVote(CNode* pfrom, const CProposalVote& vote, CSmartVotingException& exception, CConnman& connman);
 
+    /// Returns true once the cursor has no votes left
+    bool SyncVoteBatch(CNode* pnode, CVoteSyncCursor& cursor, CConnman& connman);
+
     /// Called to indicate a requested object has been received
     bool AcceptProposalMessage(const uint256& nHash);
 
@@ -37,6 +37,8 @@ CProposal::CProposal() :
     fExpired(false),
     nCreationHeight(-1),
     mapCurrentVKVotes(),
+    nTallyPowerVersion(0),
+    fTallyValid(false),
     cmmapOrphanVotes(),
     fileVotes(),
     cs()
@@ -59,6 +61,8 @@ CProposal::CProposal(const CProposal &other) :
     fExpired(other.fExpired),
     nCreationHeight(other.nCreationHeight),
     mapCurrentVKVotes(other.mapCurrentVKVotes),
+    nTallyPowerVersion(0),
+    fTallyValid(false),
     cmmapOrphanVotes(other.cmmapOrphanVotes),
     fileVotes(other.fileVotes),
     cs()
@@ -86,6 +90,9 @@ void CProposal::swap(CProposal &first, CProposal &second)
     swap(first.fDirtyCache, second.fDirtyCache);
     swap(first.fExpired, second.fExpired);
     swap(first.nCreationHeight, second.nCreationHeight);
+
+    first.fTallyValid = false;
+    second.fTallyValid = false;
 }
 
 
@@ -406,7 +413,17 @@ bool CProposal::ProcessVote(CNode* pfrom,
 //        return false;
 //    }
 
+    vote_outcome_enum_t eOutcomePrev = voteInstanceRef.eOutcome;
     voteInstanceRef = vote_instance_t(vote.GetOutcome(), nVoteTimeUpdate, vote.GetTimestamp());
+
+    // Move the vote key's power to the new outcome, a power change in between
+    // makes the next query count again anyway
+    if( fTallyValid && nTallyPowerVersion == GetVotingPowerVersion() ){
+        int64_t nPower = std::max<int64_t>(0, ::GetVotingPower(vote.GetVoteKey()));
+        vecTally[eSignal].Add(eOutcomePrev, -nPower);
+        vecTally[eSignal].Add(vote.GetOutcome(), nPower);
+    }
+
     fileVotes.AddVote(vote);
     InvalidateVoteCache();
     return true;
@@ -426,6 +443,8 @@ void CProposal::ClearVoteKeyVotes()
 //            ++it;
 //        }
     }
+
+    fTallyValid = false;
 }
 
 void CProposal::UpdateLocalValidity()
@@ -490,6 +509,17 @@ bool CProposal::UpdateProposalStartHeight(){
     return false;
 }
 
+bool CProposal::IsFeeTxCandidate(const CTransaction& tx)
+{
+    // The output IsCollateralValid looks for, OP_RETURN with the hash of the proposal
+    for (const auto& output : tx.vout) {
+        const CScript& script = output.scriptPubKey;
+        if (output.nValue == 0 && script.size() == 34 && script[0] == OP_RETURN && script[1] == 32)
+            return true;
+    }
+    return false;
+}
+
 bool CProposal::IsCollateralValid(std::string& strError, int& fMissingConfirmations) const
 {
     strError = "";
@@ -591,20 +621,46 @@ bool CProposal::IsCollateralValid(std::string& strError, int& fMissingConfirmati
     return true;
 }
 
-int64_t CProposal::GetVotingPower(vote_signal_enum_t eVoteSignalIn, vote_outcome_enum_t eVoteOutcomeIn) const
+void CProposal::UpdateTally() const
 {
-    LOCK(cs);
+    AssertLockHeld(cs);
+
+    // Read before counting, a change while counting gets it counted again next time
+    uint64_t nVersion = GetVotingPowerVersion();
+
+    if( fTallyValid && nTallyPowerVersion == nVersion )
+        return;
+
+    for( CVoteOutcomes &tally : vecTally )
+        tally = CVoteOutcomes();
 
-    int64_t nTotalPower = 0;
     for (const auto& votepair : mapCurrentVKVotes) {
-        const vote_rec_t& recVote = votepair.second;
-        vote_instance_m_cit it2 = recVote.mapInstances.find(eVoteSignalIn);
-        if(it2 != recVote.mapInstances.end() && it2->second.eOutcome == eVoteOutcomeIn) {
-            int64_t nPower = ::GetVotingPower(votepair.first);
-            nTotalPower += std::max<int64_t>(0,nPower);
+        int64_t nPower = std::max<int64_t>(0, ::GetVotingPower(votepair.first));
+        for (const auto& instance : votepair.second.mapInstances) {
+            if( instance.first > VOTE_SIGNAL_NONE && instance.first <= MAX_SUPPORTED_VOTE_SIGNAL )
+                vecTally[instance.first].Add(instance.second.eOutcome, nPower);
         }
     }
-    return nTotalPower;
+
+    nTallyPowerVersion = nVersion;
+    fTallyValid = true;
+}
+
+int64_t CProposal::GetVotingPower(vote_signal_enum_t eVoteSignalIn, vote_outcome_enum_t eVoteOutcomeIn) const
+{
+    if( eVoteSignalIn <= VOTE_SIGNAL_NONE || eVoteSignalIn > MAX_SUPPORTED_VOTE_SIGNAL )
+        return 0;
+
+    LOCK(cs);
+
+    UpdateTally();
+
+    switch(eVoteOutcomeIn){
+    case VOTE_OUTCOME_YES: return vecTally[eVoteSignalIn].nYesPower;
+    case VOTE_OUTCOME_NO: return vecTally[eVoteSignalIn].nNoPower;
+    case VOTE_OUTCOME_ABSTAIN: return vecTally[eVoteSignalIn].nAbstainPower;
+    default: return 0;
+    }
 }
 
 CVoteOutcomes CProposal::GetVotingPower(const std::set<CVoteKey> &setVoteKeys, vote_signal_enum_t eVoteSignalIn) const
@@ -624,20 +680,7 @@ CVoteOutcomes CProposal::GetVotingPower(const std::set<CVoteKey> &setVoteKeys, v
             vote_instance_m_cit it = recVotes.mapInstances.find(eVoteSignalIn);
             if( it == recVotes.mapInstances.end()  ) continue;
 
-            switch(it->second.eOutcome){
-            case VOTE_OUTCOME_YES:
-                outcome.nYesPower += nPower;
-                break;
-            case VOTE_OUTCOME_NO:
-                outcome.nNoPower += nPower;
-                break;
-            case VOTE_OUTCOME_ABSTAIN:
-                outcome.nAbstainPower += nPower;
-                break;
-            case VOTE_OUTCOME_NONE:
-                break;
-
-            }
+            outcome.Add(it->second.eOutcome, nPower);
 
         }
     }
@@ -675,9 +718,15 @@ CAmount CProposal::GetAbstainPower(vote_signal_enum_t eVoteSignalIn) const
 
 CVoteResult CProposal::GetVotingResult(vote_signal_enum_t eVoteSignalIn) const
 {
-    return CVoteResult(GetYesPower(eVoteSignalIn),
-                       GetNoPower(eVoteSignalIn),
-                       GetAbstainPower(eVoteSignalIn));
+    if( eVoteSignalIn <= VOTE_SIGNAL_NONE || eVoteSignalIn > MAX_SUPPORTED_VOTE_SIGNAL )
+        return CVoteResult(0, 0, 0);
+
+    LOCK(cs);
+
+    UpdateTally();
+
+    const CVoteOutcomes &tally = vecTally[eVoteSignalIn];
+    return CVoteResult(tally.nYesPower, tally.nNoPower, tally.nAbstainPower);
 }
 
 void CProposal::GetActiveVoteKeys(std::set<CVoteKey> &setVoteKeys) const
@@ -806,6 +855,18 @@ string CProposal::ToString() const
     return strprintf("CProposal(%s, %s, %s, %s)", GetHash().ToString(), title, url, address.ToString());
 }
 
+size_t CProposal::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(vecMilestones) + memusage::DynamicUsage(mapCurrentVKVotes) + cmmapOrphanVotes.DynamicMemoryUsage();
+    for (const auto& voteRecord : mapCurrentVKVotes) {
+        nUsage += memusage::DynamicUsage(voteRecord.second.mapInstances);
+    }
+    for (const auto& item : cmmapOrphanVotes.GetItemList()) {
+        nUsage += item.value.first.DynamicMemoryUsage();
+    }
+    return nUsage;
+}
+
 string CInternalProposal::ToString() const
 {
     return strprintf("CInternalProposal %s -- %s", hashInternal.ToString(), CProposal::ToString());
@@ -151,7 +151,7 @@ public:
 
     typedef vote_m_t::const_iterator vote_m_cit;
 
-    typedef CacheMultiMap<COutPoint, vote_time_pair_t> vote_cmm_t;
+    typedef CacheMultiMap<COutPoint, vote_time_pair_t, SaltedOutpointHasher> vote_cmm_t;
 
 protected:
 
@@ -189,6 +189,12 @@ protected:
 
     vote_m_t mapCurrentVKVotes;
 
+    /// Voting power by outcome for each signal, valid as long as fTallyValid
+    /// is set and the power version it was counted with is still current
+    mutable CVoteOutcomes vecTally[MAX_SUPPORTED_VOTE_SIGNAL + 1];
+    mutable uint64_t nTallyPowerVersion;
+    mutable bool fTallyValid;
+
     /// Limited map of votes orphaned by MN
     vote_cmm_t cmmapOrphanVotes;
 
@@ -198,6 +204,9 @@ private:
     /// critical section to protect the inner data structures
     mutable CCriticalSection cs;
 
+    /// Count vecTally again if it is outdated, requires cs
+    void UpdateTally() const;
+
 public:
 
     CProposal();
@@ -281,12 +290,17 @@ public:
         return fileVotes;
     }
 
+    /// Drop the votes from the vote database once the proposal is deleted
+    void EraseVotes() { fileVotes.EraseVotes(); }
+
     void UpdateLocalValidity();
     void UpdateSentinelVariables();
 
     bool IsValidLocally(std::string& strError, bool fCheckCollateral) const;
     bool IsValidLocally(std::string& strError, int& fMissingConfirmations, bool fCheckCollateral) const;
     bool IsCollateralValid(std::string& strError, int& fMissingConfirmations) const;
+    /// Has the OP_RETURN output of a proposal fee, these outlive their blocks in prune mode
+    static bool IsFeeTxCandidate(const CTransaction& tx);
 
     bool UpdateProposalStartHeight();
 
@@ -309,6 +323,9 @@ public:
 
     std::string ToString() const;
 
+    /// Heap usage of the milestones, the current votes and the orphan votes
+    size_t DynamicMemoryUsage() const;
+
     ADD_SERIALIZE_METHODS
 
     template <typename Stream, typename Operation>
@@ -327,6 +344,8 @@ public:
             READWRITE(fExpired);
             READWRITE(mapCurrentVKVotes);
             READWRITE(fileVotes);
+            if(ser_action.ForRead())
+                fTallyValid = false;
             LogPrint("proposal", "CProposal::SerializationOp hash = %s, vote count = %d\n", GetHash().ToString(), fileVotes.GetVoteCount());
         }
     }
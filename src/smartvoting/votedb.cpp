@@ -4,16 +4,53 @@
 
 #include "votedb.h"
 
+#include "util.h"
+
+static const char DB_VOTE = 'v';
+
+CProposalVoteDB *pvotedb = NULL;
+
+CProposalVoteDB::CProposalVoteDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "votes", nCacheSize, fMemory, fWipe, false, CDBOptions(true))
+{
+}
+
+bool CProposalVoteDB::WriteVotes(const std::vector<CProposalVote> &vecVotes)
+{
+    CDBBatch batch(*this);
+
+    for( const CProposalVote &vote : vecVotes )
+        batch.Write(std::make_pair(DB_VOTE, vote.GetHash()), vote);
+
+    return WriteBatch(batch);
+}
+
+bool CProposalVoteDB::ReadVote(const uint256 &nHash, CProposalVote &vote)
+{
+    return Read(std::make_pair(DB_VOTE, nHash), vote);
+}
+
+bool CProposalVoteDB::EraseVotes(const std::vector<uint256> &vecHashes)
+{
+    CDBBatch batch(*this);
+
+    for( const uint256 &nHash : vecHashes )
+        batch.Erase(std::make_pair(DB_VOTE, nHash));
+
+    return WriteBatch(batch);
+}
+
 CProposalVoteFile::CProposalVoteFile()
     : nMemoryVotes(0),
       listVotes(),
-      mapVoteIndex()
+      mapVoteIndex(),
+      mapDiskVotes()
 {}
 
 CProposalVoteFile::CProposalVoteFile(const CProposalVoteFile& other)
     : nMemoryVotes(other.nMemoryVotes),
       listVotes(other.listVotes),
-      mapVoteIndex()
+      mapVoteIndex(),
+      mapDiskVotes(other.mapDiskVotes)
 {
     RebuildIndex();
 }
@@ -24,32 +61,94 @@ void CProposalVoteFile::AddVote(const CProposalVote& vote)
     // make sure to never add/update already known votes
     if (HasVote(nHash))
         return;
+    ++nMemoryVotes;
+    if(pvotedb && pvotedb->WriteVotes(std::vector<CProposalVote>(1, vote))) {
+        mapDiskVotes.emplace(nHash, vote.GetVoteKey());
+        return;
+    }
     listVotes.push_front(vote);
     mapVoteIndex.emplace(nHash, listVotes.begin());
-    ++nMemoryVotes;
 }
 
 bool CProposalVoteFile::HasVote(const uint256& nHash) const
 {
-    return mapVoteIndex.find(nHash) != mapVoteIndex.end();
+    return mapVoteIndex.find(nHash) != mapVoteIndex.end() || mapDiskVotes.find(nHash) != mapDiskVotes.end();
+}
+
+bool CProposalVoteFile::ReadDiskVote(const uint256& nHash, CProposalVote& vote) const
+{
+    if(!pvotedb || mapDiskVotes.find(nHash) == mapDiskVotes.end()) {
+        return false;
+    }
+    if(!pvotedb->ReadVote(nHash, vote)) {
+        LogPrintf("CProposalVoteFile::%s -- vote %s missing in the vote database\n", __func__, nHash.ToString());
+        return false;
+    }
+    return true;
 }
 
 bool CProposalVoteFile::SerializeVoteToStream(const uint256& nHash, CDataStream& ss) const
 {
     vote_m_cit it = mapVoteIndex.find(nHash);
-    if(it == mapVoteIndex.end()) {
+    if(it != mapVoteIndex.end()) {
+        ss << *(it->second);
+        return true;
+    }
+    CProposalVote vote;
+    if(!ReadDiskVote(nHash, vote)) {
         return false;
     }
-    ss << *(it->second);
+    ss << vote;
     return true;
 }
 
 std::vector<CProposalVote> CProposalVoteFile::GetVotes() const
 {
     std::vector<CProposalVote> vecResult;
+    vecResult.reserve(nMemoryVotes);
     for(vote_l_cit it = listVotes.begin(); it != listVotes.end(); ++it) {
         vecResult.push_back(*it);
     }
+    CProposalVote vote;
+    for(const auto& diskVote : mapDiskVotes) {
+        if(ReadDiskVote(diskVote.first, vote)) {
+            vecResult.push_back(vote);
+        }
+    }
+    return vecResult;
+}
+
+std::vector<uint256> CProposalVoteFile::GetVoteHashes() const
+{
+    std::vector<uint256> vecResult;
+    vecResult.reserve(mapVoteIndex.size() + mapDiskVotes.size());
+    for(const auto& memoryVote : mapVoteIndex) {
+        vecResult.push_back(memoryVote.first);
+    }
+    for(const auto& diskVote : mapDiskVotes) {
+        vecResult.push_back(diskVote.first);
+    }
+    return vecResult;
+}
+
+std::vector<CProposalVote> CProposalVoteFile::GetVotesAfter(const uint256& nAfter, size_t nMax) const
+{
+    std::vector<CProposalVote> vecResult;
+    // Both indexes are ordered by hash already, no need for a sorted copy
+    vote_m_cit itMemory = mapVoteIndex.upper_bound(nAfter);
+    auto itDisk = mapDiskVotes.upper_bound(nAfter);
+    CProposalVote vote;
+    while(vecResult.size() < nMax && (itMemory != mapVoteIndex.end() || itDisk != mapDiskVotes.end())) {
+        if(itDisk == mapDiskVotes.end() || (itMemory != mapVoteIndex.end() && itMemory->first < itDisk->first)) {
+            vecResult.push_back(*(itMemory->second));
+            ++itMemory;
+        } else {
+            if(ReadDiskVote(itDisk->first, vote)) {
+                vecResult.push_back(vote);
+            }
+            ++itDisk;
+        }
+    }
     return vecResult;
 }
 
@@ -66,17 +165,59 @@ void CProposalVoteFile::RemoveVotesFromVotingKey(const CVoteKey &voteKey)
             ++it;
         }
     }
+
+    std::vector<uint256> vecErase;
+    auto itDisk = mapDiskVotes.begin();
+    while(itDisk != mapDiskVotes.end()) {
+        if(itDisk->second == voteKey) {
+            --nMemoryVotes;
+            vecErase.push_back(itDisk->first);
+            mapDiskVotes.erase(itDisk++);
+        }
+        else {
+            ++itDisk;
+        }
+    }
+
+    if(!vecErase.empty() && pvotedb) {
+        pvotedb->EraseVotes(vecErase);
+    }
+}
+
+void CProposalVoteFile::EraseVotes()
+{
+    if(mapDiskVotes.empty()) return;
+
+    std::vector<uint256> vecErase;
+    vecErase.reserve(mapDiskVotes.size());
+    for(const auto& diskVote : mapDiskVotes) {
+        vecErase.push_back(diskVote.first);
+    }
+
+    if(pvotedb) {
+        pvotedb->EraseVotes(vecErase);
+    }
+
+    nMemoryVotes -= mapDiskVotes.size();
+    mapDiskVotes.clear();
 }
 
 void CProposalVoteFile::RebuildIndex()
 {
     mapVoteIndex.clear();
     nMemoryVotes = 0;
+
+    // The votes on disk can't be read without the vote database, they get synced again
+    if(!pvotedb && !mapDiskVotes.empty()) {
+        LogPrintf("CProposalVoteFile::%s -- dropping %d votes without the vote database\n", __func__, mapDiskVotes.size());
+        mapDiskVotes.clear();
+    }
+
     vote_l_it it = listVotes.begin();
     while(it != listVotes.end()) {
         CProposalVote& vote = *it;
         uint256 nHash = vote.GetHash();
-        if(mapVoteIndex.find(nHash) == mapVoteIndex.end()) {
+        if(mapVoteIndex.find(nHash) == mapVoteIndex.end() && mapDiskVotes.find(nHash) == mapDiskVotes.end()) {
             mapVoteIndex[nHash] = it;
             ++nMemoryVotes;
             ++it;
@@ -85,4 +226,21 @@ void CProposalVoteFile::RebuildIndex()
             listVotes.erase(it++);
         }
     }
+
+    nMemoryVotes += mapDiskVotes.size();
+}
+
+void CProposalVoteFile::MoveToDisk()
+{
+    if(!pvotedb || listVotes.empty()) return;
+
+    std::vector<CProposalVote> vecVotes(listVotes.begin(), listVotes.end());
+    if(!pvotedb->WriteVotes(vecVotes)) return;
+
+    for(const CProposalVote& vote : vecVotes) {
+        mapDiskVotes.emplace(vote.GetHash(), vote.GetVoteKey());
+    }
+
+    listVotes.clear();
+    mapVoteIndex.clear();
 }
@@ -8,18 +8,43 @@
 #include <list>
 #include <map>
 
+#include "dbwrapper.h"
 #include "voting.h"
 #include "serialize.h"
 #include "streams.h"
 #include "uint256.h"
 
+class CProposalVoteDB;
+
+//! -votedb default
+static const bool DEFAULT_VOTE_DB = false;
+//! Cache of the vote database
+static const size_t VOTE_DB_CACHE = 8 << 20;
+
+/** Vote database, set with -votedb */
+extern CProposalVoteDB *pvotedb;
+
+/** Access to the proposal vote database (votes/), the votes by their hash */
+class CProposalVoteDB : public CDBWrapper
+{
+public:
+    CProposalVoteDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CProposalVoteDB(const CProposalVoteDB&);
+    void operator=(const CProposalVoteDB&);
+public:
+    bool WriteVotes(const std::vector<CProposalVote> &vecVotes);
+    bool ReadVote(const uint256 &nHash, CProposalVote &vote);
+    bool EraseVotes(const std::vector<uint256> &vecHashes);
+};
+
 /**
  * Represents the collection of votes associated with a given CProposal
- * Recently received votes are held in memory until a maximum size is reached after
- * which older votes a flushed to a disk file.
  *
- * Note: This is a stub implementation that doesn't limit the number of votes held
- * in memory and doesn't flush to disk.
+ * Without the vote database all votes are held in memory. With it the
+ * votes live in the database and only their hashes and vote keys stay in
+ * memory, the votes get read back when they are needed. The copies of a
+ * file share the votes in the database.
  */
 class CProposalVoteFile
 {
@@ -45,6 +70,9 @@ private:
 
     vote_m_t mapVoteIndex;
 
+    // The votes in pvotedb, vote key by vote hash
+    std::map<uint256, CVoteKey> mapDiskVotes;
+
 public:
     CProposalVoteFile();
 
@@ -61,18 +89,30 @@ public:
     bool HasVote(const uint256& nHash) const;
 
     /**
-     * Retrieve a vote cached in memory
+     * Retrieve a vote from memory or the vote database
      */
     bool SerializeVoteToStream(const uint256& nHash, CDataStream& ss) const;
 
-    int GetVoteCount() {
+    int GetVoteCount() const {
         return nMemoryVotes;
     }
 
     std::vector<CProposalVote> GetVotes() const;
 
+    std::vector<uint256> GetVoteHashes() const;
+
+    /**
+     * Up to nMax votes in the order of their hash, starting after nAfter
+     */
+    std::vector<CProposalVote> GetVotesAfter(const uint256& nAfter, size_t nMax) const;
+
     void RemoveVotesFromVotingKey(const CVoteKey &voteKey);
 
+    /**
+     * Drop all votes from the vote database, the proposal is gone
+     */
+    void EraseVotes();
+
     ADD_SERIALIZE_METHODS
 
     template <typename Stream, typename Operation>
@@ -80,13 +120,20 @@ public:
     {
         READWRITE(nMemoryVotes);
         READWRITE(listVotes);
+        READWRITE(mapDiskVotes);
         if(ser_action.ForRead()) {
             RebuildIndex();
+            MoveToDisk();
         }
     }
 private:
     void RebuildIndex();
 
+    /// Move the votes held in memory to the vote database
+    void MoveToDisk();
+
+    bool ReadDiskVote(const uint256& nHash, CProposalVote& vote) const;
+
 };
 
 #endif
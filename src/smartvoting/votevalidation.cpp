@@ -12,12 +12,147 @@
 #include "wallet/wallet.h"
 #include "txdb.h"
 
+#include <atomic>
+
+static const char DB_SNAPSHOT = 's';
+
+CVotingPowerDB *pvotingpowerdb = NULL;
+
 static CCriticalSection cs;
 
 static std::map<CVoteKey, CVotingPower> mapActiveVoteKeys;
+// Active vote keys by the address index key of their vote address
+static std::map<std::pair<unsigned int, uint160>, std::set<CVoteKey>> mapActiveAddresses;
+// Height of the last block AddressIndexUpdated applied to all valid voting powers
+static int nVotingPowerHeight = 0;
+static std::atomic<uint64_t> nVotingPowerVersion(0);
+// Balances written with the last snapshot, the next delta snapshot is made
+// against them. nLastSnapshotHeight is 0 if the next one has to be full.
+static std::map<CVoteKey, CAmount> mapLastSnapshot;
+static int nLastSnapshotHeight = 0;
+
+CVotingPowerValidationInterface votingPowerValidation;
 
 bool GetBalanceDelta(const CSmartAddress &address, int nStartBlock, int nEndBlock, CAmount &delta);
 
+CVotingPowerDB::CVotingPowerDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "votingpower", nCacheSize, fMemory, fWipe, false, CDBOptions(true))
+{
+}
+
+bool CVotingPowerDB::WriteSnapshot(const CVotingPowerSnapshot &snapshot)
+{
+    return Write(std::make_pair(DB_SNAPSHOT, snapshot.nHeight), snapshot);
+}
+
+bool CVotingPowerDB::ReadSnapshot(int nHeight, CVotingPowerSnapshot &snapshot)
+{
+    return Read(std::make_pair(DB_SNAPSHOT, nHeight), snapshot);
+}
+
+bool CVotingPowerDB::EraseSnapshot(int nHeight)
+{
+    return Erase(std::make_pair(DB_SNAPSHOT, nHeight));
+}
+
+static void WriteVotingPowerSnapshot(const CBlockIndex *pindex)
+{
+    AssertLockHeld(cs);
+
+    std::map<CVoteKey, CAmount> mapBalances;
+
+    for( const auto &it : mapActiveVoteKeys ){
+        if( it.second.IsValid() )
+            mapBalances.insert(std::make_pair(it.first, it.second.nPower));
+    }
+
+    CVotingPowerSnapshot snapshot;
+    snapshot.nHeight = pindex->nHeight;
+    snapshot.hashBlock = pindex->GetBlockHash();
+
+    bool fFull = nLastSnapshotHeight != pindex->nHeight - VOTING_POWER_SNAPSHOT_INTERVAL ||
+                 (pindex->nHeight / VOTING_POWER_SNAPSHOT_INTERVAL) % VOTING_POWER_FULL_SNAPSHOT_INTERVAL == 0;
+
+    if( fFull ){
+        snapshot.mapBalances = mapBalances;
+    }else{
+        snapshot.nBaseHeight = nLastSnapshotHeight;
+
+        for( const auto &it : mapBalances ){
+            auto itLast = mapLastSnapshot.find(it.first);
+            if( itLast == mapLastSnapshot.end() || itLast->second != it.second )
+                snapshot.mapBalances.insert(it);
+        }
+
+        for( const auto &it : mapLastSnapshot ){
+            if( !mapBalances.count(it.first) )
+                snapshot.setRemoved.insert(it.first);
+        }
+    }
+
+    if( !pvotingpowerdb->WriteSnapshot(snapshot) ){
+        LogPrintf("WriteVotingPowerSnapshot -- Failed to write the snapshot at %d\n", pindex->nHeight);
+        mapLastSnapshot.clear();
+        nLastSnapshotHeight = 0;
+        return;
+    }
+
+    mapLastSnapshot.swap(mapBalances);
+    nLastSnapshotHeight = pindex->nHeight;
+}
+
+/**
+ * Balance of the vote key in the snapshot at nSnapshotHeight, follows the
+ * delta chain down to the full snapshot. Fails if the key wasn't active there
+ * or a snapshot of the chain doesn't belong to the active chain anymore.
+ */
+static bool ReadSnapshotBalance(const CVoteKey &voteKey, int nSnapshotHeight, CAmount &nBalance)
+{
+    if( !pvotingpowerdb ) return false;
+
+    CVotingPowerSnapshot snapshot;
+
+    while( nSnapshotHeight > 0 ){
+
+        if( !pvotingpowerdb->ReadSnapshot(nSnapshotHeight, snapshot) ) return false;
+
+        {
+            LOCK(cs_main);
+            CBlockIndex *pindex = chainActive[nSnapshotHeight];
+            if( !pindex || pindex->GetBlockHash() != snapshot.hashBlock ) return false;
+        }
+
+        if( snapshot.setRemoved.count(voteKey) ) return false;
+
+        auto it = snapshot.mapBalances.find(voteKey);
+
+        if( it != snapshot.mapBalances.end() ){
+            nBalance = it->second;
+            return true;
+        }
+
+        nSnapshotHeight = snapshot.nBaseHeight;
+    }
+
+    return false;
+}
+
+/** Balance of the address after the block nHeight, starts from a snapshot of the vote key if there is one */
+static bool GetVoteKeyBalance(const CVoteKey &voteKey, const CSmartAddress &address, int nHeight, CAmount &nBalance)
+{
+    int nSnapshotHeight = nHeight - nHeight % VOTING_POWER_SNAPSHOT_INTERVAL;
+
+    nBalance = 0;
+
+    if( !ReadSnapshotBalance(voteKey, nSnapshotHeight, nBalance) ){
+        nBalance = 0;
+        return GetBalanceDelta(address, 0, nHeight, nBalance);
+    }
+
+    if( nSnapshotHeight == nHeight ) return true;
+
+    return GetBalanceDelta(address, nSnapshotHeight + 1, nHeight, nBalance);
+}
+
 void ThreadSmartVoting()
 {
     static bool fOneThread;
@@ -30,7 +165,8 @@ void ThreadSmartVoting()
     // Make this thread recognisable as the SmartVoting thread
     RenameThread("smartvoting");
 
-    // Check if we have some unparsed votekey registrations every block
+    // The voting power follows the blocks through votingPowerValidation,
+    // this only keeps the set of active vote keys up to date.
     int nLastChecked = 0;
 
     while (true)
@@ -92,51 +228,76 @@ void ThreadSmartVoting()
 
             }
 
+            if( !setActiveKeys.size() ) continue;
+
             LOCK(cs);
 
+            // Drop the addresses we don't validate anymore
             for (auto it = mapActiveVoteKeys.begin(); it != mapActiveVoteKeys.end();){
 
-                // Check if the address we validate is not longer active
-                if( setActiveKeys.size() && !setActiveKeys.count(it->first) ){
-                    it = mapActiveVoteKeys.erase(it);
+                if( setActiveKeys.count(it->first) ){
+                    ++it;
                     continue;
                 }
 
-                int nStart = 0;
+                uint160 hashBytes;
+                int type = 0;
 
-                if( it->second.IsValid() ){
-
-                    if( it->second.nBlockHeight < nHeight ){
-                        nStart = it->second.nBlockHeight + 1;
-                    }else{
-                        ++it;
-                        continue;
+                if( it->second.address.GetIndexKey(hashBytes, type) ){
+                    auto itAddress = mapActiveAddresses.find(std::make_pair((unsigned int)type, hashBytes));
+                    if( itAddress != mapActiveAddresses.end() ){
+                        itAddress->second.erase(it->first);
+                        if( itAddress->second.empty() )
+                            mapActiveAddresses.erase(itAddress);
                     }
-
                 }
 
-                if( nHeight < nValidationConfirmations ){
-                    ++it;
-                    continue;
-                }
+                if( it->second.IsValid() )
+                    ++nVotingPowerVersion;
 
-                if( ( nHeight - nStart ) < nValidationConfirmations ){
-                    ++it;
-                    continue;
-                }
+                it = mapActiveVoteKeys.erase(it);
+            }
+        }
+    }
+}
 
-                CAmount nDelta = 0;
+void CVotingPowerValidationInterface::AddressIndexUpdated(const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vecEntries, bool fConnected)
+{
+    LOCK(cs);
 
-                if( GetBalanceDelta(it->second.address, nStart, nHeight, nDelta) ){
-                    it->second.nPower += nDelta;
-                    it->second.nBlockHeight = nHeight;
-                }
+    // Disconnected blocks leave the power as it was before them
+    nVotingPowerHeight = fConnected ? pindex->nHeight : pindex->nHeight - 1;
 
-                ++it;
+    for( const std::pair<CAddressIndexKey, CAmount> &entry : vecEntries ){
 
-            }
+        if( mapActiveAddresses.empty() ) break;
+
+
+        auto itAddress = mapActiveAddresses.find(std::make_pair(entry.first.type, entry.first.hashBytes));
+
+        if( itAddress == mapActiveAddresses.end() ) continue;
+
+        for( const CVoteKey &voteKey : itAddress->second ){
+
+            auto it = mapActiveVoteKeys.find(voteKey);
+
+            if( it == mapActiveVoteKeys.end() || !it->second.IsValid() ) continue;
+
+            it->second.nPower += fConnected ? entry.second : -entry.second;
+            ++nVotingPowerVersion;
         }
     }
+
+    if( !pvotingpowerdb || pindex->nHeight % VOTING_POWER_SNAPSHOT_INTERVAL ) return;
+
+    if( fConnected ){
+        WriteVotingPowerSnapshot(pindex);
+    }else{
+        // The snapshot belongs to the disconnected block, the next one has to be full
+        pvotingpowerdb->EraseSnapshot(pindex->nHeight);
+        mapLastSnapshot.clear();
+        nLastSnapshotHeight = 0;
+    }
 }
 
 bool GetBalanceDelta(const CSmartAddress &address, int nStartBlock, int nEndBlock, CAmount &delta)
@@ -168,6 +329,7 @@ void GetVotingPower(const CVoteKey &voteKey, CVotingPower &votingPower)
     if( it != mapActiveVoteKeys.end() && it->second.IsValid() ){
         votingPower = it->second;
         votingPower.nPower /= COIN;
+        votingPower.nBlockHeight = std::max(votingPower.nBlockHeight, nVotingPowerHeight);
     }else{
         votingPower.SetNull();
     }
@@ -191,11 +353,63 @@ int64_t GetVotingPower(const CVoteKey &voteKey)
 
 void AddActiveVoteKey(const CVoteKey &voteKey)
 {
-    LOCK(cs);
+    {
+        LOCK(cs);
+        if( mapActiveVoteKeys.count(voteKey) ) return;
+    }
+
+    CVoteKeyValue voteKeyValue;
+    if( !GetVoteKeyValue(voteKey, voteKeyValue) ) return;
+
+    CVotingPower votingPower(voteKeyValue.voteAddress);
+    uint160 hashBytes;
+    int type = 0;
+
+    if( !votingPower.address.GetIndexKey(hashBytes, type) ) return;
+
+    // cs_main keeps blocks from getting connected between reading the balance
+    // and the key becoming visible to AddressIndexUpdated
+    LOCK2(cs_main, cs);
+
+    if( mapActiveVoteKeys.count(voteKey) ) return;
+
+    int nHeight = chainActive.Height();
+
+    // Wait for enough blocks, AddressIndexUpdated only changes valid ones
+    if( nHeight >= nValidationConfirmations ){
+        CAmount nBalance = 0;
+        if( GetVoteKeyBalance(voteKey, votingPower.address, nHeight, nBalance) ){
+            votingPower.nPower = nBalance;
+            votingPower.nBlockHeight = nHeight;
+        }
+    }
+
+    mapActiveVoteKeys.insert(std::make_pair(voteKey, votingPower));
+    mapActiveAddresses[std::make_pair((unsigned int)type, hashBytes)].insert(voteKey);
+
+    if( votingPower.IsValid() )
+        ++nVotingPowerVersion;
+}
+
+uint64_t GetVotingPowerVersion()
+{
+    return nVotingPowerVersion.load();
+}
 
-    if( !mapActiveVoteKeys.count(voteKey) ){
-        CVoteKeyValue voteKeyValue;
-        if(GetVoteKeyValue(voteKey, voteKeyValue) )
-            mapActiveVoteKeys.insert(std::make_pair(voteKey, CVotingPower(voteKeyValue.voteAddress)));
+bool GetVotingPowerAt(const CVoteKey &voteKey, int nHeight, int64_t &nPower)
+{
+    CVoteKeyValue voteKeyValue;
+    if( !GetVoteKeyValue(voteKey, voteKeyValue) ) return false;
+
+    {
+        LOCK(cs_main);
+        if( nHeight < 0 || nHeight > chainActive.Height() ) return false;
     }
+
+    CAmount nBalance = 0;
+    if( !GetVoteKeyBalance(voteKey, voteKeyValue.voteAddress, nHeight, nBalance) ) return false;
+
+    nPower = nBalance > 0 ? nBalance / COIN : nBalance;
+
+    return true;
 }
@@ -7,19 +7,31 @@
 
 #include <list>
 #include <map>
+#include <set>
 
+#include "dbwrapper.h"
 #include "smarthive/hive.h"
 #include "voting.h"
 #include "serialize.h"
 #include "streams.h"
 #include "uint256.h"
+#include "validationinterface.h"
 
-// Update all vote's voting power every nValidationConfirmations blocks
+// Blocks the chain needs before the voting power gets calculated
 static const int nValidationConfirmations = 6;
 // Check unparsed registrations every x seconds and remove them after n tries
 static const int nRegistrationCheckInterval = 2;
 static const int nRegistrationCheckMaxTries = 40;
 
+//! -votingpowersnapshots default
+static const bool DEFAULT_VOTING_POWER_SNAPSHOTS = true;
+//! Blocks between two voting power snapshots
+static const int VOTING_POWER_SNAPSHOT_INTERVAL = 1000;
+//! Every nth snapshot is a full one, this limits the length of the delta chains
+static const int VOTING_POWER_FULL_SNAPSHOT_INTERVAL = 10;
+//! Cache of the voting power database
+static const size_t VOTING_POWER_DB_CACHE = 2 << 20;
+
 struct CVotingPower{
     int nBlockHeight;
     int64_t nPower;
@@ -36,9 +48,79 @@ struct CVotingPower{
     }
 };
 
+/**
+ * Balances of the valid active vote keys after the block nHeight. A full
+ * snapshot (nBaseHeight 0) holds all of them, a delta snapshot only the keys
+ * which changed or became active since the snapshot at nBaseHeight and the
+ * keys which are not active anymore.
+ */
+struct CVotingPowerSnapshot
+{
+    int nHeight;
+    uint256 hashBlock;
+    int nBaseHeight;
+    std::map<CVoteKey, CAmount> mapBalances;
+    std::set<CVoteKey> setRemoved;
+
+    CVotingPowerSnapshot() : nHeight(0), hashBlock(), nBaseHeight(0) {}
+
+    bool IsFull() const { return nBaseHeight == 0; }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+        READWRITE(nBaseHeight);
+        READWRITE(mapBalances);
+        READWRITE(setRemoved);
+    }
+};
+
+class CVotingPowerDB;
+
+/** Voting power snapshots, set with -votingpowersnapshots */
+extern CVotingPowerDB *pvotingpowerdb;
+
+/** Access to the voting power database (votingpower/), the snapshots by height */
+class CVotingPowerDB : public CDBWrapper
+{
+public:
+    CVotingPowerDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+private:
+    CVotingPowerDB(const CVotingPowerDB&);
+    void operator=(const CVotingPowerDB&);
+public:
+    bool WriteSnapshot(const CVotingPowerSnapshot &snapshot);
+    bool ReadSnapshot(int nHeight, CVotingPowerSnapshot &snapshot);
+    bool EraseSnapshot(int nHeight);
+};
+
+/**
+ * Keeps the voting power of the active vote keys up to date with the address
+ * index entries of every connected or disconnected block, a new key gets its
+ * balance read once when it becomes active.
+ */
+class CVotingPowerValidationInterface : public CValidationInterface
+{
+protected:
+    void AddressIndexUpdated(const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vecEntries, bool fConnected) override;
+};
+
+extern CVotingPowerValidationInterface votingPowerValidation;
+
 void ThreadSmartVoting();
 void AddActiveVoteKey(const CVoteKey &voteKey);
 void GetVotingPower(const CVoteKey &voteKey, CVotingPower &votingPower);
 int64_t GetVotingPower(const CVoteKey &voteKey);
+/// Changes whenever the voting power of any active vote key changed
+uint64_t GetVotingPowerVersion();
+/**
+ * Voting power of the key after the block nHeight of the active chain. Starts
+ * from the last snapshot at or below nHeight and only reads the address index
+ * from there on, without a snapshot of the key it reads it from the genesis.
+ */
+bool GetVotingPowerAt(const CVoteKey &voteKey, int nHeight, int64_t &nPower);
 
 #endif
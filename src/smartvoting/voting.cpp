@@ -168,10 +168,25 @@ bool CProposalVote::Sign(const CVoteKeySecret& voteKeySecret)
     return true;
 }
 
+// Votes which signatures verified, by the hash of the vote hash and the signature. The vote
+// hash doesn't cover the signature, a copy of the vote with another signature must not pass.
+static const size_t MAX_VERIFIED_VOTE_SIGNATURES = 100000;
+static CCriticalSection cs_setVerifiedVoteSignatures;
+static std::set<uint256> setVerifiedVoteSignatures;
+
 bool CProposalVote::CheckSignature() const
 {
     std::string strError;
 
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << GetHash() << vchSig;
+    uint256 nVerifiedHash = ss.GetHash();
+
+    {
+        LOCK(cs_setVerifiedVoteSignatures);
+        if(setVerifiedVoteSignatures.count(nVerifiedHash)) return true;
+    }
+
     uint256 hash = GetSignatureHash();
     CKeyID keyId;
 
@@ -180,6 +195,10 @@ bool CProposalVote::CheckSignature() const
         return false;
     }
 
+    LOCK(cs_setVerifiedVoteSignatures);
+    if(setVerifiedVoteSignatures.size() >= MAX_VERIFIED_VOTE_SIGNATURES) setVerifiedVoteSignatures.clear();
+    setVerifiedVoteSignatures.insert(nVerifiedHash);
+
     return true;
 }
 
@@ -216,6 +235,7 @@ bool CProposalVote::IsValid(bool fSignatureCheck, bool fRegistrationCheck, std::
     if(!CheckSignature() ){
         strError = "Signature check failed";
         LogPrint("proposal", (strError + "\n").c_str());
+        return false;
     }
 
     return true;
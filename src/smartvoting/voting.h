@@ -9,6 +9,7 @@
 #include "base58.h"
 #include "net.h"
 #include "key.h"
+#include "memusage.h"
 #include "primitives/transaction.h"
 #include "univalue.h"
 
@@ -93,6 +94,8 @@ public:
 
     bool Sign(const CVoteKeySecret& voteKeySecret);
     bool CheckSignature() const;
+    /// Check the signature off the locks, CheckSignature only looks the result up then
+    void PreVerifySignature() const { CheckSignature(); }
     bool IsValid(bool fSignatureCheck, bool fRegistrationCheck, std::string &strError) const;
     void Relay(CConnman& connman) const;
 
@@ -113,6 +116,8 @@ public:
 
     std::string ToString() const;
 
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vchSig); }
+
     ADD_SERIALIZE_METHODS
 
     template <typename Stream, typename Operation>
@@ -144,6 +149,15 @@ struct CVoteOutcomes{
     }
 
     int64_t GetTotalPower() { return nYesPower+nNoPower+nAbstainPower; }
+
+    void Add(vote_outcome_enum_t eOutcome, int64_t nPower) {
+        switch(eOutcome){
+        case VOTE_OUTCOME_YES: nYesPower += nPower; break;
+        case VOTE_OUTCOME_NO: nNoPower += nPower; break;
+        case VOTE_OUTCOME_ABSTAIN: nAbstainPower += nPower; break;
+        case VOTE_OUTCOME_NONE: break;
+        }
+    }
 };
 
 
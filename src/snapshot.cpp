@@ -0,0 +1,356 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "coins.h"
+#include "hash.h"
+#include "init.h"
+#include "smartrewards/rewards.h"
+#include "streams.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include <memory>
+
+#include <boost/filesystem.hpp>
+
+std::string CSnapshotSectionInfo::GetName() const
+{
+    switch (nSection) {
+    case SNAPSHOT_COINS:
+        return "coins";
+    case SNAPSHOT_REWARDS:
+        return "rewards";
+    case SNAPSHOT_VOTEKEYS:
+        return "votekeys";
+    }
+    return "unknown";
+}
+
+//! The snapshot hash covers the header and everything the sections sum up to
+static uint256 GetSnapshotHash(const CSnapshotInfo& info)
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << info.header;
+    for (const CSnapshotSectionInfo& section : info.vSections) {
+        ss << section.nSection << section.nHeight << section.nEntries << section.hash;
+    }
+    return ss.GetHash();
+}
+
+namespace {
+
+/** Writes the entries of one section in hashed chunks. */
+class CSnapshotSectionWriter
+{
+    CAutoFile& file;
+    CSnapshotSectionInfo& section;
+    CDataStream ssChunk;
+    uint32_t nChunkEntries;
+    CHashWriter hashChunks;
+
+    void WriteChunk()
+    {
+        file << nChunkEntries;
+        WriteCompactSize(file, ssChunk.size());
+        file.write(ssChunk.data(), ssChunk.size());
+        uint256 hashChunk = Hash(ssChunk.begin(), ssChunk.end());
+        file << hashChunk;
+        hashChunks << hashChunk;
+
+        section.nEntries += nChunkEntries;
+        section.nChunks++;
+        ssChunk.clear();
+        nChunkEntries = 0;
+    }
+
+public:
+    CSnapshotSectionWriter(CAutoFile& fileIn, CSnapshotSectionInfo& sectionIn)
+        : file(fileIn), section(sectionIn), ssChunk(SER_DISK, CLIENT_VERSION), nChunkEntries(0), hashChunks(SER_GETHASH, PROTOCOL_VERSION)
+    {
+        file << section.nSection << section.nHeight;
+    }
+
+    template <typename K, typename V>
+    bool Add(const K& key, const V& value)
+    {
+        ssChunk << key << value;
+        if (++nChunkEntries == SNAPSHOT_CHUNK_ENTRIES) {
+            WriteChunk();
+            return !ShutdownRequested();
+        }
+        return true;
+    }
+
+    void Finish()
+    {
+        if (nChunkEntries > 0)
+            WriteChunk();
+        section.hash = hashChunks.GetHash();
+        file << uint32_t(0) << section.nEntries << section.hash;
+    }
+};
+
+}
+
+static bool WriteCoins(CAutoFile& file, CCoinsViewCursor& cursor, CSnapshotInfo& info, std::string& strError)
+{
+    info.vSections.push_back(CSnapshotSectionInfo(SNAPSHOT_COINS, info.header.nHeight));
+    CSnapshotSectionWriter writer(file, info.vSections.back());
+
+    while (cursor.Valid()) {
+        COutPoint outpoint;
+        Coin coin;
+        if (!cursor.GetKey(outpoint) || !cursor.GetValue(coin)) {
+            strError = "Unable to read the chainstate";
+            return false;
+        }
+        info.nTotalAmount += coin.out.nValue;
+        if (!writer.Add(outpoint, coin)) {
+            strError = "Shutting down";
+            return false;
+        }
+        cursor.Next();
+    }
+
+    writer.Finish();
+    return true;
+}
+
+static bool WriteRewards(CAutoFile& file, CDBIterator& it, int nHeight, CSnapshotInfo& info, std::string& strError)
+{
+    info.vSections.push_back(CSnapshotSectionInfo(SNAPSHOT_REWARDS, nHeight));
+    CSnapshotSectionWriter writer(file, info.vSections.back());
+    std::vector<unsigned char> vchKey, vchValue;
+
+    for (; it.Valid(); it.Next()) {
+        it.GetRaw(vchKey, vchValue);
+        if (!writer.Add(vchKey, vchValue)) {
+            strError = "Shutting down";
+            return false;
+        }
+    }
+
+    writer.Finish();
+    return true;
+}
+
+static bool WriteVoteKeys(CAutoFile& file, CDBIterator& it, CSnapshotInfo& info, std::string& strError)
+{
+    info.vSections.push_back(CSnapshotSectionInfo(SNAPSHOT_VOTEKEYS, info.header.nHeight));
+    CSnapshotSectionWriter writer(file, info.vSections.back());
+    bool fOk = true;
+
+    pblocktree->ForEachVoteKeyEntry(it, [&writer, &fOk](const std::vector<unsigned char>& vchKey, const std::vector<unsigned char>& vchValue) {
+        if (fOk && !writer.Add(vchKey, vchValue))
+            fOk = false;
+    });
+    if (!fOk) {
+        strError = "Shutting down";
+        return false;
+    }
+
+    writer.Finish();
+    return true;
+}
+
+bool DumpSnapshot(const boost::filesystem::path& path, bool fRewards, bool fVoteKeys, CSnapshotInfo& info, std::string& strError)
+{
+    if (boost::filesystem::exists(path)) {
+        strError = path.string() + " already exists";
+        return false;
+    }
+    if (fRewards && !prewards) {
+        strError = "The SmartRewards database is not available";
+        return false;
+    }
+
+    info = CSnapshotInfo();
+    std::unique_ptr<CCoinsViewCursor> pcoins;
+    std::unique_ptr<CDBIterator> pvotekeys;
+    std::unique_ptr<CDBIterator> prewardsdb;
+    CSmartRewardBlock rewardsBlock;
+
+    {
+        // The iterators see the databases as they are now, the chainstate on
+        // disk has to be at the tip for that
+        LOCK(cs_main);
+        FlushStateToDisk();
+
+        pcoins.reset(pcoinsdbview->Cursor());
+        info.header.hashBlock = pcoins->GetBestBlock();
+        BlockMap::const_iterator it = mapBlockIndex.find(info.header.hashBlock);
+        if (it == mapBlockIndex.end()) {
+            strError = "The best block of the chainstate is unknown";
+            return false;
+        }
+        info.header.nHeight = it->second->nHeight;
+
+        if (fVoteKeys)
+            pvotekeys.reset(pblocktree->IndexDB().NewIterator());
+    }
+
+    // The rewards get written in the background, they are at a height of their own
+    if (fRewards)
+        prewardsdb.reset(prewards->NewDatabaseIterator(rewardsBlock));
+
+    boost::filesystem::path pathTemp = path;
+    pathTemp += ".incomplete";
+    FILE* pfile = fopen(pathTemp.string().c_str(), "wb");
+    CAutoFile file(pfile, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = "Unable to open " + pathTemp.string() + " for writing";
+        return false;
+    }
+
+    bool fOk = false;
+    try {
+        file << info.header;
+        fOk = WriteCoins(file, *pcoins, info, strError) &&
+              (!fRewards || WriteRewards(file, *prewardsdb, rewardsBlock.nHeight, info, strError)) &&
+              (!fVoteKeys || WriteVoteKeys(file, *pvotekeys, info, strError));
+        if (fOk) {
+            info.hash = GetSnapshotHash(info);
+            file << (unsigned char)SNAPSHOT_END << info.hash;
+            FileCommit(file.Get());
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("Writing the snapshot failed: %s", e.what());
+        fOk = false;
+    }
+    file.fclose();
+
+    if (fOk && !RenameOver(pathTemp, path)) {
+        strError = "Unable to rename " + pathTemp.string();
+        fOk = false;
+    }
+    if (!fOk) {
+        boost::filesystem::remove(pathTemp);
+        return false;
+    }
+
+    LogPrintf("%s: %s at height %d, %u coins, hash %s\n", __func__, path.string(), info.header.nHeight,
+              info.vSections[0].nEntries, info.hash.ToString());
+    return true;
+}
+
+//! Check the entries of a chunk, they have to be exactly nEntries of the section's types
+static bool ReadChunkEntries(CDataStream& ss, unsigned char nSection, uint32_t nEntries, CSnapshotInfo& info)
+{
+    for (uint32_t i = 0; i < nEntries; i++) {
+        if (nSection == SNAPSHOT_COINS) {
+            COutPoint outpoint;
+            Coin coin;
+            ss >> outpoint >> coin;
+            if (coin.IsSpent())
+                return false;
+            info.nTotalAmount += coin.out.nValue;
+        } else {
+            std::vector<unsigned char> vchKey, vchValue;
+            ss >> vchKey >> vchValue;
+            if (vchKey.empty())
+                return false;
+        }
+    }
+    return ss.empty();
+}
+
+bool VerifySnapshot(const boost::filesystem::path& path, CSnapshotInfo& info, std::string& strError)
+{
+    info = CSnapshotInfo();
+
+    FILE* pfile = fopen(path.string().c_str(), "rb");
+    CAutoFile file(pfile, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = "Unable to open " + path.string();
+        return false;
+    }
+
+    try {
+        file >> info.header;
+        if (info.header.nMagic != SNAPSHOT_MAGIC || info.header.nVersion != SNAPSHOT_VERSION) {
+            strError = "Not a snapshot file of a supported version";
+            return false;
+        }
+
+        while (true) {
+            unsigned char nSection;
+            file >> nSection;
+            if (nSection == SNAPSHOT_END)
+                break;
+            if (nSection > SNAPSHOT_VOTEKEYS) {
+                strError = strprintf("Unknown section %d", nSection);
+                return false;
+            }
+
+            CSnapshotSectionInfo section(nSection, -1);
+            file >> section.nHeight;
+            CHashWriter hashChunks(SER_GETHASH, PROTOCOL_VERSION);
+
+            while (true) {
+                if (ShutdownRequested()) {
+                    strError = "Shutting down";
+                    return false;
+                }
+
+                uint32_t nEntries;
+                file >> nEntries;
+                if (nEntries == 0)
+                    break;
+
+                std::vector<char> vchChunk(ReadCompactSize(file));
+                uint256 hashChunk;
+                if (!vchChunk.empty())
+                    file.read(vchChunk.data(), vchChunk.size());
+                file >> hashChunk;
+                if (hashChunk != Hash(vchChunk.begin(), vchChunk.end())) {
+                    strError = strprintf("Chunk %u of the %s section is corrupted", section.nChunks, section.GetName());
+                    return false;
+                }
+
+                CDataStream ss(vchChunk.data(), vchChunk.data() + vchChunk.size(), SER_DISK, CLIENT_VERSION);
+                if (!ReadChunkEntries(ss, nSection, nEntries, info)) {
+                    strError = strprintf("Chunk %u of the %s section has invalid entries", section.nChunks, section.GetName());
+                    return false;
+                }
+
+                hashChunks << hashChunk;
+                section.nEntries += nEntries;
+                section.nChunks++;
+            }
+
+            uint64_t nEntries;
+            uint256 hashSection;
+            file >> nEntries >> hashSection;
+            section.hash = hashChunks.GetHash();
+            if (nEntries != section.nEntries || hashSection != section.hash) {
+                strError = strprintf("The %s section is incomplete", section.GetName());
+                return false;
+            }
+            info.vSections.push_back(section);
+        }
+
+        uint256 hashSnapshot;
+        file >> hashSnapshot;
+        info.hash = GetSnapshotHash(info);
+        if (hashSnapshot != info.hash) {
+            strError = "The snapshot hash doesn't match";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("Reading the snapshot failed: %s", e.what());
+        return false;
+    }
+
+    if (info.vSections.empty() || info.vSections[0].nSection != SNAPSHOT_COINS) {
+        strError = "The snapshot has no coins";
+        return false;
+    }
+
+    return true;
+}
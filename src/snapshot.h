@@ -0,0 +1,96 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_SNAPSHOT_H
+#define SMARTCASH_SNAPSHOT_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+//! Sections of a snapshot file
+enum SnapshotSection {
+    SNAPSHOT_END = 0,
+    //! The chainstate, outpoints with their coins
+    SNAPSHOT_COINS = 1,
+    //! The SmartRewards database, raw entries
+    SNAPSHOT_REWARDS = 2,
+    //! The vote key index, raw entries
+    SNAPSHOT_VOTEKEYS = 3,
+};
+
+static const uint32_t SNAPSHOT_MAGIC = 0x50414e53; // "SNAP"
+static const uint32_t SNAPSHOT_VERSION = 1;
+//! Entries hashed and written as one chunk
+static const uint32_t SNAPSHOT_CHUNK_ENTRIES = 50000;
+
+/** What a snapshot file starts with, the block the chainstate in it is at. */
+struct CSnapshotHeader
+{
+    uint32_t nMagic;
+    uint32_t nVersion;
+    uint256 hashBlock;
+    int32_t nHeight;
+
+    CSnapshotHeader() : nMagic(SNAPSHOT_MAGIC), nVersion(SNAPSHOT_VERSION), nHeight(-1) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersionIn) {
+        READWRITE(nMagic);
+        READWRITE(nVersion);
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+    }
+};
+
+/**
+ * One section of a snapshot. The entries follow in chunks, each with the
+ * hash of its data, the section hash is the hash of the chunk hashes.
+ */
+struct CSnapshotSectionInfo
+{
+    unsigned char nSection;
+    //! Height the section's database was at, it may lag behind the chainstate
+    int32_t nHeight;
+    uint64_t nEntries;
+    uint32_t nChunks;
+    uint256 hash;
+
+    CSnapshotSectionInfo() : nSection(SNAPSHOT_END), nHeight(-1), nEntries(0), nChunks(0) {}
+    CSnapshotSectionInfo(unsigned char nSectionIn, int nHeightIn) : nSection(nSectionIn), nHeight(nHeightIn), nEntries(0), nChunks(0) {}
+
+    std::string GetName() const;
+};
+
+struct CSnapshotInfo
+{
+    CSnapshotHeader header;
+    std::vector<CSnapshotSectionInfo> vSections;
+    //! Hash of the header and the section hashes, identifies the snapshot
+    uint256 hash;
+    //! Sum of the coin values
+    int64_t nTotalAmount;
+
+    CSnapshotInfo() : nTotalAmount(0) {}
+};
+
+/**
+ * Write the chainstate at the current tip to path, along with the SmartRewards
+ * database and the vote key index if requested. The databases are read from
+ * leveldb snapshots taken with cs_main held, the node keeps running meanwhile.
+ * The file gets written under a temporary name and is renamed once complete.
+ */
+bool DumpSnapshot(const boost::filesystem::path& path, bool fRewards, bool fVoteKeys, CSnapshotInfo& info, std::string& strError);
+
+/** Read a snapshot file and check the hashes of all its chunks and sections. */
+bool VerifySnapshot(const boost::filesystem::path& path, CSnapshotInfo& info, std::string& strError);
+
+#endif // SMARTCASH_SNAPSHOT_H
@@ -11,6 +11,9 @@
 #include "script/script.h"
 #include "smarthive/hive.h"
 
+#include <limits>
+#include <vector>
+
 struct CSpentIndexKey {
     uint256 txid;
     unsigned int outputIndex;
@@ -247,6 +250,108 @@ struct CAddressUnspentValue {
     }
 };
 
+/** Key of the amount ordered copy of the address unspent index, the value is the same. */
+struct CAddressUnspentAmountKey {
+    unsigned int type;
+    uint160 hashBytes;
+    CAmount satoshis;
+    int nBlockHeight;
+    uint256 txhash;
+    size_t index;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 69;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, (uint64_t)satoshis >> 32);
+        ser_writedata32be(s, (uint64_t)satoshis & 0xffffffff);
+        ser_writedata32be(s, nBlockHeight);
+        txhash.Serialize(s, nType, nVersion);
+        ser_writedata32(s, index);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        uint64_t nHigh = ser_readdata32be(s);
+        satoshis = (CAmount)(nHigh << 32 | ser_readdata32be(s));
+        nBlockHeight = ser_readdata32be(s);
+        txhash.Unserialize(s, nType, nVersion);
+        index = ser_readdata32(s);
+    }
+
+    CAddressUnspentAmountKey(const CAddressUnspentKey &key, CAmount sats) {
+        type = key.type;
+        hashBytes = key.hashBytes;
+        satoshis = sats;
+        nBlockHeight = key.nBlockHeight;
+        txhash = key.txhash;
+        index = key.index;
+    }
+
+    CAddressUnspentAmountKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        type = 0;
+        hashBytes.SetNull();
+        satoshis = 0;
+        nBlockHeight = -1;
+        txhash.SetNull();
+        index = 0;
+    }
+
+    bool IsNull() const { return hashBytes.IsNull(); }
+
+    CAddressUnspentKey GetUnspentKey() const {
+        return CAddressUnspentKey(type, hashBytes, txhash, index, nBlockHeight);
+    }
+};
+
+struct CAddressUnspentAmountIteratorKey {
+    unsigned int type;
+    uint160 hashBytes;
+    CAmount satoshis;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 29;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, (uint64_t)satoshis >> 32);
+        ser_writedata32be(s, (uint64_t)satoshis & 0xffffffff);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        uint64_t nHigh = ser_readdata32be(s);
+        satoshis = (CAmount)(nHigh << 32 | ser_readdata32be(s));
+    }
+
+    CAddressUnspentAmountIteratorKey(unsigned int addressType, uint160 addressHash, CAmount sats) {
+        type = addressType;
+        hashBytes = addressHash;
+        satoshis = sats;
+    }
+
+    CAddressUnspentAmountIteratorKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        type = 0;
+        hashBytes.SetNull();
+        satoshis = 0;
+    }
+};
+
 struct CAddressIndexKey {
     unsigned int type;
     uint160 hashBytes;
@@ -382,6 +487,113 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** Address index key as stored, the address replaced by its id and the
+ *  transaction by its position in the chain, see CAddressIndexTxKey. Ordered
+ *  like CAddressIndexKey within an address. */
+struct CAddressIndexCompactKey {
+    uint32_t addressId;
+    int blockHeight;
+    unsigned int txindex;
+    unsigned int index;
+    bool spending;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 17;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata32be(s, addressId);
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+        ser_writedata32(s, index);
+        char f = spending;
+        ser_writedata8(s, f);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        addressId = ser_readdata32be(s);
+        blockHeight = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+        index = ser_readdata32(s);
+        char f = ser_readdata8(s);
+        spending = f;
+    }
+
+    CAddressIndexCompactKey(uint32_t nAddressId, const CAddressIndexKey &key) {
+        addressId = nAddressId;
+        blockHeight = key.blockHeight;
+        txindex = key.txindex;
+        index = key.index;
+        spending = key.spending;
+    }
+
+    CAddressIndexCompactKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        addressId = 0;
+        blockHeight = 0;
+        txindex = 0;
+        index = 0;
+        spending = false;
+    }
+
+    CAddressIndexKey GetKey(const CAddressIndexIteratorKey &address, const uint256 &txhash) const {
+        return CAddressIndexKey(address.type, address.hashBytes, blockHeight, txindex, txhash, index, spending);
+    }
+};
+
+/** Prefix of the compact address index entries of an address, from a height on if fHeight is set. */
+struct CAddressIndexCompactIteratorKey {
+    uint32_t addressId;
+    bool fHeight;
+    int blockHeight;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return fHeight ? 8 : 4;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata32be(s, addressId);
+        if (fHeight)
+            ser_writedata32be(s, blockHeight);
+    }
+
+    CAddressIndexCompactIteratorKey(uint32_t nAddressId) : addressId(nAddressId), fHeight(false), blockHeight(0) {}
+    CAddressIndexCompactIteratorKey(uint32_t nAddressId, int height) : addressId(nAddressId), fHeight(true), blockHeight(height) {}
+};
+
+/** Position of a transaction in the chain, the compact address index keeps its hash only once under it. */
+struct CAddressIndexTxKey {
+    int blockHeight;
+    unsigned int txindex;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 8;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        blockHeight = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+    }
+
+    CAddressIndexTxKey(int height, unsigned int blockindex) : blockHeight(height), txindex(blockindex) {}
+    CAddressIndexTxKey() : blockHeight(0), txindex(0) {}
+
+    bool operator==(const CAddressIndexTxKey &other) const {
+        return blockHeight == other.blockHeight && txindex == other.txindex;
+    }
+    bool operator!=(const CAddressIndexTxKey &other) const {
+        return !(*this == other);
+    }
+};
+
 struct CAddressListEntry {
     unsigned int type;
     uint160 hashBytes;
@@ -409,6 +621,116 @@ struct CAddressListEntry {
     bool IsNull(){ return hashBytes.IsNull(); }
 };
 
+/** Running totals of an address, stored under its CAddressIndexIteratorKey with -balanceindex. */
+struct CAddressBalanceValue {
+    CAmount balance;
+    CAmount received;
+    CAmount sent;
+    int64_t txCount;
+    int firstHeight;
+    int lastHeight;
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(sent);
+        READWRITE(txCount);
+        READWRITE(firstHeight);
+        READWRITE(lastHeight);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        sent = 0;
+        txCount = 0;
+        firstHeight = -1;
+        lastHeight = -1;
+    }
+
+    bool IsNull() const {
+        return txCount == 0;
+    }
+};
+
+/** Key of an address in the rich list of the balance index, ordered by balance from the largest down. */
+struct CAddressRichListKey {
+    CAmount balance;
+    unsigned int type;
+    uint160 hashBytes;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 29;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata64be(s, std::numeric_limits<uint64_t>::max() - (uint64_t)balance);
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        balance = (CAmount)(std::numeric_limits<uint64_t>::max() - ser_readdata64be(s));
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+    }
+
+    CAddressRichListKey(CAmount nBalance, unsigned int addressType, uint160 addressHash) {
+        balance = nBalance;
+        type = addressType;
+        hashBytes = addressHash;
+    }
+
+    CAddressRichListKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        type = 0;
+        hashBytes.SetNull();
+    }
+};
+
+/** Key of the balance changes of all addresses in one block, kept along with the balance index. */
+struct CAddressBalanceDeltaKey {
+    int blockHeight;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 4;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata32be(s, blockHeight);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        blockHeight = ser_readdata32be(s);
+    }
+
+    CAddressBalanceDeltaKey(int nHeight) {
+        blockHeight = nHeight;
+    }
+
+    CAddressBalanceDeltaKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        blockHeight = 0;
+    }
+};
+
+//! Received and sent amounts of the addresses in one block
+typedef std::vector<std::pair<CAddressIndexIteratorKey, std::pair<CAmount, CAmount> > > address_balance_deltas_t;
+
 struct CDepositIndexKey {
     unsigned int type;
     uint160 hashBytes;
@@ -558,6 +880,187 @@ struct CDepositIndexIteratorTimeKey {
     }
 };
 
+//! Deposits of an address get counted per this many seconds of their timestamp
+static const unsigned int DEPOSIT_BUCKET_SECONDS = 86400;
+
+/** Count of the deposits to an address with timestamps within one bucket of
+ *  DEPOSIT_BUCKET_SECONDS, the deposit count and page queries add them up
+ *  instead of walking the deposits. */
+struct CDepositIndexBucketKey {
+    unsigned int type;
+    uint160 hashBytes;
+    unsigned int bucket;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 25;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, bucket);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        bucket = ser_readdata32be(s);
+    }
+
+    CDepositIndexBucketKey(unsigned int addressType, uint160 addressHash, unsigned int nBucket) {
+        type = addressType;
+        hashBytes = addressHash;
+        bucket = nBucket;
+    }
+
+    CDepositIndexBucketKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        type = 0;
+        hashBytes.SetNull();
+        bucket = 0;
+    }
+
+    static unsigned int Bucket(unsigned int timestamp) { return timestamp / DEPOSIT_BUCKET_SECONDS; }
+    unsigned int FirstTime() const { return bucket * DEPOSIT_BUCKET_SECONDS; }
+    unsigned int LastTime() const { return FirstTime() + DEPOSIT_BUCKET_SECONDS - 1; }
+
+    friend bool operator<(const CDepositIndexBucketKey& a, const CDepositIndexBucketKey& b) {
+        if (a.type != b.type)
+            return a.type < b.type;
+        if (a.hashBytes != b.hashBytes)
+            return a.hashBytes < b.hashBytes;
+        return a.bucket < b.bucket;
+    }
+};
+
+//! What a coinbase output pays, the payout index keeps it with the amount
+enum PayoutCategory {
+    PAYOUT_MINING = 1,
+    PAYOUT_HIVE = 2,
+    PAYOUT_SMARTNODE = 4,
+    PAYOUT_SMARTREWARDS = 8,
+};
+
+static const int PAYOUT_ALL = PAYOUT_MINING | PAYOUT_HIVE | PAYOUT_SMARTNODE | PAYOUT_SMARTREWARDS;
+
+/** A coinbase output paid to an address, sorted by the height of the block
+ *  for the range queries. */
+struct CPayoutIndexKey {
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int nOut;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 29;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        // Heights are stored big-endian for key sorting in LevelDB
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, nOut);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = ser_readdata32be(s);
+        nOut = ser_readdata32be(s);
+    }
+
+    CPayoutIndexKey(unsigned int addressType, uint160 addressHash, int height, unsigned int n) {
+        type = addressType;
+        hashBytes = addressHash;
+        blockHeight = height;
+        nOut = n;
+    }
+
+    CPayoutIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        type = 0;
+        hashBytes.SetNull();
+        blockHeight = 0;
+        nOut = 0;
+    }
+};
+
+struct CPayoutValue {
+    int category;
+    CAmount satoshis;
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(category);
+        READWRITE(satoshis);
+    }
+
+    CPayoutValue(int nCategory, CAmount sats) {
+        category = nCategory;
+        satoshis = sats;
+    }
+
+    CPayoutValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        category = 0;
+        satoshis = -1;
+    }
+
+    bool IsNull() const {
+        return (satoshis == -1);
+    }
+};
+
+struct CPayoutIndexIteratorHeightKey {
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 25;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        ser_writedata32be(s, blockHeight);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = ser_readdata32be(s);
+    }
+
+    CPayoutIndexIteratorHeightKey(unsigned int addressType, uint160 addressHash, int height) {
+        type = addressType;
+        hashBytes = addressHash;
+        blockHeight = height;
+    }
+
+    CPayoutIndexIteratorHeightKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        type = 0;
+        hashBytes.SetNull();
+        blockHeight = 0;
+    }
+};
+
 
 struct CVoteKeyRegistrationKey {
     int nHeight;
@@ -12,6 +12,35 @@
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
 
+static boost::mutex csLockStats;
+static std::vector<CLockStats*> vLockStats;
+
+void CLockStats::Reset()
+{
+    nAcquisitions = 0;
+    nContended = 0;
+    nWaitTime = 0;
+    nMaxWaitTime = 0;
+    nHoldTime = 0;
+    nMaxHoldTime = 0;
+}
+
+void RegisterLockStats(CCriticalSection& cs, const char* pszName)
+{
+    boost::lock_guard<boost::mutex> lock(csLockStats);
+    if (cs.pstats)
+        return;
+    // Never freed, the registered locks live as long as the process
+    cs.pstats = new CLockStats(pszName);
+    vLockStats.push_back(cs.pstats);
+}
+
+std::vector<CLockStats*> GetLockStats()
+{
+    boost::lock_guard<boost::mutex> lock(csLockStats);
+    return vLockStats;
+}
+
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 {
@@ -8,6 +8,10 @@
 
 #include "threadsafety.h"
 
+#include <atomic>
+#include <chrono>
+#include <vector>
+
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
@@ -85,6 +89,62 @@ void static inline DeleteLock(void* cs) {}
 #endif
 #define AssertLockHeld(cs) AssertLockHeldInternal(#cs, __FILE__, __LINE__, &cs)
 
+/** Default for -lockstats */
+static const bool DEFAULT_LOCKSTATS = true;
+
+/**
+ * Contention statistics of a lock, all times in microseconds. Only the outermost
+ * acquisition of a recursive lock counts. The counters get written by the thread
+ * which holds the lock, readers see them without taking it.
+ */
+struct CLockStats
+{
+    const char* pszName;
+    std::atomic<int64_t> nAcquisitions;
+    std::atomic<int64_t> nContended;
+    std::atomic<int64_t> nWaitTime;
+    std::atomic<int64_t> nMaxWaitTime;
+    std::atomic<int64_t> nHoldTime;
+    std::atomic<int64_t> nMaxHoldTime;
+
+    //! Recursion depth and start of the outermost hold, protected by the lock itself
+    int nDepth;
+    int64_t nHeldSince;
+
+    explicit CLockStats(const char* pszNameIn) : pszName(pszNameIn), nDepth(0), nHeldSince(0) { Reset(); }
+
+    static int64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void Acquired(bool fContended, int64_t nWait)
+    {
+        if (nDepth++)
+            return;
+        nAcquisitions.fetch_add(1, std::memory_order_relaxed);
+        if (fContended) {
+            nContended.fetch_add(1, std::memory_order_relaxed);
+            nWaitTime.fetch_add(nWait, std::memory_order_relaxed);
+            if (nWait > nMaxWaitTime.load(std::memory_order_relaxed))
+                nMaxWaitTime.store(nWait, std::memory_order_relaxed);
+        }
+        nHeldSince = Now();
+    }
+
+    void Released()
+    {
+        if (--nDepth)
+            return;
+        int64_t nHold = Now() - nHeldSince;
+        nHoldTime.fetch_add(nHold, std::memory_order_relaxed);
+        if (nHold > nMaxHoldTime.load(std::memory_order_relaxed))
+            nMaxHoldTime.store(nHold, std::memory_order_relaxed);
+    }
+
+    void Reset();
+};
+
 /**
  * Wrapped boost mutex: supports recursive locking, but no waiting
  * TODO: We should move away from using the recursive lock by default.
@@ -92,15 +152,32 @@ void static inline DeleteLock(void* cs) {}
 class CCriticalSection : public AnnotatedMixin<boost::recursive_mutex>
 {
 public:
+    //! Statistics of the LOCK and TRY_LOCK blocks, NULL unless registered with RegisterLockStats
+    CLockStats* pstats;
+
+    CCriticalSection() : pstats(NULL) {}
+
     ~CCriticalSection() {
         DeleteLock((void*)this);
     }
 };
 
+/** Keep contention statistics of the lock under the name, has to happen before other threads use it */
+void RegisterLockStats(CCriticalSection& cs, const char* pszName);
+/** Statistics of all registered locks, in the order of their registration */
+std::vector<CLockStats*> GetLockStats();
+
+static inline CLockStats* GetLockStats(CCriticalSection* cs) { return cs->pstats; }
+template <typename Mutex>
+static inline CLockStats* GetLockStats(Mutex*) { return NULL; }
+
 typedef CCriticalSection CDynamicCriticalSection;
 /** Wrapped boost mutex: supports waiting but not recursive locking */
 typedef AnnotatedMixin<boost::mutex> CWaitableCriticalSection;
 
+/** Just a typedef for boost::unique_lock, to wait on a CConditionVariable */
+typedef boost::unique_lock<boost::mutex> WaitableLock;
+
 /** Just a typedef for boost::condition_variable, can be wrapped later if desired */
 typedef boost::condition_variable CConditionVariable;
 
@@ -114,10 +191,28 @@ class SCOPED_LOCKABLE CMutexLock
 {
 private:
     boost::unique_lock<Mutex> lock;
+    //! Statistics of the lock if it has them and we hold it
+    CLockStats* pstats;
 
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
+        CLockStats* pstatsLock = GetLockStats(lock.mutex());
+        if (pstatsLock) {
+            // Only the wait of a lock which is taken already gets timed
+            if (lock.try_lock()) {
+                pstatsLock->Acquired(false, 0);
+            } else {
+#ifdef DEBUG_LOCKCONTENTION
+                PrintLockContention(pszName, pszFile, nLine);
+#endif
+                int64_t nStart = CLockStats::Now();
+                lock.lock();
+                pstatsLock->Acquired(true, CLockStats::Now() - nStart);
+            }
+            pstats = pstatsLock;
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -132,13 +227,16 @@ private:
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()), true);
         lock.try_lock();
-        if (!lock.owns_lock())
+        if (!lock.owns_lock()) {
             LeaveCritical();
+        } else if ((pstats = GetLockStats(lock.mutex()))) {
+            pstats->Acquired(false, 0);
+        }
         return lock.owns_lock();
     }
 
 public:
-    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, boost::defer_lock)
+    CMutexLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : lock(mutexIn, boost::defer_lock), pstats(NULL)
     {
         if (fTry)
             TryEnter(pszName, pszFile, nLine);
@@ -146,7 +244,7 @@ public:
             Enter(pszName, pszFile, nLine);
     }
 
-    CMutexLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn)
+    CMutexLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn) : pstats(NULL)
     {
         if (!pmutexIn) return;
 
@@ -159,8 +257,11 @@ public:
 
     ~CMutexLock() UNLOCK_FUNCTION()
     {
-        if (lock.owns_lock())
+        if (lock.owns_lock()) {
+            if (pstats)
+                pstats->Released();
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -182,12 +283,16 @@ typedef CMutexLock<CCriticalSection> CCriticalBlock;
     {                                                         \
         EnterCritical(#cs, __FILE__, __LINE__, (void*)(&cs)); \
         (cs).lock();                                          \
+        if (CLockStats* pstatsEnter = GetLockStats(&(cs)))    \
+            pstatsEnter->Acquired(false, 0);                  \
     }
 
-#define LEAVE_CRITICAL_SECTION(cs) \
-    {                              \
-        (cs).unlock();             \
-        LeaveCritical();           \
+#define LEAVE_CRITICAL_SECTION(cs)                            \
+    {                                                         \
+        if (CLockStats* pstatsLeave = GetLockStats(&(cs)))    \
+            pstatsLeave->Released();                          \
+        (cs).unlock();                                        \
+        LeaveCritical();                                      \
     }
 
 class CSemaphore
@@ -0,0 +1,313 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "taskpool.h"
+
+#include "util.h"
+
+#include <exception>
+
+#include <boost/thread/tss.hpp>
+
+CTaskPool taskPool;
+
+struct CTaskPool::Worker
+{
+    CTaskPool* pool;
+    size_t nIndex;
+    boost::mutex cs;
+    std::deque<Task> tasks[PRIORITY_COUNT];
+    boost::thread thread;
+
+    Worker(CTaskPool* pool, size_t nIndex) : pool(pool), nIndex(nIndex) {}
+};
+
+static void NoCleanup(void*) {}
+//! The worker the current thread is, if it is one
+static boost::thread_specific_ptr<void> currentWorker(&NoCleanup);
+
+CTaskPool::CTaskPool() : nPending(0), nSleeping(0), fStopping(false)
+{
+}
+
+CTaskPool::~CTaskPool()
+{
+    assert(vWorkers.empty());
+}
+
+void CTaskPool::Start(int nThreads)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    assert(vWorkers.empty());
+    fStopping = false;
+    for (int i = 0; i < nThreads; i++)
+        vWorkers.emplace_back(new Worker(this, i));
+    // The workers only look at the list once all are in it
+    for (const std::unique_ptr<Worker>& worker : vWorkers)
+        worker->thread = boost::thread(boost::bind(&CTaskPool::Run, this, worker.get()));
+}
+
+void CTaskPool::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fStopping = true;
+        cond.notify_all();
+    }
+    for (const std::unique_ptr<Worker>& worker : vWorkers)
+        worker->thread.join();
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    vWorkers.clear();
+}
+
+void CTaskPool::Wake()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (nSleeping > 0)
+        cond.notify_one();
+}
+
+void CTaskPool::Submit(Priority priority, const Task& task)
+{
+    Worker* worker = static_cast<Worker*>(currentWorker.get());
+    if (worker && worker->pool == this) {
+        boost::unique_lock<boost::mutex> lock(worker->cs);
+        worker->tasks[priority].push_back(task);
+        nPending++;
+    } else {
+        boost::unique_lock<boost::mutex> lock(cs);
+        injected[priority].push_back(task);
+        nPending++;
+        if (nSleeping > 0)
+            cond.notify_one();
+        return;
+    }
+    // Another worker can steal it while this one is busy
+    Wake();
+}
+
+/** The items of a ForEach, shared with the helpers which may start after it returned */
+struct CForEachState
+{
+    const std::function<void(size_t)>* pfunc;
+    size_t nItems;
+    std::atomic<size_t> nNext;
+
+    boost::mutex cs;
+    boost::condition_variable cond;
+    //! Helpers in the middle of taking items, protected by cs
+    int nActive;
+    //! No further helpers may start, pfunc is gone soon, protected by cs
+    bool fClosed;
+    std::exception_ptr error;
+
+    CForEachState(const std::function<void(size_t)>& func, size_t nItemsIn) : pfunc(&func), nItems(nItemsIn), nNext(0), nActive(0), fClosed(false) {}
+
+    void Work()
+    {
+        size_t nItem;
+        while ((nItem = nNext++) < nItems) {
+            try {
+                (*pfunc)(nItem);
+            } catch (...) {
+                boost::unique_lock<boost::mutex> lock(cs);
+                if (!error)
+                    error = std::current_exception();
+                // The others skip the rest
+                nNext = nItems;
+            }
+        }
+    }
+};
+
+void CTaskPool::ForEach(Priority priority, size_t nItems, size_t nItemsPerHelper, const std::function<void(size_t)>& func)
+{
+    if (nItems == 0)
+        return;
+
+    std::shared_ptr<CForEachState> state = std::make_shared<CForEachState>(func, nItems);
+    size_t nHelpers = std::min<size_t>(nItems / std::max<size_t>(nItemsPerHelper, 1), WorkerCount());
+    for (size_t i = 0; i < nHelpers; i++) {
+        Submit(priority, [state]() {
+            {
+                boost::unique_lock<boost::mutex> lock(state->cs);
+                if (state->fClosed)
+                    return;
+                state->nActive++;
+            }
+            state->Work();
+            boost::unique_lock<boost::mutex> lock(state->cs);
+            if (--state->nActive == 0)
+                state->cond.notify_all();
+        });
+    }
+
+    state->Work();
+
+    // The helpers still use func, an interruption must not unwind it from under them
+    boost::this_thread::disable_interruption noInterruption;
+    boost::unique_lock<boost::mutex> lock(state->cs);
+    state->fClosed = true;
+    while (state->nActive > 0)
+        state->cond.wait(lock);
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
+
+int CTaskPool::WorkerCount() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return vWorkers.size();
+}
+
+size_t CTaskPool::Pending() const
+{
+    return nPending.load();
+}
+
+bool CTaskPool::Take(Worker* worker, Task& task)
+{
+    for (int nPriority = 0; nPriority < PRIORITY_COUNT; nPriority++) {
+        {
+            boost::unique_lock<boost::mutex> lock(worker->cs);
+            std::deque<Task>& tasks = worker->tasks[nPriority];
+            if (!tasks.empty()) {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+                nPending--;
+                return true;
+            }
+        }
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            std::deque<Task>& tasks = injected[nPriority];
+            if (!tasks.empty()) {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                nPending--;
+                return true;
+            }
+        }
+        // Start with the next worker so the victims differ between the thieves
+        for (size_t i = 1; i < vWorkers.size(); i++) {
+            Worker* victim = vWorkers[(worker->nIndex + i) % vWorkers.size()].get();
+            boost::unique_lock<boost::mutex> lock(victim->cs);
+            std::deque<Task>& tasks = victim->tasks[nPriority];
+            if (!tasks.empty()) {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                nPending--;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void CTaskPool::Run(Worker* worker)
+{
+    RenameThread("smartcash-taskpool");
+    currentWorker.reset(worker);
+
+    while (true) {
+        Task task;
+        if (Take(worker, task)) {
+            try {
+                task();
+            } catch (const std::exception& e) {
+                PrintExceptionContinue(&e, "taskpool");
+            } catch (...) {
+                PrintExceptionContinue(NULL, "taskpool");
+            }
+            continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(cs);
+        // Submit counts a task before it takes this lock to wake a worker
+        if (nPending.load() > 0)
+            continue;
+        if (fStopping)
+            break;
+        nSleeping++;
+        cond.wait(lock);
+        nSleeping--;
+    }
+
+    currentWorker.reset();
+}
+
+CTaskQueue::CTaskQueue(CTaskPool& pool, CTaskPool::Priority priority, size_t nMaxDepth, int nMaxRunning) :
+    pool(pool),
+    priority(priority),
+    running(true),
+    nMaxDepth(nMaxDepth),
+    nMaxRunning(nMaxRunning),
+    nRunning(0)
+{
+}
+
+CTaskQueue::~CTaskQueue()
+{
+    assert(nRunning == 0);
+}
+
+bool CTaskQueue::Enqueue(const CTaskPool::Task& task)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!running || queue.size() >= nMaxDepth)
+            return false;
+        queue.push_back(task);
+        if (nRunning >= nMaxRunning)
+            return true;
+        nRunning++;
+    }
+    pool.Submit(priority, std::bind(&CTaskQueue::RunNext, this));
+    return true;
+}
+
+void CTaskQueue::RunNext()
+{
+    CTaskPool::Task task;
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!running || queue.empty()) {
+            nRunning--;
+            cond.notify_all();
+            return;
+        }
+        task = std::move(queue.front());
+        queue.pop_front();
+    }
+
+    // Queued again after each task instead of looping, higher priorities come first in between
+    try {
+        task();
+    } catch (...) {
+        pool.Submit(priority, std::bind(&CTaskQueue::RunNext, this));
+        throw;
+    }
+    pool.Submit(priority, std::bind(&CTaskQueue::RunNext, this));
+}
+
+void CTaskQueue::Interrupt()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    running = false;
+    cond.notify_all();
+}
+
+void CTaskQueue::WaitExit()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (nRunning > 0)
+        cond.wait(lock);
+}
+
+size_t CTaskQueue::Depth()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return queue.size();
+}
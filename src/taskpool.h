@@ -0,0 +1,141 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_TASKPOOL_H
+#define SMARTCASH_TASKPOOL_H
+
+#include "sync.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+/** Default for -taskthreads, 0 = one per core */
+static const int DEFAULT_TASK_THREADS = 0;
+/** The pool never runs less workers, a few blocking tasks like long polls shouldn't stall all others */
+static const int MIN_TASK_THREADS = 4;
+/** Maximum number of workers */
+static const int MAX_TASK_THREADS = 64;
+
+/**
+ * Thread pool shared by the RPC and SAPI servers and background tasks.
+ *
+ * Each worker has its own deques. Tasks submitted from a worker go to the back of them
+ * and get popped from there again while their data is likely still in its cache, tasks
+ * from other threads go to the shared injection queue. Idle workers take from the front
+ * of the injection queue or steal from the front of the other workers' deques. A
+ * priority gets exhausted in all queues before the next lower one is looked at.
+ *
+ * Submitted tasks all run, Stop() waits until there are none left.
+ */
+class CTaskPool
+{
+public:
+    enum Priority {
+        //! Interactive requests, RPC
+        PRIORITY_HIGH = 0,
+        //! Public API requests
+        PRIORITY_NORMAL,
+        //! Maintenance which can wait
+        PRIORITY_LOW,
+        PRIORITY_COUNT
+    };
+
+    typedef std::function<void()> Task;
+
+    CTaskPool();
+    /** Precondition: stopped, or never started */
+    ~CTaskPool();
+
+    CTaskPool(const CTaskPool&) = delete;
+    CTaskPool& operator=(const CTaskPool&) = delete;
+
+    /** Start the workers, tasks submitted before wait for it */
+    void Start(int nThreads);
+    /** Run the remaining tasks and join the workers */
+    void Stop();
+
+    void Submit(Priority priority, const Task& task);
+
+    /**
+     * Call func for every index below nItems, on the calling thread and on up
+     * to one helper task of the pool for every nItemsPerHelper items. The
+     * caller takes part and only waits for helpers which already started, so
+     * it is fine on a worker of the pool with all others busy. The first
+     * exception func throws gets rethrown once all started calls returned.
+     */
+    void ForEach(Priority priority, size_t nItems, size_t nItemsPerHelper, const std::function<void(size_t)>& func);
+
+    int WorkerCount() const;
+    /** Number of tasks submitted but not started yet */
+    size_t Pending() const;
+
+private:
+    struct Worker;
+
+    /** Protects the injection queue, the sleep state and the list of workers */
+    mutable boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<Task> injected[PRIORITY_COUNT];
+    std::vector<std::unique_ptr<Worker>> vWorkers;
+    std::atomic<size_t> nPending;
+    int nSleeping;
+    bool fStopping;
+
+    /** Take the next task for worker, by priority and then from its own, the injected and other workers' tasks */
+    bool Take(Worker* worker, Task& task);
+    void Run(Worker* worker);
+    void Wake();
+};
+
+/**
+ * Bounded queue of one subsystem on top of the pool, the replacement of a fixed set of
+ * threads running a work queue. At most nMaxRunning of its tasks run at the same time,
+ * so a burst of requests can't take up all workers of the pool.
+ */
+class CTaskQueue
+{
+public:
+    CTaskQueue(CTaskPool& pool, CTaskPool::Priority priority, size_t nMaxDepth, int nMaxRunning);
+    /** Precondition: interrupted and WaitExit returned */
+    ~CTaskQueue();
+
+    CTaskQueue(const CTaskQueue&) = delete;
+    CTaskQueue& operator=(const CTaskQueue&) = delete;
+
+    /** Queue a task, fails if the queue is full or interrupted */
+    bool Enqueue(const CTaskPool::Task& task);
+    /** Don't start any further tasks, the queued ones get dropped */
+    void Interrupt();
+    /** Wait for the running tasks to return */
+    void WaitExit();
+
+    /** Return current depth of queue */
+    size_t Depth();
+    int MaxRunning() const { return nMaxRunning; }
+
+private:
+    CTaskPool& pool;
+    const CTaskPool::Priority priority;
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    std::deque<CTaskPool::Task> queue;
+    bool running;
+    const size_t nMaxDepth;
+    const int nMaxRunning;
+    //! Number of tasks of the pool working off this queue
+    int nRunning;
+
+    /** Pool task, runs one queued task and queues itself again for the next one */
+    void RunNext();
+};
+
+/** The pool of the node, started in AppInit2 */
+extern CTaskPool taskPool;
+
+#endif // SMARTCASH_TASKPOOL_H
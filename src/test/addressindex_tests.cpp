@@ -0,0 +1,772 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "key.h"
+#include "random.h"
+#include "script/standard.h"
+#include "smartmining/miningpayments.h"
+#include "smartnode/smartnodepayments.h"
+#include "test/test_bitcoin.h"
+#include "txdb.h"
+#include "txmempool.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, BasicTestingSetup)
+
+typedef std::vector<std::pair<CAddressIndexKey, CAmount> > AddressIndexVector;
+
+static void CheckBalance(CBlockTreeDB& db, const uint160& hashBytes, CAmount received, CAmount sent, int64_t txCount, int firstHeight, int lastHeight)
+{
+    CAddressBalanceValue value;
+    BOOST_CHECK(db.ReadAddressBalanceIndex(hashBytes, 1, value));
+    BOOST_CHECK_EQUAL(value.received, received);
+    BOOST_CHECK_EQUAL(value.sent, sent);
+    BOOST_CHECK_EQUAL(value.balance, received - sent);
+    BOOST_CHECK_EQUAL(value.txCount, txCount);
+    BOOST_CHECK_EQUAL(value.firstHeight, firstHeight);
+    BOOST_CHECK_EQUAL(value.lastHeight, lastHeight);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_balance_connect_disconnect)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashBytes = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint256 hashBlock1 = GetRandHash(), hashBlock2 = GetRandHash(), txid1 = GetRandHash(), txid2 = GetRandHash();
+
+    // Two outputs of the same transaction count as one transaction.
+    AddressIndexVector block1;
+    block1.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, 10, 1, txid1, 0, false), 5 * COIN));
+    block1.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, 10, 1, txid1, 1, false), 3 * COIN));
+
+    AddressIndexVector block2;
+    block2.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, 20, 1, txid2, 0, true), -5 * COIN));
+
+    BOOST_CHECK(db.WriteAddressIndex(block1));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block1, hashBlock1, uint256(), false));
+    BOOST_CHECK(db.WriteAddressIndex(block2));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block2, hashBlock2, hashBlock1, false));
+    CheckBalance(db, hashBytes, 8 * COIN, 5 * COIN, 2, 10, 20);
+
+    // A block which doesn't follow the totals is refused.
+    BOOST_CHECK(!db.UpdateAddressBalanceIndex(block2, hashBlock2, hashBlock1, false));
+    BOOST_CHECK(!db.UpdateAddressBalanceIndex(block1, hashBlock1, uint256(), true));
+    CheckBalance(db, hashBytes, 8 * COIN, 5 * COIN, 2, 10, 20);
+
+    // A rebuild from the address index yields the same totals.
+    BOOST_CHECK(db.RebuildAddressBalanceIndex(hashBlock2, 20));
+    CheckBalance(db, hashBytes, 8 * COIN, 5 * COIN, 2, 10, 20);
+
+    BOOST_CHECK(db.EraseAddressIndex(block2));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block2, hashBlock2, hashBlock1, true));
+    CheckBalance(db, hashBytes, 8 * COIN, 0, 1, 10, 10);
+
+    BOOST_CHECK(db.EraseAddressIndex(block1));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block1, hashBlock1, uint256(), true));
+
+    CAddressBalanceValue value;
+    BOOST_CHECK(!db.ReadAddressBalanceIndex(hashBytes, 1, value));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_balance_replay)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashBytes = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint256 hashBlock1 = GetRandHash(), hashBlock2 = GetRandHash(), hashBlock3 = GetRandHash();
+
+    AddressIndexVector block1;
+    block1.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, 10, 1, GetRandHash(), 0, false), 5 * COIN));
+
+    AddressIndexVector block2;
+    block2.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, 20, 1, GetRandHash(), 0, false), 3 * COIN));
+
+    AddressIndexVector block3;
+    block3.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, 30, 1, GetRandHash(), 0, true), -2 * COIN));
+
+    BOOST_CHECK(db.WriteAddressIndex(block1));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block1, hashBlock1, uint256(), false));
+    BOOST_CHECK(db.WriteAddressIndex(block2));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block2, hashBlock2, hashBlock1, false));
+    BOOST_CHECK(db.WriteAddressIndex(block3));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block3, hashBlock3, hashBlock2, false));
+    CheckBalance(db, hashBytes, 8 * COIN, 2 * COIN, 3, 10, 30);
+
+    // A crash with the chainstate flushed at block 1, blocks 2 and 3 get connected again. The totals
+    // are ahead of the chainstate and don't take them.
+    uint256 hashBest;
+    BOOST_CHECK(db.ReadAddressBalanceBest(hashBest));
+    BOOST_CHECK(hashBest == hashBlock3);
+    BOOST_CHECK(!db.UpdateAddressBalanceIndex(block2, hashBlock2, hashBlock1, false));
+    CheckBalance(db, hashBytes, 8 * COIN, 2 * COIN, 3, 10, 30);
+
+    // Built again at the chainstate's block, the entries of the blocks above it don't count.
+    BOOST_CHECK(db.RebuildAddressBalanceIndex(hashBlock1, 10));
+    BOOST_CHECK(db.ReadAddressBalanceBest(hashBest));
+    BOOST_CHECK(hashBest == hashBlock1);
+    CheckBalance(db, hashBytes, 5 * COIN, 0, 1, 10, 10);
+
+    // Connecting the blocks again counts each of them once.
+    BOOST_CHECK(db.WriteAddressIndex(block2));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block2, hashBlock2, hashBlock1, false));
+    BOOST_CHECK(db.WriteAddressIndex(block3));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block3, hashBlock3, hashBlock2, false));
+    CheckBalance(db, hashBytes, 8 * COIN, 2 * COIN, 3, 10, 30);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_balance_rich_list)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashA = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 hashB = uint160(ParseHex("1102030405060708090a0b0c0d0e0f1011121314"));
+    uint256 hashBlock1 = GetRandHash(), hashBlock2 = GetRandHash();
+
+    AddressIndexVector block1;
+    block1.push_back(std::make_pair(CAddressIndexKey(1, hashA, 10, 1, GetRandHash(), 0, false), 5 * COIN));
+    block1.push_back(std::make_pair(CAddressIndexKey(1, hashB, 10, 1, GetRandHash(), 0, false), 3 * COIN));
+
+    AddressIndexVector block2;
+    block2.push_back(std::make_pair(CAddressIndexKey(1, hashA, 20, 1, GetRandHash(), 0, true), -4 * COIN));
+
+    BOOST_CHECK(db.WriteAddressBalanceDeltaStart(0));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block1, hashBlock1, uint256(), false));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block2, hashBlock2, hashBlock1, false));
+
+    // The current balances come largest first.
+    std::vector<CAddressListEntry> addresses;
+    BOOST_CHECK(db.ReadAddressBalances(addresses, -1, 20));
+    BOOST_CHECK_EQUAL(addresses.size(), 2U);
+    BOOST_CHECK(addresses[0].hashBytes == hashB);
+    BOOST_CHECK_EQUAL(addresses[0].balance, 3 * COIN);
+    BOOST_CHECK(addresses[1].hashBytes == hashA);
+    BOOST_CHECK_EQUAL(addresses[1].balance, 1 * COIN);
+    BOOST_CHECK_EQUAL(addresses[1].received, 5 * COIN);
+
+    // Before block 20 the spend of A didn't happen yet.
+    addresses.clear();
+    BOOST_CHECK(db.ReadAddressBalances(addresses, 20, 20));
+    BOOST_CHECK_EQUAL(addresses.size(), 2U);
+    for (const CAddressListEntry &entry : addresses) {
+        BOOST_CHECK_EQUAL(entry.balance, entry.hashBytes == hashA ? 5 * COIN : 3 * COIN);
+    }
+
+    // Before block 10 nobody had anything.
+    addresses.clear();
+    BOOST_CHECK(db.ReadAddressBalances(addresses, 5, 20));
+    BOOST_CHECK(addresses.empty());
+
+    // Without the changes since height 15 there is no way back to it.
+    BOOST_CHECK(db.WriteAddressBalanceDeltaStart(21));
+    BOOST_CHECK(!db.ReadAddressBalances(addresses, 15, 20));
+
+    BOOST_CHECK(db.EraseAddressIndex(block2));
+    BOOST_CHECK(db.UpdateAddressBalanceIndex(block2, hashBlock2, hashBlock1, true));
+
+    addresses.clear();
+    BOOST_CHECK(db.ReadAddressBalances(addresses, -1, 10));
+    BOOST_CHECK_EQUAL(addresses.size(), 2U);
+    BOOST_CHECK(addresses[0].hashBytes == hashA);
+    BOOST_CHECK_EQUAL(addresses[0].balance, 5 * COIN);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_transactions_cursor)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashBytes = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 otherBytes = uint160(ParseHex("1102030405060708090a0b0c0d0e0f1011121314"));
+    std::vector<uint256> txids;
+    AddressIndexVector entries;
+
+    // Ten transactions in five blocks with an input and an output each, and unrelated entries of
+    // another address behind them.
+    for (int i = 0; i < 10; i++) {
+        txids.push_back(GetRandHash());
+        entries.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, 100 + i / 2, i % 2, txids[i], 0, true), -2 * COIN));
+        entries.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, 100 + i / 2, i % 2, txids[i], 1, false), 3 * COIN));
+        entries.push_back(std::make_pair(CAddressIndexKey(1, otherBytes, 100 + i / 2, i % 2, txids[i], 0, false), COIN));
+    }
+
+    BOOST_CHECK(db.WriteAddressIndex(entries));
+
+    int64_t nCount = 0;
+    BOOST_CHECK(db.ReadAddressIndexTransactionCount(hashBytes, 1, nCount));
+    BOOST_CHECK_EQUAL(nCount, 10);
+
+    for (bool fAscending : {true, false}) {
+        std::vector<uint256> vecSeen;
+        std::vector<std::tuple<uint256, int, CAmount> > vecTxs;
+        int nCursorHeight = 0;
+        uint256 cursorTx;
+        bool fMore = true;
+
+        while (fMore) {
+            BOOST_CHECK(db.ReadAddressIndexTransactions(hashBytes, 1, fAscending, nCursorHeight, cursorTx, 0, 3, vecTxs, fMore));
+            BOOST_CHECK(!vecTxs.empty() && vecTxs.size() <= 3);
+
+            for (const auto &tx : vecTxs) {
+                BOOST_CHECK_EQUAL(std::get<2>(tx), COIN);
+                vecSeen.push_back(std::get<0>(tx));
+            }
+
+            nCursorHeight = std::get<1>(vecTxs.back());
+            cursorTx = std::get<0>(vecTxs.back());
+        }
+
+        if (!fAscending)
+            std::reverse(vecSeen.begin(), vecSeen.end());
+
+        BOOST_CHECK(vecSeen == txids);
+    }
+
+    // Offset based pages see the same transactions.
+    std::vector<std::tuple<uint256, int, CAmount> > vecTxs;
+    bool fMore = false;
+    BOOST_CHECK(db.ReadAddressIndexTransactions(hashBytes, 1, false, 0, uint256(), 8, 3, vecTxs, fMore));
+    BOOST_CHECK(!fMore);
+    BOOST_CHECK_EQUAL(vecTxs.size(), 2U);
+    BOOST_CHECK(std::get<0>(vecTxs[0]) == txids[1]);
+    BOOST_CHECK(std::get<0>(vecTxs[1]) == txids[0]);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_heights)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashBytes = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 otherBytes = uint160(ParseHex("1102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 unknownBytes = uint160(ParseHex("2102030405060708090a0b0c0d0e0f1011121314"));
+    AddressIndexVector entries;
+
+    // Several entries per height, and another address in between.
+    for (int nHeight : {5, 10, 11, 20}) {
+        for (int i = 0; i < 3; i++) {
+            entries.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, nHeight, i, GetRandHash(), 0, false), COIN));
+        }
+        entries.push_back(std::make_pair(CAddressIndexKey(1, otherBytes, nHeight + 1, 0, GetRandHash(), 0, false), COIN));
+    }
+
+    BOOST_CHECK(db.WriteAddressIndex(entries));
+
+    std::set<int> setHeights;
+    BOOST_CHECK(db.ReadAddressIndexHeights(hashBytes, 1, 0, setHeights));
+    BOOST_CHECK(setHeights == std::set<int>({5, 10, 11, 20}));
+
+    setHeights.clear();
+    BOOST_CHECK(db.ReadAddressIndexHeights(hashBytes, 1, 10, setHeights));
+    BOOST_CHECK(setHeights == std::set<int>({10, 11, 20}));
+
+    // Unknown addresses have no heights.
+    setHeights.clear();
+    BOOST_CHECK(db.ReadAddressIndexHeights(unknownBytes, 1, 0, setHeights));
+    BOOST_CHECK(db.ReadAddressIndexHeights(hashBytes, 2, 0, setHeights));
+    BOOST_CHECK(setHeights.empty());
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_unspent_reverse)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashBytes = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 otherBytes = uint160(ParseHex("1102030405060708090a0b0c0d0e0f1011121314"));
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > entries;
+
+    // Outputs of another address of the same type sort behind the ones of the address.
+    for (int i = 1; i <= 3; i++) {
+        entries.push_back(std::make_pair(CAddressUnspentKey(1, hashBytes, GetRandHash(), 0, i), CAddressUnspentValue(i * COIN, CScript(), i)));
+        entries.push_back(std::make_pair(CAddressUnspentKey(1, otherBytes, GetRandHash(), 0, i), CAddressUnspentValue(i * COIN, CScript(), i)));
+    }
+
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(entries));
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashBytes, 1, unspent, CAddressUnspentKey(), 0, 0, true));
+    BOOST_CHECK_EQUAL(unspent.size(), 3U);
+
+    for (size_t i = 0; i < unspent.size(); i++) {
+        BOOST_CHECK(unspent[i].first.hashBytes == hashBytes);
+        BOOST_CHECK_EQUAL(unspent[i].first.nBlockHeight, 3 - (int)i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_block_batch)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashBytes = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint256 hashBlock = GetRandHash(), txid = GetRandHash();
+
+    AddressIndexVector addressIndex;
+    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, hashBytes, 10, 1, txid, 0, false), 5 * COIN));
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentIndex;
+    unspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, hashBytes, txid, 0, 10), CAddressUnspentValue(5 * COIN, CScript(), 10)));
+
+    CDBBatch batch(db);
+    db.WriteAddressIndex(batch, addressIndex);
+    db.UpdateAddressUnspentIndex(batch, unspentIndex);
+    db.WriteTimestampIndex(batch, CTimestampIndexKey(1000, hashBlock));
+
+    // Nothing is visible before the batch got written.
+    AddressIndexVector read;
+    BOOST_CHECK(db.ReadAddressIndex(hashBytes, 1, read));
+    BOOST_CHECK(read.empty());
+
+    uint256 hashRead;
+    BOOST_CHECK(!db.ReadTimestampIndex(1000, hashRead));
+
+    BOOST_CHECK(db.WriteBatch(batch));
+
+    BOOST_CHECK(db.ReadAddressIndex(hashBytes, 1, read));
+    BOOST_CHECK_EQUAL(read.size(), 1U);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashBytes, 1, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 1U);
+
+    BOOST_CHECK(db.ReadTimestampIndex(1000, hashRead));
+    BOOST_CHECK(hashRead == hashBlock);
+
+    // The disconnect removes them in one batch again.
+    CDBBatch undo(db);
+    db.EraseAddressIndex(undo, addressIndex);
+    unspentIndex[0].second.SetNull();
+    db.UpdateAddressUnspentIndex(undo, unspentIndex);
+    BOOST_CHECK(db.WriteBatch(undo));
+
+    read.clear();
+    unspent.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hashBytes, 1, read));
+    BOOST_CHECK(read.empty());
+    BOOST_CHECK(db.ReadAddressUnspentIndex(hashBytes, 1, unspent));
+    BOOST_CHECK(unspent.empty());
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_build_progress)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    int nIndexes = 0, nNextHeight = 0;
+
+    BOOST_CHECK(!db.ReadIndexBuildProgress(nIndexes, nNextHeight));
+
+    // Written along with the entries of the heights below.
+    CDBBatch batch(db);
+    db.UpdateSpentIndex(batch, std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >(1,
+        std::make_pair(CSpentIndexKey(GetRandHash(), 0), CSpentIndexValue(GetRandHash(), 0, 5, COIN, 0, uint160()))));
+    db.WriteIndexBuildProgress(batch, 6, 500);
+    BOOST_CHECK(!db.ReadIndexBuildProgress(nIndexes, nNextHeight));
+    BOOST_CHECK(db.WriteBatch(batch));
+
+    BOOST_CHECK(db.ReadIndexBuildProgress(nIndexes, nNextHeight));
+    BOOST_CHECK_EQUAL(nIndexes, 6);
+    BOOST_CHECK_EQUAL(nNextHeight, 500);
+
+    BOOST_CHECK(db.EraseIndexBuildProgress());
+    BOOST_CHECK(!db.ReadIndexBuildProgress(nIndexes, nNextHeight));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_compact_upgrade)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashBytes1 = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 hashBytes2 = uint160(ParseHex("1112131415161718191a1b1c1d1e1f2021222324"));
+    uint256 txid1 = GetRandHash(), txid2 = GetRandHash();
+
+    // Entries in the format of older versions, keyed by the full address and transaction hash.
+    AddressIndexVector legacy;
+    legacy.push_back(std::make_pair(CAddressIndexKey(1, hashBytes1, 10, 1, txid1, 0, false), 5 * COIN));
+    legacy.push_back(std::make_pair(CAddressIndexKey(1, hashBytes2, 10, 1, txid1, 1, false), 2 * COIN));
+    legacy.push_back(std::make_pair(CAddressIndexKey(1, hashBytes1, 20, 3, txid2, 0, true), -5 * COIN));
+
+    CDBBatch batch(db.IndexDB());
+    for (const auto& entry : legacy)
+        batch.Write(std::make_pair('a', entry.first), entry.second);
+    BOOST_CHECK(db.IndexDB().WriteBatch(batch));
+
+    AddressIndexVector read;
+    BOOST_CHECK(db.ReadAddressIndex(hashBytes1, 1, read));
+    BOOST_CHECK(read.empty());
+
+    BOOST_CHECK(db.UpgradeAddressIndex());
+    BOOST_CHECK(!db.IndexDB().Exists(std::make_pair('a', legacy[0].first)));
+
+    // The transaction hashes come back from the transaction table.
+    BOOST_CHECK(db.ReadAddressIndex(hashBytes1, 1, read));
+    BOOST_REQUIRE_EQUAL(read.size(), 2U);
+    BOOST_CHECK(read[0].first.txhash == txid1);
+    BOOST_CHECK_EQUAL(read[0].second, 5 * COIN);
+    BOOST_CHECK(read[1].first.txhash == txid2);
+    BOOST_CHECK(read[1].first.spending);
+    BOOST_CHECK_EQUAL(read[1].first.txindex, 3U);
+
+    int64_t nCount = 0;
+    BOOST_CHECK(db.ReadAddressIndexTransactionCount(hashBytes2, 1, nCount));
+    BOOST_CHECK_EQUAL(nCount, 1);
+    BOOST_CHECK_EQUAL(db.ReadAddressIndexLastHeight(hashBytes1, 1, 20), 10);
+
+    // Disconnecting the last block drops its entries, the address keeps its id.
+    AddressIndexVector block2(1, legacy[2]);
+    BOOST_CHECK(db.EraseAddressIndex(block2));
+    read.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hashBytes1, 1, read));
+    BOOST_CHECK_EQUAL(read.size(), 1U);
+
+    std::vector<CAddressListEntry> addresses;
+    BOOST_CHECK(db.ReadAddresses(addresses, -1, true));
+    BOOST_CHECK_EQUAL(addresses.size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_deposit_buckets)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashBytes = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 hashOther = uint160(ParseHex("1112131415161718191a1b1c1d1e1f2021222324"));
+    FastRandomContext ctx(true);
+
+    // Deposits spread over a few buckets, some right at their edges
+    std::vector<std::pair<CDepositIndexKey, CDepositValue> > vecDeposits;
+    std::vector<unsigned int> vecTimes;
+    unsigned int nBase = 1500000000 / DEPOSIT_BUCKET_SECONDS * DEPOSIT_BUCKET_SECONDS;
+    for (int i = 0; i < 200; i++) {
+        unsigned int nTime = nBase + (i % 3 == 0 ? (i / 3) * DEPOSIT_BUCKET_SECONDS / 4 : ctx.rand32() % (20 * DEPOSIT_BUCKET_SECONDS));
+        vecTimes.push_back(nTime);
+        vecDeposits.push_back(std::make_pair(CDepositIndexKey(1, hashBytes, nTime, GetRandHash()), CDepositValue(COIN, i)));
+    }
+    vecDeposits.push_back(std::make_pair(CDepositIndexKey(1, hashOther, nBase, GetRandHash()), CDepositValue(COIN, 0)));
+    std::sort(vecTimes.begin(), vecTimes.end());
+
+    BOOST_CHECK(db.WriteDepositIndex(vecDeposits));
+    // Written again, like a block connected again after a crash
+    BOOST_CHECK(db.WriteDepositIndex(vecDeposits));
+
+    for (int nRun = 0; nRun < 2; nRun++) {
+        int nStarts[] = {0, (int)nBase, (int)(nBase + DEPOSIT_BUCKET_SECONDS / 2), (int)vecTimes[57]};
+        int nEnds[] = {INT_MAX, (int)(nBase + 7 * DEPOSIT_BUCKET_SECONDS - 1), (int)vecTimes[150]};
+
+        for (int nStart : nStarts) {
+            for (int nEnd : nEnds) {
+                int nExpected = std::count_if(vecTimes.begin(), vecTimes.end(), [&](unsigned int nTime) { return nTime >= (unsigned int)nStart && nTime <= (unsigned int)nEnd; });
+                int nCount, nFirst, nLast;
+                BOOST_CHECK(db.ReadDepositIndexCount(hashBytes, 1, nCount, nFirst, nLast, nStart, nEnd));
+                BOOST_CHECK_EQUAL(nCount, nExpected);
+
+                // Every page of both orders matches a walk over the range, the last one limited like address/deposit does.
+                for (bool fReverse : {false, true}) {
+                    for (int nOffset = 0; nOffset < nExpected; nOffset += 17) {
+                        std::vector<std::pair<CDepositIndexKey, CDepositValue> > vecPage;
+                        int nLimit = std::min(17, nExpected - nOffset);
+                        BOOST_CHECK(db.ReadDepositIndex(hashBytes, 1, vecPage, fReverse ? nLast : nFirst, nOffset, nLimit, fReverse));
+                        BOOST_REQUIRE_EQUAL(vecPage.size(), (size_t)nLimit);
+                        size_t nIndex = fReverse ? std::upper_bound(vecTimes.begin(), vecTimes.end(), (unsigned int)nLast) - vecTimes.begin() - 1 - nOffset
+                                                 : std::lower_bound(vecTimes.begin(), vecTimes.end(), (unsigned int)nFirst) - vecTimes.begin() + nOffset;
+                        BOOST_CHECK_EQUAL(vecPage.front().first.timestamp, vecTimes[nIndex]);
+                    }
+                }
+            }
+        }
+
+        // The counts of an older database get rebuilt the same.
+        BOOST_CHECK(db.RebuildDepositBuckets());
+    }
+
+    BOOST_CHECK(db.EraseDepositIndex(vecDeposits));
+    int nCount, nFirst, nLast;
+    BOOST_CHECK(db.ReadDepositIndexCount(hashBytes, 1, nCount, nFirst, nLast, 0, INT_MAX));
+    BOOST_CHECK_EQUAL(nCount, 0);
+    BOOST_CHECK(!db.IndexDB().Exists(std::make_pair('w', CDepositIndexBucketKey(1, hashBytes, nBase / DEPOSIT_BUCKET_SECONDS))));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_spent_batch)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vecSpent, vecRead;
+
+    // Spends deep enough below the newest one to get cached
+    for (int i = 0; i < 50; i++)
+        vecSpent.push_back(std::make_pair(CSpentIndexKey(GetRandHash(), i % 3), CSpentIndexValue(GetRandHash(), i, 10 + i, COIN, 1, uint160())));
+    vecSpent.push_back(std::make_pair(CSpentIndexKey(GetRandHash(), 0), CSpentIndexValue(GetRandHash(), 0, 100, COIN, 1, uint160())));
+    BOOST_CHECK(db.UpdateSpentIndex(vecSpent));
+
+    // Out of order and with an unspent output in between
+    for (int i = vecSpent.size() - 1; i >= 0; i--) {
+        vecRead.push_back(std::make_pair(vecSpent[i].first, CSpentIndexValue()));
+        if (i == 20)
+            vecRead.push_back(std::make_pair(CSpentIndexKey(GetRandHash(), 0), CSpentIndexValue()));
+    }
+
+    for (int nRun = 0; nRun < 2; nRun++) {
+        BOOST_CHECK(db.ReadSpentIndex(vecRead));
+        BOOST_CHECK(vecRead[vecSpent.size() - 20].second.IsNull());
+        for (size_t i = 0, j = vecSpent.size() - 1; i < vecRead.size(); i++) {
+            if (i == vecSpent.size() - 20)
+                continue;
+            BOOST_CHECK(vecRead[i].second.txid == vecSpent[j].second.txid);
+            BOOST_CHECK_EQUAL(vecRead[i].second.blockHeight, vecSpent[j--].second.blockHeight);
+        }
+    }
+
+    // A reorg drops the spend, the cached entry goes with it.
+    CSpentIndexValue value;
+    BOOST_CHECK(db.ReadSpentIndex(vecSpent[0].first, value));
+    BOOST_CHECK(db.UpdateSpentIndex(std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >(1, std::make_pair(vecSpent[0].first, CSpentIndexValue()))));
+    BOOST_CHECK(!db.ReadSpentIndex(vecSpent[0].first, value));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_unspent_by_amount)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashBytes = uint160(ParseHex("1102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 otherBytes = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > entries;
+    std::vector<CAddressUnspentKey> keys;
+
+    const CAmount amounts[] = {5 * COIN, 1, 300 * COIN, 7 * COIN, 5 * COIN, 2 * COIN};
+
+    for (int i = 0; i < 6; i++) {
+        keys.push_back(CAddressUnspentKey(1, hashBytes, GetRandHash(), 0, 10 + i));
+        entries.push_back(std::make_pair(keys.back(), CAddressUnspentValue(amounts[i], CScript(), 10 + i)));
+        entries.push_back(std::make_pair(CAddressUnspentKey(1, otherBytes, GetRandHash(), 0, 10 + i), CAddressUnspentValue(1000 * COIN, CScript(), 10 + i)));
+    }
+
+    // The 7 coin output gets spent in the same block and the 2 coin one in the next.
+    entries.push_back(std::make_pair(keys[3], CAddressUnspentValue()));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(entries));
+
+    entries.clear();
+    entries.push_back(std::make_pair(keys[5], CAddressUnspentValue()));
+    BOOST_CHECK(db.UpdateAddressUnspentIndex(entries));
+
+    // Two at a time, the largest amounts first.
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+    CAddressUnspentAmountKey cursor;
+
+    do {
+        BOOST_CHECK(db.ReadAddressUnspentAmountIndex(hashBytes, 1, unspent, cursor, 2));
+    } while (!cursor.IsNull());
+
+    BOOST_CHECK_EQUAL(unspent.size(), 4U);
+
+    for (size_t i = 0; i < unspent.size(); i++) {
+        BOOST_CHECK(unspent[i].first.hashBytes == hashBytes);
+        if (i) BOOST_CHECK(unspent[i - 1].second.satoshis >= unspent[i].second.satoshis);
+    }
+
+    BOOST_CHECK_EQUAL(unspent.front().second.satoshis, 300 * COIN);
+    BOOST_CHECK_EQUAL(unspent.back().second.satoshis, 1);
+
+    // A rebuild from the unspent index yields the same outputs.
+    BOOST_CHECK(db.RebuildAddressUnspentAmountIndex());
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > rebuilt;
+    cursor.SetNull();
+    BOOST_CHECK(db.ReadAddressUnspentAmountIndex(hashBytes, 1, rebuilt, cursor, 0));
+    BOOST_CHECK_EQUAL(rebuilt.size(), unspent.size());
+
+    for (size_t i = 0; i < rebuilt.size(); i++) {
+        BOOST_CHECK(rebuilt[i].first == unspent[i].first);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_mempool_by_time)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+
+    uint160 hashBytes = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 otherBytes = uint160(ParseHex("1102030405060708090a0b0c0d0e0f1011121314"));
+    CScript script = GetScriptForDestination(CKeyID(hashBytes));
+    CScript otherScript = GetScriptForDestination(CKeyID(otherBytes));
+
+    // Entered with falling timestamps, the result needs to follow the time and not the hashes.
+    std::vector<uint256> vecHashes;
+    for (int i = 0; i < 5; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.push_back(CTxOut((i + 1) * COIN, script));
+        tx.vout.push_back(CTxOut(COIN, otherScript));
+        pool.addAddressIndex(entry.Time(100 - i * 10).FromTx(tx), view);
+        vecHashes.push_back(tx.GetHash());
+    }
+
+    std::vector<std::pair<uint160, int> > addresses = {{hashBytes, 1}, {otherBytes, 1}};
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > results;
+
+    BOOST_CHECK(pool.getAddressIndexByTime(addresses, results));
+    BOOST_CHECK_EQUAL(results.size(), 10U);
+
+    for (size_t i = 0; i < results.size(); i++) {
+        BOOST_CHECK(results[i].first.addressBytes == (i < 5 ? hashBytes : otherBytes));
+        BOOST_CHECK(results[i].first.txhash == vecHashes[4 - i % 5]);
+    }
+
+    addresses.pop_back();
+
+    results.clear();
+    BOOST_CHECK(pool.getAddressIndexByTime(addresses, results, 80));
+    BOOST_CHECK_EQUAL(results.size(), 3U);
+
+    pool.removeAddressIndex(vecHashes[0]);
+
+    results.clear();
+    BOOST_CHECK(pool.getAddressIndexByTime(addresses, results, 80));
+    BOOST_CHECK_EQUAL(results.size(), 2U);
+    BOOST_CHECK(results[1].first.txhash == vecHashes[1]);
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_load_block_index)
+{
+    typedef std::map<uint256, CBlockIndex*> LoadedBlockMap;
+    CBlockTreeDB db(1 << 20, true, true);
+    std::vector<CBlockIndex> vIndex(5001);
+    std::vector<uint256> vHashes(vIndex.size());
+    std::vector<const CBlockIndex*> vWrite;
+
+    // A chain of several batches, the proof of work of the heights below 223855 only has to be in range.
+    // The last block claims a target its hash doesn't meet.
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        CBlockIndex& index = vIndex[i];
+        index.pprev = i ? &vIndex[i - 1] : NULL;
+        index.nHeight = i + 1 < vIndex.size() ? i : 300000;
+        index.nVersion = 4;
+        index.hashMerkleRoot = GetRandHash();
+        index.nTime = 1500000000 + i * 55;
+        index.nBits = i + 1 < vIndex.size() ? 0x1e0ffff0 : 0x1b0404cb;
+        index.nStatus = BLOCK_VALID_TREE;
+        vHashes[i] = index.GetBlockHeader().GetHash();
+        index.phashBlock = &vHashes[i];
+        vWrite.push_back(&index);
+    }
+    BOOST_CHECK(db.WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, vWrite));
+
+    for (int nRun = 0; nRun < 2; nRun++) {
+        LoadedBlockMap mapLoaded;
+        std::vector<std::unique_ptr<CBlockIndex> > vLoaded;
+        auto insert = [&mapLoaded, &vLoaded](const uint256& hash, int nHeight) -> CBlockIndex* {
+            if (hash.IsNull())
+                return NULL;
+            LoadedBlockMap::iterator mi = mapLoaded.find(hash);
+            if (mi == mapLoaded.end()) {
+                vLoaded.emplace_back(new CBlockIndex());
+                mi = mapLoaded.insert(std::make_pair(hash, vLoaded.back().get())).first;
+                mi->second->phashBlock = &mi->first;
+            }
+            return mi->second;
+        };
+
+        // With the last block assumed valid its proof of work doesn't get checked again
+        if (nRun == 0) {
+            BOOST_CHECK(!db.LoadBlockIndexGuts(insert));
+            continue;
+        }
+        BOOST_CHECK(db.LoadBlockIndexGuts(insert, vHashes.back()));
+
+        BOOST_CHECK_EQUAL(mapLoaded.size(), vIndex.size());
+        for (size_t i = 0; i < vIndex.size(); i++) {
+            LoadedBlockMap::iterator mi = mapLoaded.find(vHashes[i]);
+            BOOST_REQUIRE(mi != mapLoaded.end());
+            BOOST_CHECK_EQUAL(mi->second->nHeight, vIndex[i].nHeight);
+            BOOST_CHECK(mi->second->hashMerkleRoot == vIndex[i].hashMerkleRoot);
+            BOOST_CHECK(i ? mi->second->pprev->GetBlockHash() == vHashes[i - 1] : mi->second->pprev == NULL);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_payout_pages)
+{
+    CBlockTreeDB db(1 << 20, true, true);
+    uint160 hashA = uint160(ParseHex("0102030405060708090a0b0c0d0e0f1011121314"));
+    uint160 hashB = uint160(ParseHex("1102030405060708090a0b0c0d0e0f1011121314"));
+
+    // Two payouts at height 300, the order of the heights doesn't depend on their bytes
+    std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > vecPayouts;
+    vecPayouts.push_back(std::make_pair(CPayoutIndexKey(1, hashA, 300, 2), CPayoutValue(PAYOUT_SMARTNODE, 3 * COIN)));
+    vecPayouts.push_back(std::make_pair(CPayoutIndexKey(1, hashA, 300, 0), CPayoutValue(PAYOUT_MINING, 1 * COIN)));
+    vecPayouts.push_back(std::make_pair(CPayoutIndexKey(1, hashA, 2, 0), CPayoutValue(PAYOUT_MINING, 1 * COIN)));
+    vecPayouts.push_back(std::make_pair(CPayoutIndexKey(1, hashA, 256, 5), CPayoutValue(PAYOUT_SMARTREWARDS, 2 * COIN)));
+    vecPayouts.push_back(std::make_pair(CPayoutIndexKey(1, hashB, 100, 0), CPayoutValue(PAYOUT_MINING, 1 * COIN)));
+
+    CDBBatch batch(db.IndexDB());
+    db.WritePayoutIndex(batch, vecPayouts);
+    BOOST_CHECK(db.IndexDB().WriteBatch(batch));
+
+    std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > vecRead;
+    BOOST_CHECK(db.ReadPayoutIndex(hashA, 1, 0, INT_MAX, PAYOUT_ALL, 0, vecRead));
+    BOOST_REQUIRE_EQUAL(vecRead.size(), 4U);
+    BOOST_CHECK_EQUAL(vecRead[0].first.blockHeight, 2);
+    BOOST_CHECK_EQUAL(vecRead[1].first.blockHeight, 256);
+    BOOST_CHECK_EQUAL(vecRead[2].first.nOut, 0U);
+    BOOST_CHECK_EQUAL(vecRead[3].first.nOut, 2U);
+    BOOST_CHECK_EQUAL(vecRead[3].second.satoshis, 3 * COIN);
+
+    // A page of two ends after height 256, one of three doesn't split height 300
+    vecRead.clear();
+    BOOST_CHECK(db.ReadPayoutIndex(hashA, 1, 0, INT_MAX, PAYOUT_ALL, 2, vecRead));
+    BOOST_CHECK_EQUAL(vecRead.size(), 2U);
+    vecRead.clear();
+    BOOST_CHECK(db.ReadPayoutIndex(hashA, 1, 0, INT_MAX, PAYOUT_ALL, 3, vecRead));
+    BOOST_CHECK_EQUAL(vecRead.size(), 4U);
+
+    // Height range and categories
+    vecRead.clear();
+    BOOST_CHECK(db.ReadPayoutIndex(hashA, 1, 3, 299, PAYOUT_ALL, 0, vecRead));
+    BOOST_REQUIRE_EQUAL(vecRead.size(), 1U);
+    BOOST_CHECK_EQUAL(vecRead[0].second.category, PAYOUT_SMARTREWARDS);
+    vecRead.clear();
+    BOOST_CHECK(db.ReadPayoutIndex(hashA, 1, 0, INT_MAX, PAYOUT_MINING, 0, vecRead));
+    BOOST_CHECK_EQUAL(vecRead.size(), 2U);
+
+    CDBBatch eraseBatch(db.IndexDB());
+    db.ErasePayoutIndex(eraseBatch, vecPayouts);
+    BOOST_CHECK(db.IndexDB().WriteBatch(eraseBatch));
+    vecRead.clear();
+    BOOST_CHECK(db.ReadPayoutIndex(hashB, 1, 0, INT_MAX, PAYOUT_ALL, 0, vecRead));
+    BOOST_CHECK(vecRead.empty());
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_payout_categories)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+
+    // A block paying the smartnodes
+    int nHeight = 2100000;
+    CAmount nodeReward = SmartNodePayments::Payment(nHeight);
+    BOOST_REQUIRE(nodeReward > 0);
+    CAmount perNode = nodeReward / std::max(SmartNodePayments::PayoutsPerBlock(nHeight), 1);
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.push_back(CTxOut(COIN, script));
+    coinbase.vout.push_back(CTxOut(0, CScript() << OP_RETURN));
+    coinbase.vout.push_back(CTxOut(perNode + 1, script));
+    coinbase.vout.push_back(CTxOut(perNode, script));
+
+    std::vector<int> vCategories;
+    SmartMining::GetPayoutCategories(CTransaction(coinbase), nHeight, vCategories);
+    BOOST_REQUIRE_EQUAL(vCategories.size(), 4U);
+    BOOST_CHECK_EQUAL(vCategories[0], PAYOUT_MINING);
+    BOOST_CHECK_EQUAL(vCategories[1], 0);
+    BOOST_CHECK_EQUAL(vCategories[2], PAYOUT_SMARTNODE);
+    // Only as many smartnode payments as the block has payees
+    if (SmartNodePayments::PayoutsPerBlock(nHeight) <= 1)
+        BOOST_CHECK_EQUAL(vCategories[3], PAYOUT_SMARTREWARDS);
+
+    // The output without an address doesn't get an entry
+    std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > vecPayouts;
+    GetPayoutIndexEntries(CTransaction(coinbase), nHeight, vecPayouts);
+    BOOST_CHECK_EQUAL(vecPayouts.size(), 3U);
+    BOOST_CHECK_EQUAL(vecPayouts[1].first.nOut, 2U);
+    BOOST_CHECK_EQUAL(vecPayouts[1].second.satoshis, perNode + 1);
+
+    int nMask = 0;
+    BOOST_CHECK(SmartMining::ParsePayoutCategories("smartnode,smartrewards", nMask));
+    BOOST_CHECK_EQUAL(nMask, PAYOUT_SMARTNODE | PAYOUT_SMARTREWARDS);
+    BOOST_CHECK(SmartMining::ParsePayoutCategories("all", nMask));
+    BOOST_CHECK_EQUAL(nMask, PAYOUT_ALL);
+    BOOST_CHECK(!SmartMining::ParsePayoutCategories("mining,fees", nMask));
+    BOOST_CHECK(!SmartMining::ParsePayoutCategories("", nMask));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,104 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bip39.h"
+#include "crypto/pbkdf2_hmac_sha512.h"
+#include "crypto/sha512.h"
+#include "utilstrencodings.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(bip39_tests, BasicTestingSetup)
+
+// Test vectors of the reference implementation, with the passphrase "TREZOR"
+static const char* const vMnemonicVectors[][2] = {
+    {"abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon about",
+     "c55257c360c07c72029aebc1b53c05ed0362ada38ead3e3e9efa3708e53495531f09a6987599d18264c1e1c92f2cf141630c7a3c4ab7c81b2f001698e7463b04"},
+    {"legal winner thank year wave sausage worth useful legal winner thank yellow",
+     "2e8905819b8723fe2c1d161860e5ee1830318dbf49a83bd451cfb8440c28bd6fa457fe1296106559a3c80937a1c1069be3a3a5bd381ee6260e8d9739fce1f607"},
+};
+
+BOOST_AUTO_TEST_CASE(bip39_check)
+{
+    for (const auto& vector : vMnemonicVectors) {
+        BOOST_CHECK(CMnemonic::Check(SecureString(vector[0])));
+    }
+    // The last word of the list
+    BOOST_CHECK(CMnemonic::Check(SecureString("zoo zoo zoo zoo zoo zoo zoo zoo zoo zoo zoo wrong")));
+
+    // Bad checksum, unknown word, prefix of a word, wrong number of words
+    BOOST_CHECK(!CMnemonic::Check(SecureString("abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon")));
+    BOOST_CHECK(!CMnemonic::Check(SecureString("abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon zzz")));
+    BOOST_CHECK(!CMnemonic::Check(SecureString("abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon abou")));
+    BOOST_CHECK(!CMnemonic::Check(SecureString("abandon abandon abandon abandon abandon abandon abandon abandon abandon abandon about")));
+    BOOST_CHECK(!CMnemonic::Check(SecureString()));
+}
+
+BOOST_AUTO_TEST_CASE(bip39_seeds)
+{
+    std::vector<SecureString> vMnemonics;
+    for (const auto& vector : vMnemonicVectors) {
+        SecureVector vchSeed;
+        CMnemonic::ToSeed(SecureString(vector[0]), SecureString("TREZOR"), vchSeed);
+        BOOST_CHECK_EQUAL(HexStr(vchSeed), vector[1]);
+        vMnemonics.push_back(SecureString(vector[0]));
+    }
+
+    // Batches of four plus a remainder, each seed has to match its own derivation
+    for (int i = 0; i < 7; i++) {
+        vMnemonics.push_back(vMnemonics[i % 2]);
+    }
+    std::vector<SecureVector> vSeeds;
+    CMnemonic::ToSeeds(vMnemonics, SecureString("TREZOR"), vSeeds);
+    BOOST_REQUIRE_EQUAL(vSeeds.size(), vMnemonics.size());
+    for (size_t i = 0; i < vSeeds.size(); i++) {
+        BOOST_CHECK_EQUAL(HexStr(vSeeds[i]), vMnemonicVectors[i % 2][1]);
+    }
+}
+
+static void TestPBKDF2SHA512(const std::string &pass, const std::string &salt, unsigned int iterations, const std::string &hexout) {
+    std::vector<unsigned char> expected = ParseHex(hexout);
+    std::vector<unsigned char> out(expected.size());
+    PBKDF2_HMAC_SHA512((const unsigned char*)pass.data(), pass.size(), (const unsigned char*)salt.data(), salt.size(), iterations, &out[0], out.size());
+    BOOST_CHECK(out == expected);
+}
+
+BOOST_AUTO_TEST_CASE(pbkdf2_hmac_sha512_testvectors) {
+    SHA512AutoDetect();
+
+    TestPBKDF2SHA512("password", "salt", 1,
+                     "867f70cf1ade02cff3752599a3a53dc4af34c7a669815ae5d513554e1c8cf252"
+                     "c02d470a285a0501bad999bfe943c08f050235d7d68b1da55e63f73b60a57fce");
+    TestPBKDF2SHA512("password", "salt", 2,
+                     "e1d9c16aa681708a45f5c7c4e215ceb66e011a2e9f0040713f18aefdb866d53c"
+                     "f76cab2868a39b9f7840edce4fef5a82be67335c77a6068e04112754f27ccf4e");
+    TestPBKDF2SHA512("passwordPASSWORDpassword", "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096,
+                     "8c0511f4c6e597c6ac6315d8f0362e225f3c501495ba23b868c005174dc4ee71"
+                     "115b59f9e60cd9532fa33e0f75aefe30225c583a186cd82bd4daea9724a3d3b8"
+                     "04f75bdd41494fa324cab24bcc680fb3b96a30cf5d21fac3c2875913919f3399"
+                     "b1d9ce7e");
+
+    // Four different passwords, one longer than the block size, have to come out like one at a time
+    std::string pass[4] = {"password", "passwordPASSWORDpassword", std::string(155, 'x'), ""};
+    const unsigned char* ppass[4];
+    size_t passlen[4];
+    std::vector<unsigned char> out[4];
+    unsigned char* pout[4];
+    for (int i = 0; i < 4; i++) {
+        ppass[i] = (const unsigned char*)pass[i].data();
+        passlen[i] = pass[i].size();
+        out[i].resize(100);
+        pout[i] = &out[i][0];
+    }
+    const std::string salt = "mnemonicTREZOR";
+    PBKDF2_HMAC_SHA512_4way(ppass, passlen, (const unsigned char*)salt.data(), salt.size(), 2048, pout, 100);
+    for (int i = 0; i < 4; i++) {
+        std::vector<unsigned char> expected(100);
+        PBKDF2_HMAC_SHA512(ppass[i], passlen[i], (const unsigned char*)salt.data(), salt.size(), 2048, &expected[0], expected.size());
+        BOOST_CHECK(out[i] == expected);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,141 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "coins.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/script.h"
+#include "streams.h"
+#include "undo.h"
+#include "test/test_bitcoin.h"
+
+#include <ios>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_match)
+{
+    CGCSFilter::ElementSet included, excluded;
+    for (int i = 0; i < 100; ++i) {
+        uint256 hash = GetRandHash();
+        included.insert(CGCSFilter::Element(hash.begin(), hash.end()));
+        hash = GetRandHash();
+        excluded.insert(CGCSFilter::Element(hash.begin(), hash.end()));
+    }
+
+    CGCSFilter filter(0, 0, 10, 1 << 10, included);
+    BOOST_CHECK_EQUAL(filter.GetN(), 100);
+    for (const CGCSFilter::Element& element : included)
+        BOOST_CHECK(filter.Match(element));
+    BOOST_CHECK(filter.MatchAny(included));
+
+    // Decoded from its encoding it still matches the same
+    CGCSFilter decoded(0, 0, 10, 1 << 10, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100);
+    BOOST_CHECK(decoded.GetEncoded() == filter.GetEncoded());
+    for (const CGCSFilter::Element& element : included)
+        BOOST_CHECK(decoded.Match(element));
+
+    // A false positive of each of the other elements has a probability of 1/1024
+    int nFalsePositives = 0;
+    for (const CGCSFilter::Element& element : excluded)
+        nFalsePositives += decoded.Match(element);
+    BOOST_CHECK(nFalsePositives < 10);
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_encoding)
+{
+    // N of zero and nothing else
+    CGCSFilter empty;
+    BOOST_CHECK_EQUAL(empty.GetN(), 0);
+    BOOST_CHECK(empty.GetEncoded() == std::vector<unsigned char>(1, 0));
+    BOOST_CHECK(!empty.Match(CGCSFilter::Element(1, 1)));
+
+    CGCSFilter emptySet(0, 0, BASIC_FILTER_P, BASIC_FILTER_M, CGCSFilter::ElementSet());
+    BOOST_CHECK(emptySet.GetEncoded() == empty.GetEncoded());
+
+    // Five elements announced, the coded set missing
+    std::vector<unsigned char> vchTruncated(1, 5);
+    BOOST_CHECK_THROW(CGCSFilter(0, 0, BASIC_FILTER_P, BASIC_FILTER_M, vchTruncated), std::ios_base::failure);
+
+    CGCSFilter::ElementSet elements;
+    elements.insert(CGCSFilter::Element(20, 1));
+    elements.insert(CGCSFilter::Element(20, 2));
+    CGCSFilter filter(0, 0, BASIC_FILTER_P, BASIC_FILTER_M, elements);
+    std::vector<unsigned char> vchEncoded = filter.GetEncoded();
+    vchEncoded.resize(vchEncoded.size() - 1);
+    BOOST_CHECK_THROW(CGCSFilter(0, 0, BASIC_FILTER_P, BASIC_FILTER_M, vchEncoded), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic)
+{
+    CScript scriptOutput = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CScript scriptSpent = CScript() << OP_HASH160 << std::vector<unsigned char>(20, 2) << OP_EQUAL;
+    CScript scriptData = CScript() << OP_RETURN << std::vector<unsigned char>(4, 3);
+    CScript scriptUnspent = CScript() << OP_HASH160 << std::vector<unsigned char>(20, 4) << OP_EQUAL;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.push_back(CTxOut(COIN, scriptOutput));
+    coinbase.vout.push_back(CTxOut(0, scriptData));
+    coinbase.vout.push_back(CTxOut(0, CScript()));
+
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    tx.vout.push_back(CTxOut(COIN, scriptOutput));
+
+    CBlock block;
+    block.nNonce = 1;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    // The coinbase has no undo entry, only the spend of the second transaction
+    CBlockUndo blockUndo;
+    blockUndo.vtxundo.resize(1);
+    blockUndo.vtxundo[0].vprevout.push_back(Coin(CTxOut(COIN, scriptSpent), 1, false));
+
+    CBlockFilter blockFilter(BLOCK_FILTER_BASIC, block, blockUndo);
+    const CGCSFilter& filter = blockFilter.GetFilter();
+    BOOST_CHECK(blockFilter.GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(filter.GetN(), 2);
+    BOOST_CHECK(filter.Match(CGCSFilter::Element(scriptOutput.begin(), scriptOutput.end())));
+    BOOST_CHECK(filter.Match(CGCSFilter::Element(scriptSpent.begin(), scriptSpent.end())));
+    BOOST_CHECK(!filter.Match(CGCSFilter::Element(scriptData.begin(), scriptData.end())));
+    BOOST_CHECK(!filter.Match(CGCSFilter::Element(scriptUnspent.begin(), scriptUnspent.end())));
+
+    // Round trip in the format of the cfilter message
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << blockFilter;
+    CBlockFilter received;
+    ss >> received;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK_EQUAL(received.GetFilterType(), BLOCK_FILTER_BASIC);
+    BOOST_CHECK(received.GetBlockHash() == blockFilter.GetBlockHash());
+    BOOST_CHECK(received.GetEncodedFilter() == blockFilter.GetEncodedFilter());
+    BOOST_CHECK(received.GetFilter().Match(CGCSFilter::Element(scriptSpent.begin(), scriptSpent.end())));
+
+    // Headers chain up with the filter hashes
+    uint256 hashFilter = blockFilter.GetHash();
+    std::vector<unsigned char> vchEncoded = blockFilter.GetEncodedFilter();
+    BOOST_CHECK(hashFilter == Hash(vchEncoded.begin(), vchEncoded.end()));
+
+    uint256 genesisHeader = blockFilter.ComputeHeader(uint256());
+    BOOST_CHECK(genesisHeader == Hash(hashFilter.begin(), hashFilter.end(), uint256().begin(), uint256().end()));
+    uint256 nextHeader = ComputeBlockFilterHeader(hashFilter, genesisHeader);
+    BOOST_CHECK(nextHeader == blockFilter.ComputeHeader(genesisHeader));
+    BOOST_CHECK(nextHeader != genesisHeader);
+
+    BlockFilterType filterType;
+    BOOST_CHECK(BlockFilterTypeByName(BlockFilterTypeName(BLOCK_FILTER_BASIC), filterType));
+    BOOST_CHECK_EQUAL(filterType, BLOCK_FILTER_BASIC);
+    BOOST_CHECK(!BlockFilterTypeByName("extended", filterType));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
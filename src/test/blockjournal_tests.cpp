@@ -0,0 +1,73 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockjournal.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockjournal_tests, TestingSetup)
+
+static CBlockJournalRecord Record(int nHeight)
+{
+    CBlockJournalRecord record;
+    record.nHeight = nHeight;
+    record.hash = GetRandHash();
+    record.nTx = nHeight + 1;
+    record.nTimeTotal = 1000 * nHeight;
+    record.nCoinsHits = 3;
+    record.nCoinsMisses = 1;
+    return record;
+}
+
+BOOST_AUTO_TEST_CASE(blockjournal_recent)
+{
+    CBlockJournal journal;
+
+    for (size_t i = 0; i < BLOCK_JOURNAL_RECORDS + 5; i++) {
+        journal.Add(Record(i));
+    }
+
+    std::vector<CBlockJournalRecord> vRecords = journal.GetRecent(3);
+    BOOST_REQUIRE_EQUAL(vRecords.size(), 3U);
+    BOOST_CHECK_EQUAL(vRecords[0].nHeight, (int)BLOCK_JOURNAL_RECORDS + 4);
+    BOOST_CHECK_EQUAL(vRecords[2].nHeight, (int)BLOCK_JOURNAL_RECORDS + 2);
+
+    // The oldest ones are gone
+    vRecords = journal.GetRecent(BLOCK_JOURNAL_RECORDS * 2);
+    BOOST_REQUIRE_EQUAL(vRecords.size(), BLOCK_JOURNAL_RECORDS);
+    BOOST_CHECK_EQUAL(vRecords.back().nHeight, 5);
+}
+
+BOOST_AUTO_TEST_CASE(blockjournal_rotate)
+{
+    boost::filesystem::path path = pathTemp / "blockjournal.csv";
+    std::string strLine = Record(100).ToCSV();
+    size_t nHeader = CBlockJournalRecord::CSVHeader().size();
+
+    CBlockJournal journal;
+    // Room for the header and two records of the same length
+    BOOST_REQUIRE(journal.Open(path, nHeader + 2 * strLine.size()));
+
+    for (int i = 100; i < 105; i++) {
+        journal.Add(Record(i));
+    }
+    journal.Close();
+
+    // 100 and 101, 102 and 103, 104 in the current one
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nHeader + strLine.size());
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path.string() + ".1"), nHeader + 2 * strLine.size());
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path.string() + ".2"), nHeader + 2 * strLine.size());
+    BOOST_CHECK(!boost::filesystem::exists(path.string() + ".3"));
+
+    // Reopening appends without another header
+    BOOST_REQUIRE(journal.Open(path, 0));
+    journal.Add(Record(105));
+    journal.Close();
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size(path), nHeader + 2 * strLine.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,81 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockscripts.h"
+#include "coins.h"
+#include "key.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockscripts_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockscripts_decode)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CKeyID keyID = key.GetPubKey().GetID();
+    CScript scriptKeyHash = GetScriptForDestination(keyID);
+    CScript scriptMultisig = GetScriptForMultisig(1, std::vector<CPubKey>(2, key.GetPubKey()));
+
+    CDecodedScript keyHash(scriptKeyHash);
+    BOOST_CHECK_EQUAL(keyHash.addressType, 1);
+    BOOST_CHECK(keyHash.hashBytes == uint160(keyID));
+    BOOST_CHECK(keyHash.fDestination);
+    BOOST_CHECK(keyHash.id == CSmartAddress(keyID));
+
+    CDecodedScript multisig(scriptMultisig);
+    BOOST_CHECK_EQUAL(multisig.addressType, 0);
+    BOOST_CHECK(multisig.hashBytes.IsNull());
+    BOOST_CHECK(!multisig.fDestination);
+
+    // One output in the view, the block spends it and then an output of its own
+    CCoinsView base;
+    CCoinsViewCache view(&base);
+    COutPoint prevout(GetRandHash(), 0);
+    view.AddCoin(prevout, Coin(CTxOut(COIN, scriptKeyHash), 1, false), false);
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    coinbase.vout.push_back(CTxOut(COIN, scriptMultisig));
+
+    CMutableTransaction parent;
+    parent.vin.push_back(CTxIn(prevout));
+    parent.vout.push_back(CTxOut(COIN, scriptMultisig));
+    parent.vout.push_back(CTxOut(COIN, scriptKeyHash));
+
+    CMutableTransaction child;
+    child.vin.push_back(CTxIn(COutPoint(parent.GetHash(), 1)));
+    child.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    child.vout.push_back(CTxOut(COIN, scriptKeyHash));
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(MakeTransactionRef(parent));
+    block.vtx.push_back(MakeTransactionRef(child));
+
+    CDecodedBlockScripts scripts;
+    scripts.Decode(block, view);
+
+    BOOST_CHECK(!scripts.HaveInputs(0));
+    BOOST_CHECK(!scripts.Output(0, 0).fDestination);
+
+    BOOST_CHECK(scripts.HaveInputs(1));
+    BOOST_CHECK(scripts.Input(1, 0).id == CSmartAddress(keyID));
+    BOOST_CHECK_EQUAL(scripts.Output(1, 0).addressType, 0);
+    BOOST_CHECK_EQUAL(scripts.Output(1, 1).addressType, 1);
+
+    // Spent from the block itself, the missing input decodes to nothing
+    BOOST_CHECK(scripts.Input(2, 0).id == CSmartAddress(keyID));
+    BOOST_CHECK_EQUAL(scripts.Input(2, 0).addressType, 1);
+    BOOST_CHECK(!scripts.Input(2, 1).fDestination);
+    BOOST_CHECK_EQUAL(scripts.Input(2, 1).addressType, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,95 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blocksummary.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blocksummary_tests, BasicTestingSetup)
+
+static CBlockSummary Summary(int nHeight, const uint256& hash)
+{
+    CBlockSummary summary;
+    summary.hash = hash;
+    summary.nHeight = nHeight;
+    summary.nTx = nHeight + 1;
+    summary.fHavePayouts = true;
+    return summary;
+}
+
+BOOST_AUTO_TEST_CASE(blocksummary_cache_ring)
+{
+    CBlockSummaryCache cache(10);
+    std::vector<uint256> hashes;
+    CBlockSummary summary;
+
+    for (int i = 0; i < 25; i++) {
+        hashes.push_back(GetRandHash());
+        cache.Add(Summary(i, hashes.back()));
+    }
+
+    // Only the last ten heights are left.
+    for (int i = 0; i < 15; i++) {
+        BOOST_CHECK(!cache.Get(i, hashes[i], summary));
+    }
+
+    for (int i = 15; i < 25; i++) {
+        BOOST_CHECK(cache.Get(i, hashes[i], summary));
+        BOOST_CHECK(summary.hash == hashes[i]);
+        BOOST_CHECK_EQUAL(summary.nTx, (unsigned int)i + 1);
+    }
+
+    // A block of another chain at the same height doesn't match.
+    BOOST_CHECK(!cache.Get(20, GetRandHash(), summary));
+
+    uint256 hashReorg = GetRandHash();
+    cache.Add(Summary(20, hashReorg));
+    BOOST_CHECK(!cache.Get(20, hashes[20], summary));
+    BOOST_CHECK(cache.Get(20, hashReorg, summary));
+
+    BOOST_CHECK(!cache.Get(-1, uint256(), summary));
+}
+
+BOOST_AUTO_TEST_CASE(blocksummary_serialize)
+{
+    CBlockSummary summary = Summary(1234, GetRandHash());
+    summary.nTime = 1600000000;
+    summary.nSize = 4321;
+    summary.nFees = 100;
+    summary.nMiningReward = 200;
+    summary.nHiveReward = 300;
+    summary.nSmartnodeReward = 400;
+    summary.nSmartRewardsReward = 500;
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << summary;
+    size_t nFullSize = ss.size();
+    CBlockSummary read;
+    ss >> read;
+
+    BOOST_CHECK(read.hash == summary.hash);
+    BOOST_CHECK_EQUAL(read.nHeight, 1234);
+    BOOST_CHECK_EQUAL(read.nTime, 1600000000);
+    BOOST_CHECK_EQUAL(read.nSize, 4321U);
+    BOOST_CHECK(read.fHavePayouts);
+    BOOST_CHECK_EQUAL(read.nFees, 100);
+    BOOST_CHECK_EQUAL(read.nSmartRewardsReward, 500);
+
+    // Without the payouts only the block figures get stored
+    summary.fHavePayouts = false;
+    CDataStream ssShort(SER_DISK, CLIENT_VERSION);
+    ssShort << summary;
+    BOOST_CHECK_EQUAL(ssShort.size(), nFullSize - 5 * sizeof(CAmount));
+    CBlockSummary readShort;
+    ssShort >> readShort;
+    BOOST_CHECK(readShort.hash == summary.hash);
+    BOOST_CHECK(!readShort.fHavePayouts);
+    BOOST_CHECK_EQUAL(readShort.nFees, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
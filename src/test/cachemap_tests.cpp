@@ -0,0 +1,176 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cachemap.h"
+#include "cachemultimap.h"
+#include "clientversion.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <functional>
+#include <list>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cachemap_tests, BasicTestingSetup)
+
+typedef CacheMap<int, int, std::hash<int> > IntCacheMap;
+typedef CacheMultiMap<int, int, std::hash<int> > IntCacheMultiMap;
+
+static std::vector<int> Keys(const IntCacheMap::list_t& listItems)
+{
+    std::vector<int> vecKeys;
+    for (const auto& item : listItems) {
+        vecKeys.push_back(item.key);
+    }
+    return vecKeys;
+}
+
+BOOST_AUTO_TEST_CASE(cachemap_prune_and_touch)
+{
+    IntCacheMap cache(3);
+
+    BOOST_CHECK(cache.Insert(1, 10));
+    BOOST_CHECK(cache.Insert(2, 20));
+    BOOST_CHECK(cache.Insert(3, 30));
+    BOOST_CHECK(!cache.Insert(2, 21));
+    BOOST_CHECK_EQUAL(cache.GetSize(), 3U);
+
+    // 1 is the oldest, touching it makes 2 go first.
+    BOOST_CHECK(cache.Touch(1));
+    BOOST_CHECK(cache.Insert(4, 40));
+    BOOST_CHECK(!cache.HasKey(2));
+    BOOST_CHECK(cache.HasKey(1));
+    BOOST_CHECK((Keys(cache.GetItemList()) == std::vector<int>{4, 1, 3}));
+
+    int nValue = 0;
+    BOOST_CHECK(cache.Get(3, nValue));
+    BOOST_CHECK_EQUAL(nValue, 30);
+
+    cache.Erase(1);
+    BOOST_CHECK(!cache.Get(1, nValue));
+    BOOST_CHECK_EQUAL(cache.GetSize(), 2U);
+
+    // The erased slot gets reused, the order is kept.
+    BOOST_CHECK(cache.Insert(5, 50));
+    BOOST_CHECK((Keys(cache.GetItemList()) == std::vector<int>{5, 4, 3}));
+}
+
+BOOST_AUTO_TEST_CASE(cachemap_erase_while_iterating)
+{
+    IntCacheMap cache(100);
+
+    for (int i = 0; i < 50; i++) {
+        cache.Insert(i, i % 2);
+    }
+
+    const IntCacheMap::list_t& listItems = cache.GetItemList();
+    IntCacheMap::list_cit it = listItems.begin();
+    while (it != listItems.end()) {
+        int nKey = it->key;
+        bool fErase = it->value == 1;
+        ++it;
+        if (fErase) cache.Erase(nKey);
+    }
+
+    BOOST_CHECK_EQUAL(cache.GetSize(), 25U);
+    for (const auto& item : cache.GetItemList()) {
+        BOOST_CHECK_EQUAL(item.key % 2, 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(cachemap_serialization)
+{
+    IntCacheMap cache(10);
+    for (int i = 0; i < 20; i++) {
+        cache.Insert(i, i * 10);
+    }
+
+    // Same format as the std::list the items were kept in before.
+    std::list<CacheItem<int, int> > listItems;
+    for (int i = 19; i >= 10; i--) {
+        listItems.push_back(CacheItem<int, int>(i, i * 10));
+    }
+
+    CDataStream ssCache(SER_DISK, CLIENT_VERSION);
+    ssCache << cache;
+
+    CDataStream ssList(SER_DISK, CLIENT_VERSION);
+    ssList << uint32_t(10) << listItems;
+
+    BOOST_CHECK(ssCache.str() == ssList.str());
+    BOOST_CHECK_EQUAL(::GetSerializeSize(cache, SER_DISK, CLIENT_VERSION), ssList.size());
+
+    IntCacheMap loaded;
+    ssList >> loaded;
+
+    BOOST_CHECK_EQUAL(loaded.GetMaxSize(), 10U);
+    BOOST_CHECK(Keys(loaded.GetItemList()) == Keys(cache.GetItemList()));
+
+    int nValue = 0;
+    BOOST_CHECK(loaded.Get(15, nValue));
+    BOOST_CHECK_EQUAL(nValue, 150);
+    BOOST_CHECK(!loaded.HasKey(9));
+}
+
+BOOST_AUTO_TEST_CASE(cachemultimap_values)
+{
+    IntCacheMultiMap cache(4);
+
+    BOOST_CHECK(cache.Insert(1, 30));
+    BOOST_CHECK(cache.Insert(1, 10));
+    BOOST_CHECK(cache.Insert(1, 20));
+    BOOST_CHECK(!cache.Insert(1, 10));
+    BOOST_CHECK(cache.Insert(2, 5));
+
+    // Values of a key come ordered.
+    std::vector<int> vecValues;
+    BOOST_CHECK(cache.GetAll(1, vecValues));
+    BOOST_CHECK((vecValues == std::vector<int>{10, 20, 30}));
+
+    int nValue = 0;
+    BOOST_CHECK(cache.Get(1, nValue));
+    BOOST_CHECK_EQUAL(nValue, 10);
+
+    // (1, 30) is the oldest item.
+    BOOST_CHECK(cache.Insert(3, 7));
+    vecValues.clear();
+    BOOST_CHECK(cache.GetAll(1, vecValues));
+    BOOST_CHECK((vecValues == std::vector<int>{10, 20}));
+
+    cache.Erase(1, 10);
+    cache.Erase(1, 20);
+    BOOST_CHECK(!cache.HasKey(1));
+    BOOST_CHECK_EQUAL(cache.GetSize(), 2U);
+
+    cache.Erase(2);
+    BOOST_CHECK(!cache.HasKey(2));
+    BOOST_CHECK_EQUAL(cache.GetSize(), 1U);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << cache;
+    IntCacheMultiMap loaded;
+    ss >> loaded;
+    BOOST_CHECK(loaded.Get(3, nValue));
+    BOOST_CHECK_EQUAL(nValue, 7);
+}
+
+BOOST_AUTO_TEST_CASE(cachemap_memory_usage)
+{
+    IntCacheMap cache(1000);
+    IntCacheMultiMap multiCache(1000);
+    size_t nUsage = cache.DynamicMemoryUsage();
+    size_t nMultiUsage = multiCache.DynamicMemoryUsage();
+
+    for (int i = 0; i < 1000; ++i) {
+        cache.Insert(i, i);
+        multiCache.Insert(i % 10, i);
+    }
+
+    // At least the items themselves, the multimap also keeps a vector of positions per key
+    BOOST_CHECK(cache.DynamicMemoryUsage() >= nUsage + 1000 * 2 * sizeof(int));
+    BOOST_CHECK(multiCache.DynamicMemoryUsage() >= nMultiUsage + 1000 * (2 * sizeof(int) + sizeof(uint32_t)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,109 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+/** Counts its runs, fails if told to */
+struct CCountingCheck
+{
+    std::atomic<int>* pnRuns;
+    bool fOk;
+
+    CCountingCheck() : pnRuns(NULL), fOk(true) {}
+    CCountingCheck(std::atomic<int>& nRuns, bool fOkIn) : pnRuns(&nRuns), fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        if (pnRuns)
+            ++*pnRuns;
+        return fOk;
+    }
+
+    void swap(CCountingCheck& check)
+    {
+        std::swap(pnRuns, check.pnRuns);
+        std::swap(fOk, check.fOk);
+    }
+};
+
+/** Runs rounds of nChecks added in pieces of nPiece, nFail fails if it isn't negative */
+static bool RunRound(CCheckQueue<CCountingCheck>& queue, std::atomic<int>& nRuns, int nChecks, int nPiece, int nFail = -1)
+{
+    CCheckQueueControl<CCountingCheck> control(&queue);
+    for (int i = 0; i < nChecks; i += nPiece) {
+        std::vector<CCountingCheck> vChecks;
+        for (int j = i; j < std::min(nChecks, i + nPiece); j++)
+            vChecks.push_back(CCountingCheck(nRuns, j != nFail));
+        control.Add(vChecks);
+        BOOST_CHECK(!vChecks.size() || !vChecks.back().pnRuns);
+    }
+    return control.Wait();
+}
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_run)
+{
+    CCheckQueue<CCountingCheck> queue(128);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 8; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<CCountingCheck>::Thread, boost::ref(queue)));
+
+    // Small rounds, big ones and more than the queues hold at first
+    const int vRounds[] = {1, 2, 17, 1000, 20000, 0, 3};
+    for (int nChecks : vRounds) {
+        for (int nPiece : {1, 7, 5000}) {
+            std::atomic<int> nRuns(0);
+            BOOST_CHECK(RunRound(queue, nRuns, nChecks, nPiece));
+            BOOST_CHECK_EQUAL(nRuns.load(), nChecks);
+            BOOST_CHECK(queue.IsIdle());
+        }
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CCheckQueue<CCountingCheck> queue(16);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 4; i++)
+        threadGroup.create_thread(boost::bind(&CCheckQueue<CCountingCheck>::Thread, boost::ref(queue)));
+
+    for (int nFail : {0, 499, 999}) {
+        std::atomic<int> nRuns(0);
+        BOOST_CHECK(!RunRound(queue, nRuns, 1000, 10, nFail));
+        // The failure doesn't stick to the next round
+        BOOST_CHECK(queue.IsIdle());
+        nRuns = 0;
+        BOOST_CHECK(RunRound(queue, nRuns, 1000, 10));
+        BOOST_CHECK_EQUAL(nRuns.load(), 1000);
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_master_only)
+{
+    // Without workers the master runs everything in Wait, or in Add once its queue is full
+    CCheckQueue<CCountingCheck> queue(128);
+    std::atomic<int> nRuns(0);
+    BOOST_CHECK(RunRound(queue, nRuns, 3 * CHECKQUEUE_INITIAL_CAPACITY, 100));
+    BOOST_CHECK_EQUAL(nRuns.load(), 3 * CHECKQUEUE_INITIAL_CAPACITY);
+    nRuns = 0;
+    BOOST_CHECK(!RunRound(queue, nRuns, 10, 3, 5));
+    BOOST_CHECK(queue.IsIdle());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
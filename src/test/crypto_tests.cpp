@@ -3,12 +3,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "crypto/aes.h"
+#include "crypto/keccak256.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
@@ -439,4 +441,22 @@ BOOST_AUTO_TEST_CASE(aes_cbc_testvectors) {
                   "b2eb05e2c39be9fcda6c19078c6a9d1b3f461796d6b0d6b2e0c2a72b4d80e644");
 }
 
+BOOST_AUTO_TEST_CASE(keccak256_80_many) {
+    Keccak256AutoDetect();
+
+    // Counts around the multi-way widths, each hash has to match the single one
+    std::vector<unsigned char> vData(80 * 11);
+    for (size_t i = 0; i < vData.size(); i++) {
+        vData[i] = insecure_rand();
+    }
+
+    for (size_t nCount = 0; nCount <= 11; nCount++) {
+        std::vector<uint256> vHashes(nCount);
+        HashKeccakMany(vHashes.data(), vData.data(), nCount);
+        for (size_t i = 0; i < nCount; i++) {
+            BOOST_CHECK(vHashes[i] == HashKeccak(vData.begin() + 80 * i, vData.begin() + 80 * (i + 1)));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,110 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "uint256.h"
+
+#include <cstring>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+namespace {
+
+struct CTestHasher {
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+typedef CuckooCache::cache<uint256, CTestHasher> TestCache;
+
+std::vector<uint256> RandomHashes(size_t nCount)
+{
+    FastRandomContext ctx(true);
+    std::vector<uint256> vHashes(nCount);
+    for (uint256& hash : vHashes) {
+        for (unsigned char& c : hash) {
+            c = ctx.rand32();
+        }
+    }
+    return vHashes;
+}
+
+//! Share of the hashes found in the cache
+double HitRate(const TestCache& cache, const std::vector<uint256>& vHashes, size_t nBegin, size_t nEnd)
+{
+    size_t nHits = 0;
+    for (size_t i = nBegin; i < nEnd; i++) {
+        nHits += cache.contains(vHashes[i], false);
+    }
+    return nEnd > nBegin ? (double)nHits / (nEnd - nBegin) : 0;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_insert_contains)
+{
+    TestCache cache;
+    uint32_t nSize = cache.setup_bytes(1 << 20);
+    BOOST_CHECK_EQUAL(nSize, (1U << 20) / sizeof(uint256));
+
+    // Half full, practically everything fits
+    std::vector<uint256> vHashes = RandomHashes(nSize / 2);
+    for (const uint256& hash : vHashes) {
+        cache.insert(hash);
+    }
+    BOOST_CHECK(HitRate(cache, vHashes, 0, vHashes.size()) > 0.99);
+    BOOST_CHECK(!cache.contains(uint256S("1234"), false));
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_erase)
+{
+    TestCache cache;
+    uint32_t nSize = cache.setup(1 << 14);
+    std::vector<uint256> vHashes = RandomHashes(nSize);
+
+    // Less than two generations of inserts, none of them gets evicted
+    for (size_t i = 0; i < nSize / 4; i++) {
+        cache.insert(vHashes[i]);
+    }
+    // Erased entries are still found until their slot gets reused
+    for (size_t i = 0; i < nSize / 8; i++) {
+        BOOST_CHECK(cache.contains(vHashes[i], true));
+    }
+    BOOST_CHECK(HitRate(cache, vHashes, 0, nSize / 8) == 1.0);
+
+    // Inserting them again keeps them
+    for (size_t i = 0; i < nSize / 8; i++) {
+        cache.insert(vHashes[i]);
+    }
+    for (size_t i = nSize / 4; i < nSize * 3 / 8; i++) {
+        cache.insert(vHashes[i]);
+    }
+    BOOST_CHECK(HitRate(cache, vHashes, 0, nSize * 3 / 8) > 0.99);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_generations)
+{
+    TestCache cache;
+    uint32_t nSize = cache.setup(1 << 14);
+
+    // Three times as many as fit, the newest ones have to win
+    std::vector<uint256> vHashes = RandomHashes(nSize * 3);
+    for (const uint256& hash : vHashes) {
+        cache.insert(hash);
+    }
+    BOOST_CHECK(HitRate(cache, vHashes, vHashes.size() - nSize / 4, vHashes.size()) > 0.95);
+    BOOST_CHECK(HitRate(cache, vHashes, 0, nSize) < 0.05);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -127,6 +127,35 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
 }
 
 // Test that we do not obfuscation if there is existing data.
+BOOST_AUTO_TEST_CASE(dbwrapper_iterator_seek_for_prev)
+{
+    path ph = temp_directory_path() / unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false, true);
+
+    for (char key = 'j'; key <= 'n'; key += 2) {
+        BOOST_CHECK(dbw.Write(key, (int)key));
+    }
+
+    boost::scoped_ptr<CDBIterator> it(const_cast<CDBWrapper*>(&dbw)->NewIterator());
+    char key_res;
+
+    // An existing key is a match, missing ones land on the closest key before them.
+    it->SeekForPrev('l');
+    BOOST_CHECK(it->Valid() && it->GetKey(key_res) && key_res == 'l');
+
+    it->SeekForPrev('m');
+    BOOST_CHECK(it->Valid() && it->GetKey(key_res) && key_res == 'l');
+
+    it->SeekForPrev('z');
+    BOOST_CHECK(it->Valid() && it->GetKey(key_res) && key_res == 'n');
+
+    it->Prev();
+    BOOST_CHECK(it->Valid() && it->GetKey(key_res) && key_res == 'l');
+
+    it->SeekToLast();
+    BOOST_CHECK(it->Valid() && it->GetKey(key_res) && key_res == 'n');
+}
+
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
     // We're going to share this path between two wrappers
@@ -167,6 +196,33 @@ BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
     BOOST_CHECK_EQUAL(res3.ToString(), in2.ToString());
 }
                         
+BOOST_AUTO_TEST_CASE(dbwrapper_compaction_thread)
+{
+    path ph = temp_directory_path() / unique_path();
+    create_directories(ph);
+    mapArgs["-dbcompactionnice"] = "10";
+
+    // Several times LevelDB's smallest write buffer, so the writes flush level 0 tables
+    // and trigger compactions, which run in the thread of the database.
+    std::vector<uint256> vecValues;
+    {
+        CDBWrapper dbw(ph, (1 << 10), false, false, false);
+        for (int i = 0; i < 20000; i++) {
+            vecValues.push_back(GetRandHash());
+            BOOST_CHECK(dbw.Write(std::make_pair('k', i), vecValues.back()));
+        }
+    }
+
+    CDBWrapper dbw(ph, (1 << 10), false, false, false);
+    for (int i = 0; i < 20000; i++) {
+        uint256 res;
+        BOOST_CHECK(dbw.Read(std::make_pair('k', i), res));
+        BOOST_CHECK(res == vecValues[i]);
+    }
+
+    mapArgs.erase("-dbcompactionnice");
+}
+
 // Ensure that we start obfuscating during a reindex.
 BOOST_AUTO_TEST_CASE(existing_data_reindex)
 {
@@ -0,0 +1,110 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "smartnode/flat-database.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flatdb_tests, TestingSetup)
+
+/** Large enough to span several chunks. */
+struct FlatObject
+{
+    std::vector<uint64_t> vecValues;
+    int nCleaned = 0;
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(vecValues);
+    }
+
+    void Clear() { vecValues.clear(); }
+    void CheckAndRemove() { nCleaned++; }
+    std::string ToString() const { return strprintf("Values: %d", vecValues.size()); }
+};
+
+static FlatObject CreateObject()
+{
+    FlatObject obj;
+    for (uint64_t i = 0; i < 3 * FLATDB_CHUNK_SIZE / sizeof(uint64_t); i++) {
+        obj.vecValues.push_back(i * 7919);
+    }
+    return obj;
+}
+
+static void FlipByte(const boost::filesystem::path& path, long nOffset)
+{
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    fseek(file, nOffset, SEEK_SET);
+    int ch = fgetc(file);
+    fseek(file, nOffset, SEEK_SET);
+    fputc(ch ^ 0xff, file);
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(flatdb_chunked_roundtrip)
+{
+    FlatObject obj = CreateObject();
+    CFlatDB<FlatObject> flatdb("flattest.dat", "magicFlatTest");
+    BOOST_CHECK(flatdb.Dump(obj));
+    BOOST_CHECK(!boost::filesystem::exists(GetDataDir() / "flattest.dat.new"));
+
+    FlatObject read;
+    BOOST_CHECK(flatdb.Load(read));
+    BOOST_CHECK(read.vecValues == obj.vecValues);
+    BOOST_CHECK_EQUAL(read.nCleaned, 1);
+
+    // Another magic message must neither load nor overwrite the file.
+    CFlatDB<FlatObject> otherdb("flattest.dat", "magicOtherTest");
+    BOOST_CHECK(!otherdb.Load(read));
+    BOOST_CHECK(!otherdb.Dump(obj));
+
+    // A corrupted chunk leaves the object empty.
+    FlipByte(GetDataDir() / "flattest.dat", FLATDB_CHUNK_SIZE + 100);
+    BOOST_CHECK(!flatdb.Load(read));
+    BOOST_CHECK(read.vecValues.empty());
+
+    // The header is still fine, the file gets replaced.
+    BOOST_CHECK(flatdb.Dump(obj));
+    BOOST_CHECK(flatdb.Load(read));
+    BOOST_CHECK(read.vecValues == obj.vecValues);
+}
+
+BOOST_AUTO_TEST_CASE(flatdb_legacy_format)
+{
+    FlatObject obj = CreateObject();
+
+    // Previous format: header and data with one hash at the end.
+    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
+    ssObj << std::string("magicFlatTest");
+    ssObj << FLATDATA(Params().MessageStart());
+    ssObj << obj;
+    uint256 hash = Hash(ssObj.begin(), ssObj.end());
+    ssObj << hash;
+
+    {
+        CAutoFile fileout(fopen((GetDataDir() / "flatlegacy.dat").string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!fileout.IsNull());
+        fileout.write(&ssObj[0], ssObj.size());
+    }
+
+    CFlatDB<FlatObject> flatdb("flatlegacy.dat", "magicFlatTest");
+    FlatObject read;
+    BOOST_CHECK(flatdb.Load(read));
+    BOOST_CHECK(read.vecValues == obj.vecValues);
+
+    // Dumps rewrite it in the chunked format.
+    BOOST_CHECK(flatdb.Dump(read));
+    CAutoFile filein(fopen((GetDataDir() / "flatlegacy.dat").string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    unsigned char pchSignature[4];
+    filein >> FLATDATA(pchSignature);
+    BOOST_CHECK(!memcmp(pchSignature, FLATDB_SIGNATURE, sizeof(pchSignature)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
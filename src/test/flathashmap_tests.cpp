@@ -0,0 +1,125 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flathashmap.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <map>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flathashmap_tests, BasicTestingSetup)
+
+/** Deliberately weak hasher to get lots of collisions. */
+struct CollidingHasher
+{
+    size_t operator()(int n) const { return n % 7; }
+};
+
+template <typename Map>
+static void CheckEqual(const Map& map, const std::map<int, std::string>& expected)
+{
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+
+    for (const auto& it : expected) {
+        BOOST_CHECK_EQUAL(map.count(it.first), 1U);
+        BOOST_CHECK_EQUAL(map.at(it.first), it.second);
+    }
+
+    size_t nIterated = 0;
+    for (auto it = map.cbegin(); it != map.cend(); ++it) {
+        BOOST_CHECK(expected.count(it->first));
+        ++nIterated;
+    }
+    BOOST_CHECK_EQUAL(nIterated, expected.size());
+}
+
+BOOST_AUTO_TEST_CASE(flathashmap_insert_find)
+{
+    CFlatHashMap<int, std::string> map;
+
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(1) == map.end());
+    BOOST_CHECK_THROW(map.at(1), std::out_of_range);
+
+    BOOST_CHECK(map.insert(std::make_pair(1, std::string("one"))).second);
+    BOOST_CHECK(!map.insert(std::make_pair(1, std::string("uno"))).second);
+    BOOST_CHECK_EQUAL(map.at(1), "one");
+
+    map[2] = "two";
+    map[1] = "eins";
+    BOOST_CHECK_EQUAL(map.size(), 2U);
+    BOOST_CHECK_EQUAL(map.find(1)->second, "eins");
+    BOOST_CHECK_EQUAL(map[3], "");
+    BOOST_CHECK_EQUAL(map.size(), 3U);
+
+    // Iteration follows the insertion order as long as nothing got erased.
+    std::vector<int> vKeys;
+    for (const auto& it : map) {
+        vKeys.push_back(it.first);
+    }
+    BOOST_CHECK(vKeys == std::vector<int>({1, 2, 3}));
+}
+
+BOOST_AUTO_TEST_CASE(flathashmap_random_operations)
+{
+    CFlatHashMap<int, std::string, CollidingHasher> map;
+    std::map<int, std::string> expected;
+    FastRandomContext ctx(true);
+
+    for (int i = 0; i < 20000; i++) {
+        int nKey = ctx.rand32() % 500;
+        switch (ctx.rand32() % 3) {
+        case 0:
+            map[nKey] = std::to_string(i);
+            expected[nKey] = std::to_string(i);
+            break;
+        case 1:
+            BOOST_CHECK_EQUAL(map.insert(std::make_pair(nKey, std::to_string(i))).second, expected.insert(std::make_pair(nKey, std::to_string(i))).second);
+            break;
+        case 2:
+            BOOST_CHECK_EQUAL(map.erase(nKey), expected.erase(nKey));
+            break;
+        }
+    }
+
+    CheckEqual(map, expected);
+}
+
+BOOST_AUTO_TEST_CASE(flathashmap_clear_shrink)
+{
+    CFlatHashMap<int, std::string> map;
+    std::map<int, std::string> expected;
+
+    map.reserve(1000);
+    size_t nReserved = map.DynamicMemoryUsage();
+
+    for (int i = 0; i < 1000; i++) {
+        map[i] = std::to_string(i);
+    }
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), nReserved);
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(1) == map.end());
+    BOOST_CHECK_EQUAL(map.DynamicMemoryUsage(), nReserved);
+
+    for (int i = 0; i < 10; i++) {
+        map[i] = std::to_string(i);
+        expected[i] = std::to_string(i);
+    }
+
+    map.shrink();
+    BOOST_CHECK(map.DynamicMemoryUsage() < nReserved);
+    CheckEqual(map, expected);
+
+    CFlatHashMap<int, std::string> other;
+    other.swap(map);
+    BOOST_CHECK(map.empty());
+    CheckEqual(other, expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
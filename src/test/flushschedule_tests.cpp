@@ -0,0 +1,41 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "flushschedule.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(flushschedule_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(flushschedule_pressure)
+{
+    BOOST_CHECK_EQUAL(CFlushSchedule::Pressure(50, 100, 0.2), 0.5);
+    BOOST_CHECK_EQUAL(CFlushSchedule::Pressure(50, 100, 0.75), 0.75);
+    BOOST_CHECK_EQUAL(CFlushSchedule::Pressure(50, 0, 0.25), 0.25);
+}
+
+BOOST_AUTO_TEST_CASE(flushschedule_budget)
+{
+    CFlushSchedule schedule(10);
+
+    // Nothing flushed yet, only the pressure counts
+    BOOST_CHECK(!schedule.IsEarlyFlushDue(0.5, 1));
+    BOOST_CHECK(schedule.IsEarlyFlushDue(FLUSH_EARLY_PRESSURE, 1));
+
+    // A flush of 2s at 10% keeps the next early one away for 18s
+    schedule.Flushed(1000000, 3000000);
+    BOOST_CHECK_EQUAL(schedule.GetNextEarlyFlush(), 21000000);
+    BOOST_CHECK(!schedule.IsEarlyFlushDue(1.0, 20999999));
+    BOOST_CHECK(schedule.IsEarlyFlushDue(1.0, 21000000));
+
+    schedule.SetBudget(100);
+    BOOST_CHECK_EQUAL(schedule.GetNextEarlyFlush(), 3000000);
+
+    schedule.SetBudget(0);
+    BOOST_CHECK_EQUAL(schedule.GetBudget(), 1);
+    BOOST_CHECK_EQUAL(schedule.GetNextEarlyFlush(), 3000000 + 2000000 * 99);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
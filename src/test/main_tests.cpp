@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chainparams.h"
+#include "consensus/consensus.h"
+#include "random.h"
 #include "validation.h"
 
 #include "test/test_bitcoin.h"
@@ -56,6 +58,36 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK_EQUAL(nSum, 2099999997690000ULL);
 }
 
+static CAmount GetBlockValueSumSlow(int nFirstHeight, int nLastHeight)
+{
+    CAmount nSum = 0;
+    for (int nHeight = nFirstHeight; nHeight <= nLastHeight; nHeight++) {
+        nSum += GetBlockValue(nHeight, 0, INT_MAX);
+    }
+    return nSum;
+}
+
+BOOST_AUTO_TEST_CASE(block_value_sum_test)
+{
+    BOOST_CHECK_EQUAL(GetBlockValueSum(10, 9), 0);
+    BOOST_CHECK_EQUAL(GetBlockValueSum(-10, 0), 0);
+    BOOST_CHECK_EQUAL(GetBlockValueSum(1, 143499), 143499 * 5000 * COIN);
+
+    // Around the start of the taper and the end of the rewards, out of order on purpose.
+    BOOST_CHECK_EQUAL(GetBlockValueSum(HF_CHAIN_REWARD_END_HEIGHT - 1000, HF_CHAIN_REWARD_END_HEIGHT + 1000),
+                      GetBlockValueSum(HF_CHAIN_REWARD_END_HEIGHT - 1000, HF_CHAIN_REWARD_END_HEIGHT + 1000));
+    BOOST_CHECK_EQUAL(GetBlockValueSum(HF_CHAIN_REWARD_END_HEIGHT - 1000, HF_CHAIN_REWARD_END_HEIGHT + 1000),
+                      GetBlockValueSumSlow(HF_CHAIN_REWARD_END_HEIGHT - 1000, HF_CHAIN_REWARD_END_HEIGHT + 1000));
+    BOOST_CHECK_EQUAL(GetBlockValueSum(-5, 200000), GetBlockValueSumSlow(0, 200000));
+
+    FastRandomContext ctx(true);
+    for (int i = 0; i < 100; i++) {
+        int nFirst = ctx.rand32() % 5000000;
+        int nLast = nFirst + ctx.rand32() % 50000;
+        BOOST_CHECK_EQUAL(GetBlockValueSum(nFirst, nLast), GetBlockValueSumSlow(nFirst, nLast));
+    }
+}
+
 bool ReturnFalse() { return false; }
 bool ReturnTrue() { return true; }
 
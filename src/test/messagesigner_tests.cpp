@@ -0,0 +1,36 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "messagesigner.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(messagesigner_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(messagesigner_cached_verify)
+{
+    CKey key, keyOther;
+    key.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+
+    std::string strMessage = "smartnode ping", strError;
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(CMessageSigner::SignMessage(strMessage, vchSig, key));
+
+    // The second time it's found in the cache, with the same result
+    BOOST_CHECK(CMessageSigner::VerifyMessage(key.GetPubKey(), vchSig, strMessage, strError));
+    BOOST_CHECK(CMessageSigner::VerifyMessage(key.GetPubKey(), vchSig, strMessage, strError));
+
+    // Valid entries don't vouch for another key, message or signature
+    BOOST_CHECK(!CMessageSigner::VerifyMessage(keyOther.GetPubKey(), vchSig, strMessage, strError));
+    BOOST_CHECK(!CMessageSigner::VerifyMessage(key.GetPubKey(), vchSig, strMessage + " ", strError));
+    std::vector<unsigned char> vchSigBad(vchSig);
+    vchSigBad[10] ^= 1;
+    BOOST_CHECK(!CMessageSigner::VerifyMessage(key.GetPubKey(), vchSigBad, strMessage, strError));
+    BOOST_CHECK(!CMessageSigner::VerifyMessage(key.GetPubKey(), vchSigBad, strMessage, strError));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,168 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coins.h"
+#include "objectpool.h"
+#include "test/test_bitcoin.h"
+
+#include <set>
+#include <string>
+#include <unordered_map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(objectpool_tests, BasicTestingSetup)
+
+struct CountedObject
+{
+    static int nAlive;
+    std::string str;
+    CountedObject(const std::string& strIn) : str(strIn) { ++nAlive; }
+    ~CountedObject() { --nAlive; }
+};
+
+int CountedObject::nAlive = 0;
+
+BOOST_AUTO_TEST_CASE(objectpool_construct_destroy)
+{
+    CObjectPool<CountedObject> pool(4);
+
+    std::vector<CountedObject*> vObjects;
+    std::set<CountedObject*> setObjects;
+
+    for (int i = 0; i < 10; ++i) {
+        vObjects.push_back(pool.Construct(std::to_string(i)));
+        setObjects.insert(vObjects.back());
+    }
+
+    // All objects got their own slot and are alive
+    BOOST_CHECK_EQUAL(setObjects.size(), 10U);
+    BOOST_CHECK_EQUAL(CountedObject::nAlive, 10);
+    BOOST_CHECK_EQUAL(pool.Size(), 10U);
+    BOOST_CHECK_EQUAL(pool.Capacity(), 12U);
+
+    for (int i = 0; i < 10; ++i) {
+        BOOST_CHECK_EQUAL(vObjects[i]->str, std::to_string(i));
+    }
+
+    // Released slots get reused before the pool grows
+    pool.Destroy(vObjects[3]);
+    BOOST_CHECK_EQUAL(CountedObject::nAlive, 9);
+    CountedObject* pReused = pool.Construct("reused");
+    BOOST_CHECK(pReused == vObjects[3]);
+    BOOST_CHECK_EQUAL(pool.Capacity(), 12U);
+    vObjects[3] = pReused;
+
+    for (CountedObject* pObject : vObjects) {
+        pool.Destroy(pObject);
+    }
+
+    BOOST_CHECK_EQUAL(CountedObject::nAlive, 0);
+    BOOST_CHECK_EQUAL(pool.Size(), 0U);
+
+    pool.Destroy(nullptr);
+    BOOST_CHECK_EQUAL(pool.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(objectpool_reset)
+{
+    CObjectPool<CountedObject> pool(4);
+
+    std::vector<CountedObject*> vObjects;
+
+    for (int i = 0; i < 20; ++i) {
+        vObjects.push_back(pool.Construct(std::to_string(i)));
+    }
+
+    BOOST_CHECK_EQUAL(pool.Capacity(), 20U);
+
+    for (CountedObject* pObject : vObjects) {
+        pool.Destroy(pObject);
+    }
+
+    // Keep enough slabs for 5 objects
+    pool.Reset(5);
+    BOOST_CHECK_EQUAL(pool.Capacity(), 8U);
+
+    // The kept slabs get used first
+    CountedObject* pFirst = pool.Construct("first");
+    BOOST_CHECK(pFirst == vObjects[0]);
+    pool.Destroy(pFirst);
+
+    pool.Reset();
+    BOOST_CHECK_EQUAL(pool.Capacity(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(objectpool_swap)
+{
+    CObjectPool<CountedObject> pool(4);
+    CObjectPool<CountedObject> other(2);
+
+    CountedObject* pObject = pool.Construct("swapped");
+    pool.Swap(other);
+
+    BOOST_CHECK_EQUAL(pool.Size(), 0U);
+    BOOST_CHECK_EQUAL(pool.Capacity(), 0U);
+    BOOST_CHECK_EQUAL(other.Size(), 1U);
+    BOOST_CHECK_EQUAL(other.Capacity(), 4U);
+
+    other.Destroy(pObject);
+    BOOST_CHECK_EQUAL(CountedObject::nAlive, 0);
+}
+
+BOOST_AUTO_TEST_CASE(objectpool_allocator)
+{
+    typedef CObjectPoolAllocator<std::pair<const int, int>, sizeof(std::pair<const int, int>) + sizeof(void*) * 4> IntAllocator;
+    typedef std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, IntAllocator> IntPoolMap;
+
+    IntAllocator::Pool pool(64);
+    {
+        IntPoolMap map(0, std::hash<int>(), std::equal_to<int>(), IntAllocator(&pool));
+        for (int i = 0; i < 1000; ++i) {
+            map[i] = i * 3;
+        }
+        // The nodes, the larger bucket arrays don't fit a block
+        BOOST_CHECK_EQUAL(pool.Size(), 1000U);
+
+        for (int i = 0; i < 1000; i += 2) {
+            map.erase(i);
+        }
+        BOOST_CHECK_EQUAL(pool.Size(), 500U);
+        size_t nCapacity = pool.Capacity();
+
+        // The erased nodes get reused
+        for (int i = 0; i < 1000; i += 2) {
+            map[i] = i;
+        }
+        BOOST_CHECK_EQUAL(pool.Capacity(), nCapacity);
+        BOOST_CHECK_EQUAL(map.size(), 1000U);
+        BOOST_CHECK_EQUAL(map[999], 999 * 3);
+    }
+    BOOST_CHECK_EQUAL(pool.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(objectpool_coins_cache)
+{
+    CCoinsView viewEmpty;
+    CCoinsViewCache cache(&viewEmpty);
+    size_t nEmptyUsage = cache.DynamicMemoryUsage();
+
+    for (uint32_t i = 0; i < 10000; ++i) {
+        cache.AddCoin(COutPoint(uint256S("ab"), i), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false), false);
+    }
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 10000U);
+    BOOST_CHECK(cache.HaveCoinInCache(COutPoint(uint256S("ab"), 9999)));
+    size_t nUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > nEmptyUsage + 10000 * sizeof(CCoinsCacheEntry));
+
+    // A flushed cache gives its slabs back, just the list of them stays
+    cache.Flush();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK(cache.DynamicMemoryUsage() < nEmptyUsage + 1024);
+
+    cache.AddCoin(COutPoint(uint256S("cd"), 0), Coin(CTxOut(1, CScript() << OP_TRUE), 1, false), false);
+    BOOST_CHECK(cache.HaveCoinInCache(COutPoint(uint256S("cd"), 0)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
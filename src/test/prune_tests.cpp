@@ -0,0 +1,121 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "coins.h"
+#include "key.h"
+#include "script/interpreter.h"
+#include "script/standard.h"
+#include "smartnode/smartnode.h"
+#include "smartvoting/proposal.h"
+#include "test/test_bitcoin.h"
+#include "validation.h"
+
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(prune_tests, TestChain100Setup)
+
+static CMutableTransaction SpendCoinbase(const CTransaction& coinbase, const CKey& key, const CScript& scriptData)
+{
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbase.GetHash(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 0;
+    spend.vout[0].scriptPubKey = scriptData;
+    spend.vout[1].nValue = coinbase.vout[0].nValue - CENT;
+    spend.vout[1].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbase.vout[0].scriptPubKey, spend, 0, SIGHASH_ALL);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    return spend;
+}
+
+BOOST_AUTO_TEST_CASE(pruned_fee_and_collateral)
+{
+    fPruneMode = true;
+
+    // A proposal fee and a transaction without the OP_RETURN of one in the same block
+    CInternalProposal proposal;
+    CScript scriptFee = CScript() << OP_RETURN << ToByteVector(proposal.GetHash());
+    std::vector<CMutableTransaction> txns;
+    txns.push_back(SpendCoinbase(coinbaseTxns[0], coinbaseKey, scriptFee));
+    txns.push_back(SpendCoinbase(coinbaseTxns[1], coinbaseKey, CScript() << OP_RETURN));
+    BOOST_CHECK(CProposal::IsFeeTxCandidate(txns[0]));
+    BOOST_CHECK(!CProposal::IsFeeTxCandidate(txns[1]));
+
+    CBlock block = CreateAndProcessBlock(txns, GetScriptForDestination(coinbaseKey.GetPubKey().GetID()));
+    uint256 hashFee = txns[0].GetHash();
+    uint256 hashOther = txns[1].GetHash();
+
+    int nHeight;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+        nHeight = chainActive.Height();
+    }
+
+    // The smartnode collateral is a coin of the UTXO set, its transaction is in no block at all
+    CKey keyCollateral;
+    keyCollateral.MakeNewKey(true);
+    COutPoint outpointCollateral(GetRandHash(), 0);
+    {
+        LOCK(cs_main);
+        CTxOut out(SMARTNODE_COIN_REQUIRED * COIN, GetScriptForDestination(keyCollateral.GetPubKey().GetID()));
+        pcoinsTip->AddCoin(outpointCollateral, Coin(out, nHeight, false), false);
+    }
+
+    // Prune all of the chain
+    {
+        LOCK(cs_main);
+        std::set<int> setFilesToPrune;
+        setFilesToPrune.insert(0);
+        PruneOneBlockFile(0);
+        UnlinkPrunedFiles(setFilesToPrune);
+        fHavePruned = true;
+    }
+
+    CTransaction tx;
+    uint256 hashBlock;
+
+    // The fee transaction was kept, the proposal gets its height
+    BOOST_CHECK(GetTransaction(hashFee, tx, Params().GetConsensus(), hashBlock, true));
+    BOOST_CHECK(tx.GetHash() == hashFee);
+    BOOST_CHECK(hashBlock == block.GetHash());
+    BOOST_CHECK(!IsTransactionPruned(hashFee));
+    proposal.SetFeeHash(hashFee);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(proposal.UpdateProposalStartHeight());
+    }
+    BOOST_CHECK_EQUAL(proposal.GetVotingStartHeight(), nHeight + SMARTVOTING_FEE_CONFIRMATIONS);
+
+    // The other one is gone with the block and reported as pruned, unlike an unknown one
+    BOOST_CHECK(!GetTransaction(hashOther, tx, Params().GetConsensus(), hashBlock, true));
+    BOOST_CHECK(IsTransactionPruned(hashOther));
+    BOOST_CHECK(!IsTransactionPruned(GetRandHash()));
+
+    // The collateral checks out without a block, and only against its own key
+    CKey keySmartnode;
+    keySmartnode.MakeNewKey(true);
+    CSmartnode mn(CService(), outpointCollateral, keyCollateral.GetPubKey(), keySmartnode.GetPubKey(), PROTOCOL_VERSION);
+    CSmartnode mnOther(CService(), outpointCollateral, keySmartnode.GetPubKey(), keySmartnode.GetPubKey(), PROTOCOL_VERSION);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mn.IsInputAssociatedWithPubkey());
+        BOOST_CHECK(!mnOther.IsInputAssociatedWithPubkey());
+    }
+
+    fHavePruned = false;
+    fPruneMode = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,282 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "random.h"
+#include "smartrewards/rewards.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rewardsdb_tests, TestingSetup)
+
+static CSmartAddress RandomAddress(FastRandomContext& ctx)
+{
+    std::vector<unsigned char> vchKey(20);
+    for (unsigned char& c : vchKey) {
+        c = ctx.rand32();
+    }
+
+    if (ctx.rand32() % 2) {
+        return CSmartAddress(CTxDestination(CScriptID(uint160(vchKey))));
+    }
+
+    return CSmartAddress(CTxDestination(CKeyID(uint160(vchKey))));
+}
+
+BOOST_AUTO_TEST_CASE(rewardsdb_read_entries_batch)
+{
+    FastRandomContext ctx(true);
+    CSmartRewardsDB db(1 << 20, true, true);
+    std::vector<CSmartAddress> ids;
+
+    {
+        CSmartRewardsCache cache;
+
+        for (int i = 0; i < 300; i++) {
+            CSmartRewardEntry* entry = cache.CreateEntry(RandomAddress(ctx));
+            entry->balance = 1 + ctx.rand32();
+            cache.AddEntry(entry);
+            ids.push_back(entry->id);
+        }
+
+        BOOST_CHECK(db.SyncCached(cache));
+        cache.Clear();
+    }
+
+    // Unknown addresses and duplicates in random order.
+    for (int i = 0; i < 100; i++) {
+        ids.push_back(RandomAddress(ctx));
+        ids.push_back(ids[ctx.rand32() % ids.size()]);
+    }
+
+    for (size_t i = 0; i < ids.size(); i++) {
+        std::swap(ids[i], ids[i + ctx.rand32() % (ids.size() - i)]);
+    }
+
+    CSmartRewardEntryList entries;
+    std::vector<bool> vFound;
+    BOOST_CHECK(db.ReadRewardEntries(ids, entries, vFound));
+    BOOST_CHECK_EQUAL(entries.size(), ids.size());
+    BOOST_CHECK_EQUAL(vFound.size(), ids.size());
+
+    size_t nFound = 0;
+
+    for (size_t i = 0; i < ids.size(); i++) {
+        CSmartRewardEntry entry;
+        bool fFound = db.ReadRewardEntry(ids[i], entry);
+
+        BOOST_CHECK_EQUAL(vFound[i], fFound);
+
+        if (fFound) {
+            BOOST_CHECK(entries[i].id == ids[i]);
+            BOOST_CHECK_EQUAL(entries[i].balance, entry.balance);
+            ++nFound;
+        }
+    }
+
+    BOOST_CHECK(nFound >= 300);
+
+    BOOST_CHECK(db.ReadRewardEntries(std::vector<CSmartAddress>(), entries, vFound));
+    BOOST_CHECK(entries.empty() && vFound.empty());
+}
+
+BOOST_AUTO_TEST_CASE(rewardsdb_term_entry_indexes)
+{
+    FastRandomContext ctx(true);
+    CSmartRewardsDB db(1 << 20, true, true);
+    std::vector<CSmartAddress> addresses;
+    std::vector<CTermRewardEntry> expected;
+
+    for (int i = 0; i < 10; i++) {
+        addresses.push_back(RandomAddress(ctx));
+    }
+
+    {
+        CSmartRewardsCache cache;
+
+        for (int i = 0; i < 100; i++) {
+            CTermRewardEntry* entry = cache.CreateTermRewardEntry({addresses[i % addresses.size()], GetRandHash()});
+            entry->balance = 1 + ctx.rand32();
+            entry->expires = 1600000000 + i * 1000;
+            cache.AddTermRewardEntry(entry);
+            expected.push_back(*entry);
+        }
+
+        BOOST_CHECK(db.SyncCached(cache));
+    }
+
+    CTermRewardEntryList entries;
+    BOOST_CHECK(db.ReadTermRewardEntries(addresses[3], entries));
+    BOOST_CHECK_EQUAL(entries.size(), 10U);
+
+    for (const CTermRewardEntry& entry : entries) {
+        BOOST_CHECK(entry.address == addresses[3]);
+    }
+
+    entries.clear();
+    BOOST_CHECK(db.ReadTermRewardEntries(1600010000, 1600019999, entries));
+    BOOST_CHECK_EQUAL(entries.size(), 10U);
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        BOOST_CHECK(entries[i] == expected[10 + i]);
+    }
+
+    // Moving the expiry drops the old index key.
+    {
+        CSmartRewardsCache cache;
+        CTermRewardEntry* entry = cache.CreateTermRewardEntry({expected[10].address, expected[10].txHash});
+        *entry = expected[10];
+        entry->expires = 1700000000;
+        cache.AddTermRewardEntry(entry);
+        BOOST_CHECK(db.SyncCached(cache));
+    }
+
+    entries.clear();
+    BOOST_CHECK(db.ReadTermRewardEntries(1600010000, 1600019999, entries));
+    BOOST_CHECK_EQUAL(entries.size(), 9U);
+
+    entries.clear();
+    BOOST_CHECK(db.ReadTermRewardEntries(1699999999, 1700000000, entries));
+    BOOST_CHECK_EQUAL(entries.size(), 1U);
+    BOOST_CHECK(entries[0] == expected[10]);
+}
+
+BOOST_AUTO_TEST_CASE(rewardsdb_entry_compact_encoding)
+{
+    FastRandomContext ctx(true);
+
+    for (int i = 0; i < 1000; i++) {
+        CSmartRewardEntry entry(RandomAddress(ctx));
+        entry.balance = (CAmount)(ctx.rand32() % 3) * COIN + ctx.rand32() % 2 * ctx.rand32();
+        entry.balanceAtStart = ctx.rand32() % 2 ? -(CAmount)ctx.rand32() : (CAmount)ctx.rand32() * 1000;
+        entry.balanceEligible = ctx.rand32() % 2 ? 0 : MAX_MONEY - ctx.rand32();
+        if (ctx.rand32() % 2) entry.disqualifyingTx = GetRandHash();
+        if (ctx.rand32() % 2) entry.activationTx = GetRandHash();
+        if (ctx.rand32() % 2) entry.smartnodePaymentTx = GetRandHash();
+        entry.fDisqualifyingTx = ctx.rand32() % 2;
+        entry.fActivated = ctx.rand32() % 2;
+        entry.fSmartnodePaymentTx = ctx.rand32() % 2;
+        entry.bonusLevel = ctx.rand32() % 3;
+
+        CDataStream ssCompact(SER_DISK, CLIENT_VERSION), ssFull(SER_DISK, CLIENT_VERSION);
+        ssCompact << CSmartRewardEntryCompactor(entry);
+        ssFull << entry;
+        BOOST_CHECK(ssCompact.size() < ssFull.size());
+
+        // Both encodings must decode to the same entry.
+        for (CDataStream* ss : {&ssCompact, &ssFull}) {
+            CSmartRewardEntry decoded;
+            CSmartRewardEntryCompactor compactor(decoded);
+            *ss >> compactor;
+            BOOST_CHECK(ss->empty());
+            BOOST_CHECK_EQUAL(decoded.balance, entry.balance);
+            BOOST_CHECK_EQUAL(decoded.balanceAtStart, entry.balanceAtStart);
+            BOOST_CHECK_EQUAL(decoded.balanceEligible, entry.balanceEligible);
+            BOOST_CHECK(decoded.disqualifyingTx == entry.disqualifyingTx);
+            BOOST_CHECK(decoded.activationTx == entry.activationTx);
+            BOOST_CHECK(decoded.smartnodePaymentTx == entry.smartnodePaymentTx);
+            BOOST_CHECK_EQUAL(decoded.fDisqualifyingTx, entry.fDisqualifyingTx);
+            BOOST_CHECK_EQUAL(decoded.fActivated, entry.fActivated);
+            BOOST_CHECK_EQUAL(decoded.fSmartnodePaymentTx, entry.fSmartnodePaymentTx);
+            BOOST_CHECK_EQUAL(decoded.bonusLevel, entry.bonusLevel);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rewardsdb_block_undo_journal)
+{
+    FastRandomContext ctx(true);
+    CSmartRewardsDB db(1 << 20, true, true);
+    CSmartRewardsBlockUndo undo;
+
+    undo.blockHash = GetRandHash();
+    undo.disqualifiedEntries = 2;
+    undo.eligibleSmart = 5000 * COIN;
+
+    for (int i = 0; i < 50; i++) {
+        CSmartRewardEntry entry(RandomAddress(ctx));
+        entry.balance = ctx.rand32() % 2 ? 0 : (CAmount)ctx.rand32();
+        if (ctx.rand32() % 2) entry.disqualifyingTx = GetRandHash();
+        undo.entries.push_back(entry);
+    }
+
+    {
+        CSmartRewardsCache cache;
+        cache.AddBlockUndo(1000, undo);
+        BOOST_CHECK(db.SyncCached(cache));
+    }
+
+    CSmartRewardsBlockUndo read;
+    BOOST_CHECK(!db.ReadBlockUndo(999, read));
+    BOOST_CHECK(db.ReadBlockUndo(1000, read));
+    BOOST_CHECK(read.blockHash == undo.blockHash);
+    BOOST_CHECK_EQUAL(read.disqualifiedEntries, undo.disqualifiedEntries);
+    BOOST_CHECK_EQUAL(read.eligibleSmart, undo.eligibleSmart);
+    BOOST_CHECK_EQUAL(read.entries.size(), undo.entries.size());
+
+    for (size_t i = 0; i < read.entries.size(); i++) {
+        BOOST_CHECK(read.entries[i].id == undo.entries[i].id);
+        BOOST_CHECK_EQUAL(read.entries[i].balance, undo.entries[i].balance);
+        BOOST_CHECK(read.entries[i].disqualifyingTx == undo.entries[i].disqualifyingTx);
+    }
+
+    {
+        CSmartRewardsCache cache;
+        cache.AddBlockUndo(1001, undo);
+        cache.AddBlockUndo(1002, undo);
+        BOOST_CHECK(db.SyncCached(cache));
+    }
+
+    // All journals too far below the new one get dropped, not just the one of the height which left the window.
+    {
+        CSmartRewardsCache cache;
+        cache.AddBlockUndo(1002 + REWARDS_UNDO_JOURNAL_BLOCKS, CSmartRewardsBlockUndo());
+        BOOST_CHECK(db.SyncCached(cache));
+    }
+
+    BOOST_CHECK(!db.ReadBlockUndo(1000, read));
+    BOOST_CHECK(!db.ReadBlockUndo(1001, read));
+    BOOST_CHECK(!db.ReadBlockUndo(1002, read));
+    BOOST_CHECK(db.ReadBlockUndo(1002 + REWARDS_UNDO_JOURNAL_BLOCKS, read));
+
+    // The cache doesn't keep journals which are out of the window either.
+    {
+        CSmartRewardsCache cache;
+        cache.AddBlockUndo(2000, undo);
+        cache.AddBlockUndo(2000 + REWARDS_UNDO_JOURNAL_BLOCKS - 1, undo);
+        BOOST_CHECK_EQUAL(cache.GetBlockUndos()->size(), 2U);
+        cache.AddBlockUndo(2000 + REWARDS_UNDO_JOURNAL_BLOCKS, undo);
+        BOOST_CHECK_EQUAL(cache.GetBlockUndos()->size(), 2U);
+        BOOST_CHECK(!cache.GetBlockUndos()->count(2000));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rewardsdb_round_eligible_counters)
+{
+    CSmartRewardRound round;
+    round.eligibleEntries = 10;
+    round.eligibleSmart = 50000 * COIN;
+    round.disqualifiedEntries = 3;
+    round.disqualifiedSmart = 15000 * COIN;
+    BOOST_CHECK_EQUAL(round.GetEligibleEntries(), 7);
+    BOOST_CHECK_EQUAL(round.GetEligibleSmart(), 35000 * COIN);
+
+    // More disqualifications than qualified entries never yield negative counters.
+    round.disqualifiedEntries = 12;
+    round.disqualifiedSmart = 60000 * COIN;
+    BOOST_CHECK_EQUAL(round.GetEligibleEntries(), 0);
+    BOOST_CHECK_EQUAL(round.GetEligibleSmart(), 0);
+
+    round.UpdatePayoutParameter();
+    BOOST_CHECK_EQUAL(round.GetPayeeCount(), 0);
+
+    CSmartRewardEntry entry;
+    entry.balanceEligible = 1000 * COIN;
+    entry.fActivated = true;
+    BOOST_CHECK(entry.IsEligible());
+    entry.fDisqualifyingTx = true;
+    BOOST_CHECK(!entry.IsEligible());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,91 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "random.h"
+#include "smartrewards/rewardsroundfile.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rewardsroundfile_tests, TestingSetup)
+
+static CSmartRewardRound MakeRound(int nNumber)
+{
+    CSmartRewardRound round;
+    round.number = nNumber;
+    round.endBlockHeight = 1000 * nNumber;
+    round.endBlockTime = 1500000000 + nNumber;
+    return round;
+}
+
+BOOST_AUTO_TEST_CASE(rewardsroundfile_write_read)
+{
+    FastRandomContext ctx(true);
+    CSmartRewardResultEntryList results;
+
+    for (int i = 0; i < 500; i++) {
+        std::vector<unsigned char> vchKey(20);
+        for (unsigned char& c : vchKey) {
+            c = ctx.rand32();
+        }
+
+        CSmartRewardEntry entry{CSmartAddress(CTxDestination(CKeyID(uint160(vchKey))))};
+        entry.balance = ctx.rand32();
+        results.push_back(CSmartRewardResultEntry(&entry, i % 3 ? ctx.rand32() : 0));
+    }
+
+    CSmartRewardRound round = MakeRound(7);
+    BOOST_CHECK(CSmartRewardsRoundFile::Write(round, results));
+
+    CSmartRewardsRoundFile file;
+    BOOST_CHECK(file.Open(round));
+    BOOST_CHECK_EQUAL(file.size(), results.size());
+
+    // Sorted like the database keys.
+    for (size_t i = 1; i < file.size(); i++) {
+        BOOST_CHECK(file.GetAddress(i - 1) < file.GetAddress(i));
+    }
+
+    for (const CSmartRewardResultEntry& s : results) {
+        size_t nIndex;
+        BOOST_CHECK(file.Find(s.entry.id, nIndex));
+        BOOST_CHECK(file.GetAddress(nIndex) == s.entry.id);
+        BOOST_CHECK_EQUAL(file.GetBalance(nIndex), s.entry.balance);
+        BOOST_CHECK_EQUAL(file.GetReward(nIndex), s.reward);
+    }
+
+    size_t nIndex;
+    BOOST_CHECK(!file.Find(CSmartAddress(CTxDestination(CKeyID(uint160()))), nIndex));
+
+    // Files of other rounds or of an undone and again finalized round don't match.
+    CSmartRewardsRoundFile other;
+    BOOST_CHECK(!other.Open(MakeRound(8)));
+    CSmartRewardRound changed = round;
+    changed.endBlockTime++;
+    BOOST_CHECK(!other.Open(changed));
+
+    CSmartRewardsRoundFile::Remove(round.number);
+    BOOST_CHECK(!other.Open(round));
+}
+
+BOOST_AUTO_TEST_CASE(rewardsroundfile_truncated)
+{
+    CSmartRewardRound round = MakeRound(3);
+    CSmartRewardEntry entry{CSmartAddress(CTxDestination(CKeyID(uint160(std::vector<unsigned char>(20, 1)))))};
+    CSmartRewardResultEntryList results(1, CSmartRewardResultEntry(&entry, 5));
+
+    BOOST_CHECK(CSmartRewardsRoundFile::Write(round, results));
+
+    boost::filesystem::path path = CSmartRewardsRoundFile::GetPath(round.number);
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 1);
+
+    CSmartRewardsRoundFile file;
+    BOOST_CHECK(!file.Open(round));
+
+    CSmartRewardsRoundFile::RemoveAll();
+    BOOST_CHECK(!boost::filesystem::exists(CSmartRewardsRoundFile::GetDirectory()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,10 +6,13 @@
 #include "rpc/client.h"
 
 #include "base58.h"
+#include "changefeed.h"
 #include "netbase.h"
 
 #include "test/test_bitcoin.h"
 
+#include <thread>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/assign/list_of.hpp>
 #include <boost/test/unit_test.hpp>
@@ -332,4 +335,137 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_batch_order)
+{
+    SetRPCWarmupFinished();
+
+    // Runs of read-only calls around one which isn't
+    UniValue vReq(UniValue::VARR);
+    for (int i = 0; i < 40; i++) {
+        UniValue req(UniValue::VOBJ);
+        req.push_back(Pair("method", i == 20 ? "nosuchmethod" : "decodescript"));
+        UniValue params(UniValue::VARR);
+        params.push_back(strprintf("%02x", 0x51 + i % 16));
+        req.push_back(Pair("params", params));
+        req.push_back(Pair("id", i));
+        vReq.push_back(req);
+    }
+
+    std::vector<std::thread> threads;
+    RPCBatchEnqueue enqueue = [&threads](const boost::function<void ()>& func) {
+        threads.emplace_back(func);
+        return true;
+    };
+
+    std::string strSequential = JSONRPCExecBatch(vReq);
+    std::string strConcurrent = JSONRPCExecBatch(vReq, 3, enqueue);
+    for (std::thread& thread : threads)
+        thread.join();
+
+    BOOST_CHECK_EQUAL(threads.size(), 6U);
+    BOOST_CHECK_EQUAL(strConcurrent, strSequential);
+
+    UniValue replies;
+    BOOST_REQUIRE(replies.read(strConcurrent));
+    BOOST_REQUIRE_EQUAL(replies.size(), 40U);
+    for (int i = 0; i < 40; i++) {
+        BOOST_CHECK_EQUAL(find_value(replies[i], "id").get_int(), i);
+        BOOST_CHECK_EQUAL(find_value(replies[i], "error").isNull(), i != 20);
+    }
+}
+
+class TestStreamSink : public RPCStreamSink
+{
+public:
+    std::string strJSON;
+    int nWrites = 0;
+
+    void Write(const std::string& str)
+    {
+        strJSON += str;
+        nWrites++;
+    }
+};
+
+static UniValue StreamEntries(int nEntries, bool fCSV)
+{
+    CRPCResultStream stream;
+    if (fCSV) {
+        stream.BeginString();
+        for (int i = 0; i < nEntries; i++)
+            stream.Append(strprintf("entry \"%d\",%d\n", i, i * 3));
+    } else {
+        stream.BeginObject();
+        for (int i = 0; i < nEntries; i++)
+            stream.Push(strprintf("entry%d", i), i * 3);
+    }
+    return stream.Finish();
+}
+
+BOOST_AUTO_TEST_CASE(rpc_result_stream)
+{
+    for (bool fCSV : {false, true}) {
+        // Without a sink the result is the same as one built as UniValue
+        UniValue expected(fCSV ? UniValue::VSTR : UniValue::VOBJ);
+        std::string strCSV;
+        for (int i = 0; i < 20000; i++) {
+            if (fCSV)
+                strCSV += strprintf("entry \"%d\",%d\n", i, i * 3);
+            else
+                expected.push_back(Pair(strprintf("entry%d", i), i * 3));
+        }
+        if (fCSV)
+            expected = UniValue(strCSV);
+        BOOST_CHECK_EQUAL(StreamEntries(20000, fCSV).write(), expected.write());
+
+        // Small results don't get streamed
+        TestStreamSink sink;
+        SetRPCStreamSink(&sink);
+        BOOST_CHECK(!StreamEntries(10, fCSV).isNull());
+        BOOST_CHECK_EQUAL(sink.nWrites, 0);
+
+        // Only the first stream gets the sink
+        SetRPCStreamSink(&sink);
+        BOOST_CHECK(StreamEntries(20000, fCSV).isNull());
+        BOOST_CHECK(sink.nWrites > 1);
+        BOOST_CHECK_EQUAL(sink.strJSON, expected.write());
+        BOOST_CHECK_EQUAL(StreamEntries(20000, fCSV).write(), expected.write());
+        SetRPCStreamSink(NULL);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpc_waitforchange)
+{
+    uint64_t nKnown;
+    int64_t nTimeout;
+
+    RPCParseWaitForChange(UniValue(UniValue::VARR), 1, nKnown, nTimeout);
+    BOOST_CHECK_EQUAL(nKnown, 0U);
+    BOOST_CHECK_EQUAL(nTimeout, 0);
+    // Numbers from JSON-RPC, strings from bitcoin-cli
+    RPCParseWaitForChange(RPCConvertValues("snsync", boost::assign::list_of("waitforchange")("7")("250")), 1, nKnown, nTimeout);
+    BOOST_CHECK_EQUAL(nKnown, 7U);
+    BOOST_CHECK_EQUAL(nTimeout, 250);
+    UniValue params(UniValue::VARR);
+    params.push_back("waitforchange");
+    params.push_back(9);
+    params.push_back(100);
+    RPCParseWaitForChange(params, 1, nKnown, nTimeout);
+    BOOST_CHECK_EQUAL(nKnown, 9U);
+    BOOST_CHECK_EQUAL(nTimeout, 100);
+    params.push_back(1);
+    BOOST_CHECK_THROW(RPCParseWaitForChange(params, 1, nKnown, nTimeout), UniValue);
+    BOOST_CHECK_THROW(RPCParseWaitForChange(RPCConvertValues("snsync", boost::assign::list_of("waitforchange")("-1")), 1, nKnown, nTimeout), UniValue);
+    BOOST_CHECK_THROW(RPCParseWaitForChange(RPCConvertValues("snsync", boost::assign::list_of("waitforchange")("x")), 1, nKnown, nTimeout), UniValue);
+
+    CChangeFeed feed;
+    uint64_t nVersion = feed.GetVersion();
+    BOOST_CHECK_EQUAL(feed.WaitForChange(0, std::chrono::milliseconds(0)), nVersion);
+    BOOST_CHECK_EQUAL(feed.WaitForChange(nVersion, std::chrono::milliseconds(1)), nVersion);
+
+    std::thread notifier([&feed]() { MilliSleep(10); feed.Notify(); });
+    BOOST_CHECK_EQUAL(feed.WaitForChange(nVersion, std::chrono::seconds(60)), nVersion + 1);
+    notifier.join();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
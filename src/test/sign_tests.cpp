@@ -0,0 +1,99 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "keystore.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "script/interpreter.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sign_tests, BasicTestingSetup)
+
+static CMutableTransaction RandomTransaction(FastRandomContext& ctx, int nInputs, int nOutputs)
+{
+    CMutableTransaction tx;
+    tx.nVersion = ctx.rand32();
+    tx.nLockTime = ctx.rand32();
+    for (int i = 0; i < nInputs; i++)
+        tx.vin.push_back(CTxIn(COutPoint(GetRandHash(), ctx.rand32() % 4), CScript() << OP_1, ctx.rand32()));
+    for (int i = 0; i < nOutputs; i++)
+        tx.vout.push_back(CTxOut(ctx.rand32() % 100000000, CScript() << OP_RETURN << i));
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(sighash_precomputed)
+{
+    FastRandomContext ctx(true);
+    const int hashTypes[] = {SIGHASH_ALL, SIGHASH_NONE, SIGHASH_SINGLE, SIGHASH_ALL | SIGHASH_ANYONECANPAY,
+                             SIGHASH_NONE | SIGHASH_ANYONECANPAY, SIGHASH_SINGLE | SIGHASH_ANYONECANPAY, 0, 0x41};
+
+    // The script code includes an OP_CODESEPARATOR which doesn't get hashed
+    CScript scriptCode = CScript() << OP_DUP << OP_CODESEPARATOR << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    for (int nInputs = 1; nInputs <= 20; nInputs += 7) {
+        CTransaction tx(RandomTransaction(ctx, nInputs, 1 + ctx.rand32() % 3));
+        PrecomputedTransactionData txdata(tx);
+        for (int nIn = 0; nIn < nInputs; nIn++) {
+            for (int nHashType : hashTypes) {
+                BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, &txdata) == SignatureHash(scriptCode, tx, nIn, nHashType));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(produce_signatures)
+{
+    FastRandomContext ctx(true);
+    CBasicKeyStore keystore;
+    std::vector<CKey> keys(3);
+    for (CKey& key : keys) {
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+    }
+
+    CScript scriptMultisig = GetScriptForMultisig(2, std::vector<CPubKey>{keys[0].GetPubKey(), keys[1].GetPubKey(), keys[2].GetPubKey()});
+    keystore.AddCScript(scriptMultisig);
+
+    std::vector<CScript> vScripts;
+    vScripts.push_back(GetScriptForDestination(keys[0].GetPubKey().GetID()));
+    vScripts.push_back(GetScriptForRawPubKey(keys[1].GetPubKey()));
+    vScripts.push_back(GetScriptForDestination(CScriptID(scriptMultisig)));
+
+    // Many inputs of the same scripts like a consolidation
+    CMutableTransaction txMutable = RandomTransaction(ctx, 60, 2);
+    std::vector<CScript> vScriptPubKeys;
+    for (size_t i = 0; i < txMutable.vin.size(); i++)
+        vScriptPubKeys.push_back(vScripts[i % vScripts.size()]);
+
+    CTransaction tx(txMutable);
+    std::vector<CScript> vScriptSigs;
+    BOOST_CHECK(ProduceSignatures(keystore, tx, vScriptPubKeys, SIGHASH_ALL, vScriptSigs));
+    BOOST_REQUIRE_EQUAL(vScriptSigs.size(), tx.vin.size());
+
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        BOOST_CHECK(VerifyScript(vScriptSigs[i], vScriptPubKeys[i], STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, i)));
+
+        // The signatures are deterministic, the same as the ones of one input at a time
+        CMutableTransaction txSingle(txMutable);
+        BOOST_CHECK(SignSignature(keystore, vScriptPubKeys[i], txSingle, i));
+        BOOST_CHECK(txSingle.vin[i].scriptSig == vScriptSigs[i]);
+    }
+
+    // Inputs without a script pubkey are left out, the missing key fails the others
+    vScriptPubKeys[0] = CScript();
+    CKey keyMissing;
+    keyMissing.MakeNewKey(true);
+    vScriptPubKeys[1] = GetScriptForDestination(keyMissing.GetPubKey().GetID());
+    BOOST_CHECK(!ProduceSignatures(keystore, tx, vScriptPubKeys, SIGHASH_ALL, vScriptSigs));
+    BOOST_CHECK(vScriptSigs[0].empty());
+    BOOST_CHECK(vScriptSigs[1].empty());
+    BOOST_CHECK(VerifyScript(vScriptSigs[2], vScriptPubKeys[2], STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, 2)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -44,6 +44,38 @@ BOOST_AUTO_TEST_CASE(skiplist_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockindexarena_test)
+{
+    CBlockIndexArena arena;
+    const int nChunk = CBlockIndexArena::BLOCK_INDEX_ARENA_CHUNK;
+
+    // A chain gets consecutive entries, also across chunks allocated out of order
+    std::vector<CBlockIndex*> vChain(2 * nChunk);
+    for (int i = vChain.size() - 1; i >= 0; i--)
+        vChain[i] = arena.New(i);
+    for (int i = 1; i < nChunk; i++)
+        BOOST_CHECK_EQUAL(vChain[i] - vChain[i - 1], 1);
+    BOOST_CHECK_EQUAL(vChain[nChunk + 1] - vChain[nChunk], 1);
+    BOOST_CHECK_EQUAL(arena.OverflowSize(), 0U);
+
+    // A fork at a height which is taken, and entries without a height
+    CBlockIndex* pindexFork = arena.New(5);
+    CBlockIndex* pindexUnknown = arena.New(-1);
+    BOOST_CHECK(pindexFork != vChain[5]);
+    BOOST_CHECK_EQUAL(pindexUnknown - pindexFork, 1);
+    BOOST_CHECK_EQUAL(arena.OverflowSize(), 2U);
+    BOOST_CHECK_EQUAL(arena.size(), vChain.size() + 2);
+
+    // Skipped heights leave their slots free
+    CBlockIndex* pindexFar = arena.New(10 * nChunk);
+    BOOST_CHECK(pindexFar->pprev == NULL && pindexFar->nHeight == 0);
+    BOOST_CHECK_EQUAL(arena.New(10 * nChunk + 1) - pindexFar, 1);
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.size(), 0U);
+    BOOST_CHECK_EQUAL(arena.OverflowSize(), 0U);
+}
+
 BOOST_AUTO_TEST_CASE(getlocator_test)
 {
     // Build a main chain 100000 blocks long.
@@ -100,4 +132,48 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(findearliestatleast_test)
+{
+    std::vector<uint256> vHashMain(100000);
+    std::vector<CBlockIndex> vBlocksMain(100000);
+    for (unsigned int i=0; i<vBlocksMain.size(); i++) {
+        vHashMain[i] = ArithToUint256(i); // Set the hash equal to the height
+        vBlocksMain[i].nHeight = i;
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : NULL;
+        vBlocksMain[i].phashBlock = &vHashMain[i];
+        vBlocksMain[i].BuildSkip();
+        if (i < 10) {
+            vBlocksMain[i].nTime = i;
+            vBlocksMain[i].nTimeMax = i;
+        } else {
+            // randomly choose something in the range [MTP, MTP*2]
+            int64_t medianTimePast = vBlocksMain[i].GetMedianTimePast();
+            int r = insecure_rand() % medianTimePast;
+            vBlocksMain[i].nTime = r + medianTimePast;
+            vBlocksMain[i].nTimeMax = std::max(vBlocksMain[i].nTime, vBlocksMain[i-1].nTimeMax);
+        }
+    }
+    // Check that we set nTimeMax up correctly.
+    unsigned int curTimeMax = 0;
+    for (unsigned int i=0; i<vBlocksMain.size(); ++i) {
+        curTimeMax = std::max(curTimeMax, vBlocksMain[i].nTime);
+        BOOST_CHECK(curTimeMax == vBlocksMain[i].nTimeMax);
+    }
+
+    // Build a CChain for the main branch.
+    CChain chain;
+    chain.SetTip(&vBlocksMain.back());
+
+    // Verify that FindEarliestAtLeast is correct.
+    for (unsigned int i=0; i<10000; ++i) {
+        // Pick a random element in vBlocksMain.
+        int r = insecure_rand() % vBlocksMain.size();
+        int64_t test_time = vBlocksMain[r].nTime;
+        CBlockIndex *ret = chain.FindEarliestAtLeast(test_time);
+        BOOST_CHECK(ret->nTimeMax >= test_time);
+        BOOST_CHECK((ret->pprev==NULL) || ret->pprev->nTimeMax < test_time);
+        BOOST_CHECK(vBlocksMain[r].GetAncestor(ret->nHeight) == ret);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
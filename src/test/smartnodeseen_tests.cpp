@@ -0,0 +1,100 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "hash.h"
+#include "smartnode/smartnodeseen.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(smartnodeseen_tests, BasicTestingSetup)
+
+struct SeenMessage
+{
+    int nHeight;
+
+    SeenMessage() : nHeight(0) {}
+    explicit SeenMessage(int nHeight) : nHeight(nHeight) {}
+
+    ADD_SERIALIZE_METHODS
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(nHeight);
+    }
+};
+
+struct SeenMessageBucket
+{
+    int64_t operator()(const SeenMessage& message) const { return message.nHeight; }
+};
+
+typedef CSeenSmartnodeMessages<SeenMessage, SeenMessageBucket> SeenMessages;
+
+static uint256 MessageHash(int n)
+{
+    return Hash(BEGIN(n), END(n));
+}
+
+BOOST_AUTO_TEST_CASE(smartnodeseen_insert_and_expire)
+{
+    SeenMessages seen;
+
+    for (int i = 0; i < 1000; i++) {
+        BOOST_CHECK(seen.Insert(MessageHash(i), SeenMessage(i / 10)));
+    }
+
+    // Seen messages are never replaced.
+    BOOST_CHECK(!seen.Insert(MessageHash(5), SeenMessage(99)));
+    BOOST_CHECK_EQUAL(seen.Size(), 1000U);
+
+    SeenMessage message;
+    BOOST_CHECK(seen.Get(MessageHash(5), message));
+    BOOST_CHECK_EQUAL(message.nHeight, 0);
+    BOOST_CHECK(!seen.Get(MessageHash(1000), message));
+
+    // Only the buckets below the limit are dropped.
+    BOOST_CHECK_EQUAL(seen.EraseBefore(50), 500U);
+    BOOST_CHECK_EQUAL(seen.Size(), 500U);
+    BOOST_CHECK(!seen.Has(MessageHash(499)));
+    BOOST_CHECK(seen.Has(MessageHash(500)));
+    BOOST_CHECK_EQUAL(seen.EraseBefore(50), 0U);
+
+    // An expired message can be seen again.
+    BOOST_CHECK(seen.Insert(MessageHash(0), SeenMessage(200)));
+    BOOST_CHECK_EQUAL(seen.EraseBefore(100), 500U);
+    BOOST_CHECK_EQUAL(seen.Size(), 1U);
+    BOOST_CHECK(seen.Has(MessageHash(0)));
+
+    seen.Clear();
+    BOOST_CHECK_EQUAL(seen.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(smartnodeseen_serialization)
+{
+    SeenMessages seen;
+    std::map<uint256, SeenMessage> mapExpected;
+
+    for (int i = 0; i < 100; i++) {
+        seen.Insert(MessageHash(i), SeenMessage(i));
+        mapExpected[MessageHash(i)] = SeenMessage(i);
+    }
+
+    // Same format as the std::map of the previous cache files.
+    CDataStream ssSeen(SER_DISK, CLIENT_VERSION), ssMap(SER_DISK, CLIENT_VERSION);
+    ssSeen << seen;
+    ssMap << mapExpected;
+    BOOST_CHECK(ssSeen.str() == ssMap.str());
+    BOOST_CHECK_EQUAL(ssSeen.size(), seen.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+
+    SeenMessages read;
+    ssMap >> read;
+    BOOST_CHECK_EQUAL(read.Size(), 100U);
+    BOOST_CHECK_EQUAL(read.EraseBefore(50), 50U);
+    BOOST_CHECK(read.Has(MessageHash(50)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
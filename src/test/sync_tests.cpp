@@ -0,0 +1,79 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sync.h"
+#include "test/test_bitcoin.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
+
+// The registry keeps the statistics for the lifetime of the process, so are the locks
+static CCriticalSection csRecursive;
+static CCriticalSection csContended;
+
+BOOST_AUTO_TEST_CASE(lockstats_recursive)
+{
+    RegisterLockStats(csRecursive, "csRecursive");
+    CLockStats* pstats = GetLockStats(&csRecursive);
+    BOOST_REQUIRE(pstats);
+    pstats->Reset();
+
+    {
+        LOCK(csRecursive);
+        LOCK(csRecursive);
+        TRY_LOCK(csRecursive, lockTry);
+        bool fLocked = lockTry;
+        BOOST_CHECK(fLocked);
+    }
+    BOOST_CHECK_EQUAL(pstats->nAcquisitions.load(), 1);
+    BOOST_CHECK_EQUAL(pstats->nDepth, 0);
+
+    // Releasing an outer LOCK by hand ends the hold like in the getblocktemplate longpoll
+    {
+        LOCK(csRecursive);
+        LEAVE_CRITICAL_SECTION(csRecursive);
+        BOOST_CHECK_EQUAL(pstats->nDepth, 0);
+        ENTER_CRITICAL_SECTION(csRecursive);
+    }
+    BOOST_CHECK_EQUAL(pstats->nAcquisitions.load(), 3);
+    BOOST_CHECK_EQUAL(pstats->nContended.load(), 0);
+    BOOST_CHECK_EQUAL(pstats->nDepth, 0);
+
+    bool fFound = false;
+    for (CLockStats* p : GetLockStats())
+        fFound |= p == pstats;
+    BOOST_CHECK(fFound);
+}
+
+static void LockContended()
+{
+    LOCK(csContended);
+}
+
+BOOST_AUTO_TEST_CASE(lockstats_contended)
+{
+    RegisterLockStats(csContended, "csContended");
+    CLockStats* pstats = GetLockStats(&csContended);
+    BOOST_REQUIRE(pstats);
+    pstats->Reset();
+
+    boost::thread thread;
+    {
+        LOCK(csContended);
+        thread = boost::thread(LockContended);
+        MilliSleep(50);
+    }
+    thread.join();
+
+    BOOST_CHECK_EQUAL(pstats->nAcquisitions.load(), 2);
+    BOOST_CHECK_EQUAL(pstats->nContended.load(), 1);
+    BOOST_CHECK(pstats->nWaitTime.load() > 0);
+    BOOST_CHECK_EQUAL(pstats->nWaitTime.load(), pstats->nMaxWaitTime.load());
+    BOOST_CHECK(pstats->nMaxHoldTime.load() >= 50000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,181 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "taskpool.h"
+
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(taskpool_tests, BasicTestingSetup)
+
+/** Blocks a worker of the pool until it gets opened */
+class Gate
+{
+    boost::mutex cs;
+    boost::condition_variable cond;
+    bool fOpen = false;
+    int nWaiting = 0;
+
+public:
+    void Wait()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        nWaiting++;
+        cond.notify_all();
+        while (!fOpen)
+            cond.wait(lock);
+    }
+    void WaitFor(int n)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        while (nWaiting < n)
+            cond.wait(lock);
+    }
+    void Open()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fOpen = true;
+        cond.notify_all();
+    }
+};
+
+static void Spawn(CTaskPool& pool, std::atomic<int>& nRun, int nDepth)
+{
+    nRun++;
+    if (nDepth == 0)
+        return;
+    for (int i = 0; i < 2; i++)
+        pool.Submit(CTaskPool::PRIORITY_NORMAL, std::bind(&Spawn, std::ref(pool), std::ref(nRun), nDepth - 1));
+}
+
+BOOST_AUTO_TEST_CASE(taskpool_runs_all)
+{
+    CTaskPool pool;
+    std::atomic<int> nRun(0);
+
+    // Submitted before the start and from the workers, Stop runs all of them
+    pool.Submit(CTaskPool::PRIORITY_LOW, std::bind(&Spawn, std::ref(pool), std::ref(nRun), 10));
+    pool.Start(4);
+    BOOST_CHECK_EQUAL(pool.WorkerCount(), 4);
+    pool.Submit(CTaskPool::PRIORITY_HIGH, std::bind(&Spawn, std::ref(pool), std::ref(nRun), 10));
+    pool.Submit(CTaskPool::PRIORITY_HIGH, []() { throw std::runtime_error("taskpool test"); });
+    pool.Stop();
+
+    BOOST_CHECK_EQUAL(nRun.load(), 2 * ((1 << 11) - 1));
+    BOOST_CHECK_EQUAL(pool.Pending(), 0U);
+    BOOST_CHECK_EQUAL(pool.WorkerCount(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(taskpool_priority)
+{
+    CTaskPool pool;
+    Gate gate;
+    std::string strOrder;
+
+    pool.Start(1);
+    pool.Submit(CTaskPool::PRIORITY_NORMAL, std::bind(&Gate::Wait, &gate));
+    gate.WaitFor(1);
+
+    // The only worker is busy, it takes them by priority once free
+    pool.Submit(CTaskPool::PRIORITY_LOW, [&strOrder]() { strOrder += "l"; });
+    pool.Submit(CTaskPool::PRIORITY_NORMAL, [&strOrder]() { strOrder += "n"; });
+    pool.Submit(CTaskPool::PRIORITY_HIGH, [&strOrder]() { strOrder += "h"; });
+    pool.Submit(CTaskPool::PRIORITY_HIGH, [&strOrder]() { strOrder += "H"; });
+    BOOST_CHECK_EQUAL(pool.Pending(), 4U);
+    gate.Open();
+    pool.Stop();
+
+    BOOST_CHECK_EQUAL(strOrder, "hHnl");
+}
+
+BOOST_AUTO_TEST_CASE(taskpool_foreach)
+{
+    CTaskPool pool;
+    std::vector<std::atomic<int>> vRuns(1000);
+    auto count = [&vRuns](size_t i) { vRuns[i]++; };
+
+    // Not started, the caller does it all
+    pool.ForEach(CTaskPool::PRIORITY_NORMAL, vRuns.size(), 10, count);
+    for (const std::atomic<int>& nRuns : vRuns)
+        BOOST_CHECK_EQUAL(nRuns.load(), 1);
+
+    pool.Start(4);
+    pool.ForEach(CTaskPool::PRIORITY_NORMAL, vRuns.size(), 10, count);
+    for (const std::atomic<int>& nRuns : vRuns)
+        BOOST_CHECK_EQUAL(nRuns.load(), 2);
+
+    // From the only free worker, the helpers can't start before it is done
+    Gate gate;
+    std::atomic<bool> fDone(false);
+    for (int i = 0; i < 3; i++)
+        pool.Submit(CTaskPool::PRIORITY_HIGH, std::bind(&Gate::Wait, &gate));
+    gate.WaitFor(3);
+    pool.Submit(CTaskPool::PRIORITY_HIGH, [&]() {
+        pool.ForEach(CTaskPool::PRIORITY_HIGH, vRuns.size(), 1, count);
+        fDone = true;
+    });
+    while (!fDone)
+        MilliSleep(1);
+    gate.Open();
+    for (const std::atomic<int>& nRuns : vRuns)
+        BOOST_CHECK_EQUAL(nRuns.load(), 3);
+
+    BOOST_CHECK_THROW(pool.ForEach(CTaskPool::PRIORITY_NORMAL, 100, 1, [](size_t i) {
+        if (i == 50)
+            throw std::runtime_error("taskpool test");
+    }), std::runtime_error);
+
+    pool.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(taskqueue_limits)
+{
+    CTaskPool pool;
+    Gate gate;
+    std::atomic<int> nRunning(0), nMaxRunning(0), nRun(0);
+
+    pool.Start(4);
+    {
+        CTaskQueue queue(pool, CTaskPool::PRIORITY_NORMAL, 3, 2);
+        BOOST_CHECK_EQUAL(queue.MaxRunning(), 2);
+
+        auto task = [&]() {
+            int n = ++nRunning;
+            int nMax = nMaxRunning.load();
+            while (n > nMax && !nMaxRunning.compare_exchange_weak(nMax, n)) {}
+            gate.Wait();
+            nRunning--;
+            nRun++;
+        };
+
+        // Two run and wait at the gate, three more fit into the queue
+        for (int i = 0; i < 2; i++)
+            BOOST_CHECK(queue.Enqueue(task));
+        gate.WaitFor(2);
+        for (int i = 0; i < 3; i++)
+            BOOST_CHECK(queue.Enqueue(task));
+        BOOST_CHECK_EQUAL(queue.Depth(), 3U);
+        BOOST_CHECK(!queue.Enqueue(task));
+
+        gate.Open();
+        while (nRun < 5)
+            MilliSleep(1);
+        BOOST_CHECK_EQUAL(nMaxRunning.load(), 2);
+        BOOST_CHECK_EQUAL(queue.Depth(), 0U);
+
+        queue.Interrupt();
+        BOOST_CHECK(!queue.Enqueue(task));
+        queue.WaitExit();
+    }
+    pool.Stop();
+    BOOST_CHECK_EQUAL(nRun.load(), 5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
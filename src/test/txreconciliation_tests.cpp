@@ -0,0 +1,203 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txreconciliation.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_bitcoin.h"
+#include "version.h"
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+namespace {
+
+std::set<uint32_t> RandomElements(FastRandomContext& ctx, size_t nCount)
+{
+    std::set<uint32_t> setElements;
+    while (setElements.size() < nCount) {
+        uint32_t n = ctx.rand32();
+        if (n != 0)
+            setElements.insert(n);
+    }
+    return setElements;
+}
+
+CTxSketch MakeSketch(const std::set<uint32_t>& setElements, size_t nCapacity)
+{
+    CTxSketch sketch(nCapacity);
+    for (uint32_t n : setElements)
+        sketch.Add(n);
+    return sketch;
+}
+
+uint256 RandomHash(FastRandomContext& ctx)
+{
+    uint256 hash;
+    for (unsigned char& c : hash)
+        c = ctx.rand32();
+    return hash;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(sketch_decode)
+{
+    FastRandomContext ctx(true);
+    for (size_t nSize : {0, 1, 2, 7, 32}) {
+        std::set<uint32_t> setElements = RandomElements(ctx, nSize);
+        std::vector<uint32_t> vDecoded;
+        BOOST_CHECK(MakeSketch(setElements, 32).Decode(vDecoded));
+        BOOST_CHECK(std::set<uint32_t>(vDecoded.begin(), vDecoded.end()) == setElements);
+        BOOST_CHECK_EQUAL(vDecoded.size(), nSize);
+    }
+
+    // Adding an element twice removes it again
+    CTxSketch sketch(4);
+    sketch.Add(12345);
+    sketch.Add(12345);
+    std::vector<uint32_t> vDecoded;
+    BOOST_CHECK(sketch.Decode(vDecoded));
+    BOOST_CHECK(vDecoded.empty());
+}
+
+BOOST_AUTO_TEST_CASE(sketch_merge)
+{
+    FastRandomContext ctx(true);
+    std::set<uint32_t> setCommon = RandomElements(ctx, 500);
+    std::set<uint32_t> setOnlyA = RandomElements(ctx, 10), setOnlyB = RandomElements(ctx, 15);
+
+    std::set<uint32_t> setA = setCommon, setB = setCommon;
+    setA.insert(setOnlyA.begin(), setOnlyA.end());
+    setB.insert(setOnlyB.begin(), setOnlyB.end());
+
+    // The common elements cancel out, the merge shrinks to the smaller capacity
+    CTxSketch sketch = MakeSketch(setA, 40);
+    sketch.Merge(MakeSketch(setB, 30));
+    BOOST_CHECK_EQUAL(sketch.GetCapacity(), 30U);
+
+    std::vector<uint32_t> vDecoded;
+    BOOST_CHECK(sketch.Decode(vDecoded));
+    std::set<uint32_t> setExpected = setOnlyA;
+    setExpected.insert(setOnlyB.begin(), setOnlyB.end());
+    BOOST_CHECK(std::set<uint32_t>(vDecoded.begin(), vDecoded.end()) == setExpected);
+}
+
+BOOST_AUTO_TEST_CASE(sketch_overfull)
+{
+    // More elements than the capacity don't decode into a wrong set
+    FastRandomContext ctx(true);
+    for (int i = 0; i < 20; i++) {
+        std::vector<uint32_t> vDecoded;
+        BOOST_CHECK(!MakeSketch(RandomElements(ctx, 12), 8).Decode(vDecoded));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sketch_serialization)
+{
+    FastRandomContext ctx(true);
+    std::set<uint32_t> setElements = RandomElements(ctx, 5);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << MakeSketch(setElements, 8);
+    CTxSketch sketch;
+    stream >> sketch;
+    BOOST_CHECK_EQUAL(sketch.GetCapacity(), 8U);
+    std::vector<uint32_t> vDecoded;
+    BOOST_CHECK(sketch.Decode(vDecoded));
+    BOOST_CHECK(std::set<uint32_t>(vDecoded.begin(), vDecoded.end()) == setElements);
+
+    // A peer can't make us keep sketches larger than the largest capacity
+    stream << CTxSketch(MAX_SKETCH_CAPACITY + 1);
+    BOOST_CHECK_THROW(stream >> sketch, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(capacity_estimate)
+{
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(0, 0), 1U);
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(10, 14), 7U);
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(14, 10), 7U);
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(5000, 0), MAX_SKETCH_CAPACITY);
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_state)
+{
+    FastRandomContext ctx(true);
+
+    // Both sides derive the same short ids, whichever salt is whose
+    CTxReconciliationState initiator(true, 1111, 2222), responder(false, 2222, 1111);
+    uint256 hash = RandomHash(ctx);
+    BOOST_CHECK_EQUAL(initiator.GetShortID(hash), responder.GetShortID(hash));
+    BOOST_CHECK(initiator.GetShortID(hash) != CTxReconciliationState(true, 1111, 3333).GetShortID(hash));
+
+    // Only the initiator floods a share of the items
+    size_t nFlooded = 0;
+    for (int i = 0; i < 1000; i++) {
+        uint256 h = RandomHash(ctx);
+        BOOST_CHECK(!responder.ShouldFlood(h));
+        nFlooded += initiator.ShouldFlood(h);
+    }
+    BOOST_CHECK(nFlooded > 400 && nFlooded < 600);
+
+    CInv inv(MSG_TX, hash);
+    BOOST_CHECK(initiator.Add(inv));
+    BOOST_CHECK(initiator.Add(inv));
+    BOOST_CHECK_EQUAL(initiator.setInventory.size(), 1U);
+    initiator.Remove(RandomHash(ctx));
+    BOOST_CHECK_EQUAL(initiator.setInventory.size(), 1U);
+    initiator.Remove(hash);
+    BOOST_CHECK(initiator.setInventory.empty());
+
+    // Past the set size limit everything gets flooded
+    while (initiator.setInventory.size() < MAX_RECON_SET_SIZE)
+        BOOST_CHECK(initiator.Add(CInv(MSG_TX, RandomHash(ctx))));
+    BOOST_CHECK(!initiator.Add(CInv(MSG_TX, RandomHash(ctx))));
+
+    BOOST_CHECK(CTxReconciliationState::IsReconciled(MSG_TX));
+    BOOST_CHECK(!CTxReconciliationState::IsReconciled(MSG_BLOCK));
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_round)
+{
+    // One round as the peers run it, the sets differ by one side's items each
+    FastRandomContext ctx(true);
+    CTxReconciliationState initiator(true, 42, 4242), responder(false, 4242, 42);
+    std::vector<CInv> vCommon, vOnlyInitiator, vOnlyResponder;
+    for (int i = 0; i < 200; i++)
+        vCommon.push_back(CInv(MSG_TX, RandomHash(ctx)));
+    for (int i = 0; i < 6; i++) {
+        vOnlyInitiator.push_back(CInv(MSG_TX, RandomHash(ctx)));
+        vOnlyResponder.push_back(CInv(MSG_TX, RandomHash(ctx)));
+    }
+    for (const CInv& inv : vCommon) {
+        BOOST_CHECK(initiator.Add(inv));
+        BOOST_CHECK(responder.Add(inv));
+    }
+    for (const CInv& inv : vOnlyInitiator)
+        BOOST_CHECK(initiator.Add(inv));
+    for (const CInv& inv : vOnlyResponder)
+        BOOST_CHECK(responder.Add(inv));
+
+    size_t nCapacity = EstimateSketchCapacity(responder.setInventory.size(), initiator.setInventory.size());
+    CTxSketch sketch = CTxReconciliationState::GetSketch(initiator.setInventory, nCapacity);
+    sketch.Merge(CTxReconciliationState::GetSketch(responder.setInventory, nCapacity));
+
+    std::vector<uint32_t> vDiff;
+    BOOST_CHECK(sketch.Decode(vDiff));
+    BOOST_CHECK_EQUAL(vDiff.size(), 12U);
+    size_t nInitiatorHas = 0, nResponderHas = 0;
+    for (uint32_t nShortID : vDiff) {
+        nInitiatorHas += initiator.setInventory.count(nShortID);
+        nResponderHas += responder.setInventory.count(nShortID);
+    }
+    BOOST_CHECK_EQUAL(nInitiatorHas, 6U);
+    BOOST_CHECK_EQUAL(nResponderHas, 6U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -286,6 +286,41 @@ BOOST_AUTO_TEST_CASE(univalue_object)
     BOOST_CHECK_EQUAL(obj.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(univalue_object_index)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.reserve(2 * UniValue::INDEX_MIN_KEYS);
+    for (size_t i = 0; i < 2 * UniValue::INDEX_MIN_KEYS; i++) {
+        UniValue v(UniValue::VARR);
+        v.push_back(UniValue((uint64_t)i));
+        BOOST_CHECK(obj.pushKV("key" + std::to_string(i), std::move(v)));
+    }
+    // The first occurrence of a duplicate key wins, with and without the index
+    BOOST_CHECK(obj.pushKV("key1", "dup"));
+    BOOST_CHECK_EQUAL(obj.size(), 2 * UniValue::INDEX_MIN_KEYS + 1);
+
+    UniValue copy(obj);
+    UniValue moved(std::move(copy));
+    UniValue read;
+    BOOST_CHECK(read.read(obj.write()));
+    for (const UniValue* o : {&obj, &moved, &read}) {
+        for (size_t i = 0; i < 2 * UniValue::INDEX_MIN_KEYS; i++)
+            BOOST_CHECK_EQUAL(find_value(*o, "key" + std::to_string(i))[0].get_int64(), (int64_t)i);
+        BOOST_CHECK((*o)["key1"].isArray());
+        BOOST_CHECK(!o->exists("nyuknyuknyuk"));
+    }
+
+    map<string, UniValue::VType> objTypes;
+    objTypes["key0"] = UniValue::VARR;
+    objTypes["key31"] = UniValue::VARR;
+    BOOST_CHECK(moved.checkObject(objTypes));
+
+    obj.setObject();
+    BOOST_CHECK(!obj.exists("key0"));
+    BOOST_CHECK(obj.pushKV("key0", 1));
+    BOOST_CHECK_EQUAL(obj["key0"].get_int(), 1);
+}
+
 static const char *json1 =
 "[1.10000000,{\"key1\":\"str\\u0000\",\"key2\":800,\"key3\":{\"name\":\"martian http://test.com\"}}]";
 
@@ -330,6 +365,17 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
     BOOST_CHECK(!v.read("[]{}"));
     BOOST_CHECK(!v.read("{}[]"));
     BOOST_CHECK(!v.read("{} 42"));
+
+    /* With a size the input ends there, it doesn't need a NUL and a NUL
+       inside of it is an error. */
+    const char *pchBody = "{\"key\":[1,\"str\"]}{\"more\":";
+    BOOST_CHECK(v.read(pchBody, 17));
+    BOOST_CHECK_EQUAL(v["key"][1].get_str(), "str");
+    BOOST_CHECK(!v.read(pchBody, 16));
+    BOOST_CHECK(!v.read(pchBody, 18));
+    BOOST_CHECK(!v.read("[12", 2));
+    BOOST_CHECK(!v.read("[\"ab", 4));
+    BOOST_CHECK(!v.read(std::string("[1]\0", 4)));
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -67,6 +67,15 @@ BOOST_AUTO_TEST_CASE(util_ParseHex)
     // Stop parsing at invalid value
     result = ParseHex("1234 invalid 1234");
     BOOST_CHECK(result.size() == 2 && result[0] == 0x12 && result[1] == 0x34);
+
+    // Long runs are decoded in blocks, uppercase and spaces in and after them
+    std::string strHex = HexStr(ParseHex_expected, ParseHex_expected + sizeof(ParseHex_expected));
+    result = ParseHex(strHex.substr(0, 40) + " " + strHex.substr(40, 50) + "\n" + strHex.substr(90));
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.end());
+    result = ParseHex("04678AFDB0FE5548271967F1A67130B7105CD6A828E03909A67962E0EA1F61DE");
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.begin() + 32);
+    result = ParseHex(strHex.substr(0, 41) + "x" + strHex.substr(42));
+    BOOST_CHECK_EQUAL_COLLECTIONS(result.begin(), result.end(), expected.begin(), expected.begin() + 20);
 }
 
 BOOST_AUTO_TEST_CASE(util_HexStr)
@@ -88,6 +97,12 @@ BOOST_AUTO_TEST_CASE(util_HexStr)
     BOOST_CHECK_EQUAL(
         HexStr(ParseHex_vec, true),
         "04 67 8a fd b0");
+
+    // Pointers to bytes and other iterators are encoded the same
+    std::vector<unsigned char> ParseHex_all(ParseHex_expected, ParseHex_expected + sizeof(ParseHex_expected));
+    std::vector<char> ParseHex_chars(ParseHex_all.begin(), ParseHex_all.end());
+    BOOST_CHECK_EQUAL(HexStr(ParseHex_all), HexStr(ParseHex_expected, ParseHex_expected + sizeof(ParseHex_expected)));
+    BOOST_CHECK_EQUAL(HexStr(ParseHex_chars.data(), ParseHex_chars.data() + ParseHex_chars.size()), HexStr(ParseHex_all));
 }
 
 
@@ -239,6 +254,10 @@ BOOST_AUTO_TEST_CASE(util_IsHex)
     BOOST_CHECK(!IsHex("eleven"));
     BOOST_CHECK(!IsHex("00xx00"));
     BOOST_CHECK(!IsHex("0x0000"));
+    BOOST_CHECK(IsHex("00112233445566778899aabbccddeeffAABBCCDDEEFF0011"));
+    BOOST_CHECK(!IsHex("00112233445566778899aabbccddeeffAABBCCDDEEFF001"));
+    BOOST_CHECK(!IsHex("00112233445566778899aabbccddeefgAABBCCDDEEFF0011"));
+    BOOST_CHECK(!IsHex("00112233445566778899aabbccddeeffAABBCCDDEEFF0011 "));
 }
 
 BOOST_AUTO_TEST_CASE(util_seed_insecure_rand)
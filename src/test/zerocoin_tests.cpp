@@ -0,0 +1,63 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "libzerocoin/Zerocoin.h"
+#include "taskpool.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace libzerocoin;
+
+BOOST_FIXTURE_TEST_SUITE(zerocoin_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(accumulator_batch)
+{
+    Bignum modulus = Bignum::generatePrime(1024, false) * Bignum::generatePrime(1024, false);
+    libzerocoin::Params params(modulus, modulus);
+
+    std::vector<PublicCoin> coins;
+    for (int i = 0; i < 5; i++)
+        coins.push_back(PrivateCoin(&params).getPublicCoin());
+
+    Accumulator accSerial(&params);
+    for (const PublicCoin& coin : coins)
+        accSerial += coin;
+    AccumulatorWitness witnessSerial(&params, Accumulator(&params), coins[2]);
+    for (const PublicCoin& coin : coins)
+        witnessSerial += coin;
+
+    // Inline without workers and spread over the pool, the same as one by one
+    for (int nThreads : {0, 3}) {
+        if (nThreads)
+            taskPool.Start(nThreads);
+
+        Accumulator acc(&params);
+        acc.accumulate(coins);
+        BOOST_CHECK(acc == accSerial);
+
+        AccumulatorWitness witness(&params, Accumulator(&params), coins[2]);
+        witness.AddElements(coins);
+        BOOST_CHECK(witness.getValue() == witnessSerial.getValue());
+        BOOST_CHECK(witness.VerifyWitness(acc, coins[2]));
+        BOOST_CHECK(!witness.VerifyWitness(acc, coins[3]));
+
+        if (nThreads)
+            taskPool.Stop();
+    }
+
+    // An empty batch leaves it as it was, an invalid coin anywhere fails all of it
+    Accumulator acc(&params);
+    acc.accumulate(std::vector<PublicCoin>());
+    BOOST_CHECK(acc == Accumulator(&params));
+
+    std::vector<PublicCoin> invalid(coins);
+    invalid.insert(invalid.begin() + 3, PublicCoin(&params, Bignum(4)));
+    BOOST_CHECK_THROW(acc.accumulate(invalid), ZerocoinException);
+    BOOST_CHECK(acc == Accumulator(&params));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
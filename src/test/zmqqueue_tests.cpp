@@ -0,0 +1,69 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zmq/zmqqueue.h"
+
+#include "test/test_bitcoin.h"
+
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(zmqqueue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(zmqqueue_order)
+{
+    CZMQQueue<int> queue;
+    int n;
+    BOOST_CHECK(!queue.Pop(n));
+
+    for (int i = 0; i < 100; i++)
+        queue.Push(i);
+    BOOST_CHECK_EQUAL(queue.Size(), 100U);
+
+    for (int i = 0; i < 100; i++) {
+        BOOST_CHECK(queue.Pop(n));
+        BOOST_CHECK_EQUAL(n, i);
+    }
+    BOOST_CHECK(!queue.Pop(n));
+    BOOST_CHECK_EQUAL(queue.Size(), 0U);
+
+    // Left over ones get freed with the queue
+    queue.Push(1);
+}
+
+BOOST_AUTO_TEST_CASE(zmqqueue_producers)
+{
+    static const int nProducers = 4;
+    static const int nPerProducer = 20000;
+    CZMQQueue<std::pair<int, int> > queue;
+
+    std::vector<std::thread> vThreads;
+    for (int p = 0; p < nProducers; p++) {
+        vThreads.emplace_back([&queue, p] {
+            for (int i = 0; i < nPerProducer; i++)
+                queue.Push(std::make_pair(p, i));
+        });
+    }
+
+    // Everything arrives once, in the order of each producer
+    std::vector<int> vNext(nProducers, 0);
+    int nPopped = 0;
+    std::pair<int, int> value;
+    while (nPopped < nProducers * nPerProducer) {
+        if (!queue.Pop(value))
+            continue;
+        BOOST_REQUIRE_EQUAL(value.second, vNext[value.first]);
+        vNext[value.first]++;
+        nPopped++;
+    }
+
+    for (std::thread& thread : vThreads)
+        thread.join();
+    BOOST_CHECK(!queue.Pop(value));
+    BOOST_CHECK_EQUAL(queue.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
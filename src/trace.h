@@ -0,0 +1,45 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_TRACE_H
+#define SMARTCASH_TRACE_H
+
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
+/**
+ * Static tracepoints (USDT) for SystemTap and bpftrace, built in with --enable-usdt. A tracepoint
+ * is a nop instruction in the binary until a tracer attaches to it. Its arguments get evaluated
+ * either way, so they need to be values at hand. Without --enable-usdt the macros expand to nothing.
+ *
+ * The context is the provider of a probe and the event its name, e.g.
+ *   bpftrace -e 'usdt:./smartcashd:validation:block_connected { @ms = hist(arg2 / 1000); }'
+ * The arguments of each tracepoint are listed where it is placed.
+ */
+#ifdef ENABLE_TRACING
+
+#include <sys/sdt.h>
+
+#define TRACE(context, event) DTRACE_PROBE(context, event)
+#define TRACE1(context, event, a) DTRACE_PROBE1(context, event, a)
+#define TRACE2(context, event, a, b) DTRACE_PROBE2(context, event, a, b)
+#define TRACE3(context, event, a, b, c) DTRACE_PROBE3(context, event, a, b, c)
+#define TRACE4(context, event, a, b, c, d) DTRACE_PROBE4(context, event, a, b, c, d)
+#define TRACE5(context, event, a, b, c, d, e) DTRACE_PROBE5(context, event, a, b, c, d, e)
+#define TRACE6(context, event, a, b, c, d, e, f) DTRACE_PROBE6(context, event, a, b, c, d, e, f)
+
+#else
+
+#define TRACE(context, event)
+#define TRACE1(context, event, a)
+#define TRACE2(context, event, a, b)
+#define TRACE3(context, event, a, b, c)
+#define TRACE4(context, event, a, b, c, d)
+#define TRACE5(context, event, a, b, c, d, e)
+#define TRACE6(context, event, a, b, c, d, e, f)
+
+#endif // ENABLE_TRACING
+
+#endif // SMARTCASH_TRACE_H
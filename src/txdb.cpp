@@ -5,6 +5,7 @@
 
 #include "txdb.h"
 
+#include "blockfilter.h"
 #include "chainparams.h"
 #include "hash.h"
 #include "pow.h"
@@ -12,7 +13,15 @@
 #include "ui_interface.h"
 #include "init.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <set>
 #include <stdint.h>
+#include <thread>
 
 #include <boost/thread.hpp>
 
@@ -23,10 +32,28 @@ static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSINDEXCOMPACT = 'X';
+static const char DB_ADDRESSINDEXTX = 'x';
+static const char DB_ADDRESSID = 'N';
+static const char DB_ADDRESSIDADDRESS = 'n';
+static const char DB_ADDRESSIDNEXT = 'O';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSUNSPENTAMOUNTINDEX = 'U';
+static const char DB_ADDRESSBALANCEINDEX = 'A';
+static const char DB_ADDRESSBALANCEBEST = 'L';
+static const char DB_ADDRESSRICHLIST = 'Q';
+static const char DB_ADDRESSBALANCEDELTA = 'D';
+static const char DB_ADDRESSBALANCEDELTASTART = 'E';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_SPENTINDEX = 'p';
 static const char DB_DEPOSITINDEX = 'd';
+static const char DB_DEPOSITBUCKET = 'w';
+static const char DB_PAYOUTINDEX = 'P';
+static const char DB_BLOCKSUMMARY = 'S';
+static const char DB_KEPTTX = 'K';
+static const char DB_BLOCKFILTER = 'G';
+static const char DB_BLOCKFILTERHEADER = 'g';
+static const char DB_INDEXBUILD = 'H';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_VOTE_KEY_REGISTRATION = 'r';
@@ -72,6 +99,55 @@ bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
+void CCoinsViewDB::GetCoins(const std::vector<COutPoint> &vOutpoints, std::vector<Coin> &vCoins) const
+{
+    vCoins.assign(vOutpoints.size(), Coin());
+
+    // Neighbouring keys mostly share the table blocks leveldb has to read
+    std::vector<size_t> vOrder(vOutpoints.size());
+    for (size_t i = 0; i < vOrder.size(); i++)
+        vOrder[i] = i;
+    std::sort(vOrder.begin(), vOrder.end(), [&vOutpoints](size_t a, size_t b) { return vOutpoints[a] < vOutpoints[b]; });
+
+    auto readRange = [this, &vOutpoints, &vCoins, &vOrder](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; i++) {
+            if (!db.Read(CoinEntry(&vOutpoints[vOrder[i]]), vCoins[vOrder[i]]))
+                vCoins[vOrder[i]].Clear();
+        }
+    };
+
+    size_t nThreads = std::min<size_t>(std::min(GetNumCores(), MAX_COINS_READ_THREADS), vOutpoints.size() / COINS_READ_THREAD_MIN);
+    if (nThreads <= 1) {
+        readRange(0, vOutpoints.size());
+        return;
+    }
+
+    // The calling thread reads the first range, read errors get rethrown to it
+    size_t nPerThread = (vOutpoints.size() + nThreads - 1) / nThreads;
+    std::vector<std::exception_ptr> vErrors(nThreads);
+    std::vector<std::thread> vThreads;
+    for (size_t t = 1; t < nThreads; t++) {
+        vThreads.emplace_back([&readRange, &vErrors, &vOutpoints, nPerThread, t]() {
+            try {
+                readRange(t * nPerThread, std::min(vOutpoints.size(), (t + 1) * nPerThread));
+            } catch (...) {
+                vErrors[t] = std::current_exception();
+            }
+        });
+    }
+    try {
+        readRange(0, nPerThread);
+    } catch (...) {
+        vErrors[0] = std::current_exception();
+    }
+    for (std::thread& thread : vThreads)
+        thread.join();
+    for (const std::exception_ptr& error : vErrors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
     return db.Exists(CoinEntry(&outpoint));
 }
@@ -113,7 +189,16 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+size_t CVoteKeyHasher::operator()(const CVoteKey& voteKey) const
+{
+    CKeyID keyId;
+    voteKey.GetKeyID(keyId);
+    return ReadLE64(keyId.begin());
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe, size_t nIndexCacheSize) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, CDBOptions(true)), spentCache(SPENT_INDEX_CACHE_SIZE), fVoteKeysLoaded(false), nNextAddressId(0) {
+    if (nIndexCacheSize > 0)
+        pindexdb.reset(new CDBWrapper(GetDataDir() / "indexes", nIndexCacheSize, fMemory, fWipe, false, CDBOptions(true, INDEX_DB_BLOCK_SIZE)));
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -203,22 +288,114 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
 }
 
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
-    return Read(make_pair(DB_TXINDEX, txid), pos);
+    return IndexDB().Read(make_pair(DB_TXINDEX, txid), pos);
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
-    CDBBatch batch(*this);
+void CBlockTreeDB::WriteTxIndex(CDBBatch &batch, const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
     for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
-    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+    CDBBatch batch(IndexDB());
+    WriteTxIndex(batch, vect);
+    return IndexDB().WriteBatch(batch);
+}
+
+bool CSpentIndexCache::Get(const CSpentIndexKey &key, CSpentIndexValue &value) {
+    LOCK(cs);
+
+    auto it = mapEntries.find(key);
+
+    if (it == mapEntries.end())
+        return false;
+
+    listEntries.splice(listEntries.begin(), listEntries, it->second);
+    value = it->second->second;
+
+    return true;
+}
+
+void CSpentIndexCache::Add(const CSpentIndexKey &key, const CSpentIndexValue &value) {
+    LOCK(cs);
+
+    if (value.IsNull() || value.blockHeight > nBestHeight - SPENT_INDEX_CACHE_MIN_DEPTH || mapEntries.count(key))
+        return;
+
+    listEntries.push_front(std::make_pair(key, value));
+    mapEntries[key] = listEntries.begin();
+
+    while (listEntries.size() > nMaxEntries) {
+        mapEntries.erase(listEntries.back().first);
+        listEntries.pop_back();
+    }
+}
+
+void CSpentIndexCache::Update(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect) {
+    LOCK(cs);
+
+    for (const auto &entry : vect) {
+        auto it = mapEntries.find(entry.first);
+        if (it != mapEntries.end()) {
+            listEntries.erase(it->second);
+            mapEntries.erase(it);
+        }
+        if (!entry.second.IsNull())
+            nBestHeight = std::max(nBestHeight, entry.second.blockHeight);
+    }
 }
 
 bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
-    return Read(make_pair(DB_SPENTINDEX, key), value);
+    if (spentCache.Get(key, value))
+        return true;
+
+    if (!IndexDB().Read(make_pair(DB_SPENTINDEX, key), value))
+        return false;
+
+    spentCache.Add(key, value);
+    return true;
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
-    CDBBatch batch(*this);
+bool CBlockTreeDB::ReadSpentIndex(std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect) {
+
+    // Sorted like the database keys, the iterator moves forward only.
+    std::vector<size_t> vecOrder;
+    for (size_t i = 0; i < vect.size(); i++) {
+        if (!spentCache.Get(vect[i].first, vect[i].second))
+            vecOrder.push_back(i);
+    }
+
+    if (vecOrder.empty())
+        return true;
+
+    std::sort(vecOrder.begin(), vecOrder.end(), [&vect](size_t a, size_t b) {
+        return CSpentIndexKeyCompare()(vect[a].first, vect[b].first);
+    });
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+
+    for (size_t i : vecOrder) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CSpentIndexKey> key;
+
+        vect[i].second.SetNull();
+        pcursor->Seek(make_pair(DB_SPENTINDEX, vect[i].first));
+
+        if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_SPENTINDEX ||
+            key.second.txid != vect[i].first.txid || key.second.outputIndex != vect[i].first.outputIndex)
+            continue;
+
+        if (!pcursor->GetValue(vect[i].second))
+            return error("failed to get spent index value");
+
+        spentCache.Add(vect[i].first, vect[i].second);
+    }
+
+    return true;
+}
+
+void CBlockTreeDB::UpdateSpentIndex(CDBBatch &batch, const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+    spentCache.Update(vect);
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
             batch.Erase(make_pair(DB_SPENTINDEX, it->first));
@@ -226,24 +403,137 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
             batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
-    CDBBatch batch(*this);
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+    CDBBatch batch(IndexDB());
+    UpdateSpentIndex(batch, vect);
+    return IndexDB().WriteBatch(batch);
+}
+
+void CBlockTreeDB::UpdateAddressUnspentIndex(CDBBatch &batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+    // Amounts of the outputs written by this batch, they can get spent in the same block.
+    std::map<std::pair<uint256, size_t>, CAmount> mapWritten;
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        std::pair<uint256, size_t> outpoint(it->first.txhash, it->first.index);
         if (it->second.IsNull()) {
+            // The amount key of a spent output is only known from its value.
+            CAddressUnspentValue value;
+            auto written = mapWritten.find(outpoint);
+            if (written != mapWritten.end()) {
+                batch.Erase(make_pair(DB_ADDRESSUNSPENTAMOUNTINDEX, CAddressUnspentAmountKey(it->first, written->second)));
+                mapWritten.erase(written);
+            } else if (IndexDB().Read(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), value)) {
+                batch.Erase(make_pair(DB_ADDRESSUNSPENTAMOUNTINDEX, CAddressUnspentAmountKey(it->first, value.satoshis)));
+            }
             batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
         } else {
             batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+            batch.Write(make_pair(DB_ADDRESSUNSPENTAMOUNTINDEX, CAddressUnspentAmountKey(it->first, it->second.satoshis)), it->second);
+            mapWritten[outpoint] = it->second.satoshis;
+        }
+    }
+}
+
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+    CDBBatch batch(IndexDB());
+    UpdateAddressUnspentIndex(batch, vect);
+    return IndexDB().WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentAmountIndex(uint160 addressHash, int type,
+                                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                                                 CAddressUnspentAmountKey &cursor, int limit) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+    std::pair<char,CAddressUnspentAmountKey> key;
+    int nFound = 0;
+
+    // Largest amounts first, continue below the last output of the previous call.
+    if (cursor.IsNull()) {
+        pcursor->SeekForPrev(make_pair(DB_ADDRESSUNSPENTAMOUNTINDEX, CAddressUnspentAmountIteratorKey(type, addressHash, std::numeric_limits<CAmount>::max())));
+    } else {
+        pcursor->SeekForPrev(make_pair(DB_ADDRESSUNSPENTAMOUNTINDEX, cursor));
+        if (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTAMOUNTINDEX &&
+            key.second.GetUnspentKey() == cursor.GetUnspentKey())
+            pcursor->Prev();
+    }
+
+    cursor.SetNull();
+
+    while (pcursor->Valid() && (limit <= 0 || nFound < limit)) {
+        boost::this_thread::interruption_point();
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENTAMOUNTINDEX ||
+            key.second.type != (unsigned int)type || key.second.hashBytes != addressHash)
+            return true;
+
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value))
+            return error("failed to get address unspent amount value");
+
+        unspentOutputs.push_back(make_pair(key.second.GetUnspentKey(), value));
+        ++nFound;
+        pcursor->Prev();
+    }
+
+    // Keep the cursor only if there might be more outputs.
+    if (nFound && nFound == limit)
+        cursor = key.second;
+
+    return true;
+}
+
+bool CBlockTreeDB::RebuildAddressUnspentAmountIndex() {
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+    CDBBatch batch(IndexDB());
+    int64_t nCount = 0;
+
+    // Drop the keys of a previous run, they might be outdated.
+    pcursor->Seek(DB_ADDRESSUNSPENTAMOUNTINDEX);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressUnspentAmountKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENTAMOUNTINDEX)
+            break;
+        batch.Erase(key);
+        pcursor->Next();
+    }
+
+    if (!IndexDB().WriteBatch(batch))
+        return false;
+    batch.Clear();
+
+    pcursor->Seek(DB_ADDRESSUNSPENTINDEX);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENTINDEX)
+            break;
+
+        CAddressUnspentValue value;
+        if (!pcursor->GetValue(value))
+            return error("failed to get address unspent value");
+
+        batch.Write(make_pair(DB_ADDRESSUNSPENTAMOUNTINDEX, CAddressUnspentAmountKey(key.second, value.satoshis)), value);
+
+        if (++nCount % 10000 == 0) {
+            if (!IndexDB().WriteBatch(batch))
+                return false;
+            batch.Clear();
         }
+
+        pcursor->Next();
     }
-    return WriteBatch(batch);
+
+    return IndexDB().WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadAddressUnspentIndexCount(uint160 addressHash, int type, int &nCount, CAddressUnspentKey &lastIndex) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
 
     pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
 
@@ -277,11 +567,15 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
                                            const CAddressUnspentKey &start, int offset, int limit, bool reverse) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
     int nOffsetCount = 0, nFound = 0;
 
-    if( start.IsNull() )
+    if( reverse && start.IsNull() )
+        pcursor->SeekForPrev(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorHeightKey(type, addressHash, std::numeric_limits<int>::max())));
+    else if( start.IsNull() )
         pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    else if( reverse )
+        pcursor->SeekForPrev(make_pair(DB_ADDRESSUNSPENTINDEX, start));
     else
         pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, start));
 
@@ -314,18 +608,133 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
+bool CBlockTreeDB::ReadAddressId(unsigned int type, const uint160 &addressHash, uint32_t &nId) {
+    return IndexDB().Read(make_pair(DB_ADDRESSID, CAddressIndexIteratorKey(type, addressHash)), nId);
+}
+
+bool CBlockTreeDB::GetAddressId(unsigned int type, const uint160 &addressHash, uint32_t &nId) {
+    LOCK(cs_addressids);
+
+    if (ReadAddressId(type, addressHash, nId))
+        return true;
+
+    if (!nNextAddressId && !IndexDB().Read(DB_ADDRESSIDNEXT, nNextAddressId))
+        nNextAddressId = 1;
+
+    // Written before the entries which use it, an id of a batch which didn't make it just stays unused.
+    CDBBatch batch(IndexDB());
+    batch.Write(make_pair(DB_ADDRESSID, CAddressIndexIteratorKey(type, addressHash)), nNextAddressId);
+    batch.Write(make_pair(DB_ADDRESSIDADDRESS, nNextAddressId), CAddressIndexIteratorKey(type, addressHash));
+    batch.Write(DB_ADDRESSIDNEXT, nNextAddressId + 1);
+
+    if (!IndexDB().WriteBatch(batch))
+        return false;
+
+    nId = nNextAddressId++;
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressById(uint32_t nId, CAddressIndexIteratorKey &address) {
+    return IndexDB().Read(make_pair(DB_ADDRESSIDADDRESS, nId), address);
+}
+
+bool CBlockTreeDB::ReadAddressIndexTx(const CAddressIndexTxKey &txKey, uint256 &txhash) {
+    return IndexDB().Read(make_pair(DB_ADDRESSINDEXTX, txKey), txhash);
+}
+
+void CBlockTreeDB::WriteCompactAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fErase) {
+
+    // The entries come grouped by transaction and mostly by address too.
+    CAddressIndexIteratorKey lastAddress;
+    CAddressIndexTxKey lastTx;
+    uint32_t nId = 0;
+
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        const CAddressIndexKey &key = it->first;
+
+        if (it == vect.begin() || key.type != lastAddress.type || key.hashBytes != lastAddress.hashBytes) {
+            lastAddress = CAddressIndexIteratorKey(key.type, key.hashBytes);
+            // Nothing to erase for an address without id
+            if (!(fErase ? ReadAddressId(key.type, key.hashBytes, nId) : GetAddressId(key.type, key.hashBytes, nId)))
+                nId = 0;
+        }
+
+        if (!nId)
+            continue;
+
+        CAddressIndexCompactKey compactKey(nId, key);
+        CAddressIndexTxKey txKey(key.blockHeight, key.txindex);
+
+        if (fErase)
+            batch.Erase(make_pair(DB_ADDRESSINDEXCOMPACT, compactKey));
+        else
+            batch.Write(make_pair(DB_ADDRESSINDEXCOMPACT, compactKey), it->second);
+
+        if (it == vect.begin() || txKey != lastTx) {
+            if (fErase)
+                batch.Erase(make_pair(DB_ADDRESSINDEXTX, txKey));
+            else
+                batch.Write(make_pair(DB_ADDRESSINDEXTX, txKey), key.txhash);
+            lastTx = txKey;
+        }
+    }
+}
+
+bool CBlockTreeDB::UpgradeAddressIndex() {
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+    CDBBatch batch(IndexDB());
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vect;
+
+    // The iterator sees the database as it was, the converted entries get erased underneath.
+    pcursor->Seek(DB_ADDRESSINDEX);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX)
+            break;
+
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+
+        vect.push_back(make_pair(key.second, nValue));
+        batch.Erase(key);
+
+        if (vect.size() >= 10000) {
+            WriteCompactAddressIndex(batch, vect, false);
+            if (!IndexDB().WriteBatch(batch))
+                return false;
+            batch.Clear();
+            vect.clear();
+        }
+
+        pcursor->Next();
+    }
+
+    WriteCompactAddressIndex(batch, vect, false);
+    return IndexDB().WriteBatch(batch);
+}
+
+void CBlockTreeDB::WriteAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    WriteCompactAddressIndex(batch, vect, false);
+}
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
+    CDBBatch batch(IndexDB());
+    WriteAddressIndex(batch, vect);
+    return IndexDB().WriteBatch(batch);
+}
+
+void CBlockTreeDB::EraseAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    WriteCompactAddressIndex(batch, vect, true);
 }
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
+    CDBBatch batch(IndexDB());
+    EraseAddressIndex(batch, vect);
+    return IndexDB().WriteBatch(batch);
 }
 
 
@@ -333,170 +742,994 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    uint32_t nId;
+    if (!ReadAddressId(type, addressHash, nId))
+        return true;
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+    CAddressIndexIteratorKey address(type, addressHash);
+    CAddressIndexTxKey lastTx;
+    uint256 txhash;
 
     if (start > 0 && end > 0) {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
+        pcursor->Seek(make_pair(DB_ADDRESSINDEXCOMPACT, CAddressIndexCompactIteratorKey(nId, start)));
     } else {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+        pcursor->Seek(make_pair(DB_ADDRESSINDEXCOMPACT, CAddressIndexCompactIteratorKey(nId)));
     }
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
+        std::pair<char,CAddressIndexCompactKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEXCOMPACT && key.second.addressId == nId) {
             if (end > 0 && key.second.blockHeight > end) {
                 break;
             }
+            CAddressIndexTxKey txKey(key.second.blockHeight, key.second.txindex);
+            if ((txhash.IsNull() || txKey != lastTx) && !ReadAddressIndexTx(txKey, txhash)) {
+                return error("failed to get address index transaction");
+            }
+            lastTx = txKey;
+            CAmount nValue;
+            if (pcursor->GetValue(nValue)) {
+                addressIndex.push_back(make_pair(key.second.GetKey(address, txhash), nValue));
+                pcursor->Next();
+            } else {
+                return error("failed to get address index value");
+            }
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressIndexTransactions(uint160 addressHash, int type, bool fAscending,
+                                                int nCursorHeight, const uint256 &cursorTx, int64_t nSkip, int64_t nLimit,
+                                                std::vector<std::tuple<uint256, int, CAmount> > &vecTxs, bool &fMore) {
+
+    vecTxs.clear();
+    fMore = false;
+
+    uint32_t nId;
+    if (!ReadAddressId(type, addressHash, nId))
+        return true;
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+    bool fCursor = !cursorTx.IsNull();
+
+    if (fAscending) {
+        pcursor->Seek(make_pair(DB_ADDRESSINDEXCOMPACT, CAddressIndexCompactIteratorKey(nId, fCursor ? nCursorHeight : 0)));
+    } else {
+        // Position on the last entry at or below the cursor height.
+        int nHeight = fCursor && nCursorHeight < std::numeric_limits<int>::max() ? nCursorHeight + 1 : std::numeric_limits<int>::max();
+
+        pcursor->SeekForPrev(make_pair(DB_ADDRESSINDEXCOMPACT, CAddressIndexCompactIteratorKey(nId, nHeight)));
+    }
+
+    // The entries of one transaction are adjacent, the key is ordered by height and position in the block.
+    // Only the hashes of the transactions returned and of the ones at the cursor height get read.
+    bool fCursorFound = false;
+    bool fLastTx = false;
+    CAddressIndexTxKey lastTx;
+    CAddressIndexTxKey hashTx;
+    uint256 txhash;
+    int64_t nTxs = 0;
+
+    for (; pcursor->Valid(); fAscending ? pcursor->Next() : pcursor->Prev()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexCompactKey> key;
+
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEXCOMPACT || key.second.addressId != nId) {
+            break;
+        }
+
+        CAddressIndexTxKey txKey(key.second.blockHeight, key.second.txindex);
+
+        // Skip everything up to and including the transaction of the cursor. It might be gone
+        // after a reorg, then the page starts with the next height.
+        if (fCursor) {
+            if (key.second.blockHeight == nCursorHeight) {
+                if ((txhash.IsNull() || txKey != hashTx) && !ReadAddressIndexTx(txKey, txhash))
+                    return error("failed to get address index transaction");
+                hashTx = txKey;
+
+                if (!fCursorFound || txhash == cursorTx) {
+                    fCursorFound |= txhash == cursorTx;
+                    continue;
+                }
+            }
+            fCursor = false;
+        }
+
+        bool fNewTx = !fLastTx || txKey != lastTx;
+
+        if (fNewTx) {
+            if (nTxs++ >= nSkip + nLimit) {
+                fMore = true;
+                break;
+            }
+            lastTx = txKey;
+            fLastTx = true;
+        }
+
+        if (nTxs <= nSkip)
+            continue;
+
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+
+        if (fNewTx) {
+            if ((txhash.IsNull() || txKey != hashTx) && !ReadAddressIndexTx(txKey, txhash))
+                return error("failed to get address index transaction");
+            hashTx = txKey;
+            vecTxs.emplace_back(txhash, key.second.blockHeight, nValue);
+        } else {
+            std::get<2>(vecTxs.back()) += nValue;
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressIndexTransactionCount(uint160 addressHash, int type, int64_t &count) {
+
+    count = 0;
+
+    uint32_t nId;
+    if (!ReadAddressId(type, addressHash, nId))
+        return true;
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+    CAddressIndexTxKey lastTx;
+
+    pcursor->Seek(make_pair(DB_ADDRESSINDEXCOMPACT, CAddressIndexCompactIteratorKey(nId)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexCompactKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEXCOMPACT || key.second.addressId != nId) {
+            break;
+        }
+        CAddressIndexTxKey txKey(key.second.blockHeight, key.second.txindex);
+        if (!count || txKey != lastTx) {
+            lastTx = txKey;
+            ++count;
+        }
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddresses(std::vector<CAddressListEntry> &addressList, int nEndHeight, bool excludeZeroBalances) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+
+    // Ordered by address id, the order the addresses showed up in the chain
+    pcursor->Seek(DB_ADDRESSINDEXCOMPACT);
+
+    uint32_t nCurrentId = 0;
+    CAddressIndexIteratorKey currentKey;
+    CAmount currentReceived = 0, currentBalance = 0;
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexCompactKey> key;
+        if (pcursor->GetKey(key)){
+
+            if( key.first != DB_ADDRESSINDEXCOMPACT)
+                break;
+
+            if( key.second.addressId != nCurrentId ) {
+
+                if( nCurrentId && currentBalance > 0 && (!excludeZeroBalances || (excludeZeroBalances && currentBalance )))
+                    // Save the address info
+                    addressList.push_back(CAddressListEntry(currentKey.type,
+                                                            currentKey.hashBytes,
+                                                            currentReceived,
+                                                            currentBalance));
+
+                // And move on with the next one
+                currentReceived = 0;
+                currentBalance = 0;
+                nCurrentId = key.second.addressId;
+                if (!ReadAddressById(nCurrentId, currentKey))
+                    return error("failed to get the address of id %u", nCurrentId);
+            }
+
             CAmount nValue;
             if (pcursor->GetValue(nValue)) {
-                addressIndex.push_back(make_pair(key.second, nValue));
+
+                if( nEndHeight == -1 || key.second.blockHeight < nEndHeight ){
+                    currentBalance += nValue;
+                    if( nValue > 0)
+                        currentReceived += nValue;
+                }
+
                 pcursor->Next();
             } else {
                 return error("failed to get address index value");
             }
-        } else {
-            break;
+        } else {
+            break;
+        }
+    }
+
+    if( nCurrentId && (!excludeZeroBalances || (excludeZeroBalances && currentBalance )))
+        // Store the last one..
+        addressList.push_back(CAddressListEntry(currentKey.type,
+                                                currentKey.hashBytes,
+                                                currentReceived,
+                                                currentBalance));
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadAddressBalanceIndex(uint160 addressHash, int type, CAddressBalanceValue &value) {
+    return IndexDB().Read(make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)), value);
+}
+
+/** Height of the last address index entry of the address below nHeight, -1 if there is none. */
+int CBlockTreeDB::ReadAddressIndexLastHeight(uint160 addressHash, int type, int nHeight) {
+
+    uint32_t nId;
+    if (!ReadAddressId(type, addressHash, nId))
+        return -1;
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+
+    pcursor->SeekForPrev(make_pair(DB_ADDRESSINDEXCOMPACT, CAddressIndexCompactIteratorKey(nId, nHeight)));
+
+    std::pair<char,CAddressIndexCompactKey> key;
+
+    if (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEXCOMPACT &&
+        key.second.addressId == nId && key.second.blockHeight < nHeight) {
+        return key.second.blockHeight;
+    }
+
+    return -1;
+}
+
+bool CBlockTreeDB::ReadAddressIndexHeights(uint160 addressHash, int type, int nStartHeight, std::set<int> &setHeights) {
+
+    uint32_t nId;
+    if (!ReadAddressId(type, addressHash, nId))
+        return true;
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+    int nHeight = std::max(nStartHeight, 0);
+
+    while (true) {
+        boost::this_thread::interruption_point();
+        pcursor->Seek(make_pair(DB_ADDRESSINDEXCOMPACT, CAddressIndexCompactIteratorKey(nId, nHeight)));
+
+        std::pair<char,CAddressIndexCompactKey> key;
+        if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_ADDRESSINDEXCOMPACT || key.second.addressId != nId)
+            break;
+
+        // Skip the other entries of the height
+        setHeights.insert(key.second.blockHeight);
+        nHeight = key.second.blockHeight + 1;
+    }
+
+    return true;
+}
+
+namespace {
+
+struct CAddressBalanceDelta {
+    CAmount received;
+    CAmount sent;
+    int64_t txCount;
+    int firstHeight;
+    int lastHeight;
+
+    CAddressBalanceDelta() : received(0), sent(0), txCount(0), firstHeight(std::numeric_limits<int>::max()), lastHeight(-1) {}
+};
+
+}
+
+bool CBlockTreeDB::UpdateAddressBalanceIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect,
+                                             const uint256 &hashBlock, const uint256 &hashPrev, bool fDisconnect) {
+
+    // Unlike the address index writes the totals are not idempotent, they have to be at the block
+    // before. InitBalanceIndex builds them again if they are off the chainstate after a crash. Without
+    // a best block nothing got counted yet, the genesis block doesn't get connected like the others.
+    uint256 hashBest;
+    if (!IndexDB().Read(DB_ADDRESSBALANCEBEST, hashBest))
+        hashBest.SetNull();
+
+    if (fDisconnect ? hashBest != hashBlock : !hashBest.IsNull() && hashBest != hashPrev)
+        return error("%s: the balance index is at block %s, not at the one before %s", __func__, hashBest.ToString(), hashBlock.ToString());
+
+    std::map<std::pair<unsigned int, uint160>, CAddressBalanceDelta> mapDeltas;
+    std::set<std::pair<std::pair<unsigned int, uint160>, uint256> > setTxs;
+
+    for (const std::pair<CAddressIndexKey, CAmount> &entry : vect) {
+        std::pair<unsigned int, uint160> address = make_pair(entry.first.type, entry.first.hashBytes);
+        CAddressBalanceDelta &delta = mapDeltas[address];
+
+        if (entry.second > 0)
+            delta.received += entry.second;
+        else
+            delta.sent -= entry.second;
+
+        if (setTxs.insert(make_pair(address, entry.first.txhash)).second)
+            ++delta.txCount;
+
+        delta.firstHeight = std::min(delta.firstHeight, entry.first.blockHeight);
+        delta.lastHeight = std::max(delta.lastHeight, entry.first.blockHeight);
+    }
+
+    address_balance_deltas_t vecBlockDeltas;
+
+    for (const auto &it : mapDeltas) {
+        const CAddressBalanceDelta &delta = it.second;
+        CAddressIndexIteratorKey key(it.first.first, it.first.second);
+        CAddressBalanceValue value;
+
+        if (!IndexDB().Read(make_pair(DB_ADDRESSBALANCEINDEX, key), value))
+            value.SetNull();
+
+        if (value.balance > 0)
+            batch.Erase(make_pair(DB_ADDRESSRICHLIST, CAddressRichListKey(value.balance, key.type, key.hashBytes)));
+
+        vecBlockDeltas.push_back(make_pair(key, make_pair(delta.received, delta.sent)));
+
+        if (fDisconnect) {
+            value.received -= delta.received;
+            value.sent -= delta.sent;
+            value.txCount -= delta.txCount;
+
+            if (value.txCount <= 0) {
+                batch.Erase(make_pair(DB_ADDRESSBALANCEINDEX, key));
+                continue;
+            }
+
+            // The entries of the block are gone already, the last one left is the new last height.
+            if (value.lastHeight >= delta.firstHeight)
+                value.lastHeight = ReadAddressIndexLastHeight(key.hashBytes, key.type, delta.firstHeight);
+        } else {
+            value.received += delta.received;
+            value.sent += delta.sent;
+            value.txCount += delta.txCount;
+
+            if (value.firstHeight < 0 || delta.firstHeight < value.firstHeight)
+                value.firstHeight = delta.firstHeight;
+
+            value.lastHeight = std::max(value.lastHeight, delta.lastHeight);
+        }
+
+        value.balance = value.received - value.sent;
+        batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, key), value);
+
+        if (value.balance > 0)
+            batch.Write(make_pair(DB_ADDRESSRICHLIST, CAddressRichListKey(value.balance, key.type, key.hashBytes)), value.received);
+    }
+
+    // The changes of the block, the balances at an earlier height get calculated back from them.
+    if (!vect.empty()) {
+        CAddressBalanceDeltaKey deltaKey(vect.front().first.blockHeight);
+        if (fDisconnect)
+            batch.Erase(make_pair(DB_ADDRESSBALANCEDELTA, deltaKey));
+        else
+            batch.Write(make_pair(DB_ADDRESSBALANCEDELTA, deltaKey), vecBlockDeltas);
+    }
+
+    batch.Write(DB_ADDRESSBALANCEBEST, fDisconnect ? hashPrev : hashBlock);
+
+    return true;
+}
+
+bool CBlockTreeDB::UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect,
+                                             const uint256 &hashBlock, const uint256 &hashPrev, bool fDisconnect) {
+    CDBBatch batch(IndexDB());
+    return UpdateAddressBalanceIndex(batch, vect, hashBlock, hashPrev, fDisconnect) && IndexDB().WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseAddressBalanceIndex() {
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+    CDBBatch batch(IndexDB());
+
+    pcursor->Seek(DB_ADDRESSBALANCEINDEX);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexIteratorKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCEINDEX)
+            break;
+        batch.Erase(key);
+        pcursor->Next();
+    }
+
+    pcursor->Seek(DB_ADDRESSRICHLIST);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressRichListKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSRICHLIST)
+            break;
+        batch.Erase(key);
+        pcursor->Next();
+    }
+
+    pcursor->Seek(DB_ADDRESSBALANCEDELTA);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressBalanceDeltaKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCEDELTA)
+            break;
+        batch.Erase(key);
+        pcursor->Next();
+    }
+
+    batch.Erase(DB_ADDRESSBALANCEBEST);
+    batch.Erase(DB_ADDRESSBALANCEDELTASTART);
+
+    return IndexDB().WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressBalanceBest(uint256 &hashBest) {
+    return IndexDB().Read(DB_ADDRESSBALANCEBEST, hashBest);
+}
+
+bool CBlockTreeDB::RebuildAddressBalanceIndex(const uint256 &hashBest, int nBestHeight) {
+
+    // Drop the totals of a previous run first, they might be outdated.
+    if (!EraseAddressBalanceIndex())
+        return false;
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+    CDBBatch batch(IndexDB());
+
+    // The address index is ordered by address id, height and transaction. So the totals of one
+    // address are complete once the next one shows up and the entries of a transaction are adjacent.
+    uint32_t nCurrentId = 0;
+    CAddressIndexIteratorKey currentKey;
+    CAddressBalanceValue current;
+    CAddressIndexTxKey lastTx;
+    int64_t nAddresses = 0;
+
+    pcursor->Seek(DB_ADDRESSINDEXCOMPACT);
+
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexCompactKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEXCOMPACT;
+
+        if (!current.IsNull() && (!fValid || key.second.addressId != nCurrentId)) {
+            current.balance = current.received - current.sent;
+            batch.Write(make_pair(DB_ADDRESSBALANCEINDEX, currentKey), current);
+            if (current.balance > 0)
+                batch.Write(make_pair(DB_ADDRESSRICHLIST, CAddressRichListKey(current.balance, currentKey.type, currentKey.hashBytes)), current.received);
+            current.SetNull();
+
+            if (++nAddresses % 10000 == 0) {
+                if (!IndexDB().WriteBatch(batch))
+                    return false;
+                batch.Clear();
+            }
+        }
+
+        if (!fValid)
+            break;
+
+        // Entries of blocks connected after the chainstate got flushed, they get connected again.
+        if (key.second.blockHeight > nBestHeight) {
+            pcursor->Next();
+            continue;
+        }
+
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+
+        CAddressIndexTxKey txKey(key.second.blockHeight, key.second.txindex);
+
+        if (current.IsNull()) {
+            nCurrentId = key.second.addressId;
+            if (!ReadAddressById(nCurrentId, currentKey))
+                return error("failed to get the address of id %u", nCurrentId);
+            current.firstHeight = key.second.blockHeight;
+            ++current.txCount;
+            lastTx = txKey;
+        } else if (txKey != lastTx) {
+            ++current.txCount;
+            lastTx = txKey;
+        }
+
+        if (nValue > 0)
+            current.received += nValue;
+        else
+            current.sent -= nValue;
+
+        current.lastHeight = key.second.blockHeight;
+
+        pcursor->Next();
+    }
+
+    LogPrintf("%s: built the balance index of %d addresses\n", __func__, nAddresses);
+
+    batch.Write(DB_ADDRESSBALANCEBEST, hashBest);
+
+    return IndexDB().WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteAddressBalanceDeltaStart(int nHeight) {
+    return IndexDB().Write(DB_ADDRESSBALANCEDELTASTART, nHeight);
+}
+
+bool CBlockTreeDB::ReadAddressBalanceDeltaStart(int &nHeight) {
+    return IndexDB().Read(DB_ADDRESSBALANCEDELTASTART, nHeight);
+}
+
+bool CBlockTreeDB::ReadAddressBalances(std::vector<CAddressListEntry> &addressList, int nEndHeight, int nTipHeight) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+
+    if (nEndHeight < 0 || nEndHeight > nTipHeight) {
+        // The current balances, the rich list has them in order already.
+        pcursor->Seek(DB_ADDRESSRICHLIST);
+
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            std::pair<char,CAddressRichListKey> key;
+            if (!pcursor->GetKey(key) || key.first != DB_ADDRESSRICHLIST)
+                break;
+            CAmount nReceived;
+            if (!pcursor->GetValue(nReceived))
+                return error("failed to get address rich list value");
+            addressList.push_back(CAddressListEntry(key.second.type, key.second.hashBytes, nReceived, key.second.balance));
+            pcursor->Next();
+        }
+
+        return true;
+    }
+
+    // Take back the changes of the blocks from nEndHeight on, they are only known since the delta start.
+    int nDeltaStart;
+    if (!ReadAddressBalanceDeltaStart(nDeltaStart) || nEndHeight < nDeltaStart)
+        return false;
+
+    std::map<std::pair<unsigned int, uint160>, std::pair<CAmount, CAmount> > mapUndo;
+
+    pcursor->Seek(make_pair(DB_ADDRESSBALANCEDELTA, CAddressBalanceDeltaKey(nEndHeight)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressBalanceDeltaKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCEDELTA)
+            break;
+        address_balance_deltas_t vecDeltas;
+        if (!pcursor->GetValue(vecDeltas))
+            return error("failed to get address balance delta");
+        for (const auto &delta : vecDeltas) {
+            std::pair<CAmount, CAmount> &undo = mapUndo[make_pair(delta.first.type, delta.first.hashBytes)];
+            undo.first += delta.second.first;
+            undo.second += delta.second.second;
+        }
+        pcursor->Next();
+    }
+
+    pcursor->Seek(DB_ADDRESSBALANCEINDEX);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressIndexIteratorKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSBALANCEINDEX)
+            break;
+        CAddressBalanceValue value;
+        if (!pcursor->GetValue(value))
+            return error("failed to get address balance value");
+
+        auto undo = mapUndo.find(make_pair(key.second.type, key.second.hashBytes));
+        if (undo != mapUndo.end()) {
+            value.received -= undo->second.first;
+            value.sent -= undo->second.second;
+            value.balance = value.received - value.sent;
+        }
+
+        if (value.balance > 0)
+            addressList.push_back(CAddressListEntry(key.second.type, key.second.hashBytes, value.received, value.balance));
+
+        pcursor->Next();
+    }
+
+    return true;
+}
+
+void CBlockTreeDB::WriteTimestampIndex(CDBBatch &batch, const CTimestampIndexKey &timestampIndex) {
+    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
+}
+
+bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
+    CDBBatch batch(IndexDB());
+    WriteTimestampIndex(batch, timestampIndex);
+    return IndexDB().WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+
+    pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CTimestampIndexKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp <= high) {
+            hashes.push_back(key.second.blockHash);
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &timestamp, uint256 &blockHash) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+
+    pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(timestamp)));
+
+    blockHash.SetNull();
+
+    if (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CTimestampIndexKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX) {
+            blockHash = key.second.blockHash;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void CBlockTreeDB::WriteIndexBuildProgress(CDBBatch &batch, int nIndexes, int nNextHeight) {
+    batch.Write(DB_INDEXBUILD, make_pair(nIndexes, nNextHeight));
+}
+
+bool CBlockTreeDB::ReadIndexBuildProgress(int &nIndexes, int &nNextHeight) {
+    std::pair<int, int> progress;
+    if (!IndexDB().Read(DB_INDEXBUILD, progress))
+        return false;
+    nIndexes = progress.first;
+    nNextHeight = progress.second;
+    return true;
+}
+
+bool CBlockTreeDB::EraseIndexBuildProgress() {
+    return IndexDB().Erase(DB_INDEXBUILD);
+}
+
+void CBlockTreeDB::UpdateDepositBuckets(CDBBatch &batch, const std::vector<std::pair<CDepositIndexKey, CDepositValue> > &vect, bool fErase) {
+
+    // Only deposits the index doesn't have yet, or still has, change the counts. Writing
+    // the entries of a block again after a crash leaves them right.
+    std::map<CDepositIndexBucketKey, int> mapDeltas;
+
+    for (std::vector<std::pair<CDepositIndexKey, CDepositValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (IndexDB().Exists(make_pair(DB_DEPOSITINDEX, it->first)) != fErase)
+            continue;
+        CDepositIndexBucketKey bucketKey(it->first.type, it->first.hashBytes, CDepositIndexBucketKey::Bucket(it->first.timestamp));
+        mapDeltas[bucketKey] += fErase ? -1 : 1;
+    }
+
+    for (const auto &delta : mapDeltas) {
+        int nCount = 0;
+        IndexDB().Read(make_pair(DB_DEPOSITBUCKET, delta.first), nCount);
+        nCount += delta.second;
+        if (nCount > 0)
+            batch.Write(make_pair(DB_DEPOSITBUCKET, delta.first), nCount);
+        else
+            batch.Erase(make_pair(DB_DEPOSITBUCKET, delta.first));
+    }
+}
+
+void CBlockTreeDB::WriteDepositIndex(CDBBatch &batch, const std::vector<std::pair<CDepositIndexKey, CDepositValue > >&vect) {
+    UpdateDepositBuckets(batch, vect, false);
+    for (std::vector<std::pair<CDepositIndexKey, CDepositValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_DEPOSITINDEX, it->first), it->second);
+}
+
+bool CBlockTreeDB::WriteDepositIndex(const std::vector<std::pair<CDepositIndexKey, CDepositValue > >&vect) {
+    CDBBatch batch(IndexDB());
+    WriteDepositIndex(batch, vect);
+    return IndexDB().WriteBatch(batch);
+}
+
+void CBlockTreeDB::EraseDepositIndex(CDBBatch &batch, const std::vector<std::pair<CDepositIndexKey, CDepositValue > >&vect) {
+    UpdateDepositBuckets(batch, vect, true);
+    for (std::vector<std::pair<CDepositIndexKey, CDepositValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Erase(make_pair(DB_DEPOSITINDEX, it->first));
+}
+
+bool CBlockTreeDB::EraseDepositIndex(const std::vector<std::pair<CDepositIndexKey, CDepositValue > >&vect) {
+    CDBBatch batch(IndexDB());
+    EraseDepositIndex(batch, vect);
+    return IndexDB().WriteBatch(batch);
+}
+
+bool CBlockTreeDB::RebuildDepositBuckets() {
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+    CDBBatch batch(IndexDB());
+
+    // Drop the counts of a previous run first.
+    pcursor->Seek(DB_DEPOSITBUCKET);
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CDepositIndexBucketKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_DEPOSITBUCKET)
+            break;
+        batch.Erase(key);
+        pcursor->Next();
+    }
+
+    // The deposits are ordered by address and time, the ones of a bucket are adjacent.
+    CDepositIndexBucketKey currentKey;
+    int nCount = 0;
+    int64_t nBuckets = 0;
+
+    pcursor->Seek(DB_DEPOSITINDEX);
+
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CDepositIndexKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_DEPOSITINDEX;
+
+        if (nCount && (!fValid || key.second.type != currentKey.type || key.second.hashBytes != currentKey.hashBytes ||
+                       CDepositIndexBucketKey::Bucket(key.second.timestamp) != currentKey.bucket)) {
+            batch.Write(make_pair(DB_DEPOSITBUCKET, currentKey), nCount);
+            nCount = 0;
+
+            if (++nBuckets % 10000 == 0) {
+                if (!IndexDB().WriteBatch(batch))
+                    return false;
+                batch.Clear();
+            }
         }
-    }
 
-    return true;
-}
+        if (!fValid)
+            break;
 
+        if (!nCount)
+            currentKey = CDepositIndexBucketKey(key.second.type, key.second.hashBytes, CDepositIndexBucketKey::Bucket(key.second.timestamp));
+        ++nCount;
 
-bool CBlockTreeDB::ReadAddresses(std::vector<CAddressListEntry> &addressList, int nEndHeight, bool excludeZeroBalances) {
+        pcursor->Next();
+    }
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    LogPrintf("%s: counted the deposits in %d buckets\n", __func__, nBuckets);
 
-    pcursor->Seek(DB_ADDRESSINDEX);
+    return IndexDB().WriteBatch(batch);
+}
 
-    CAddressIndexKey currentKey = CAddressIndexKey();
-    CAmount currentReceived = 0, currentBalance = 0;
+void CBlockTreeDB::WritePayoutIndex(CDBBatch &batch, const std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > &vect) {
+    for (std::vector<std::pair<CPayoutIndexKey, CPayoutValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_PAYOUTINDEX, it->first), it->second);
+}
 
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key)){
+void CBlockTreeDB::ErasePayoutIndex(CDBBatch &batch, const std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > &vect) {
+    for (std::vector<std::pair<CPayoutIndexKey, CPayoutValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Erase(make_pair(DB_PAYOUTINDEX, it->first));
+}
 
-            if( currentKey.IsNull() ){
-                currentKey = key.second;
-            }
+void CBlockTreeDB::WriteBlockSummary(CDBBatch &batch, const CBlockSummary &summary) {
+    batch.Write(make_pair(DB_BLOCKSUMMARY, summary.nHeight), summary);
+}
 
-            if( key.first != DB_ADDRESSINDEX)
-                break;
+bool CBlockTreeDB::ReadBlockSummary(int nHeight, CBlockSummary &summary) {
+    return IndexDB().Read(make_pair(DB_BLOCKSUMMARY, nHeight), summary);
+}
 
-            if( key.second.hashBytes != currentKey.hashBytes ) {
+void CBlockTreeDB::WriteKeptTx(CDBBatch &batch, const CTransaction &tx, const uint256 &hashBlock) {
+    batch.Write(make_pair(DB_KEPTTX, tx.GetHash()), make_pair(hashBlock, tx));
+}
 
-                if( currentBalance > 0 && (!excludeZeroBalances || (excludeZeroBalances && currentBalance )))
-                    // Save the address info
-                    addressList.push_back(CAddressListEntry(currentKey.type,
-                                                            currentKey.hashBytes,
-                                                            currentReceived,
-                                                            currentBalance));
+bool CBlockTreeDB::ReadKeptTx(const uint256 &txid, CTransaction &tx, uint256 &hashBlock) {
+    std::pair<uint256, CTransaction> value;
+    if (!IndexDB().Read(make_pair(DB_KEPTTX, txid), value))
+        return false;
 
-                // And move on with the next one
-                currentReceived = 0;
-                currentBalance = 0;
-                currentKey = key.second;
-            }
+    hashBlock = value.first;
+    tx = value.second;
+    return true;
+}
 
-            CAmount nValue;
-            if (pcursor->GetValue(nValue)) {
+void CBlockTreeDB::WriteBlockFilter(CDBBatch &batch, const CBlockFilter &filter) {
+    batch.Write(make_pair(DB_BLOCKFILTER, filter.GetBlockHash()), make_pair(filter.GetHash(), filter.GetEncodedFilter()));
+}
 
-                if( nEndHeight == -1 || key.second.blockHeight < nEndHeight ){
-                    currentBalance += nValue;
-                    if( nValue > 0)
-                        currentReceived += nValue;
-                }
+bool CBlockTreeDB::ReadBlockFilter(const uint256 &hashBlock, CBlockFilter &filter) {
+    std::pair<uint256, std::vector<unsigned char> > value;
+    if (!IndexDB().Read(make_pair(DB_BLOCKFILTER, hashBlock), value))
+        return false;
 
-                pcursor->Next();
-            } else {
-                return error("failed to get address index value");
-            }
-        } else {
-            break;
-        }
+    try {
+        filter = CBlockFilter(BLOCK_FILTER_BASIC, hashBlock, value.second);
+    } catch (const std::exception& e) {
+        return error("%s: the filter of block %s is corrupted: %s", __func__, hashBlock.ToString(), e.what());
     }
+    return true;
+}
 
-    if( !excludeZeroBalances || (excludeZeroBalances && currentBalance ))
-        // Store the last one..
-        addressList.push_back(CAddressListEntry(currentKey.type,
-                                                currentKey.hashBytes,
-                                                currentReceived,
-                                                currentBalance));
-
+bool CBlockTreeDB::ReadBlockFilterHash(const uint256 &hashBlock, uint256 &hashFilter) {
+    std::pair<uint256, std::vector<unsigned char> > value;
+    if (!IndexDB().Read(make_pair(DB_BLOCKFILTER, hashBlock), value))
+        return false;
+    hashFilter = value.first;
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(*this);
-    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
+void CBlockTreeDB::WriteBlockFilterHeader(CDBBatch &batch, const uint256 &hashBlock, const uint256 &header) {
+    batch.Write(make_pair(DB_BLOCKFILTERHEADER, hashBlock), header);
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes) {
+bool CBlockTreeDB::ReadBlockFilterHeader(const uint256 &hashBlock, uint256 &header) {
+    return IndexDB().Read(make_pair(DB_BLOCKFILTERHEADER, hashBlock), header);
+}
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+bool CBlockTreeDB::ReadPayoutIndex(uint160 addressHash, int type, int nFrom, int nTo, int categoryMask, int limit,
+                                   std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > &payoutIndex) {
 
-    pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+
+    pcursor->Seek(make_pair(DB_PAYOUTINDEX, CPayoutIndexIteratorHeightKey(type, addressHash, nFrom)));
 
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        std::pair<char, CTimestampIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp <= high) {
-            hashes.push_back(key.second.blockHash);
-            pcursor->Next();
-        } else {
+        std::pair<char,CPayoutIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_PAYOUTINDEX || key.second.type != (unsigned int)type ||
+            key.second.hashBytes != addressHash || key.second.blockHeight > nTo)
             break;
-        }
+
+        // Pages end with a whole height, the next one starts at the following height then
+        if (limit > 0 && payoutIndex.size() >= (size_t)limit && payoutIndex.back().first.blockHeight != key.second.blockHeight)
+            break;
+
+        CPayoutValue value;
+        if (!pcursor->GetValue(value))
+            return error("failed to get payout index value");
+
+        if (value.category & categoryMask)
+            payoutIndex.push_back(make_pair(key.second, value));
+
+        pcursor->Next();
     }
 
     return true;
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &timestamp, uint256 &blockHash) {
+bool CBlockTreeDB::CountDeposits(unsigned int type, const uint160 &addressHash, unsigned int nFrom, unsigned int nTo, int &count) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    count = 0;
 
-    pcursor->Seek(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(timestamp)));
+    if (nFrom > nTo)
+        return true;
 
-    blockHash.SetNull();
+    unsigned int nFromBucket = CDepositIndexBucketKey::Bucket(nFrom);
+    unsigned int nToBucket = CDepositIndexBucketKey::Bucket(nTo);
+    CDepositIndexBucketKey firstBucket(type, addressHash, nFromBucket);
+    CDepositIndexBucketKey lastBucket(type, addressHash, nToBucket);
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+
+    // The buckets only partly in the range get their deposits walked.
+    auto walk = [&](unsigned int nStart, unsigned int nEnd) {
+        pcursor->Seek(make_pair(DB_DEPOSITINDEX, CDepositIndexIteratorTimeKey(type, addressHash, nStart)));
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            std::pair<char,CDepositIndexKey> key;
+            if (!pcursor->GetKey(key) || key.first != DB_DEPOSITINDEX || key.second.type != type ||
+                key.second.hashBytes != addressHash || key.second.timestamp > nEnd)
+                break;
+            ++count;
+            pcursor->Next();
+        }
+    };
 
-    if (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, CTimestampIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX) {
-            blockHash = key.second.blockHash;
+    if (nFrom != firstBucket.FirstTime()) {
+        walk(nFrom, std::min(nTo, firstBucket.LastTime()));
+        if (nFromBucket == nToBucket)
             return true;
-        }
+        ++nFromBucket;
     }
 
-    return false;
-}
+    if (nTo != lastBucket.LastTime()) {
+        walk(std::max(nFrom, lastBucket.FirstTime()), nTo);
+        if (nFromBucket > --nToBucket || nToBucket == std::numeric_limits<unsigned int>::max())
+            return true;
+    }
 
-bool CBlockTreeDB::WriteDepositIndex(const std::vector<std::pair<CDepositIndexKey, CDepositValue > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CDepositIndexKey, CDepositValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_DEPOSITINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
+    pcursor->Seek(make_pair(DB_DEPOSITBUCKET, CDepositIndexBucketKey(type, addressHash, nFromBucket)));
 
-bool CBlockTreeDB::EraseDepositIndex(const std::vector<std::pair<CDepositIndexKey, CDepositValue > >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CDepositIndexKey, CDepositValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(make_pair(DB_DEPOSITINDEX, it->first));
-    return WriteBatch(batch);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CDepositIndexBucketKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_DEPOSITBUCKET || key.second.type != type ||
+            key.second.hashBytes != addressHash || key.second.bucket > nToBucket)
+            break;
+        int nCount;
+        if (!pcursor->GetValue(nCount))
+            return error("failed to get deposit bucket count");
+        count += nCount;
+        pcursor->Next();
+    }
+
+    return true;
 }
 
 bool CBlockTreeDB::ReadDepositIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CDepositIndexKey, CDepositValue> > &depositIndex,
                                     int start, int offset, int limit, bool reverse) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    // Skip the whole buckets within the offset by their counts, only the rest gets walked.
+    if (offset > 0) {
+        unsigned int nStart = reverse ? (start > 0 ? start : std::numeric_limits<int>::max()) : std::max(start, 0);
+        CDepositIndexBucketKey startBucket(type, addressHash, CDepositIndexBucketKey::Bucket(nStart));
+        int nCount;
+
+        // The start bucket up to or from the start time
+        if (!CountDeposits(type, addressHash, reverse ? startBucket.FirstTime() : nStart,
+                           reverse ? nStart : startBucket.LastTime(), nCount))
+            return false;
+
+        if (nCount <= offset) {
+            boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
+            bool fFound = false;
+
+            offset -= nCount;
+
+            // Bucket 0 has none before it, the cursor stays invalid then.
+            if (reverse && startBucket.bucket) {
+                pcursor->SeekForPrev(make_pair(DB_DEPOSITBUCKET, CDepositIndexBucketKey(type, addressHash, startBucket.bucket - 1)));
+            } else if (!reverse) {
+                pcursor->Seek(make_pair(DB_DEPOSITBUCKET, CDepositIndexBucketKey(type, addressHash, startBucket.bucket + 1)));
+            }
+
+            while (!fFound && pcursor->Valid()) {
+                boost::this_thread::interruption_point();
+                std::pair<char,CDepositIndexBucketKey> key;
+                if (!pcursor->GetKey(key) || key.first != DB_DEPOSITBUCKET || key.second.type != (unsigned int)type ||
+                    key.second.hashBytes != addressHash)
+                    break;
+                if (!pcursor->GetValue(nCount))
+                    return error("failed to get deposit bucket count");
+                if (nCount > offset) {
+                    // The page starts in this bucket.
+                    start = reverse ? std::min<unsigned int>(key.second.LastTime(), std::numeric_limits<int>::max()) : key.second.FirstTime();
+                    fFound = true;
+                } else {
+                    offset -= nCount;
+                    if( reverse ) pcursor->Prev();
+                    else          pcursor->Next();
+                }
+            }
+
+            // Fewer deposits than the offset
+            if (!fFound)
+                return true;
+        }
+    }
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
 
     int nCount = 0;
 
-    if (start > 0) {
+    if (reverse) {
+        // Newest first walks start behind the last deposit at the start time.
+        int nStart = start > 0 && start < std::numeric_limits<int>::max() ? start + 1 : std::numeric_limits<int>::max();
+        pcursor->SeekForPrev(make_pair(DB_DEPOSITINDEX, CDepositIndexIteratorTimeKey(type, addressHash, nStart)));
+    } else if (start > 0) {
         pcursor->Seek(make_pair(DB_DEPOSITINDEX, CDepositIndexIteratorTimeKey(type, addressHash, start)));
     } else {
         pcursor->Seek(make_pair(DB_DEPOSITINDEX, CDepositIndexIteratorKey(type, addressHash)));
@@ -533,7 +1766,7 @@ bool CBlockTreeDB::ReadDepositIndexCount(uint160 addressHash, int type,
                                     int &firstTime, int &lastTime,
                                     int start, int end) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
 
     count = 0;
     firstTime = 0;
@@ -545,51 +1778,57 @@ bool CBlockTreeDB::ReadDepositIndexCount(uint160 addressHash, int type,
         pcursor->Seek(make_pair(DB_DEPOSITINDEX, CDepositIndexIteratorKey(type, addressHash)));
     }
 
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char,CDepositIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_DEPOSITINDEX && key.second.hashBytes == addressHash) {
-
-            if( !firstTime ) firstTime = key.second.timestamp;
+    std::pair<char,CDepositIndexKey> key;
 
-            if (end > 0 && key.second.timestamp > (unsigned int)end) {
-                if( !lastTime ) lastTime = firstTime;
-                break;
-            }
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_DEPOSITINDEX || key.second.hashBytes != addressHash)
+        return true;
 
-            lastTime = key.second.timestamp;
-            count++;
-            pcursor->Next();
+    firstTime = key.second.timestamp;
 
-        } else {
-            break;
-        }
+    if (end > 0 && key.second.timestamp > (unsigned int)end) {
+        lastTime = firstTime;
+        return true;
     }
 
-    return true;
+    // The last deposit at or before the end time
+    int nEnd = end > 0 && end < std::numeric_limits<int>::max() ? end + 1 : std::numeric_limits<int>::max();
+    pcursor->SeekForPrev(make_pair(DB_DEPOSITINDEX, CDepositIndexIteratorTimeKey(type, addressHash, nEnd)));
+
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_DEPOSITINDEX || key.second.hashBytes != addressHash)
+        return error("failed to get the last deposit");
+
+    lastTime = key.second.timestamp;
+
+    return CountDeposits(type, addressHash, firstTime, lastTime, count);
 }
 
-bool CBlockTreeDB::WriteInstantPayLocks(std::map<CInstantPayIndexKey, CInstantPayValue> &mapLocks)
+bool CBlockTreeDB::WriteInstantPayLocks(const std::vector<std::pair<CInstantPayIndexKey, CInstantPayValue> > &vecLocks, size_t nMaxBatchSize)
 {
-    CDBBatch batch(*this);
-    for (auto& lock : mapLocks ){
+    CDBBatch batch(IndexDB());
+    for (const auto& lock : vecLocks ){
+
+        batch.Write(make_pair(DB_INSTANTPAY_INDEX, lock.first), lock.second);
 
-        if( lock.second.fProcessed && !lock.second.fWritten ){
-            lock.second.fWritten = true;
-            batch.Write(make_pair(DB_INSTANTPAY_INDEX, lock.first), lock.second);
+        if( batch.SizeEstimate() > nMaxBatchSize ){
+            if( !IndexDB().WriteBatch(batch) ) return false;
+            batch.Clear();
         }
     }
-    return batch.SizeEstimate() ? WriteBatch(batch) : true;
+    return batch.SizeEstimate() ? IndexDB().WriteBatch(batch) : true;
 }
 
 bool CBlockTreeDB::ReadInstantPayIndex( std::vector<std::pair<CInstantPayIndexKey, CInstantPayValue> > &instantPayIndex,
                                         int start, int offset, int limit, bool reverse) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
 
     int nCount = 0;
 
-    if (start > 0) {
+    if (reverse) {
+        // Newest first walks start behind the last lock at the start time.
+        unsigned int nStart = start > 0 ? (unsigned int)start + 1 : std::numeric_limits<unsigned int>::max();
+        pcursor->SeekForPrev(make_pair(DB_INSTANTPAY_INDEX, CInstantPayIndexIteratorTimeKey(nStart)));
+    } else if (start > 0) {
         pcursor->Seek(make_pair(DB_INSTANTPAY_INDEX, CInstantPayIndexIteratorTimeKey(start)));
     } else {
         pcursor->Seek(DB_INSTANTPAY_INDEX);
@@ -624,7 +1863,7 @@ bool CBlockTreeDB::ReadInstantPayIndex( std::vector<std::pair<CInstantPayIndexKe
 bool CBlockTreeDB::ReadInstantPayIndexCount(int &count, int &firstTime, int &lastTime,
                                             int start, int end) {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
 
     count = 0;
     firstTime = 0;
@@ -662,7 +1901,7 @@ bool CBlockTreeDB::ReadInstantPayIndexCount(int &count, int &firstTime, int &las
 
 bool CBlockTreeDB::WriteInvalidVoteKeyRegistrations(std::vector<std::pair<CVoteKeyRegistrationKey, VoteKeyParseResult>> vecInvalidRegistrations)
 {
-    CDBBatch batch(*this);
+    CDBBatch batch(IndexDB());
 
     int val;
 
@@ -671,23 +1910,23 @@ bool CBlockTreeDB::WriteInvalidVoteKeyRegistrations(std::vector<std::pair<CVoteK
         batch.Write(make_pair(DB_VOTE_KEY_REGISTRATION, reg.first), val);
     }
 
-    return WriteBatch(batch);
+    return IndexDB().WriteBatch(batch);
 }
 
 bool CBlockTreeDB::EraseInvalidVoteKeyRegistrations(std::vector<CVoteKeyRegistrationKey> vecInvalidRegistrations)
 {
-    CDBBatch batch(*this);
+    CDBBatch batch(IndexDB());
 
     for( auto reg : vecInvalidRegistrations ){
         batch.Erase(make_pair(DB_VOTE_KEY_REGISTRATION, reg));
     }
 
-    return WriteBatch(batch);
+    return IndexDB().WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadInvalidVoteKeyRegistration(const uint256 &txHash, CVoteKeyRegistrationKey &registrationKey, VoteKeyParseResult &result)
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
 
     pcursor->Seek(DB_VOTE_KEY_REGISTRATION);
 
@@ -722,31 +1961,123 @@ bool CBlockTreeDB::ReadInvalidVoteKeyRegistration(const uint256 &txHash, CVoteKe
 
 bool CBlockTreeDB::WriteVoteKeys(const std::map<CVoteKey, CVoteKeyValue> &mapVoteKeys)
 {
-    CDBBatch batch(*this);
+    return WriteVoteKeyRegistrations(mapVoteKeys, std::vector<std::pair<CVoteKeyRegistrationKey, VoteKeyParseResult>>());
+}
+
+bool CBlockTreeDB::WriteVoteKeyRegistrations(const std::map<CVoteKey, CVoteKeyValue> &mapVoteKeys,
+                                             const std::vector<std::pair<CVoteKeyRegistrationKey, VoteKeyParseResult>> &vecInvalidRegistrations)
+{
+    CDBBatch batch(IndexDB());
 
     for( auto it : mapVoteKeys ){
         batch.Write(make_pair(DB_VOTE_MAP_ADDRESS_TO_KEY, it.second.voteAddress), it.first);
         batch.Write(make_pair(DB_VOTE_MAP_KEY_TO_ADDRESS, it.first), it.second);
     }
 
-    return WriteBatch(batch);
+    for( auto reg : vecInvalidRegistrations ){
+        int val = reg.second;
+        batch.Write(make_pair(DB_VOTE_KEY_REGISTRATION, reg.first), val);
+    }
+
+    LOCK(cs_votekeys);
+
+    if( !IndexDB().WriteBatch(batch) )
+        return false;
+
+    if( fVoteKeysLoaded ){
+        for( auto it : mapVoteKeys ){
+            mapVoteKeyValues[it.first] = it.second;
+            mapVoteAddressKeys[it.second.voteAddress] = it.first;
+        }
+    }
+
+    return true;
 }
 
 bool CBlockTreeDB::EraseVoteKeys(const std::map<CVoteKey, CSmartAddress> &mapVoteKeys)
 {
-    CDBBatch batch(*this);
+    CDBBatch batch(IndexDB());
 
     for( auto it : mapVoteKeys ){
         batch.Erase(make_pair(DB_VOTE_MAP_ADDRESS_TO_KEY, it.second));
         batch.Erase(make_pair(DB_VOTE_MAP_KEY_TO_ADDRESS, it.first));
     }
 
-    return WriteBatch(batch);
+    LOCK(cs_votekeys);
+
+    if( !IndexDB().WriteBatch(batch) )
+        return false;
+
+    if( fVoteKeysLoaded ){
+        for( auto it : mapVoteKeys ){
+            mapVoteKeyValues.erase(it.first);
+            mapVoteAddressKeys.erase(it.second);
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::LoadVoteKeys()
+{
+    std::vector<std::pair<CVoteKey,CVoteKeyValue>> vecVoteKeys;
+
+    LOCK(cs_votekeys);
+
+    fVoteKeysLoaded = false;
+    mapVoteKeyValues.clear();
+    mapVoteAddressKeys.clear();
+
+    if( !ReadVoteKeys(vecVoteKeys) )
+        return false;
+
+    mapVoteKeyValues.reserve(vecVoteKeys.size());
+    mapVoteAddressKeys.reserve(vecVoteKeys.size());
+
+    for( auto it : vecVoteKeys ){
+        mapVoteKeyValues[it.first] = it.second;
+        mapVoteAddressKeys[it.second.voteAddress] = it.first;
+    }
+
+    fVoteKeysLoaded = true;
+
+    LogPrintf("%s: %d vote keys\n", __func__, mapVoteKeyValues.size());
+
+    return true;
+}
+
+void CBlockTreeDB::ForEachVoteKeyEntry(CDBIterator &it, const std::function<void(const std::vector<unsigned char>&, const std::vector<unsigned char>&)> &func)
+{
+    // In key order, the vote key entries of the index database start with one of these
+    static const char vchPrefixes[] = {DB_VOTE_MAP_KEY_TO_ADDRESS, DB_VOTE_KEY_REGISTRATION, DB_VOTE_MAP_ADDRESS_TO_KEY};
+    std::vector<unsigned char> vchKey, vchValue;
+
+    for (char chPrefix : vchPrefixes) {
+        it.Seek(chPrefix);
+        while (it.Valid()) {
+            boost::this_thread::interruption_point();
+            it.GetRaw(vchKey, vchValue);
+            if (vchKey.empty() || vchKey[0] != (unsigned char)chPrefix)
+                break;
+            func(vchKey, vchValue);
+            it.Next();
+        }
+    }
 }
 
 bool CBlockTreeDB::ReadVoteKeyForAddress(const CSmartAddress &voteAddress, CVoteKey &voteKey)
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    {
+        LOCK(cs_votekeys);
+        if( fVoteKeysLoaded ){
+            auto it = mapVoteAddressKeys.find(voteAddress);
+            if( it == mapVoteAddressKeys.end() ) return false;
+            voteKey = it->second;
+            return true;
+        }
+    }
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
 
     pcursor->Seek(make_pair(DB_VOTE_MAP_ADDRESS_TO_KEY, voteAddress));
 
@@ -770,7 +2101,7 @@ bool CBlockTreeDB::ReadVoteKeyForAddress(const CSmartAddress &voteAddress, CVote
 
 bool CBlockTreeDB::ReadVoteKeys(std::vector<std::pair<CVoteKey,CVoteKeyValue>> &vecVoteKeys)
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
 
     pcursor->Seek(DB_VOTE_MAP_KEY_TO_ADDRESS);
 
@@ -801,7 +2132,17 @@ bool CBlockTreeDB::ReadVoteKeys(std::vector<std::pair<CVoteKey,CVoteKeyValue>> &
 
 bool CBlockTreeDB::ReadVoteKeyValue(const CVoteKey &voteKey, CVoteKeyValue &voteKeyValue)
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    {
+        LOCK(cs_votekeys);
+        if( fVoteKeysLoaded ){
+            auto it = mapVoteKeyValues.find(voteKey);
+            if( it == mapVoteKeyValues.end() ) return false;
+            voteKeyValue = it->second;
+            return true;
+        }
+    }
+
+    boost::scoped_ptr<CDBIterator> pcursor(IndexDB().NewIterator());
 
     pcursor->Seek(make_pair(DB_VOTE_MAP_KEY_TO_ADDRESS, voteKey));
 
@@ -835,47 +2176,199 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+namespace {
+
+//! Block index entries one of the LoadBlockIndexGuts threads read, along with their hashes
+struct CBlockIndexLoadBatch
+{
+    std::vector<CDiskBlockIndex> vDiskIndex;
+    std::vector<uint256> vHashes;
+};
+
+/** Passes the batches of the reading threads on to LoadBlockIndexGuts. At most nMaxBatches wait
+ *  in there, the readers pause until it inserted some. */
+class CBlockIndexLoadQueue
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    std::deque<CBlockIndexLoadBatch> queue;
+    size_t nMaxBatches;
+    int nRunning;
+    bool fStop;
+    bool fFailed;
+
+public:
+    CBlockIndexLoadQueue(size_t nMaxBatchesIn, int nThreads) : nMaxBatches(nMaxBatchesIn), nRunning(nThreads), fStop(false), fFailed(false) {}
+
+    //! False if the loading stopped meanwhile
+    bool Push(CBlockIndexLoadBatch&& batch)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        cond.wait(lock, [this] { return fStop || queue.size() < nMaxBatches; });
+        if (fStop)
+            return false;
+        queue.push_back(std::move(batch));
+        cond.notify_all();
+        return true;
+    }
+
+    //! The next batch, false once all readers are done or the loading stopped
+    bool Pop(CBlockIndexLoadBatch& batch)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        cond.wait(lock, [this] { return fStop || !queue.empty() || nRunning == 0; });
+        if (fStop || queue.empty())
+            return false;
+        batch = std::move(queue.front());
+        queue.pop_front();
+        cond.notify_all();
+        return true;
+    }
+
+    void Done()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        nRunning--;
+        cond.notify_all();
+    }
+
+    void Stop(bool fFailure)
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fStop = true;
+        fFailed |= fFailure;
+        cond.notify_all();
+    }
+
+    bool Failed()
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        return fFailed;
+    }
+};
+
+/** Read the block index entries whose hash starts with a byte in [nBegin, nEnd). Entries above
+ *  nTrustedHeight get hashed and their proof of work checked, the others keep the hash of their key. */
+void ReadBlockIndexRange(CDBWrapper& db, CBlockIndexLoadQueue& load, int nBegin, int nEnd, int nTrustedHeight)
 {
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    uint256 hashBegin;
+    *hashBegin.begin() = nBegin;
+
+    pcursor->Seek(make_pair(DB_BLOCK_INDEX, hashBegin));
+
+    bool fEnd = false;
+    while (!fEnd) {
+        CBlockIndexLoadBatch batch;
+        std::vector<size_t> vCheck;
+        std::vector<CBlockHeader> vHeaders;
+        std::vector<uint256> vHashes;
+
+        while (batch.vDiskIndex.size() < BLOCK_INDEX_LOAD_BATCH) {
+            std::pair<char, uint256> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd) {
+                fEnd = true;
+                break;
+            }
+            batch.vDiskIndex.push_back(CDiskBlockIndex());
+            if (!pcursor->GetValue(batch.vDiskIndex.back())) {
+                error("%s: failed to read value", __func__);
+                load.Stop(true);
+                return;
+            }
+            batch.vHashes.push_back(key.second);
+            if (batch.vDiskIndex.back().nHeight > nTrustedHeight) {
+                vCheck.push_back(batch.vDiskIndex.size() - 1);
+                vHeaders.push_back(batch.vDiskIndex.back().GetBlockHeader());
+            }
+            pcursor->Next();
+        }
+
+        GetBlockHeaderHashes(vHeaders, vHashes);
+
+        for (size_t i = 0; i < vCheck.size(); i++) {
+            const CDiskBlockIndex& diskindex = batch.vDiskIndex[vCheck[i]];
+            batch.vHashes[vCheck[i]] = vHashes[i];
+            if (!CheckProofOfWork(diskindex.nHeight, vHashes[i], diskindex.nBits, consensusParams)) {
+                error("%s: CheckProofOfWork failed: block %s at height %d", __func__, vHashes[i].ToString(), diskindex.nHeight);
+                load.Stop(true);
+                return;
+            }
+        }
+
+        if (!batch.vDiskIndex.empty() && !load.Push(std::move(batch)))
+            return;
+    }
+}
 
-    pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&, int)> insertBlockIndex, const uint256& hashAssumeValid)
+{
+    // The headers up to the assumed valid block passed the proof of work check when they
+    // got accepted, the key of their entry counts as their hash
+    int nTrustedHeight = -1;
+    CDiskBlockIndex diskindexTrusted;
+    if (!hashAssumeValid.IsNull() && Read(make_pair(DB_BLOCK_INDEX, hashAssumeValid), diskindexTrusted))
+        nTrustedHeight = diskindexTrusted.nHeight;
+
+    // Every thread reads the entries of a range of hashes
+    int nThreads = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    LogPrintf("%s: %d threads, proof of work trusted up to height %d\n", __func__, nThreads, nTrustedHeight);
+
+    CBlockIndexLoadQueue load(2 * nThreads, nThreads);
+    std::vector<std::thread> vThreads;
+
+    // Stop the readers whichever way this returns
+    struct CStopReaders {
+        CBlockIndexLoadQueue& load;
+        std::vector<std::thread>& vThreads;
+        ~CStopReaders()
+        {
+            load.Stop(false);
+            for (std::thread& thread : vThreads)
+                thread.join();
+        }
+    } stopReaders{load, vThreads};
+
+    for (int i = 0; i < nThreads; i++) {
+        int nBegin = 256 * i / nThreads;
+        int nEnd = 256 * (i + 1) / nThreads;
+        vThreads.emplace_back([this, &load, nBegin, nEnd, nTrustedHeight] {
+            RenameThread("smartcash-blkidx");
+            ReadBlockIndexRange(*this, load, nBegin, nEnd, nTrustedHeight);
+            load.Done();
+        });
+    }
 
     // Load mapBlockIndex
-    while (pcursor->Valid()) {
+    CBlockIndexLoadBatch batch;
+    while (load.Pop(batch)) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->nHeight, pindexNew->GetBlockHash(), pindexNew->nBits, Params().GetConsensus()))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
 
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
-            }
-        } else {
-            break;
+        for (size_t i = 0; i < batch.vDiskIndex.size(); i++) {
+            const CDiskBlockIndex& diskindex = batch.vDiskIndex[i];
+
+            // Construct block index object, the entries go where their heights are
+            CBlockIndex* pindexNew = insertBlockIndex(batch.vHashes[i], diskindex.nHeight);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev, diskindex.nHeight - 1);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
         }
     }
 
-    return true;
+    // The reader logged what went wrong
+    return !load.Failed();
 }
 
 namespace {
@@ -6,18 +6,27 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "blocksummary.h"
 #include "coins.h"
 #include "dbwrapper.h"
 #include "chain.h"
 #include "spentindex.h"
+#include "sync.h"
 
+#include <functional>
+#include <list>
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <boost/function.hpp>
 
+class CBlockFilter;
 class CBlockIndex;
 class CCoinsViewDBCursor;
 class uint256;
@@ -41,6 +50,18 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -indexdbcache default (MiB), 0 keeps the optional indexes in the block tree database
+static const int64_t nDefaultIndexDBCache = 0;
+//! Block size of indexes/, the address index mostly gets read in ranges of an address
+static const size_t INDEX_DB_BLOCK_SIZE = 16 << 10;
+//! Block index entries a LoadBlockIndexGuts thread hashes and hands over at once
+static const size_t BLOCK_INDEX_LOAD_BATCH = 1024;
+//! Upper limit of the threads reading the block index at startup
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
+//! Upper limit of the threads CCoinsViewDB::GetCoins reads with
+static const int MAX_COINS_READ_THREADS = 8;
+//! Fewest outpoints a GetCoins thread gets, fewer aren't worth starting one
+static const size_t COINS_READ_THREAD_MIN = 64;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -76,6 +97,8 @@ public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    //! Reads the outpoints in key order, split up between several threads for larger sets
+    void GetCoins(const std::vector<COutPoint> &vOutpoints, std::vector<Coin> &vCoins) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
@@ -109,40 +132,164 @@ private:
 };
 
 /** Access to the block database (blocks/index/) */
+struct CVoteKeyHasher {
+    size_t operator()(const CVoteKey& voteKey) const;
+};
+
+struct CVoteAddressHasher {
+    size_t operator()(const CSmartAddress& address) const { return address.GetHashSeed(); }
+};
+
+//! Spent index entries kept in memory by CBlockTreeDB
+static const size_t SPENT_INDEX_CACHE_SIZE = 10000;
+//! Only spends at least this many blocks below the newest indexed one get cached
+static const int SPENT_INDEX_CACHE_MIN_DEPTH = 6;
+
+/** LRU of spent index entries. The spend of an output only changes with a
+ *  reorg, the updates of the index drop the keys they touch. Spends near the
+ *  tip aren't kept, a read might see them before the update got written. */
+class CSpentIndexCache
+{
+    typedef std::list<std::pair<CSpentIndexKey, CSpentIndexValue> > EntryList;
+
+    CCriticalSection cs;
+    EntryList listEntries;
+    std::map<CSpentIndexKey, EntryList::iterator, CSpentIndexKeyCompare> mapEntries;
+    size_t nMaxEntries;
+    int nBestHeight;
+
+public:
+    explicit CSpentIndexCache(size_t nMaxEntriesIn) : nMaxEntries(nMaxEntriesIn), nBestHeight(0) {}
+
+    bool Get(const CSpentIndexKey &key, CSpentIndexValue &value);
+    void Add(const CSpentIndexKey &key, const CSpentIndexValue &value);
+    void Update(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect);
+};
+
+/**
+ * Access to the block database (blocks/index/)
+ *
+ * The optional indexes (tx, address, unspent, spent, timestamp, deposit,
+ * payout, instantpay and vote keys) go to IndexDB(). With an index cache
+ * size that is the database indexes/ with its own cache and write buffer,
+ * otherwise the block database itself.
+ */
 class CBlockTreeDB : public CDBWrapper
 {
 public:
-    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CBlockTreeDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, size_t nIndexCacheSize = 0);
 private:
     CBlockTreeDB(const CBlockTreeDB&);
     void operator=(const CBlockTreeDB&);
+
+    std::unique_ptr<CDBWrapper> pindexdb;
+
+    // All registered vote keys in both directions once LoadVoteKeys ran, the
+    // lookups don't touch the database anymore then
+    mutable CCriticalSection cs_votekeys;
+    bool fVoteKeysLoaded;
+    std::unordered_map<CVoteKey, CVoteKeyValue, CVoteKeyHasher> mapVoteKeyValues;
+    std::unordered_map<CSmartAddress, CVoteKey, CVoteAddressHasher> mapVoteAddressKeys;
+
+    CSpentIndexCache spentCache;
+
+    // Next id of the compact address index, 0 until read from the database
+    CCriticalSection cs_addressids;
+    uint32_t nNextAddressId;
+
+    bool ReadAddressId(unsigned int type, const uint160 &addressHash, uint32_t &nId);
+    //! Id of the address, a new one gets written right away
+    bool GetAddressId(unsigned int type, const uint160 &addressHash, uint32_t &nId);
+    bool ReadAddressById(uint32_t nId, CAddressIndexIteratorKey &address);
+    bool ReadAddressIndexTx(const CAddressIndexTxKey &txKey, uint256 &txhash);
+    void WriteCompactAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fErase);
+    //! Has to get all deposits of a batch in one call, the counts are read from the database
+    void UpdateDepositBuckets(CDBBatch &batch, const std::vector<std::pair<CDepositIndexKey, CDepositValue> > &vect, bool fErase);
+    //! Deposits to the address with a timestamp from nFrom to nTo
+    bool CountDeposits(unsigned int type, const uint160 &addressHash, unsigned int nFrom, unsigned int nTo, int &count);
 public:
+    //! Database of the optional indexes, batches of index writes have to be made for it
+    CDBWrapper& IndexDB() { return pindexdb ? *pindexdb : *this; }
+    bool HasIndexDB() const { return pindexdb != nullptr; }
+
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
+    // The index writes taking a batch only add to it, the block's index
+    // changes get written together then. Reads don't see what is in the
+    // batch yet.
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    void WriteTxIndex(CDBBatch &batch, const std::vector<std::pair<uint256, CDiskTxPos> > &list);
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+    //! Look the keys up in their order with one iterator, the values of unspent outputs stay null
+    bool ReadSpentIndex(std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
+    void UpdateSpentIndex(CDBBatch &batch, const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
+    void UpdateAddressUnspentIndex(CDBBatch &batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
+    /** Unspent outputs of the address with the largest amounts first, up to limit of them below the cursor.
+     *  The cursor gets set to the last one read, or null if there are no more. */
+    bool ReadAddressUnspentAmountIndex(uint160 addressHash, int type,
+                                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                       CAddressUnspentAmountKey &cursor, int limit);
+    bool RebuildAddressUnspentAmountIndex();
     bool ReadAddressUnspentIndexCount(uint160 addressHash, int type, int &nCount, CAddressUnspentKey &lastIndex);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
                                  const CAddressUnspentKey &start = CAddressUnspentKey(),
                                  int offset = -1, int limit = -1, bool reverse = false);
+    /** The address index stores CAddressIndexCompactKey entries, the full keys of databases
+     *  of older versions get converted once. */
+    bool UpgradeAddressIndex();
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    void WriteAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    void EraseAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    bool ReadAddressIndexTransactions(uint160 addressHash, int type, bool fAscending,
+                                      int nCursorHeight, const uint256 &cursorTx, int64_t nSkip, int64_t nLimit,
+                                      std::vector<std::tuple<uint256, int, CAmount> > &vecTxs, bool &fMore);
+    bool ReadAddressIndexTransactionCount(uint160 addressHash, int type, int64_t &count);
     bool ReadAddresses(std::vector<CAddressListEntry> &addressList, int nEndHeight, bool excludeZeroBalances);
+    bool ReadAddressBalanceIndex(uint160 addressHash, int type, CAddressBalanceValue &value);
+    int ReadAddressIndexLastHeight(uint160 addressHash, int type, int nHeight);
+    /** Heights from nStartHeight on with entries of the address, without reading the entries themselves. */
+    bool ReadAddressIndexHeights(uint160 addressHash, int type, int nStartHeight, std::set<int> &setHeights);
+    /** Doesn't read the entries of the block's height from the address index, they can be written in the same batch. */
+    bool UpdateAddressBalanceIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect,
+                                   const uint256 &hashBlock, const uint256 &hashPrev, bool fDisconnect);
+    bool UpdateAddressBalanceIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect,
+                                   const uint256 &hashBlock, const uint256 &hashPrev, bool fDisconnect);
+    bool EraseAddressBalanceIndex();
+    //! Block the totals are at
+    bool ReadAddressBalanceBest(uint256 &hashBest);
+    /** Totals of the address index entries up to nBestHeight, the height of hashBest. */
+    bool RebuildAddressBalanceIndex(const uint256 &hashBest, int nBestHeight);
+    //! First height the per block balance changes are complete from
+    bool WriteAddressBalanceDeltaStart(int nHeight);
+    bool ReadAddressBalanceDeltaStart(int &nHeight);
+    /** Addresses with a positive balance from the balance index, largest first for the current balances.
+     *  For nEndHeight up to nTipHeight the balances before that block, fails if the changes since aren't known. */
+    bool ReadAddressBalances(std::vector<CAddressListEntry> &addressList, int nEndHeight, int nTipHeight);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
+    void WriteTimestampIndex(CDBBatch &batch, const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &vect);
     bool ReadTimestampIndex(const unsigned int &timestamp, uint256 &blockHash);
+    //! Indexes the background index builder works on and the height it continues at
+    void WriteIndexBuildProgress(CDBBatch &batch, int nIndexes, int nNextHeight);
+    bool ReadIndexBuildProgress(int &nIndexes, int &nNextHeight);
+    bool EraseIndexBuildProgress();
+    /** The deposit writes keep CDepositIndexBucketKey counts which the count and page queries
+     *  use, the deposits of one batch have to be written or erased in one call. */
     bool WriteDepositIndex(const std::vector<std::pair<CDepositIndexKey, CDepositValue> > &vect);
+    void WriteDepositIndex(CDBBatch &batch, const std::vector<std::pair<CDepositIndexKey, CDepositValue> > &vect);
     bool EraseDepositIndex(const std::vector<std::pair<CDepositIndexKey, CDepositValue> > &vect);
+    void EraseDepositIndex(CDBBatch &batch, const std::vector<std::pair<CDepositIndexKey, CDepositValue> > &vect);
     bool ReadDepositIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CDepositIndexKey, CDepositValue> > &depositIndex,
                           int start = 0, int offset = 0, int limit = 0, bool reverse = false);
@@ -150,8 +297,33 @@ public:
                                         int &count,
                                         int &firstTime, int &lastTime,
                                         int start, int end);
+    //! Count the deposits of databases of older versions
+    bool RebuildDepositBuckets();
+    void WritePayoutIndex(CDBBatch &batch, const std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > &vect);
+    void ErasePayoutIndex(CDBBatch &batch, const std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > &vect);
+    /** Payouts of the categories in categoryMask from nFrom to nTo in height order. With a limit
+     *  the heights get read up to the one the limit is reached at, a page never splits a height. */
+    bool ReadPayoutIndex(uint160 addressHash, int type, int nFrom, int nTo, int categoryMask, int limit,
+                         std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > &payoutIndex);
+
+    //! Summaries of the blocks stored in prune mode, by height. The one of a block
+    //! disconnected since stays until the next block at its height replaces it.
+    void WriteBlockSummary(CDBBatch &batch, const CBlockSummary &summary);
+    bool ReadBlockSummary(int nHeight, CBlockSummary &summary);
+    //! Transactions stored in prune mode along with the hash of their block, the ones a
+    //! node has to read again after pruning deleted the block. See CProposal::IsFeeTxCandidate.
+    void WriteKeptTx(CDBBatch &batch, const CTransaction &tx, const uint256 &hashBlock);
+    bool ReadKeptTx(const uint256 &txid, CTransaction &tx, uint256 &hashBlock);
+    //! Block filters by block hash along with the hash of the filter. The header of a filter
+    //! is written once the one of the previous block is known, see CIndexBuilder.
+    void WriteBlockFilter(CDBBatch &batch, const CBlockFilter &filter);
+    bool ReadBlockFilter(const uint256 &hashBlock, CBlockFilter &filter);
+    bool ReadBlockFilterHash(const uint256 &hashBlock, uint256 &hashFilter);
+    void WriteBlockFilterHeader(CDBBatch &batch, const uint256 &hashBlock, const uint256 &header);
+    bool ReadBlockFilterHeader(const uint256 &hashBlock, uint256 &header);
 
-    bool WriteInstantPayLocks(std::map<CInstantPayIndexKey, CInstantPayValue> &mapLocks);
+    //! Write the locks in batches of at most nMaxBatchSize bytes
+    bool WriteInstantPayLocks(const std::vector<std::pair<CInstantPayIndexKey, CInstantPayValue> > &vecLocks, size_t nMaxBatchSize);
     bool ReadInstantPayIndex(std::vector<std::pair<CInstantPayIndexKey, CInstantPayValue> > &instantPayIndex,
                                             int start, int offset, int limit, bool reverse);
     bool ReadInstantPayIndexCount(int &count, int &firstTime, int &lastTime,
@@ -162,15 +334,25 @@ public:
     bool EraseInvalidVoteKeyRegistrations(std::vector<CVoteKeyRegistrationKey> vecInvalidRegistrations);
     bool ReadInvalidVoteKeyRegistration(const uint256 &txHash, CVoteKeyRegistrationKey &registrationKey, VoteKeyParseResult &result);
     bool WriteVoteKeys(const std::map<CVoteKey, CVoteKeyValue> &mapVoteKeys);
+    //! Write the registrations and the invalid registrations of a block in one batch
+    bool WriteVoteKeyRegistrations(const std::map<CVoteKey, CVoteKeyValue> &mapVoteKeys,
+                                   const std::vector<std::pair<CVoteKeyRegistrationKey, VoteKeyParseResult>> &vecInvalidRegistrations);
     bool EraseVoteKeys(const std::map<CVoteKey, CSmartAddress> &mapVoteKeys);
     bool ReadVoteKeyForAddress(const CSmartAddress &voteAddress, CVoteKey &voteKey);
     bool ReadVoteKeys(std::vector<std::pair<CVoteKey,CVoteKeyValue>> &vecVoteKeys);
     bool ReadVoteKeyValue(const CVoteKey &voteKey, CVoteKeyValue &voteKeyValue);
+    //! Keep all vote keys in memory from now on
+    bool LoadVoteKeys();
+    /** Call func with the raw entries of the vote key index, for a snapshot of it.
+     *  The iterator has to be one of IndexDB(). */
+    void ForEachVoteKeyEntry(CDBIterator &it, const std::function<void(const std::vector<unsigned char>&, const std::vector<unsigned char>&)> &func);
     /** SmartVoting end **/
 
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /** Hand all block index entries to insertBlockIndex. Threads read and check them, the proof of
+     *  work of the entries up to the height of hashAssumeValid isn't checked again. */
+    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&, int)> insertBlockIndex, const uint256& hashAssumeValid = uint256());
 };
 
 #endif // BITCOIN_TXDB_H
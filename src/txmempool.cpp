@@ -20,7 +20,7 @@
 
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, double _entryPriority, unsigned int _entryHeight,
                                  bool poolHasNoInputsOf, CAmount _inChainInputValue,
                                  bool _spendsCoinbase, unsigned int _sigOps, LockPoints lp):
@@ -28,14 +28,14 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
     hadNoDependencies(poolHasNoInputsOf), inChainInputValue(_inChainInputValue),
     spendsCoinbase(_spendsCoinbase), sigOpCount(_sigOps), lockPoints(lp)
 {
-    nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-    nModSize = tx.CalculateModifiedSize(nTxSize);
+    nTxSize = ::GetSerializeSize(*tx, SER_NETWORK, PROTOCOL_VERSION);
+    nModSize = tx->CalculateModifiedSize(nTxSize);
     nUsageSize = RecursiveDynamicUsage(tx);
 
     nCountWithDescendants = 1;
     nSizeWithDescendants = nTxSize;
     nModFeesWithDescendants = nFee;
-    CAmount nValueIn = tx.GetValueOut()+nFee;
+    CAmount nValueIn = tx->GetValueOut()+nFee;
     assert(inChainInputValue <= nValueIn);
 
     feeDelta = 0;
@@ -431,8 +431,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
             vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
             CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
+            addAddressDelta(key, delta, inserted);
         } else if (prevout.scriptPubKey.IsPayToPublicKeyHash() || prevout.scriptPubKey.IsPayToPublicKey()) {
 
             uint160 nPubKeyHash;
@@ -448,8 +447,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
 
             CMempoolAddressDeltaKey key(1, nPubKeyHash, txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
+            addAddressDelta(key, delta, inserted);
         } else if (prevout.scriptPubKey.IsPayToPublicKeyHashLocked() ) {
 
             int nOffset = prevout.scriptPubKey[0] + 6;
@@ -458,8 +456,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
 
             CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
+            addAddressDelta(key, delta, inserted);
         } else if (prevout.scriptPubKey.IsPayToScriptHashLocked() ) {
 
             int nOffset = prevout.scriptPubKey[0] + 5;
@@ -468,8 +465,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
 
             CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
+            addAddressDelta(key, delta, inserted);
         }
     }
 
@@ -478,8 +474,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
         if (out.scriptPubKey.IsPayToScriptHash()) {
             vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
             CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+            addAddressDelta(key, CMempoolAddressDelta(entry.GetTime(), out.nValue), inserted);
         } else if (out.scriptPubKey.IsPayToPublicKeyHash() || out.scriptPubKey.IsPayToPublicKey() ) {
 
             uint160 nPubKeyHash;
@@ -493,20 +488,16 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
                 nPubKeyHash = uint160(hashBytes);
             }
 
-            std::pair<addressDeltaMap::iterator,bool> ret;
             CMempoolAddressDeltaKey key(1, nPubKeyHash, txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+            addAddressDelta(key, CMempoolAddressDelta(entry.GetTime(), out.nValue), inserted);
         } else if (out.scriptPubKey.IsPayToPublicKeyHashLocked() ) {
 
             int nOffset = out.scriptPubKey[0] + 6;
 
             vector<unsigned char> hashBytes(out.scriptPubKey.begin() + nOffset, out.scriptPubKey.begin() + nOffset + 20);
 
-            std::pair<addressDeltaMap::iterator,bool> ret;
             CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+            addAddressDelta(key, CMempoolAddressDelta(entry.GetTime(), out.nValue), inserted);
         } else if (out.scriptPubKey.IsPayToScriptHashLocked() ) {
 
             int nOffset = out.scriptPubKey[0] + 5;
@@ -514,14 +505,23 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
             vector<unsigned char> hashBytes(out.scriptPubKey.begin() + nOffset, out.scriptPubKey.begin() + nOffset + 20);
 
             CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+            addAddressDelta(key, CMempoolAddressDelta(entry.GetTime(), out.nValue), inserted);
         }
     }
 
     mapAddressInserted.insert(make_pair(txhash, inserted));
 }
 
+void CTxMemPool::addAddressDelta(const CMempoolAddressDeltaKey &key, const CMempoolAddressDelta &delta, std::vector<CMempoolAddressDeltaKey> &inserted)
+{
+    std::pair<addressDeltaMap::iterator, bool> ret = mapAddress.insert(make_pair(key, delta));
+
+    if (ret.second)
+        mapAddressByTime.insert(make_pair(CMempoolAddressDeltaTimeKey(key, delta.time), ret.first));
+
+    inserted.push_back(key);
+}
+
 bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
                                  std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
 {
@@ -536,6 +536,21 @@ bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresse
     return true;
 }
 
+bool CTxMemPool::getAddressIndexByTime(const std::vector<std::pair<uint160, int> > &addresses,
+                                       std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results,
+                                       int64_t nStartTime)
+{
+    LOCK(cs);
+    for (const std::pair<uint160, int> &address : addresses) {
+        addressDeltaTimeMap::const_iterator it = mapAddressByTime.lower_bound(CMempoolAddressDeltaTimeKey(address.second, address.first, nStartTime));
+        while (it != mapAddressByTime.end() && it->first.addressBytes == address.first && it->first.type == address.second) {
+            results.push_back(*it->second);
+            it++;
+        }
+    }
+    return true;
+}
+
 bool CTxMemPool::removeAddressIndex(const uint256 txhash)
 {
     LOCK(cs);
@@ -544,7 +559,11 @@ bool CTxMemPool::removeAddressIndex(const uint256 txhash)
     if (it != mapAddressInserted.end()) {
         std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
         for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapAddress.erase(*mit);
+            addressDeltaMap::iterator ait = mapAddress.find(*mit);
+            if (ait == mapAddress.end())
+                continue;
+            mapAddressByTime.erase(CMempoolAddressDeltaTimeKey(ait->first, ait->second.time));
+            mapAddress.erase(ait);
         }
         mapAddressInserted.erase(it);
     }
@@ -779,21 +798,22 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
 /**
  * Called when a block is connected. Removes from mempool and updates the miner fee estimator.
  */
-void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
+void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight,
                                 std::list<CTransaction>& conflicts, bool fCurrentEstimate)
 {
     LOCK(cs);
     std::vector<CTxMemPoolEntry> entries;
-    BOOST_FOREACH(const CTransaction& tx, vtx)
+    for (const CTransactionRef& ptx : vtx)
     {
-        uint256 hash = tx.GetHash();
+        uint256 hash = ptx->GetHash();
 
         indexed_transaction_set::iterator i = mapTx.find(hash);
         if (i != mapTx.end())
             entries.push_back(*i);
     }
-    BOOST_FOREACH(const CTransaction& tx, vtx)
+    for (const CTransactionRef& ptx : vtx)
     {
+        const CTransaction& tx = *ptx;
         std::list<CTransaction> dummy;
         remove(tx, dummy, false);
         removeConflicts(tx, conflicts);
@@ -950,6 +970,15 @@ bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
     return true;
 }
 
+CTransactionRef CTxMemPool::get(const uint256& hash) const
+{
+    LOCK(cs);
+    indexed_transaction_set::const_iterator i = mapTx.find(hash);
+    if (i == mapTx.end())
+        return CTransactionRef();
+    return i->GetSharedTx();
+}
+
 CFeeRate CTxMemPool::estimateFee(int nBlocks) const
 {
     LOCK(cs);
@@ -1060,10 +1089,10 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     // If an entry in the mempool exists, always return that one, as it's guaranteed to never
     // conflict with the underlying cache, and it cannot have pruned entries (as it contains full)
     // transactions. First checking the underlying cache risks returning a pruned entry instead.
-    CTransaction tx;
-    if (mempool.lookup(outpoint.hash, tx)) {
-        if (outpoint.n < tx.vout.size()) {
-            coin = Coin(tx.vout[outpoint.n], MEMPOOL_HEIGHT, false);
+    CTransactionRef ptx = mempool.get(outpoint.hash);
+    if (ptx) {
+        if (outpoint.n < ptx->vout.size()) {
+            coin = Coin(ptx->vout[outpoint.n], MEMPOOL_HEIGHT, false);
             return true;
         } else {
             return false;
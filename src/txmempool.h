@@ -75,7 +75,7 @@ class CTxMemPool;
 class CTxMemPoolEntry
 {
 private:
-    CTransaction tx;
+    CTransactionRef tx;
     CAmount nFee; //! Cached to avoid expensive parent-transaction lookups
     size_t nTxSize; //! ... and avoid recomputing tx size
     size_t nModSize; //! ... and modified size for priority
@@ -100,13 +100,15 @@ private:
     CAmount nModFeesWithDescendants;  //! ... and total fees (all including us)
 
 public:
-    CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee,
+    CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, double _entryPriority, unsigned int _entryHeight,
                     bool poolHasNoInputsOf, CAmount _inChainInputValue, bool spendsCoinbase,
                     unsigned int nSigOps, LockPoints lp);
     CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
-    const CTransaction& GetTx() const { return this->tx; }
+    const CTransaction& GetTx() const { return *this->tx; }
+    //! The transaction shared with everyone else holding it, e.g. a block or a peer's orphans
+    const CTransactionRef& GetSharedTx() const { return this->tx; }
     /**
      * Fast calculation of lower bound of current priority as update
      * from entry priority. Only inputs that were originally in-chain will age.
@@ -441,12 +443,18 @@ private:
     typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
     addressDeltaMapInserted mapAddressInserted;
 
+    //! The deltas of mapAddress per address in the order they entered the mempool
+    typedef std::map<CMempoolAddressDeltaTimeKey, addressDeltaMap::const_iterator, CMempoolAddressDeltaTimeKeyCompare> addressDeltaTimeMap;
+    addressDeltaTimeMap mapAddressByTime;
+
     typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
     mapSpentIndex mapSpent;
 
     typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
+    void addAddressDelta(const CMempoolAddressDeltaKey &key, const CMempoolAddressDelta &delta, std::vector<CMempoolAddressDeltaKey> &inserted);
+
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
@@ -481,6 +489,10 @@ public:
     void addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
+    /** Deltas of all addresses with one lock, per address in time order and not older than nStartTime. */
+    bool getAddressIndexByTime(const std::vector<std::pair<uint160, int> > &addresses,
+                               std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results,
+                               int64_t nStartTime = 0);
     bool removeAddressIndex(const uint256 txhash);
 
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
@@ -490,7 +502,7 @@ public:
     void remove(const CTransaction &tx, std::list<CTransaction>& removed, bool fRecursive = false);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags);
     void removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed);
-    void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight,
+    void removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight,
                         std::list<CTransaction>& conflicts, bool fCurrentEstimate = true);
     void clear();
     void _clear(); //lock free
@@ -587,6 +599,8 @@ public:
     }
 
     bool lookup(uint256 hash, CTransaction& result) const;
+    /** The transaction itself rather than a copy of it, NULL if it isn't in the pool */
+    CTransactionRef get(const uint256& hash) const;
 
     /** Estimate fee rate needed to get into the next nBlocks
      *  If no answer can be given at nBlocks, return an estimate
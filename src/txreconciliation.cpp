@@ -0,0 +1,289 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txreconciliation.h"
+
+#include "crypto/sha256.h"
+#include "hash.h"
+
+#include <algorithm>
+
+namespace {
+
+/** Random splits tried before the roots of a polynomial count as not found */
+const uint32_t MAX_SPLIT_TRIES = 64;
+
+uint32_t GFMul(uint32_t a, uint32_t b)
+{
+    // Carry-less product in four bit steps
+    uint64_t table[16];
+    table[0] = 0;
+    for (int i = 1; i < 16; i++)
+        table[i] = (i & 1 ? uint64_t(a) : 0) ^ (table[i >> 1] << 1);
+    uint64_t r = 0;
+    for (int i = 28; i >= 0; i -= 4)
+        r = (r << 4) ^ table[(b >> i) & 15];
+
+    // x^32 = x^7 + x^3 + x^2 + 1, twice for the bits the first round pushes above x^31
+    uint64_t hi = r >> 32;
+    r = (r & 0xffffffff) ^ hi ^ (hi << 2) ^ (hi << 3) ^ (hi << 7);
+    hi = r >> 32;
+    return r ^ hi ^ (hi << 2) ^ (hi << 3) ^ (hi << 7);
+}
+
+//! a^(2^32 - 2), the inverse of a for a != 0
+uint32_t GFInv(uint32_t a)
+{
+    uint32_t r = a;
+    for (int i = 0; i < 30; i++)
+        r = GFMul(GFMul(r, r), a);
+    return GFMul(r, r);
+}
+
+/** Polynomials over GF(2^32), the coefficients from x^0 up */
+typedef std::vector<uint32_t> Poly;
+
+void Trim(Poly& p)
+{
+    while (!p.empty() && p.back() == 0)
+        p.pop_back();
+}
+
+void MakeMonic(Poly& p)
+{
+    Trim(p);
+    if (p.empty() || p.back() == 1)
+        return;
+    uint32_t inv = GFInv(p.back());
+    for (uint32_t& c : p)
+        c = GFMul(c, inv);
+}
+
+//! a mod m and the quotient in pquot, m has to be monic
+Poly DivMod(Poly a, const Poly& m, Poly* pquot = NULL)
+{
+    Trim(a);
+    size_t nDegM = m.size() - 1;
+    if (pquot)
+        pquot->assign(a.size() > nDegM ? a.size() - nDegM : 0, 0);
+    for (size_t i = a.size(); i-- > nDegM;) {
+        uint32_t c = a[i];
+        if (!c)
+            continue;
+        if (pquot)
+            (*pquot)[i - nDegM] = c;
+        for (size_t j = 0; j <= nDegM; j++)
+            a[i - nDegM + j] ^= GFMul(c, m[j]);
+    }
+    a.resize(std::min(a.size(), nDegM));
+    Trim(a);
+    return a;
+}
+
+//! a^2 mod m, squaring only squares the coefficients in characteristic 2
+Poly SqrMod(const Poly& a, const Poly& m)
+{
+    Poly r(a.empty() ? 0 : 2 * a.size() - 1, 0);
+    for (size_t i = 0; i < a.size(); i++)
+        r[2 * i] = GFMul(a[i], a[i]);
+    return DivMod(r, m);
+}
+
+void AddTo(Poly& a, const Poly& b)
+{
+    if (a.size() < b.size())
+        a.resize(b.size(), 0);
+    for (size_t i = 0; i < b.size(); i++)
+        a[i] ^= b[i];
+    Trim(a);
+}
+
+//! Monic greatest common divisor
+Poly GCD(Poly a, Poly b)
+{
+    Trim(a);
+    Trim(b);
+    while (!b.empty()) {
+        MakeMonic(b);
+        a = DivMod(a, b);
+        std::swap(a, b);
+    }
+    MakeMonic(a);
+    return a;
+}
+
+/**
+ * The roots of a monic polynomial with distinct roots which all are in the field.
+ * Tr(a * x) is 0 for about half the elements, the gcd with the sum of
+ * (a * x)^(2^i) splits off the roots for which it is.
+ */
+bool FindRoots(const Poly& p, std::vector<uint32_t>& vRoots)
+{
+    size_t nDeg = p.size() - 1;
+    if (nDeg == 0)
+        return true;
+    if (nDeg == 1) {
+        vRoots.push_back(p[0]);
+        return true;
+    }
+
+    for (uint32_t nTry = 1; nTry <= MAX_SPLIT_TRIES; nTry++) {
+        Poly t = {0, nTry * 2654435761U};
+        Poly trace = t;
+        for (int i = 1; i < 32; i++) {
+            t = SqrMod(t, p);
+            AddTo(trace, t);
+        }
+        Poly g = GCD(trace, p);
+        if (g.size() < 2 || g.size() == p.size())
+            continue;
+        Poly q;
+        DivMod(p, g, &q);
+        return FindRoots(g, vRoots) && FindRoots(q, vRoots);
+    }
+    return false;
+}
+
+}
+
+void CTxSketch::Add(uint32_t nElement)
+{
+    uint32_t nSquare = GFMul(nElement, nElement);
+    uint32_t nPower = nElement;
+    for (uint32_t& s : vSyndromes) {
+        s ^= nPower;
+        nPower = GFMul(nPower, nSquare);
+    }
+}
+
+void CTxSketch::Merge(const CTxSketch& other)
+{
+    vSyndromes.resize(std::min(vSyndromes.size(), other.vSyndromes.size()));
+    for (size_t i = 0; i < vSyndromes.size(); i++)
+        vSyndromes[i] ^= other.vSyndromes[i];
+}
+
+bool CTxSketch::Decode(std::vector<uint32_t>& vElementsRet) const
+{
+    vElementsRet.clear();
+    size_t nCapacity = vSyndromes.size();
+
+    // All the power sums s_1 ... s_2c, s_2i = s_i^2 in characteristic 2
+    std::vector<uint32_t> vSums(2 * nCapacity);
+    for (size_t j = 1; j <= vSums.size(); j++)
+        vSums[j - 1] = (j & 1) ? vSyndromes[j / 2] : GFMul(vSums[j / 2 - 1], vSums[j / 2 - 1]);
+
+    // Berlekamp-Massey, the connection polynomial is the product of (1 - e * x)
+    Poly c = {1}, b = {1};
+    size_t nLength = 0, nShift = 1;
+    uint32_t nLastDiscrepancy = 1;
+    for (size_t n = 0; n < vSums.size(); n++) {
+        uint32_t d = vSums[n];
+        for (size_t i = 1; i <= nLength && i < c.size(); i++)
+            d ^= GFMul(c[i], vSums[n - i]);
+        if (!d) {
+            nShift++;
+            continue;
+        }
+
+        uint32_t nCoef = GFMul(d, GFInv(nLastDiscrepancy));
+        Poly t = c;
+        if (c.size() < b.size() + nShift)
+            c.resize(b.size() + nShift, 0);
+        for (size_t i = 0; i < b.size(); i++)
+            c[i + nShift] ^= GFMul(nCoef, b[i]);
+
+        if (2 * nLength <= n) {
+            nLength = n + 1 - nLength;
+            b = t;
+            nLastDiscrepancy = d;
+            nShift = 1;
+        } else {
+            nShift++;
+        }
+    }
+
+    Trim(c);
+    if (nLength > nCapacity || c.size() != nLength + 1)
+        return false;
+    if (nLength == 0)
+        return true;
+
+    // The reversed polynomial is the product of (x - e)
+    Poly p(c.rbegin(), c.rend());
+
+    // All the roots are distinct elements of the field if p divides x^(2^32) - x
+    Poly x = DivMod({0, 1}, p);
+    Poly t = x;
+    for (int i = 0; i < 32; i++)
+        t = SqrMod(t, p);
+    if (t != x)
+        return false;
+
+    std::vector<uint32_t> vRoots;
+    if (!FindRoots(p, vRoots) || vRoots.size() != nLength)
+        return false;
+    if (std::find(vRoots.begin(), vRoots.end(), 0) != vRoots.end())
+        return false;
+
+    vElementsRet.swap(vRoots);
+    return true;
+}
+
+size_t EstimateSketchCapacity(size_t nLocalSize, size_t nRemoteSize)
+{
+    size_t nDiff = nLocalSize > nRemoteSize ? nLocalSize - nRemoteSize : nRemoteSize - nLocalSize;
+    return std::min(nDiff + std::min(nLocalSize, nRemoteSize) / 4 + 1, MAX_SKETCH_CAPACITY);
+}
+
+CTxReconciliationState::CTxReconciliationState(bool fInitiatorIn, uint64_t nLocalSalt, uint64_t nRemoteSalt) :
+    fInitiator(fInitiatorIn), nRequestTime(0), nNextRequest(0)
+{
+    // Both sides get the same keys, the salts in ascending order
+    static const std::string strTag = "Tx Relay Salting";
+    uint64_t nSalt1 = std::min(nLocalSalt, nRemoteSalt), nSalt2 = std::max(nLocalSalt, nRemoteSalt);
+    uint256 hash;
+    CSHA256().Write((const unsigned char*)strTag.data(), strTag.size())
+             .Write((const unsigned char*)&nSalt1, sizeof(nSalt1))
+             .Write((const unsigned char*)&nSalt2, sizeof(nSalt2))
+             .Finalize(hash.begin());
+    k0 = hash.GetUint64(0);
+    k1 = hash.GetUint64(1);
+}
+
+uint32_t CTxReconciliationState::GetShortID(const uint256& hash) const
+{
+    uint32_t nShortID = SipHashUint256(k0, k1, hash);
+    return nShortID ? nShortID : 1;
+}
+
+bool CTxReconciliationState::ShouldFlood(const uint256& hash) const
+{
+    // About half of the items to every outbound peer, a different half for each
+    return fInitiator && (SipHashUint256(k1, k0, hash) & 1);
+}
+
+bool CTxReconciliationState::Add(const CInv& inv)
+{
+    if (setInventory.size() >= MAX_RECON_SET_SIZE)
+        return false;
+    // A short id some other item has already got has to be flooded
+    auto ret = setInventory.emplace(GetShortID(inv.hash), inv);
+    return ret.second || ret.first->second.hash == inv.hash;
+}
+
+void CTxReconciliationState::Remove(const uint256& hash)
+{
+    ReconSet::iterator it = setInventory.find(GetShortID(hash));
+    if (it != setInventory.end() && it->second.hash == hash)
+        setInventory.erase(it);
+}
+
+CTxSketch CTxReconciliationState::GetSketch(const ReconSet& set, size_t nCapacity)
+{
+    CTxSketch sketch(nCapacity);
+    for (const auto& pair : set)
+        sketch.Add(pair.first);
+    return sketch;
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_TXRECONCILIATION_H
+#define SMARTCASH_TXRECONCILIATION_H
+
+#include "protocol.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+/** Default for -txreconciliation, reconciling the transaction inventory with the peers which support it */
+static const bool DEFAULT_TXRECONCILIATION = true;
+/** Version of the reconciliation protocol sent along with sendrecon */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Average seconds between two reconciliations with an outbound peer */
+static const int RECON_REQUEST_INTERVAL = 4;
+/** Seconds an outbound peer has to answer a reconciliation request with a sketch */
+static const int RECON_RESPONSE_TIMEOUT = 60;
+/** Most differences a sketch gets sized for, larger differences get flooded */
+static const size_t MAX_SKETCH_CAPACITY = 128;
+/** Most inventory items waiting for the next reconciliation with a peer, further ones get flooded */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+
+/**
+ * Sketch of a set of 32 bit elements (PinSketch over GF(2^32)): the odd power
+ * sums s_1, s_3, ..., s_(2c-1) of the elements for a capacity of c.
+ *
+ * Merging the sketches of two sets gives the sketch of their symmetric
+ * difference, the elements in common cancel out. A sketch decodes as long as
+ * the set it stands for has at most c elements, so two peers can find the
+ * difference of their sets with 4 bytes per differing element, however large
+ * the sets are.
+ */
+class CTxSketch
+{
+private:
+    std::vector<uint32_t> vSyndromes;
+
+public:
+    explicit CTxSketch(size_t nCapacity = 0) : vSyndromes(nCapacity, 0) {}
+
+    size_t GetCapacity() const { return vSyndromes.size(); }
+
+    //! Add an element or remove it again, 0 is no valid element
+    void Add(uint32_t nElement);
+
+    //! Turn this into the sketch of the symmetric difference, shrinks to the smaller capacity
+    void Merge(const CTxSketch& other);
+
+    //! The elements of the set, false if it has more of them than the capacity
+    bool Decode(std::vector<uint32_t>& vElementsRet) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(vSyndromes);
+        if (ser_action.ForRead() && vSyndromes.size() > MAX_SKETCH_CAPACITY)
+            throw std::ios_base::failure("sketch capacity too large");
+    }
+};
+
+/** Sketch capacity for the difference of two sets of the sizes, (|a - b| + min(a, b) / 4 + 1) at most MAX_SKETCH_CAPACITY */
+size_t EstimateSketchCapacity(size_t nLocalSize, size_t nRemoteSize);
+
+/**
+ * Reconciliation state of one peer, both sides sent sendrecon with their salt.
+ * The inventory which didn't get flooded to the peer waits in the set until the
+ * next reconciliation. The side which made the connection asks for the sketch of
+ * the other side's set, every RECON_REQUEST_INTERVAL seconds on average, and
+ * finds out which items either side is missing. Only those get announced then.
+ *
+ * Protected by the cs_inventory of the node.
+ */
+class CTxReconciliationState
+{
+public:
+    typedef std::map<uint32_t, CInv> ReconSet;
+
+private:
+    //! SipHash keys of the short ids, from both salts
+    uint64_t k0, k1;
+
+public:
+    //! We made the connection and ask for the sketches
+    const bool fInitiator;
+    //! Inventory the peer didn't get from us since the last reconciliation, by short id
+    ReconSet setInventory;
+    //! Responder: the set the last sketch was made of, until the peer told which items it's missing
+    ReconSet setSnapshot;
+    //! Initiator: the time of the request whose sketch didn't arrive yet, 0 if there is none
+    int64_t nRequestTime;
+    //! Initiator: the time of the next request
+    int64_t nNextRequest;
+
+    CTxReconciliationState(bool fInitiatorIn, uint64_t nLocalSalt, uint64_t nRemoteSalt);
+
+    //! The inventory types which get reconciled, everything else is always flooded
+    static bool IsReconciled(int nType) { return nType == MSG_TX || nType == MSG_TXLOCK_VOTE; }
+
+    uint32_t GetShortID(const uint256& hash) const;
+
+    //! Some of the inventory still gets flooded to the outbound peers, to keep the relay fast
+    bool ShouldFlood(const uint256& hash) const;
+
+    //! Keep the item for the next reconciliation, false if it has to be flooded instead
+    bool Add(const CInv& inv);
+
+    //! The peer announced the item itself, it doesn't have to be reconciled
+    void Remove(const uint256& hash);
+
+    static CTxSketch GetSketch(const ReconSet& set, size_t nCapacity);
+};
+
+#endif // SMARTCASH_TXRECONCILIATION_H
@@ -11,6 +11,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <cassert>
 
 #include <sstream>        // .get_int64()
@@ -27,6 +29,10 @@ public:
         typ = initialType;
         val = initialStr;
     }
+    UniValue(UniValue::VType initialType, std::string&& initialStr) {
+        typ = initialType;
+        val = std::move(initialStr);
+    }
     UniValue(uint64_t val_) {
         setInt(val_);
     }
@@ -49,8 +55,15 @@ public:
         std::string s(val_);
         setStr(s);
     }
+    UniValue(const UniValue& other);
+    UniValue(UniValue&& other) = default;
+    UniValue& operator=(const UniValue& other);
+    UniValue& operator=(UniValue&& other) = default;
     ~UniValue() {}
 
+    /** Objects with at least this many keys get a hashed index for the key lookups */
+    static const size_t INDEX_MIN_KEYS = 16;
+
     void clear();
 
     bool setNull();
@@ -69,6 +82,8 @@ public:
     bool empty() const { return (values.size() == 0); }
 
     size_t size() const { return values.size(); }
+    /** Reserve room for n elements of an array or n members of an object */
+    void reserve(size_t n);
 
     bool getBool() const { return isTrue(); }
     bool checkObject(const std::map<std::string,UniValue::VType>& memberTypes);
@@ -87,9 +102,10 @@ public:
 
     bool insert(int index, const UniValue& val);
     bool push_back(const UniValue& val);
+    bool push_back(UniValue&& val);
     bool push_back(const std::string& val_) {
         UniValue tmpVal(VSTR, val_);
-        return push_back(tmpVal);
+        return push_back(std::move(tmpVal));
     }
     bool push_back(const char *val_) {
         std::string s(val_);
@@ -98,9 +114,10 @@ public:
     bool push_backV(const std::vector<UniValue>& vec);
 
     bool pushKV(const std::string& key, const UniValue& val);
+    bool pushKV(std::string key, UniValue&& val);
     bool pushKV(const std::string& key, const std::string& val) {
         UniValue tmpVal(VSTR, val);
-        return pushKV(key, tmpVal);
+        return pushKV(key, std::move(tmpVal));
     }
     bool pushKV(const std::string& key, const char *val_) {
         std::string val(val_);
@@ -108,28 +125,30 @@ public:
     }
     bool pushKV(const std::string& key, int64_t val) {
         UniValue tmpVal(val);
-        return pushKV(key, tmpVal);
+        return pushKV(key, std::move(tmpVal));
     }
     bool pushKV(const std::string& key, uint64_t val) {
         UniValue tmpVal(val);
-        return pushKV(key, tmpVal);
+        return pushKV(key, std::move(tmpVal));
     }
     bool pushKV(const std::string& key, int val) {
         UniValue tmpVal((int64_t)val);
-        return pushKV(key, tmpVal);
+        return pushKV(key, std::move(tmpVal));
     }
     bool pushKV(const std::string& key, double val) {
         UniValue tmpVal(val);
-        return pushKV(key, tmpVal);
+        return pushKV(key, std::move(tmpVal));
     }
     bool pushKVs(const UniValue& obj);
 
     std::string write(unsigned int prettyIndent = 0,
                       unsigned int indentLevel = 0) const;
 
+    /** Parse size bytes at raw, they don't have to be NUL terminated */
+    bool read(const char *raw, size_t size);
     bool read(const char *raw);
     bool read(const std::string& rawStr) {
-        return read(rawStr.c_str());
+        return read(rawStr.data(), rawStr.size());
     }
 
 private:
@@ -137,8 +156,12 @@ private:
     std::string val;                       // numbers are stored as C++ strings
     std::vector<std::string> keys;
     std::vector<UniValue> values;
+    //! Position of the first occurrence of each key, only for objects of INDEX_MIN_KEYS keys or more
+    std::unique_ptr<std::unordered_map<std::string, size_t> > keyIndex;
 
     int findKey(const std::string& key) const;
+    /** Add the key pushed last to the index, builds it once the object got large enough */
+    void indexLastKey();
     void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
 
@@ -158,7 +181,7 @@ public:
 
     enum VType type() const { return getType(); }
     bool push_back(std::pair<std::string,UniValue> pear) {
-        return pushKV(pear.first, pear.second);
+        return pushKV(std::move(pear.first), std::move(pear.second));
     }
     friend const UniValue& find_value( const UniValue& obj, const std::string& name);
 };
@@ -244,7 +267,7 @@ enum jtokentype {
 };
 
 extern enum jtokentype getJsonToken(std::string& tokenVal,
-                                    unsigned int& consumed, const char *raw);
+                                    unsigned int& consumed, const char *raw, const char *end);
 extern const char *uvTypeName(UniValue::VType t);
 
 static inline bool jsonTokenIsValue(enum jtokentype jtt)
@@ -30,12 +30,40 @@ using namespace std;
 
 const UniValue NullUniValue;
 
+UniValue::UniValue(const UniValue& other) :
+    typ(other.typ),
+    val(other.val),
+    keys(other.keys),
+    values(other.values)
+{
+    if (other.keyIndex)
+        keyIndex.reset(new std::unordered_map<std::string, size_t>(*other.keyIndex));
+}
+
+UniValue& UniValue::operator=(const UniValue& other)
+{
+    if (this != &other) {
+        UniValue tmp(other);
+        *this = std::move(tmp);
+    }
+    return *this;
+}
+
 void UniValue::clear()
 {
     typ = VNULL;
     val.clear();
     keys.clear();
     values.clear();
+    keyIndex.reset();
+}
+
+void UniValue::reserve(size_t n)
+{
+    if (typ == VOBJ)
+        keys.reserve(n);
+    if (typ == VOBJ || typ == VARR)
+        values.reserve(n);
 }
 
 bool UniValue::setNull()
@@ -57,7 +85,7 @@ static bool validNumStr(const string& s)
 {
     string tokenVal;
     unsigned int consumed;
-    enum jtokentype tt = getJsonToken(tokenVal, consumed, s.c_str());
+    enum jtokentype tt = getJsonToken(tokenVal, consumed, s.data(), s.data() + s.size());
     return (tt == JTOK_NUMBER);
 }
 
@@ -145,6 +173,15 @@ bool UniValue::push_back(const UniValue& val)
     return true;
 }
 
+bool UniValue::push_back(UniValue&& val)
+{
+    if (typ != VARR)
+        return false;
+
+    values.push_back(std::move(val));
+    return true;
+}
+
 bool UniValue::push_backV(const std::vector<UniValue>& vec)
 {
     if (typ != VARR)
@@ -162,6 +199,18 @@ bool UniValue::pushKV(const std::string& key, const UniValue& val)
 
     keys.push_back(key);
     values.push_back(val);
+    indexLastKey();
+    return true;
+}
+
+bool UniValue::pushKV(std::string key, UniValue&& val)
+{
+    if (typ != VOBJ)
+        return false;
+
+    keys.push_back(std::move(key));
+    values.push_back(std::move(val));
+    indexLastKey();
     return true;
 }
 
@@ -170,16 +219,36 @@ bool UniValue::pushKVs(const UniValue& obj)
     if (typ != VOBJ || obj.typ != VOBJ)
         return false;
 
+    reserve(keys.size() + obj.keys.size());
     for (unsigned int i = 0; i < obj.keys.size(); i++) {
         keys.push_back(obj.keys[i]);
         values.push_back(obj.values.at(i));
+        indexLastKey();
     }
 
     return true;
 }
 
+void UniValue::indexLastKey()
+{
+    if (keyIndex) {
+        // emplace keeps the first occurrence of a duplicate key, as the linear search finds it
+        keyIndex->emplace(keys.back(), keys.size() - 1);
+    } else if (keys.size() >= INDEX_MIN_KEYS) {
+        keyIndex.reset(new std::unordered_map<std::string, size_t>());
+        keyIndex->reserve(keys.size() * 2);
+        for (size_t i = 0; i < keys.size(); i++)
+            keyIndex->emplace(keys[i], i);
+    }
+}
+
 int UniValue::findKey(const std::string& key) const
 {
+    if (keyIndex) {
+        std::unordered_map<std::string, size_t>::const_iterator it = keyIndex->find(key);
+        return it == keyIndex->end() ? -1 : (int) it->second;
+    }
+
     for (unsigned int i = 0; i < keys.size(); i++) {
         if (keys[i] == key)
             return (int) i;
@@ -242,11 +311,11 @@ const char *uvTypeName(UniValue::VType t)
 
 const UniValue& find_value(const UniValue& obj, const std::string& name)
 {
-    for (unsigned int i = 0; i < obj.keys.size(); i++)
-        if (obj.keys[i] == name)
-            return obj.values.at(i);
+    int index = obj.findKey(name);
+    if (index < 0)
+        return NullUniValue;
 
-    return NullUniValue;
+    return obj.values.at(index);
 }
 
 std::vector<std::string> UniValue::getKeys() const
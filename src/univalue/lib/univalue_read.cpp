@@ -43,21 +43,21 @@ static const char *hatoui(const char *first, const char *last,
 }
 
 enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
-                            const char *raw)
+                            const char *raw, const char *end)
 {
     tokenVal.clear();
     consumed = 0;
 
     const char *rawStart = raw;
 
-    while ((*raw) && (json_isspace(*raw)))             // skip whitespace
+    while (raw < end && (json_isspace(*raw)))          // skip whitespace
         raw++;
 
-    switch (*raw) {
-
-    case 0:
+    if (raw >= end)
         return JTOK_NONE;
 
+    switch (*raw) {
+
     case '{':
         raw++;
         consumed = (raw - rawStart);
@@ -87,15 +87,15 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case 'n':
     case 't':
     case 'f':
-        if (!strncmp(raw, "null", 4)) {
+        if (end - raw >= 4 && !memcmp(raw, "null", 4)) {
             raw += 4;
             consumed = (raw - rawStart);
             return JTOK_KW_NULL;
-        } else if (!strncmp(raw, "true", 4)) {
+        } else if (end - raw >= 4 && !memcmp(raw, "true", 4)) {
             raw += 4;
             consumed = (raw - rawStart);
             return JTOK_KW_TRUE;
-        } else if (!strncmp(raw, "false", 5)) {
+        } else if (end - raw >= 5 && !memcmp(raw, "false", 5)) {
             raw += 5;
             consumed = (raw - rawStart);
             return JTOK_KW_FALSE;
@@ -114,59 +114,47 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case '8':
     case '9': {
         // part 1: int
-        string numStr;
-
         const char *first = raw;
 
         const char *firstDigit = first;
         if (!json_isdigit(*firstDigit))
             firstDigit++;
-        if ((*firstDigit == '0') && json_isdigit(firstDigit[1]))
+        if (firstDigit + 1 < end && (*firstDigit == '0') && json_isdigit(firstDigit[1]))
             return JTOK_ERR;
 
-        numStr += *raw;                       // copy first char
-        raw++;
+        raw++;                                // first char
 
-        if ((*first == '-') && (!json_isdigit(*raw)))
+        if ((*first == '-') && (raw >= end || !json_isdigit(*raw)))
             return JTOK_ERR;
 
-        while ((*raw) && json_isdigit(*raw)) {     // copy digits
-            numStr += *raw;
+        while (raw < end && json_isdigit(*raw))    // digits
             raw++;
-        }
 
         // part 2: frac
-        if (*raw == '.') {
-            numStr += *raw;                   // copy .
-            raw++;
+        if (raw < end && *raw == '.') {
+            raw++;                            // .
 
-            if (!json_isdigit(*raw))
+            if (raw >= end || !json_isdigit(*raw))
                 return JTOK_ERR;
-            while ((*raw) && json_isdigit(*raw)) { // copy digits
-                numStr += *raw;
+            while (raw < end && json_isdigit(*raw)) // digits
                 raw++;
-            }
         }
 
         // part 3: exp
-        if (*raw == 'e' || *raw == 'E') {
-            numStr += *raw;                   // copy E
-            raw++;
+        if (raw < end && (*raw == 'e' || *raw == 'E')) {
+            raw++;                            // E
 
-            if (*raw == '-' || *raw == '+') { // copy +/-
-                numStr += *raw;
+            if (raw < end && (*raw == '-' || *raw == '+')) // +/-
                 raw++;
-            }
 
-            if (!json_isdigit(*raw))
+            if (raw >= end || !json_isdigit(*raw))
                 return JTOK_ERR;
-            while ((*raw) && json_isdigit(*raw)) { // copy digits
-                numStr += *raw;
+            while (raw < end && json_isdigit(*raw)) // digits
                 raw++;
-            }
         }
 
-        tokenVal = numStr;
+        // copied in one go instead of char by char
+        tokenVal.assign(first, raw);
         consumed = (raw - rawStart);
         return JTOK_NUMBER;
         }
@@ -174,16 +162,19 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case '"': {
         raw++;                                // skip "
 
-        string valStr;
-        JSONUTF8StringFilter writer(valStr);
+        // written straight into the token, it was cleared above
+        JSONUTF8StringFilter writer(tokenVal);
 
-        while (*raw) {
-            if ((unsigned char)*raw < 0x20)
+        while (true) {
+            if (raw >= end || (unsigned char)*raw < 0x20)
                 return JTOK_ERR;
 
             else if (*raw == '\\') {
                 raw++;                        // skip backslash
 
+                if (raw >= end)
+                    return JTOK_ERR;
+
                 switch (*raw) {
                 case '"':  writer.push_back('\"'); break;
                 case '\\': writer.push_back('\\'); break;
@@ -196,7 +187,8 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
 
                 case 'u': {
                     unsigned int codepoint;
-                    if (hatoui(raw + 1, raw + 1 + 4, codepoint) !=
+                    if (end - raw < 5 ||
+                        hatoui(raw + 1, raw + 1 + 4, codepoint) !=
                                raw + 1 + 4)
                         return JTOK_ERR;
                     writer.push_back_u(codepoint);
@@ -224,7 +216,6 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
 
         if (!writer.finalize())
             return JTOK_ERR;
-        tokenVal = valStr;
         consumed = (raw - rawStart);
         return JTOK_STRING;
         }
@@ -246,10 +237,12 @@ enum expect_bits {
 #define setExpect(bit) (expectMask |= EXP_##bit)
 #define clearExpect(bit) (expectMask &= ~EXP_##bit)
 
-bool UniValue::read(const char *raw)
+bool UniValue::read(const char *raw, size_t size)
 {
     clear();
 
+    const char *end = raw + size;
+
     uint32_t expectMask = 0;
     vector<UniValue*> stack;
 
@@ -260,7 +253,7 @@ bool UniValue::read(const char *raw)
     do {
         last_tok = tok;
 
-        tok = getJsonToken(tokenVal, consumed, raw);
+        tok = getJsonToken(tokenVal, consumed, raw, end);
         if (tok == JTOK_NONE || tok == JTOK_ERR)
             return false;
         raw += consumed;
@@ -314,7 +307,7 @@ bool UniValue::read(const char *raw)
             } else {
                 UniValue tmpVal(utyp);
                 UniValue *top = stack.back();
-                top->values.push_back(tmpVal);
+                top->values.push_back(std::move(tmpVal));
 
                 UniValue *newTop = &(top->values.back());
                 stack.push_back(newTop);
@@ -389,7 +382,7 @@ bool UniValue::read(const char *raw)
             }
 
             UniValue *top = stack.back();
-            top->values.push_back(tmpVal);
+            top->values.push_back(std::move(tmpVal));
 
             setExpect(NOT_VALUE);
             break;
@@ -399,9 +392,9 @@ bool UniValue::read(const char *raw)
             if (!stack.size())
                 return false;
 
-            UniValue tmpVal(VNUM, tokenVal);
+            UniValue tmpVal(VNUM, std::move(tokenVal));
             UniValue *top = stack.back();
-            top->values.push_back(tmpVal);
+            top->values.push_back(std::move(tmpVal));
 
             setExpect(NOT_VALUE);
             break;
@@ -414,12 +407,13 @@ bool UniValue::read(const char *raw)
             UniValue *top = stack.back();
 
             if (expect(OBJ_NAME)) {
-                top->keys.push_back(tokenVal);
+                top->keys.push_back(std::move(tokenVal));
+                top->indexLastKey();
                 clearExpect(OBJ_NAME);
                 setExpect(COLON);
             } else {
-                UniValue tmpVal(VSTR, tokenVal);
-                top->values.push_back(tmpVal);
+                UniValue tmpVal(VSTR, std::move(tokenVal));
+                top->values.push_back(std::move(tmpVal));
             }
 
             setExpect(NOT_VALUE);
@@ -432,10 +426,14 @@ bool UniValue::read(const char *raw)
     } while (!stack.empty ());
 
     /* Check that nothing follows the initial construct (parsed above).  */
-    tok = getJsonToken(tokenVal, consumed, raw);
+    tok = getJsonToken(tokenVal, consumed, raw, end);
     if (tok != JTOK_NONE)
         return false;
 
     return true;
 }
 
+bool UniValue::read(const char *raw)
+{
+    return read(raw, strlen(raw));
+}
@@ -12,6 +12,10 @@
 #include <errno.h>
 #include <limits>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
 static const string CHARS_ALPHA_NUM = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
@@ -56,11 +60,73 @@ signed char HexDigit(char c)
     return p_util_hexdigit[(unsigned char)c];
 }
 
+#if defined(__SSE2__)
+/** 16 chars of a hex string to the nibbles they stand for, false if one of them isn't a hex digit */
+static inline bool HexDigits16(const char* psz, __m128i& nibbles)
+{
+    const __m128i chars = _mm_loadu_si128((const __m128i*)psz);
+    const __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    const __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    // Unsigned <= through min, anything below '0' or 'a' wrapped around above it
+    const __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    const __m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+    if (_mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) != 0xffff)
+        return false;
+    nibbles = _mm_or_si128(_mm_and_si128(isDigit, digit),
+                           _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+    return true;
+}
+
+/** Nibble pairs to the bytes they make up, in the low half of each 16 bit lane */
+static inline __m128i HexPairs(__m128i nibbles)
+{
+    return _mm_or_si128(_mm_and_si128(_mm_slli_epi16(nibbles, 4), _mm_set1_epi16(0x00f0)),
+                        _mm_srli_epi16(nibbles, 8));
+}
+
+/** Nibbles 0-15 to their lowercase hex digits */
+static inline __m128i HexChars(__m128i nibbles)
+{
+    const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+#endif
+
+void HexEncode(const unsigned char* pch, size_t len, char* psz)
+{
+    static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    for (; i + 16 <= len; i += 16, psz += 32) {
+        const __m128i bytes = _mm_loadu_si128((const __m128i*)(pch + i));
+        const __m128i hi = HexChars(_mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+        const __m128i lo = HexChars(_mm_and_si128(bytes, mask));
+        _mm_storeu_si128((__m128i*)psz, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i*)(psz + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+#endif
+    for (; i < len; i++) {
+        *psz++ = hexmap[pch[i] >> 4];
+        *psz++ = hexmap[pch[i] & 15];
+    }
+}
+
 bool IsHex(const string& str)
 {
-    for(std::string::const_iterator it(str.begin()); it != str.end(); ++it)
+    const char* psz = str.data();
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i nibbles;
+    for (; i + 16 <= str.size(); i += 16) {
+        if (!HexDigits16(psz + i, nibbles))
+            return false;
+    }
+#endif
+    for (; i < str.size(); i++)
     {
-        if (HexDigit(*it) < 0)
+        if (HexDigit(psz[i]) < 0)
             return false;
     }
     return (str.size() > 0) && (str.size()%2 == 0);
@@ -78,10 +144,21 @@ bool IsInteger(const std::string& s)
 
 vector<unsigned char> ParseHex(const char* psz)
 {
-    // convert hex dump to vector
-    vector<unsigned char> vch;
+    // convert hex dump to vector, sized for the whole string and cut back to the bytes found
+    const char* pszEnd = psz + strlen(psz);
+    vector<unsigned char> vch((pszEnd - psz) / 2);
+    size_t nBytes = 0;
     while (true)
     {
+#if defined(__SSE2__)
+        // Runs of 32 digits without spaces in between, 16 bytes at a time
+        __m128i nibbles0, nibbles1;
+        while (pszEnd - psz >= 32 && HexDigits16(psz, nibbles0) && HexDigits16(psz + 16, nibbles1)) {
+            _mm_storeu_si128((__m128i*)&vch[nBytes], _mm_packus_epi16(HexPairs(nibbles0), HexPairs(nibbles1)));
+            nBytes += 16;
+            psz += 32;
+        }
+#endif
         while (isspace(*psz))
             psz++;
         signed char c = HexDigit(*psz++);
@@ -92,8 +169,9 @@ vector<unsigned char> ParseHex(const char* psz)
         if (c == (signed char)-1)
             break;
         n |= c;
-        vch.push_back(n);
+        vch[nBytes++] = n;
     }
+    vch.resize(nBytes);
     return vch;
 }
 
@@ -92,9 +92,41 @@ bool ParseUInt64(const std::string& str, uint64_t *out);
  */
 bool ParseDouble(const std::string& str, double *out);
 
+/**
+ * Write the lowercase hex of the len bytes at pch to psz, 2 * len chars
+ * without a terminator. Uses SSE2 on the platforms that have it.
+ */
+void HexEncode(const unsigned char* pch, size_t len, char* psz);
+
+template<typename T>
+inline void HexEncodeRange(const T itbegin, const T itend, char* psz)
+{
+    static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    for(T it = itbegin; it < itend; ++it)
+    {
+        unsigned char val = (unsigned char)(*it);
+        *psz++ = hexmap[val>>4];
+        *psz++ = hexmap[val&15];
+    }
+}
+
+/** Byte buffers, serialized blocks and transactions among them, get the vectorized encoder */
+inline void HexEncodeRange(const unsigned char* itbegin, const unsigned char* itend, char* psz) { HexEncode(itbegin, itend - itbegin, psz); }
+inline void HexEncodeRange(unsigned char* itbegin, unsigned char* itend, char* psz) { HexEncode(itbegin, itend - itbegin, psz); }
+inline void HexEncodeRange(const char* itbegin, const char* itend, char* psz) { HexEncode((const unsigned char*)itbegin, itend - itbegin, psz); }
+inline void HexEncodeRange(char* itbegin, char* itend, char* psz) { HexEncode((const unsigned char*)itbegin, itend - itbegin, psz); }
+
 template<typename T>
 std::string HexStr(const T itbegin, const T itend, bool fSpaces=false)
 {
+    if (!fSpaces) {
+        std::string rv(itbegin < itend ? (itend-itbegin)*2 : 0, '\0');
+        if (!rv.empty())
+            HexEncodeRange(itbegin, itend, &rv[0]);
+        return rv;
+    }
+
     std::string rv;
     static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
                                      '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
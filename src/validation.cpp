@@ -7,13 +7,19 @@
 
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockfilter.h"
+#include "blockjournal.h"
+#include "blockscripts.h"
+#include "blocksummary.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "core_memusage.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
 #include "hash.h"
+#include "indexbuilder.h"
 #include "init.h"
 #include "messagesigner.h"
 #include "net_processing.h"
@@ -26,6 +32,7 @@
 #include "script/standard.h"
 #include "timedata.h"
 #include "tinyformat.h"
+#include "trace.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -38,6 +45,7 @@
 #include "wallet/wallet.h"
 #include "warnings.h"
 
+#include <memory>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -53,6 +61,7 @@
 #include "smartnode/instantx.h"
 #include "smartnode/spork.h"
 #include "smartmining/miningpayments.h"
+#include "smartvoting/proposal.h"
 #include "smartvoting/votevalidation.h"
 
 using namespace std;
@@ -81,6 +90,9 @@ bool fAddressIndex = true;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
 bool fDepositIndex = false;
+bool fPayoutIndex = false;
+bool fBlockFilterIndex = DEFAULT_BLOCKFILTERINDEX;
+bool fBalanceIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -89,7 +101,10 @@ unsigned int nBytesPerSigOp = DEFAULT_BYTES_PER_SIGOP;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+int nDBFlushBudget = DEFAULT_DB_FLUSH_BUDGET;
+unsigned int nUndoCacheBlocks = DEFAULT_UNDO_CACHE_BLOCKS;
 uint64_t nPruneTarget = 0;
+unsigned int nPruneKeepBlocks = DEFAULT_PRUNE_KEEP_BLOCKS;
 bool fAlerts = DEFAULT_ALERTS;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
 
@@ -154,6 +169,9 @@ namespace {
 
     CBlockIndex *pindexBestInvalid;
 
+    //! The entries of mapBlockIndex
+    CBlockIndexArena blockIndexArena;
+
     /**
      * The set of all CBlockIndex entries with BLOCK_VALID_TRANSACTIONS (for itself and all ancestors) and
      * as good as our current tip or better. Entries may be failed, though, and pruning nodes may be
@@ -564,6 +582,98 @@ int64_t GetBlockValue(int nHeight, int64_t nFees, unsigned int nTime)
     return value;
 }
 
+namespace {
+
+/** Heights [nStart, nEnd] which all get the same block value. */
+struct CBlockValueRun {
+    int nStart;
+    int nEnd;
+    CAmount nValue;
+    CAmount nSumBefore; //! Sum of the block values of all heights below nStart
+};
+
+CCriticalSection cs_blockvalueruns;
+//! The block value only changes every few thousand blocks, so a few thousand runs cover the whole schedule.
+std::vector<CBlockValueRun> vBlockValueRuns;
+
+// Append the run which follows the last one. The value of a run never comes back once it ended, which
+// allows to find its end with an exponential search.
+void ExtendBlockValueRuns()
+{
+    AssertLockHeld(cs_blockvalueruns);
+
+    int nStart = 0;
+    CAmount nSumBefore = 0;
+
+    if (!vBlockValueRuns.empty()) {
+        const CBlockValueRun& last = vBlockValueRuns.back();
+        nStart = last.nEnd + 1;
+        nSumBefore = last.nSumBefore + (CAmount)(last.nEnd - last.nStart + 1) * last.nValue;
+    }
+
+    CAmount nValue = GetBlockValue(nStart, 0, INT_MAX);
+
+    // There are no rewards after the end height, the last run is open ended.
+    if (nStart > HF_CHAIN_REWARD_END_HEIGHT) {
+        vBlockValueRuns.push_back(CBlockValueRun{nStart, std::numeric_limits<int>::max(), nValue, nSumBefore});
+        return;
+    }
+
+    int nLimit = HF_CHAIN_REWARD_END_HEIGHT;
+    int nEnd = nStart;
+    int nStep = 1;
+
+    while (nEnd < nLimit && GetBlockValue(std::min(nLimit, nEnd + nStep), 0, INT_MAX) == nValue) {
+        nEnd = std::min(nLimit, nEnd + nStep);
+        nStep *= 2;
+    }
+
+    // The end is now in [nEnd, nEnd + nStep)
+    int nHigh = std::min(nLimit, nEnd + nStep);
+    while (nEnd < nHigh) {
+        int nMiddle = nEnd + (nHigh - nEnd + 1) / 2;
+        if (GetBlockValue(nMiddle, 0, INT_MAX) == nValue) {
+            nEnd = nMiddle;
+        } else {
+            nHigh = nMiddle - 1;
+        }
+    }
+
+    vBlockValueRuns.push_back(CBlockValueRun{nStart, nEnd, nValue, nSumBefore});
+}
+
+// Sum of the block values of all heights below nHeight.
+CAmount GetBlockValuePrefix(int nHeight)
+{
+    AssertLockHeld(cs_blockvalueruns);
+
+    if (nHeight <= 0) {
+        return 0;
+    }
+
+    while (vBlockValueRuns.empty() || vBlockValueRuns.back().nEnd < nHeight - 1) {
+        ExtendBlockValueRuns();
+    }
+
+    auto it = std::upper_bound(vBlockValueRuns.begin(), vBlockValueRuns.end(), nHeight - 1,
+        [](int n, const CBlockValueRun& run) { return n < run.nStart; });
+    --it;
+
+    return it->nSumBefore + (CAmount)(nHeight - it->nStart) * it->nValue;
+}
+
+} // anon namespace
+
+CAmount GetBlockValueSum(int nFirstHeight, int nLastHeight)
+{
+    if (nLastHeight < nFirstHeight) {
+        return 0;
+    }
+
+    LOCK(cs_blockvalueruns);
+    return GetBlockValuePrefix(nLastHeight + 1) - GetBlockValuePrefix(nFirstHeight);
+}
+
 bool CheckTransaction(const CTransaction& tx, CValidationState& state, uint256 hashTx, bool isVerifyDB, int nHeight){
 
     // Basic checks that don't depend on any context
@@ -636,10 +746,11 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetRejectCode());
 }
 
-bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                              bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee,
+bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+                              bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee,
                               std::vector<COutPoint>& coins_to_uncache, bool fDryRun){
 
+    const CTransaction& tx = *ptx;
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
         *pfMissingInputs = false;
@@ -832,7 +943,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
             }
         }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOps, lp);
+        CTxMemPoolEntry entry(ptx, nFees, nAcceptTime, dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOps, lp);
 
         // Don't accept it if it can't get into a block
         int64_t txMinFee = tx.GetMinFee(1000, true, GMF_RELAY);
@@ -1126,13 +1237,74 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
     return true;
 }
 
+/** Blocks connected once which are not in chainActive anymore, by time. Those the timestamp
+ *  index has besides the active chain. Loaded from the block index by the first query. */
+static std::multimap<unsigned int, const CBlockIndex*> mapStaleBlockTimes;
+static bool fStaleBlockTimesLoaded = false;
+
+static void UpdateStaleBlockTimes(const CBlockIndex* pindex, bool fStale)
+{
+    AssertLockHeld(cs_main);
+
+    if (!fStaleBlockTimesLoaded)
+        return;
+
+    if (fStale) {
+        mapStaleBlockTimes.insert(std::make_pair(pindex->nTime, pindex));
+        return;
+    }
+
+    auto range = mapStaleBlockTimes.equal_range(pindex->nTime);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == pindex) {
+            mapStaleBlockTimes.erase(it);
+            break;
+        }
+    }
+}
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes)
 {
     if (!fTimestampIndex)
         return error("Timestamp index not enabled");
 
-    if (!pblocktree->ReadTimestampIndex(high, low, hashes))
-        return error("Unable to get hashes for timestamps");
+    LOCK(cs_main);
+
+    // Answered from the block index, the timestamp index in the database has the same blocks.
+    std::vector<const CBlockIndex*> vBlocks;
+
+    // Block times are almost ordered along the chain. nTimeMax only grows and each block is
+    // later than the median time past of its parent, so after a block with a median time past
+    // above the range none follows in it.
+    for (const CBlockIndex* pindex = chainActive.FindEarliestAtLeast(low); pindex; pindex = chainActive.Next(pindex)) {
+        if (pindex->nTime <= high) {
+            if (pindex->nTime >= low)
+                vBlocks.push_back(pindex);
+        } else if (pindex->GetMedianTimePast() > high) {
+            break;
+        }
+    }
+
+    if (!fStaleBlockTimesLoaded) {
+        // Connecting a block raises it to BLOCK_VALID_SCRIPTS, that stays if it gets disconnected.
+        for (const auto &entry : mapBlockIndex) {
+            const CBlockIndex* pindex = entry.second;
+            if ((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_SCRIPTS && !chainActive.Contains(pindex))
+                mapStaleBlockTimes.insert(std::make_pair(pindex->nTime, pindex));
+        }
+        fStaleBlockTimesLoaded = true;
+    }
+
+    for (auto it = mapStaleBlockTimes.lower_bound(low); it != mapStaleBlockTimes.end() && it->first <= high; ++it)
+        vBlocks.push_back(it->second);
+
+    // In the order of the database keys, by time and hash
+    std::sort(vBlocks.begin(), vBlocks.end(), [](const CBlockIndex* a, const CBlockIndex* b) {
+        return a->nTime != b->nTime ? a->nTime < b->nTime : a->GetBlockHash() < b->GetBlockHash();
+    });
+
+    for (const CBlockIndex* pindex : vBlocks)
+        hashes.push_back(pindex->GetBlockHash());
 
     return true;
 }
@@ -1151,6 +1323,33 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     return true;
 }
 
+bool GetSpentIndex(std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect)
+{
+    if (!fSpentIndex)
+        return false;
+
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vectRead;
+    std::vector<size_t> vecReadIndex;
+
+    for (size_t i = 0; i < vect.size(); i++) {
+        if (!mempool.getSpentIndex(vect[i].first, vect[i].second)) {
+            vectRead.push_back(std::make_pair(vect[i].first, CSpentIndexValue()));
+            vecReadIndex.push_back(i);
+        }
+    }
+
+    if (vectRead.empty())
+        return true;
+
+    if (!pblocktree->ReadSpentIndex(vectRead))
+        return false;
+
+    for (size_t i = 0; i < vectRead.size(); i++)
+        vect[vecReadIndex[i]].second = vectRead[i].second;
+
+    return true;
+}
+
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
 {
@@ -1168,12 +1367,76 @@ bool GetAddresses(std::vector<CAddressListEntry> &addressList, int nEndHeight, b
     if (!fAddressIndex)
         return error("address index not enabled");
 
+    // The balance index answers without reading the whole address index
+    if (fBalanceIndex) {
+        LOCK(cs_main);
+        if (pblocktree->ReadAddressBalances(addressList, nEndHeight, chainActive.Height()))
+            return true;
+        addressList.clear();
+    }
+
     if (!pblocktree->ReadAddresses(addressList, nEndHeight, excludeZeroBalances))
         return error("unable to get all addresses");
 
     return true;
 }
 
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value)
+{
+    if (!fBalanceIndex)
+        return error("balance index not enabled");
+
+    // Unknown addresses just have no balance yet.
+    if (!pblocktree->ReadAddressBalanceIndex(addressHash, type, value))
+        value.SetNull();
+
+    return true;
+}
+
+bool GetAddressTransactions(uint160 addressHash, int type, bool fAscending,
+                            int nCursorHeight, const uint256 &cursorTx, int64_t nSkip, int64_t nLimit,
+                            std::vector<std::tuple<uint256, int, CAmount> > &vecTxs, bool &fMore)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressIndexTransactions(addressHash, type, fAscending, nCursorHeight, cursorTx, nSkip, nLimit, vecTxs, fMore))
+        return error("unable to get transactions for address");
+
+    return true;
+}
+
+bool GetAddressIndexHeights(uint160 addressHash, int type, int nStartHeight, std::set<int> &setHeights)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressIndexHeights(addressHash, type, nStartHeight, setHeights))
+        return error("unable to get heights for address");
+
+    return true;
+}
+
+bool GetAddressTransactionCount(uint160 addressHash, int type, int64_t &count)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    // The balance index maintains the number, without it the address index needs a walk.
+    if (fBalanceIndex) {
+        CAddressBalanceValue value;
+        if (!GetAddressBalance(addressHash, type, value))
+            return false;
+        count = value.txCount;
+        return true;
+    }
+
+    if (!pblocktree->ReadAddressIndexTransactionCount(addressHash, type, count))
+        return error("unable to get transaction count for address");
+
+    return true;
+}
+
 bool GetAddressUnspentCount(uint160 addressHash, int type, int &count, CAddressUnspentKey &lastIndex)
 {
     if (!fAddressIndex)
@@ -1199,6 +1462,19 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     return true;
 }
 
+bool GetAddressUnspentByAmount(uint160 addressHash, int type,
+                               std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                               CAddressUnspentAmountKey &cursor, int limit)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressUnspentAmountIndex(addressHash, type, unspentOutputs, cursor, limit))
+        return error("unable to get unspent outputs by amount for address");
+
+    return true;
+}
+
 bool GetDepositIndexCount(uint160 addressHash, int type, int &count, int &firstTime, int &lastTime, int start, int end)
 {
     if (!fDepositIndex)
@@ -1223,6 +1499,71 @@ bool GetDepositIndex(uint160 addressHash, int type,
     return true;
 }
 
+void GetPayoutIndexEntries(const CTransaction &coinbase, int nHeight,
+                           std::vector<std::pair<CPayoutIndexKey, CPayoutValue>> &payoutIndex)
+{
+    std::vector<int> vCategories;
+    SmartMining::GetPayoutCategories(coinbase, nHeight, vCategories);
+
+    for (unsigned int k = 0; k < coinbase.vout.size(); k++) {
+        if (!vCategories[k])
+            continue;
+
+        uint160 hashBytes;
+        int addressType = GetIndexAddress(coinbase.vout[k].scriptPubKey, hashBytes);
+        if (addressType)
+            payoutIndex.push_back(std::make_pair(CPayoutIndexKey(addressType, hashBytes, nHeight, k),
+                                                 CPayoutValue(vCategories[k], coinbase.vout[k].nValue)));
+    }
+}
+
+bool GetPayoutIndex(uint160 addressHash, int type, int nFrom, int nTo, int categoryMask, int limit,
+                    std::vector<std::pair<CPayoutIndexKey, CPayoutValue>> &payoutIndex)
+{
+    if (!fPayoutIndex)
+        return error("payout index not enabled");
+
+    if (!pblocktree->ReadPayoutIndex(addressHash, type, nFrom, nTo, categoryMask, limit, payoutIndex))
+        return error("unable to get payouts for address");
+
+    return true;
+}
+
+bool GetBlockFilter(const uint256 &hashBlock, CBlockFilter &filter)
+{
+    if (!fBlockFilterIndex)
+        return error("block filter index not enabled");
+
+    return pblocktree->ReadBlockFilter(hashBlock, filter);
+}
+
+bool GetBlockFilterHash(const uint256 &hashBlock, uint256 &hashFilter)
+{
+    if (!fBlockFilterIndex)
+        return error("block filter index not enabled");
+
+    return pblocktree->ReadBlockFilterHash(hashBlock, hashFilter);
+}
+
+bool GetBlockFilterHeader(const uint256 &hashBlock, uint256 &header)
+{
+    if (!fBlockFilterIndex)
+        return error("block filter index not enabled");
+
+    return pblocktree->ReadBlockFilterHeader(hashBlock, header);
+}
+
+/** Write the filter of the block, and its header if the one of the previous block is known already */
+static void WriteBlockFilterIndex(CDBBatch &batch, const CBlockIndex* pindex, const CBlock &block, const CBlockUndo &blockundo)
+{
+    CBlockFilter filter(BLOCK_FILTER_BASIC, block, blockundo);
+    pblocktree->WriteBlockFilter(batch, filter);
+
+    uint256 prevHeader;
+    if (!pindex->pprev || pblocktree->ReadBlockFilterHeader(pindex->pprev->GetBlockHash(), prevHeader))
+        pblocktree->WriteBlockFilterHeader(batch, pindex->GetBlockHash(), filter.ComputeHeader(prevHeader));
+}
+
 bool GetInstantPayIndexCount(int &count, int &firstTime, int &lastTime, int start, int end)
 {
     if (!fInstantPayIndex)
@@ -1246,11 +1587,16 @@ bool GetInstantPayIndex(std::vector<std::pair<CInstantPayIndexKey, CInstantPayVa
     return true;
 }
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fDryRun)
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fDryRun)
 {
+    const CTransaction& tx = *ptx;
     std::vector<COutPoint> coins_to_uncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, fRejectAbsurdFee, coins_to_uncache, fDryRun);
+    // txid, the duration is the time until mempool:accept on the same thread
+    TRACE1(mempool, accept_start, tx.GetHash().begin());
+    bool res = AcceptToMemoryPoolWorker(pool, state, ptx, fLimitFree, pfMissingInputs, nAcceptTime, fOverrideMempoolLimit, fRejectAbsurdFee, coins_to_uncache, fDryRun);
+    // txid, accepted, only checked, reject code
+    TRACE4(mempool, accept, tx.GetHash().begin(), res, fDryRun, state.GetRejectCode());
     if (!res || fDryRun) {
         if(!res) LogPrint("mempool", "%s: %s %s\n", __func__, tx.GetHash().ToString(), state.GetRejectReason());
         BOOST_FOREACH(const COutPoint& hashTx, coins_to_uncache)
@@ -1262,6 +1608,18 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return res;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fDryRun)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, ptx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, fRejectAbsurdFee, fDryRun);
+}
+
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fDryRun)
+{
+    return AcceptToMemoryPool(pool, state, MakeTransactionRef(tx), fLimitFree, pfMissingInputs, fOverrideMempoolLimit, fRejectAbsurdFee, fDryRun);
+}
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1277,6 +1635,9 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::P
     if (fTxIndex) {
         CDiskTxPos postx;
         if (pblocktree->ReadTxIndex(hash, postx)) {
+            // Pruning doesn't delete the transactions ConnectBlock kept
+            if (fPruneMode && pblocktree->ReadKeptTx(hash, txOut, hashBlock))
+                return true;
             CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
             if (file.IsNull())
                 return error("%s: OpenBlockFile failed", __func__);
@@ -1303,9 +1664,9 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::P
     if (pindexSlow) {
         CBlock block;
         if (ReadBlockFromDisk(block, pindexSlow, consensusParams)) {
-            BOOST_FOREACH(const CTransaction &tx, block.vtx) {
-                if (tx.GetHash() == hash) {
-                    txOut = tx;
+            for (const CTransactionRef& tx : block.vtx) {
+                if (tx->GetHash() == hash) {
+                    txOut = *tx;
                     hashBlock = pindexSlow->GetBlockHash();
                     return true;
                 }
@@ -1316,6 +1677,26 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::P
     return false;
 }
 
+bool IsTransactionPruned(const uint256 &hash)
+{
+    LOCK(cs_main);
+
+    if (!fHavePruned || !fTxIndex)
+        return false;
+
+    CDiskTxPos postx;
+    if (!pblocktree->ReadTxIndex(hash, postx))
+        return false;
+
+    // The info of a pruned file gets nulled, and its number isn't used again
+    if (postx.nFile < 0 || (size_t)postx.nFile >= vinfoBlockFile.size() || vinfoBlockFile[postx.nFile].nBlocks > 0)
+        return false;
+
+    CTransaction tx;
+    uint256 hashBlock;
+    return !pblocktree->ReadKeptTx(hash, tx, hashBlock);
+}
+
 
 
 
@@ -1358,7 +1739,7 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
-bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+static bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPoW)
 {
     block.SetNull();
 
@@ -1376,20 +1757,59 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     }
 
     // Check the header
-    int nHeight = getNHeight(block);
-    if (!CheckProofOfWork(nHeight, block.GetHash(), block.nBits, consensusParams))
-        return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
+    if (fCheckPoW) {
+        int nHeight = getNHeight(block);
+        if (!CheckProofOfWork(nHeight, block.GetHash(), block.nBits, consensusParams))
+            return error("ReadBlockFromDisk: Errors in block header at %s", pos.ToString());
+    }
 
     return true;
 }
 
+bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
+{
+    return ReadBlockFromDisk(block, pos, consensusParams, true);
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams))
+    // The header of an indexed block passed the proof of work check when it got accepted,
+    // the data on disk only has to match its hash.
+    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams, false))
         return false;
-    if (block.GetHash() != pindex->GetBlockHash())
+    uint256 hash = block.GetHash();
+    if (hash != pindex->GetBlockHash())
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
                 pindex->ToString(), pindex->GetBlockPos().ToString());
+    block.SetHash(hash);
+    return true;
+}
+
+bool GetBlockDiskRange(const CBlockIndex* pindex, CDiskBlockPos& pos, unsigned int& nSize, const CMessageHeader::MessageStartChars& messageStart)
+{
+    pos = pindex->GetBlockPos();
+    if (pos.IsNull() || pos.nPos < sizeof(messageStart) + sizeof(nSize))
+        return false;
+
+    // The index header written by WriteBlockToDisk, then the block
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(messageStart) - sizeof(nSize)), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    CMessageHeader::MessageStartChars fileStart;
+    try {
+        filein >> FLATDATA(fileStart) >> nSize;
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    if (memcmp(fileStart, messageStart, sizeof(fileStart)) || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+        return error("%s: Invalid index header at %s", __func__, pos.ToString());
+
+    // A block cut off at the end of the file would get sent short
+    if (fseek(filein.Get(), 0, SEEK_END) || ftell(filein.Get()) < (long)pos.nPos + (long)nSize)
+        return error("%s: Block at %s exceeds the file", __func__, pos.ToString());
+
     return true;
 }
 
@@ -1589,6 +2009,11 @@ bool CScriptCheck::operator()() {
     return true;
 }
 
+bool CBlockTxCheck::operator()() {
+    CValidationState state;
+    return CheckTransaction(*ptx, state, ptx->GetHash(), isVerifyDB, nHeight);
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -1738,6 +2163,8 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+} // anon namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -1765,6 +2192,8 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1783,6 +2212,70 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
     return state.Error(strMessage);
 }
 
+/**
+ * The last nUndoCacheBlocks blocks ConnectBlock connected, with their undo
+ * data. Disconnecting one of them, like in the reorgs of one or two blocks
+ * the smartnode payment races cause, reads neither the block nor its undo
+ * data from disk. The transactions are shared with the block the cache got,
+ * so an entry costs the undo data and little more.
+ *
+ * All access happens with cs_main held.
+ */
+class CRecentBlockUndos
+{
+    struct CEntry
+    {
+        std::shared_ptr<const CBlock> pblock;
+        CBlockUndo blockundo;
+    };
+
+    std::map<const CBlockIndex*, CEntry> mapEntries;
+    //! The keys of mapEntries, in the order the blocks were connected
+    std::deque<const CBlockIndex*> queueConnected;
+
+public:
+    void Add(const CBlockIndex* pindex, const CBlock& block, CBlockUndo&& blockundo)
+    {
+        AssertLockHeld(cs_main);
+        if (nUndoCacheBlocks == 0)
+            return;
+
+        CEntry& entry = mapEntries[pindex];
+        if (!entry.pblock)
+            queueConnected.push_back(pindex);
+        entry.pblock = std::make_shared<const CBlock>(block);
+        entry.blockundo = std::move(blockundo);
+
+        while (queueConnected.size() > nUndoCacheBlocks) {
+            mapEntries.erase(queueConnected.front());
+            queueConnected.pop_front();
+        }
+    }
+
+    /** Move the block of pindex and its undo data out of the cache, false if they aren't in it */
+    bool Take(const CBlockIndex* pindex, std::shared_ptr<const CBlock>& pblock, CBlockUndo& blockundo)
+    {
+        AssertLockHeld(cs_main);
+        auto it = mapEntries.find(pindex);
+        if (it == mapEntries.end())
+            return false;
+
+        pblock = std::move(it->second.pblock);
+        blockundo = std::move(it->second.blockundo);
+        mapEntries.erase(it);
+        queueConnected.erase(std::find(queueConnected.begin(), queueConnected.end(), pindex));
+        return true;
+    }
+
+    void Clear()
+    {
+        mapEntries.clear();
+        queueConnected.clear();
+    }
+};
+
+CRecentBlockUndos recentBlockUndos;
+
 } // anon namespace
 
 enum DisconnectResult
@@ -1823,24 +2316,28 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 }
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
+ *  The undo data is read from disk unless pblockUndoIn passes it in, it gets used up then.
  *  When UNCLEAN or FAILED is returned, view is left in an indeterminate state. */
-static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool fIsVerifyDB = false)
+static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& view, bool fIsVerifyDB = false, CBlockUndo* pblockUndoIn = NULL)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
 
     CChainParams params = Params();
     bool fClean = true;
 
-    CBlockUndo blockUndo;
-    CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull()) {
-        error("DisconnectBlock(): no undo data available");
-        return DISCONNECT_FAILED;
-    }
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash())) {
-        error("DisconnectBlock(): failure reading undo data");
-        return DISCONNECT_FAILED;
+    CBlockUndo blockUndoRead;
+    if (!pblockUndoIn) {
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull()) {
+            error("DisconnectBlock(): no undo data available");
+            return DISCONNECT_FAILED;
+        }
+        if (!UndoReadFromDisk(blockUndoRead, pos, pindex->pprev->GetBlockHash())) {
+            error("DisconnectBlock(): failure reading undo data");
+            return DISCONNECT_FAILED;
+        }
     }
+    CBlockUndo& blockUndo = pblockUndoIn ? *pblockUndoIn : blockUndoRead;
 
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
         error("DisconnectBlock(): block and undo data inconsistent");
@@ -1851,6 +2348,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     std::vector<std::pair<CDepositIndexKey, CDepositValue> > depositIndex;
+    std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > payoutIndex;
     /* WIP-VOTING uncomment
     std::map<CVoteKey, CSmartAddress> mapVoteKeys;
     std::vector<CVoteKeyRegistrationKey> vecInvalidVoteKeyRegistrations;
@@ -1859,9 +2357,12 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
     // Result of the smartrewards block processing.
     CSmartRewardsUpdateResult smartRewardsResult(pindex);
 
+    // Put back the rewards entries from the block's journal if there is one.
+    bool fRewardsUndone = !fIsVerifyDB && prewards->UndoBlock(pindex, block, smartRewardsResult);
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
-        const CTransaction &tx = block.vtx[i];
+        const CTransaction &tx = *block.vtx[i];
         uint256 hash = tx.GetHash();
         bool is_coinbase = tx.IsCoinBase();
         std::map<std::pair<uint160, int>, CAmount> vecInputs;
@@ -2087,7 +2588,7 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
             // At this point, all of txundo.vprevout should have been moved out.
         }
 
-        if( !fIsVerifyDB ){
+        if( !fIsVerifyDB && !fRewardsUndone ){
             prewards->UndoTransaction((CBlockIndex*) pindex, tx, view, params, smartRewardsResult);
         }
     }
@@ -2096,25 +2597,38 @@ static DisconnectResult DisconnectBlock(const CBlock& block, CValidationState& s
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
-    if (!fIsVerifyDB && fDepositIndex) {
+    if (!fIsVerifyDB && fPayoutIndex)
+        GetPayoutIndexEntries(*block.vtx[0], pindex->nHeight, payoutIndex);
 
-        if( !pblocktree->EraseDepositIndex(depositIndex) ){
-            AbortNode(state, "Failed to write deposit index");
-            return DISCONNECT_FAILED;
-        }
-    }
+    if (!fIsVerifyDB && (fDepositIndex || fAddressIndex || fPayoutIndex)) {
+        // All index changes of the block go in one write
+        CDBBatch indexBatch(pblocktree->IndexDB());
 
-    if (!fIsVerifyDB && fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            AbortNode(state, "Failed to delete address index");
-            return DISCONNECT_FAILED;
+        if (fDepositIndex)
+            pblocktree->EraseDepositIndex(indexBatch, depositIndex);
+
+        if (fPayoutIndex)
+            pblocktree->ErasePayoutIndex(indexBatch, payoutIndex);
+
+        if (fAddressIndex) {
+            pblocktree->EraseAddressIndex(indexBatch, addressIndex);
+            pblocktree->UpdateAddressUnspentIndex(indexBatch, addressUnspentIndex);
+
+            if (fBalanceIndex && !pblocktree->UpdateAddressBalanceIndex(indexBatch, addressIndex, pindex->GetBlockHash(), pindex->pprev->GetBlockHash(), true)) {
+                AbortNode(state, "Failed to write address balance index");
+                return DISCONNECT_FAILED;
+            }
         }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            AbortNode(state, "Failed to write address unspent index");
+
+        if (!pblocktree->IndexDB().WriteBatch(indexBatch)) {
+            AbortNode(state, "Failed to write block indexes");
             return DISCONNECT_FAILED;
         }
     }
 
+    if (!fIsVerifyDB && fAddressIndex)
+        GetMainSignals().AddressIndexUpdated(pindex, addressIndex, false);
+
     if( !fIsVerifyDB && !prewards->CommitUndoBlock( (CBlockIndex*) pindex, smartRewardsResult) ){
         AbortNode(state, "Failed to commit smartrewards block undo");
         return DISCONNECT_FAILED;
@@ -2167,6 +2681,13 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CBlockTxCheck> blockcheckqueue(128);
+
+void ThreadBlockCheck() {
+    RenameThread("smartcash-blockch");
+    blockcheckqueue.Thread();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2237,8 +2758,58 @@ static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
+static int64_t nTimePayments = 0;
 static int64_t nTimeTotal = 0;
 
+// Journal record of the block ConnectTip connects, ConnectBlock fills in the times of its phases
+static CBlockJournalRecord journalRecord;
+
+//! Entries of a per block vector of ConnectBlock kept allocated for the next block
+static const size_t CONNECT_SCRATCH_MAX_ENTRIES = 1 << 16;
+
+/**
+ * The per block vectors of ConnectBlock, kept from one block to the next so
+ * they only get allocated while the blocks grow instead of once per block and
+ * transaction. Cleared when a block starts, released after one which needed
+ * more than CONNECT_SCRATCH_MAX_ENTRIES of them so a single large block
+ * doesn't keep its memory.
+ */
+struct CConnectBlockScratch
+{
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+    std::vector<std::pair<CDepositIndexKey, CDepositValue> > depositIndex;
+    std::vector<int> prevheights;
+    std::vector<Coin> prevouts;
+    std::vector<CScriptCheck> vChecks;
+
+    template <typename T>
+    static void Reset(std::vector<T>& vec)
+    {
+        if (vec.capacity() > CONNECT_SCRATCH_MAX_ENTRIES)
+            std::vector<T>().swap(vec);
+        else
+            vec.clear();
+    }
+
+    void Reset()
+    {
+        Reset(vPos);
+        Reset(addressIndex);
+        Reset(addressUnspentIndex);
+        Reset(spentIndex);
+        Reset(depositIndex);
+        Reset(prevheights);
+        Reset(prevouts);
+        Reset(vChecks);
+    }
+};
+
+// Protected by cs_main
+static CConnectBlockScratch connectScratch;
+
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
@@ -2248,6 +2819,8 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     AssertLockHeld(cs_main);
 
     int64_t nTimeStart = GetTimeMicros();
+    // block hash, height, only checked
+    TRACE3(validation, block_connect_start, pindex->phashBlock->begin(), pindex->nHeight, fJustCheck);
 
     // Check it again in case a previous version let a bad block in
     if (!CheckBlock(block, state, !fJustCheck, !fJustCheck))
@@ -2262,6 +2835,13 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     if (block.GetHash() == chainparams.GetConsensus().hashGenesisBlock) {
         if (!fJustCheck)
             view.SetBestBlock(pindex->GetBlockHash());
+        // The filter header chain starts with its coinbase output
+        if (!fJustCheck && !fIsVerifyDB && fBlockFilterIndex) {
+            CDBBatch indexBatch(pblocktree->IndexDB());
+            WriteBlockFilterIndex(indexBatch, pindex, block, CBlockUndo());
+            if (!pblocktree->IndexDB().WriteBatch(indexBatch))
+                return AbortNode(state, "Failed to write the block filter index");
+        }
         return true;
     }
 
@@ -2321,9 +2901,9 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     fEnforceBIP30 = fEnforceBIP30 && (!pindexBIP34height || !(pindexBIP34height->GetBlockHash() == chainparams.GetConsensus().BIP34Hash));
 
     if (fEnforceBIP30) {
-        BOOST_FOREACH(const CTransaction& tx, block.vtx) {
-            for (size_t o = 0; o < tx.vout.size(); o++) {
-                if (view.HaveCoin(COutPoint(tx.GetHash(), o))) {
+        for (const CTransactionRef& tx : block.vtx) {
+            for (size_t o = 0; o < tx->vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx->GetHash(), o))) {
                     return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
                                      REJECT_INVALID, "bad-txns-BIP30");
                 }
@@ -2363,19 +2943,22 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
-    std::vector<int> prevheights;
-    std::vector<Coin> prevouts;
+    // Left over from the last block, the checks of the control are swapped out of vChecks
+    connectScratch.Reset();
+    std::vector<int>& prevheights = connectScratch.prevheights;
+    std::vector<Coin>& prevouts = connectScratch.prevouts;
+    std::vector<CScriptCheck>& vChecks = connectScratch.vChecks;
     CAmount nFees = 0;
     int nInputs = 0;
     unsigned int nSigOps = 0;
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+    std::vector<std::pair<uint256, CDiskTxPos> >& vPos = connectScratch.vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
-    std::vector<std::pair<CDepositIndexKey, CDepositValue> > depositIndex;
+    std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex = connectScratch.addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& addressUnspentIndex = connectScratch.addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& spentIndex = connectScratch.spentIndex;
+    std::vector<std::pair<CDepositIndexKey, CDepositValue> >& depositIndex = connectScratch.depositIndex;
     /* WIP-VOTING uncomment
     std::vector<std::pair<CVoteKeyRegistrationKey, VoteKeyParseResult>> vecInvalidVoteKeyRegistrations;
     std::map<CVoteKey, CVoteKeyValue> mapVoteKeys;
@@ -2383,12 +2966,23 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     // Result of the smartrewards block processing.
     CSmartRewardsUpdateResult smartRewardsResult(pindex);
+    // Blocks keep the previous state of their entries for a cheap disconnect. Only the journals of the
+    // most recent ones are kept, whether the headers are in sync or not.
+    smartRewardsResult.fUndoJournal = true;
+
+    // The addresses of all scripts the block creates or spends, for the rewards and the indexes
+    CDecodedBlockScripts scripts;
+    scripts.Decode(block, view);
+
+    if (!fIsVerifyDB) {
+        prewards->PrefetchRewardEntries(pindex, block, scripts);
+    }
 
     //bool fDIP0001Active_context = (VersionBitsState(pindex->pprev, chainparams.GetConsensus(), Consensus::DEPLOYMENT_DIP0001, versionbitscache) == THRESHOLD_ACTIVE);
 
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
-        const CTransaction &tx = block.vtx[i];
+        const CTransaction &tx = *block.vtx[i];
         const uint256 txhash = tx.GetHash();
         std::map<std::pair<uint160, int>, CAmount> vecInputs;
         std::map<std::pair<uint160, int>, CAmount> vecOutputs;
@@ -2430,40 +3024,16 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                 const Coin& coin = prevouts[j];
                 const CTxOut &prevout = coin.out;
 
+                const CDecodedScript& script = scripts.Input(i, j);
+
                 if( fProcessRewards && !input.scriptSig.IsZerocoinSpend() ){
-                    prewards->ProcessInput(tx, prevout, coin.nHeight, nCurrentRewardsRound, smartRewardsResult);
+                    prewards->ProcessInput(tx, prevout, script, coin.nHeight, nCurrentRewardsRound, smartRewardsResult);
                 }
 
                 if (fAddressIndex || fSpentIndex || fDepositIndex)
                 {
-                    uint160 hashBytes;
-                    int addressType;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        hashBytes = uint160(vector <unsigned char>(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22));
-                        addressType = 2;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-                        hashBytes = uint160(vector <unsigned char>(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23));
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKey()) {
-                        vector<unsigned char> pubKeyBytes(prevout.scriptPubKey.begin()+1, prevout.scriptPubKey.begin()+34);
-                        CPubKey pubKey(pubKeyBytes);
-                        hashBytes = pubKey.GetID();
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToScriptHashLocked()) {
-                        int nOffset = prevout.scriptPubKey[0] + 5;
-
-                        hashBytes = uint160(vector<unsigned char>(prevout.scriptPubKey.begin() + nOffset, prevout.scriptPubKey.begin() + nOffset + 20));
-                        addressType = 2;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHashLocked()) {
-                        int nOffset = prevout.scriptPubKey[0] + 6;
-
-                        hashBytes = uint160(vector<unsigned char>(prevout.scriptPubKey.begin() + nOffset, prevout.scriptPubKey.begin() + nOffset + 20));
-                        addressType = 1;
-                    } else {
-                        hashBytes.SetNull();
-                        addressType = 0;
-                    }
+                    const uint160& hashBytes = script.hashBytes;
+                    int addressType = script.addressType;
 
                     if (fDepositIndex && addressType) {
 
@@ -2509,7 +3079,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
             nFees += view.GetValueIn(tx)-tx.GetValueOut();
 
-            std::vector<CScriptCheck> vChecks;
+            vChecks.clear();
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, nScriptCheckThreads ? &vChecks : NULL))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
@@ -2521,39 +3091,19 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
             const CTxOut &out = tx.vout[k];
 
+            const CDecodedScript& script = scripts.Output(i, k);
+
             if( fProcessRewards && !out.scriptPubKey.IsZerocoinMint() ){
-                prewards->ProcessOutput(tx, out, nCurrentRewardsRound, pindex->nHeight, pindex->nTime, smartRewardsResult);
+                prewards->ProcessOutput(tx, out, script, nCurrentRewardsRound, pindex->nHeight, pindex->nTime, smartRewardsResult);
             }
 
             if (fAddressIndex || fDepositIndex) {
 
-                uint160 hashBytes;
-                int addressType;
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    hashBytes = uint160(vector <unsigned char>(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22));
-                    addressType = 2;
-                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-                    hashBytes = uint160(vector <unsigned char>(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23));
-                    addressType = 1;
-                } else if (out.scriptPubKey.IsPayToPublicKey()) {
-                    vector<unsigned char> pubKeyBytes(out.scriptPubKey.begin()+1, out.scriptPubKey.begin()+34);
-                    CPubKey pubKey(pubKeyBytes);
-                    hashBytes = pubKey.GetID();
-                    addressType = 1;
-                } else if (out.scriptPubKey.IsPayToScriptHashLocked()) {
-                    int nOffset = out.scriptPubKey[0] + 5;
-
-                    hashBytes = uint160(vector<unsigned char>(out.scriptPubKey.begin() + nOffset, out.scriptPubKey.begin() + nOffset + 20));
-                    addressType = 2;
-                } else if (out.scriptPubKey.IsPayToPublicKeyHashLocked()) {
-                    int nOffset = out.scriptPubKey[0] + 6;
+                const uint160& hashBytes = script.hashBytes;
+                int addressType = script.addressType;
 
-                    hashBytes = uint160(vector<unsigned char>(out.scriptPubKey.begin() + nOffset, out.scriptPubKey.begin() + nOffset + 20));
-                    addressType = 1;
-                } else {
+                if (addressType == 0)
                     continue;
-                }
 
                 if ( fDepositIndex ) {
 
@@ -2673,10 +3223,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     // to recognize that block is actually invalid.
     // TODO: resync data (both ways?) and try to reprocess this block later.
 
-    if( !SmartMining::Validate(block, pindex, state, nFees) ){
+    SmartMining::Payouts payouts;
+
+    int64_t nTimePaymentsStart = GetTimeMicros();
+    if( !SmartMining::Validate(block, pindex, state, nFees, &payouts) ){
         mapRejectedBlocks.insert(make_pair(block.GetHash(), GetTime()));
         return false;
     }
+    int64_t nTimePaymentsBlock = GetTimeMicros() - nTimePaymentsStart; nTimePayments += nTimePaymentsBlock;
+    LogPrint("bench", "      - Validate payments: %.2fms [%.2fs]\n", 0.001 * nTimePaymentsBlock, nTimePayments * 0.000001);
 
     // END SMARTCASH
 
@@ -2688,9 +3243,23 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     if (fJustCheck)
         return true;
 
+    int64_t nTimeRewardsCommit = GetTimeMicros();
     if( !fIsVerifyDB && smartRewardsResult.IsValid() ){
         prewards->CommitBlock(pindex, smartRewardsResult);
     }
+    nTimeRewardsCommit = GetTimeMicros() - nTimeRewardsCommit;
+
+    CBlockSummary summary;
+    if (!fIsVerifyDB) {
+        summary = CBlockSummary(block, pindex->nHeight);
+        summary.nFees = nFees;
+        summary.nMiningReward = payouts.mining;
+        summary.nHiveReward = payouts.hive;
+        summary.nSmartnodeReward = payouts.smartnode;
+        summary.nSmartRewardsReward = payouts.smartrewards;
+        summary.fHavePayouts = true;
+        blockSummaries.Add(summary);
+    }
 
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS))
@@ -2711,40 +3280,59 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (!fIsVerifyDB && fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
+    if (!fIsVerifyDB && (fTxIndex || fAddressIndex || fSpentIndex || fTimestampIndex || fDepositIndex || fPayoutIndex || fBlockFilterIndex || fPruneMode)) {
+        // All index changes of the block go in one write
+        CDBBatch indexBatch(pblocktree->IndexDB());
 
-    if (!fIsVerifyDB && fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
+        if (fTxIndex)
+            pblocktree->WriteTxIndex(indexBatch, vPos);
+
+        if (fAddressIndex) {
+            pblocktree->WriteAddressIndex(indexBatch, addressIndex);
+            pblocktree->UpdateAddressUnspentIndex(indexBatch, addressUnspentIndex);
 
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
+            if (fBalanceIndex && !pblocktree->UpdateAddressBalanceIndex(indexBatch, addressIndex, pindex->GetBlockHash(), pindex->pprev ? pindex->pprev->GetBlockHash() : uint256(), false))
+                return AbortNode(state, "Failed to write address balance index");
         }
-    }
 
-    if (!fIsVerifyDB && fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write spent index");
+        if (fSpentIndex)
+            pblocktree->UpdateSpentIndex(indexBatch, spentIndex);
 
-    if (!fIsVerifyDB && fTimestampIndex)
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
+        if (fTimestampIndex)
+            pblocktree->WriteTimestampIndex(indexBatch, CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()));
+
+        if (fDepositIndex)
+            pblocktree->WriteDepositIndex(indexBatch, depositIndex);
+
+        if (fPayoutIndex) {
+            std::vector<std::pair<CPayoutIndexKey, CPayoutValue> > payoutIndex;
+            GetPayoutIndexEntries(*block.vtx[0], pindex->nHeight, payoutIndex);
+            pblocktree->WritePayoutIndex(indexBatch, payoutIndex);
+        }
 
-    if (!fIsVerifyDB && fDepositIndex) {
+        if (fBlockFilterIndex)
+            WriteBlockFilterIndex(indexBatch, pindex, block, blockundo);
 
-        if( !pblocktree->WriteDepositIndex(depositIndex) ){
-            return AbortNode(state, "Failed to write deposit index");
+        // The block goes away with its file, the SAPI answers from the summary then
+        // and the proposals read their fee transactions from the kept ones
+        if (fPruneMode) {
+            pblocktree->WriteBlockSummary(indexBatch, summary);
+            for (const CTransactionRef& tx : block.vtx) {
+                if (CProposal::IsFeeTxCandidate(*tx))
+                    pblocktree->WriteKeptTx(indexBatch, *tx, pindex->GetBlockHash());
+            }
         }
+
+        if (!pblocktree->IndexDB().WriteBatch(indexBatch))
+            return AbortNode(state, "Failed to write block indexes");
     }
 
-    /* WIP-VOTING uncomment
-    if ( vecInvalidVoteKeyRegistrations.size() && !pblocktree->WriteInvalidVoteKeyRegistrations(vecInvalidVoteKeyRegistrations) )
-        return AbortNode(state, "Failed to write invalid VoteKey registrations");
+    if (!fIsVerifyDB && fAddressIndex)
+        GetMainSignals().AddressIndexUpdated(pindex, addressIndex, true);
 
-    if( mapVoteKeys.size() && !pblocktree->WriteVoteKeys(mapVoteKeys) )
+    /* WIP-VOTING uncomment
+    if( ( mapVoteKeys.size() || vecInvalidVoteKeyRegistrations.size() ) &&
+        !pblocktree->WriteVoteKeyRegistrations(mapVoteKeys, vecInvalidVoteKeyRegistrations) )
         return AbortNode(state, "Failed to write VoteKeys");
     */
 
@@ -2757,11 +3345,33 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
     GetMainSignals().UpdatedTransaction(hashPrevBestCoinBase);
-    hashPrevBestCoinBase = block.vtx[0].GetHash();
+    hashPrevBestCoinBase = block.vtx[0]->GetHash();
 
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
     LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime6 - nTime5), nTimeCallbacks * 0.000001);
 
+    // Without the one of the coinbase
+    journalRecord.nInputs = nInputs - 1;
+    journalRecord.nTimeCheck = nTime1 - nTimeStart;
+    journalRecord.nTimeForks = nTime2 - nTime1;
+    journalRecord.nTimeInputs = nTime3 - nTime2;
+    journalRecord.nTimeVerify = nTime4 - nTime2;
+    journalRecord.nTimePayments = nTimePaymentsBlock;
+    journalRecord.nTimeIndex = nTime5 - nTime4 - nTimeRewardsCommit;
+    // The rewards statistics include the prefetch and the processing of the transactions
+    CSmartRewardsBlockTiming rewardsTiming;
+    if (!fIsVerifyDB && prewards->GetStats().GetLastBlock(rewardsTiming) && rewardsTiming.nHeight == pindex->nHeight) {
+        journalRecord.nTimeRewards = rewardsTiming.nTotal / 1000;
+    } else {
+        journalRecord.nTimeRewards = nTimeRewardsCommit;
+    }
+
+    // block hash, height, transactions, inputs, sigops, duration in microseconds
+    TRACE6(validation, block_connected, pindex->phashBlock->begin(), pindex->nHeight, block.vtx.size(), nInputs, nSigOps, nTime6 - nTimeStart);
+
+    if (!fIsVerifyDB)
+        recentBlockUndos.Add(pindex, block, std::move(blockundo));
+
     return true;
 }
 
@@ -2777,6 +3387,7 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
+    static CFlushSchedule flushSchedule;
     std::set<int> setFilesToPrune;
     bool fFlushForPrune = false;
     try {
@@ -2803,18 +3414,23 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         nLastSetChain = nNow;
     }
     size_t cacheSize = pcoinsTip->DynamicMemoryUsage();
-    // The cache is large and close to the limit, but we have time now (not in the middle of a block processing).
-    bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize * (10.0/9) > nCoinCacheUsage;
+    // The coins and the rewards cache get written together, the fuller one decides.
+    double nPressure = CFlushSchedule::Pressure(cacheSize, nCoinCacheUsage, prewards->GetCachePressure());
+    flushSchedule.SetBudget(nDBFlushBudget);
+    // A cache is large and close to the limit, but we have time now (not in the middle of a block processing)
+    // and the last flush was long enough ago.
+    bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && flushSchedule.IsEarlyFlushDue(nPressure, nNow);
     // The cache is over the limit, we have to write now.
     bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nCoinCacheUsage;
     // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
     bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
     // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
     bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
-    // The cache is over the limit, we have to write now.
+    // The rewards cache is over the limit or has a round to write, we have to write now.
     bool fRewardsNeedsSync = prewards->NeedsCacheWrite();
     // Combine all conditions that result in a full cache flush.
     bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune || fRewardsNeedsSync;
+    int64_t nTimeFlushStart = 0;
     // Write blocks and block index to disk.
     if (fDoFullFlush || fPeriodicWrite) {
         // Depend on nMinDiskSpace to ensure we can write block index
@@ -2822,6 +3438,12 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             return state.Error("out of disk space");
         // First make sure all block and undo data is flushed to disk.
         FlushBlockFile();
+        nTimeFlushStart = GetTimeMicros();
+        // Hand the rewards cache over to its writer before anything else, it keeps writing
+        // to its own database while the block index and the chainstate get written.
+        if (fDoFullFlush && !prewards->SyncCached(true)) {
+            return AbortNode(state, "Failed to write to rewards database");
+        }
         // Then update all block file information (which may refer to block and undo files).
         {
             std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -2839,9 +3461,6 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
             if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                 return AbortNode(state, "Files to write to block index database");
             }
-            if (!prewards->SyncCached()) {
-                return AbortNode(state, "Files to write to block index database");
-            }
         }
         // Finally remove any pruned files
         if (fFlushForPrune)
@@ -2855,11 +3474,22 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
         // overwrite one. Still, use a conservative safety factor of 2.
-        if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
+        size_t nCoins = pcoinsTip->GetCacheSize();
+        if (!CheckDiskSpace(128 * 2 * 2 * nCoins))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
+        int64_t nTimeCoinsStart = GetTimeMicros();
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
+        int64_t nTimeFlushed = GetTimeMicros() - nTimeCoinsStart;
+        LogPrint("bench", "- Flush %u coins (%.2fMB): %.2fms\n", nCoins, cacheSize * 0.000001, nTimeFlushed * 0.001);
+        // duration in microseconds, mode, coins, coins cache usage, flushed for pruning
+        TRACE5(utxocache, flush, nTimeFlushed, (int)mode, nCoins, cacheSize, fFlushForPrune);
+        // Only a forced flush has to wait for the rewards database, all others leave it
+        // to the writer while the block processing continues.
+        if (mode == FLUSH_STATE_ALWAYS && !prewards->FinishFlush())
+            return AbortNode(state, "Failed to write to rewards database");
+        flushSchedule.Flushed(nTimeFlushStart, GetTimeMicros());
         nLastFlush = nNow;
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
@@ -2948,63 +3578,256 @@ void static UpdateTip(CBlockIndex *pindexNew) {
             }
         }
     }
-}
+}
+
+static int64_t nTimeDisconnect = 0;
+static int64_t nBlocksDisconnected = 0;
+
+/** Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and manually re-limit mempool size after this, with cs_main held. */
+bool static DisconnectTip(CValidationState& state, const Consensus::Params& consensusParams)
+{
+    CBlockIndex *pindexDelete = chainActive.Tip();
+    assert(pindexDelete);
+    // Read block from disk, unless it was connected recently.
+    std::shared_ptr<const CBlock> pblockCached;
+    CBlockUndo blockUndo;
+    bool fCached = recentBlockUndos.Take(pindexDelete, pblockCached, blockUndo);
+    CBlock blockRead;
+    if (!fCached && !ReadBlockFromDisk(blockRead, pindexDelete, consensusParams))
+        return AbortNode(state, "Failed to read block");
+    const CBlock& block = fCached ? *pblockCached : blockRead;
+    // Apply the block atomically to the chain state.
+    int64_t nStart = GetTimeMicros();
+    {
+        CCoinsViewCache view(pcoinsTip);
+        if (DisconnectBlock(block, state, pindexDelete, view, false, fCached ? &blockUndo : NULL) != DISCONNECT_OK)
+            return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
+        assert(view.Flush());
+    }
+    int64_t nTimeDisconnected = GetTimeMicros() - nStart; nTimeDisconnect += nTimeDisconnected; nBlocksDisconnected++;
+    LogPrint("bench", "- Disconnect block%s: %.2fms [%.2fs]\n", fCached ? " (undo cached)" : "", nTimeDisconnected * 0.001, nTimeDisconnect * 0.000001);
+
+    // Write the chain state to disk, if necessary.
+    if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
+        return false;
+    // Resurrect mempool transactions from the disconnected block.
+    std::vector<uint256> vHashUpdate;
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
+        // ignore validation errors in resurrected transactions
+        list<CTransaction> removed;
+        CValidationState stateDummy;
+        // The mempool shares the transactions of the block instead of copying them
+        if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, ptx, false, NULL, true)) {
+            mempool.remove(tx, removed, true);
+        } else if (mempool.exists(tx.GetHash())) {
+            vHashUpdate.push_back(tx.GetHash());
+        }
+    }
+    // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
+    // no in-mempool children, which is generally not true when adding
+    // previously-confirmed transactions back to the mempool.
+    // UpdateTransactionsFromBlock finds descendants of any transactions in this
+    // block that were added back and cleans up the mempool state.
+    mempool.UpdateTransactionsFromBlock(vHashUpdate);
+    // Update chainActive and related variables.
+    UpdateTip(pindexDelete->pprev);
+    UpdateStaleBlockTimes(pindexDelete, true);
+    // Let wallets know transactions went from 1-confirmed to
+    // 0-confirmed or conflicted:
+    GetMainSignals().SyncTransactions(block.vtx, NULL);
+    return true;
+}
+
+static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
+static int64_t nTimeConnectTotal = 0;
+static int64_t nTimeFlush = 0;
+static int64_t nTimeChainState = 0;
+static int64_t nTimePostConnect = 0;
+static int64_t nBlocksConnected = 0;
+
+/**
+ * Load the coins the block spends into pcoinsTip in one go, ConnectBlock finds
+ * them in the cache then. The outputs of the block's own transactions aren't
+ * in the chainstate, they are left out.
+ */
+static void PrefetchBlockInputs(const CBlock& block)
+{
+    std::set<uint256> setBlockTxids;
+    std::vector<COutPoint> vOutpoints;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn& txin : tx->vin) {
+                if (!setBlockTxids.count(txin.prevout.hash))
+                    vOutpoints.push_back(txin.prevout);
+            }
+        }
+        setBlockTxids.insert(tx->GetHash());
+    }
+    pcoinsTip->Prefetch(vOutpoints);
+}
+
+namespace {
+
+/**
+ * Reads the next blocks ActivateBestChainStep is going to connect on a thread
+ * of its own, so the disk reads and the deserialization overlap with
+ * connecting the blocks before them. The blocks read are kept until
+ * ConnectTip takes them, up to a memory budget.
+ *
+ * The read ahead thread never takes cs_main, everything it needs of the
+ * block index is copied when the blocks get requested.
+ */
+class CBlockReadAhead
+{
+    struct CPendingBlock
+    {
+        const CBlockIndex* pindex;
+        CDiskBlockPos pos;
+        uint256 hash;
+    };
+
+    boost::mutex mutex;
+    //! Signalled when there are blocks to read or memory got freed
+    boost::condition_variable condWork;
+    //! Signalled when a block has been read
+    boost::condition_variable condRead;
+    std::deque<CPendingBlock> queuePending;
+    std::map<const CBlockIndex*, std::shared_ptr<const CBlock> > mapRead;
+    //! The block being read right now, it isn't in queuePending anymore
+    const CBlockIndex* pindexReading;
+    //! Set when pindexReading isn't wanted anymore
+    bool fDiscardReading;
+    //! No blocks get requested while this is 0, no read ahead thread runs then
+    size_t nMaxMemory;
+    size_t nMemory;
+
+    void Erase(std::map<const CBlockIndex*, std::shared_ptr<const CBlock> >::iterator it)
+    {
+        nMemory -= RecursiveDynamicUsage(*it->second);
+        mapRead.erase(it);
+    }
+
+public:
+    CBlockReadAhead() : pindexReading(NULL), fDiscardReading(false), nMaxMemory(0), nMemory(0) {}
+
+    /**
+     * Read the blocks of vpindex ahead, in place of the ones requested before.
+     * vpindex is in the order ActivateBestChainStep collects them, the block
+     * to connect last comes first. pindexSkip is already in memory.
+     */
+    void Request(const std::vector<CBlockIndex*>& vpindex, const CBlockIndex* pindexSkip)
+    {
+        AssertLockHeld(cs_main);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nMaxMemory == 0)
+            return;
+
+        std::set<const CBlockIndex*> setWanted(vpindex.begin(), vpindex.end());
+        for (auto it = mapRead.begin(); it != mapRead.end();) {
+            if (setWanted.count(it->first))
+                ++it;
+            else
+                Erase(it++);
+        }
+        fDiscardReading = pindexReading && !setWanted.count(pindexReading);
+
+        queuePending.clear();
+        BOOST_REVERSE_FOREACH(const CBlockIndex* pindex, vpindex) {
+            if (pindex == pindexSkip || pindex == pindexReading || mapRead.count(pindex) || !(pindex->nStatus & BLOCK_HAVE_DATA))
+                continue;
+            CPendingBlock pending = {pindex, pindex->GetBlockPos(), pindex->GetBlockHash()};
+            queuePending.push_back(pending);
+        }
+        if (!queuePending.empty())
+            condWork.notify_one();
+    }
+
+    /**
+     * The block of pindex if it has been read ahead, waiting for it if it is
+     * being read right now. The blocks requested before pindex are dropped.
+     */
+    std::shared_ptr<const CBlock> Take(const CBlockIndex* pindex)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (pindexReading == pindex)
+            condRead.wait(lock);
+
+        while (!queuePending.empty() && queuePending.front().pindex->nHeight <= pindex->nHeight)
+            queuePending.pop_front();
+
+        std::shared_ptr<const CBlock> pblock;
+        auto it = mapRead.find(pindex);
+        if (it != mapRead.end()) {
+            pblock = it->second;
+            Erase(it);
+            condWork.notify_one();
+        }
+        return pblock;
+    }
 
-/** Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and manually re-limit mempool size after this, with cs_main held. */
-bool static DisconnectTip(CValidationState& state, const Consensus::Params& consensusParams)
-{
-    CBlockIndex *pindexDelete = chainActive.Tip();
-    assert(pindexDelete);
-    // Read block from disk.
-    CBlock block;
-    if (!ReadBlockFromDisk(block, pindexDelete, consensusParams))
-        return AbortNode(state, "Failed to read block");
-    // Apply the block atomically to the chain state.
-    int64_t nStart = GetTimeMicros();
+    void Thread(size_t nMaxMemoryIn, const Consensus::Params& consensusParams)
     {
-        CCoinsViewCache view(pcoinsTip);
-        if (DisconnectBlock(block, state, pindexDelete, view) != DISCONNECT_OK)
-            return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
-        assert(view.Flush());
-    }
-    LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nMaxMemory = nMaxMemoryIn;
+        }
 
-    // Write the chain state to disk, if necessary.
-    if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
-        return false;
-    // Resurrect mempool transactions from the disconnected block.
-    std::vector<uint256> vHashUpdate;
-    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
-        // ignore validation errors in resurrected transactions
-        list<CTransaction> removed;
-        CValidationState stateDummy;
-        if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL, true)) {
-            mempool.remove(tx, removed, true);
-        } else if (mempool.exists(tx.GetHash())) {
-            vHashUpdate.push_back(tx.GetHash());
+        try {
+            while (true) {
+                CPendingBlock pending;
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    while (queuePending.empty() || nMemory >= nMaxMemory)
+                        condWork.wait(lock);
+                    pending = queuePending.front();
+                    queuePending.pop_front();
+                    pindexReading = pending.pindex;
+                    fDiscardReading = false;
+                }
+
+                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                bool fRead = ReadBlockFromDisk(*pblock, pending.pos, consensusParams, false);
+                if (fRead) {
+                    // ConnectTip reads the block again and reports what's wrong with it
+                    uint256 hash = pblock->GetHash();
+                    fRead = hash == pending.hash;
+                    pblock->SetHash(hash);
+                }
+
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    if (fRead && !fDiscardReading) {
+                        nMemory += RecursiveDynamicUsage(*pblock);
+                        mapRead[pending.pindex] = pblock;
+                    }
+                    pindexReading = NULL;
+                    condRead.notify_all();
+                }
+            }
+        } catch (const boost::thread_interrupted&) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nMaxMemory = 0;
+            nMemory = 0;
+            queuePending.clear();
+            mapRead.clear();
+            pindexReading = NULL;
+            condRead.notify_all();
+            throw;
         }
     }
-    // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
-    // no in-mempool children, which is generally not true when adding
-    // previously-confirmed transactions back to the mempool.
-    // UpdateTransactionsFromBlock finds descendants of any transactions in this
-    // block that were added back and cleans up the mempool state.
-    mempool.UpdateTransactionsFromBlock(vHashUpdate);
-    // Update chainActive and related variables.
-    UpdateTip(pindexDelete->pprev);
-    // Let wallets know transactions went from 1-confirmed to
-    // 0-confirmed or conflicted:
-    BOOST_FOREACH(const CTransaction &tx, block.vtx) {
-        GetMainSignals().SyncTransaction(tx, NULL);
-    }
-    return true;
+};
+
+CBlockReadAhead blockReadAhead;
+
 }
 
-static int64_t nTimeReadFromDisk = 0;
-static int64_t nTimeConnectTotal = 0;
-static int64_t nTimeFlush = 0;
-static int64_t nTimeChainState = 0;
-static int64_t nTimePostConnect = 0;
+void ThreadBlockReadAhead(size_t nMaxMemory)
+{
+    RenameThread("smartcash-readahead");
+    blockReadAhead.Thread(nMaxMemory, Params().GetConsensus());
+}
 
 /**
  * Connect a new block to chainActive. pblock is either NULL or a pointer to a CBlock
@@ -3013,20 +3836,39 @@ static int64_t nTimePostConnect = 0;
 bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const CBlock* pblock)
 {
     assert(pindexNew->pprev == chainActive.Tip());
-    // Read block from disk.
+    // Read block from disk, unless it has been read ahead.
     int64_t nTime1 = GetTimeMicros();
+    // block hash, height
+    TRACE2(validation, tip_connect_start, pindexNew->phashBlock->begin(), pindexNew->nHeight);
     CBlock block;
+    std::shared_ptr<const CBlock> pblockRead;
     if (!pblock) {
-        if (!ReadBlockFromDisk(block, pindexNew, chainparams.GetConsensus()))
-            return AbortNode(state, "Failed to read block");
-        pblock = &block;
+        pblockRead = blockReadAhead.Take(pindexNew);
+        if (pblockRead) {
+            pblock = pblockRead.get();
+        } else {
+            if (!ReadBlockFromDisk(block, pindexNew, chainparams.GetConsensus()))
+                return AbortNode(state, "Failed to read block");
+            pblock = &block;
+        }
     }
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    uint64_t nCoinsHitsStart, nCoinsMissesStart, nSigCacheHitsStart, nSigCacheMissesStart;
+    pcoinsTip->GetCacheStats(nCoinsHitsStart, nCoinsMissesStart);
+    GetSignatureCacheStats(nSigCacheHitsStart, nSigCacheMissesStart);
+    PrefetchBlockInputs(*pblock);
+    int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetch += nTimePrefetched - nTime2;
+    LogPrint("bench", "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTimePrefetched - nTime2) * 0.001, nTimePrefetch * 0.000001);
+    nTime2 = nTimePrefetched;
     {
         CCoinsViewCache view(pcoinsTip);
+        journalRecord.SetNull();
+        journalRecord.nHeight = pindexNew->nHeight;
+        journalRecord.hash = pindexNew->GetBlockHash();
+        journalRecord.nTx = pblock->vtx.size();
         bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, false);
         GetMainSignals().BlockChecked(*pblock, state);
         if (!rv) {
@@ -3036,6 +3878,12 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         }
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        pcoinsTip->GetCacheStats(journalRecord.nCoinsHits, journalRecord.nCoinsMisses);
+        journalRecord.nCoinsHits -= nCoinsHitsStart;
+        journalRecord.nCoinsMisses -= nCoinsMissesStart;
+        GetSignatureCacheStats(journalRecord.nSigCacheHits, journalRecord.nSigCacheMisses);
+        journalRecord.nSigCacheHits -= nSigCacheHitsStart;
+        journalRecord.nSigCacheMisses -= nSigCacheMissesStart;
         assert(view.Flush());
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
@@ -3050,23 +3898,57 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted, !IsInitialBlockDownload());
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    UpdateStaleBlockTimes(pindexNew, false);
     // Tell wallet about transactions that went from mempool
     // to conflicted:
     BOOST_FOREACH(const CTransaction &tx, txConflicted) {
         GetMainSignals().SyncTransaction(tx, NULL);
     }
     // ... and about transactions that got confirmed:
-    BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
-        GetMainSignals().SyncTransaction(tx, pblock);
-    }
+    GetMainSignals().SyncTransactions(pblock->vtx, pblock);
+    GetMainSignals().BlockConnected(*pblock, pindexNew);
 
-    int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
+    int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1; nBlocksConnected++;
     LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
 
+    journalRecord.nTime = GetTime();
+    journalRecord.nSize = ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
+    journalRecord.nTimeRead = nTime2 - nTime1;
+    journalRecord.nTimeFlush = nTime4 - nTime3;
+    journalRecord.nTimeChainState = nTime5 - nTime4;
+    journalRecord.nTimeTotal = nTime6 - nTime1;
+    blockJournal.Add(journalRecord);
+
+    // block hash, height, read, connect, flush, chainstate write and total duration in microseconds
+    TRACE6(validation, tip_connected, pindexNew->phashBlock->begin(), pindexNew->nHeight, nTime2 - nTime1, nTime3 - nTime2, nTime5 - nTime3, nTime6 - nTime1);
+
     return true;
 }
 
+void GetBlockConnectTimings(CBlockConnectTimings& timings)
+{
+    LOCK(cs_main);
+
+    timings.nBlocksConnected = nBlocksConnected;
+    timings.nBlocksDisconnected = nBlocksDisconnected;
+    timings.nTimeCheck = nTimeCheck;
+    timings.nTimeForks = nTimeForks;
+    timings.nTimeConnect = nTimeConnect;
+    timings.nTimeVerify = nTimeVerify;
+    timings.nTimeIndex = nTimeIndex;
+    timings.nTimeCallbacks = nTimeCallbacks;
+    timings.nTimePayments = nTimePayments;
+    timings.nTimeReadFromDisk = nTimeReadFromDisk;
+    timings.nTimePrefetch = nTimePrefetch;
+    timings.nTimeConnectTotal = nTimeConnectTotal;
+    timings.nTimeFlush = nTimeFlush;
+    timings.nTimeChainState = nTimeChainState;
+    timings.nTimePostConnect = nTimePostConnect;
+    timings.nTimeTotal = nTimeTotal;
+    timings.nTimeDisconnect = nTimeDisconnect;
+}
+
 bool GetUTXOCoin(const COutPoint& outpoint, Coin& coin)
 {
     AssertLockHeld(cs_main);
@@ -3239,6 +4121,9 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
         }
         nHeight = nTargetHeight;
 
+        if (IsInitialBlockDownload())
+            blockReadAhead.Request(vpindexToConnect, pblock ? pindexMostWork : NULL);
+
         // Connect new blocks.
         BOOST_REVERSE_FOREACH(CBlockIndex *pindexConnect, vpindexToConnect) {
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : NULL)) {
@@ -3435,30 +4320,30 @@ bool ReconsiderBlock(CValidationState &state, CBlockIndex *pindex) {
     return true;
 }
 
-CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
+static CBlockIndex* AddToBlockIndex(const CBlockHeader& block, const uint256& hash)
 {
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end())
         return it->second;
 
-    // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    // Construct new block index object, in the slot of its height
+    BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
+    CBlockIndex* pindexNew = blockIndexArena.New(miPrev != mapBlockIndex.end() ? miPrev->second->nHeight + 1 : 0);
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
     BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
-    BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
         pindexNew->pprev = (*miPrev).second;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
     }
+    pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
@@ -3469,6 +4354,11 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
     return pindexNew;
 }
 
+CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
+{
+    return AddToBlockIndex(block, block.GetHash());
+}
+
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 bool ReceivedBlockTransactions(const CBlock &block, CValidationState& state, CBlockIndex *pindexNew, const CDiskBlockPos& pos)
 {
@@ -3603,16 +4493,21 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     return true;
 }
 
-bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW)
+static bool CheckBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, bool fCheckPOW)
 {
     // Check proof of work matches claimed amount
     int nHeight = getNHeight(block);
-    if (fCheckPOW && !CheckProofOfWork(nHeight, block.GetHash(), block.nBits, Params().GetConsensus()))
+    if (fCheckPOW && !CheckProofOfWork(nHeight, hash, block.nBits, Params().GetConsensus()))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     return true;
 }
 
+bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, bool fCheckPOW)
+{
+    return CheckBlockHeader(block, fCheckPOW ? block.GetHash() : uint256(), state, fCheckPOW);
+}
+
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool isVerifyDB)
 {
      // These are checks that are independent of context.
@@ -3625,6 +4520,21 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     if (!CheckBlockHeader(block, state, fCheckPOW))
         return false;
 
+    int nHeight = getNHeight(block);
+
+    // The transactions get checked on the block check queue threads
+    // meanwhile, the result is only looked at after the checks which
+    // have to come first.
+    bool fParallelTxChecks = nScriptCheckThreads && block.vtx.size() >= MIN_PARALLEL_BLOCK_CHECK_TXS;
+    CCheckQueueControl<CBlockTxCheck> control(fParallelTxChecks ? &blockcheckqueue : NULL);
+    if (fParallelTxChecks) {
+        std::vector<CBlockTxCheck> vChecks;
+        vChecks.reserve(block.vtx.size());
+        for (const CTransactionRef& tx : block.vtx)
+            vChecks.push_back(CBlockTxCheck(*tx, nHeight, isVerifyDB));
+        control.Add(vChecks);
+    }
+
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
@@ -3651,11 +4561,11 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
                          REJECT_INVALID, "bad-blk-length");
 
     // First transaction must be coinbase, the rest must not be
-    if (block.vtx.empty() || !block.vtx[0].IsCoinBase())
+    if (block.vtx.empty() || !block.vtx[0]->IsCoinBase())
         return state.DoS(100, error("CheckBlock(): first tx is not coinbase"),
                          REJECT_INVALID, "bad-cb-missing");
     for (unsigned int i = 1; i < block.vtx.size(); i++)
-        if (block.vtx[i].IsCoinBase())
+        if (block.vtx[i]->IsCoinBase())
             return state.DoS(100, error("CheckBlock(): more than one coinbase"),
                              REJECT_INVALID, "bad-cb-multiple");
 
@@ -3666,7 +4576,8 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         // We should never accept block which conflicts with completed transaction lock,
         // that's why this is in CheckBlock unlike coinbase payee/amount.
         // Require other nodes to comply, send them some data in case they are missing it.
-        BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        for (const CTransactionRef& ptx : block.vtx) {
+            const CTransaction& tx = *ptx;
             // skip coinbase, it has no inputs
             if (tx.IsCoinBase()) continue;
             // LOOK FOR TRANSACTION LOCK IN OUR MAP OF OUTPOINTS
@@ -3689,16 +4600,19 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 
     // END SMART
 
-    // Check transactions
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state, tx.GetHash(), isVerifyDB, getNHeight(block)))
-            return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx.GetHash().ToString(), state.GetDebugMessage()));
+    // Check transactions, once more one by one if the queue found a failure
+    // to tell which transaction it was
+    if (!fParallelTxChecks || !control.Wait()) {
+        for (const CTransactionRef& tx : block.vtx)
+            if (!CheckTransaction(*tx, state, tx->GetHash(), isVerifyDB, nHeight))
+                return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
+                                     strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), state.GetDebugMessage()));
+    }
 
     unsigned int nSigOps = 0;
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    for (const CTransactionRef& tx : block.vtx)
     {
-        nSigOps += GetLegacySigOpCount(tx);
+        nSigOps += GetLegacySigOpCount(*tx);
     }
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.DoS(100, false, REJECT_INVALID, "bad-blk-sigops", false, "out-of-bounds SigOpCount");
@@ -3734,8 +4648,8 @@ bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& pa
 static int GetWitnessCommitmentIndex(const CBlock& block)
 {
     int commitpos = -1;
-    for (size_t o = 0; o < block.vtx[0].vout.size(); o++) {
-        if (block.vtx[0].vout[o].scriptPubKey.size() >= 38 && block.vtx[0].vout[o].scriptPubKey[0] == OP_RETURN && block.vtx[0].vout[o].scriptPubKey[1] == 0x24 && block.vtx[0].vout[o].scriptPubKey[2] == 0xaa && block.vtx[0].vout[o].scriptPubKey[3] == 0x21 && block.vtx[0].vout[o].scriptPubKey[4] == 0xa9 && block.vtx[0].vout[o].scriptPubKey[5] == 0xed) {
+    for (size_t o = 0; o < block.vtx[0]->vout.size(); o++) {
+        if (block.vtx[0]->vout[o].scriptPubKey.size() >= 38 && block.vtx[0]->vout[o].scriptPubKey[0] == OP_RETURN && block.vtx[0]->vout[o].scriptPubKey[1] == 0x24 && block.vtx[0]->vout[o].scriptPubKey[2] == 0xaa && block.vtx[0]->vout[o].scriptPubKey[3] == 0x21 && block.vtx[0]->vout[o].scriptPubKey[4] == 0xa9 && block.vtx[0]->vout[o].scriptPubKey[5] == 0xed) {
             commitpos = o;
         }
     }
@@ -3746,10 +4660,13 @@ void UpdateUncommittedBlockStructures(CBlock& block, const CBlockIndex* pindexPr
 {
     int commitpos = GetWitnessCommitmentIndex(block);
     static const std::vector<unsigned char> nonce(32, 0x00);
-    if (commitpos != -1 && IsWitnessEnabled(pindexPrev, consensusParams) && block.vtx[0].wit.IsEmpty()) {
-        block.vtx[0].wit.vtxinwit.resize(1);
-        block.vtx[0].wit.vtxinwit[0].scriptWitness.stack.resize(1);
-        block.vtx[0].wit.vtxinwit[0].scriptWitness.stack[0] = nonce;
+    if (commitpos != -1 && IsWitnessEnabled(pindexPrev, consensusParams) && block.vtx[0]->wit.IsEmpty()) {
+        // The coinbase may be shared, it gets replaced instead of changed
+        CMutableTransaction tx(*block.vtx[0]);
+        tx.wit.vtxinwit.resize(1);
+        tx.wit.vtxinwit[0].scriptWitness.stack.resize(1);
+        tx.wit.vtxinwit[0].scriptWitness.stack[0] = nonce;
+        block.vtx[0] = MakeTransactionRef(std::move(tx));
     }
 }
 
@@ -3773,8 +4690,9 @@ std::vector<unsigned char> GenerateCoinbaseCommitment(CBlock& block, const CBloc
             out.scriptPubKey[5] = 0xed;
             memcpy(&out.scriptPubKey[6], witnessroot.begin(), 32);
             commitment = std::vector<unsigned char>(out.scriptPubKey.begin(), out.scriptPubKey.end());
-            const_cast<std::vector<CTxOut>*>(&block.vtx[0].vout)->push_back(out);
-            block.vtx[0].UpdateHash();
+            CMutableTransaction tx(*block.vtx[0]);
+            tx.vout.push_back(out);
+            block.vtx[0] = MakeTransactionRef(std::move(tx));
         }
     }
     UpdateUncommittedBlockStructures(block, pindexPrev, consensusParams);
@@ -3821,8 +4739,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
                               : block.GetBlockTime();
 
     // Check that all transactions are finalized
-    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
-        if (!IsFinalTx(tx, nHeight, nLockTimeCutoff)) {
+    for (const CTransactionRef& tx : block.vtx) {
+        if (!IsFinalTx(*tx, nHeight, nLockTimeCutoff)) {
             return state.DoS(10, false, REJECT_INVALID, "bad-txns-nonfinal", false, "non-final transaction");
         }
     }
@@ -3858,11 +4776,11 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
             // The malleation check is ignored; as the transaction tree itself
             // already does not permit it, it is impossible to trigger in the
             // witness tree.
-            if (block.vtx[0].wit.vtxinwit.size() != 1 || block.vtx[0].wit.vtxinwit[0].scriptWitness.stack.size() != 1 || block.vtx[0].wit.vtxinwit[0].scriptWitness.stack[0].size() != 32) {
+            if (block.vtx[0]->wit.vtxinwit.size() != 1 || block.vtx[0]->wit.vtxinwit[0].scriptWitness.stack.size() != 1 || block.vtx[0]->wit.vtxinwit[0].scriptWitness.stack[0].size() != 32) {
                 return state.DoS(100, error("%s : invalid witness nonce size", __func__), REJECT_INVALID, "bad-witness-nonce-size", true);
             }
-            CHash256().Write(hashWitness.begin(), 32).Write(&block.vtx[0].wit.vtxinwit[0].scriptWitness.stack[0][0], 32).Finalize(hashWitness.begin());
-            if (memcmp(hashWitness.begin(), &block.vtx[0].vout[commitpos].scriptPubKey[6], 32)) {
+            CHash256().Write(hashWitness.begin(), 32).Write(&block.vtx[0]->wit.vtxinwit[0].scriptWitness.stack[0][0], 32).Finalize(hashWitness.begin());
+            if (memcmp(hashWitness.begin(), &block.vtx[0]->vout[commitpos].scriptPubKey[6], 32)) {
                 return state.DoS(100, error("%s : witness merkle commitment mismatch", __func__), REJECT_INVALID, "bad-witness-merkle-match", true);
             }
             fHaveWitness = true;
@@ -3872,7 +4790,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     // No witness data is allowed in blocks that don't commit to witness data, as this would otherwise leave room for spam
     if (!fHaveWitness) {
         for (size_t i = 0; i < block.vtx.size(); i++) {
-            if (!block.vtx[i].wit.IsNull()) {
+            if (!block.vtx[i]->wit.IsNull()) {
                 return state.DoS(100, error("%s : unexpected witness data found", __func__), REJECT_INVALID, "unexpected-witness", true);
             }
         }
@@ -3891,11 +4809,10 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+static bool AcceptBlockHeader(const CBlockHeader& block, const uint256& hash, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = NULL;
 
@@ -3912,7 +4829,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state))
+        if (!CheckBlockHeader(block, hash, state, true))
             return false;
 
         // Get prev block index
@@ -3932,7 +4849,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return false;
     }
     if (pindex == NULL)
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, hash);
 
     if (ppindex)
         *ppindex = pindex;
@@ -3945,12 +4862,21 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
     return true;
 }
 
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex=NULL)
+{
+    return AcceptBlockHeader(block, block.GetHash(), state, chainparams, ppindex);
+}
+
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
+    // Hash them up front, outside of cs_main
+    std::vector<uint256> vHashes;
+    GetBlockHeaderHashes(headers, vHashes);
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
-            if (!AcceptBlockHeader(header, state, chainparams, ppindex)) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            if (!AcceptBlockHeader(headers[i], vHashes[i], state, chainparams, ppindex)) {
                 return false;
             }
         }
@@ -4164,7 +5090,12 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
         return;
     }
 
-    unsigned int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP;
+    unsigned int nKeepBlocks = std::max(nPruneKeepBlocks, MIN_BLOCKS_TO_KEEP);
+    if ((unsigned int)chainActive.Tip()->nHeight <= nKeepBlocks) {
+        return;
+    }
+
+    unsigned int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - nKeepBlocks;
     uint64_t nCurrentUsage = CalculateCurrentUsage();
     // We don't check to prune until after we've allocated new space for files
     // So we should leave a buffer under our target to account for another allocation
@@ -4183,7 +5114,7 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
             if (nCurrentUsage + nBuffer < nPruneTarget)  // are we below our target?
                 break;
 
-            // don't prune files that could have a block within MIN_BLOCKS_TO_KEEP of the main chain's tip but keep scanning
+            // don't prune files that could have a block within nPruneKeepBlocks of the main chain's tip but keep scanning
             if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
                 continue;
 
@@ -4248,7 +5179,7 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
 }
 
-CBlockIndex * InsertBlockIndex(uint256 hash)
+CBlockIndex * InsertBlockIndex(const uint256& hash, int nHeight)
 {
     if (hash.IsNull())
         return NULL;
@@ -4259,9 +5190,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error(std::string(__func__) + ": new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.New(nHeight);
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -4271,7 +5200,7 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, hashAssumeValid))
         return false;
 
     boost::this_thread::interruption_point();
@@ -4289,6 +5218,7 @@ bool static LoadBlockIndexDB()
     {
         CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -4313,6 +5243,9 @@ bool static LoadBlockIndexDB()
             pindexBestHeader = pindex;
     }
 
+    LogPrintf("%s: %u block index entries, %u of them outside the slot of their height\n", __func__,
+              blockIndexArena.size(), blockIndexArena.OverflowSize());
+
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
@@ -4371,6 +5304,13 @@ bool static LoadBlockIndexDB()
     fReindex |= !fCheckIndex;
     LogPrintf("%s: addressindex index %s\n", __func__, fCheckIndex ? "enabled" : "disabled");
 
+    // The indexes have to be built again when they move between the block
+    // database and the separate index database
+    fCheckIndex = false;
+    pblocktree->ReadFlag("indexdb", fCheckIndex);
+    fReindex |= fCheckIndex != pblocktree->HasIndexDB();
+    LogPrintf("%s: index database %s\n", __func__, pblocktree->HasIndexDB() ? "separate" : "shared with the block index");
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
@@ -4498,10 +5438,9 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
-    }
+    recentBlockUndos.Clear();
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
     fHavePruned = false;
 }
 
@@ -4513,6 +5452,19 @@ bool LoadBlockIndex()
     return true;
 }
 
+/** Write the flag of an optional index, true if the blocks connected so far have to be indexed yet. */
+static bool InitOptionalIndexFlag(const std::string& strFlag, bool fEnabled)
+{
+    bool fBuilt = false;
+    pblocktree->ReadFlag(strFlag, fBuilt);
+
+    if (fEnabled && !fBuilt && !fReindex && chainActive.Genesis() != NULL)
+        return true;
+
+    pblocktree->WriteFlag(strFlag, fEnabled);
+    return false;
+}
+
 bool InitBlockIndex(const CChainParams& chainparams)
 {
     LOCK(cs_main);
@@ -4531,14 +5483,29 @@ bool InitBlockIndex(const CChainParams& chainparams)
 
     // Use the provided setting for -timestampindex in the new database
     fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
-    pblocktree->WriteFlag("timestampindex", fTimestampIndex);
-
     fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
-    pblocktree->WriteFlag("spentindex", fSpentIndex);
-
     // Use the provided setting for -addressindex in the new database
     fDepositIndex = GetBoolArg("-depositindex", DEFAULT_DEPOSITINDEX);
-    pblocktree->WriteFlag("depositindex", fDepositIndex);
+    fPayoutIndex = GetBoolArg("-payoutindex", DEFAULT_PAYOUTINDEX);
+    fBlockFilterIndex = GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
+
+    // Indexes enabled on an existing chain get built in the background,
+    // their flag stays unset until the builder reached the tip.
+    int nBuildIndexes = 0;
+    nBuildIndexes |= InitOptionalIndexFlag("timestampindex", fTimestampIndex) ? INDEX_BUILD_TIMESTAMP : 0;
+    nBuildIndexes |= InitOptionalIndexFlag("spentindex", fSpentIndex) ? INDEX_BUILD_SPENT : 0;
+    nBuildIndexes |= InitOptionalIndexFlag("depositindex", fDepositIndex) ? INDEX_BUILD_DEPOSIT : 0;
+    nBuildIndexes |= InitOptionalIndexFlag("payoutindex", fPayoutIndex) ? INDEX_BUILD_PAYOUT : 0;
+    nBuildIndexes |= InitOptionalIndexFlag("blockfilterindex", fBlockFilterIndex) ? INDEX_BUILD_BLOCKFILTER : 0;
+
+    // The builder reads every block of the chain again
+    if (nBuildIndexes && fHavePruned)
+        return error("%s: the indexes 0x%x can't be built from pruned block files, enable them with -reindex", __func__, nBuildIndexes);
+
+    if (!indexBuilder.Init(nBuildIndexes, chainActive.Height()))
+        return error("%s: failed to set up the index builder", __func__);
+
+    pblocktree->WriteFlag("indexdb", pblocktree->HasIndexDB());
 
     // Check whether we're already initialized
     if (chainActive.Genesis() != NULL)
@@ -4573,6 +5540,133 @@ bool InitBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
+bool InitBalanceIndex(bool fWipe)
+{
+    LOCK(cs_main);
+
+    bool fRequested = fAddressIndex && GetBoolArg("-balanceindex", DEFAULT_BALANCEINDEX);
+    bool fBuilt = false;
+
+    pblocktree->ReadFlag("balanceindex", fBuilt);
+
+    // Balance indexes of older versions lack the rich list
+    bool fRichList = false;
+    pblocktree->ReadFlag("balancerichlist", fRichList);
+    fBuilt &= fRichList;
+
+    const uint256 hashBest = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+
+    // The totals are written when a block gets connected, the chainstate only on a flush. After a
+    // crash the blocks since the last flush get connected again and would be counted twice.
+    uint256 hashBalanceBest;
+    if (fRequested && fBuilt && !fWipe && (!pblocktree->ReadAddressBalanceBest(hashBalanceBest) || hashBalanceBest != hashBest)) {
+        LogPrintf("%s: the balance index is not at the chainstate's best block %s\n", __func__, hashBest.ToString());
+        fBuilt = false;
+    }
+
+    if (fRequested && fWipe) {
+        // All blocks get connected again and add up the balances from scratch.
+        if (!pblocktree->EraseAddressBalanceIndex())
+            return error("%s: failed to erase the balance index", __func__);
+        if (!pblocktree->WriteAddressBalanceDeltaStart(0))
+            return error("%s: failed to write the balance index", __func__);
+    } else if (fRequested && !fBuilt) {
+        LogPrintf("%s: building the balance index from the address index...\n", __func__);
+        uiInterface.InitMessage(_("Building the balance index..."));
+
+        int64_t nStart = GetTimeMillis();
+
+        if (!pblocktree->RebuildAddressBalanceIndex(hashBest, chainActive.Height()))
+            return error("%s: failed to build the balance index", __func__);
+
+        LogPrintf("%s: balance index built in %dms\n", __func__, GetTimeMillis() - nStart);
+    }
+
+    // The balance changes are kept from the next block on
+    int nDeltaStart;
+    if (fRequested && !pblocktree->ReadAddressBalanceDeltaStart(nDeltaStart) &&
+        !pblocktree->WriteAddressBalanceDeltaStart(chainActive.Height() + 1))
+        return error("%s: failed to write the balance index", __func__);
+
+    fBalanceIndex = fRequested;
+
+    // Once disabled the totals get outdated and need to be built again when enabled the next time.
+    return pblocktree->WriteFlag("balanceindex", fBalanceIndex) &&
+           pblocktree->WriteFlag("balancerichlist", fBalanceIndex);
+}
+
+bool InitCompactAddressIndex()
+{
+    LOCK(cs_main);
+
+    bool fCompact = false;
+
+    pblocktree->ReadFlag("addressindexcompact", fCompact);
+
+    // Older versions keyed the entries by the full address and transaction hash.
+    if (fAddressIndex && !fCompact) {
+        LogPrintf("%s: converting the address index to the compact keys...\n", __func__);
+        uiInterface.InitMessage(_("Upgrading the address index..."));
+
+        int64_t nStart = GetTimeMillis();
+
+        if (!pblocktree->UpgradeAddressIndex())
+            return error("%s: failed to convert the address index", __func__);
+
+        LogPrintf("%s: address index converted in %dms\n", __func__, GetTimeMillis() - nStart);
+    }
+
+    return pblocktree->WriteFlag("addressindexcompact", fAddressIndex);
+}
+
+bool InitUnspentAmountIndex()
+{
+    LOCK(cs_main);
+
+    bool fBuilt = false;
+
+    pblocktree->ReadFlag("unspentamountindex", fBuilt);
+
+    // Maintained along with the address unspent index, only databases of older versions lack it.
+    if (fAddressIndex && !fBuilt) {
+        LogPrintf("%s: building the unspent amount index from the address unspent index...\n", __func__);
+        uiInterface.InitMessage(_("Building the unspent amount index..."));
+
+        int64_t nStart = GetTimeMillis();
+
+        if (!pblocktree->RebuildAddressUnspentAmountIndex())
+            return error("%s: failed to build the unspent amount index", __func__);
+
+        LogPrintf("%s: unspent amount index built in %dms\n", __func__, GetTimeMillis() - nStart);
+    }
+
+    return pblocktree->WriteFlag("unspentamountindex", fAddressIndex);
+}
+
+bool InitDepositBuckets()
+{
+    LOCK(cs_main);
+
+    bool fBuilt = false;
+
+    pblocktree->ReadFlag("depositbuckets", fBuilt);
+
+    // Maintained along with the deposit index, only databases of older versions lack them.
+    if (fDepositIndex && !fBuilt) {
+        LogPrintf("%s: counting the deposits of the deposit index...\n", __func__);
+        uiInterface.InitMessage(_("Counting the deposits..."));
+
+        int64_t nStart = GetTimeMillis();
+
+        if (!pblocktree->RebuildDepositBuckets())
+            return error("%s: failed to count the deposits", __func__);
+
+        LogPrintf("%s: deposits counted in %dms\n", __func__, GetTimeMillis() - nStart);
+    }
+
+    return pblocktree->WriteFlag("depositbuckets", fDepositIndex);
+}
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
@@ -4888,10 +5982,8 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
+        blockIndexArena.Clear();
     }
 } instance_of_cmaincleanup;
 
@@ -5187,3 +6279,282 @@ bool IsRegisteredForVoting(const CVoteKey &voteKey)
 
     return false;
 }
+
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+//! In-mempool ancestors of a transaction on the longest path, the parents of a transaction get stored before it
+static unsigned int GetMempoolDepth(CTxMemPool::txiter it, std::map<CTxMemPool::txiter, unsigned int, CTxMemPool::CompareIteratorByHash>& mapDepth)
+{
+    auto itDepth = mapDepth.find(it);
+    if (itDepth != mapDepth.end())
+        return itDepth->second;
+
+    unsigned int nDepth = 0;
+    for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(it))
+        nDepth = std::max(nDepth, GetMempoolDepth(parent, mapDepth) + 1);
+    mapDepth[it] = nDepth;
+    return nDepth;
+}
+
+void DumpMempool()
+{
+    int64_t nStart = GetTimeMicros();
+
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::vector<std::pair<unsigned int, CTxMemPool::txiter> > vSorted;
+    std::vector<std::pair<CTransactionRef, int64_t> > vtx;
+    std::vector<uint256> vLockRequests;
+    std::vector<CTxLockVote> vLockVotes;
+
+    instantsend.GetTxLockCandidatesToStore(vLockRequests, vLockVotes);
+
+    {
+        LOCK(mempool.cs);
+        mapDeltas = mempool.mapDeltas;
+
+        std::map<CTxMemPool::txiter, unsigned int, CTxMemPool::CompareIteratorByHash> mapDepth;
+        vSorted.reserve(mempool.mapTx.size());
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it)
+            vSorted.push_back(std::make_pair(GetMempoolDepth(it, mapDepth), it));
+        std::stable_sort(vSorted.begin(), vSorted.end(), [](const std::pair<unsigned int, CTxMemPool::txiter>& a, const std::pair<unsigned int, CTxMemPool::txiter>& b) {
+            return a.first < b.first;
+        });
+
+        vtx.reserve(vSorted.size());
+        for (const auto& pair : vSorted)
+            vtx.push_back(std::make_pair(pair.second->GetSharedTx(), pair.second->GetTime()));
+
+        // Only the lock requests which are still in the mempool can be loaded again
+        vLockRequests.erase(std::remove_if(vLockRequests.begin(), vLockRequests.end(), [](const uint256& hash) {
+            return !mempool.exists(hash);
+        }), vLockRequests.end());
+    }
+
+    int64_t nMid = GetTimeMicros();
+
+    try {
+        boost::filesystem::path path = GetDataDir() / "mempool.dat";
+        boost::filesystem::path pathTemp = GetDataDir() / "mempool.dat.new";
+        FILE* filestr = fopen(pathTemp.string().c_str(), "wb");
+        if (!filestr)
+            return;
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        file << MEMPOOL_DUMP_VERSION;
+        file << mapDeltas;
+        file << vLockRequests;
+        file << vLockVotes;
+        file << (uint64_t)vtx.size();
+        for (const auto& pair : vtx)
+            file << pair.first << pair.second;
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(pathTemp, path);
+        int64_t nLast = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump, %u txs, %u InstantSend lock requests\n",
+                  (nMid - nStart) * 0.000001, (nLast - nMid) * 0.000001, vtx.size(), vLockRequests.size());
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+    }
+}
+
+/**
+ * Check the scripts of a batch of transactions on the script check threads, parents first.
+ * The results only matter for the signature cache, AcceptToMemoryPool checks the
+ * transactions one by one afterwards and finds their signatures in there.
+ */
+static void PreVerifyScripts(const std::vector<const CTransaction*>& vtx)
+{
+    // The block checks use the queue under cs_main, it has to be idle for a control
+    LOCK(cs_main);
+    std::vector<CScriptCheck> vChecks;
+    {
+        LOCK(mempool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        std::map<COutPoint, CTxOut> mapBatchOutputs;
+        for (const CTransaction* ptx : vtx) {
+            const CTransaction& tx = *ptx;
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                const COutPoint& prevout = tx.vin[i].prevout;
+                std::map<COutPoint, CTxOut>::const_iterator it = mapBatchOutputs.find(prevout);
+                if (it != mapBatchOutputs.end()) {
+                    vChecks.push_back(CScriptCheck(it->second.scriptPubKey, it->second.nValue, tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true));
+                    continue;
+                }
+                Coin coin;
+                if (viewMemPool.GetCoin(prevout, coin) && !coin.IsSpent())
+                    vChecks.push_back(CScriptCheck(coin.out.scriptPubKey, coin.out.nValue, tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true));
+            }
+            for (unsigned int i = 0; i < tx.vout.size(); i++)
+                mapBatchOutputs[COutPoint(tx.GetHash(), i)] = tx.vout[i];
+        }
+    }
+
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
+//! The indexes of vtx with the transactions spending outputs of others in vtx after those
+static std::vector<size_t> SortBatchByDependencies(const std::vector<CTransactionRef>& vtx)
+{
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < vtx.size(); i++)
+        mapIndex.emplace(vtx[i]->GetHash(), i);
+
+    std::vector<size_t> vParents(vtx.size(), 0);
+    std::vector<std::vector<size_t> > vChildren(vtx.size());
+    for (size_t i = 0; i < vtx.size(); i++) {
+        std::set<size_t> setParents;
+        for (const CTxIn& txin : vtx[i]->vin) {
+            std::map<uint256, size_t>::const_iterator it = mapIndex.find(txin.prevout.hash);
+            if (it != mapIndex.end() && it->second != i && setParents.insert(it->second).second)
+                vChildren[it->second].push_back(i);
+        }
+        vParents[i] = setParents.size();
+    }
+
+    std::vector<size_t> vOrder;
+    vOrder.reserve(vtx.size());
+    for (size_t i = 0; i < vtx.size(); i++) {
+        if (vParents[i] == 0)
+            vOrder.push_back(i);
+    }
+    for (size_t n = 0; n < vOrder.size(); n++) {
+        for (size_t nChild : vChildren[vOrder[n]]) {
+            if (--vParents[nChild] == 0)
+                vOrder.push_back(nChild);
+        }
+    }
+    return vOrder;
+}
+
+void AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, std::vector<CMempoolAcceptResult>& vResultsRet,
+                             bool fLimitFree, bool fRejectAbsurdFee, const std::vector<int64_t>* pvAcceptTime)
+{
+    AssertLockHeld(cs_main);
+    assert(!pvAcceptTime || pvAcceptTime->size() == vtx.size());
+
+    vResultsRet.assign(vtx.size(), CMempoolAcceptResult());
+    std::vector<size_t> vOrder = SortBatchByDependencies(vtx);
+
+    if (nScriptCheckThreads && vOrder.size() > 1) {
+        std::vector<const CTransaction*> vSorted;
+        vSorted.reserve(vOrder.size());
+        for (size_t i : vOrder)
+            vSorted.push_back(vtx[i].get());
+        PreVerifyScripts(vSorted);
+    }
+
+    int64_t nNow = GetTime();
+    for (size_t i : vOrder) {
+        const CTransaction& tx = *vtx[i];
+        CMempoolAcceptResult& result = vResultsRet[i];
+        std::vector<COutPoint> coins_to_uncache;
+        result.fAccepted = AcceptToMemoryPoolWorker(pool, result.state, vtx[i], fLimitFree, &result.fMissingInputs,
+                                                    pvAcceptTime ? (*pvAcceptTime)[i] : nNow, false, fRejectAbsurdFee, coins_to_uncache, false);
+        if (!result.fAccepted) {
+            LogPrint("mempool", "%s: %s %s\n", __func__, tx.GetHash().ToString(), result.state.GetRejectReason());
+            BOOST_FOREACH(const COutPoint& hashTx, coins_to_uncache)
+                pcoinsTip->Uncache(hashTx);
+        }
+    }
+
+    // One check of the coins cache size for the whole batch
+    CValidationState stateDummy;
+    FlushStateToDisk(stateDummy, FLUSH_STATE_PERIODIC);
+}
+
+bool LoadMempool(CConnman& connman)
+{
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t count = 0;
+    int64_t skipped = 0;
+    int64_t failed = 0;
+    int64_t nNow = GetTime();
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION)
+            return false;
+
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        std::vector<uint256> vLockRequests;
+        std::vector<CTxLockVote> vLockVotes;
+        file >> mapDeltas;
+        file >> vLockRequests;
+        file >> vLockVotes;
+
+        // The prioritisations apply to the transactions while they get accepted
+        for (const auto& pair : mapDeltas)
+            mempool.PrioritiseTransaction(pair.first, pair.first.ToString(), pair.second.first, pair.second.second);
+
+        std::set<uint256> setLockRequests(vLockRequests.begin(), vLockRequests.end());
+
+        uint64_t num;
+        file >> num;
+        while (num > 0) {
+            std::vector<CTransactionRef> vtx;
+            std::vector<int64_t> vTime;
+            while (num > 0 && vtx.size() < MEMPOOL_LOAD_CHUNK_TXS) {
+                CTransactionRef tx;
+                int64_t nTime;
+                file >> tx;
+                file >> nTime;
+                --num;
+                if (nTime + nExpiryTimeout <= nNow) {
+                    ++skipped;
+                    continue;
+                }
+                vtx.push_back(tx);
+                vTime.push_back(nTime);
+            }
+
+            // The lock candidates have to be there before AcceptToMemoryPool checks the requests
+            std::vector<bool> vLockRequest(vtx.size(), false);
+            for (size_t i = 0; i < vtx.size(); i++) {
+                if (setLockRequests.count(vtx[i]->GetHash()))
+                    vLockRequest[i] = instantsend.ProcessTxLockRequest(CTxLockRequest(*vtx[i]), connman);
+            }
+
+            std::vector<CMempoolAcceptResult> vResults;
+            {
+                LOCK(cs_main);
+                AcceptToMemoryPoolBatch(mempool, vtx, vResults, true, false, &vTime);
+            }
+
+            for (size_t i = 0; i < vtx.size(); i++) {
+                if (vResults[i].fAccepted) {
+                    ++count;
+                    if (vLockRequest[i])
+                        instantsend.AcceptLockRequest(CTxLockRequest(*vtx[i]));
+                } else {
+                    ++failed;
+                    if (vLockRequest[i])
+                        instantsend.RejectLockRequest(CTxLockRequest(*vtx[i]));
+                }
+            }
+
+            if (ShutdownRequested())
+                return false;
+        }
+
+        instantsend.ProcessStoredTxLockVotes(vLockVotes, connman);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
+    return true;
+}
@@ -13,6 +13,8 @@
 #include "amount.h"
 #include "chain.h"
 #include "coins.h"
+#include "consensus/validation.h"
+#include "flushschedule.h"
 #include "net.h"
 #include "script/script_error.h"
 #include "sync.h"
@@ -27,14 +29,17 @@
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 #include <boost/unordered_map.hpp>
 #include <boost/filesystem/path.hpp>
 
+class CBlockFilter;
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CBloomFilter;
 class CChainParams;
 class CCoinsViewDB;
@@ -80,6 +85,10 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -persistmempool, keeping the mempool in mempool.dat over a restart */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Stored transactions whose scripts get checked on the script check threads at once while they are loaded */
+static const unsigned int MEMPOOL_LOAD_CHUNK_TXS = 1000;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -92,8 +101,22 @@ static const int64_t DUST_HARD_LIMIT = 1000;   // 0.00001 SMART mininput
 static const int MAX_SCRIPTCHECK_THREADS = 15;  // was 16
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Blocks with fewer transactions get their transactions checked without the block check queue */
+static const unsigned int MIN_PARALLEL_BLOCK_CHECK_TXS = 16;
+/** -blockreadahead default (MiB of blocks to read ahead during the initial block download, 0 = off) */
+static const unsigned int DEFAULT_BLOCK_READAHEAD = 32;
+/** -undocache default (number of the last connected blocks kept in memory with their undo data, 0 = off) */
+static const unsigned int DEFAULT_UNDO_CACHE_BLOCKS = 6;
+/** Most blocks -undocache accepts */
+static const unsigned int MAX_UNDO_CACHE_BLOCKS = 100;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 64;  //was 16
+/** Fewest blocks the block download keeps in flight from a peer, however slow it is. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 8;
+/** Most blocks the block download keeps in flight from a peer which delivers them fast. */
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 128;
+/** Seconds of blocks at the rate a peer delivered them so far the block download keeps in flight from it. */
+static const int BLOCK_DOWNLOAD_TARGET_LATENCY = 4;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 1; //was 2
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -150,6 +173,8 @@ static const bool DEFAULT_ADDRESSINDEX = false; // WIP-VOTING, Voting set to tru
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
 static const bool DEFAULT_DEPOSITINDEX = false;
+static const bool DEFAULT_PAYOUTINDEX = false;
+static const bool DEFAULT_BALANCEINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 static const bool DEFAULT_TESTSAFEMODE = false;
@@ -161,6 +186,9 @@ static const bool DEFAULT_FEEFILTER = true;
 /** Maximum number of headers to announce when relaying blocks with headers message.*/
 static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 
+/** Number of peers which get to announce new blocks to us with cmpctblocks right away */
+static const unsigned int MAX_CMPCTBLOCK_ANNOUNCING_PEERS = 3;
+
 /** Maximum number of unconnecting headers announcements before DoS score */
 static const int MAX_UNCONNECTING_HEADERS = 10;
 
@@ -192,12 +220,18 @@ extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fInstantPayIndex;
+extern bool fBalanceIndex;
+extern bool fBlockFilterIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern unsigned int nBytesPerSigOp;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Percent of the time the early flushes of the coins and rewards caches may take, -dbflushbudget */
+extern int nDBFlushBudget;
+/** Number of the last connected blocks DisconnectTip finds in memory, -undocache */
+extern unsigned int nUndoCacheBlocks;
 extern int64_t nMinimumInputValue;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
@@ -225,6 +259,10 @@ extern bool fPruneMode;
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/** Default for -prunekeepblocks, the recent blocks the SAPI and the rewards keep around in prune mode */
+static const unsigned int DEFAULT_PRUNE_KEEP_BLOCKS = 2880;
+/** Block files containing a block-height within this many blocks of chainActive.Tip() will not be pruned, at least MIN_BLOCKS_TO_KEEP. */
+extern unsigned int nPruneKeepBlocks;
 
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
@@ -289,12 +327,24 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex(const CChainParams& chainparams);
+/** Convert the address index to the compact keys if it was written by an older version */
+bool InitCompactAddressIndex();
+/** Enable the address balance index if requested, build it from the address index if required */
+bool InitBalanceIndex(bool fWipe);
+/** Build the amount ordered unspent outputs from the address unspent index if it has none yet */
+bool InitUnspentAmountIndex();
+/** Count the deposits per time bucket if the deposit index has no counts yet */
+bool InitDepositBuckets();
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex();
 /** Unload database information */
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the block transaction checking thread */
+void ThreadBlockCheck();
+/** Read the blocks to connect next ahead, keeping up to nMaxMemory bytes of them */
+void ThreadBlockReadAhead(size_t nMaxMemory);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -306,6 +356,8 @@ bool IsInitialBlockDownload();
  */
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256 &hash, CTransaction &tx, const Consensus::Params& params, uint256 &hashBlock, bool fAllowSlow = false);
+/** Is the transaction in the txindex, but out of reach of GetTransaction since pruning deleted its block file? */
+bool IsTransactionPruned(const uint256 &hash);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams, const CBlock* pblock = NULL);
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
@@ -327,13 +379,18 @@ CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
  */
 void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
 
+/**
+ *  Mark the blocks of one block file as pruned and null its info, the file gets deleted by UnlinkPrunedFiles
+ */
+void PruneOneBlockFile(const int fileNumber);
+
 /**
  *  Actually unlink the specified files
  */
 void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 
-/** Create a new block index entry for a given block hash */
-CBlockIndex * InsertBlockIndex(uint256 hash);
+/** Create a new block index entry for a given block hash, nHeight is the height the entry will get */
+CBlockIndex * InsertBlockIndex(const uint256& hash, int nHeight);
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Increase a node's misbehavior score. */
@@ -344,11 +401,44 @@ void FlushStateToDisk();
 void PruneAndFlush();
 
 int64_t GetBlockValue(int nHeight, int64_t nFees, unsigned int nTime);
+/** Sum of the fee-less block values of the heights [nFirstHeight, nLastHeight]. */
+CAmount GetBlockValueSum(int nFirstHeight, int nLastHeight);
 
-/** (try to) add transaction to memory pool **/
+/** (try to) add transaction to memory pool, the pool shares ptx **/
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fOverrideMempoolLimit=false, bool fRejectAbsurdFee=false, bool fDryRun=false);
+/** As above, the pool keeps a copy of tx if it gets accepted **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fOverrideMempoolLimit=false, bool fRejectAbsurdFee=false, bool fDryRun=false);
 
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit=false, bool fRejectAbsurdFee=false, bool fDryRun=false);
+
+/** Outcome of one transaction of AcceptToMemoryPoolBatch */
+struct CMempoolAcceptResult {
+    bool fAccepted;
+    bool fMissingInputs;
+    CValidationState state;
+
+    CMempoolAcceptResult() : fAccepted(false), fMissingInputs(false) {}
+};
+
+/**
+ * Add a batch of transactions to the memory pool, requires cs_main. Transactions of the
+ * batch spending outputs of others in it get accepted after them, the scripts of the whole
+ * batch get checked on the script check threads first. vResultsRet is in the order of vtx,
+ * pvAcceptTime has the acceptance times of vtx or is NULL for now.
+ */
+void AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx, std::vector<CMempoolAcceptResult>& vResultsRet,
+                             bool fLimitFree, bool fRejectAbsurdFee=false, const std::vector<int64_t>* pvAcceptTime=NULL);
+
+/** Dump the mempool, its prioritisations and the InstantSend lock candidates to mempool.dat */
+void DumpMempool();
+
+/** Load mempool.dat again through AcceptToMemoryPool, false if it couldn't be read */
+bool LoadMempool(CConnman& connman);
+
 bool GetUTXOCoin(const COutPoint& outpoint, Coin& coin);
 int GetUTXOHeight(const COutPoint& outpoint);
 int GetUTXOConfirmations(const COutPoint& outpoint);
@@ -507,21 +597,71 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure running the context-free checks of one transaction of a block,
+ * CheckBlock puts them on the block check queue.
+ * Note that this stores a reference to the transaction
+ */
+class CBlockTxCheck
+{
+private:
+    const CTransaction *ptx;
+    int nHeight;
+    bool isVerifyDB;
+
+public:
+    CBlockTxCheck(): ptx(0), nHeight(0), isVerifyDB(false) {}
+    CBlockTxCheck(const CTransaction& txIn, int nHeightIn, bool isVerifyDBIn) :
+        ptx(&txIn), nHeight(nHeightIn), isVerifyDB(isVerifyDBIn) { }
+
+    bool operator()();
+
+    void swap(CBlockTxCheck &check) {
+        std::swap(ptx, check.ptx);
+        std::swap(nHeight, check.nHeight);
+        std::swap(isVerifyDB, check.isVerifyDB);
+    }
+};
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+/** Spent info of all the keys at once, the values of unspent outputs stay null */
+bool GetSpentIndex(std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                      int start = 0, int end = 0);
 bool GetAddresses(std::vector<CAddressListEntry> &addressList,int nEndHeight = -1, bool excludeZeroBalances = false);
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalanceValue &value);
+bool GetAddressTransactions(uint160 addressHash, int type, bool fAscending,
+                            int nCursorHeight, const uint256 &cursorTx, int64_t nSkip, int64_t nLimit,
+                            std::vector<std::tuple<uint256, int, CAmount> > &vecTxs, bool &fMore);
+bool GetAddressTransactionCount(uint160 addressHash, int type, int64_t &count);
+/** Heights of the blocks from nStartHeight on with transactions of the address */
+bool GetAddressIndexHeights(uint160 addressHash, int type, int nStartHeight, std::set<int> &setHeights);
 bool GetAddressUnspentCount(uint160 addressHash, int type, int &count, CAddressUnspentKey &lastIndex);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
                        const CAddressUnspentKey &start = CAddressUnspentKey(),
                        int offset = -1, int limit = -1, bool reverse = false);
+bool GetAddressUnspentByAmount(uint160 addressHash, int type,
+                               std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                               CAddressUnspentAmountKey &cursor, int limit);
 bool GetDepositIndexCount(uint160 addressHash, int type, int &count, int &firstTime, int &lastTime, int start, int end);
 bool GetDepositIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CDepositIndexKey, CDepositValue>> &depositIndex,
                      int start, int offset, int limit, bool reverse);
+/** The payout index entries of the coinbase of the block at nHeight, for the outputs paying an address */
+void GetPayoutIndexEntries(const CTransaction &coinbase, int nHeight,
+                           std::vector<std::pair<CPayoutIndexKey, CPayoutValue>> &payoutIndex);
+/** Payouts of the categories in categoryMask to the address at heights from nFrom to nTo, all of
+ *  the heights up to the one reaching limit entries. */
+bool GetPayoutIndex(uint160 addressHash, int type, int nFrom, int nTo, int categoryMask, int limit,
+                    std::vector<std::pair<CPayoutIndexKey, CPayoutValue>> &payoutIndex);
+
+/** The filter of the block with the hash, its hash and its header, false without the index or an entry */
+bool GetBlockFilter(const uint256 &hashBlock, CBlockFilter &filter);
+bool GetBlockFilterHash(const uint256 &hashBlock, uint256 &hashFilter);
+bool GetBlockFilterHeader(const uint256 &hashBlock, uint256 &header);
 
 bool GetInstantPayIndexCount(int &count, int &firstTime, int &lastTime, int start, int end);
 bool GetInstantPayIndex(std::vector<std::pair<CInstantPayIndexKey, CInstantPayValue>> &instantPayIndex,
@@ -536,6 +676,10 @@ bool GetInvalidVoteKeyRegistration(const uint256 &txHash);
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Find the serialized block of pindex in its blk file, it starts at pos.nPos and is nSize bytes long. Only the
+ *  index header in front of it gets checked, not the block itself. */
+bool GetBlockDiskRange(const CBlockIndex* pindex, CDiskBlockPos& pos, unsigned int& nSize, const CMessageHeader::MessageStartChars& messageStart);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -550,6 +694,37 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
 /** Reprocess a number of blocks to try and get on the correct chain again **/ 
 bool DisconnectBlocks(int blocks); 
 void ReprocessBlocks(int nBlocks); 
+
+/** Totals of the phases the -debug=bench log reports for connecting and disconnecting blocks, in microseconds since startup */
+struct CBlockConnectTimings
+{
+    int64_t nBlocksConnected;
+    int64_t nBlocksDisconnected;
+
+    // ConnectBlock
+    int64_t nTimeCheck;
+    int64_t nTimeForks;
+    int64_t nTimeConnect;
+    int64_t nTimeVerify;
+    int64_t nTimeIndex;
+    int64_t nTimeCallbacks;
+    //! Part of nTimeVerify
+    int64_t nTimePayments;
+
+    // ConnectTip, nTimeConnectTotal is all of ConnectBlock
+    int64_t nTimeReadFromDisk;
+    int64_t nTimePrefetch;
+    int64_t nTimeConnectTotal;
+    int64_t nTimeFlush;
+    int64_t nTimeChainState;
+    int64_t nTimePostConnect;
+    int64_t nTimeTotal;
+
+    // DisconnectTip, DisconnectBlock and the flush of its view
+    int64_t nTimeDisconnect;
+};
+
+void GetBlockConnectTimings(CBlockConnectTimings& timings);
  
 int GetInputAge(const CTxIn &txin); 
 int GetInputAgeIX(const uint256 &nTXHash, const CTxIn &txin); 
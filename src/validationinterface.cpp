@@ -5,6 +5,9 @@
 
 #include "validationinterface.h"
 
+#include "primitives/transaction.h"
+#include "spentindex.h"
+
 static CMainSignals g_signals;
 
 CMainSignals& GetMainSignals()
@@ -16,7 +19,9 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.AcceptedBlockHeader.connect(boost::bind(&CValidationInterface::AcceptedBlockHeader, pwalletIn, _1));
     g_signals.NotifyHeaderTip.connect(boost::bind(&CValidationInterface::NotifyHeaderTip, pwalletIn, _1, _2));
     g_signals.UpdatedBlockTip.connect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
+    g_signals.BlockConnected.connect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2));
     g_signals.SyncTransaction.connect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
+    g_signals.SyncTransactions.connect(boost::bind(&CValidationInterface::SyncTransactions, pwalletIn, _1, _2));
     g_signals.NotifyTransactionLock.connect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
     g_signals.UpdatedTransaction.connect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.SetBestChain.connect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
@@ -25,9 +30,15 @@ void RegisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.BlockChecked.connect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.ScriptForMining.connect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
     g_signals.BlockFound.connect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
+    g_signals.AddressIndexUpdated.connect(boost::bind(&CValidationInterface::AddressIndexUpdated, pwalletIn, _1, _2, _3));
+    g_signals.NotifySmartnodeListChanged.connect(boost::bind(&CValidationInterface::NotifySmartnodeListChanged, pwalletIn, _1, _2, _3));
+    g_signals.NotifyProposalVote.connect(boost::bind(&CValidationInterface::NotifyProposalVote, pwalletIn, _1));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
+    g_signals.NotifyProposalVote.disconnect(boost::bind(&CValidationInterface::NotifyProposalVote, pwalletIn, _1));
+    g_signals.NotifySmartnodeListChanged.disconnect(boost::bind(&CValidationInterface::NotifySmartnodeListChanged, pwalletIn, _1, _2, _3));
+    g_signals.AddressIndexUpdated.disconnect(boost::bind(&CValidationInterface::AddressIndexUpdated, pwalletIn, _1, _2, _3));
     g_signals.BlockFound.disconnect(boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
     g_signals.ScriptForMining.disconnect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
     g_signals.BlockChecked.disconnect(boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
@@ -36,13 +47,18 @@ void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     g_signals.SetBestChain.disconnect(boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
     g_signals.UpdatedTransaction.disconnect(boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
     g_signals.NotifyTransactionLock.disconnect(boost::bind(&CValidationInterface::NotifyTransactionLock, pwalletIn, _1));
+    g_signals.SyncTransactions.disconnect(boost::bind(&CValidationInterface::SyncTransactions, pwalletIn, _1, _2));
     g_signals.SyncTransaction.disconnect(boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1, _2));
+    g_signals.BlockConnected.disconnect(boost::bind(&CValidationInterface::BlockConnected, pwalletIn, _1, _2));
     g_signals.UpdatedBlockTip.disconnect(boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
     g_signals.NotifyHeaderTip.disconnect(boost::bind(&CValidationInterface::NotifyHeaderTip, pwalletIn, _1, _2));
     g_signals.AcceptedBlockHeader.disconnect(boost::bind(&CValidationInterface::AcceptedBlockHeader, pwalletIn, _1));
 }
 
 void UnregisterAllValidationInterfaces() {
+    g_signals.NotifyProposalVote.disconnect_all_slots();
+    g_signals.NotifySmartnodeListChanged.disconnect_all_slots();
+    g_signals.AddressIndexUpdated.disconnect_all_slots();
     g_signals.BlockFound.disconnect_all_slots();
     g_signals.ScriptForMining.disconnect_all_slots();
     g_signals.BlockChecked.disconnect_all_slots();
@@ -51,8 +67,15 @@ void UnregisterAllValidationInterfaces() {
     g_signals.SetBestChain.disconnect_all_slots();
     g_signals.UpdatedTransaction.disconnect_all_slots();
     g_signals.NotifyTransactionLock.disconnect_all_slots();
+    g_signals.SyncTransactions.disconnect_all_slots();
     g_signals.SyncTransaction.disconnect_all_slots();
+    g_signals.BlockConnected.disconnect_all_slots();
     g_signals.UpdatedBlockTip.disconnect_all_slots();
     g_signals.NotifyHeaderTip.disconnect_all_slots();
     g_signals.AcceptedBlockHeader.disconnect_all_slots();
 }
+
+void CValidationInterface::SyncTransactions(const std::vector<CTransactionRef> &vtx, const CBlock *pblock) {
+    for (const CTransactionRef& tx : vtx)
+        SyncTransaction(*tx, pblock);
+}
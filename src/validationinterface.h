@@ -6,15 +6,21 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include "amount.h"
+#include "primitives/transaction.h" // CTransaction(Ref)
+
 #include <boost/signals2/signal.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <vector>
+
+struct CAddressIndexKey;
 class CBlock;
 struct CBlockLocator;
 class CBlockIndex;
 class CConnman;
+class CProposalVote;
 class CReserveScript;
-class CTransaction;
 class CValidationInterface;
 class CValidationState;
 class uint256;
@@ -34,7 +40,10 @@ protected:
     virtual void NotifyHeaderTip(const CBlockIndex *pindexNew, bool fInitialDownload) {}
     virtual void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {}
     virtual void SyncTransaction(const CTransaction &tx, const CBlock *pblock) {}
+    /** The transactions of a connected or disconnected block, one SyncTransaction each unless overridden */
+    virtual void SyncTransactions(const std::vector<CTransactionRef> &vtx, const CBlock *pblock);
     virtual void NotifyTransactionLock(const CTransaction &tx) {}
+    virtual void BlockConnected(const CBlock &block, const CBlockIndex *pindex) {}
     virtual void SetBestChain(const CBlockLocator &locator) {}
     virtual bool UpdatedTransaction(const uint256 &hash) { return false;}
     virtual void Inventory(const uint256 &hash) {}
@@ -42,6 +51,9 @@ protected:
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
     virtual void GetScriptForMining(boost::shared_ptr<CReserveScript>&) {}
     virtual void ResetRequestCount(const uint256 &hash) {}
+    virtual void AddressIndexUpdated(const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vecEntries, bool fConnected) {}
+    virtual void NotifySmartnodeListChanged(int nCount, bool fAdded, bool fRemoved) {}
+    virtual void NotifyProposalVote(const CProposalVote &vote) {}
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
@@ -54,8 +66,12 @@ struct CMainSignals {
     boost::signals2::signal<void (const CBlockIndex *, bool fInitialDownload)> NotifyHeaderTip;
     /** Notifies listeners of updated block chain tip */
     boost::signals2::signal<void (const CBlockIndex *, const CBlockIndex *, bool fInitialDownload)> UpdatedBlockTip;
+    /** Notifies listeners of a block connected to the tip, with cs_main held. The block is only valid during the call. */
+    boost::signals2::signal<void (const CBlock &, const CBlockIndex *)> BlockConnected;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
     boost::signals2::signal<void (const CTransaction &, const CBlock *)> SyncTransaction;
+    /** Notifies listeners of the transactions of a block (and the block if they are found in it). */
+    boost::signals2::signal<void (const std::vector<CTransactionRef> &, const CBlock *)> SyncTransactions;
     /** Notifies listeners of an updated transaction lock without new data. */
     boost::signals2::signal<void (const CTransaction &)> NotifyTransactionLock;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
@@ -72,6 +88,12 @@ struct CMainSignals {
     boost::signals2::signal<void (boost::shared_ptr<CReserveScript>&)> ScriptForMining;
     /** Notifies listeners that a block has been successfully mined */
     boost::signals2::signal<void (const uint256 &)> BlockFound;
+    /** Notifies listeners of the address index entries of a block written at connect (or erased at disconnect), with cs_main held */
+    boost::signals2::signal<void (const CBlockIndex *, const std::vector<std::pair<CAddressIndexKey, CAmount> > &, bool fConnected)> AddressIndexUpdated;
+    /** Notifies listeners of smartnodes added to or removed from the list, with the count after the change */
+    boost::signals2::signal<void (int nCount, bool fAdded, bool fRemoved)> NotifySmartnodeListChanged;
+    /** Notifies listeners of a newly accepted proposal vote, with the cs of the voting manager held */
+    boost::signals2::signal<void (const CProposalVote &)> NotifyProposalVote;
 };
 
 CMainSignals& GetMainSignals();
@@ -143,6 +143,30 @@ static bool DecryptKey(const CKeyingMaterial& vMasterKey, const std::vector<unsi
     return key.VerifyPubKey(vchPubKey);
 }
 
+static void CacheDecryptedKey(KeyMap& mapCache, const CKeyID& address, const CKey& key)
+{
+    if (mapCache.size() >= WALLET_DECRYPTED_KEY_CACHE_SIZE && !mapCache.count(address)) {
+        // The key ids are hashes, so the first one is as good as a random one to make room
+        mapCache.erase(mapCache.begin());
+    }
+    mapCache[address] = key;
+}
+
+static bool GetDecryptedKey(KeyMap& mapCache, const CKeyingMaterial& vMasterKey, const CKeyID& address, const CPubKey& vchPubKey, const std::vector<unsigned char>& vchCryptedSecret, CKey& keyOut)
+{
+    KeyMap::const_iterator it = mapCache.find(address);
+    if (it != mapCache.end()) {
+        keyOut = it->second;
+        return true;
+    }
+
+    if (!DecryptKey(vMasterKey, vchCryptedSecret, vchPubKey, keyOut))
+        return false;
+
+    CacheDecryptedKey(mapCache, address, keyOut);
+    return true;
+}
+
 bool CCryptoKeyStore::SetCrypted()
 {
     LOCK(cs_KeyStore);
@@ -162,6 +186,7 @@ bool CCryptoKeyStore::Lock()
     {
         LOCK(cs_KeyStore);
         vMasterKey.clear();
+        mapDecryptedKeys.clear();
     }
 
     NotifyStatusChanged(this);
@@ -177,6 +202,8 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
 
         bool keyPass = false;
         bool keyFail = false;
+        // The keys decrypted by the check are the first ones of the cache
+        KeyMap mapUnlockedKeys;
         CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
         for (; mi != mapCryptedKeys.end(); ++mi)
         {
@@ -188,6 +215,8 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
                 keyFail = true;
                 break;
             }
+            if (mapUnlockedKeys.size() < WALLET_DECRYPTED_KEY_CACHE_SIZE)
+                mapUnlockedKeys[(*mi).first] = key;
             keyPass = true;
             if (fDecryptionThoroughlyChecked)
                 break;
@@ -216,6 +245,7 @@ bool CCryptoKeyStore::Unlock(const CKeyingMaterial& vMasterKeyIn)
             }
         }
         fDecryptionThoroughlyChecked = true;
+        mapDecryptedKeys.swap(mapUnlockedKeys);
     }
     NotifyStatusChanged(this);
     return true;
@@ -267,7 +297,7 @@ bool CCryptoKeyStore::GetKey(const CKeyID &address, CKey& keyOut) const
         {
             const CPubKey &vchPubKey = (*mi).second.first;
             const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
-            return DecryptKey(vMasterKey, vchCryptedSecret, vchPubKey, keyOut);
+            return GetDecryptedKey(mapDecryptedKeys, vMasterKey, address, vchPubKey, vchCryptedSecret, keyOut);
         }
     }
     return false;
@@ -477,6 +507,7 @@ bool CCryptoKeyStore::LockVoting()
     {
         LOCK(cs_VotingKeyStore);
         vVotingMasterKey.clear();
+        mapDecryptedVotingKeys.clear();
     }
 
 //    NotifyVotingStatusChanged(this);
@@ -492,6 +523,7 @@ bool CCryptoKeyStore::UnlockVoting(const CKeyingMaterial& vMasterKeyIn)
 
         bool keyPass = false;
         bool keyFail = false;
+        KeyMap mapUnlockedKeys;
         CryptedKeyMap::const_iterator mi = mapCryptedVotingKeys.begin();
         for (; mi != mapCryptedVotingKeys.end(); ++mi)
         {
@@ -503,6 +535,8 @@ bool CCryptoKeyStore::UnlockVoting(const CKeyingMaterial& vMasterKeyIn)
                 keyFail = true;
                 break;
             }
+            if (mapUnlockedKeys.size() < WALLET_DECRYPTED_KEY_CACHE_SIZE)
+                mapUnlockedKeys[(*mi).first] = key;
             keyPass = true;
             if (fVotingDecryptionThoroughlyChecked)
                 break;
@@ -516,6 +550,7 @@ bool CCryptoKeyStore::UnlockVoting(const CKeyingMaterial& vMasterKeyIn)
             return false;
         vVotingMasterKey = vMasterKeyIn;
         fVotingDecryptionThoroughlyChecked = true;
+        mapDecryptedVotingKeys.swap(mapUnlockedKeys);
     }
 //    NotifyVotingStatusChanged(this);
     return true;
@@ -568,7 +603,7 @@ bool CCryptoKeyStore::GetVotingKey(const CKeyID &address, CKey& keyOut) const
         {
             const CPubKey &vchPubKey = (*mi).second.first;
             const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
-            return DecryptKey(vVotingMasterKey, vchCryptedSecret, vchPubKey, keyOut);
+            return GetDecryptedKey(mapDecryptedVotingKeys, vVotingMasterKey, address, vchPubKey, vchCryptedSecret, keyOut);
         }
     }
     return false;
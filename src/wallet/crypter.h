@@ -14,6 +14,8 @@ class uint256;
 const unsigned int WALLET_CRYPTO_KEY_SIZE = 32;
 const unsigned int WALLET_CRYPTO_SALT_SIZE = 8;
 const unsigned int WALLET_CRYPTO_IV_SIZE = 16;
+//! Decrypted keys kept per key store while it is unlocked
+const unsigned int WALLET_DECRYPTED_KEY_CACHE_SIZE = 1000;
 
 /**
  * Private key encryption is done based on a CMasterKey,
@@ -140,6 +142,11 @@ private:
     //! keeps track of whether Unlock has run a thorough check before
     bool fVotingDecryptionThoroughlyChecked;
 
+    //! keys decrypted since the last Unlock, up to WALLET_DECRYPTED_KEY_CACHE_SIZE, they
+    //! save the AES and public key check of repeated lookups and get wiped by Lock
+    mutable KeyMap mapDecryptedKeys;
+    mutable KeyMap mapDecryptedVotingKeys;
+
 protected:
     bool SetCrypted();
     bool SetVotingCrypted();
@@ -9,6 +9,7 @@
 #include "validation.h"
 #include "script/script.h"
 #include "script/standard.h"
+#include "spentindex.h"
 #include "sync.h"
 #include "util.h"
 #include "utiltime.h"
@@ -347,6 +348,154 @@ UniValue importaddress(const UniValue& params, bool fHelp)
 //     return NullUniValue;
 // }
 
+static CWatchAddress ParseWatchAddress(const UniValue& value)
+{
+    CBitcoinAddress address(value.get_str());
+    uint160 hashBytes;
+    int type = 0;
+    if (!address.IsValid() || !address.GetIndexKey(hashBytes, type))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid SmartCash address: " + value.get_str());
+    return CWatchAddress(type, hashBytes);
+}
+
+static std::string WatchAddressToString(const CWatchAddress& address)
+{
+    if (address.type == 2)
+        return CBitcoinAddress(CScriptID(address.hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(address.hashBytes)).ToString();
+}
+
+UniValue importwatchaddresses(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "importwatchaddresses [\"address\",...]\n"
+            "\nWatch addresses through the address index. Their transactions don't get into the wallet,\n"
+            "only their balance changes get recorded (see listwatchdeltas). No rescan is needed.\n"
+            "\nArguments:\n"
+            "1. \"addresses\"        (string, required) A json array of SmartCash addresses\n"
+            "\nResult:\n"
+            "n                     (numeric) The number of addresses which were not watched yet\n"
+            "\nExamples:\n"
+            + HelpExampleCli("importwatchaddresses", "'[\"Sa1...\",\"Sb2...\"]'") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("importwatchaddresses", "[\"Sa1...\",\"Sb2...\"]")
+        );
+
+    const UniValue& addresses = params[0].get_array();
+    std::vector<CWatchAddress> vAddresses;
+    for (size_t i = 0; i < addresses.size(); ++i)
+        vAddresses.push_back(ParseWatchAddress(addresses[i]));
+
+    int nAdded = 0;
+    for (const CWatchAddress& address : vAddresses) {
+        if (pwalletMain->AddWatchAddress(address))
+            ++nAdded;
+    }
+
+    return nAdded;
+}
+
+UniValue removewatchaddresses(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "removewatchaddresses [\"address\",...]\n"
+            "\nStop watching addresses of importwatchaddresses.\n"
+            "\nArguments:\n"
+            "1. \"addresses\"        (string, required) A json array of SmartCash addresses\n"
+            "\nResult:\n"
+            "n                     (numeric) The number of addresses which were watched\n"
+            "\nExamples:\n"
+            + HelpExampleCli("removewatchaddresses", "'[\"Sa1...\"]'") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("removewatchaddresses", "[\"Sa1...\"]")
+        );
+
+    const UniValue& addresses = params[0].get_array();
+    std::vector<CWatchAddress> vAddresses;
+    for (size_t i = 0; i < addresses.size(); ++i)
+        vAddresses.push_back(ParseWatchAddress(addresses[i]));
+
+    int nRemoved = 0;
+    for (const CWatchAddress& address : vAddresses) {
+        if (pwalletMain->RemoveWatchAddress(address))
+            ++nRemoved;
+    }
+
+    return nRemoved;
+}
+
+UniValue listwatchdeltas(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "listwatchdeltas startheight ( endheight )\n"
+            "\nThe balance changes of the addresses of importwatchaddresses in the blocks startheight to endheight,\n"
+            "one per address and transaction. The last blocks of -watchdeltablocks are answered from memory,\n"
+            "older ones from the address index.\n"
+            "\nArguments:\n"
+            "1. startheight        (numeric, required) The first block\n"
+            "2. endheight          (numeric, optional, default=tip) The last block\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The watched address\n"
+            "    \"txid\": \"txid\",        (string) The transaction id\n"
+            "    \"height\": n,           (numeric) The height of the block of the transaction\n"
+            "    \"delta\": x.xxx         (numeric) The balance change of the address in " + CURRENCY_UNIT + "\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("listwatchdeltas", "1000000") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("listwatchdeltas", "1000000, 1000100")
+        );
+
+    std::vector<CWatchDelta> vDeltas;
+    {
+        LOCK(cs_main);
+        int nStart = params[0].get_int();
+        int nEnd = params.size() > 1 ? params[1].get_int() : chainActive.Height();
+        if (nStart < 0 || nEnd < nStart)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block range");
+
+        if (!pwalletMain->watchAddresses.GetDeltas(nStart, nEnd, vDeltas)) {
+            for (const CWatchAddress& address : pwalletMain->watchAddresses.GetAddresses()) {
+                std::vector<std::pair<CAddressIndexKey, CAmount> > vecEntries;
+                if (!GetAddressIndex(address.hashBytes, address.type, vecEntries, nStart, nEnd))
+                    throw JSONRPCError(RPC_MISC_ERROR, "Failed to read the address index");
+                CWatchAddresses::AggregateEntries(vecEntries, vDeltas);
+            }
+            std::stable_sort(vDeltas.begin(), vDeltas.end(), [](const CWatchDelta& a, const CWatchDelta& b) {
+                return a.nHeight < b.nHeight;
+            });
+        }
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const CWatchDelta& delta : vDeltas) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("address", WatchAddressToString(delta.address)));
+        entry.push_back(Pair("txid", delta.txid.GetHex()));
+        entry.push_back(Pair("height", delta.nHeight));
+        entry.push_back(Pair("delta", ValueFromAmount(delta.nDelta)));
+        result.push_back(entry);
+    }
+
+    return result;
+}
+
 UniValue importpubkey(const UniValue& params, bool fHelp)
 {
     if (!EnsureWalletIsAvailable(fHelp))
@@ -2672,7 +2672,7 @@ UniValue resendwallettransactions(const UniValue& params, bool fHelp)
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    std::vector<uint256> txids = pwalletMain->ResendWalletTransactionsBefore(GetTime(), g_connman.get());
+    std::vector<uint256> txids = pwalletMain->ResendWalletTransactionsBefore(GetTime(), g_connman.get(), true);
     UniValue result(UniValue::VARR);
     BOOST_FOREACH(const uint256& txid, txids)
     {
@@ -2923,62 +2923,68 @@ extern UniValue dumpprivkey(const UniValue& params, bool fHelp); // in rpcdump.c
 extern UniValue importprivkey(const UniValue& params, bool fHelp);
 extern UniValue importaddress(const UniValue& params, bool fHelp);
 extern UniValue importpubkey(const UniValue& params, bool fHelp);
+extern UniValue importwatchaddresses(const UniValue& params, bool fHelp);
+extern UniValue removewatchaddresses(const UniValue& params, bool fHelp);
+extern UniValue listwatchdeltas(const UniValue& params, bool fHelp);
 extern UniValue dumpwallet(const UniValue& params, bool fHelp);
 extern UniValue importwallet(const UniValue& params, bool fHelp);
 extern UniValue importprunedfunds(const UniValue& params, bool fHelp);
 extern UniValue removeprunedfunds(const UniValue& params, bool fHelp);
 
 static const CRPCCommand commands[] =
-{ //  category              name                        actor (function)           okSafeMode
-    //  --------------------- ------------------------    -----------------------    ----------
-    { "rawtransactions",    "fundrawtransaction",       &fundrawtransaction,       false },
-    { "hidden",             "resendwallettransactions", &resendwallettransactions, true  },
-    { "wallet",             "abandontransaction",       &abandontransaction,       false },
-    { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true  },
-    { "wallet",             "addwitnessaddress",        &addwitnessaddress,        true  },
-    { "wallet",             "backupwallet",             &backupwallet,             true  },
-    { "wallet",             "dumpprivkey",              &dumpprivkey,              true  },
-    { "wallet",             "dumpwallet",               &dumpwallet,               true  },
-    { "wallet",             "encryptwallet",            &encryptwallet,            true  },
-    { "wallet",             "getaccountaddress",        &getaccountaddress,        true  },
-    { "wallet",             "getaccount",               &getaccount,               true  },
-    { "wallet",             "getaddress",               &getaddress,               true  },
-    { "wallet",             "getaddressesbyaccount",    &getaddressesbyaccount,    true  },
-    { "wallet",             "getbalance",               &getbalance,               false },
-    { "wallet",             "getnewaddress",            &getnewaddress,            true  },
-    { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true  },
-    { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false },
-    { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false },
-    { "wallet",             "gettransaction",           &gettransaction,           false },
-    { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false },
-    { "wallet",             "getwalletinfo",            &getwalletinfo,            false },
-    { "wallet",             "importprivkey",            &importprivkey,            true  },
-    { "wallet",             "importwallet",             &importwallet,             true  },
-    { "wallet",             "importaddress",            &importaddress,            true  },
-    //{ "wallet",             "importprunedfunds",        &importprunedfunds,        true  },
-    { "wallet",             "importpubkey",             &importpubkey,             true  },
-    { "wallet",             "instantsendtoaddress",     &instantsendtoaddress,     false },
-    { "wallet",             "keypoolrefill",            &keypoolrefill,            true  },
-    { "wallet",             "listaccounts",             &listaccounts,             false },
-    { "wallet",             "listaddressgroupings",     &listaddressgroupings,     false },
-    { "wallet",             "listlockunspent",          &listlockunspent,          false },
-    { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    false },
-    { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    false },
-    { "wallet",             "listsinceblock",           &listsinceblock,           false },
-    { "wallet",             "listtransactions",         &listtransactions,         false },
-    { "wallet",             "listunspent",              &listunspent,              false },
-    { "wallet",             "lockunspent",              &lockunspent,              true  },
-    { "wallet",             "move",                     &movecmd,                  false },
-    { "wallet",             "sendfrom",                 &sendfrom,                 false },
-    { "wallet",             "sendmany",                 &sendmany,                 false },
-    { "wallet",             "sendtoaddress",            &sendtoaddress,            false },
-    { "wallet",             "setaccount",               &setaccount,               true  },
-    { "wallet",             "settxfee",                 &settxfee,                 true  },
-    { "wallet",             "signmessage",              &signmessage,              true  },
-    { "wallet",             "walletlock",               &walletlock,               true  },
-    { "wallet",             "walletpassphrasechange",   &walletpassphrasechange,   true  },
-    { "wallet",             "walletpassphrase",         &walletpassphrase,         true  },
-    //{ "wallet",             "removeprunedfunds",        &removeprunedfunds,        true  },
+{ //  category              name                        actor (function)           okSafeMode  readOnly
+    //  --------------------- ------------------------    -----------------------    ----------  --------
+    { "rawtransactions",    "fundrawtransaction",       &fundrawtransaction,       false,      false },
+    { "hidden",             "resendwallettransactions", &resendwallettransactions, true,       false },
+    { "wallet",             "abandontransaction",       &abandontransaction,       false,      false },
+    { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true,       false },
+    { "wallet",             "addwitnessaddress",        &addwitnessaddress,        true,       false },
+    { "wallet",             "backupwallet",             &backupwallet,             true,       false },
+    { "wallet",             "dumpprivkey",              &dumpprivkey,              true,       false },
+    { "wallet",             "dumpwallet",               &dumpwallet,               true,       false },
+    { "wallet",             "encryptwallet",            &encryptwallet,            true,       false },
+    { "wallet",             "getaccountaddress",        &getaccountaddress,        true,       false },
+    { "wallet",             "getaccount",               &getaccount,               true,       true  },
+    { "wallet",             "getaddress",               &getaddress,               true,       false },
+    { "wallet",             "getaddressesbyaccount",    &getaddressesbyaccount,    true,       true  },
+    { "wallet",             "getbalance",               &getbalance,               false,      true  },
+    { "wallet",             "getnewaddress",            &getnewaddress,            true,       false },
+    { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true,       false },
+    { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false,      true  },
+    { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false,      true  },
+    { "wallet",             "gettransaction",           &gettransaction,           false,      true  },
+    { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false,      true  },
+    { "wallet",             "getwalletinfo",            &getwalletinfo,            false,      true  },
+    { "wallet",             "importprivkey",            &importprivkey,            true,       false },
+    { "wallet",             "importwallet",             &importwallet,             true,       false },
+    { "wallet",             "importaddress",            &importaddress,            true,       false },
+    //{ "wallet",             "importprunedfunds",        &importprunedfunds,        true,       false },
+    { "wallet",             "importpubkey",             &importpubkey,             true,       false },
+    { "wallet",             "importwatchaddresses",     &importwatchaddresses,     true,       false },
+    { "wallet",             "instantsendtoaddress",     &instantsendtoaddress,     false,      false },
+    { "wallet",             "keypoolrefill",            &keypoolrefill,            true,       false },
+    { "wallet",             "listaccounts",             &listaccounts,             false,      true  },
+    { "wallet",             "listaddressgroupings",     &listaddressgroupings,     false,      true  },
+    { "wallet",             "listlockunspent",          &listlockunspent,          false,      true  },
+    { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    false,      true  },
+    { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    false,      true  },
+    { "wallet",             "listsinceblock",           &listsinceblock,           false,      true  },
+    { "wallet",             "listtransactions",         &listtransactions,         false,      true  },
+    { "wallet",             "listunspent",              &listunspent,              false,      true  },
+    { "wallet",             "listwatchdeltas",          &listwatchdeltas,          false,      true  },
+    { "wallet",             "lockunspent",              &lockunspent,              true,       false },
+    { "wallet",             "move",                     &movecmd,                  false,      false },
+    { "wallet",             "removewatchaddresses",     &removewatchaddresses,     true,       false },
+    { "wallet",             "sendfrom",                 &sendfrom,                 false,      false },
+    { "wallet",             "sendmany",                 &sendmany,                 false,      false },
+    { "wallet",             "sendtoaddress",            &sendtoaddress,            false,      false },
+    { "wallet",             "setaccount",               &setaccount,               true,       false },
+    { "wallet",             "settxfee",                 &settxfee,                 true,       false },
+    { "wallet",             "signmessage",              &signmessage,              true,       false },
+    { "wallet",             "walletlock",               &walletlock,               true,       false },
+    { "wallet",             "walletpassphrasechange",   &walletpassphrasechange,   true,       false },
+    { "wallet",             "walletpassphrase",         &walletpassphrase,         true,       false },
+    //{ "wallet",             "removeprunedfunds",        &removeprunedfunds,        true,       false },
 };
 
 void RegisterWalletRPCCommands(CRPCTable &tableRPC)
@@ -0,0 +1,197 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "script/interpreter.h"
+#include "test/test_bitcoin.h"
+#include "validation.h"
+#include "wallet/db.h"
+#include "wallet/wallet.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+/** A chain of 100 blocks paying to a wallet, which holds the coinbase key */
+struct WalletBalanceTestingSetup : public TestChain100Setup {
+    CScript scriptExternal;
+
+    WalletBalanceTestingSetup()
+    {
+        bitdb.MakeMock();
+
+        bool fFirstRun;
+        pwalletMain = new CWallet("wallet_test.dat");
+        pwalletMain->LoadWallet(fFirstRun);
+        {
+            LOCK(pwalletMain->cs_wallet);
+            pwalletMain->AddKey(coinbaseKey);
+        }
+        pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
+        RegisterValidationInterface(pwalletMain);
+
+        CKey keyExternal;
+        keyExternal.MakeNewKey(true);
+        scriptExternal = CScript() << ToByteVector(keyExternal.GetPubKey()) << OP_CHECKSIG;
+    }
+
+    ~WalletBalanceTestingSetup()
+    {
+        UnregisterValidationInterface(pwalletMain);
+        delete pwalletMain;
+        pwalletMain = NULL;
+
+        bitdb.Flush(true);
+        bitdb.Reset();
+    }
+
+    void InvalidateTip()
+    {
+        CValidationState state;
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(InvalidateBlock(state, Params().GetConsensus(), chainActive.Tip()));
+        }
+        BOOST_CHECK(ActivateBestChain(state, Params()));
+    }
+
+    void Reconsider(CBlockIndex* pindex)
+    {
+        CValidationState state;
+        {
+            LOCK(cs_main);
+            BOOST_CHECK(::ReconsiderBlock(state, pindex));
+        }
+        BOOST_CHECK(ActivateBestChain(state, Params()));
+    }
+};
+
+/** The balances the way they were computed before the cache, walking all of mapWallet */
+static void CheckBalances(const CWallet& wallet)
+{
+    LOCK2(cs_main, wallet.cs_wallet);
+
+    CWalletBalances expected;
+    for (std::map<uint256, CWalletTx>::const_iterator it = wallet.mapWallet.begin(); it != wallet.mapWallet.end(); ++it) {
+        const CWalletTx& wtx = it->second;
+        if (wtx.IsTrusted()) {
+            expected.nTrusted += wtx.GetAvailableCredit(true, true);
+            expected.nTrustedUnlocked += wtx.GetAvailableCredit(true, false);
+            expected.nWatchOnlyTrusted += wtx.GetAvailableWatchOnlyCredit();
+        } else if (wtx.GetDepthInMainChain() == 0 && wtx.InMempool()) {
+            expected.nUntrusted += wtx.GetAvailableCredit();
+            expected.nWatchOnlyUntrusted += wtx.GetAvailableWatchOnlyCredit();
+        }
+        expected.nImmature += wtx.GetImmatureCredit();
+        expected.nWatchOnlyImmature += wtx.GetImmatureWatchOnlyCredit();
+    }
+
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), expected.nTrusted);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(false), expected.nTrustedUnlocked);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), expected.nUntrusted);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), expected.nImmature);
+    BOOST_CHECK_EQUAL(wallet.GetWatchOnlyBalance(), expected.nWatchOnlyTrusted);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedWatchOnlyBalance(), expected.nWatchOnlyUntrusted);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureWatchOnlyBalance(), expected.nWatchOnlyImmature);
+}
+
+static CMutableTransaction SpendCoinbase(const CTransaction& coinbase, const CKey& key, const CScript& scriptPubKey)
+{
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbase.GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = coinbase.vout[0].nValue - CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbase.vout[0].scriptPubKey, spend, 0, SIGHASH_ALL);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    return spend;
+}
+
+BOOST_FIXTURE_TEST_SUITE(walletbalance_tests, WalletBalanceTestingSetup)
+
+BOOST_AUTO_TEST_CASE(balance_cache_invalidation)
+{
+    const CWallet& wallet = *pwalletMain;
+    const std::vector<CMutableTransaction> noTxns;
+    const CAmount nCoinbase0 = coinbaseTxns[0].vout[0].nValue;
+    const CAmount nCoinbase1 = coinbaseTxns[1].vout[0].nValue;
+    const CAmount nCoinbase2 = coinbaseTxns[2].vout[0].nValue;
+
+    // None of the coinbases is mature at a depth of 100
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+    BOOST_CHECK(wallet.GetImmatureBalance() > 0);
+
+    // A block connects, the first coinbase matures without a MarkDirty
+    CAmount nImmature = wallet.GetImmatureBalance();
+    CreateAndProcessBlock(noTxns, scriptExternal);
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), nCoinbase0);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), nImmature - nCoinbase0);
+
+    // Locking a coin only changes the balance without the locked coins
+    COutPoint outpoint(coinbaseTxns[0].GetHash(), 0);
+    {
+        LOCK(pwalletMain->cs_wallet);
+        pwalletMain->LockCoin(outpoint);
+    }
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), nCoinbase0);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(false), 0);
+    {
+        LOCK(pwalletMain->cs_wallet);
+        pwalletMain->UnlockCoin(outpoint);
+    }
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(false), nCoinbase0);
+
+    // A wallet transaction changes, its coin is spent by a transaction of the next block
+    std::vector<CMutableTransaction> spends;
+    spends.push_back(SpendCoinbase(coinbaseTxns[0], coinbaseKey, scriptExternal));
+    CreateAndProcessBlock(spends, scriptExternal);
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), nCoinbase1);
+
+    CBlockIndex* pindexSpend;
+    {
+        LOCK(cs_main);
+        pindexSpend = chainActive.Tip();
+    }
+
+    // The block disconnects, the second coinbase is immature again. The spend
+    // stays in the wallet unconfirmed, so the first one doesn't come back.
+    InvalidateTip();
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), 0);
+
+    // ... and connects again
+    Reconsider(pindexSpend);
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), nCoinbase1);
+
+    // A reorganization to a longer branch without the spend, without a query in
+    // between. The spend went back to the mempool, CreateAndProcessBlock would
+    // count its fee in the coinbase.
+    InvalidateTip();
+    mempool.clear();
+    CreateAndProcessBlock(noTxns, scriptExternal);
+    CreateAndProcessBlock(noTxns, scriptExternal);
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), nCoinbase1 + nCoinbase2);
+
+    // Everything computed again from scratch agrees with the cache kept up to date
+    pwalletMain->MarkDirty();
+    CheckBalances(wallet);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), nCoinbase1 + nCoinbase2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,119 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/watchaddresses.h"
+
+#include "spentindex.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(watchaddresses_tests, BasicTestingSetup)
+
+static CWatchAddress Address(unsigned char n, unsigned int type = 1)
+{
+    uint160 hashBytes;
+    for (unsigned char* p = hashBytes.begin(); p != hashBytes.end(); ++p)
+        *p = n * 31 + (p - hashBytes.begin());
+    return CWatchAddress(type, hashBytes);
+}
+
+static uint256 TxId(unsigned char n)
+{
+    uint256 txid;
+    *txid.begin() = n;
+    return txid;
+}
+
+static std::pair<CAddressIndexKey, CAmount> Entry(const CWatchAddress& address, int nHeight, unsigned char nTx, CAmount nDelta)
+{
+    return std::make_pair(CAddressIndexKey(address.type, address.hashBytes, nHeight, nTx, TxId(nTx), 0, nDelta < 0), nDelta);
+}
+
+BOOST_AUTO_TEST_CASE(watchaddresses_membership)
+{
+    CWatchAddresses watch;
+
+    // Enough to rebuild the bloom filter a few times
+    for (int n = 0; n < 5000; ++n)
+        BOOST_CHECK(watch.Insert(Address(n % 256, 1 + n / 256)));
+    BOOST_CHECK(!watch.Insert(Address(7, 1)));
+    BOOST_CHECK_EQUAL(watch.Size(), 5000U);
+
+    for (int n = 0; n < 5000; ++n)
+        BOOST_CHECK(watch.Contains(Address(n % 256, 1 + n / 256)));
+    BOOST_CHECK(!watch.Contains(Address(7, 100)));
+
+    BOOST_CHECK(watch.Erase(Address(7, 1)));
+    BOOST_CHECK(!watch.Erase(Address(7, 1)));
+    BOOST_CHECK(!watch.Contains(Address(7, 1)));
+    BOOST_CHECK_EQUAL(watch.GetAddresses().size(), 4999U);
+}
+
+BOOST_AUTO_TEST_CASE(watchaddresses_deltas)
+{
+    CWatchAddresses watch;
+    watch.SetMaxBlocks(3);
+
+    CWatchAddress a = Address(1), b = Address(2), c = Address(3, 2);
+    watch.Insert(a);
+    watch.Insert(b);
+
+    std::vector<CWatchDelta> vDeltas;
+    BOOST_CHECK(!watch.GetDeltas(10, 10, vDeltas));
+
+    // The output and input of a in the same transaction get summed up, c isn't watched
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vecEntries;
+    vecEntries.push_back(Entry(a, 10, 1, 500));
+    vecEntries.push_back(Entry(c, 10, 1, 100));
+    vecEntries.push_back(Entry(a, 10, 1, -200));
+    vecEntries.push_back(Entry(b, 10, 2, 50));
+    watch.BlockUpdated(10, vecEntries, true);
+    watch.BlockUpdated(11, std::vector<std::pair<CAddressIndexKey, CAmount> >(1, Entry(b, 11, 3, -50)), true);
+
+    BOOST_CHECK_EQUAL(watch.GetRecordedFrom(), 10);
+    BOOST_CHECK(watch.GetDeltas(10, 11, vDeltas));
+    BOOST_REQUIRE_EQUAL(vDeltas.size(), 3U);
+    BOOST_CHECK(vDeltas[0].address == a && vDeltas[0].txid == TxId(1) && vDeltas[0].nDelta == 300);
+    BOOST_CHECK(vDeltas[1].address == b && vDeltas[1].nHeight == 10 && vDeltas[1].nDelta == 50);
+    BOOST_CHECK(vDeltas[2].address == b && vDeltas[2].nHeight == 11 && vDeltas[2].nDelta == -50);
+
+    // A disconnected block drops its deltas
+    watch.BlockUpdated(11, std::vector<std::pair<CAddressIndexKey, CAmount> >(), false);
+    vDeltas.clear();
+    BOOST_CHECK(watch.GetDeltas(10, 11, vDeltas));
+    BOOST_CHECK_EQUAL(vDeltas.size(), 2U);
+
+    // A newly watched address gets the entries of the recorded blocks only
+    watch.Insert(c);
+    vecEntries.clear();
+    vecEntries.push_back(Entry(c, 9, 4, 70));
+    vecEntries.push_back(Entry(c, 10, 1, 100));
+    watch.AddEntries(c, vecEntries);
+    vDeltas.clear();
+    BOOST_CHECK(watch.GetDeltas(10, 10, vDeltas));
+    BOOST_REQUIRE_EQUAL(vDeltas.size(), 3U);
+    BOOST_CHECK(vDeltas[2].address == c && vDeltas[2].nDelta == 100);
+
+    // Only the last three blocks are kept
+    for (int nHeight = 11; nHeight <= 13; ++nHeight)
+        watch.BlockUpdated(nHeight, std::vector<std::pair<CAddressIndexKey, CAmount> >(1, Entry(a, nHeight, 5, 1)), true);
+    BOOST_CHECK_EQUAL(watch.GetRecordedFrom(), 11);
+    vDeltas.clear();
+    BOOST_CHECK(!watch.GetDeltas(10, 13, vDeltas));
+    BOOST_CHECK(watch.GetDeltas(11, 13, vDeltas));
+    BOOST_CHECK_EQUAL(vDeltas.size(), 3U);
+
+    // Removing an address drops its deltas
+    watch.Erase(a);
+    vDeltas.clear();
+    BOOST_CHECK(watch.GetDeltas(11, 13, vDeltas));
+    BOOST_CHECK(vDeltas.empty());
+
+    // Disconnecting all of them starts over
+    watch.BlockUpdated(11, std::vector<std::pair<CAddressIndexKey, CAmount> >(), false);
+    BOOST_CHECK_EQUAL(watch.GetRecordedFrom(), -1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -24,6 +24,7 @@
 #include "smartnode/instantx.h"
 #include "smartnode/smartnode.h"
 #include "smarthive/hive.h"
+#include "spentindex.h"
 #include "timedata.h"
 #include "txmempool.h"
 #include "util.h"
@@ -31,6 +32,9 @@
 #include "utilmoneystr.h"
 
 #include <assert.h>
+#include <atomic>
+#include <functional>
+#include <thread>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
@@ -193,6 +197,108 @@ void CWallet::DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, u
         throw std::runtime_error(std::string(__func__) + ": AddHDPubKey failed");
 }
 
+void CWallet::DeriveNewChildKeys(const CKeyMetadata& metadata, uint32_t nAccountIndex, bool fInternal, size_t nCount, CWalletDB& walletdb, std::vector<CPubKey>& vPubKeysRet)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata, mapHdPubKeys
+
+    if (!nCount)
+        return;
+
+    CHDChain hdChainTmp;
+    if (!GetHDChain(hdChainTmp)) {
+        throw std::runtime_error(std::string(__func__) + ": GetHDChain failed");
+    }
+
+    if (!DecryptHDChain(hdChainTmp))
+        throw std::runtime_error(std::string(__func__) + ": DecryptHDChainSeed failed");
+    // make sure seed matches this chain
+    if (hdChainTmp.GetID() != hdChainTmp.GetSeedHash())
+        throw std::runtime_error(std::string(__func__) + ": Wrong HD chain!");
+
+    CHDAccount acc;
+    if (!hdChainTmp.GetAccount(nAccountIndex, acc))
+        throw std::runtime_error(std::string(__func__) + ": Wrong HD account!");
+
+    // The hardened part of the path is the same for all of them, each key is one derivation from there
+    CExtKey changeKey;
+    hdChainTmp.DeriveChangeExtKey(nAccountIndex, fInternal, changeKey);
+
+    uint32_t nChildIndex = fInternal ? acc.nInternalChainCounter : acc.nExternalChainCounter;
+    size_t nAdded = 0;
+    while (nAdded < nCount) {
+        size_t nDerive = nCount - nAdded;
+        std::vector<CExtKey> vChildKeys(nDerive);
+        std::vector<CExtPubKey> vChildPubKeys(nDerive);
+        std::atomic<size_t> nNext(0);
+        auto deriveKeys = [&]() {
+            for (size_t i = nNext++; i < nDerive; i = nNext++) {
+                changeKey.Derive(vChildKeys[i], nChildIndex + i);
+                vChildPubKeys[i] = vChildKeys[i].Neuter();
+                assert(vChildKeys[i].key.VerifyPubKey(vChildPubKeys[i].pubkey));
+            }
+        };
+        int nThreads = std::min<int>(std::min<int>(std::max<int>(std::thread::hardware_concurrency(), 1), MAX_KEYPOOL_DERIVE_THREADS), nDerive);
+        std::vector<std::thread> vThreads;
+        for (int i = 1; i < nThreads; ++i)
+            vThreads.emplace_back(deriveKeys);
+        deriveKeys();
+        for (std::thread& thread : vThreads)
+            thread.join();
+        nChildIndex += nDerive;
+
+        CHDChain hdChainCurrent;
+        GetHDChain(hdChainCurrent);
+
+        for (size_t i = 0; i < nDerive; ++i) {
+            const CPubKey& pubkey = vChildPubKeys[i].pubkey;
+            CKeyID keyID = pubkey.GetID();
+            // skip keys already known to the wallet
+            if (HaveKey(keyID))
+                continue;
+
+            mapKeyMetadata[keyID] = metadata;
+
+            CHDPubKey hdPubKey;
+            hdPubKey.extPubKey = vChildPubKeys[i];
+            hdPubKey.hdchainID = hdChainCurrent.GetID();
+            hdPubKey.nChangeIndex = fInternal ? 1 : 0;
+            mapHdPubKeys[keyID] = hdPubKey;
+
+            if (fFileBacked && !walletdb.WriteHDPubKey(hdPubKey, metadata))
+                throw std::runtime_error(std::string(__func__) + ": WriteHDPubKey failed");
+
+            vPubKeysRet.push_back(pubkey);
+            ++nAdded;
+        }
+    }
+
+    if (!nTimeFirstKey || metadata.nCreateTime < nTimeFirstKey)
+        nTimeFirstKey = metadata.nCreateTime;
+
+    // update the chain model in the database
+    CHDChain hdChainCurrent;
+    GetHDChain(hdChainCurrent);
+
+    if (fInternal) {
+        acc.nInternalChainCounter = nChildIndex;
+    }
+    else {
+        acc.nExternalChainCounter = nChildIndex;
+    }
+
+    if (!hdChainCurrent.SetAccount(nAccountIndex, acc))
+        throw std::runtime_error(std::string(__func__) + ": SetAccount failed");
+
+    if (IsCrypted()) {
+        if (!CCryptoKeyStore::SetCryptedHDChain(hdChainCurrent) || (fFileBacked && !walletdb.WriteCryptedHDChain(hdChainCurrent)))
+            throw std::runtime_error(std::string(__func__) + ": SetCryptedHDChain failed");
+    }
+    else {
+        if (!CCryptoKeyStore::SetHDChain(hdChainCurrent) || (fFileBacked && !walletdb.WriteHDChain(hdChainCurrent)))
+            throw std::runtime_error(std::string(__func__) + ": SetHDChain failed");
+    }
+}
+
 bool CWallet::GetPubKey(const CKeyID &address, CPubKey& vchPubKeyOut) const
 {
     LOCK(cs_wallet);
@@ -392,6 +498,48 @@ bool CWallet::LoadWatchOnly(const CScript &dest) {
     return CCryptoKeyStore::AddWatchOnly(dest);
 }
 
+bool CWallet::AddWatchAddress(const CWatchAddress &address)
+{
+    {
+        // No block may come in between reading the address index and recording its entries
+        LOCK(cs_main);
+        if (!watchAddresses.Insert(address))
+            return false;
+
+        int nRecordedFrom = watchAddresses.GetRecordedFrom();
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vecEntries;
+        if (nRecordedFrom >= 0 && chainActive.Height() >= nRecordedFrom) {
+            if (!GetAddressIndex(address.hashBytes, address.type, vecEntries, nRecordedFrom, chainActive.Height()))
+                LogPrintf("%s: failed to read the address index entries of a watched address\n", __func__);
+            watchAddresses.AddEntries(address, vecEntries);
+        }
+    }
+
+    if (!fFileBacked)
+        return true;
+    return CWalletDB(strWalletFile).WriteWatchAddress(address);
+}
+
+bool CWallet::RemoveWatchAddress(const CWatchAddress &address)
+{
+    if (!watchAddresses.Erase(address))
+        return false;
+    if (!fFileBacked)
+        return true;
+    return CWalletDB(strWalletFile).EraseWatchAddress(address);
+}
+
+bool CWallet::LoadWatchAddress(const CWatchAddress &address)
+{
+    watchAddresses.Insert(address);
+    return true;
+}
+
+void CWallet::AddressIndexUpdated(const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vecEntries, bool fConnected)
+{
+    watchAddresses.BlockUpdated(pindex->nHeight, vecEntries, fConnected);
+}
+
 bool CWallet::HaveVotingKey(const CKeyID &address) const
 {
     LOCK(cs_wallet);
@@ -1004,6 +1152,7 @@ bool CWallet::IsSpent(const uint256 &hash, unsigned int n) const {
 
 void CWallet::AddToSpends(const COutPoint &outpoint, const uint256 &wtxid) {
     mapTxSpends.insert(make_pair(outpoint, wtxid));
+    MarkTxDirty(outpoint.hash);
 
     pair <TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -1108,12 +1257,23 @@ bool CWallet::AccountMove(std::string strFrom, std::string strTo, CAmount nAmoun
 void CWallet::MarkDirty() {
     {
         LOCK(cs_wallet);
+        fBalancesCached = false;
+        fWalletUTXOCached = false;
+
         BOOST_FOREACH(PAIRTYPE(
         const uint256, CWalletTx)&item, mapWallet)
         item.second.MarkDirty();
     }
 }
 
+void CWallet::MarkTxDirty(const uint256& hash) const {
+    LOCK(cs_wallet);
+    if (fBalancesCached)
+        setBalancesDirty.insert(hash);
+    if (fWalletUTXOCached)
+        setWalletUTXODirty.insert(hash);
+}
+
 bool CWallet::AddToWallet(const CWalletTx &wtxIn, bool fFromLoadWallet, CWalletDB *pwalletdb) {
     LogPrint("selectcoins", "CWallet::AddToWallet\n");
     uint256 hash = wtxIn.GetHash();
@@ -1255,6 +1415,9 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction &tx, const CBlock *pbl
             if (pblock)
                 wtx.SetMerkleBranch(*pblock);
 
+            if (pwalletdbBatch)
+                return AddToWallet(wtx, false, pwalletdbBatch);
+
             // Do not flush the wallet here for performance reasons
             // this is safe, as in case of a crash, we rescan the necessary blocks on startup through our SetBestChain-mechanism
             CWalletDB walletdb(strWalletFile, "r+", false);
@@ -1402,6 +1565,40 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
     fAnonymizableTallyCachedNonDenom = false;
 }
 
+void CWallet::SyncTransactions(const std::vector<CTransactionRef>& vtx, const CBlock* pblock)
+{
+    LOCK2(cs_main, cs_wallet);
+
+    // Do not flush the wallet here for performance reasons, see AddToWalletIfInvolvingMe
+    CWalletDB walletdb(strWalletFile, "r+", false);
+    BeginTxBatch(walletdb);
+    for (const CTransactionRef& tx : vtx)
+        SyncTransaction(*tx, pblock);
+    EndTxBatch(walletdb);
+}
+
+void CWallet::BeginTxBatch(CWalletDB& walletdb)
+{
+    AssertLockHeld(cs_wallet);
+    assert(!pwalletdbBatch);
+    // Without the database transaction the records get written one by one as before
+    if (walletdb.TxnBegin())
+        pwalletdbBatch = &walletdb;
+    else
+        LogPrintf("%s: Failed to begin a wallet database transaction\n", __func__);
+}
+
+void CWallet::EndTxBatch(CWalletDB& walletdb)
+{
+    AssertLockHeld(cs_wallet);
+    if (!pwalletdbBatch)
+        return;
+    assert(pwalletdbBatch == &walletdb);
+    pwalletdbBatch = NULL;
+    if (!walletdb.TxnCommit())
+        LogPrintf("%s: Failed to commit the wallet database transaction\n", __func__);
+}
+
 
 isminetype CWallet::IsMine(const CTxIn &txin) const {
     {
@@ -1739,17 +1936,86 @@ bool CWalletTx::WriteToDisk(CWalletDB *pwalletdb)
     return pwalletdb->WriteTx(GetHash(), *this);
 }
 
+bool CWallet::GetAddressIndexKeys(std::set<std::pair<int, uint160> >& setKeysRet) const
+{
+    bool fComplete = true;
+
+    std::set<CKeyID> setKeyIDs;
+    GetKeys(setKeyIDs);
+    for (const CKeyID& keyID : setKeyIDs)
+        setKeysRet.insert(std::make_pair(1, keyID));
+
+    for (const CScriptID& scriptID : GetCScripts()) {
+        setKeysRet.insert(std::make_pair(2, scriptID));
+
+        // The wallet's multisig scripts can be paid to bare as well
+        CScript script;
+        txnouttype type;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        if (GetCScript(scriptID, script) && Solver(script, type, vSolutions) && type == TX_MULTISIG)
+            fComplete = false;
+    }
+
+    LOCK(cs_KeyStore);
+    for (const CScript& script : setWatchOnly) {
+        CTxDestination dest;
+        if (!ExtractDestination(script, dest)) {
+            fComplete = false;
+            continue;
+        }
+        if (const CKeyID* pkeyID = boost::get<CKeyID>(&dest)) {
+            setKeysRet.insert(std::make_pair(1, *pkeyID));
+        } else if (const CScriptID* pscriptID = boost::get<CScriptID>(&dest)) {
+            setKeysRet.insert(std::make_pair(2, *pscriptID));
+        } else {
+            fComplete = false;
+        }
+    }
+
+    return fComplete;
+}
+
+bool CWallet::GetRescanHeights(int nStartHeight, std::set<std::pair<int, uint160> >& setKeysDone, std::set<int>& setHeights) const
+{
+    std::set<std::pair<int, uint160> > setKeys;
+    GetAddressIndexKeys(setKeys);
+
+    for (const std::pair<int, uint160>& key : setKeys) {
+        if (setKeysDone.count(key))
+            continue;
+        if (!GetAddressIndexHeights(key.second, key.first, nStartHeight, setHeights))
+            return false;
+        setKeysDone.insert(key);
+    }
+
+    return true;
+}
+
 /**
- * Scan the block chain (starting in pindexStart) for transactions
- * from or to us. If fUpdate is true, found transactions that already
- * exist in the wallet will be updated.
+ * Scan the active chain from pindexStart on for transactions of the wallet.
+ *
+ * Only the blocks with transactions of the wallet's keys and scripts get read,
+ * their heights come from the address index. Keys the scan adds to the
+ * wallet, like the top-up of the keypool, are looked up as they appear. If the
+ * wallet has scripts whose outputs the address index doesn't cover, like bare
+ * multisig or watch-only scripts without an address, or with
+ * -rescanaddressindex=0 all blocks get read. Bare multisig outputs of the
+ * wallet's keys without such a script are missed on the index path.
+ *
+ * The blocks are read in batches by several threads without holding cs_main or
+ * cs_wallet, the locks are only held while a batch gets added to the wallet.
+ * Blocks which are no longer in the active chain by then are skipped, the scan
+ * goes on at the fork.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex *pindexStart, bool fUpdate) {
     int ret = 0;
     int64_t nNow = GetTime();
+    int64_t nTimeStart = GetTimeMillis();
+    int nBlocksRead = 0;
     const CChainParams &chainParams = Params();
 
     CBlockIndex *pindex = pindexStart;
+    double dProgressStart, dProgressTip;
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -1760,33 +2026,119 @@ int CWallet::ScanForWalletTransactions(CBlockIndex *pindexStart, bool fUpdate) {
 
         ShowProgress(_("Rescanning..."),
                      0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(),
-                                                                     false);
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99,
-                                                                      (int) ((Checkpoints::GuessVerificationProgress(
-                                                                              chainParams.Checkpoints(), pindex,
-                                                                              false) - dProgressStart) /
-                                                                             (dProgressTip - dProgressStart) * 100))));
-
-            CBlock block;
-            ReadBlockFromDisk(block, pindex, Params().GetConsensus());
-            BOOST_FOREACH(CTransaction & tx, block.vtx)
+        dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
+    }
+
+    bool fUseIndex = pindex != NULL && GetBoolArg("-rescanaddressindex", DEFAULT_RESCAN_ADDRESS_INDEX);
+    std::set<std::pair<int, uint160> > setKeysDone;
+    std::set<int> setHeights;
+    int nStartHeight = pindex ? pindex->nHeight : 0;
+    if (fUseIndex) {
+        std::set<std::pair<int, uint160> > setKeys;
+        if (!GetAddressIndexKeys(setKeys)) {
+            LogPrintf("%s: The wallet has scripts without address index entries, scanning all blocks\n", __func__);
+            fUseIndex = false;
+        } else if (!GetRescanHeights(nStartHeight, setKeysDone, setHeights)) {
+            LogPrintf("%s: Address index lookup failed, scanning all blocks\n", __func__);
+            fUseIndex = false;
+        } else {
+            LogPrintf("%s: Reading only the blocks the address index has for the wallet, bare multisig outputs are not found. "
+                      "Use -rescanaddressindex=0 to read all blocks.\n", __func__);
+        }
+    }
+
+    while (pindex) {
+        std::vector<CBlockIndex*> vIndex;
+        std::vector<CDiskBlockPos> vPos;
+        {
+            LOCK(cs_main);
+            while (pindex && vIndex.size() < (size_t)WALLET_RESCAN_BATCH_BLOCKS) {
+                if (fUseIndex) {
+                    std::set<int>::const_iterator it = setHeights.lower_bound(pindex->nHeight);
+                    pindex = it != setHeights.end() ? chainActive[*it] : NULL;
+                    if (!pindex)
+                        break;
+                }
+                vIndex.push_back(pindex);
+                vPos.push_back(pindex->GetBlockPos());
+                pindex = chainActive.Next(pindex);
+            }
+        }
+
+        if (vIndex.empty())
+            break;
+
+        // The positions of the blocks on disk don't change, they can be read without cs_main
+        std::vector<CBlock> vBlocks(vIndex.size());
+        std::vector<char> vRead(vIndex.size(), 0);
+        std::atomic<size_t> nNext(0);
+        auto readBlocks = [&]() {
+            for (size_t i = nNext++; i < vPos.size(); i = nNext++)
+                vRead[i] = ReadBlockFromDisk(vBlocks[i], vPos[i], chainParams.GetConsensus());
+        };
+        std::vector<std::thread> vThreads;
+        for (int i = 1; i < std::min<int>(WALLET_RESCAN_READ_THREADS, vPos.size()); ++i)
+            vThreads.emplace_back(readBlocks);
+        readBlocks();
+        for (std::thread& thread : vThreads)
+            thread.join();
+        nBlocksRead += vIndex.size();
+
+        LOCK2(cs_main, cs_wallet);
+
+        CWalletDB walletdb(strWalletFile, "r+", false);
+        BeginTxBatch(walletdb);
+        for (size_t i = 0; i < vIndex.size(); ++i) {
+            if (!chainActive.Contains(vIndex[i])) {
+                // Reorganized while the locks were released, the connected blocks were synced already
+                pindex = chainActive.Next(chainActive.FindFork(vIndex[i]));
+                break;
+            }
+            if (!vRead[i]) {
+                LogPrintf("%s: Failed to read block %s at height %d\n", __func__, vIndex[i]->GetBlockHash().ToString(), vIndex[i]->nHeight);
+                continue;
+            }
+            for (const CTransactionRef& tx : vBlocks[i].vtx)
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
+                if (AddToWalletIfInvolvingMe(*tx, &vBlocks[i], fUpdate))
                     ret++;
             }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight,
-                          Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+        }
+        EndTxBatch(walletdb);
+
+        CBlockIndex* pindexLast = vIndex.back();
+
+        // Keys added by the scan, their blocks can be behind the batch as well
+        if (fUseIndex) {
+            std::set<int> setNewHeights;
+            if (!GetRescanHeights(nStartHeight, setKeysDone, setNewHeights)) {
+                LogPrintf("%s: Address index lookup failed, scanning all blocks\n", __func__);
+                fUseIndex = false;
+                // The blocks skipped so far get read as well
+                pindex = chainActive[nStartHeight];
+            } else if (!setNewHeights.empty()) {
+                setHeights.insert(setNewHeights.begin(), setNewHeights.end());
+                if (!pindex || *setNewHeights.begin() < pindex->nHeight)
+                    pindex = chainActive[*setNewHeights.begin()];
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+        if (dProgressTip - dProgressStart > 0.0)
+            ShowProgress(_("Rescanning..."), std::max(1, std::min(99,
+                (int) ((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindexLast, false) - dProgressStart) /
+                       (dProgressTip - dProgressStart) * 100))));
+
+        if (GetTime() >= nNow + 60) {
+            nNow = GetTime();
+            LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindexLast->nHeight,
+                      Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindexLast));
+        }
     }
+
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+    LogPrintf("%s: Read %d blocks%s, found %d transactions in %dms\n", __func__, nBlocksRead,
+              fUseIndex ? " found by the address index" : "", ret, GetTimeMillis() - nTimeStart);
     return ret;
 }
 
@@ -1839,6 +2191,7 @@ bool CWalletTx::RelayWalletTransaction(CConnman* connman, std::string strCommand
             }
             if (connman) {
                 connman->RelayTransaction((CTransaction)*this);
+                pwallet->MarkTxRelayed(hash);
                 return true;
             }
         }
@@ -1856,6 +2209,20 @@ set <uint256> CWalletTx::GetConflicts() const {
     return result;
 }
 
+void CWalletTx::MarkDirty() {
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+
+    if (pwallet)
+        pwallet->MarkTxDirty(GetHash());
+}
+
 CAmount CWalletTx::GetDebit(const isminefilter &filter) const {
     if (vin.empty())
         return 0;
@@ -2052,16 +2419,26 @@ bool CWalletTx::IsEquivalentTo(const CWalletTx &tx) const {
     return CTransaction(tx1) == CTransaction(tx2);
 }
 
-std::vector<uint256> CWallet::ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman)
+void CWallet::MarkTxRelayed(const uint256& hash) const
+{
+    LOCK(cs_wallet);
+    mapTxRelayed[hash] = GetTime();
+}
+
+std::vector<uint256> CWallet::ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman, bool fForce)
 {
     std::vector<uint256> result;
 
-    LOCK(cs_wallet);
+    LOCK2(cs_main, cs_wallet);
     // Sort them in chronological order
     multimap<unsigned int, CWalletTx*> mapSorted;
     BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
     {
         CWalletTx& wtx = item.second;
+        if (wtx.IsCoinBase() || wtx.isAbandoned() || wtx.GetDepthInMainChain() != 0) {
+            mapTxRelayed.erase(item.first);
+            continue;
+        }
         // Don't rebroadcast if newer than nTime:
         if (wtx.nTimeReceived > nTime)
             continue;
@@ -2070,6 +2447,15 @@ std::vector<uint256> CWallet::ResendWalletTransactionsBefore(int64_t nTime, CCon
     BOOST_FOREACH(PAIRTYPE(const unsigned int, CWalletTx*)& item, mapSorted)
     {
         CWalletTx& wtx = *item.second;
+        if (!wtx.InMempool()) {
+            // Evicted or expired, the peers are unlikely to keep it either
+            LOCK(mempool.cs);
+            if (!wtx.AcceptToMemoryPool(false))
+                continue;
+        } else if (!fForce && mapTxRelayed.count(wtx.GetHash())) {
+            // Our own mempool has it and the peers got the inventory already
+            continue;
+        }
         if (wtx.RelayWalletTransaction(connman))
             result.push_back(wtx.GetHash());
     }
@@ -2110,18 +2496,84 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-CAmount CWallet::GetBalance(bool countLocked) const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit(true, countLocked);
+void CWallet::AddTxBalances(const CWalletTx& wtx) const {
+    const uint256& hash = wtx.GetHash();
+    CWalletBalances balances;
+
+    if (wtx.IsTrusted()) {
+        balances.nTrusted = wtx.GetAvailableCredit(true, true);
+        balances.nTrustedUnlocked = wtx.GetAvailableCredit(true, false);
+        balances.nWatchOnlyTrusted = wtx.GetAvailableWatchOnlyCredit();
+    } else if (wtx.GetDepthInMainChain() == 0 && wtx.InMempool()) {
+        balances.nUntrusted = wtx.GetAvailableCredit();
+        balances.nWatchOnlyUntrusted = wtx.GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature = wtx.GetImmatureCredit();
+    balances.nWatchOnlyImmature = wtx.GetImmatureWatchOnlyCredit();
+
+    // Trust, maturity and time locks change with the chain and the mempool
+    bool fPending = wtx.GetDepthInMainChain() < 1 || wtx.GetBlocksToMaturity() > 0;
+    for (unsigned int i = 0; i < wtx.vout.size() && !fPending; i++)
+        fPending = IsTimeLockedCoin(wtx.vout[i]);
+
+    if (fPending)
+        setBalancesPending.insert(hash);
+
+    if (!balances.IsNull()) {
+        mapTxBalances[hash] = balances;
+        balancesCached += balances;
+    }
+}
+
+const CWalletBalances& CWallet::GetCachedBalances() const {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    uint256 hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+
+    if (fBalancesCached && hashTip != hashBalancesTip) {
+        BlockMap::const_iterator mi = mapBlockIndex.find(hashBalancesTip);
+        if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+            fBalancesCached = false;
+    }
+
+    if (!fBalancesCached) {
+        balancesCached = CWalletBalances();
+        mapTxBalances.clear();
+        setBalancesDirty.clear();
+        setBalancesPending.clear();
+
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            AddTxBalances(it->second);
+
+        fBalancesCached = true;
+    } else {
+        setBalancesDirty.insert(setBalancesPending.begin(), setBalancesPending.end());
+
+        for (const uint256& hash : setBalancesDirty) {
+            std::map<uint256, CWalletBalances>::iterator itBalances = mapTxBalances.find(hash);
+            if (itBalances != mapTxBalances.end()) {
+                balancesCached -= itBalances->second;
+                mapTxBalances.erase(itBalances);
+            }
+            setBalancesPending.erase(hash);
+
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it != mapWallet.end())
+                AddTxBalances(it->second);
         }
+
+        setBalancesDirty.clear();
     }
 
-    return nTotal;
+    hashBalancesTip = hashTip;
+    return balancesCached;
+}
+
+CAmount CWallet::GetBalance(bool countLocked) const {
+    LOCK2(cs_main, cs_wallet);
+    const CWalletBalances& balances = GetCachedBalances();
+    return countLocked ? balances.nTrusted : balances.nTrustedUnlocked;
 }
 
 // CAmount CWallet::GetAnonymizableBalance(bool fSkipDenominated, bool fSkipUnconfirmed) const
@@ -2248,55 +2700,23 @@ CAmount CWallet::GetBalance(bool countLocked) const {
 // }
 
 CAmount CWallet::GetUnconfirmedBalance() const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalances().nUntrusted;
 }
 
 CAmount CWallet::GetImmatureBalance() const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalances().nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalances().nWatchOnlyUntrusted;
 }
 
 // bool CWallet::IsDenominated(const CTxIn &txin) const
@@ -2340,15 +2760,39 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const {
 // }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const CWalletTx *pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
+    LOCK2(cs_main, cs_wallet);
+    return GetCachedBalances().nWatchOnlyImmature;
+}
+
+void CWallet::UpdateWalletUTXO() const {
+    AssertLockHeld(cs_main); // IsSpent
+    AssertLockHeld(cs_wallet);
+
+    auto addOutputs = [this](const uint256& hash, const CWalletTx& wtx) {
+        for (unsigned int i = 0; i < wtx.vout.size(); ++i) {
+            if (IsMine(wtx.vout[i]) && !IsSpent(hash, i))
+                setWalletUTXO.insert(COutPoint(hash, i));
+        }
+    };
+
+    if (!fWalletUTXOCached) {
+        setWalletUTXO.clear();
+        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            addOutputs(it->first, it->second);
+        fWalletUTXOCached = true;
+    } else {
+        for (const uint256& hash : setWalletUTXODirty) {
+            std::set<COutPoint>::iterator itUTXO = setWalletUTXO.lower_bound(COutPoint(hash, 0));
+            while (itUTXO != setWalletUTXO.end() && itUTXO->hash == hash)
+                setWalletUTXO.erase(itUTXO++);
+
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
+            if (it != mapWallet.end())
+                addOutputs(it->first, it->second);
         }
     }
-    return nTotal;
+
+    setWalletUTXODirty.clear();
 }
 
 void CWallet::AvailableCoins(vector <COutput> &vCoins, bool fOnlyConfirmed, const CCoinControl *coinControl,
@@ -2357,8 +2801,17 @@ void CWallet::AvailableCoins(vector <COutput> &vCoins, bool fOnlyConfirmed, cons
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256 &wtxid = it->first;
+        UpdateWalletUTXO();
+
+        for (std::set<COutPoint>::const_iterator itUTXO = setWalletUTXO.begin(); itUTXO != setWalletUTXO.end();) {
+            const uint256 wtxid = itUTXO->hash;
+            std::vector<unsigned int> vOutputs;
+            for (; itUTXO != setWalletUTXO.end() && itUTXO->hash == wtxid; ++itUTXO)
+                vOutputs.push_back(itUTXO->n);
+
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(wtxid);
+            if (it == mapWallet.end())
+                continue;
             const CWalletTx *pcoin = &(*it).second;
 
             if (!CheckFinalTx(*pcoin))
@@ -2380,7 +2833,7 @@ void CWallet::AvailableCoins(vector <COutput> &vCoins, bool fOnlyConfirmed, cons
             if (nDepth == 0 && !pcoin->InMempool())
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+            for (unsigned int i : vOutputs) {
                 bool found = false;
                 if(nCoinType == ONLY_DENOMINATED) {
                     //found = CPrivateSend::IsDenominatedAmount(pcoin->vout[i].nValue);
@@ -2421,9 +2874,17 @@ void CWallet::AvailableCoins(vector <COutput> &vCoins, const CSmartAddress& addr
         LOCK2(cs_main, cs_wallet);
 
         CScript addressScript = address.GetScript();
+        UpdateWalletUTXO();
 
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256 &wtxid = it->first;
+        for (std::set<COutPoint>::const_iterator itUTXO = setWalletUTXO.begin(); itUTXO != setWalletUTXO.end();) {
+            const uint256 wtxid = itUTXO->hash;
+            std::vector<unsigned int> vOutputs;
+            for (; itUTXO != setWalletUTXO.end() && itUTXO->hash == wtxid; ++itUTXO)
+                vOutputs.push_back(itUTXO->n);
+
+            map<uint256, CWalletTx>::const_iterator it = mapWallet.find(wtxid);
+            if (it == mapWallet.end())
+                continue;
             const CWalletTx *pcoin = &(*it).second;
 
             if (!CheckFinalTx(*pcoin))
@@ -2442,7 +2903,7 @@ void CWallet::AvailableCoins(vector <COutput> &vCoins, const CSmartAddress& addr
             if (nDepth == 0 && !pcoin->InMempool())
                 continue;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+            for (unsigned int i : vOutputs) {
 
                 if( pcoin->vout[i].scriptPubKey != addressScript)
                     continue;
@@ -2632,21 +3093,85 @@ bool less_then_denom (const COutput& out1, const COutput& out2)
     return false;
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const uint64_t nMaxAncestors, vector<COutput> vCoins,
+/**
+ * Depth first search for a subset of vValue, sorted by descending value, which adds up to at least
+ * nTargetValue and less than nTargetValue + nCostOfChange, and no more than nMaxTotal. A change
+ * output below nCostOfChange would be dust which goes to the fee anyway, so such a subset makes
+ * a transaction without change. The smallest sum in the first BNB_TOTAL_TRIES steps wins.
+ */
+static bool SelectCoinsBnB(const vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >& vValue, const CAmount& nTargetValue,
+                           const CAmount& nCostOfChange, const CAmount& nMaxTotal, vector<char>& vfBest, CAmount& nBest)
+{
+    CAmount nAvailable = 0;
+    for (unsigned int i = 0; i < vValue.size(); i++)
+        nAvailable += vValue[i].first;
+
+    vector<char> vfSelected;
+    CAmount nSelected = 0;
+    bool fFound = false;
+
+    for (int nTries = 0; nTries < BNB_TOTAL_TRIES; nTries++)
+    {
+        bool fBacktrack = false;
+        if (nSelected + nAvailable < nTargetValue || nSelected >= nTargetValue + nCostOfChange || nSelected > nMaxTotal) {
+            fBacktrack = true;
+        } else if (nSelected >= nTargetValue) {
+            if (!fFound || nSelected < nBest) {
+                fFound = true;
+                nBest = nSelected;
+                vfBest = vfSelected;
+                if (nBest == nTargetValue)
+                    break;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Back to the last coin which was included and leave it out
+            while (!vfSelected.empty() && !vfSelected.back()) {
+                vfSelected.pop_back();
+                nAvailable += vValue[vfSelected.size()].first;
+            }
+            if (vfSelected.empty())
+                break;
+            vfSelected.back() = false;
+            nSelected -= vValue[vfSelected.size() - 1].first;
+        } else {
+            const CAmount& n = vValue[vfSelected.size()].first;
+            nAvailable -= n;
+            // Including a coin of the same value as the one left out just before gives the same sums again
+            if (!vfSelected.empty() && !vfSelected.back() && n == vValue[vfSelected.size() - 1].first) {
+                vfSelected.push_back(false);
+            } else {
+                vfSelected.push_back(true);
+                nSelected += n;
+            }
+        }
+    }
+
+    if (fFound)
+        vfBest.resize(vValue.size(), false);
+    return fFound;
+}
+
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, const uint64_t nMaxAncestors, const vector<COutput>& vAvailableCoins,
                                  set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, bool fUseInstantSend) const
 {
         setCoinsRet.clear();
     nValueRet = 0;
 
     // List of values less than target
-    pair<CAmount, pair<const CWalletTx*,unsigned int> > coinLowestLarger;
-    coinLowestLarger.first = fUseInstantSend
+    const CAmount nMaxTotal = fUseInstantSend
                                         ? sporkManager.GetSporkValue(SPORK_5_INSTANTSEND_MAX_VALUE)*COIN
                                         : std::numeric_limits<CAmount>::max();
+    pair<CAmount, pair<const CWalletTx*,unsigned int> > coinLowestLarger;
+    coinLowestLarger.first = nMaxTotal;
     coinLowestLarger.second.first = NULL;
     vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vValue;
     CAmount nTotalLower = 0;
 
+    // Shuffle references, the coins stay where they are
+    vector<std::reference_wrapper<const COutput> > vCoins(vAvailableCoins.begin(), vAvailableCoins.end());
     random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
 
     // move denoms down on the list
@@ -2723,11 +3248,28 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
 
     }
 
-    // Solve subset sum by stochastic approximation
     sort(vValue.rbegin(), vValue.rend(), CompareValueOnly());
     vector<char> vfBest;
     CAmount nBest;
 
+    // A subset without change first, the change output would be a P2PKH one
+    CScript scriptChange = CScript() << OP_DUP << OP_HASH160 << ToByteVector(uint160()) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CAmount nCostOfChange = std::min(CTxOut(0, scriptChange).GetDustThreshold(::minRelayTxFee), MIN_CHANGE);
+    if (SelectCoinsBnB(vValue, nTargetValue, nCostOfChange, nMaxTotal, vfBest, nBest)) {
+        for (unsigned int i = 0; i < vValue.size(); i++)
+        {
+            if (vfBest[i])
+            {
+                setCoinsRet.insert(vValue[i].second);
+                nValueRet += vValue[i].first;
+            }
+        }
+        LogPrint("selectcoins", "CWallet::SelectCoinsMinConf branch and bound: %d coins - total %s\n", setCoinsRet.size(), FormatMoney(nBest));
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation
+
     ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest, fUseInstantSend);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
         ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest, fUseInstantSend);
@@ -2757,15 +3299,12 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     return true;
 }
 
-bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, AvailableCoinsType nCoinType, bool fUseInstantSend) const
+bool CWallet::SelectCoins(const vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl, bool fUseInstantSend) const
 {
-    vector<COutput> vCoins;
-    AvailableCoins(vCoins, true, coinControl, false, nCoinType, fUseInstantSend);
-
     // coin control -> return all selected outputs (we want all selected to go into the transaction for sure)
     if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs) {
         BOOST_FOREACH(
-        const COutput &out, vCoins)
+        const COutput &out, vAvailableCoins)
         {
             if (!out.fSpendable)
                 continue;
@@ -2797,14 +3336,16 @@ bool CWallet::SelectCoins(const CAmount& nTargetValue, set<pair<const CWalletTx*
             return false; // TODO: Allow non-wallet inputs
     }
 
-    // remove preset inputs from vCoins
-    for (vector<COutput>::iterator it = vCoins.begin();
-         it != vCoins.end() && coinControl && coinControl->HasSelected();) {
-        if (setPresetCoins.count(make_pair(it->tx, it->i)))
-            it = vCoins.erase(it);
-        else
-            ++it;
+    // remove preset inputs from vCoins, only then it's a copy
+    vector<COutput> vCoinsWithoutPreset;
+    if (coinControl && coinControl->HasSelected()) {
+        BOOST_FOREACH(const COutput &out, vAvailableCoins)
+        {
+            if (!setPresetCoins.count(make_pair(out.tx, out.i)))
+                vCoinsWithoutPreset.push_back(out);
+        }
     }
+    const vector<COutput>& vCoins = coinControl && coinControl->HasSelected() ? vCoinsWithoutPreset : vAvailableCoins;
 
     size_t nMaxChainLength = std::min(GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT),
                                       GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT));
@@ -3064,7 +3605,7 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
         LOCK2(cs_main, cs_wallet);
         {
             std::vector <COutput> vAvailableCoins;
-            AvailableCoins(vAvailableCoins, true, coinControl);
+            AvailableCoins(vAvailableCoins, true, coinControl, false, nCoinType, fUseInstantSend);
 
             nFeeRet = payTxFee.GetFeePerK();
             // Start with no fee and loop until there is enough fee
@@ -3113,7 +3654,7 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                 // Choose coins to use
                 set <pair<const CWalletTx *, unsigned int>> setCoins;
                 CAmount nValueIn = 0;
-                if (!SelectCoins(nValueToSelect, setCoins, nValueIn, coinControl, nCoinType, fUseInstantSend))
+                if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, coinControl, fUseInstantSend))
                 {
                     if (nValueIn < nValueToSelect) {
                         strFailReason = _("Insufficient funds.");
@@ -3306,24 +3847,25 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                     txNew.vin.push_back(CTxIn(coin.first->GetHash(), coin.second, CScript(), std::numeric_limits < unsigned int > ::max() - 1));
 
                 // Sign
-                int nIn = 0;
-                CTransaction txNewConst(txNew);
+                std::vector<CScript> vScriptPubKeys;
                 BOOST_FOREACH(const PAIRTYPE(const CWalletTx *, unsigned int) &coin, setCoins)
-                {
-                    bool signSuccess;
-                    const CScript &scriptPubKey = coin.first->vout[coin.second].scriptPubKey;
-                    CScript& scriptSigRes = txNew.vin[nIn].scriptSig;
-                    if (sign)
-                        signSuccess = ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, SIGHASH_ALL), scriptPubKey, scriptSigRes);
-                    else
-                        signSuccess = ProduceSignature(DummySignatureCreator(this), scriptPubKey, scriptSigRes);
+                    vScriptPubKeys.push_back(coin.first->vout[coin.second].scriptPubKey);
+
+                bool signSuccess = true;
+                if (sign) {
+                    std::vector<CScript> vScriptSigs;
+                    signSuccess = ProduceSignatures(*this, CTransaction(txNew), vScriptPubKeys, SIGHASH_ALL, vScriptSigs);
+                    for (unsigned int nIn = 0; nIn < txNew.vin.size(); nIn++)
+                        txNew.vin[nIn].scriptSig = vScriptSigs[nIn];
+                } else {
+                    for (unsigned int nIn = 0; nIn < txNew.vin.size() && signSuccess; nIn++)
+                        signSuccess = ProduceSignature(DummySignatureCreator(this), vScriptPubKeys[nIn], txNew.vin[nIn].scriptSig);
+                }
 
-                    if (!signSuccess)
-                    {
-                        strFailReason = _("Signing transaction failed");
-                        return false;
-                    }
-                    nIn++;
+                if (!signSuccess)
+                {
+                    strFailReason = _("Signing transaction failed");
+                    return false;
                 }
 
                 unsigned int nBytes = ::GetSerializeSize(txNew, SER_NETWORK, PROTOCOL_VERSION);
@@ -3387,7 +3929,7 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
     if (GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS)) {
         // Lastly, ensure this tx will pass the mempool's chain limits
         LockPoints lp;
-        CTxMemPoolEntry entry(txNew, 0, 0, 0, 0, false, 0, false, 0, lp);
+        CTxMemPoolEntry entry(MakeTransactionRef(txNew), 0, 0, 0, 0, false, 0, false, 0, lp);
         CTxMemPool::setEntries setAncestors;
         size_t nLimitAncestors = GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
         size_t nLimitAncestorSize = GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
@@ -3464,8 +4006,10 @@ bool CWallet::EraseFromWallet(uint256 hash)
         return false;
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        if (mapWallet.erase(hash)) {
+            MarkTxDirty(hash);
             CWalletDB(strWalletFile).EraseTx(hash);
+        }
     }
     return true;
 }
@@ -3527,13 +4071,8 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (auto& pair : mapWallet) {
-            for(unsigned int i = 0; i < pair.second.vout.size(); ++i) {
-                if (IsMine(pair.second.vout[i]) && !IsSpent(pair.first, i)) {
-                    setWalletUTXO.insert(COutPoint(pair.first, i));
-                }
-            }
-        }
+        fWalletUTXOCached = false;
+        UpdateWalletUTXO();
     }
 
     if (nLoadWalletRet != DB_LOAD_OK)
@@ -3687,35 +4226,67 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize) {
             missingInternal = 0;
         }
 
-        bool fInternal = false;
+        if (!missingInternal && !missingExternal)
+            return true;
+
         CWalletDB walletdb(strWalletFile);
-        for (int64_t i = missingInternal + missingExternal; i--;)
-        {
-            int64_t nEnd = 1;
-            if (i < missingInternal) {
-                fInternal = true;
-            }
-            if (!setInternalKeyPool.empty()) {
-                nEnd = *(--setInternalKeyPool.end()) + 1;
-            }
-            if (!setExternalKeyPool.empty()) {
-                nEnd = std::max(nEnd, *(--setExternalKeyPool.end()) + 1);
-            }
+        int64_t nEnd = 1;
+        if (!setInternalKeyPool.empty()) {
+            nEnd = *(--setInternalKeyPool.end()) + 1;
+        }
+        if (!setExternalKeyPool.empty()) {
+            nEnd = std::max(nEnd, *(--setExternalKeyPool.end()) + 1);
+        }
+
+        // The external keys come first in the pool, then the internal ones
+        std::vector<CPubKey> vExternal, vInternal;
+        bool fHD = IsHDEnabled();
+        if (!fHD) {
+            for (int64_t i = 0; i < missingExternal; i++)
+                vExternal.push_back(GenerateNewKey(0, false));
+        }
+
+        // The derived keys and the pool entries get written in one database transaction
+        if (!walletdb.TxnBegin())
+            throw runtime_error("TopUpKeyPool(): TxnBegin failed");
+
+        if (fHD) {
             // TODO: implement keypools for all accounts?
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey(0, fInternal), fInternal)))
+            CKeyMetadata metadata(GetTime());
+            DeriveNewChildKeys(metadata, 0, false, missingExternal, walletdb, vExternal);
+            DeriveNewChildKeys(metadata, 0, true, missingInternal, walletdb, vInternal);
+        }
+
+        for (const CPubKey& pubkey : vExternal) {
+            if (!walletdb.WritePool(nEnd, CKeyPool(pubkey, false)))
+                throw runtime_error("TopUpKeyPool(): writing generated key failed");
+            setExternalKeyPool.insert(nEnd++);
+        }
+        for (const CPubKey& pubkey : vInternal) {
+            if (!walletdb.WritePool(nEnd, CKeyPool(pubkey, true)))
                 throw runtime_error("TopUpKeyPool(): writing generated key failed");
+            setInternalKeyPool.insert(nEnd++);
+        }
 
-            if (fInternal) {
-                setInternalKeyPool.insert(nEnd);
-            } else {
-                setExternalKeyPool.insert(nEnd);
+        if (!walletdb.TxnCommit())
+            throw runtime_error("TopUpKeyPool(): TxnCommit failed");
+
+        // check if we need to remove from watch-only, outside of the transaction as it writes on its own
+        if (fHD) {
+            vExternal.insert(vExternal.end(), vInternal.begin(), vInternal.end());
+            for (const CPubKey& pubkey : vExternal) {
+                CScript script = GetScriptForDestination(pubkey.GetID());
+                if (HaveWatchOnly(script))
+                    RemoveWatchOnly(script);
+                script = GetScriptForRawPubKey(pubkey);
+                if (HaveWatchOnly(script))
+                    RemoveWatchOnly(script);
             }
-            LogPrintf("keypool added key %d, size=%u, internal=%d\n", nEnd, setInternalKeyPool.size() + setExternalKeyPool.size(), fInternal);
-
-            double dProgress = 100.f * nEnd / (nTargetSize + 1);
-            std::string strMsg = strprintf(_("Loading wallet... (%3.2f %%)"), dProgress);
-            uiInterface.InitMessage(strMsg);
         }
+
+        if (!vExternal.empty())
+            LogPrintf("keypool added %u keys (%u internal), size=%u\n", vExternal.size(), vInternal.size(),
+                      setInternalKeyPool.size() + setExternalKeyPool.size());
     }
     return true;
 }
@@ -4072,16 +4643,19 @@ void CWallet::GetScriptForMining(boost::shared_ptr <CReserveScript> &script) {
 void CWallet::LockCoin(const COutPoint &output) {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    MarkTxDirty(output.hash);
 }
 
 void CWallet::UnlockCoin(const COutPoint &output) {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    MarkTxDirty(output.hash);
 }
 
 void CWallet::UnlockAllCoins() {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    fBalancesCached = false;
 }
 
 bool CWallet::IsLockedCoin(uint256 hash, unsigned int n) const {
@@ -4257,6 +4831,8 @@ std::string CWallet::GetWalletHelpString(bool showDebug) {
                                strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"),
                                          CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
+    strUsage += HelpMessageOpt("-rescanaddressindex", strprintf(_("Rescan only the blocks the address index has for the wallet's addresses, without bare multisig outputs (default: %u)"),
+                                                                 DEFAULT_RESCAN_ADDRESS_INDEX));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     if (showDebug)
         strUsage += HelpMessageOpt("-sendfreetransactions",
@@ -4279,6 +4855,8 @@ std::string CWallet::GetWalletHelpString(bool showDebug) {
                                                    strprintf(_("(default: %u)"), DEFAULT_WALLETBROADCAST));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>",
                                _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)"));
+    strUsage += HelpMessageOpt("-watchdeltablocks=<n>", strprintf(_("Keep the transactions of the watched addresses of importwatchaddresses for the last <n> blocks in memory (default: %u)"),
+                                                        DEFAULT_WATCH_DELTA_BLOCKS));
     strUsage += HelpMessageOpt("-zapwallettxes=<mode>",
                                _("Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup") +
                                " " +
@@ -4424,7 +5002,7 @@ int CMerkleTx::SetMerkleBranch(const CBlock &block) {
 
     // Locate the transaction
     for (nIndex = 0; nIndex < (int) block.vtx.size(); nIndex++)
-        if (block.vtx[nIndex] == *(CTransaction * )this)
+        if (*block.vtx[nIndex] == *(CTransaction * )this)
     break;
     if (nIndex == (int) block.vtx.size()) {
         nIndex = -1;
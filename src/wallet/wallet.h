@@ -18,6 +18,7 @@
 #include "smarthive/hive.h"
 #include "wallet/crypter.h"
 #include "wallet/walletdb.h"
+#include "wallet/watchaddresses.h"
 #include "wallet/rpcwallet.h"
 
 #include <algorithm>
@@ -52,6 +53,8 @@ static const CAmount DEFAULT_FALLBACK_FEE = 2000;
 static const CAmount DEFAULT_TRANSACTION_MINFEE = 1000;
 //! minimum change amount
 static const CAmount MIN_CHANGE = .1 * CENT;
+//! Steps of the branch and bound coin selection before it takes the best subset so far
+static const int BNB_TOTAL_TRIES = 100000;
 //! Default for -spendzeroconfchange
 static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = false;  //was true
 //! Default for -sendfreetransactions
@@ -69,6 +72,15 @@ static const bool DEFAULT_WALLETBROADCAST = true;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
 
+//! Whether a rescan only reads the blocks the address index has for the wallet
+static const bool DEFAULT_RESCAN_ADDRESS_INDEX = true;
+//! Blocks a rescan reads at once, the locks get released in between
+static const int WALLET_RESCAN_BATCH_BLOCKS = 64;
+//! Threads reading the blocks of a rescan batch
+static const int WALLET_RESCAN_READ_THREADS = 4;
+//! Most threads deriving the HD keys of a keypool top-up
+static const int MAX_KEYPOOL_DERIVE_THREADS = 8;
+
 extern const char * DEFAULT_WALLET_DAT;
 
 class CBlockIndex;
@@ -401,17 +413,8 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    //! Break the caches of the credits and debits, and the part of the wallet balances
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -588,6 +591,51 @@ private:
 };
 
 
+/** Balances of the wallet, or the part of a single transaction of them */
+struct CWalletBalances
+{
+    CAmount nTrusted;            //! GetBalance()
+    CAmount nTrustedUnlocked;    //! GetBalance(false), without locked and time-locked coins
+    CAmount nUntrusted;          //! GetUnconfirmedBalance()
+    CAmount nImmature;           //! GetImmatureBalance()
+    CAmount nWatchOnlyTrusted;   //! GetWatchOnlyBalance()
+    CAmount nWatchOnlyUntrusted; //! GetUnconfirmedWatchOnlyBalance()
+    CAmount nWatchOnlyImmature;  //! GetImmatureWatchOnlyBalance()
+
+    CWalletBalances() : nTrusted(0), nTrustedUnlocked(0), nUntrusted(0), nImmature(0),
+                        nWatchOnlyTrusted(0), nWatchOnlyUntrusted(0), nWatchOnlyImmature(0) {}
+
+    bool IsNull() const
+    {
+        return !nTrusted && !nTrustedUnlocked && !nUntrusted && !nImmature &&
+               !nWatchOnlyTrusted && !nWatchOnlyUntrusted && !nWatchOnlyImmature;
+    }
+
+    CWalletBalances& operator+=(const CWalletBalances& other)
+    {
+        nTrusted += other.nTrusted;
+        nTrustedUnlocked += other.nTrustedUnlocked;
+        nUntrusted += other.nUntrusted;
+        nImmature += other.nImmature;
+        nWatchOnlyTrusted += other.nWatchOnlyTrusted;
+        nWatchOnlyUntrusted += other.nWatchOnlyUntrusted;
+        nWatchOnlyImmature += other.nWatchOnlyImmature;
+        return *this;
+    }
+
+    CWalletBalances& operator-=(const CWalletBalances& other)
+    {
+        nTrusted -= other.nTrusted;
+        nTrustedUnlocked -= other.nTrustedUnlocked;
+        nUntrusted -= other.nUntrusted;
+        nImmature -= other.nImmature;
+        nWatchOnlyTrusted -= other.nWatchOnlyTrusted;
+        nWatchOnlyUntrusted -= other.nWatchOnlyUntrusted;
+        nWatchOnlyImmature -= other.nWatchOnlyImmature;
+        return *this;
+    }
+};
+
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -596,14 +644,20 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface
 {
 private:
     /**
-     * Select a set of coins such that nValueRet >= nTargetValue and at least
+     * Select a set of coins of vAvailableCoins such that nValueRet >= nTargetValue and at least
      * all coins from coinControl are selected; Never select unconfirmed coins
      * if they are not ours
      */
-    bool SelectCoins(const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = NULL, AvailableCoinsType nCoinType=ALL_COINS, bool fUseInstantSend = false) const;
+    bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = NULL, bool fUseInstantSend = false) const;
 
     CWalletDB *pwalletdbEncryption;
     CWalletDB *pvotingdbEncryption;
+    //! the database transaction AddToWalletIfInvolvingMe writes through during BeginTxBatch/EndTxBatch
+    CWalletDB *pwalletdbBatch;
+
+    /** Write the wallet transactions of AddToWalletIfInvolvingMe through walletdb in one database transaction */
+    void BeginTxBatch(CWalletDB& walletdb);
+    void EndTxBatch(CWalletDB& walletdb);
 
     //! the current wallet version: clients below this version are not able to load the wallet
     int nWalletVersion;
@@ -614,12 +668,33 @@ private:
     int64_t nNextResend;
     int64_t nLastResend;
     bool fBroadcastTransactions;
+    //! when the unconfirmed wallet transactions were announced to the peers last, memory only
+    mutable std::map<uint256, int64_t> mapTxRelayed;
 
     mutable bool fAnonymizableTallyCached;
     mutable std::vector<CompactTallyItem> vecAnonymizableTallyCached;
     mutable bool fAnonymizableTallyCachedNonDenom;
     mutable std::vector<CompactTallyItem> vecAnonymizableTallyCachedNonDenom;
 
+    /**
+     * The balances are the sum of the parts of the transactions, kept up to date instead of
+     * walking mapWallet for every query. The part of a transaction changes with MarkDirty, it
+     * gets computed again at the next query. The parts of the transactions which change without
+     * that, the unconfirmed (mempool) and immature ones and the ones with time-locked outputs,
+     * get computed again at every query. A chain tip which is no descendant of the one of the
+     * last query means a reorganization, all parts get computed again then.
+     */
+    mutable bool fBalancesCached;
+    mutable uint256 hashBalancesTip;
+    mutable CWalletBalances balancesCached;
+    mutable std::map<uint256, CWalletBalances> mapTxBalances; //! Only the parts which aren't null
+    mutable std::set<uint256> setBalancesDirty;
+    mutable std::set<uint256> setBalancesPending;
+
+    /* Add the part of wtx to the balances, only parts which aren't null are kept */
+    void AddTxBalances(const CWalletTx& wtx) const;
+    const CWalletBalances& GetCachedBalances() const;
+
     /**
      * Used to keep track of spent outpoints, and
      * detect and report conflicts (double-spends or
@@ -630,7 +705,15 @@ private:
     void AddToSpends(const COutPoint& outpoint, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
-    std::set<COutPoint> setWalletUTXO;
+    /**
+     * The outputs of the wallet which aren't spent, what AvailableCoins looks at instead of all
+     * of mapWallet. The outputs of the transactions in setWalletUTXODirty get looked at again
+     * before it's used, fWalletUTXOCached false means all of them.
+     */
+    mutable bool fWalletUTXOCached;
+    mutable std::set<COutPoint> setWalletUTXO;
+    mutable std::set<uint256> setWalletUTXODirty;
+    void UpdateWalletUTXO() const;
 
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
@@ -639,6 +722,13 @@ private:
 
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(const CKeyMetadata& metadata, CKey& secretRet, uint32_t nAccountIndex, bool fInternal /*= false*/);
+    /* HD derive nCount new child keys at once, in parallel, and write them and the chain through walletdb */
+    void DeriveNewChildKeys(const CKeyMetadata& metadata, uint32_t nAccountIndex, bool fInternal, size_t nCount, CWalletDB& walletdb, std::vector<CPubKey>& vPubKeysRet);
+
+    /* Address index keys (type, hash) of the keys, scripts and watch-only scripts of the wallet, false if some of their outputs aren't in the index */
+    bool GetAddressIndexKeys(std::set<std::pair<int, uint160> >& setKeysRet) const;
+    /* Add the heights of the blocks from nStartHeight on with transactions of the address index keys not in setKeysDone, and add them there */
+    bool GetRescanHeights(int nStartHeight, std::set<std::pair<int, uint160> >& setKeysDone, std::set<int>& setHeights) const;
 
 public:
     /*
@@ -710,6 +800,7 @@ public:
         nMasterKeyMaxID = 0;
         pwalletdbEncryption = NULL;
         pvotingdbEncryption = NULL;
+        pwalletdbBatch = NULL;
         nOrderPosNext = 0;
         nNextResend = 0;
         nLastResend = 0;
@@ -719,6 +810,8 @@ public:
         fAnonymizableTallyCachedNonDenom = false;
         vecAnonymizableTallyCached.clear();
         vecAnonymizableTallyCachedNonDenom.clear();
+        fBalancesCached = false;
+        fWalletUTXOCached = false;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -758,7 +851,7 @@ public:
      * completion the coin set and corresponding actual target value is
      * assembled
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, bool fUseInstantSend = false) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, bool fUseInstantSend = false) const;
     bool SelectCoinsByDenominations(int nDenom, CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& vecTxInRet, std::vector<COutput>& vCoinsRet, CAmount& nValueRet, int nPrivateSendRoundsMin, int nPrivateSendRoundsMax); 
     bool SelectCoinsDark(CAmount nValueMin, CAmount nValueMax, std::vector<CTxIn>& vecTxInRet, CAmount& nValueRet, int nPrivateSendRoundsMin, int nPrivateSendRoundsMax) const; 
     bool SelectCoinsGrouppedByAddresses(std::vector<CompactTallyItem>& vecTallyRet, bool fSkipDenominated = true, bool fAnonymizable = true) const;
@@ -857,6 +950,15 @@ public:
     //! Adds a watch-only address to the store, without saving it to disk (used by LoadWallet)
     bool LoadWatchOnly(const CScript &dest);
 
+    /**
+     * Watched addresses of the address index, their transactions don't get into mapWallet.
+     * Adding one records its deltas of the blocks watchAddresses keeps from the address index.
+     */
+    bool AddWatchAddress(const CWatchAddress &address);
+    bool RemoveWatchAddress(const CWatchAddress &address);
+    bool LoadWatchAddress(const CWatchAddress &address);
+    CWatchAddresses watchAddresses;
+
     bool Unlock(const SecureString& strWalletPassphrase);
     bool ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase, const SecureString& strNewWalletPassphrase);
     bool EncryptWallet(const SecureString& strWalletPassphrase);
@@ -876,13 +978,22 @@ public:
     bool GetAccountPubkey(CPubKey &pubKey, std::string strAccount, bool bForceNew = false);
 
     void MarkDirty();
+    //! The part of the transaction of the balances and its outputs in setWalletUTXO need to be computed again
+    void MarkTxDirty(const uint256& hash) const;
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb);
     void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+    void SyncTransactions(const std::vector<CTransactionRef>& vtx, const CBlock* pblock);
+    void AddressIndexUpdated(const CBlockIndex *pindex, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vecEntries, bool fConnected) override;
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman);
-    std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
+    /**
+     * Announce the unconfirmed wallet transactions received before nTime which are missing from our
+     * mempool, they are submitted to it again, or were not announced yet. fForce announces all of them.
+     */
+    std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman, bool fForce = false);
+    void MarkTxRelayed(const uint256& hash) const;
     CAmount GetBalance(bool countLocked = true) const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;
@@ -23,10 +23,17 @@
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include <atomic>
+#include <thread>
+
 using namespace std;
 
 static uint64_t nAccountingEntryNumber = 0;
 
+// "tx" records LoadWallet deserializes in parallel before it adds them to the wallet in order.
+static const size_t WALLET_LOAD_BATCH_RECORDS = 4096;
+static const unsigned int WALLET_LOAD_THREADS = 8;
+
 //
 // CWalletDB
 //
@@ -196,6 +203,18 @@ bool CWalletDB::EraseWatchOnly(const CScript &dest)
     return Erase(std::make_pair(std::string("watchs"), *(const CScriptBase*)(&dest)));
 }
 
+bool CWalletDB::WriteWatchAddress(const CWatchAddress &address)
+{
+    nWalletDBUpdated++;
+    return Write(std::make_pair(std::string("watchaddr"), std::make_pair(address.type, address.hashBytes)), '1');
+}
+
+bool CWalletDB::EraseWatchAddress(const CWatchAddress &address)
+{
+    nWalletDBUpdated++;
+    return Erase(std::make_pair(std::string("watchaddr"), std::make_pair(address.type, address.hashBytes)));
+}
+
 bool CWalletDB::WriteBestBlock(const CBlockLocator& locator)
 {
     nWalletDBUpdated++;
@@ -435,6 +454,49 @@ public:
     }
 };
 
+/** Deserialize and check the transaction of a "tx" record whose type was read from ssKey already */
+static bool ReadWalletTx(CDataStream& ssKey, CDataStream& ssValue, uint256& hash, CWalletTx& wtx, bool& fUpgradeRet, string& strErr)
+{
+    ssKey >> hash;
+    ssValue >> wtx;
+    CValidationState state;
+    if (!(CheckTransaction(wtx, state, wtx.GetHash(), true) && (wtx.GetHash() == hash) && state.IsValid()))
+        return false;
+
+    // Undo serialize changes in 31600
+    fUpgradeRet = false;
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+    {
+        if (!ssValue.empty())
+        {
+            char fTmp;
+            char fUnused;
+            ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
+                               wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        }
+        else
+        {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgradeRet = true;
+    }
+    return true;
+}
+
+static void LoadWalletTx(CWallet* pwallet, const uint256& hash, const CWalletTx& wtx, bool fUpgrade, CWalletScanState& wss)
+{
+    if (fUpgrade)
+        wss.vWalletUpgrade.push_back(hash);
+
+    if (wtx.nOrderPos == -1)
+        wss.fAnyUnordered = true;
+
+    pwallet->AddToWallet(wtx, true, NULL);
+}
+
 bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, string& strType, string& strErr)
@@ -459,37 +521,11 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
         else if (strType == "tx")
         {
             uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx;
-            ssValue >> wtx;
-            CValidationState state;
-            if (!(CheckTransaction(wtx, state, wtx.GetHash(), true) && (wtx.GetHash() == hash) && state.IsValid()))
+            bool fUpgrade;
+            if (!ReadWalletTx(ssKey, ssValue, hash, wtx, fUpgrade, strErr))
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    ssValue >> fTmp >> fUnused >> wtx.strFromAccount;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d '%s' %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, wtx.strFromAccount, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->AddToWallet(wtx, true, NULL);
+            LoadWalletTx(pwallet, hash, wtx, fUpgrade, wss);
         }
         else if (strType == "acentry")
         {
@@ -521,6 +557,15 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             // so set the wallet birthday to the beginning of time.
             pwallet->nTimeFirstKey = 1;
         }
+        else if (strType == "watchaddr")
+        {
+            std::pair<unsigned int, uint160> address;
+            ssKey >> address;
+            char fYes;
+            ssValue >> fYes;
+            if (fYes == '1')
+                pwallet->LoadWatchAddress(CWatchAddress(address.first, address.second));
+        }
         else if (strType == "key" || strType == "wkey")
         {
             CPubKey vchPubKey;
@@ -834,6 +879,59 @@ static bool IsKeyType(string strType)
             strType == "vckey");
 }
 
+/** A "tx" record read by LoadWallet, the transaction gets deserialized by one of its threads */
+struct CWalletTxRecord
+{
+    CDataStream ssKey;
+    CDataStream ssValue;
+    uint256 hash;
+    CWalletTx wtx;
+    bool fUpgrade;
+    bool fValid;
+    string strErr;
+
+    CWalletTxRecord() : ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION), fUpgrade(false), fValid(false) {}
+};
+
+/**
+ * Deserialize the transactions of vRecords in parallel, they don't depend on the wallet. Adding
+ * them to it is not, that happens afterwards in the order of the records.
+ */
+static void LoadWalletTxRecords(CWallet* pwallet, vector<CWalletTxRecord>& vRecords, CWalletScanState& wss)
+{
+    std::atomic<size_t> nNext(0);
+    auto readRecords = [&]() {
+        for (size_t i = nNext++; i < vRecords.size(); i = nNext++) {
+            CWalletTxRecord& record = vRecords[i];
+            try {
+                string strType;
+                record.ssKey >> strType;
+                record.fValid = ReadWalletTx(record.ssKey, record.ssValue, record.hash, record.wtx, record.fUpgrade, record.strErr);
+            } catch (...) {
+                record.fValid = false;
+            }
+        }
+    };
+    unsigned int nThreads = std::max(1u, std::min(WALLET_LOAD_THREADS, std::thread::hardware_concurrency()));
+    std::vector<std::thread> vThreads;
+    for (unsigned int i = 1; i < nThreads && i * 64 < vRecords.size(); ++i)
+        vThreads.emplace_back(readRecords);
+    readRecords();
+    for (std::thread& thread : vThreads)
+        thread.join();
+
+    for (CWalletTxRecord& record : vRecords) {
+        if (record.fValid)
+            LoadWalletTx(pwallet, record.hash, record.wtx, record.fUpgrade, wss);
+        else
+            // Rescan if there is a bad transaction record:
+            SoftSetBoolArg("-rescan", true);
+        if (!record.strErr.empty())
+            LogPrintf("%s\n", record.strErr);
+    }
+    vRecords.clear();
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     pwallet->vchDefaultKey = CPubKey();
@@ -858,6 +956,8 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
             return DB_CORRUPT;
         }
 
+        vector<CWalletTxRecord> vTxRecords;
+        vTxRecords.reserve(WALLET_LOAD_BATCH_RECORDS);
         while (true)
         {
             // Read next record
@@ -872,8 +972,28 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 return DB_CORRUPT;
             }
 
-            // Try to be tolerant of single corrupt records:
+            // The transactions are collected for LoadWalletTxRecords, any other
+            // record is read right away after the transactions before it
             string strType, strErr;
+            try {
+                CDataStream ssType(ssKey);
+                ssType >> strType;
+            } catch (const std::exception&) {
+                // ReadKeyValue deals with the corrupt record
+            }
+            if (strType == "tx")
+            {
+                vTxRecords.emplace_back();
+                vTxRecords.back().ssKey = std::move(ssKey);
+                vTxRecords.back().ssValue = std::move(ssValue);
+                if (vTxRecords.size() >= WALLET_LOAD_BATCH_RECORDS)
+                    LoadWalletTxRecords(pwallet, vTxRecords, wss);
+                continue;
+            }
+            if (!vTxRecords.empty())
+                LoadWalletTxRecords(pwallet, vTxRecords, wss);
+
+            // Try to be tolerant of single corrupt records:
             if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
             {
                 // losing keys is considered a catastrophic error, anything else
@@ -892,6 +1012,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+        LoadWalletTxRecords(pwallet, vTxRecords, wss);
 
         // Store initial external keypool size since we mostly use external keys in mixing
         pwallet->nKeysLeftSinceAutoBackup = pwallet->KeypoolCountExternalKeys();
@@ -1031,6 +1152,7 @@ DBErrors CWalletDB::ZapSelectTx(CWallet* pwallet, vector<uint256>& vTxHashIn, ve
         }
         else if ((*it) == hash) {
             pwallet->mapWallet.erase(hash);
+            pwallet->MarkTxDirty(hash);
             if(!EraseTx(hash)) {
                 LogPrint("db", "Transaction was found for deletion but returned database error: %s\n", hash.GetHex());
                 delerror = true;
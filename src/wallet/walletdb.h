@@ -29,6 +29,7 @@ class CMasterKey;
 class CScript;
 class CWallet;
 class CWalletTx;
+struct CWatchAddress;
 class uint160;
 class uint256;
 class CInternalProposal;
@@ -172,6 +173,9 @@ public:
     bool WriteWatchOnly(const CScript &script);
     bool EraseWatchOnly(const CScript &script);
 
+    bool WriteWatchAddress(const CWatchAddress &address);
+    bool EraseWatchAddress(const CWatchAddress &address);
+
     bool WriteBestBlock(const CBlockLocator& locator);
     bool ReadBestBlock(CBlockLocator& locator);
 
@@ -0,0 +1,221 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/watchaddresses.h"
+
+#include "crypto/common.h"
+#include "spentindex.h"
+
+#include <algorithm>
+
+//! Bits of the bloom filter per address and bits set per address, about 0.25% false positives
+static const size_t WATCH_BLOOM_BITS_PER_ADDRESS = 16;
+static const size_t WATCH_BLOOM_HASHES = 4;
+static const size_t WATCH_BLOOM_MIN_CAPACITY = 1024;
+
+size_t CWatchAddressHasher::operator()(const CWatchAddress& address) const
+{
+    return ReadLE64(address.hashBytes.begin()) ^ address.type;
+}
+
+CWatchAddresses::CWatchAddresses() : nBloomCapacity(0), nRecordedFrom(-1), nMaxBlocks(DEFAULT_WATCH_DELTA_BLOCKS)
+{
+    BloomRebuild(WATCH_BLOOM_MIN_CAPACITY);
+}
+
+void CWatchAddresses::BloomInsert(const CWatchAddress& address)
+{
+    // The capacity is a power of two, so is the number of bits
+    size_t nMask = vBloom.size() * 64 - 1;
+    const unsigned char* pch = address.hashBytes.begin();
+    for (size_t i = 0; i < WATCH_BLOOM_HASHES; ++i) {
+        size_t nBit = (ReadLE32(pch + 4 * i) ^ (address.type * 0x9E3779B9U)) & nMask;
+        vBloom[nBit >> 6] |= (uint64_t)1 << (nBit & 63);
+    }
+}
+
+bool CWatchAddresses::BloomContains(const CWatchAddress& address) const
+{
+    size_t nMask = vBloom.size() * 64 - 1;
+    const unsigned char* pch = address.hashBytes.begin();
+    for (size_t i = 0; i < WATCH_BLOOM_HASHES; ++i) {
+        size_t nBit = (ReadLE32(pch + 4 * i) ^ (address.type * 0x9E3779B9U)) & nMask;
+        if (!(vBloom[nBit >> 6] & ((uint64_t)1 << (nBit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CWatchAddresses::BloomRebuild(size_t nCapacity)
+{
+    nBloomCapacity = nCapacity;
+    vBloom.assign(nBloomCapacity * WATCH_BLOOM_BITS_PER_ADDRESS / 64, 0);
+    for (const std::pair<CWatchAddress, char>& entry : setAddresses) {
+        BloomInsert(entry.first);
+    }
+}
+
+void CWatchAddresses::SetMaxBlocks(int nMaxBlocksIn)
+{
+    LOCK(cs);
+    nMaxBlocks = std::max(nMaxBlocksIn, 1);
+}
+
+bool CWatchAddresses::Insert(const CWatchAddress& address)
+{
+    LOCK(cs);
+    if (!setAddresses.insert(std::make_pair(address, (char)1)).second) {
+        return false;
+    }
+
+    if (setAddresses.size() > nBloomCapacity) {
+        BloomRebuild(nBloomCapacity * 2);
+    } else {
+        BloomInsert(address);
+    }
+    return true;
+}
+
+bool CWatchAddresses::Erase(const CWatchAddress& address)
+{
+    LOCK(cs);
+    // The bits stay in the bloom filter, the hash set is the one which decides
+    if (!setAddresses.erase(address)) {
+        return false;
+    }
+
+    for (std::map<int, std::vector<CWatchDelta> >::iterator it = mapDeltas.begin(); it != mapDeltas.end(); ) {
+        std::vector<CWatchDelta>& vDeltas = it->second;
+        vDeltas.erase(std::remove_if(vDeltas.begin(), vDeltas.end(), [&address](const CWatchDelta& delta) {
+            return delta.address == address;
+        }), vDeltas.end());
+
+        if (vDeltas.empty()) {
+            it = mapDeltas.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return true;
+}
+
+bool CWatchAddresses::Contains(const CWatchAddress& address) const
+{
+    LOCK(cs);
+    return BloomContains(address) && setAddresses.count(address);
+}
+
+size_t CWatchAddresses::Size() const
+{
+    LOCK(cs);
+    return setAddresses.size();
+}
+
+std::vector<CWatchAddress> CWatchAddresses::GetAddresses() const
+{
+    LOCK(cs);
+    std::vector<CWatchAddress> vAddresses;
+    vAddresses.reserve(setAddresses.size());
+    for (const std::pair<CWatchAddress, char>& entry : setAddresses) {
+        vAddresses.push_back(entry.first);
+    }
+    return vAddresses;
+}
+
+void CWatchAddresses::BlockUpdated(int nHeight, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vecEntries, bool fConnected)
+{
+    LOCK(cs);
+
+    if (!fConnected) {
+        mapDeltas.erase(mapDeltas.lower_bound(nHeight), mapDeltas.end());
+        // Nothing recorded is left, recording starts over with the next block
+        if (nRecordedFrom >= nHeight) {
+            nRecordedFrom = -1;
+        }
+        return;
+    }
+
+    if (nRecordedFrom < 0) {
+        nRecordedFrom = nHeight;
+    }
+
+    if (!setAddresses.empty()) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vecWatched;
+        for (const std::pair<CAddressIndexKey, CAmount>& entry : vecEntries) {
+            CWatchAddress address(entry.first.type, entry.first.hashBytes);
+            if (BloomContains(address) && setAddresses.count(address)) {
+                vecWatched.push_back(entry);
+            }
+        }
+
+        if (!vecWatched.empty()) {
+            AggregateEntries(vecWatched, mapDeltas[nHeight]);
+        }
+    }
+
+    int nFrom = nHeight - nMaxBlocks + 1;
+    if (nFrom > nRecordedFrom) {
+        mapDeltas.erase(mapDeltas.begin(), mapDeltas.lower_bound(nFrom));
+        nRecordedFrom = nFrom;
+    }
+}
+
+int CWatchAddresses::GetRecordedFrom() const
+{
+    LOCK(cs);
+    return nRecordedFrom;
+}
+
+void CWatchAddresses::AddEntries(const CWatchAddress& address, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vecEntries)
+{
+    LOCK(cs);
+    if (nRecordedFrom < 0 || !setAddresses.count(address)) {
+        return;
+    }
+
+    // The entries of the address index are sorted by height, aggregate them per block
+    std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator itBlock = vecEntries.begin();
+    while (itBlock != vecEntries.end()) {
+        int nHeight = itBlock->first.blockHeight;
+        std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator itEnd = itBlock;
+        while (itEnd != vecEntries.end() && itEnd->first.blockHeight == nHeight) {
+            ++itEnd;
+        }
+
+        if (nHeight >= nRecordedFrom && CWatchAddress(itBlock->first.type, itBlock->first.hashBytes) == address) {
+            AggregateEntries(std::vector<std::pair<CAddressIndexKey, CAmount> >(itBlock, itEnd), mapDeltas[nHeight]);
+        }
+        itBlock = itEnd;
+    }
+}
+
+bool CWatchAddresses::GetDeltas(int nStart, int nEnd, std::vector<CWatchDelta>& vDeltas) const
+{
+    LOCK(cs);
+    if (nRecordedFrom < 0 || nStart < nRecordedFrom) {
+        return false;
+    }
+
+    for (std::map<int, std::vector<CWatchDelta> >::const_iterator it = mapDeltas.lower_bound(nStart); it != mapDeltas.end() && it->first <= nEnd; ++it) {
+        vDeltas.insert(vDeltas.end(), it->second.begin(), it->second.end());
+    }
+    return true;
+}
+
+void CWatchAddresses::AggregateEntries(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vecEntries, std::vector<CWatchDelta>& vDeltas)
+{
+    std::map<std::pair<CWatchAddress, uint256>, size_t> mapPos;
+    for (const std::pair<CAddressIndexKey, CAmount>& entry : vecEntries) {
+        CWatchAddress address(entry.first.type, entry.first.hashBytes);
+        std::pair<std::map<std::pair<CWatchAddress, uint256>, size_t>::iterator, bool> ret =
+            mapPos.insert(std::make_pair(std::make_pair(address, entry.first.txhash), vDeltas.size()));
+
+        if (ret.second) {
+            vDeltas.push_back(CWatchDelta(address, entry.first.txhash, entry.first.blockHeight, entry.second));
+        } else {
+            vDeltas[ret.first->second].nDelta += entry.second;
+        }
+    }
+}
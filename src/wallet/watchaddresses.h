@@ -0,0 +1,129 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_WALLET_WATCHADDRESSES_H
+#define SMARTCASH_WALLET_WATCHADDRESSES_H
+
+#include "amount.h"
+#include "flathashmap.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+struct CAddressIndexKey;
+
+//! Blocks of which the watched address deltas are kept in memory by default
+static const int DEFAULT_WATCH_DELTA_BLOCKS = 1000;
+
+/** Address of the address index, type 1 for P2PKH and 2 for P2SH */
+struct CWatchAddress
+{
+    unsigned int type;
+    uint160 hashBytes;
+
+    CWatchAddress() : type(0) {}
+    CWatchAddress(unsigned int typeIn, const uint160& hashBytesIn) : type(typeIn), hashBytes(hashBytesIn) {}
+
+    friend bool operator==(const CWatchAddress& a, const CWatchAddress& b)
+    {
+        return a.type == b.type && a.hashBytes == b.hashBytes;
+    }
+
+    friend bool operator<(const CWatchAddress& a, const CWatchAddress& b)
+    {
+        return a.type < b.type || (a.type == b.type && a.hashBytes < b.hashBytes);
+    }
+};
+
+/** The hash bytes are uniformly distributed already */
+struct CWatchAddressHasher
+{
+    size_t operator()(const CWatchAddress& address) const;
+};
+
+/** Sum of the outputs and inputs of a transaction of a block for a watched address */
+struct CWatchDelta
+{
+    CWatchAddress address;
+    uint256 txid;
+    int nHeight;
+    CAmount nDelta;
+
+    CWatchDelta() : nHeight(0), nDelta(0) {}
+    CWatchDelta(const CWatchAddress& addressIn, const uint256& txidIn, int nHeightIn, CAmount nDeltaIn) :
+        address(addressIn), txid(txidIn), nHeight(nHeightIn), nDelta(nDeltaIn) {}
+};
+
+/**
+ * Watch-only addresses which don't go through IsMine and mapWallet. Their transactions are
+ * taken from the address index entries of the connected blocks, nothing but the
+ * (txid, height, delta) tuples of the last nMaxBlocks blocks is kept. Older ones need
+ * to be read from the address index again.
+ *
+ * The entries of a block get tested against a bloom filter first, only its hits look
+ * into the hash set. The bits of the filter come straight from the hash bytes of the
+ * address, so a block costs the same no matter how many addresses are watched.
+ */
+class CWatchAddresses
+{
+private:
+    mutable CCriticalSection cs;
+
+    CFlatHashMap<CWatchAddress, char, CWatchAddressHasher> setAddresses;
+    //! Bloom filter in front of setAddresses, rebuilt twice as large when it gets full
+    std::vector<uint64_t> vBloom;
+    size_t nBloomCapacity;
+
+    //! Deltas of the blocks from nRecordedFrom on, -1 until the first block got recorded
+    std::map<int, std::vector<CWatchDelta> > mapDeltas;
+    int nRecordedFrom;
+    int nMaxBlocks;
+
+    void BloomInsert(const CWatchAddress& address);
+    bool BloomContains(const CWatchAddress& address) const;
+    void BloomRebuild(size_t nCapacity);
+
+public:
+    CWatchAddresses();
+
+    void SetMaxBlocks(int nMaxBlocksIn);
+
+    //! Returns false if the address is watched already
+    bool Insert(const CWatchAddress& address);
+    //! Returns false if the address wasn't watched, its recorded deltas get dropped
+    bool Erase(const CWatchAddress& address);
+    bool Contains(const CWatchAddress& address) const;
+    size_t Size() const;
+    std::vector<CWatchAddress> GetAddresses() const;
+
+    /**
+     * Record the address index entries of the watched addresses of the block at nHeight,
+     * or drop the ones of nHeight and above if the block got disconnected.
+     */
+    void BlockUpdated(int nHeight, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vecEntries, bool fConnected);
+
+    //! First height of the recorded blocks, -1 if none got recorded yet
+    int GetRecordedFrom() const;
+    /**
+     * Record the address index entries of a newly watched address from GetRecordedFrom()
+     * on, cs_main has to be held from reading them until here so no block comes in between.
+     */
+    void AddEntries(const CWatchAddress& address, const std::vector<std::pair<CAddressIndexKey, CAmount> >& vecEntries);
+
+    /**
+     * The recorded deltas of the blocks nStart to nEnd in height order, false if
+     * the range starts before the recorded blocks. Returns the deltas of a block in the
+     * order they got recorded.
+     */
+    bool GetDeltas(int nStart, int nEnd, std::vector<CWatchDelta>& vDeltas) const;
+
+    /** Aggregate address index entries per address and transaction, keeping their order */
+    static void AggregateEntries(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vecEntries, std::vector<CWatchDelta>& vDeltas);
+};
+
+#endif // SMARTCASH_WALLET_WATCHADDRESSES_H
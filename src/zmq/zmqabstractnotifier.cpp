@@ -11,17 +11,32 @@ CZMQAbstractNotifier::~CZMQAbstractNotifier()
     assert(!psocket);
 }
 
-bool CZMQAbstractNotifier::NotifyBlock(const CBlockIndex * /*CBlockIndex*/)
+bool CZMQAbstractNotifier::NotifyBlock(const uint256 &/*hash*/, const std::vector<unsigned char> &/*vchBlock*/)
 {
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifyTransactions(const std::vector<uint256> &/*vHashes*/, const std::vector<unsigned char> &/*vchTransactions*/)
 {
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransactionLock(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifyTransactionLock(const uint256 &/*hash*/, const std::vector<unsigned char> &/*vchTransaction*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyRewardBlock(const uint256 &/*hash*/, CAmount /*nPaid*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifySmartnodeList(int /*nCount*/, bool /*fAdded*/, bool /*fRemoved*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyProposalVote(const uint256 &/*hash*/, const std::vector<unsigned char> &/*vchVote*/)
 {
     return true;
 }
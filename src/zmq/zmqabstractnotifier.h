@@ -12,10 +12,13 @@ class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
+//! -zmqpubhwm default, the same as the one of libzmq
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
+
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(0) { }
+    CZMQAbstractNotifier() : psocket(0), nHighWaterMark(DEFAULT_ZMQ_SNDHWM) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -28,18 +31,39 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetHighWaterMark() const { return nHighWaterMark; }
+    void SetHighWaterMark(int n) { nHighWaterMark = n; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
-    virtual bool NotifyBlock(const CBlockIndex *pindex);
-    virtual bool NotifyTransaction(const CTransaction &transaction);
-    virtual bool NotifyTransactionLock(const CTransaction &transaction);
+    //! Whether the Notify methods need the serialized block, transaction or vote
+    virtual bool NeedsRawBlock() const { return false; }
+    virtual bool NeedsRawTransaction() const { return false; }
+    virtual bool NeedsRawProposalVote() const { return false; }
+
+    /**
+     * Called from the publishing thread of the notification interface. The raw data
+     * is serialized once for all the notifiers, it's empty unless one of them needs it.
+     */
+    virtual bool NotifyBlock(const uint256 &hash, const std::vector<unsigned char> &vchBlock);
+    /**
+     * A batch of up to -zmqtxbatch mempool or block transactions, vchTransactions holds
+     * their serializations one after the other.
+     */
+    virtual bool NotifyTransactions(const std::vector<uint256> &vHashes, const std::vector<unsigned char> &vchTransactions);
+    virtual bool NotifyTransactionLock(const uint256 &hash, const std::vector<unsigned char> &vchTransaction);
+    //! A connected block which paid out SmartRewards
+    virtual bool NotifyRewardBlock(const uint256 &hash, CAmount nPaid);
+    virtual bool NotifySmartnodeList(int nCount, bool fAdded, bool fRemoved);
+    virtual bool NotifyProposalVote(const uint256 &hash, const std::vector<unsigned char> &vchVote);
 
 protected:
     void *psocket;
     std::string type;
     std::string address;
+    //! ZMQ_SNDHWM of the socket, messages beyond it get dropped by the PUB socket
+    int nHighWaterMark;
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
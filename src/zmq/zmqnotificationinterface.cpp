@@ -5,17 +5,43 @@
 #include "zmqnotificationinterface.h"
 #include "zmqpublishnotifier.h"
 
+#include "blocksummary.h"
+#include "chainparams.h"
 #include "version.h"
 #include "validation.h"
+#include "smartvoting/voting.h"
 #include "streams.h"
 #include "util.h"
+#include "utilstrencodings.h"
+
+#include <algorithm>
+
+CZMQNotificationInterface* pzmqNotificationInterface = NULL;
 
 void zmqError(const char *str)
 {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL)
+template <typename T>
+static std::shared_ptr<const std::vector<unsigned char> > SerializeRaw(const T& obj)
+{
+    std::shared_ptr<std::vector<unsigned char> > pdata = std::make_shared<std::vector<unsigned char> >();
+    pdata->reserve(::GetSerializeSize(obj, SER_NETWORK, PROTOCOL_VERSION));
+    CVectorWriter writer(SER_NETWORK, PROTOCOL_VERSION, *pdata, 0);
+    ::Serialize(writer, obj, SER_NETWORK, PROTOCOL_VERSION);
+    return pdata;
+}
+
+static int64_t GetIntArgument(const std::map<std::string, std::string> &args, const std::string &strArg, int64_t nDefault)
+{
+    std::map<std::string, std::string>::const_iterator it = args.find(strArg);
+    return it != args.end() ? atoi64(it->second) : nDefault;
+}
+
+CZMQNotificationInterface::CZMQNotificationInterface() :
+    pcontext(NULL), fRawBlock(false), fRawTransaction(false), fRawProposalVote(false),
+    nMaxQueued(DEFAULT_ZMQ_QUEUE_SIZE), nTxBatch(DEFAULT_ZMQ_TX_BATCH), nDropped(0), fWaiting(false), fStop(false)
 {
 }
 
@@ -41,6 +67,12 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubrawtxlock"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionLockNotifier>;
+    factories["pubrewardblock"] = CZMQAbstractNotifier::Create<CZMQPublishRewardBlockNotifier>;
+    factories["pubsmartnodelist"] = CZMQAbstractNotifier::Create<CZMQPublishSmartnodeListNotifier>;
+    factories["pubhashproposalvote"] = CZMQAbstractNotifier::Create<CZMQPublishHashProposalVoteNotifier>;
+    factories["pubrawproposalvote"] = CZMQAbstractNotifier::Create<CZMQPublishRawProposalVoteNotifier>;
+
+    int nHighWaterMark = std::max<int64_t>(0, GetIntArgument(args, "-zmqpubhwm", DEFAULT_ZMQ_SNDHWM));
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
@@ -52,6 +84,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
             CZMQAbstractNotifier *notifier = factory();
             notifier->SetType(i->first);
             notifier->SetAddress(address);
+            notifier->SetHighWaterMark(nHighWaterMark);
             notifiers.push_back(notifier);
         }
     }
@@ -60,6 +93,8 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     {
         notificationInterface = new CZMQNotificationInterface();
         notificationInterface->notifiers = notifiers;
+        notificationInterface->nMaxQueued = std::max<int64_t>(0, GetIntArgument(args, "-zmqqueuesize", DEFAULT_ZMQ_QUEUE_SIZE));
+        notificationInterface->nTxBatch = std::min<int64_t>(MAX_ZMQ_TX_BATCH, std::max<int64_t>(1, GetIntArgument(args, "-zmqtxbatch", DEFAULT_ZMQ_TX_BATCH)));
 
         if (!notificationInterface->Initialize())
         {
@@ -105,6 +140,14 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    for (i = notifiers.begin(); i != notifiers.end(); ++i)
+    {
+        fRawBlock |= (*i)->NeedsRawBlock();
+        fRawTransaction |= (*i)->NeedsRawTransaction();
+        fRawProposalVote |= (*i)->NeedsRawProposalVote();
+    }
+
+    threadPublish = std::thread(&CZMQNotificationInterface::ThreadPublish, this);
     return true;
 }
 
@@ -112,6 +155,20 @@ bool CZMQNotificationInterface::Initialize()
 void CZMQNotificationInterface::Shutdown()
 {
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
+    if (threadPublish.joinable())
+    {
+        // The queued notifications still get published
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fStop = true;
+        }
+        condQueue.notify_all();
+        threadPublish.join();
+
+        if (nDropped.load())
+            LogPrintf("zmq: %u notifications were dropped with %u queued\n", nDropped.load(), nMaxQueued);
+    }
+
     if (pcontext)
     {
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
@@ -126,56 +183,228 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+std::vector<CZMQNotificationInterface::CNotifierStatus> CZMQNotificationInterface::GetNotifiers() const
 {
-    if (fInitialDownload || pindexNew == pindexFork) // In IBD or blocks were disconnected without any new ones
+    std::lock_guard<std::mutex> lock(mutexNotifiers);
+    std::vector<CNotifierStatus> vStatus;
+    for (std::list<CZMQAbstractNotifier*>::const_iterator i = notifiers.begin(); i != notifiers.end(); ++i)
+    {
+        CNotifierStatus status;
+        status.type = (*i)->GetType();
+        status.address = (*i)->GetAddress();
+        status.nHighWaterMark = (*i)->GetHighWaterMark();
+        vStatus.push_back(status);
+    }
+    return vStatus;
+}
+
+void CZMQNotificationInterface::Enqueue(const CNotification &notification)
+{
+    bool fDroppable = notification.type != NOTIFY_BLOCK && notification.type != NOTIFY_REWARD_BLOCK;
+    if (fDroppable && nMaxQueued && queue.Size() >= nMaxQueued)
+    {
+        if (nDropped.fetch_add(1) == 0)
+            LogPrintf("zmq: More than %u notifications queued, dropping them\n", nMaxQueued);
         return;
+    }
 
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    queue.Push(notification);
+    // Either the publishing thread sees the new one before it goes to sleep or we see it waiting
+    if (fWaiting.load())
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindexNew))
-        {
-            i++;
-        }
-        else
+        std::lock_guard<std::mutex> lock(mutex);
+        condQueue.notify_one();
+    }
+}
+
+void CZMQNotificationInterface::ThreadPublish()
+{
+    RenameThread("smartcash-zmq");
+
+    CNotification notification;
+    while (true)
+    {
+        if (queue.Pop(notification))
         {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
+            Publish(notification);
+            continue;
         }
+
+        // Nothing else is queued, the collected transactions don't wait for a full batch
+        PublishTransactions();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        fWaiting = true;
+        condQueue.wait(lock, [this] { return fStop || queue.Size() > 0; });
+        fWaiting = false;
+        // The queued notifications still get published
+        if (fStop && !queue.Size())
+            return;
     }
 }
 
-void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+template <typename Function>
+void CZMQNotificationInterface::ForEachNotifier(Function func)
 {
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
+        if (func(notifier))
         {
             i++;
         }
         else
         {
             notifier->Shutdown();
+            std::lock_guard<std::mutex> lock(mutexNotifiers);
             i = notifiers.erase(i);
         }
     }
 }
 
-void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
+void CZMQNotificationInterface::PublishTransactions()
 {
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    if (vBatchHashes.empty())
+        return;
+
+    ForEachNotifier([this](CZMQAbstractNotifier *notifier) {
+        return notifier->NotifyTransactions(vBatchHashes, vchBatchTransactions);
+    });
+    vBatchHashes.clear();
+    vchBatchTransactions.clear();
+}
+
+void CZMQNotificationInterface::Publish(const CNotification &notification)
+{
+    if (notification.type == NOTIFY_TRANSACTION)
     {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransactionLock(tx))
+        vBatchHashes.push_back(notification.hash);
+        if (notification.pdata)
+            vchBatchTransactions.insert(vchBatchTransactions.end(), notification.pdata->begin(), notification.pdata->end());
+        if (vBatchHashes.size() >= nTxBatch)
+            PublishTransactions();
+        return;
+    }
+
+    // The batch goes out first to keep the order of the notifications
+    PublishTransactions();
+
+    std::shared_ptr<const std::vector<unsigned char> > pdata = notification.pdata;
+    if (notification.type == NOTIFY_BLOCK && fRawBlock && !pdata)
+    {
+        // The tip didn't come with its block, like one connected during the initial block download
+        CDiskBlockPos pos;
         {
-            i++;
+            LOCK(cs_main);
+            pos = notification.pindex->GetBlockPos();
         }
-        else
+        CBlock block;
+        if (ReadBlockFromDisk(block, pos, Params().GetConsensus()))
+            pdata = SerializeRaw(block);
+    }
+
+    static const std::vector<unsigned char> vchEmpty;
+    const std::vector<unsigned char> &vchData = pdata ? *pdata : vchEmpty;
+
+    ForEachNotifier([&notification, &vchData](CZMQAbstractNotifier *notifier) {
+        switch (notification.type)
         {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
+        case NOTIFY_BLOCK:
+            return notifier->NotifyBlock(notification.hash, vchData);
+        case NOTIFY_TRANSACTION_LOCK:
+            return notifier->NotifyTransactionLock(notification.hash, vchData);
+        case NOTIFY_REWARD_BLOCK:
+            return notifier->NotifyRewardBlock(notification.hash, notification.nValue);
+        case NOTIFY_SMARTNODE_LIST:
+            return notifier->NotifySmartnodeList(notification.nValue, notification.nFlags & 1, notification.nFlags & 2);
+        case NOTIFY_PROPOSAL_VOTE:
+            return notifier->NotifyProposalVote(notification.hash, vchData);
+        default:
+            return true;
         }
+    });
+}
+
+void CZMQNotificationInterface::BlockConnected(const CBlock &block, const CBlockIndex *pindex)
+{
+    // UpdatedBlockTip publishes nothing during the initial block download
+    if (IsInitialBlockDownload())
+        return;
+
+    // ConnectBlock left the payouts of the block in the summary cache
+    CBlockSummary summary;
+    if (blockSummaries.Get(pindex->nHeight, pindex->GetBlockHash(), summary) && summary.fHavePayouts && summary.nSmartRewardsReward > 0)
+    {
+        CNotification notification;
+        notification.type = NOTIFY_REWARD_BLOCK;
+        notification.hash = pindex->GetBlockHash();
+        notification.pindex = pindex;
+        notification.nValue = summary.nSmartRewardsReward;
+        Enqueue(notification);
+    }
+
+    if (!fRawBlock)
+        return;
+
+    std::shared_ptr<const std::vector<unsigned char> > pdata = SerializeRaw(block);
+    std::lock_guard<std::mutex> lock(mutexConnected);
+    lastConnected = std::make_pair(pindex, pdata);
+}
+
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload || pindexNew == pindexFork) // In IBD or blocks were disconnected without any new ones
+        return;
+
+    CNotification notification;
+    notification.type = NOTIFY_BLOCK;
+    notification.hash = pindexNew->GetBlockHash();
+    notification.pindex = pindexNew;
+    {
+        std::lock_guard<std::mutex> lock(mutexConnected);
+        if (lastConnected.first == pindexNew)
+            notification.pdata = lastConnected.second;
+        lastConnected.first = NULL;
+        lastConnected.second.reset();
     }
+    Enqueue(notification);
+}
+
+void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx, const CBlock *pblock)
+{
+    CNotification notification;
+    notification.type = NOTIFY_TRANSACTION;
+    notification.hash = tx.GetHash();
+    if (fRawTransaction)
+        notification.pdata = SerializeRaw(tx);
+    Enqueue(notification);
+}
+
+void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx)
+{
+    CNotification notification;
+    notification.type = NOTIFY_TRANSACTION_LOCK;
+    notification.hash = tx.GetHash();
+    if (fRawTransaction)
+        notification.pdata = SerializeRaw(tx);
+    Enqueue(notification);
+}
+
+void CZMQNotificationInterface::NotifySmartnodeListChanged(int nCount, bool fAdded, bool fRemoved)
+{
+    CNotification notification;
+    notification.type = NOTIFY_SMARTNODE_LIST;
+    notification.nValue = nCount;
+    notification.nFlags = (fAdded ? 1 : 0) | (fRemoved ? 2 : 0);
+    Enqueue(notification);
+}
+
+void CZMQNotificationInterface::NotifyProposalVote(const CProposalVote &vote)
+{
+    CNotification notification;
+    notification.type = NOTIFY_PROPOSAL_VOTE;
+    notification.hash = vote.GetHash();
+    if (fRawProposalVote)
+        notification.pdata = SerializeRaw(vote);
+    Enqueue(notification);
 }
@@ -6,33 +6,137 @@
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
 #include "validationinterface.h"
-#include <string>
+#include "uint256.h"
+#include "zmqqueue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
+//! -zmqqueuesize default, notifications waiting to be published before they get dropped
+static const unsigned int DEFAULT_ZMQ_QUEUE_SIZE = 10000;
+//! -zmqtxbatch default and maximum, transactions published in one hashtx or rawtx message
+static const unsigned int DEFAULT_ZMQ_TX_BATCH = 1;
+static const unsigned int MAX_ZMQ_TX_BATCH = 1000;
+
+/**
+ * The notifications get queued and published by a thread of their own, so no
+ * ZMQ send happens with cs_main held. Blocks and transactions get serialized
+ * once for all the notifiers which publish them raw, the connected block is
+ * serialized from memory instead of being read from disk again.
+ *
+ * The queue doesn't take a lock to push to. Once -zmqqueuesize notifications
+ * wait to be published the transactions, locks, smartnode list changes and votes
+ * get dropped and counted, blocks are always queued.
+ */
 class CZMQNotificationInterface : public CValidationInterface
 {
 public:
+    struct CNotifierStatus
+    {
+        std::string type;
+        std::string address;
+        int nHighWaterMark;
+    };
+
     virtual ~CZMQNotificationInterface();
 
     static CZMQNotificationInterface* CreateWithArguments(const std::map<std::string, std::string> &args);
 
+    std::vector<CNotifierStatus> GetNotifiers() const;
+    size_t GetQueued() const { return queue.Size(); }
+    uint64_t GetDropped() const { return nDropped.load(); }
+    size_t GetMaxQueued() const { return nMaxQueued; }
+    size_t GetTxBatch() const { return nTxBatch; }
+
 protected:
     bool Initialize();
     void Shutdown();
 
     // CValidationInterface
     void SyncTransaction(const CTransaction &tx, const CBlock *pblock);
+    void BlockConnected(const CBlock &block, const CBlockIndex *pindex);
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload);
     void NotifyTransactionLock(const CTransaction &tx);
+    void NotifySmartnodeListChanged(int nCount, bool fAdded, bool fRemoved);
+    void NotifyProposalVote(const CProposalVote &vote);
 
 private:
+    enum NotificationType
+    {
+        NOTIFY_BLOCK,
+        NOTIFY_TRANSACTION,
+        NOTIFY_TRANSACTION_LOCK,
+        NOTIFY_REWARD_BLOCK,
+        NOTIFY_SMARTNODE_LIST,
+        NOTIFY_PROPOSAL_VOTE
+    };
+
+    struct CNotification
+    {
+        NotificationType type;
+        uint256 hash;
+        //! For the blocks which have to be read from disk
+        const CBlockIndex *pindex;
+        //! The paid out SmartRewards of a reward block or the smartnode count
+        int64_t nValue;
+        //! Smartnodes got added (1) and/or removed (2)
+        int nFlags;
+        std::shared_ptr<const std::vector<unsigned char> > pdata;
+
+        CNotification() : type(NOTIFY_BLOCK), pindex(NULL), nValue(0), nFlags(0) {}
+    };
+
     CZMQNotificationInterface();
 
+    void Enqueue(const CNotification &notification);
+    void ThreadPublish();
+    void Publish(const CNotification &notification);
+    //! Publish the collected transactions of the batch, if any
+    void PublishTransactions();
+    //! Call func for every notifier, the ones it fails for get shut down and removed
+    template <typename Function>
+    void ForEachNotifier(Function func);
+
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+    //! Held to remove a failed notifier, the publishing thread doesn't need it to read the list
+    mutable std::mutex mutexNotifiers;
+    bool fRawBlock;
+    bool fRawTransaction;
+    bool fRawProposalVote;
+    //! 0 for no limit
+    size_t nMaxQueued;
+    size_t nTxBatch;
+
+    CZMQQueue<CNotification> queue;
+    std::atomic<uint64_t> nDropped;
+    //! The publishing thread sets fWaiting with mutex held before it sleeps, the producers only take it to wake it up
+    std::mutex mutex;
+    std::condition_variable condQueue;
+    std::atomic<bool> fWaiting;
+    bool fStop;
+    std::thread threadPublish;
+
+    //! The transactions collected for the next batch, only used by the publishing thread
+    std::vector<uint256> vBatchHashes;
+    std::vector<unsigned char> vchBatchTransactions;
+
+    std::mutex mutexConnected;
+    //! The last connected block, serialized for the UpdatedBlockTip which follows
+    std::pair<const CBlockIndex*, std::shared_ptr<const std::vector<unsigned char> > > lastConnected;
 };
 
+extern CZMQNotificationInterface* pzmqNotificationInterface;
+
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
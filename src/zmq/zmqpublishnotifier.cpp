@@ -2,10 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-#include "chainparams.h"
-#include "streams.h"
 #include "zmqpublishnotifier.h"
-#include "validation.h"
 #include "util.h"
 
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
@@ -16,6 +13,17 @@ static const char *MSG_HASHTXLOCK = "hashtxlock";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
 static const char *MSG_RAWTXLOCK = "rawtxlock";
+static const char *MSG_REWARDBLOCK = "rewardblock";
+static const char *MSG_SMARTNODELIST = "smartnodelist";
+static const char *MSG_HASHPROPOSALVOTE = "hashproposalvote";
+static const char *MSG_RAWPROPOSALVOTE = "rawproposalvote";
+
+// Hashes are published in the byte order they are displayed in
+static void WriteHashReversed(unsigned char *data, const uint256 &hash)
+{
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+}
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -73,7 +81,15 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &nHighWaterMark, sizeof(nHighWaterMark));
+        if (rc!=0)
+        {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
@@ -87,6 +103,7 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
     }
     else
     {
+        // The high water mark of the socket is the one of the first notifier
         LogPrint("zmq", "zmq: Reusing socket for address %s\n", address);
 
         psocket = i->second->psocket;
@@ -143,71 +160,83 @@ bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* d
     return true;
 }
 
-bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishHashBlockNotifier::NotifyBlock(const uint256 &hash, const std::vector<unsigned char> &/*vchBlock*/)
 {
-    uint256 hash = pindex->GetBlockHash();
     LogPrint("zmq", "zmq: Publish hashblock %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
+    unsigned char data[32];
+    WriteHashReversed(data, hash);
     return SendMessage(MSG_HASHBLOCK, data, 32);
 }
 
-bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishHashTransactionNotifier::NotifyTransactions(const std::vector<uint256> &vHashes, const std::vector<unsigned char> &/*vchTransactions*/)
 {
-    uint256 hash = transaction.GetHash();
-    LogPrint("zmq", "zmq: Publish hashtx %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTX, data, 32);
+    // The hashes of a batch one after the other, a single one without batching
+    LogPrint("zmq", "zmq: Publish hashtx %s (%u)\n", vHashes.front().GetHex(), vHashes.size());
+    std::vector<unsigned char> data(32 * vHashes.size());
+    for (size_t i = 0; i < vHashes.size(); i++)
+        WriteHashReversed(&data[32 * i], vHashes[i]);
+    return SendMessage(MSG_HASHTX, data.data(), data.size());
 }
 
-bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction)
+bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const uint256 &hash, const std::vector<unsigned char> &/*vchTransaction*/)
 {
-    uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish hashtxlock %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
+    unsigned char data[32];
+    WriteHashReversed(data, hash);
     return SendMessage(MSG_HASHTXLOCK, data, 32);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::NotifyBlock(const uint256 &hash, const std::vector<unsigned char> &vchBlock)
 {
-    LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
-
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    LogPrint("zmq", "zmq: Publish rawblock %s\n", hash.GetHex());
+    if (vchBlock.empty())
     {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
-
-        ss << block;
+        zmqError("Can't read block from disk");
+        return false;
     }
-
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, vchBlock.data(), vchBlock.size());
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishRawTransactionNotifier::NotifyTransactions(const std::vector<uint256> &vHashes, const std::vector<unsigned char> &vchTransactions)
 {
-    uint256 hash = transaction.GetHash();
-    LogPrint("zmq", "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    LogPrint("zmq", "zmq: Publish rawtx %s (%u)\n", vHashes.front().GetHex(), vHashes.size());
+    return SendMessage(MSG_RAWTX, vchTransactions.data(), vchTransactions.size());
 }
 
-bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction)
+bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const uint256 &hash, const std::vector<unsigned char> &vchTransaction)
 {
-    uint256 hash = transaction.GetHash();
     LogPrint("zmq", "zmq: Publish rawtxlock %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWTXLOCK, vchTransaction.data(), vchTransaction.size());
+}
+
+bool CZMQPublishRewardBlockNotifier::NotifyRewardBlock(const uint256 &hash, CAmount nPaid)
+{
+    LogPrint("zmq", "zmq: Publish rewardblock %s\n", hash.GetHex());
+    unsigned char data[40];
+    WriteHashReversed(data, hash);
+    WriteLE64(data + 32, nPaid);
+    return SendMessage(MSG_REWARDBLOCK, data, sizeof(data));
+}
+
+bool CZMQPublishSmartnodeListNotifier::NotifySmartnodeList(int nCount, bool fAdded, bool fRemoved)
+{
+    LogPrint("zmq", "zmq: Publish smartnodelist %d\n", nCount);
+    unsigned char data[5];
+    WriteLE32(data, nCount);
+    data[4] = (fAdded ? 1 : 0) | (fRemoved ? 2 : 0);
+    return SendMessage(MSG_SMARTNODELIST, data, sizeof(data));
+}
+
+bool CZMQPublishHashProposalVoteNotifier::NotifyProposalVote(const uint256 &hash, const std::vector<unsigned char> &/*vchVote*/)
+{
+    LogPrint("zmq", "zmq: Publish hashproposalvote %s\n", hash.GetHex());
+    unsigned char data[32];
+    WriteHashReversed(data, hash);
+    return SendMessage(MSG_HASHPROPOSALVOTE, data, 32);
+}
+
+bool CZMQPublishRawProposalVoteNotifier::NotifyProposalVote(const uint256 &hash, const std::vector<unsigned char> &vchVote)
+{
+    LogPrint("zmq", "zmq: Publish rawproposalvote %s\n", hash.GetHex());
+    return SendMessage(MSG_RAWPROPOSALVOTE, vchVote.data(), vchVote.size());
 }
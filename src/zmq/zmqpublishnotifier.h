@@ -31,37 +31,65 @@ public:
 class CZMQPublishHashBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlock(const uint256 &hash, const std::vector<unsigned char> &vchBlock);
 };
 
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NotifyTransactions(const std::vector<uint256> &vHashes, const std::vector<unsigned char> &vchTransactions);
 };
 
 class CZMQPublishHashTransactionLockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransactionLock(const CTransaction &transaction);
+    bool NotifyTransactionLock(const uint256 &hash, const std::vector<unsigned char> &vchTransaction);
 };
 
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NeedsRawBlock() const { return true; }
+    bool NotifyBlock(const uint256 &hash, const std::vector<unsigned char> &vchBlock);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction);
+    bool NeedsRawTransaction() const { return true; }
+    bool NotifyTransactions(const std::vector<uint256> &vHashes, const std::vector<unsigned char> &vchTransactions);
 };
 
 class CZMQPublishRawTransactionLockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransactionLock(const CTransaction &transaction);
+    bool NeedsRawTransaction() const { return true; }
+    bool NotifyTransactionLock(const uint256 &hash, const std::vector<unsigned char> &vchTransaction);
+};
+
+class CZMQPublishRewardBlockNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyRewardBlock(const uint256 &hash, CAmount nPaid);
+};
+
+class CZMQPublishSmartnodeListNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifySmartnodeList(int nCount, bool fAdded, bool fRemoved);
+};
+
+class CZMQPublishHashProposalVoteNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyProposalVote(const uint256 &hash, const std::vector<unsigned char> &vchVote);
+};
+
+class CZMQPublishRawProposalVoteNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NeedsRawProposalVote() const { return true; }
+    bool NotifyProposalVote(const uint256 &hash, const std::vector<unsigned char> &vchVote);
 };
 
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
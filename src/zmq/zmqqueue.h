@@ -0,0 +1,80 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_ZMQ_ZMQQUEUE_H
+#define SMARTCASH_ZMQ_ZMQQUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <utility>
+
+/**
+ * Unbounded multi producer single consumer queue, Vyukov's MPSC node queue.
+ *
+ * Push doesn't take a lock and can be called from any thread, Pop only from the
+ * one consumer. A Pop right after a Push of another thread can still find the
+ * queue empty for the moment the producer needs to link its node, Size() does
+ * count it already.
+ */
+template <typename T>
+class CZMQQueue
+{
+private:
+    struct Node
+    {
+        std::atomic<Node*> next;
+        T value;
+
+        Node() : next(nullptr) {}
+        explicit Node(const T& valueIn) : next(nullptr), value(valueIn) {}
+    };
+
+    //! The last pushed node, swapped by the producers
+    std::atomic<Node*> head;
+    //! The node before the next one to pop, only touched by the consumer
+    Node* tail;
+    std::atomic<size_t> nSize;
+
+public:
+    CZMQQueue() : head(new Node()), nSize(0)
+    {
+        tail = head.load();
+    }
+
+    ~CZMQQueue()
+    {
+        T value;
+        while (Pop(value)) {}
+        delete tail;
+    }
+
+    CZMQQueue(const CZMQQueue&) = delete;
+    CZMQQueue& operator=(const CZMQQueue&) = delete;
+
+    void Push(const T& value)
+    {
+        Node* node = new Node(value);
+        nSize.fetch_add(1);
+        Node* prev = head.exchange(node);
+        prev->next.store(node);
+    }
+
+    bool Pop(T& value)
+    {
+        Node* next = tail->next.load();
+        if (!next)
+            return false;
+
+        // The popped node becomes the new tail, its value is moved out already
+        value = std::move(next->value);
+        delete tail;
+        tail = next;
+        nSize.fetch_sub(1);
+        return true;
+    }
+
+    size_t Size() const { return nSize.load(); }
+};
+
+#endif // SMARTCASH_ZMQ_ZMQQUEUE_H
@@ -0,0 +1,70 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zmq/zmqrpc.h"
+
+#include "rpc/server.h"
+#include "utilstrencodings.h"
+#include "zmq/zmqnotificationinterface.h"
+
+#include <univalue.h>
+
+using namespace std;
+
+UniValue getzmqnotifications(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getzmqnotifications\n"
+            "\nReturns information about the active ZeroMQ notifications and their queue.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"notifications\": [\n"
+            "    {\n"
+            "      \"type\": \"pubhashtx\",          (string) Type of notification\n"
+            "      \"address\": \"...\",             (string) Address of the publisher\n"
+            "      \"hwm\": n                      (numeric) Outbound message high water mark of the socket\n"
+            "    },\n"
+            "    ...\n"
+            "  ],\n"
+            "  \"queued\": n,                      (numeric) Notifications waiting to be published\n"
+            "  \"queuesize\": n,                   (numeric) Queued notifications from which on new ones get dropped, 0 for no limit\n"
+            "  \"dropped\": n,                     (numeric) Notifications dropped since the start because of a full queue\n"
+            "  \"txbatch\": n                      (numeric) Transactions published per hashtx or rawtx message at most\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getzmqnotifications", "")
+            + HelpExampleRpc("getzmqnotifications", "")
+        );
+
+    UniValue result(UniValue::VOBJ);
+    UniValue notifications(UniValue::VARR);
+    if (pzmqNotificationInterface) {
+        for (const CZMQNotificationInterface::CNotifierStatus& status : pzmqNotificationInterface->GetNotifiers()) {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("type", status.type));
+            obj.push_back(Pair("address", status.address));
+            obj.push_back(Pair("hwm", status.nHighWaterMark));
+            notifications.push_back(obj);
+        }
+    }
+    result.push_back(Pair("notifications", notifications));
+    result.push_back(Pair("queued", pzmqNotificationInterface ? (uint64_t)pzmqNotificationInterface->GetQueued() : 0));
+    result.push_back(Pair("queuesize", pzmqNotificationInterface ? (uint64_t)pzmqNotificationInterface->GetMaxQueued() : 0));
+    result.push_back(Pair("dropped", pzmqNotificationInterface ? pzmqNotificationInterface->GetDropped() : 0));
+    result.push_back(Pair("txbatch", pzmqNotificationInterface ? (uint64_t)pzmqNotificationInterface->GetTxBatch() : 0));
+    return result;
+}
+
+static const CRPCCommand commands[] =
+{ //  category              name                      actor (function)         okSafeMode  readOnly
+  //  --------------------- ------------------------  -----------------------  ----------  --------
+    { "zmq",                "getzmqnotifications",    &getzmqnotifications,    true,       true  },
+};
+
+void RegisterZMQRPCCommands(CRPCTable &tableRPC)
+{
+    for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++)
+        tableRPC.appendCommand(commands[vcidx].name, &commands[vcidx]);
+}
@@ -0,0 +1,13 @@
+// Copyright (c) 2017 - 2021 - The SmartCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef SMARTCASH_ZMQ_ZMQRPC_H
+#define SMARTCASH_ZMQ_ZMQRPC_H
+
+class CRPCTable;
+
+/** Register the ZMQ RPC commands, they are in the ZMQ library which the server library doesn't link */
+void RegisterZMQRPCCommands(CRPCTable &tableRPC);
+
+#endif // SMARTCASH_ZMQ_ZMQRPC_H